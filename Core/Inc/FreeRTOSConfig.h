@@ -51,24 +51,54 @@
 #if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
   #include <stdint.h>
   extern uint32_t SystemCoreClock;
+/* USER CODE BEGIN 0 */
+  extern void configureTimerForRunTimeStats(void);
+  extern unsigned long getRunTimeCounterValue(void);
+  extern void Crash_Assert(uint32_t line);
+  extern void Crash_TaskCreated(void* task);
+  extern void Crash_TaskDeleted(void* task);
+  extern void Trace_KernelSwitchedIn(uint32_t task, uint32_t priority);
+  extern void Trace_KernelSwitchedOut(uint32_t task, uint32_t priority);
+  extern void Trace_KernelIsrEnter(void);
+  extern void Trace_KernelIsrExit(void);
+  extern void Trace_KernelBlockedReceive(const void* object);
+  extern void Trace_KernelBlockedSend(const void* object);
+  extern void Trace_KernelBlockedNotify(void);
+  extern void Trace_KernelInherit(uint32_t task, uint32_t priority);
+  extern void Trace_KernelDisinherit(uint32_t task, uint32_t priority);
+  extern void Queues_KernelSent(const void* object);
+  extern void Queues_KernelSentFromIsr(const void* object);
+  extern void Queues_KernelSendFailed(const void* object);
+  extern void Queues_KernelSendFailedFromIsr(const void* object);
+  extern void Queues_KernelStreamSent(const void* object, uint32_t sent, uint32_t length);
+  extern void Queues_KernelStreamSentFromIsr(const void* object, uint32_t sent, uint32_t length);
+  extern void Queues_KernelReceived(const void* object);
+  extern void Queues_KernelReceiveFailed(const void* object);
+  extern void Queues_KernelBlockedSend(const void* object);
+  extern void Queues_KernelBlockedReceive(const void* object);
+/* USER CODE END 0 */
 #endif
-#define configENABLE_FPU                         0
+#define configENABLE_FPU                         1
 #define configENABLE_MPU                         0
 
 #define configUSE_PREEMPTION                     1
 #define configSUPPORT_STATIC_ALLOCATION          1
 #define configSUPPORT_DYNAMIC_ALLOCATION         1
-#define configUSE_IDLE_HOOK                      0
-#define configUSE_TICK_HOOK                      0
+#define configUSE_IDLE_HOOK                      1
+#define configUSE_TICK_HOOK                      1
+#define configCHECK_FOR_STACK_OVERFLOW           2
 #define configCPU_CLOCK_HZ                       ( SystemCoreClock )
 #define configTICK_RATE_HZ                       ((TickType_t)1000)
 #define configMAX_PRIORITIES                     ( 7 )
 #define configMINIMAL_STACK_SIZE                 ((uint16_t)128)
-#define configTOTAL_HEAP_SIZE                    ((size_t)8192)
+#define configTOTAL_HEAP_SIZE                    ((size_t)512)
 #define configMAX_TASK_NAME_LEN                  ( 16 )
 #define configUSE_16_BIT_TICKS                   0
 #define configUSE_MUTEXES                        1
 #define configQUEUE_REGISTRY_SIZE                8
+#define configUSE_TRACE_FACILITY                 1
+#define configGENERATE_RUN_TIME_STATS            1
+#define configUSE_TICKLESS_IDLE                  2
 #define configUSE_PORT_OPTIMISED_TASK_SELECTION  1
 /* USER CODE BEGIN MESSAGE_BUFFER_LENGTH_TYPE */
 /* Defaults to size_t for backward compatibility, but can be changed
@@ -76,15 +106,16 @@
 #define configMESSAGE_BUFFER_LENGTH_TYPE         size_t
 /* USER CODE END MESSAGE_BUFFER_LENGTH_TYPE */
 
+/* Definitions needed when configGENERATE_RUN_TIME_STATS is on */
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS configureTimerForRunTimeStats
+#define portGET_RUN_TIME_COUNTER_VALUE getRunTimeCounterValue
+
 /* Co-routine definitions. */
 #define configUSE_CO_ROUTINES                    0
 #define configMAX_CO_ROUTINE_PRIORITIES          ( 2 )
 
 /* Software timer definitions. */
-#define configUSE_TIMERS                         1
-#define configTIMER_TASK_PRIORITY                ( 2 )
-#define configTIMER_QUEUE_LENGTH                 10
-#define configTIMER_TASK_STACK_DEPTH             256
+#define configUSE_TIMERS                         0
 
 /* The following flag must be enabled only when using newlib */
 #define configUSE_NEWLIB_REENTRANT          1
@@ -99,6 +130,8 @@ to exclude the API function. */
 #define INCLUDE_vTaskDelayUntil              0
 #define INCLUDE_vTaskDelay                   1
 #define INCLUDE_xTaskGetSchedulerState       1
+#define INCLUDE_uxTaskGetStackHighWaterMark  1
+#define INCLUDE_xTaskGetCurrentTaskHandle    1
 
 /* Cortex-M specific definitions. */
 #ifdef __NVIC_PRIO_BITS
@@ -128,7 +161,8 @@ See http://www.FreeRTOS.org/RTOS-Cortex-M3-M4.html. */
 /* Normal assert() semantics without relying on the provision of an assert.h
 header file. */
 /* USER CODE BEGIN 1 */
-#define configASSERT( x ) if ((x) == 0) {taskDISABLE_INTERRUPTS(); for( ;; );}
+/* Records a crash report (app_crash.c) and resets */
+#define configASSERT( x ) if ((x) == 0) {Crash_Assert(__LINE__);}
 /* USER CODE END 1 */
 
 /* Definitions that map the FreeRTOS port interrupt handlers to their CMSIS
@@ -143,6 +177,43 @@ standard names. */
 
 /* USER CODE BEGIN Defines */
 /* Section where parameter definitions can be added (for instance, to override default ones in FreeRTOS.h) */
+/* Task list of the crash report, kept as tasks come and go */
+#define traceTASK_CREATE( pxNewTCB )        Crash_TaskCreated( pxNewTCB )
+#define traceTASK_DELETE( pxTaskToDelete )  Crash_TaskDeleted( pxTaskToDelete )
+/* Scheduler trace (app_trace.c), recorded while system/kernel_trace has it on.
+ * Tasks are traced by the number uxTaskGetSystemState reports for them. */
+#define traceTASK_SWITCHED_IN()             Trace_KernelSwitchedIn( pxCurrentTCB->uxTCBNumber, pxCurrentTCB->uxPriority )
+#define traceTASK_SWITCHED_OUT()            Trace_KernelSwitchedOut( pxCurrentTCB->uxTCBNumber, pxCurrentTCB->uxPriority )
+#define traceBLOCKING_ON_QUEUE_RECEIVE( pxQueue )  \
+  do { Trace_KernelBlockedReceive( pxQueue ); Queues_KernelBlockedReceive( pxQueue ); } while( 0 )
+#define traceBLOCKING_ON_QUEUE_SEND( pxQueue )  \
+  do { Trace_KernelBlockedSend( pxQueue ); Queues_KernelBlockedSend( pxQueue ); } while( 0 )
+#define traceBLOCKING_ON_STREAM_BUFFER_RECEIVE( xStreamBuffer )  Trace_KernelBlockedReceive( xStreamBuffer )
+#define traceBLOCKING_ON_STREAM_BUFFER_SEND( xStreamBuffer )  \
+  do { Trace_KernelBlockedSend( xStreamBuffer ); Queues_KernelBlockedSend( xStreamBuffer ); } while( 0 )
+#define traceTASK_NOTIFY_TAKE_BLOCK()       Trace_KernelBlockedNotify()
+#define traceTASK_NOTIFY_WAIT_BLOCK()       Trace_KernelBlockedNotify()
+#define traceTASK_PRIORITY_INHERIT( pxTCBOfMutexHolder, uxInheritedPriority )  \
+  Trace_KernelInherit( ( pxTCBOfMutexHolder )->uxTCBNumber, uxInheritedPriority )
+#define traceTASK_PRIORITY_DISINHERIT( pxTCBOfMutexHolder, uxOriginalPriority )  \
+  Trace_KernelDisinherit( ( pxTCBOfMutexHolder )->uxTCBNumber, uxOriginalPriority )
+/* Queue, stream buffer and mutex figures (app_queues.c) of the registered
+ * objects. The stream buffer send hooks expand in the two send functions,
+ * where xDataLengthBytes is the length asked for. */
+#define traceQUEUE_SEND( pxQueue )                    Queues_KernelSent( pxQueue )
+#define traceQUEUE_SEND_FROM_ISR( pxQueue )           Queues_KernelSentFromIsr( pxQueue )
+#define traceQUEUE_SEND_FAILED( pxQueue )             Queues_KernelSendFailed( pxQueue )
+#define traceQUEUE_SEND_FROM_ISR_FAILED( pxQueue )    Queues_KernelSendFailedFromIsr( pxQueue )
+#define traceQUEUE_RECEIVE( pxQueue )                 Queues_KernelReceived( pxQueue )
+#define traceQUEUE_RECEIVE_FAILED( pxQueue )          Queues_KernelReceiveFailed( pxQueue )
+#define traceSTREAM_BUFFER_SEND( xStreamBuffer, xReturn )  \
+  Queues_KernelStreamSent( xStreamBuffer, ( uint32_t ) ( xReturn ), ( uint32_t ) xDataLengthBytes )
+#define traceSTREAM_BUFFER_SEND_FROM_ISR( xStreamBuffer, xReturn )  \
+  Queues_KernelStreamSentFromIsr( xStreamBuffer, ( uint32_t ) ( xReturn ), ( uint32_t ) xDataLengthBytes )
+#define traceSTREAM_BUFFER_SEND_FAILED( xStreamBuffer )    Queues_KernelSendFailed( xStreamBuffer )
+/* Not kernel hooks: the interrupt handlers (stm32l4xx_it.c) call them */
+#define traceISR_ENTER()                    Trace_KernelIsrEnter()
+#define traceISR_EXIT()                     Trace_KernelIsrExit()
 /* USER CODE END Defines */
 
 #endif /* FREERTOS_CONFIG_H */
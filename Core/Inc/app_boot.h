@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file    app_boot.h
+  * @brief   Header for app_boot.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_BOOT_H
+#define __APP_BOOT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  BOOT_STAGE_OUTPUTS_SAFE = 0,      /* PWM outputs running at 0% */
+  BOOT_STAGE_SCHEDULER,             /* First task running */
+  BOOT_STAGE_SERIAL,                /* Commands are being received */
+  BOOT_STAGE_ANALOG,                /* Sensor sampling started */
+  BOOT_STAGE_DATA_STORE,            /* Stored configuration and error log found */
+  BOOT_STAGE_COORDINATOR,           /* Light commands accepted */
+  BOOT_STAGE_READY,                 /* Start-up complete */
+  BOOT_STAGE_COUNT
+} Boot_Stage_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Record that a start-up stage has completed
+ * @param stage Stage that completed
+ * @return None
+ */
+void Boot_Mark(Boot_Stage_t stage);
+
+/**
+ * @brief Get the time at which a start-up stage completed
+ * @param stage Stage to query
+ * @param time_us Pointer to store the microseconds since the clock was configured
+ * @return VAL_Status VAL_OK if the stage completed, VAL_ERROR if not yet,
+ *         VAL_PARAM if invalid
+ */
+VAL_Status Boot_GetTime(Boot_Stage_t stage, uint32_t* time_us);
+
+/**
+ * @brief Get the name of a start-up stage as reported to the host
+ * @param stage Stage to query
+ * @return const char* Stage name, "unknown" for invalid stages
+ */
+const char* Boot_GetName(Boot_Stage_t stage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_BOOT_H */
@@ -0,0 +1,192 @@
+/**
+  ******************************************************************************
+  * @file    app_cbor.h
+  * @brief   Header for app_cbor.c module
+  ******************************************************************************
+  * @attention
+  *
+  * Minimal CBOR (RFC 8949) reader and writer over caller provided buffers.
+  * Nothing is allocated. The reader returns one data item at a time and
+  * leaves the nesting to the caller; the writer opens maps and arrays with
+  * indefinite length, so a message is written in one pass without knowing
+  * its element counts. As with JSON_Writer_t, a write that does not fit
+  * sets the overflow flag and every later write is ignored.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_CBOR_H
+#define __APP_CBOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Exported types ------------------------------------------------------------*/
+/* Data items as seen by the reader */
+typedef enum {
+  CBOR_ITEM_UINT = 0,         /* value */
+  CBOR_ITEM_NINT,             /* -1 - value */
+  CBOR_ITEM_BYTES,            /* value bytes at data */
+  CBOR_ITEM_TEXT,             /* value bytes of UTF-8 at data, not terminated */
+  CBOR_ITEM_ARRAY,            /* value items follow, or up to a break */
+  CBOR_ITEM_MAP,              /* value key/value pairs follow, or up to a break */
+  CBOR_ITEM_TAG,              /* Tag value on the next item */
+  CBOR_ITEM_FALSE,
+  CBOR_ITEM_TRUE,
+  CBOR_ITEM_NULL,
+  CBOR_ITEM_FLOAT,            /* number, from a half, single or double */
+  CBOR_ITEM_BREAK             /* End of an indefinite array or map */
+} CBOR_Item_Type_t;
+
+typedef struct {
+  CBOR_Item_Type_t type;
+  uint64_t value;             /* Argument: integer, length or count */
+  bool indefinite;            /* Array or map closed by a break */
+  const uint8_t* data;        /* String bytes, inside the reader's buffer */
+  float number;
+} CBOR_Item_t;
+
+typedef struct {
+  const uint8_t* data;
+  size_t length;
+  size_t pos;                 /* Offset of the next item */
+} CBOR_Reader_t;
+
+typedef struct {
+  uint8_t* buffer;
+  size_t size;
+  size_t length;              /* Bytes written so far */
+  bool overflow;              /* A write did not fit, the message is incomplete */
+} CBOR_Writer_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Start reading items from a buffer
+ * @param reader Reader to initialize
+ * @param data Encoded items
+ * @param length Number of bytes
+ * @return None
+ */
+void CBOR_Reader_Init(CBOR_Reader_t* reader, const uint8_t* data, size_t length);
+
+/**
+ * @brief Read the next data item
+ * @note  Indefinite length strings, undefined and the other simple values
+ *        are refused.
+ * @param reader Reader
+ * @param item Item to fill
+ * @return bool false at the end of the buffer or on a malformed item
+ */
+bool CBOR_Reader_Next(CBOR_Reader_t* reader, CBOR_Item_t* item);
+
+/**
+ * @brief Check whether every byte of the buffer was read
+ * @param reader Reader
+ * @return bool true at the end of the buffer
+ */
+bool CBOR_Reader_AtEnd(const CBOR_Reader_t* reader);
+
+/**
+ * @brief Start writing into a buffer
+ * @param writer Writer to initialize
+ * @param buffer Destination buffer
+ * @param size Size of the destination buffer
+ * @return None
+ */
+void CBOR_Writer_Init(CBOR_Writer_t* writer, uint8_t* buffer, size_t size);
+
+/**
+ * @brief Append an unsigned integer, in the shortest form
+ * @param writer Writer
+ * @param value Value to append
+ * @return None
+ */
+void CBOR_Writer_Uint(CBOR_Writer_t* writer, uint64_t value);
+
+/**
+ * @brief Append a signed integer, in the shortest form
+ * @param writer Writer
+ * @param value Value to append
+ * @return None
+ */
+void CBOR_Writer_Int(CBOR_Writer_t* writer, int64_t value);
+
+/**
+ * @brief Append a text string
+ * @param writer Writer
+ * @param text UTF-8 text, not necessarily terminated
+ * @param length Number of bytes
+ * @return None
+ */
+void CBOR_Writer_Text(CBOR_Writer_t* writer, const char* text, size_t length);
+
+/**
+ * @brief Append a number as a half float if that is exact, else a single
+ * @param writer Writer
+ * @param value Value to append
+ * @return None
+ */
+void CBOR_Writer_Float(CBOR_Writer_t* writer, float value);
+
+/**
+ * @brief Append true or false
+ * @param writer Writer
+ * @param value Value to append
+ * @return None
+ */
+void CBOR_Writer_Bool(CBOR_Writer_t* writer, bool value);
+
+/**
+ * @brief Append null
+ * @param writer Writer
+ * @return None
+ */
+void CBOR_Writer_Null(CBOR_Writer_t* writer);
+
+/**
+ * @brief Open a map of indefinite length, closed by CBOR_Writer_End
+ * @param writer Writer
+ * @return None
+ */
+void CBOR_Writer_BeginMap(CBOR_Writer_t* writer);
+
+/**
+ * @brief Open an array of indefinite length, closed by CBOR_Writer_End
+ * @param writer Writer
+ * @return None
+ */
+void CBOR_Writer_BeginArray(CBOR_Writer_t* writer);
+
+/**
+ * @brief Close the innermost open map or array
+ * @param writer Writer
+ * @return None
+ */
+void CBOR_Writer_End(CBOR_Writer_t* writer);
+
+/**
+ * @brief Re-encode a JSON text as CBOR
+ * @note  Objects and arrays become indefinite maps and arrays, integers
+ *        CBOR integers and numbers with decimals floats. The destination
+ *        may overlap the text as long as it does not start after it: every
+ *        item is written over bytes already read, or the call fails.
+ * @param dest Destination buffer
+ * @param size Size of the destination buffer
+ * @param json JSON text, one value, as formatted by JSON_Writer_t
+ * @param length Text length
+ * @return size_t Encoded length, 0 if it does not fit or the text is malformed
+ */
+size_t CBOR_FromJson(uint8_t* dest, size_t size, const char* json, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_CBOR_H */
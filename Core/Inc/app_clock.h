@@ -0,0 +1,69 @@
+/**
+  ******************************************************************************
+  * @file    app_clock.h
+  * @brief   Header for app_clock.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_CLOCK_H
+#define __APP_CLOCK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define CLOCK_STEP_MS        1000                 /* Larger offsets set the clock rather than shift it */
+#define CLOCK_RTT_MAX_MS     250                  /* Samples with a longer round trip are not used */
+#define CLOCK_DRIFT_MIN_MS   (15U * 60U * 1000U)  /* Shortest interval a rate estimate is taken over */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  int32_t offset_ms;         /* Host minus device time before the correction, clamped */
+  bool used;                 /* false if the round trip was too long to use the sample */
+  bool stepped;              /* The clock was set rather than shifted */
+  bool trimmed;              /* The rate trim was updated */
+  int32_t calibration_ppb;   /* Rate trim in effect afterwards, positive if faster */
+} Clock_SyncResult_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Get the wall-clock time
+ * @note  Safe to call from interrupts
+ * @return uint64_t Milliseconds since 1970-01-01 UTC, 0 if the clock was never set
+ */
+uint64_t Clock_GetTime(void);
+
+/**
+ * @brief Get the wall-clock time of an earlier moment
+ * @note  Safe to call from interrupts
+ * @param age_ms Time since the moment in milliseconds
+ * @return uint64_t Milliseconds since 1970-01-01 UTC, 0 if the clock was never set
+ */
+uint64_t Clock_GetTimeBefore(uint32_t age_ms);
+
+/**
+ * @brief Correct the clock from a host time sample
+ * @note  Communications task only. The host sends its time when it sends the
+ *        request and the round trip it measured on the previous one; half of
+ *        that is taken as the transit time.
+ * @param host_ms Host time when the request was sent, milliseconds since 1970-01-01 UTC
+ * @param rtt_ms Round trip of the previous sync in milliseconds, 0 if unknown
+ * @param result Pointer to store what was done
+ * @return VAL_Status VAL_OK if the sample was taken or skipped, VAL_BUSY while the
+ *         previous correction is pending, VAL_PARAM if the time is out of range,
+ *         VAL_ERROR if the RTC could not be set
+ */
+VAL_Status Clock_Sync(uint64_t host_ms, uint32_t rtt_ms, Clock_SyncResult_t* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_CLOCK_H */
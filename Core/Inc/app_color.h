@@ -0,0 +1,89 @@
+/**
+  ******************************************************************************
+  * @file    app_color.h
+  * @brief   Header for app_color.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_COLOR_H
+#define __APP_COLOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+#include "val_channels.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define COLOR_XY_UNIT       10000U   /* Chromaticity coordinates in 1/10000 */
+#define COLOR_CCT_MIN_K     1667U    /* Colour temperature range of Color_MixCct */
+#define COLOR_CCT_MAX_K     25000U
+#define COLOR_TINT_MAX      500      /* Largest distance from the Planckian locus, Duv in 1/10000 */
+
+/* Exported types ------------------------------------------------------------*/
+/* Calibrated colour of one light at full output */
+typedef struct {
+  uint16_t x;                 /* CIE 1931 chromaticity, 1/10000 */
+  uint16_t y;
+  uint16_t flux_lm;           /* Luminous flux at full duty cycle */
+} Color_Primary_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Load the board defaults from the channel table
+ * @return VAL_Status VAL_OK; VAL_ERROR if the defaults span no gamut
+ */
+VAL_Status Color_Init(void);
+
+/**
+ * @brief Replace the primaries and the mixing matrix built from them
+ * @note  Any task. The matrix is built in floating point once here, mixing
+ *        then runs in fixed point only.
+ * @param primaries_in Primary per light, VAL_LIGHT_COUNT entries
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if a primary is out of
+ *         range or the primaries span no gamut; the previous ones stay then
+ */
+VAL_Status Color_SetPrimaries(const Color_Primary_t* primaries_in);
+
+/**
+ * @brief Get the primaries in use
+ * @param primaries_out Array to store the primaries (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if primaries_out is NULL
+ */
+VAL_Status Color_GetPrimaries(Color_Primary_t* primaries_out);
+
+/**
+ * @brief Compute the intensities mixing a chromaticity
+ * @note  Any context. The brightest mix of the colour is scaled to the
+ *        given level; intensities follow each light's output curve.
+ * @param x CIE 1931 x in 1/10000
+ * @param y CIE 1931 y in 1/10000
+ * @param permille Brightness as a fraction of the brightest mix (0-1000)
+ * @param intensities Array to store the intensity per light (0-1000)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if the colour is out of
+ *         the gamut of the primaries
+ */
+VAL_Status Color_MixXy(uint16_t x, uint16_t y, uint16_t permille, uint16_t* intensities);
+
+/**
+ * @brief Compute the intensities mixing a white of a colour temperature
+ * @note  Any context, as Color_MixXy
+ * @param cct_k Correlated colour temperature (COLOR_CCT_MIN_K-COLOR_CCT_MAX_K)
+ * @param tint Distance from the Planckian locus, Duv in 1/10000, positive
+ *        towards green (-COLOR_TINT_MAX to COLOR_TINT_MAX)
+ * @param permille Brightness as a fraction of the brightest mix (0-1000)
+ * @param intensities Array to store the intensity per light (0-1000)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if out of range or out
+ *         of the gamut of the primaries
+ */
+VAL_Status Color_MixCct(uint16_t cct_k, int16_t tint, uint16_t permille, uint16_t* intensities);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_COLOR_H */
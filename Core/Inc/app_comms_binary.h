@@ -0,0 +1,1231 @@
+/**
+  ******************************************************************************
+  * @file    app_comms_binary.h
+  * @brief   Header for app_comms_binary.c module
+  ******************************************************************************
+  * @attention
+  *
+  * Binary frame layout, before COBS encoding:
+  *
+  *   type (1) | seq (1) | code (1) | body (0..n) | CRC16 (2)
+  *
+  * - type: COMMS_BIN_TYPE_*
+  * - seq:  Chosen by the host for commands, echoed in the response
+  * - code: Topic in the high nibble, action in the low nibble (COMMS_BIN_CODE)
+  * - CRC16-CCITT (poly 0x1021, init 0xFFFF) over type..body, little endian
+  *
+  * The encoded frame is sent between two 0x00 delimiters. Consecutive frames
+  * may share a delimiter. All multi-byte fields are little endian.
+  *
+  * Responses start their body with a status byte (VAL_Status value).
+  *
+  * On a link shared by several devices a command is sent as
+  * COMMS_BIN_TYPE_ADDR_CMD, with the device address right after the type:
+  *
+  *   type (1) | addr (1) | seq (1) | code (1) | body (0..n) | CRC16 (2)
+  *
+  * Only the device with that address answers. COMMS_ADDRESS_BROADCAST runs
+  * the command on every device and none of them answers, and so does a
+  * multicast group address on the devices that joined it
+  * (config/set_groups). The response has the usual layout.
+  *
+  * With COMMS_BIN_TYPE_NOACK added to either command type, e.g. for a fast
+  * sweep of light/set, the command is only answered if it fails; the
+  * failure response is the usual one, matched to the command by its seq.
+  *
+  * A COMMS_BIN_SYSTEM_BATCH command carries several commands, each as
+  * code (1) | length (1) | arguments (length). Each command is answered with
+  * its own response frame; all of them are sent together.
+  *
+  * A COMMS_BIN_TYPE_CBOR frame carries a JSON message in CBOR instead: its
+  * body is one map with the keys of the JSON command (topic, action, id,
+  * data, ...), seq is echoed and code is 0. A host sending CBOR commands
+  * gets its responses, and the JSON events, as CBOR frames too; objects are
+  * maps, integers CBOR integers and decimals half or single floats.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_COMMS_BINARY_H
+#define __APP_COMMS_BINARY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define COMMS_BIN_DELIMITER           0x00U
+#define COMMS_BIN_CRC16_INIT          0xFFFFU
+
+/* Message types */
+#define COMMS_BIN_TYPE_CMD            0x01U
+#define COMMS_BIN_TYPE_RESP           0x02U
+#define COMMS_BIN_TYPE_EVENT          0x03U
+#define COMMS_BIN_TYPE_ADDR_CMD       0x04U  /* Command for one device address */
+#define COMMS_BIN_TYPE_CBOR           0x05U  /* JSON message model encoded in CBOR */
+#define COMMS_BIN_TYPE_NOACK          0x80U  /* Flag on a command type: answer failures only */
+
+/* Device address of a command for all devices, which do not respond */
+#define COMMS_ADDRESS_BROADCAST       0xFFU
+
+/* Multicast group addresses below the broadcast one, group 1 first; the
+ * devices that joined a group run its commands without responding */
+#define COMMS_ADDRESS_GROUP_FIRST     0xF0U
+#define COMMS_ADDRESS_GROUPS          15U
+
+/* Topics */
+#define COMMS_BIN_TOPIC_SYSTEM        0x1U
+#define COMMS_BIN_TOPIC_LIGHT         0x2U
+#define COMMS_BIN_TOPIC_STATUS        0x3U
+#define COMMS_BIN_TOPIC_ALARM         0x4U
+#define COMMS_BIN_TOPIC_TELEMETRY     0x5U
+#define COMMS_BIN_TOPIC_CONFIG        0x6U
+#define COMMS_BIN_TOPIC_CAPTURE       0x7U
+#define COMMS_BIN_TOPIC_SCENE         0x8U
+#define COMMS_BIN_TOPIC_SEQUENCE      0x9U
+#define COMMS_BIN_TOPIC_STROBE        0xAU
+#define COMMS_BIN_TOPIC_DMX           0xBU
+#define COMMS_BIN_TOPIC_UPDATE        0xCU  /* Firmware updater only */
+#define COMMS_BIN_TOPIC_BENCH         0xDU  /* Benchmark builds, or COMMS_LINK_BENCH */
+#define COMMS_BIN_TOPIC_RULES         0xEU
+#define COMMS_BIN_TOPIC_DIAG          0xFU
+
+#define COMMS_BIN_CODE(topic, action) ((uint8_t)(((topic) << 4) | (action)))
+
+/* Command codes, same semantics as the JSON topic/action pairs */
+#define COMMS_BIN_SYSTEM_PING         COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0x1U)
+#define COMMS_BIN_SYSTEM_PERF         COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0x2U)
+#define COMMS_BIN_SYSTEM_SET_BAUD     COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0x3U)
+#define COMMS_BIN_SYSTEM_BATCH        COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0x4U)
+#define COMMS_BIN_SYSTEM_BOOT_TIME    COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0x5U)
+#define COMMS_BIN_SYSTEM_RESOURCES    COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0x6U)
+#define COMMS_BIN_SYSTEM_CPU          COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0x7U)
+#define COMMS_BIN_SYSTEM_INJECT_FAULT COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0x8U)  /* Benchmark builds */
+#define COMMS_BIN_SYSTEM_TRACE        COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0x9U)
+#define COMMS_BIN_SYSTEM_LOG_LEVEL    COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0xAU)
+#define COMMS_BIN_SYSTEM_LOG          COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0xBU)  /* Event */
+#define COMMS_BIN_SYSTEM_LINK         COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0xCU)
+#define COMMS_BIN_SYSTEM_SELFTEST     COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0xDU)
+#define COMMS_BIN_SYSTEM_IRQ_LATENCY  COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0xEU)  /* Benchmark builds */
+#define COMMS_BIN_SYSTEM_DEADLINES    COMMS_BIN_CODE(COMMS_BIN_TOPIC_SYSTEM, 0xFU)
+#define COMMS_BIN_LIGHT_GET           COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0x1U)
+#define COMMS_BIN_LIGHT_GET_ALL       COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0x2U)
+#define COMMS_BIN_LIGHT_SET           COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0x3U)
+#define COMMS_BIN_LIGHT_SET_ALL       COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0x4U)
+#define COMMS_BIN_LIGHT_GET_PERMILLE  COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0x5U)
+#define COMMS_BIN_LIGHT_GET_ALL_PERMILLE COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0x6U)
+#define COMMS_BIN_LIGHT_SET_PERMILLE  COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0x7U)
+#define COMMS_BIN_LIGHT_SET_ALL_PERMILLE COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0x8U)
+#define COMMS_BIN_LIGHT_FADE          COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0x9U)
+#define COMMS_BIN_LIGHT_SET_CURVE     COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0xAU)
+#define COMMS_BIN_LIGHT_SET_CURRENT   COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0xBU)
+#define COMMS_BIN_LIGHT_STAGE         COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0xCU)
+#define COMMS_BIN_LIGHT_COMMIT        COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0xDU)
+#define COMMS_BIN_LIGHT_SET_MASK      COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0xEU)
+#define COMMS_BIN_LIGHT_SET_PWM_FREQ  COMMS_BIN_CODE(COMMS_BIN_TOPIC_LIGHT, 0xFU)
+#define COMMS_BIN_STATUS_GET_SENSORS  COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0x1U)
+#define COMMS_BIN_STATUS_GET_ALL_SENSORS COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0x2U)
+#define COMMS_BIN_SYSTEM_GET_STATE    COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0x3U)  /* system/get_state */
+#define COMMS_BIN_STATUS_GET_STATS    COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0x4U)
+#define COMMS_BIN_STATUS_SET_STATS_WINDOW COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0x5U)
+#define COMMS_BIN_STATUS_GET_USAGE    COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0x6U)
+#define COMMS_BIN_SYSTEM_CRASH_REPORT COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0x7U)  /* system/crash_report */
+#define COMMS_BIN_SYSTEM_TIME_SYNC    COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0x8U)  /* system/time_sync */
+#define COMMS_BIN_SYSTEM_UPDATE       COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0x9U)  /* system/update */
+#define COMMS_BIN_SYSTEM_CAPABILITIES COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0xAU)  /* system/capabilities */
+#define COMMS_BIN_STATUS_GET_FLICKER  COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0xBU)
+#define COMMS_BIN_SYSTEM_KERNEL_TRACE COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0xCU)  /* system/kernel_trace */
+#define COMMS_BIN_SYSTEM_LATENCY      COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0xDU)  /* system/latency */
+#define COMMS_BIN_SYSTEM_LOOP_TIMING  COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0xEU)  /* system/loop_timing */
+#define COMMS_BIN_STATUS_BLOCK_SCANS  COMMS_BIN_CODE(COMMS_BIN_TOPIC_STATUS, 0xFU)
+#define COMMS_BIN_ALARM_CLEAR         COMMS_BIN_CODE(COMMS_BIN_TOPIC_ALARM, 0x1U)
+#define COMMS_BIN_ALARM_STATUS        COMMS_BIN_CODE(COMMS_BIN_TOPIC_ALARM, 0x2U)
+#define COMMS_BIN_ALARM_TRIGGERED     COMMS_BIN_CODE(COMMS_BIN_TOPIC_ALARM, 0x3U)
+#define COMMS_BIN_ALARM_THERMAL_WARNING COMMS_BIN_CODE(COMMS_BIN_TOPIC_ALARM, 0x4U)
+#define COMMS_BIN_ALARM_FAILSAFE      COMMS_BIN_CODE(COMMS_BIN_TOPIC_ALARM, 0x5U)  /* Event */
+#define COMMS_BIN_ALARM_HISTORY       COMMS_BIN_CODE(COMMS_BIN_TOPIC_ALARM, 0x6U)
+#define COMMS_BIN_ALARM_RECORDING     COMMS_BIN_CODE(COMMS_BIN_TOPIC_ALARM, 0x7U)
+#define COMMS_BIN_ALARM_POWER_WARNING COMMS_BIN_CODE(COMMS_BIN_TOPIC_ALARM, 0x8U)  /* Event */
+#define COMMS_BIN_ALARM_BLACKOUT      COMMS_BIN_CODE(COMMS_BIN_TOPIC_ALARM, 0x9U)
+#define COMMS_BIN_TELEMETRY_SUBSCRIBE COMMS_BIN_CODE(COMMS_BIN_TOPIC_TELEMETRY, 0x1U)
+#define COMMS_BIN_TELEMETRY_UNSUBSCRIBE COMMS_BIN_CODE(COMMS_BIN_TOPIC_TELEMETRY, 0x2U)
+#define COMMS_BIN_TELEMETRY_SAMPLE    COMMS_BIN_CODE(COMMS_BIN_TOPIC_TELEMETRY, 0x3U)
+#define COMMS_BIN_CONFIG_GET          COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0x1U)
+#define COMMS_BIN_CONFIG_SET          COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0x2U)
+#define COMMS_BIN_CONFIG_GET_CALIBRATION COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0x3U)
+#define COMMS_BIN_CONFIG_SET_CALIBRATION COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0x4U)
+#define COMMS_BIN_CONFIG_SET_ADDRESS  COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0x5U)
+#define COMMS_BIN_CONFIG_SET_FAILSAFE COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0x6U)
+#define COMMS_BIN_CONFIG_SET_SLEW     COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0x7U)
+#define COMMS_BIN_CONFIG_SET_PRIMARY  COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0x8U)
+#define COMMS_BIN_CONFIG_GET_GROUPS   COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0x9U)
+#define COMMS_BIN_CONFIG_SET_GROUPS   COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0xAU)
+#define COMMS_BIN_CONFIG_SET_POWER_ON COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0xBU)
+#define COMMS_BIN_CONFIG_BEGIN        COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0xCU)
+#define COMMS_BIN_CONFIG_COMMIT       COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0xDU)
+#define COMMS_BIN_CONFIG_ABORT        COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0xEU)
+#define COMMS_BIN_CONFIG_EXPORT       COMMS_BIN_CODE(COMMS_BIN_TOPIC_CONFIG, 0xFU)
+#define COMMS_BIN_CAPTURE_START       COMMS_BIN_CODE(COMMS_BIN_TOPIC_CAPTURE, 0x1U)
+#define COMMS_BIN_CAPTURE_READ        COMMS_BIN_CODE(COMMS_BIN_TOPIC_CAPTURE, 0x2U)
+#define COMMS_BIN_CAPTURE_READ_PACKED COMMS_BIN_CODE(COMMS_BIN_TOPIC_CAPTURE, 0x3U)
+#define COMMS_BIN_CONFIG_IMPORT       COMMS_BIN_CODE(COMMS_BIN_TOPIC_CAPTURE, 0x4U)  /* config/import */
+#define COMMS_BIN_CONFIG_SET_AGEING   COMMS_BIN_CODE(COMMS_BIN_TOPIC_CAPTURE, 0x5U)  /* config/set_ageing */
+#define COMMS_BIN_CONFIG_SET_TRIM     COMMS_BIN_CODE(COMMS_BIN_TOPIC_CAPTURE, 0x6U)  /* config/set_trim */
+#define COMMS_BIN_CONFIG_SET_STOP_MODE COMMS_BIN_CODE(COMMS_BIN_TOPIC_CAPTURE, 0x7U) /* config/set_stop_mode */
+#define COMMS_BIN_SCENE_GET           COMMS_BIN_CODE(COMMS_BIN_TOPIC_SCENE, 0x1U)
+#define COMMS_BIN_SCENE_SAVE          COMMS_BIN_CODE(COMMS_BIN_TOPIC_SCENE, 0x2U)
+#define COMMS_BIN_SCENE_RECALL        COMMS_BIN_CODE(COMMS_BIN_TOPIC_SCENE, 0x3U)
+#define COMMS_BIN_LIGHT_SET_COLOR     COMMS_BIN_CODE(COMMS_BIN_TOPIC_SCENE, 0x4U)  /* light/set_color */
+#define COMMS_BIN_LIGHT_EFFECT        COMMS_BIN_CODE(COMMS_BIN_TOPIC_SCENE, 0x5U)  /* light/effect */
+#define COMMS_BIN_LIGHT_STROBE        COMMS_BIN_CODE(COMMS_BIN_TOPIC_SCENE, 0x6U)  /* light/strobe */
+#define COMMS_BIN_SEQUENCE_CLEAR      COMMS_BIN_CODE(COMMS_BIN_TOPIC_SEQUENCE, 0x1U)
+#define COMMS_BIN_SEQUENCE_ADD        COMMS_BIN_CODE(COMMS_BIN_TOPIC_SEQUENCE, 0x2U)
+#define COMMS_BIN_SEQUENCE_START      COMMS_BIN_CODE(COMMS_BIN_TOPIC_SEQUENCE, 0x3U)
+#define COMMS_BIN_SEQUENCE_STOP       COMMS_BIN_CODE(COMMS_BIN_TOPIC_SEQUENCE, 0x4U)
+#define COMMS_BIN_SEQUENCE_STATUS     COMMS_BIN_CODE(COMMS_BIN_TOPIC_SEQUENCE, 0x5U)
+#define COMMS_BIN_STROBE_START        COMMS_BIN_CODE(COMMS_BIN_TOPIC_STROBE, 0x1U)
+#define COMMS_BIN_STROBE_STOP         COMMS_BIN_CODE(COMMS_BIN_TOPIC_STROBE, 0x2U)
+#define COMMS_BIN_STROBE_STATUS       COMMS_BIN_CODE(COMMS_BIN_TOPIC_STROBE, 0x3U)
+#define COMMS_BIN_DMX_START           COMMS_BIN_CODE(COMMS_BIN_TOPIC_DMX, 0x1U)
+#define COMMS_BIN_DMX_STATUS          COMMS_BIN_CODE(COMMS_BIN_TOPIC_DMX, 0x2U)
+#define COMMS_BIN_MODBUS_START        COMMS_BIN_CODE(COMMS_BIN_TOPIC_DMX, 0x3U)  /* modbus/start */
+#define COMMS_BIN_MODBUS_STATUS       COMMS_BIN_CODE(COMMS_BIN_TOPIC_DMX, 0x4U)  /* modbus/status */
+#define COMMS_BIN_UPDATE_WRITE        COMMS_BIN_CODE(COMMS_BIN_TOPIC_UPDATE, 0x1U)
+#define COMMS_BIN_UPDATE_FINISH       COMMS_BIN_CODE(COMMS_BIN_TOPIC_UPDATE, 0x2U)
+#define COMMS_BIN_BENCH_ECHO          COMMS_BIN_CODE(COMMS_BIN_TOPIC_BENCH, 0x1U)
+#define COMMS_BIN_BENCH_SINK          COMMS_BIN_CODE(COMMS_BIN_TOPIC_BENCH, 0x2U)
+#define COMMS_BIN_BENCH_SOURCE        COMMS_BIN_CODE(COMMS_BIN_TOPIC_BENCH, 0x3U)
+#define COMMS_BIN_BENCH_SYNTHETIC     COMMS_BIN_CODE(COMMS_BIN_TOPIC_BENCH, 0x4U)  /* Benchmark builds */
+#define COMMS_BIN_BENCH_CRC           COMMS_BIN_CODE(COMMS_BIN_TOPIC_BENCH, 0x5U)  /* Benchmark builds */
+#define COMMS_BIN_BENCH_COPY          COMMS_BIN_CODE(COMMS_BIN_TOPIC_BENCH, 0x6U)  /* Benchmark builds */
+#define COMMS_BIN_RULES_ADD           COMMS_BIN_CODE(COMMS_BIN_TOPIC_RULES, 0x1U)
+#define COMMS_BIN_RULES_CLEAR         COMMS_BIN_CODE(COMMS_BIN_TOPIC_RULES, 0x2U)
+#define COMMS_BIN_RULES_STATUS        COMMS_BIN_CODE(COMMS_BIN_TOPIC_RULES, 0x3U)
+#define COMMS_BIN_RULES_FIRED         COMMS_BIN_CODE(COMMS_BIN_TOPIC_RULES, 0x4U)  /* Event */
+#define COMMS_BIN_MACRO_SAVE          COMMS_BIN_CODE(COMMS_BIN_TOPIC_RULES, 0x5U)  /* macro/save */
+#define COMMS_BIN_MACRO_RUN           COMMS_BIN_CODE(COMMS_BIN_TOPIC_RULES, 0x6U)  /* macro/run */
+#define COMMS_BIN_MACRO_GET           COMMS_BIN_CODE(COMMS_BIN_TOPIC_RULES, 0x7U)  /* macro/get */
+#define COMMS_BIN_DIAG_SPECTRUM       COMMS_BIN_CODE(COMMS_BIN_TOPIC_DIAG, 0x1U)
+#define COMMS_BIN_SYSTEM_QUEUES       COMMS_BIN_CODE(COMMS_BIN_TOPIC_DIAG, 0x2U)  /* system/queues */
+
+/* Curve argument values, the JSON "curve" names in the same order */
+#define COMMS_CURVE_LINEAR            0x00U  /* "linear": fades and outputs */
+#define COMMS_CURVE_EASE              0x01U  /* "ease": fades */
+#define COMMS_CURVE_PERCEPTUAL        0x02U  /* "perceptual": fades */
+#define COMMS_CURVE_GAMMA             0x03U  /* "gamma": outputs */
+#define COMMS_CURVE_COUNT             4
+
+/* capture/start trigger values, the JSON "trigger" names in the same order;
+ * strobe/start takes the rising and falling edges */
+#define COMMS_CAPTURE_NOW             0x00U  /* "now" */
+#define COMMS_CAPTURE_INTENSITY       0x01U  /* "intensity": next output change */
+#define COMMS_CAPTURE_RISING          0x02U  /* "rising": current reaches the threshold */
+#define COMMS_CAPTURE_FALLING         0x03U  /* "falling": current drops below the threshold */
+#define COMMS_CAPTURE_TRIGGER_COUNT   4
+
+/* bench/synthetic shape values, the JSON "shape" names in the same order */
+#define COMMS_SYNTH_OFF               0x00U  /* "off": real samples again */
+#define COMMS_SYNTH_STEP              0x01U  /* "step" */
+#define COMMS_SYNTH_RAMP              0x02U  /* "ramp" */
+#define COMMS_SYNTH_SPIKE             0x03U  /* "spike" */
+#define COMMS_SYNTH_NOISE             0x04U  /* "noise" */
+#define COMMS_SYNTH_SHAPE_COUNT       5
+
+/* light/effect values, the JSON "effect" names in the same order */
+#define COMMS_EFFECT_OFF              0x00U  /* "off": stop, the lights stay where they are */
+#define COMMS_EFFECT_SINE             0x01U  /* "sine": breathing */
+#define COMMS_EFFECT_TRIANGLE         0x02U  /* "triangle": linear pulse */
+#define COMMS_EFFECT_SQUARE           0x03U  /* "square": strobe, on for the width */
+#define COMMS_EFFECT_FLICKER          0x04U  /* "flicker": random dips, the period sets their pace */
+#define COMMS_EFFECT_COUNT            5
+
+/* rules/add input values, the JSON "input" names in the same order */
+#define COMMS_RULE_INPUT_CURRENT      0x00U  /* "current": threshold in mA */
+#define COMMS_RULE_INPUT_TEMPERATURE  0x01U  /* "temperature": threshold in centi-degrees */
+#define COMMS_RULE_INPUT_ALARM        0x02U  /* "alarm": threshold an alarm code */
+#define COMMS_RULE_INPUT_COUNT        3
+
+/* rules/add action values, the JSON "then" names in the same order */
+#define COMMS_RULE_SET                0x00U  /* "set": set the masked lights */
+#define COMMS_RULE_FADE               0x01U  /* "fade": fade the masked lights */
+#define COMMS_RULE_SCENE              0x02U  /* "scene": recall a scene */
+#define COMMS_RULE_EVENT              0x03U  /* "event": only send rules/fired */
+#define COMMS_RULE_MACRO              0x04U  /* "macro": run the macro given as the scene */
+#define COMMS_RULE_ACTION_COUNT       5
+
+#define COMMS_RULES_MAX               16     /* Rules in the table */
+#define COMMS_MACROS_MAX              4      /* Command macros, numbered from 1 */
+#define COMMS_MACRO_BYTES_MAX         118    /* Command bytes of one macro */
+
+#define COMMS_SPECTRUM_PEAKS_MAX      8      /* diag/spectrum peaks per response */
+
+/* config/set keys, the JSON names in the same order */
+#define COMMS_CONFIG_CURRENT_WARN     0x01U  /* "current_warn": mA */
+#define COMMS_CONFIG_CURRENT_MAX      0x02U  /* "current_max": mA */
+#define COMMS_CONFIG_CURRENT_TRIP     0x04U  /* "current_trip": mA, hardware cutoff */
+#define COMMS_CONFIG_TEMPERATURE_WARN 0x08U  /* "temperature_warn": centi-degrees */
+#define COMMS_CONFIG_TEMPERATURE_MAX  0x10U  /* "temperature_max": centi-degrees */
+#define COMMS_CONFIG_CURRENT_SCALE    0x20U  /* "current_scale": mA per mV */
+#define COMMS_CONFIG_TEMPERATURE_SCALE 0x40U /* "temperature_scale": centi-degrees per mV */
+#define COMMS_CONFIG_SAMPLE_PHASE     0x80U  /* "sample_phase": permille of the PWM period, 0 free-running */
+#define COMMS_CONFIG_KEY_COUNT        8
+
+/* config/set_calibration keys, the JSON names in the same order */
+#define COMMS_CALIBRATION_CURRENT_GAIN       0x01U  /* "current_gain": per 10000 */
+#define COMMS_CALIBRATION_CURRENT_OFFSET     0x02U  /* "current_offset": mA */
+#define COMMS_CALIBRATION_TEMPERATURE_GAIN   0x04U  /* "temperature_gain": per 10000 */
+#define COMMS_CALIBRATION_TEMPERATURE_OFFSET 0x08U  /* "temperature_offset": centi-degrees */
+#define COMMS_CALIBRATION_KEY_COUNT          4
+
+/* telemetry/subscribe report-on-change keys, the JSON names in the same order */
+#define COMMS_ON_CHANGE_CURRENT       0x01U  /* "deadband_current": mA */
+#define COMMS_ON_CHANGE_TEMPERATURE   0x02U  /* "deadband_temperature": centi-degrees */
+#define COMMS_ON_CHANGE_HEARTBEAT     0x04U  /* "heartbeat": ms, 0 for 1 s */
+#define COMMS_ON_CHANGE_KEY_COUNT     3
+
+/* system/time_sync response flags */
+#define COMMS_TIME_SYNC_USED          0x01U  /* The sample moved the clock */
+#define COMMS_TIME_SYNC_STEPPED       0x02U  /* The clock was set rather than shifted */
+#define COMMS_TIME_SYNC_TRIMMED       0x04U  /* The drift calibration was updated */
+
+/* Command set and message layouts; bumped when a change breaks existing hosts */
+#define COMMS_PROTOCOL_VERSION        2U
+
+/* system/capabilities feature flags */
+#define COMMS_FEATURE_JSON            0x01U  /* JSON commands */
+#define COMMS_FEATURE_BINARY          0x02U  /* Binary frames */
+#define COMMS_FEATURE_BATCH           0x04U  /* Batches of commands */
+#define COMMS_FEATURE_CHECKED         0x08U  /* Checked mode, system/link */
+#define COMMS_FEATURE_RS485           0x10U  /* RS-485 bus, config/set_address */
+#define COMMS_FEATURE_FLOW            0x20U  /* RTS/CTS flow control, system/set_baud */
+#define COMMS_FEATURE_CBOR            0x40U  /* CBOR frames, COMMS_BIN_TYPE_CBOR */
+
+/* Largest image data in one COMMS_BIN_UPDATE_WRITE frame */
+#define COMMS_UPDATE_CHUNK_MAX        1024U
+
+/* Largest configuration data in one config/export response, and in one
+ * config/import command, which must fit COMMS_BIN_MAX_RX_FRAME encoded */
+#define COMMS_CONFIG_EXPORT_CHUNK     128U
+#define COMMS_CONFIG_IMPORT_CHUNK     48U
+
+/* Sizes */
+#define COMMS_BIN_HEADER_SIZE         3
+#define COMMS_BIN_CRC_SIZE            2
+#define COMMS_BIN_MAX_PAYLOAD         160  /* Header, body and CRC */
+
+/* Largest encoded command accepted from the host. Kept below 0x7B so a '{'
+ * right after a delimiter can never be a valid COBS code byte, which is how
+ * a JSON command is told apart from a binary frame. */
+#define COMMS_BIN_MAX_RX_FRAME        64
+
+/* Encoded size of a payload, including COBS overhead and both delimiters */
+#define COMMS_BIN_FRAME_SIZE(payload) ((payload) + ((payload) / 254) + 1 + 2)
+
+/* Room to leave before a payload, CRC included, encoded in place by
+ * COMMS_Binary_EncodeInPlace */
+#define COMMS_BIN_FRAME_LEAD(payload) (2 + ((payload) / 254))
+
+/* Exported types ------------------------------------------------------------*/
+/* Response bodies, following the status byte */
+typedef struct __attribute__((packed)) {
+  uint8_t light_id;
+  uint8_t intensity;
+} COMMS_Bin_Intensity_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t light_id;
+  uint16_t permille;          /* Intensity in tenths of a percent */
+} COMMS_Bin_Permille_t;
+
+typedef struct __attribute__((packed)) {
+  uint16_t current_ma;        /* Current in milliamps */
+  int16_t temperature_cdeg;   /* Temperature in hundredths of a degree Celsius */
+} COMMS_Bin_Sensor_t;
+
+/* When sensor readings were taken, at the end of the sensor response bodies */
+typedef struct __attribute__((packed)) {
+  uint32_t sequence;          /* ADC scans completed; unchanged means no new readings */
+  uint32_t timestamp_us;      /* Microsecond time of the last scan block */
+} COMMS_Bin_Sample_Stamp_t;
+
+/* status/get_sensors body: uint8 light_id, then the filtered reading and the
+ * latest unfiltered reading, each a COMMS_Bin_Sensor_t, and a
+ * COMMS_Bin_Sample_Stamp_t. */
+
+/* status/get_all_sensors body: a COMMS_Bin_Sensor_t per light, a
+ * COMMS_Bin_Sample_Stamp_t, then a COMMS_Bin_Mcu_Sensors_t. */
+typedef struct __attribute__((packed)) {
+  int16_t temperature_cdeg;   /* MCU die temperature in hundredths of a degree Celsius */
+  uint16_t supply_mv;         /* Analog supply voltage (VDDA) */
+} COMMS_Bin_Mcu_Sensors_t;
+
+/* system/get_state body: uint32 state sequence, uint16 permille, uint8 alarm
+ * code and uint16 derate factor (permille) per light, each as an array, then
+ * a COMMS_Bin_Sensor_t per light, a COMMS_Bin_Sample_Stamp_t and a
+ * COMMS_Bin_Mcu_Sensors_t. The system codes are all taken, so it has a
+ * status code. */
+
+/* status/get_stats arguments: uint8 reset. Body: a COMMS_Bin_Stats_Header_t,
+ * then per light a COMMS_Bin_Stats_t of its current (mA) and one of its
+ * temperature (centi-degrees).
+ *
+ * status/set_stats_window arguments: uint16 scans per window, 0 for one
+ * run until reset. Body: none.
+ *
+ * status/block_scans arguments: uint16 scans per ADC block (1 to
+ * ANALOG_MAX_BLOCK_SCANS), left out to only read it. Body: uint8 scans per
+ * block now in effect. */
+typedef struct __attribute__((packed)) {
+  uint32_t scans;             /* Scans covered, 0 if none yet */
+  uint32_t window_scans;      /* Scans per window, 0 for one run since the last reset */
+  uint32_t first_sample;      /* ADC scan count at the first scan covered */
+  uint16_t rate_hz;           /* Scan rate */
+} COMMS_Bin_Stats_Header_t;
+
+typedef struct __attribute__((packed)) {
+  int32_t min;
+  int32_t max;
+  int32_t mean;
+  int32_t rms;                /* Root mean square */
+} COMMS_Bin_Stats_t;
+
+/* status/get_usage body: one per light, in light order, then uint32 per
+ * Counters_Id_t (app_counters.h): boots, watchdog resets, alarm trips and
+ * link drops over the life of the device */
+typedef struct __attribute__((packed)) {
+  uint32_t charge_as;         /* Current integrated over time, ampere-seconds */
+  uint32_t on_time_s;         /* Time at full duty cycle the PWM output adds up to */
+  uint32_t over_warning_s;    /* Time above the warning temperature */
+} COMMS_Bin_Usage_t;
+
+/* status/get_flicker arguments: uint16 window in scans, left out to keep
+ * it; a new window starts the measurement over. Body: a
+ * COMMS_Bin_Flicker_Header_t, then one COMMS_Bin_Flicker_t per light in
+ * light order, zero until the state is COMMS_FLICKER_DONE. */
+#define COMMS_FLICKER_SETTLING        0x00U  /* "settling": first window after a change */
+#define COMMS_FLICKER_MEASURING       0x01U  /* "measuring": second window */
+#define COMMS_FLICKER_DONE            0x02U  /* "done": metrics valid */
+
+typedef struct __attribute__((packed)) {
+  uint8_t state;              /* COMMS_FLICKER_* */
+  uint16_t window_scans;      /* Raw samples per window */
+  uint32_t measurements;      /* Windows measured since start-up */
+} COMMS_Bin_Flicker_Header_t;
+
+typedef struct __attribute__((packed)) {
+  uint16_t percent_centi;     /* Percent flicker, hundredths of a percent */
+  uint16_t index_e4;          /* Flicker index, ten-thousandths */
+} COMMS_Bin_Flicker_t;
+
+/* system/perf body: one entry per Profiler_Probe_t, in enum order */
+typedef struct __attribute__((packed)) {
+  uint32_t count;
+  uint32_t min_us;
+  uint32_t max_us;
+  uint32_t avg_us;
+} COMMS_Bin_Probe_t;
+
+/* system/boot_time body: uint32 microseconds per Boot_Stage_t, 0xFFFFFFFF for
+ * stages not completed yet */
+
+/* system/resources body: uint32 heap bytes free, uint32 least heap bytes free,
+ * NUL-terminated name of the task whose stack overflowed before the last
+ * reset (empty if none), a COMMS_Bin_Integrity_t per background check in the
+ * order image, config, ram, a COMMS_Bin_FlashWear_t, uint8 task count, then
+ * per task uint16 least free stack bytes and its NUL-terminated name. Tasks
+ * that do not fit are left out. */
+#define COMMS_INTEGRITY_CHECKS 3U
+#define COMMS_STORE_PAGES 6U
+
+typedef struct __attribute__((packed)) {
+  uint32_t bytes;             /* Covered by the last complete pass */
+  uint32_t passes;            /* Complete passes since start-up */
+  uint32_t errors;            /* Flash: passes whose CRC changed; RAM: words changed */
+  uint32_t crc;               /* CRC-32 of the last pass, 0 for the RAM check */
+  uint32_t pass_ms;           /* Time the last pass took */
+  uint32_t age_ms;            /* Time since the last pass ended */
+} COMMS_Bin_Integrity_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t base_address;      /* Of the first store page */
+  uint32_t generation;        /* Key/value compactions since the store was first written */
+  uint32_t page_erases[COMMS_STORE_PAGES];  /* Since start-up, from base_address up */
+  uint32_t erase_total_us;    /* Wraps */
+  uint32_t writes;            /* Program sequences since start-up */
+  uint32_t write_total_us;    /* Wraps */
+  uint32_t write_max_us;
+  uint8_t queued;             /* Error log entries waiting to be written */
+  uint8_t queued_max;
+  uint32_t queue_full;        /* Entries lost to a full queue */
+} COMMS_Bin_FlashWear_t;
+
+/* system/cpu body: uint32 microseconds since the previous query, uint16
+ * permille per Resources_Isr_t, the Power_Stats_t counters since start-up as
+ * five uint32 (stops, milliseconds stopped, serial wakes, longest entry
+ * and exit in microseconds), uint8 job count
+ * and a COMMS_Bin_Job_t per scheduler job, in the order of the JSON "jobs",
+ * uint8 task count, then per task uint16 permille and its NUL-terminated
+ * name. Tasks that do not fit are left out. */
+typedef struct __attribute__((packed)) {
+  uint32_t runs;              /* Runs since start-up */
+  uint32_t skipped;           /* Runs dropped while behind */
+  uint32_t total_us;          /* Time spent in the job, wraps */
+  uint32_t max_us;            /* Longest run */
+} COMMS_Bin_Job_t;
+
+/* system/crash_report arguments: uint32 trace sequence number, left out for
+ * the summary. Summary body: uint8 Crash_Cause_t (app_crash.h, 0 and nothing
+ * more if the last reset was not a crash), uint8 1 if in an interrupt
+ * handler, uint8 trace entries kept, uint8 task count, uint32 assert line,
+ * uint32 tick, uint32 R0-R3, R12, LR, PC, xPSR, SP, CFSR, HFSR, MMFAR and
+ * BFAR, NUL-terminated name of the running task, then per task uint16 least
+ * free stack bytes and its NUL-terminated name. Tasks that do not fit are
+ * left out. With the argument, the body is as for system/trace, from the
+ * entries kept with the crash. */
+
+/* system/trace arguments: uint32 sequence number of the first entry wanted.
+ * Body: uint32 sequence number of the first entry sent (later than asked if
+ * the entries were overwritten), uint32 sequence number of the next entry
+ * to be recorded, then up to 12 Trace_Entry_t (app_trace.h). */
+
+/* system/kernel_trace arguments: uint8 reset (1 to clear the cost figures
+ * after reporting them), uint32 sequence number of the first entry wanted,
+ * uint8 enable (1 to record, 0 to stop), each left out to skip it. Without
+ * the sequence number the body is a COMMS_Bin_KernelTrace_t, uint8 task
+ * count, then per task uint8 task number and its NUL-terminated name. Tasks
+ * that do not fit are left out. With it, the body is as for system/trace
+ * with up to 18 Trace_KernelEntry_t (app_trace.h). Entry times are DWT
+ * cycles, wrapping every 2^32 / clock_hz seconds. */
+typedef struct __attribute__((packed)) {
+  uint8_t enabled;            /* 1 while scheduler events are recorded */
+  uint32_t next;              /* Sequence number of the next entry */
+  uint32_t clock_hz;          /* Core clock, the rate of the entry cycles */
+  uint32_t records;           /* Entries recorded since enabled or reset */
+  uint64_t cost_cycles;       /* Cycles spent recording them */
+  uint64_t elapsed_us;        /* Time they were recorded over */
+  uint32_t load_ppm;          /* cost_cycles over elapsed_us, parts per million */
+} COMMS_Bin_KernelTrace_t;
+
+/* system/latency arguments: optional uint32 from, the command table index
+ * to go on from. Body: a COMMS_Bin_Latency_t, then one
+ * COMMS_Bin_LatencyEntry_t per transport, with the transport number as
+ * code, if from is 0, then one per command measured since the last read,
+ * from there on, as many as fit. Each entry reported is cleared. */
+typedef struct __attribute__((packed)) {
+  uint8_t total;              /* Commands in all */
+  uint8_t next;               /* Index to go on from, total once all are read */
+  uint8_t transports;         /* Transport entries that follow */
+  uint8_t commands;           /* Command entries after them */
+} COMMS_Bin_Latency_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t code;               /* COMMS_BIN_* code of the command, or Transport_Id_t */
+  uint32_t count;             /* Measurements since the last read */
+  uint32_t p50_us;            /* Upper bounds of the log2 buckets holding */
+  uint32_t p90_us;            /* the percentiles, at most max_us */
+  uint32_t p99_us;
+  uint32_t max_us;
+} COMMS_Bin_LatencyEntry_t;
+
+/* system/loop_timing arguments: uint8 reset (1 to clear the figures after
+ * reporting them), left out to keep them. Body: uint8 loop count, then a
+ * COMMS_Bin_LoopTiming_t per loop in Jitter_Loop_t order (app_jitter.h):
+ * sampling, then control. */
+typedef struct __attribute__((packed)) {
+  uint32_t period_us;         /* Nominal period, 0 until the loop has run */
+  uint32_t iterations;        /* Intervals measured */
+  uint32_t missed;            /* Whole periods iterations came late by */
+  uint32_t max_early_us;      /* Largest start before the period was up */
+  uint32_t max_late_us;       /* Largest start after it */
+  uint32_t early[8];          /* Intervals by error, bucket n under 2 << n us, */
+  uint32_t late[8];           /* the last one open */
+} COMMS_Bin_LoopTiming_t;
+
+/* Loop timing in the ADC field of a telemetry sample, per loop as above */
+typedef struct __attribute__((packed)) {
+  uint16_t max_early_us;      /* Worst errors since the previous sample, */
+  uint16_t max_late_us;       /* saturating at 65535 */
+  uint32_t missed;            /* As COMMS_Bin_LoopTiming_t */
+} COMMS_Bin_LoopWindow_t;
+
+/* system/log_level arguments: uint8 Logger_Level_t (app_logger.h), left out
+ * to only read it. Body: uint8 level now in effect. */
+
+/* system/link arguments: uint8 reset (1 to clear the counters after
+ * reporting them), uint8 checked mode (1 on, 0 off), each left out to keep
+ * it. Body: a COMMS_Bin_Link_Stats_t. In checked mode a command whose seq
+ * is not ahead of the previous command's (modulo 256) is dropped. */
+typedef struct __attribute__((packed)) {
+  uint8_t checked;            /* 1 while commands must carry a check */
+  uint32_t accepted;          /* Commands that passed the checks */
+  uint32_t crc;               /* Dropped: CRC or check mismatch */
+  uint32_t unchecked;         /* Dropped: no check in checked mode */
+  uint32_t duplicate;         /* Dropped: sequence number not ahead */
+  uint32_t malformed;         /* Dropped: unparsable or cut short */
+  uint32_t oversize;          /* Dropped: binary frame too long */
+  uint32_t overflow;          /* Receive buffer overruns */
+  uint32_t filtered;          /* Dropped: for another device */
+  uint32_t throttled_control; /* Answered busy: control command rate limit */
+  uint32_t throttled_query;   /* Answered busy: query rate limit */
+  uint32_t pipeline_full;     /* Answered busy: slow commands outstanding */
+  uint16_t rx_peak;           /* Most bytes waiting in the receive stream */
+  uint16_t rx_size;           /* Receive stream size */
+} COMMS_Bin_Link_Stats_t;
+
+/* system/selftest body: a COMMS_Bin_SelfTest_t. Times per command of the
+ * built-in corpus, run through the decoder with the responses dropped */
+typedef struct __attribute__((packed)) {
+  uint32_t p50_us;
+  uint32_t p90_us;
+  uint32_t max_us;
+} COMMS_Bin_SelfTest_Phase_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t commands;           /* Commands run, samples per phase */
+  uint32_t bytes;             /* Response bytes formatted */
+  COMMS_Bin_SelfTest_Phase_t phases[4];  /* Parse, dispatch, format, total */
+} COMMS_Bin_SelfTest_t;
+
+/* system/irq_latency arguments: uint8 reset (1 to clear the figures after
+ * reporting them), left out to keep them. Body: uint8 1 if the probe ran
+ * before this command, then a COMMS_Bin_IrqLatency_t per level, safety,
+ * sampling and comms, then a COMMS_Bin_Wakeup_t per Profiler_Wakeup_t
+ * (app_profiler.h), then a COMMS_Bin_FlashStall_t. Benchmark builds only. */
+typedef struct __attribute__((packed)) {
+  uint8_t priority;           /* NVIC priority of the level */
+  uint32_t count;             /* Probe interrupts measured */
+  uint32_t min_ns;
+  uint32_t max_ns;
+} COMMS_Bin_IrqLatency_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t count;             /* Interrupt to task wakeups measured */
+  uint32_t min_ns;
+  uint32_t max_ns;
+} COMMS_Bin_Wakeup_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t erases;            /* Pages erased */
+  uint32_t erase_max_us;      /* Longest stall of an erase */
+  uint32_t programs;          /* Double words programmed */
+  uint32_t program_max_us;    /* Longest stall of one double word */
+  uint32_t deferred;          /* Background erases left for quiet outputs */
+} COMMS_Bin_FlashStall_t;
+
+/* system/deadlines arguments: uint8 reset (1 to clear the figures after
+ * reporting them), left out to keep them. Body: uint8 1 if the last reset
+ * was caused by the watchdog, uint8 Supervisor_Task_t (app_supervisor.h)
+ * that was over its limit then (0xFF if none), uint32 milliseconds it was
+ * over its deadline, then a COMMS_Bin_Deadline_t per task. */
+typedef struct __attribute__((packed)) {
+  uint16_t deadline_ms;       /* Longest expected work item */
+  uint32_t runs;              /* Work items completed */
+  uint32_t misses;            /* Work items over the deadline */
+  uint32_t worst_us;          /* Longest work item */
+  uint32_t last_over_us;      /* Time over the deadline of the latest miss */
+} COMMS_Bin_Deadline_t;
+
+/* system/queues arguments: uint8 reset (1 to clear the figures after
+ * reporting them), left out to keep them. Body: uint8 object count, then per
+ * object a COMMS_Bin_Queue_t and its NUL-terminated name, in registration
+ * order. Objects that do not fit are left out. */
+typedef struct __attribute__((packed)) {
+  uint8_t kind;               /* Queues_Kind_t (app_queues.h) */
+  uint32_t capacity;          /* Items, bytes or slots */
+  uint32_t high_water;        /* Most held at once */
+  uint32_t fails;             /* Sends refused or cut short; mutex: takes that gave up */
+  uint32_t blocks;            /* Senders that had to wait; mutex: takes that found it held */
+  uint32_t block_us;          /* Time spent waiting, wraps */
+  uint32_t block_max_us;      /* Longest wait */
+} COMMS_Bin_Queue_t;
+
+/* system/time_sync arguments: uint64 host time in milliseconds since
+ * 1970-01-01 UTC, as sent, then uint32 round trip of the previous sync in
+ * milliseconds (0 or left out if unknown). Body: a COMMS_Bin_TimeSync_t.
+ * The host sends samples now and then, with the round trip it measured
+ * for the last one; samples with a long round trip are not used. */
+typedef struct __attribute__((packed)) {
+  uint64_t time;              /* Clock after the sample, ms since 1970 UTC */
+  uint32_t uptime;            /* Milliseconds since start-up at the same moment */
+  int32_t offset_ms;          /* Host estimate minus the clock before the sample */
+  uint8_t flags;              /* COMMS_TIME_SYNC_* */
+  int32_t calibration_ppb;    /* RTC drift correction in use */
+} COMMS_Bin_TimeSync_t;
+
+/* alarm/clear arguments: uint8 id (0 for all lights), then optionally a
+ * uint8 mask of lights, bit n for light n+1, which replaces the ID. Body: a
+ * COMMS_Bin_Alarm_Clear_t, with VAL_ERROR as the status if any alarm stays */
+typedef struct __attribute__((packed)) {
+  uint8_t lights;             /* Lights asked for */
+  uint8_t failed;             /* Lights whose alarm condition is still present */
+} COMMS_Bin_Alarm_Clear_t;
+
+/* alarm/status body: uint8 alarm code per light, then a COMMS_Bin_Alarm_Info_t
+ * per light */
+typedef struct __attribute__((packed)) {
+  uint8_t state;              /* LED_Driver_AlarmState_t */
+  uint16_t trip_count;        /* Alarms raised since start-up */
+} COMMS_Bin_Alarm_Info_t;
+
+/* alarm/history arguments: uint32 from, uint8 limit, uint32 since, uint32
+ * until, each optional from the end. Body: uint16 matching entries in the
+ * log, uint16 from, then a COMMS_Bin_History_Entry_t per entry, newest
+ * first. The host asks again with from plus the entries received until it
+ * reaches the total. */
+typedef struct __attribute__((packed)) {
+  uint32_t timestamp;         /* Milliseconds since the start-up that logged it */
+  uint8_t source;             /* Light ID, or the source of a system error */
+  uint8_t error_type;         /* ErrorType_t */
+  int32_t value_milli;        /* Measured value in thousandths of its unit */
+  uint8_t action;             /* VAL_DATA_STORE_ACTION_x, 0 for none */
+} COMMS_Bin_History_Entry_t;
+
+/* alarm/blackout arguments: none. Body: status only. Recognised in the RX
+ * interrupt as a frame of at most COMMS_BIN_FAST_FRAME_MAX encoded bytes,
+ * which cuts the outputs there, before the frame reaches the task. */
+#define COMMS_BIN_FAST_FRAME_MAX      8      /* Encoded bytes; an addressed command with no body takes 7 */
+
+/* alarm/recording arguments: uint8 reset (1 to arm the recorder again after
+ * reporting), left out to keep the recording. Body: a COMMS_Bin_Recording_t,
+ * the rest zero unless COMMS_RECORDING_RECORDED is set. While the state is
+ * COMMS_RECORDER_DONE the raw scans are read with capture/read, the first
+ * pre_scans of them from before the trip. */
+#define COMMS_RECORDER_OFF            0x00U  /* "off": a host capture took the buffer */
+#define COMMS_RECORDER_ARMED          0x01U  /* "armed": waiting for a trip */
+#define COMMS_RECORDER_RECORDING      0x02U  /* "recording": tripped, scans after it coming in */
+#define COMMS_RECORDER_DONE           0x03U  /* "done": frozen until reset */
+
+#define COMMS_RECORDING_RECORDED      0x01U  /* The summary holds a recording */
+#define COMMS_RECORDING_STORED        0x02U  /* The summary is in flash */
+
+#define COMMS_RECORDING_CHANNELS      8      /* ADC channels, in scan rank order */
+
+typedef struct __attribute__((packed)) {
+  uint8_t state;              /* COMMS_RECORDER_* */
+  uint8_t flags;              /* COMMS_RECORDING_* */
+  uint32_t boot;              /* Boot count the trip happened in */
+  uint32_t trip_ms;           /* Milliseconds since that start-up */
+  uint32_t first_sample;      /* Scan count of the first recorded scan */
+  uint16_t pre_scans;         /* Scans before the trip */
+  uint16_t post_scans;        /* Scans from the trip on */
+  uint16_t rate_hz;
+  uint8_t light_id;           /* Light that tripped, 0 if not known */
+  uint8_t error_type;         /* ErrorType_t */
+  uint16_t before[3][COMMS_RECORDING_CHANNELS];  /* Minimum, mean and maximum raw counts */
+  uint16_t after[3][COMMS_RECORDING_CHANNELS];
+} COMMS_Bin_Recording_t;
+
+/* config/get body: uint16 current scale, uint16 temperature scale, uint16
+ * sample phase, then a COMMS_Bin_Limits_t per light, uint8 address, uint8
+ * bus (1 on an RS-485 bus), uint16 failsafe timeout in ms (0 off), uint8
+ * failsafe scene (0 all off), a uint16 slew limit per light, a
+ * COMMS_Bin_Primary_t per light, uint8 power-on mode (Restore_Mode_t),
+ * uint8 power-on scene, uint8 staged (1 between config/begin and
+ * config/commit or config/abort, the body then holds the staged settings)
+ * and uint8 stop mode (1 if enabled).
+ *
+ * config/begin, config/commit and config/abort take no arguments and
+ * return an empty body.
+ *
+ * config/export arguments: uint32 offset; offset 0 takes a new snapshot of
+ * the settings, calibrations, saved scenes and macros and the rules table.
+ * Body: uint16 size of the whole export, then up to
+ * COMMS_CONFIG_EXPORT_CHUNK bytes of it from the offset, none past the end. The export carries its own layout versions
+ * and CRC-32, so it is kept as it is and sent back whole.
+ * config/import arguments: uint32 offset, uint8 length, then that many
+ * bytes of an export (up to COMMS_CONFIG_IMPORT_CHUNK), in order from
+ * offset 0, which starts over. Body: uint16 bytes received. The part that
+ * completes the export checks, applies and stores it, and its status is
+ * that of the import; nothing is changed unless it is valid as a whole.
+ * Both are binary protocol only.
+ *
+ * config/set_address arguments: uint8 address, uint8 bus. Body: uint8
+ * address, uint8 bus.
+ *
+ * config/set_failsafe arguments: uint16 timeout in ms, uint8 scene. Body:
+ * the same, as now in use.
+ *
+ * config/set_slew arguments: uint8 light_id (0 all), uint16 slew limit in
+ * permille of the PWM period per ms (0 off). Body: a uint16 slew limit
+ * per light, as now in use.
+ *
+ * config/set_primary arguments: uint8 light_id, uint16 x, uint16 y, uint16
+ * flux; trailing ones left out are kept. Body: a COMMS_Bin_Primary_t per light, as
+ * now in use.
+ *
+ * config/set_ageing arguments: uint8 light_id (0 all), uint16 hours between
+ * points (0 off), uint8 count, then that many uint16 outputs left in
+ * permille (1-LED_DRIVER_AGEING_POINTS, the last one repeats). Body: a
+ * uint16 step and LED_DRIVER_AGEING_POINTS uint16 outputs per light, then
+ * a uint16 output scale in permille per light, as now in use.
+ *
+ * config/set_trim arguments: uint32 mask, then a uint16 trim in permille
+ * per bit set, lowest bit first (LED_DRIVER_TRIM_MIN_PERMILLE-
+ * LED_DRIVER_TRIM_MAX_PERMILLE). Body: a uint16 trim per light, as now in
+ * use.
+ *
+ * config/get_groups body: a uint8 light mask per light group (bit 0 for light
+ * 1, 0 unused), then uint16 bus groups joined (bit 0 for group 1).
+ * config/set_groups arguments: uint32 mask, uint8 group, uint16 bus groups;
+ * a group of 0 leaves the light groups as they are, bus groups left out are
+ * kept. Body: as config/get_groups, now in use.
+ *
+ * config/set_power_on arguments: uint8 scene, uint8 enable; a scene other
+ * than 0 selects it, else enable 1 selects the last intensities and 0 all
+ * off. Body: uint8 mode, uint8 scene, as now in use, and uint8 restored (1
+ * if lights were restored at this start-up).
+ *
+ * config/set_stop_mode arguments: uint8 enable (1 lets the idle MCU enter
+ * stop mode). Body: uint8 enable, as now in use.
+ *
+ * light/set, light/set_permille, light/fade, light/effect and scene/recall
+ * take a trailing uint8 light group; when sent, the command applies to the
+ * lights of that group rather than light_id. */
+typedef struct __attribute__((packed)) {
+  int32_t current_warn_ma;
+  int32_t current_max_ma;
+  int32_t current_trip_ma;
+  int32_t temperature_warn_cdeg;
+  int32_t temperature_max_cdeg;
+} COMMS_Bin_Limits_t;
+
+typedef struct __attribute__((packed)) {
+  uint16_t x;                 /* CIE 1931 chromaticity at full output, 1/10000 */
+  uint16_t y;
+  uint16_t flux_lm;           /* Luminous flux at full duty cycle */
+} COMMS_Bin_Primary_t;
+
+/* config/get_calibration arguments: uint8 light_id. Body: a
+ * COMMS_Bin_Calibration_t, then point_count points of uint16 mV and int16
+ * centi-degrees.
+ *
+ * config/set_calibration arguments: uint8 light_id, uint8 COMMS_CALIBRATION_*
+ * mask and an int32 per key set, in bit order, then uint8 point count and
+ * the points as above. The whole calibration is replaced; keys left out
+ * take their default (gain 10000, offset 0, no table). Body: none. */
+typedef struct __attribute__((packed)) {
+  uint16_t current_gain;            /* Per 10000 */
+  int16_t current_offset_ma;
+  uint16_t temperature_gain;        /* Per 10000 */
+  int16_t temperature_offset_cdeg;
+  uint8_t point_count;              /* Temperature table points, 0 for the linear scale */
+} COMMS_Bin_Calibration_t;
+
+/* Telemetry sample event, with the stream number (1-COMMS_TELEMETRY_STREAMS)
+ * in its seq byte. Body: uint32 timestamp, uint8 fields, uint16 rate
+ * (1/100 Hz, the subscribed rate divided by any slowing down for a busy
+ * link), then per field in COMMS_TELEMETRY_* bit order: intensities (uint8
+ * per light), currents and temperatures (per light, uint16 mA then int16
+ * centi-degrees, as present), alarms (uint8 per light), the ADC error counters
+ * (AnalogErrorCounts, five uint32) followed by a COMMS_Bin_LoopWindow_t
+ * per control loop, the derate factors (uint16 permille
+ * per light, 1000 for the full output) and the strobe counts (uint32
+ * triggers, pulses and missed triggers, as in the strobe/status body) and
+ * the time (uint64 milliseconds since 1970 UTC, 0 if the clock is not set). */
+
+/* Log event body: uint32 timestamp, uint8 Logger_Level_t, then the
+ * NUL-terminated message. */
+
+/* Alarm event body: one entry per light whose alarm was raised in the same
+ * sample, each with the time of its trip. */
+typedef struct __attribute__((packed)) {
+  uint32_t timestamp;         /* Milliseconds since start-up */
+  uint8_t light_id;
+  uint8_t error_type;         /* ErrorType_t */
+  int32_t value_milli;        /* Measured value in thousandths of its unit */
+} COMMS_Bin_Alarm_Event_t;
+
+/* Thermal warning event body: a light is heating up towards its maximum
+ * temperature and projected to reach it within the warning horizon. */
+typedef struct __attribute__((packed)) {
+  uint32_t timestamp;         /* Milliseconds since start-up */
+  uint8_t light_id;
+  int16_t temperature_cdeg;
+  int32_t slope_cdeg_per_s;   /* Rise rate, centi-degrees per second */
+  uint32_t time_to_limit_ms;  /* Projected time to the maximum temperature */
+} COMMS_Bin_Thermal_Warning_t;
+
+/* Power warning event body: the MCU supply fell under its warning level
+ * and the outputs were cut to the shed factor, or it recovered and they
+ * rise back. */
+typedef struct __attribute__((packed)) {
+  uint32_t timestamp;         /* Milliseconds since start-up */
+  uint8_t low;                /* 1 under the level, 0 recovered */
+  uint16_t threshold_mv;      /* Warning level */
+  uint16_t supply_mv;         /* VDDA measured at the last block */
+  uint16_t permille;          /* Factor applied to every output */
+  uint32_t warnings;          /* Times the supply fell under the level since start-up */
+} COMMS_Bin_Power_Warning_t;
+
+/* Failsafe event body: the link is back after no valid frame arrived for
+ * the failsafe timeout and the lights went to the failsafe scene. */
+typedef struct __attribute__((packed)) {
+  uint32_t timestamp;         /* Milliseconds since start-up */
+  uint32_t silence_ms;        /* Time without a valid frame */
+  uint8_t scene;              /* Scene applied, 0 for all off */
+} COMMS_Bin_Failsafe_t;
+
+/* capture/start arguments: uint8 light_id, uint16 scans, uint8 trigger
+ * (COMMS_CAPTURE_*), int32 threshold in mA. Light and threshold are only
+ * used by the rising and falling triggers. Body: none.
+ *
+ * capture/read arguments: uint32 index of the first scan wanted. Body: a
+ * COMMS_Bin_Capture_Header_t, then the scans that follow it (up to 8), each
+ * a uint16 raw sample per ADC channel in scan order: all currents, all
+ * temperatures, then VREFINT and the MCU temperature sensor. Convert with
+ * full_scale, the config/get scales and the light's calibration; samples
+ * are not corrected for the supply voltage.
+ *
+ * capture/read_packed arguments: as capture/read. Body: a
+ * COMMS_Bin_Capture_Header_t, a uint8 count of the scans that follow, then
+ * the samples of those scans in the same order as nibbles, the high nibble
+ * of each byte first. A nibble n below 15 is a zig-zag delta from the
+ * previous sample of the channel (n / 2 if n is even, -(n + 1) / 2 if odd);
+ * 15 is followed by the sample itself in four nibbles, most significant
+ * first.
+ * The first scan is always written this way, so every response decodes on
+ * its own. */
+typedef struct __attribute__((packed)) {
+  uint8_t state;              /* AnalogCaptureState: idle, armed, running, done */
+  uint16_t scans;             /* Scans recorded so far */
+  uint16_t scans_wanted;      /* Scans the capture was started with */
+  uint16_t from;              /* Index of the first scan in this response */
+  uint32_t first_sample;      /* ADC scan count at the first recorded scan */
+  uint16_t rate_hz;           /* Scan rate */
+  uint16_t full_scale;        /* Raw counts at the ADC reference voltage */
+} COMMS_Bin_Capture_Header_t;
+
+/* scene/get arguments: uint8 scene number. Body: uint16 permille per light,
+ * uint16 fade time in milliseconds and uint8 curve (COMMS_CURVE_LINEAR,
+ * _EASE or _PERCEPTUAL).
+ *
+ * scene/save arguments: uint8 scene number, then optionally the scene as in
+ * the scene/get body; the present intensities are saved if the permille
+ * values are left out. Body: none.
+ *
+ * scene/recall arguments: uint8 scene number. Body: none.
+ *
+ * light/set_color, coded in the scene topic as the light topic is full,
+ * arguments: uint16 permille of the brightest mix (1000 if left out),
+ * uint16 colour temperature in K (0 to mix x, y instead), int16 tint in
+ * Duv/10000, uint16 x, uint16 y in 1/10000. Body: uint16 permille per
+ * light as set.
+ *
+ * light/effect, coded in the scene topic as well, arguments: uint16 crest
+ * permille per light (0xFFFF keeps the light), uint32 period and uint32
+ * square wave on-time in microseconds (0 for half the period), uint8
+ * effect (COMMS_EFFECT_*) and uint16 depth in permille of the crest.
+ * The period is needed unless the effect is off. Body: none.
+ *
+ * light/strobe, coded in the scene topic as well, arguments: uint16
+ * permille per light, uint32 pulse period and uint32 pulse width in
+ * microseconds. Body: none. */
+
+/* sequence/add arguments: uint16 permille per light (0xFFFF keeps the
+ * light), uint16 transition time in milliseconds, uint8 curve
+ * (COMMS_CURVE_LINEAR, _EASE or _PERCEPTUAL) and uint32 offset in
+ * microseconds. Body: uint8 cues in the list.
+ *
+ * sequence/start arguments: uint32 loop period in microseconds, 0 or left
+ * out to play once. Body: none.
+ *
+ * sequence/clear, sequence/stop: no arguments. Body: none.
+ *
+ * sequence/status body: a COMMS_Bin_Sequence_Status_t. */
+typedef struct __attribute__((packed)) {
+  uint8_t running;            /* 1 while playing */
+  uint8_t cue_count;          /* Cues in the list */
+  uint8_t next_cue;           /* Index of the cue due next */
+  uint32_t period_us;         /* Loop period, 0 to play once */
+  uint32_t passes;            /* Passes completed since the start */
+  uint32_t late_max_us;       /* Longest delay of a cue past its time */
+} COMMS_Bin_Sequence_Status_t;
+
+/* rules/add arguments: uint8 light watched, uint16 permille, uint16 fade
+ * time in milliseconds, uint8 curve (COMMS_CURVE_LINEAR, _EASE or
+ * _PERCEPTUAL), uint8 trigger (COMMS_CAPTURE_RISING or _FALLING), int32
+ * threshold, uint32 mask of lights, uint8 scene (the macro for
+ * COMMS_RULE_MACRO), uint8 input (COMMS_RULE_INPUT_*), uint8 action
+ * (COMMS_RULE_*) and int32 hysteresis in the unit of the threshold. Body:
+ * uint8 rules in the table, the number of the rule added.
+ *
+ * rules/clear: no arguments. Body: none.
+ *
+ * rules/status body: a COMMS_Bin_Rules_Status_t.
+ *
+ * rules/fired event body: a COMMS_Bin_Rule_Fired_t, sent by the rules with
+ * the event action. */
+typedef struct __attribute__((packed)) {
+  uint8_t rule_count;         /* Rules in the table */
+  uint32_t scans;             /* Samples evaluated since the table was cleared */
+  uint32_t active;            /* Rules whose condition holds, bit 0 for rule 1 */
+  uint32_t hits[COMMS_RULES_MAX]; /* Times each rule fired */
+} COMMS_Bin_Rules_Status_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t timestamp;         /* Milliseconds since start-up */
+  uint8_t rule;               /* Rule number, from 1 */
+  int32_t value_milli;        /* Watched value in thousandths of its unit */
+} COMMS_Bin_Rule_Fired_t;
+
+/* macro/save arguments: uint8 macro (1-COMMS_MACROS_MAX), uint32 offset,
+ * uint8 length, then that many bytes (up to COMMS_CONFIG_IMPORT_CHUNK) of
+ * its commands, in order from offset 0, which starts over. The commands
+ * are framed as the body of a system/batch frame, up to
+ * COMMS_MACRO_BYTES_MAX bytes. A part shorter than
+ * COMMS_CONFIG_IMPORT_CHUNK is the last: the commands are checked against
+ * the command table and the macro stored, and its status is that of the
+ * save. A lone empty part clears the macro. Body: uint8 bytes received.
+ * Binary protocol only.
+ *
+ * macro/run arguments: uint8 macro. The commands run in order without
+ * responses of their own; a failed one does not stop the ones after it.
+ * Body: a COMMS_Bin_Macro_Run_t.
+ *
+ * macro/get arguments: uint8 macro. Body: uint8 commands, then the
+ * commands as saved. */
+typedef struct __attribute__((packed)) {
+  uint8_t macro;              /* Macro number, from 1 */
+  uint8_t steps;              /* Commands run */
+  uint8_t failed;             /* Commands that failed */
+  uint8_t first_failed;       /* Number of the first that failed, from 1, 0 if none */
+} COMMS_Bin_Macro_Run_t;
+
+/* diag/spectrum arguments: uint8 light and uint8 peaks wanted (1 to
+ * COMMS_SPECTRUM_PEAKS_MAX, 4 if left out). Body: a COMMS_Bin_Spectrum_t
+ * followed by peak_count COMMS_Bin_Spectrum_Peak_t, largest first. A peak
+ * at bin k is at k * rate_hz / size. */
+typedef struct __attribute__((packed)) {
+  uint8_t light_id;           /* Light whose current was analyzed */
+  uint16_t size;              /* Samples analyzed */
+  uint32_t rate_hz;           /* Sampling rate */
+  int32_t mean_ua;            /* Average current, microamps */
+  uint32_t ripple_ua;         /* RMS about the average, microamps */
+  uint8_t peak_count;         /* Peaks that follow */
+} COMMS_Bin_Spectrum_t;
+
+typedef struct __attribute__((packed)) {
+  uint16_t bin;               /* Frequency in multiples of rate_hz / size */
+  uint32_t amplitude_ua;      /* Peak amplitude of the tone, microamps */
+} COMMS_Bin_Spectrum_Peak_t;
+
+/* strobe/start arguments: uint16 permille per light, uint8 trigger edge
+ * (COMMS_CAPTURE_RISING or _FALLING) and uint32 pulse width in
+ * microseconds. Body: none.
+ *
+ * strobe/stop: no arguments. Body: none.
+ *
+ * strobe/status body: a COMMS_Bin_Strobe_Status_t, for light/strobe too. */
+typedef struct __attribute__((packed)) {
+  uint8_t active;             /* 1 while the outputs follow the trigger input */
+  uint8_t edge;               /* COMMS_CAPTURE_RISING or _FALLING */
+  uint32_t width_us;          /* Pulse width */
+  uint32_t triggers;          /* Edges seen since the strobe was started */
+  uint32_t pulses;            /* Pulses completed */
+  uint32_t missed;            /* Edges that came while a pulse was running */
+  uint32_t period_us;         /* Pulse period of light/strobe, 0 on the trigger input */
+} COMMS_Bin_Strobe_Status_t;
+
+/* dmx/start arguments: uint16 DMX channel of light 1. Body: none; the
+ * response is sent before the line switches to DMX512.
+ *
+ * dmx/status body: a COMMS_Bin_Dmx_Status_t. */
+typedef struct __attribute__((packed)) {
+  uint8_t active;             /* 1 while listening to a desk */
+  uint16_t channel;           /* DMX channel of light 1 */
+  uint32_t packets;           /* Packets applied during the last session */
+  uint32_t ignored;           /* Other start codes, or too few slots */
+  uint32_t dropped;           /* Packets lost to line errors */
+  uint8_t levels[VAL_LIGHT_COUNT]; /* Last channel values applied */
+} COMMS_Bin_Dmx_Status_t;
+
+/* modbus/start arguments: uint32 baud, uint8 slave address, uint16 timeout
+ * in milliseconds, each optional. Body: none; the response is sent before
+ * the line switches to Modbus RTU.
+ *
+ * modbus/status body: a COMMS_Bin_Modbus_Status_t. */
+typedef struct __attribute__((packed)) {
+  uint8_t active;             /* 1 while answering a Modbus master */
+  uint8_t address;            /* Slave address */
+  uint32_t baud;              /* Bus baud rate, 8E1 */
+  uint32_t timeout_ms;        /* Master silence before the host link returns */
+  uint32_t requests;          /* Requests served, broadcasts included */
+  uint32_t exceptions;        /* Exception responses sent */
+  uint32_t crc_errors;        /* Frames failing their CRC */
+  uint32_t ignored;           /* Frames for other slaves, or too short */
+  uint32_t dropped;           /* Frames lost to line errors */
+  uint32_t max_response_us;   /* Longest request processing */
+} COMMS_Bin_Modbus_Status_t;
+
+/* system/capabilities arguments: optional uint32 from, the index of the
+ * first command listed. Body: a COMMS_Bin_Capabilities_t, then one
+ * COMMS_Bin_Capability_t per command from there, as many as fit. The
+ * argument mask is the "mask" of the JSON response, which names its bits;
+ * a command's arguments follow its header in bit order. */
+typedef struct __attribute__((packed)) {
+  uint8_t protocol;           /* COMMS_PROTOCOL_VERSION */
+  uint8_t features;           /* COMMS_FEATURE_* */
+  uint8_t lights;             /* Light channels */
+  uint8_t total;              /* Commands in all */
+  uint8_t from;               /* Index of the first command below */
+} COMMS_Bin_Capabilities_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t code;               /* COMMS_BIN_* code of the command */
+  uint64_t args;              /* Arguments the command takes */
+} COMMS_Bin_Capability_t;
+
+/* system/update arguments: uint32 image size, uint32 CRC-32 of the image
+ * (zlib's crc32). Body: a COMMS_Bin_Update_t. Once the response is sent
+ * the device resets into its resident boot loader, which answers nothing
+ * but system/update and the COMMS_BIN_TOPIC_UPDATE commands below, at the
+ * same baud rate. It resets after 10 s without a frame: into the old
+ * firmware as long as none of it was erased, back into the boot loader
+ * otherwise. The image is a whole build from the start of the flash; its
+ * boot loader part goes into the CRC but is not written.
+ *
+ * The boot loader takes commands of the usual layout, COMMS_BIN_TYPE_CMD or
+ * COMMS_BIN_TYPE_ADDR_CMD with the device's own address, up to
+ * COMMS_UPDATE_CHUNK_MAX bytes of data long. Every command is answered, the
+ * NOACK flag is ignored. When it starts without an update requested, as
+ * when the firmware is not whole, it runs at the default baud rate and
+ * waits for system/update, which it answers with a COMMS_Bin_Update_t too.
+ * Its other responses carry uint32 next, the offset of the image data it
+ * expects next, after the status byte:
+ *
+ * update/write arguments: uint32 offset, then the image data from there,
+ * up to COMMS_UPDATE_CHUNK_MAX bytes and a multiple of 8 except for the last
+ * chunk. Chunks go in order; one already written is answered VAL_OK again,
+ * so a chunk whose response was lost can be resent, and one past next gets
+ * VAL_PARAM.
+ *
+ * update/finish: no arguments. Checks the CRC-32 and the vector table of the
+ * image; if both are right, answers VAL_OK and resets into the new firmware.
+ * A wrong CRC is answered VAL_ERROR with next 0: send the image again. */
+typedef struct __attribute__((packed)) {
+  uint32_t size;              /* Image size accepted */
+  uint16_t chunk;             /* COMMS_UPDATE_CHUNK_MAX */
+} COMMS_Bin_Update_t;
+
+/* bench/echo, bench/sink and bench/source arguments: uint32 size. The
+ * response, a COMMS_Bin_Bench_t, follows once the run is over. Echo and
+ * sink runs take the next size bytes received, line ends right after the
+ * command excepted, and end short after a second without any; source runs
+ * send size bytes of 64-byte lines of digits, each ending in '\n'. */
+typedef struct __attribute__((packed)) {
+  uint8_t transport;          /* Transport_Id_t of the link */
+  uint8_t complete;           /* 1 if all size bytes were moved */
+  uint32_t size;              /* Bytes asked for */
+  uint32_t bytes;             /* Bytes moved */
+  uint32_t elapsed_us;        /* First to last byte received, or queued to sent */
+  uint32_t bytes_per_s;       /* bytes over elapsed_us */
+  uint32_t overflow;          /* Receive buffer overruns during the run */
+  uint32_t turnaround_max_us; /* Echo: longest time from receive to queued again */
+} COMMS_Bin_Bench_t;
+
+/* bench/synthetic arguments: uint8 light_id, int32 level in mA, uint32
+ * delay, spike period and ramp or spike width in microseconds, uint8 shape
+ * (COMMS_SYNTH_*), int32 noise peak in mA. Without arguments only the
+ * progress is reported. Body: a COMMS_Bin_Synthetic_t. Each stage is timed
+ * from the moment the edge scan was taken and is 0 until it is reached. */
+typedef struct __attribute__((packed)) {
+  uint8_t active;             /* 1 while the waveform is substituted */
+  uint8_t light_id;           /* Light of the last waveform started, 0 if none */
+  uint32_t scans;             /* Scans since the start */
+  uint16_t trips;             /* Alarms raised on the light since the start */
+  uint32_t filter_us;         /* Edge block handed to the filters */
+  uint32_t violation_us;      /* First reading over the limit */
+  uint32_t cut_us;            /* Output cut */
+  uint32_t event_us;          /* Alarm event formatted */
+} COMMS_Bin_Synthetic_t;
+
+/* bench/crc arguments: uint32 size in bytes, left out for 4096. Body:
+ * uint32 size, then a COMMS_Bin_BenchCrc_t per VAL_Crc_Type_t (val_crc.h),
+ * CRC16-CCITT, CRC-32 then Modbus CRC-16, over the start of the flash. Benchmark builds
+ * only. */
+typedef struct __attribute__((packed)) {
+  uint32_t crc;               /* Software result */
+  uint32_t software_us;       /* Bit-by-bit loop */
+  uint32_t cpu_us;            /* CRC unit, words written by the CPU */
+  uint32_t dma_us;            /* CRC unit fed by DMA, start to result */
+  uint8_t match;              /* 1 if both CRC unit results equal crc */
+} COMMS_Bin_BenchCrc_t;
+
+/* bench/copy arguments: uint32 size in bytes, left out for
+ * VAL_DMA_COPY_MIN_BYTES. Body: uint32 size, then a COMMS_Bin_BenchCopy_t
+ * with both ends word aligned and one with the destination a byte off.
+ * Each figure is the shortest of several runs, in core clock cycles.
+ * Benchmark builds only. */
+typedef struct __attribute__((packed)) {
+  uint32_t cpu_cycles;        /* memcpy */
+  uint32_t setup_cycles;      /* VAL_DMA_Start, the unaligned ends included */
+  uint32_t irq_cycles;        /* Completion interrupt, as the task saw it */
+  uint32_t dma_cycles;        /* VAL_DMA_Start to the callback */
+  uint8_t match;              /* 1 if both copies equal the source */
+} COMMS_Bin_BenchCopy_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Compute the CRC16-CCITT of a buffer
+ * @param data Data to checksum
+ * @param length Number of bytes
+ * @return uint16_t CRC value
+ */
+uint16_t COMMS_Binary_CRC16(const uint8_t* data, size_t length);
+
+/**
+ * @brief Add one byte to a running CRC16-CCITT
+ * @param crc CRC so far, COMMS_BIN_CRC16_INIT before the first byte
+ * @param byte Next byte
+ * @return uint16_t CRC including the byte
+ */
+uint16_t COMMS_Binary_CRC16Update(uint16_t crc, uint8_t byte);
+
+/**
+ * @brief Build a delimited COBS frame from a header and body
+ * @param type Message type (COMMS_BIN_TYPE_*)
+ * @param seq Sequence number
+ * @param code Topic/action code
+ * @param body Body bytes, may be NULL if body_length is 0
+ * @param body_length Number of body bytes
+ * @param frame Buffer to store the encoded frame
+ * @param frame_size Size of the frame buffer
+ * @return size_t Encoded frame length, 0 if it does not fit
+ */
+size_t COMMS_Binary_EncodeFrame(uint8_t type, uint8_t seq, uint8_t code,
+                                const void* body, size_t body_length,
+                                uint8_t* frame, size_t frame_size);
+
+/**
+ * @brief Seal a payload built in the frame buffer and encode it in place
+ * @param frame Buffer holding the payload at offset
+ * @param frame_size Size of the frame buffer
+ * @param offset Position of the payload, at least COMMS_BIN_FRAME_LEAD of
+ *        the payload with its CRC
+ * @param length Number of payload bytes, header and body
+ * @return size_t Encoded frame length from the start of the buffer, 0 if it
+ *         does not fit
+ */
+size_t COMMS_Binary_EncodeInPlace(uint8_t* frame, size_t frame_size, size_t offset, size_t length);
+
+/**
+ * @brief Decode a COBS frame (without delimiters) and check its CRC
+ * @param frame Encoded bytes between the delimiters; decoded in place
+ * @param length Number of encoded bytes
+ * @param payload_length Pointer to store the payload length, CRC excluded
+ * @return VAL_Status VAL_OK if the frame is valid, VAL_ERROR if the CRC does
+ *         not match, VAL_PARAM if the frame is malformed
+ */
+VAL_Status COMMS_Binary_DecodeFrame(uint8_t* frame, size_t length, size_t* payload_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_COMMS_BINARY_H */
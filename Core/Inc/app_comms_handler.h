@@ -16,18 +16,142 @@ extern "C" {
 /* Includes ------------------------------------------------------------------*/
 #include <stdint.h>
 #include "val_status.h"
+#include "app_led_driver.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Telemetry fields, combined into a subscription mask */
+#define COMMS_TELEMETRY_INTENSITY     0x01U
+#define COMMS_TELEMETRY_CURRENT       0x02U
+#define COMMS_TELEMETRY_TEMPERATURE   0x04U
+#define COMMS_TELEMETRY_ALARMS        0x08U
+#define COMMS_TELEMETRY_ADC           0x10U  /* ADC error counters */
+#define COMMS_TELEMETRY_DERATE        0x20U  /* Thermal derate factors */
+#define COMMS_TELEMETRY_STROBE        0x40U  /* Strobe trigger and pulse counts */
+#define COMMS_TELEMETRY_TIME          0x80U  /* Wall-clock time, system/time_sync */
+#define COMMS_TELEMETRY_ALL           0xFFU
+
+/* Telemetry subscriptions running at once, numbered from 1 */
+#define COMMS_TELEMETRY_STREAMS       4U
+
+/* Exported types ------------------------------------------------------------*/
+/* One light raising an alarm */
+typedef struct {
+  uint8_t light_id;          /* 1-VAL_LIGHT_COUNT */
+  uint8_t error_type;        /* ErrorType_t */
+  float value;               /* Measured value that caused the alarm */
+  uint64_t trip_us;          /* Time of the trip in microseconds since start-up, 0 for now */
+} COMMS_Alarm_Source_t;
+
+/* One telemetry stream due for a sample */
+typedef struct {
+  uint8_t stream;            /* 1-COMMS_TELEMETRY_STREAMS */
+  uint8_t fields;            /* COMMS_TELEMETRY_* fields to include */
+  uint16_t rate_centihz;     /* Rate samples are sent at, after any slowing down for the link */
+  VAL_Status status;         /* Set by COMMS_Handler_SendTelemetry */
+} COMMS_Telemetry_Stream_t;
 
 /* Exported functions prototypes ---------------------------------------------*/
 VAL_Status COMMS_Handler_Handler_Init(void);
 
 /**
- * @brief Send alarm event notification
- * @param lightId Light source ID that triggered the alarm (1-3)
- * @param errorType Type of error that occurred
- * @param value Measured value that caused the alarm
+ * @brief Set the device address and the kind of link
+ * @note  On a bus, commands without an address are dropped and no events
+ *        are sent; the UART drives the RS-485 driver enable
+ * @param address Device address (0-254)
+ * @param bus true on an RS-485 bus, false point-to-point
+ * @retval VAL_Status VAL_OK if successful, VAL_PARAM for the broadcast
+ *         address, else as VAL_Serial_SetRS485
+ */
+VAL_Status COMMS_Handler_SetAddress(uint8_t address, bool bus);
+
+/**
+ * @brief Set how long the link may stay silent and what the lights do then
+ * @note  Any valid frame restarts the timeout, the first one arms it; a
+ *        scene that was never saved turns all lights off
+ * @param timeout_ms Time without a valid frame, 0 turns the failsafe off
+ * @param scene Scene to recall (1-CONFIG_SCENE_COUNT), 0 for all lights off
+ */
+void COMMS_Handler_SetFailsafe(uint16_t timeout_ms, uint8_t scene);
+
+/**
+ * @brief Set the multicast groups the device answers to besides its address
+ * @note  A command to a group runs without a response, as a broadcast one
+ * @param groups Groups joined, bit 0 for COMMS_ADDRESS_GROUP_FIRST
+ */
+void COMMS_Handler_SetBusGroups(uint16_t groups);
+
+/**
+ * @brief Send one alarm event for the alarms raised in the same sample
+ * @param alarms Alarms raised, the first is also reported at the top level
+ * @param count Number of alarms (1-VAL_LIGHT_COUNT)
+ * @retval VAL_Status VAL_OK if successful, VAL_BUSY if no TX slot was free,
+ *         VAL_ERROR otherwise
+ */
+VAL_Status COMMS_Handler_SendAlarmEvents(const COMMS_Alarm_Source_t* alarms, uint8_t count);
+
+/**
+ * @brief Send a thermal warning event, the projected time to a light's
+ *        maximum temperature fell below the warning horizon
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param trend Temperature trend that raised the warning
+ * @retval VAL_Status VAL_OK if successful, VAL_BUSY if no TX slot was free,
+ *         VAL_ERROR otherwise
+ */
+VAL_Status COMMS_Handler_SendThermalWarning(uint8_t lightId, const LED_Driver_ThermalTrend_t* trend);
+
+/**
+ * @brief Send a power warning event, the MCU supply crossed its warning
+ *        level and the outputs were shed or are restored
+ * @param budget Output factor and supply state after the crossing
+ * @retval VAL_Status VAL_OK if successful, VAL_BUSY if no TX slot was free,
+ *         VAL_ERROR otherwise
+ */
+VAL_Status COMMS_Handler_SendPowerWarning(const LED_Driver_Budget_t* budget);
+
+/**
+ * @brief Send a rules/fired event, a rule with the event action fired
+ * @note  Called from the system coordinator task only
+ * @param rule Rule number (1-RULES_MAX)
+ * @param value Watched value when it fired, in mA, degrees or an alarm code
+ * @retval VAL_Status VAL_OK if successful, VAL_BUSY if no TX slot was free,
+ *         VAL_ERROR otherwise
+ */
+VAL_Status COMMS_Handler_SendRuleEvent(uint8_t rule, float value);
+
+/**
+ * @brief Queue a stored command macro for the worker task, without waiting
+ * @note  The commands run as they would from macro/run, without responses.
+ *        Called from the system coordinator task for a rule.
+ * @param macro Macro number (1-CONFIG_MACRO_COUNT)
+ * @retval VAL_Status VAL_OK if queued, VAL_BUSY if the pipeline is full or
+ *         the handler is not running, VAL_PARAM if invalid
+ */
+VAL_Status COMMS_Handler_RunMacro(uint8_t macro);
+
+/**
+ * @brief Send a telemetry sample to each stream due
+ * @note  Called from the system coordinator task only. The values common to
+ *        all streams are read once; each stream gets its own event, in the
+ *        format it subscribed with.
+ * @param streams Streams due; the status of each is set
+ * @param count Number of streams
+ * @param intensities Light intensities (VAL_LIGHT_COUNT entries)
+ * @param sensorData Sensor readings (VAL_LIGHT_COUNT entries)
+ * @param alarms Alarm codes (VAL_LIGHT_COUNT entries)
+ * @retval None
+ */
+void COMMS_Handler_SendTelemetry(COMMS_Telemetry_Stream_t* streams, uint8_t count, const uint8_t* intensities,
+                                 const LightSensorData_t* sensorData, const uint8_t* alarms);
+
+/**
+ * @brief Send a log message event
+ * @note  Called from the logger task only
+ * @param level Logger_Level_t of the message
+ * @param tick HAL tick when the message was logged
+ * @param text Formatted message
  * @retval VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
-VAL_Status COMMS_Handler_SendAlarmEvent(uint8_t lightId, uint8_t errorType, float value);
+VAL_Status COMMS_Handler_SendLogEvent(uint8_t level, uint32_t tick, const char* text);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,233 @@
+/**
+  ******************************************************************************
+  * @file    app_config.h
+  * @brief   Header for app_config.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_CONFIG_H
+#define __APP_CONFIG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val.h"
+#include "app_led_driver.h"
+#include "app_color.h"
+#include "app_rules.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define CONFIG_VERSION  11  /* Stored layout, bump when Config_Settings_t changes */
+#define CONFIG_CALIBRATION_VERSION  1   /* Stored layout, bump when AnalogCalibration changes */
+#define CONFIG_SCENE_VERSION  1   /* Stored layout, bump when Config_Scene_t changes */
+#define CONFIG_SCENE_COUNT    VAL_DATA_STORE_SCENES  /* Scenes, numbered from 1 */
+#define CONFIG_MACRO_VERSION  1   /* Stored layout, bump when Config_Macro_t changes */
+#define CONFIG_MACRO_COUNT    VAL_DATA_STORE_MACROS  /* Command macros, numbered from 1 */
+#define CONFIG_MACRO_BYTES    118  /* Command bytes of one macro */
+#define CONFIG_ADDRESS_MAX    239  /* Highest device address, those above are bus groups and broadcast */
+#define CONFIG_LIGHT_GROUPS   8    /* Light groups, numbered from 1 */
+#define CONFIG_BUS_GROUPS     15   /* Multicast groups on a bus, numbered from 1 */
+#define CONFIG_LIGHTS_ALL     ((1U << VAL_LIGHT_COUNT) - 1U)  /* Light mask of every light */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  uint16_t current_ma_per_mv;                 /* Current sensor scale at the ADC pin */
+  uint16_t temperature_cdeg_per_mv;           /* Temperature sensor scale at the ADC pin */
+  uint16_t sample_phase_permille;             /* Current sampling point in the PWM period, 0 free-running */
+  LED_Driver_Limits_t limits[VAL_LIGHT_COUNT];
+  uint16_t slew_permille_per_ms[VAL_LIGHT_COUNT];  /* PWM slew limit of each light, 0 none */
+  Color_Primary_t primaries[VAL_LIGHT_COUNT]; /* Measured colour of each light, for colour mixing */
+  uint8_t address;                            /* Device address on a shared link (0-CONFIG_ADDRESS_MAX) */
+  uint8_t bus;                                /* 1 on an RS-485 bus, 0 point-to-point */
+  uint16_t failsafe_ms;                       /* Link silence before the failsafe scene, 0 off */
+  uint8_t failsafe_scene;                     /* Scene applied then (1-CONFIG_SCENE_COUNT), 0 all off */
+  uint8_t light_groups[CONFIG_LIGHT_GROUPS];  /* Lights of each group, bit 0 for light 1, 0 unused */
+  uint16_t bus_groups;                        /* Multicast groups joined, bit 0 for group 1 */
+  uint8_t power_on;                           /* Restore_Mode_t, what the lights come up with */
+  uint8_t power_on_scene;                     /* Scene for RESTORE_SCENE (1-CONFIG_SCENE_COUNT) */
+  LED_Driver_Ageing_t ageing[VAL_LIGHT_COUNT];  /* Output lost with use by each light */
+  uint16_t trim_permille[VAL_LIGHT_COUNT];    /* Output of each light matched to other units */
+  uint8_t stop_mode;                          /* 1 lets the idle MCU enter stop mode, 0 (default) only sleep */
+} Config_Settings_t;
+
+/* Intensities of all lights, recalled together with one command */
+typedef struct {
+  uint16_t permille[VAL_LIGHT_COUNT];         /* Intensity of each light (0-1000) */
+  uint16_t duration_ms;                       /* Fade time on recall, 0 switches at once */
+  uint8_t curve;                              /* LED_Driver_FadeCurve_t */
+} Config_Scene_t;
+
+/* Commands run one after the other by one request, kept as the body of a
+ * binary batch frame: per command its code, argument length and arguments */
+typedef struct {
+  uint8_t length;                             /* Bytes used in commands, 0 if cleared */
+  uint8_t steps;                              /* Commands */
+  uint8_t commands[CONFIG_MACRO_BYTES];
+} Config_Macro_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Apply the settings stored in flash, if any
+ * @return VAL_Status VAL_OK; the defaults stay in use if nothing valid is stored
+ */
+VAL_Status Config_Init(void);
+
+/**
+ * @brief Get the settings in use, or those staged
+ * @param settings Pointer to store the settings
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if settings is NULL
+ */
+VAL_Status Config_Get(Config_Settings_t* settings);
+
+/**
+ * @brief Apply new settings and store them in flash
+ * @note While staging they are only checked and kept for Config_Commit
+ * @param settings New settings
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         applied but not stored
+ */
+VAL_Status Config_Set(const Config_Settings_t* settings);
+
+/**
+ * @brief Start staging changes, from the settings in use
+ * @return VAL_Status VAL_OK if successful, VAL_BUSY if already staging
+ */
+VAL_Status Config_Begin(void);
+
+/**
+ * @brief Apply the staged settings at once and store them with one write
+ * @note Refused settings stay staged, to be corrected or aborted
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if nothing is staged or
+ *         the settings are invalid, VAL_ERROR if applied but not stored
+ */
+VAL_Status Config_Commit(void);
+
+/**
+ * @brief Drop the staged settings, the ones in use stay
+ * @return None
+ */
+void Config_Abort(void);
+
+/**
+ * @brief Check whether changes are being staged
+ * @return bool true between Config_Begin and Config_Commit or Config_Abort
+ */
+bool Config_IsStaging(void);
+
+/**
+ * @brief Get the lights of a light group
+ * @param group Group number (1-CONFIG_LIGHT_GROUPS)
+ * @param mask Pointer to store the lights, bit 0 for light 1
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid or the group
+ *         has no lights
+ */
+VAL_Status Config_GetLightGroup(uint8_t group, uint32_t* mask);
+
+/**
+ * @brief Check whether the settings in use let the MCU enter stop mode
+ * @return bool true if enabled with config/set_stop_mode
+ */
+bool Config_IsStopModeEnabled(void);
+
+/**
+ * @brief Get the sensor calibration of a light
+ * @param light_id Light ID (1-VAL_LIGHT_COUNT)
+ * @param calibration Pointer to store the calibration
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status Config_GetCalibration(uint8_t light_id, AnalogCalibration* calibration);
+
+/**
+ * @brief Apply a new sensor calibration to a light and store it in flash
+ * @param light_id Light ID (1-VAL_LIGHT_COUNT)
+ * @param calibration New calibration
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         applied but not stored
+ */
+VAL_Status Config_SetCalibration(uint8_t light_id, const AnalogCalibration* calibration);
+
+/**
+ * @brief Get a scene, read in place from its flash record
+ * @param scene Scene number (1-CONFIG_SCENE_COUNT)
+ * @param data Pointer to store the scene
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR if the scene was never
+ *         saved, VAL_PARAM if invalid
+ */
+VAL_Status Config_GetScene(uint8_t scene, Config_Scene_t* data);
+
+/**
+ * @brief Save a scene and store it in flash
+ * @param scene Scene number (1-CONFIG_SCENE_COUNT)
+ * @param data New scene
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         not stored, the previous scene stays in use
+ */
+VAL_Status Config_SetScene(uint8_t scene, const Config_Scene_t* data);
+
+/**
+ * @brief Get a command macro, read in place from its flash record
+ * @param macro Macro number (1-CONFIG_MACRO_COUNT)
+ * @param data Pointer to store the macro
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR if the macro was never
+ *         saved or is cleared, VAL_PARAM if invalid
+ */
+VAL_Status Config_GetMacro(uint8_t macro, Config_Macro_t* data);
+
+/**
+ * @brief Save a command macro and store it in flash
+ * @note Only the framing is checked here; the commands themselves are
+ *       checked by the caller, which knows them. A length of 0 clears it.
+ * @param macro Macro number (1-CONFIG_MACRO_COUNT)
+ * @param data New macro
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         not stored, the previous macro stays in use
+ */
+VAL_Status Config_SetMacro(uint8_t macro, const Config_Macro_t* data);
+
+/**
+ * @brief Check a rule, and that the scene, macro or curve it names exist
+ * @param rule Rule to check
+ * @return VAL_Status VAL_OK if it can be added, VAL_PARAM if invalid
+ */
+VAL_Status Config_CheckRule(const Rules_Rule_t* rule);
+
+/**
+ * @brief Read part of an export of the whole configuration
+ * @note Offset 0 takes a new snapshot, later offsets read from it
+ * @param offset Byte offset into the export
+ * @param data Buffer to store the bytes
+ * @param max Size of the buffer
+ * @param length Pointer to store the bytes read, 0 past the end
+ * @param size Pointer to store the size of the whole export
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid or no
+ *         snapshot was taken
+ */
+VAL_Status Config_Export(uint32_t offset, uint8_t* data, uint16_t max, uint16_t* length, uint16_t* size);
+
+/**
+ * @brief Receive part of an export, and import it once complete
+ * @note Parts must come in order, offset 0 starts over. Nothing is changed
+ *       unless the whole export is valid.
+ * @param offset Byte offset of the part, the bytes received so far
+ * @param data Bytes of the part
+ * @param length Number of bytes
+ * @param received Pointer to store the bytes received, the whole export
+ *        once imported
+ * @param complete Pointer to store true if this was the last part, whether
+ *        or not the export was imported
+ * @return VAL_Status VAL_OK if received or imported, VAL_PARAM if out of
+ *         order or the export is invalid, VAL_BUSY if settings are staged,
+ *         VAL_ERROR if imported but not all of it stored
+ */
+VAL_Status Config_Import(uint32_t offset, const uint8_t* data, uint16_t length, uint16_t* received, bool* complete);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_CONFIG_H */
@@ -0,0 +1,82 @@
+/**
+  ******************************************************************************
+  * @file    app_counters.h
+  * @brief   Header for app_counters.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_COUNTERS_H
+#define __APP_COUNTERS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define COUNTERS_VERSION         1  /* Layout of the counters in the data store */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  COUNTERS_BOOTS = 0,               /* Start-ups, whatever the cause */
+  COUNTERS_WATCHDOG_RESETS,         /* Resets by the independent watchdog */
+  COUNTERS_ALARM_TRIPS,             /* Alarms raised on any light */
+  COUNTERS_LINK_DROPS,              /* Host link silent past the failsafe timeout */
+  COUNTERS_COUNT
+} Counters_Id_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Take over the counters kept in the RTC backup registers and count the boot
+ * @note  Called right after VAL_Init, before anything counts
+ * @return None
+ */
+void Counters_Init(void);
+
+/**
+ * @brief Add the stored counters if the backup registers were lost
+ * @note  Called once the data store runs
+ * @return None
+ */
+void Counters_Restore(void);
+
+/**
+ * @brief Count one event
+ * @note  Safe to call from interrupts, a backup register write
+ * @param id Counter to increment
+ * @return None
+ */
+void Counters_Increment(Counters_Id_t id);
+
+/**
+ * @brief Get all counters
+ * @param values Array to store the counters, COUNTERS_COUNT entries
+ * @return None
+ */
+void Counters_GetAll(uint32_t* values);
+
+/**
+ * @brief Get the name of a counter
+ * @param id Counter
+ * @return const char* Name, "unknown" if out of range
+ */
+const char* Counters_GetName(Counters_Id_t id);
+
+/**
+ * @brief Store the counters in flash, unless they are the ones stored last
+ * @note  Error log task only, the one that makes background writes
+ * @return VAL_Status VAL_OK if stored or unchanged, VAL_BUSY if flash was in
+ *         use, VAL_ERROR if the write failed
+ */
+VAL_Status Counters_Save(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_COUNTERS_H */
@@ -0,0 +1,126 @@
+/**
+  ******************************************************************************
+  * @file    app_crash.h
+  * @brief   Header for app_crash.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_CRASH_H
+#define __APP_CRASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+#include "app_resources.h"
+#include "app_trace.h"
+#include "FreeRTOS.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define CRASH_TRACE_ENTRIES  8    /* Last trace entries kept with a crash */
+
+/* Exported types ------------------------------------------------------------*/
+/* Faults are numbered as their exceptions */
+typedef enum {
+  CRASH_CAUSE_NONE = 0,
+  CRASH_CAUSE_ASSERT = 1,           /* configASSERT failed */
+  CRASH_CAUSE_STACK_OVERFLOW = 2,   /* FreeRTOS stack check */
+  CRASH_CAUSE_HARD_FAULT = 3,
+  CRASH_CAUSE_MEM_FAULT = 4,
+  CRASH_CAUSE_BUS_FAULT = 5,
+  CRASH_CAUSE_USAGE_FAULT = 6,
+  CRASH_CAUSE_COUNT
+} Crash_Cause_t;
+
+typedef struct {
+  uint8_t cause;             /* Crash_Cause_t */
+  uint8_t task_count;        /* Entries in tasks */
+  uint8_t trace_count;       /* Entries in trace */
+  uint8_t in_handler;        /* 1 if an interrupt handler was running */
+  uint32_t line;             /* Source line of a failed configASSERT, else 0 */
+  uint32_t tick_ms;          /* HAL tick at the crash */
+  uint32_t r[5];             /* R0-R3 and R12 of a fault, else 0 */
+  uint32_t lr;
+  uint32_t pc;               /* Faulting instruction, or the caller of the assert */
+  uint32_t xpsr;
+  uint32_t sp;               /* Stack pointer before the fault */
+  uint32_t cfsr;             /* SCB fault status and address registers */
+  uint32_t hfsr;
+  uint32_t mmfar;
+  uint32_t bfar;
+  char task[configMAX_TASK_NAME_LEN];  /* Task running, empty before the scheduler */
+  Resources_Task_t tasks[RESOURCES_MAX_TASKS];
+  uint32_t trace_first;      /* Sequence number of trace[0] */
+  Trace_Entry_t trace[CRASH_TRACE_ENTRIES];
+} Crash_Report_t;
+
+/* Exported macro ------------------------------------------------------------*/
+/* Body of a naked fault handler, leaves the stack as the fault left it */
+#ifdef SIMULATION
+#define CRASH_FAULT_ENTRY()  __asm volatile ("jmp Crash_FaultEntry")
+#else
+#define CRASH_FAULT_ENTRY()  __asm volatile ("b Crash_FaultEntry")
+#endif
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Take over the crash report left by the previous run
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status Crash_Init(void);
+
+/**
+ * @brief Get the crash that caused the last reset
+ * @return const Crash_Report_t* Report, NULL if the last reset was not a crash
+ */
+const Crash_Report_t* Crash_GetReport(void);
+
+/**
+ * @brief Get the protocol name of a crash cause
+ * @param cause Cause
+ * @return const char* Cause name, "unknown" for invalid values
+ */
+const char* Crash_GetCauseName(Crash_Cause_t cause);
+
+/**
+ * @brief Record a failed configASSERT and reset
+ * @param line Source line of the assert
+ * @return None
+ */
+void Crash_Assert(uint32_t line) __attribute__((noreturn));
+
+/**
+ * @brief Record a stack overflow of the running task and reset
+ * @return None
+ */
+void Crash_StackOverflow(void) __attribute__((noreturn));
+
+/**
+ * @brief Fault entry, see CRASH_FAULT_ENTRY
+ * @return None
+ */
+void Crash_FaultEntry(void);
+
+/**
+ * @brief Add a task to those whose stack use is recorded (traceTASK_CREATE)
+ * @param task Task handle
+ * @return None
+ */
+void Crash_TaskCreated(void* task);
+
+/**
+ * @brief Remove a deleted task (traceTASK_DELETE)
+ * @param task Task handle
+ * @return None
+ */
+void Crash_TaskDeleted(void* task);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_CRASH_H */
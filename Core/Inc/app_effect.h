@@ -0,0 +1,94 @@
+/**
+  ******************************************************************************
+  * @file    app_effect.h
+  * @brief   Header for app_effect.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_EFFECT_H
+#define __APP_EFFECT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define EFFECT_PERIOD_MIN_US    20000U      /* Period range of an effect */
+#define EFFECT_PERIOD_MAX_US    60000000U
+#define EFFECT_UNITY            1000U       /* Full scale of the modulation */
+
+/* Exported types ------------------------------------------------------------*/
+/* Waveform of an effect, each starting at its crest */
+typedef enum {
+  EFFECT_SHAPE_OFF = 0,       /* No effect */
+  EFFECT_SHAPE_SINE,          /* Breathing */
+  EFFECT_SHAPE_TRIANGLE,      /* Linear pulse */
+  EFFECT_SHAPE_SQUARE,        /* Strobe, on for the width of each period */
+  EFFECT_SHAPE_FLICKER,       /* Random dips, the period sets how fast they come and go */
+  EFFECT_SHAPE_COUNT
+} Effect_Shape_t;
+
+typedef struct {
+  Effect_Shape_t shape;
+  uint32_t period_us;         /* EFFECT_PERIOD_MIN_US-EFFECT_PERIOD_MAX_US */
+  uint32_t width_us;          /* On-time of a square wave, 0 for half the period */
+  uint16_t depth_permille;    /* Trough below the crest, in permille of the crest */
+} Effect_Config_t;
+
+/* State of one running effect, advanced one row at a time */
+typedef struct {
+  Effect_Shape_t shape;
+  uint32_t phase;             /* Position in the period, full circle 2^32 */
+  uint32_t increment;         /* Phase per row */
+  uint32_t threshold;         /* Phase a square wave turns off at */
+  uint32_t noise;             /* Flicker noise state, never 0 */
+  uint32_t alpha_q16;         /* Flicker smoothing per row, Q16 */
+  int32_t level_q16;          /* Smoothed flicker level, Q16 modulation */
+} Effect_Generator_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Check an effect configuration
+ * @param config Effect to check
+ * @return VAL_Status VAL_OK if it can be played, VAL_PARAM otherwise
+ */
+VAL_Status Effect_Validate(const Effect_Config_t* config);
+
+/**
+ * @brief Start a generator at the crest of an effect
+ * @note  Any context, no floating point
+ * @param generator Generator to start
+ * @param config Effect to generate
+ * @param row_ns Time each row of output lasts, in nanoseconds
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if the configuration is
+ *         invalid or a row is longer than the period
+ */
+VAL_Status Effect_Start(Effect_Generator_t* generator, const Effect_Config_t* config, uint32_t row_ns);
+
+/**
+ * @brief Get the modulation of the next row and advance by one row
+ * @note  Any context, a few integer operations
+ * @param generator Started generator
+ * @return uint16_t Modulation, EFFECT_UNITY at the crest and 0 at the trough
+ */
+uint16_t Effect_Step(Effect_Generator_t* generator);
+
+/**
+ * @brief Get the intensity of a light for a modulation
+ * @param crest_permille Intensity at the crest (0-1000)
+ * @param depth_permille Trough below the crest, in permille of the crest
+ * @param modulation Modulation from Effect_Step
+ * @return uint16_t Intensity (0-1000)
+ */
+uint16_t Effect_Level(uint16_t crest_permille, uint16_t depth_permille, uint16_t modulation);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_EFFECT_H */
@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file    app_integrity.h
+  * @brief   Header for app_integrity.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_INTEGRITY_H
+#define __APP_INTEGRITY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define INTEGRITY_SLICE_BYTES    128U  /* Flash read per idle entry */
+#define INTEGRITY_SLICE_WORDS    32U   /* Spare RAM words per idle entry */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  INTEGRITY_CHECK_IMAGE = 0,       /* CRC-32 of the firmware image in flash */
+  INTEGRITY_CHECK_CONFIG,          /* CRC-32 of the records of the key/value store */
+  INTEGRITY_CHECK_RAM,             /* Alternating pattern in the spare RAM */
+  INTEGRITY_CHECK_COUNT
+} Integrity_Check_t;
+
+typedef struct {
+  uint32_t bytes;            /* Covered by the last complete pass */
+  uint32_t passes;           /* Complete passes since start-up */
+  uint32_t errors;           /* Flash: passes whose CRC changed; RAM: words that changed */
+  uint32_t crc;              /* CRC-32 of the last pass, 0 for the RAM check */
+  uint32_t pass_ms;          /* Time the last pass took to cover its region */
+  uint32_t age_ms;           /* Time since the last pass ended */
+} Integrity_Result_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Get the results of the background checks
+ * @param results Array of INTEGRITY_CHECK_COUNT entries to store them
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if results is NULL
+ */
+VAL_Status Integrity_GetResults(Integrity_Result_t* results);
+
+/**
+ * @brief Get the name of a check as reported to the host
+ * @param check Check to query
+ * @return const char* Check name, "unknown" for invalid values
+ */
+const char* Integrity_GetCheckName(Integrity_Check_t check);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_INTEGRITY_H */
@@ -0,0 +1,107 @@
+/**
+  ******************************************************************************
+  * @file    app_jitter.h
+  * @brief   Header for app_jitter.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_JITTER_H
+#define __APP_JITTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define JITTER_BUCKET_COUNT      8    /* Bucket n ends at JITTER_FIRST_US << n, the last is open */
+#define JITTER_FIRST_US          2    /* Upper bound of the first bucket */
+
+/* Exported types ------------------------------------------------------------*/
+/* Periodic loops whose start times are tracked */
+typedef enum {
+  JITTER_LOOP_SAMPLING = 0,   /* ADC block processing */
+  JITTER_LOOP_CONTROL,        /* Alarm, derating and current loop steps of a block */
+  JITTER_LOOP_COUNT
+} Jitter_Loop_t;
+
+typedef struct {
+  uint32_t period_us;                     /* Nominal period, 0 until the loop has run */
+  uint32_t iterations;                    /* Intervals measured */
+  uint32_t missed;                        /* Whole periods an iteration came late by */
+  uint32_t max_early_us;                  /* Largest interval under the period, by how much */
+  uint32_t max_late_us;                   /* Largest interval over the period, by how much */
+  uint32_t early[JITTER_BUCKET_COUNT];    /* Intervals under the period, by error */
+  uint32_t late[JITTER_BUCKET_COUNT];     /* Intervals on or over the period, by error */
+} Jitter_Stats_t;
+
+/* Worst errors since the previous telemetry sample */
+typedef struct {
+  uint16_t max_early_us;      /* Saturates at 65535 */
+  uint16_t max_late_us;
+  uint32_t missed;            /* As Jitter_Stats_t, since the last reset */
+} Jitter_Window_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Initialize the jitter tracker
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status Jitter_Init(void);
+
+/**
+ * @brief Record the start of a loop iteration
+ * @note Interrupt context. A change of the period restarts the measurement
+ *       without counting the interval.
+ * @param loop Loop that started
+ * @param start_us VAL_SysClock_GetMicros when it started
+ * @param period_us Nominal period of the loop
+ * @return None
+ */
+void Jitter_Mark(Jitter_Loop_t loop, uint32_t start_us, uint32_t period_us);
+
+/**
+ * @brief Forget the last start of every loop, after the loops were stopped
+ * @note The next iteration of each loop is not measured
+ * @return None
+ */
+void Jitter_Resync(void);
+
+/**
+ * @brief Get the figures of a loop
+ * @param loop Loop to query
+ * @param stats Pointer to store the figures
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status Jitter_GetStats(Jitter_Loop_t loop, Jitter_Stats_t* stats);
+
+/**
+ * @brief Get the worst errors of a loop since the previous call and clear them
+ * @param loop Loop to query
+ * @param window Pointer to store the figures
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status Jitter_TakeWindow(Jitter_Loop_t loop, Jitter_Window_t* window);
+
+/**
+ * @brief Clear the figures of all loops
+ * @return None
+ */
+void Jitter_Reset(void);
+
+/**
+ * @brief Get the name of a loop
+ * @param loop Loop
+ * @return const char* Name, "unknown" for an invalid loop
+ */
+const char* Jitter_GetLoopName(Jitter_Loop_t loop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_JITTER_H */
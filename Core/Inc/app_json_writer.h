@@ -0,0 +1,132 @@
+/**
+  ******************************************************************************
+  * @file    app_json_writer.h
+  * @brief   Header for app_json_writer.c module
+  ******************************************************************************
+  * @attention
+  *
+  * Append-only JSON text writer over a caller provided buffer. Nothing is
+  * allocated and no printf family function is used, so the stack use of a
+  * formatter is fixed. A write that does not fit sets the overflow flag and
+  * every later write is ignored; check it once before sending.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_JSON_WRITER_H
+#define __APP_JSON_WRITER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  char* buffer;
+  size_t size;
+  size_t length;     /* Bytes written so far */
+  bool overflow;     /* A write did not fit, the text is incomplete */
+} JSON_Writer_t;
+
+/* Exported macro ------------------------------------------------------------*/
+/* Append a string literal, its length is known at compile time. The empty
+ * literals make anything else, a pointer or a conditional, fail to compile,
+ * where sizeof would otherwise give the size of a pointer */
+#define JSON_Writer_Literal(writer, literal) \
+  JSON_Writer_Append((writer), "" literal "", sizeof(literal) - 1)
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Start writing into a buffer
+ * @param writer Writer to initialize
+ * @param buffer Destination buffer
+ * @param size Size of the destination buffer
+ * @return None
+ */
+void JSON_Writer_Init(JSON_Writer_t* writer, char* buffer, size_t size);
+
+/**
+ * @brief Append raw bytes, e.g. a constant JSON fragment
+ * @param writer Writer
+ * @param text Bytes to append
+ * @param length Number of bytes
+ * @return None
+ */
+void JSON_Writer_Append(JSON_Writer_t* writer, const char* text, size_t length);
+
+/**
+ * @brief Append a single character
+ * @param writer Writer
+ * @param c Character to append
+ * @return None
+ */
+void JSON_Writer_Char(JSON_Writer_t* writer, char c);
+
+/**
+ * @brief Append the escaped contents of a string, without quotes
+ * @param writer Writer
+ * @param str NUL terminated string
+ * @return None
+ */
+void JSON_Writer_Text(JSON_Writer_t* writer, const char* str);
+
+/**
+ * @brief Append a quoted and escaped string value
+ * @param writer Writer
+ * @param str NUL terminated string
+ * @return None
+ */
+void JSON_Writer_String(JSON_Writer_t* writer, const char* str);
+
+/**
+ * @brief Append an unsigned integer
+ * @param writer Writer
+ * @param value Value to append
+ * @return None
+ */
+void JSON_Writer_Uint(JSON_Writer_t* writer, uint32_t value);
+
+/**
+ * @brief Append a 64-bit unsigned integer, e.g. a wall-clock time in milliseconds
+ * @param writer Writer
+ * @param value Value to append
+ * @return None
+ */
+void JSON_Writer_Uint64(JSON_Writer_t* writer, uint64_t value);
+
+/**
+ * @brief Append a signed integer
+ * @param writer Writer
+ * @param value Value to append
+ * @return None
+ */
+void JSON_Writer_Int(JSON_Writer_t* writer, int32_t value);
+
+/**
+ * @brief Append true or false
+ * @param writer Writer
+ * @param value Value to append
+ * @return None
+ */
+void JSON_Writer_Bool(JSON_Writer_t* writer, bool value);
+
+/**
+ * @brief Append a number with a fixed count of decimals, rounded
+ * @param writer Writer
+ * @param value Value to append; null is written if it is not representable
+ * @param decimals Number of decimals (0-6)
+ * @return None
+ */
+void JSON_Writer_Fixed(JSON_Writer_t* writer, float value, uint8_t decimals);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_JSON_WRITER_H */
@@ -0,0 +1,91 @@
+/**
+  ******************************************************************************
+  * @file    app_latency.h
+  * @brief   Header for app_latency.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_LATENCY_H
+#define __APP_LATENCY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+#include "app_transport.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define LATENCY_COMMAND_SLOTS    112  /* Histograms for commands, at least the command table */
+#define LATENCY_BUCKET_COUNT     16   /* Bucket n ends at LATENCY_FIRST_US << n, the last is open */
+#define LATENCY_FIRST_US         16   /* Upper bound of the first bucket */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  uint32_t count;      /* Measurements since the last read */
+  uint32_t p50_us;     /* Upper bound of the bucket holding the median, at most max_us */
+  uint32_t p90_us;     /* As p50_us for the 90th percentile */
+  uint32_t p99_us;     /* As p50_us for the 99th percentile */
+  uint32_t max_us;     /* Longest measurement */
+} Latency_Summary_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Initialize the latency histograms
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status Latency_Init(void);
+
+/**
+ * @brief Record the time from a command frame received to its response queued
+ * @param slot Command table index of the command
+ * @param elapsed Duration in cycles
+ * @return None
+ */
+void Latency_RecordCommand(uint8_t slot, uint32_t elapsed);
+
+/**
+ * @brief Note that a response was just queued on the active transport
+ * @note Task context, right after the transport accepted the response
+ * @return None
+ */
+void Latency_ResponseQueued(void);
+
+/**
+ * @brief Time the queued response once the transport has sent it
+ * @note Interrupt context, from every transport TX completion
+ * @return None
+ */
+void Latency_TxComplete(void);
+
+/**
+ * @brief Get the figures of a command and clear its histogram
+ * @param slot Command table index of the command
+ * @param summary Pointer to store the figures
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status Latency_TakeCommand(uint8_t slot, Latency_Summary_t* summary);
+
+/**
+ * @brief Get the figures of a transport and clear its histogram
+ * @param id Transport to query
+ * @param summary Pointer to store the figures
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status Latency_TakeTransport(Transport_Id_t id, Latency_Summary_t* summary);
+
+/**
+ * @brief Get the number of measurements of a command since the last read
+ * @param slot Command table index of the command
+ * @return uint32_t Measurements, 0 for an invalid slot
+ */
+uint32_t Latency_GetCommandCount(uint8_t slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_LATENCY_H */
@@ -15,24 +15,220 @@ extern "C" {
 
 /* Includes ------------------------------------------------------------------*/
 #include <stdint.h>
+#include <stdbool.h>
 #include "val_status.h"
+#include "app_effect.h"
 
 /* Exported types ------------------------------------------------------------*/
 typedef struct {
-    uint8_t light_id;   /* Light ID (1-3) */
+    uint8_t light_id;   /* Light ID (1-VAL_LIGHT_COUNT) */
     float current;     /* Current in milliamps */
     float temperature; /* Temperature in degrees Celsius */
+    float current_raw;     /* Latest unfiltered current */
+    float temperature_raw; /* Latest unfiltered temperature */
 } LightSensorData_t;
 
+/* When sensor readings were taken, and the MCU readings of the same scans */
+typedef struct {
+    uint32_t sequence;      /* ADC scans completed up to the readings */
+    uint32_t timestamp_us;  /* Microsecond time of the last scan block */
+    uint16_t supply_mv;     /* Analog supply voltage */
+    int16_t mcu_temperature_cdeg;  /* MCU die temperature, centi-degrees */
+} LightSampleStamp_t;
+
+/* Event flags passed to the LED driver event callback */
+#define LED_DRIVER_EVENT_INTENSITY_CHANGED  0x01U  /* Output intensity changed */
+#define LED_DRIVER_EVENT_ALARM_CHANGED      0x02U  /* Alarm raised or cleared */
+#define LED_DRIVER_EVENT_THERMAL_WARNING    0x04U  /* A light is projected to overheat soon */
+#define LED_DRIVER_EVENT_POWER_WARNING      0x08U  /* MCU supply fell under or rose over its warning level */
+
+/* Projected time to the maximum temperature that raises a thermal warning */
+#define LED_DRIVER_THERMAL_HORIZON_MS       30000U
+
+/* Flicker measurement window, in scans */
+#define LED_DRIVER_FLICKER_WINDOW_DEFAULT   1000U  /* 1 s at the default scan rate */
+#define LED_DRIVER_FLICKER_WINDOW_MIN       16U
+
+typedef void (*LED_Driver_EventCallback)(uint32_t events);
+
+/* Fade curves, from the start to the target intensity */
+typedef enum {
+    LED_DRIVER_FADE_LINEAR = 0,     /* Constant rate */
+    LED_DRIVER_FADE_EASE,           /* Slow start and end (smoothstep) */
+    LED_DRIVER_FADE_PERCEPTUAL,     /* Constant rate in perceived brightness */
+    LED_DRIVER_FADE_CURVE_COUNT
+} LED_Driver_FadeCurve_t;
+
+/* Mapping from intensity to PWM duty cycle */
+typedef enum {
+    LED_DRIVER_CURVE_LINEAR = 0,    /* Duty cycle proportional to intensity */
+    LED_DRIVER_CURVE_GAMMA,         /* Gamma corrected, per-colour offset */
+    LED_DRIVER_CURVE_COUNT
+} LED_Driver_OutputCurve_t;
+
+/* Alarm state of a light source */
+typedef enum {
+    LED_DRIVER_ALARM_NORMAL = 0,    /* Within limits */
+    LED_DRIVER_ALARM_WARNING,       /* Above a warning threshold, output stays on */
+    LED_DRIVER_ALARM_TRIPPED,       /* Output off, condition still present */
+    LED_DRIVER_ALARM_RELEASED,      /* Output off, condition gone; may be cleared */
+    LED_DRIVER_ALARM_STATE_COUNT
+} LED_Driver_AlarmState_t;
+
+/* Alarm evaluation, common to all lights. Readings are evaluated once per
+ * completed ADC block (VAL_Analog_GetBlockScans scans). */
+typedef struct {
+    uint8_t trip_samples;           /* Consecutive readings over a limit that raise the alarm */
+    uint8_t release_samples;        /* Consecutive readings under the release thresholds to release it */
+    uint16_t hysteresis_permille;   /* Release thresholds, in permille below the limits (0-500) */
+    bool auto_recover;              /* Re-enable a released light after the backoff delay */
+    uint32_t recover_delay_ms;      /* Backoff after the first trip, doubled per automatic recovery */
+    uint32_t recover_max_delay_ms;  /* Longest backoff; a clean run this long resets it */
+} LED_Driver_AlarmConfig_t;
+
+typedef struct {
+    LED_Driver_AlarmState_t state;
+    uint8_t code;                   /* Active alarm (ErrorType_t), 0 for none */
+    uint16_t trip_count;            /* Alarms raised since start-up */
+    uint64_t trip_us;               /* Time of the last trip, microseconds since start-up, 0 if none */
+    uint64_t violation_us;          /* First reading over the limit of the last trip, as trip_us */
+    uint32_t recover_in_ms;         /* Time to the automatic recovery, 0 if none is due */
+} LED_Driver_AlarmInfo_t;
+
+/* Alarm limits of one light in engineering units; 0 < warn <= max, and the
+ * hardware trip current is not below the maximum */
+typedef struct {
+    int32_t current_warn_ma;        /* Warning current */
+    int32_t current_max_ma;         /* Debounced over-current alarm */
+    int32_t current_trip_ma;        /* Hardware cutoff on single conversions */
+    int32_t temperature_warn_cdeg;  /* Warning temperature */
+    int32_t temperature_max_cdeg;   /* Debounced over-temperature alarm */
+} LED_Driver_Limits_t;
+
+/* Thermal derating, common to all lights: a PI controller scales the output
+ * down to hold a light at its warning temperature */
+typedef struct {
+    bool enabled;
+    uint16_t kp_permille_per_deg;   /* Output reduction per degree over the warning temperature (0-1000) */
+    uint16_t ki_permille_per_deg_s; /* Reduction added per degree-second over it (0-1000) */
+    uint16_t min_permille;          /* Lowest derate factor; beyond it the alarm trips as before */
+} LED_Driver_DerateConfig_t;
+
+/* Supply current budget, common to all lights: above the limit every output
+ * is scaled by the same factor */
+typedef struct {
+    int32_t limit_ma;               /* Largest total current, 0 for no limit */
+    int32_t total_ma;               /* Sum of the filtered currents at the last block */
+    uint16_t permille;              /* Factor applied to every output, 1000 for the full output */
+    bool supply_low;                /* MCU supply under its warning level, the factor is held down */
+} LED_Driver_Budget_t;
+
+/* Constant-current regulation, common to all lights: a PID controller sets
+ * the duty cycle of a regulated light to hold its filtered current at the
+ * target. Duty cycles are in 1/65536 of the PWM period. */
+typedef struct {
+    uint8_t interval_blocks;        /* ADC blocks per controller step (1-255) */
+    uint16_t kp;                    /* Duty per mA of error */
+    uint16_t ki;                    /* Duty added per mA-second of error */
+    uint16_t kd;                    /* Duty taken off per mA/s rise of the current */
+    uint16_t output_min_permille;   /* Lowest duty cycle while regulating */
+    uint16_t output_max_permille;   /* Highest duty cycle, scaled down by derating */
+} LED_Driver_CurrentLoopConfig_t;
+
+/* Strobe mode: every edge on the trigger input, or every period, fires one pulse */
+typedef struct {
+    bool active;
+    bool falling_edge;              /* Fires on the falling instead of the rising edge */
+    uint32_t duration_us;           /* Pulse length */
+    uint32_t period_us;             /* Pulse period, 0 when fired by the trigger input */
+    uint32_t triggers;              /* Edges seen since the strobe was started */
+    uint32_t pulses;                /* Pulses completed */
+    uint32_t missed;                /* Edges that came while a pulse was running */
+} LED_Driver_StrobeStatus_t;
+
+/* Usage of one light source over its life, for maintenance planning.
+ * Integrated on every ADC block over the block's nominal length. */
+typedef struct {
+    uint64_t charge_ma_us;          /* Measured current over time, mA x us */
+    uint64_t duty_permille_us;      /* PWM duty cycle over time, permille x us */
+    uint64_t over_warning_us;       /* Time above the warning temperature */
+} LED_Driver_Usage_t;
+
+/* Points of an ageing curve, and the lowest output one may fall to; the
+ * on-time that makes up for it is at most VAL_PWM_SCALE_MAX */
+#define LED_DRIVER_AGEING_POINTS        6U
+#define LED_DRIVER_AGEING_MIN_PERMILLE  500U
+
+/* Output trim of a light, matching it to other units by a shorter on-time;
+ * with the ageing compensation on top it stays within VAL_PWM_SCALE_MIN
+ * and VAL_PWM_SCALE_MAX */
+#define LED_DRIVER_TRIM_MIN_PERMILLE    VAL_PWM_SCALE_MIN
+#define LED_DRIVER_TRIM_MAX_PERMILLE    VAL_PWM_SCALE_UNITY
+
+/* Light output one light source loses with use, made up for by a longer
+ * on-time. Point n is the output left after (n + 1) x step_hours at full
+ * output, in permille of the new output; linear between points, held
+ * after the last. */
+typedef struct {
+    uint16_t step_hours;            /* Equivalent full-output hours between points, 0 off */
+    uint16_t output_permille[LED_DRIVER_AGEING_POINTS];  /* Non-increasing */
+} LED_Driver_Ageing_t;
+
+/* Temperature trend of one light source, from a least squares fit over
+ * the last 8 s of filtered temperatures */
+typedef struct {
+    int32_t temperature_cdeg;       /* Temperature at the last point */
+    int32_t slope_cdeg_per_s;       /* Rise rate in centi-degrees per second */
+    uint32_t time_to_limit_ms;      /* Projected time to the maximum temperature, UINT32_MAX if not heating */
+    bool warning;                   /* A thermal warning was raised and has not re-armed */
+    uint16_t warnings;              /* Thermal warnings raised since start-up */
+} LED_Driver_ThermalTrend_t;
+
+/* Progress of the flicker measurement, which runs once per output change */
+typedef enum {
+    LED_DRIVER_FLICKER_SETTLING = 0,  /* First window after a change, takes the averages */
+    LED_DRIVER_FLICKER_MEASURING,     /* Second window, measured against them */
+    LED_DRIVER_FLICKER_DONE           /* Metrics valid until the next change */
+} LED_Driver_FlickerState_t;
+
+typedef struct {
+    LED_Driver_FlickerState_t state;
+    uint16_t window_scans;          /* Raw samples per window */
+    uint32_t measurements;          /* Windows measured since start-up */
+} LED_Driver_FlickerStatus_t;
+
+/* Flicker of one light source's current over the last measured window */
+typedef struct {
+    uint16_t percent_centi;         /* (max - min) / (max + min), hundredths of a percent */
+    uint16_t index_e4;              /* Area above the average over the total area, ten-thousandths */
+} LED_Driver_Flicker_t;
+
+/* Longest fade accepted by LED_Driver_FadeTo */
+#define LED_DRIVER_FADE_MAX_MS  60000U
+
+/* Intensity that keeps a light as it is, in the all-lights calls */
+#define LED_DRIVER_PERMILLE_HOLD  0xFFFFU
+
 /* Exported functions prototypes ---------------------------------------------*/
 VAL_Status LED_Driver_Init(void);
 VAL_Status LED_Driver_SetIntensity(uint8_t lightId, uint8_t intensity);
 VAL_Status LED_Driver_SetAllIntensities(uint8_t *intensities);
+VAL_Status LED_Driver_SetIntensityPermille(uint8_t lightId, uint16_t permille);
+VAL_Status LED_Driver_SetAllIntensitiesPermille(const uint16_t* permille);
 VAL_Status LED_Driver_ClearAlarm(uint8_t lightId);
+VAL_Status LED_Driver_ClearAlarms(uint32_t mask, uint32_t* failed);
+
+/**
+ * @brief Register a callback notified when intensities or alarms change
+ * @param callback Callback function, or NULL. Called from task context, and
+ *        from interrupt context for alarm transitions and hardware cutoffs
+ * @return None
+ */
+void LED_Driver_SetEventCallback(LED_Driver_EventCallback callback);
 
 /**
  * @brief Get the current intensity of a specific light source
- * @param lightId Light source ID (1-3)
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
  * @param intensity Pointer to store the retrieved intensity
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
@@ -45,28 +241,440 @@ VAL_Status LED_Driver_GetIntensity(uint8_t lightId, uint8_t* intensity);
  */
 VAL_Status LED_Driver_GetAllIntensities(uint8_t* intensities);
 
+/**
+ * @brief Get the current intensity of a specific light source in permille
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param permille Pointer to store the retrieved intensity (0-1000)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_GetIntensityPermille(uint8_t lightId, uint16_t* permille);
+
+/**
+ * @brief Get intensities for all light sources in permille
+ * @param permille Array to store retrieved intensities
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_GetAllIntensitiesPermille(uint16_t* permille);
+
+/**
+ * @brief Check whether all outputs are off with nothing left to monitor
+ * @return bool true if no output is on, fading, strobing or in an alarm state
+ */
+bool LED_Driver_IsIdle(void);
+
+/**
+ * @brief Check whether a fade or a current loop is driving the outputs
+ * @return bool true while fading or while any light holds a target current
+ */
+bool LED_Driver_IsControlActive(void);
+
+#ifdef BENCHMARK
+/**
+ * @brief Make a light read as over current until its alarm trips
+ * @param light_id Light source ID (1-VAL_LIGHT_COUNT)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_InjectFault(uint8_t light_id);
+#endif
+
+/**
+ * @brief Fade a light source to a target intensity in the background
+ * @note A new fade, a set intensity call or an alarm stops a running fade
+ *       where it is. Reads return the target intensity while fading.
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param permille Target intensity (0-1000)
+ * @param durationMs Fade duration in milliseconds (0 sets it at once)
+ * @param curve Fade curve
+ * @return VAL_Status VAL_OK if the fade started, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_FadeTo(uint8_t lightId, uint16_t permille, uint16_t durationMs,
+                             LED_Driver_FadeCurve_t curve);
+
+/**
+ * @brief Fade all light sources to new intensities together
+ * @note Lights with an active alarm are skipped. Stops like LED_Driver_FadeTo.
+ *       Also called from the sequencer cue interrupt.
+ * @param permille Target intensity per light (0-1000, or LED_DRIVER_PERMILLE_HOLD
+ *        to keep it where it is), VAL_LIGHT_COUNT entries
+ * @param durationMs Fade duration in milliseconds (0 sets them at once)
+ * @param curve Fade curve
+ * @return VAL_Status VAL_OK if the fade started, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_FadeAllTo(const uint16_t* permille, uint16_t durationMs,
+                                LED_Driver_FadeCurve_t curve);
+
+/**
+ * @brief Modulate light sources with an effect until stopped
+ * @note Runs from the PWM DMA with two short interrupts per table. Stops like
+ *       LED_Driver_FadeTo, where the output is at that moment; derate and
+ *       budget changes apply to the rows still to come instead.
+ * @param permille Crest intensity per light (0-1000, or LED_DRIVER_PERMILLE_HOLD
+ *        to keep it where it is), VAL_LIGHT_COUNT entries
+ * @param effect Waveform, period and depth
+ * @return VAL_Status VAL_OK if the effect started, VAL_BUSY while strobing,
+ *         VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_StartEffect(const uint16_t* permille, const Effect_Config_t* effect);
+
+/**
+ * @brief Stop a running effect, keeping the lights where it left them
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status LED_Driver_StopEffect(void);
+
+/**
+ * @brief Check whether an effect is running
+ * @return bool true while an effect modulates the outputs
+ */
+bool LED_Driver_IsEffectActive(void);
+
+/**
+ * @brief Stage new intensities for all light sources, to be applied together
+ * @note The lights keep their intensities until LED_Driver_CommitStage or,
+ *       with syncInput, a rising edge on the sync line (PA12). Any other
+ *       output change or an alarm drops the staged values.
+ * @param permille Intensity per light (0-1000, or LED_DRIVER_PERMILLE_HOLD),
+ *        VAL_LIGHT_COUNT entries
+ * @param syncInput true to also commit on a sync line edge
+ * @return VAL_Status VAL_OK if staged, VAL_BUSY while strobing, VAL_ERROR
+ *         otherwise
+ */
+VAL_Status LED_Driver_StagePermille(const uint16_t* permille, bool syncInput);
+
+/**
+ * @brief Apply the staged intensities, restarting the PWM period
+ * @return VAL_Status VAL_OK if applied, VAL_ERROR if nothing is staged
+ */
+VAL_Status LED_Driver_CommitStage(void);
+
+/**
+ * @brief Check whether intensities are staged and not yet committed
+ * @return bool true while staged
+ */
+bool LED_Driver_IsStaged(void);
+
+/**
+ * @brief Select how intensities map to the PWM duty cycle of a light source
+ * @note Stops a running fade; the current intensity is re-applied
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param curve Output curve
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_SetOutputCurve(uint8_t lightId, LED_Driver_OutputCurve_t curve);
+
 /**
  * @brief Get sensor readings for a specific light source
- * @param lightId Light source ID (1-3)
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
  * @param sensorData Pointer to store the retrieved sensor data
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
 VAL_Status LED_Driver_GetSensorData(uint8_t lightId, LightSensorData_t* sensorData);
 
 /**
- * @brief Get sensor readings for all light sources
- * @param sensorData Array to store the retrieved sensor data (must be size 3)
+ * @brief Refresh the alarm thresholds and get sensor readings for all light sources
+ * @note Call periodically from a task; thresholds in counts follow changes of
+ *       the ADC resolution here
+ * @param sensorData Array to store the retrieved sensor data (must hold VAL_LIGHT_COUNT entries)
+ * @param stamp Pointer to store when the readings were taken, or NULL
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
-VAL_Status LED_Driver_GetAllSensorData(LightSensorData_t* sensorData);
+VAL_Status LED_Driver_GetAllSensorData(LightSensorData_t* sensorData, LightSampleStamp_t* stamp);
 
 /**
  * @brief  Get alarm status for all light sources
- * @param  alarms: Array to store alarm status (must be size 3)
+ * @param  alarms: Array to store alarm status (must hold VAL_LIGHT_COUNT entries)
  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
  */
 VAL_Status LED_Driver_GetAlarmStatus(uint8_t* alarms);
 
+/**
+ * @brief Get the alarm state machine of a light source
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param info Pointer to store the alarm state
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_GetAlarmInfo(uint8_t lightId, LED_Driver_AlarmInfo_t* info);
+
+/**
+ * @brief Change how readings are debounced and alarms released
+ * @param config New configuration
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status LED_Driver_SetAlarmConfig(const LED_Driver_AlarmConfig_t* config);
+
+/**
+ * @brief Get the alarm configuration
+ * @param config Pointer to store the configuration
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if config is NULL
+ */
+VAL_Status LED_Driver_GetAlarmConfig(LED_Driver_AlarmConfig_t* config);
+
+/**
+ * @brief Replace the alarm limits of all light sources
+ * @param limits Limits per light, VAL_LIGHT_COUNT entries
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status LED_Driver_SetLimits(const LED_Driver_Limits_t* limits);
+
+/**
+ * @brief Get the alarm limits of all light sources
+ * @param limits Array to store the limits (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if limits is NULL
+ */
+VAL_Status LED_Driver_GetLimits(LED_Driver_Limits_t* limits);
+
+/**
+ * @brief Change the thermal derating controller
+ * @param config New configuration
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status LED_Driver_SetDerateConfig(const LED_Driver_DerateConfig_t* config);
+
+/**
+ * @brief Get the thermal derating configuration
+ * @param config Pointer to store the configuration
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if config is NULL
+ */
+VAL_Status LED_Driver_GetDerateConfig(LED_Driver_DerateConfig_t* config);
+
+/**
+ * @brief Get the derate factor applied to each light source
+ * @note Intensities read back unchanged; the output is this fraction of them
+ * @param factors Array to store the factors in permille, 1000 for the full
+ *        output (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if factors is NULL
+ */
+VAL_Status LED_Driver_GetDerating(uint16_t* factors);
+
+/**
+ * @brief Set the largest total current of all lights
+ * @note Starts at VAL_SUPPLY_CURRENT_MAX_MA. The factor applies on top of
+ *       the derating; intensities read back unchanged.
+ * @param limitMa Total current in mA, 0 for no limit
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if negative
+ */
+VAL_Status LED_Driver_SetCurrentBudget(int32_t limitMa);
+
+/**
+ * @brief Dither the steady outputs for resolution below one timer count
+ * @note Adds VAL_PWM_DITHER_BITS for deep dimming and regulation, played
+ *       by DMA without CPU time per period. Fades, staged intensities and
+ *       the strobe are not dithered. Off at reset.
+ * @param enable true to dither, false for one compare value per light
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status LED_Driver_SetDither(bool enable);
+
+/**
+ * @brief Check whether steady outputs are dithered
+ * @return bool true if enabled
+ */
+bool LED_Driver_IsDitherEnabled(void);
+
+/**
+ * @brief Get the supply current budget and the factor it applies
+ * @param budget Pointer to store the budget
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if budget is NULL
+ */
+VAL_Status LED_Driver_GetCurrentBudget(LED_Driver_Budget_t* budget);
+
+/**
+ * @brief Regulate a light source to a constant current
+ * @note An intensity or fade command, or an alarm, returns the light to
+ *       open-loop operation. Reads return the duty cycle driven meanwhile.
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param currentMa Target current in mA, up to the maximum current limit;
+ *        0 turns the light off
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_SetCurrent(uint8_t lightId, int32_t currentMa);
+
+/**
+ * @brief Get the constant-current target of a light source
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param currentMa Pointer to store the target in mA, 0 in open-loop operation
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_GetCurrentTarget(uint8_t lightId, int32_t* currentMa);
+
+/**
+ * @brief Change the constant-current controller
+ * @param config New configuration
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status LED_Driver_SetCurrentLoopConfig(const LED_Driver_CurrentLoopConfig_t* config);
+
+/**
+ * @brief Get the constant-current controller configuration
+ * @param config Pointer to store the configuration
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if config is NULL
+ */
+VAL_Status LED_Driver_GetCurrentLoopConfig(LED_Driver_CurrentLoopConfig_t* config);
+
+/**
+ * @brief Sample the currents at a fixed point of the PWM period
+ * @param phase_permille Sampling point as a fraction of the period (1-999),
+ *        or 0 to sample at the free-running scan rate
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if out of range,
+ *         VAL_ERROR if the ADC could not be reconfigured
+ */
+VAL_Status LED_Driver_SetSamplePhase(uint16_t phase_permille);
+
+/**
+ * @brief Change the PWM frequency, keeping the intensities
+ * @note Channels, period and ADC trigger latch together on one PWM period
+ *       boundary. A running fade is cancelled.
+ * @param freqHz Frequency (VAL_PWM_FREQ_MIN_HZ-VAL_PWM_FREQ_MAX_HZ)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if out of range,
+ *         VAL_BUSY while strobing or a latch is armed, VAL_ERROR if the ADC
+ *         could not be reconfigured
+ */
+VAL_Status LED_Driver_SetPwmFrequency(uint32_t freqHz);
+
+/**
+ * @brief Get the PWM frequency
+ * @return uint32_t Frequency in Hz
+ */
+uint32_t LED_Driver_GetPwmFrequency(void);
+
+/**
+ * @brief Fire all light sources from the external trigger input or at a rate
+ * @note Hardware starts each pulse, no software runs per edge. Fades and
+ *       regulation stop, the continuous outputs turn off and intensity
+ *       commands return VAL_BUSY until LED_Driver_StopStrobe. Calling it
+ *       again replaces the pulse. With a period, a timer fires the pulses
+ *       and the ADC scans within them.
+ * @param durationUs Pulse length (1 to VAL_PWM_STROBE_MAX_US)
+ * @param periodUs Pulse period (above the length, up to VAL_PWM_STROBE_PERIOD_MAX_US),
+ *        0 to fire on the trigger input
+ * @param permille Intensity per light during the pulse (0-1000), VAL_LIGHT_COUNT entries
+ * @param fallingEdge Fire on the falling instead of the rising edge
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_BUSY
+ *         if the rate timer is in use, VAL_ERROR if the ADC could not be
+ *         reconfigured
+ */
+VAL_Status LED_Driver_StartStrobe(uint32_t durationUs, uint32_t periodUs, const uint16_t* permille,
+                                  bool fallingEdge);
+
+/**
+ * @brief Return to continuous operation with all light sources off
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR if the ADC could not be
+ *         reconfigured
+ */
+VAL_Status LED_Driver_StopStrobe(void);
+
+/**
+ * @brief Turn all light sources off at once, ahead of any queued command
+ * @note Safe to call from interrupts. Stops fades, effects, the strobe, the
+ *       current loops and staged values; alarms are kept. After a strobe,
+ *       LED_Driver_StopStrobe restores the sampling.
+ * @return None
+ */
+void LED_Driver_Blackout(void);
+
+/**
+ * @brief Get the strobe configuration and counts
+ * @param status Pointer to store the state
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status LED_Driver_GetStrobeStatus(LED_Driver_StrobeStatus_t* status);
+
+/**
+ * @brief Get the current sampling point within the PWM period
+ * @return uint16_t Sampling point in permille of the period, 0 if free-running
+ */
+uint16_t LED_Driver_GetSamplePhase(void);
+
+/**
+ * @brief Get the usage counters of all light sources
+ * @param usage Array to store the counters (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if usage is NULL
+ */
+VAL_Status LED_Driver_GetUsage(LED_Driver_Usage_t* usage);
+
+/**
+ * @brief Get the temperature trend of a light source
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param trend Pointer to store the trend
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status LED_Driver_GetThermalTrend(uint8_t lightId, LED_Driver_ThermalTrend_t* trend);
+
+/**
+ * @brief Set the window of the flicker measurement and measure again
+ * @param windowScans Raw samples per window (LED_DRIVER_FLICKER_WINDOW_MIN-65535)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if too short
+ */
+VAL_Status LED_Driver_SetFlickerWindow(uint16_t windowScans);
+
+/**
+ * @brief Get the flicker of all light sources at their present outputs
+ * @note  Measured from the raw current samples of two windows after every
+ *        change of an intensity, a regulated current, the PWM frequency or
+ *        dithering; the metrics are zero until the state is done
+ * @param status Pointer to store the progress
+ * @param metrics Array to store the metrics (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if a pointer is NULL
+ */
+VAL_Status LED_Driver_GetFlicker(LED_Driver_FlickerStatus_t* status, LED_Driver_Flicker_t* metrics);
+
+/**
+ * @brief Replace the ageing curves of all light sources
+ * @note Taken up by the next LED_Driver_UpdateAgeing
+ * @param ageing Curve per light, VAL_LIGHT_COUNT entries
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status LED_Driver_SetAgeing(const LED_Driver_Ageing_t* ageing);
+
+/**
+ * @brief Get the ageing curves of all light sources
+ * @param ageing Array to store the curves (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if ageing is NULL
+ */
+VAL_Status LED_Driver_GetAgeing(LED_Driver_Ageing_t* ageing);
+
+/**
+ * @brief Replace the output trims of all light sources
+ * @note Taken up by the next LED_Driver_UpdateAgeing, together with the
+ *       ageing compensation
+ * @param trims Trim per light in permille of the untrimmed output
+ *        (LED_DRIVER_TRIM_MIN_PERMILLE-LED_DRIVER_TRIM_MAX_PERMILLE),
+ *        VAL_LIGHT_COUNT entries
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status LED_Driver_SetTrims(const uint16_t* trims);
+
+/**
+ * @brief Get the output trims of all light sources
+ * @param trims Array to store the trims in permille (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if trims is NULL
+ */
+VAL_Status LED_Driver_GetTrims(uint16_t* trims);
+
+/**
+ * @brief Follow the usage counters with the ageing compensation
+ * @note Coordinator task only. Cheap while no light has crossed into
+ *       another full-output hour; a steady output is re-applied when its
+ *       compensation or trim changes.
+ * @return None
+ */
+void LED_Driver_UpdateAgeing(void);
+
+/**
+ * @brief Get the on-time the ageing compensation and the trim give each light source
+ * @param scales Array to store the output scales in permille, VAL_PWM_SCALE_UNITY
+ *        for none (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if scales is NULL
+ */
+VAL_Status LED_Driver_GetAgeingScales(uint16_t* scales);
+
+/**
+ * @brief Add counts to the usage counters, such as the ones stored before a restart
+ * @param usage Counts to add per light source, VAL_LIGHT_COUNT entries
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if usage is NULL
+ */
+VAL_Status LED_Driver_AddUsage(const LED_Driver_Usage_t* usage);
+
 #ifdef __cplusplus
 }
 #endif
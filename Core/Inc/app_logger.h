@@ -17,11 +17,112 @@ extern "C" {
 #include <stdint.h>
 #include "val_status.h"
 
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  LOGGER_LEVEL_DEBUG = 0,
+  LOGGER_LEVEL_INFO,
+  LOGGER_LEVEL_WARNING,
+  LOGGER_LEVEL_ERROR,
+  LOGGER_LEVEL_NONE          /* Runtime level only: nothing is sent */
+} Logger_Level_t;
+
+/* Messages, formatted by the logger task from the format table in app_logger.c */
+typedef enum {
+  LOGGER_MSG_TEXT = 0,               /* arg0: constant string */
+  LOGGER_MSG_SYSTEM_READY,
+  LOGGER_MSG_SENSOR_SYNC_FAILED,     /* arg0: VAL_Status */
+  LOGGER_MSG_INTENSITY_SYNC_FAILED,  /* arg0: VAL_Status */
+  LOGGER_MSG_ALARM_SYNC_FAILED,      /* arg0: VAL_Status */
+  LOGGER_MSG_ADC_ERROR,              /* arg0: HAL_ADC_ERROR_x bits, arg1: HAL_DMA_ERROR_x bits */
+  LOGGER_MSG_ADC_RECOVERY_FAILED,    /* arg0: VAL_Status */
+  LOGGER_MSG_DROPPED,                /* arg0: messages lost while the ring was full */
+  LOGGER_MSG_DEADLINE_MISS,          /* arg0: task name, arg1: microseconds over the deadline */
+  LOGGER_MSG_WATCHDOG_RESET,         /* arg0: task name, arg1: milliseconds over the deadline */
+  LOGGER_MSG_DMX_SWITCH_FAILED,      /* arg0: VAL_Status */
+  LOGGER_MSG_DMX_SIGNAL_LOST,        /* arg0: packets applied, arg1: packets dropped */
+  LOGGER_MSG_CRASH,                  /* arg0: cause name, arg1: faulting address */
+  LOGGER_MSG_LINK_FAILSAFE,          /* arg0: milliseconds of silence, arg1: scene, 0 for all off */
+  LOGGER_MSG_MODBUS_SWITCH_FAILED,   /* arg0: VAL_Status */
+  LOGGER_MSG_MODBUS_ENDED,           /* arg0: requests served, arg1: milliseconds of silence, 0 if released */
+  LOGGER_MSG_SUPPLY_LOW,             /* arg0: warning level in mV, arg1: output factor in permille */
+  LOGGER_MSG_SUPPLY_RECOVERED,       /* arg0: warning level in mV, arg1: output factor in permille */
+  LOGGER_MSG_INTEGRITY_FAILED,       /* arg0: check name, arg1: CRC found, or the first RAM word changed */
+  LOGGER_MSG_COUNT
+} Logger_Msg_t;
+
+/* Exported constants --------------------------------------------------------*/
+/* Messages below this level are compiled out */
+#ifndef LOGGER_COMPILE_LEVEL
+#ifdef DEBUG
+#define LOGGER_COMPILE_LEVEL     LOGGER_LEVEL_DEBUG
+#else
+#define LOGGER_COMPILE_LEVEL     LOGGER_LEVEL_INFO
+#endif
+#endif
+
+/* Exported macro ------------------------------------------------------------*/
+/* Log a message; the call disappears when level is below LOGGER_COMPILE_LEVEL */
+#define LOGGER_LOG(level, msg, arg0, arg1) \
+  do { \
+    if ((level) >= LOGGER_COMPILE_LEVEL) { \
+      (void)Logger_Log((level), (msg), (uint32_t)(arg0), (uint32_t)(arg1)); \
+    } \
+  } while (0)
+
 /* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Initialize the logger and start its task
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
 VAL_Status Logger_Init(void);
+
+/**
+ * @brief Queue a message for the logger task
+ * @note  Safe from tasks and interrupts; never waits. Only the arguments are
+ *        stored, formatting happens in the logger task.
+ * @param level Message level
+ * @param msg Message format
+ * @param arg0 First format argument
+ * @param arg1 Second format argument
+ * @return VAL_Status VAL_OK if queued or filtered, VAL_BUSY if the ring was full
+ */
+VAL_Status Logger_Log(Logger_Level_t level, Logger_Msg_t msg, uint32_t arg0, uint32_t arg1);
+
+/**
+ * @brief Log an informational text
+ * @param event Constant string; only the pointer is stored
+ * @return VAL_Status VAL_OK if queued or filtered, VAL_BUSY if the ring was full
+ */
 VAL_Status Logger_LogEvent(const char* event);
+
+/**
+ * @brief Log an error text
+ * @param severity Logger_Level_t of the error
+ * @param error Constant string; only the pointer is stored
+ * @return VAL_Status VAL_OK if queued or filtered, VAL_BUSY if the ring was full
+ */
 VAL_Status Logger_LogError(uint8_t severity, const char* error);
 
+/**
+ * @brief Set the lowest level sent to the host
+ * @param level Level, LOGGER_LEVEL_NONE to send nothing
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM for an invalid level
+ */
+VAL_Status Logger_SetLevel(Logger_Level_t level);
+
+/**
+ * @brief Get the lowest level sent to the host
+ * @return Logger_Level_t Current runtime level
+ */
+Logger_Level_t Logger_GetLevel(void);
+
+/**
+ * @brief Get the protocol name of a level
+ * @param level Level
+ * @return const char* Level name, "none" for LOGGER_LEVEL_NONE and invalid levels
+ */
+const char* Logger_GetLevelName(Logger_Level_t level);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,131 @@
+/**
+  ******************************************************************************
+  * @file    app_modbus.h
+  * @brief   Header for app_modbus.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_MODBUS_H
+#define __APP_MODBUS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define MODBUS_ADDRESS_MIN       1U
+#define MODBUS_ADDRESS_MAX       247U
+#define MODBUS_BAUD_DEFAULT      19200U  /* Modbus over serial line default */
+#define MODBUS_TIMEOUT_MS        5000U   /* Master silence before the host link returns */
+
+/* Holding registers, read and write (function codes 03, 06, 16) */
+#define MODBUS_HOLDING_PERMILLE  0x0000U /* + light - 1: intensity (0-1000) */
+#define MODBUS_HOLDING_ALARM     0x0100U /* + light - 1: alarm code, write 0 to clear */
+#define MODBUS_HOLDING_RELEASE   0x0200U /* Write 1 to hand the link back to the host */
+
+/* Input registers, read only (function code 04) */
+#define MODBUS_INPUT_LIGHTS      0x0000U /* Light count */
+#define MODBUS_INPUT_SEQUENCE    0x0001U /* Snapshot sequence, high word first, two registers */
+#define MODBUS_INPUT_PERMILLE    0x0010U /* + light - 1: intensity */
+#define MODBUS_INPUT_SENSORS     0x0020U /* + 4 * (light - 1): see MODBUS_SENSOR_* */
+#define MODBUS_INPUT_CONFIG      0x0100U /* See MODBUS_CONFIG_* */
+#define MODBUS_INPUT_LIMITS      0x0110U /* + 6 * (light - 1): see MODBUS_LIMIT_* */
+
+/* Registers of each light in the sensor block */
+#define MODBUS_SENSOR_CURRENT    0U      /* Filtered current, mA */
+#define MODBUS_SENSOR_TEMPERATURE 1U     /* Filtered temperature, 0.1 degC, signed */
+#define MODBUS_SENSOR_DERATE     2U      /* Derate factor, permille */
+#define MODBUS_SENSOR_ALARM      3U      /* Alarm code, 0 for none */
+#define MODBUS_SENSOR_REGISTERS  4U
+
+/* Registers of the configuration block */
+#define MODBUS_CONFIG_CURRENT_SCALE     0U  /* current_ma_per_mv */
+#define MODBUS_CONFIG_TEMPERATURE_SCALE 1U  /* temperature_cdeg_per_mv */
+#define MODBUS_CONFIG_SAMPLE_PHASE      2U  /* sample_phase_permille */
+#define MODBUS_CONFIG_ADDRESS           3U  /* Host protocol device address */
+#define MODBUS_CONFIG_BUS               4U  /* 1 on an RS-485 bus */
+#define MODBUS_CONFIG_FAILSAFE_MS       5U
+#define MODBUS_CONFIG_FAILSAFE_SCENE    6U
+#define MODBUS_CONFIG_POWER_ON          7U  /* Restore_Mode_t */
+#define MODBUS_CONFIG_POWER_ON_SCENE    8U
+#define MODBUS_CONFIG_BUS_GROUPS        9U
+#define MODBUS_CONFIG_STOP_MODE         10U /* 1 if enabled */
+#define MODBUS_CONFIG_REGISTERS         11U
+
+/* Registers of each light in the limits block, mA and centi-degrees */
+#define MODBUS_LIMIT_CURRENT_WARN       0U
+#define MODBUS_LIMIT_CURRENT_MAX        1U
+#define MODBUS_LIMIT_CURRENT_TRIP       2U
+#define MODBUS_LIMIT_TEMPERATURE_WARN   3U  /* Signed */
+#define MODBUS_LIMIT_TEMPERATURE_MAX    4U  /* Signed */
+#define MODBUS_LIMIT_SLEW               5U  /* Permille per millisecond, 0 none */
+#define MODBUS_LIMIT_REGISTERS          6U
+
+/* Exported types ------------------------------------------------------------*/
+/* State of the present session, or the counts of the last one */
+typedef struct {
+  bool active;                /* Answering a Modbus master */
+  uint8_t address;            /* Slave address (MODBUS_ADDRESS_MIN-MODBUS_ADDRESS_MAX) */
+  uint32_t baud;              /* Bus baud rate, 8E1 */
+  uint32_t timeout_ms;        /* Master silence before the host link returns */
+  uint32_t requests;          /* Requests served, broadcasts included */
+  uint32_t exceptions;        /* Exception responses sent */
+  uint32_t crc_errors;        /* Frames failing their CRC */
+  uint32_t ignored;           /* Frames for other slaves, or too short */
+  uint32_t dropped;           /* Frames lost to line errors */
+  uint32_t max_response_us;   /* Longest frame end to reply start */
+} Modbus_Status_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Check whether a Modbus session can start with these settings
+ * @param address Slave address (MODBUS_ADDRESS_MIN-MODBUS_ADDRESS_MAX)
+ * @param baud Bus baud rate
+ * @param timeout_ms Master silence before the host link returns, not 0
+ * @return VAL_Status VAL_OK if it can, VAL_PARAM for an invalid setting,
+ *         VAL_BUSY if DMX512 or Modbus mode is running
+ */
+VAL_Status Modbus_Check(uint8_t address, uint32_t baud, uint32_t timeout_ms);
+
+/**
+ * @brief Hand the serial link over to a Modbus RTU master
+ * @note Task context. The host link stops until the master has been silent
+ *       for timeout_ms or writes MODBUS_HOLDING_RELEASE.
+ * @param address Slave address (MODBUS_ADDRESS_MIN-MODBUS_ADDRESS_MAX)
+ * @param baud Bus baud rate
+ * @param timeout_ms Master silence before the host link returns
+ * @return VAL_Status As Modbus_Check, else as VAL_Serial_StartModbus
+ */
+VAL_Status Modbus_Start(uint8_t address, uint32_t baud, uint32_t timeout_ms);
+
+/**
+ * @brief Return to the host link once the master is silent or has released it
+ * @note Called from the coordinator task on every wakeup
+ * @return None
+ */
+void Modbus_CheckSignal(void);
+
+/**
+ * @brief Check whether a Modbus master has the link
+ * @return bool true during a session
+ */
+bool Modbus_IsActive(void);
+
+/**
+ * @brief Get the session state and counts
+ * @param status Pointer to store them
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status Modbus_GetStatus(Modbus_Status_t* status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_MODBUS_H */
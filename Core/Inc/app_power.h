@@ -0,0 +1,47 @@
+/**
+  ******************************************************************************
+  * @file    app_power.h
+  * @brief   Header for app_power.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_POWER_H
+#define __APP_POWER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define POWER_SERIAL_AWAKE_MS    2000  /* Stay out of stop this long after serial activity */
+#define POWER_STOP_MIN_MS        5     /* Shorter idle periods use sleep mode */
+#define POWER_CLOCK_LOW_MS       100   /* Serial quiet time before the low clock level */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  uint32_t stops;            /* Times stop mode was entered */
+  uint32_t stopped_ms;       /* Total time spent in stop mode */
+  uint32_t serial_wakes;     /* Stops ended by the serial RX line */
+  uint32_t entry_max_us;     /* Longest time from deciding to stop to the stop */
+  uint32_t exit_max_us;      /* Longest time from a wake-up to running tasks again */
+  uint32_t clock_changes;    /* Switches between core clock levels */
+} Power_Stats_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Get the stop mode statistics since start-up
+ * @param stats Pointer to store the statistics
+ * @return None
+ */
+void Power_GetStats(Power_Stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_POWER_H */
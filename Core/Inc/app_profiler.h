@@ -0,0 +1,155 @@
+/**
+  ******************************************************************************
+  * @file    app_profiler.h
+  * @brief   Header for app_profiler.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_PROFILER_H
+#define __APP_PROFILER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  PROFILER_PROBE_COMMAND = 0,       /* First command byte to response queued */
+  PROFILER_PROBE_JSON_PARSE,        /* Stream decoding of one command */
+  PROFILER_PROBE_RESPONSE_FORMAT,   /* Response formatting */
+  PROFILER_PROBE_SERIAL_SEND,       /* VAL_Serial_Send */
+  PROFILER_PROBE_SENSOR_UPDATE,     /* Sensor update and alarm check */
+  PROFILER_PROBE_FRAME_DECODE,      /* Binary frame decoding and CRC check */
+  PROFILER_PROBE_ADC_BLOCK,         /* Interval between completed sample blocks */
+  PROFILER_PROBE_ALARM_REACTION,    /* First reading over a limit to output cut */
+  PROFILER_PROBE_PWM_UPDATE,        /* Intensity call to compare registers written */
+  PROFILER_PROBE_COUNT
+} Profiler_Probe_t;
+
+typedef struct {
+  uint32_t count;      /* Number of measurements */
+  uint32_t min_us;     /* Shortest duration in microseconds */
+  uint32_t max_us;     /* Longest duration in microseconds */
+  uint32_t avg_us;     /* Average duration in microseconds */
+} Profiler_Stats_t;
+
+#ifdef BENCHMARK
+/* Interrupt to task handoffs, from the notification to the task running */
+typedef enum {
+  PROFILER_WAKEUP_RX = 0,           /* UART RX block to communications task */
+  PROFILER_WAKEUP_ADC,              /* ADC sample block to coordinator task */
+  PROFILER_WAKEUP_TX,               /* TX completion to the task waiting for room */
+  PROFILER_WAKEUP_COUNT
+} Profiler_Wakeup_t;
+
+typedef struct {
+  uint32_t count;      /* Wakeups measured */
+  uint32_t min_ns;     /* 0 if none measured */
+  uint32_t max_ns;
+} Profiler_WakeupStats_t;
+#endif
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Initialize the profiler and clear all probes
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status Profiler_Init(void);
+
+/**
+ * @brief Take the start timestamp of a measurement
+ * @return uint32_t Cycle counter value to pass to Profiler_Stop
+ */
+uint32_t Profiler_Start(void);
+
+/**
+ * @brief Record the time elapsed since a start timestamp
+ * @param probe Probe to account the measurement to
+ * @param start Value returned by Profiler_Start
+ * @return None
+ */
+void Profiler_Stop(Profiler_Probe_t probe, uint32_t start);
+
+/**
+ * @brief Record a measurement taken by the caller
+ * @param probe Probe to account the measurement to
+ * @param elapsed Duration in cycles
+ * @return None
+ */
+void Profiler_Record(Profiler_Probe_t probe, uint32_t elapsed);
+
+/**
+ * @brief Get the statistics of a probe
+ * @param probe Probe to query
+ * @param stats Pointer to store the statistics
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status Profiler_GetStats(Profiler_Probe_t probe, Profiler_Stats_t* stats);
+
+/**
+ * @brief Get the name of a probe as reported to the host
+ * @param probe Probe to query
+ * @return const char* Probe name, "unknown" for invalid probes
+ */
+const char* Profiler_GetName(Profiler_Probe_t probe);
+
+/**
+ * @brief Clear the statistics of all probes
+ * @return None
+ */
+void Profiler_Reset(void);
+
+#ifdef BENCHMARK
+/**
+ * @brief Note that a task is about to block waiting for a handoff
+ * @param wakeup Handoff the task waits for
+ * @return None
+ */
+void Profiler_WakeupArm(Profiler_Wakeup_t wakeup);
+
+/**
+ * @brief Stamp a handoff just before the interrupt notifies the task
+ * @param wakeup Handoff being signalled
+ * @return None
+ */
+void Profiler_WakeupMark(Profiler_Wakeup_t wakeup);
+
+/**
+ * @brief Record the wakeup latency once the woken task runs
+ * @param wakeup Handoff the task waited for
+ * @return None
+ */
+void Profiler_WakeupDone(Profiler_Wakeup_t wakeup);
+
+/**
+ * @brief Get the wakeup latency figures of a handoff
+ * @param wakeup Handoff to query
+ * @param stats Pointer to store the figures
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status Profiler_GetWakeup(Profiler_Wakeup_t wakeup, Profiler_WakeupStats_t* stats);
+
+/**
+ * @brief Get the name of a handoff as reported to the host
+ * @param wakeup Handoff to query
+ * @return const char* Handoff name, "unknown" for invalid values
+ */
+const char* Profiler_GetWakeupName(Profiler_Wakeup_t wakeup);
+
+/**
+ * @brief Clear the wakeup latency figures
+ * @return None
+ */
+void Profiler_ResetWakeup(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_PROFILER_H */
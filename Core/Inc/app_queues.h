@@ -0,0 +1,123 @@
+/**
+  ******************************************************************************
+  * @file    app_queues.h
+  * @brief   Header for app_queues.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_QUEUES_H
+#define __APP_QUEUES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+#include "FreeRTOS.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define QUEUES_MAX_OBJECTS       configQUEUE_REGISTRY_SIZE  /* Objects watched */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  QUEUES_KIND_QUEUE = 0,     /* FreeRTOS queue, capacity in items */
+  QUEUES_KIND_STREAM,        /* FreeRTOS stream buffer, capacity in bytes */
+  QUEUES_KIND_MUTEX,         /* FreeRTOS mutex */
+  QUEUES_KIND_RING,          /* Lock-free ring of the application, capacity in entries */
+  QUEUES_KIND_POOL,          /* Slot pool of the application, capacity in slots */
+  QUEUES_KIND_COUNT
+} Queues_Kind_t;
+
+typedef struct {
+  const char* name;
+  uint8_t kind;              /* Queues_Kind_t */
+  uint32_t capacity;
+  uint32_t high_water;       /* Most items, bytes or slots held at once */
+  uint32_t fails;            /* Sends refused or cut short; for a mutex, takes that gave up */
+  uint32_t blocks;           /* Senders that had to wait; for a mutex, takes that found it held */
+  uint32_t block_us;         /* Time spent waiting, wraps */
+  uint32_t block_max_us;     /* Longest wait */
+} Queues_Stats_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Watch a queue, stream buffer, mutex or application buffer
+ * @note Call once, after creating it and before it is used. FreeRTOS queues
+ *       and mutexes are also added to the kernel queue registry.
+ * @param object Handle of the FreeRTOS object, or address of the buffer
+ * @param name Constant name reported for it
+ * @param kind What it is
+ * @param capacity Items, bytes or slots it holds, 1 for a mutex
+ * @return VAL_Status VAL_OK if successful, VAL_BUSY if QUEUES_MAX_OBJECTS are
+ *         watched, VAL_PARAM for invalid arguments
+ */
+VAL_Status Queues_Register(const void* object, const char* name, Queues_Kind_t kind, uint32_t capacity);
+
+/**
+ * @brief Record the fill level of an application buffer after adding to it
+ * @note Any context; ignored for an object not registered
+ * @param object Address given to Queues_Register
+ * @param level Items or slots held
+ * @return None
+ */
+void Queues_NoteLevel(const void* object, uint32_t level);
+
+/**
+ * @brief Record an add refused by a full application buffer
+ * @note Any context; ignored for an object not registered
+ * @param object Address given to Queues_Register
+ * @return None
+ */
+void Queues_NoteFailed(const void* object);
+
+/**
+ * @brief Record a wait for room in an application buffer
+ * @note Any context; ignored for an object not registered
+ * @param object Address given to Queues_Register
+ * @param us Time waited in microseconds
+ * @return None
+ */
+void Queues_NoteBlocked(const void* object, uint32_t us);
+
+/**
+ * @brief Get the figures of the watched objects, in registration order
+ * @param stats Array to store them
+ * @param max_objects Size of the array
+ * @return uint8_t Number of entries stored
+ */
+uint8_t Queues_GetStats(Queues_Stats_t* stats, uint8_t max_objects);
+
+/**
+ * @brief Clear the figures of all watched objects
+ * @return None
+ */
+void Queues_ResetStats(void);
+
+/**
+ * @brief Get the name of a kind as reported to the host
+ * @param kind Kind to query
+ * @return const char* Kind name, "unknown" for invalid values
+ */
+const char* Queues_GetKindName(Queues_Kind_t kind);
+
+/* FreeRTOS trace hooks (FreeRTOSConfig.h); each returns at once for an
+ * object not registered */
+void Queues_KernelSent(const void* object);
+void Queues_KernelSentFromIsr(const void* object);
+void Queues_KernelSendFailed(const void* object);
+void Queues_KernelSendFailedFromIsr(const void* object);
+void Queues_KernelStreamSent(const void* object, uint32_t sent, uint32_t length);
+void Queues_KernelStreamSentFromIsr(const void* object, uint32_t sent, uint32_t length);
+void Queues_KernelReceived(const void* object);
+void Queues_KernelReceiveFailed(const void* object);
+void Queues_KernelBlockedSend(const void* object);
+void Queues_KernelBlockedReceive(const void* object);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_QUEUES_H */
@@ -0,0 +1,114 @@
+/**
+  ******************************************************************************
+  * @file    app_recorder.h
+  * @brief   Header for app_recorder.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_RECORDER_H
+#define __APP_RECORDER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+#include "val_analog.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define RECORDER_VERSION         1     /* Layout of the summary in the data store */
+#define RECORDER_SCANS           ANALOG_CAPTURE_MAX_SCANS  /* Scans per recording */
+#define RECORDER_PRE_SCANS       256U  /* Of those, scans kept from before the trip */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  RECORDER_OFF = 0,               /* Not armed, a host capture took the buffer */
+  RECORDER_ARMED,                 /* Holding the latest scans, waiting for a trip */
+  RECORDER_RECORDING,             /* Tripped, recording the scans after it */
+  RECORDER_DONE                   /* Frozen until armed again; raw scans readable */
+} Recorder_State_t;
+
+typedef enum {
+  RECORDER_WINDOW_BEFORE = 0,     /* Scans before the trip */
+  RECORDER_WINDOW_AFTER,          /* Scans from the trip on */
+  RECORDER_WINDOW_COUNT
+} Recorder_Window_Id_t;
+
+/* Raw counts of every ADC channel over one window, in scan rank order */
+typedef struct {
+  uint16_t min[ANALOG_CHANNEL_COUNT];
+  uint16_t mean[ANALOG_CHANNEL_COUNT];
+  uint16_t max[ANALOG_CHANNEL_COUNT];
+} Recorder_Window_t;
+
+/* Summary of one recording, the part kept in the data store */
+typedef struct {
+  uint32_t boot;                  /* Boot count (COUNTERS_BOOTS) the trip happened in */
+  uint32_t trip_ms;               /* Time of the trip, milliseconds since that boot */
+  uint32_t first_sample;          /* Scan count of the first recorded scan */
+  uint16_t pre_scans;             /* Scans before the trip */
+  uint16_t post_scans;            /* Scans from the trip on */
+  uint16_t rate_hz;               /* Scan rate */
+  uint8_t light_id;               /* Light that tripped, 0 if not known */
+  uint8_t code;                   /* Alarm raised (ErrorType_t) */
+  Recorder_Window_t windows[RECORDER_WINDOW_COUNT];
+} Recorder_Summary_t;
+
+typedef struct {
+  Recorder_State_t state;
+  bool recorded;                  /* summary holds a recording */
+  bool stored;                    /* The summary is in flash */
+  Recorder_Summary_t summary;     /* Last recording, of this boot or a stored one */
+} Recorder_Status_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Take over the stored summary and arm the recorder
+ * @note  Called once the data store runs
+ * @return None
+ */
+void Recorder_Init(void);
+
+/**
+ * @brief Start holding the latest scans for the next trip
+ * @note  Replaces the raw capture in progress, a host capture included
+ * @return VAL_Status VAL_OK if armed, VAL_ERROR otherwise
+ */
+VAL_Status Recorder_Arm(void);
+
+/**
+ * @brief Tell the recorder about a newly raised alarm
+ * @note  Coordinator task. The earliest trip since the recorder was armed
+ *        is the one that froze it.
+ * @param lightId Light that tripped
+ * @param code Alarm raised (ErrorType_t)
+ * @param tripUs Time of the trip, VAL_SysClock_GetMicros64
+ * @return None
+ */
+void Recorder_NoteAlarm(uint8_t lightId, uint8_t code, uint64_t tripUs);
+
+/**
+ * @brief Summarize a completed recording and store the summary in flash
+ * @note  Error log task only, the one that makes background writes
+ * @return VAL_Status VAL_OK if stored or nothing is due, VAL_BUSY while the
+ *         recording is still running or flash was in use, VAL_ERROR if the
+ *         write failed
+ */
+VAL_Status Recorder_Save(void);
+
+/**
+ * @brief Get the recorder state and the summary of the last recording
+ * @param status Pointer to store the status
+ * @return None
+ */
+void Recorder_GetStatus(Recorder_Status_t* status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_RECORDER_H */
@@ -0,0 +1,117 @@
+/**
+  ******************************************************************************
+  * @file    app_resources.h
+  * @brief   Header for app_resources.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_RESOURCES_H
+#define __APP_RESOURCES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+#include "FreeRTOS.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define RESOURCES_MAX_TASKS      10   /* Tasks reported, start-up tasks included */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  RESOURCES_ISR_UART = 0,    /* Host link: USART1 per received byte, SPI slave per transaction */
+  RESOURCES_ISR_UART_DMA,    /* USART1 TX and RX DMA channels */
+  RESOURCES_ISR_ADC_DMA,     /* Continuous ADC conversions, internal and external, and I2C sensor reads */
+  RESOURCES_ISR_ADC,         /* ADC analog watchdog */
+  RESOURCES_ISR_PWM_DMA,     /* PWM ramp updates */
+  RESOURCES_ISR_TICK,        /* 1 kHz HAL time base (TIM7) */
+  RESOURCES_ISR_CUE,         /* Sequencer cue timer (TIM2) */
+  RESOURCES_ISR_STROBE,      /* Strobe trigger and pulse end (TIM1) */
+  RESOURCES_ISR_SYNC,        /* PWM sync line (EXTI) */
+  RESOURCES_ISR_DMA_COPY,    /* Memory to memory copy completion (DMA2) */
+  RESOURCES_ISR_COUNT
+} Resources_Isr_t;
+
+typedef struct {
+  char name[configMAX_TASK_NAME_LEN];
+  uint32_t stack_free;       /* Least free stack since the task started, in bytes */
+  uint8_t number;            /* FreeRTOS task number, as in the scheduler trace */
+} Resources_Task_t;
+
+typedef struct {
+  uint32_t free;             /* FreeRTOS heap bytes free now */
+  uint32_t min_free;         /* Least FreeRTOS heap bytes free since start-up */
+} Resources_Heap_t;
+
+typedef struct {
+  char name[configMAX_TASK_NAME_LEN];
+  uint16_t permille;         /* Share of the interval spent in the task, 0-1000 */
+} Resources_Load_t;
+
+typedef struct {
+  uint32_t interval_us;      /* Time since the previous Resources_GetCpuLoad call */
+  uint16_t isr_permille[RESOURCES_ISR_COUNT];  /* Share spent in each interrupt */
+} Resources_CpuLoad_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Take over the stack overflow record left by the previous run
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status Resources_Init(void);
+
+/**
+ * @brief Get the stack usage of all tasks
+ * @param tasks Array to store the task entries
+ * @param max_tasks Size of the array
+ * @return uint8_t Number of entries stored
+ */
+uint8_t Resources_GetTasks(Resources_Task_t* tasks, uint8_t max_tasks);
+
+/**
+ * @brief Get the FreeRTOS heap usage
+ * @param heap Pointer to store the heap figures
+ * @return None
+ */
+void Resources_GetHeap(Resources_Heap_t* heap);
+
+/**
+ * @brief Get the task whose stack overflowed before the last reset
+ * @return const char* Task name, NULL if the last reset was not caused by
+ *         a stack overflow
+ */
+const char* Resources_GetStackOverflow(void);
+
+/**
+ * @brief Get the CPU load of all tasks and interrupts since the previous call
+ * @param load Pointer to store the interval and interrupt figures
+ * @param tasks Array to store the task entries
+ * @param max_tasks Size of the array
+ * @return uint8_t Number of task entries stored
+ */
+uint8_t Resources_GetCpuLoad(Resources_CpuLoad_t* load, Resources_Load_t* tasks, uint8_t max_tasks);
+
+/**
+ * @brief Get the name of an interrupt as reported to the host
+ * @param isr Interrupt to query
+ * @return const char* Interrupt name, "unknown" for invalid values
+ */
+const char* Resources_GetIsrName(Resources_Isr_t isr);
+
+/**
+ * @brief Account the time spent in an interrupt handler
+ * @param isr Interrupt that ran
+ * @param start_cycles VAL_SysClock_GetCycles() at handler entry
+ * @return None
+ */
+void Resources_IsrDone(Resources_Isr_t isr, uint32_t start_cycles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_RESOURCES_H */
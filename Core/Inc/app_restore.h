@@ -0,0 +1,97 @@
+/**
+  ******************************************************************************
+  * @file    app_restore.h
+  * @brief   Header for app_restore.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_RESTORE_H
+#define __APP_RESTORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define RESTORE_MAX_ATTEMPTS    2    /* Start-ups restored in a row without reaching ready */
+
+/* Exported types ------------------------------------------------------------*/
+/* What the lights come up with after a reset or a loss of supply */
+typedef enum {
+  RESTORE_OFF = 0,            /* All lights off, the default */
+  RESTORE_LAST,               /* The intensities last set */
+  RESTORE_SCENE,              /* A saved scene */
+  RESTORE_MODE_COUNT
+} Restore_Mode_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Read the power-on record and bring up the lights it holds
+ * @note Called right after VAL_Init and Counters_Init, before the scheduler.
+ *       Only lights guarded by a comparator are switched on here.
+ * @return None
+ */
+void Restore_Init(void);
+
+/**
+ * @brief Check whether any light was restored at this start-up
+ * @return bool true if at least one light came up on
+ */
+bool Restore_IsActive(void);
+
+/**
+ * @brief Check whether a valid power-on record was found at start-up
+ * @return bool false if the backup domain was lost
+ */
+bool Restore_IsRetained(void);
+
+/**
+ * @brief Get the intensities restored at start-up
+ * @param permille Array to store the intensities, VAL_LIGHT_COUNT entries;
+ *        all 0 if nothing was restored or a light tripped since
+ * @return None
+ */
+void Restore_GetIntensities(uint16_t* permille);
+
+/**
+ * @brief Select what the lights come up with
+ * @param mode Restore_Mode_t
+ * @param scene Scene number for RESTORE_SCENE
+ * @param permille Intensities of the scene, VAL_LIGHT_COUNT entries, or
+ *        NULL to keep the last ones for RESTORE_LAST; all off if NULL for
+ *        RESTORE_SCENE
+ * @return None
+ */
+void Restore_SetMode(Restore_Mode_t mode, uint8_t scene, const uint16_t* permille);
+
+/**
+ * @brief Record the intensities in use, for RESTORE_LAST
+ * @note Coordinator task; the record is only written when they changed
+ * @param permille Intensity per light (0-1000), VAL_LIGHT_COUNT entries
+ * @return None
+ */
+void Restore_Record(const uint16_t* permille);
+
+/**
+ * @brief Mark the start-up as complete, so the next one restores again
+ * @return None
+ */
+void Restore_Confirm(void);
+
+/**
+ * @brief Get the name of a mode
+ * @param mode Mode
+ * @return const char* Name, "unknown" for an invalid mode
+ */
+const char* Restore_GetModeName(Restore_Mode_t mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_RESTORE_H */
@@ -0,0 +1,130 @@
+/**
+  ******************************************************************************
+  * @file    app_rules.h
+  * @brief   Header for app_rules.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_RULES_H
+#define __APP_RULES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+#include "val_channels.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define RULES_MAX           16  /* Rules in the table */
+#define RULES_VERSION       1   /* Exported layout, bump when Rules_Rule_t changes */
+#define RULES_INPUT_VALUES  (RULES_INPUT_COUNT * VAL_LIGHT_COUNT)  /* Values of one scan */
+
+/* Exported types ------------------------------------------------------------*/
+/* Value a rule watches, one per light */
+typedef enum {
+  RULES_INPUT_CURRENT = 0,    /* Filtered current, threshold in mA */
+  RULES_INPUT_TEMPERATURE,    /* Filtered temperature, threshold in centi-degrees */
+  RULES_INPUT_ALARM,          /* Alarm code (ErrorType_t), 0 for none */
+  RULES_INPUT_COUNT
+} Rules_Input_t;
+
+/* What a rule does when its condition starts to hold */
+typedef enum {
+  RULES_ACTION_SET = 0,       /* Set the masked lights to the intensity */
+  RULES_ACTION_FADE,          /* Fade the masked lights to the intensity */
+  RULES_ACTION_SCENE,         /* Recall a scene */
+  RULES_ACTION_EVENT,         /* Only tell the host */
+  RULES_ACTION_MACRO,         /* Run a stored command macro */
+  RULES_ACTION_COUNT
+} Rules_Action_t;
+
+/* A rule as uploaded; it fires once each time the condition starts to
+ * hold and re-arms once the value is back past the hysteresis */
+typedef struct {
+  Rules_Input_t input;
+  uint8_t light_id;           /* Light whose value is watched (1-VAL_LIGHT_COUNT) */
+  bool falling;               /* Holds at or below the threshold, else at or above it */
+  int32_t threshold;          /* In the unit of the input */
+  int32_t hysteresis;         /* Re-arm distance back past the threshold, not negative */
+  Rules_Action_t action;
+  uint8_t mask;               /* Lights set or faded, bit 0 for light 1 */
+  uint16_t permille;          /* Intensity set or faded to (0-1000) */
+  uint16_t duration_ms;       /* Fade time */
+  uint8_t curve;              /* LED_Driver_FadeCurve_t of a fade */
+  uint8_t scene;              /* Scene recalled */
+  uint8_t macro;              /* Command macro run */
+} Rules_Rule_t;
+
+/* Values of one scan, indexed by input * VAL_LIGHT_COUNT + light_id - 1,
+ * currents in mA, temperatures in degrees and alarm codes */
+typedef struct {
+  float values[RULES_INPUT_VALUES];
+} Rules_Inputs_t;
+
+typedef struct {
+  uint8_t rule_count;         /* Rules in the table */
+  uint32_t scans;             /* Scans evaluated since the table was cleared */
+  uint32_t active;            /* Rules whose condition holds, bit 0 for rule 1 */
+  uint32_t hits[RULES_MAX];   /* Times each rule fired */
+} Rules_Status_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Check a rule, without adding it
+ * @note  The same checks as Rules_Add, for a set of rules to be checked
+ *        before any of them replaces the table
+ * @param rule Rule to check
+ * @return VAL_Status VAL_OK if it can be added, VAL_PARAM if invalid
+ */
+VAL_Status Rules_Check(const Rules_Rule_t* rule);
+
+/**
+ * @brief Compile a rule and append it to the table
+ * @note  The threshold is converted to the unit of the scan values here,
+ *        an evaluation only compares. Not reentrant with Rules_Evaluate.
+ * @param rule Rule to add; the fields its action does not use are ignored
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR
+ *         if the table is full
+ */
+VAL_Status Rules_Add(const Rules_Rule_t* rule);
+
+/**
+ * @brief Empty the table and reset the counters
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status Rules_Clear(void);
+
+/**
+ * @brief Get a rule as it was added
+ * @param index Rule index (0 to the rule count - 1)
+ * @param rule Pointer to store the rule
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status Rules_GetRule(uint8_t index, Rules_Rule_t* rule);
+
+/**
+ * @brief Evaluate all rules against one scan
+ * @note  Any context, a compare and a few bit operations per rule whatever
+ *        fires; the caller runs the actions
+ * @param inputs Values of the scan
+ * @return uint32_t Rules that fired, bit 0 for rule 1
+ */
+uint32_t Rules_Evaluate(const Rules_Inputs_t* inputs);
+
+/**
+ * @brief Get the table size and the counters
+ * @param status Pointer to store them
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status Rules_GetStatus(Rules_Status_t* status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_RULES_H */
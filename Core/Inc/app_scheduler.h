@@ -0,0 +1,52 @@
+/**
+  ******************************************************************************
+  * @file    app_scheduler.h
+  * @brief   Header for app_scheduler.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_SCHEDULER_H
+#define __APP_SCHEDULER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define SCHEDULER_MAX_JOBS       8    /* Entries of the job table */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  const char* name;
+  uint32_t period_ms;        /* Time between runs */
+  uint32_t runs;             /* Runs since start-up */
+  uint32_t skipped;          /* Runs dropped because the task fell behind */
+  uint32_t total_us;         /* Time spent in the job, wraps */
+  uint32_t max_us;           /* Longest run */
+} Scheduler_JobStats_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Start the scheduler task, which runs the periodic jobs
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status Scheduler_Init(void);
+
+/**
+ * @brief Get the run figures of all periodic jobs
+ * @param stats Array to store the job entries
+ * @param max_jobs Size of the array
+ * @return uint8_t Number of entries stored, in table order
+ */
+uint8_t Scheduler_GetJobs(Scheduler_JobStats_t* stats, uint8_t max_jobs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_SCHEDULER_H */
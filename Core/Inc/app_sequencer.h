@@ -0,0 +1,92 @@
+/**
+  ******************************************************************************
+  * @file    app_sequencer.h
+  * @brief   Header for app_sequencer.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_SEQUENCER_H
+#define __APP_SEQUENCER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+#include "val_channels.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define SEQUENCER_MAX_CUES     32  /* Cues in the list */
+#define SEQUENCER_MAX_TIME_US  0x7FFFFFFFU  /* Longest cue offset and loop period, about 35 minutes */
+
+/* Exported types ------------------------------------------------------------*/
+/* One step of the sequence, applied to all lights at once */
+typedef struct {
+  uint32_t offset_us;                   /* Time from the start of the pass */
+  uint16_t permille[VAL_LIGHT_COUNT];   /* Target (0-1000), LED_DRIVER_PERMILLE_HOLD keeps the light */
+  uint16_t duration_ms;                 /* Transition time, 0 switches at once */
+  uint8_t curve;                        /* LED_Driver_FadeCurve_t of the transition */
+} Sequencer_Cue_t;
+
+typedef struct {
+  bool running;
+  uint8_t cue_count;          /* Cues in the list */
+  uint8_t next_cue;           /* Cue due next while running */
+  uint32_t period_us;         /* Loop period, 0 to play once */
+  uint32_t passes;            /* Passes completed since the start */
+  uint32_t late_max_us;       /* Longest delay of a cue past its time */
+} Sequencer_Status_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Append a cue to the list
+ * @param cue Cue to add; offsets must not decrease along the list
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid or out of
+ *         order, VAL_ERROR if the list is full, VAL_BUSY while running
+ */
+VAL_Status Sequencer_AddCue(const Sequencer_Cue_t* cue);
+
+/**
+ * @brief Stop the sequence and empty the cue list
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status Sequencer_Clear(void);
+
+/**
+ * @brief Play the cue list from the start
+ * @note A running sequence restarts
+ * @param periodUs Time from the start of one pass to the next, 0 to play once
+ * @return VAL_Status VAL_OK if started, VAL_PARAM if the period does not
+ *         exceed the last cue offset or is too long, VAL_ERROR if the list
+ *         is empty or the timer failed
+ */
+VAL_Status Sequencer_Start(uint32_t periodUs);
+
+/**
+ * @brief Stop the sequence; the lights keep their intensities
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status Sequencer_Stop(void);
+
+/**
+ * @brief Check whether a sequence is playing
+ * @return bool true while running; the cue timer stops in stop mode
+ */
+bool Sequencer_IsRunning(void);
+
+/**
+ * @brief Get the sequencer state
+ * @param status Pointer to store the state
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status Sequencer_GetStatus(Sequencer_Status_t* status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_SEQUENCER_H */
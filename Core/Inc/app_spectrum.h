@@ -0,0 +1,55 @@
+/**
+  ******************************************************************************
+  * @file    app_spectrum.h
+  * @brief   Header for app_spectrum.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_SPECTRUM_H
+#define __APP_SPECTRUM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define SPECTRUM_SIZE       256U    /* Samples per analysis, a power of two */
+#define SPECTRUM_BINS       (SPECTRUM_SIZE / 2U)  /* Bins from DC below the Nyquist frequency */
+#define SPECTRUM_PEAKS_MAX  8U      /* Largest peaks reported */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  uint16_t bin;               /* Frequency in multiples of the rate over SPECTRUM_SIZE */
+  float amplitude;            /* Peak amplitude of the tone, counts */
+} Spectrum_Peak_t;
+
+typedef struct {
+  float mean;                 /* Average, counts */
+  float ripple_rms;           /* RMS of the samples about the average, counts */
+  uint8_t peak_count;         /* Peaks found, largest first */
+  Spectrum_Peak_t peaks[SPECTRUM_PEAKS_MAX];
+} Spectrum_Result_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Find the largest tones in a block of samples
+ * @note  Task context; a Q15 fixed-point FFT of a Hann window on static
+ *        buffers, so one caller at a time. Peaks are local maxima of the
+ *        spectrum above DC.
+ * @param samples SPECTRUM_SIZE samples, evenly spaced, in counts
+ * @param peaks Largest peaks wanted (1-SPECTRUM_PEAKS_MAX)
+ * @param result Pointer to store the analysis
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status Spectrum_Analyze(const uint16_t* samples, uint8_t peaks, Spectrum_Result_t* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_SPECTRUM_H */
@@ -0,0 +1,161 @@
+/**
+  ******************************************************************************
+  * @file    app_spi_link.h
+  * @brief   Header for app_spi_link.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_SPI_LINK_H
+#define __APP_SPI_LINK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+#include "val_serial_comms.h"
+#include "val_spi_slave.h"
+
+#if VAL_SPI_SLAVE_ENABLED
+#include "app_transport.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define SPI_LINK_VERSION          1U
+
+/* First byte of a transaction: register, with SPI_LINK_READ to select it
+ * for the reply of the next transaction; a read gives the bytes wanted in
+ * the second byte, 0 for all of them */
+#define SPI_LINK_READ             0x80U
+
+/* First two bytes of every reply, then the data of the read selected */
+#define SPI_LINK_REPLY_HEADER     2U      /* Status, data length */
+
+/* Reply status bits */
+#define SPI_LINK_STATUS_EVENTS    0x01U   /* Event FIFO not empty */
+#define SPI_LINK_STATUS_MESSAGE   0x02U   /* Protocol bytes waiting in SPI_LINK_REG_MESSAGE */
+#define SPI_LINK_STATUS_ALARM     0x04U   /* A light has an alarm */
+#define SPI_LINK_STATUS_ERROR     0x08U   /* The previous transaction was refused */
+#define SPI_LINK_STATUS_OVERFLOW  0x10U   /* Events were dropped since the last event read */
+#define SPI_LINK_STATUS_LOST      0x20U   /* The previous transaction overran the buffer */
+
+/* Registers; multi-byte values are big-endian */
+#define SPI_LINK_REG_INFO         0x00U   /* R: version, light count, frame size (2), message MTU (2) */
+#define SPI_LINK_REG_STATS        0x01U   /* R: SpiLink_Stats_t, in field order, each 4 bytes */
+#define SPI_LINK_REG_PERMILLE     0x10U   /* R/W: intensity of each light from light 1, 2 bytes each */
+#define SPI_LINK_REG_STAGE        0x11U   /* R/W: as SPI_LINK_REG_PERMILLE, held until committed */
+#define SPI_LINK_REG_COMMIT       0x12U   /* W, no data: apply the staged intensities together */
+#define SPI_LINK_REG_SNAPSHOT     0x20U   /* R: sequence (4), then SPI_LINK_SNAPSHOT_LIGHT bytes per light */
+#define SPI_LINK_REG_ALARMS       0x30U   /* R: alarm code per light; W: mask of lights to clear (4) */
+#define SPI_LINK_REG_EVENTS       0x40U   /* R: whole events, popped as they are clocked out */
+#define SPI_LINK_REG_MESSAGE      0x50U   /* R/W: host protocol bytes, as on the UART */
+
+/* Per light in SPI_LINK_REG_SNAPSHOT: permille (2), current in mA (2),
+ * temperature in 0.1 degC, signed (2), derate in permille (2), alarm code,
+ * zero */
+#define SPI_LINK_SNAPSHOT_LIGHT   10U
+
+/* Events, SPI_LINK_EVENT_SIZE bytes: type, light ID, value (2) */
+#define SPI_LINK_EVENT_SIZE       4U
+#define SPI_LINK_EVENT_ALARM      1U      /* Alarm code changed, 0 when cleared */
+#define SPI_LINK_EVENT_DERATE     2U      /* Derate factor changed, permille */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  uint32_t transactions;      /* Transactions since start-up */
+  uint32_t lost;              /* Transactions that overran the buffer */
+  uint32_t refused;           /* Unknown registers, bad lengths, full queues */
+  uint32_t events_dropped;    /* Events lost to a full FIFO */
+  uint32_t max_turnaround_us; /* Longest NSS rise to next reply ready */
+} SpiLink_Stats_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Start the SPI slave link, transport init of TRANSPORT_SPI
+ * @param rx_callback Called with the bytes written to SPI_LINK_REG_MESSAGE
+ * @return VAL_Status As VAL_SpiSlave_Init
+ */
+VAL_Status SpiLink_Init(Transport_RxCallback_t rx_callback);
+
+/**
+ * @brief Set the function called when the host has read queued bytes
+ * @param callback Function to call from interrupt context, or NULL
+ * @return None
+ */
+void SpiLink_SetTxCallback(Transport_TxCallback_t callback);
+
+/**
+ * @brief Queue a message for SPI_LINK_REG_MESSAGE, without waiting
+ * @param segments Buffers of the message, in order
+ * @param count Number of segments
+ * @return VAL_Status VAL_OK if queued, VAL_BUSY if there is no room for it yet,
+ *         VAL_PARAM if it is longer than SpiLink_GetMtu
+ */
+VAL_Status SpiLink_SendSegments(const VAL_Serial_Segment_t* segments, uint8_t count);
+
+/**
+ * @brief Get the longest message that can be queued
+ * @return uint16_t Bytes
+ */
+uint16_t SpiLink_GetMtu(void);
+
+/**
+ * @brief Check whether queued bytes wait for the host
+ * @return bool true until the host has read them all
+ */
+bool SpiLink_IsBusy(void);
+
+/**
+ * @brief Get the time since the last transaction
+ * @return uint32_t Milliseconds
+ */
+uint32_t SpiLink_GetIdleTime(void);
+
+/**
+ * @brief Wait until the host has read everything queued
+ * @param timeout Maximum time to wait in milliseconds
+ * @return VAL_Status VAL_OK if read, VAL_TIMEOUT otherwise
+ */
+VAL_Status SpiLink_Flush(uint32_t timeout);
+
+/**
+ * @brief Get the number of bytes queued since start-up, wrapping
+ * @return uint32_t Bytes
+ */
+uint32_t SpiLink_GetTxQueued(void);
+
+/**
+ * @brief Get the number of bytes the host has read since start-up, wrapping
+ * @return uint32_t Bytes
+ */
+uint32_t SpiLink_GetTxSent(void);
+
+/**
+ * @brief Queue events for the alarm and derate changes of the last publication
+ * @note Called from the coordinator task on every wakeup
+ * @return None
+ */
+void SpiLink_Poll(void);
+
+/**
+ * @brief Check whether the SPI slave link has been started
+ * @return bool true once started
+ */
+bool SpiLink_IsActive(void);
+
+/**
+ * @brief Get the link counts
+ * @param stats Pointer to store them
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if stats is NULL
+ */
+VAL_Status SpiLink_GetStats(SpiLink_Stats_t* stats);
+#endif /* VAL_SPI_SLAVE_ENABLED */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_SPI_LINK_H */
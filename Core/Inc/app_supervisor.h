@@ -0,0 +1,109 @@
+/**
+  ******************************************************************************
+  * @file    app_supervisor.h
+  * @brief   Header for app_supervisor.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_SUPERVISOR_H
+#define __APP_SUPERVISOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define SUPERVISOR_WATCHDOG_MS   4000  /* IWDG timeout, above the longest stop */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  SUPERVISOR_TASK_COORDINATOR = 0,  /* Sensor, intensity and alarm sync, telemetry */
+  SUPERVISOR_TASK_COMMS,            /* Command decoding and responses */
+  SUPERVISOR_TASK_WORKER,           /* Slow commands, flash writes */
+  SUPERVISOR_TASK_LOGGER,           /* Diagnostic messages */
+  SUPERVISOR_TASK_ERROR_LOG,        /* Error log flash writes */
+  SUPERVISOR_TASK_SCHEDULER,        /* Periodic jobs */
+  SUPERVISOR_TASK_COUNT
+} Supervisor_Task_t;
+
+typedef struct {
+  uint32_t deadline_ms;      /* Longest expected work item */
+  uint32_t limit_ms;         /* Work item time at which the watchdog resets */
+  uint32_t runs;             /* Work items completed */
+  uint32_t misses;           /* Work items that took longer than the deadline */
+  uint32_t worst_us;         /* Longest work item */
+  uint32_t last_over_us;     /* Time past the deadline of the latest miss */
+} Supervisor_Stats_t;
+
+typedef struct {
+  bool watchdog;             /* The last reset was caused by the watchdog */
+  uint8_t task;              /* Supervisor_Task_t over its limit, SUPERVISOR_TASK_COUNT if none */
+  uint32_t over_ms;          /* Time past its deadline when reset */
+} Supervisor_Reset_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Take over the reset record left by the previous run
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status Supervisor_Init(void);
+
+/**
+ * @brief Log the reset record and start the watchdog
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status Supervisor_Start(void);
+
+/**
+ * @brief Mark the start of a work item of a task
+ * @param task Task starting work, after its blocking wait returned
+ * @return None
+ */
+void Supervisor_Begin(Supervisor_Task_t task);
+
+/**
+ * @brief Mark the end of a work item and check it against the deadline
+ * @param task Task done with its work, before its next blocking wait
+ * @return None
+ */
+void Supervisor_End(Supervisor_Task_t task);
+
+/**
+ * @brief Get the deadline figures of a task
+ * @param task Task to query
+ * @param stats Pointer to store the figures
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status Supervisor_GetStats(Supervisor_Task_t task, Supervisor_Stats_t* stats);
+
+/**
+ * @brief Clear the run, miss and worst time figures of all tasks
+ * @return None
+ */
+void Supervisor_ResetStats(void);
+
+/**
+ * @brief Get the cause of the last reset, as far as the watchdog is concerned
+ * @param reset Pointer to store the record
+ * @return None
+ */
+void Supervisor_GetReset(Supervisor_Reset_t* reset);
+
+/**
+ * @brief Get the name of a task as reported to the host
+ * @param task Task to query
+ * @return const char* Task name, "none" for SUPERVISOR_TASK_COUNT
+ */
+const char* Supervisor_GetTaskName(Supervisor_Task_t task);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_SUPERVISOR_H */
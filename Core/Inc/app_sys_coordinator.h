@@ -17,22 +17,78 @@ extern "C" {
 #include <stdint.h>
 #include "app_comms_handler.h"
 #include "app_led_driver.h"
+#include "app_config.h"
+#include "app_sequencer.h"
+#include "app_rules.h"
 #include "val_status.h"
+#include <stdbool.h>
 #include "FreeRTOS.h"
 #include "queue.h"
 
+/* Exported constants --------------------------------------------------------*/
+#define SYS_COORD_POLL_MS             1000                  /* Fallback synchronization */
+#define SYS_COORD_USAGE_CHECKPOINT_MS (60U * 60U * 1000U)   /* Usage counters to flash */
+
 /* Exported types ------------------------------------------------------------*/
 typedef struct {
-    uint8_t light_id;    // Light source ID (1-3)
+    uint8_t light_id;    // Light source ID (1-VAL_LIGHT_COUNT)
     uint8_t intensity;  // Current intensity (0-100)
 } LightStatus_t;
 
+/* DMX512 reception state and counts */
+typedef struct {
+    bool active;                      // Listening to a desk instead of the host
+    uint16_t channel;                 // DMX channel of light 1 (1-512)
+    uint32_t packets;                 // Packets applied to the lights
+    uint32_t ignored;                 // Other start codes, or too few slots
+    uint32_t dropped;                 // Packets lost to line errors
+    uint8_t levels[VAL_LIGHT_COUNT];  // Last channel values applied (0-255)
+} SYS_Coordinator_DmxStatus_t;
+
+/* Report-on-change telemetry: a due sample is only sent when a streamed
+ * value changed, a reading moved further than its deadband from the last
+ * sample sent, or the heartbeat expired */
+typedef struct {
+    bool enabled;                     // Set by SYS_Coordinator_SetTelemetry
+    int32_t current_ma;               // Current deadband, 0 for any change
+    int32_t temperature_cdeg;         // Temperature deadband, 0 for any change
+    uint32_t heartbeat_ms;            // Longest gap between samples, 0 for 1 s
+} SYS_Coordinator_OnChange_t;
+
+/* The light state as one publication left it, all fields consistent */
+typedef struct {
+    uint32_t sequence;                          // Publications so far; changes with any field
+    uint16_t permille[VAL_LIGHT_COUNT];         // Intensities (0-1000)
+    uint8_t alarms[VAL_LIGHT_COUNT];            // Alarm codes, 0 for none
+    uint16_t derate[VAL_LIGHT_COUNT];           // Derate factors in permille
+    LightSensorData_t sensors[VAL_LIGHT_COUNT]; // Latest sensor readings
+    LightSampleStamp_t sensors_stamp;           // When they were taken
+} SYS_Coordinator_Snapshot_t;
+
 /* Exported functions prototypes ---------------------------------------------*/
 VAL_Status SYS_Coordinator_Init(void);
 
+/**
+ * @brief Check whether the coordinator has finished initializing
+ * @return bool true once light, sensor and alarm requests are served
+ */
+bool SYS_Coordinator_IsReady(void);
+
+/**
+ * @brief Wake the coordinator task to synchronize everything
+ * @return None
+ */
+void SYS_Coordinator_Poll(void);
+
+/**
+ * @brief Have the error log task checkpoint the usage counters
+ * @return None
+ */
+void SYS_Coordinator_RequestUsageSave(void);
+
 /**
  * @brief Get the current intensity of a specific light source
- * @param lightId Light source ID (1-3)
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
  * @param intensity Pointer to store the retrieved intensity
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
@@ -47,7 +103,7 @@ VAL_Status SYS_Coordinator_GetAllLightIntensities(uint8_t* intensities);
 
 /**
  * @brief Set the intensity for a specific light source
- * @param lightId Light source ID (1-3)
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
  * @param intensity Intensity value (0-100)
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
@@ -60,35 +116,601 @@ VAL_Status SYS_Coordinator_SetLightIntensity(uint8_t lightId, uint8_t intensity)
  */
 VAL_Status SYS_Coordinator_SetAllLightIntensities(uint8_t* intensities);
 
+/**
+ * @brief Get the current intensity of a specific light source in permille
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param permille Pointer to store the retrieved intensity (0-1000)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_GetLightPermille(uint8_t lightId, uint16_t* permille);
+
+/**
+ * @brief Get the current intensities of all light sources in permille
+ * @param permille Array to store the retrieved intensities (0-1000)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_GetAllLightPermille(uint16_t* permille);
+
+/**
+ * @brief Set the intensity for a specific light source in permille
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param permille Intensity value (0-1000)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_SetLightPermille(uint8_t lightId, uint16_t permille);
+
+/**
+ * @brief Set intensities for all light sources in permille
+ * @param permille Array of intensity values (0-1000)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_SetAllLightPermille(const uint16_t* permille);
+
+/**
+ * @brief Queue the intensity of a specific light source from an interrupt
+ * @note The other setters wait for the coordinator task and are task context
+ *       only; this one returns once the command is queued
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param permille Intensity value (0-1000)
+ * @return VAL_Status VAL_OK once queued, VAL_ERROR for invalid arguments,
+ *         VAL_BUSY if the queue is full or the coordinator is not running
+ */
+VAL_Status SYS_Coordinator_SetLightPermilleFromISR(uint8_t lightId, uint16_t permille);
+
+/**
+ * @brief Queue the intensities of all light sources from an interrupt
+ * @param permille Array of intensity values (0-1000)
+ * @return VAL_Status VAL_OK once queued, VAL_ERROR for invalid arguments,
+ *         VAL_BUSY if the queue is full or the coordinator is not running
+ */
+VAL_Status SYS_Coordinator_SetAllLightPermilleFromISR(const uint16_t* permille);
+
+/**
+ * @brief Set the intensities of some light sources in permille, together
+ * @note The other lights keep their outputs
+ * @param mask Lights to set, bit 0 for light 1
+ * @param values Intensity per bit set in mask, lowest bit first (0-1000)
+ * @param count Number of values, must match the bits set
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_SetMaskedLightPermille(uint32_t mask, const uint16_t* values, uint8_t count);
+
+/**
+ * @brief Queue the intensities of some light sources from an interrupt
+ * @param mask Lights to set, bit 0 for light 1
+ * @param values Intensity per bit set in mask, lowest bit first (0-1000)
+ * @param count Number of values, must match the bits set
+ * @return VAL_Status VAL_OK once queued, VAL_ERROR for invalid arguments,
+ *         VAL_BUSY if the queue is full or the coordinator is not running
+ */
+VAL_Status SYS_Coordinator_SetMaskedLightPermilleFromISR(uint32_t mask, const uint16_t* values, uint8_t count);
+
+/**
+ * @brief Set the intensity of all light sources of a group, together
+ * @param group Light group (1-CONFIG_LIGHT_GROUPS)
+ * @param intensity Intensity value (0-100)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_SetGroupIntensity(uint8_t group, uint8_t intensity);
+
+/**
+ * @brief Set the intensity of all light sources of a group in permille, together
+ * @note The other lights keep their outputs
+ * @param group Light group (1-CONFIG_LIGHT_GROUPS)
+ * @param permille Intensity value (0-1000)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_SetGroupPermille(uint8_t group, uint16_t permille);
+
+/**
+ * @brief Fade a light source to a target intensity in the background
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param permille Target intensity (0-1000)
+ * @param durationMs Fade duration in milliseconds
+ * @param curve Fade curve
+ * @return VAL_Status VAL_OK if the fade started, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_FadeLight(uint8_t lightId, uint16_t permille, uint16_t durationMs,
+                                     LED_Driver_FadeCurve_t curve);
+
+/**
+ * @brief Fade some light sources to one target intensity, together
+ * @note The other lights keep their outputs, or their fades
+ * @param mask Lights to fade, bit 0 for light 1
+ * @param permille Target intensity (0-1000)
+ * @param durationMs Fade duration in milliseconds
+ * @param curve Fade curve
+ * @return VAL_Status VAL_OK if the fade started, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_FadeMaskedLights(uint32_t mask, uint16_t permille, uint16_t durationMs,
+                                            LED_Driver_FadeCurve_t curve);
+
+/**
+ * @brief Modulate light sources with an effect until stopped
+ * @note Any other light command stops the effect
+ * @param permille Crest intensity per light (0-1000, or LED_DRIVER_PERMILLE_HOLD)
+ * @param effect Effect to start, EFFECT_SHAPE_OFF to stop a running one
+ * @return VAL_Status As LED_Driver_StartEffect, VAL_PARAM for an invalid effect
+ */
+VAL_Status SYS_Coordinator_StartEffect(const uint16_t* permille, const Effect_Config_t* effect);
+
+/**
+ * @brief Select how intensities map to the PWM duty cycle of a light source
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param curve Output curve
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_SetLightCurve(uint8_t lightId, LED_Driver_OutputCurve_t curve);
+
+/**
+ * @brief Regulate a light source to a constant current
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param currentMa Target current in mA, 0 turns the light off
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_SetLightCurrent(uint8_t lightId, int32_t currentMa);
+
+/**
+ * @brief Stage new intensities for all light sources, applied together by
+ *        SYS_Coordinator_CommitLights
+ * @note Stops the sequence and the strobe; the lights keep their
+ *       intensities until the commit
+ * @param permille Intensity per light (0-1000, or LED_DRIVER_PERMILLE_HOLD)
+ * @param syncInput true to also commit on a rising edge of the sync line
+ * @return VAL_Status VAL_OK if staged, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_StageLights(const uint16_t* permille, bool syncInput);
+
+/**
+ * @brief Apply the staged intensities to all light sources at once
+ * @return VAL_Status VAL_OK if applied, VAL_ERROR if nothing is staged
+ */
+VAL_Status SYS_Coordinator_CommitLights(void);
+
+/**
+ * @brief Change the PWM frequency of all light sources, e.g. to avoid
+ *        banding on a camera
+ * @param freqHz Frequency (VAL_PWM_FREQ_MIN_HZ-VAL_PWM_FREQ_MAX_HZ)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if out of range,
+ *         VAL_BUSY while strobing or staged intensities wait for the sync line
+ */
+VAL_Status SYS_Coordinator_SetPwmFrequency(uint32_t freqHz);
+
+/**
+ * @brief Get the PWM frequency of the light sources
+ * @return uint32_t Frequency in Hz
+ */
+uint32_t SYS_Coordinator_GetPwmFrequency(void);
+
+/**
+ * @brief Dither the steady outputs of the light sources below one timer
+ *        count, for finer deep dimming
+ * @param enable true to dither, false for one compare value per light
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status SYS_Coordinator_SetDither(bool enable);
+
+/**
+ * @brief Check whether the steady outputs are dithered
+ * @return bool true if enabled
+ */
+bool SYS_Coordinator_IsDitherEnabled(void);
+
+#ifdef BENCHMARK
+/**
+ * @brief Make a light read as over current until its alarm trips
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_InjectLightFault(uint8_t lightId);
+#endif
+
+/**
+ * @brief Add an error that is not a light alarm to the persistent error log
+ * @param errorType Type of error
+ * @param source Source of the error, stored as the light ID
+ * @param value Value that describes the error
+ * @param action Action taken (VAL_DATA_STORE_ACTION_x)
+ * @return VAL_Status VAL_OK if queued, VAL_BUSY if the log queue is full
+ */
+VAL_Status SYS_Coordinator_LogSystemError(ErrorType_t errorType, uint8_t source, float value, uint8_t action);
+
 /**
  * @brief Get sensor data for a specific light source
- * @param lightId Light source ID (1-3)
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
  * @param sensorData Pointer to store sensor readings
+ * @param stamp Pointer to store when the readings were taken, or NULL
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
-VAL_Status SYS_Coordinator_GetLightSensorData(uint8_t lightId, LightSensorData_t* sensorData);
+VAL_Status SYS_Coordinator_GetLightSensorData(uint8_t lightId, LightSensorData_t* sensorData,
+                                              LightSampleStamp_t* stamp);
 
 /**
  * @brief Get sensor data for all light sources
- * @param sensorData Array to store sensor readings (must be size 3)
+ * @param sensorData Array to store sensor readings (must hold VAL_LIGHT_COUNT entries)
+ * @param stamp Pointer to store when the readings were taken, or NULL
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
-VAL_Status SYS_Coordinator_GetAllLightSensorData(LightSensorData_t* sensorData);
+VAL_Status SYS_Coordinator_GetAllLightSensorData(LightSensorData_t* sensorData, LightSampleStamp_t* stamp);
+
+/**
+ * @brief Get intensities, alarms, sensor readings and derating all from one
+ *        publication of the light state
+ * @param snapshot Pointer to store the state
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR if snapshot is NULL
+ */
+VAL_Status SYS_Coordinator_GetSnapshot(SYS_Coordinator_Snapshot_t* snapshot);
+
+/**
+ * @brief Get the usage counters of all light sources, restored ones included
+ * @note Checkpointed to flash hourly, so up to an hour is lost on power-off
+ * @param usage Array to store the counters (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if usage is NULL
+ */
+VAL_Status SYS_Coordinator_GetUsage(LED_Driver_Usage_t* usage);
+
+/**
+ * @brief Get the on-time the ageing compensation adds to each light source
+ * @note Follows the usage counters within SYS_COORD_POLL_MS or so
+ * @param scales Array to store the output scales in permille, VAL_PWM_SCALE_UNITY
+ *        for none (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if scales is NULL
+ */
+VAL_Status SYS_Coordinator_GetAgeingScales(uint16_t* scales);
+
+/**
+ * @brief Get the flicker of all light sources at their present outputs
+ * @note Measured again after every output change, see LED_Driver_GetFlicker
+ * @param status Pointer to store the progress
+ * @param metrics Array to store the metrics (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if a pointer is NULL
+ */
+VAL_Status SYS_Coordinator_GetFlicker(LED_Driver_FlickerStatus_t* status, LED_Driver_Flicker_t* metrics);
+
+/**
+ * @brief Set the window of the flicker measurement and measure again
+ * @param windowScans Raw samples per window (LED_DRIVER_FLICKER_WINDOW_MIN-65535)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if too short
+ */
+VAL_Status SYS_Coordinator_SetFlickerWindow(uint16_t window_scans);
 
 /**
  * @brief Clear alarm for a specific light source
- * @param lightId Light source ID (1-3)
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
 VAL_Status SYS_Coordinator_ClearLightAlarm(uint8_t lightId);
 
+/**
+ * @brief Clear the alarms of a set of light sources in one command
+ * @param mask Bit n for light n+1, none above VAL_LIGHT_COUNT
+ * @param failed Set to the lights whose alarm stays, or NULL
+ * @return VAL_Status VAL_OK if all are clear, VAL_ERROR if any alarm stays
+ *         or the mask is empty or invalid
+ */
+VAL_Status SYS_Coordinator_ClearLightAlarms(uint32_t mask, uint32_t* failed);
+
+/**
+ * @brief Queue the clearing of a light source's alarm from an interrupt
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @return VAL_Status VAL_OK once queued, VAL_ERROR for an invalid ID,
+ *         VAL_BUSY if the queue is full or the coordinator is not running
+ */
+VAL_Status SYS_Coordinator_ClearLightAlarmFromISR(uint8_t lightId);
+
+/**
+ * @brief Queue the clearing of a set of light sources' alarms from an interrupt
+ * @param mask Bit n for light n+1, none above VAL_LIGHT_COUNT
+ * @return VAL_Status VAL_OK once queued, VAL_ERROR for an empty or invalid
+ *         mask, VAL_BUSY if the queue is full or the coordinator is not running
+ */
+VAL_Status SYS_Coordinator_ClearLightAlarmsFromISR(uint32_t mask);
+
 /**
  * @brief Get alarm status for all light sources
- * @param alarms Array to store alarm status (must be size 3)
+ * @param alarms Array to store alarm status (must hold VAL_LIGHT_COUNT entries)
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
 VAL_Status SYS_Coordinator_GetAlarmStatus(uint8_t* alarms);
 
+/**
+ * @brief Get the alarm state machine of a light source
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param info Pointer to store the alarm state
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_GetAlarmInfo(uint8_t lightId, LED_Driver_AlarmInfo_t* info);
+
+/**
+ * @brief Get the persistent settings in use, or those staged
+ * @param settings Pointer to store the settings
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if settings is NULL
+ */
+VAL_Status SYS_Coordinator_GetConfig(Config_Settings_t* settings);
+
+/**
+ * @brief Apply new persistent settings and store them in flash
+ * @param settings New settings
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         applied but not stored
+ */
+VAL_Status SYS_Coordinator_SetConfig(const Config_Settings_t* settings);
+
+/**
+ * @brief Start staging settings changes, applied together by
+ *        SYS_Coordinator_CommitConfig
+ * @return VAL_Status As Config_Begin
+ */
+VAL_Status SYS_Coordinator_BeginConfig(void);
+
+/**
+ * @brief Apply the staged settings at once and store them in flash
+ * @return VAL_Status As Config_Commit
+ */
+VAL_Status SYS_Coordinator_CommitConfig(void);
+
+/**
+ * @brief Drop the staged settings
+ * @return None
+ */
+void SYS_Coordinator_AbortConfig(void);
+
+/**
+ * @brief Check whether settings changes are being staged
+ * @return bool true if SYS_Coordinator_GetConfig returns staged settings
+ */
+bool SYS_Coordinator_IsConfigStaged(void);
+
+/**
+ * @brief Get the sensor calibration of a light
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param calibration Pointer to store the calibration
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status SYS_Coordinator_GetCalibration(uint8_t lightId, AnalogCalibration* calibration);
+
+/**
+ * @brief Apply a new sensor calibration to a light and store it in flash
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param calibration New calibration
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         applied but not stored
+ */
+VAL_Status SYS_Coordinator_SetCalibration(uint8_t lightId, const AnalogCalibration* calibration);
+
+/**
+ * @brief Get a saved scene
+ * @param scene Scene number (1-CONFIG_SCENE_COUNT)
+ * @param data Pointer to store the scene
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR if never saved, VAL_PARAM if invalid
+ */
+VAL_Status SYS_Coordinator_GetScene(uint8_t scene, Config_Scene_t* data);
+
+/**
+ * @brief Save a scene and store it in flash
+ * @param scene Scene number (1-CONFIG_SCENE_COUNT)
+ * @param data New scene
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         not stored, the previous scene stays in use
+ */
+VAL_Status SYS_Coordinator_SaveScene(uint8_t scene, const Config_Scene_t* data);
+
+/**
+ * @brief Get a saved command macro
+ * @param macro Macro number (1-CONFIG_MACRO_COUNT)
+ * @param data Pointer to store the macro
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR if never saved or
+ *         cleared, VAL_PARAM if invalid
+ */
+VAL_Status SYS_Coordinator_GetMacro(uint8_t macro, Config_Macro_t* data);
+
+/**
+ * @brief Save a command macro and store it in flash
+ * @param macro Macro number (1-CONFIG_MACRO_COUNT)
+ * @param data New macro, its commands already checked
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         not stored, the previous macro stays in use
+ */
+VAL_Status SYS_Coordinator_SaveMacro(uint8_t macro, const Config_Macro_t* data);
+
+/**
+ * @brief Read part of an export of the whole configuration
+ * @param offset Byte offset into the export, 0 takes a new snapshot
+ * @param data Buffer to store the bytes
+ * @param max Size of the buffer
+ * @param length Pointer to store the bytes read
+ * @param size Pointer to store the size of the whole export
+ * @return VAL_Status As Config_Export
+ */
+VAL_Status SYS_Coordinator_ExportConfig(uint32_t offset, uint8_t* data, uint16_t max, uint16_t* length, uint16_t* size);
+
+/**
+ * @brief Receive part of an export, and import it once complete
+ * @param offset Byte offset of the part, 0 starts over
+ * @param data Bytes of the part
+ * @param length Number of bytes
+ * @param received Pointer to store the bytes received
+ * @param complete Pointer to store true if this was the last part
+ * @return VAL_Status As Config_Import
+ */
+VAL_Status SYS_Coordinator_ImportConfig(uint32_t offset, const uint8_t* data, uint16_t length, uint16_t* received, bool* complete);
+
+/**
+ * @brief Apply a saved scene to some or all light sources at once
+ * @note Lights outside the mask keep their outputs
+ * @param scene Scene number (1-CONFIG_SCENE_COUNT)
+ * @param mask Lights to apply the scene to, bit 0 for light 1
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_RecallScene(uint8_t scene, uint32_t mask);
+
+/**
+ * @brief Get the lights of a light group
+ * @param group Group number (1-CONFIG_LIGHT_GROUPS)
+ * @param mask Pointer to store the lights, bit 0 for light 1
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid or the group
+ *         has no lights
+ */
+VAL_Status SYS_Coordinator_GetLightGroup(uint8_t group, uint32_t* mask);
+
+/**
+ * @brief Put the lights in their failsafe state, the host link went silent
+ * @param scene Scene to recall (1-CONFIG_SCENE_COUNT), 0 to turn all lights off
+ * @return VAL_Status VAL_OK if successful, VAL_BUSY while DMX512 or Modbus
+ *         is active, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_EnterFailsafe(uint8_t scene);
+
+/**
+ * @brief Turn all light sources off and stop whatever drives them
+ * @note The cue sequence, a strobe, fades, effects and current loops stop
+ * @return VAL_Status VAL_OK if successful, VAL_BUSY while DMX512 or Modbus
+ *         is active, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_Blackout(void);
+
+/**
+ * @brief Turn all light sources off from an interrupt, ahead of the queue
+ * @note Cuts the outputs in place and queues a set-all to 0 for the task;
+ *       the command's own SYS_Coordinator_Blackout follows from the task
+ * @return VAL_Status VAL_OK once the outputs are off, VAL_BUSY if the
+ *         coordinator is not running or DMX512 or Modbus is active
+ */
+VAL_Status SYS_Coordinator_BlackoutFromISR(void);
+
+/**
+ * @brief Append a cue to the sequence
+ * @param cue Cue to add; offsets must not decrease along the list
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid or out of
+ *         order, VAL_ERROR if the list is full, VAL_BUSY while running
+ */
+VAL_Status SYS_Coordinator_AddCue(const Sequencer_Cue_t* cue);
+
+/**
+ * @brief Stop the sequence and empty its cue list
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status SYS_Coordinator_ClearSequence(void);
+
+/**
+ * @brief Play the sequence from the start, restarting it if running
+ * @note Any later request that sets a light stops it
+ * @param periodUs Loop period in microseconds, 0 to play once
+ * @return VAL_Status VAL_OK if started, VAL_PARAM for a period not past the
+ *         last cue, VAL_ERROR if there are no cues
+ */
+VAL_Status SYS_Coordinator_StartSequence(uint32_t periodUs);
+
+/**
+ * @brief Stop the sequence, the lights keep their intensities
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status SYS_Coordinator_StopSequence(void);
+
+/**
+ * @brief Get the sequence state
+ * @param status Pointer to store the state
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status SYS_Coordinator_GetSequenceStatus(Sequencer_Status_t* status);
+
+/**
+ * @brief Fire all light sources on each edge of the external trigger input,
+ *        or every period
+ * @note Stops the sequence; any later request that sets a light, or a
+ *       sequence start, stops the strobe
+ * @param durationUs Pulse length in microseconds (1 to VAL_PWM_STROBE_MAX_US)
+ * @param periodUs Pulse period in microseconds (above the length, up to
+ *        VAL_PWM_STROBE_PERIOD_MAX_US), 0 to fire on the trigger input
+ * @param permille Intensity per light during the pulse (0-1000)
+ * @param fallingEdge Fire on the falling instead of the rising edge
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_BUSY
+ *         if the rate timer is in use, VAL_ERROR if the ADC could not be
+ *         reconfigured
+ */
+VAL_Status SYS_Coordinator_StartStrobe(uint32_t durationUs, uint32_t periodUs, const uint16_t* permille,
+                                       bool fallingEdge);
+
+/**
+ * @brief Return to continuous operation with all light sources off
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_StopStrobe(void);
+
+/**
+ * @brief Get the strobe configuration and counts
+ * @param status Pointer to store the state
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status SYS_Coordinator_GetStrobeStatus(LED_Driver_StrobeStatus_t* status);
+
+/**
+ * @brief Append a rule to the rules table
+ * @note Rules are evaluated on every sample and kept until cleared or reset;
+ *       their light actions are skipped while DMX512 is active
+ * @param rule Rule to add
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR
+ *         if the table is full
+ */
+VAL_Status SYS_Coordinator_AddRule(const Rules_Rule_t* rule);
+
+/**
+ * @brief Empty the rules table
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status SYS_Coordinator_ClearRules(void);
+
+/**
+ * @brief Get the rules table size and counters
+ * @param status Pointer to store them
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status SYS_Coordinator_GetRulesStatus(Rules_Status_t* status);
+
+/**
+ * @brief Check whether DMX512 mode can start at a channel
+ * @param channel DMX channel of light 1; the others follow it
+ * @return VAL_Status VAL_OK if it can, VAL_PARAM if the lights would not fit
+ *         into the 512 channels, VAL_BUSY if DMX512 or Modbus mode is running
+ */
+VAL_Status SYS_Coordinator_CheckDmx(uint16_t channel);
+
+/**
+ * @brief Hand the lights and the serial link over to a DMX512 desk
+ * @note The host link stops until no packet has arrived for a second; the
+ *       lights then keep the last levels received
+ * @param channel DMX channel of light 1; the others follow it
+ * @return VAL_Status As SYS_Coordinator_CheckDmx, else as VAL_Serial_StartDmx
+ */
+VAL_Status SYS_Coordinator_StartDmx(uint16_t channel);
+
+/**
+ * @brief Get the DMX512 state and the counts of the last session
+ * @param status Pointer to store the state
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status SYS_Coordinator_GetDmxStatus(SYS_Coordinator_DmxStatus_t* status);
+
+/**
+ * @brief Start, change or stop a periodic telemetry stream
+ * @param stream Stream number (1-COMMS_TELEMETRY_STREAMS)
+ * @param rateHz Samples per second (1-50), 0 to stop
+ * @param fields COMMS_TELEMETRY_* fields to stream
+ * @param onChange Deadbands and heartbeat to send samples only on change,
+ *        NULL to send every sample
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM for an unknown stream,
+ *         an unsupported rate, a negative deadband or a heartbeat over a
+ *         minute
+ */
+VAL_Status SYS_Coordinator_SetTelemetry(uint8_t stream, uint8_t rateHz, uint8_t fields,
+                                        const SYS_Coordinator_OnChange_t* onChange);
+
+/**
+ * @brief Check whether any telemetry stream is running
+ * @return bool true if samples are being streamed
+ */
+bool SYS_Coordinator_IsTelemetryActive(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,145 @@
+/**
+  ******************************************************************************
+  * @file    app_trace.h
+  * @brief   Header for app_trace.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_TRACE_H
+#define __APP_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define TRACE_ENTRY_COUNT        128  /* Entries kept, a power of two */
+#define TRACE_KERNEL_ENTRY_COUNT 256  /* Scheduler entries kept, a power of two */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  TRACE_TYPE_COMMAND = 1,    /* A command was handled */
+  TRACE_TYPE_ALARM           /* An alarm state machine changed state */
+} Trace_Type_t;
+
+/* One trace entry; the binary system/trace body sends it as is */
+typedef struct __attribute__((packed)) {
+  uint32_t time_us;          /* VAL_SysClock_GetMicros when recorded */
+  uint32_t cycles;           /* Command: handler time in cycles; alarm: 0 */
+  uint8_t type;              /* Trace_Type_t */
+  uint8_t code;              /* Command: COMMS_BIN_* code; alarm: light ID */
+  uint8_t status;            /* Command: VAL_Status; alarm: LED_Driver_AlarmState_t */
+  uint8_t detail;            /* Command: 1 if binary; alarm: ERROR_x code, 0 if none */
+} Trace_Entry_t;
+
+/* Scheduler event; every entry also names the task running at the time */
+typedef enum {
+  TRACE_KERNEL_SWITCH_IN = 1,   /* Task starts running; object: its priority */
+  TRACE_KERNEL_SWITCH_OUT,      /* Task stops running; object: its priority */
+  TRACE_KERNEL_ISR_ENTER,       /* object: exception number (IRQn + 16) */
+  TRACE_KERNEL_ISR_EXIT,        /* object: exception number */
+  TRACE_KERNEL_BLOCK_RECEIVE,   /* Task waits to take from a queue, semaphore, mutex or stream buffer; object: its address */
+  TRACE_KERNEL_BLOCK_SEND,      /* Task waits for room in a queue or stream buffer; object: its address */
+  TRACE_KERNEL_BLOCK_NOTIFY,    /* Task waits for a notification; object: 0 */
+  TRACE_KERNEL_INHERIT,         /* Mutex holder raised; task: the holder, object: priority now */
+  TRACE_KERNEL_DISINHERIT       /* Mutex holder back; task: the holder, object: priority now */
+} Trace_KernelEvent_t;
+
+/* One scheduler entry; the binary system/kernel_trace body sends it as is */
+typedef struct __attribute__((packed)) {
+  uint32_t cycles;           /* DWT cycle counter when recorded */
+  uint8_t event;             /* Trace_KernelEvent_t */
+  uint8_t task;              /* FreeRTOS task number (uxTaskGetSystemState xTaskNumber) */
+  uint16_t object;           /* Per event, addresses as their low 16 bits */
+} Trace_KernelEntry_t;
+
+typedef struct {
+  bool enabled;
+  uint32_t next;             /* Sequence number the next entry will get */
+  uint32_t records;          /* Entries recorded since enabled or reset */
+  uint64_t cost_cycles;      /* Cycles spent recording them */
+  uint64_t elapsed_us;       /* Time recorded over, since enabled or reset */
+} Trace_KernelStatus_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Record a trace entry
+ * @param type Entry type
+ * @param code Command code or light ID
+ * @param status Command status or alarm state
+ * @param detail Format flag or error code
+ * @param cycles Command duration in cycles, 0 for alarms
+ * @return None
+ */
+void Trace_Record(Trace_Type_t type, uint8_t code, uint8_t status, uint8_t detail, uint32_t cycles);
+
+/**
+ * @brief Copy recorded entries, oldest first
+ * @param from Sequence number of the first entry wanted
+ * @param entries Array to store the entries
+ * @param max_entries Size of the array
+ * @param first Pointer to store the sequence number of the first entry copied
+ * @return uint8_t Number of entries copied
+ */
+uint8_t Trace_Read(uint32_t from, Trace_Entry_t* entries, uint8_t max_entries, uint32_t* first);
+
+/**
+ * @brief Get the sequence number the next entry will get
+ * @return uint32_t Number of entries recorded since start-up
+ */
+uint32_t Trace_GetNext(void);
+
+/**
+ * @brief Start or stop recording scheduler events
+ * @note  Starting clears the recording cost figures; the entries stay
+ * @param enable true to record
+ * @return None
+ */
+void Trace_KernelEnable(bool enable);
+
+/**
+ * @brief Clear the recording cost figures
+ * @return None
+ */
+void Trace_KernelReset(void);
+
+/**
+ * @brief Get the scheduler trace state and what recording costs
+ * @param status Pointer to store the status
+ * @return None
+ */
+void Trace_KernelGetStatus(Trace_KernelStatus_t* status);
+
+/**
+ * @brief Copy recorded scheduler entries, oldest first
+ * @param from Sequence number of the first entry wanted
+ * @param entries Array to store the entries
+ * @param max_entries Size of the array
+ * @param first Pointer to store the sequence number of the first entry copied
+ * @return uint8_t Number of entries copied
+ */
+uint8_t Trace_KernelRead(uint32_t from, Trace_KernelEntry_t* entries, uint8_t max_entries, uint32_t* first);
+
+/* FreeRTOS trace hooks (FreeRTOSConfig.h) and interrupt handlers
+ * (stm32l4xx_it.c); each returns at once while recording is off */
+void Trace_KernelSwitchedIn(uint32_t task, uint32_t priority);
+void Trace_KernelSwitchedOut(uint32_t task, uint32_t priority);
+void Trace_KernelIsrEnter(void);
+void Trace_KernelIsrExit(void);
+void Trace_KernelBlockedReceive(const void* object);
+void Trace_KernelBlockedSend(const void* object);
+void Trace_KernelBlockedNotify(void);
+void Trace_KernelInherit(uint32_t task, uint32_t priority);
+void Trace_KernelDisinherit(uint32_t task, uint32_t priority);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_TRACE_H */
@@ -0,0 +1,143 @@
+/**
+  ******************************************************************************
+  * @file    app_transport.h
+  * @brief   Header for app_transport.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_TRANSPORT_H
+#define __APP_TRANSPORT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+#include "val_serial_comms.h"
+#include "val_spi_slave.h"
+
+/* Exported types ------------------------------------------------------------*/
+/* Host links the protocol can run over */
+typedef enum {
+  TRANSPORT_UART = 0,         /* USART1, point to point or RS-485 bus */
+#if VAL_SPI_SLAVE_ENABLED
+  TRANSPORT_SPI,              /* SPI1 slave register link to a host MCU */
+#endif
+  TRANSPORT_COUNT
+} Transport_Id_t;
+
+/* Transport the host protocol starts on: the SPI link where the board
+ * profile wires one */
+#if VAL_SPI_SLAVE_ENABLED
+#define TRANSPORT_DEFAULT TRANSPORT_SPI
+#else
+#define TRANSPORT_DEFAULT TRANSPORT_UART
+#endif
+
+/* Received bytes, a block at a time, from interrupt context */
+typedef void (*Transport_RxCallback_t)(const uint8_t* data, uint16_t length);
+
+/* Room was freed in the transmit queue, from interrupt context */
+typedef void (*Transport_TxCallback_t)(void);
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Start a transport and make it the one messages are sent over
+ * @param id Transport to start
+ * @param rx_callback Called with every block of received bytes
+ * @return VAL_Status VAL_OK if started, VAL_PARAM for an unknown transport,
+ *         else as the transport's initialization
+ */
+VAL_Status Transport_Init(Transport_Id_t id, Transport_RxCallback_t rx_callback);
+
+/**
+ * @brief Set the function called when room frees up in the transmit queue
+ * @param callback Function to call, or NULL
+ * @return None
+ */
+void Transport_SetTxCallback(Transport_TxCallback_t callback);
+
+/**
+ * @brief Queue a message gathered from several buffers, without waiting
+ * @note  Buffers outside flash are copied before this returns
+ * @param segments Buffers of the message, in order
+ * @param count Number of segments
+ * @return VAL_Status VAL_OK if queued, VAL_BUSY if there is no room for it yet,
+ *         VAL_PARAM if it is longer than Transport_GetMtu
+ */
+VAL_Status Transport_SendSegments(const VAL_Serial_Segment_t* segments, uint8_t count);
+
+/**
+ * @brief Queue a message without waiting, as Transport_SendSegments
+ * @param data Message
+ * @param length Message length
+ * @return VAL_Status As Transport_SendSegments
+ */
+VAL_Status Transport_Send(const uint8_t* data, uint16_t length);
+
+/**
+ * @brief Get the longest message the transport takes in one send
+ * @return uint16_t Bytes
+ */
+uint16_t Transport_GetMtu(void);
+
+/**
+ * @brief Check whether messages are still queued or being sent
+ * @return bool true while the transport is sending
+ */
+bool Transport_IsBusy(void);
+
+/**
+ * @brief Get the time since the last byte was received
+ * @return uint32_t Milliseconds
+ */
+uint32_t Transport_GetIdleTime(void);
+
+/**
+ * @brief Wait until everything queued has been sent
+ * @param timeout Maximum time to wait in milliseconds
+ * @return VAL_Status VAL_OK if sent, VAL_TIMEOUT otherwise
+ */
+VAL_Status Transport_Flush(uint32_t timeout);
+
+/**
+ * @brief Get the number of bytes queued since start-up, wrapping
+ * @return uint32_t Bytes
+ */
+uint32_t Transport_GetTxQueued(void);
+
+/**
+ * @brief Get the number of bytes sent since start-up, wrapping
+ * @return uint32_t Bytes
+ */
+uint32_t Transport_GetTxSent(void);
+
+/**
+ * @brief Get how full the transmit queue is
+ * @return uint16_t Bytes queued and not sent yet, in permille of
+ *         Transport_GetMtu, at most 1000
+ */
+uint16_t Transport_GetTxFill(void);
+
+/**
+ * @brief Get the transport messages are sent over
+ * @return Transport_Id_t Active transport
+ */
+Transport_Id_t Transport_GetActive(void);
+
+/**
+ * @brief Get the protocol name of a transport
+ * @param id Transport
+ * @return const char* Name, "unknown" for an invalid transport
+ */
+const char* Transport_GetName(Transport_Id_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_TRANSPORT_H */
@@ -0,0 +1,110 @@
+/**
+  ******************************************************************************
+  * @file    app_tx_pool.h
+  * @brief   Header for app_tx_pool.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_TX_POOL_H
+#define __APP_TX_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include "val_status.h"
+#include "val_serial_comms.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define TX_POOL_SLOT_COUNT       4    /* Messages formatted or waiting at once */
+#define TX_POOL_SLOT_SIZE        448  /* Fits the longest event, an alarm for every light */
+#define TX_POOL_INVALID          0xFFU
+
+/* Exported types ------------------------------------------------------------*/
+typedef uint8_t TxPool_Handle_t;
+
+/* Outbound priorities, most urgent first */
+typedef enum {
+  TX_PRIORITY_ALARM = 0,
+  TX_PRIORITY_RESPONSE,
+  TX_PRIORITY_TELEMETRY,
+  TX_PRIORITY_LOG,
+  TX_PRIORITY_COUNT
+} TxPool_Priority_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Initialize the pool and hook it to the transport's TX completion
+ * @return None
+ */
+void TxPool_Init(void);
+
+/**
+ * @brief Take a free message slot
+ * @param priority Priority the message will be sent with
+ * @return TxPool_Handle_t Slot handle, TX_POOL_INVALID if no slot is free
+ *         for this priority
+ */
+TxPool_Handle_t TxPool_Acquire(TxPool_Priority_t priority);
+
+/**
+ * @brief Get the buffer of a slot
+ * @param handle Slot handle
+ * @return char* TX_POOL_SLOT_SIZE bytes to format into, NULL for an invalid handle
+ */
+char* TxPool_GetBuffer(TxPool_Handle_t handle);
+
+/**
+ * @brief Queue the message of a slot; the slot is released once it is sent
+ * @param handle Slot handle
+ * @param length Number of bytes formatted into the slot
+ * @return VAL_Status VAL_OK if queued, VAL_PARAM for an invalid handle or length
+ */
+VAL_Status TxPool_Queue(TxPool_Handle_t handle, size_t length);
+
+/**
+ * @brief Release a slot without sending it
+ * @param handle Slot handle
+ * @return None
+ */
+void TxPool_Release(TxPool_Handle_t handle);
+
+/**
+ * @brief Send a message from the caller's buffer, ahead of less urgent queued messages
+ * @param data Message
+ * @param length Message length
+ * @param priority Priority of the message
+ * @param timeout Maximum time to wait for TX queue space in milliseconds
+ * @return VAL_Status VAL_OK if queued, VAL_TIMEOUT if the queue stayed full,
+ *         VAL_PARAM for invalid arguments
+ */
+VAL_Status TxPool_SendDirect(const uint8_t* data, size_t length, TxPool_Priority_t priority,
+                             uint32_t timeout);
+
+/**
+ * @brief Send a message gathered from several buffers, as TxPool_SendDirect
+ * @param segments Buffers of the message, in order
+ * @param count Number of segments
+ * @param priority Priority of the message
+ * @param timeout Maximum time to wait for TX queue space in milliseconds
+ * @return VAL_Status VAL_OK if queued, VAL_TIMEOUT if the queue stayed full,
+ *         VAL_PARAM for invalid arguments
+ */
+VAL_Status TxPool_SendSegments(const VAL_Serial_Segment_t* segments, uint8_t count,
+                               TxPool_Priority_t priority, uint32_t timeout);
+
+/**
+ * @brief Get the fewest free slots seen since start-up
+ * @return uint8_t Low-water mark of free slots
+ */
+uint8_t TxPool_GetMinFree(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_TX_POOL_H */
@@ -0,0 +1,66 @@
+/**
+  ******************************************************************************
+  * @file    app_update.h
+  * @brief   Header for app_update.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_UPDATE_H
+#define __APP_UPDATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+#include "val_update.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define UPDATE_MIN_SIZE          (VAL_UPDATE_BOOT_SIZE + 8U)  /* Boot loader, initial stack pointer and reset vector */
+#define UPDATE_IDLE_TIMEOUT_MS   10000U   /* Silence before the updater resets into the boot loader again */
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+ * @brief Get the largest image an update takes
+ * @return uint32_t Bytes of flash below the data store
+ */
+uint32_t Update_GetMaxSize(void);
+
+/**
+ * @brief Check an update request and take the flash for it
+ * @note  Communications task only. Once this succeeds the data store cannot
+ *        write any more, and Update_Run must follow after the response.
+ * @param size Image size in bytes
+ * @return VAL_Status VAL_OK if the update can run, VAL_PARAM if the size is out
+ *         of range, VAL_BUSY while the data store writes
+ */
+VAL_Status Update_Prepare(uint32_t size);
+
+/**
+ * @brief Reset into the boot loader, which receives the image
+ * @note  Never returns: the boot loader resets the MCU into the new image
+ *        once it is programmed and checked. Call once the response to the
+ *        update request has been sent.
+ * @param size Image size in bytes, as given to Update_Prepare
+ * @param crc CRC-32 of the image, as zlib computes it
+ * @param address Device address answered in COMMS_BIN_TYPE_ADDR_CMD frames
+ * @return None
+ */
+void Update_Run(uint32_t size, uint32_t crc, uint8_t address) __attribute__((noreturn));
+
+/**
+ * @brief Boot loader reset handler
+ * @note  Runs on every reset, before the startup code: starts the firmware
+ *        unless an update was requested or the firmware is not whole
+ * @return None
+ */
+void Update_Boot(void) __attribute__((noreturn));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_UPDATE_H */
@@ -0,0 +1,42 @@
+/**
+  ******************************************************************************
+  * @file    lwjson_opts.h
+  * @brief   LwJSON options for the command protocol
+  ******************************************************************************
+  * @attention
+  *
+  * Commands are decoded with the stream parser only, one static instance in
+  * app_comms_handler.c, and its buffers are sized for this protocol rather
+  * than for any JSON:
+  *
+  * - Stack: the deepest command is a batch holding an array data field,
+  *   [{"data":{"key":[...]}}], six entries. Two more leave room for
+  *   unknown fields; deeper input is rejected as invalid JSON.
+  * - Keys: the longest data key is 20 characters, deadband_temperature.
+  *   Longer keys are truncated and match nothing.
+  * - Strings: topics and actions fit COMMAND_FIELD_MAX_LEN, and IDs
+  *   longer than MSG_ID_MAX_LEN are truncated from the first chunk anyway.
+  *
+  * This takes the parser from 932 to 324 bytes. The token parser is not
+  * used; numbers are converted by COMMS_Handler_ParseInt, so an int32_t
+  * matches it and keeps lwjson.c free of 64-bit arithmetic.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef LWJSON_OPTS_HDR_H
+#define LWJSON_OPTS_HDR_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define LWJSON_CFG_INT_TYPE                  int32_t
+#define LWJSON_CFG_REAL_TYPE                 float
+
+#define LWJSON_CFG_STREAM_STACK_SIZE         8
+#define LWJSON_CFG_STREAM_KEY_MAX_LEN        23
+#define LWJSON_CFG_STREAM_STRING_MAX_LEN     64
+
+#endif /* LWJSON_OPTS_HDR_H */
@@ -0,0 +1,91 @@
+/**
+  ******************************************************************************
+  * @file    app_boot.c
+  * @brief   Application layer start-up timeline
+  ******************************************************************************
+  * @attention
+  *
+  * This module records when each start-up stage completed, measured with the
+  * DWT cycle counter. The counter starts once VAL_SysClock_Init has set up
+  * the system clock, so all times are relative to that point; the time spent
+  * in reset and HAL_Init before it is not included.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_boot.h"
+#include "val.h"
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t stage_cycles[BOOT_STAGE_COUNT];
+static uint32_t stages_done = 0;  /* One bit per Boot_Stage_t */
+
+static const char* const stage_names[BOOT_STAGE_COUNT] = {
+  "outputs_safe",
+  "scheduler",
+  "serial",
+  "analog",
+  "data_store",
+  "coordinator",
+  "ready"
+};
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Record that a start-up stage has completed
+ * @note   Only the first call per stage is kept
+ * @param  stage: Stage that completed
+ * @retval None
+ */
+void Boot_Mark(Boot_Stage_t stage) {
+  uint32_t cycles = VAL_SysClock_GetCycles();
+  uint32_t primask;
+
+  if (stage >= BOOT_STAGE_COUNT) {
+    return;
+  }
+
+  /* Stages complete in parallel tasks */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if ((stages_done & (1U << stage)) == 0) {
+    stage_cycles[stage] = cycles;
+    stages_done |= 1U << stage;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Get the time at which a start-up stage completed
+ * @param  stage: Stage to query
+ * @param  time_us: Pointer to store the microseconds since the clock was configured
+ * @retval VAL_Status: VAL_OK if the stage completed, VAL_ERROR if not yet,
+ *         VAL_PARAM if invalid
+ */
+VAL_Status Boot_GetTime(Boot_Stage_t stage, uint32_t* time_us) {
+  if (stage >= BOOT_STAGE_COUNT || time_us == NULL) {
+    return VAL_PARAM;
+  }
+
+  if ((stages_done & (1U << stage)) == 0) {
+    return VAL_ERROR;
+  }
+
+  *time_us = VAL_SysClock_CyclesToMicros(stage_cycles[stage]);
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the name of a start-up stage as reported to the host
+ * @param  stage: Stage to query
+ * @retval const char*: Stage name, "unknown" for invalid stages
+ */
+const char* Boot_GetName(Boot_Stage_t stage) {
+  if (stage >= BOOT_STAGE_COUNT) {
+    return "unknown";
+  }
+
+  return stage_names[stage];
+}
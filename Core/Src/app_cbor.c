@@ -0,0 +1,713 @@
+/**
+  ******************************************************************************
+  * @file    app_cbor.c
+  * @brief   Application layer CBOR reader and writer
+  ******************************************************************************
+  * @attention
+  *
+  * Only what the command protocol needs is supported: integers, text and
+  * byte strings of definite length, arrays, maps, tags, false, true, null
+  * and floats. Each head is decoded from the buffer in place, so reading a
+  * command costs a few shifts per item instead of a character by character
+  * scan.
+  *
+  * CBOR_FromJson turns a message formatted by JSON_Writer_t into the same
+  * structure in CBOR. It needs no other buffer: the result is never much
+  * longer than the text, and with the text moved to the end of its buffer
+  * it is written over it from the start.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_cbor.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+/* Major types, in the top three bits of the initial byte */
+#define CBOR_MAJOR_UINT               0U
+#define CBOR_MAJOR_NINT               1U
+#define CBOR_MAJOR_BYTES              2U
+#define CBOR_MAJOR_TEXT               3U
+#define CBOR_MAJOR_ARRAY              4U
+#define CBOR_MAJOR_MAP                5U
+#define CBOR_MAJOR_TAG                6U
+#define CBOR_MAJOR_SIMPLE             7U
+
+/* Additional information, in the low five bits */
+#define CBOR_INFO_UINT8               24U
+#define CBOR_INFO_UINT64              27U
+#define CBOR_INFO_INDEFINITE          31U
+#define CBOR_SIMPLE_FALSE             20U
+#define CBOR_SIMPLE_TRUE              21U
+#define CBOR_SIMPLE_NULL              22U
+#define CBOR_SIMPLE_HALF              25U
+#define CBOR_SIMPLE_SINGLE            26U
+#define CBOR_SIMPLE_DOUBLE            27U
+
+#define CBOR_INITIAL(major, info)     ((uint8_t)(((major) << 5) | (info)))
+#define CBOR_BREAK                    CBOR_INITIAL(CBOR_MAJOR_SIMPLE, CBOR_INFO_INDEFINITE)
+
+#define CBOR_EXACT_DECIMALS           10U   /* 10^10 is still exact in a float */
+
+/* Private variables ---------------------------------------------------------*/
+static const float decimal_scale[CBOR_EXACT_DECIMALS + 1] = {
+  1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void CBOR_Writer_Append(CBOR_Writer_t* writer, const void* data, size_t length);
+static void CBOR_Writer_Head(CBOR_Writer_t* writer, uint8_t major, uint64_t value);
+static float CBOR_HalfToFloat(uint16_t half);
+static bool CBOR_FloatToHalf(float value, uint16_t* half);
+static float CBOR_Decimal(uint64_t mantissa, uint8_t decimals);
+static void CBOR_Reach(CBOR_Writer_t* writer, size_t size, bool in_place, const char* read);
+static bool CBOR_JsonText(CBOR_Writer_t* writer, size_t size, bool in_place,
+                          const char** pos, const char* end);
+static uint8_t CBOR_Hex(char c);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Start reading items from a buffer
+  * @param  reader: Reader to initialize
+  * @param  data: Encoded items
+  * @param  length: Number of bytes
+  * @retval None
+  */
+void CBOR_Reader_Init(CBOR_Reader_t* reader, const uint8_t* data, size_t length) {
+  reader->data = data;
+  reader->length = length;
+  reader->pos = 0;
+}
+
+/**
+  * @brief  Read the next data item
+  * @note   Indefinite length strings, undefined and the other simple values
+  *         are refused.
+  * @param  reader: Reader
+  * @param  item: Item to fill
+  * @retval bool: false at the end of the buffer or on a malformed item
+  */
+bool CBOR_Reader_Next(CBOR_Reader_t* reader, CBOR_Item_t* item) {
+  uint8_t initial;
+  uint8_t major;
+  uint8_t info;
+  uint64_t value = 0;
+
+  if (reader->pos >= reader->length) {
+    return false;
+  }
+
+  initial = reader->data[reader->pos++];
+  major = initial >> 5;
+  info = initial & 0x1FU;
+  item->indefinite = false;
+  item->data = NULL;
+  item->number = 0.0f;
+
+  if (initial == CBOR_BREAK) {
+    item->type = CBOR_ITEM_BREAK;
+    item->value = 0;
+    return true;
+  }
+
+  /* The argument follows in 1, 2, 4 or 8 bytes, big endian */
+  if (info < CBOR_INFO_UINT8) {
+    value = info;
+  } else if (info <= CBOR_INFO_UINT64) {
+    size_t count = (size_t)1U << (info - CBOR_INFO_UINT8);
+
+    if (count > reader->length - reader->pos) {
+      return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+      value = (value << 8) | reader->data[reader->pos++];
+    }
+  } else if (info == CBOR_INFO_INDEFINITE && (major == CBOR_MAJOR_ARRAY || major == CBOR_MAJOR_MAP)) {
+    item->indefinite = true;
+  } else {
+    return false;
+  }
+  item->value = value;
+
+  switch (major) {
+    case CBOR_MAJOR_UINT:
+      item->type = CBOR_ITEM_UINT;
+      break;
+
+    case CBOR_MAJOR_NINT:
+      item->type = CBOR_ITEM_NINT;
+      break;
+
+    case CBOR_MAJOR_BYTES:
+    case CBOR_MAJOR_TEXT:
+      if (value > reader->length - reader->pos) {
+        return false;
+      }
+      item->type = (major == CBOR_MAJOR_TEXT) ? CBOR_ITEM_TEXT : CBOR_ITEM_BYTES;
+      item->data = &reader->data[reader->pos];
+      reader->pos += (size_t)value;
+      break;
+
+    case CBOR_MAJOR_ARRAY:
+      item->type = CBOR_ITEM_ARRAY;
+      break;
+
+    case CBOR_MAJOR_MAP:
+      item->type = CBOR_ITEM_MAP;
+      break;
+
+    case CBOR_MAJOR_TAG:
+      item->type = CBOR_ITEM_TAG;
+      break;
+
+    default:
+      if (info == CBOR_SIMPLE_FALSE) {
+        item->type = CBOR_ITEM_FALSE;
+      } else if (info == CBOR_SIMPLE_TRUE) {
+        item->type = CBOR_ITEM_TRUE;
+      } else if (info == CBOR_SIMPLE_NULL) {
+        item->type = CBOR_ITEM_NULL;
+      } else if (info == CBOR_SIMPLE_HALF) {
+        item->type = CBOR_ITEM_FLOAT;
+        item->number = CBOR_HalfToFloat((uint16_t)value);
+      } else if (info == CBOR_SIMPLE_SINGLE) {
+        uint32_t bits = (uint32_t)value;
+
+        item->type = CBOR_ITEM_FLOAT;
+        memcpy(&item->number, &bits, sizeof(bits));
+      } else if (info == CBOR_SIMPLE_DOUBLE) {
+        double number;
+
+        item->type = CBOR_ITEM_FLOAT;
+        memcpy(&number, &value, sizeof(number));
+        item->number = (float)number;
+      } else {
+        return false;
+      }
+      break;
+  }
+
+  return true;
+}
+
+/**
+  * @brief  Check whether every byte of the buffer was read
+  * @param  reader: Reader
+  * @retval bool: true at the end of the buffer
+  */
+bool CBOR_Reader_AtEnd(const CBOR_Reader_t* reader) {
+  return reader->pos >= reader->length;
+}
+
+/**
+  * @brief  Start writing into a buffer
+  * @param  writer: Writer to initialize
+  * @param  buffer: Destination buffer
+  * @param  size: Size of the destination buffer
+  * @retval None
+  */
+void CBOR_Writer_Init(CBOR_Writer_t* writer, uint8_t* buffer, size_t size) {
+  writer->buffer = buffer;
+  writer->size = size;
+  writer->length = 0;
+  writer->overflow = false;
+}
+
+/**
+  * @brief  Append an unsigned integer, in the shortest form
+  * @param  writer: Writer
+  * @param  value: Value to append
+  * @retval None
+  */
+void CBOR_Writer_Uint(CBOR_Writer_t* writer, uint64_t value) {
+  CBOR_Writer_Head(writer, CBOR_MAJOR_UINT, value);
+}
+
+/**
+  * @brief  Append a signed integer, in the shortest form
+  * @param  writer: Writer
+  * @param  value: Value to append
+  * @retval None
+  */
+void CBOR_Writer_Int(CBOR_Writer_t* writer, int64_t value) {
+  if (value < 0) {
+    /* -1 - value cannot overflow, even for INT64_MIN */
+    CBOR_Writer_Head(writer, CBOR_MAJOR_NINT, (uint64_t)(-1 - value));
+  } else {
+    CBOR_Writer_Head(writer, CBOR_MAJOR_UINT, (uint64_t)value);
+  }
+}
+
+/**
+  * @brief  Append a text string
+  * @param  writer: Writer
+  * @param  text: UTF-8 text, not necessarily terminated
+  * @param  length: Number of bytes
+  * @retval None
+  */
+void CBOR_Writer_Text(CBOR_Writer_t* writer, const char* text, size_t length) {
+  CBOR_Writer_Head(writer, CBOR_MAJOR_TEXT, length);
+  CBOR_Writer_Append(writer, text, length);
+}
+
+/**
+  * @brief  Append a number as a half float if that is exact, else a single
+  * @param  writer: Writer
+  * @param  value: Value to append
+  * @retval None
+  */
+void CBOR_Writer_Float(CBOR_Writer_t* writer, float value) {
+  uint8_t encoded[5];
+  uint16_t half;
+  uint32_t bits;
+
+  if (CBOR_FloatToHalf(value, &half)) {
+    encoded[0] = CBOR_INITIAL(CBOR_MAJOR_SIMPLE, CBOR_SIMPLE_HALF);
+    encoded[1] = (uint8_t)(half >> 8);
+    encoded[2] = (uint8_t)half;
+    CBOR_Writer_Append(writer, encoded, 3);
+    return;
+  }
+
+  memcpy(&bits, &value, sizeof(bits));
+  encoded[0] = CBOR_INITIAL(CBOR_MAJOR_SIMPLE, CBOR_SIMPLE_SINGLE);
+  encoded[1] = (uint8_t)(bits >> 24);
+  encoded[2] = (uint8_t)(bits >> 16);
+  encoded[3] = (uint8_t)(bits >> 8);
+  encoded[4] = (uint8_t)bits;
+  CBOR_Writer_Append(writer, encoded, sizeof(encoded));
+}
+
+/**
+  * @brief  Append true or false
+  * @param  writer: Writer
+  * @param  value: Value to append
+  * @retval None
+  */
+void CBOR_Writer_Bool(CBOR_Writer_t* writer, bool value) {
+  uint8_t initial = CBOR_INITIAL(CBOR_MAJOR_SIMPLE, value ? CBOR_SIMPLE_TRUE : CBOR_SIMPLE_FALSE);
+
+  CBOR_Writer_Append(writer, &initial, 1);
+}
+
+/**
+  * @brief  Append null
+  * @param  writer: Writer
+  * @retval None
+  */
+void CBOR_Writer_Null(CBOR_Writer_t* writer) {
+  uint8_t initial = CBOR_INITIAL(CBOR_MAJOR_SIMPLE, CBOR_SIMPLE_NULL);
+
+  CBOR_Writer_Append(writer, &initial, 1);
+}
+
+/**
+  * @brief  Open a map of indefinite length, closed by CBOR_Writer_End
+  * @param  writer: Writer
+  * @retval None
+  */
+void CBOR_Writer_BeginMap(CBOR_Writer_t* writer) {
+  uint8_t initial = CBOR_INITIAL(CBOR_MAJOR_MAP, CBOR_INFO_INDEFINITE);
+
+  CBOR_Writer_Append(writer, &initial, 1);
+}
+
+/**
+  * @brief  Open an array of indefinite length, closed by CBOR_Writer_End
+  * @param  writer: Writer
+  * @retval None
+  */
+void CBOR_Writer_BeginArray(CBOR_Writer_t* writer) {
+  uint8_t initial = CBOR_INITIAL(CBOR_MAJOR_ARRAY, CBOR_INFO_INDEFINITE);
+
+  CBOR_Writer_Append(writer, &initial, 1);
+}
+
+/**
+  * @brief  Close the innermost open map or array
+  * @param  writer: Writer
+  * @retval None
+  */
+void CBOR_Writer_End(CBOR_Writer_t* writer) {
+  uint8_t initial = CBOR_BREAK;
+
+  CBOR_Writer_Append(writer, &initial, 1);
+}
+
+/**
+  * @brief  Re-encode a JSON text as CBOR
+  * @note   Objects and arrays become indefinite maps and arrays, integers
+  *         CBOR integers and numbers with decimals floats. The destination
+  *         may overlap the text as long as it does not start after it: every
+  *         item is written over bytes already read, or the call fails.
+  * @param  dest: Destination buffer
+  * @param  size: Size of the destination buffer
+  * @param  json: JSON text, one value, as formatted by JSON_Writer_t
+  * @param  length: Text length
+  * @retval size_t: Encoded length, 0 if it does not fit or the text is malformed
+  */
+size_t CBOR_FromJson(uint8_t* dest, size_t size, const char* json, size_t length) {
+  CBOR_Writer_t writer;
+  const char* pos = json;
+  const char* end = json + length;
+  const uint8_t* text = (const uint8_t*)json;
+  bool in_place = (text >= dest && text < dest + size);
+  uint32_t depth = 0;
+
+  /* A destination starting inside the text would overwrite it unread */
+  if (!in_place && dest > text && dest < text + length) {
+    return 0;
+  }
+
+  CBOR_Writer_Init(&writer, dest, size);
+
+  while (pos < end && !writer.overflow) {
+    char c = *pos;
+
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',' || c == ':') {
+      /* Maps alternate keys and values, no separators are needed */
+      pos++;
+    } else if (c == '{' || c == '[') {
+      CBOR_Reach(&writer, size, in_place, ++pos);
+      if (c == '{') {
+        CBOR_Writer_BeginMap(&writer);
+      } else {
+        CBOR_Writer_BeginArray(&writer);
+      }
+      depth++;
+    } else if (c == '}' || c == ']') {
+      if (depth == 0) {
+        return 0;
+      }
+      CBOR_Reach(&writer, size, in_place, ++pos);
+      CBOR_Writer_End(&writer);
+      depth--;
+    } else if (c == '"') {
+      if (!CBOR_JsonText(&writer, size, in_place, &pos, end)) {
+        return 0;
+      }
+    } else if (c == 't' && end - pos >= 4 && memcmp(pos, "true", 4) == 0) {
+      pos += 4;
+      CBOR_Reach(&writer, size, in_place, pos);
+      CBOR_Writer_Bool(&writer, true);
+    } else if (c == 'f' && end - pos >= 5 && memcmp(pos, "false", 5) == 0) {
+      pos += 5;
+      CBOR_Reach(&writer, size, in_place, pos);
+      CBOR_Writer_Bool(&writer, false);
+    } else if (c == 'n' && end - pos >= 4 && memcmp(pos, "null", 4) == 0) {
+      pos += 4;
+      CBOR_Reach(&writer, size, in_place, pos);
+      CBOR_Writer_Null(&writer);
+    } else {
+      bool negative = (c == '-');
+      bool fraction = false;
+      uint64_t mantissa = 0;
+      uint8_t decimals = 0;
+      uint8_t digits = 0;
+
+      if (negative) {
+        pos++;
+      }
+      for (; pos < end; pos++) {
+        if (*pos >= '0' && *pos <= '9') {
+          if (mantissa > (UINT64_MAX - 9U) / 10U) {
+            return 0;
+          }
+          mantissa = mantissa * 10U + (uint64_t)(*pos - '0');
+          digits++;
+          decimals += fraction ? 1U : 0U;
+        } else if (*pos == '.' && !fraction) {
+          fraction = true;
+        } else {
+          break;
+        }
+      }
+      if (digits == 0) {
+        return 0;
+      }
+
+      CBOR_Reach(&writer, size, in_place, pos);
+      if (fraction) {
+        float value = CBOR_Decimal(mantissa, decimals);
+
+        CBOR_Writer_Float(&writer, negative ? -value : value);
+      } else if (negative && mantissa != 0) {
+        CBOR_Writer_Head(&writer, CBOR_MAJOR_NINT, mantissa - 1U);
+      } else {
+        CBOR_Writer_Uint(&writer, mantissa);
+      }
+    }
+  }
+
+  if (writer.overflow || depth != 0) {
+    return 0;
+  }
+
+  return writer.length;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Append raw bytes
+  * @note   The source may overlap the destination from above, see
+  *         CBOR_FromJson
+  * @param  writer: Writer
+  * @param  data: Bytes to append
+  * @param  length: Number of bytes
+  * @retval None
+  */
+static void CBOR_Writer_Append(CBOR_Writer_t* writer, const void* data, size_t length) {
+  if (writer->overflow || length > writer->size - writer->length) {
+    writer->overflow = true;
+    return;
+  }
+
+  memmove(&writer->buffer[writer->length], data, length);
+  writer->length += length;
+}
+
+/**
+  * @brief  Append the initial byte of an item and its argument
+  * @param  writer: Writer
+  * @param  major: Major type
+  * @param  value: Argument, written in as few bytes as it fits
+  * @retval None
+  */
+static void CBOR_Writer_Head(CBOR_Writer_t* writer, uint8_t major, uint64_t value) {
+  uint8_t head[9];
+  uint8_t count;
+
+  if (value < CBOR_INFO_UINT8) {
+    head[0] = CBOR_INITIAL(major, (uint8_t)value);
+    CBOR_Writer_Append(writer, head, 1);
+    return;
+  }
+
+  if (value <= UINT8_MAX) {
+    count = 1;
+  } else if (value <= UINT16_MAX) {
+    count = 2;
+  } else if (value <= UINT32_MAX) {
+    count = 4;
+  } else {
+    count = 8;
+  }
+
+  /* 24 + log2 of the byte count */
+  head[0] = CBOR_INITIAL(major, (uint8_t)(CBOR_INFO_UINT8 + (uint8_t)__builtin_ctz(count)));
+  for (uint8_t i = 0; i < count; i++) {
+    head[count - i] = (uint8_t)(value >> (8U * i));
+  }
+  CBOR_Writer_Append(writer, head, 1U + count);
+}
+
+/**
+  * @brief  Convert a half precision float
+  * @param  half: IEEE 754 binary16 bits
+  * @retval float: Same value
+  */
+static float CBOR_HalfToFloat(uint16_t half) {
+  uint32_t sign = (uint32_t)(half & 0x8000U) << 16;
+  uint32_t exponent = (half >> 10) & 0x1FU;
+  uint32_t mantissa = half & 0x3FFU;
+  uint32_t bits;
+  float value;
+
+  if (exponent == 0) {
+    /* Zero or subnormal, mantissa * 2^-24 */
+    value = (float)mantissa * (1.0f / 16777216.0f);
+    return sign ? -value : value;
+  }
+
+  if (exponent == 0x1FU) {
+    bits = sign | 0x7F800000U | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent + 112U) << 23) | (mantissa << 13);
+  }
+  memcpy(&value, &bits, sizeof(value));
+
+  return value;
+}
+
+/**
+  * @brief  Convert a float to half precision if that loses nothing
+  * @param  value: Value
+  * @param  half: Pointer to store the binary16 bits
+  * @retval bool: true if the half holds the exact value
+  */
+static bool CBOR_FloatToHalf(float value, uint16_t* half) {
+  uint32_t bits;
+  uint16_t sign;
+  int32_t exponent;
+  uint32_t mantissa;
+
+  memcpy(&bits, &value, sizeof(bits));
+  sign = (uint16_t)((bits >> 16) & 0x8000U);
+  exponent = (int32_t)((bits >> 23) & 0xFFU) - 127;
+  mantissa = bits & 0x7FFFFFU;
+
+  if ((bits & 0x7FFFFFFFU) == 0) {
+    *half = sign;
+    return true;
+  }
+
+  /* Normal halves only, with the 13 low mantissa bits clear */
+  if (exponent < -14 || exponent > 15 || (mantissa & 0x1FFFU) != 0) {
+    return false;
+  }
+
+  *half = (uint16_t)(sign | ((uint32_t)(exponent + 15) << 10) | (mantissa >> 13));
+  return true;
+}
+
+/**
+  * @brief  Convert a decimal number to a float
+  * @note   Correctly rounded while the mantissa fits 24 bits and there are
+  *         at most CBOR_EXACT_DECIMALS decimals, as both are exact floats
+  * @param  mantissa: Digits without the point
+  * @param  decimals: Digits after the point
+  * @retval float: mantissa / 10^decimals
+  */
+static float CBOR_Decimal(uint64_t mantissa, uint8_t decimals) {
+  float value = (float)mantissa;
+
+  while (decimals > CBOR_EXACT_DECIMALS) {
+    value /= decimal_scale[CBOR_EXACT_DECIMALS];
+    decimals -= CBOR_EXACT_DECIMALS;
+  }
+
+  return value / decimal_scale[decimals];
+}
+
+/**
+  * @brief  Let an in-place conversion write up to the read position
+  * @param  writer: Writer
+  * @param  size: Size of the destination buffer
+  * @param  in_place: true if the text lies in the destination buffer
+  * @param  read: First byte of the text not read yet
+  * @retval None
+  */
+static void CBOR_Reach(CBOR_Writer_t* writer, size_t size, bool in_place, const char* read) {
+  size_t reach;
+
+  if (!in_place) {
+    return;
+  }
+
+  reach = (size_t)((const uint8_t*)read - writer->buffer);
+  writer->size = (reach < size) ? reach : size;
+}
+
+/**
+  * @brief  Convert a quoted JSON string to a text string
+  * @note   The head is written before the first character of the string
+  *         and each character over bytes of the escaped string already
+  *         read, so the string may be converted in place.
+  * @param  writer: Writer
+  * @param  size: Size of the destination buffer
+  * @param  in_place: true if the text lies in the destination buffer
+  * @param  pos: Position of the opening quote, advanced past the closing one
+  * @param  end: End of the text
+  * @retval bool: false if the string is malformed
+  */
+static bool CBOR_JsonText(CBOR_Writer_t* writer, size_t size, bool in_place,
+                          const char** pos, const char* end) {
+  const char* start = *pos + 1;
+  const char* p = start;
+  size_t length = 0;
+
+  /* Unescaped length first, it goes in the head */
+  while (p < end && *p != '"') {
+    if (*p != '\\') {
+      length++;
+      p++;
+    } else if (end - p >= 6 && p[1] == 'u') {
+      uint16_t code = (uint16_t)((CBOR_Hex(p[2]) << 12) | (CBOR_Hex(p[3]) << 8) |
+                                 (CBOR_Hex(p[4]) << 4) | CBOR_Hex(p[5]));
+
+      length += (code < 0x80U) ? 1U : (code < 0x800U) ? 2U : 3U;
+      p += 6;
+    } else if (end - p >= 2) {
+      length++;
+      p += 2;
+    } else {
+      return false;
+    }
+  }
+  if (p >= end) {
+    return false;
+  }
+
+  CBOR_Reach(writer, size, in_place, start);
+  CBOR_Writer_Head(writer, CBOR_MAJOR_TEXT, length);
+  CBOR_Reach(writer, size, in_place, p);
+
+  for (const char* s = start; s < p && !writer->overflow;) {
+    const char* run = s;
+    uint8_t utf8[3];
+    uint8_t count = 1;
+
+    /* Copy the plain run before the next escape in one go */
+    while (s < p && *s != '\\') {
+      s++;
+    }
+    CBOR_Writer_Append(writer, run, (size_t)(s - run));
+    if (s >= p) {
+      break;
+    }
+
+    switch (s[1]) {
+      case 'u': {
+        uint16_t code = (uint16_t)((CBOR_Hex(s[2]) << 12) | (CBOR_Hex(s[3]) << 8) |
+                                   (CBOR_Hex(s[4]) << 4) | CBOR_Hex(s[5]));
+
+        if (code < 0x80U) {
+          utf8[0] = (uint8_t)code;
+        } else if (code < 0x800U) {
+          utf8[0] = (uint8_t)(0xC0U | (code >> 6));
+          utf8[1] = (uint8_t)(0x80U | (code & 0x3FU));
+          count = 2;
+        } else {
+          utf8[0] = (uint8_t)(0xE0U | (code >> 12));
+          utf8[1] = (uint8_t)(0x80U | ((code >> 6) & 0x3FU));
+          utf8[2] = (uint8_t)(0x80U | (code & 0x3FU));
+          count = 3;
+        }
+        s += 6;
+        break;
+      }
+      case 'b': utf8[0] = '\b'; s += 2; break;
+      case 'f': utf8[0] = '\f'; s += 2; break;
+      case 'n': utf8[0] = '\n'; s += 2; break;
+      case 'r': utf8[0] = '\r'; s += 2; break;
+      case 't': utf8[0] = '\t'; s += 2; break;
+      default:  utf8[0] = (uint8_t)s[1]; s += 2; break;
+    }
+    CBOR_Writer_Append(writer, utf8, count);
+  }
+
+  *pos = p + 1;
+  return !writer->overflow;
+}
+
+/**
+  * @brief  Value of a hex digit
+  * @param  c: Character
+  * @retval uint8_t: 0-15, 0 for any other character
+  */
+static uint8_t CBOR_Hex(char c) {
+  if (c >= '0' && c <= '9') {
+    return (uint8_t)(c - '0');
+  }
+  if (c >= 'a' && c <= 'f') {
+    return (uint8_t)(c - 'a' + 10);
+  }
+  if (c >= 'A' && c <= 'F') {
+    return (uint8_t)(c - 'A' + 10);
+  }
+
+  return 0;
+}
@@ -0,0 +1,163 @@
+/**
+  ******************************************************************************
+  * @file    app_clock.c
+  * @brief   Application layer wall-clock time and host time sync
+  ******************************************************************************
+  * @attention
+  *
+  * Wall-clock time comes from the RTC (val_rtc.c), which keeps counting
+  * through resets, so events and messages can be lined up with host logs
+  * and with other devices. The host keeps it right with system/time_sync:
+  * it sends its own time and the round trip it measured on the previous
+  * sync, and the device takes the host time at arrival as that time plus
+  * half the round trip.
+  *
+  * An offset of CLOCK_STEP_MS or more, or a clock never set, sets the RTC
+  * to the host time. Smaller offsets shift it without stopping the
+  * calendar, and are summed: once CLOCK_DRIFT_MIN_MS of host time have
+  * passed since the reference sync, the sum over that interval is the rate
+  * error of the LSE, and the RTC calibration is trimmed by it. The shifts
+  * then shrink towards the jitter of the link. Samples with a round trip
+  * over CLOCK_RTT_MAX_MS are answered but not used, their transit time is
+  * too uncertain.
+  *
+  * The rate trim stays in the RTC through resets; the reference is kept in
+  * RAM only, so the first sync after a start-up begins a new interval.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_clock.h"
+#include "val.h"
+#include <stddef.h>
+
+/* Private variables ---------------------------------------------------------*/
+/* Rate estimate: host time of the reference sync and the shifts since; comms task only */
+static bool reference_valid = false;
+static uint64_t reference_ms = 0;
+static int64_t shifted_ms = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static VAL_Status Clock_Trim(uint64_t now_ms, Clock_SyncResult_t* result);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Get the wall-clock time
+ * @note   Safe to call from interrupts
+ * @retval uint64_t: Milliseconds since 1970-01-01 UTC, 0 if the clock was never set
+ */
+uint64_t Clock_GetTime(void) {
+  return VAL_RTC_GetTime();
+}
+
+/**
+ * @brief  Get the wall-clock time of an earlier moment
+ * @note   Safe to call from interrupts
+ * @param  age_ms: Time since the moment in milliseconds
+ * @retval uint64_t: Milliseconds since 1970-01-01 UTC, 0 if the clock was never set
+ */
+uint64_t Clock_GetTimeBefore(uint32_t age_ms) {
+  uint64_t now = VAL_RTC_GetTime();
+
+  return (now > age_ms) ? now - age_ms : 0;
+}
+
+/**
+ * @brief  Correct the clock from a host time sample
+ * @note   Communications task only
+ * @param  host_ms: Host time when the request was sent, milliseconds since 1970-01-01 UTC
+ * @param  rtt_ms: Round trip of the previous sync in milliseconds, 0 if unknown
+ * @param  result: Pointer to store what was done
+ * @retval VAL_Status: VAL_OK if the sample was taken or skipped, VAL_BUSY while
+ *         the previous correction is pending, VAL_PARAM if the time is out of
+ *         range, VAL_ERROR if the RTC could not be set
+ */
+VAL_Status Clock_Sync(uint64_t host_ms, uint32_t rtt_ms, Clock_SyncResult_t* result) {
+  VAL_Status status;
+
+  if (result == NULL) {
+    return VAL_PARAM;
+  }
+
+  uint64_t estimate = host_ms + rtt_ms / 2U;
+  uint64_t now = VAL_RTC_GetTime();
+  int64_t offset = (int64_t)(estimate - now);
+
+  result->offset_ms = (offset > INT32_MAX) ? INT32_MAX : (offset < INT32_MIN) ? INT32_MIN : (int32_t)offset;
+  result->used = false;
+  result->stepped = false;
+  result->trimmed = false;
+  result->calibration_ppb = VAL_RTC_GetCalibration();
+
+  if (estimate < VAL_RTC_TIME_MIN_MS || estimate > VAL_RTC_TIME_MAX_MS) {
+    return VAL_PARAM;
+  }
+  if (rtt_ms > CLOCK_RTT_MAX_MS) {
+    return VAL_OK;
+  }
+
+  if (now == 0 || offset <= -CLOCK_STEP_MS || offset >= CLOCK_STEP_MS) {
+    status = VAL_RTC_SetTime(estimate);
+    if (status != VAL_OK) {
+      return status;
+    }
+    /* A step says nothing about the rate */
+    reference_valid = false;
+    result->stepped = true;
+  } else {
+    status = VAL_RTC_Adjust((int32_t)offset);
+    if (status != VAL_OK) {
+      return status;
+    }
+    shifted_ms += offset;
+  }
+  result->used = true;
+
+  /* The first sample only starts the interval */
+  if (!reference_valid || estimate < reference_ms) {
+    reference_valid = true;
+    reference_ms = estimate;
+    shifted_ms = 0;
+    return VAL_OK;
+  }
+
+  return Clock_Trim(estimate, result);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Trim the RTC rate by the shifts of a long enough interval
+ * @param  now_ms: Host time of the present sample
+ * @param  result: Sync result to update
+ * @retval VAL_Status: VAL_OK, also if the interval is still too short or the
+ *         RTC is busy, in which case the next sample tries again
+ */
+static VAL_Status Clock_Trim(uint64_t now_ms, Clock_SyncResult_t* result) {
+  uint64_t elapsed = now_ms - reference_ms;
+
+  if (elapsed < CLOCK_DRIFT_MIN_MS) {
+    return VAL_OK;
+  }
+
+  /* Time gained per time passed: a clock falling behind needs to run faster */
+  int64_t ppb = (int64_t)result->calibration_ppb + shifted_ms * 1000000000LL / (int64_t)elapsed;
+  if (ppb > VAL_RTC_CALIBRATION_MAX_PPB) {
+    ppb = VAL_RTC_CALIBRATION_MAX_PPB;
+  } else if (ppb < -VAL_RTC_CALIBRATION_MAX_PPB) {
+    ppb = -VAL_RTC_CALIBRATION_MAX_PPB;
+  }
+
+  if (VAL_RTC_SetCalibration((int32_t)ppb) != VAL_OK) {
+    return VAL_OK;
+  }
+
+  reference_ms = now_ms;
+  shifted_ms = 0;
+  result->trimmed = true;
+  result->calibration_ppb = VAL_RTC_GetCalibration();
+
+  return VAL_OK;
+}
@@ -0,0 +1,367 @@
+/**
+  ******************************************************************************
+  * @file    app_color.c
+  * @brief   Application layer colour mixing from a target colour to intensities
+  ******************************************************************************
+  * @attention
+  *
+  * Each light is a primary: its CIE 1931 chromaticity and its flux at full
+  * duty cycle, measured per unit and stored with the settings. The three
+  * primaries give the matrix M from duty cycles to tristimulus values, and
+  * its inverse takes a target colour back to duty cycles. The inverse is
+  * worked out in floating point once, when the primaries change, and kept
+  * as integers scaled to about 2^20, so a mix is nine multiplies and a
+  * division per light, from any context.
+  *
+  * Only the proportions of the duty cycles matter for the colour, so the
+  * target is given by its chromaticity alone and the largest duty cycle is
+  * scaled to the brightness asked for. A colour calling for a negative duty
+  * cycle lies outside the triangle of the primaries and is refused; small
+  * negatives, within rounding of the matrix, are taken as zero.
+  *
+  * Colour temperatures are looked up on the Planckian locus in CIE 1960
+  * (u, v), in steps of 10 mired, with the unit normal at each step for the
+  * tint. With white, green and red primaries the gamut reaches from the
+  * white LED down to candlelight; bluer whites are out of it.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_color.h"
+#include "val.h"
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+_Static_assert(VAL_LIGHT_COUNT == 3, "Colour mixing solves for exactly three primaries");
+
+#define COLOR_MATRIX_FULL_SCALE  (1L << 20)  /* Largest entry of the fixed-point inverse */
+#define COLOR_DET_MIN            1e-4f       /* Smallest determinant over the column norms */
+#define COLOR_GAMUT_TOLERANCE    1000        /* Negative duty cycles down to 1/1000 of the largest are rounding */
+
+#define COLOR_LOCUS_MIRED_MIN    40U
+#define COLOR_LOCUS_MIRED_STEP   10U
+#define COLOR_LOCUS_ENTRIES      57U
+#define COLOR_NORMAL_ONE         16384       /* Unit length of the locus normal */
+
+/* Private types -------------------------------------------------------------*/
+typedef struct {
+  int32_t u;          /* CIE 1960 u, 1/100000 */
+  int32_t v;          /* CIE 1960 v, 1/100000 */
+  int16_t nu;         /* Unit normal towards green, Q14 */
+  int16_t nv;
+} Color_LocusPoint_t;
+
+/* Private variables ---------------------------------------------------------*/
+/* Planckian locus from 40 to 600 mired (25000 K to 1667 K), from the cubic
+ * spline fit of Kim et al. (2002) converted to (u, v); the normal is that
+ * of the fit at each point. Regenerated with the same formulas if the
+ * range or step changes. */
+static const Color_LocusPoint_t locus[COLOR_LOCUS_ENTRIES] = {
+  {18288, 27409, -15620,  4944}, /* 25000 K */
+  {18386, 27708, -15532,  5215},
+  {18494, 28019, -15423,  5530},
+  {18613, 28340, -15295,  5872},
+  {18743, 28667, -15148,  6243},
+  {18884, 28997, -14979,  6639}, /* 11111 K */
+  {19036, 29328, -14786,  7058},
+  {19199, 29657, -14567,  7499},
+  {19373, 29982, -14322,  7957},
+  {19558, 30302, -14050,  8428},
+  {19753, 30616, -13750,  8909}, /* 7143 K */
+  {19959, 30922, -13423,  9395},
+  {20176, 31219, -13070,  9880},
+  {20402, 31507, -12693, 10359},
+  {20637, 31785, -12296, 10828},
+  {20882, 32052, -11881, 11282}, /* 5263 K */
+  {21136, 32310, -11452, 11717},
+  {21398, 32556, -11015, 12129},
+  {21667, 32792, -10572, 12516},
+  {21943, 33018, -10130, 12877},
+  {22226, 33233,  -9692, 13210}, /* 4167 K */
+  {22515, 33437,  -9373, 13438},
+  {22808, 33635,  -8949, 13724},
+  {23101, 33820,  -8505, 14004},
+  {23397, 33994,  -8065, 14262},
+  {23697, 34157,  -7630, 14499}, /* 3448 K */
+  {23999, 34311,  -7204, 14715},
+  {24305, 34455,  -6788, 14912},
+  {24614, 34590,  -6383, 15090},
+  {24925, 34717,  -5990, 15250},
+  {25240, 34837,  -5611, 15393}, /* 2941 K */
+  {25557, 34948,  -5246, 15521},
+  {25877, 35052,  -4896, 15635},
+  {26200, 35149,  -4561, 15736},
+  {26525, 35240,  -4240, 15826},
+  {26852, 35324,  -3934, 15905}, /* 2564 K */
+  {27181, 35402,  -3643, 15974},
+  {27512, 35475,  -3367, 16034},
+  {27844, 35542,  -3104, 16087},
+  {28178, 35603,  -2855, 16133},
+  {28513, 35660,  -2620, 16173}, /* 2273 K */
+  {28848, 35712,  -2378, 16211},
+  {29183, 35760,  -2211, 16234},
+  {29518, 35803,  -1997, 16262},
+  {29853, 35842,  -1795, 16285},
+  {30188, 35877,  -1606, 16305}, /* 2041 K */
+  {30521, 35908,  -1428, 16322},
+  {30854, 35935,  -1260, 16335},
+  {31184, 35959,  -1103, 16347},
+  {31512, 35980,   -955, 16356},
+  {31837, 35998,   -817, 16364}, /* 1852 K */
+  {32158, 36012,   -687, 16370},
+  {32475, 36024,   -566, 16374},
+  {32787, 36034,   -453, 16378},
+  {33093, 36042,   -346, 16380},
+  {33393, 36047,   -247, 16382}, /* 1695 K */
+  {33686, 36051,   -160, 16383}
+};
+
+/* Primaries in use and the fixed-point inverse of their matrix; swapped
+ * together under PRIMASK, read by copying */
+static Color_Primary_t primaries[VAL_LIGHT_COUNT];
+static int32_t mix_matrix[VAL_LIGHT_COUNT][3];
+
+/* Private function prototypes -----------------------------------------------*/
+static VAL_Status Color_Mix(const int32_t* target, uint16_t permille, uint16_t* intensities);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Load the board defaults from the channel table
+ * @retval VAL_Status: VAL_OK; VAL_ERROR if the defaults span no gamut
+ */
+VAL_Status Color_Init(void) {
+  Color_Primary_t defaults[VAL_LIGHT_COUNT];
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    defaults[i].x = VAL_Channels[i].chroma_x;
+    defaults[i].y = VAL_Channels[i].chroma_y;
+    defaults[i].flux_lm = VAL_Channels[i].flux_lm;
+  }
+
+  return (Color_SetPrimaries(defaults) == VAL_OK) ? VAL_OK : VAL_ERROR;
+}
+
+/**
+ * @brief  Replace the primaries and the mixing matrix built from them
+ * @note   Any task
+ * @param  primaries_in: Primary per light, VAL_LIGHT_COUNT entries
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if a primary is out of
+ *         range or the primaries span no gamut; the previous ones stay then
+ */
+VAL_Status Color_SetPrimaries(const Color_Primary_t* primaries_in) {
+  float m[3][3];
+  float inverse[3][3];
+  float flux_max = 0.0f;
+  float largest = 0.0f;
+  int32_t matrix[VAL_LIGHT_COUNT][3];
+
+  if (primaries_in == NULL) {
+    return VAL_PARAM;
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    const Color_Primary_t* p = &primaries_in[i];
+    if (p->x == 0 || p->y == 0 || (uint32_t)p->x + p->y > COLOR_XY_UNIT || p->flux_lm == 0) {
+      return VAL_PARAM;
+    }
+    if (p->flux_lm > flux_max) {
+      flux_max = p->flux_lm;
+    }
+  }
+
+  /* Column i: tristimulus values of light i at full duty, Y relative to the brightest */
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    const Color_Primary_t* p = &primaries_in[i];
+    float scale = ((float)p->flux_lm / flux_max) / (float)p->y;
+    m[0][i] = (float)p->x * scale;
+    m[1][i] = (float)p->y * scale;
+    m[2][i] = (float)(COLOR_XY_UNIT - p->x - p->y) * scale;
+  }
+
+  /* Inverse by cofactors; the determinant against the column norms tells
+   * collinear primaries apart from merely dim ones */
+  inverse[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+  inverse[0][1] = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+  inverse[0][2] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+  inverse[1][0] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+  inverse[1][1] = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+  inverse[1][2] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+  inverse[2][0] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+  inverse[2][1] = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+  inverse[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+
+  float det = m[0][0] * inverse[0][0] + m[0][1] * inverse[1][0] + m[0][2] * inverse[2][0];
+  float norms = 1.0f;
+  for (uint8_t i = 0; i < 3; i++) {
+    norms *= sqrtf(m[0][i] * m[0][i] + m[1][i] * m[1][i] + m[2][i] * m[2][i]);
+  }
+  if (fabsf(det) < COLOR_DET_MIN * norms) {
+    return VAL_PARAM;
+  }
+
+  /* The scale of the inverse drops out of the mix, so det is left out too,
+   * keeping only its sign */
+  for (uint8_t i = 0; i < 3; i++) {
+    for (uint8_t j = 0; j < 3; j++) {
+      if (det < 0.0f) {
+        inverse[i][j] = -inverse[i][j];
+      }
+      if (fabsf(inverse[i][j]) > largest) {
+        largest = fabsf(inverse[i][j]);
+      }
+    }
+  }
+  for (uint8_t i = 0; i < 3; i++) {
+    for (uint8_t j = 0; j < 3; j++) {
+      matrix[i][j] = (int32_t)lroundf(inverse[i][j] * ((float)COLOR_MATRIX_FULL_SCALE / largest));
+    }
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  memcpy(primaries, primaries_in, sizeof(primaries));
+  memcpy(mix_matrix, matrix, sizeof(mix_matrix));
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the primaries in use
+ * @param  primaries_out: Array to store the primaries (must hold VAL_LIGHT_COUNT entries)
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if primaries_out is NULL
+ */
+VAL_Status Color_GetPrimaries(Color_Primary_t* primaries_out) {
+  if (primaries_out == NULL) {
+    return VAL_PARAM;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  memcpy(primaries_out, primaries, sizeof(primaries));
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Compute the intensities mixing a chromaticity
+ * @note   Any context
+ * @param  x: CIE 1931 x in 1/10000
+ * @param  y: CIE 1931 y in 1/10000
+ * @param  permille: Brightness as a fraction of the brightest mix (0-1000)
+ * @param  intensities: Array to store the intensity per light (0-1000)
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if the colour is out of
+ *         the gamut of the primaries
+ */
+VAL_Status Color_MixXy(uint16_t x, uint16_t y, uint16_t permille, uint16_t* intensities) {
+  int32_t target[3];
+
+  if (y == 0 || (uint32_t)x + y > COLOR_XY_UNIT) {
+    return VAL_PARAM;
+  }
+
+  target[0] = x;
+  target[1] = y;
+  target[2] = (int32_t)COLOR_XY_UNIT - x - y;
+
+  return Color_Mix(target, permille, intensities);
+}
+
+/**
+ * @brief  Compute the intensities mixing a white of a colour temperature
+ * @note   Any context
+ * @param  cct_k: Correlated colour temperature (COLOR_CCT_MIN_K-COLOR_CCT_MAX_K)
+ * @param  tint: Distance from the Planckian locus, Duv in 1/10000, positive
+ *         towards green (-COLOR_TINT_MAX to COLOR_TINT_MAX)
+ * @param  permille: Brightness as a fraction of the brightest mix (0-1000)
+ * @param  intensities: Array to store the intensity per light (0-1000)
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if out of range or out
+ *         of the gamut of the primaries
+ */
+VAL_Status Color_MixCct(uint16_t cct_k, int16_t tint, uint16_t permille, uint16_t* intensities) {
+  int32_t target[3];
+
+  if (cct_k < COLOR_CCT_MIN_K || cct_k > COLOR_CCT_MAX_K ||
+      tint < -COLOR_TINT_MAX || tint > COLOR_TINT_MAX) {
+    return VAL_PARAM;
+  }
+
+  /* Rounded to the nearest mired, 40-600 over the range */
+  uint32_t mired = (1000000UL + cct_k / 2U) / cct_k;
+  uint32_t index = (mired - COLOR_LOCUS_MIRED_MIN) / COLOR_LOCUS_MIRED_STEP;
+  int32_t frac = (int32_t)((mired - COLOR_LOCUS_MIRED_MIN) % COLOR_LOCUS_MIRED_STEP);
+  const Color_LocusPoint_t* a = &locus[index];
+  const Color_LocusPoint_t* b = (frac != 0) ? &locus[index + 1] : a;
+
+  int32_t u = a->u + ((b->u - a->u) * frac) / (int32_t)COLOR_LOCUS_MIRED_STEP;
+  int32_t v = a->v + ((b->v - a->v) * frac) / (int32_t)COLOR_LOCUS_MIRED_STEP;
+  int32_t nu = a->nu + ((b->nu - a->nu) * frac) / (int32_t)COLOR_LOCUS_MIRED_STEP;
+  int32_t nv = a->nv + ((b->nv - a->nv) * frac) / (int32_t)COLOR_LOCUS_MIRED_STEP;
+
+  /* Duv in 1/10000 against (u, v) in 1/100000 */
+  u += (tint * nu * 10) / COLOR_NORMAL_ONE;
+  v += (tint * nv * 10) / COLOR_NORMAL_ONE;
+
+  /* (x, y, z) scaled by 2u - 8v + 4, which drops out of the mix */
+  target[0] = 3 * u;
+  target[1] = 2 * v;
+  target[2] = 400000 - u - 10 * v;
+
+  return Color_Mix(target, permille, intensities);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Solve for the duty cycles of a target colour and scale them
+ * @param  target: Tristimulus values of the colour, any positive scale
+ * @param  permille: Largest duty cycle (0-1000)
+ * @param  intensities: Array to store the intensity per light (0-1000)
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if out of range or out
+ *         of gamut
+ */
+static VAL_Status Color_Mix(const int32_t* target, uint16_t permille, uint16_t* intensities) {
+  int32_t matrix[VAL_LIGHT_COUNT][3];
+  int64_t duty[VAL_LIGHT_COUNT];
+  int64_t duty_max = 0;
+
+  if (intensities == NULL || permille > VAL_PWM_PERMILLE_MAX) {
+    return VAL_PARAM;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  memcpy(matrix, mix_matrix, sizeof(matrix));
+  __set_PRIMASK(primask);
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    duty[i] = 0;
+    for (uint8_t j = 0; j < 3; j++) {
+      duty[i] += (int64_t)matrix[i][j] * target[j];
+    }
+    if (duty[i] > duty_max) {
+      duty_max = duty[i];
+    }
+  }
+
+  if (duty_max <= 0) {
+    return VAL_PARAM;
+  }
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (duty[i] < -(duty_max / COLOR_GAMUT_TOLERANCE)) {
+      return VAL_PARAM;
+    }
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    uint16_t duty_permille = (duty[i] > 0) ? (uint16_t)((duty[i] * permille + duty_max / 2) / duty_max) : 0;
+    intensities[i] = VAL_PWM_DutyToPermille(i + 1, duty_permille);
+  }
+
+  return VAL_OK;
+}
@@ -0,0 +1,207 @@
+/**
+  ******************************************************************************
+  * @file    app_comms_binary.c
+  * @brief   Application layer binary frame encoding
+  ******************************************************************************
+  * @attention
+  *
+  * This module implements the framing of the compact binary protocol: COBS
+  * byte stuffing, 0x00 frame delimiters and a CRC16 trailer. Message routing
+  * stays in the communications handler, which uses the same command table
+  * for binary frames and JSON commands.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_comms_binary.h"
+#include "val_crc.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define CRC16_POLY                    0x1021U
+
+_Static_assert(CRC16_POLY == VAL_CRC16_POLY && COMMS_BIN_CRC16_INIT == VAL_CRC16_INIT, "Frame CRC must match VAL_CRC_16_CCITT");
+
+/* Private function prototypes -----------------------------------------------*/
+static size_t COMMS_Binary_Stuff(const uint8_t* payload, size_t length, uint8_t* frame);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Compute the CRC16-CCITT of a buffer
+  * @note   On the CRC unit (val_crc.c), in software while it is taken
+  * @param  data: Data to checksum
+  * @param  length: Number of bytes
+  * @retval uint16_t: CRC value
+  */
+uint16_t COMMS_Binary_CRC16(const uint8_t* data, size_t length) {
+  return (uint16_t)VAL_Crc_Compute(VAL_CRC_16_CCITT, data, length);
+}
+
+/**
+  * @brief  Add one byte to a running CRC16-CCITT
+  * @note   Software: a byte at a time is not worth programming the unit for
+  * @param  crc: CRC so far, COMMS_BIN_CRC16_INIT before the first byte
+  * @param  byte: Next byte
+  * @retval uint16_t: CRC including the byte
+  */
+uint16_t COMMS_Binary_CRC16Update(uint16_t crc, uint8_t byte) {
+  crc ^= (uint16_t)byte << 8;
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    crc = (crc & 0x8000U) ? (uint16_t)((crc << 1) ^ CRC16_POLY) : (uint16_t)(crc << 1);
+  }
+
+  return crc;
+}
+
+/**
+  * @brief  Build a delimited COBS frame from a header and body
+  * @param  type: Message type (COMMS_BIN_TYPE_*)
+  * @param  seq: Sequence number
+  * @param  code: Topic/action code
+  * @param  body: Body bytes, may be NULL if body_length is 0
+  * @param  body_length: Number of body bytes
+  * @param  frame: Buffer to store the encoded frame
+  * @param  frame_size: Size of the frame buffer
+  * @retval size_t: Encoded frame length, 0 if it does not fit
+  */
+size_t COMMS_Binary_EncodeFrame(uint8_t type, uint8_t seq, uint8_t code,
+                                const void* body, size_t body_length,
+                                uint8_t* frame, size_t frame_size) {
+  uint8_t payload[COMMS_BIN_MAX_PAYLOAD];
+  size_t length = COMMS_BIN_HEADER_SIZE + body_length + COMMS_BIN_CRC_SIZE;
+
+  if (length > sizeof(payload) || COMMS_BIN_FRAME_SIZE(length) > frame_size) {
+    return 0;
+  }
+
+  /* Assemble header, body and CRC */
+  payload[0] = type;
+  payload[1] = seq;
+  payload[2] = code;
+  if (body_length > 0) {
+    memcpy(&payload[COMMS_BIN_HEADER_SIZE], body, body_length);
+  }
+
+  uint16_t crc = COMMS_Binary_CRC16(payload, length - COMMS_BIN_CRC_SIZE);
+  payload[length - 2] = (uint8_t)(crc & 0xFFU);
+  payload[length - 1] = (uint8_t)(crc >> 8);
+
+  return COMMS_Binary_Stuff(payload, length, frame);
+}
+
+/**
+  * @brief  Seal a payload built in the frame buffer and encode it in place
+  * @note   The payload is stuffed towards the start of the buffer, which is
+  *         possible as COBS adds at most one byte per 254 ahead of the read
+  *         position; offset must leave COMMS_BIN_FRAME_LEAD of the payload
+  *         with its CRC.
+  * @param  frame: Buffer holding the payload at offset
+  * @param  frame_size: Size of the frame buffer
+  * @param  offset: Position of the payload, header first
+  * @param  length: Number of payload bytes, header and body
+  * @retval size_t: Encoded frame length from the start of the buffer, 0 if
+  *         it does not fit
+  */
+size_t COMMS_Binary_EncodeInPlace(uint8_t* frame, size_t frame_size, size_t offset, size_t length) {
+  size_t sealed = length + COMMS_BIN_CRC_SIZE;
+
+  if (length < COMMS_BIN_HEADER_SIZE || offset < COMMS_BIN_FRAME_LEAD(sealed) ||
+      offset + sealed > frame_size || COMMS_BIN_FRAME_SIZE(sealed) > frame_size) {
+    return 0;
+  }
+
+  uint16_t crc = COMMS_Binary_CRC16(&frame[offset], length);
+  frame[offset + length] = (uint8_t)(crc & 0xFFU);
+  frame[offset + length + 1] = (uint8_t)(crc >> 8);
+
+  return COMMS_Binary_Stuff(&frame[offset], sealed, frame);
+}
+
+/**
+  * @brief  Decode a COBS frame (without delimiters) and check its CRC
+  * @note   Decoding never writes ahead of the read position, so it is done
+  *         in place.
+  * @param  frame: Encoded bytes between the delimiters; decoded in place
+  * @param  length: Number of encoded bytes
+  * @param  payload_length: Pointer to store the payload length, CRC excluded
+  * @retval VAL_Status: VAL_OK if the frame is valid, VAL_ERROR if the CRC
+  *         does not match, VAL_PARAM if the frame is malformed
+  */
+VAL_Status COMMS_Binary_DecodeFrame(uint8_t* frame, size_t length, size_t* payload_length) {
+  size_t in = 0;
+  size_t out = 0;
+
+  while (in < length) {
+    uint8_t code = frame[in++];
+
+    if (code == 0 || in + code - 1 > length) {
+      return VAL_PARAM;
+    }
+
+    for (uint8_t i = 1; i < code; i++) {
+      frame[out++] = frame[in++];
+    }
+
+    /* A code below 0xFF stands for a zero, except at the end of the frame */
+    if (code != 0xFF && in < length) {
+      frame[out++] = 0;
+    }
+  }
+
+  if (out < COMMS_BIN_HEADER_SIZE + COMMS_BIN_CRC_SIZE) {
+    return VAL_PARAM;
+  }
+
+  out -= COMMS_BIN_CRC_SIZE;
+  uint16_t crc = (uint16_t)frame[out] | ((uint16_t)frame[out + 1] << 8);
+  if (COMMS_Binary_CRC16(frame, out) != crc) {
+    return VAL_ERROR;
+  }
+
+  *payload_length = out;
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  COBS encode a payload between two delimiters
+  * @note   The frame may start before the payload in the same buffer, see
+  *         COMMS_Binary_EncodeInPlace: every byte is written at or before
+  *         the position it was read from.
+  * @param  payload: Header, body and CRC
+  * @param  length: Number of payload bytes
+  * @param  frame: Buffer to store the frame, COMMS_BIN_FRAME_SIZE(length) bytes
+  * @retval size_t: Encoded frame length
+  */
+static size_t COMMS_Binary_Stuff(const uint8_t* payload, size_t length, uint8_t* frame) {
+  size_t out = 0;
+  frame[out++] = COMMS_BIN_DELIMITER;
+
+  size_t code_pos = out++;
+  uint8_t run = 1;
+
+  for (size_t i = 0; i < length; i++) {
+    uint8_t byte = payload[i];
+
+    if (byte == 0) {
+      frame[code_pos] = run;
+      code_pos = out++;
+      run = 1;
+    } else {
+      frame[out++] = byte;
+      if (++run == 0xFF) {
+        frame[code_pos] = run;
+        code_pos = out++;
+        run = 1;
+      }
+    }
+  }
+
+  frame[code_pos] = run;
+  frame[out++] = COMMS_BIN_DELIMITER;
+
+  return out;
+}
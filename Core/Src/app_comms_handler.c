@@ -5,7 +5,123 @@
   ******************************************************************************
   * @attention
   *
-  * This module implements a minimal communications handler with ping functionality.
+  * This module implements the host command protocol: JSON, binary and CBOR
+  * commands over the serial link, their responses and the events.
+  * Serial data arrives in blocks from the circular RX DMA and is handed to the
+  * communications task through a stream buffer, so JSON decoding and response
+  * transmission never run in interrupt context. Commands are decoded byte by
+  * byte with the lwjson stream parser into a fixed command structure, so their
+  * length and token count are not limited by any line buffer.
+  *
+  * The decoder is a state machine per session (COMMS_Session_t): its state,
+  * parser and frame buffer live in the session, and each byte moves it on
+  * from where the last one left it, so nothing is held on the task stack
+  * between bytes and one task can read several links by keeping a session
+  * for each. The batch and the reply state belong to the command being run
+  * and are shared. Only the host link on TRANSPORT_DEFAULT has one for now.
+  *
+  * A compact binary protocol (see app_comms_binary.h) shares the UART. A 0x00
+  * byte, which never occurs in JSON text, starts a binary frame; replies go
+  * out in the format of the command, and events in the format last used.
+  * Events are formatted into slots from app_tx_pool, so any task may send
+  * them while a response is being formatted.
+  *
+  * A COMMS_BIN_TYPE_CBOR frame carries a JSON command as one CBOR map. Its
+  * items are fed to COMMS_Handler_StreamEvent as the lwjson events the same
+  * JSON text would raise, so both share the decoder. The JSON response is
+  * then transcoded to CBOR in place (app_cbor.c) and sent in a CBOR frame
+  * echoing the seq byte, as are events while the last command was CBOR.
+  *
+  * Responses fixed but for the message ID and a few numbers are gathered
+  * instead of formatted (COMMS_Gather_t): the constant text, joined into
+  * one literal per command at compile time, is sent straight from flash,
+  * and only the ID and numbers are formatted, into txBuffer, as separate
+  * segments of the same message.
+  *
+  * The bodies of the polled queries (light/get_all, light/get_all_permille,
+  * status/get_all_sensors, alarm/status) are kept rendered as fragments
+  * (COMMS_Fragment_t), each with a copy of the state it was rendered from.
+  * A poll compares the state it just read with that copy and only formats
+  * the body again if they differ; otherwise the fragment is gathered as it
+  * stands, after the message ID.
+  *
+  * A message ID may be a string or an unsigned integer. Integer IDs are
+  * kept as a number in the reply state instead of a string copy, and are
+  * echoed unquoted; handlers then see an empty msg_id.
+  *
+  * Several commands can be sent as one message, as a JSON array of command
+  * objects or a binary batch frame. They are collected, run back to back with
+  * the scheduler suspended, and their responses go out in one transmission.
+  *
+  * Slow commands, those in the table with a work function, are handed to a
+  * worker task below this one, so others are answered while, for example,
+  * config/set writes flash. Up to COMMS_PIPELINE_DEPTH of them may be
+  * outstanding; the host matches their responses by message ID or sequence
+  * number, as they may come after those of later commands. Beyond that
+  * depth the command is answered as busy and should be resent later. Inside
+  * a batch slow commands run in place. txBuffer and the reply state are
+  * shared with the worker task under response_lock.
+  *
+  * A command macro is a batch body kept in flash, checked against the
+  * command table when saved. macro/run and the rules hand it to the worker
+  * task, which decodes the stored arguments and calls the handlers in turn
+  * as silent binary commands, so running one costs no parsing and sends
+  * one response at most.
+  *
+  * Every command belongs to a class in the table, with a token bucket per
+  * class: control commands and queries over their rate are answered busy
+  * without running, so a host flooding the link cannot starve the tasks
+  * below this one, while safety commands (alarm/clear, the stop commands,
+  * system/link) are always admitted. system/link reports the throttled
+  * commands and the peak depth of the RX stream.
+  *
+  * The class is the latency class of the command as well. Emergency
+  * commands (alarm/blackout) do not wait for the queue: the RX interrupt
+  * follows the binary frames in each block before queuing it, and a frame
+  * of at most COMMS_BIN_FAST_FRAME_MAX bytes that decodes, passes its CRC
+  * and address checks and carries an emergency code has the outputs cut
+  * there (SYS_Coordinator_BlackoutFromISR). The frame is then decoded and
+  * answered as usual, and until the task gets to it control commands
+  * queued ahead of it are answered busy rather than turning lights back
+  * on. Its latency histogram holds the time from the RX callback to the
+  * outputs cut; docs/benchmark.md gives the bound from the last byte on
+  * the line. JSON emergency commands take the usual path.
+  *
+  * Only system commands are served until the system coordinator has finished
+  * initializing; others are answered as busy during start-up.
+  *
+  * system/set_baud acknowledges at the current rate and then switches the
+  * UART. Unless a valid command arrives at the new rate within
+  * COMMS_BAUD_CONFIRM_TIMEOUT_MS, the previous rate is restored, so a host
+  * that cannot follow never loses the link.
+  *
+  * Several devices can share one link, an RS-485 bus for example. A command
+  * addressed to one of them starts with {"addr":N (or is a binary
+  * COMMS_BIN_TYPE_ADDR_CMD frame); the address is matched as the first
+  * bytes arrive, and commands for other devices are dropped up to the line
+  * end without reaching the JSON parser. COMMS_ADDRESS_BROADCAST reaches all
+  * devices, which run the command without responding, so a scene change
+  * takes effect on every head at once. The addresses from
+  * COMMS_ADDRESS_GROUP_FIRST up are multicast groups (config/set_groups);
+  * the devices that joined one run its commands the same way, silently. On
+  * a bus commands without an address are dropped too, and events are not
+  * sent as the devices would talk over each other; the host polls, for
+  * example with alarm/status.
+  *
+  * In checked mode (system/link) a JSON command must be followed by
+  * CHECK_MARK and its CRC16 as four hex digits, {...}*1A2F, and only runs
+  * once the check matches; with a "seq" it must also be ahead of the
+  * previous one, so a repeated line does not run twice. Binary frames carry
+  * their CRC anyway, their seq is checked the same way. Malformed input is
+  * dropped at the first byte the stream parser rejects. Each dropped
+  * command is counted by cause in link_stats.
+  *
+  * system/selftest feeds selftest_corpus through the same decoder once the
+  * command itself is finished, with the responses formatted and timed but
+  * not sent, and reports percentiles of the time spent per stage. Its
+  * commands also count in the profiler probes and the trace, but not in
+  * the latency histograms; the link state they would change is restored
+  * afterwards.
   *
   ******************************************************************************
   */
@@ -13,49 +129,1361 @@
 /* Includes ------------------------------------------------------------------*/
 #include "app_comms_handler.h"
 #include "app_sys_coordinator.h"  // For light intensity retrieval
+#include "app_profiler.h"
+#include "app_latency.h"
+#include "app_jitter.h"
+#include "app_boot.h"
+#include "app_resources.h"
+#include "app_integrity.h"
+#include "app_queues.h"
+#include "app_crash.h"
+#include "app_power.h"
+#include "app_trace.h"
+#include "app_logger.h"
+#include "app_tx_pool.h"
+#include "app_transport.h"
+#include "app_supervisor.h"
+#include "app_scheduler.h"
+#include "app_clock.h"
+#include "app_counters.h"
+#include "app_update.h"
+#include "app_color.h"
+#include "app_spectrum.h"
+#include "app_recorder.h"
+#include "app_restore.h"
+#include "app_modbus.h"
+#include "app_comms_binary.h"
+#include "app_json_writer.h"
+#include "app_cbor.h"
 #include "val.h"
 #include "FreeRTOS.h"
 #include "task.h"
+#include "stream_buffer.h"
+#include "queue.h"
+#include "semphr.h"
 #include "cmsis_os.h"
 #include "lwjson/lwjson.h" /* JSON parser library */
 #include <string.h>
-#include <stdio.h>
 #include <stdbool.h>
 
 /* Private define ------------------------------------------------------------*/
-#define COMMS_HANDLER_STACK_SIZE   384
+#define COMMS_HANDLER_STACK_SIZE   416
 #define COMMS_HANDLER_PRIORITY     osPriorityNormal
 
-#define RX_BUFFER_SIZE             256
-#define TX_BUFFER_SIZE             512
+/* Runs slow commands; may erase flash, see docs/tasks.md */
+#define COMMS_WORKER_STACK_SIZE    384
+#define COMMS_WORKER_PRIORITY      osPriorityLow
+
+#define COMMS_PIPELINE_DEPTH       4    /* Slow commands accepted and not yet answered */
+#define COMMS_PIPELINE_RETRY_MS    50   /* Suggested wait after a busy response */
+
+/* Admission limits per command class, token buckets refilled at the rate
+ * and holding up to the burst; emergency and safety commands are never limited */
+#define ADMIT_CONTROL_RATE         500  /* Commands per second */
+#define ADMIT_CONTROL_BURST        50
+#define ADMIT_QUERY_RATE           200
+#define ADMIT_QUERY_BURST          32
+#define ADMIT_TOKEN                1000U  /* A command's cost; levels count thousandths */
+#define ADMIT_REFILL_MAX_MS        60000U /* Longer gaps refill as much, no overflow */
+
+#define RX_STREAM_SIZE             512  /* Raw bytes between the RX DMA and the task */
+#define RX_CHUNK_SIZE              32   /* Bytes taken from the stream per receive */
+#define TX_BUFFER_SIZE             1024 /* Fits system/cpu and system/deadlines with every task */
+#define BATCH_BUFFER_SIZE          768  /* Aggregated responses of a batch */
+#define CBOR_FRAME_SIZE            (TX_BUFFER_SIZE + 16)  /* A response, with room for the frame header */
+
+/* Items left in a CBOR array or map of indefinite length */
+#define CBOR_COUNT_INDEFINITE      UINT32_MAX
+
+/* Commands accepted in one batch */
+#define BATCH_MAX_COMMANDS         8
+
+/* diag/spectrum capture, read back in chunks on the worker stack */
+#define SPECTRUM_PEAKS_DEFAULT     4
+#define SPECTRUM_CHUNK_SCANS       16
+#define SPECTRUM_CAPTURE_MAX_MS    1000U /* Well inside the worker's supervisor limit */
+#define SPECTRUM_POLL_MS           10
+#define SPECTRUM_SCALE_SPAN_MA     100  /* Current span the counts per mA are taken over */
+
+/* Decoded command fields; longer topics/actions cannot match any command */
+#define MSG_ID_MAX_LEN             64
+#define COMMAND_FIELD_MAX_LEN      24
 
 /* Message types */
 #define MSG_TYPE_CMD               "cmd"
 #define MSG_TYPE_RESP              "resp"
 #define MSG_TYPE_EVENT             "event"
 
+/* Command argument fields, decoded from the "data" object on request */
+#define COMMAND_ARG_ID             0x01U  /* "id": integer */
+#define COMMAND_ARG_INTENSITY      0x02U  /* "intensity": integer */
+#define COMMAND_ARG_INTENSITIES    0x04U  /* "intensities": one integer per light */
+#define COMMAND_ARG_LIGHTS         0x08U  /* "lights": array of integers */
+#define COMMAND_ARG_RESET          0x10U  /* "reset": true */
+#define COMMAND_ARG_RATE           0x20U  /* "rate": integer */
+#define COMMAND_ARG_FIELDS         0x40U  /* "fields": array of field names */
+#define COMMAND_ARG_BAUD           0x80U  /* "baud": integer */
+#define COMMAND_ARG_PERMILLE       0x100U /* "permille": integer */
+#define COMMAND_ARG_PERMILLES      0x200U /* "permilles": one integer per light */
+#define COMMAND_ARG_DURATION       0x400U /* "duration": integer, milliseconds */
+#define COMMAND_ARG_CURVE          0x800U /* "curve": curve name */
+#define COMMAND_ARG_CONFIG         0x1000U /* config/set keys: integers */
+#define COMMAND_ARG_FROM           0x2000U /* "from": integer, trace sequence number or capture scan */
+#define COMMAND_ARG_LEVEL          0x4000U /* "level": log level name */
+#define COMMAND_ARG_SCANS          0x8000U /* "scans": integer */
+#define COMMAND_ARG_TRIGGER        0x10000U /* "trigger": capture trigger name */
+#define COMMAND_ARG_THRESHOLD      0x20000U /* "threshold": integer, mA or the unit of a rule input */
+#define COMMAND_ARG_CALIBRATION    0x40000U /* config/set_calibration keys: integers */
+#define COMMAND_ARG_POINTS         0x80000U /* "points": mV and centi-degree pairs */
+#define COMMAND_ARG_CURRENT        0x100000U /* "current": integer, mA */
+#define COMMAND_ARG_OFFSET         0x200000U /* "offset": integer, microseconds */
+#define COMMAND_ARG_PERIOD         0x400000U /* "period": integer, microseconds */
+#define COMMAND_ARG_WIDTH          0x800000U /* "width": integer, microseconds */
+#define COMMAND_ARG_ADDRESS        0x1000000U /* "address": integer, device address */
+#define COMMAND_ARG_BUS            0x2000000U /* "bus": true on an RS-485 bus */
+#define COMMAND_ARG_SYNC           0x4000000U /* "sync": true to also latch on the sync line */
+#define COMMAND_ARG_CHECKED        0x8000000U /* "checked": true to require checked commands */
+#define COMMAND_ARG_CHANNEL        0x10000000U /* "channel": integer, DMX512 channel */
+#define COMMAND_ARG_MASK           0x20000000U /* "mask": integer, bit 0 for light 1 */
+#define COMMAND_ARG_VALUES         0x40000000U /* "values": one integer per bit set in "mask" */
+#define COMMAND_ARG_ON_CHANGE      0x80000000U /* telemetry/subscribe report-on-change keys: integers */
+#define COMMAND_ARG_FREQUENCY      0x100000000ULL /* "frequency": integer, Hz */
+#define COMMAND_ARG_DITHER         0x200000000ULL /* "dither": true to dither steady outputs */
+#define COMMAND_ARG_TIMEOUT        0x400000000ULL /* "timeout": integer, milliseconds */
+#define COMMAND_ARG_SCENE          0x800000000ULL /* "scene": integer, scene number */
+#define COMMAND_ARG_LIMIT          0x1000000000ULL /* "limit": integer, entries per response */
+#define COMMAND_ARG_SINCE          0x2000000000ULL /* "since": integer, milliseconds */
+#define COMMAND_ARG_UNTIL          0x4000000000ULL /* "until": integer, milliseconds */
+#define COMMAND_ARG_TIME           0x8000000000ULL /* "time": integer, milliseconds since 1970 UTC */
+#define COMMAND_ARG_RTT            0x10000000000ULL /* "rtt": integer, milliseconds */
+#define COMMAND_ARG_SIZE           0x20000000000ULL /* "size": integer, bytes */
+#define COMMAND_ARG_CRC            0x40000000000ULL /* "crc": integer, CRC-32 */
+#define COMMAND_ARG_SHAPE          0x80000000000ULL /* "shape": synthetic waveform name */
+#define COMMAND_ARG_NOISE          0x100000000000ULL /* "noise": integer, mA */
+#define COMMAND_ARG_SLEW           0x200000000000ULL /* "slew": integer, permille per millisecond */
+#define COMMAND_ARG_CCT            0x400000000000ULL /* "cct": integer, kelvin */
+#define COMMAND_ARG_TINT           0x800000000000ULL /* "tint": integer, Duv in 1/10000 */
+#define COMMAND_ARG_X              0x1000000000000ULL /* "x": integer, CIE 1931 x in 1/10000 */
+#define COMMAND_ARG_Y              0x2000000000000ULL /* "y": integer, CIE 1931 y in 1/10000 */
+#define COMMAND_ARG_FLUX           0x4000000000000ULL /* "flux": integer, lumens */
+#define COMMAND_ARG_EFFECT         0x8000000000000ULL /* "effect": light effect name */
+#define COMMAND_ARG_DEPTH          0x10000000000000ULL /* "depth": integer, permille of the crest */
+#define COMMAND_ARG_GROUP          0x20000000000000ULL /* "group": integer, light group in place of "id" */
+#define COMMAND_ARG_BUS_GROUPS     0x40000000000000ULL /* "bus_groups": integer, bit 0 for bus group 1 */
+#define COMMAND_ARG_INPUT          0x80000000000000ULL /* "input": rule input name */
+#define COMMAND_ARG_THEN           0x100000000000000ULL /* "then": rule action name */
+#define COMMAND_ARG_HYSTERESIS     0x200000000000000ULL /* "hysteresis": integer, unit of the threshold */
+#define COMMAND_ARG_ENABLE         0x400000000000000ULL /* "enable": true to record */
+#define COMMAND_ARG_DATA           0x800000000000000ULL /* "data": bytes, binary protocol only */
+#define COMMAND_ARG_FLOW           0x1000000000000000ULL /* "flow": true for RTS/CTS flow control */
+#define COMMAND_ARG_STREAM         0x2000000000000000ULL /* "stream": integer, telemetry subscription */
+#define COMMAND_ARG_HOURS          0x4000000000000000ULL /* "hours": integer, full-output hours */
+#define COMMAND_ARG_AGEING         0x8000000000000000ULL /* "ageing": output left at each point, permille */
+#define COMMAND_ARG_COUNT          64     /* Bits above, for system/capabilities */
+
+/* Trace entries per system/trace response */
+#define TRACE_JSON_ENTRIES         4
+#define TRACE_BIN_ENTRIES          ((COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE - 1 - \
+                                     2 * sizeof(uint32_t)) / sizeof(Trace_Entry_t))
+
+/* Scheduler trace entries per system/kernel_trace response */
+#define KERNEL_TRACE_JSON_ENTRIES  4
+#define KERNEL_TRACE_BIN_ENTRIES   ((COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE - 1 - \
+                                     2 * sizeof(uint32_t)) / sizeof(Trace_KernelEntry_t))
+
+/* Commands per system/latency response */
+#define LATENCY_JSON_COMMANDS      6
+#define LATENCY_BIN_COMMANDS       ((COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE - 1 - \
+                                     sizeof(COMMS_Bin_Latency_t) - TRANSPORT_COUNT * sizeof(COMMS_Bin_LatencyEntry_t)) / \
+                                    sizeof(COMMS_Bin_LatencyEntry_t))
+
+/* Commands per system/capabilities response */
+#define CAPABILITIES_JSON_COMMANDS 5
+#define CAPABILITIES_BIN_COMMANDS  ((COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE - 1 - \
+                                     sizeof(COMMS_Bin_Capabilities_t)) / sizeof(COMMS_Bin_Capability_t))
+
+/* Alarm history entries per alarm/history response */
+#define HISTORY_JSON_ENTRIES       8
+#define HISTORY_BIN_ENTRIES        ((COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE - 1 - \
+                                     2 * sizeof(uint16_t)) / sizeof(COMMS_Bin_History_Entry_t))
+
+/* Raw capture scans per capture/read response */
+#define CAPTURE_SCAN_SIZE          (ANALOG_CHANNEL_COUNT * sizeof(uint16_t))
+#define CAPTURE_JSON_SCANS         4
+#define CAPTURE_BIN_SCANS          ((COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE - 1 - \
+                                     sizeof(COMMS_Bin_Capture_Header_t)) / CAPTURE_SCAN_SIZE)
+
+/* capture/read_packed: a 4-bit zig-zag delta per sample, or the escape
+ * nibble and the sample in four nibbles; each response starts from a
+ * keyframe of escaped samples */
+#define CAPTURE_PACKED_BODY        (COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE - 1)
+#define CAPTURE_PACKED_ESCAPE      0xFU
+#define CAPTURE_PACKED_SCAN_MAX    (ANALOG_CHANNEL_COUNT * 5)  /* Nibbles of a keyframe scan */
+
+/* Baud rate switching */
+#define COMMS_BAUD_CONFIRM_TIMEOUT_MS 2000  /* Time for the host to follow a switch */
+#define COMMS_BAUD_FLUSH_TIMEOUT_MS   100   /* Time for the ack to leave at the old rate */
+
+/* Address prefix of a JSON command, matched before the parser sees the line */
+#define ADDR_PREFIX                "{\"addr\":"
+#define ADDR_PREFIX_LEN            (sizeof(ADDR_PREFIX) - 1)
+#define ADDR_HOLD_SIZE             16   /* Bytes held back while matching, with whitespace */
+#define ADDR_DIGITS_MAX            3
+
+/* Check after a JSON command: the mark, then its CRC16 as hex digits */
+#define CHECK_MARK                 '*'
+#define CHECK_DIGITS               4
+
+/* Link self-benchmark, bench/echo, bench/sink and bench/source: always in
+ * Benchmark builds, define COMMS_LINK_BENCH to keep it in the others */
+#if defined(BENCHMARK) && !defined(COMMS_LINK_BENCH)
+#define COMMS_LINK_BENCH
+#endif
+#define BENCH_MAX_BYTES            1048576U  /* Largest run */
+#define BENCH_IDLE_MS              1000U     /* Silence that ends an echo or sink run */
+#define BENCH_SOURCE_CHUNK         256U      /* Pattern bytes queued at once, whole lines */
+#define BENCH_LINE_LENGTH          64U       /* Pattern line, line end included */
+
+/* bench/crc block at the start of the flash; the software loop takes about
+ * a millisecond per kilobyte, all CRCs of the largest block stay well
+ * inside the communications deadline */
+#define BENCH_CRC_BYTES            4096U
+#define BENCH_CRC_MAX_BYTES        16384U
+
+/* bench/copy, RAM to RAM; each way is timed BENCH_COPY_ROUNDS times and the
+ * shortest kept, so an interrupt in between does not count */
+#define BENCH_COPY_BYTES           VAL_DMA_COPY_MIN_BYTES
+#define BENCH_COPY_MAX_BYTES       2048U
+#define BENCH_COPY_ROUNDS          8U
+
+/* system/selftest passes over selftest_corpus */
+#define SELFTEST_CORPUS_SIZE       8
+#define SELFTEST_ROUNDS            4
+#define SELFTEST_SAMPLES           (SELFTEST_CORPUS_SIZE * SELFTEST_ROUNDS)
+
+/* system/selftest phases, indexes into selftest_samples */
+#define SELFTEST_PHASE_PARSE       0
+#define SELFTEST_PHASE_DISPATCH    1    /* Lookup and handler, without formatting */
+#define SELFTEST_PHASE_FORMAT      2
+#define SELFTEST_PHASE_TOTAL       3
+#define SELFTEST_PHASES            4
+
+/* Segments of a gathered response, constant text and formatted fields; a
+ * status response for a runtime topic/action takes 9 */
+#define GATHER_MAX_SEGMENTS        12
+
+/* Rendered response bodies: state compared per fragment, and text sizes */
+#define FRAGMENT_KEY_SIZE          40
+#define FRAGMENT_INTENSITIES_SIZE  24
+#define FRAGMENT_SENSORS_SIZE      256
+#define FRAGMENT_ALARMS_SIZE       384
+
+/* Command hash index, a power of two kept well above the command count */
+#define COMMAND_INDEX_SLOTS        128
+#define COMMAND_SLOT_EMPTY         0xFFU
+#define POINT_VALUES_INVALID       0xFFU  /* A "points" value out of range or too many */
+#define LIGHTS_INVALID             0x80U  /* A "lights" entry that is not a light */
+
+/* Response framing; the header after the message ID is constant per command */
+#define RESP_HEADER(topic, action) "\",\"topic\":\"" topic "\",\"action\":\"" action "\",\"data\":{"
+#define RESP_STATUS_OK             "\"status\":\"ok\""
+#define RESP_STATUS_ERROR          "\"status\":\"error\",\"message\":"
+#define RESP_STATUS_BUSY           "\"status\":\"busy\",\"retry_ms\":"
+#define RESP_END                   "}}\r\n"
+
+/* Private macro -------------------------------------------------------------*/
+#define COMMS_Handler_BeginResponse(writer, msg_id, topic, action) \
+  COMMS_Handler_WriteHeader((writer), (msg_id), RESP_HEADER(topic, action), \
+                            sizeof(RESP_HEADER(topic, action)) - 1)
+
+/* Gathered responses; the body literal joins the header at compile time */
+#define COMMS_Handler_BeginGather(gather, msg_id, topic, action, body) \
+  COMMS_Handler_GatherHeader((gather), (msg_id), RESP_HEADER(topic, action) body, \
+                             sizeof(RESP_HEADER(topic, action) body) - 1)
+#define COMMS_Handler_GatherLiteral(gather, literal) \
+  COMMS_Handler_GatherConst((gather), (literal), sizeof(literal) - 1)
+#define COMMS_Handler_SendFixedResponse(msg_id, topic, action, body) \
+  COMMS_Handler_SendFixed((msg_id), RESP_HEADER(topic, action) body, \
+                          sizeof(RESP_HEADER(topic, action) body) - 1)
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint64_t found;             /* COMMAND_ARG_* fields present in the message */
+  uint8_t id;
+  uint8_t intensity;
+  uint8_t intensities[VAL_LIGHT_COUNT];
+  uint8_t lights;             /* Mask of "lights", bit n for light n+1, LIGHTS_INVALID if unusable */
+  uint8_t rate;
+  uint8_t fields;             /* COMMS_TELEMETRY_* mask */
+  uint32_t baud;
+  uint16_t permille;
+  uint16_t permilles[VAL_LIGHT_COUNT];
+  uint16_t duration;          /* Milliseconds */
+  uint8_t curve;              /* COMMS_CURVE_* value */
+  uint8_t config_keys;        /* COMMS_CONFIG_* keys present */
+  int32_t config_values[COMMS_CONFIG_KEY_COUNT];  /* Indexed by key bit */
+  uint32_t from;              /* Trace sequence number */
+  uint8_t level;              /* Logger_Level_t */
+  uint16_t scans;             /* Capture length */
+  uint8_t trigger;            /* COMMS_CAPTURE_* value */
+  int32_t threshold;          /* Capture threshold, mA */
+  uint8_t calibration_keys;   /* COMMS_CALIBRATION_* keys present */
+  int32_t calibration_values[COMMS_CALIBRATION_KEY_COUNT];  /* Indexed by key bit */
+  uint8_t point_values;       /* Numbers in "points", POINT_VALUES_INVALID if unusable */
+  AnalogCalPoint points[ANALOG_CAL_MAX_POINTS];
+  int32_t current;            /* Regulated current, mA */
+  uint32_t offset;            /* Cue time, microseconds */
+  uint32_t period;            /* Sequence loop period, microseconds */
+  uint32_t width;             /* Strobe pulse width, microseconds */
+  uint8_t address;            /* Device address */
+  bool bus;                   /* RS-485 bus */
+  bool sync;                  /* Latch on the sync line too */
+  bool checked;               /* Checked mode */
+  uint16_t channel;           /* DMX512 channel of light 1 */
+  uint32_t mask;              /* Lights to set, bit 0 for light 1 */
+  uint16_t values[VAL_LIGHT_COUNT];  /* Permille per light in mask, lowest bit first */
+  uint8_t value_count;        /* Values decoded, VAL_LIGHT_COUNT + 1 if too many */
+  uint8_t on_change_keys;     /* COMMS_ON_CHANGE_* keys present */
+  int32_t on_change_values[COMMS_ON_CHANGE_KEY_COUNT];  /* Indexed by key bit */
+  uint32_t frequency;         /* PWM frequency, Hz */
+  bool dither;                /* Dither steady outputs */
+  uint32_t timeout;           /* Failsafe timeout, milliseconds */
+  uint8_t scene;              /* Failsafe scene, 0 for all off */
+  uint8_t limit;              /* Alarm history entries wanted */
+  uint32_t since;             /* Alarm history range, milliseconds */
+  uint32_t until;
+  uint64_t time;              /* Host time, milliseconds since 1970 UTC */
+  uint32_t rtt;               /* Host round trip of the last sync, milliseconds */
+  uint32_t size;              /* Firmware image size, bytes */
+  uint32_t crc;               /* Firmware image CRC-32 */
+  uint8_t shape;              /* COMMS_SYNTH_* value */
+  int32_t noise;              /* Synthetic noise peak, mA */
+  uint16_t slew;              /* PWM slew limit, permille of the period per millisecond */
+  uint16_t cct;               /* Colour temperature, kelvin */
+  int16_t tint;               /* Distance from the Planckian locus, Duv in 1/10000 */
+  uint16_t x;                 /* CIE 1931 chromaticity, 1/10000 */
+  uint16_t y;
+  uint16_t flux;              /* Luminous flux of a primary, lumens */
+  uint8_t effect;             /* COMMS_EFFECT_* value */
+  uint16_t depth;             /* Effect trough below the crest, permille */
+  uint8_t group;              /* Light group (1-CONFIG_LIGHT_GROUPS) */
+  uint16_t bus_groups;        /* Multicast groups joined, bit 0 for group 1 */
+  uint8_t input;              /* COMMS_RULE_INPUT_* value */
+  uint8_t then;               /* COMMS_RULE_* value */
+  int32_t hysteresis;         /* Rule re-arm distance, unit of the threshold */
+  bool enable;                /* Scheduler trace recording on */
+  uint8_t data_length;        /* Bytes in data */
+  uint8_t data[COMMS_CONFIG_IMPORT_CHUNK];  /* Part of a configuration export */
+  bool flow;                  /* RTS/CTS flow control on */
+  uint8_t stream;             /* Telemetry subscription (1-COMMS_TELEMETRY_STREAMS) */
+  uint16_t hours;             /* Ageing curve step, full-output hours */
+  uint16_t ageing[LED_DRIVER_AGEING_POINTS];  /* Output left at each point, permille */
+  uint8_t ageing_count;       /* Points decoded, LED_DRIVER_AGEING_POINTS + 1 if too many */
+} COMMS_Command_Args_t;
+
+/* One alarm/history page being collected from the log */
+typedef struct {
+  ErrorLogEntry_t* entries;   /* Entries of the page */
+  uint32_t skip;              /* Matching entries before the page */
+  uint32_t since;
+  uint32_t until;
+  uint8_t max;                /* Page size */
+  uint8_t count;              /* Entries kept */
+  uint16_t total;             /* Matching entries in the whole log */
+} COMMS_History_Page_t;
+
+typedef struct {
+  char id[MSG_ID_MAX_LEN];    /* String ID, empty for an integer ID */
+  uint32_t id_number;         /* Integer ID */
+  bool id_numeric;            /* The ID is id_number */
+  uint32_t seq;               /* Sequence number, valid with has_seq */
+  bool has_seq;
+  bool no_ack;                /* "ack":false, answer failures only */
+  char type[COMMAND_FIELD_MAX_LEN];
+  char topic[COMMAND_FIELD_MAX_LEN];
+  char action[COMMAND_FIELD_MAX_LEN];
+  uint8_t intensity_count;    /* Intensities decoded so far */
+  uint8_t permille_count;     /* Permille intensities decoded so far */
+  COMMS_Command_Args_t args;
+} COMMS_Command_Msg_t;
+
+typedef void (*COMMS_Command_Handler_t)(const char* msg_id, const COMMS_Command_Args_t* args);
+typedef VAL_Status (*COMMS_Command_Work_t)(const COMMS_Command_Args_t* args);
+typedef void (*COMMS_Command_Complete_t)(const char* msg_id, VAL_Status status);
+
+/* Latency and admission class of a command, each with its own rate limit */
+typedef enum {
+  COMMS_CLASS_EMERGENCY = 0,  /* Cuts the outputs from the RX interrupt: always admitted */
+  COMMS_CLASS_SAFETY,         /* Stops outputs, alarms and the link itself: always admitted */
+  COMMS_CLASS_CONTROL,        /* Changes outputs or settings */
+  COMMS_CLASS_QUERY,          /* Reads state back */
+  COMMS_CLASS_COUNT
+} COMMS_Command_Class_t;
+
+typedef struct {
+  const char* topic;
+  const char* action;
+  uint8_t bin_code;           /* COMMS_BIN_* code of the same command */
+  uint64_t args;              /* COMMAND_ARG_* fields the handler takes */
+  COMMS_Command_Class_t command_class;  /* Rate limit the command counts against */
+  COMMS_Command_Handler_t handler;    /* Runs the command in place */
+  COMMS_Command_Work_t work;          /* Slow commands: run by the worker task, NULL otherwise */
+  COMMS_Command_Complete_t complete;  /* Slow commands: responds with the work status */
+} COMMS_Command_t;
+
+/* JSON key and value type of a COMMAND_ARG_* field */
+typedef struct {
+  const char* key;
+  const char* type;           /* int, bool, ints, name, names or keys (an integer per key) */
+} COMMS_Arg_Info_t;
+
+typedef struct {
+  const COMMS_Command_t* command;  /* NULL for an unknown command */
+  uint8_t code;               /* Binary command code, for the reply */
+  bool id_numeric;            /* The ID is id_number, id is empty */
+  uint32_t id_number;
+  char id[MSG_ID_MAX_LEN];
+  COMMS_Command_Args_t args;
+} COMMS_Batch_Entry_t;
+
+/* Commands received, and dropped by cause */
+typedef struct {
+  uint32_t accepted;          /* Passed the checks */
+  uint32_t crc;               /* CRC or check mismatch */
+  uint32_t unchecked;         /* No check in checked mode */
+  uint32_t duplicate;         /* Sequence number not ahead of the previous one */
+  uint32_t malformed;         /* Unparsable or cut short by a line end */
+  uint32_t oversize;          /* Binary frame too long */
+  uint32_t overflow;          /* Bytes lost in the RX stream */
+  uint32_t filtered;          /* For another device */
+  uint32_t throttled[COMMS_CLASS_COUNT];  /* Answered busy by the rate limit of the class */
+  uint32_t pipeline_full;     /* Slow commands answered busy, COMMS_PIPELINE_DEPTH outstanding */
+  uint16_t rx_peak;           /* Most bytes waiting in the RX stream */
+} COMMS_Link_Stats_t;
+
+/* Token bucket of a command class */
+typedef struct {
+  uint16_t rate;              /* Commands per second, 0 for no limit */
+  uint16_t burst;             /* Commands admitted back to back */
+} COMMS_Admit_Limit_t;
+
+typedef struct {
+  uint32_t level;             /* Tokens left, in thousandths */
+  TickType_t refilled;        /* Tick of the last refill */
+} COMMS_Admit_Bucket_t;
+
+/* A response sent as a list of segments instead of one formatted buffer */
+typedef struct {
+  VAL_Serial_Segment_t segments[GATHER_MAX_SEGMENTS];
+  uint8_t count;
+  bool overflow;              /* Too many segments, the response is incomplete */
+  JSON_Writer_t fields;       /* Formatted fields, in txBuffer */
+} COMMS_Gather_t;
+
+/* A response body kept rendered while the state it shows is unchanged */
+typedef struct {
+  uint8_t key[FRAGMENT_KEY_SIZE];  /* State the text was rendered from */
+  uint8_t key_size;
+  uint16_t length;            /* Text length, 0 until rendered */
+  uint16_t size;
+  char* text;
+} COMMS_Fragment_t;
+
+typedef struct {
+  bool binary;                /* Reply with a binary frame */
+  uint8_t seq;                /* Sequence number to echo */
+  uint8_t code;               /* Command code to echo */
+  bool id_numeric;            /* Echo id_number instead of the msg_id string */
+  uint32_t id_number;         /* Integer message ID */
+  VAL_Status status;          /* Failure reported to the host, for the trace */
+  bool silent;                /* Broadcast command, no response is sent */
+  bool no_ack;                /* Only a failure is answered */
+  bool cbor;                  /* Re-encode the JSON reply as a CBOR frame */
+} COMMS_Reply_t;
+
+/* Link self-benchmark run; the raw bytes of echo and sink runs bypass the
+ * decoder, source runs send while commands are decoded as usual */
+typedef enum {
+  BENCH_MODE_IDLE = 0,
+  BENCH_MODE_ECHO,
+  BENCH_MODE_SINK,
+  BENCH_MODE_SOURCE
+} COMMS_Bench_Mode_t;
+
+typedef struct {
+  uint8_t mode;               /* COMMS_Bench_Mode_t */
+  uint32_t size;              /* Bytes the run moves */
+  uint32_t bytes;             /* Bytes moved so far */
+  uint32_t start_us;          /* First byte received or queued */
+  uint32_t last_us;           /* Last byte received, queued or sent */
+  uint32_t turnaround_max_us; /* Echo: longest receive to queued again */
+  uint32_t overflow;          /* link_stats.overflow at the start */
+  TickType_t last_tick;       /* Last byte received, for the idle timeout */
+  COMMS_Reply_t reply;
+  char id[MSG_ID_MAX_LEN];
+} COMMS_Bench_t;
+
+typedef struct {
+  const COMMS_Command_t* command;
+  COMMS_Reply_t reply;        /* Format, sequence number and code to respond with */
+  uint32_t start;             /* Profiler timestamp when accepted, for the trace */
+  uint32_t received;          /* Profiler timestamp when its frame was complete */
+  char id[MSG_ID_MAX_LEN];
+  COMMS_Command_Args_t args;
+} COMMS_Pending_t;
+
+/* Delta encoder of capture/read_packed, one previous sample per channel */
+typedef struct {
+  uint16_t last[ANALOG_CHANNEL_COUNT];
+  bool keyframe;              /* Next scan is written whole */
+  uint8_t* data;              /* Nibbles, high one first */
+  uint16_t nibbles;
+  uint16_t capacity;          /* In nibbles */
+} COMMS_Capture_Packer_t;
+
+/* Everything a telemetry sample may carry, read once for all streams due */
+typedef struct {
+  uint64_t now_us;
+  const uint8_t* intensities;
+  const LightSensorData_t* sensor_data;
+  const uint8_t* alarms;
+  AnalogErrorCounts adc_errors;
+  Jitter_Window_t loops[JITTER_LOOP_COUNT];
+  uint16_t derate[VAL_LIGHT_COUNT];
+  LED_Driver_StrobeStatus_t strobe;
+  uint64_t time;
+} COMMS_Telemetry_Sample_t;
+
 /* Private variables ---------------------------------------------------------*/
 static TaskHandle_t comms_handler_task_handle = NULL;
-static char rxBuffer[RX_BUFFER_SIZE];
-static char txBuffer[TX_BUFFER_SIZE];
-static uint16_t rx_index = 0;
+static StreamBufferHandle_t rx_stream = NULL;
+static uint32_t comms_handler_stack[COMMS_HANDLER_STACK_SIZE];
+static osStaticThreadDef_t comms_handler_tcb;
+static uint8_t rx_stream_storage[RX_STREAM_SIZE + 1];  /* A stream buffer keeps one byte free */
+static StaticStreamBuffer_t rx_stream_control;
+static volatile uint8_t rx_overflow = 0;     /* Set by the ISR when bytes were dropped */
 
-static lwjson_t jsonParser;
-static lwjson_token_t jsonTokens[32];
+/* Emergency fast path, followed by the RX interrupt */
+static uint8_t fast_frame[COMMS_BIN_FAST_FRAME_MAX];  /* Encoded bytes since the last delimiter */
+static uint8_t fast_length = 0;
+static bool fast_collecting = false;         /* After a delimiter, until the frame is too long */
+static volatile uint8_t fast_pending = 0;    /* Cut in the interrupt, not yet run by the task */
+static char txBuffer[TX_BUFFER_SIZE];        /* Responses, under response_lock; events use app_tx_pool */
+static uint8_t cborFrame[CBOR_FRAME_SIZE];   /* Responses re-encoded for a CBOR host, under response_lock */
+
+/* Bodies of the polled queries, only used by the communications task */
+static char intensities_text[FRAGMENT_INTENSITIES_SIZE];
+static char permilles_text[FRAGMENT_INTENSITIES_SIZE];
+static char sensors_text[FRAGMENT_SENSORS_SIZE];
+static char alarms_text[FRAGMENT_ALARMS_SIZE];
+static COMMS_Fragment_t intensities_fragment = { .size = sizeof(intensities_text), .text = intensities_text };
+static COMMS_Fragment_t permilles_fragment = { .size = sizeof(permilles_text), .text = permilles_text };
+static COMMS_Fragment_t sensors_fragment = { .size = sizeof(sensors_text), .text = sensors_text };
+static COMMS_Fragment_t alarms_fragment = { .size = sizeof(alarms_text), .text = alarms_text };
+
+/* Slow commands */
+static TaskHandle_t comms_worker_task_handle = NULL;
+static uint32_t comms_worker_stack[COMMS_WORKER_STACK_SIZE];
+static osStaticThreadDef_t comms_worker_tcb;
+static QueueHandle_t pipeline_queue = NULL;
+static uint8_t pipeline_storage[COMMS_PIPELINE_DEPTH * sizeof(COMMS_Pending_t)];
+static StaticQueue_t pipeline_control;
+static SemaphoreHandle_t response_lock = NULL;  /* txBuffer and reply */
+static StaticSemaphore_t response_lock_control;
+static COMMS_Pending_t worker_command;       /* Worker task only */
+
+/* Progress of config/import, from its work function to its response */
+static uint16_t import_received = 0;
+static bool import_complete = false;
+
+/* Macro being received by macro/save, and the number it is for, 0 if none */
+static Config_Macro_t macro_staged;
+static uint8_t macro_staged_id = 0;
+static uint8_t macro_received = 0;
+
+/* Last macro run, from its work function to its response; the macro and
+ * the arguments of its commands are kept here, under response_lock, as
+ * the worker task stack is small */
+static COMMS_Bin_Macro_Run_t macro_result;
+static Config_Macro_t macro_running;
+static COMMS_Command_Args_t macro_args;
+
+/* Last diag/spectrum analysis (worker task only) */
+static uint8_t spectrum_light = 0;
+static uint32_t spectrum_rate_hz = 0;
+static uint16_t spectrum_samples[SPECTRUM_SIZE];
+static Spectrum_Result_t spectrum_result;
+
+/* Last command or frame complete, for the latency (task only) */
+static uint32_t rx_received;
+
+/* Batch collected from a JSON array or a binary batch frame (task only) */
+static COMMS_Batch_Entry_t batch[BATCH_MAX_COMMANDS];
+static uint8_t batch_count = 0;
+static bool batch_dropped = false;           /* Commands beyond BATCH_MAX_COMMANDS */
+static bool batch_collecting = false;        /* Transmit appends to batchBuffer */
+static char batchBuffer[BATCH_BUFFER_SIZE];
+static size_t batch_length = 0;
+
+static COMMS_Reply_t reply = { false, 0, 0, false, 0, VAL_OK, false, false, false };
+
+/* Address filter result */
+typedef enum {
+  ADDR_FILTER_HOLD = 0,       /* Byte held back, no decision yet */
+  ADDR_FILTER_ACCEPT,         /* Held bytes and this one go to the parser */
+  ADDR_FILTER_DROP            /* Command for another device */
+} COMMS_Addr_Filter_t;
+
+/* Decoder state of a session. Every byte moves it on from where the last
+ * one left it, nothing is kept on the stack in between. */
+typedef enum {
+  RX_STATE_IDLE = 0,          /* Between commands, bytes go through the address filter */
+  RX_STATE_ACCEPTED,          /* Passed the filter, no opening bracket yet */
+  RX_STATE_COMMAND,           /* JSON command in the parser */
+  RX_STATE_CHECK,             /* Parsed, runs once the check matches */
+  RX_STATE_FRAME,             /* Binary frame, up to the next delimiter */
+  RX_STATE_DISCARD            /* Dropped, up to the next line end */
+} COMMS_Rx_State_t;
+
+/* One session per link the task reads commands from (task only) */
+typedef struct {
+  COMMS_Rx_State_t state;
+  lwjson_stream_parser_t parser;             /* user_data points back to the session */
+  COMMS_Command_Msg_t command;
+  uint32_t command_start;
+  uint32_t parse_cycles;
+  uint16_t crc;                              /* CRC16 of the command so far */
+  uint16_t check_value;
+  uint8_t check_len;                         /* Check characters received, the mark included */
+  bool cbor;                                 /* The command being run came in a CBOR frame */
+  bool broadcast;                            /* The current command is for all devices or a group */
+  uint8_t held_len;
+  char held[ADDR_HOLD_SIZE];
+  uint8_t addr_matched;                      /* Characters of ADDR_PREFIX matched */
+  uint8_t addr_digits;
+  uint16_t addr_value;
+  uint8_t frame_len;
+  uint8_t frame[COMMS_BIN_MAX_RX_FRAME];
+} COMMS_Session_t;
+
+static COMMS_Session_t host_session;         /* Commands from TRANSPORT_DEFAULT */
+
+/* Link validation (task only) */
+static bool link_checked = false;
+static COMMS_Link_Stats_t link_stats;
+static bool json_seq_seen = false;           /* json_seq holds the last accepted "seq" */
+static uint32_t json_seq;
+static bool bin_seq_seen = false;
+static uint8_t bin_seq;
+
+/* Admission control (task only), indexed by COMMS_Command_Class_t */
+static const COMMS_Admit_Limit_t admit_limits[COMMS_CLASS_COUNT] = {
+  { 0, 0 },
+  { 0, 0 },
+  { ADMIT_CONTROL_RATE, ADMIT_CONTROL_BURST },
+  { ADMIT_QUERY_RATE, ADMIT_QUERY_BURST }
+};
+static COMMS_Admit_Bucket_t admit_buckets[COMMS_CLASS_COUNT];  /* Fill up within 200 ms of start-up */
+
+/* Link sharing, set by COMMS_Handler_SetAddress */
+static volatile uint8_t device_address = 0;
+static volatile bool bus_mode = false;
+static volatile uint16_t bus_groups = 0;     /* Multicast groups joined, set by COMMS_Handler_SetBusGroups */
+
+/* Unconfirmed baud rate switch (task only); 0 when the link is confirmed */
+static uint32_t link_fallback_baud = 0;
+static uint8_t link_fallback_flow;
+static TickType_t link_switch_tick;
+
+/* Failsafe on a silent link, set by COMMS_Handler_SetFailsafe */
+static volatile uint16_t failsafe_ms = 0;
+static volatile uint8_t failsafe_scene = 0;
+
+/* Link activity (task only); the failsafe is armed by the first valid frame */
+static bool link_seen = false;
+static TickType_t link_frame_tick;           /* Tick of the last valid frame */
+static bool failsafe_active = false;
+static volatile bool host_binary = false;    /* Format of the last command, used for events */
+static volatile bool host_cbor = false;      /* The last JSON command came as CBOR, so do JSON events */
+static bool telemetry_binary[COMMS_TELEMETRY_STREAMS];  /* Format each stream was subscribed in */
+
+/* Self-test run (task only) */
+static bool selftest_pending = false;        /* Runs once the decoder is idle */
+static COMMS_Reply_t selftest_reply;
+static char selftest_id[MSG_ID_MAX_LEN];
+static bool tx_null_sink = false;            /* Transmit counts responses and drops them */
+static uint32_t selftest_format_cycles;      /* Of the command being run */
+static uint32_t selftest_bytes;
+static uint32_t selftest_samples[SELFTEST_PHASES][SELFTEST_SAMPLES];
+
+#ifdef COMMS_LINK_BENCH
+/* Link self-benchmark (task only) */
+static COMMS_Bench_t bench;
+static uint8_t bench_block[BENCH_SOURCE_CHUNK];  /* Pattern of source runs */
+static const char* const bench_mode_names[] = { "idle", "echo", "sink", "source" };
+#endif
+
+#ifdef BENCHMARK
+/* Synthetic source started by bench/synthetic */
+static uint8_t synth_light = 0;              /* 0 until the first start */
+static uint16_t synth_trips = 0;             /* Trip count of the light at the start */
+static uint64_t alarm_event_us = 0;          /* Last alarm event formatted */
+
+/* bench/copy source, then destination with room for a one byte offset */
+static uint8_t bench_copy_buffer[2U * BENCH_COPY_MAX_BYTES + 8U] __attribute__((aligned(4)));
+static volatile bool bench_copy_done;
+static volatile uint32_t bench_copy_cycles;  /* Cycle counter at the callback */
+static volatile VAL_Status bench_copy_status;
+#endif
 
 /* Private function prototypes -----------------------------------------------*/
 static void COMMS_Handler_Task(void const *argument);
-static void COMMS_Handler_ProcessJsonCommand(const char* json_str);
-static void COMMS_Handler_SerialRxCallback(uint8_t byte);
+static void COMMS_Handler_WorkerTask(void const *argument);
+static void COMMS_Handler_SerialRxCallback(const uint8_t* data, uint16_t length);
+static void COMMS_Handler_FastScan(const uint8_t* data, uint16_t length, uint32_t received);
+static uint8_t COMMS_Handler_FastMatch(void);
 static void COMMS_Handler_SendPingResponse(const char* msg_id);
 static void COMMS_Handler_SendLightIntensityResponse(const char* msg_id, uint8_t light_id);
 static void COMMS_Handler_SendSetLightResponse(const char* msg_id, VAL_Status status);
 static void COMMS_Handler_SendSetAllLightsResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendBlackoutResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendLightPermilleResponse(const char* msg_id, uint8_t light_id);
+static void COMMS_Handler_SendSetPermilleResponse(const char* msg_id, const char* action, VAL_Status status);
+static void COMMS_Handler_SendSetColorResponse(const char* msg_id, VAL_Status status, const uint16_t* permille);
+static void COMMS_Handler_SendEffectResponse(const char* msg_id, VAL_Status status);
 static void COMMS_Handler_SendSensorDataResponse(const char* msg_id, uint8_t light_id);
 static void COMMS_Handler_SendAllSensorDataResponse(const char* msg_id);
-static void COMMS_Handler_SendAlarmClearResponse(const char* msg_id, uint8_t light_id, VAL_Status status);
+static void COMMS_Handler_SendStateResponse(const char* msg_id);
+static void COMMS_Handler_SendStatsResponse(const char* msg_id, bool reset);
+static void COMMS_Handler_SendUsageResponse(const char* msg_id);
+static void COMMS_Handler_SendFlickerResponse(const char* msg_id, VAL_Status status);
+static uint32_t COMMS_Handler_UsageSeconds(uint64_t count, uint32_t per_second);
+static void COMMS_Handler_WriteStats(JSON_Writer_t* writer, const AnalogStatsReading* reading, bool centi);
+static void COMMS_Handler_SendStatsWindowResponse(const char* msg_id, VAL_Status status, uint16_t scans);
+static void COMMS_Handler_SendBlockScansResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendAlarmClearResponse(const char* msg_id, uint8_t lights, uint8_t failed,
+                                                 VAL_Status status);
 static void COMMS_Handler_SendAlarmStatusResponse(const char* msg_id);
+static void COMMS_Handler_SendAlarmHistoryResponse(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_SendRecordingResponse(const char* msg_id);
+static bool COMMS_Handler_VisitHistory(const ErrorLogEntry_t* entry, void* context);
+static const char* COMMS_Handler_ActionName(uint8_t action);
 static void COMMS_Handler_SendErrorResponse(const char* msg_id, const char* topic, const char* action, const char* message);
+static void COMMS_Handler_SendBusyResponse(const char* msg_id, const char* topic, const char* action);
+static void COMMS_Handler_SendPerfResponse(const char* msg_id);
+static void COMMS_Handler_SendBootTimeResponse(const char* msg_id);
+static void COMMS_Handler_SendResourcesResponse(const char* msg_id);
+static void COMMS_Handler_SendCpuResponse(const char* msg_id);
+static void COMMS_Handler_SendTraceResponse(const char* msg_id, uint32_t from);
+static void COMMS_Handler_SendCrashReportResponse(const char* msg_id);
+static void COMMS_Handler_SendCrashTraceResponse(const char* msg_id, uint32_t from);
+static void COMMS_Handler_WriteTraceEntry(JSON_Writer_t* writer, const Trace_Entry_t* entry);
+static void COMMS_Handler_SendKernelTraceResponse(const char* msg_id);
+static void COMMS_Handler_SendKernelEntriesResponse(const char* msg_id, uint32_t from);
+static void COMMS_Handler_SendLogLevelResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendLinkResponse(const char* msg_id);
+static void COMMS_Handler_SendTimeSyncResponse(const char* msg_id, VAL_Status status,
+                                               const Clock_SyncResult_t* result);
+static void COMMS_Handler_SendUpdateResponse(const char* msg_id, VAL_Status status, uint32_t size);
+static void COMMS_Handler_SendCapabilitiesResponse(const char* msg_id, uint32_t from);
+static void COMMS_Handler_SendLatencyResponse(const char* msg_id, uint32_t from);
+static uint32_t COMMS_Handler_NextLatency(uint32_t index);
+static void COMMS_Handler_WriteLatency(JSON_Writer_t* writer, const Latency_Summary_t* summary);
+static size_t COMMS_Handler_PackLatency(uint8_t* dest, uint8_t code, const Latency_Summary_t* summary);
+static void COMMS_Handler_SendDeadlinesResponse(const char* msg_id);
+static void COMMS_Handler_SendQueuesResponse(const char* msg_id);
+static void COMMS_Handler_SendLoopTimingResponse(const char* msg_id);
+static void COMMS_Handler_SendSelfTestResponse(const char* msg_id, uint8_t count);
+#ifdef COMMS_LINK_BENCH
+static void COMMS_Handler_SendBenchResponse(const char* msg_id);
+#endif
+static void COMMS_Handler_SendSetBaudResponse(const char* msg_id, VAL_Status status, uint32_t baud, bool flow);
+static void COMMS_Handler_SendSetPwmFreqResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendConfigResponse(const char* msg_id);
+static void COMMS_Handler_SendSetConfigResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendCalibrationResponse(const char* msg_id, uint8_t light_id);
+static void COMMS_Handler_SendSetCalibrationResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendSetAddressResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendSetFailsafeResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendSetSlewResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendSetAgeingResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendSetTrimResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendSetPrimaryResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendGroupsResponse(const char* msg_id, const char* action, VAL_Status status);
+static void COMMS_Handler_SendSetGroupsResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendSetPowerOnResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendSetStopModeResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendBeginConfigResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendCommitConfigResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendAbortConfigResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendExportConfigResponse(const char* msg_id, uint32_t from);
+static void COMMS_Handler_SendImportConfigResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_ApplyLinkConfig(void);
+static VAL_Status COMMS_Handler_SendFailsafeEvent(uint32_t silence_ms);
+static void COMMS_Handler_SendSceneResponse(const char* msg_id, uint8_t scene);
+static void COMMS_Handler_SendSceneStatusResponse(const char* msg_id, const char* action, VAL_Status status);
+static void COMMS_Handler_SendSaveSceneResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendCaptureStartResponse(const char* msg_id, VAL_Status status, uint16_t scans);
+static void COMMS_Handler_SendSequenceStatusResponse(const char* msg_id, const char* action, VAL_Status status);
+static void COMMS_Handler_SendSequenceResponse(const char* msg_id);
+static void COMMS_Handler_SendStrobeStatusResponse(const char* msg_id, const char* topic, const char* action,
+                                                   VAL_Status status);
+static void COMMS_Handler_SendStrobeResponse(const char* msg_id);
+static void COMMS_Handler_SendDmxStartResponse(const char* msg_id, VAL_Status status, uint16_t channel);
+static void COMMS_Handler_SendDmxResponse(const char* msg_id);
+static void COMMS_Handler_SendModbusStartResponse(const char* msg_id, VAL_Status status, uint8_t address,
+                                                  uint32_t baud, uint32_t timeout_ms);
+static void COMMS_Handler_SendModbusResponse(const char* msg_id);
+static void COMMS_Handler_SendRulesStatusResponse(const char* msg_id, const char* action, VAL_Status status);
+static void COMMS_Handler_SendRulesResponse(const char* msg_id);
+static void COMMS_Handler_SendSaveMacroResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendRunMacroResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendMacroResponse(const char* msg_id, uint8_t macro);
+static void COMMS_Handler_SendSpectrumResponse(const char* msg_id, VAL_Status status);
+static void COMMS_Handler_SendCaptureReadResponse(const char* msg_id, uint16_t from);
+static void COMMS_Handler_SendCapturePackedResponse(const char* msg_id, uint16_t from);
+static bool COMMS_Handler_PackScan(COMMS_Capture_Packer_t* packer, const uint16_t* scan);
+static void COMMS_Handler_PackNibble(COMMS_Capture_Packer_t* packer, uint8_t nibble);
+static void COMMS_Handler_ConfirmLink(void);
+static TickType_t COMMS_Handler_LinkTimeout(void);
+static bool COMMS_Handler_EnterFailsafe(TickType_t now);
+static VAL_Status COMMS_Handler_Transmit(const char* buffer, int length, uint32_t format_start);
+static VAL_Status COMMS_Handler_TransmitSegments(const VAL_Serial_Segment_t* segments, uint8_t count,
+                                                 uint32_t format_start);
+static VAL_Status COMMS_Handler_TransmitEvent(TxPool_Handle_t slot, size_t length, uint32_t format_start);
+static void COMMS_Handler_WriteHeader(JSON_Writer_t* writer, const char* msg_id,
+                                      const char* header, size_t header_length);
+static void COMMS_Handler_BeginResponseFor(JSON_Writer_t* writer, const char* msg_id,
+                                           const char* topic, const char* action);
+static VAL_Status COMMS_Handler_EndResponse(JSON_Writer_t* writer, uint32_t format_start);
+static void COMMS_Handler_GatherHeader(COMMS_Gather_t* gather, const char* msg_id,
+                                       const char* header, size_t header_length);
+static void COMMS_Handler_BeginGatherFor(COMMS_Gather_t* gather, const char* msg_id,
+                                         const char* topic, const char* action);
+static void COMMS_Handler_GatherConst(COMMS_Gather_t* gather, const char* text, size_t length);
+static void COMMS_Handler_GatherUint(COMMS_Gather_t* gather, uint32_t value);
+static VAL_Status COMMS_Handler_EndGather(COMMS_Gather_t* gather, uint32_t format_start);
+static bool COMMS_Handler_FragmentCurrent(COMMS_Fragment_t* fragment, const void* key, size_t key_size,
+                                          JSON_Writer_t* writer);
+static void COMMS_Handler_EndFragment(COMMS_Fragment_t* fragment, const JSON_Writer_t* writer);
+static void COMMS_Handler_GatherFragment(COMMS_Gather_t* gather, const COMMS_Fragment_t* fragment);
+static void COMMS_Handler_SendFixed(const char* msg_id, const char* text, size_t length);
+static void COMMS_Handler_WriteSensor(JSON_Writer_t* writer, uint8_t light_id, const LightSensorData_t* data,
+                                      bool with_raw);
+static void COMMS_Handler_WriteSampleStamp(JSON_Writer_t* writer, const LightSampleStamp_t* stamp);
+static const char* COMMS_Handler_ErrorName(uint8_t error_type);
+static const char* COMMS_Handler_AlarmStateName(LED_Driver_AlarmState_t state);
+static uint32_t COMMS_Handler_TripTimestamp(const COMMS_Alarm_Source_t* alarm, uint32_t now_ms);
+static void COMMS_Handler_WriteTime(JSON_Writer_t* writer, uint32_t age_ms);
+static VAL_Status COMMS_Handler_BuildCommandIndex(void);
+static uint32_t COMMS_Handler_HashCommand(const char* topic, size_t topic_len,
+                                          const char* action, size_t action_len);
+static const COMMS_Command_t* COMMS_Handler_FindCommand(const char* topic, size_t topic_len,
+                                                        const char* action, size_t action_len);
+static void COMMS_Handler_InitSession(COMMS_Session_t* session);
+static void COMMS_Handler_BeginCommand(COMMS_Session_t* session);
+static void COMMS_Handler_ClearCommand(COMMS_Command_Msg_t* msg);
+static void COMMS_Handler_ResetDecoder(COMMS_Session_t* session, bool discard);
+static void COMMS_Handler_DecodeByte(COMMS_Session_t* session, char byte);
+static void COMMS_Handler_ParseByte(COMMS_Session_t* session, char byte);
+static void COMMS_Handler_CheckByte(COMMS_Session_t* session, char byte);
+static void COMMS_Handler_FinishCommand(COMMS_Session_t* session);
+static void COMMS_Handler_RunSelfTest(COMMS_Session_t* session);
+static COMMS_Addr_Filter_t COMMS_Handler_FilterByte(COMMS_Session_t* session, char byte);
+static bool COMMS_Handler_IsAddressed(uint16_t address);
+static void COMMS_Handler_CopyString(const lwjson_stream_parser_t* jsp, char* dest, size_t size);
+static bool COMMS_Handler_ParseInt(const char* str, int32_t* value);
+static bool COMMS_Handler_ParseId(const char* str, uint32_t* value);
+static bool COMMS_Handler_ParseTime(const char* str, uint64_t* value);
+static void COMMS_Handler_StreamEvent(lwjson_stream_parser_t* jsp, lwjson_stream_type_t type);
+static void COMMS_Handler_DispatchCommand(COMMS_Session_t* session);
+static VAL_Status COMMS_Handler_DeferCommand(const COMMS_Command_t* command, const char* msg_id,
+                                             const COMMS_Command_Args_t* args, uint32_t start);
+static void COMMS_Handler_RunCommand(const COMMS_Command_t* command, const char* msg_id,
+                                     COMMS_Command_Args_t* args);
+static bool COMMS_Handler_Admit(const COMMS_Command_t* command);
+static void COMMS_Handler_ProcessFrame(COMMS_Session_t* session);
+static void COMMS_Handler_ProcessBatchFrame(const uint8_t* body, size_t length);
+static void COMMS_Handler_ProcessCbor(COMMS_Session_t* session, const uint8_t* body, size_t length,
+                                      uint8_t seq, bool no_ack);
+static bool COMMS_Handler_CborItem(lwjson_stream_parser_t* jsp, const CBOR_Item_t* item, uint32_t* remaining);
+static void COMMS_Handler_CborString(lwjson_stream_parser_t* jsp, const CBOR_Item_t* item);
+static void COMMS_Handler_CborPop(lwjson_stream_parser_t* jsp);
+static void COMMS_Handler_CborCount(lwjson_stream_parser_t* jsp, uint32_t* remaining);
+static size_t COMMS_Handler_EncodeCbor(uint8_t* buffer, size_t size, size_t length, uint8_t seq);
+static void COMMS_Handler_QueueCommand(const COMMS_Command_t* command, uint8_t code,
+                                       const char* msg_id, uint32_t id_number,
+                                       const COMMS_Command_Args_t* args);
+static void COMMS_Handler_RunBatch(void);
+static void COMMS_Handler_DecodeBinaryArgs(const uint8_t* body, size_t length, uint64_t wanted,
+                                           COMMS_Command_Args_t* args);
+static void COMMS_Handler_SendBinaryResponse(VAL_Status status, const void* body, size_t body_length);
+static void COMMS_Handler_PackSensor(const LightSensorData_t* data, COMMS_Bin_Sensor_t* packed);
+static void COMMS_Handler_CmdSystemPing(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemPerf(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemBootTime(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemResources(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemCpu(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemTrace(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemCrashReport(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemKernelTrace(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemLatency(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemLogLevel(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemLink(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemDeadlines(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemQueues(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemLoopTiming(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemTimeSync(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemUpdate(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemCapabilities(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemGetState(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemSelfTest(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemSetBaud(const char* msg_id, const COMMS_Command_Args_t* args);
+#ifdef BENCHMARK
+static void COMMS_Handler_CmdSystemInjectFault(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSystemIrqLatency(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdBenchSynthetic(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdBenchCrc(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdBenchCopy(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_BenchCopyDone(void* context, VAL_Status status);
+static void COMMS_Handler_BenchCopyRun(uint32_t offset, uint32_t size, COMMS_Bin_BenchCopy_t* result);
+static VAL_Status COMMS_Handler_StartSynthetic(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_SendSyntheticResponse(const char* msg_id, VAL_Status status);
+#endif
+#ifdef COMMS_LINK_BENCH
+static void COMMS_Handler_CmdBenchEcho(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdBenchSink(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdBenchSource(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_StartBench(const char* msg_id, const COMMS_Command_Args_t* args, uint8_t mode);
+static TickType_t COMMS_Handler_BenchWait(TickType_t wait);
+static size_t COMMS_Handler_BenchReceive(const char* data, size_t length);
+static void COMMS_Handler_BenchPoll(void);
+#endif
+static void COMMS_Handler_CmdLightGet(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightGetAll(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightSet(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightSetAll(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightGetPermille(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightGetAllPermille(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightSetPermille(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightSetCurrent(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightStage(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightCommit(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightSetAllPermille(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightSetMask(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightSetColor(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightEffect(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightStrobe(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightSetPwmFreq(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightFade(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdLightSetCurve(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdStatusGetSensors(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdStatusGetAllSensors(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdStatusGetStats(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdStatusGetUsage(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdStatusGetFlicker(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdStatusSetStatsWindow(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdStatusBlockScans(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdAlarmClear(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdAlarmStatus(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdAlarmHistory(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdAlarmRecording(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdAlarmBlackout(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdTelemetrySubscribe(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdTelemetryUnsubscribe(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigGet(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigSet(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigSet(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigGetCalibration(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigSetCalibration(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigSetCalibration(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigSetAddress(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigSetAddress(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigSetFailsafe(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigSetFailsafe(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigSetSlew(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigSetSlew(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigSetAgeing(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigSetAgeing(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigSetTrim(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigSetTrim(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigSetPrimary(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigSetPrimary(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigGetGroups(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigSetGroups(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigSetGroups(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigSetPowerOn(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigSetPowerOn(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigSetStopMode(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigSetStopMode(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigBegin(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigBegin(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigCommit(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigCommit(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigAbort(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigAbort(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigExport(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdConfigImport(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkConfigImport(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSceneGet(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSceneSave(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkSceneSave(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSceneRecall(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdCaptureStart(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdCaptureRead(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdCaptureReadPacked(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSequenceClear(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSequenceAdd(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSequenceStart(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSequenceStop(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdSequenceStatus(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdStrobeStart(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdStrobeStop(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdStrobeStatus(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdDmxStart(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdDmxStatus(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdModbusStart(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdModbusStatus(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdRulesAdd(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdRulesClear(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdRulesStatus(const char* msg_id, const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdMacroSave(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkMacroSave(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdMacroRun(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkMacroRun(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_CmdMacroGet(const char* msg_id, const COMMS_Command_Args_t* args);
+static const COMMS_Command_t* COMMS_Handler_MacroCommand(uint8_t code);
+static VAL_Status COMMS_Handler_CheckMacro(Config_Macro_t* data);
+static VAL_Status COMMS_Handler_ExecuteMacro(uint8_t macro);
+static void COMMS_Handler_CmdDiagSpectrum(const char* msg_id, const COMMS_Command_Args_t* args);
+static VAL_Status COMMS_Handler_WorkDiagSpectrum(const COMMS_Command_Args_t* args);
+static void COMMS_Handler_SendTelemetryResponse(const char* msg_id, const char* action, VAL_Status status,
+                                                uint8_t stream, uint8_t rate, uint8_t fields);
+static VAL_Status COMMS_Handler_SendTelemetrySample(const COMMS_Telemetry_Sample_t* sample,
+                                                   const COMMS_Telemetry_Stream_t* stream);
+
+/* Command table -------------------------------------------------------------*/
+/* New commands only need an entry here; lookup goes through command_index.
+ * Slow commands add their work and complete functions after the handler. */
+static const COMMS_Command_t command_table[] = {
+  /* topic     action             binary code                        args                                    class                handler */
+  { "system", "ping",            COMMS_BIN_SYSTEM_PING,             0,                                      COMMS_CLASS_SAFETY,  COMMS_Handler_CmdSystemPing },
+  { "system", "perf",            COMMS_BIN_SYSTEM_PERF,             COMMAND_ARG_RESET,                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemPerf },
+  { "system", "set_baud",        COMMS_BIN_SYSTEM_SET_BAUD,         COMMAND_ARG_BAUD | COMMAND_ARG_FLOW,    COMMS_CLASS_SAFETY,  COMMS_Handler_CmdSystemSetBaud },
+  { "system", "boot_time",       COMMS_BIN_SYSTEM_BOOT_TIME,        0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemBootTime },
+  { "system", "resources",       COMMS_BIN_SYSTEM_RESOURCES,        0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemResources },
+  { "system", "cpu",             COMMS_BIN_SYSTEM_CPU,              0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemCpu },
+  { "system", "trace",           COMMS_BIN_SYSTEM_TRACE,            COMMAND_ARG_FROM,                       COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemTrace },
+  { "system", "crash_report",    COMMS_BIN_SYSTEM_CRASH_REPORT,     COMMAND_ARG_FROM,                       COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemCrashReport },
+  { "system", "log_level",       COMMS_BIN_SYSTEM_LOG_LEVEL,        COMMAND_ARG_LEVEL,                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdSystemLogLevel },
+  { "system", "link",            COMMS_BIN_SYSTEM_LINK,             COMMAND_ARG_RESET | COMMAND_ARG_CHECKED, COMMS_CLASS_SAFETY,  COMMS_Handler_CmdSystemLink },
+  { "system", "selftest",        COMMS_BIN_SYSTEM_SELFTEST,         0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemSelfTest },
+  { "system", "deadlines",       COMMS_BIN_SYSTEM_DEADLINES,        COMMAND_ARG_RESET,                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemDeadlines },
+  { "system", "queues",          COMMS_BIN_SYSTEM_QUEUES,           COMMAND_ARG_RESET,                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemQueues },
+  { "system", "get_state",       COMMS_BIN_SYSTEM_GET_STATE,        0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemGetState },
+  { "system", "time_sync",       COMMS_BIN_SYSTEM_TIME_SYNC,        COMMAND_ARG_TIME | COMMAND_ARG_RTT,     COMMS_CLASS_CONTROL, COMMS_Handler_CmdSystemTimeSync },
+  { "system", "update",          COMMS_BIN_SYSTEM_UPDATE,           COMMAND_ARG_SIZE | COMMAND_ARG_CRC,     COMMS_CLASS_CONTROL, COMMS_Handler_CmdSystemUpdate },
+  { "system", "capabilities",    COMMS_BIN_SYSTEM_CAPABILITIES,     COMMAND_ARG_FROM,                       COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemCapabilities },
+  { "system", "kernel_trace",    COMMS_BIN_SYSTEM_KERNEL_TRACE,     COMMAND_ARG_RESET | COMMAND_ARG_FROM |
+                                                                    COMMAND_ARG_ENABLE,                     COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemKernelTrace },
+  { "system", "latency",         COMMS_BIN_SYSTEM_LATENCY,          COMMAND_ARG_FROM,                       COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemLatency },
+  { "system", "loop_timing",     COMMS_BIN_SYSTEM_LOOP_TIMING,      COMMAND_ARG_RESET,                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemLoopTiming },
+#ifdef BENCHMARK
+  { "system", "inject_fault",    COMMS_BIN_SYSTEM_INJECT_FAULT,     COMMAND_ARG_ID,                         COMMS_CLASS_CONTROL, COMMS_Handler_CmdSystemInjectFault },
+  { "system", "irq_latency",     COMMS_BIN_SYSTEM_IRQ_LATENCY,      COMMAND_ARG_RESET,                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdSystemIrqLatency },
+#endif
+  { "light",  "get",             COMMS_BIN_LIGHT_GET,               COMMAND_ARG_ID,                         COMMS_CLASS_QUERY,   COMMS_Handler_CmdLightGet },
+  { "light",  "get_all",         COMMS_BIN_LIGHT_GET_ALL,           0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdLightGetAll },
+  { "light",  "set",             COMMS_BIN_LIGHT_SET,               COMMAND_ARG_ID | COMMAND_ARG_INTENSITY |
+                                                                    COMMAND_ARG_GROUP,                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightSet },
+  { "light",  "set_all",         COMMS_BIN_LIGHT_SET_ALL,           COMMAND_ARG_INTENSITIES,                COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightSetAll },
+  { "light",  "get_permille",    COMMS_BIN_LIGHT_GET_PERMILLE,      COMMAND_ARG_ID,                         COMMS_CLASS_QUERY,   COMMS_Handler_CmdLightGetPermille },
+  { "light",  "get_all_permille", COMMS_BIN_LIGHT_GET_ALL_PERMILLE, 0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdLightGetAllPermille },
+  { "light",  "set_permille",    COMMS_BIN_LIGHT_SET_PERMILLE,      COMMAND_ARG_ID | COMMAND_ARG_PERMILLE |
+                                                                    COMMAND_ARG_GROUP,                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightSetPermille },
+  { "light",  "set_all_permille", COMMS_BIN_LIGHT_SET_ALL_PERMILLE, COMMAND_ARG_PERMILLES,                  COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightSetAllPermille },
+  { "light",  "fade",            COMMS_BIN_LIGHT_FADE,              COMMAND_ARG_ID | COMMAND_ARG_PERMILLE |
+                                                                    COMMAND_ARG_DURATION | COMMAND_ARG_CURVE |
+                                                                    COMMAND_ARG_GROUP,                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightFade },
+  { "light",  "set_curve",       COMMS_BIN_LIGHT_SET_CURVE,         COMMAND_ARG_ID | COMMAND_ARG_CURVE,     COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightSetCurve },
+  { "light",  "set_current",     COMMS_BIN_LIGHT_SET_CURRENT,       COMMAND_ARG_ID | COMMAND_ARG_CURRENT,   COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightSetCurrent },
+  { "light",  "stage",           COMMS_BIN_LIGHT_STAGE,             COMMAND_ARG_PERMILLES | COMMAND_ARG_SYNC, COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightStage },
+  { "light",  "commit",          COMMS_BIN_LIGHT_COMMIT,            0,                                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightCommit },
+  { "light",  "set_mask",        COMMS_BIN_LIGHT_SET_MASK,          COMMAND_ARG_MASK | COMMAND_ARG_VALUES,  COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightSetMask },
+  { "light",  "set_pwm_freq",    COMMS_BIN_LIGHT_SET_PWM_FREQ,      COMMAND_ARG_FREQUENCY | COMMAND_ARG_DITHER, COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightSetPwmFreq },
+  { "light",  "set_color",       COMMS_BIN_LIGHT_SET_COLOR,         COMMAND_ARG_PERMILLE | COMMAND_ARG_CCT | COMMAND_ARG_TINT |
+                                                                    COMMAND_ARG_X | COMMAND_ARG_Y,          COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightSetColor },
+  { "light",  "effect",          COMMS_BIN_LIGHT_EFFECT,            COMMAND_ARG_PERMILLES | COMMAND_ARG_PERIOD | COMMAND_ARG_WIDTH |
+                                                                    COMMAND_ARG_EFFECT | COMMAND_ARG_DEPTH |
+                                                                    COMMAND_ARG_GROUP,                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightEffect },
+  { "light",  "strobe",          COMMS_BIN_LIGHT_STROBE,            COMMAND_ARG_PERMILLES | COMMAND_ARG_PERIOD |
+                                                                    COMMAND_ARG_WIDTH,                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdLightStrobe },
+  { "status", "get_sensors",     COMMS_BIN_STATUS_GET_SENSORS,      COMMAND_ARG_ID,                         COMMS_CLASS_QUERY,   COMMS_Handler_CmdStatusGetSensors },
+  { "status", "get_all_sensors", COMMS_BIN_STATUS_GET_ALL_SENSORS,  0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdStatusGetAllSensors },
+  { "status", "get_stats",       COMMS_BIN_STATUS_GET_STATS,        COMMAND_ARG_RESET,                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdStatusGetStats },
+  { "status", "set_stats_window", COMMS_BIN_STATUS_SET_STATS_WINDOW, COMMAND_ARG_SCANS,                     COMMS_CLASS_CONTROL, COMMS_Handler_CmdStatusSetStatsWindow },
+  { "status", "block_scans",     COMMS_BIN_STATUS_BLOCK_SCANS,      COMMAND_ARG_SCANS,                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdStatusBlockScans },
+  { "status", "get_usage",       COMMS_BIN_STATUS_GET_USAGE,        0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdStatusGetUsage },
+  { "status", "get_flicker",     COMMS_BIN_STATUS_GET_FLICKER,      COMMAND_ARG_SCANS,                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdStatusGetFlicker },
+  { "alarm",  "clear",           COMMS_BIN_ALARM_CLEAR,             COMMAND_ARG_ID | COMMAND_ARG_LIGHTS,    COMMS_CLASS_SAFETY,  COMMS_Handler_CmdAlarmClear },
+  { "alarm",  "status",          COMMS_BIN_ALARM_STATUS,            0,                                      COMMS_CLASS_SAFETY,  COMMS_Handler_CmdAlarmStatus },
+  { "alarm",  "history",         COMMS_BIN_ALARM_HISTORY,           COMMAND_ARG_FROM | COMMAND_ARG_LIMIT |
+                                                                    COMMAND_ARG_SINCE | COMMAND_ARG_UNTIL,  COMMS_CLASS_QUERY,   COMMS_Handler_CmdAlarmHistory },
+  { "alarm",  "recording",       COMMS_BIN_ALARM_RECORDING,         COMMAND_ARG_RESET,                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdAlarmRecording },
+  { "alarm",  "blackout",        COMMS_BIN_ALARM_BLACKOUT,          0,                                      COMMS_CLASS_EMERGENCY, COMMS_Handler_CmdAlarmBlackout },
+  { "telemetry", "subscribe",    COMMS_BIN_TELEMETRY_SUBSCRIBE,     COMMAND_ARG_RATE | COMMAND_ARG_FIELDS |
+                                                                    COMMAND_ARG_ON_CHANGE | COMMAND_ARG_STREAM, COMMS_CLASS_CONTROL, COMMS_Handler_CmdTelemetrySubscribe },
+  { "telemetry", "unsubscribe",  COMMS_BIN_TELEMETRY_UNSUBSCRIBE,   COMMAND_ARG_STREAM,                     COMMS_CLASS_SAFETY,  COMMS_Handler_CmdTelemetryUnsubscribe },
+  { "config", "get",             COMMS_BIN_CONFIG_GET,              0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdConfigGet },
+  { "config", "set",             COMMS_BIN_CONFIG_SET,              COMMAND_ARG_ID | COMMAND_ARG_CONFIG,    COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigSet,
+                                 COMMS_Handler_WorkConfigSet, COMMS_Handler_SendSetConfigResponse },
+  { "config", "get_calibration", COMMS_BIN_CONFIG_GET_CALIBRATION,  COMMAND_ARG_ID,                         COMMS_CLASS_QUERY,   COMMS_Handler_CmdConfigGetCalibration },
+  { "config", "set_calibration", COMMS_BIN_CONFIG_SET_CALIBRATION,  COMMAND_ARG_ID | COMMAND_ARG_CALIBRATION |
+                                                                    COMMAND_ARG_POINTS,                     COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigSetCalibration,
+                                 COMMS_Handler_WorkConfigSetCalibration, COMMS_Handler_SendSetCalibrationResponse },
+  { "config", "set_address",     COMMS_BIN_CONFIG_SET_ADDRESS,      COMMAND_ARG_ADDRESS | COMMAND_ARG_BUS,  COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigSetAddress,
+                                 COMMS_Handler_WorkConfigSetAddress, COMMS_Handler_SendSetAddressResponse },
+  { "config", "set_failsafe",    COMMS_BIN_CONFIG_SET_FAILSAFE,     COMMAND_ARG_TIMEOUT | COMMAND_ARG_SCENE, COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigSetFailsafe,
+                                 COMMS_Handler_WorkConfigSetFailsafe, COMMS_Handler_SendSetFailsafeResponse },
+  { "config", "set_slew",        COMMS_BIN_CONFIG_SET_SLEW,         COMMAND_ARG_ID | COMMAND_ARG_SLEW,      COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigSetSlew,
+                                 COMMS_Handler_WorkConfigSetSlew, COMMS_Handler_SendSetSlewResponse },
+  { "config", "set_primary",     COMMS_BIN_CONFIG_SET_PRIMARY,      COMMAND_ARG_ID | COMMAND_ARG_X | COMMAND_ARG_Y |
+                                                                    COMMAND_ARG_FLUX,                       COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigSetPrimary,
+                                 COMMS_Handler_WorkConfigSetPrimary, COMMS_Handler_SendSetPrimaryResponse },
+  { "config", "set_ageing",      COMMS_BIN_CONFIG_SET_AGEING,       COMMAND_ARG_ID | COMMAND_ARG_HOURS |
+                                                                    COMMAND_ARG_AGEING,                     COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigSetAgeing,
+                                 COMMS_Handler_WorkConfigSetAgeing, COMMS_Handler_SendSetAgeingResponse },
+  { "config", "set_trim",        COMMS_BIN_CONFIG_SET_TRIM,         COMMAND_ARG_MASK | COMMAND_ARG_VALUES,  COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigSetTrim,
+                                 COMMS_Handler_WorkConfigSetTrim, COMMS_Handler_SendSetTrimResponse },
+  { "config", "get_groups",      COMMS_BIN_CONFIG_GET_GROUPS,       0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdConfigGetGroups },
+  { "config", "set_groups",      COMMS_BIN_CONFIG_SET_GROUPS,       COMMAND_ARG_MASK | COMMAND_ARG_GROUP |
+                                                                    COMMAND_ARG_BUS_GROUPS,                 COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigSetGroups,
+                                 COMMS_Handler_WorkConfigSetGroups, COMMS_Handler_SendSetGroupsResponse },
+  { "config", "set_power_on",    COMMS_BIN_CONFIG_SET_POWER_ON,     COMMAND_ARG_SCENE | COMMAND_ARG_ENABLE, COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigSetPowerOn,
+                                 COMMS_Handler_WorkConfigSetPowerOn, COMMS_Handler_SendSetPowerOnResponse },
+  { "config", "set_stop_mode",   COMMS_BIN_CONFIG_SET_STOP_MODE,    COMMAND_ARG_ENABLE,                     COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigSetStopMode,
+                                 COMMS_Handler_WorkConfigSetStopMode, COMMS_Handler_SendSetStopModeResponse },
+  { "config", "begin",           COMMS_BIN_CONFIG_BEGIN,            0,                                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigBegin,
+                                 COMMS_Handler_WorkConfigBegin, COMMS_Handler_SendBeginConfigResponse },
+  { "config", "commit",          COMMS_BIN_CONFIG_COMMIT,           0,                                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigCommit,
+                                 COMMS_Handler_WorkConfigCommit, COMMS_Handler_SendCommitConfigResponse },
+  { "config", "abort",           COMMS_BIN_CONFIG_ABORT,            0,                                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigAbort,
+                                 COMMS_Handler_WorkConfigAbort, COMMS_Handler_SendAbortConfigResponse },
+  { "config", "export",          COMMS_BIN_CONFIG_EXPORT,           COMMAND_ARG_FROM,                       COMMS_CLASS_QUERY,   COMMS_Handler_CmdConfigExport },
+  { "config", "import",          COMMS_BIN_CONFIG_IMPORT,           COMMAND_ARG_FROM | COMMAND_ARG_DATA,    COMMS_CLASS_CONTROL, COMMS_Handler_CmdConfigImport,
+                                 COMMS_Handler_WorkConfigImport, COMMS_Handler_SendImportConfigResponse },
+  { "capture", "start",          COMMS_BIN_CAPTURE_START,           COMMAND_ARG_ID | COMMAND_ARG_SCANS |
+                                                                    COMMAND_ARG_TRIGGER | COMMAND_ARG_THRESHOLD, COMMS_CLASS_CONTROL, COMMS_Handler_CmdCaptureStart },
+  { "capture", "read",           COMMS_BIN_CAPTURE_READ,            COMMAND_ARG_FROM,                       COMMS_CLASS_QUERY,   COMMS_Handler_CmdCaptureRead },
+  { "capture", "read_packed",    COMMS_BIN_CAPTURE_READ_PACKED,     COMMAND_ARG_FROM,                       COMMS_CLASS_QUERY,   COMMS_Handler_CmdCaptureReadPacked },
+  { "scene",  "get",             COMMS_BIN_SCENE_GET,               COMMAND_ARG_ID,                         COMMS_CLASS_QUERY,   COMMS_Handler_CmdSceneGet },
+  { "scene",  "save",            COMMS_BIN_SCENE_SAVE,              COMMAND_ARG_ID | COMMAND_ARG_PERMILLES |
+                                                                    COMMAND_ARG_DURATION | COMMAND_ARG_CURVE, COMMS_CLASS_CONTROL, COMMS_Handler_CmdSceneSave,
+                                 COMMS_Handler_WorkSceneSave, COMMS_Handler_SendSaveSceneResponse },
+  { "scene",  "recall",          COMMS_BIN_SCENE_RECALL,            COMMAND_ARG_ID | COMMAND_ARG_GROUP,     COMMS_CLASS_CONTROL, COMMS_Handler_CmdSceneRecall },
+  { "sequence", "clear",         COMMS_BIN_SEQUENCE_CLEAR,          0,                                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdSequenceClear },
+  { "sequence", "add",           COMMS_BIN_SEQUENCE_ADD,            COMMAND_ARG_PERMILLES | COMMAND_ARG_DURATION |
+                                                                    COMMAND_ARG_CURVE | COMMAND_ARG_OFFSET, COMMS_CLASS_CONTROL, COMMS_Handler_CmdSequenceAdd },
+  { "sequence", "start",         COMMS_BIN_SEQUENCE_START,          COMMAND_ARG_PERIOD,                     COMMS_CLASS_CONTROL, COMMS_Handler_CmdSequenceStart },
+  { "sequence", "stop",          COMMS_BIN_SEQUENCE_STOP,           0,                                      COMMS_CLASS_SAFETY,  COMMS_Handler_CmdSequenceStop },
+  { "sequence", "status",        COMMS_BIN_SEQUENCE_STATUS,         0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdSequenceStatus },
+  { "strobe", "start",           COMMS_BIN_STROBE_START,            COMMAND_ARG_PERMILLES | COMMAND_ARG_TRIGGER |
+                                                                    COMMAND_ARG_WIDTH,                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdStrobeStart },
+  { "strobe", "stop",            COMMS_BIN_STROBE_STOP,             0,                                      COMMS_CLASS_SAFETY,  COMMS_Handler_CmdStrobeStop },
+  { "strobe", "status",          COMMS_BIN_STROBE_STATUS,           0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdStrobeStatus },
+  { "dmx",    "start",           COMMS_BIN_DMX_START,               COMMAND_ARG_CHANNEL,                    COMMS_CLASS_CONTROL, COMMS_Handler_CmdDmxStart },
+  { "dmx",    "status",          COMMS_BIN_DMX_STATUS,              0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdDmxStatus },
+  { "modbus", "start",           COMMS_BIN_MODBUS_START,            COMMAND_ARG_ADDRESS | COMMAND_ARG_BAUD |
+                                                                    COMMAND_ARG_TIMEOUT,                    COMMS_CLASS_CONTROL, COMMS_Handler_CmdModbusStart },
+  { "modbus", "status",          COMMS_BIN_MODBUS_STATUS,           0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdModbusStatus },
+  { "rules",  "add",             COMMS_BIN_RULES_ADD,               COMMAND_ARG_ID | COMMAND_ARG_PERMILLE | COMMAND_ARG_DURATION |
+                                                                    COMMAND_ARG_CURVE | COMMAND_ARG_TRIGGER | COMMAND_ARG_THRESHOLD |
+                                                                    COMMAND_ARG_MASK | COMMAND_ARG_SCENE | COMMAND_ARG_INPUT |
+                                                                    COMMAND_ARG_THEN | COMMAND_ARG_HYSTERESIS, COMMS_CLASS_CONTROL, COMMS_Handler_CmdRulesAdd },
+  { "rules",  "clear",           COMMS_BIN_RULES_CLEAR,             0,                                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdRulesClear },
+  { "rules",  "status",          COMMS_BIN_RULES_STATUS,            0,                                      COMMS_CLASS_QUERY,   COMMS_Handler_CmdRulesStatus },
+  { "macro",  "save",            COMMS_BIN_MACRO_SAVE,              COMMAND_ARG_ID | COMMAND_ARG_FROM | COMMAND_ARG_DATA, COMMS_CLASS_CONTROL, COMMS_Handler_CmdMacroSave,
+                                 COMMS_Handler_WorkMacroSave, COMMS_Handler_SendSaveMacroResponse },
+  { "macro",  "run",             COMMS_BIN_MACRO_RUN,               COMMAND_ARG_ID,                         COMMS_CLASS_CONTROL, COMMS_Handler_CmdMacroRun,
+                                 COMMS_Handler_WorkMacroRun, COMMS_Handler_SendRunMacroResponse },
+  { "macro",  "get",             COMMS_BIN_MACRO_GET,               COMMAND_ARG_ID,                         COMMS_CLASS_QUERY,   COMMS_Handler_CmdMacroGet },
+  { "diag",   "spectrum",        COMMS_BIN_DIAG_SPECTRUM,           COMMAND_ARG_ID | COMMAND_ARG_LIMIT,     COMMS_CLASS_QUERY,   COMMS_Handler_CmdDiagSpectrum,
+                                 COMMS_Handler_WorkDiagSpectrum, COMMS_Handler_SendSpectrumResponse },
+#ifdef COMMS_LINK_BENCH
+  { "bench",  "echo",            COMMS_BIN_BENCH_ECHO,              COMMAND_ARG_SIZE,                       COMMS_CLASS_CONTROL, COMMS_Handler_CmdBenchEcho },
+  { "bench",  "sink",            COMMS_BIN_BENCH_SINK,              COMMAND_ARG_SIZE,                       COMMS_CLASS_CONTROL, COMMS_Handler_CmdBenchSink },
+  { "bench",  "source",          COMMS_BIN_BENCH_SOURCE,            COMMAND_ARG_SIZE,                       COMMS_CLASS_CONTROL, COMMS_Handler_CmdBenchSource },
+#endif
+#ifdef BENCHMARK
+  { "bench",  "synthetic",       COMMS_BIN_BENCH_SYNTHETIC,         COMMAND_ARG_ID | COMMAND_ARG_CURRENT | COMMAND_ARG_OFFSET |
+                                                                    COMMAND_ARG_PERIOD | COMMAND_ARG_WIDTH | COMMAND_ARG_SHAPE |
+                                                                    COMMAND_ARG_NOISE,                      COMMS_CLASS_CONTROL, COMMS_Handler_CmdBenchSynthetic },
+  { "bench",  "crc",             COMMS_BIN_BENCH_CRC,               COMMAND_ARG_SIZE,                       COMMS_CLASS_QUERY,   COMMS_Handler_CmdBenchCrc },
+  { "bench",  "copy",            COMMS_BIN_BENCH_COPY,              COMMAND_ARG_SIZE,                       COMMS_CLASS_QUERY,   COMMS_Handler_CmdBenchCopy },
+#endif
+};
+
+#define COMMAND_TABLE_SIZE         (sizeof(command_table) / sizeof(command_table[0]))
+
+/* Key and type of each COMMAND_ARG_* field, in bit order */
+static const COMMS_Arg_Info_t command_arg_info[COMMAND_ARG_COUNT] = {
+  { "id", "int" },          { "intensity", "int" },   { "intensities", "ints" }, { "lights", "ints" },
+  { "reset", "bool" },      { "rate", "int" },        { "fields", "names" },     { "baud", "int" },
+  { "permille", "int" },    { "permilles", "ints" },  { "duration", "int" },     { "curve", "name" },
+  { "config", "keys" },     { "from", "int" },        { "level", "name" },       { "scans", "int" },
+  { "trigger", "name" },    { "threshold", "int" },   { "calibration", "keys" }, { "points", "ints" },
+  { "current", "int" },     { "offset", "int" },      { "period", "int" },       { "width", "int" },
+  { "address", "int" },     { "bus", "bool" },        { "sync", "bool" },        { "checked", "bool" },
+  { "channel", "int" },     { "mask", "int" },        { "values", "ints" },      { "on_change", "keys" },
+  { "frequency", "int" },   { "dither", "bool" },     { "timeout", "int" },      { "scene", "int" },
+  { "limit", "int" },       { "since", "int" },       { "until", "int" },        { "time", "int" },
+  { "rtt", "int" },         { "size", "int" },        { "crc", "int" },          { "shape", "name" },
+  { "noise", "int" },       { "slew", "int" },        { "cct", "int" },          { "tint", "int" },
+  { "x", "int" },           { "y", "int" },           { "flux", "int" },         { "effect", "name" },
+  { "depth", "int" },       { "group", "int" },       { "bus_groups", "int" },   { "input", "name" },
+  { "then", "name" },       { "hysteresis", "int" },   { "enable", "bool" },      { "data", "bytes" },
+  { "flow", "bool" },       { "stream", "int" },      { "hours", "int" },        { "ageing", "ints" },
+};
+
+_Static_assert(COMMAND_ARG_AGEING == (1ULL << (COMMAND_ARG_COUNT - 1)), "command_arg_info out of step with COMMAND_ARG_*");
+_Static_assert(COMMS_EFFECT_FLICKER == EFFECT_SHAPE_FLICKER && COMMS_EFFECT_COUNT == EFFECT_SHAPE_COUNT,
+               "COMMS_EFFECT_* out of step with Effect_Shape_t");
+_Static_assert(COMMS_RULE_INPUT_ALARM == RULES_INPUT_ALARM && COMMS_RULE_INPUT_COUNT == RULES_INPUT_COUNT &&
+               COMMS_RULE_EVENT == RULES_ACTION_EVENT && COMMS_RULE_MACRO == RULES_ACTION_MACRO &&
+               COMMS_RULE_ACTION_COUNT == RULES_ACTION_COUNT &&
+               COMMS_RULES_MAX == RULES_MAX, "COMMS_RULE_* out of step with app_rules.h");
+_Static_assert(COMMS_MACROS_MAX == CONFIG_MACRO_COUNT && COMMS_MACRO_BYTES_MAX == CONFIG_MACRO_BYTES,
+               "COMMS_MACRO_* out of step with app_config.h");
+_Static_assert((1U << VAL_LIGHT_COUNT) <= LIGHTS_INVALID, "The lights mask and its invalid flag share a byte");
+_Static_assert(COMMS_FLICKER_SETTLING == LED_DRIVER_FLICKER_SETTLING && COMMS_FLICKER_MEASURING == LED_DRIVER_FLICKER_MEASURING &&
+               COMMS_FLICKER_DONE == LED_DRIVER_FLICKER_DONE, "COMMS_FLICKER_* out of step with LED_Driver_FlickerState_t");
+_Static_assert(COMMS_RECORDER_ARMED == RECORDER_ARMED && COMMS_RECORDER_DONE == RECORDER_DONE &&
+               COMMS_RECORDING_CHANNELS == ANALOG_CHANNEL_COUNT, "COMMS_RECORDER_* out of step with app_recorder.h");
+_Static_assert(sizeof(Color_Primary_t) == sizeof(COMMS_Bin_Primary_t), "config/get body out of step with Color_Primary_t");
+_Static_assert(CONFIG_ADDRESS_MAX < COMMS_ADDRESS_GROUP_FIRST && CONFIG_BUS_GROUPS == COMMS_ADDRESS_GROUPS,
+               "Device addresses overlap the bus groups");
+_Static_assert(COMMS_INTEGRITY_CHECKS == INTEGRITY_CHECK_COUNT &&
+               sizeof(COMMS_Bin_Integrity_t) == sizeof(Integrity_Result_t),
+               "system/resources body out of step with Integrity_Result_t");
+_Static_assert(COMMS_STORE_PAGES == VAL_DATA_STORE_PAGES, "system/resources body out of step with val_data_store.h");
+_Static_assert(COMMAND_TABLE_SIZE < COMMAND_SLOT_EMPTY, "Command table too large for an uint8_t index");
+_Static_assert(COMMAND_TABLE_SIZE <= LATENCY_COMMAND_SLOTS, "Raise LATENCY_COMMAND_SLOTS for the command table");
+_Static_assert(sizeof(((COMMS_Bin_LoopTiming_t*)0)->early) == JITTER_BUCKET_COUNT * sizeof(uint32_t),
+               "system/loop_timing body out of step with JITTER_BUCKET_COUNT");
+_Static_assert(LWJSON_CFG_STREAM_STRING_MAX_LEN >= MSG_ID_MAX_LEN &&
+               LWJSON_CFG_STREAM_STRING_MAX_LEN >= COMMAND_FIELD_MAX_LEN + 1,
+               "lwjson_opts.h string buffer too small for the command fields");
+
+/* Position in command_table for each hash slot, built once at init */
+static uint8_t command_index[COMMAND_INDEX_SLOTS];
+
+/* Position in command_table for each binary command code */
+static uint8_t bin_command_index[256];
+
+/* "curve" argument names, indexed by COMMS_CURVE_* value */
+static const char* const curve_names[COMMS_CURVE_COUNT] = {
+  "linear",
+  "ease",
+  "perceptual",
+  "gamma"
+};
+
+/* "trigger" argument names, indexed by COMMS_CAPTURE_* value */
+static const char* const capture_trigger_names[COMMS_CAPTURE_TRIGGER_COUNT] = {
+  "now",
+  "intensity",
+  "rising",
+  "falling"
+};
+
+/* "shape" argument names, indexed by COMMS_SYNTH_* value */
+static const char* const synth_shape_names[COMMS_SYNTH_SHAPE_COUNT] = {
+  "off",
+  "step",
+  "ramp",
+  "spike",
+  "noise"
+};
+
+/* "effect" argument names, indexed by COMMS_EFFECT_* value */
+static const char* const effect_names[COMMS_EFFECT_COUNT] = {
+  "off",
+  "sine",
+  "triangle",
+  "square",
+  "flicker"
+};
+
+/* "input" argument names, indexed by COMMS_RULE_INPUT_* value */
+static const char* const rule_input_names[COMMS_RULE_INPUT_COUNT] = {
+  "current",
+  "temperature",
+  "alarm"
+};
+
+/* "then" argument names, indexed by COMMS_RULE_* value */
+static const char* const rule_action_names[COMMS_RULE_ACTION_COUNT] = {
+  "set",
+  "fade",
+  "scene",
+  "event",
+  "macro"
+};
+
+/* capture/read state names, indexed by AnalogCaptureState */
+static const char* const capture_state_names[] = {
+  "idle",
+  "armed",
+  "running",
+  "done"
+};
+
+/* config/set key names, indexed by COMMS_CONFIG_* bit */
+static const char* const config_key_names[COMMS_CONFIG_KEY_COUNT] = {
+  "current_warn",
+  "current_max",
+  "current_trip",
+  "temperature_warn",
+  "temperature_max",
+  "current_scale",
+  "temperature_scale",
+  "sample_phase"
+};
+
+/* config/set_calibration key names, indexed by COMMS_CALIBRATION_* bit */
+static const char* const calibration_key_names[COMMS_CALIBRATION_KEY_COUNT] = {
+  "current_gain",
+  "current_offset",
+  "temperature_gain",
+  "temperature_offset"
+};
+
+/* telemetry/subscribe report-on-change key names, indexed by COMMS_ON_CHANGE_* bit */
+static const char* const on_change_key_names[COMMS_ON_CHANGE_KEY_COUNT] = {
+  "deadband_current",
+  "deadband_temperature",
+  "heartbeat"
+};
+
+/* system/selftest commands; read-only, so a run changes nothing */
+static const char* const selftest_corpus[SELFTEST_CORPUS_SIZE] = {
+  "{\"type\":\"cmd\",\"id\":1,\"topic\":\"system\",\"action\":\"ping\"}\n",
+  "{\"type\":\"cmd\",\"id\":\"selftest\",\"topic\":\"light\",\"action\":\"get_all_permille\"}\n",
+  "{\"type\":\"cmd\",\"id\":3,\"topic\":\"status\",\"action\":\"get_all_sensors\"}\n",
+  "{\"type\":\"cmd\",\"id\":4,\"topic\":\"alarm\",\"action\":\"status\"}\n",
+  "{\"type\":\"cmd\",\"id\":5,\"topic\":\"config\",\"action\":\"get\"}\n",
+  "{\"type\":\"cmd\",\"id\":6,\"topic\":\"light\",\"action\":\"get\",\"data\":{\"id\":1}}\n",
+  "{\"type\":\"cmd\",\"id\":7,\"topic\":\"sequence\",\"action\":\"status\"}\n",
+  "{\"type\":\"cmd\",\"id\":8,\"topic\":\"strobe\",\"action\":\"status\"}\n"
+};
+
+/* system/selftest phase names, indexed by SELFTEST_PHASE_* */
+static const char* const selftest_phase_names[SELFTEST_PHASES] = {
+  "parse",
+  "dispatch",
+  "format",
+  "total"
+};
 
 /* Public functions ----------------------------------------------------------*/
 
@@ -64,26 +1492,110 @@ static void COMMS_Handler_SendErrorResponse(const char* msg_id, const char* topi
   * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
   */
 VAL_Status COMMS_Handler_Handler_Init(void) {
-  /* Initialize JSON parser */
-  lwjson_init(&jsonParser, jsonTokens, LWJSON_ARRAYSIZE(jsonTokens));
+  /* Initialize streaming JSON decoder */
+  COMMS_Handler_InitSession(&host_session);
+
+  /* Index the command table for constant-time dispatch */
+  if (COMMS_Handler_BuildCommandIndex() != VAL_OK) {
+    return VAL_ERROR;
+  }
+
+  /* Slow commands wait in the pipeline; responses share txBuffer with the worker */
+  pipeline_queue = xQueueCreateStatic(COMMS_PIPELINE_DEPTH, sizeof(COMMS_Pending_t),
+                                      pipeline_storage, &pipeline_control);
+  response_lock = xSemaphoreCreateMutexStatic(&response_lock_control);
+  if (pipeline_queue == NULL || response_lock == NULL) {
+    return VAL_ERROR;
+  }
+  (void)Queues_Register(pipeline_queue, "pipeline", QUEUES_KIND_QUEUE, COMMS_PIPELINE_DEPTH);
+  (void)Queues_Register(response_lock, "response", QUEUES_KIND_MUTEX, 1);
+
+  /* Create the RX stream before reception can start */
+  rx_stream = xStreamBufferCreateStatic(RX_STREAM_SIZE, 1, rx_stream_storage, &rx_stream_control);
+  if (rx_stream == NULL) {
+    return VAL_ERROR;
+  }
+  (void)Queues_Register(rx_stream, "rx", QUEUES_KIND_STREAM, RX_STREAM_SIZE);
 
-  /* Initialize serial with callback */
-  VAL_Status status = VAL_Serial_Init(COMMS_Handler_SerialRxCallback);
+  /* Start the host link; received blocks go to the RX stream */
+  VAL_Status status = Transport_Init(TRANSPORT_DEFAULT, COMMS_Handler_SerialRxCallback);
   if (status != VAL_OK) {
     return status;
   }
 
+  /* Queued events are sent as TX queue space frees up */
+  TxPool_Init();
+
   /* Create communications handler task */
-  osThreadDef(COMSHandlerTask, COMMS_Handler_Task, COMMS_HANDLER_PRIORITY, 0, COMMS_HANDLER_STACK_SIZE);
+  osThreadStaticDef(COMSHandlerTask, COMMS_Handler_Task, COMMS_HANDLER_PRIORITY, 0, COMMS_HANDLER_STACK_SIZE,
+                    comms_handler_stack, &comms_handler_tcb);
   comms_handler_task_handle = osThreadCreate(osThread(COMSHandlerTask), NULL);
 
   if (comms_handler_task_handle == NULL) {
     return VAL_ERROR;
   }
 
+  /* Create the worker task for slow commands */
+  osThreadStaticDef(COMSWorkerTask, COMMS_Handler_WorkerTask, COMMS_WORKER_PRIORITY, 0, COMMS_WORKER_STACK_SIZE,
+                    comms_worker_stack, &comms_worker_tcb);
+  comms_worker_task_handle = osThreadCreate(osThread(COMSWorkerTask), NULL);
+
+  if (comms_worker_task_handle == NULL) {
+    return VAL_ERROR;
+  }
+
   return VAL_OK;
 }
 
+/**
+  * @brief  Set the device address and the kind of link
+  * @note   Called with the stored settings at start-up and after
+  *         config/set_address. Must not be called from interrupt context.
+  * @param  address: Device address (0-CONFIG_ADDRESS_MAX)
+  * @param  bus: true on an RS-485 bus, false point-to-point
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM for a group or the
+  *         broadcast address, else as VAL_Serial_SetRS485
+  */
+VAL_Status COMMS_Handler_SetAddress(uint8_t address, bool bus) {
+  VAL_Status status = VAL_OK;
+
+  if (address >= COMMS_ADDRESS_GROUP_FIRST) {
+    return VAL_PARAM;
+  }
+
+  device_address = address;
+  if (bus != bus_mode) {
+    status = VAL_Serial_SetRS485(bus ? 1U : 0U);
+  }
+  bus_mode = bus;
+
+  return status;
+}
+
+/**
+  * @brief  Set how long the link may stay silent and what the lights do then
+  * @note   Called with the stored settings at start-up and after
+  *         config/set_failsafe; takes effect from the next wait for data
+  * @param  timeout_ms: Time without a valid frame, 0 turns the failsafe off
+  * @param  scene: Scene to recall (1-CONFIG_SCENE_COUNT), 0 for all lights off
+  * @retval None
+  */
+void COMMS_Handler_SetFailsafe(uint16_t timeout_ms, uint8_t scene) {
+  failsafe_scene = scene;
+  failsafe_ms = timeout_ms;
+}
+
+/**
+  * @brief  Set the multicast groups the device answers to besides its address
+  * @note   Called with the stored settings at start-up and after
+  *         config/set_groups; takes effect from the next command
+  * @param  groups: Groups joined, bit 0 for COMMS_ADDRESS_GROUP_FIRST
+  * @retval None
+  */
+void COMMS_Handler_SetBusGroups(uint16_t groups) {
+  bus_groups = groups & ((1U << COMMS_ADDRESS_GROUPS) - 1U);
+}
+
 /* Private functions ---------------------------------------------------------*/
 
 /**
@@ -92,13 +1604,252 @@ VAL_Status COMMS_Handler_Handler_Init(void) {
   * @retval None
   */
 static void COMMS_Handler_Task(void const *argument) {
-  /* Initialize */
+  char chunk[RX_CHUNK_SIZE];
+  size_t length;
+  TickType_t wait;
 
   /* Task main loop */
   for (;;) {
-    /* Wait for events, task is primarily driven by the Serial RX callback */
-    osDelay(100);
+    /* Block until the RX interrupt delivers any bytes, a baud rate switch
+     * the host did not follow times out or the link falls silent */
+    wait = COMMS_Handler_LinkTimeout();
+#ifdef COMMS_LINK_BENCH
+    wait = COMMS_Handler_BenchWait(wait);
+#endif
+#ifdef BENCHMARK
+    Profiler_WakeupArm(PROFILER_WAKEUP_RX);
+#endif
+    length = xStreamBufferReceive(rx_stream, chunk, sizeof(chunk), wait);
+#ifdef BENCHMARK
+    Profiler_WakeupDone(PROFILER_WAKEUP_RX);
+#endif
+    Supervisor_Begin(SUPERVISOR_TASK_COMMS);
+
+    /* Backlog the task is about to work through */
+    size_t waiting = length + xStreamBufferBytesAvailable(rx_stream);
+    if (waiting > link_stats.rx_peak) {
+      link_stats.rx_peak = (uint16_t)waiting;
+    }
+
+    /* Bytes were lost, the command being decoded cannot be trusted */
+    if (rx_overflow) {
+      rx_overflow = 0;
+      link_stats.overflow++;
+      COMMS_Handler_ResetDecoder(&host_session, true);
+    }
+
+    /* Decode the received bytes as they arrive; the responses go out
+     * through txBuffer, which the worker task also uses */
+    xSemaphoreTake(response_lock, portMAX_DELAY);
+    for (size_t i = 0; i < length; i++) {
+#ifdef COMMS_LINK_BENCH
+      if (bench.mode == BENCH_MODE_ECHO || bench.mode == BENCH_MODE_SINK) {
+        i += COMMS_Handler_BenchReceive(&chunk[i], length - i) - 1;
+        continue;
+      }
+#endif
+      COMMS_Handler_DecodeByte(&host_session, chunk[i]);
+      if (selftest_pending) {
+        COMMS_Handler_RunSelfTest(&host_session);
+      }
+    }
+
+    /* A frame cut in the interrupt that did not run, a duplicate or one
+     * lost to an overrun, holds the control commands until all is read */
+    if (fast_pending != 0) {
+      taskENTER_CRITICAL();
+      if (xStreamBufferIsEmpty(rx_stream) == pdTRUE) {
+        fast_pending = 0;
+      }
+      taskEXIT_CRITICAL();
+    }
+#ifdef COMMS_LINK_BENCH
+    COMMS_Handler_BenchPoll();
+#endif
+    xSemaphoreGive(response_lock);
+    Supervisor_End(SUPERVISOR_TASK_COMMS);
+  }
+}
+
+/**
+  * @brief  Worker task, runs slow commands and responds to them
+  * @param  argument: Task argument
+  * @retval None
+  */
+static void COMMS_Handler_WorkerTask(void const *argument) {
+  VAL_Status status;
+
+  for (;;) {
+    /* The command stays queued until answered, so it counts towards
+     * COMMS_PIPELINE_DEPTH while it runs */
+    xQueuePeek(pipeline_queue, &worker_command, portMAX_DELAY);
+    Supervisor_Begin(SUPERVISOR_TASK_WORKER);
+
+    status = worker_command.command->work(&worker_command.args);
+
+    xSemaphoreTake(response_lock, portMAX_DELAY);
+    reply = worker_command.reply;
+    reply.status = VAL_OK;
+    worker_command.command->complete(worker_command.id, status);
+
+    /* Time from acceptance to the response */
+    Trace_Record(TRACE_TYPE_COMMAND, worker_command.command->bin_code, (uint8_t)reply.status,
+                 reply.binary ? 1U : 0U, Profiler_Start() - worker_command.start);
+    Latency_RecordCommand((uint8_t)(worker_command.command - command_table),
+                          Profiler_Start() - worker_command.received);
+    xSemaphoreGive(response_lock);
+
+    xQueueReceive(pipeline_queue, &worker_command, 0);
+    Supervisor_End(SUPERVISOR_TASK_WORKER);
+  }
+}
+
+/**
+  * @brief  Get how long to wait for data before a baud rate switch or the
+  *         failsafe times out
+  * @note   Restores the previous baud rate once the confirmation time is
+  *         over, and enters the failsafe once the link has been silent for
+  *         its timeout
+  * @retval TickType_t: Ticks to wait, portMAX_DELAY when neither is pending
+  */
+static TickType_t COMMS_Handler_LinkTimeout(void) {
+  TickType_t now = xTaskGetTickCount();
+  TickType_t wait = portMAX_DELAY;
+
+  if (link_fallback_baud != 0) {
+    TickType_t timeout = pdMS_TO_TICKS(COMMS_BAUD_CONFIRM_TIMEOUT_MS);
+    TickType_t elapsed = now - link_switch_tick;
+
+    if (elapsed < timeout) {
+      wait = timeout - elapsed;
+    } else {
+      /* Nothing valid arrived at the new rate, go back to the one that
+       * worked; flow control first, in case CTS is what holds the link */
+      VAL_Serial_SetFlowControl(link_fallback_flow);
+      VAL_Serial_SetBaudRate(link_fallback_baud);
+      link_fallback_baud = 0;
+      COMMS_Handler_ResetDecoder(&host_session, false);
+    }
+  }
+
+  if (failsafe_ms != 0 && link_seen && !failsafe_active) {
+    TickType_t timeout = pdMS_TO_TICKS(failsafe_ms);
+    TickType_t elapsed = now - link_frame_tick;
+
+    if (elapsed < timeout) {
+      if (timeout - elapsed < wait) {
+        wait = timeout - elapsed;
+      }
+    } else if (!COMMS_Handler_EnterFailsafe(now)) {
+      /* Not entered, look again after another timeout */
+      if (timeout < wait) {
+        wait = timeout;
+      }
+    }
+  }
+
+  return wait;
+}
+
+/**
+  * @brief  Enter the failsafe, the link has been silent for its timeout
+  * @note   A DMX512 desk or Modbus master that has taken over the link
+  *         keeps the lights; the failsafe is then looked at again one timeout later
+  * @param  now: Present tick
+  * @retval bool: true if entered
+  */
+static bool COMMS_Handler_EnterFailsafe(TickType_t now) {
+  uint8_t scene = failsafe_scene;
+
+  if (SYS_Coordinator_EnterFailsafe(scene) == VAL_BUSY) {
+    link_frame_tick = now;
+    return false;
+  }
+
+  failsafe_active = true;
+  Counters_Increment(COUNTERS_LINK_DROPS);
+  LOGGER_LOG(LOGGER_LEVEL_WARNING, LOGGER_MSG_LINK_FAILSAFE, failsafe_ms, scene);
+
+  return true;
+}
+
+/**
+  * @brief  Note a valid frame: confirm a pending baud rate switch and
+  *         restart the failsafe timeout
+  * @note   Called for every valid command; the host has followed the switch.
+  *         Only stores the tick, unless the failsafe was entered: then the
+  *         host is told that the link is back.
+  * @retval None
+  */
+static void COMMS_Handler_ConfirmLink(void) {
+  TickType_t now = xTaskGetTickCount();
+
+  link_fallback_baud = 0;
+  if (failsafe_active) {
+    failsafe_active = false;
+    COMMS_Handler_SendFailsafeEvent((now - link_frame_tick) * portTICK_PERIOD_MS);
+  }
+  link_frame_tick = now;
+  link_seen = true;
+}
+
+/**
+  * @brief  Send a failsafe event, the link is back after the failsafe was entered
+  * @note   Called from the communications task with the frame that ended
+  *         the silence, before its response
+  * @param  silence_ms: Time since the last valid frame before it
+  * @retval VAL_Status: VAL_OK if successful, VAL_BUSY if no TX slot was free,
+  *         VAL_ERROR otherwise
+  */
+static VAL_Status COMMS_Handler_SendFailsafeEvent(uint32_t silence_ms) {
+  uint32_t probe_start = Profiler_Start();
+  uint64_t now_us = VAL_SysClock_GetMicros64();
+  uint32_t timestamp = (uint32_t)(now_us / 1000U);
+  JSON_Writer_t writer;
+
+  /* Devices on a bus only talk when asked */
+  if (bus_mode) {
+    return VAL_OK;
+  }
+
+  TxPool_Handle_t slot = TxPool_Acquire(TX_PRIORITY_ALARM);
+  char* buffer = TxPool_GetBuffer(slot);
+
+  if (buffer == NULL) {
+    return VAL_BUSY;
+  }
+
+  if (host_binary) {
+    COMMS_Bin_Failsafe_t event;
+
+    event.timestamp = timestamp;
+    event.silence_ms = silence_ms;
+    event.scene = failsafe_scene;
+
+    size_t length = COMMS_Binary_EncodeFrame(COMMS_BIN_TYPE_EVENT, 0, COMMS_BIN_ALARM_FAILSAFE,
+                                             &event, sizeof(event),
+                                             (uint8_t*)buffer, TX_POOL_SLOT_SIZE);
+    return COMMS_Handler_TransmitEvent(slot, length, probe_start);
+  }
+
+  JSON_Writer_Init(&writer, buffer, TX_POOL_SLOT_SIZE);
+  JSON_Writer_Literal(&writer, "{\"type\":\"event\",\"id\":\"evt-");
+  JSON_Writer_Uint(&writer, (uint32_t)now_us);
+  JSON_Writer_Literal(&writer, "\",\"topic\":\"alarm\",\"action\":\"failsafe\",\"data\":{\"timestamp\":\"");
+  JSON_Writer_Uint(&writer, timestamp);
+  JSON_Writer_Literal(&writer, "\",\"state\":\"recovered\",\"silence\":");
+  JSON_Writer_Uint(&writer, silence_ms);
+  JSON_Writer_Literal(&writer, ",\"scene\":");
+  JSON_Writer_Uint(&writer, failsafe_scene);
+  COMMS_Handler_WriteTime(&writer, 0);
+  JSON_Writer_Literal(&writer, RESP_END);
+
+  if (writer.overflow) {
+    TxPool_Release(slot);
+    return VAL_ERROR;
   }
+
+  return COMMS_Handler_TransmitEvent(slot, writer.length, probe_start);
 }
 
 /**
@@ -107,22 +1858,12 @@ static void COMMS_Handler_Task(void const *argument) {
   * @retval None
   */
 static void COMMS_Handler_SendPingResponse(const char* msg_id) {
-  /* Format ping response */
-  uint16_t length = snprintf(txBuffer, TX_BUFFER_SIZE,
-    "{"
-      "\"type\":\"resp\","
-      "\"id\":\"%s\","
-      "\"topic\":\"system\","
-      "\"action\":\"ping\","
-      "\"data\":{"
-        "\"status\":\"ok\","
-        "\"message\":\"pong\""
-      "}"
-    "}\r\n",
-    msg_id);
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(VAL_OK, NULL, 0);
+    return;
+  }
 
-  /* Send response */
-  VAL_Serial_Send((uint8_t*)txBuffer, length, 1000);
+  COMMS_Handler_SendFixedResponse(msg_id, "system", "ping", RESP_STATUS_OK ",\"message\":\"pong\"");
 }
 
 /**
@@ -132,67 +1873,63 @@ static void COMMS_Handler_SendPingResponse(const char* msg_id) {
  * @retval None
  */
 static void COMMS_Handler_SendLightIntensityResponse(const char* msg_id, uint8_t light_id) {
-  uint8_t intensities[3] = {0, 0, 0};
+  JSON_Writer_t writer;
+  uint8_t intensities[VAL_LIGHT_COUNT] = {0};
   VAL_Status status = VAL_ERROR;
 
   if (light_id == 0) {
     /* Get all light intensities */
     status = SYS_Coordinator_GetAllLightIntensities(intensities);
-  } else if (light_id >= 1 && light_id <= 3) {
+  } else if (light_id >= 1 && light_id <= VAL_LIGHT_COUNT) {
     /* Get single light intensity */
     status = SYS_Coordinator_GetLightIntensity(light_id, &intensities[light_id - 1]);
   }
 
-  /* Format response */
-  uint16_t length;
-  if (status == VAL_OK) {
+  if (reply.binary) {
     if (light_id == 0) {
-      length = snprintf(txBuffer, TX_BUFFER_SIZE,
-        "{"
-          "\"type\":\"resp\","
-          "\"id\":\"%s\","
-          "\"topic\":\"light\","
-          "\"action\":\"get_all\","
-          "\"data\":{"
-            "\"status\":\"ok\","
-            "\"intensities\":[%u, %u, %u]"
-          "}"
-        "}\r\n",
-        msg_id, intensities[0], intensities[1], intensities[2]);
+      COMMS_Handler_SendBinaryResponse(status, intensities, sizeof(intensities));
     } else {
-      length = snprintf(txBuffer, TX_BUFFER_SIZE,
-        "{"
-          "\"type\":\"resp\","
-          "\"id\":\"%s\","
-          "\"topic\":\"light\","
-          "\"action\":\"get\","
-          "\"data\":{"
-            "\"status\":\"ok\","
-            "\"id\":%u,"
-            "\"intensity\":%u"
-          "}"
-        "}\r\n",
-        msg_id, light_id, intensities[light_id - 1]);
+      COMMS_Bin_Intensity_t body = { light_id, (status == VAL_OK) ? intensities[light_id - 1] : 0 };
+      COMMS_Handler_SendBinaryResponse(status, &body, sizeof(body));
     }
-  } else {
-    /* Error response */
-    length = snprintf(txBuffer, TX_BUFFER_SIZE,
-      "{"
-        "\"type\":\"resp\","
-        "\"id\":\"%s\","
-        "\"topic\":\"light\","
-        "\"action\":\"%s\","
-        "\"data\":{"
-          "\"status\":\"error\","
-          "\"message\":\"Failed to retrieve light intensity\""
-        "}"
-      "}\r\n",
-      msg_id,
-      (light_id == 0) ? "get_all" : "get");
+    return;
+  }
+
+  /* Format response */
+  uint32_t probe_start = Profiler_Start();
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "light", (light_id == 0) ? "get_all" : "get",
+                                    "Failed to retrieve light intensity");
+    return;
   }
 
+  if (light_id == 0) {
+    COMMS_Gather_t gather;
+
+    COMMS_Handler_BeginGather(&gather, msg_id, "light", "get_all", RESP_STATUS_OK ",\"intensities\":[");
+    if (!COMMS_Handler_FragmentCurrent(&intensities_fragment, intensities, sizeof(intensities), &writer)) {
+      for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+        if (i > 0) {
+          JSON_Writer_Literal(&writer, ", ");
+        }
+        JSON_Writer_Uint(&writer, intensities[i]);
+      }
+      JSON_Writer_Char(&writer, ']');
+      COMMS_Handler_EndFragment(&intensities_fragment, &writer);
+    }
+    COMMS_Handler_GatherFragment(&gather, &intensities_fragment);
+    COMMS_Handler_EndGather(&gather, probe_start);
+    return;
+  }
+
+  COMMS_Handler_BeginResponse(&writer, msg_id, "light", "get");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"id\":");
+  JSON_Writer_Uint(&writer, light_id);
+  JSON_Writer_Literal(&writer, ",\"intensity\":");
+  JSON_Writer_Uint(&writer, intensities[light_id - 1]);
+
   /* Send response */
-  VAL_Serial_Send((uint8_t*)txBuffer, length, 1000);
+  COMMS_Handler_EndResponse(&writer, probe_start);
 }
 
 /**
@@ -202,37 +1939,17 @@ static void COMMS_Handler_SendLightIntensityResponse(const char* msg_id, uint8_t
  * @retval None
  */
 static void COMMS_Handler_SendSetLightResponse(const char* msg_id, VAL_Status status) {
-  uint16_t length;
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
 
-  if (status == VAL_OK) {
-    length = snprintf(txBuffer, TX_BUFFER_SIZE,
-      "{"
-        "\"type\":\"resp\","
-        "\"id\":\"%s\","
-        "\"topic\":\"light\","
-        "\"action\":\"set\","
-        "\"data\":{"
-          "\"status\":\"ok\""
-        "}"
-      "}\r\n",
-      msg_id);
-  } else {
-    length = snprintf(txBuffer, TX_BUFFER_SIZE,
-      "{"
-        "\"type\":\"resp\","
-        "\"id\":\"%s\","
-        "\"topic\":\"light\","
-        "\"action\":\"set\","
-        "\"data\":{"
-          "\"status\":\"error\","
-          "\"message\":\"Failed to set light intensity\""
-        "}"
-      "}\r\n",
-      msg_id);
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "light", "set", "Failed to set light intensity");
+    return;
   }
 
-  /* Send response */
-  VAL_Serial_Send((uint8_t*)txBuffer, length, 1000);
+  COMMS_Handler_SendFixedResponse(msg_id, "light", "set", RESP_STATUS_OK);
 }
 
 /**
@@ -242,642 +1959,10986 @@ static void COMMS_Handler_SendSetLightResponse(const char* msg_id, VAL_Status st
  * @retval None
  */
 static void COMMS_Handler_SendSetAllLightsResponse(const char* msg_id, VAL_Status status) {
-  uint16_t length;
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
 
-  if (status == VAL_OK) {
-    length = snprintf(txBuffer, TX_BUFFER_SIZE,
-      "{"
-        "\"type\":\"resp\","
-        "\"id\":\"%s\","
-        "\"topic\":\"light\","
-        "\"action\":\"set_all\","
-        "\"data\":{"
-          "\"status\":\"ok\""
-        "}"
-      "}\r\n",
-      msg_id);
-  } else {
-    length = snprintf(txBuffer, TX_BUFFER_SIZE,
-      "{"
-        "\"type\":\"resp\","
-        "\"id\":\"%s\","
-        "\"topic\":\"light\","
-        "\"action\":\"set_all\","
-        "\"data\":{"
-          "\"status\":\"error\","
-          "\"message\":\"Failed to set light intensities\""
-        "}"
-      "}\r\n",
-      msg_id);
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "light", "set_all", "Failed to set light intensities");
+    return;
   }
 
-  /* Send response */
-  VAL_Serial_Send((uint8_t*)txBuffer, length, 1000);
+  COMMS_Handler_SendFixedResponse(msg_id, "light", "set_all", RESP_STATUS_OK);
 }
 
 /**
- * @brief Send sensor data response for a specific light
+ * @brief Send response for the blackout command
  * @param msgId Original message ID
- * @param light_id Light source ID
+ * @param status Operation status
  * @retval None
  */
-static void COMMS_Handler_SendSensorDataResponse(const char* msg_id, uint8_t light_id) {
-  LightSensorData_t sensor_data;
-  VAL_Status status = VAL_ERROR;
-
-  /* Get sensor data for the specified light */
-  if (light_id >= 1 && light_id <= 3) {
-    status = SYS_Coordinator_GetLightSensorData(light_id, &sensor_data);
+static void COMMS_Handler_SendBlackoutResponse(const char* msg_id, VAL_Status status) {
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
   }
 
-  /* Format response */
-  uint16_t length;
-  if (status == VAL_OK) {
-    length = snprintf(txBuffer, TX_BUFFER_SIZE,
-      "{"
-        "\"type\":\"resp\","
-        "\"id\":\"%s\","
-        "\"topic\":\"status\","
-        "\"action\":\"get_sensors\","
-        "\"data\":{"
-          "\"status\":\"ok\","
-          "\"sensor\":{"
-            "\"id\":%u,"
-            "\"current\":%.1f,"
-            "\"temperature\":%.1f"
-          "}"
-        "}"
-      "}\r\n",
-      msg_id, light_id, sensor_data.current, sensor_data.temperature);
-  } else {
-    /* Error response */
-    COMMS_Handler_SendErrorResponse(msg_id, "status", "get_sensors",
-                          "Failed to retrieve sensor data");
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "alarm", "blackout", "Failed to turn the lights off");
     return;
   }
 
-  /* Send response */
-  VAL_Serial_Send((uint8_t*)txBuffer, length, 1000);
+  COMMS_Handler_SendFixedResponse(msg_id, "alarm", "blackout", RESP_STATUS_OK);
 }
 
 /**
- * @brief Send sensor data response for all lights
+ * @brief Send light intensity response in permille
  * @param msgId Original message ID
+ * @param light_id Light source ID (or 0 for all)
  * @retval None
  */
-static void COMMS_Handler_SendAllSensorDataResponse(const char* msg_id) {
-  LightSensorData_t sensor_data[3];
-  VAL_Status status;
+static void COMMS_Handler_SendLightPermilleResponse(const char* msg_id, uint8_t light_id) {
+  JSON_Writer_t writer;
+  COMMS_Gather_t gather;
+  uint16_t permille[VAL_LIGHT_COUNT] = {0};
+  VAL_Status status = VAL_ERROR;
 
-  /* Get sensor data for all lights */
-  status = SYS_Coordinator_GetAllLightSensorData(sensor_data);
+  if (light_id == 0) {
+    status = SYS_Coordinator_GetAllLightPermille(permille);
+  } else if (light_id >= 1 && light_id <= VAL_LIGHT_COUNT) {
+    status = SYS_Coordinator_GetLightPermille(light_id, &permille[light_id - 1]);
+  }
 
-  /* Format response */
-  uint16_t length;
-  if (status == VAL_OK) {
-    length = snprintf(txBuffer, TX_BUFFER_SIZE,
-      "{"
-        "\"type\":\"resp\","
-        "\"id\":\"%s\","
-        "\"topic\":\"status\","
-        "\"action\":\"get_all_sensors\","
-        "\"data\":{"
-          "\"status\":\"ok\","
-          "\"sensors\":["
-            "{\"id\":1,\"current\":%.1f,\"temperature\":%.1f},"
-            "{\"id\":2,\"current\":%.1f,\"temperature\":%.1f},"
-            "{\"id\":3,\"current\":%.1f,\"temperature\":%.1f}"
-          "]"
-        "}"
-      "}\r\n",
-      msg_id,
-      sensor_data[0].current, sensor_data[0].temperature,
-      sensor_data[1].current, sensor_data[1].temperature,
-      sensor_data[2].current, sensor_data[2].temperature);
+  if (reply.binary) {
+    if (light_id == 0) {
+      COMMS_Handler_SendBinaryResponse(status, permille, sizeof(permille));
+    } else {
+      COMMS_Bin_Permille_t body = { light_id, (status == VAL_OK) ? permille[light_id - 1] : 0 };
+      COMMS_Handler_SendBinaryResponse(status, &body, sizeof(body));
+    }
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "light", (light_id == 0) ? "get_all_permille" : "get_permille",
+                                    "Failed to retrieve light intensity");
+    return;
+  }
+
+  if (light_id == 0) {
+    COMMS_Handler_BeginGather(&gather, msg_id, "light", "get_all_permille", RESP_STATUS_OK ",\"permilles\":[");
+    if (!COMMS_Handler_FragmentCurrent(&permilles_fragment, permille, sizeof(permille), &writer)) {
+      for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+        if (i > 0) {
+          JSON_Writer_Literal(&writer, ", ");
+        }
+        JSON_Writer_Uint(&writer, permille[i]);
+      }
+      JSON_Writer_Char(&writer, ']');
+      COMMS_Handler_EndFragment(&permilles_fragment, &writer);
+    }
+    COMMS_Handler_GatherFragment(&gather, &permilles_fragment);
   } else {
-    /* Error response */
-    COMMS_Handler_SendErrorResponse(msg_id, "status", "get_all_sensors",
-                          "Failed to retrieve sensor data");
+    COMMS_Handler_BeginGather(&gather, msg_id, "light", "get_permille", RESP_STATUS_OK ",\"id\":");
+    COMMS_Handler_GatherUint(&gather, light_id);
+    COMMS_Handler_GatherLiteral(&gather, ",\"permille\":");
+    COMMS_Handler_GatherUint(&gather, permille[light_id - 1]);
+  }
+
+  /* Send response */
+  COMMS_Handler_EndGather(&gather, probe_start);
+}
+
+/**
+ * @brief Send response for a permille set command
+ * @param msgId Original message ID
+ * @param action Command action ("set_permille" or "set_all_permille")
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSetPermilleResponse(const char* msg_id, const char* action, VAL_Status status) {
+  COMMS_Gather_t gather;
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "light", action, "Failed to set light intensity");
     return;
   }
 
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginGatherFor(&gather, msg_id, "light", action);
+  COMMS_Handler_GatherLiteral(&gather, RESP_STATUS_OK);
+
   /* Send response */
-  VAL_Serial_Send((uint8_t*)txBuffer, length, 1000);
+  COMMS_Handler_EndGather(&gather, probe_start);
 }
 
 /**
- * @brief Send response for clear alarm command
+ * @brief Send response for a colour set
  * @param msgId Original message ID
- * @param light_id Light source ID
  * @param status Operation status
+ * @param permille Intensities mixed, valid with VAL_OK
  * @retval None
  */
-static void COMMS_Handler_SendAlarmClearResponse(const char* msg_id, uint8_t light_id, VAL_Status status) {
-  uint16_t length;
+static void COMMS_Handler_SendSetColorResponse(const char* msg_id, VAL_Status status, const uint16_t* permille) {
+  JSON_Writer_t writer;
 
-  if (status == VAL_OK) {
-    length = snprintf(txBuffer, TX_BUFFER_SIZE,
-      "{"
-        "\"type\":\"resp\","
-        "\"id\":\"%s\","
-        "\"topic\":\"alarm\","
-        "\"action\":\"clear\","
-        "\"data\":{"
-          "\"status\":\"ok\","
-          "\"message\":\"Alarm cleared for light %u\""
-        "}"
-      "}\r\n",
-      msg_id, light_id);
-  } else {
-    length = snprintf(txBuffer, TX_BUFFER_SIZE,
-      "{"
-        "\"type\":\"resp\","
-        "\"id\":\"%s\","
-        "\"topic\":\"alarm\","
-        "\"action\":\"clear\","
-        "\"data\":{"
-          "\"status\":\"error\","
-          "\"message\":\"Failed to clear alarm for light %u\""
-        "}"
-      "}\r\n",
-      msg_id, light_id);
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, permille, VAL_LIGHT_COUNT * sizeof(uint16_t));
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "light", "set_color", "Invalid or out of gamut colour");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "light", "set_color", "Failed to set light intensity");
+    return;
   }
 
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "light", "set_color");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"permilles\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Uint(&writer, permille[i]);
+  }
+  JSON_Writer_Char(&writer, ']');
+
   /* Send response */
-  VAL_Serial_Send((uint8_t*)txBuffer, length, 1000);
+  COMMS_Handler_EndResponse(&writer, probe_start);
 }
 
 /**
- * @brief Send alarm status response
+ * @brief Send response for a light effect start or stop
  * @param msgId Original message ID
+ * @param status Operation status
  * @retval None
  */
-static void COMMS_Handler_SendAlarmStatusResponse(const char* msg_id) {
-  uint8_t alarms[3] = {0, 0, 0};
-  VAL_Status status;
+static void COMMS_Handler_SendEffectResponse(const char* msg_id, VAL_Status status) {
+  COMMS_Gather_t gather;
 
-  /* Get alarm status for all lights */
-  status = SYS_Coordinator_GetAlarmStatus(alarms);
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
 
-  /* Format response */
-  int length;
-  if (status == VAL_OK) {
-    length = snprintf(txBuffer, TX_BUFFER_SIZE,
-      "{"
-        "\"type\":\"resp\","
-        "\"id\":\"%s\","
-        "\"topic\":\"alarm\","
-        "\"action\":\"status\","
-        "\"data\":{"
-          "\"status\":\"ok\","
-          "\"active_alarms\":["
-      , msg_id);
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "light", "effect", "Invalid effect");
+    return;
+  } else if (status == VAL_BUSY) {
+    COMMS_Handler_SendErrorResponse(msg_id, "light", "effect", "Strobe running");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "light", "effect", "Failed to start effect");
+    return;
+  }
 
-    /* Add active alarms to the response */
-    int alarm_count = 0;
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginGatherFor(&gather, msg_id, "light", "effect");
+  COMMS_Handler_GatherLiteral(&gather, RESP_STATUS_OK);
 
-    for (int i = 0; i < 3; i++) {
-      if (alarms[i] != 0) {
-        /* Format alarm entry */
-        if (alarm_count > 0) {
-          /* Add comma separator for subsequent entries */
-          length += snprintf(txBuffer + length, TX_BUFFER_SIZE - length, ",");
-        }
+  /* Send response */
+  COMMS_Handler_EndGather(&gather, probe_start);
+}
 
-        const char* alarm_type = "unknown";
-        switch (alarms[i]) {
-          case 0:
-            alarm_type = "none";
-            break;
-          case 1:
-            alarm_type = "over_current";
-            break;
-          case 2:
-            alarm_type = "over_temperature";
-            break;
-          default:
-            alarm_type = "system_error";
-            break;
-        }
+/**
+ * @brief Send sensor data response for a specific light
+ * @param msgId Original message ID
+ * @param light_id Light source ID
+ * @retval None
+ */
+static void COMMS_Handler_SendSensorDataResponse(const char* msg_id, uint8_t light_id) {
+  JSON_Writer_t writer;
+  LightSensorData_t sensor_data;
+  LightSampleStamp_t stamp;
+  VAL_Status status = VAL_ERROR;
 
-        length += snprintf(txBuffer + length, TX_BUFFER_SIZE - length,
-          "{\"light\":%d,\"code\":\"%s\"}", i + 1, alarm_type);
+  /* Get sensor data for the specified light */
+  if (light_id >= 1 && light_id <= VAL_LIGHT_COUNT) {
+    status = SYS_Coordinator_GetLightSensorData(light_id, &sensor_data, &stamp);
+  }
 
-        alarm_count++;
-      }
-    }
+  if (reply.binary) {
+    uint8_t body[1 + 2 * sizeof(COMMS_Bin_Sensor_t) + sizeof(COMMS_Bin_Sample_Stamp_t)];
+    LightSensorData_t raw_data;
+    COMMS_Bin_Sensor_t packed[2];
+    COMMS_Bin_Sample_Stamp_t packed_stamp = { stamp.sequence, stamp.timestamp_us };
 
-    /* Complete the JSON object */
-    length += snprintf(txBuffer + length, TX_BUFFER_SIZE - length,
-      "]"
-        "}"
-      "}\r\n");
+    /* Filtered reading, then the unfiltered one */
+    raw_data.current = sensor_data.current_raw;
+    raw_data.temperature = sensor_data.temperature_raw;
+    COMMS_Handler_PackSensor(&sensor_data, &packed[0]);
+    COMMS_Handler_PackSensor(&raw_data, &packed[1]);
+    body[0] = light_id;
+    memcpy(&body[1], packed, sizeof(packed));
+    memcpy(&body[1 + sizeof(packed)], &packed_stamp, sizeof(packed_stamp));
+    COMMS_Handler_SendBinaryResponse(status, body, sizeof(body));
+    return;
+  }
 
-  } else {
-    /* Error response */
-    COMMS_Handler_SendErrorResponse(msg_id, "alarm", "status", "Failed to retrieve alarm status");
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "status", "get_sensors",
+                                    "Failed to retrieve sensor data");
     return;
   }
 
+  /* Format response */
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "status", "get_sensors");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"sensor\":");
+  COMMS_Handler_WriteSensor(&writer, light_id, &sensor_data, true);
+  COMMS_Handler_WriteSampleStamp(&writer, &stamp);
+
   /* Send response */
-  VAL_Serial_Send((uint8_t*)txBuffer, length, 1000);
+  COMMS_Handler_EndResponse(&writer, probe_start);
 }
 
 /**
- * @brief Send a generic error response
+ * @brief Send sensor data response for all lights
  * @param msgId Original message ID
- * @param topic Message topic
- * @param action Message action
- * @param message Error message
  * @retval None
  */
-static void COMMS_Handler_SendErrorResponse(const char* msg_id, const char* topic, const char* action, const char* message) {
-  uint16_t length = snprintf(txBuffer, TX_BUFFER_SIZE,
-    "{"
-      "\"type\":\"resp\","
-      "\"id\":\"%s\","
-      "\"topic\":\"%s\","
-      "\"action\":\"%s\","
-      "\"data\":{"
-        "\"status\":\"error\","
-        "\"message\":\"%s\""
-      "}"
-    "}\r\n",
-    msg_id, topic, action, message);
+static void COMMS_Handler_SendAllSensorDataResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  COMMS_Gather_t gather;
+  LightSensorData_t sensor_data[VAL_LIGHT_COUNT];
+  LightSampleStamp_t stamp;
+  VAL_Status status;
+  struct {
+    float readings[VAL_LIGHT_COUNT][2];  /* Current and temperature */
+    uint16_t supply_mv;
+    int16_t mcu_temperature_cdeg;
+  } key;
+
+  /* Get sensor data for all lights */
+  status = SYS_Coordinator_GetAllLightSensorData(sensor_data, &stamp);
+
+  if (reply.binary) {
+    struct __attribute__((packed)) {
+      COMMS_Bin_Sensor_t sensors[VAL_LIGHT_COUNT];
+      COMMS_Bin_Sample_Stamp_t stamp;
+      COMMS_Bin_Mcu_Sensors_t mcu;
+    } body;
+
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      COMMS_Handler_PackSensor(&sensor_data[i], &body.sensors[i]);
+    }
+    body.stamp.sequence = stamp.sequence;
+    body.stamp.timestamp_us = stamp.timestamp_us;
+    body.mcu.temperature_cdeg = stamp.mcu_temperature_cdeg;
+    body.mcu.supply_mv = stamp.supply_mv;
+    COMMS_Handler_SendBinaryResponse(status, &body, sizeof(body));
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "status", "get_all_sensors",
+                                    "Failed to retrieve sensor data");
+    return;
+  }
+
+  /* The readings often repeat from one poll to the next, the stamp never does */
+  memset(&key, 0, sizeof(key));
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    key.readings[i][0] = sensor_data[i].current;
+    key.readings[i][1] = sensor_data[i].temperature;
+  }
+  key.supply_mv = stamp.supply_mv;
+  key.mcu_temperature_cdeg = stamp.mcu_temperature_cdeg;
+
+  /* Format response */
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginGather(&gather, msg_id, "status", "get_all_sensors", RESP_STATUS_OK ",\"sensors\":[");
+  if (!COMMS_Handler_FragmentCurrent(&sensors_fragment, &key, sizeof(key), &writer)) {
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      if (i > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      COMMS_Handler_WriteSensor(&writer, i + 1, &sensor_data[i], false);
+    }
+    JSON_Writer_Literal(&writer, "],\"mcu_temperature\":");
+    JSON_Writer_Fixed(&writer, stamp.mcu_temperature_cdeg * 0.01f, 1);
+    JSON_Writer_Literal(&writer, ",\"supply_mv\":");
+    JSON_Writer_Uint(&writer, stamp.supply_mv);
+    COMMS_Handler_EndFragment(&sensors_fragment, &writer);
+  }
+  COMMS_Handler_GatherFragment(&gather, &sensors_fragment);
+
+  /* Formatted behind the message ID, as one segment */
+  size_t start = gather.fields.length;
+  COMMS_Handler_WriteSampleStamp(&gather.fields, &stamp);
+  COMMS_Handler_GatherConst(&gather, &txBuffer[start], gather.fields.length - start);
 
   /* Send response */
-  VAL_Serial_Send((uint8_t*)txBuffer, length, 1000);
+  COMMS_Handler_EndGather(&gather, probe_start);
 }
 
 /**
- * @brief Send alarm event notification
- * @param light_id Light source ID that triggered the alarm (1-3)
- * @param errorType Type of error that caused the alarm
- * @param value Measured value that caused the alarm
- * @retval VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ * @brief Send the whole light state, as one publication left it
+ * @param msgId Original message ID
+ * @retval None
  */
-VAL_Status COMMS_Handler_SendAlarmEvent(uint8_t light_id, uint8_t error_type, float value) {
-  const char* error_code_str;
-  char event_id[16];
-  int length;
+static void COMMS_Handler_SendStateResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  SYS_Coordinator_Snapshot_t snapshot;
+  LightSampleStamp_t* stamp = &snapshot.sensors_stamp;
+  VAL_Status status;
 
-  /* Generate event ID with timestamp */
-  snprintf(event_id, sizeof(event_id), "evt-%lu", HAL_GetTick());
+  status = SYS_Coordinator_GetSnapshot(&snapshot);
 
-  /* Convert error type to string */
-  switch (error_type) {
-    case 1:
-      error_code_str = "over_current";
-      break;
-    case 2:
-      error_code_str = "over_temperature";
-      break;
-    default:
-      error_code_str = "system_error";
-      break;
+  if (reply.binary) {
+    struct __attribute__((packed)) {
+      uint32_t sequence;
+      uint16_t permille[VAL_LIGHT_COUNT];
+      uint8_t alarms[VAL_LIGHT_COUNT];
+      uint16_t derate[VAL_LIGHT_COUNT];
+      COMMS_Bin_Sensor_t sensors[VAL_LIGHT_COUNT];
+      COMMS_Bin_Sample_Stamp_t stamp;
+      COMMS_Bin_Mcu_Sensors_t mcu;
+    } body;
+
+    body.sequence = snapshot.sequence;
+    memcpy(body.permille, snapshot.permille, sizeof(body.permille));
+    memcpy(body.alarms, snapshot.alarms, sizeof(body.alarms));
+    memcpy(body.derate, snapshot.derate, sizeof(body.derate));
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      COMMS_Handler_PackSensor(&snapshot.sensors[i], &body.sensors[i]);
+    }
+    body.stamp.sequence = stamp->sequence;
+    body.stamp.timestamp_us = stamp->timestamp_us;
+    body.mcu.temperature_cdeg = stamp->mcu_temperature_cdeg;
+    body.mcu.supply_mv = stamp->supply_mv;
+    COMMS_Handler_SendBinaryResponse(status, &body, sizeof(body));
+    return;
   }
 
-  /* Format event message */
-  length = snprintf(txBuffer, TX_BUFFER_SIZE,
-    "{"
-      "\"type\":\"event\","
-      "\"id\":\"%s\","
-      "\"topic\":\"alarm\","
-      "\"action\":\"triggered\","
-      "\"data\":{"
-        "\"timestamp\":\"%lu\","
-        "\"code\":\"%s\","
-        "\"source\":\"light_%u\","
-        "\"value\":%.1f,"
-        "\"status\":\"disabled\""
-      "}"
-    "}\r\n",
-    event_id, HAL_GetTick(), error_code_str, light_id, value);
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "get_state", "Failed to retrieve state");
+    return;
+  }
 
-  /* Send event message */
-  return VAL_Serial_Send((uint8_t*)txBuffer, length, 1000);
+  /* Format response */
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "get_state");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"state_seq\":");
+  JSON_Writer_Uint(&writer, snapshot.sequence);
+  JSON_Writer_Literal(&writer, ",\"permilles\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Uint(&writer, snapshot.permille[i]);
+  }
+  JSON_Writer_Literal(&writer, "],\"alarms\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Uint(&writer, snapshot.alarms[i]);
+  }
+  JSON_Writer_Literal(&writer, "],\"derate\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Uint(&writer, snapshot.derate[i]);
+  }
+  JSON_Writer_Literal(&writer, "],\"sensors\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    COMMS_Handler_WriteSensor(&writer, i + 1, &snapshot.sensors[i], false);
+  }
+  JSON_Writer_Literal(&writer, "],\"mcu_temperature\":");
+  JSON_Writer_Fixed(&writer, stamp->mcu_temperature_cdeg * 0.01f, 1);
+  JSON_Writer_Literal(&writer, ",\"supply_mv\":");
+  JSON_Writer_Uint(&writer, stamp->supply_mv);
+  COMMS_Handler_WriteSampleStamp(&writer, stamp);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
 }
 
 /**
-  * @brief  Process a received JSON command string
-  * @param  jsonStr: JSON command string
-  * @retval None
-  */
-static void COMMS_Handler_ProcessJsonCommand(const char* json_str) {
-  /* Parse JSON message */
-  lwjson_parse(&jsonParser, json_str);
+ * @brief Send the statistics of every light input over the raw scans
+ * @param msgId Original message ID
+ * @param reset Start the statistics over once read
+ * @retval None
+ */
+static void COMMS_Handler_SendStatsResponse(const char* msg_id, bool reset) {
+  JSON_Writer_t writer;
+  AnalogStats stats;
+  VAL_Status status = VAL_Analog_GetStats(&stats, reset ? 1U : 0U);
+  uint16_t rate_hz = (uint16_t)VAL_Analog_GetSampleRate();
 
-  /* Get first token - this is the root object */
-  const lwjson_token_t* root = lwjson_get_first_token(&jsonParser);
-  if (root == NULL || root->type != LWJSON_TYPE_OBJECT) {
-    lwjson_free(&jsonParser);
+  if (reply.binary) {
+    struct __attribute__((packed)) {
+      COMMS_Bin_Stats_Header_t header;
+      COMMS_Bin_Stats_t inputs[VAL_LIGHT_COUNT][2];
+    } body;
+
+    body.header.scans = stats.scans;
+    body.header.window_scans = stats.window_scans;
+    body.header.first_sample = stats.first_sample;
+    body.header.rate_hz = rate_hz;
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      const AnalogStatsReading* readings[2] = { &stats.lights[i].current, &stats.lights[i].temperature };
+
+      for (int input = 0; input < 2; input++) {
+        body.inputs[i][input].min = readings[input]->min;
+        body.inputs[i][input].max = readings[input]->max;
+        body.inputs[i][input].mean = readings[input]->mean;
+        body.inputs[i][input].rms = readings[input]->rms;
+      }
+    }
+    COMMS_Handler_SendBinaryResponse(status, &body, sizeof(body));
     return;
   }
 
-  /* Retrieve message details */
-  char msg_id[64] = "unknown";
-  const char* type = NULL;
-  const char* topic = NULL;
-  const char* action = NULL;
-  size_t type_len = 0, topic_len = 0, action_len = 0;
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "status", "get_stats", "Failed to retrieve statistics");
+    return;
+  }
 
-  /* Extract message details */
-  const lwjson_token_t* token = root->u.first_child;
-  while (token != NULL) {
-    if (token->token_name != NULL) {
-      if (strncmp(token->token_name, "id", token->token_name_len) == 0 &&
-          token->type == LWJSON_TYPE_STRING) {
-        size_t id_len;
-        const char* tmp = lwjson_get_val_string(token, &id_len);
-        if (tmp != NULL) {
-          strncpy(msg_id, tmp, id_len);
-          msg_id[id_len] = '\0';
-        }
-      } else if (strncmp(token->token_name, "type", token->token_name_len) == 0 &&
-                 token->type == LWJSON_TYPE_STRING) {
-        type = lwjson_get_val_string(token, &type_len);
-      } else if (strncmp(token->token_name, "topic", token->token_name_len) == 0 &&
-                 token->type == LWJSON_TYPE_STRING) {
-        topic = lwjson_get_val_string(token, &topic_len);
-      } else if (strncmp(token->token_name, "action", token->token_name_len) == 0 &&
-                 token->type == LWJSON_TYPE_STRING) {
-        action = lwjson_get_val_string(token, &action_len);
-      }
-    }
-    token = token->next;
-  }
-
-  /* Check if this is a valid command */
-  if (type != NULL && topic != NULL && action != NULL &&
-      strncmp(type, MSG_TYPE_CMD, type_len) == 0) {
-
-    /* Check for system ping command */
-    if (topic_len == 6 && strncmp(topic, "system", 6) == 0 &&
-        action_len == 4 && strncmp(action, "ping", 4) == 0) {
-      /* Send ping response */
-      COMMS_Handler_SendPingResponse(msg_id);
-    }
-    /* Check for light topic commands */
-    else if (topic_len == 5 && strncmp(topic, "light", 5) == 0) {
-      if (action_len == 3 && strncmp(action, "get", 3) == 0) {
-        /* Check for light ID in data */
-        uint8_t light_id = 0;
-        token = root->u.first_child;
-        while (token != NULL) {
-          if (token->token_name != NULL &&
-              strncmp(token->token_name, "data", token->token_name_len) == 0 &&
-              token->type == LWJSON_TYPE_OBJECT) {
-
-            /* Search for "id" inside data */
-            const lwjson_token_t* data_token = token->u.first_child;
-            while (data_token != NULL) {
-              if (data_token->token_name != NULL &&
-                  strncmp(data_token->token_name, "id", data_token->token_name_len) == 0 &&
-                  data_token->type == LWJSON_TYPE_NUM_INT) {
-
-                light_id = (uint8_t)data_token->u.num_int;
-                break;
-              }
-              data_token = data_token->next;
-            }
-            break;
-          }
-          token = token->next;
-        }
+  /* Format response */
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "status", "get_stats");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"scans\":");
+  JSON_Writer_Uint(&writer, stats.scans);
+  JSON_Writer_Literal(&writer, ",\"window\":");
+  JSON_Writer_Uint(&writer, stats.window_scans);
+  JSON_Writer_Literal(&writer, ",\"first_sample\":");
+  JSON_Writer_Uint(&writer, stats.first_sample);
+  JSON_Writer_Literal(&writer, ",\"rate_hz\":");
+  JSON_Writer_Uint(&writer, rate_hz);
+  JSON_Writer_Literal(&writer, ",\"stats\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"id\":");
+    JSON_Writer_Uint(&writer, stats.lights[i].light_id);
+    JSON_Writer_Literal(&writer, ",\"current\":");
+    COMMS_Handler_WriteStats(&writer, &stats.lights[i].current, false);
+    JSON_Writer_Literal(&writer, ",\"temperature\":");
+    COMMS_Handler_WriteStats(&writer, &stats.lights[i].temperature, true);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
 
-        /* Send response */
-        COMMS_Handler_SendLightIntensityResponse(msg_id, light_id);
-      }
-      else if (action_len == 7 && strncmp(action, "get_all", 7) == 0) {
-        /* Get intensities for all lights */
-        COMMS_Handler_SendLightIntensityResponse(msg_id, 0);
-      }
-      else if (action_len == 3 && strncmp(action, "set", 3) == 0) {
-        /* Set light intensity */
-        uint8_t light_id = 0;
-        uint8_t intensity = 0;
-        bool found_id = false;
-        bool found_intensity = false;
-
-        /* Find data object */
-        token = root->u.first_child;
-        while (token != NULL) {
-          if (token->token_name != NULL &&
-              strncmp(token->token_name, "data", token->token_name_len) == 0 &&
-              token->type == LWJSON_TYPE_OBJECT) {
-
-            /* Search for "id" and "intensity" inside data */
-            const lwjson_token_t* data_token = token->u.first_child;
-            while (data_token != NULL) {
-              if (data_token->token_name != NULL) {
-                if (strncmp(data_token->token_name, "id", data_token->token_name_len) == 0 &&
-                    data_token->type == LWJSON_TYPE_NUM_INT) {
-                  light_id = (uint8_t)data_token->u.num_int;
-                  found_id = true;
-                }
-                else if (strncmp(data_token->token_name, "intensity", data_token->token_name_len) == 0 &&
-                         data_token->type == LWJSON_TYPE_NUM_INT) {
-                  intensity = (uint8_t)data_token->u.num_int;
-                  found_intensity = true;
-                }
-              }
-              data_token = data_token->next;
-            }
-            break;
-          }
-          token = token->next;
-        }
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
 
-        /* Set light intensity if parameters are valid */
-        VAL_Status status = VAL_ERROR;
-        if (found_id && found_intensity) {
-          status = SYS_Coordinator_SetLightIntensity(light_id, intensity);
-        }
+/**
+ * @brief Write the statistics of one input as an object
+ * @param writer Writer
+ * @param reading Statistics
+ * @param centi true for centi-degrees, written in degrees; false for mA
+ * @retval None
+ */
+static void COMMS_Handler_WriteStats(JSON_Writer_t* writer, const AnalogStatsReading* reading, bool centi) {
+  const char* const names[4] = { "{\"min\":", ",\"max\":", ",\"mean\":", ",\"rms\":" };
+  const int32_t values[4] = { reading->min, reading->max, reading->mean, reading->rms };
 
-        /* Send response */
-        COMMS_Handler_SendSetLightResponse(msg_id, status);
-      }
-      else if (action_len == 7 && strncmp(action, "set_all", 7) == 0) {
-        /* Set all light intensities */
-        uint8_t intensities[3] = {0, 0, 0};
-        bool found_intensities = false;
-
-        /* Find data object */
-        token = root->u.first_child;
-        while (token != NULL) {
-          if (token->token_name != NULL &&
-              strncmp(token->token_name, "data", token->token_name_len) == 0 &&
-              token->type == LWJSON_TYPE_OBJECT) {
-
-            /* Search for "intensities" array inside data */
-            const lwjson_token_t* data_token = token->u.first_child;
-            while (data_token != NULL) {
-              if (data_token->token_name != NULL &&
-                  strncmp(data_token->token_name, "intensities", data_token->token_name_len) == 0 &&
-                  data_token->type == LWJSON_TYPE_ARRAY) {
-
-                /* Parse intensities array */
-                const lwjson_token_t* array_token = data_token->u.first_child;
-                int index = 0;
-
-                while (array_token != NULL && index < 3) {
-                  if (array_token->type == LWJSON_TYPE_NUM_INT) {
-                    intensities[index++] = (uint8_t)array_token->u.num_int;
-                  }
-                  array_token = array_token->next;
-                }
-
-                if (index == 3) {
-                  found_intensities = true;
-                }
-                break;
-              }
-              data_token = data_token->next;
-            }
-            break;
-          }
-          token = token->next;
-        }
+  for (int i = 0; i < 4; i++) {
+    JSON_Writer_Text(writer, names[i]);
+    if (centi) {
+      JSON_Writer_Fixed(writer, values[i] * 0.01f, 2);
+    } else {
+      JSON_Writer_Int(writer, values[i]);
+    }
+  }
+  JSON_Writer_Char(writer, '}');
+}
 
-        /* Set all light intensities if parameters are valid */
-        VAL_Status status = VAL_ERROR;
-        if (found_intensities) {
-          status = SYS_Coordinator_SetAllLightIntensities(intensities);
-        }
+/**
+ * @brief Send the usage counters of every light
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendUsageResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  LED_Driver_Usage_t usage[VAL_LIGHT_COUNT];
+  VAL_Status status = SYS_Coordinator_GetUsage(usage);
+  uint32_t values[VAL_LIGHT_COUNT][3];
+  uint32_t counters[COUNTERS_COUNT];
 
-        /* Send response */
-        COMMS_Handler_SendSetAllLightsResponse(msg_id, status);
-      }
-    }
-    /* Check for status topic commands */
-    else if (topic_len == 6 && strncmp(topic, "status", 6) == 0) {
-      if (action_len == 11 && strncmp(action, "get_sensors", 11) == 0) {
-        /* Get sensor data for a specific light */
-        uint8_t light_id = 0;
-        token = root->u.first_child;
-        while (token != NULL) {
-          if (token->token_name != NULL &&
-              strncmp(token->token_name, "data", token->token_name_len) == 0 &&
-              token->type == LWJSON_TYPE_OBJECT) {
-
-            /* Search for "id" inside data */
-            const lwjson_token_t* data_token = token->u.first_child;
-            while (data_token != NULL) {
-              if (data_token->token_name != NULL &&
-                  strncmp(data_token->token_name, "id", data_token->token_name_len) == 0 &&
-                  data_token->type == LWJSON_TYPE_NUM_INT) {
-
-                light_id = (uint8_t)data_token->u.num_int;
-                break;
-              }
-              data_token = data_token->next;
-            }
-            break;
-          }
-          token = token->next;
-        }
+  Counters_GetAll(counters);
 
-        if (light_id >= 1 && light_id <= 3) {
-          /* Send sensor data response for specific light */
-          COMMS_Handler_SendSensorDataResponse(msg_id, light_id);
-        } else {
-          /* Invalid light ID */
-          COMMS_Handler_SendErrorResponse(msg_id, "status", "get_sensors", "Invalid light ID");
-        }
-      }
-      else if (action_len == 15 && strncmp(action, "get_all_sensors", 15) == 0) {
-        /* Get sensor data for all lights */
-        COMMS_Handler_SendAllSensorDataResponse(msg_id);
-      }
-    }
-    /* Check for alarm topic commands */
-    else if (topic_len == 5 && strncmp(topic, "alarm", 5) == 0) {
-      if (action_len == 5 && strncmp(action, "clear", 5) == 0) {
-        /* Clear alarm for specific light(s) */
-        uint8_t light_id = 0;
-        bool single_light = false;
-        bool valid_command = false;
-
-        /* Find data object */
-        token = root->u.first_child;
-        while (token != NULL) {
-          if (token->token_name != NULL &&
-              strncmp(token->token_name, "data", token->token_name_len) == 0 &&
-              token->type == LWJSON_TYPE_OBJECT) {
-
-            /* Check for single light ID or array of light IDs */
-            const lwjson_token_t* data_token = token->u.first_child;
-            while (data_token != NULL) {
-              if (data_token->token_name != NULL) {
-                /* Single light ID */
-                if (strncmp(data_token->token_name, "id", data_token->token_name_len) == 0 &&
-                    data_token->type == LWJSON_TYPE_NUM_INT) {
-                  light_id = (uint8_t)data_token->u.num_int;
-                  single_light = true;
-                  valid_command = true;
-                  break;
-                }
-                /* Array of light IDs - only handle first one for this implementation */
-                else if (strncmp(data_token->token_name, "lights", data_token->token_name_len) == 0 &&
-                         data_token->type == LWJSON_TYPE_ARRAY) {
-                  const lwjson_token_t* array_token = data_token->u.first_child;
-                  if (array_token != NULL && array_token->type == LWJSON_TYPE_NUM_INT) {
-                    light_id = (uint8_t)array_token->u.num_int;
-                    single_light = true;
-                    valid_command = true;
-                    break;
-                  }
-                }
-              }
-              data_token = data_token->next;
-            }
-            break;
-          }
-          token = token->next;
-        }
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    values[i][0] = COMMS_Handler_UsageSeconds(usage[i].charge_ma_us, 1000000000U);
+    values[i][1] = COMMS_Handler_UsageSeconds(usage[i].duty_permille_us, 1000000000U);
+    values[i][2] = COMMS_Handler_UsageSeconds(usage[i].over_warning_us, 1000000U);
+  }
 
-        if (valid_command && single_light) {
-          /* Clear alarm for a specific light */
-          VAL_Status status = SYS_Coordinator_ClearLightAlarm(light_id);
-          COMMS_Handler_SendAlarmClearResponse(msg_id, light_id, status);
-        } else {
-          /* Invalid command */
-          COMMS_Handler_SendErrorResponse(msg_id, "alarm", "clear", "Invalid parameters");
-        }
-      }
-      else if (action_len == 6 && strncmp(action, "status", 6) == 0) {
-    	/* Get alarm status for all lights */
-        COMMS_Handler_SendAlarmStatusResponse(msg_id);
-      }
+  if (reply.binary) {
+    uint8_t body[VAL_LIGHT_COUNT * sizeof(COMMS_Bin_Usage_t) + sizeof(counters)];
+
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      COMMS_Bin_Usage_t entry = { values[i][0], values[i][1], values[i][2] };
+      memcpy(&body[i * sizeof(entry)], &entry, sizeof(entry));
+    }
+    memcpy(&body[VAL_LIGHT_COUNT * sizeof(COMMS_Bin_Usage_t)], counters, sizeof(counters));
+    COMMS_Handler_SendBinaryResponse(status, body, sizeof(body));
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "status", "get_usage", "Failed to retrieve usage");
+    return;
+  }
+
+  /* Format response */
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "status", "get_usage");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"usage\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"id\":");
+    JSON_Writer_Uint(&writer, i + 1);
+    JSON_Writer_Literal(&writer, ",\"charge_as\":");
+    JSON_Writer_Uint(&writer, values[i][0]);
+    JSON_Writer_Literal(&writer, ",\"on_time_s\":");
+    JSON_Writer_Uint(&writer, values[i][1]);
+    JSON_Writer_Literal(&writer, ",\"over_warning_s\":");
+    JSON_Writer_Uint(&writer, values[i][2]);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Literal(&writer, "],\"counters\":{");
+  for (uint8_t i = 0; i < COUNTERS_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
     }
+    JSON_Writer_String(&writer, Counters_GetName((Counters_Id_t)i));
+    JSON_Writer_Char(&writer, ':');
+    JSON_Writer_Uint(&writer, counters[i]);
   }
+  JSON_Writer_Char(&writer, '}');
 
-  /* Cleanup parser */
-  lwjson_free(&jsonParser);
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
 }
+
 /**
-  * @brief  Serial RX callback - Called for each byte received
-  * @param  byte: Received byte
-  * @retval None
-  */
-static void COMMS_Handler_SerialRxCallback(uint8_t byte) {
-  /* Add byte to buffer */
-  if (rx_index < RX_BUFFER_SIZE - 1) {
-    rxBuffer[rx_index++] = byte;
+ * @brief Send the flicker of every light
+ * @param msgId Original message ID
+ * @param status Status of setting the window, VAL_OK if none was given
+ * @retval None
+ */
+static void COMMS_Handler_SendFlickerResponse(const char* msg_id, VAL_Status status) {
+  /* Indexed by LED_Driver_FlickerState_t, the COMMS_FLICKER_* values */
+  static const char* const state_names[] = { "settling", "measuring", "done" };
+  JSON_Writer_t writer;
+  LED_Driver_FlickerStatus_t flicker;
+  LED_Driver_Flicker_t metrics[VAL_LIGHT_COUNT];
+
+  if (status == VAL_OK) {
+    status = SYS_Coordinator_GetFlicker(&flicker, metrics);
   }
 
-  /* Check for end of message */
-  if (byte == '\n' || byte == '\r') {
-    /* Null-terminate the string */
-    rxBuffer[rx_index] = '\0';
+  if (reply.binary) {
+    uint8_t body[sizeof(COMMS_Bin_Flicker_Header_t) + VAL_LIGHT_COUNT * sizeof(COMMS_Bin_Flicker_t)];
+    COMMS_Bin_Flicker_Header_t header;
 
-    /* Check if we have a non-empty message */
-    if (rx_index > 0) {
-      /* Process the received message */
-      COMMS_Handler_ProcessJsonCommand(rxBuffer);
+    if (status != VAL_OK) {
+      COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+      return;
     }
 
-    /* Reset index for next message */
-    rx_index = 0;
+    header.state = (uint8_t)flicker.state;
+    header.window_scans = flicker.window_scans;
+    header.measurements = flicker.measurements;
+    memcpy(&body[0], &header, sizeof(header));
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      COMMS_Bin_Flicker_t entry = { metrics[i].percent_centi, metrics[i].index_e4 };
+      memcpy(&body[sizeof(header) + i * sizeof(entry)], &entry, sizeof(entry));
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, sizeof(body));
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "status", "get_flicker", "Invalid flicker window");
+    return;
+  }
+
+  /* Format response */
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "status", "get_flicker");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"state\":");
+  JSON_Writer_String(&writer, state_names[flicker.state]);
+  JSON_Writer_Literal(&writer, ",\"window\":");
+  JSON_Writer_Uint(&writer, flicker.window_scans);
+  JSON_Writer_Literal(&writer, ",\"measurements\":");
+  JSON_Writer_Uint(&writer, flicker.measurements);
+  JSON_Writer_Literal(&writer, ",\"flicker\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"id\":");
+    JSON_Writer_Uint(&writer, i + 1);
+    JSON_Writer_Literal(&writer, ",\"percent\":");
+    JSON_Writer_Fixed(&writer, metrics[i].percent_centi / 100.0f, 2);
+    JSON_Writer_Literal(&writer, ",\"index\":");
+    JSON_Writer_Fixed(&writer, metrics[i].index_e4 / 10000.0f, 4);
+    JSON_Writer_Char(&writer, '}');
   }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Convert a usage counter to whole seconds
+ * @param count Counter value
+ * @param per_second Counts in one second at full scale
+ * @retval uint32_t Seconds, limited to UINT32_MAX
+ */
+static uint32_t COMMS_Handler_UsageSeconds(uint64_t count, uint32_t per_second) {
+  uint64_t seconds = count / per_second;
+
+  return (seconds > UINT32_MAX) ? UINT32_MAX : (uint32_t)seconds;
+}
+
+/**
+ * @brief Send the outcome of status/set_stats_window
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @param scans Scans per window, 0 for one run until reset
+ * @retval None
+ */
+static void COMMS_Handler_SendStatsWindowResponse(const char* msg_id, VAL_Status status, uint16_t scans) {
+  JSON_Writer_t writer;
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "status", "set_stats_window", "Invalid window");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "status", "set_stats_window");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"window\":");
+  JSON_Writer_Uint(&writer, scans);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the ADC block size, after status/block_scans
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendBlockScansResponse(const char* msg_id, VAL_Status status) {
+  JSON_Writer_t writer;
+  uint8_t scans = VAL_Analog_GetBlockScans();
+  uint32_t rate_hz = VAL_Analog_GetSampleRate();
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, &scans, sizeof(scans));
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "status", "block_scans",
+                                    (status == VAL_PARAM) ? "Invalid scans" : "ADC restart failed");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "status", "block_scans");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"scans\":");
+  JSON_Writer_Uint(&writer, scans);
+  JSON_Writer_Literal(&writer, ",\"block_us\":");
+  JSON_Writer_Uint(&writer, (rate_hz != 0) ? (scans * 1000000U + rate_hz / 2U) / rate_hz : 0);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for clear alarm command
+ * @param msgId Original message ID
+ * @param lights Lights asked for, bit n for light n+1
+ * @param failed Lights whose alarm stays
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendAlarmClearResponse(const char* msg_id, uint8_t lights, uint8_t failed,
+                                                 VAL_Status status) {
+  JSON_Writer_t writer;
+
+  if (reply.binary) {
+    COMMS_Bin_Alarm_Clear_t body = { .lights = lights, .failed = failed };
+    COMMS_Handler_SendBinaryResponse(status, &body, sizeof(body));
+    return;
+  }
+
+  /* Not run at all: the coordinator was busy */
+  if (status != VAL_OK && failed == 0) {
+    COMMS_Handler_SendErrorResponse(msg_id, "alarm", "clear", "Failed to clear alarms");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "alarm", "clear");
+  if (status == VAL_OK) {
+    JSON_Writer_Literal(&writer, RESP_STATUS_OK);
+  } else {
+    reply.status = status;
+    JSON_Writer_Literal(&writer, RESP_STATUS_ERROR "\"Alarm condition still present\"");
+  }
+
+  /* Per light: clear now, or still in alarm */
+  JSON_Writer_Literal(&writer, ",\"cleared\":[");
+  for (uint8_t i = 0, n = 0; i < VAL_LIGHT_COUNT; i++) {
+    if ((lights & ~failed) & (1U << i)) {
+      if (n++ > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Uint(&writer, i + 1U);
+    }
+  }
+  JSON_Writer_Literal(&writer, "],\"failed\":[");
+  for (uint8_t i = 0, n = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (failed & (1U << i)) {
+      if (n++ > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Uint(&writer, i + 1U);
+    }
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send alarm status response
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendAlarmStatusResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  COMMS_Gather_t gather;
+  struct {
+    uint8_t alarms[VAL_LIGHT_COUNT];
+    LED_Driver_AlarmInfo_t info[VAL_LIGHT_COUNT];
+  } state;
+  uint8_t* alarms = state.alarms;
+  LED_Driver_AlarmInfo_t* info = state.info;
+  VAL_Status status;
+
+  /* Get alarm status for all lights; zeroed first, the state is compared bytewise */
+  memset(&state, 0, sizeof(state));
+  status = SYS_Coordinator_GetAlarmStatus(alarms);
+  for (int i = 0; i < VAL_LIGHT_COUNT && status == VAL_OK; i++) {
+    status = SYS_Coordinator_GetAlarmInfo(i + 1, &info[i]);
+  }
+
+  if (reply.binary) {
+    uint8_t body[VAL_LIGHT_COUNT * (1 + sizeof(COMMS_Bin_Alarm_Info_t))];
+    COMMS_Bin_Alarm_Info_t packed[VAL_LIGHT_COUNT];
+
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      packed[i].state = (uint8_t)info[i].state;
+      packed[i].trip_count = info[i].trip_count;
+    }
+    memcpy(body, state.alarms, sizeof(state.alarms));
+    memcpy(&body[sizeof(state.alarms)], packed, sizeof(packed));
+    COMMS_Handler_SendBinaryResponse(status, body, sizeof(body));
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "alarm", "status", "Failed to retrieve alarm status");
+    return;
+  }
+
+  /* Format response */
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginGather(&gather, msg_id, "alarm", "status", RESP_STATUS_OK ",\"active_alarms\":[");
+  if (!COMMS_Handler_FragmentCurrent(&alarms_fragment, &state, sizeof(state), &writer)) {
+    /* Add active alarms to the response */
+    int alarm_count = 0;
+
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      if (alarms[i] != 0) {
+        /* Add comma separator for subsequent entries */
+        if (alarm_count > 0) {
+          JSON_Writer_Char(&writer, ',');
+        }
+
+        JSON_Writer_Literal(&writer, "{\"light\":");
+        JSON_Writer_Uint(&writer, i + 1);
+        JSON_Writer_Literal(&writer, ",\"code\":");
+        JSON_Writer_String(&writer, COMMS_Handler_ErrorName(alarms[i]));
+        JSON_Writer_Char(&writer, '}');
+
+        alarm_count++;
+      }
+    }
+    JSON_Writer_Char(&writer, ']');
+
+    /* Alarm state machine of every light */
+    JSON_Writer_Literal(&writer, ",\"lights\":[");
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      if (i > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Literal(&writer, "{\"light\":");
+      JSON_Writer_Uint(&writer, i + 1);
+      JSON_Writer_Literal(&writer, ",\"state\":");
+      JSON_Writer_String(&writer, COMMS_Handler_AlarmStateName(info[i].state));
+      JSON_Writer_Literal(&writer, ",\"trips\":");
+      JSON_Writer_Uint(&writer, info[i].trip_count);
+      JSON_Writer_Literal(&writer, ",\"recover_in_ms\":");
+      JSON_Writer_Uint(&writer, info[i].recover_in_ms);
+      JSON_Writer_Char(&writer, '}');
+    }
+    JSON_Writer_Char(&writer, ']');
+    COMMS_Handler_EndFragment(&alarms_fragment, &writer);
+  }
+  COMMS_Handler_GatherFragment(&gather, &alarms_fragment);
+
+  /* Send response */
+  COMMS_Handler_EndGather(&gather, probe_start);
+}
+
+/**
+ * @brief Send one page of the persistent alarm history, newest first
+ * @note  The flash log is walked in place; only the entries of the page are
+ *        kept, so any length of history costs one bounded response
+ * @param msgId Original message ID
+ * @param args "from", "limit", "since" and "until" of the request
+ * @retval None
+ */
+static void COMMS_Handler_SendAlarmHistoryResponse(const char* msg_id, const COMMS_Command_Args_t* args) {
+  JSON_Writer_t writer;
+  ErrorLogEntry_t entries[HISTORY_BIN_ENTRIES];
+  COMMS_History_Page_t page;
+  uint8_t page_size = reply.binary ? HISTORY_BIN_ENTRIES : HISTORY_JSON_ENTRIES;
+
+  memset(&page, 0, sizeof(page));
+  page.entries = entries;
+  page.skip = (args->found & COMMAND_ARG_FROM) ? args->from : 0;
+  page.max = (args->found & COMMAND_ARG_LIMIT && args->limit < page_size) ? args->limit : page_size;
+  page.since = (args->found & COMMAND_ARG_SINCE) ? args->since : 0;
+  page.until = (args->found & COMMAND_ARG_UNTIL) ? args->until : UINT32_MAX;
+  VAL_DataStore_VisitErrorLogs(COMMS_Handler_VisitHistory, &page);
+
+  if (reply.binary) {
+    uint8_t body[2 * sizeof(uint16_t) + HISTORY_BIN_ENTRIES * sizeof(COMMS_Bin_History_Entry_t)];
+    uint16_t from = (uint16_t)((page.skip > UINT16_MAX) ? UINT16_MAX : page.skip);
+    size_t length = 2 * sizeof(uint16_t);
+
+    memcpy(&body[0], &page.total, sizeof(page.total));
+    memcpy(&body[2], &from, sizeof(from));
+    for (uint8_t i = 0; i < page.count; i++) {
+      COMMS_Bin_History_Entry_t entry;
+
+      entry.timestamp = entries[i].timestamp;
+      entry.source = entries[i].light_id;
+      entry.error_type = entries[i].error_type;
+      entry.value_milli = (int32_t)(entries[i].measured_value * 1000.0f);
+      entry.action = entries[i].action_taken;
+      memcpy(&body[length], &entry, sizeof(entry));
+      length += sizeof(entry);
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, length);
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "alarm", "history");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"total\":");
+  JSON_Writer_Uint(&writer, page.total);
+  JSON_Writer_Literal(&writer, ",\"from\":");
+  JSON_Writer_Uint(&writer, page.skip);
+  JSON_Writer_Literal(&writer, ",\"entries\":[");
+  for (uint8_t i = 0; i < page.count; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"timestamp\":");
+    JSON_Writer_Uint(&writer, entries[i].timestamp);
+    JSON_Writer_Literal(&writer, ",\"code\":");
+    JSON_Writer_String(&writer, COMMS_Handler_ErrorName(entries[i].error_type));
+    JSON_Writer_Literal(&writer, ",\"source\":");
+    JSON_Writer_Uint(&writer, entries[i].light_id);
+    JSON_Writer_Literal(&writer, ",\"value\":");
+    JSON_Writer_Fixed(&writer, entries[i].measured_value, 1);
+    JSON_Writer_Literal(&writer, ",\"action\":");
+    JSON_Writer_String(&writer, COMMS_Handler_ActionName(entries[i].action_taken));
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "alarm", "history", "Response too long");
+  }
+}
+
+/**
+ * @brief Send the alarm recorder state and the summary of the last recording
+ * @note  JSON reports the current and temperature inputs of the light that
+ *        tripped; the binary body has every channel
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendRecordingResponse(const char* msg_id) {
+  /* Indexed by Recorder_State_t, the COMMS_RECORDER_* values */
+  static const char* const state_names[] = { "off", "armed", "recording", "done" };
+  JSON_Writer_t writer;
+  Recorder_Status_t recorder;
+
+  Recorder_GetStatus(&recorder);
+  const Recorder_Summary_t* summary = &recorder.summary;
+
+  if (reply.binary) {
+    COMMS_Bin_Recording_t body;
+
+    memset(&body, 0, sizeof(body));
+    body.state = (uint8_t)recorder.state;
+    body.flags = (recorder.recorded ? COMMS_RECORDING_RECORDED : 0) | (recorder.stored ? COMMS_RECORDING_STORED : 0);
+    if (recorder.recorded) {
+      const Recorder_Window_t* before = &summary->windows[RECORDER_WINDOW_BEFORE];
+      const Recorder_Window_t* after = &summary->windows[RECORDER_WINDOW_AFTER];
+
+      body.boot = summary->boot;
+      body.trip_ms = summary->trip_ms;
+      body.first_sample = summary->first_sample;
+      body.pre_scans = summary->pre_scans;
+      body.post_scans = summary->post_scans;
+      body.rate_hz = summary->rate_hz;
+      body.light_id = summary->light_id;
+      body.error_type = summary->code;
+      memcpy(body.before[0], before->min, sizeof(body.before[0]));
+      memcpy(body.before[1], before->mean, sizeof(body.before[1]));
+      memcpy(body.before[2], before->max, sizeof(body.before[2]));
+      memcpy(body.after[0], after->min, sizeof(body.after[0]));
+      memcpy(body.after[1], after->mean, sizeof(body.after[1]));
+      memcpy(body.after[2], after->max, sizeof(body.after[2]));
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, &body, sizeof(body));
+    return;
+  }
+
+  /* Format response */
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "alarm", "recording");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"state\":");
+  JSON_Writer_String(&writer, state_names[recorder.state]);
+  JSON_Writer_Literal(&writer, ",\"recorded\":");
+  JSON_Writer_Bool(&writer, recorder.recorded);
+  if (recorder.recorded) {
+    JSON_Writer_Literal(&writer, ",\"stored\":");
+    JSON_Writer_Bool(&writer, recorder.stored);
+    JSON_Writer_Literal(&writer, ",\"boot\":");
+    JSON_Writer_Uint(&writer, summary->boot);
+    JSON_Writer_Literal(&writer, ",\"trip_ms\":");
+    JSON_Writer_Uint(&writer, summary->trip_ms);
+    JSON_Writer_Literal(&writer, ",\"light\":");
+    JSON_Writer_Uint(&writer, summary->light_id);
+    JSON_Writer_Literal(&writer, ",\"code\":");
+    JSON_Writer_String(&writer, COMMS_Handler_ErrorName(summary->code));
+    JSON_Writer_Literal(&writer, ",\"first_sample\":");
+    JSON_Writer_Uint(&writer, summary->first_sample);
+    JSON_Writer_Literal(&writer, ",\"pre\":");
+    JSON_Writer_Uint(&writer, summary->pre_scans);
+    JSON_Writer_Literal(&writer, ",\"post\":");
+    JSON_Writer_Uint(&writer, summary->post_scans);
+    JSON_Writer_Literal(&writer, ",\"rate_hz\":");
+    JSON_Writer_Uint(&writer, summary->rate_hz);
+
+    /* [min, mean, max] in raw counts, before and from the trip */
+    if (summary->light_id >= 1 && summary->light_id <= VAL_LIGHT_COUNT) {
+      const VAL_Channel_t* channel = &VAL_Channels[summary->light_id - 1];
+      const uint8_t ranks[2] = { channel->current_rank, channel->temperature_rank };
+      static const char* const inputs[2] = { "current", "temperature" };
+
+      for (uint8_t n = 0; n < 2; n++) {
+        JSON_Writer_Literal(&writer, ",\"");
+        JSON_Writer_Text(&writer, inputs[n]);
+        JSON_Writer_Literal(&writer, "\":{");
+        for (uint8_t w = 0; w < RECORDER_WINDOW_COUNT; w++) {
+          const Recorder_Window_t* window = &summary->windows[w];
+
+          if (w == RECORDER_WINDOW_BEFORE) {
+            JSON_Writer_Literal(&writer, "\"before\":[");
+          } else {
+            JSON_Writer_Literal(&writer, ",\"after\":[");
+          }
+          JSON_Writer_Uint(&writer, window->min[ranks[n]]);
+          JSON_Writer_Char(&writer, ',');
+          JSON_Writer_Uint(&writer, window->mean[ranks[n]]);
+          JSON_Writer_Char(&writer, ',');
+          JSON_Writer_Uint(&writer, window->max[ranks[n]]);
+          JSON_Writer_Char(&writer, ']');
+        }
+        JSON_Writer_Char(&writer, '}');
+      }
+    }
+  }
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Count an alarm history entry and keep it if it is on the page
+ * @param entry Logged event
+ * @param context COMMS_History_Page_t
+ * @retval bool true, every match is counted for the total
+ */
+static bool COMMS_Handler_VisitHistory(const ErrorLogEntry_t* entry, void* context) {
+  COMMS_History_Page_t* page = (COMMS_History_Page_t*)context;
+
+  if (entry->timestamp < page->since || entry->timestamp > page->until) {
+    return true;
+  }
+
+  if (page->total >= page->skip && page->count < page->max) {
+    page->entries[page->count++] = *entry;
+  }
+  if (page->total < UINT16_MAX) {
+    page->total++;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Get the protocol name of an error log action
+ * @param action Action taken (VAL_DATA_STORE_ACTION_x)
+ * @retval const char* Action name
+ */
+static const char* COMMS_Handler_ActionName(uint8_t action) {
+  switch (action) {
+    case VAL_DATA_STORE_ACTION_LIGHT_DISABLED:
+      return "disabled";
+    case VAL_DATA_STORE_ACTION_RESET:
+      return "reset";
+    default:
+      return "none";
+  }
+}
+
+/**
+ * @brief Send a generic error response
+ * @param msgId Original message ID
+ * @param topic Message topic
+ * @param action Message action
+ * @param message Error message
+ * @retval None
+ */
+static void COMMS_Handler_SendErrorResponse(const char* msg_id, const char* topic, const char* action, const char* message) {
+  JSON_Writer_t writer;
+
+  reply.status = VAL_ERROR;
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(VAL_ERROR, NULL, 0);
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponseFor(&writer, msg_id, topic, action);
+  JSON_Writer_Literal(&writer, RESP_STATUS_ERROR);
+  JSON_Writer_String(&writer, message);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send a response asking the host to resend the command later
+ * @param msgId Original message ID
+ * @param topic Message topic
+ * @param action Message action
+ * @retval None
+ */
+static void COMMS_Handler_SendBusyResponse(const char* msg_id, const char* topic, const char* action) {
+  JSON_Writer_t writer;
+
+  reply.status = VAL_BUSY;
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(VAL_BUSY, NULL, 0);
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponseFor(&writer, msg_id, topic, action);
+  JSON_Writer_Literal(&writer, RESP_STATUS_BUSY);
+  JSON_Writer_Uint(&writer, COMMS_PIPELINE_RETRY_MS);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send profiler statistics response
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendPerfResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  Profiler_Stats_t stats;
+
+  if (reply.binary) {
+    COMMS_Bin_Probe_t probes[PROFILER_PROBE_COUNT];
+
+    for (int i = 0; i < PROFILER_PROBE_COUNT; i++) {
+      Profiler_GetStats((Profiler_Probe_t)i, &stats);
+      probes[i].count = stats.count;
+      probes[i].min_us = stats.min_us;
+      probes[i].max_us = stats.max_us;
+      probes[i].avg_us = stats.avg_us;
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, probes, sizeof(probes));
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "perf");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"probes\":[");
+
+  /* Add one entry per probe */
+  for (int i = 0; i < PROFILER_PROBE_COUNT; i++) {
+    Profiler_GetStats((Profiler_Probe_t)i, &stats);
+
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"name\":");
+    JSON_Writer_String(&writer, Profiler_GetName((Profiler_Probe_t)i));
+    JSON_Writer_Literal(&writer, ",\"count\":");
+    JSON_Writer_Uint(&writer, stats.count);
+    JSON_Writer_Literal(&writer, ",\"min_us\":");
+    JSON_Writer_Uint(&writer, stats.min_us);
+    JSON_Writer_Literal(&writer, ",\"max_us\":");
+    JSON_Writer_Uint(&writer, stats.max_us);
+    JSON_Writer_Literal(&writer, ",\"avg_us\":");
+    JSON_Writer_Uint(&writer, stats.avg_us);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "perf", "Response too long");
+  }
+}
+
+/**
+ * @brief Send start-up timeline response
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendBootTimeResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  uint32_t time_us;
+
+  if (reply.binary) {
+    uint32_t times[BOOT_STAGE_COUNT];
+
+    /* Stages not reached yet read as 0xFFFFFFFF */
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+      if (Boot_GetTime((Boot_Stage_t)i, &times[i]) != VAL_OK) {
+        times[i] = UINT32_MAX;
+      }
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, times, sizeof(times));
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "boot_time");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"stages\":[");
+
+  /* Add one entry per completed stage, in start-up order */
+  bool first = true;
+  for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+    if (Boot_GetTime((Boot_Stage_t)i, &time_us) != VAL_OK) {
+      continue;
+    }
+
+    if (!first) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    first = false;
+    JSON_Writer_Literal(&writer, "{\"name\":");
+    JSON_Writer_String(&writer, Boot_GetName((Boot_Stage_t)i));
+    JSON_Writer_Literal(&writer, ",\"us\":");
+    JSON_Writer_Uint(&writer, time_us);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send task stack and heap usage response
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendResourcesResponse(const char* msg_id) {
+  static Resources_Task_t tasks[RESOURCES_MAX_TASKS];  /* Comms task only */
+  JSON_Writer_t writer;
+  Resources_Heap_t heap;
+  Integrity_Result_t integrity[INTEGRITY_CHECK_COUNT];
+  VAL_DataStore_Wear_t wear;
+  uint32_t erases = 0;
+  const char* overflow = Resources_GetStackOverflow();
+  uint8_t count = Resources_GetTasks(tasks, RESOURCES_MAX_TASKS);
+
+  Resources_GetHeap(&heap);
+  (void)Integrity_GetResults(integrity);
+  VAL_DataStore_GetWear(&wear);
+
+  if (reply.binary) {
+    uint8_t body[COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE - 1];
+    size_t length = 0;
+    size_t name_length = (overflow != NULL) ? strlen(overflow) : 0;
+    uint8_t* task_count;
+
+    memcpy(&body[length], &heap.free, sizeof(heap.free));
+    length += sizeof(heap.free);
+    memcpy(&body[length], &heap.min_free, sizeof(heap.min_free));
+    length += sizeof(heap.min_free);
+    if (overflow != NULL) {
+      memcpy(&body[length], overflow, name_length);
+      length += name_length;
+    }
+    body[length++] = '\0';
+    memcpy(&body[length], integrity, sizeof(integrity));
+    length += sizeof(integrity);
+    COMMS_Bin_FlashWear_t flash = {
+      VAL_DataStore_GetBaseAddress(), VAL_DataStore_GetGeneration(), {0}, wear.erase_total_us, wear.writes,
+      wear.write_total_us, wear.write_max_us, wear.queued, wear.queued_max, wear.queue_full
+    };
+    memcpy(flash.page_erases, wear.page_erases, sizeof(flash.page_erases));
+    memcpy(&body[length], &flash, sizeof(flash));
+    length += sizeof(flash);
+    task_count = &body[length++];
+    *task_count = 0;
+
+    /* As many tasks as fit */
+    for (uint8_t i = 0; i < count; i++) {
+      uint16_t stack_free = (uint16_t)tasks[i].stack_free;
+
+      name_length = strlen(tasks[i].name);
+      if (length + sizeof(stack_free) + name_length + 1 > sizeof(body)) {
+        break;
+      }
+      memcpy(&body[length], &stack_free, sizeof(stack_free));
+      length += sizeof(stack_free);
+      memcpy(&body[length], tasks[i].name, name_length + 1);
+      length += name_length + 1;
+      (*task_count)++;
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, length);
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "resources");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"heap_free\":");
+  JSON_Writer_Uint(&writer, heap.free);
+  JSON_Writer_Literal(&writer, ",\"heap_min_free\":");
+  JSON_Writer_Uint(&writer, heap.min_free);
+  JSON_Writer_Literal(&writer, ",\"stack_overflow\":");
+  if (overflow != NULL) {
+    JSON_Writer_String(&writer, overflow);
+  } else {
+    JSON_Writer_Literal(&writer, "null");
+  }
+  JSON_Writer_Literal(&writer, ",\"integrity\":{");
+
+  /* Add one object per background check */
+  for (uint8_t i = 0; i < INTEGRITY_CHECK_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_String(&writer, Integrity_GetCheckName((Integrity_Check_t)i));
+    JSON_Writer_Literal(&writer, ":{\"bytes\":");
+    JSON_Writer_Uint(&writer, integrity[i].bytes);
+    JSON_Writer_Literal(&writer, ",\"passes\":");
+    JSON_Writer_Uint(&writer, integrity[i].passes);
+    JSON_Writer_Literal(&writer, ",\"errors\":");
+    JSON_Writer_Uint(&writer, integrity[i].errors);
+    JSON_Writer_Literal(&writer, ",\"crc\":");
+    JSON_Writer_Uint(&writer, integrity[i].crc);
+    JSON_Writer_Literal(&writer, ",\"pass_ms\":");
+    JSON_Writer_Uint(&writer, integrity[i].pass_ms);
+    JSON_Writer_Literal(&writer, ",\"age_ms\":");
+    JSON_Writer_Uint(&writer, integrity[i].age_ms);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Literal(&writer, "},\"flash\":{\"generation\":");
+  JSON_Writer_Uint(&writer, VAL_DataStore_GetGeneration());
+  JSON_Writer_Literal(&writer, ",\"page_erases\":[");
+  for (uint8_t i = 0; i < VAL_DATA_STORE_PAGES; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Uint(&writer, wear.page_erases[i]);
+    erases += wear.page_erases[i];
+  }
+  JSON_Writer_Literal(&writer, "],\"erase_avg_us\":");
+  JSON_Writer_Uint(&writer, (erases > 0) ? wear.erase_total_us / erases : 0);
+  JSON_Writer_Literal(&writer, ",\"writes\":");
+  JSON_Writer_Uint(&writer, wear.writes);
+  JSON_Writer_Literal(&writer, ",\"write_avg_us\":");
+  JSON_Writer_Uint(&writer, (wear.writes > 0) ? wear.write_total_us / wear.writes : 0);
+  JSON_Writer_Literal(&writer, ",\"write_max_us\":");
+  JSON_Writer_Uint(&writer, wear.write_max_us);
+  JSON_Writer_Literal(&writer, ",\"queued\":");
+  JSON_Writer_Uint(&writer, wear.queued);
+  JSON_Writer_Literal(&writer, ",\"queued_max\":");
+  JSON_Writer_Uint(&writer, wear.queued_max);
+  JSON_Writer_Literal(&writer, ",\"queue_full\":");
+  JSON_Writer_Uint(&writer, wear.queue_full);
+  JSON_Writer_Literal(&writer, "},\"tasks\":[");
+
+  /* Add one entry per task */
+  for (uint8_t i = 0; i < count; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"name\":");
+    JSON_Writer_String(&writer, tasks[i].name);
+    JSON_Writer_Literal(&writer, ",\"stack_free\":");
+    JSON_Writer_Uint(&writer, tasks[i].stack_free);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "resources", "Response too long");
+  }
+}
+
+/**
+ * @brief Send task and interrupt CPU load response
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendCpuResponse(const char* msg_id) {
+  static Resources_Load_t tasks[RESOURCES_MAX_TASKS];  /* Comms task only */
+  static Scheduler_JobStats_t jobs[SCHEDULER_MAX_JOBS];
+  JSON_Writer_t writer;
+  Resources_CpuLoad_t load;
+  Power_Stats_t power;
+  uint8_t count = Resources_GetCpuLoad(&load, tasks, RESOURCES_MAX_TASKS);
+  uint8_t job_count = Scheduler_GetJobs(jobs, SCHEDULER_MAX_JOBS);
+
+  Power_GetStats(&power);
+
+  if (reply.binary) {
+    uint8_t body[COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE - 1];
+    size_t length = 0;
+    uint8_t* task_count;
+
+    memcpy(&body[length], &load.interval_us, sizeof(load.interval_us));
+    length += sizeof(load.interval_us);
+    memcpy(&body[length], load.isr_permille, sizeof(load.isr_permille));
+    length += sizeof(load.isr_permille);
+    memcpy(&body[length], &power.stops, sizeof(power.stops));
+    length += sizeof(power.stops);
+    memcpy(&body[length], &power.stopped_ms, sizeof(power.stopped_ms));
+    length += sizeof(power.stopped_ms);
+    memcpy(&body[length], &power.serial_wakes, sizeof(power.serial_wakes));
+    length += sizeof(power.serial_wakes);
+    memcpy(&body[length], &power.entry_max_us, sizeof(power.entry_max_us));
+    length += sizeof(power.entry_max_us);
+    memcpy(&body[length], &power.exit_max_us, sizeof(power.exit_max_us));
+    length += sizeof(power.exit_max_us);
+    body[length++] = job_count;
+    for (uint8_t i = 0; i < job_count; i++) {
+      COMMS_Bin_Job_t job = { jobs[i].runs, jobs[i].skipped, jobs[i].total_us, jobs[i].max_us };
+
+      memcpy(&body[length], &job, sizeof(job));
+      length += sizeof(job);
+    }
+    task_count = &body[length++];
+    *task_count = 0;
+
+    /* As many tasks as fit */
+    for (uint8_t i = 0; i < count; i++) {
+      size_t name_length = strlen(tasks[i].name);
+
+      if (length + sizeof(tasks[i].permille) + name_length + 1 > sizeof(body)) {
+        break;
+      }
+      memcpy(&body[length], &tasks[i].permille, sizeof(tasks[i].permille));
+      length += sizeof(tasks[i].permille);
+      memcpy(&body[length], tasks[i].name, name_length + 1);
+      length += name_length + 1;
+      (*task_count)++;
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, length);
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "cpu");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"interval_us\":");
+  JSON_Writer_Uint(&writer, load.interval_us);
+  JSON_Writer_Literal(&writer, ",\"interrupts\":[");
+
+  /* Add one entry per interrupt, then per task */
+  for (uint8_t i = 0; i < RESOURCES_ISR_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"name\":");
+    JSON_Writer_String(&writer, Resources_GetIsrName((Resources_Isr_t)i));
+    JSON_Writer_Literal(&writer, ",\"percent\":");
+    JSON_Writer_Fixed(&writer, load.isr_permille[i] / 10.0f, 1);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Literal(&writer, "],\"stop\":{\"count\":");
+  JSON_Writer_Uint(&writer, power.stops);
+  JSON_Writer_Literal(&writer, ",\"ms\":");
+  JSON_Writer_Uint(&writer, power.stopped_ms);
+  JSON_Writer_Literal(&writer, ",\"serial_wakes\":");
+  JSON_Writer_Uint(&writer, power.serial_wakes);
+  JSON_Writer_Literal(&writer, ",\"entry_max_us\":");
+  JSON_Writer_Uint(&writer, power.entry_max_us);
+  JSON_Writer_Literal(&writer, ",\"exit_max_us\":");
+  JSON_Writer_Uint(&writer, power.exit_max_us);
+  JSON_Writer_Literal(&writer, "},\"clock\":{\"mhz\":");
+  JSON_Writer_Uint(&writer, VAL_SysClock_GetFrequency() / 1000000U);
+  JSON_Writer_Literal(&writer, ",\"changes\":");
+  JSON_Writer_Uint(&writer, power.clock_changes);
+  JSON_Writer_Literal(&writer, "},\"tasks\":[");
+  for (uint8_t i = 0; i < count; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"name\":");
+    JSON_Writer_String(&writer, tasks[i].name);
+    JSON_Writer_Literal(&writer, ",\"percent\":");
+    JSON_Writer_Fixed(&writer, tasks[i].permille / 10.0f, 1);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Literal(&writer, "],\"jobs\":[");
+  for (uint8_t i = 0; i < job_count; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"name\":");
+    JSON_Writer_String(&writer, jobs[i].name);
+    JSON_Writer_Literal(&writer, ",\"period_ms\":");
+    JSON_Writer_Uint(&writer, jobs[i].period_ms);
+    JSON_Writer_Literal(&writer, ",\"runs\":");
+    JSON_Writer_Uint(&writer, jobs[i].runs);
+    JSON_Writer_Literal(&writer, ",\"skipped\":");
+    JSON_Writer_Uint(&writer, jobs[i].skipped);
+    JSON_Writer_Literal(&writer, ",\"total_us\":");
+    JSON_Writer_Uint(&writer, jobs[i].total_us);
+    JSON_Writer_Literal(&writer, ",\"max_us\":");
+    JSON_Writer_Uint(&writer, jobs[i].max_us);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "cpu", "Response too long");
+  }
+}
+
+/**
+ * @brief Send trace entries response
+ * @param msgId Original message ID
+ * @param from Sequence number of the first entry wanted
+ * @retval None
+ */
+static void COMMS_Handler_SendTraceResponse(const char* msg_id, uint32_t from) {
+  JSON_Writer_t writer;
+  uint32_t first;
+  uint32_t next = Trace_GetNext();
+
+  if (reply.binary) {
+    uint8_t body[2 * sizeof(uint32_t) + TRACE_BIN_ENTRIES * sizeof(Trace_Entry_t)];
+    uint8_t count = Trace_Read(from, (Trace_Entry_t*)&body[2 * sizeof(uint32_t)],
+                               TRACE_BIN_ENTRIES, &first);
+
+    memcpy(&body[0], &first, sizeof(first));
+    memcpy(&body[sizeof(uint32_t)], &next, sizeof(next));
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, 2 * sizeof(uint32_t) + count * sizeof(Trace_Entry_t));
+    return;
+  }
+
+  Trace_Entry_t entries[TRACE_JSON_ENTRIES];
+  uint8_t count = Trace_Read(from, entries, TRACE_JSON_ENTRIES, &first);
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "trace");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"from\":");
+  JSON_Writer_Uint(&writer, first);
+  JSON_Writer_Literal(&writer, ",\"next\":");
+  JSON_Writer_Uint(&writer, next);
+  JSON_Writer_Literal(&writer, ",\"entries\":[");
+
+  for (uint8_t i = 0; i < count; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    COMMS_Handler_WriteTraceEntry(&writer, &entries[i]);
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "trace", "Response too long");
+  }
+}
+
+/**
+ * @brief Send the crash report left by the last reset, without its trace
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendCrashReportResponse(const char* msg_id) {
+  const Crash_Report_t* report = Crash_GetReport();
+  JSON_Writer_t writer;
+
+  if (reply.binary) {
+    uint8_t body[COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE - 1];
+    size_t length = 0;
+
+    if (report == NULL) {
+      body[length++] = CRASH_CAUSE_NONE;
+      COMMS_Handler_SendBinaryResponse(VAL_OK, body, length);
+      return;
+    }
+
+    const uint32_t words[] = {
+      report->line, report->tick_ms, report->r[0], report->r[1], report->r[2], report->r[3],
+      report->r[4], report->lr, report->pc, report->xpsr, report->sp, report->cfsr,
+      report->hfsr, report->mmfar, report->bfar
+    };
+    size_t name_length = strlen(report->task);
+    uint8_t* task_count;
+
+    body[length++] = report->cause;
+    body[length++] = report->in_handler;
+    body[length++] = report->trace_count;
+    task_count = &body[length++];
+    *task_count = 0;
+    memcpy(&body[length], words, sizeof(words));
+    length += sizeof(words);
+    memcpy(&body[length], report->task, name_length + 1);
+    length += name_length + 1;
+
+    /* As many tasks as fit */
+    for (uint8_t i = 0; i < report->task_count; i++) {
+      uint16_t stack_free = (uint16_t)report->tasks[i].stack_free;
+
+      name_length = strlen(report->tasks[i].name);
+      if (length + sizeof(stack_free) + name_length + 1 > sizeof(body)) {
+        break;
+      }
+      memcpy(&body[length], &stack_free, sizeof(stack_free));
+      length += sizeof(stack_free);
+      memcpy(&body[length], report->tasks[i].name, name_length + 1);
+      length += name_length + 1;
+      (*task_count)++;
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, length);
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "crash_report");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"cause\":");
+  JSON_Writer_String(&writer, Crash_GetCauseName(report ? (Crash_Cause_t)report->cause : CRASH_CAUSE_NONE));
+
+  if (report != NULL) {
+    JSON_Writer_Literal(&writer, ",\"task\":");
+    JSON_Writer_String(&writer, report->task);
+    if (report->in_handler) {
+      JSON_Writer_Literal(&writer, ",\"in_isr\":true");
+    }
+    if (report->cause == CRASH_CAUSE_ASSERT) {
+      JSON_Writer_Literal(&writer, ",\"line\":");
+      JSON_Writer_Uint(&writer, report->line);
+    }
+    JSON_Writer_Literal(&writer, ",\"tick_ms\":");
+    JSON_Writer_Uint(&writer, report->tick_ms);
+    JSON_Writer_Literal(&writer, ",\"pc\":");
+    JSON_Writer_Uint(&writer, report->pc);
+    JSON_Writer_Literal(&writer, ",\"lr\":");
+    JSON_Writer_Uint(&writer, report->lr);
+    JSON_Writer_Literal(&writer, ",\"sp\":");
+    JSON_Writer_Uint(&writer, report->sp);
+    JSON_Writer_Literal(&writer, ",\"xpsr\":");
+    JSON_Writer_Uint(&writer, report->xpsr);
+    JSON_Writer_Literal(&writer, ",\"r\":[");
+    for (uint8_t i = 0; i < sizeof(report->r) / sizeof(report->r[0]); i++) {
+      if (i > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Uint(&writer, report->r[i]);
+    }
+    JSON_Writer_Literal(&writer, "],\"cfsr\":");
+    JSON_Writer_Uint(&writer, report->cfsr);
+    JSON_Writer_Literal(&writer, ",\"hfsr\":");
+    JSON_Writer_Uint(&writer, report->hfsr);
+    JSON_Writer_Literal(&writer, ",\"mmfar\":");
+    JSON_Writer_Uint(&writer, report->mmfar);
+    JSON_Writer_Literal(&writer, ",\"bfar\":");
+    JSON_Writer_Uint(&writer, report->bfar);
+
+    /* Least free stack bytes by task name */
+    JSON_Writer_Literal(&writer, ",\"stack_free\":{");
+    for (uint8_t i = 0; i < report->task_count; i++) {
+      if (i > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_String(&writer, report->tasks[i].name);
+      JSON_Writer_Char(&writer, ':');
+      JSON_Writer_Uint(&writer, report->tasks[i].stack_free);
+    }
+    JSON_Writer_Literal(&writer, "},\"trace_from\":");
+    JSON_Writer_Uint(&writer, report->trace_first);
+    JSON_Writer_Literal(&writer, ",\"trace_count\":");
+    JSON_Writer_Uint(&writer, report->trace_count);
+  }
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "crash_report", "Response too long");
+  }
+}
+
+/**
+ * @brief Send the trace entries kept with the crash report
+ * @param msgId Original message ID
+ * @param from Sequence number of the first entry wanted
+ * @retval None
+ */
+static void COMMS_Handler_SendCrashTraceResponse(const char* msg_id, uint32_t from) {
+  const Crash_Report_t* report = Crash_GetReport();
+  uint32_t first = 0;
+  uint32_t next = 0;
+  uint8_t start = 0;
+  uint8_t count = 0;
+  JSON_Writer_t writer;
+
+  if (report != NULL) {
+    first = report->trace_first;
+    next = first + report->trace_count;
+    if (from > first) {
+      first = (from < next) ? from : next;
+    }
+    start = (uint8_t)(first - report->trace_first);
+    count = (uint8_t)(next - first);
+  }
+
+  if (reply.binary) {
+    uint8_t body[2 * sizeof(uint32_t) + CRASH_TRACE_ENTRIES * sizeof(Trace_Entry_t)];
+
+    memcpy(&body[0], &first, sizeof(first));
+    memcpy(&body[sizeof(uint32_t)], &next, sizeof(next));
+    if (count > 0) {
+      memcpy(&body[2 * sizeof(uint32_t)], &report->trace[start], count * sizeof(Trace_Entry_t));
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, 2 * sizeof(uint32_t) + count * sizeof(Trace_Entry_t));
+    return;
+  }
+
+  if (count > TRACE_JSON_ENTRIES) {
+    count = TRACE_JSON_ENTRIES;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "crash_report");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"from\":");
+  JSON_Writer_Uint(&writer, first);
+  JSON_Writer_Literal(&writer, ",\"next\":");
+  JSON_Writer_Uint(&writer, next);
+  JSON_Writer_Literal(&writer, ",\"entries\":[");
+  for (uint8_t i = 0; i < count; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    COMMS_Handler_WriteTraceEntry(&writer, &report->trace[start + i]);
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "crash_report", "Response too long");
+  }
+}
+
+/**
+ * @brief Write a trace entry as a JSON object
+ * @param writer Writer to append to
+ * @param entry Entry to write
+ * @retval None
+ */
+static void COMMS_Handler_WriteTraceEntry(JSON_Writer_t* writer, const Trace_Entry_t* entry) {
+  JSON_Writer_Literal(writer, "{\"us\":");
+  JSON_Writer_Uint(writer, entry->time_us);
+
+  if (entry->type == TRACE_TYPE_ALARM) {
+    JSON_Writer_Literal(writer, ",\"light\":");
+    JSON_Writer_Uint(writer, entry->code);
+    JSON_Writer_Literal(writer, ",\"state\":");
+    JSON_Writer_String(writer, COMMS_Handler_AlarmStateName((LED_Driver_AlarmState_t)entry->status));
+    JSON_Writer_Literal(writer, ",\"error\":");
+    JSON_Writer_String(writer, COMMS_Handler_ErrorName(entry->detail));
+  } else {
+    uint8_t index = bin_command_index[entry->code];
+
+    JSON_Writer_Literal(writer, ",\"topic\":");
+    JSON_Writer_String(writer, (index != COMMAND_SLOT_EMPTY) ? command_table[index].topic : "unknown");
+    JSON_Writer_Literal(writer, ",\"action\":");
+    JSON_Writer_String(writer, (index != COMMAND_SLOT_EMPTY) ? command_table[index].action : "unknown");
+    JSON_Writer_Literal(writer, ",\"status\":");
+    JSON_Writer_Uint(writer, entry->status);
+    if (entry->detail) {
+      JSON_Writer_Literal(writer, ",\"binary\":true");
+    }
+    JSON_Writer_Literal(writer, ",\"us\":");
+    JSON_Writer_Uint(writer, VAL_SysClock_CyclesToMicros(entry->cycles));
+  }
+  JSON_Writer_Char(writer, '}');
+}
+
+/**
+ * @brief Send the scheduler trace state, its cost and the task numbers
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendKernelTraceResponse(const char* msg_id) {
+  static Resources_Task_t tasks[RESOURCES_MAX_TASKS];  /* Comms task only */
+  JSON_Writer_t writer;
+  Trace_KernelStatus_t status;
+  uint32_t clock_hz = VAL_SysClock_GetFrequency();
+  uint8_t count = Resources_GetTasks(tasks, RESOURCES_MAX_TASKS);
+  float elapsed_cycles;
+  float load = 0.0f;
+
+  Trace_KernelGetStatus(&status);
+  elapsed_cycles = (float)status.elapsed_us * ((float)clock_hz / 1000000.0f);
+  if (elapsed_cycles > 0.0f) {
+    load = (float)status.cost_cycles / elapsed_cycles;
+  }
+
+  if (reply.binary) {
+    uint8_t body[COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE - 1];
+    COMMS_Bin_KernelTrace_t header;
+    size_t length = 0;
+    uint8_t* task_count;
+
+    header.enabled = status.enabled ? 1U : 0U;
+    header.next = status.next;
+    header.clock_hz = clock_hz;
+    header.records = status.records;
+    header.cost_cycles = status.cost_cycles;
+    header.elapsed_us = status.elapsed_us;
+    header.load_ppm = (uint32_t)(load * 1000000.0f + 0.5f);
+    memcpy(&body[length], &header, sizeof(header));
+    length += sizeof(header);
+    task_count = &body[length++];
+    *task_count = 0;
+
+    /* As many tasks as fit */
+    for (uint8_t i = 0; i < count; i++) {
+      size_t name_length = strlen(tasks[i].name);
+
+      if (length + 1 + name_length + 1 > sizeof(body)) {
+        break;
+      }
+      body[length++] = tasks[i].number;
+      memcpy(&body[length], tasks[i].name, name_length + 1);
+      length += name_length + 1;
+      (*task_count)++;
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, length);
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "kernel_trace");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"enabled\":");
+  if (status.enabled) {
+    JSON_Writer_Literal(&writer, "true");
+  } else {
+    JSON_Writer_Literal(&writer, "false");
+  }
+  JSON_Writer_Literal(&writer, ",\"next\":");
+  JSON_Writer_Uint(&writer, status.next);
+  JSON_Writer_Literal(&writer, ",\"clock_hz\":");
+  JSON_Writer_Uint(&writer, clock_hz);
+  JSON_Writer_Literal(&writer, ",\"records\":");
+  JSON_Writer_Uint(&writer, status.records);
+  JSON_Writer_Literal(&writer, ",\"cost_cycles\":");
+  JSON_Writer_Uint64(&writer, status.cost_cycles);
+  JSON_Writer_Literal(&writer, ",\"cycles_per_record\":");
+  JSON_Writer_Uint(&writer, (status.records > 0) ? (uint32_t)(status.cost_cycles / status.records) : 0);
+  JSON_Writer_Literal(&writer, ",\"elapsed_us\":");
+  JSON_Writer_Uint64(&writer, status.elapsed_us);
+  JSON_Writer_Literal(&writer, ",\"load_permille\":");
+  JSON_Writer_Fixed(&writer, load * 1000.0f, 2);
+  JSON_Writer_Literal(&writer, ",\"tasks\":[");
+
+  /* Names for the task numbers in the entries */
+  for (uint8_t i = 0; i < count; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"number\":");
+    JSON_Writer_Uint(&writer, tasks[i].number);
+    JSON_Writer_Literal(&writer, ",\"name\":");
+    JSON_Writer_String(&writer, tasks[i].name);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "kernel_trace", "Response too long");
+  }
+}
+
+/**
+ * @brief Send scheduler trace entries response
+ * @param msgId Original message ID
+ * @param from Sequence number of the first entry wanted
+ * @retval None
+ */
+static void COMMS_Handler_SendKernelEntriesResponse(const char* msg_id, uint32_t from) {
+  static const char* const event_names[] = {
+    "unknown", "switch_in", "switch_out", "isr_enter", "isr_exit",
+    "block_receive", "block_send", "block_notify", "inherit", "disinherit"
+  };
+  JSON_Writer_t writer;
+  uint32_t first;
+  Trace_KernelStatus_t status;
+
+  Trace_KernelGetStatus(&status);
+
+  if (reply.binary) {
+    uint8_t body[2 * sizeof(uint32_t) + KERNEL_TRACE_BIN_ENTRIES * sizeof(Trace_KernelEntry_t)];
+    uint8_t count = Trace_KernelRead(from, (Trace_KernelEntry_t*)&body[2 * sizeof(uint32_t)],
+                                     KERNEL_TRACE_BIN_ENTRIES, &first);
+
+    memcpy(&body[0], &first, sizeof(first));
+    memcpy(&body[sizeof(uint32_t)], &status.next, sizeof(status.next));
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, 2 * sizeof(uint32_t) + count * sizeof(Trace_KernelEntry_t));
+    return;
+  }
+
+  Trace_KernelEntry_t entries[KERNEL_TRACE_JSON_ENTRIES];
+  uint8_t count = Trace_KernelRead(from, entries, KERNEL_TRACE_JSON_ENTRIES, &first);
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "kernel_trace");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"from\":");
+  JSON_Writer_Uint(&writer, first);
+  JSON_Writer_Literal(&writer, ",\"next\":");
+  JSON_Writer_Uint(&writer, status.next);
+  JSON_Writer_Literal(&writer, ",\"entries\":[");
+
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t event = entries[i].event;
+
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"cycles\":");
+    JSON_Writer_Uint(&writer, entries[i].cycles);
+    JSON_Writer_Literal(&writer, ",\"event\":");
+    JSON_Writer_String(&writer, event_names[(event < sizeof(event_names) / sizeof(event_names[0])) ? event : 0]);
+    JSON_Writer_Literal(&writer, ",\"task\":");
+    JSON_Writer_Uint(&writer, entries[i].task);
+    JSON_Writer_Literal(&writer, ",\"object\":");
+    JSON_Writer_Uint(&writer, entries[i].object);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "kernel_trace", "Response too long");
+  }
+}
+
+/**
+ * @brief Send the latency figures and clear those sent
+ * @note  The transports go with the first page only. Commands follow from
+ *        "from" on, those measured since the last read only, as many as
+ *        fit; the rest keep their figures for the next page.
+ * @param msg_id Original message ID
+ * @param from Command table index to go on from
+ * @retval None
+ */
+static void COMMS_Handler_SendLatencyResponse(const char* msg_id, uint32_t from) {
+  JSON_Writer_t writer;
+  Latency_Summary_t summary;
+  uint32_t total = COMMAND_TABLE_SIZE;
+  uint32_t first = (from < total) ? from : total;
+  uint32_t index = COMMS_Handler_NextLatency(first);
+  uint8_t listed = 0;
+
+  if (reply.binary) {
+    uint8_t body[sizeof(COMMS_Bin_Latency_t) +
+                 (TRANSPORT_COUNT + LATENCY_BIN_COMMANDS) * sizeof(COMMS_Bin_LatencyEntry_t)];
+    COMMS_Bin_Latency_t header = { (uint8_t)total, 0, 0, 0 };
+    size_t length = sizeof(header);
+
+    if (first == 0) {
+      for (uint8_t i = 0; i < TRANSPORT_COUNT; i++) {
+        Latency_TakeTransport((Transport_Id_t)i, &summary);
+        length += COMMS_Handler_PackLatency(&body[length], i, &summary);
+      }
+      header.transports = TRANSPORT_COUNT;
+    }
+    while (index < total && header.commands < LATENCY_BIN_COMMANDS) {
+      Latency_TakeCommand((uint8_t)index, &summary);
+      length += COMMS_Handler_PackLatency(&body[length], command_table[index].bin_code, &summary);
+      header.commands++;
+      index = COMMS_Handler_NextLatency(index + 1U);
+    }
+    header.next = (uint8_t)index;
+    memcpy(body, &header, sizeof(header));
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, length);
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "latency");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"total\":");
+  JSON_Writer_Uint(&writer, total);
+  JSON_Writer_Literal(&writer, ",\"from\":");
+  JSON_Writer_Uint(&writer, first);
+  if (first == 0) {
+    JSON_Writer_Literal(&writer, ",\"transports\":[");
+    for (uint8_t i = 0; i < TRANSPORT_COUNT; i++) {
+      if (i > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      Latency_TakeTransport((Transport_Id_t)i, &summary);
+      JSON_Writer_Literal(&writer, "{\"name\":");
+      JSON_Writer_String(&writer, Transport_GetName((Transport_Id_t)i));
+      COMMS_Handler_WriteLatency(&writer, &summary);
+    }
+    JSON_Writer_Char(&writer, ']');
+  }
+  JSON_Writer_Literal(&writer, ",\"commands\":[");
+  while (index < total && listed < LATENCY_JSON_COMMANDS) {
+    const COMMS_Command_t* command = &command_table[index];
+
+    if (listed > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    Latency_TakeCommand((uint8_t)index, &summary);
+    JSON_Writer_Literal(&writer, "{\"topic\":");
+    JSON_Writer_String(&writer, command->topic);
+    JSON_Writer_Literal(&writer, ",\"action\":");
+    JSON_Writer_String(&writer, command->action);
+    COMMS_Handler_WriteLatency(&writer, &summary);
+    listed++;
+    index = COMMS_Handler_NextLatency(index + 1U);
+  }
+  JSON_Writer_Literal(&writer, "],\"next\":");
+  JSON_Writer_Uint(&writer, index);
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "latency", "Response too long");
+  }
+}
+
+/**
+ * @brief Find the next command with latency measurements
+ * @param index Command table index to start looking at
+ * @retval uint32_t Index of the command, COMMAND_TABLE_SIZE if there is none
+ */
+static uint32_t COMMS_Handler_NextLatency(uint32_t index) {
+  while (index < COMMAND_TABLE_SIZE && Latency_GetCommandCount((uint8_t)index) == 0) {
+    index++;
+  }
+
+  return index;
+}
+
+/**
+ * @brief Write the latency figures of one entry and close it
+ * @param writer Writer of the response
+ * @param summary Figures to write
+ * @retval None
+ */
+static void COMMS_Handler_WriteLatency(JSON_Writer_t* writer, const Latency_Summary_t* summary) {
+  JSON_Writer_Literal(writer, ",\"count\":");
+  JSON_Writer_Uint(writer, summary->count);
+  JSON_Writer_Literal(writer, ",\"p50_us\":");
+  JSON_Writer_Uint(writer, summary->p50_us);
+  JSON_Writer_Literal(writer, ",\"p90_us\":");
+  JSON_Writer_Uint(writer, summary->p90_us);
+  JSON_Writer_Literal(writer, ",\"p99_us\":");
+  JSON_Writer_Uint(writer, summary->p99_us);
+  JSON_Writer_Literal(writer, ",\"max_us\":");
+  JSON_Writer_Uint(writer, summary->max_us);
+  JSON_Writer_Char(writer, '}');
+}
+
+/**
+ * @brief Pack the latency figures of one entry for a binary response
+ * @param dest Where to write the entry
+ * @param code Command code or transport number
+ * @param summary Figures to pack
+ * @retval size_t Bytes written
+ */
+static size_t COMMS_Handler_PackLatency(uint8_t* dest, uint8_t code, const Latency_Summary_t* summary) {
+  COMMS_Bin_LatencyEntry_t entry = {
+    code, summary->count, summary->p50_us, summary->p90_us, summary->p99_us, summary->max_us
+  };
+
+  memcpy(dest, &entry, sizeof(entry));
+  return sizeof(entry);
+}
+
+/**
+ * @brief Send response for the log level command
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendLogLevelResponse(const char* msg_id, VAL_Status status) {
+  JSON_Writer_t writer;
+  Logger_Level_t level = Logger_GetLevel();
+
+  if (reply.binary) {
+    uint8_t body = (uint8_t)level;
+    COMMS_Handler_SendBinaryResponse(status, &body, sizeof(body));
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "log_level", "Invalid level");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "log_level");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"level\":");
+  JSON_Writer_String(&writer, Logger_GetLevelName(level));
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for the time sync command
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @param result What the sample did to the clock
+ * @retval None
+ */
+static void COMMS_Handler_SendTimeSyncResponse(const char* msg_id, VAL_Status status,
+                                               const Clock_SyncResult_t* result) {
+  JSON_Writer_t writer;
+  uint64_t time = Clock_GetTime();
+  uint32_t uptime = HAL_GetTick();
+
+  if (reply.binary) {
+    COMMS_Bin_TimeSync_t body;
+
+    body.time = time;
+    body.uptime = uptime;
+    body.offset_ms = result->offset_ms;
+    body.flags = (result->used ? COMMS_TIME_SYNC_USED : 0U) |
+                 (result->stepped ? COMMS_TIME_SYNC_STEPPED : 0U) |
+                 (result->trimmed ? COMMS_TIME_SYNC_TRIMMED : 0U);
+    body.calibration_ppb = result->calibration_ppb;
+    COMMS_Handler_SendBinaryResponse(status, &body, sizeof(body));
+    return;
+  }
+
+  if (status == VAL_BUSY) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "time_sync", "Clock busy");
+    return;
+  }
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "time_sync", "Invalid time");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "time_sync");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"time\":");
+  JSON_Writer_Uint64(&writer, time);
+  JSON_Writer_Literal(&writer, ",\"uptime\":");
+  JSON_Writer_Uint(&writer, uptime);
+  JSON_Writer_Literal(&writer, ",\"offset\":");
+  JSON_Writer_Int(&writer, result->offset_ms);
+  JSON_Writer_Literal(&writer, ",\"used\":");
+  JSON_Writer_Bool(&writer, result->used);
+  JSON_Writer_Literal(&writer, ",\"stepped\":");
+  JSON_Writer_Bool(&writer, result->stepped);
+  JSON_Writer_Literal(&writer, ",\"trimmed\":");
+  JSON_Writer_Bool(&writer, result->trimmed);
+  JSON_Writer_Literal(&writer, ",\"calibration_ppb\":");
+  JSON_Writer_Int(&writer, result->calibration_ppb);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for the update command
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @param size Image size accepted
+ * @retval None
+ */
+static void COMMS_Handler_SendUpdateResponse(const char* msg_id, VAL_Status status, uint32_t size) {
+  JSON_Writer_t writer;
+
+  if (reply.binary) {
+    COMMS_Bin_Update_t body;
+
+    body.size = size;
+    body.chunk = COMMS_UPDATE_CHUNK_MAX;
+    COMMS_Handler_SendBinaryResponse(status, &body, sizeof(body));
+    return;
+  }
+
+  if (status == VAL_BUSY) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "update", "Flash busy");
+    return;
+  }
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "update", "Invalid image");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "update");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"size\":");
+  JSON_Writer_Uint(&writer, size);
+  JSON_Writer_Literal(&writer, ",\"chunk\":");
+  JSON_Writer_Uint(&writer, COMMS_UPDATE_CHUNK_MAX);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send a page of the command table with each command's arguments
+ * @param msgId Original message ID
+ * @param from Index of the first command listed
+ * @retval None
+ */
+static void COMMS_Handler_SendCapabilitiesResponse(const char* msg_id, uint32_t from) {
+  JSON_Writer_t writer;
+  uint32_t total = COMMAND_TABLE_SIZE;
+  uint32_t first = (from < total) ? from : total;
+
+  if (reply.binary) {
+    uint8_t body[sizeof(COMMS_Bin_Capabilities_t) + CAPABILITIES_BIN_COMMANDS * sizeof(COMMS_Bin_Capability_t)];
+    COMMS_Bin_Capabilities_t header;
+    size_t length = sizeof(header);
+
+    header.protocol = COMMS_PROTOCOL_VERSION;
+    header.features = COMMS_FEATURE_JSON | COMMS_FEATURE_BINARY | COMMS_FEATURE_BATCH |
+                      COMMS_FEATURE_CHECKED | COMMS_FEATURE_RS485 | COMMS_FEATURE_FLOW |
+                      COMMS_FEATURE_CBOR;
+    header.lights = VAL_LIGHT_COUNT;
+    header.total = (uint8_t)total;
+    header.from = (uint8_t)first;
+    memcpy(body, &header, sizeof(header));
+    for (uint32_t i = first; i < total && i < first + CAPABILITIES_BIN_COMMANDS; i++) {
+      COMMS_Bin_Capability_t entry;
+
+      entry.code = command_table[i].bin_code;
+      entry.args = command_table[i].args;
+      memcpy(&body[length], &entry, sizeof(entry));
+      length += sizeof(entry);
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, length);
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "capabilities");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"protocol\":");
+  JSON_Writer_Uint(&writer, COMMS_PROTOCOL_VERSION);
+  JSON_Writer_Literal(&writer, ",\"features\":[\"json\",\"binary\",\"batch\",\"checked\",\"rs485\",\"flow\","
+                               "\"cbor\"],\"board\":\"" VAL_BOARD_NAME "\",\"colours\":[");
+  JSON_Writer_Append(&writer, VAL_BOARD_COLOURS_JSON + 1, sizeof(VAL_BOARD_COLOURS_JSON) - 2);
+  JSON_Writer_Literal(&writer, "],\"lights\":");
+  JSON_Writer_Uint(&writer, VAL_LIGHT_COUNT);
+  JSON_Writer_Literal(&writer, ",\"total\":");
+  JSON_Writer_Uint(&writer, total);
+  JSON_Writer_Literal(&writer, ",\"from\":");
+  JSON_Writer_Uint(&writer, first);
+  JSON_Writer_Literal(&writer, ",\"commands\":[");
+  for (uint32_t i = first; i < total && i < first + CAPABILITIES_JSON_COMMANDS; i++) {
+    const COMMS_Command_t* command = &command_table[i];
+    bool first_arg = true;
+
+    if (i > first) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"topic\":");
+    JSON_Writer_String(&writer, command->topic);
+    JSON_Writer_Literal(&writer, ",\"action\":");
+    JSON_Writer_String(&writer, command->action);
+    JSON_Writer_Literal(&writer, ",\"code\":");
+    JSON_Writer_Uint(&writer, command->bin_code);
+    JSON_Writer_Literal(&writer, ",\"mask\":");
+    JSON_Writer_Uint64(&writer, command->args);
+    JSON_Writer_Literal(&writer, ",\"args\":{");
+    for (uint8_t bit = 0; bit < COMMAND_ARG_COUNT; bit++) {
+      if ((command->args & (1ULL << bit)) == 0) {
+        continue;
+      }
+      if (!first_arg) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      first_arg = false;
+      JSON_Writer_String(&writer, command_arg_info[bit].key);
+      JSON_Writer_Char(&writer, ':');
+      JSON_Writer_String(&writer, command_arg_info[bit].type);
+    }
+    JSON_Writer_Literal(&writer, "}}");
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "capabilities", "Response too long");
+  }
+}
+
+/**
+ * @brief Send response for the link command: checked mode and counters
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendLinkResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+
+  if (reply.binary) {
+    COMMS_Bin_Link_Stats_t body;
+
+    body.checked = link_checked ? 1U : 0U;
+    body.accepted = link_stats.accepted;
+    body.crc = link_stats.crc;
+    body.unchecked = link_stats.unchecked;
+    body.duplicate = link_stats.duplicate;
+    body.malformed = link_stats.malformed;
+    body.oversize = link_stats.oversize;
+    body.overflow = link_stats.overflow;
+    body.filtered = link_stats.filtered;
+    body.throttled_control = link_stats.throttled[COMMS_CLASS_CONTROL];
+    body.throttled_query = link_stats.throttled[COMMS_CLASS_QUERY];
+    body.pipeline_full = link_stats.pipeline_full;
+    body.rx_peak = link_stats.rx_peak;
+    body.rx_size = RX_STREAM_SIZE;
+    COMMS_Handler_SendBinaryResponse(VAL_OK, &body, sizeof(body));
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "link");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"transport\":");
+  JSON_Writer_String(&writer, Transport_GetName(Transport_GetActive()));
+  JSON_Writer_Literal(&writer, ",\"mtu\":");
+  JSON_Writer_Uint(&writer, Transport_GetMtu());
+  JSON_Writer_Literal(&writer, ",\"checked\":");
+  JSON_Writer_Bool(&writer, link_checked);
+  JSON_Writer_Literal(&writer, ",\"accepted\":");
+  JSON_Writer_Uint(&writer, link_stats.accepted);
+  JSON_Writer_Literal(&writer, ",\"dropped\":{\"crc\":");
+  JSON_Writer_Uint(&writer, link_stats.crc);
+  JSON_Writer_Literal(&writer, ",\"unchecked\":");
+  JSON_Writer_Uint(&writer, link_stats.unchecked);
+  JSON_Writer_Literal(&writer, ",\"duplicate\":");
+  JSON_Writer_Uint(&writer, link_stats.duplicate);
+  JSON_Writer_Literal(&writer, ",\"malformed\":");
+  JSON_Writer_Uint(&writer, link_stats.malformed);
+  JSON_Writer_Literal(&writer, ",\"oversize\":");
+  JSON_Writer_Uint(&writer, link_stats.oversize);
+  JSON_Writer_Literal(&writer, ",\"overflow\":");
+  JSON_Writer_Uint(&writer, link_stats.overflow);
+  JSON_Writer_Literal(&writer, ",\"filtered\":");
+  JSON_Writer_Uint(&writer, link_stats.filtered);
+  JSON_Writer_Literal(&writer, "},\"throttled\":{\"control\":");
+  JSON_Writer_Uint(&writer, link_stats.throttled[COMMS_CLASS_CONTROL]);
+  JSON_Writer_Literal(&writer, ",\"query\":");
+  JSON_Writer_Uint(&writer, link_stats.throttled[COMMS_CLASS_QUERY]);
+  JSON_Writer_Literal(&writer, "},\"pipeline_full\":");
+  JSON_Writer_Uint(&writer, link_stats.pipeline_full);
+  JSON_Writer_Literal(&writer, ",\"rx_queue\":{\"peak\":");
+  JSON_Writer_Uint(&writer, link_stats.rx_peak);
+  JSON_Writer_Literal(&writer, ",\"size\":");
+  JSON_Writer_Uint(&writer, RX_STREAM_SIZE);
+  JSON_Writer_Char(&writer, '}');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send task deadline and watchdog reset response
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendDeadlinesResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  Supervisor_Reset_t reset;
+  Supervisor_Stats_t stats;
+
+  Supervisor_GetReset(&reset);
+
+  if (reply.binary) {
+    uint8_t body[2 + sizeof(uint32_t) + SUPERVISOR_TASK_COUNT * sizeof(COMMS_Bin_Deadline_t)];
+    size_t length = 0;
+
+    body[length++] = reset.watchdog ? 1U : 0U;
+    body[length++] = (reset.task < SUPERVISOR_TASK_COUNT) ? reset.task : 0xFFU;
+    memcpy(&body[length], &reset.over_ms, sizeof(reset.over_ms));
+    length += sizeof(reset.over_ms);
+
+    for (uint8_t i = 0; i < SUPERVISOR_TASK_COUNT; i++) {
+      COMMS_Bin_Deadline_t entry;
+
+      Supervisor_GetStats((Supervisor_Task_t)i, &stats);
+      entry.deadline_ms = (uint16_t)stats.deadline_ms;
+      entry.runs = stats.runs;
+      entry.misses = stats.misses;
+      entry.worst_us = stats.worst_us;
+      entry.last_over_us = stats.last_over_us;
+      memcpy(&body[length], &entry, sizeof(entry));
+      length += sizeof(entry);
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, length);
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "deadlines");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"watchdog_ms\":");
+  JSON_Writer_Uint(&writer, SUPERVISOR_WATCHDOG_MS);
+  JSON_Writer_Literal(&writer, ",\"last_reset\":");
+  if (reset.watchdog || reset.task < SUPERVISOR_TASK_COUNT) {
+    JSON_Writer_Literal(&writer, "{\"watchdog\":");
+    JSON_Writer_Bool(&writer, reset.watchdog);
+    JSON_Writer_Literal(&writer, ",\"task\":");
+    JSON_Writer_String(&writer, Supervisor_GetTaskName((Supervisor_Task_t)reset.task));
+    JSON_Writer_Literal(&writer, ",\"over_ms\":");
+    JSON_Writer_Uint(&writer, reset.over_ms);
+    JSON_Writer_Char(&writer, '}');
+  } else {
+    JSON_Writer_Literal(&writer, "null");
+  }
+  JSON_Writer_Literal(&writer, ",\"tasks\":[");
+
+  /* Add one entry per supervised task */
+  for (uint8_t i = 0; i < SUPERVISOR_TASK_COUNT; i++) {
+    Supervisor_GetStats((Supervisor_Task_t)i, &stats);
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"name\":");
+    JSON_Writer_String(&writer, Supervisor_GetTaskName((Supervisor_Task_t)i));
+    JSON_Writer_Literal(&writer, ",\"deadline_ms\":");
+    JSON_Writer_Uint(&writer, stats.deadline_ms);
+    JSON_Writer_Literal(&writer, ",\"runs\":");
+    JSON_Writer_Uint(&writer, stats.runs);
+    JSON_Writer_Literal(&writer, ",\"misses\":");
+    JSON_Writer_Uint(&writer, stats.misses);
+    JSON_Writer_Literal(&writer, ",\"worst_us\":");
+    JSON_Writer_Uint(&writer, stats.worst_us);
+    JSON_Writer_Literal(&writer, ",\"last_over_us\":");
+    JSON_Writer_Uint(&writer, stats.last_over_us);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "deadlines", "Response too long");
+  }
+}
+
+/**
+ * @brief Send queue, buffer and mutex contention response
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendQueuesResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  Queues_Stats_t objects[QUEUES_MAX_OBJECTS];
+  uint8_t count = Queues_GetStats(objects, QUEUES_MAX_OBJECTS);
+
+  if (reply.binary) {
+    uint8_t body[COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE - 1];
+    size_t length = 0;
+    uint8_t* object_count = &body[length++];
+
+    *object_count = 0;
+
+    /* As many objects as fit */
+    for (uint8_t i = 0; i < count; i++) {
+      COMMS_Bin_Queue_t entry = { objects[i].kind, objects[i].capacity, objects[i].high_water, objects[i].fails,
+                                  objects[i].blocks, objects[i].block_us, objects[i].block_max_us };
+      size_t name_length = strlen(objects[i].name);
+
+      if (length + sizeof(entry) + name_length + 1 > sizeof(body)) {
+        break;
+      }
+      memcpy(&body[length], &entry, sizeof(entry));
+      length += sizeof(entry);
+      memcpy(&body[length], objects[i].name, name_length + 1);
+      length += name_length + 1;
+      (*object_count)++;
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, length);
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "queues");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"objects\":[");
+
+  /* Add one entry per watched object */
+  for (uint8_t i = 0; i < count; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"name\":");
+    JSON_Writer_String(&writer, objects[i].name);
+    JSON_Writer_Literal(&writer, ",\"kind\":");
+    JSON_Writer_String(&writer, Queues_GetKindName((Queues_Kind_t)objects[i].kind));
+    JSON_Writer_Literal(&writer, ",\"capacity\":");
+    JSON_Writer_Uint(&writer, objects[i].capacity);
+    JSON_Writer_Literal(&writer, ",\"high_water\":");
+    JSON_Writer_Uint(&writer, objects[i].high_water);
+    JSON_Writer_Literal(&writer, ",\"fails\":");
+    JSON_Writer_Uint(&writer, objects[i].fails);
+    JSON_Writer_Literal(&writer, ",\"blocks\":");
+    JSON_Writer_Uint(&writer, objects[i].blocks);
+    JSON_Writer_Literal(&writer, ",\"block_us\":");
+    JSON_Writer_Uint(&writer, objects[i].block_us);
+    JSON_Writer_Literal(&writer, ",\"block_max_us\":");
+    JSON_Writer_Uint(&writer, objects[i].block_max_us);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "queues", "Response too long");
+  }
+}
+
+/**
+ * @brief Send control loop period jitter response
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendLoopTimingResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  Jitter_Stats_t stats;
+
+  if (reply.binary) {
+    uint8_t body[1 + JITTER_LOOP_COUNT * sizeof(COMMS_Bin_LoopTiming_t)];
+    size_t length = 0;
+
+    body[length++] = JITTER_LOOP_COUNT;
+    for (uint8_t i = 0; i < JITTER_LOOP_COUNT; i++) {
+      COMMS_Bin_LoopTiming_t entry;
+
+      Jitter_GetStats((Jitter_Loop_t)i, &stats);
+      entry.period_us = stats.period_us;
+      entry.iterations = stats.iterations;
+      entry.missed = stats.missed;
+      entry.max_early_us = stats.max_early_us;
+      entry.max_late_us = stats.max_late_us;
+      memcpy(entry.early, stats.early, sizeof(entry.early));
+      memcpy(entry.late, stats.late, sizeof(entry.late));
+      memcpy(&body[length], &entry, sizeof(entry));
+      length += sizeof(entry);
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, length);
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "loop_timing");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"first_us\":");
+  JSON_Writer_Uint(&writer, JITTER_FIRST_US);
+  JSON_Writer_Literal(&writer, ",\"loops\":[");
+
+  /* Add one entry per loop, the histograms as arrays of bucket counts */
+  for (uint8_t i = 0; i < JITTER_LOOP_COUNT; i++) {
+    Jitter_GetStats((Jitter_Loop_t)i, &stats);
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"name\":");
+    JSON_Writer_String(&writer, Jitter_GetLoopName((Jitter_Loop_t)i));
+    JSON_Writer_Literal(&writer, ",\"period_us\":");
+    JSON_Writer_Uint(&writer, stats.period_us);
+    JSON_Writer_Literal(&writer, ",\"iterations\":");
+    JSON_Writer_Uint(&writer, stats.iterations);
+    JSON_Writer_Literal(&writer, ",\"missed\":");
+    JSON_Writer_Uint(&writer, stats.missed);
+    JSON_Writer_Literal(&writer, ",\"max_early_us\":");
+    JSON_Writer_Uint(&writer, stats.max_early_us);
+    JSON_Writer_Literal(&writer, ",\"max_late_us\":");
+    JSON_Writer_Uint(&writer, stats.max_late_us);
+    JSON_Writer_Literal(&writer, ",\"early\":[");
+    for (uint8_t b = 0; b < JITTER_BUCKET_COUNT; b++) {
+      if (b > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Uint(&writer, stats.early[b]);
+    }
+    JSON_Writer_Literal(&writer, "],\"late\":[");
+    for (uint8_t b = 0; b < JITTER_BUCKET_COUNT; b++) {
+      if (b > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Uint(&writer, stats.late[b]);
+    }
+    JSON_Writer_Literal(&writer, "]}");
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "loop_timing", "Response too long");
+  }
+}
+
+/**
+ * @brief Send self-test results response
+ * @note  Sorts selftest_samples in place
+ * @param msgId Original message ID
+ * @param count Commands run, samples per phase
+ * @retval None
+ */
+static void COMMS_Handler_SendSelfTestResponse(const char* msg_id, uint8_t count) {
+  JSON_Writer_t writer;
+  COMMS_Bin_SelfTest_t body;
+
+  body.commands = count;
+  body.bytes = selftest_bytes;
+  for (uint8_t phase = 0; phase < SELFTEST_PHASES; phase++) {
+    uint32_t* samples = selftest_samples[phase];
+
+    /* Insertion sort, the sample count is small */
+    for (uint8_t i = 1; i < count; i++) {
+      uint32_t value = samples[i];
+      uint8_t j = i;
+
+      while (j > 0 && samples[j - 1] > value) {
+        samples[j] = samples[j - 1];
+        j--;
+      }
+      samples[j] = value;
+    }
+
+    body.phases[phase].p50_us = VAL_SysClock_CyclesToMicros(samples[(count - 1) / 2]);
+    body.phases[phase].p90_us = VAL_SysClock_CyclesToMicros(samples[(count - 1) * 9 / 10]);
+    body.phases[phase].max_us = VAL_SysClock_CyclesToMicros(samples[count - 1]);
+  }
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(VAL_OK, &body, sizeof(body));
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "selftest");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"commands\":");
+  JSON_Writer_Uint(&writer, body.commands);
+  JSON_Writer_Literal(&writer, ",\"bytes\":");
+  JSON_Writer_Uint(&writer, body.bytes);
+
+  /* Add one object per phase */
+  for (uint8_t phase = 0; phase < SELFTEST_PHASES; phase++) {
+    JSON_Writer_Literal(&writer, ",\"");
+    JSON_Writer_Text(&writer, selftest_phase_names[phase]);
+    JSON_Writer_Literal(&writer, "\":{\"p50_us\":");
+    JSON_Writer_Uint(&writer, body.phases[phase].p50_us);
+    JSON_Writer_Literal(&writer, ",\"p90_us\":");
+    JSON_Writer_Uint(&writer, body.phases[phase].p90_us);
+    JSON_Writer_Literal(&writer, ",\"max_us\":");
+    JSON_Writer_Uint(&writer, body.phases[phase].max_us);
+    JSON_Writer_Char(&writer, '}');
+  }
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+#ifdef COMMS_LINK_BENCH
+/**
+ * @brief Send the results of the finished link self-benchmark run
+ * @param msgId Message ID of the command that started the run
+ * @retval None
+ */
+static void COMMS_Handler_SendBenchResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  COMMS_Bin_Bench_t body;
+  uint32_t elapsed_us = (bench.bytes > 0) ? bench.last_us - bench.start_us : 0;
+
+  body.transport = (uint8_t)Transport_GetActive();
+  body.complete = (bench.bytes == bench.size) ? 1U : 0U;
+  body.size = bench.size;
+  body.bytes = bench.bytes;
+  body.elapsed_us = elapsed_us;
+  body.bytes_per_s = (elapsed_us > 0) ? (uint32_t)((uint64_t)bench.bytes * 1000000U / elapsed_us) : 0;
+  body.overflow = link_stats.overflow - bench.overflow;
+  body.turnaround_max_us = bench.turnaround_max_us;
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(VAL_OK, &body, sizeof(body));
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponseFor(&writer, msg_id, "bench", bench_mode_names[bench.mode]);
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"transport\":");
+  JSON_Writer_String(&writer, Transport_GetName((Transport_Id_t)body.transport));
+  JSON_Writer_Literal(&writer, ",\"complete\":");
+  JSON_Writer_Bool(&writer, body.complete);
+  JSON_Writer_Literal(&writer, ",\"size\":");
+  JSON_Writer_Uint(&writer, body.size);
+  JSON_Writer_Literal(&writer, ",\"bytes\":");
+  JSON_Writer_Uint(&writer, body.bytes);
+  JSON_Writer_Literal(&writer, ",\"elapsed_us\":");
+  JSON_Writer_Uint(&writer, body.elapsed_us);
+  JSON_Writer_Literal(&writer, ",\"bytes_per_s\":");
+  JSON_Writer_Uint(&writer, body.bytes_per_s);
+  JSON_Writer_Literal(&writer, ",\"overflow\":");
+  JSON_Writer_Uint(&writer, body.overflow);
+  if (bench.mode == BENCH_MODE_ECHO) {
+    JSON_Writer_Literal(&writer, ",\"turnaround_max_us\":");
+    JSON_Writer_Uint(&writer, body.turnaround_max_us);
+  }
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+#endif
+
+#ifdef BENCHMARK
+/**
+ * @brief Send the progress of the synthetic source and its stage times
+ * @param msgId Original message ID
+ * @param status Result of starting or stopping it
+ * @retval None
+ */
+static void COMMS_Handler_SendSyntheticResponse(const char* msg_id, VAL_Status status) {
+  static const char* const stage_names[] = { "filter_us", "violation_us", "cut_us", "event_us" };
+  AnalogSynthStatus synth;
+  LED_Driver_AlarmInfo_t info = {0};
+  COMMS_Bin_Synthetic_t body = {0};
+  uint64_t stamps[4];
+  uint32_t stages[4] = {0};
+  JSON_Writer_t writer;
+
+  VAL_Analog_GetSyntheticStatus(&synth);
+  if (synth_light != 0) {
+    SYS_Coordinator_GetAlarmInfo(synth_light, &info);
+  }
+
+  body.active = synth.active ? 1U : 0U;
+  body.light_id = synth_light;
+  body.scans = synth.scans;
+  body.trips = (uint16_t)(info.trip_count - synth_trips);
+
+  /* Stages not reached since the edge stay 0; the event follows a trip */
+  stamps[0] = synth.block_us;
+  stamps[1] = info.violation_us;
+  stamps[2] = info.trip_us;
+  stamps[3] = (info.trip_us >= synth.edge_us) ? alarm_event_us : 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    if (synth.edge_us != 0 && stamps[i] >= synth.edge_us) {
+      stages[i] = (uint32_t)(stamps[i] - synth.edge_us);
+    }
+  }
+  body.filter_us = stages[0];
+  body.violation_us = stages[1];
+  body.cut_us = stages[2];
+  body.event_us = stages[3];
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, &body, sizeof(body));
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "bench", "synthetic", "Invalid waveform");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "bench", "synthetic");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"active\":");
+  JSON_Writer_Bool(&writer, body.active);
+  JSON_Writer_Literal(&writer, ",\"id\":");
+  JSON_Writer_Uint(&writer, body.light_id);
+  JSON_Writer_Literal(&writer, ",\"scans\":");
+  JSON_Writer_Uint(&writer, body.scans);
+  JSON_Writer_Literal(&writer, ",\"trips\":");
+  JSON_Writer_Uint(&writer, body.trips);
+  for (uint8_t i = 0; i < 4; i++) {
+    if (stages[i] != 0) {
+      JSON_Writer_Char(&writer, ',');
+      JSON_Writer_String(&writer, stage_names[i]);
+      JSON_Writer_Char(&writer, ':');
+      JSON_Writer_Uint(&writer, stages[i]);
+    }
+  }
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+#endif
+
+/**
+ * @brief Send response for baud rate change
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @param baud Requested baud rate
+ * @param flow Requested RTS/CTS flow control
+ * @retval None
+ */
+static void COMMS_Handler_SendSetBaudResponse(const char* msg_id, VAL_Status status, uint32_t baud, bool flow) {
+  JSON_Writer_t writer;
+
+  if (reply.binary) {
+    uint8_t body[sizeof(uint32_t) + sizeof(uint16_t) + 1];
+    uint16_t timeout = COMMS_BAUD_CONFIRM_TIMEOUT_MS;
+
+    memcpy(&body[0], &baud, sizeof(baud));
+    memcpy(&body[sizeof(baud)], &timeout, sizeof(timeout));
+    body[sizeof(baud) + sizeof(timeout)] = flow ? 1U : 0U;
+    COMMS_Handler_SendBinaryResponse(status, body, sizeof(body));
+    return;
+  }
+
+  if (status == VAL_BUSY) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "set_baud", "Flow control needs a point-to-point link");
+    return;
+  }
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "set_baud", "Unsupported baud rate");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "set_baud");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"baud\":");
+  JSON_Writer_Uint(&writer, baud);
+  JSON_Writer_Literal(&writer, ",\"timeout_ms\":");
+  JSON_Writer_Uint(&writer, COMMS_BAUD_CONFIRM_TIMEOUT_MS);
+  JSON_Writer_Literal(&writer, ",\"flow\":");
+  JSON_Writer_Bool(&writer, flow);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for a PWM frequency change
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSetPwmFreqResponse(const char* msg_id, VAL_Status status) {
+  JSON_Writer_t writer;
+  uint32_t frequency = SYS_Coordinator_GetPwmFrequency();
+
+  if (reply.binary) {
+    uint8_t body[sizeof(uint32_t) + 1];
+
+    memcpy(&body[0], &frequency, sizeof(frequency));
+    body[sizeof(frequency)] = SYS_Coordinator_IsDitherEnabled() ? 1U : 0U;
+    COMMS_Handler_SendBinaryResponse(status, body, sizeof(body));
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "light", "set_pwm_freq",
+                                    (status == VAL_PARAM) ? "Frequency out of range"
+                                                          : "PWM frequency cannot change now");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "light", "set_pwm_freq");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"frequency\":");
+  JSON_Writer_Uint(&writer, frequency);
+  JSON_Writer_Literal(&writer, ",\"dither\":");
+  JSON_Writer_Bool(&writer, SYS_Coordinator_IsDitherEnabled());
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the persistent settings
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendConfigResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  Config_Settings_t settings;
+  VAL_Status status = SYS_Coordinator_GetConfig(&settings);
+
+  if (reply.binary) {
+    uint8_t body[3 * sizeof(uint16_t) + VAL_LIGHT_COUNT * sizeof(COMMS_Bin_Limits_t) + 5 +
+                 sizeof(settings.slew_permille_per_ms) + sizeof(settings.primaries) + 4];
+    COMMS_Bin_Limits_t packed[VAL_LIGHT_COUNT];
+
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      packed[i].current_warn_ma = settings.limits[i].current_warn_ma;
+      packed[i].current_max_ma = settings.limits[i].current_max_ma;
+      packed[i].current_trip_ma = settings.limits[i].current_trip_ma;
+      packed[i].temperature_warn_cdeg = settings.limits[i].temperature_warn_cdeg;
+      packed[i].temperature_max_cdeg = settings.limits[i].temperature_max_cdeg;
+    }
+    memcpy(&body[0], &settings.current_ma_per_mv, sizeof(uint16_t));
+    memcpy(&body[2], &settings.temperature_cdeg_per_mv, sizeof(uint16_t));
+    memcpy(&body[4], &settings.sample_phase_permille, sizeof(uint16_t));
+    memcpy(&body[6], packed, sizeof(packed));
+    body[6 + sizeof(packed)] = settings.address;
+    body[7 + sizeof(packed)] = settings.bus;
+    memcpy(&body[8 + sizeof(packed)], &settings.failsafe_ms, sizeof(uint16_t));
+    body[10 + sizeof(packed)] = settings.failsafe_scene;
+    memcpy(&body[11 + sizeof(packed)], settings.slew_permille_per_ms, sizeof(settings.slew_permille_per_ms));
+    memcpy(&body[11 + sizeof(packed) + sizeof(settings.slew_permille_per_ms)], settings.primaries,
+           sizeof(settings.primaries));
+    body[sizeof(body) - 4] = settings.power_on;
+    body[sizeof(body) - 3] = settings.power_on_scene;
+    body[sizeof(body) - 2] = SYS_Coordinator_IsConfigStaged() ? 1U : 0U;
+    body[sizeof(body) - 1] = settings.stop_mode;
+    COMMS_Handler_SendBinaryResponse(status, body, sizeof(body));
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "get", "Failed to retrieve configuration");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "config", "get");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"current_scale\":");
+  JSON_Writer_Uint(&writer, settings.current_ma_per_mv);
+  JSON_Writer_Literal(&writer, ",\"temperature_scale\":");
+  JSON_Writer_Uint(&writer, settings.temperature_cdeg_per_mv);
+  JSON_Writer_Literal(&writer, ",\"sample_phase\":");
+  JSON_Writer_Uint(&writer, settings.sample_phase_permille);
+  JSON_Writer_Literal(&writer, ",\"address\":");
+  JSON_Writer_Uint(&writer, settings.address);
+  JSON_Writer_Literal(&writer, ",\"bus\":");
+  JSON_Writer_Bool(&writer, settings.bus);
+  JSON_Writer_Literal(&writer, ",\"failsafe\":{\"timeout\":");
+  JSON_Writer_Uint(&writer, settings.failsafe_ms);
+  JSON_Writer_Literal(&writer, ",\"scene\":");
+  JSON_Writer_Uint(&writer, settings.failsafe_scene);
+  JSON_Writer_Literal(&writer, "},\"power_on\":{\"mode\":\"");
+  JSON_Writer_Text(&writer, Restore_GetModeName((Restore_Mode_t)settings.power_on));
+  JSON_Writer_Literal(&writer, "\",\"scene\":");
+  JSON_Writer_Uint(&writer, settings.power_on_scene);
+  JSON_Writer_Char(&writer, '}');
+  JSON_Writer_Literal(&writer, ",\"stop_mode\":");
+  JSON_Writer_Bool(&writer, settings.stop_mode != 0);
+  JSON_Writer_Literal(&writer, ",\"staged\":");
+  JSON_Writer_Bool(&writer, SYS_Coordinator_IsConfigStaged());
+
+  JSON_Writer_Literal(&writer, ",\"lights\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    const LED_Driver_Limits_t* limits = &settings.limits[i];
+
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"light\":");
+    JSON_Writer_Uint(&writer, i + 1);
+    JSON_Writer_Literal(&writer, ",\"current_warn\":");
+    JSON_Writer_Int(&writer, limits->current_warn_ma);
+    JSON_Writer_Literal(&writer, ",\"current_max\":");
+    JSON_Writer_Int(&writer, limits->current_max_ma);
+    JSON_Writer_Literal(&writer, ",\"current_trip\":");
+    JSON_Writer_Int(&writer, limits->current_trip_ma);
+    JSON_Writer_Literal(&writer, ",\"temperature_warn\":");
+    JSON_Writer_Int(&writer, limits->temperature_warn_cdeg);
+    JSON_Writer_Literal(&writer, ",\"temperature_max\":");
+    JSON_Writer_Int(&writer, limits->temperature_max_cdeg);
+    JSON_Writer_Literal(&writer, ",\"slew\":");
+    JSON_Writer_Uint(&writer, settings.slew_permille_per_ms[i]);
+    JSON_Writer_Literal(&writer, ",\"x\":");
+    JSON_Writer_Uint(&writer, settings.primaries[i].x);
+    JSON_Writer_Literal(&writer, ",\"y\":");
+    JSON_Writer_Uint(&writer, settings.primaries[i].y);
+    JSON_Writer_Literal(&writer, ",\"flux\":");
+    JSON_Writer_Uint(&writer, settings.primaries[i].flux_lm);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for a settings change
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSetConfigResponse(const char* msg_id, VAL_Status status) {
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set", "Invalid configuration");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set", "Configuration applied but not stored");
+    return;
+  }
+
+  COMMS_Handler_SendFixedResponse(msg_id, "config", "set", RESP_STATUS_OK);
+}
+
+/**
+ * @brief Send the sensor calibration of a light
+ * @param msgId Original message ID
+ * @param light_id Light ID
+ * @retval None
+ */
+static void COMMS_Handler_SendCalibrationResponse(const char* msg_id, uint8_t light_id) {
+  JSON_Writer_t writer;
+  AnalogCalibration calibration;
+  VAL_Status status = SYS_Coordinator_GetCalibration(light_id, &calibration);
+
+  if (reply.binary) {
+    uint8_t body[sizeof(COMMS_Bin_Calibration_t) + sizeof(calibration.points)];
+    COMMS_Bin_Calibration_t packed;
+
+    packed.current_gain = calibration.current_gain;
+    packed.current_offset_ma = calibration.current_offset_ma;
+    packed.temperature_gain = calibration.temperature_gain;
+    packed.temperature_offset_cdeg = calibration.temperature_offset_cdeg;
+    packed.point_count = calibration.point_count;
+    memcpy(&body[0], &packed, sizeof(packed));
+    memcpy(&body[sizeof(packed)], calibration.points, calibration.point_count * sizeof(AnalogCalPoint));
+    COMMS_Handler_SendBinaryResponse(status, body,
+                                     sizeof(packed) + calibration.point_count * sizeof(AnalogCalPoint));
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "get_calibration", "Invalid light ID");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "config", "get_calibration");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"light\":");
+  JSON_Writer_Uint(&writer, light_id);
+  JSON_Writer_Literal(&writer, ",\"current_gain\":");
+  JSON_Writer_Uint(&writer, calibration.current_gain);
+  JSON_Writer_Literal(&writer, ",\"current_offset\":");
+  JSON_Writer_Int(&writer, calibration.current_offset_ma);
+  JSON_Writer_Literal(&writer, ",\"temperature_gain\":");
+  JSON_Writer_Uint(&writer, calibration.temperature_gain);
+  JSON_Writer_Literal(&writer, ",\"temperature_offset\":");
+  JSON_Writer_Int(&writer, calibration.temperature_offset_cdeg);
+
+  /* Voltage and temperature alternate, as in config/set_calibration */
+  JSON_Writer_Literal(&writer, ",\"points\":[");
+  for (uint8_t i = 0; i < calibration.point_count; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Uint(&writer, calibration.points[i].mv);
+    JSON_Writer_Char(&writer, ',');
+    JSON_Writer_Int(&writer, calibration.points[i].cdeg);
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for a calibration change
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSetCalibrationResponse(const char* msg_id, VAL_Status status) {
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_calibration", "Invalid calibration");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_calibration",
+                                    "Calibration applied but not stored");
+    return;
+  }
+
+  COMMS_Handler_SendFixedResponse(msg_id, "config", "set_calibration", RESP_STATUS_OK);
+}
+
+/**
+ * @brief Send response for an address change, then switch the link
+ * @note  The response goes out on the link the host sent the command on
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSetAddressResponse(const char* msg_id, VAL_Status status) {
+  JSON_Writer_t writer;
+  Config_Settings_t settings;
+
+  memset(&settings, 0, sizeof(settings));
+
+  /* Also applied when storing failed */
+  if (status != VAL_PARAM && SYS_Coordinator_GetConfig(&settings) != VAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  if (reply.binary) {
+    uint8_t body[2];
+
+    body[0] = settings.address;
+    body[1] = settings.bus;
+    COMMS_Handler_SendBinaryResponse(status, body, (status == VAL_PARAM) ? 0 : sizeof(body));
+  } else if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_address", "Invalid address");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_address", "Address applied but not stored");
+  } else {
+    uint32_t probe_start = Profiler_Start();
+    COMMS_Handler_BeginResponse(&writer, msg_id, "config", "set_address");
+    JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"address\":");
+    JSON_Writer_Uint(&writer, settings.address);
+    JSON_Writer_Literal(&writer, ",\"bus\":");
+    JSON_Writer_Bool(&writer, settings.bus);
+
+    /* Send response */
+    COMMS_Handler_EndResponse(&writer, probe_start);
+  }
+
+  /* A staged address waits for config/commit */
+  if (status == VAL_PARAM || SYS_Coordinator_IsConfigStaged()) {
+    return;
+  }
+
+  /* Switching the driver enable cuts a frame still being sent */
+  VAL_Serial_Flush(COMMS_BAUD_FLUSH_TIMEOUT_MS);
+  COMMS_Handler_SetAddress(settings.address, settings.bus != 0);
+}
+
+/**
+ * @brief Send response for a failsafe change
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSetFailsafeResponse(const char* msg_id, VAL_Status status) {
+  JSON_Writer_t writer;
+  Config_Settings_t settings;
+
+  memset(&settings, 0, sizeof(settings));
+
+  /* Also applied when storing failed */
+  if (status != VAL_PARAM && SYS_Coordinator_GetConfig(&settings) != VAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  if (reply.binary) {
+    uint8_t body[3];
+
+    memcpy(&body[0], &settings.failsafe_ms, sizeof(uint16_t));
+    body[2] = settings.failsafe_scene;
+    COMMS_Handler_SendBinaryResponse(status, body, (status == VAL_PARAM) ? 0 : sizeof(body));
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_failsafe", "Invalid timeout or scene");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_failsafe", "Failsafe applied but not stored");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "config", "set_failsafe");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"timeout\":");
+  JSON_Writer_Uint(&writer, settings.failsafe_ms);
+  JSON_Writer_Literal(&writer, ",\"scene\":");
+  JSON_Writer_Uint(&writer, settings.failsafe_scene);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for a slew limit change
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSetSlewResponse(const char* msg_id, VAL_Status status) {
+  JSON_Writer_t writer;
+  Config_Settings_t settings;
+
+  memset(&settings, 0, sizeof(settings));
+
+  /* Also applied when storing failed */
+  if (status != VAL_PARAM && SYS_Coordinator_GetConfig(&settings) != VAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, settings.slew_permille_per_ms,
+                                     (status == VAL_PARAM) ? 0 : sizeof(settings.slew_permille_per_ms));
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_slew", "Invalid light or slew limit");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_slew", "Slew limit applied but not stored");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "config", "set_slew");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"slew\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Uint(&writer, settings.slew_permille_per_ms[i]);
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for an ageing curve change
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSetAgeingResponse(const char* msg_id, VAL_Status status) {
+  JSON_Writer_t writer;
+  Config_Settings_t settings;
+  uint16_t scales[VAL_LIGHT_COUNT];
+
+  memset(&settings, 0, sizeof(settings));
+
+  /* Also applied when storing failed */
+  if (status != VAL_PARAM && (SYS_Coordinator_GetConfig(&settings) != VAL_OK ||
+                              SYS_Coordinator_GetAgeingScales(scales) != VAL_OK)) {
+    status = VAL_ERROR;
+  }
+
+  if (reply.binary) {
+    uint8_t body[sizeof(settings.ageing) + sizeof(scales)];
+
+    memcpy(body, settings.ageing, sizeof(settings.ageing));
+    memcpy(&body[sizeof(settings.ageing)], scales, sizeof(scales));
+    COMMS_Handler_SendBinaryResponse(status, body, (status == VAL_PARAM) ? 0 : sizeof(body));
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_ageing", "Invalid light or ageing curve");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_ageing", "Ageing curve applied but not stored");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "config", "set_ageing");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"lights\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    const LED_Driver_Ageing_t* curve = &settings.ageing[i];
+
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"light\":");
+    JSON_Writer_Uint(&writer, i + 1);
+    JSON_Writer_Literal(&writer, ",\"hours\":");
+    JSON_Writer_Uint(&writer, curve->step_hours);
+    JSON_Writer_Literal(&writer, ",\"ageing\":[");
+    for (uint8_t n = 0; n < LED_DRIVER_AGEING_POINTS; n++) {
+      if (n > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Uint(&writer, curve->output_permille[n]);
+    }
+    JSON_Writer_Literal(&writer, "],\"scale\":");
+    JSON_Writer_Uint(&writer, scales[i]);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for an output trim change
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSetTrimResponse(const char* msg_id, VAL_Status status) {
+  JSON_Writer_t writer;
+  Config_Settings_t settings;
+
+  memset(&settings, 0, sizeof(settings));
+
+  /* Also applied when storing failed */
+  if (status != VAL_PARAM && SYS_Coordinator_GetConfig(&settings) != VAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, settings.trim_permille,
+                                     (status == VAL_PARAM) ? 0 : sizeof(settings.trim_permille));
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_trim", "Invalid lights or trims");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_trim", "Trims applied but not stored");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "config", "set_trim");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"trim\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Uint(&writer, settings.trim_permille[i]);
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for a colour primary change
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSetPrimaryResponse(const char* msg_id, VAL_Status status) {
+  JSON_Writer_t writer;
+  Config_Settings_t settings;
+
+  memset(&settings, 0, sizeof(settings));
+
+  /* Also applied when storing failed */
+  if (status != VAL_PARAM && SYS_Coordinator_GetConfig(&settings) != VAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, settings.primaries,
+                                     (status == VAL_PARAM) ? 0 : sizeof(settings.primaries));
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_primary", "Invalid light or primary");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_primary", "Primary applied but not stored");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "config", "set_primary");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"primaries\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"x\":");
+    JSON_Writer_Uint(&writer, settings.primaries[i].x);
+    JSON_Writer_Literal(&writer, ",\"y\":");
+    JSON_Writer_Uint(&writer, settings.primaries[i].y);
+    JSON_Writer_Literal(&writer, ",\"flux\":");
+    JSON_Writer_Uint(&writer, settings.primaries[i].flux_lm);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the light groups and the bus groups joined
+ * @param msgId Original message ID
+ * @param action Action to respond to, get_groups or set_groups
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendGroupsResponse(const char* msg_id, const char* action, VAL_Status status) {
+  JSON_Writer_t writer;
+  Config_Settings_t settings;
+
+  memset(&settings, 0, sizeof(settings));
+
+  /* Also applied when storing failed */
+  if (status != VAL_PARAM && SYS_Coordinator_GetConfig(&settings) != VAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  if (reply.binary) {
+    uint8_t body[CONFIG_LIGHT_GROUPS + 2];
+
+    memcpy(&body[0], settings.light_groups, CONFIG_LIGHT_GROUPS);
+    memcpy(&body[CONFIG_LIGHT_GROUPS], &settings.bus_groups, sizeof(uint16_t));
+    COMMS_Handler_SendBinaryResponse(status, body, (status == VAL_PARAM) ? 0 : sizeof(body));
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", action, "Invalid group or lights");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", action, "Groups applied but not stored");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponseFor(&writer, msg_id, "config", action);
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"groups\":[");
+  for (int i = 0; i < CONFIG_LIGHT_GROUPS; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Uint(&writer, settings.light_groups[i]);
+  }
+  JSON_Writer_Literal(&writer, "],\"bus_groups\":");
+  JSON_Writer_Uint(&writer, settings.bus_groups);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for a group change
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSetGroupsResponse(const char* msg_id, VAL_Status status) {
+  COMMS_Handler_SendGroupsResponse(msg_id, "set_groups", status);
+}
+
+/**
+ * @brief Send response for a power-on mode change
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSetPowerOnResponse(const char* msg_id, VAL_Status status) {
+  JSON_Writer_t writer;
+  Config_Settings_t settings;
+  bool restored = Restore_IsActive();
+
+  memset(&settings, 0, sizeof(settings));
+
+  /* Also applied when storing failed */
+  if (status != VAL_PARAM && SYS_Coordinator_GetConfig(&settings) != VAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  if (reply.binary) {
+    uint8_t body[3];
+
+    body[0] = settings.power_on;
+    body[1] = settings.power_on_scene;
+    body[2] = restored ? 1U : 0U;
+    COMMS_Handler_SendBinaryResponse(status, body, (status == VAL_PARAM) ? 0 : sizeof(body));
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_power_on", "Invalid scene");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_power_on", "Power-on mode applied but not stored");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "config", "set_power_on");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"mode\":\"");
+  JSON_Writer_Text(&writer, Restore_GetModeName((Restore_Mode_t)settings.power_on));
+  JSON_Writer_Literal(&writer, "\",\"scene\":");
+  JSON_Writer_Uint(&writer, settings.power_on_scene);
+  JSON_Writer_Literal(&writer, ",\"restored\":");
+  JSON_Writer_Bool(&writer, restored);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for a stop mode change
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSetStopModeResponse(const char* msg_id, VAL_Status status) {
+  JSON_Writer_t writer;
+  Config_Settings_t settings;
+
+  memset(&settings, 0, sizeof(settings));
+
+  /* Also applied when storing failed */
+  if (status != VAL_PARAM && SYS_Coordinator_GetConfig(&settings) != VAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  if (reply.binary) {
+    uint8_t body[1];
+
+    body[0] = settings.stop_mode;
+    COMMS_Handler_SendBinaryResponse(status, body, (status == VAL_PARAM) ? 0 : sizeof(body));
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_stop_mode", "Missing enable");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "set_stop_mode", "Stop mode applied but not stored");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "config", "set_stop_mode");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"enable\":");
+  JSON_Writer_Bool(&writer, settings.stop_mode != 0);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for the start of a staged configuration
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendBeginConfigResponse(const char* msg_id, VAL_Status status) {
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "begin", "Configuration already staged");
+    return;
+  }
+
+  COMMS_Handler_SendFixedResponse(msg_id, "config", "begin", RESP_STATUS_OK);
+}
+
+/**
+ * @brief Send response for a configuration commit, then apply the link settings
+ * @note  The response goes out on the link the host sent the command on
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendCommitConfigResponse(const char* msg_id, VAL_Status status) {
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+  } else if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "commit", "Nothing staged or invalid configuration");
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "commit", "Configuration applied but not stored");
+  } else {
+    COMMS_Handler_SendFixedResponse(msg_id, "config", "commit", RESP_STATUS_OK);
+  }
+
+  /* Also applied when storing failed */
+  if (status != VAL_PARAM) {
+    COMMS_Handler_ApplyLinkConfig();
+  }
+}
+
+/**
+ * @brief Send response for a dropped staged configuration
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendAbortConfigResponse(const char* msg_id, VAL_Status status) {
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
+
+  COMMS_Handler_SendFixedResponse(msg_id, "config", "abort", RESP_STATUS_OK);
+}
+
+/**
+ * @brief Send part of a configuration export
+ * @note  Binary protocol only
+ * @param msgId Original message ID
+ * @param from Byte offset into the export, 0 for a new snapshot
+ * @retval None
+ */
+static void COMMS_Handler_SendExportConfigResponse(const char* msg_id, uint32_t from) {
+  uint8_t body[sizeof(uint16_t) + COMMS_CONFIG_EXPORT_CHUNK];
+  uint16_t length = 0;
+  uint16_t size = 0;
+  VAL_Status status;
+
+  if (!reply.binary) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "export", "Binary protocol only");
+    return;
+  }
+
+  status = SYS_Coordinator_ExportConfig(from, &body[sizeof(size)], COMMS_CONFIG_EXPORT_CHUNK, &length, &size);
+  memcpy(&body[0], &size, sizeof(size));
+  COMMS_Handler_SendBinaryResponse(status, body, sizeof(size) + length);
+}
+
+/**
+ * @brief Send response for part of a configuration import, then apply the
+ *        link settings once imported
+ * @note  Binary protocol only
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendImportConfigResponse(const char* msg_id, VAL_Status status) {
+  if (!reply.binary) {
+    COMMS_Handler_SendErrorResponse(msg_id, "config", "import", "Binary protocol only");
+    return;
+  }
+
+  COMMS_Handler_SendBinaryResponse(status, &import_received, sizeof(import_received));
+
+  /* Also applied when storing failed */
+  if (import_complete && (status == VAL_OK || status == VAL_ERROR)) {
+    COMMS_Handler_ApplyLinkConfig();
+  }
+}
+
+/**
+ * @brief Put the address, failsafe and bus groups of the settings in use
+ *        into effect, after a commit or an import
+ * @note  Called once the response is queued; it goes out on the link the
+ *        host sent the command on
+ * @retval None
+ */
+static void COMMS_Handler_ApplyLinkConfig(void) {
+  Config_Settings_t settings;
+
+  if (SYS_Coordinator_GetConfig(&settings) != VAL_OK) {
+    return;
+  }
+
+  /* Switching the driver enable cuts a frame still being sent */
+  VAL_Serial_Flush(COMMS_BAUD_FLUSH_TIMEOUT_MS);
+  COMMS_Handler_SetAddress(settings.address, settings.bus != 0);
+  COMMS_Handler_SetFailsafe(settings.failsafe_ms, settings.failsafe_scene);
+  COMMS_Handler_SetBusGroups(settings.bus_groups);
+}
+
+/**
+ * @brief Send a saved scene
+ * @param msgId Original message ID
+ * @param scene Scene number
+ * @retval None
+ */
+static void COMMS_Handler_SendSceneResponse(const char* msg_id, uint8_t scene) {
+  JSON_Writer_t writer;
+  Config_Scene_t data = {0};
+  VAL_Status status = SYS_Coordinator_GetScene(scene, &data);
+
+  /* Fade curves share their values with COMMS_CURVE_* */
+  if (reply.binary) {
+    uint8_t body[sizeof(data.permille) + 3];
+
+    memcpy(&body[0], data.permille, sizeof(data.permille));
+    memcpy(&body[sizeof(data.permille)], &data.duration_ms, sizeof(data.duration_ms));
+    body[sizeof(data.permille) + 2] = data.curve;
+    COMMS_Handler_SendBinaryResponse(status, body, sizeof(body));
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "scene", "get", "Invalid scene");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "scene", "get", "Scene not saved");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "scene", "get");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"id\":");
+  JSON_Writer_Uint(&writer, scene);
+  JSON_Writer_Literal(&writer, ",\"permilles\":[");
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Uint(&writer, data.permille[i]);
+  }
+  JSON_Writer_Literal(&writer, "],\"duration\":");
+  JSON_Writer_Uint(&writer, data.duration_ms);
+  JSON_Writer_Literal(&writer, ",\"curve\":\"");
+  JSON_Writer_Text(&writer, curve_names[data.curve]);
+  JSON_Writer_Char(&writer, '"');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send an empty response for a scene command
+ * @param msgId Original message ID
+ * @param action Command action
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSceneStatusResponse(const char* msg_id, const char* action, VAL_Status status) {
+  COMMS_Gather_t gather;
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "scene", action, "Invalid scene");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "scene", action,
+                                    (strcmp(action, "save") == 0) ? "Scene not stored" :
+                                    "Scene not saved or not applied");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginGatherFor(&gather, msg_id, "scene", action);
+  COMMS_Handler_GatherLiteral(&gather, RESP_STATUS_OK);
+
+  /* Send response */
+  COMMS_Handler_EndGather(&gather, probe_start);
+}
+
+/**
+ * @brief Send response for a scene save, once it is stored
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSaveSceneResponse(const char* msg_id, VAL_Status status) {
+  COMMS_Handler_SendSceneStatusResponse(msg_id, "save", status);
+}
+
+/**
+ * @brief Send response for starting a raw capture
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @param scans Scans to be recorded
+ * @retval None
+ */
+static void COMMS_Handler_SendCaptureStartResponse(const char* msg_id, VAL_Status status, uint16_t scans) {
+  JSON_Writer_t writer;
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "capture", "start", "Invalid capture settings");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "capture", "start");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"scans\":");
+  JSON_Writer_Uint(&writer, scans);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the outcome of a sequence command
+ * @note sequence/add also reports the cues in the list
+ * @param msgId Original message ID
+ * @param action Command action
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSequenceStatusResponse(const char* msg_id, const char* action, VAL_Status status) {
+  JSON_Writer_t writer;
+  Sequencer_Status_t sequence;
+  bool add = (strcmp(action, "add") == 0);
+
+  SYS_Coordinator_GetSequenceStatus(&sequence);
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, &sequence.cue_count, add ? 1 : 0);
+    return;
+  }
+
+  if (status == VAL_BUSY) {
+    COMMS_Handler_SendErrorResponse(msg_id, "sequence", action, "Sequence running");
+    return;
+  } else if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "sequence", action, add ? "Invalid cue" : "Invalid period");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "sequence", action, add ? "Cue list full" : "No cues");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponseFor(&writer, msg_id, "sequence", action);
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK);
+  if (add) {
+    JSON_Writer_Literal(&writer, ",\"cues\":");
+    JSON_Writer_Uint(&writer, sequence.cue_count);
+  }
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the sequence state
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendSequenceResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  Sequencer_Status_t sequence;
+
+  SYS_Coordinator_GetSequenceStatus(&sequence);
+
+  if (reply.binary) {
+    COMMS_Bin_Sequence_Status_t body;
+
+    body.running = sequence.running ? 1U : 0U;
+    body.cue_count = sequence.cue_count;
+    body.next_cue = sequence.next_cue;
+    body.period_us = sequence.period_us;
+    body.passes = sequence.passes;
+    body.late_max_us = sequence.late_max_us;
+    COMMS_Handler_SendBinaryResponse(VAL_OK, (const uint8_t*)&body, sizeof(body));
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "sequence", "status");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"running\":");
+  JSON_Writer_Bool(&writer, sequence.running);
+  JSON_Writer_Literal(&writer, ",\"cues\":");
+  JSON_Writer_Uint(&writer, sequence.cue_count);
+  JSON_Writer_Literal(&writer, ",\"next\":");
+  JSON_Writer_Uint(&writer, sequence.next_cue);
+  JSON_Writer_Literal(&writer, ",\"period\":");
+  JSON_Writer_Uint(&writer, sequence.period_us);
+  JSON_Writer_Literal(&writer, ",\"passes\":");
+  JSON_Writer_Uint(&writer, sequence.passes);
+  JSON_Writer_Literal(&writer, ",\"late_max_us\":");
+  JSON_Writer_Uint(&writer, sequence.late_max_us);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the outcome of a strobe command
+ * @param msgId Original message ID
+ * @param topic Command topic
+ * @param action Command action
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendStrobeStatusResponse(const char* msg_id, const char* topic, const char* action,
+                                                   VAL_Status status) {
+  COMMS_Gather_t gather;
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, topic, action, "Invalid pulse");
+    return;
+  } else if (status == VAL_BUSY) {
+    COMMS_Handler_SendErrorResponse(msg_id, topic, action, "Rate timer in use");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, topic, action, "ADC error");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginGatherFor(&gather, msg_id, topic, action);
+  COMMS_Handler_GatherLiteral(&gather, RESP_STATUS_OK);
+
+  /* Send response */
+  COMMS_Handler_EndGather(&gather, probe_start);
+}
+
+/**
+ * @brief Send the strobe configuration and counts
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendStrobeResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  LED_Driver_StrobeStatus_t strobe;
+
+  SYS_Coordinator_GetStrobeStatus(&strobe);
+
+  if (reply.binary) {
+    COMMS_Bin_Strobe_Status_t body;
+
+    body.active = strobe.active ? 1U : 0U;
+    body.edge = strobe.falling_edge ? COMMS_CAPTURE_FALLING : COMMS_CAPTURE_RISING;
+    body.width_us = strobe.duration_us;
+    body.triggers = strobe.triggers;
+    body.pulses = strobe.pulses;
+    body.missed = strobe.missed;
+    body.period_us = strobe.period_us;
+    COMMS_Handler_SendBinaryResponse(VAL_OK, (const uint8_t*)&body, sizeof(body));
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "strobe", "status");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"active\":");
+  JSON_Writer_Bool(&writer, strobe.active);
+  JSON_Writer_Literal(&writer, ",\"width\":");
+  JSON_Writer_Uint(&writer, strobe.duration_us);
+  if (strobe.period_us != 0) {
+    JSON_Writer_Literal(&writer, ",\"period\":");
+    JSON_Writer_Uint(&writer, strobe.period_us);
+  } else {
+    if (strobe.falling_edge) {
+      JSON_Writer_Literal(&writer, ",\"trigger\":\"falling\"");
+    } else {
+      JSON_Writer_Literal(&writer, ",\"trigger\":\"rising\"");
+    }
+  }
+  JSON_Writer_Literal(&writer, ",\"triggers\":");
+  JSON_Writer_Uint(&writer, strobe.triggers);
+  JSON_Writer_Literal(&writer, ",\"pulses\":");
+  JSON_Writer_Uint(&writer, strobe.pulses);
+  JSON_Writer_Literal(&writer, ",\"missed\":");
+  JSON_Writer_Uint(&writer, strobe.missed);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the outcome of dmx/start
+ * @param msgId Original message ID
+ * @param status As SYS_Coordinator_CheckDmx
+ * @param channel DMX channel of light 1
+ * @retval None
+ */
+static void COMMS_Handler_SendDmxStartResponse(const char* msg_id, VAL_Status status, uint16_t channel) {
+  JSON_Writer_t writer;
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "dmx", "start", "Invalid channel");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "dmx", "start", "DMX active");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "dmx", "start");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"channel\":");
+  JSON_Writer_Uint(&writer, channel);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the DMX512 state and the counts of the last session
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendDmxResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  SYS_Coordinator_DmxStatus_t dmx;
+
+  SYS_Coordinator_GetDmxStatus(&dmx);
+
+  if (reply.binary) {
+    COMMS_Bin_Dmx_Status_t body;
+
+    body.active = dmx.active ? 1U : 0U;
+    body.channel = dmx.channel;
+    body.packets = dmx.packets;
+    body.ignored = dmx.ignored;
+    body.dropped = dmx.dropped;
+    memcpy(body.levels, dmx.levels, sizeof(body.levels));
+    COMMS_Handler_SendBinaryResponse(VAL_OK, (const uint8_t*)&body, sizeof(body));
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "dmx", "status");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"active\":");
+  JSON_Writer_Bool(&writer, dmx.active);
+  JSON_Writer_Literal(&writer, ",\"channel\":");
+  JSON_Writer_Uint(&writer, dmx.channel);
+  JSON_Writer_Literal(&writer, ",\"packets\":");
+  JSON_Writer_Uint(&writer, dmx.packets);
+  JSON_Writer_Literal(&writer, ",\"ignored\":");
+  JSON_Writer_Uint(&writer, dmx.ignored);
+  JSON_Writer_Literal(&writer, ",\"dropped\":");
+  JSON_Writer_Uint(&writer, dmx.dropped);
+  JSON_Writer_Literal(&writer, ",\"levels\":[");
+  for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Uint(&writer, dmx.levels[i]);
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the outcome of modbus/start
+ * @param msgId Original message ID
+ * @param status As Modbus_Check
+ * @param address Slave address
+ * @param baud Bus baud rate
+ * @param timeout_ms Master silence before the host link returns
+ * @retval None
+ */
+static void COMMS_Handler_SendModbusStartResponse(const char* msg_id, VAL_Status status, uint8_t address,
+                                                  uint32_t baud, uint32_t timeout_ms) {
+  JSON_Writer_t writer;
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "modbus", "start", "Invalid address, baud or timeout");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "modbus", "start", "DMX or Modbus active");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "modbus", "start");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"address\":");
+  JSON_Writer_Uint(&writer, address);
+  JSON_Writer_Literal(&writer, ",\"baud\":");
+  JSON_Writer_Uint(&writer, baud);
+  JSON_Writer_Literal(&writer, ",\"timeout\":");
+  JSON_Writer_Uint(&writer, timeout_ms);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the Modbus session state and the counts of the last session
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendModbusResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  Modbus_Status_t modbus;
+
+  Modbus_GetStatus(&modbus);
+
+  if (reply.binary) {
+    COMMS_Bin_Modbus_Status_t body;
+
+    body.active = modbus.active ? 1U : 0U;
+    body.address = modbus.address;
+    body.baud = modbus.baud;
+    body.timeout_ms = modbus.timeout_ms;
+    body.requests = modbus.requests;
+    body.exceptions = modbus.exceptions;
+    body.crc_errors = modbus.crc_errors;
+    body.ignored = modbus.ignored;
+    body.dropped = modbus.dropped;
+    body.max_response_us = modbus.max_response_us;
+    COMMS_Handler_SendBinaryResponse(VAL_OK, (const uint8_t*)&body, sizeof(body));
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "modbus", "status");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"active\":");
+  JSON_Writer_Bool(&writer, modbus.active);
+  JSON_Writer_Literal(&writer, ",\"address\":");
+  JSON_Writer_Uint(&writer, modbus.address);
+  JSON_Writer_Literal(&writer, ",\"baud\":");
+  JSON_Writer_Uint(&writer, modbus.baud);
+  JSON_Writer_Literal(&writer, ",\"timeout\":");
+  JSON_Writer_Uint(&writer, modbus.timeout_ms);
+  JSON_Writer_Literal(&writer, ",\"requests\":");
+  JSON_Writer_Uint(&writer, modbus.requests);
+  JSON_Writer_Literal(&writer, ",\"exceptions\":");
+  JSON_Writer_Uint(&writer, modbus.exceptions);
+  JSON_Writer_Literal(&writer, ",\"crc_errors\":");
+  JSON_Writer_Uint(&writer, modbus.crc_errors);
+  JSON_Writer_Literal(&writer, ",\"ignored\":");
+  JSON_Writer_Uint(&writer, modbus.ignored);
+  JSON_Writer_Literal(&writer, ",\"dropped\":");
+  JSON_Writer_Uint(&writer, modbus.dropped);
+  JSON_Writer_Literal(&writer, ",\"max_response_us\":");
+  JSON_Writer_Uint(&writer, modbus.max_response_us);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the outcome of a rules command
+ * @note rules/add also reports the rules in the table
+ * @param msgId Original message ID
+ * @param action Command action
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendRulesStatusResponse(const char* msg_id, const char* action, VAL_Status status) {
+  JSON_Writer_t writer;
+  Rules_Status_t rules;
+  bool add = (strcmp(action, "add") == 0);
+
+  SYS_Coordinator_GetRulesStatus(&rules);
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, &rules.rule_count, add ? 1 : 0);
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "rules", action, "Invalid rule");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "rules", action, "Rules table full");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponseFor(&writer, msg_id, "rules", action);
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK);
+  if (add) {
+    JSON_Writer_Literal(&writer, ",\"rule\":");
+    JSON_Writer_Uint(&writer, rules.rule_count);
+  }
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the rules table size and counters
+ * @param msgId Original message ID
+ * @retval None
+ */
+static void COMMS_Handler_SendRulesResponse(const char* msg_id) {
+  JSON_Writer_t writer;
+  Rules_Status_t rules;
+
+  SYS_Coordinator_GetRulesStatus(&rules);
+
+  if (reply.binary) {
+    COMMS_Bin_Rules_Status_t body;
+
+    body.rule_count = rules.rule_count;
+    body.scans = rules.scans;
+    body.active = rules.active;
+    memcpy(body.hits, rules.hits, sizeof(body.hits));
+    COMMS_Handler_SendBinaryResponse(VAL_OK, (const uint8_t*)&body, sizeof(body));
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "rules", "status");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"rules\":");
+  JSON_Writer_Uint(&writer, rules.rule_count);
+  JSON_Writer_Literal(&writer, ",\"scans\":");
+  JSON_Writer_Uint(&writer, rules.scans);
+  JSON_Writer_Literal(&writer, ",\"active\":");
+  JSON_Writer_Uint(&writer, rules.active);
+  JSON_Writer_Literal(&writer, ",\"hits\":[");
+  for (int i = 0; i < rules.rule_count; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Uint(&writer, rules.hits[i]);
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send response for a part of a command macro, once the last one is stored
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendSaveMacroResponse(const char* msg_id, VAL_Status status) {
+  if (!reply.binary) {
+    COMMS_Handler_SendErrorResponse(msg_id, "macro", "save", "Binary protocol only");
+    return;
+  }
+
+  COMMS_Handler_SendBinaryResponse(status, &macro_received, sizeof(macro_received));
+}
+
+/**
+ * @brief Send the outcome of a command macro run
+ * @param msgId Original message ID
+ * @param status Operation status
+ * @retval None
+ */
+static void COMMS_Handler_SendRunMacroResponse(const char* msg_id, VAL_Status status) {
+  JSON_Writer_t writer;
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, &macro_result, sizeof(macro_result));
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "macro", "run", "Invalid macro");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "macro", "run", "Macro not saved");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "macro", "run");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"id\":");
+  JSON_Writer_Uint(&writer, macro_result.macro);
+  JSON_Writer_Literal(&writer, ",\"steps\":");
+  JSON_Writer_Uint(&writer, macro_result.steps);
+  JSON_Writer_Literal(&writer, ",\"failed\":");
+  JSON_Writer_Uint(&writer, macro_result.failed);
+  JSON_Writer_Literal(&writer, ",\"first_failed\":");
+  JSON_Writer_Uint(&writer, macro_result.first_failed);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send a saved command macro
+ * @note JSON hosts get the commands by name, binary hosts as saved
+ * @param msgId Original message ID
+ * @param macro Macro number
+ * @retval None
+ */
+static void COMMS_Handler_SendMacroResponse(const char* msg_id, uint8_t macro) {
+  JSON_Writer_t writer;
+  Config_Macro_t data;
+  VAL_Status status = SYS_Coordinator_GetMacro(macro, &data);
+
+  if (reply.binary) {
+    uint8_t body[1 + CONFIG_MACRO_BYTES];
+
+    body[0] = data.steps;
+    if (status == VAL_OK) {
+      memcpy(&body[1], data.commands, data.length);
+    }
+    COMMS_Handler_SendBinaryResponse(status, body, 1U + data.length);
+    return;
+  }
+
+  if (status == VAL_PARAM) {
+    COMMS_Handler_SendErrorResponse(msg_id, "macro", "get", "Invalid macro");
+    return;
+  } else if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "macro", "get", "Macro not saved");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "macro", "get");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"id\":");
+  JSON_Writer_Uint(&writer, macro);
+  JSON_Writer_Literal(&writer, ",\"commands\":[");
+  for (uint16_t pos = 0, i = 0; pos + 2U <= data.length; pos += 2U + data.commands[pos + 1U], i++) {
+    const COMMS_Command_t* command = COMMS_Handler_MacroCommand(data.commands[pos]);
+
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Char(&writer, '"');
+    if (command != NULL) {
+      JSON_Writer_Text(&writer, command->topic);
+      JSON_Writer_Char(&writer, '/');
+      JSON_Writer_Text(&writer, command->action);
+    } else {
+      JSON_Writer_Text(&writer, "unknown");
+    }
+    JSON_Writer_Char(&writer, '"');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the last current spectrum
+ * @note Counts are converted with the calibration of the light, without the
+ *       supply correction of the filtered readings
+ * @param msgId Original message ID
+ * @param status Status of the analysis
+ * @retval None
+ */
+static void COMMS_Handler_SendSpectrumResponse(const char* msg_id, VAL_Status status) {
+  JSON_Writer_t writer;
+  AnalogCalibration calibration = {0};
+  const Spectrum_Result_t* result = &spectrum_result;
+
+  if (status == VAL_BUSY) {
+    COMMS_Handler_SendBusyResponse(msg_id, "diag", "spectrum");
+    return;
+  }
+  if (reply.binary && status != VAL_OK) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "diag", "spectrum",
+                                    (status == VAL_PARAM) ? "Invalid spectrum settings" : "Capture failed");
+    return;
+  }
+
+  /* Straight line through the calibration offset */
+  VAL_Analog_GetCalibration(spectrum_light, &calibration);
+  uint32_t zero_counts = VAL_Analog_CurrentToCounts(spectrum_light, calibration.current_offset_ma);
+  uint32_t span_counts = VAL_Analog_CurrentToCounts(spectrum_light, calibration.current_offset_ma +
+                                                    SPECTRUM_SCALE_SPAN_MA) - zero_counts;
+  float ma_per_count = (span_counts != 0) ? (float)SPECTRUM_SCALE_SPAN_MA / (float)span_counts : 0.0f;
+  float mean_ma = (float)calibration.current_offset_ma + (result->mean - (float)zero_counts) * ma_per_count;
+
+  if (reply.binary) {
+    uint8_t body[sizeof(COMMS_Bin_Spectrum_t) + SPECTRUM_PEAKS_MAX * sizeof(COMMS_Bin_Spectrum_Peak_t)];
+    COMMS_Bin_Spectrum_t header;
+
+    header.light_id = spectrum_light;
+    header.size = SPECTRUM_SIZE;
+    header.rate_hz = spectrum_rate_hz;
+    header.mean_ua = (int32_t)(mean_ma * 1000.0f);
+    header.ripple_ua = (uint32_t)(result->ripple_rms * ma_per_count * 1000.0f);
+    header.peak_count = result->peak_count;
+    memcpy(&body[0], &header, sizeof(header));
+
+    for (uint8_t i = 0; i < result->peak_count; i++) {
+      COMMS_Bin_Spectrum_Peak_t peak;
+
+      peak.bin = result->peaks[i].bin;
+      peak.amplitude_ua = (uint32_t)(result->peaks[i].amplitude * ma_per_count * 1000.0f);
+      memcpy(&body[sizeof(header) + i * sizeof(peak)], &peak, sizeof(peak));
+    }
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body,
+                                     sizeof(header) + result->peak_count * sizeof(COMMS_Bin_Spectrum_Peak_t));
+    return;
+  }
+
+  float resolution_hz = (float)spectrum_rate_hz / (float)SPECTRUM_SIZE;
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "diag", "spectrum");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"id\":");
+  JSON_Writer_Uint(&writer, spectrum_light);
+  JSON_Writer_Literal(&writer, ",\"rate\":");
+  JSON_Writer_Uint(&writer, spectrum_rate_hz);
+  JSON_Writer_Literal(&writer, ",\"size\":");
+  JSON_Writer_Uint(&writer, SPECTRUM_SIZE);
+  JSON_Writer_Literal(&writer, ",\"resolution\":");
+  JSON_Writer_Fixed(&writer, resolution_hz, 2);
+  JSON_Writer_Literal(&writer, ",\"mean\":");
+  JSON_Writer_Fixed(&writer, mean_ma, 2);
+  JSON_Writer_Literal(&writer, ",\"ripple\":");
+  JSON_Writer_Fixed(&writer, result->ripple_rms * ma_per_count, 3);
+  JSON_Writer_Literal(&writer, ",\"peaks\":[");
+  for (uint8_t i = 0; i < result->peak_count; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"frequency\":");
+    JSON_Writer_Fixed(&writer, (float)result->peaks[i].bin * resolution_hz, 1);
+    JSON_Writer_Literal(&writer, ",\"amplitude\":");
+    JSON_Writer_Fixed(&writer, result->peaks[i].amplitude * ma_per_count, 3);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send the progress of the raw capture and the scans that follow one
+ * @param msgId Original message ID
+ * @param from Index of the first scan wanted
+ * @retval None
+ */
+static void COMMS_Handler_SendCaptureReadResponse(const char* msg_id, uint16_t from) {
+  JSON_Writer_t writer;
+  AnalogCaptureStatus capture;
+  COMMS_Bin_Capture_Header_t header;
+
+  VAL_Analog_GetCaptureStatus(&capture);
+  header.state = (uint8_t)capture.state;
+  header.scans = capture.scans;
+  header.scans_wanted = capture.scans_wanted;
+  header.from = from;
+  header.first_sample = capture.first_sample;
+  header.rate_hz = (uint16_t)VAL_Analog_GetSampleRate();
+  header.full_scale = (uint16_t)VAL_Analog_GetFullScaleCounts();
+
+  if (reply.binary) {
+    uint8_t body[sizeof(header) + CAPTURE_BIN_SCANS * CAPTURE_SCAN_SIZE];
+    uint16_t samples[CAPTURE_BIN_SCANS * ANALOG_CHANNEL_COUNT];
+    uint16_t count = VAL_Analog_ReadCapture(from, CAPTURE_BIN_SCANS, samples);
+
+    memcpy(&body[0], &header, sizeof(header));
+    memcpy(&body[sizeof(header)], samples, count * CAPTURE_SCAN_SIZE);
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, sizeof(header) + count * CAPTURE_SCAN_SIZE);
+    return;
+  }
+
+  uint16_t samples[CAPTURE_JSON_SCANS][ANALOG_CHANNEL_COUNT];
+  uint16_t count = VAL_Analog_ReadCapture(from, CAPTURE_JSON_SCANS, &samples[0][0]);
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "capture", "read");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"state\":");
+  JSON_Writer_String(&writer, capture_state_names[capture.state]);
+  JSON_Writer_Literal(&writer, ",\"scans\":");
+  JSON_Writer_Uint(&writer, header.scans);
+  JSON_Writer_Literal(&writer, ",\"wanted\":");
+  JSON_Writer_Uint(&writer, header.scans_wanted);
+  JSON_Writer_Literal(&writer, ",\"from\":");
+  JSON_Writer_Uint(&writer, from);
+  JSON_Writer_Literal(&writer, ",\"first_sample\":");
+  JSON_Writer_Uint(&writer, header.first_sample);
+  JSON_Writer_Literal(&writer, ",\"rate_hz\":");
+  JSON_Writer_Uint(&writer, header.rate_hz);
+  JSON_Writer_Literal(&writer, ",\"full_scale\":");
+  JSON_Writer_Uint(&writer, header.full_scale);
+  JSON_Writer_Literal(&writer, ",\"samples\":[");
+  for (uint16_t i = 0; i < count; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Char(&writer, '[');
+    for (uint8_t ch = 0; ch < ANALOG_CHANNEL_COUNT; ch++) {
+      if (ch > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Uint(&writer, samples[i][ch]);
+    }
+    JSON_Writer_Char(&writer, ']');
+  }
+  JSON_Writer_Char(&writer, ']');
+
+  /* Send response */
+  if (COMMS_Handler_EndResponse(&writer, probe_start) != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "capture", "read", "Response too long");
+  }
+}
+
+/**
+ * @brief Send recorded capture scans delta encoded, as many as fit one frame
+ * @note  Binary protocol only. Scans are read a few at a time and encoded
+ *        as they go, so only the previous sample of each channel is kept.
+ * @param msgId Original message ID
+ * @param from Index of the first scan to send
+ * @retval None
+ */
+static void COMMS_Handler_SendCapturePackedResponse(const char* msg_id, uint16_t from) {
+  AnalogCaptureStatus capture;
+  COMMS_Bin_Capture_Header_t header;
+  uint8_t body[CAPTURE_PACKED_BODY];
+  uint16_t samples[CAPTURE_BIN_SCANS][ANALOG_CHANNEL_COUNT];
+  COMMS_Capture_Packer_t packer;
+  const size_t data_start = sizeof(header) + 1;
+  uint8_t count = 0;
+
+  if (!reply.binary) {
+    COMMS_Handler_SendErrorResponse(msg_id, "capture", "read_packed", "Binary protocol only");
+    return;
+  }
+
+  VAL_Analog_GetCaptureStatus(&capture);
+  header.state = (uint8_t)capture.state;
+  header.scans = capture.scans;
+  header.scans_wanted = capture.scans_wanted;
+  header.from = from;
+  header.first_sample = capture.first_sample;
+  header.rate_hz = (uint16_t)VAL_Analog_GetSampleRate();
+  header.full_scale = (uint16_t)VAL_Analog_GetFullScaleCounts();
+
+  memset(&packer, 0, sizeof(packer));
+  packer.keyframe = true;
+  packer.data = &body[data_start];
+  packer.capacity = (uint16_t)((sizeof(body) - data_start) * 2U);
+
+  /* Stop at the first scan that might not fit, or the end of the recording */
+  for (;;) {
+    uint16_t chunk = VAL_Analog_ReadCapture(from + count, CAPTURE_BIN_SCANS, &samples[0][0]);
+    uint16_t packed = 0;
+
+    while (packed < chunk && count < UINT8_MAX &&
+           COMMS_Handler_PackScan(&packer, samples[packed])) {
+      packed++;
+      count++;
+    }
+    if (chunk == 0 || packed < chunk) {
+      break;
+    }
+  }
+
+  memcpy(&body[0], &header, sizeof(header));
+  body[sizeof(header)] = count;
+  COMMS_Handler_SendBinaryResponse(VAL_OK, body, data_start + (packer.nibbles + 1U) / 2U);
+}
+
+/**
+ * @brief Append one capture scan to a packed response
+ * @param packer Encoder state
+ * @param scan A raw sample per ADC channel
+ * @retval bool true if appended, false if a scan might not fit any more
+ */
+static bool COMMS_Handler_PackScan(COMMS_Capture_Packer_t* packer, const uint16_t* scan) {
+  if (packer->nibbles + CAPTURE_PACKED_SCAN_MAX > packer->capacity) {
+    return false;
+  }
+
+  for (uint8_t ch = 0; ch < ANALOG_CHANNEL_COUNT; ch++) {
+    int32_t delta = (int32_t)scan[ch] - (int32_t)packer->last[ch];
+    uint32_t zigzag = (delta >= 0) ? ((uint32_t)delta << 1) : (((uint32_t)-delta << 1) - 1U);
+
+    if (!packer->keyframe && zigzag < CAPTURE_PACKED_ESCAPE) {
+      COMMS_Handler_PackNibble(packer, (uint8_t)zigzag);
+    } else {
+      COMMS_Handler_PackNibble(packer, CAPTURE_PACKED_ESCAPE);
+      for (int8_t shift = 12; shift >= 0; shift -= 4) {
+        COMMS_Handler_PackNibble(packer, (uint8_t)((scan[ch] >> shift) & 0xFU));
+      }
+    }
+    packer->last[ch] = scan[ch];
+  }
+  packer->keyframe = false;
+
+  return true;
+}
+
+/**
+ * @brief Append a nibble to a packed response, high nibble of a byte first
+ * @param packer Encoder state
+ * @param nibble Value (0-15)
+ * @retval None
+ */
+static void COMMS_Handler_PackNibble(COMMS_Capture_Packer_t* packer, uint8_t nibble) {
+  uint8_t* byte = &packer->data[packer->nibbles / 2U];
+
+  if ((packer->nibbles & 1U) == 0) {
+    *byte = (uint8_t)(nibble << 4);
+  } else {
+    *byte |= nibble;
+  }
+  packer->nibbles++;
+}
+
+/**
+ * @brief Queue a formatted message for transmission
+ * @note  Dropped for a broadcast command
+ * @param buffer Buffer holding the message
+ * @param length Number of bytes formatted into the buffer
+ * @param format_start Profiler timestamp taken before formatting began
+ * @retval VAL_Status Status of TxPool_SendSegments
+ */
+static VAL_Status COMMS_Handler_Transmit(const char* buffer, int length, uint32_t format_start) {
+  VAL_Serial_Segment_t segment = { (const uint8_t*)buffer, (uint16_t)length };
+
+  return COMMS_Handler_TransmitSegments(&segment, 1, format_start);
+}
+
+/**
+ * @brief Queue a message made of several segments for transmission
+ * @note  Dropped for a broadcast command, and for a successful one sent
+ *        with "ack":false. Sent as a CBOR frame to a CBOR host.
+ * @param segments Buffers of the message, in order
+ * @param count Number of segments
+ * @param format_start Profiler timestamp taken before formatting began
+ * @retval VAL_Status Status of TxPool_SendSegments
+ */
+static VAL_Status COMMS_Handler_TransmitSegments(const VAL_Serial_Segment_t* segments, uint8_t count,
+                                                 uint32_t format_start) {
+  VAL_Serial_Segment_t cbor_segment;
+  size_t length = 0;
+
+  for (uint8_t i = 0; i < count; i++) {
+    length += segments[i].length;
+  }
+
+  /* Self-test responses are only timed */
+  if (tx_null_sink) {
+    selftest_format_cycles += Profiler_Start() - format_start;
+    selftest_bytes += (uint32_t)length;
+    return VAL_OK;
+  }
+
+  Profiler_Stop(PROFILER_PROBE_RESPONSE_FORMAT, format_start);
+
+  /* Every device runs a broadcast command; none of them answers */
+  if (reply.silent) {
+    return VAL_OK;
+  }
+
+  /* Unacknowledged commands are only answered when they fail */
+  if (reply.no_ack && reply.status == VAL_OK) {
+    return VAL_OK;
+  }
+
+  /* A CBOR host gets the same message re-encoded, in one segment */
+  if (reply.cbor) {
+    size_t pos;
+
+    if (length > sizeof(cborFrame)) {
+      return VAL_ERROR;
+    }
+    pos = sizeof(cborFrame) - length;
+    for (uint8_t i = 0; i < count; i++) {
+      memcpy(&cborFrame[pos], segments[i].data, segments[i].length);
+      pos += segments[i].length;
+    }
+
+    length = COMMS_Handler_EncodeCbor(cborFrame, sizeof(cborFrame), length, reply.seq);
+    if (length == 0) {
+      return VAL_ERROR;
+    }
+    cbor_segment.data = cborFrame;
+    cbor_segment.length = (uint16_t)length;
+    segments = &cbor_segment;
+    count = 1;
+  }
+
+  /* Batch responses are collected and sent together by COMMS_Handler_RunBatch */
+  if (batch_collecting) {
+    size_t batch_limit = Transport_GetMtu();
+
+    if (batch_limit > BATCH_BUFFER_SIZE) {
+      batch_limit = BATCH_BUFFER_SIZE;
+    }
+    if (batch_length + length > batch_limit) {
+      /* Full: send what is collected so far and continue from empty */
+      TxPool_SendDirect((const uint8_t*)batchBuffer, batch_length, TX_PRIORITY_RESPONSE, 1000);
+      batch_length = 0;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+      memcpy(&batchBuffer[batch_length], segments[i].data, segments[i].length);
+      batch_length += segments[i].length;
+    }
+    return VAL_OK;
+  }
+
+  uint32_t send_start = Profiler_Start();
+  VAL_Status status = TxPool_SendSegments(segments, count, TX_PRIORITY_RESPONSE, 1000);
+  Profiler_Stop(PROFILER_PROBE_SERIAL_SEND, send_start);
+  if (status == VAL_OK) {
+    Latency_ResponseQueued();
+  }
+
+  return status;
+}
+
+/**
+ * @brief Queue a formatted event for transmission
+ * @note  Events never join a batch response, so any task may send them.
+ *        A JSON event is re-encoded as a CBOR frame for a CBOR host.
+ * @param slot Pool slot holding the event, released once sent
+ * @param length Number of bytes formatted into the slot
+ * @param format_start Profiler timestamp taken before formatting began
+ * @retval VAL_Status Status of TxPool_Queue
+ */
+static VAL_Status COMMS_Handler_TransmitEvent(TxPool_Handle_t slot, size_t length, uint32_t format_start) {
+  uint8_t* buffer = (uint8_t*)TxPool_GetBuffer(slot);
+
+  /* JSON events go to a CBOR host re-encoded in their slot; binary ones,
+   * starting with a delimiter, are left alone */
+  if (host_cbor && buffer != NULL && length > 0 && buffer[0] == '{') {
+    memmove(&buffer[TX_POOL_SLOT_SIZE - length], buffer, length);
+    length = COMMS_Handler_EncodeCbor(buffer, TX_POOL_SLOT_SIZE, length, 0);
+    if (length == 0) {
+      TxPool_Release(slot);
+      return VAL_ERROR;
+    }
+  }
+
+  Profiler_Stop(PROFILER_PROBE_RESPONSE_FORMAT, format_start);
+
+  uint32_t send_start = Profiler_Start();
+  VAL_Status status = TxPool_Queue(slot, length);
+  Profiler_Stop(PROFILER_PROBE_SERIAL_SEND, send_start);
+
+  return status;
+}
+
+/**
+ * @brief Re-encode a JSON message as a CBOR frame, in its own buffer
+ * @note  The frame is built from the start of the buffer over the text
+ *        already converted, see CBOR_FromJson; a message that fills the
+ *        buffer to within a few bytes does not fit.
+ * @param buffer Buffer holding the message in its last length bytes
+ * @param size Size of the buffer
+ * @param length Message length
+ * @param seq Sequence number of the frame
+ * @retval size_t Frame length from the start of the buffer, 0 if it does not fit
+ */
+static size_t COMMS_Handler_EncodeCbor(uint8_t* buffer, size_t size, size_t length, uint8_t seq) {
+  size_t offset = COMMS_BIN_FRAME_LEAD(size);
+  size_t body_start = offset + COMMS_BIN_HEADER_SIZE;
+  size_t body;
+
+  if (length > size || body_start > size - length) {
+    return 0;
+  }
+
+  body = CBOR_FromJson(&buffer[body_start], size - body_start, (const char*)&buffer[size - length], length);
+  if (body == 0) {
+    return 0;
+  }
+
+  buffer[offset] = COMMS_BIN_TYPE_CBOR;
+  buffer[offset + 1] = seq;
+  buffer[offset + 2] = 0;
+
+  return COMMS_Binary_EncodeInPlace(buffer, size, offset, COMMS_BIN_HEADER_SIZE + body);
+}
+
+/**
+ * @brief Start a response in txBuffer with a precomputed header
+ * @param writer Writer to initialize
+ * @param msg_id Original message ID, unused for an integer ID
+ * @param header Header following the message ID, see RESP_HEADER
+ * @param header_length Header length
+ * @retval None
+ */
+static void COMMS_Handler_WriteHeader(JSON_Writer_t* writer, const char* msg_id,
+                                      const char* header, size_t header_length) {
+  JSON_Writer_Init(writer, txBuffer, TX_BUFFER_SIZE);
+
+  /* The header starts by closing the quoted ID */
+  if (reply.id_numeric) {
+    JSON_Writer_Literal(writer, "{\"type\":\"resp\",\"id\":");
+    JSON_Writer_Uint(writer, reply.id_number);
+    JSON_Writer_Append(writer, header + 1, header_length - 1);
+    return;
+  }
+
+  JSON_Writer_Literal(writer, "{\"type\":\"resp\",\"id\":\"");
+  JSON_Writer_Text(writer, msg_id);
+  JSON_Writer_Append(writer, header, header_length);
+}
+
+/**
+ * @brief Start a response in txBuffer for a topic/action given at runtime
+ * @param writer Writer to initialize
+ * @param msg_id Original message ID, unused for an integer ID
+ * @param topic Message topic
+ * @param action Message action
+ * @retval None
+ */
+static void COMMS_Handler_BeginResponseFor(JSON_Writer_t* writer, const char* msg_id,
+                                           const char* topic, const char* action) {
+  JSON_Writer_Init(writer, txBuffer, TX_BUFFER_SIZE);
+  if (reply.id_numeric) {
+    JSON_Writer_Literal(writer, "{\"type\":\"resp\",\"id\":");
+    JSON_Writer_Uint(writer, reply.id_number);
+    JSON_Writer_Literal(writer, ",\"topic\":\"");
+  } else {
+    JSON_Writer_Literal(writer, "{\"type\":\"resp\",\"id\":\"");
+    JSON_Writer_Text(writer, msg_id);
+    JSON_Writer_Literal(writer, "\",\"topic\":\"");
+  }
+  JSON_Writer_Text(writer, topic);
+  JSON_Writer_Literal(writer, "\",\"action\":\"");
+  JSON_Writer_Text(writer, action);
+  JSON_Writer_Literal(writer, "\",\"data\":{");
+}
+
+/**
+ * @brief Close the data object of a response and queue it
+ * @param writer Writer holding the response
+ * @param format_start Profiler timestamp taken before formatting began
+ * @retval VAL_Status VAL_ERROR if the response did not fit, else as COMMS_Handler_Transmit
+ */
+static VAL_Status COMMS_Handler_EndResponse(JSON_Writer_t* writer, uint32_t format_start) {
+  JSON_Writer_Literal(writer, RESP_END);
+
+  if (writer->overflow) {
+    return VAL_ERROR;
+  }
+
+  return COMMS_Handler_Transmit(writer->buffer, writer->length, format_start);
+}
+
+/**
+ * @brief Start a gathered response with a header fixed at compile time
+ * @param gather Response to initialize
+ * @param msg_id Original message ID, unused for an integer ID
+ * @param header Header following the message ID, see RESP_HEADER
+ * @param header_length Header length
+ * @retval None
+ */
+static void COMMS_Handler_GatherHeader(COMMS_Gather_t* gather, const char* msg_id,
+                                       const char* header, size_t header_length) {
+  size_t start;
+
+  gather->count = 0;
+  gather->overflow = false;
+  JSON_Writer_Init(&gather->fields, txBuffer, TX_BUFFER_SIZE);
+
+  /* The header starts by closing the quoted ID */
+  if (reply.id_numeric) {
+    COMMS_Handler_GatherLiteral(gather, "{\"type\":\"resp\",\"id\":");
+    COMMS_Handler_GatherUint(gather, reply.id_number);
+    COMMS_Handler_GatherConst(gather, header + 1, header_length - 1);
+    return;
+  }
+
+  COMMS_Handler_GatherLiteral(gather, "{\"type\":\"resp\",\"id\":\"");
+  start = gather->fields.length;
+  JSON_Writer_Text(&gather->fields, msg_id);
+  COMMS_Handler_GatherConst(gather, &txBuffer[start], gather->fields.length - start);
+  COMMS_Handler_GatherConst(gather, header, header_length);
+}
+
+/**
+ * @brief Start a gathered response for a topic/action given at runtime
+ * @note  The topic and action are sent in place, they must stay valid
+ *        until the response is queued
+ * @param gather Response to initialize
+ * @param msg_id Original message ID, unused for an integer ID
+ * @param topic Message topic
+ * @param action Message action
+ * @retval None
+ */
+static void COMMS_Handler_BeginGatherFor(COMMS_Gather_t* gather, const char* msg_id,
+                                         const char* topic, const char* action) {
+  COMMS_Handler_GatherHeader(gather, msg_id, "\",\"topic\":\"", sizeof("\",\"topic\":\"") - 1);
+  COMMS_Handler_GatherConst(gather, topic, strlen(topic));
+  COMMS_Handler_GatherLiteral(gather, "\",\"action\":\"");
+  COMMS_Handler_GatherConst(gather, action, strlen(action));
+  COMMS_Handler_GatherLiteral(gather, "\",\"data\":{");
+}
+
+/**
+ * @brief Append text sent in place to a gathered response
+ * @param gather Response
+ * @param text Text, valid until the response is queued
+ * @param length Text length
+ * @retval None
+ */
+static void COMMS_Handler_GatherConst(COMMS_Gather_t* gather, const char* text, size_t length) {
+  if (length == 0) {
+    return;
+  }
+
+  if (gather->count >= GATHER_MAX_SEGMENTS) {
+    gather->overflow = true;
+    return;
+  }
+
+  gather->segments[gather->count].data = (const uint8_t*)text;
+  gather->segments[gather->count].length = (uint16_t)length;
+  gather->count++;
+}
+
+/**
+ * @brief Append an unsigned integer field to a gathered response
+ * @param gather Response
+ * @param value Value to append
+ * @retval None
+ */
+static void COMMS_Handler_GatherUint(COMMS_Gather_t* gather, uint32_t value) {
+  size_t start = gather->fields.length;
+
+  JSON_Writer_Uint(&gather->fields, value);
+  COMMS_Handler_GatherConst(gather, &txBuffer[start], gather->fields.length - start);
+}
+
+/**
+ * @brief Close the data object of a gathered response and queue it
+ * @param gather Response
+ * @param format_start Profiler timestamp taken before formatting began
+ * @retval VAL_Status VAL_ERROR if the response did not fit, else as COMMS_Handler_TransmitSegments
+ */
+static VAL_Status COMMS_Handler_EndGather(COMMS_Gather_t* gather, uint32_t format_start) {
+  COMMS_Handler_GatherLiteral(gather, RESP_END);
+
+  if (gather->overflow || gather->fields.overflow) {
+    return VAL_ERROR;
+  }
+
+  return COMMS_Handler_TransmitSegments(gather->segments, gather->count, format_start);
+}
+
+/**
+ * @brief Check whether a fragment was rendered from the given state
+ * @note  If not, the fragment takes the state and the writer is set up to
+ *        render it again; finish with COMMS_Handler_EndFragment
+ * @param fragment Fragment
+ * @param key State the fragment shows, compared bytewise
+ * @param key_size Size of the state, at most FRAGMENT_KEY_SIZE
+ * @param writer Writer to initialize on the fragment text
+ * @retval bool true if the text is current and may be sent as it is
+ */
+static bool COMMS_Handler_FragmentCurrent(COMMS_Fragment_t* fragment, const void* key, size_t key_size,
+                                          JSON_Writer_t* writer) {
+  if (fragment->length > 0 && fragment->key_size == key_size && memcmp(fragment->key, key, key_size) == 0) {
+    return true;
+  }
+
+  /* A state too large to compare is rendered every time */
+  fragment->length = 0;
+  fragment->key_size = 0;
+  if (key_size <= sizeof(fragment->key)) {
+    memcpy(fragment->key, key, key_size);
+    fragment->key_size = (uint8_t)key_size;
+  }
+
+  JSON_Writer_Init(writer, fragment->text, fragment->size);
+  return false;
+}
+
+/**
+ * @brief Finish rendering a fragment
+ * @param fragment Fragment
+ * @param writer Writer the text was rendered with
+ * @retval None
+ */
+static void COMMS_Handler_EndFragment(COMMS_Fragment_t* fragment, const JSON_Writer_t* writer) {
+  fragment->length = writer->overflow ? 0 : (uint16_t)writer->length;
+}
+
+/**
+ * @brief Append a rendered fragment to a gathered response
+ * @note  The fragment is sent in place; a text that did not fit fails the response
+ * @param gather Response
+ * @param fragment Fragment finished with COMMS_Handler_EndFragment
+ * @retval None
+ */
+static void COMMS_Handler_GatherFragment(COMMS_Gather_t* gather, const COMMS_Fragment_t* fragment) {
+  if (fragment->length == 0) {
+    gather->overflow = true;
+    return;
+  }
+
+  COMMS_Handler_GatherConst(gather, fragment->text, fragment->length);
+}
+
+/**
+ * @brief Send a response that is fixed but for the message ID
+ * @note  Use through COMMS_Handler_SendFixedResponse
+ * @param msg_id Original message ID
+ * @param text Header and body, see RESP_HEADER
+ * @param length Text length
+ * @retval None
+ */
+static void COMMS_Handler_SendFixed(const char* msg_id, const char* text, size_t length) {
+  COMMS_Gather_t gather;
+  uint32_t probe_start = Profiler_Start();
+
+  COMMS_Handler_GatherHeader(&gather, msg_id, text, length);
+  COMMS_Handler_EndGather(&gather, probe_start);
+}
+
+/**
+ * @brief Write the JSON object of one light's sensor reading
+ * @param writer Writer
+ * @param light_id Light source ID
+ * @param data Sensor reading
+ * @param with_raw Also write the unfiltered values
+ * @retval None
+ */
+static void COMMS_Handler_WriteSensor(JSON_Writer_t* writer, uint8_t light_id, const LightSensorData_t* data,
+                                      bool with_raw) {
+  JSON_Writer_Literal(writer, "{\"id\":");
+  JSON_Writer_Uint(writer, light_id);
+  JSON_Writer_Literal(writer, ",\"current\":");
+  JSON_Writer_Fixed(writer, data->current, 1);
+  JSON_Writer_Literal(writer, ",\"temperature\":");
+  JSON_Writer_Fixed(writer, data->temperature, 1);
+  if (with_raw) {
+    JSON_Writer_Literal(writer, ",\"current_raw\":");
+    JSON_Writer_Fixed(writer, data->current_raw, 1);
+    JSON_Writer_Literal(writer, ",\"temperature_raw\":");
+    JSON_Writer_Fixed(writer, data->temperature_raw, 1);
+  }
+  JSON_Writer_Char(writer, '}');
+}
+
+/**
+ * @brief Write the sequence and time of a sensor snapshot as two fields
+ * @param writer Writer
+ * @param stamp When the readings were taken
+ * @retval None
+ */
+static void COMMS_Handler_WriteSampleStamp(JSON_Writer_t* writer, const LightSampleStamp_t* stamp) {
+  JSON_Writer_Literal(writer, ",\"sequence\":");
+  JSON_Writer_Uint(writer, stamp->sequence);
+  JSON_Writer_Literal(writer, ",\"timestamp_us\":");
+  JSON_Writer_Uint(writer, stamp->timestamp_us);
+}
+
+/**
+ * @brief Get the protocol name of an error type
+ * @param error_type Error type (ErrorType_t)
+ * @retval const char* Error code name
+ */
+static const char* COMMS_Handler_ErrorName(uint8_t error_type) {
+  switch (error_type) {
+    case 0:
+      return "none";
+    case 1:
+      return "over_current";
+    case 2:
+      return "over_temperature";
+    case 4:
+      return "deadline_overrun";
+    case 5:
+      return "sensor_fault";
+    default:
+      return "system_error";
+  }
+}
+
+/**
+ * @brief Get the protocol name of an alarm state
+ * @param state Alarm state
+ * @retval const char* State name
+ */
+static const char* COMMS_Handler_AlarmStateName(LED_Driver_AlarmState_t state) {
+  switch (state) {
+    case LED_DRIVER_ALARM_NORMAL:
+      return "normal";
+    case LED_DRIVER_ALARM_WARNING:
+      return "warning";
+    case LED_DRIVER_ALARM_TRIPPED:
+      return "tripped";
+    case LED_DRIVER_ALARM_RELEASED:
+      return "released";
+    default:
+      return "unknown";
+  }
+}
+
+/**
+ * @brief Get the event timestamp of an alarm
+ * @param alarm Alarm raised
+ * @param now_ms Current time in milliseconds, for alarms without a trip time
+ * @retval uint32_t Time of the trip in milliseconds since start-up
+ */
+static uint32_t COMMS_Handler_TripTimestamp(const COMMS_Alarm_Source_t* alarm, uint32_t now_ms) {
+  return (alarm->trip_us != 0) ? (uint32_t)(alarm->trip_us / 1000U) : now_ms;
+}
+
+/**
+ * @brief Write the wall-clock "time" of an event, if the clock is set
+ * @param writer JSON writer, inside the data object
+ * @param age_ms Time since the event in milliseconds
+ * @retval None
+ */
+static void COMMS_Handler_WriteTime(JSON_Writer_t* writer, uint32_t age_ms) {
+  uint64_t time = Clock_GetTimeBefore(age_ms);
+
+  if (time != 0) {
+    JSON_Writer_Literal(writer, ",\"time\":");
+    JSON_Writer_Uint64(writer, time);
+  }
+}
+
+/**
+ * @brief Send one alarm event for the alarms raised in the same sample
+ * @note  The top-level fields describe the first alarm, as for a single
+ *        alarm; "alarms" lists all of them when there are several. The
+ *        timestamps are the trip times where known.
+ * @param alarms Alarms raised
+ * @param count Number of alarms (1-VAL_LIGHT_COUNT)
+ * @retval VAL_Status VAL_OK if successful, VAL_BUSY if no TX slot was free,
+ *         VAL_ERROR otherwise
+ */
+VAL_Status COMMS_Handler_SendAlarmEvents(const COMMS_Alarm_Source_t* alarms, uint8_t count) {
+  uint32_t probe_start = Profiler_Start();
+  uint64_t now_us = VAL_SysClock_GetMicros64();
+  uint32_t timestamp = (uint32_t)(now_us / 1000U);
+  JSON_Writer_t writer;
+
+  if (alarms == NULL || count == 0 || count > VAL_LIGHT_COUNT) {
+    return VAL_PARAM;
+  }
+
+  /* Devices on a bus only talk when asked */
+  if (bus_mode) {
+    return VAL_OK;
+  }
+
+#ifdef BENCHMARK
+  alarm_event_us = now_us;
+#endif
+
+  TxPool_Handle_t slot = TxPool_Acquire(TX_PRIORITY_ALARM);
+  char* buffer = TxPool_GetBuffer(slot);
+
+  if (buffer == NULL) {
+    return VAL_BUSY;
+  }
+
+  /* Hosts talking binary get a binary event */
+  if (host_binary) {
+    COMMS_Bin_Alarm_Event_t events[VAL_LIGHT_COUNT];
+
+    for (uint8_t i = 0; i < count; i++) {
+      events[i].timestamp = COMMS_Handler_TripTimestamp(&alarms[i], timestamp);
+      events[i].light_id = alarms[i].light_id;
+      events[i].error_type = alarms[i].error_type;
+      events[i].value_milli = (int32_t)(alarms[i].value * 1000.0f);
+    }
+
+    size_t length = COMMS_Binary_EncodeFrame(COMMS_BIN_TYPE_EVENT, 0, COMMS_BIN_ALARM_TRIGGERED,
+                                             events, count * sizeof(events[0]),
+                                             (uint8_t*)buffer, TX_POOL_SLOT_SIZE);
+    return COMMS_Handler_TransmitEvent(slot, length, probe_start);
+  }
+
+  /* Format event message, the event ID is the time in microseconds, so two
+   * events in the same millisecond still differ */
+  JSON_Writer_Init(&writer, buffer, TX_POOL_SLOT_SIZE);
+  JSON_Writer_Literal(&writer, "{\"type\":\"event\",\"id\":\"evt-");
+  JSON_Writer_Uint(&writer, (uint32_t)now_us);
+  JSON_Writer_Literal(&writer, "\",\"topic\":\"alarm\",\"action\":\"triggered\",\"data\":{\"timestamp\":\"");
+  JSON_Writer_Uint(&writer, COMMS_Handler_TripTimestamp(&alarms[0], timestamp));
+  JSON_Writer_Literal(&writer, "\",\"code\":");
+  JSON_Writer_String(&writer, COMMS_Handler_ErrorName(alarms[0].error_type));
+  JSON_Writer_Literal(&writer, ",\"source\":\"light_");
+  JSON_Writer_Uint(&writer, alarms[0].light_id);
+  JSON_Writer_Literal(&writer, "\",\"value\":");
+  JSON_Writer_Fixed(&writer, alarms[0].value, 1);
+  JSON_Writer_Literal(&writer, ",\"status\":\"disabled\"");
+  COMMS_Handler_WriteTime(&writer, timestamp - COMMS_Handler_TripTimestamp(&alarms[0], timestamp));
+
+  if (count > 1) {
+    JSON_Writer_Literal(&writer, ",\"alarms\":[");
+    for (uint8_t i = 0; i < count; i++) {
+      if (i > 0) {
+        JSON_Writer_Literal(&writer, ",");
+      }
+      JSON_Writer_Literal(&writer, "{\"code\":");
+      JSON_Writer_String(&writer, COMMS_Handler_ErrorName(alarms[i].error_type));
+      JSON_Writer_Literal(&writer, ",\"source\":\"light_");
+      JSON_Writer_Uint(&writer, alarms[i].light_id);
+      JSON_Writer_Literal(&writer, "\",\"value\":");
+      JSON_Writer_Fixed(&writer, alarms[i].value, 1);
+      JSON_Writer_Literal(&writer, "}");
+    }
+    JSON_Writer_Literal(&writer, "]");
+  }
+  JSON_Writer_Literal(&writer, RESP_END);
+
+  if (writer.overflow) {
+    TxPool_Release(slot);
+    return VAL_ERROR;
+  }
+
+  /* Send event message */
+  return COMMS_Handler_TransmitEvent(slot, writer.length, probe_start);
+}
+
+/**
+ * @brief Send a thermal warning event
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param trend Temperature trend that raised the warning
+ * @retval VAL_Status VAL_OK if successful, VAL_BUSY if no TX slot was free,
+ *         VAL_ERROR otherwise
+ */
+VAL_Status COMMS_Handler_SendThermalWarning(uint8_t lightId, const LED_Driver_ThermalTrend_t* trend) {
+  uint32_t probe_start = Profiler_Start();
+  uint64_t now_us = VAL_SysClock_GetMicros64();
+  uint32_t timestamp = (uint32_t)(now_us / 1000U);
+  JSON_Writer_t writer;
+
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT || trend == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* Devices on a bus only talk when asked */
+  if (bus_mode) {
+    return VAL_OK;
+  }
+
+  TxPool_Handle_t slot = TxPool_Acquire(TX_PRIORITY_ALARM);
+  char* buffer = TxPool_GetBuffer(slot);
+
+  if (buffer == NULL) {
+    return VAL_BUSY;
+  }
+
+  if (host_binary) {
+    COMMS_Bin_Thermal_Warning_t event;
+
+    event.timestamp = timestamp;
+    event.light_id = lightId;
+    event.temperature_cdeg = (int16_t)trend->temperature_cdeg;
+    event.slope_cdeg_per_s = trend->slope_cdeg_per_s;
+    event.time_to_limit_ms = trend->time_to_limit_ms;
+
+    size_t length = COMMS_Binary_EncodeFrame(COMMS_BIN_TYPE_EVENT, 0, COMMS_BIN_ALARM_THERMAL_WARNING,
+                                             &event, sizeof(event),
+                                             (uint8_t*)buffer, TX_POOL_SLOT_SIZE);
+    return COMMS_Handler_TransmitEvent(slot, length, probe_start);
+  }
+
+  JSON_Writer_Init(&writer, buffer, TX_POOL_SLOT_SIZE);
+  JSON_Writer_Literal(&writer, "{\"type\":\"event\",\"id\":\"evt-");
+  JSON_Writer_Uint(&writer, (uint32_t)now_us);
+  JSON_Writer_Literal(&writer, "\",\"topic\":\"alarm\",\"action\":\"thermal_warning\",\"data\":{\"timestamp\":\"");
+  JSON_Writer_Uint(&writer, timestamp);
+  JSON_Writer_Literal(&writer, "\",\"source\":\"light_");
+  JSON_Writer_Uint(&writer, lightId);
+  JSON_Writer_Literal(&writer, "\",\"temperature\":");
+  JSON_Writer_Fixed(&writer, trend->temperature_cdeg / 100.0f, 2);
+  JSON_Writer_Literal(&writer, ",\"slope\":");
+  JSON_Writer_Fixed(&writer, trend->slope_cdeg_per_s / 100.0f, 2);
+  JSON_Writer_Literal(&writer, ",\"time_to_limit\":");
+  JSON_Writer_Fixed(&writer, trend->time_to_limit_ms / 1000.0f, 1);
+  COMMS_Handler_WriteTime(&writer, 0);
+  JSON_Writer_Literal(&writer, RESP_END);
+
+  if (writer.overflow) {
+    TxPool_Release(slot);
+    return VAL_ERROR;
+  }
+
+  return COMMS_Handler_TransmitEvent(slot, writer.length, probe_start);
+}
+
+/**
+ * @brief Send a power warning event
+ * @param budget Output factor and supply state after the crossing
+ * @retval VAL_Status VAL_OK if successful, VAL_BUSY if no TX slot was free,
+ *         VAL_ERROR otherwise
+ */
+VAL_Status COMMS_Handler_SendPowerWarning(const LED_Driver_Budget_t* budget) {
+  uint32_t probe_start = Profiler_Start();
+  uint64_t now_us = VAL_SysClock_GetMicros64();
+  uint32_t timestamp = (uint32_t)(now_us / 1000U);
+  uint32_t supply_mv = 0;
+  JSON_Writer_t writer;
+
+  if (budget == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* Devices on a bus only talk when asked */
+  if (bus_mode) {
+    return VAL_OK;
+  }
+
+  TxPool_Handle_t slot = TxPool_Acquire(TX_PRIORITY_ALARM);
+  char* buffer = TxPool_GetBuffer(slot);
+
+  if (buffer == NULL) {
+    return VAL_BUSY;
+  }
+
+  VAL_Analog_GetSupplyMilliVolts(&supply_mv);
+
+  if (host_binary) {
+    COMMS_Bin_Power_Warning_t event;
+
+    event.timestamp = timestamp;
+    event.low = budget->supply_low ? 1U : 0U;
+    event.threshold_mv = (uint16_t)VAL_Pvd_GetThreshold();
+    event.supply_mv = (uint16_t)supply_mv;
+    event.permille = budget->permille;
+    event.warnings = VAL_Pvd_GetWarningCount();
+
+    size_t length = COMMS_Binary_EncodeFrame(COMMS_BIN_TYPE_EVENT, 0, COMMS_BIN_ALARM_POWER_WARNING,
+                                             &event, sizeof(event),
+                                             (uint8_t*)buffer, TX_POOL_SLOT_SIZE);
+    return COMMS_Handler_TransmitEvent(slot, length, probe_start);
+  }
+
+  JSON_Writer_Init(&writer, buffer, TX_POOL_SLOT_SIZE);
+  JSON_Writer_Literal(&writer, "{\"type\":\"event\",\"id\":\"evt-");
+  JSON_Writer_Uint(&writer, (uint32_t)now_us);
+  JSON_Writer_Literal(&writer, "\",\"topic\":\"alarm\",\"action\":\"power_warning\",\"data\":{\"timestamp\":\"");
+  JSON_Writer_Uint(&writer, timestamp);
+  JSON_Writer_Literal(&writer, "\",\"low\":");
+  JSON_Writer_Bool(&writer, budget->supply_low);
+  JSON_Writer_Literal(&writer, ",\"supply_mv\":");
+  JSON_Writer_Uint(&writer, supply_mv);
+  JSON_Writer_Literal(&writer, ",\"threshold_mv\":");
+  JSON_Writer_Uint(&writer, VAL_Pvd_GetThreshold());
+  JSON_Writer_Literal(&writer, ",\"permille\":");
+  JSON_Writer_Uint(&writer, budget->permille);
+  JSON_Writer_Literal(&writer, ",\"warnings\":");
+  JSON_Writer_Uint(&writer, VAL_Pvd_GetWarningCount());
+  COMMS_Handler_WriteTime(&writer, 0);
+  JSON_Writer_Literal(&writer, RESP_END);
+
+  if (writer.overflow) {
+    TxPool_Release(slot);
+    return VAL_ERROR;
+  }
+
+  return COMMS_Handler_TransmitEvent(slot, writer.length, probe_start);
+}
+
+/**
+ * @brief Queue a stored command macro for the worker task, without waiting
+ * @note  The commands run as they would from macro/run, without responses.
+ *        Called from the system coordinator task for a rule.
+ * @param macro Macro number (1-CONFIG_MACRO_COUNT)
+ * @retval VAL_Status VAL_OK if queued, VAL_BUSY if the pipeline is full or
+ *         the handler is not running, VAL_PARAM if invalid
+ */
+VAL_Status COMMS_Handler_RunMacro(uint8_t macro) {
+  static COMMS_Pending_t pending;  /* Coordinator task only, copied into the queue */
+  uint8_t index = bin_command_index[COMMS_BIN_MACRO_RUN];
+
+  if (macro < 1 || macro > CONFIG_MACRO_COUNT) {
+    return VAL_PARAM;
+  }
+  if (pipeline_queue == NULL) {
+    return VAL_BUSY;
+  }
+
+  /* Answered like a broadcast command: not at all */
+  memset(&pending, 0, sizeof(pending));
+  pending.command = &command_table[index];
+  pending.reply.binary = true;
+  pending.reply.silent = true;
+  pending.reply.id_numeric = true;
+  pending.reply.code = COMMS_BIN_MACRO_RUN;
+  pending.start = Profiler_Start();
+  pending.received = pending.start;
+  pending.args.found = COMMAND_ARG_ID;
+  pending.args.id = macro;
+
+  return (xQueueSendToBack(pipeline_queue, &pending, 0) == pdPASS) ? VAL_OK : VAL_BUSY;
+}
+
+/**
+ * @brief Send a rules/fired event
+ * @param rule Rule number (1-RULES_MAX)
+ * @param value Watched value when it fired
+ * @retval VAL_Status VAL_OK if successful, VAL_BUSY if no TX slot was free,
+ *         VAL_ERROR otherwise
+ */
+VAL_Status COMMS_Handler_SendRuleEvent(uint8_t rule, float value) {
+  uint32_t probe_start = Profiler_Start();
+  uint64_t now_us = VAL_SysClock_GetMicros64();
+  uint32_t timestamp = (uint32_t)(now_us / 1000U);
+  JSON_Writer_t writer;
+
+  /* Devices on a bus only talk when asked */
+  if (bus_mode) {
+    return VAL_OK;
+  }
+
+  TxPool_Handle_t slot = TxPool_Acquire(TX_PRIORITY_ALARM);
+  char* buffer = TxPool_GetBuffer(slot);
+
+  if (buffer == NULL) {
+    return VAL_BUSY;
+  }
+
+  if (host_binary) {
+    COMMS_Bin_Rule_Fired_t event;
+
+    event.timestamp = timestamp;
+    event.rule = rule;
+    event.value_milli = (int32_t)(value * 1000.0f);
+
+    size_t length = COMMS_Binary_EncodeFrame(COMMS_BIN_TYPE_EVENT, 0, COMMS_BIN_RULES_FIRED,
+                                             &event, sizeof(event),
+                                             (uint8_t*)buffer, TX_POOL_SLOT_SIZE);
+    return COMMS_Handler_TransmitEvent(slot, length, probe_start);
+  }
+
+  JSON_Writer_Init(&writer, buffer, TX_POOL_SLOT_SIZE);
+  JSON_Writer_Literal(&writer, "{\"type\":\"event\",\"id\":\"evt-");
+  JSON_Writer_Uint(&writer, (uint32_t)now_us);
+  JSON_Writer_Literal(&writer, "\",\"topic\":\"rules\",\"action\":\"fired\",\"data\":{\"timestamp\":\"");
+  JSON_Writer_Uint(&writer, timestamp);
+  JSON_Writer_Literal(&writer, "\",\"rule\":");
+  JSON_Writer_Uint(&writer, rule);
+  JSON_Writer_Literal(&writer, ",\"value\":");
+  JSON_Writer_Fixed(&writer, value, 2);
+  COMMS_Handler_WriteTime(&writer, 0);
+  JSON_Writer_Literal(&writer, RESP_END);
+
+  if (writer.overflow) {
+    TxPool_Release(slot);
+    return VAL_ERROR;
+  }
+
+  return COMMS_Handler_TransmitEvent(slot, writer.length, probe_start);
+}
+
+/**
+ * @brief Send a log message event
+ * @note  Called from the logger task
+ * @param level Logger_Level_t of the message
+ * @param tick HAL tick when the message was logged
+ * @param text Formatted message
+ * @retval VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status COMMS_Handler_SendLogEvent(uint8_t level, uint32_t tick, const char* text) {
+  uint32_t probe_start = Profiler_Start();
+  JSON_Writer_t writer;
+  size_t length;
+
+  /* Devices on a bus only talk when asked */
+  if (bus_mode) {
+    return VAL_OK;
+  }
+
+  TxPool_Handle_t slot = TxPool_Acquire(TX_PRIORITY_LOG);
+  char* buffer = TxPool_GetBuffer(slot);
+
+  if (buffer == NULL) {
+    return VAL_BUSY;
+  }
+
+  if (host_binary) {
+    uint8_t body[COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE];
+    size_t text_length = strnlen(text, sizeof(body) - sizeof(uint32_t) - 2);  /* Level and NUL */
+
+    memcpy(&body[0], &tick, sizeof(tick));
+    body[sizeof(tick)] = level;
+    memcpy(&body[sizeof(tick) + 1], text, text_length);
+    body[sizeof(tick) + 1 + text_length] = '\0';
+
+    length = COMMS_Binary_EncodeFrame(COMMS_BIN_TYPE_EVENT, 0, COMMS_BIN_SYSTEM_LOG,
+                                      body, sizeof(tick) + 2 + text_length,
+                                      (uint8_t*)buffer, TX_POOL_SLOT_SIZE);
+  } else {
+    /* The event ID is generated from the timestamp */
+    JSON_Writer_Init(&writer, buffer, TX_POOL_SLOT_SIZE);
+    JSON_Writer_Literal(&writer, "{\"type\":\"event\",\"id\":\"log-");
+    JSON_Writer_Uint(&writer, tick);
+    JSON_Writer_Literal(&writer, "\",\"topic\":\"system\",\"action\":\"log\",\"data\":{\"level\":");
+    JSON_Writer_String(&writer, Logger_GetLevelName((Logger_Level_t)level));
+    JSON_Writer_Literal(&writer, ",\"message\":");
+    JSON_Writer_String(&writer, text);
+    COMMS_Handler_WriteTime(&writer, HAL_GetTick() - tick);
+    JSON_Writer_Literal(&writer, RESP_END);
+
+    if (writer.overflow) {
+      TxPool_Release(slot);
+      return VAL_ERROR;
+    }
+    length = writer.length;
+  }
+
+  return COMMS_Handler_TransmitEvent(slot, length, probe_start);
+}
+
+/**
+ * @brief Send response for telemetry subscription commands
+ * @param msgId Original message ID
+ * @param action Command action
+ * @param status Operation status
+ * @param stream Stream number, 0 for all streams
+ * @param rate Subscribed rate in Hz
+ * @param fields Subscribed COMMS_TELEMETRY_* fields
+ * @retval None
+ */
+static void COMMS_Handler_SendTelemetryResponse(const char* msg_id, const char* action, VAL_Status status,
+                                                uint8_t stream, uint8_t rate, uint8_t fields) {
+  JSON_Writer_t writer;
+
+  if (reply.binary) {
+    uint8_t body[3] = { rate, fields, stream };
+    COMMS_Handler_SendBinaryResponse(status, body, sizeof(body));
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "telemetry", action, "Invalid stream, rate or fields");
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponseFor(&writer, msg_id, "telemetry", action);
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"stream\":");
+  JSON_Writer_Uint(&writer, stream);
+  JSON_Writer_Literal(&writer, ",\"rate\":");
+  JSON_Writer_Uint(&writer, rate);
+  JSON_Writer_Literal(&writer, ",\"fields\":");
+  JSON_Writer_Uint(&writer, fields);
+
+  /* Send response */
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+ * @brief Send a telemetry sample to each stream due
+ * @param streams Streams due; the status of each is set
+ * @param count Number of streams
+ * @param intensities Light intensities (VAL_LIGHT_COUNT entries)
+ * @param sensor_data Sensor readings (VAL_LIGHT_COUNT entries)
+ * @param alarms Alarm codes (VAL_LIGHT_COUNT entries)
+ * @retval None
+ */
+void COMMS_Handler_SendTelemetry(COMMS_Telemetry_Stream_t* streams, uint8_t count, const uint8_t* intensities,
+                                 const LightSensorData_t* sensor_data, const uint8_t* alarms) {
+  COMMS_Telemetry_Sample_t sample;
+  uint8_t fields = 0;
+
+  for (uint8_t i = 0; i < count; i++) {
+    fields |= streams[i].fields;
+  }
+
+  /* Read once; the loop windows restart with every read */
+  sample.now_us = VAL_SysClock_GetMicros64();
+  sample.intensities = intensities;
+  sample.sensor_data = sensor_data;
+  sample.alarms = alarms;
+  sample.time = 0;
+  if (fields & COMMS_TELEMETRY_ADC) {
+    VAL_Analog_GetErrorCounts(&sample.adc_errors);
+    for (uint8_t i = 0; i < JITTER_LOOP_COUNT; i++) {
+      Jitter_TakeWindow((Jitter_Loop_t)i, &sample.loops[i]);
+    }
+  }
+  if (fields & COMMS_TELEMETRY_DERATE) {
+    LED_Driver_GetDerating(sample.derate);
+  }
+  if (fields & COMMS_TELEMETRY_STROBE) {
+    LED_Driver_GetStrobeStatus(&sample.strobe);
+  }
+  if (fields & COMMS_TELEMETRY_TIME) {
+    sample.time = Clock_GetTime();
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    streams[i].status = COMMS_Handler_SendTelemetrySample(&sample, &streams[i]);
+  }
+}
+
+/**
+ * @brief Send one telemetry sample event to a stream
+ * @note  In the format the stream subscribed with; a binary event carries
+ *        the stream number in its seq byte
+ * @param sample Values read for all streams
+ * @param stream Stream and the fields it takes
+ * @retval VAL_Status VAL_OK if successful, VAL_BUSY if no TX slot was free,
+ *         VAL_ERROR otherwise
+ */
+static VAL_Status COMMS_Handler_SendTelemetrySample(const COMMS_Telemetry_Sample_t* sample,
+                                                   const COMMS_Telemetry_Stream_t* stream) {
+  uint32_t probe_start = Profiler_Start();
+  uint32_t timestamp = (uint32_t)(sample->now_us / 1000U);
+  uint8_t fields = stream->fields;
+  uint16_t rate_centihz = stream->rate_centihz;
+  const uint8_t* intensities = sample->intensities;
+  const LightSensorData_t* sensor_data = sample->sensor_data;
+  const uint8_t* alarms = sample->alarms;
+  const Jitter_Window_t* loops = sample->loops;
+  const uint16_t* derate = sample->derate;
+  uint64_t time = sample->time;
+  JSON_Writer_t writer;
+  TxPool_Handle_t slot = TxPool_Acquire(TX_PRIORITY_TELEMETRY);
+  char* buffer = TxPool_GetBuffer(slot);
+
+  if (buffer == NULL) {
+    return VAL_BUSY;
+  }
+
+  if (telemetry_binary[stream->stream - 1]) {
+    uint8_t body[4 + 1 + 2 + VAL_LIGHT_COUNT * (2 + sizeof(COMMS_Bin_Sensor_t) + sizeof(uint16_t)) +
+                 sizeof(AnalogErrorCounts) + JITTER_LOOP_COUNT * sizeof(COMMS_Bin_LoopWindow_t) +
+                 3 * sizeof(uint32_t) + sizeof(uint64_t)];
+    size_t pos = 0;
+
+    memcpy(&body[pos], &timestamp, sizeof(timestamp));
+    pos += sizeof(timestamp);
+    body[pos++] = fields;
+    memcpy(&body[pos], &rate_centihz, sizeof(rate_centihz));
+    pos += sizeof(rate_centihz);
+
+    /* Fields follow in COMMS_TELEMETRY_* bit order */
+    if (fields & COMMS_TELEMETRY_INTENSITY) {
+      memcpy(&body[pos], intensities, VAL_LIGHT_COUNT);
+      pos += VAL_LIGHT_COUNT;
+    }
+    for (int i = 0; i < VAL_LIGHT_COUNT && (fields & (COMMS_TELEMETRY_CURRENT | COMMS_TELEMETRY_TEMPERATURE)); i++) {
+      COMMS_Bin_Sensor_t packed;
+      COMMS_Handler_PackSensor(&sensor_data[i], &packed);
+      if (fields & COMMS_TELEMETRY_CURRENT) {
+        memcpy(&body[pos], &packed.current_ma, sizeof(packed.current_ma));
+        pos += sizeof(packed.current_ma);
+      }
+      if (fields & COMMS_TELEMETRY_TEMPERATURE) {
+        memcpy(&body[pos], &packed.temperature_cdeg, sizeof(packed.temperature_cdeg));
+        pos += sizeof(packed.temperature_cdeg);
+      }
+    }
+    if (fields & COMMS_TELEMETRY_ALARMS) {
+      memcpy(&body[pos], alarms, VAL_LIGHT_COUNT);
+      pos += VAL_LIGHT_COUNT;
+    }
+    if (fields & COMMS_TELEMETRY_ADC) {
+      memcpy(&body[pos], &sample->adc_errors, sizeof(sample->adc_errors));
+      pos += sizeof(sample->adc_errors);
+      for (uint8_t i = 0; i < JITTER_LOOP_COUNT; i++) {
+        COMMS_Bin_LoopWindow_t window = { loops[i].max_early_us, loops[i].max_late_us, loops[i].missed };
+
+        memcpy(&body[pos], &window, sizeof(window));
+        pos += sizeof(window);
+      }
+    }
+    if (fields & COMMS_TELEMETRY_DERATE) {
+      memcpy(&body[pos], derate, sizeof(sample->derate));
+      pos += sizeof(sample->derate);
+    }
+    if (fields & COMMS_TELEMETRY_STROBE) {
+      memcpy(&body[pos], &sample->strobe.triggers, sizeof(sample->strobe.triggers));
+      pos += sizeof(sample->strobe.triggers);
+      memcpy(&body[pos], &sample->strobe.pulses, sizeof(sample->strobe.pulses));
+      pos += sizeof(sample->strobe.pulses);
+      memcpy(&body[pos], &sample->strobe.missed, sizeof(sample->strobe.missed));
+      pos += sizeof(sample->strobe.missed);
+    }
+    if (fields & COMMS_TELEMETRY_TIME) {
+      memcpy(&body[pos], &time, sizeof(time));
+      pos += sizeof(time);
+    }
+
+    size_t length = COMMS_Binary_EncodeFrame(COMMS_BIN_TYPE_EVENT, stream->stream, COMMS_BIN_TELEMETRY_SAMPLE,
+                                      body, pos, (uint8_t*)buffer, TX_POOL_SLOT_SIZE);
+    return COMMS_Handler_TransmitEvent(slot, length, probe_start);
+  }
+
+  JSON_Writer_Init(&writer, buffer, TX_POOL_SLOT_SIZE);
+  JSON_Writer_Literal(&writer, "{\"type\":\"event\",\"id\":\"tlm-");
+  JSON_Writer_Uint(&writer, (uint32_t)sample->now_us);
+  JSON_Writer_Char(&writer, '-');
+  JSON_Writer_Uint(&writer, stream->stream);
+  JSON_Writer_Literal(&writer, "\",\"topic\":\"telemetry\",\"action\":\"sample\",\"data\":{\"timestamp\":\"");
+  JSON_Writer_Uint(&writer, timestamp);
+  JSON_Writer_Literal(&writer, "\",\"stream\":");
+  JSON_Writer_Uint(&writer, stream->stream);
+  JSON_Writer_Literal(&writer, ",\"rate\":");
+  JSON_Writer_Fixed(&writer, rate_centihz / 100.0f, 2);
+
+  if (fields & COMMS_TELEMETRY_INTENSITY) {
+    JSON_Writer_Literal(&writer, ",\"intensities\":[");
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      if (i > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Uint(&writer, intensities[i]);
+    }
+    JSON_Writer_Char(&writer, ']');
+  }
+  if (fields & COMMS_TELEMETRY_CURRENT) {
+    JSON_Writer_Literal(&writer, ",\"currents\":[");
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      if (i > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Fixed(&writer, sensor_data[i].current, 1);
+    }
+    JSON_Writer_Char(&writer, ']');
+  }
+  if (fields & COMMS_TELEMETRY_TEMPERATURE) {
+    JSON_Writer_Literal(&writer, ",\"temperatures\":[");
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      if (i > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Fixed(&writer, sensor_data[i].temperature, 1);
+    }
+    JSON_Writer_Char(&writer, ']');
+  }
+  if (fields & COMMS_TELEMETRY_ALARMS) {
+    JSON_Writer_Literal(&writer, ",\"alarms\":[");
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      if (i > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Uint(&writer, alarms[i]);
+    }
+    JSON_Writer_Char(&writer, ']');
+  }
+  if (fields & COMMS_TELEMETRY_ADC) {
+    JSON_Writer_Literal(&writer, ",\"adc\":{\"overrun\":");
+    JSON_Writer_Uint(&writer, sample->adc_errors.overrun);
+    JSON_Writer_Literal(&writer, ",\"dma\":");
+    JSON_Writer_Uint(&writer, sample->adc_errors.dma);
+    JSON_Writer_Literal(&writer, ",\"internal\":");
+    JSON_Writer_Uint(&writer, sample->adc_errors.internal);
+    JSON_Writer_Literal(&writer, ",\"other\":");
+    JSON_Writer_Uint(&writer, sample->adc_errors.other);
+    JSON_Writer_Literal(&writer, ",\"recoveries\":");
+    JSON_Writer_Uint(&writer, sample->adc_errors.recoveries);
+    /* Loop timing, one entry per loop in Jitter_Loop_t order */
+    JSON_Writer_Literal(&writer, ",\"early_us\":[");
+    for (uint8_t i = 0; i < JITTER_LOOP_COUNT; i++) {
+      if (i > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Uint(&writer, loops[i].max_early_us);
+    }
+    JSON_Writer_Literal(&writer, "],\"late_us\":[");
+    for (uint8_t i = 0; i < JITTER_LOOP_COUNT; i++) {
+      if (i > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Uint(&writer, loops[i].max_late_us);
+    }
+    JSON_Writer_Literal(&writer, "],\"missed\":[");
+    for (uint8_t i = 0; i < JITTER_LOOP_COUNT; i++) {
+      if (i > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Uint(&writer, loops[i].missed);
+    }
+    JSON_Writer_Literal(&writer, "]}");
+  }
+  if (fields & COMMS_TELEMETRY_DERATE) {
+    JSON_Writer_Literal(&writer, ",\"derate\":[");
+    for (int i = 0; i < VAL_LIGHT_COUNT; i++) {
+      if (i > 0) {
+        JSON_Writer_Char(&writer, ',');
+      }
+      JSON_Writer_Uint(&writer, derate[i]);
+    }
+    JSON_Writer_Char(&writer, ']');
+  }
+  if (fields & COMMS_TELEMETRY_STROBE) {
+    JSON_Writer_Literal(&writer, ",\"strobe\":{\"triggers\":");
+    JSON_Writer_Uint(&writer, sample->strobe.triggers);
+    JSON_Writer_Literal(&writer, ",\"pulses\":");
+    JSON_Writer_Uint(&writer, sample->strobe.pulses);
+    JSON_Writer_Literal(&writer, ",\"missed\":");
+    JSON_Writer_Uint(&writer, sample->strobe.missed);
+    JSON_Writer_Char(&writer, '}');
+  }
+  /* Left out until the host has set the clock */
+  if ((fields & COMMS_TELEMETRY_TIME) && time != 0) {
+    JSON_Writer_Literal(&writer, ",\"time\":");
+    JSON_Writer_Uint64(&writer, time);
+  }
+
+  /* Complete the JSON object */
+  JSON_Writer_Literal(&writer, RESP_END);
+
+  if (writer.overflow) {
+    TxPool_Release(slot);
+    return VAL_ERROR;
+  }
+
+  /* Send event message */
+  return COMMS_Handler_TransmitEvent(slot, writer.length, probe_start);
+}
+
+/**
+  * @brief  Build the hash index over the command table
+  * @note   Called once at init; the table itself is const, only the index
+  *         of table positions by hash slot is computed here.
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR if the index is full
+  */
+static VAL_Status COMMS_Handler_BuildCommandIndex(void) {
+  memset(command_index, COMMAND_SLOT_EMPTY, sizeof(command_index));
+  memset(bin_command_index, COMMAND_SLOT_EMPTY, sizeof(bin_command_index));
+
+  for (uint8_t i = 0; i < COMMAND_TABLE_SIZE; i++) {
+    const COMMS_Command_t* command = &command_table[i];
+
+    /* Binary codes index the table directly */
+    bin_command_index[command->bin_code] = i;
+    uint32_t slot = COMMS_Handler_HashCommand(command->topic, strlen(command->topic),
+                                              command->action, strlen(command->action));
+    uint32_t probes = 0;
+
+    /* Linear probing, the index is sized so collisions stay rare */
+    slot &= (COMMAND_INDEX_SLOTS - 1);
+    while (command_index[slot] != COMMAND_SLOT_EMPTY) {
+      slot = (slot + 1) & (COMMAND_INDEX_SLOTS - 1);
+      if (++probes >= COMMAND_INDEX_SLOTS) {
+        return VAL_ERROR;
+      }
+    }
+
+    command_index[slot] = i;
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Hash a topic/action pair (32-bit FNV-1a over "topic/action")
+  * @param  topic: Topic string, not necessarily null-terminated
+  * @param  topic_len: Topic length
+  * @param  action: Action string, not necessarily null-terminated
+  * @param  action_len: Action length
+  * @retval uint32_t: Hash value
+  */
+static uint32_t COMMS_Handler_HashCommand(const char* topic, size_t topic_len,
+                                          const char* action, size_t action_len) {
+  uint32_t hash = 2166136261UL;
+
+  for (size_t i = 0; i < topic_len; i++) {
+    hash = (hash ^ (uint8_t)topic[i]) * 16777619UL;
+  }
+  hash = (hash ^ (uint8_t)'/') * 16777619UL;
+  for (size_t i = 0; i < action_len; i++) {
+    hash = (hash ^ (uint8_t)action[i]) * 16777619UL;
+  }
+
+  return hash;
+}
+
+/**
+  * @brief  Look up a command in the command table
+  * @param  topic: Topic string, not necessarily null-terminated
+  * @param  topic_len: Topic length
+  * @param  action: Action string, not necessarily null-terminated
+  * @param  action_len: Action length
+  * @retval const COMMS_Command_t*: Matching command, NULL if unknown
+  */
+static const COMMS_Command_t* COMMS_Handler_FindCommand(const char* topic, size_t topic_len,
+                                                        const char* action, size_t action_len) {
+  uint32_t slot = COMMS_Handler_HashCommand(topic, topic_len, action, action_len) &
+                  (COMMAND_INDEX_SLOTS - 1);
+
+  for (uint32_t probes = 0; probes < COMMAND_INDEX_SLOTS; probes++) {
+    uint8_t index = command_index[slot];
+    if (index == COMMAND_SLOT_EMPTY) {
+      break;
+    }
+
+    const COMMS_Command_t* command = &command_table[index];
+    if (strlen(command->topic) == topic_len && strncmp(command->topic, topic, topic_len) == 0 &&
+        strlen(command->action) == action_len && strncmp(command->action, action, action_len) == 0) {
+      return command;
+    }
+
+    slot = (slot + 1) & (COMMAND_INDEX_SLOTS - 1);
+  }
+
+  return NULL;
+}
+
+/**
+  * @brief  Prepare a session to decode commands
+  * @param  session: Session to prepare
+  * @retval None
+  */
+static void COMMS_Handler_InitSession(COMMS_Session_t* session) {
+  memset(session, 0, sizeof(*session));
+  lwjson_stream_init(&session->parser, COMMS_Handler_StreamEvent);
+  lwjson_stream_set_user_data(&session->parser, session);
+  COMMS_Handler_ResetDecoder(session, false);
+}
+
+/**
+  * @brief  Start decoding a new command
+  * @param  session: Session the command comes in
+  * @retval None
+  */
+static void COMMS_Handler_BeginCommand(COMMS_Session_t* session) {
+  COMMS_Handler_ClearCommand(&session->command);
+  batch_count = 0;
+  batch_dropped = false;
+  session->parse_cycles = 0;
+  session->crc = COMMS_BIN_CRC16_INIT;
+  session->command_start = Profiler_Start();
+}
+
+/**
+  * @brief  Clear a command structure before decoding into it
+  * @param  msg: Command to clear
+  * @retval None
+  */
+static void COMMS_Handler_ClearCommand(COMMS_Command_Msg_t* msg) {
+  memset(msg, 0, sizeof(*msg));
+  strcpy(msg->id, "unknown");
+}
+
+/**
+  * @brief  Return the stream decoder of a session to its idle state
+  * @param  session: Session to reset
+  * @param  discard: true to ignore further bytes until the next line end
+  * @retval None
+  */
+static void COMMS_Handler_ResetDecoder(COMMS_Session_t* session, bool discard) {
+  lwjson_stream_reset(&session->parser);
+  session->state = discard ? RX_STATE_DISCARD : RX_STATE_IDLE;
+  session->held_len = 0;
+  session->addr_matched = 0;
+  session->addr_digits = 0;
+  session->addr_value = 0;
+  session->broadcast = false;
+  session->check_len = 0;
+  session->check_value = 0;
+}
+
+/**
+  * @brief  Feed one received byte to the stream decoder of a session
+  * @note   A line end always resynchronises the decoder, so an incomplete
+  *         command is dropped the same way an unparsable line is.
+  * @param  session: Session the byte came in
+  * @param  byte: Received byte
+  * @retval None
+  */
+static void COMMS_Handler_DecodeByte(COMMS_Session_t* session, char byte) {
+  /* A delimiter ends the current binary frame and starts the next one */
+  if ((uint8_t)byte == COMMS_BIN_DELIMITER) {
+    if (session->state == RX_STATE_FRAME && session->frame_len > 0) {
+      COMMS_Handler_ProcessFrame(session);
+    }
+    COMMS_Handler_ResetDecoder(session, false);
+    session->state = RX_STATE_FRAME;
+    session->frame_len = 0;
+    return;
+  }
+
+  switch (session->state) {
+    case RX_STATE_FRAME:
+      if (session->frame_len == 0 && byte == '{') {
+        /* Too large for a COBS code byte of a command frame: back to JSON */
+        session->state = RX_STATE_IDLE;
+        break;
+      }
+      if (session->frame_len < sizeof(session->frame)) {
+        session->frame[session->frame_len++] = (uint8_t)byte;
+      } else {
+        /* Oversized frame, drop everything up to the next delimiter */
+        link_stats.oversize++;
+        COMMS_Handler_ResetDecoder(session, true);
+      }
+      return;
+
+    case RX_STATE_CHECK:
+      COMMS_Handler_CheckByte(session, byte);
+      return;
+
+    default:
+      break;
+  }
+
+  if (byte == '\n' || byte == '\r') {
+    if (session->state == RX_STATE_COMMAND) {
+      link_stats.malformed++;
+    }
+    if (session->state == RX_STATE_COMMAND || session->state == RX_STATE_DISCARD ||
+        session->held_len > 0) {
+      COMMS_Handler_ResetDecoder(session, false);
+    }
+    return;
+  }
+
+  if (session->state == RX_STATE_DISCARD) {
+    return;
+  }
+
+  /* A check after a command that already ran, outside checked mode */
+  if (byte == CHECK_MARK && session->state != RX_STATE_COMMAND && session->held_len == 0) {
+    session->state = RX_STATE_DISCARD;
+    return;
+  }
+
+  if (session->state == RX_STATE_IDLE) {
+    switch (COMMS_Handler_FilterByte(session, byte)) {
+      case ADDR_FILTER_HOLD:
+        return;
+
+      case ADDR_FILTER_DROP:
+        link_stats.filtered++;
+        COMMS_Handler_ResetDecoder(session, true);
+        return;
+
+      default:
+        /* The held bytes are only the address prefix and whitespace, which
+         * never complete or break a command */
+        session->state = RX_STATE_ACCEPTED;
+        for (uint8_t i = 0; i < session->held_len; i++) {
+          COMMS_Handler_ParseByte(session, session->held[i]);
+        }
+        session->held_len = 0;
+        break;
+    }
+  }
+
+  COMMS_Handler_ParseByte(session, byte);
+}
+
+/**
+  * @brief  Feed one byte of an accepted JSON command to the stream parser
+  * @param  session: Session the byte came in
+  * @param  byte: Received byte
+  * @retval None
+  */
+static void COMMS_Handler_ParseByte(COMMS_Session_t* session, char byte) {
+  if (session->state != RX_STATE_COMMAND) {
+    COMMS_Handler_BeginCommand(session);
+  }
+
+  uint32_t parse_start = Profiler_Start();
+  lwjsonr_t result = lwjson_stream_parse(&session->parser, byte);
+  session->parse_cycles += Profiler_Start() - parse_start;
+
+  /* The check covers the command from its opening bracket on */
+  if (result != lwjsonSTREAMWAITFIRSTCHAR) {
+    session->crc = COMMS_Binary_CRC16Update(session->crc, (uint8_t)byte);
+  }
+
+  switch (result) {
+    case lwjsonSTREAMWAITFIRSTCHAR:
+      /* Whitespace before the opening brace */
+      break;
+
+    case lwjsonSTREAMINPROG:
+      session->state = RX_STATE_COMMAND;
+      break;
+
+    case lwjsonSTREAMDONE:
+      Profiler_Record(PROFILER_PROBE_JSON_PARSE, session->parse_cycles);
+      if (link_checked) {
+        /* Nothing has run yet, batch commands are only queued */
+        session->state = RX_STATE_CHECK;
+        session->check_len = 0;
+        session->check_value = 0;
+      } else {
+        COMMS_Handler_FinishCommand(session);
+      }
+      break;
+
+    default:
+      /* Malformed JSON or nesting deeper than the stream stack */
+      link_stats.malformed++;
+      COMMS_Handler_ResetDecoder(session, true);
+      break;
+  }
+}
+
+/**
+  * @brief  Collect the check that follows a command in checked mode
+  * @note   The command runs as soon as the last digit matches, a line end
+  *         may follow. Anything else drops it up to the line end.
+  * @param  session: Session the byte came in
+  * @param  byte: Received byte
+  * @retval None
+  */
+static void COMMS_Handler_CheckByte(COMMS_Session_t* session, char byte) {
+  bool line_end = (byte == '\n' || byte == '\r');
+  uint8_t digit;
+
+  if (session->check_len == 0) {
+    if (byte == CHECK_MARK) {
+      session->check_len = 1;
+    } else {
+      link_stats.unchecked++;
+      COMMS_Handler_ResetDecoder(session, !line_end);
+    }
+    return;
+  }
+
+  if (byte >= '0' && byte <= '9') {
+    digit = (uint8_t)(byte - '0');
+  } else if (byte >= 'A' && byte <= 'F') {
+    digit = (uint8_t)(byte - 'A' + 10);
+  } else if (byte >= 'a' && byte <= 'f') {
+    digit = (uint8_t)(byte - 'a' + 10);
+  } else {
+    /* Check cut short */
+    link_stats.crc++;
+    COMMS_Handler_ResetDecoder(session, !line_end);
+    return;
+  }
+
+  session->check_value = (uint16_t)((session->check_value << 4) | digit);
+  if (++session->check_len <= CHECK_DIGITS) {
+    return;
+  }
+
+  if (session->check_value != session->crc) {
+    link_stats.crc++;
+    COMMS_Handler_ResetDecoder(session, true);
+    return;
+  }
+
+  COMMS_Handler_FinishCommand(session);
+}
+
+/**
+  * @brief  Run a completely parsed JSON command or batch
+  * @note   In checked mode a command whose "seq" is not ahead of the last
+  *         one is dropped. Batch entries carry no sequence number.
+  * @param  session: Session the command was decoded in
+  * @retval None
+  */
+static void COMMS_Handler_FinishCommand(COMMS_Session_t* session) {
+  COMMS_Command_Msg_t* msg = &session->command;
+
+  rx_received = Profiler_Start();
+
+  /* The stack is already reset here; only a batch has queued commands */
+  if (batch_count > 0 || batch_dropped) {
+    link_stats.accepted++;
+    host_binary = false;
+    host_cbor = false;
+    reply.binary = false;
+    reply.silent = session->broadcast;
+    reply.no_ack = msg->no_ack;
+    COMMS_Handler_ConfirmLink();
+    COMMS_Handler_RunBatch();
+  } else if (link_checked && msg->has_seq && json_seq_seen &&
+             (int32_t)(msg->seq - json_seq) <= 0) {
+    /* Repeated or late, the command already ran */
+    link_stats.duplicate++;
+  } else {
+    if (link_checked && msg->has_seq) {
+      json_seq = msg->seq;
+      json_seq_seen = true;
+    }
+    link_stats.accepted++;
+    COMMS_Handler_DispatchCommand(session);
+  }
+  Profiler_Stop(PROFILER_PROBE_COMMAND, session->command_start);
+  reply.silent = false;
+  reply.no_ack = false;
+  COMMS_Handler_ResetDecoder(session, false);
+}
+
+/**
+  * @brief  Run the self-test corpus through the decoder and respond
+  * @note   Called by the task once the system/selftest command is finished.
+  *         Checked mode and bus mode are left off for the run, and the link
+  *         counters and event format are restored after it.
+  * @param  session: Session the command came in, decodes the corpus
+  * @retval None
+  */
+static void COMMS_Handler_RunSelfTest(COMMS_Session_t* session) {
+  COMMS_Link_Stats_t stats = link_stats;
+  bool checked = link_checked;
+  bool bus = bus_mode;
+  bool binary = host_binary;
+  bool cbor = host_cbor;
+  bool in_frame = (session->state == RX_STATE_FRAME);
+  uint8_t count = 0;
+
+  selftest_pending = false;
+  link_checked = false;
+  bus_mode = false;
+  selftest_bytes = 0;
+  tx_null_sink = true;
+  COMMS_Handler_ResetDecoder(session, false);
+
+  for (uint8_t round = 0; round < SELFTEST_ROUNDS; round++) {
+    for (uint8_t i = 0; i < SELFTEST_CORPUS_SIZE; i++) {
+      const char* line = selftest_corpus[i];
+      uint32_t start = Profiler_Start();
+      uint32_t total;
+      uint32_t parse;
+
+      selftest_format_cycles = 0;
+      while (*line != '\0') {
+        COMMS_Handler_DecodeByte(session, *line++);
+      }
+      total = Profiler_Start() - start;
+      parse = session->parse_cycles;
+
+      selftest_samples[SELFTEST_PHASE_PARSE][count] = parse;
+      selftest_samples[SELFTEST_PHASE_DISPATCH][count] = (total > parse + selftest_format_cycles) ?
+                                                         total - parse - selftest_format_cycles : 0;
+      selftest_samples[SELFTEST_PHASE_FORMAT][count] = selftest_format_cycles;
+      selftest_samples[SELFTEST_PHASE_TOTAL][count] = total;
+      count++;
+    }
+  }
+
+  tx_null_sink = false;
+  bus_mode = bus;
+  link_checked = checked;
+  link_stats = stats;
+  host_binary = binary;
+  host_cbor = cbor;
+  COMMS_Handler_ResetDecoder(session, false);
+  if (in_frame) {
+    session->state = RX_STATE_FRAME;
+  }
+
+  reply = selftest_reply;
+  COMMS_Handler_SendSelfTestResponse(selftest_id, count);
+}
+
+/**
+  * @brief  Match the start of a JSON command against the address prefix
+  * @note   Bytes are held back until the address is known or the command
+  *         turns out to have none. Whitespace is allowed before and between
+  *         the tokens of {"addr":N. Runs before the parser, so commands for
+  *         other devices cost no parsing.
+  * @param  session: Session the byte came in
+  * @param  byte: Received byte, not a line end
+  * @retval COMMS_Addr_Filter_t: Whether to hold, pass or drop the command
+  */
+static COMMS_Addr_Filter_t COMMS_Handler_FilterByte(COMMS_Session_t* session, char byte) {
+  bool space = (byte == ' ' || byte == '\t');
+
+  if (session->held_len >= sizeof(session->held)) {
+    /* Too much whitespace to be an address prefix */
+    return bus_mode ? ADDR_FILTER_DROP : ADDR_FILTER_ACCEPT;
+  }
+
+  if (session->addr_matched < ADDR_PREFIX_LEN) {
+    /* Whitespace may go anywhere but inside the quoted key */
+    bool in_key = (session->addr_matched > 1 && session->addr_matched < ADDR_PREFIX_LEN - 1);
+
+    if (byte == ADDR_PREFIX[session->addr_matched]) {
+      session->addr_matched++;
+    } else if (!space || in_key) {
+      /* No address: for any device on a point-to-point link */
+      return bus_mode ? ADDR_FILTER_DROP : ADDR_FILTER_ACCEPT;
+    }
+    session->held[session->held_len++] = byte;
+    return ADDR_FILTER_HOLD;
+  }
+
+  if (byte >= '0' && byte <= '9' && session->addr_digits < ADDR_DIGITS_MAX) {
+    session->addr_value = (uint16_t)(session->addr_value * 10U + (uint16_t)(byte - '0'));
+    session->addr_digits++;
+    session->held[session->held_len++] = byte;
+    return ADDR_FILTER_HOLD;
+  }
+
+  if (space && session->addr_digits == 0) {
+    session->held[session->held_len++] = byte;
+    return ADDR_FILTER_HOLD;
+  }
+
+  /* An address that is not a small integer matches no device */
+  if (session->addr_digits == 0 || !(space || byte == ',' || byte == '}')) {
+    return ADDR_FILTER_DROP;
+  }
+
+  if (!COMMS_Handler_IsAddressed(session->addr_value)) {
+    return ADDR_FILTER_DROP;
+  }
+
+  /* Group commands run silently, as broadcast ones */
+  session->broadcast = (session->addr_value >= COMMS_ADDRESS_GROUP_FIRST);
+  return ADDR_FILTER_ACCEPT;
+}
+
+/**
+  * @brief  Check whether a command address selects this device
+  * @note   One compare and one bit test, the groups joined are kept as a mask
+  * @param  address: Address of the command
+  * @retval bool: true for the device address, a group joined and the
+  *         broadcast address
+  */
+static bool COMMS_Handler_IsAddressed(uint16_t address) {
+  if (address >= COMMS_ADDRESS_GROUP_FIRST && address < COMMS_ADDRESS_BROADCAST) {
+    return (bus_groups & (1U << (address - COMMS_ADDRESS_GROUP_FIRST))) != 0;
+  }
+  return address == device_address || address == COMMS_ADDRESS_BROADCAST;
+}
+
+/**
+  * @brief  Copy a decoded string value into a fixed size field
+  * @note   Values that do not fit, or that lwjson delivers in several
+  *         chunks, leave the field empty so they can never match a command.
+  * @param  jsp: Stream parser holding the string value
+  * @param  dest: Destination field
+  * @param  size: Size of the destination field
+  * @retval None
+  */
+static void COMMS_Handler_CopyString(const lwjson_stream_parser_t* jsp, char* dest, size_t size) {
+  if (!jsp->data.str.is_last || jsp->data.str.buff_total_pos != jsp->data.str.buff_pos ||
+      jsp->data.str.buff_pos >= size) {
+    dest[0] = '\0';
+    return;
+  }
+
+  memcpy(dest, jsp->data.str.buff, jsp->data.str.buff_pos);
+  dest[jsp->data.str.buff_pos] = '\0';
+}
+
+/**
+  * @brief  Parse a decoded number primitive as an integer
+  * @param  str: Null-terminated number text
+  * @param  value: Pointer to store the value
+  * @retval bool: true if the number is a plain integer
+  */
+static bool COMMS_Handler_ParseInt(const char* str, int32_t* value) {
+  bool negative = false;
+  int32_t result = 0;
+
+  if (*str == '-') {
+    negative = true;
+    str++;
+  }
+  if (*str == '\0') {
+    return false;
+  }
+
+  while (*str != '\0') {
+    if (*str < '0' || *str > '9') {
+      return false;  /* Fractions and exponents are not integers */
+    }
+    result = result * 10 + (*str - '0');
+    str++;
+  }
+
+  *value = negative ? -result : result;
+  return true;
+}
+
+/**
+  * @brief  Parse a decoded number primitive as an unsigned integer, e.g. a message ID
+  * @param  str: Null-terminated number text
+  * @param  value: Pointer to store the value
+  * @retval bool: true if the number is an integer that fits 32 bits unsigned
+  */
+static bool COMMS_Handler_ParseId(const char* str, uint32_t* value) {
+  uint32_t result = 0;
+
+  if (*str == '\0') {
+    return false;
+  }
+
+  while (*str != '\0') {
+    uint32_t digit = (uint32_t)(*str - '0');
+
+    if (*str < '0' || *str > '9' || result > (UINT32_MAX - digit) / 10U) {
+      return false;
+    }
+    result = result * 10U + digit;
+    str++;
+  }
+
+  *value = result;
+  return true;
+}
+
+/**
+  * @brief  Parse a decoded number primitive as a time in milliseconds
+  * @param  str: Null-terminated number text
+  * @param  value: Pointer to store the value
+  * @retval bool: true if the number is an integer that fits 64 bits unsigned
+  */
+static bool COMMS_Handler_ParseTime(const char* str, uint64_t* value) {
+  uint64_t result = 0;
+
+  if (*str == '\0') {
+    return false;
+  }
+
+  while (*str != '\0') {
+    uint64_t digit = (uint64_t)(*str - '0');
+
+    if (*str < '0' || *str > '9' || result > (UINT64_MAX - digit) / 10U) {
+      return false;
+    }
+    result = result * 10U + digit;
+    str++;
+  }
+
+  *value = result;
+  return true;
+}
+
+/**
+  * @brief  Stream parser event callback - extracts command fields
+  * @note   Only the values the protocol knows about are kept, everything
+  *         else is parsed and dropped without using any memory.
+  * @param  jsp: Stream parser
+  * @param  type: Type of the element that was just parsed
+  * @retval None
+  */
+static void COMMS_Handler_StreamEvent(lwjson_stream_parser_t* jsp, lwjson_stream_type_t type) {
+  COMMS_Session_t* session = lwjson_stream_get_user_data(jsp);
+  COMMS_Command_Msg_t* msg = &session->command;
+  int32_t value;
+
+  /* In a batch every command object sits one level down, in the array */
+  size_t base = (jsp->stack[0].type == LWJSON_STREAM_TYPE_ARRAY) ? 1 : 0;
+
+  if (base == 1 && jsp->stack_pos == 1) {
+    if (type == LWJSON_STREAM_TYPE_OBJECT) {
+      /* Next command of the batch */
+      COMMS_Handler_ClearCommand(msg);
+    } else if (type == LWJSON_STREAM_TYPE_OBJECT_END && strcmp(msg->type, MSG_TYPE_CMD) == 0) {
+      COMMS_Handler_QueueCommand(COMMS_Handler_FindCommand(msg->topic, strlen(msg->topic),
+                                                           msg->action, strlen(msg->action)),
+                                 0, msg->id_numeric ? NULL : msg->id, msg->id_number, &msg->args);
+    }
+    return;
+  }
+
+  /* Top level string fields: {"key": "value"} */
+  if (jsp->stack_pos == base + 2 && lwjson_stack_seq_2(jsp, base, OBJECT, KEY)) {
+    const char* key = jsp->stack[base + 1].meta.name;
+
+    /* Integer IDs are parsed once and kept as a number */
+    if (type == LWJSON_STREAM_TYPE_NUMBER && strcmp(key, "id") == 0 &&
+        COMMS_Handler_ParseId(jsp->data.prim.buff, &msg->id_number)) {
+      msg->id_numeric = true;
+      msg->id[0] = '\0';
+      return;
+    }
+
+    if (type == LWJSON_STREAM_TYPE_NUMBER && strcmp(key, "seq") == 0) {
+      msg->has_seq = COMMS_Handler_ParseId(jsp->data.prim.buff, &msg->seq);
+      return;
+    }
+
+    if ((type == LWJSON_STREAM_TYPE_TRUE || type == LWJSON_STREAM_TYPE_FALSE) && strcmp(key, "ack") == 0) {
+      msg->no_ack = (type == LWJSON_STREAM_TYPE_FALSE);
+      return;
+    }
+
+    if (type != LWJSON_STREAM_TYPE_STRING) {
+      return;
+    }
+
+    if (strcmp(key, "id") == 0) {
+      /* An ID too long for one parser chunk (lwjson_opts.h) arrives in
+       * pieces and is not kept; the command still runs and is answered
+       * with the "unknown" ID */
+      if (jsp->data.str.is_last && jsp->data.str.buff_total_pos == jsp->data.str.buff_pos) {
+        COMMS_Handler_CopyString(jsp, msg->id, sizeof(msg->id));
+        msg->id_numeric = false;
+      }
+    } else if (strcmp(key, "type") == 0) {
+      COMMS_Handler_CopyString(jsp, msg->type, sizeof(msg->type));
+    } else if (strcmp(key, "topic") == 0) {
+      COMMS_Handler_CopyString(jsp, msg->topic, sizeof(msg->topic));
+    } else if (strcmp(key, "action") == 0) {
+      COMMS_Handler_CopyString(jsp, msg->action, sizeof(msg->action));
+    }
+    return;
+  }
+
+  /* Scalar data fields: {"data": {"key": value}} */
+  if (jsp->stack_pos == base + 4 && lwjson_stack_seq_4(jsp, base, OBJECT, KEY, OBJECT, KEY) &&
+      strcmp(jsp->stack[base + 1].meta.name, "data") == 0) {
+    const char* key = jsp->stack[base + 3].meta.name;
+
+    /* Wall-clock times do not fit 32 bits, CRCs do not fit an int32 */
+    if (type == LWJSON_STREAM_TYPE_NUMBER && strcmp(key, "time") == 0) {
+      if (COMMS_Handler_ParseTime(jsp->data.prim.buff, &msg->args.time)) {
+        msg->args.found |= COMMAND_ARG_TIME;
+      }
+    } else if (type == LWJSON_STREAM_TYPE_NUMBER && strcmp(key, "crc") == 0) {
+      if (COMMS_Handler_ParseId(jsp->data.prim.buff, &msg->args.crc)) {
+        msg->args.found |= COMMAND_ARG_CRC;
+      }
+    } else if (type == LWJSON_STREAM_TYPE_NUMBER && COMMS_Handler_ParseInt(jsp->data.prim.buff, &value)) {
+      if (strcmp(key, "id") == 0) {
+        msg->args.id = (uint8_t)value;
+        msg->args.found |= COMMAND_ARG_ID;
+      } else if (strcmp(key, "intensity") == 0) {
+        msg->args.intensity = (uint8_t)value;
+        msg->args.found |= COMMAND_ARG_INTENSITY;
+      } else if (strcmp(key, "rate") == 0) {
+        msg->args.rate = (value < 0 || value > 255) ? 0 : (uint8_t)value;
+        msg->args.found |= COMMAND_ARG_RATE;
+      } else if (strcmp(key, "stream") == 0) {
+        msg->args.stream = (value < 0 || value > 255) ? 0 : (uint8_t)value;
+        msg->args.found |= COMMAND_ARG_STREAM;
+      } else if (strcmp(key, "baud") == 0) {
+        msg->args.baud = (value < 0) ? 0 : (uint32_t)value;
+        msg->args.found |= COMMAND_ARG_BAUD;
+      } else if (strcmp(key, "permille") == 0) {
+        msg->args.permille = (value < 0 || value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+        msg->args.found |= COMMAND_ARG_PERMILLE;
+      } else if (strcmp(key, "duration") == 0) {
+        msg->args.duration = (value < 0 || value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+        msg->args.found |= COMMAND_ARG_DURATION;
+      } else if (strcmp(key, "from") == 0) {
+        msg->args.from = (value < 0) ? 0 : (uint32_t)value;
+        msg->args.found |= COMMAND_ARG_FROM;
+      } else if (strcmp(key, "scans") == 0) {
+        msg->args.scans = (value < 0 || value > UINT16_MAX) ? 0 : (uint16_t)value;
+        msg->args.found |= COMMAND_ARG_SCANS;
+      } else if (strcmp(key, "threshold") == 0) {
+        msg->args.threshold = value;
+        msg->args.found |= COMMAND_ARG_THRESHOLD;
+      } else if (strcmp(key, "current") == 0) {
+        msg->args.current = value;
+        msg->args.found |= COMMAND_ARG_CURRENT;
+      } else if (strcmp(key, "noise") == 0) {
+        msg->args.noise = value;
+        msg->args.found |= COMMAND_ARG_NOISE;
+      } else if (strcmp(key, "slew") == 0) {
+        msg->args.slew = (value < 0 || value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+        msg->args.found |= COMMAND_ARG_SLEW;
+      } else if (strcmp(key, "hours") == 0) {
+        msg->args.hours = (value < 0 || value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+        msg->args.found |= COMMAND_ARG_HOURS;
+      } else if (strcmp(key, "cct") == 0) {
+        msg->args.cct = (value < 0 || value > UINT16_MAX) ? 0 : (uint16_t)value;
+        msg->args.found |= COMMAND_ARG_CCT;
+      } else if (strcmp(key, "tint") == 0) {
+        msg->args.tint = (value < INT16_MIN || value > INT16_MAX) ? INT16_MAX : (int16_t)value;
+        msg->args.found |= COMMAND_ARG_TINT;
+      } else if (strcmp(key, "x") == 0) {
+        msg->args.x = (value < 0 || value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+        msg->args.found |= COMMAND_ARG_X;
+      } else if (strcmp(key, "y") == 0) {
+        msg->args.y = (value < 0 || value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+        msg->args.found |= COMMAND_ARG_Y;
+      } else if (strcmp(key, "flux") == 0) {
+        msg->args.flux = (value < 0 || value > UINT16_MAX) ? 0 : (uint16_t)value;
+        msg->args.found |= COMMAND_ARG_FLUX;
+      } else if (strcmp(key, "depth") == 0) {
+        msg->args.depth = (value < 0 || value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+        msg->args.found |= COMMAND_ARG_DEPTH;
+      } else if (strcmp(key, "group") == 0) {
+        msg->args.group = (value < 1 || value > CONFIG_LIGHT_GROUPS) ? UINT8_MAX : (uint8_t)value;
+        msg->args.found |= COMMAND_ARG_GROUP;
+      } else if (strcmp(key, "bus_groups") == 0) {
+        /* Bits beyond the groups are rejected by the configuration */
+        msg->args.bus_groups = (value < 0 || value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+        msg->args.found |= COMMAND_ARG_BUS_GROUPS;
+      } else if (strcmp(key, "hysteresis") == 0) {
+        msg->args.hysteresis = value;
+        msg->args.found |= COMMAND_ARG_HYSTERESIS;
+      } else if (strcmp(key, "offset") == 0) {
+        msg->args.offset = (value < 0) ? UINT32_MAX : (uint32_t)value;
+        msg->args.found |= COMMAND_ARG_OFFSET;
+      } else if (strcmp(key, "period") == 0) {
+        msg->args.period = (value < 0) ? UINT32_MAX : (uint32_t)value;
+        msg->args.found |= COMMAND_ARG_PERIOD;
+      } else if (strcmp(key, "width") == 0) {
+        msg->args.width = (value < 0) ? UINT32_MAX : (uint32_t)value;
+        msg->args.found |= COMMAND_ARG_WIDTH;
+      } else if (strcmp(key, "address") == 0) {
+        /* Out-of-range addresses are kept as the broadcast address and rejected */
+        msg->args.address = (value < 0 || value > CONFIG_ADDRESS_MAX) ? COMMS_ADDRESS_BROADCAST : (uint8_t)value;
+        msg->args.found |= COMMAND_ARG_ADDRESS;
+      } else if (strcmp(key, "channel") == 0) {
+        msg->args.channel = (value < 0 || value > UINT16_MAX) ? 0 : (uint16_t)value;
+        msg->args.found |= COMMAND_ARG_CHANNEL;
+      } else if (strcmp(key, "mask") == 0) {
+        /* Zero and bits beyond the lights are rejected by the coordinator */
+        msg->args.mask = (value < 0) ? 0 : (uint32_t)value;
+        msg->args.found |= COMMAND_ARG_MASK;
+      } else if (strcmp(key, "frequency") == 0) {
+        msg->args.frequency = (value < 0) ? 0 : (uint32_t)value;
+        msg->args.found |= COMMAND_ARG_FREQUENCY;
+      } else if (strcmp(key, "timeout") == 0) {
+        msg->args.timeout = (value < 0) ? UINT32_MAX : (uint32_t)value;
+        msg->args.found |= COMMAND_ARG_TIMEOUT;
+      } else if (strcmp(key, "limit") == 0) {
+        msg->args.limit = (value < 0) ? 0 : (value > UINT8_MAX) ? UINT8_MAX : (uint8_t)value;
+        msg->args.found |= COMMAND_ARG_LIMIT;
+      } else if (strcmp(key, "since") == 0) {
+        msg->args.since = (value < 0) ? 0 : (uint32_t)value;
+        msg->args.found |= COMMAND_ARG_SINCE;
+      } else if (strcmp(key, "until") == 0) {
+        msg->args.until = (value < 0) ? 0 : (uint32_t)value;
+        msg->args.found |= COMMAND_ARG_UNTIL;
+      } else if (strcmp(key, "rtt") == 0) {
+        msg->args.rtt = (value < 0) ? UINT32_MAX : (uint32_t)value;
+        msg->args.found |= COMMAND_ARG_RTT;
+      } else if (strcmp(key, "size") == 0) {
+        /* Negative sizes are kept as 0 and rejected */
+        msg->args.size = (value < 0) ? 0 : (uint32_t)value;
+        msg->args.found |= COMMAND_ARG_SIZE;
+      } else if (strcmp(key, "scene") == 0) {
+        /* Out-of-range scenes are kept past CONFIG_SCENE_COUNT and rejected */
+        msg->args.scene = (value < 0 || value > CONFIG_SCENE_COUNT) ? UINT8_MAX : (uint8_t)value;
+        msg->args.found |= COMMAND_ARG_SCENE;
+      } else {
+        for (uint8_t i = 0; i < COMMS_CONFIG_KEY_COUNT; i++) {
+          if (strcmp(key, config_key_names[i]) == 0) {
+            msg->args.config_values[i] = value;
+            msg->args.config_keys |= (uint8_t)(1U << i);
+            msg->args.found |= COMMAND_ARG_CONFIG;
+            break;
+          }
+        }
+        for (uint8_t i = 0; i < COMMS_CALIBRATION_KEY_COUNT; i++) {
+          if (strcmp(key, calibration_key_names[i]) == 0) {
+            msg->args.calibration_values[i] = value;
+            msg->args.calibration_keys |= (uint8_t)(1U << i);
+            msg->args.found |= COMMAND_ARG_CALIBRATION;
+            break;
+          }
+        }
+        for (uint8_t i = 0; i < COMMS_ON_CHANGE_KEY_COUNT; i++) {
+          if (strcmp(key, on_change_key_names[i]) == 0) {
+            msg->args.on_change_values[i] = value;
+            msg->args.on_change_keys |= (uint8_t)(1U << i);
+            msg->args.found |= COMMAND_ARG_ON_CHANGE;
+            break;
+          }
+        }
+      }
+    } else if (type == LWJSON_STREAM_TYPE_TRUE && strcmp(key, "reset") == 0) {
+      msg->args.found |= COMMAND_ARG_RESET;
+    } else if ((type == LWJSON_STREAM_TYPE_TRUE || type == LWJSON_STREAM_TYPE_FALSE) &&
+               strcmp(key, "bus") == 0) {
+      msg->args.bus = (type == LWJSON_STREAM_TYPE_TRUE);
+      msg->args.found |= COMMAND_ARG_BUS;
+    } else if ((type == LWJSON_STREAM_TYPE_TRUE || type == LWJSON_STREAM_TYPE_FALSE) &&
+               strcmp(key, "sync") == 0) {
+      msg->args.sync = (type == LWJSON_STREAM_TYPE_TRUE);
+      msg->args.found |= COMMAND_ARG_SYNC;
+    } else if ((type == LWJSON_STREAM_TYPE_TRUE || type == LWJSON_STREAM_TYPE_FALSE) &&
+               strcmp(key, "checked") == 0) {
+      msg->args.checked = (type == LWJSON_STREAM_TYPE_TRUE);
+      msg->args.found |= COMMAND_ARG_CHECKED;
+    } else if ((type == LWJSON_STREAM_TYPE_TRUE || type == LWJSON_STREAM_TYPE_FALSE) &&
+               strcmp(key, "dither") == 0) {
+      msg->args.dither = (type == LWJSON_STREAM_TYPE_TRUE);
+      msg->args.found |= COMMAND_ARG_DITHER;
+    } else if ((type == LWJSON_STREAM_TYPE_TRUE || type == LWJSON_STREAM_TYPE_FALSE) &&
+               strcmp(key, "enable") == 0) {
+      msg->args.enable = (type == LWJSON_STREAM_TYPE_TRUE);
+      msg->args.found |= COMMAND_ARG_ENABLE;
+    } else if ((type == LWJSON_STREAM_TYPE_TRUE || type == LWJSON_STREAM_TYPE_FALSE) &&
+               strcmp(key, "flow") == 0) {
+      msg->args.flow = (type == LWJSON_STREAM_TYPE_TRUE);
+      msg->args.found |= COMMAND_ARG_FLOW;
+    } else if (type == LWJSON_STREAM_TYPE_STRING && strcmp(key, "curve") == 0) {
+      /* Unknown names are kept as COMMS_CURVE_COUNT for the handler to reject */
+      msg->args.curve = 0;
+      while (msg->args.curve < COMMS_CURVE_COUNT &&
+             strcmp(jsp->data.str.buff, curve_names[msg->args.curve]) != 0) {
+        msg->args.curve++;
+      }
+      msg->args.found |= COMMAND_ARG_CURVE;
+    } else if (type == LWJSON_STREAM_TYPE_STRING && strcmp(key, "level") == 0) {
+      /* Unknown names are kept past LOGGER_LEVEL_NONE for the handler to reject */
+      msg->args.level = LOGGER_LEVEL_DEBUG;
+      while (msg->args.level <= LOGGER_LEVEL_NONE &&
+             strcmp(jsp->data.str.buff, Logger_GetLevelName((Logger_Level_t)msg->args.level)) != 0) {
+        msg->args.level++;
+      }
+      msg->args.found |= COMMAND_ARG_LEVEL;
+    } else if (type == LWJSON_STREAM_TYPE_STRING && strcmp(key, "trigger") == 0) {
+      /* Unknown names are kept as COMMS_CAPTURE_TRIGGER_COUNT for the handler to reject */
+      msg->args.trigger = 0;
+      while (msg->args.trigger < COMMS_CAPTURE_TRIGGER_COUNT &&
+             strcmp(jsp->data.str.buff, capture_trigger_names[msg->args.trigger]) != 0) {
+        msg->args.trigger++;
+      }
+      msg->args.found |= COMMAND_ARG_TRIGGER;
+    } else if (type == LWJSON_STREAM_TYPE_STRING && strcmp(key, "shape") == 0) {
+      /* Unknown names are kept as COMMS_SYNTH_SHAPE_COUNT for the handler to reject */
+      msg->args.shape = 0;
+      while (msg->args.shape < COMMS_SYNTH_SHAPE_COUNT &&
+             strcmp(jsp->data.str.buff, synth_shape_names[msg->args.shape]) != 0) {
+        msg->args.shape++;
+      }
+      msg->args.found |= COMMAND_ARG_SHAPE;
+    } else if (type == LWJSON_STREAM_TYPE_STRING && strcmp(key, "effect") == 0) {
+      /* Unknown names are kept as COMMS_EFFECT_COUNT for the handler to reject */
+      msg->args.effect = 0;
+      while (msg->args.effect < COMMS_EFFECT_COUNT &&
+             strcmp(jsp->data.str.buff, effect_names[msg->args.effect]) != 0) {
+        msg->args.effect++;
+      }
+      msg->args.found |= COMMAND_ARG_EFFECT;
+    } else if (type == LWJSON_STREAM_TYPE_STRING && strcmp(key, "input") == 0) {
+      /* Unknown names are kept as COMMS_RULE_INPUT_COUNT for the handler to reject */
+      msg->args.input = 0;
+      while (msg->args.input < COMMS_RULE_INPUT_COUNT &&
+             strcmp(jsp->data.str.buff, rule_input_names[msg->args.input]) != 0) {
+        msg->args.input++;
+      }
+      msg->args.found |= COMMAND_ARG_INPUT;
+    } else if (type == LWJSON_STREAM_TYPE_STRING && strcmp(key, "then") == 0) {
+      /* Unknown names are kept as COMMS_RULE_ACTION_COUNT for the handler to reject */
+      msg->args.then = 0;
+      while (msg->args.then < COMMS_RULE_ACTION_COUNT &&
+             strcmp(jsp->data.str.buff, rule_action_names[msg->args.then]) != 0) {
+        msg->args.then++;
+      }
+      msg->args.found |= COMMAND_ARG_THEN;
+    }
+    return;
+  }
+
+  /* Array data fields: {"data": {"key": [value, ...]}} */
+  if (jsp->stack_pos == base + 5 && lwjson_stack_seq_5(jsp, base, OBJECT, KEY, OBJECT, KEY, ARRAY) &&
+      strcmp(jsp->stack[base + 1].meta.name, "data") == 0) {
+    const char* key = jsp->stack[base + 3].meta.name;
+
+    /* Telemetry field names */
+    if (type == LWJSON_STREAM_TYPE_STRING && strcmp(key, "fields") == 0) {
+      const char* name = jsp->data.str.buff;
+
+      if (strcmp(name, "intensity") == 0) {
+        msg->args.fields |= COMMS_TELEMETRY_INTENSITY;
+      } else if (strcmp(name, "current") == 0) {
+        msg->args.fields |= COMMS_TELEMETRY_CURRENT;
+      } else if (strcmp(name, "temperature") == 0) {
+        msg->args.fields |= COMMS_TELEMETRY_TEMPERATURE;
+      } else if (strcmp(name, "alarms") == 0) {
+        msg->args.fields |= COMMS_TELEMETRY_ALARMS;
+      } else if (strcmp(name, "adc") == 0) {
+        msg->args.fields |= COMMS_TELEMETRY_ADC;
+      } else if (strcmp(name, "derate") == 0) {
+        msg->args.fields |= COMMS_TELEMETRY_DERATE;
+      } else if (strcmp(name, "strobe") == 0) {
+        msg->args.fields |= COMMS_TELEMETRY_STROBE;
+      } else if (strcmp(name, "time") == 0) {
+        msg->args.fields |= COMMS_TELEMETRY_TIME;
+      }
+      msg->args.found |= COMMAND_ARG_FIELDS;
+      return;
+    }
+
+    if (type != LWJSON_STREAM_TYPE_NUMBER || !COMMS_Handler_ParseInt(jsp->data.prim.buff, &value)) {
+      return;
+    }
+
+    if (strcmp(key, "intensities") == 0) {
+      /* One integer entry per light is used, all of them are required */
+      if (msg->intensity_count < VAL_LIGHT_COUNT) {
+        msg->args.intensities[msg->intensity_count++] = (uint8_t)value;
+        if (msg->intensity_count == VAL_LIGHT_COUNT) {
+          msg->args.found |= COMMAND_ARG_INTENSITIES;
+        }
+      }
+    } else if (strcmp(key, "permilles") == 0) {
+      /* Same as intensities; out of range values are rejected by the driver.
+       * A negative value reads as LED_DRIVER_PERMILLE_HOLD, which cues take. */
+      if (msg->permille_count < VAL_LIGHT_COUNT) {
+        msg->args.permilles[msg->permille_count++] =
+            (value < 0 || value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+        if (msg->permille_count == VAL_LIGHT_COUNT) {
+          msg->args.found |= COMMAND_ARG_PERMILLES;
+        }
+      }
+    } else if (strcmp(key, "values") == 0) {
+      /* Packed, one per light in "mask"; the count is checked against it */
+      if (msg->args.value_count < VAL_LIGHT_COUNT) {
+        msg->args.values[msg->args.value_count++] =
+            (value < 0 || value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+      } else {
+        msg->args.value_count = VAL_LIGHT_COUNT + 1;
+      }
+      msg->args.found |= COMMAND_ARG_VALUES;
+    } else if (strcmp(key, "ageing") == 0) {
+      /* Checked by the LED driver, the count here */
+      if (msg->args.ageing_count < LED_DRIVER_AGEING_POINTS) {
+        msg->args.ageing[msg->args.ageing_count++] =
+            (value < 0 || value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+      } else {
+        msg->args.ageing_count = LED_DRIVER_AGEING_POINTS + 1;
+      }
+      msg->args.found |= COMMAND_ARG_AGEING;
+    } else if (strcmp(key, "points") == 0) {
+      /* Voltage and temperature alternate; one bad value rejects the table */
+      uint8_t n = msg->args.point_values;
+
+      if (n != POINT_VALUES_INVALID) {
+        bool valid = (n < 2 * ANALOG_CAL_MAX_POINTS) &&
+                     ((n % 2 == 0) ? (value >= 0 && value <= UINT16_MAX)
+                                   : (value >= INT16_MIN && value <= INT16_MAX));
+
+        if (!valid) {
+          msg->args.point_values = POINT_VALUES_INVALID;
+        } else if (n % 2 == 0) {
+          msg->args.points[n / 2].mv = (uint16_t)value;
+          msg->args.point_values++;
+        } else {
+          msg->args.points[n / 2].cdeg = (int16_t)value;
+          msg->args.point_values++;
+        }
+      }
+      msg->args.found |= COMMAND_ARG_POINTS;
+    } else if (strcmp(key, "lights") == 0) {
+      /* Collected as a mask; one entry that is not a light rejects the array */
+      if (value >= 1 && value <= VAL_LIGHT_COUNT) {
+        msg->args.lights |= (uint8_t)(1U << (value - 1));
+      } else {
+        msg->args.lights |= LIGHTS_INVALID;
+      }
+      msg->args.found |= COMMAND_ARG_LIGHTS;
+    }
+  }
+}
+
+/**
+  * @brief  Dispatch a decoded command through the command table
+  * @param  session: Session the command was decoded in
+  * @retval None
+  */
+static void COMMS_Handler_DispatchCommand(COMMS_Session_t* session) {
+  COMMS_Command_Msg_t* msg = &session->command;
+
+  if (strcmp(msg->type, MSG_TYPE_CMD) != 0) {
+    return;
+  }
+
+  host_binary = false;
+  host_cbor = session->cbor;
+  reply.binary = false;
+  reply.cbor = session->cbor;
+  reply.silent = session->broadcast;
+  reply.no_ack = msg->no_ack;
+  reply.id_numeric = msg->id_numeric;
+  reply.id_number = msg->id_number;
+
+  const COMMS_Command_t* command = COMMS_Handler_FindCommand(msg->topic, strlen(msg->topic),
+                                                             msg->action, strlen(msg->action));
+  COMMS_Handler_ConfirmLink();
+  if (command == NULL) {
+    /* Answered at once, so a host probing for a command need not time out */
+    COMMS_Handler_SendErrorResponse(msg->id, msg->topic, msg->action, "Unknown command");
+    return;
+  }
+
+  COMMS_Handler_RunCommand(command, msg->id, &msg->args);
+}
+
+/**
+  * @brief  Take a token from the bucket of the command's class
+  * @note   Keeps a flooding host from starving the tasks below this one:
+  *         over the rate, commands are answered busy without running.
+  *         Safety commands always pass, so do the self-test's own.
+  * @param  command: Command table entry
+  * @retval bool: true if the command may run
+  */
+static bool COMMS_Handler_Admit(const COMMS_Command_t* command) {
+  const COMMS_Admit_Limit_t* limit = &admit_limits[command->command_class];
+  COMMS_Admit_Bucket_t* bucket = &admit_buckets[command->command_class];
+
+  if (limit->rate == 0 || tx_null_sink) {
+    return true;
+  }
+
+  /* A rate per second over milliseconds refills in thousandths of a token */
+  TickType_t now = xTaskGetTickCount();
+  uint32_t elapsed = (uint32_t)(now - bucket->refilled) * portTICK_PERIOD_MS;
+  uint32_t full = (uint32_t)limit->burst * ADMIT_TOKEN;
+
+  bucket->refilled = now;
+  if (elapsed > ADMIT_REFILL_MAX_MS) {
+    elapsed = ADMIT_REFILL_MAX_MS;
+  }
+  bucket->level += elapsed * limit->rate;
+  if (bucket->level > full) {
+    bucket->level = full;
+  }
+
+  if (bucket->level < ADMIT_TOKEN) {
+    link_stats.throttled[command->command_class]++;
+    return false;
+  }
+
+  bucket->level -= ADMIT_TOKEN;
+  return true;
+}
+
+/**
+  * @brief  Hand a slow command to the worker task
+  * @param  command: Command table entry
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded arguments
+  * @param  start: Profiler timestamp when the command was accepted
+  * @retval VAL_Status: VAL_OK if queued, VAL_BUSY if COMMS_PIPELINE_DEPTH
+  *         commands are outstanding
+  */
+static VAL_Status COMMS_Handler_DeferCommand(const COMMS_Command_t* command, const char* msg_id,
+                                             const COMMS_Command_Args_t* args, uint32_t start) {
+  static COMMS_Pending_t pending;  /* Comms task only, copied into the queue */
+
+  pending.command = command;
+  pending.reply = reply;
+  pending.start = start;
+  pending.received = rx_received;
+  if (reply.id_numeric) {
+    pending.id[0] = '\0';
+  } else {
+    strncpy(pending.id, msg_id, sizeof(pending.id) - 1);
+    pending.id[sizeof(pending.id) - 1] = '\0';
+  }
+  pending.args = *args;
+
+  return (xQueueSendToBack(pipeline_queue, &pending, 0) == pdPASS) ? VAL_OK : VAL_BUSY;
+}
+
+/**
+  * @brief  Run a decoded command, or refuse it while start-up is in progress
+  * @param  command: Command table entry
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded arguments, reduced to the fields the command takes
+  * @retval None
+  */
+static void COMMS_Handler_RunCommand(const COMMS_Command_t* command, const char* msg_id,
+                                     COMMS_Command_Args_t* args) {
+  uint32_t start = Profiler_Start();
+  bool cut = false;
+
+  reply.status = VAL_OK;
+
+  /* The RX interrupt cut the outputs for this frame and timed it there */
+  if (command->command_class == COMMS_CLASS_EMERGENCY && reply.binary) {
+    taskENTER_CRITICAL();
+    cut = (fast_pending != 0);
+    if (cut) {
+      fast_pending--;
+    }
+    taskEXIT_CRITICAL();
+  }
+
+  if (!COMMS_Handler_Admit(command)) {
+    COMMS_Handler_SendBusyResponse(msg_id, command->topic, command->action);
+  } else if (fast_pending != 0 && command->command_class == COMMS_CLASS_CONTROL) {
+    /* Sent ahead of a blackout already cut, it must not undo it */
+    COMMS_Handler_SendBusyResponse(msg_id, command->topic, command->action);
+  } else if (!SYS_Coordinator_IsReady() && strcmp(command->topic, "system") != 0) {
+    /* System commands do not depend on the coordinator */
+    if (reply.binary) {
+      COMMS_Handler_SendBinaryResponse(VAL_BUSY, NULL, 0);
+    } else {
+      COMMS_Handler_SendErrorResponse(msg_id, command->topic, command->action, "Starting up");
+      reply.status = VAL_BUSY;
+    }
+  } else {
+    /* Hand the handler only the fields it takes */
+    args->found &= command->args;
+
+    if (command->work == NULL || batch_collecting) {
+      command->handler(msg_id, args);
+    } else if (COMMS_Handler_DeferCommand(command, msg_id, args, start) == VAL_OK) {
+      /* The worker task responds and records the trace entry */
+      return;
+    } else {
+      link_stats.pipeline_full++;
+      COMMS_Handler_SendBusyResponse(msg_id, command->topic, command->action);
+    }
+  }
+
+  /* Reading the trace back would otherwise fill it */
+  if (command->handler != COMMS_Handler_CmdSystemTrace) {
+    Trace_Record(TRACE_TYPE_COMMAND, command->bin_code, (uint8_t)reply.status,
+                 reply.binary ? 1U : 0U, Profiler_Start() - start);
+  }
+  if (!tx_null_sink && !cut) {
+    Latency_RecordCommand((uint8_t)(command - command_table), Profiler_Start() - rx_received);
+  }
+}
+
+/**
+  * @brief  Decode and dispatch the binary frame collected by a session
+  * @param  session: Session holding the frame
+  * @retval None
+  */
+static void COMMS_Handler_ProcessFrame(COMMS_Session_t* session) {
+  uint32_t command_start = Profiler_Start();
+  size_t length;
+  bool broadcast = false;
+  bool no_ack;
+
+  rx_received = command_start;
+  VAL_Status status = COMMS_Binary_DecodeFrame(session->frame, session->frame_len, &length);
+  if (status != VAL_OK) {
+    if (status == VAL_ERROR) {
+      link_stats.crc++;
+    } else {
+      link_stats.malformed++;
+    }
+    return;
+  }
+
+  /* Either command type may ask for failures to be answered only */
+  no_ack = (session->frame[0] & COMMS_BIN_TYPE_NOACK) != 0U;
+  session->frame[0] &= (uint8_t)~COMMS_BIN_TYPE_NOACK;
+
+  if (session->frame[0] == COMMS_BIN_TYPE_ADDR_CMD) {
+    if (length < COMMS_BIN_HEADER_SIZE + 1) {
+      link_stats.malformed++;
+      return;
+    }
+    if (!COMMS_Handler_IsAddressed(session->frame[1])) {
+      link_stats.filtered++;
+      return;
+    }
+
+    /* Drop the address, the rest has the layout of a command frame */
+    broadcast = (session->frame[1] >= COMMS_ADDRESS_GROUP_FIRST);
+    length--;
+    memmove(&session->frame[1], &session->frame[2], length - 1);
+  } else if (session->frame[0] == COMMS_BIN_TYPE_CBOR) {
+    if (bus_mode) {
+      link_stats.filtered++;
+      return;
+    }
+    Profiler_Stop(PROFILER_PROBE_FRAME_DECODE, command_start);
+    COMMS_Handler_ProcessCbor(session, &session->frame[COMMS_BIN_HEADER_SIZE],
+                              length - COMMS_BIN_HEADER_SIZE, session->frame[1], no_ack);
+    return;
+  } else if (session->frame[0] != COMMS_BIN_TYPE_CMD) {
+    link_stats.malformed++;
+    return;
+  } else if (bus_mode) {
+    link_stats.filtered++;
+    return;
+  }
+  Profiler_Stop(PROFILER_PROBE_FRAME_DECODE, command_start);
+
+  if (link_checked) {
+    if (bin_seq_seen && (int8_t)(uint8_t)(session->frame[1] - bin_seq) <= 0) {
+      link_stats.duplicate++;
+      return;
+    }
+    bin_seq = session->frame[1];
+    bin_seq_seen = true;
+  }
+  link_stats.accepted++;
+
+  COMMS_Handler_ConfirmLink();
+  host_binary = true;
+  host_cbor = false;
+  reply.binary = true;
+  reply.silent = broadcast;
+  reply.no_ack = no_ack;
+  reply.seq = session->frame[1];
+  reply.code = session->frame[2];
+
+  uint8_t index = bin_command_index[reply.code];
+  if (reply.code == COMMS_BIN_SYSTEM_BATCH) {
+    COMMS_Handler_ProcessBatchFrame(&session->frame[COMMS_BIN_HEADER_SIZE], length - COMMS_BIN_HEADER_SIZE);
+  } else if (index == COMMAND_SLOT_EMPTY) {
+    /* Unlike JSON, binary hosts always get an answer */
+    COMMS_Handler_SendBinaryResponse(VAL_PARAM, NULL, 0);
+  } else {
+    const COMMS_Command_t* command = &command_table[index];
+    COMMS_Command_Args_t args;
+
+    COMMS_Handler_DecodeBinaryArgs(&session->frame[COMMS_BIN_HEADER_SIZE], length - COMMS_BIN_HEADER_SIZE,
+                                   command->args, &args);
+    COMMS_Handler_RunCommand(command, "", &args);
+  }
+
+  reply.binary = false;
+  reply.silent = false;
+  reply.no_ack = false;
+  Profiler_Stop(PROFILER_PROBE_COMMAND, command_start);
+}
+
+/**
+  * @brief  Decode and run the CBOR command of a COMMS_BIN_TYPE_CBOR frame
+  * @note   The items are handed to COMMS_Handler_StreamEvent as the events
+  *         the stream parser gives for the same command in JSON, so both
+  *         decode into the session's command the same way and the command runs as a
+  *         JSON one. It is answered in CBOR. Batches are JSON only.
+  * @param  session: Session the frame came in
+  * @param  body: CBOR map of the command
+  * @param  length: Body length
+  * @param  seq: Sequence number of the frame, echoed in the response frame
+  * @param  no_ack: Only a failure is answered, as with "ack":false
+  * @retval None
+  */
+static void COMMS_Handler_ProcessCbor(COMMS_Session_t* session, const uint8_t* body, size_t length,
+                                      uint8_t seq, bool no_ack) {
+  uint32_t remaining[LWJSON_CFG_STREAM_STACK_SIZE];
+  CBOR_Reader_t reader;
+  CBOR_Item_t item;
+  bool valid;
+
+  COMMS_Handler_BeginCommand(session);
+  lwjson_stream_reset(&session->parser);
+  CBOR_Reader_Init(&reader, body, length);
+
+  uint32_t parse_start = Profiler_Start();
+  do {
+    valid = CBOR_Reader_Next(&reader, &item) && COMMS_Handler_CborItem(&session->parser, &item, remaining);
+  } while (valid && session->parser.stack_pos > 0);
+  session->parse_cycles = Profiler_Start() - parse_start;
+
+  if (!valid || !CBOR_Reader_AtEnd(&reader)) {
+    link_stats.malformed++;
+    lwjson_stream_reset(&session->parser);
+    return;
+  }
+  Profiler_Record(PROFILER_PROBE_JSON_PARSE, session->parse_cycles);
+
+  session->cbor = true;
+  reply.seq = seq;
+  session->command.no_ack = session->command.no_ack || no_ack;
+  COMMS_Handler_FinishCommand(session);
+  session->cbor = false;
+  reply.cbor = false;
+}
+
+/**
+  * @brief  Feed one CBOR item to the command decoder
+  * @note   The parser stack is kept the way lwjson keeps it: a key is
+  *         pushed over its map until its value is complete, and an array
+  *         counts its entries in meta.index.
+  * @param  jsp: Stream parser whose stack and data are filled in
+  * @param  item: Item read from the frame
+  * @param  remaining: Items left per array or map on the stack, pairs for a
+  *         map, CBOR_COUNT_INDEFINITE for one closed by a break
+  * @retval bool: false if the item cannot be part of a command
+  */
+static bool COMMS_Handler_CborItem(lwjson_stream_parser_t* jsp, const CBOR_Item_t* item, uint32_t* remaining) {
+  lwjson_stream_type_t top = (jsp->stack_pos > 0) ? jsp->stack[jsp->stack_pos - 1].type : LWJSON_STREAM_TYPE_NONE;
+  lwjson_stream_type_t type;
+  JSON_Writer_t writer;
+
+  if (item->type == CBOR_ITEM_BREAK) {
+    if ((top != LWJSON_STREAM_TYPE_OBJECT && top != LWJSON_STREAM_TYPE_ARRAY) ||
+        remaining[jsp->stack_pos - 1] != CBOR_COUNT_INDEFINITE) {
+      return false;
+    }
+    COMMS_Handler_CborPop(jsp);
+    COMMS_Handler_CborCount(jsp, remaining);
+    return true;
+  }
+
+  /* In a map every other item is a key, which JSON only has as text */
+  if (top == LWJSON_STREAM_TYPE_OBJECT) {
+    lwjson_stream_stack_t* key = &jsp->stack[jsp->stack_pos];
+    size_t key_length;
+
+    if (item->type != CBOR_ITEM_TEXT || jsp->stack_pos >= LWJSON_CFG_STREAM_STACK_SIZE) {
+      return false;
+    }
+    COMMS_Handler_CborString(jsp, item);
+    COMMS_Handler_StreamEvent(jsp, LWJSON_STREAM_TYPE_KEY);
+
+    key_length = (item->value < sizeof(key->meta.name)) ? (size_t)item->value : sizeof(key->meta.name) - 1;
+    key->type = LWJSON_STREAM_TYPE_KEY;
+    memcpy(key->meta.name, item->data, key_length);
+    key->meta.name[key_length] = '\0';
+    jsp->stack_pos++;
+    return true;
+  }
+
+  switch (item->type) {
+    case CBOR_ITEM_MAP:
+    case CBOR_ITEM_ARRAY:
+      /* A command is a map; a top level array would be a batch */
+      if ((jsp->stack_pos == 0 && item->type != CBOR_ITEM_MAP) ||
+          jsp->stack_pos >= LWJSON_CFG_STREAM_STACK_SIZE ||
+          (!item->indefinite && item->value >= CBOR_COUNT_INDEFINITE)) {
+        return false;
+      }
+      type = (item->type == CBOR_ITEM_MAP) ? LWJSON_STREAM_TYPE_OBJECT : LWJSON_STREAM_TYPE_ARRAY;
+      jsp->stack[jsp->stack_pos].type = type;
+      jsp->stack[jsp->stack_pos].meta.index = 0;
+      remaining[jsp->stack_pos] = item->indefinite ? CBOR_COUNT_INDEFINITE : (uint32_t)item->value;
+      jsp->stack_pos++;
+      COMMS_Handler_StreamEvent(jsp, type);
+
+      if (remaining[jsp->stack_pos - 1] == 0) {
+        COMMS_Handler_CborPop(jsp);
+        COMMS_Handler_CborCount(jsp, remaining);
+      }
+      return true;
+
+    case CBOR_ITEM_UINT:
+    case CBOR_ITEM_NINT:
+    case CBOR_ITEM_FLOAT:
+      /* Numbers are handed over as text, as the stream parser does */
+      JSON_Writer_Init(&writer, jsp->data.prim.buff, sizeof(jsp->data.prim.buff) - 1);
+      if (item->type == CBOR_ITEM_FLOAT) {
+        JSON_Writer_Fixed(&writer, item->number, 3);
+      } else if (item->type == CBOR_ITEM_UINT) {
+        JSON_Writer_Uint64(&writer, item->value);
+      } else if (item->value < UINT64_MAX) {
+        JSON_Writer_Char(&writer, '-');
+        JSON_Writer_Uint64(&writer, item->value + 1U);
+      } else {
+        return false;
+      }
+      jsp->data.prim.buff[writer.length] = '\0';
+      jsp->data.prim.buff_pos = writer.length;
+      type = LWJSON_STREAM_TYPE_NUMBER;
+      break;
+
+    case CBOR_ITEM_TEXT:
+      COMMS_Handler_CborString(jsp, item);
+      type = LWJSON_STREAM_TYPE_STRING;
+      break;
+
+    case CBOR_ITEM_TRUE:
+      type = LWJSON_STREAM_TYPE_TRUE;
+      break;
+
+    case CBOR_ITEM_FALSE:
+      type = LWJSON_STREAM_TYPE_FALSE;
+      break;
+
+    case CBOR_ITEM_NULL:
+      type = LWJSON_STREAM_TYPE_NULL;
+      break;
+
+    default:
+      /* Byte strings and tags have no JSON counterpart */
+      return false;
+  }
+
+  if (jsp->stack_pos == 0) {
+    return false;
+  }
+
+  COMMS_Handler_StreamEvent(jsp, type);
+  if (top == LWJSON_STREAM_TYPE_KEY) {
+    jsp->stack_pos--;
+  }
+  COMMS_Handler_CborCount(jsp, remaining);
+
+  return true;
+}
+
+/**
+  * @brief  Put a CBOR text string where the stream parser puts a string
+  * @note   As with the stream parser, a string longer than its buffer is
+  *         cut, with buff_total_pos telling it was
+  * @param  jsp: Stream parser
+  * @param  item: Text item
+  * @retval None
+  */
+static void COMMS_Handler_CborString(lwjson_stream_parser_t* jsp, const CBOR_Item_t* item) {
+  size_t length = (item->value < LWJSON_CFG_STREAM_STRING_MAX_LEN - 1) ?
+                  (size_t)item->value : LWJSON_CFG_STREAM_STRING_MAX_LEN - 1;
+
+  memcpy(jsp->data.str.buff, item->data, length);
+  jsp->data.str.buff[length] = '\0';
+  jsp->data.str.buff_pos = length;
+  jsp->data.str.buff_total_pos = (size_t)item->value;
+  jsp->data.str.is_last = 1;
+}
+
+/**
+  * @brief  Close the array or map on top of the parser stack
+  * @note   Its key goes with it, before the end event, as in lwjson
+  * @param  jsp: Stream parser
+  * @retval None
+  */
+static void COMMS_Handler_CborPop(lwjson_stream_parser_t* jsp) {
+  lwjson_stream_type_t type = jsp->stack[--jsp->stack_pos].type;
+
+  if (jsp->stack_pos > 0 && jsp->stack[jsp->stack_pos - 1].type == LWJSON_STREAM_TYPE_KEY) {
+    jsp->stack_pos--;
+  }
+  COMMS_Handler_StreamEvent(jsp, (type == LWJSON_STREAM_TYPE_OBJECT) ? LWJSON_STREAM_TYPE_OBJECT_END
+                                                                     : LWJSON_STREAM_TYPE_ARRAY_END);
+}
+
+/**
+  * @brief  Count a complete value in the array or map on top of the stack
+  * @note   Arrays and maps of definite length are closed by their last
+  *         value, which completes a value of the one around them in turn
+  * @param  jsp: Stream parser
+  * @param  remaining: Items left per array or map on the stack
+  * @retval None
+  */
+static void COMMS_Handler_CborCount(lwjson_stream_parser_t* jsp, uint32_t* remaining) {
+  while (jsp->stack_pos > 0) {
+    size_t top = jsp->stack_pos - 1;
+
+    if (jsp->stack[top].type == LWJSON_STREAM_TYPE_ARRAY) {
+      jsp->stack[top].meta.index++;
+    }
+    if (remaining[top] == CBOR_COUNT_INDEFINITE || --remaining[top] > 0) {
+      return;
+    }
+    COMMS_Handler_CborPop(jsp);
+  }
+}
+
+/**
+  * @brief  Collect and run the commands of a binary batch frame
+  * @note   The body is a sequence of code (1), length (1) and that many
+  *         argument bytes. Every command gets its own response frame, with
+  *         its own code and the sequence number of the batch.
+  * @param  body: Batch frame body
+  * @param  length: Body length
+  * @retval None
+  */
+static void COMMS_Handler_ProcessBatchFrame(const uint8_t* body, size_t length) {
+  size_t pos = 0;
+
+  batch_count = 0;
+  batch_dropped = false;
+
+  while (pos + 2 <= length) {
+    uint8_t code = body[pos];
+    uint8_t args_length = body[pos + 1];
+    uint8_t index = bin_command_index[code];
+    COMMS_Command_Args_t args;
+
+    pos += 2;
+    if (pos + args_length > length) {
+      break;
+    }
+
+    const COMMS_Command_t* command = (index == COMMAND_SLOT_EMPTY) ? NULL : &command_table[index];
+    COMMS_Handler_DecodeBinaryArgs(&body[pos], args_length, (command != NULL) ? command->args : 0, &args);
+    COMMS_Handler_QueueCommand(command, code, "", 0, &args);
+    pos += args_length;
+  }
+
+  /* A truncated entry rejects the batch as a whole */
+  if (pos != length) {
+    COMMS_Handler_SendBinaryResponse(VAL_PARAM, NULL, 0);
+    return;
+  }
+
+  COMMS_Handler_RunBatch();
+}
+
+/**
+  * @brief  Add a decoded command to the batch
+  * @param  command: Command table entry, NULL if unknown
+  * @param  code: Binary command code
+  * @param  msg_id: Message ID to respond to, NULL for the integer ID id_number
+  * @param  id_number: Integer message ID, used if msg_id is NULL
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_QueueCommand(const COMMS_Command_t* command, uint8_t code,
+                                       const char* msg_id, uint32_t id_number,
+                                       const COMMS_Command_Args_t* args) {
+  if (batch_count >= BATCH_MAX_COMMANDS) {
+    batch_dropped = true;
+    return;
+  }
+
+  COMMS_Batch_Entry_t* entry = &batch[batch_count++];
+  entry->command = command;
+  entry->code = code;
+  entry->id_numeric = (msg_id == NULL);
+  entry->id_number = id_number;
+  if (msg_id == NULL) {
+    entry->id[0] = '\0';
+  } else {
+    strncpy(entry->id, msg_id, sizeof(entry->id) - 1);
+    entry->id[sizeof(entry->id) - 1] = '\0';
+  }
+  entry->args = *args;
+}
+
+/**
+  * @brief  Run the collected batch and send all responses at once
+  * @note   The commands run with the scheduler suspended, so the coordinator
+  *         never sees a scene half applied. Handlers only format responses
+  *         and call non-blocking drivers, which is safe in that window.
+  *         system/set_baud and config/set_address are refused, the link
+  *         must not change mid-batch, and so is system/selftest.
+  * @retval None
+  */
+static void COMMS_Handler_RunBatch(void) {
+  batch_length = 0;
+
+  vTaskSuspendAll();
+  batch_collecting = true;
+
+  for (uint8_t i = 0; i < batch_count; i++) {
+    COMMS_Batch_Entry_t* entry = &batch[i];
+
+    reply.code = entry->code;
+    reply.id_numeric = entry->id_numeric;
+    reply.id_number = entry->id_number;
+    if (entry->command == NULL) {
+      if (reply.binary) {
+        COMMS_Handler_SendBinaryResponse(VAL_PARAM, NULL, 0);
+      } else {
+        COMMS_Handler_SendErrorResponse(entry->id, "unknown", "unknown", "Unknown command");
+      }
+    } else if (entry->command->handler == COMMS_Handler_CmdSystemSetBaud ||
+               entry->command->handler == COMMS_Handler_CmdConfigSetAddress ||
+               entry->command->handler == COMMS_Handler_CmdSystemSelfTest) {
+      if (reply.binary) {
+        COMMS_Handler_SendBinaryResponse(VAL_BUSY, NULL, 0);
+      } else {
+        COMMS_Handler_SendErrorResponse(entry->id, entry->command->topic, entry->command->action,
+                                        "Not allowed in a batch");
+      }
+    } else {
+      COMMS_Handler_RunCommand(entry->command, entry->id, &entry->args);
+    }
+  }
+
+  if (batch_dropped) {
+    reply.id_numeric = false;
+    if (reply.binary) {
+      reply.code = COMMS_BIN_SYSTEM_BATCH;
+      COMMS_Handler_SendBinaryResponse(VAL_PARAM, NULL, 0);
+    } else {
+      COMMS_Handler_SendErrorResponse("batch", "system", "batch", "Too many commands");
+    }
+  }
+
+  batch_collecting = false;
+  xTaskResumeAll();
+
+  uint32_t send_start = Profiler_Start();
+  if (batch_length > 0 &&
+      TxPool_SendDirect((const uint8_t*)batchBuffer, batch_length, TX_PRIORITY_RESPONSE, 1000) == VAL_OK) {
+    Latency_ResponseQueued();
+  }
+  Profiler_Stop(PROFILER_PROBE_SERIAL_SEND, send_start);
+
+  batch_count = 0;
+  batch_dropped = false;
+}
+
+/**
+  * @brief  Decode the arguments of a binary command body
+  * @note   The body holds the fields the command takes, in COMMAND_ARG_* bit
+  *         order: id (1), intensity (1), intensities (1 per light),
+  *         first light (1), reset (1), rate (1), fields (1), baud (4),
+  *         permille (2), permilles (2 per light), duration (2),
+  *         curve (1, COMMS_CURVE_*), config (1, COMMS_CONFIG_* mask,
+  *         then an int32 per key set, in bit order), from (4),
+  *         level (1, Logger_Level_t), scans (2), trigger (1,
+  *         COMMS_CAPTURE_*), threshold (4, int32), calibration (1,
+  *         COMMS_CALIBRATION_* mask, then an int32 per key set, in bit
+  *         order), points (1, count, then uint16 mV and int16
+  *         centi-degrees per point), current (4, int32), offset (4),
+  *         period (4), width (4), address (1), bus (1, 0 or 1),
+  *         sync (1, 0 or 1), checked (1, 0 or 1), channel (2), mask (4),
+  *         values (2 each, up to one per light, to the end of the body)
+  *         on-change (1, COMMS_ON_CHANGE_* mask, then an int32 per key
+  *         set, in bit order), frequency (4), dither (1, 0 or 1), timeout
+  *         (2), scene (1), limit (1), since (4) and until (4). Trailing
+  *         fields may be left out.
+  * @param  body: Command body
+  * @param  length: Body length
+  * @param  wanted: COMMAND_ARG_* fields the command takes
+  * @param  args: Pointer to store the decoded arguments
+  * @retval None
+  */
+static void COMMS_Handler_DecodeBinaryArgs(const uint8_t* body, size_t length, uint64_t wanted,
+                                           COMMS_Command_Args_t* args) {
+  size_t pos = 0;
+
+  memset(args, 0, sizeof(*args));
+
+  if ((wanted & COMMAND_ARG_ID) && pos + 1 <= length) {
+    args->id = body[pos++];
+    args->found |= COMMAND_ARG_ID;
+  }
+  if ((wanted & COMMAND_ARG_INTENSITY) && pos + 1 <= length) {
+    args->intensity = body[pos++];
+    args->found |= COMMAND_ARG_INTENSITY;
+  }
+  if ((wanted & COMMAND_ARG_INTENSITIES) && pos + sizeof(args->intensities) <= length) {
+    memcpy(args->intensities, &body[pos], sizeof(args->intensities));
+    pos += sizeof(args->intensities);
+    args->found |= COMMAND_ARG_INTENSITIES;
+  }
+  if ((wanted & COMMAND_ARG_LIGHTS) && pos + 1 <= length) {
+    args->lights = body[pos++];
+    args->found |= COMMAND_ARG_LIGHTS;
+  }
+  if ((wanted & COMMAND_ARG_RESET) && pos + 1 <= length) {
+    if (body[pos++] != 0) {
+      args->found |= COMMAND_ARG_RESET;
+    }
+  }
+  if ((wanted & COMMAND_ARG_RATE) && pos + 1 <= length) {
+    args->rate = body[pos++];
+    args->found |= COMMAND_ARG_RATE;
+  }
+  if ((wanted & COMMAND_ARG_FIELDS) && pos + 1 <= length) {
+    args->fields = body[pos++] & COMMS_TELEMETRY_ALL;
+    args->found |= COMMAND_ARG_FIELDS;
+  }
+  if ((wanted & COMMAND_ARG_BAUD) && pos + 4 <= length) {
+    memcpy(&args->baud, &body[pos], sizeof(args->baud));
+    pos += 4;
+    args->found |= COMMAND_ARG_BAUD;
+  }
+  if ((wanted & COMMAND_ARG_PERMILLE) && pos + 2 <= length) {
+    memcpy(&args->permille, &body[pos], sizeof(args->permille));
+    pos += 2;
+    args->found |= COMMAND_ARG_PERMILLE;
+  }
+  if ((wanted & COMMAND_ARG_PERMILLES) && pos + sizeof(args->permilles) <= length) {
+    memcpy(args->permilles, &body[pos], sizeof(args->permilles));
+    pos += sizeof(args->permilles);
+    args->found |= COMMAND_ARG_PERMILLES;
+  }
+  if ((wanted & COMMAND_ARG_DURATION) && pos + 2 <= length) {
+    memcpy(&args->duration, &body[pos], sizeof(args->duration));
+    pos += 2;
+    args->found |= COMMAND_ARG_DURATION;
+  }
+  if ((wanted & COMMAND_ARG_CURVE) && pos + 1 <= length) {
+    args->curve = body[pos++];
+    args->found |= COMMAND_ARG_CURVE;
+  }
+  if ((wanted & COMMAND_ARG_CONFIG) && pos + 1 <= length) {
+    uint8_t keys = body[pos++];
+
+    /* All announced values must be present */
+    for (uint8_t i = 0; i < COMMS_CONFIG_KEY_COUNT; i++) {
+      if ((keys & (1U << i)) == 0) {
+        continue;
+      }
+      if (pos + sizeof(int32_t) > length) {
+        return;
+      }
+      memcpy(&args->config_values[i], &body[pos], sizeof(int32_t));
+      pos += sizeof(int32_t);
+    }
+    args->config_keys = keys & ((1U << COMMS_CONFIG_KEY_COUNT) - 1U);
+    args->found |= COMMAND_ARG_CONFIG;
+  }
+  if ((wanted & COMMAND_ARG_FROM) && pos + 4 <= length) {
+    memcpy(&args->from, &body[pos], sizeof(args->from));
+    pos += 4;
+    args->found |= COMMAND_ARG_FROM;
+  }
+  if ((wanted & COMMAND_ARG_LEVEL) && pos + 1 <= length) {
+    args->level = body[pos++];
+    args->found |= COMMAND_ARG_LEVEL;
+  }
+  if ((wanted & COMMAND_ARG_SCANS) && pos + 2 <= length) {
+    memcpy(&args->scans, &body[pos], sizeof(args->scans));
+    pos += 2;
+    args->found |= COMMAND_ARG_SCANS;
+  }
+  if ((wanted & COMMAND_ARG_TRIGGER) && pos + 1 <= length) {
+    args->trigger = body[pos++];
+    args->found |= COMMAND_ARG_TRIGGER;
+  }
+  if ((wanted & COMMAND_ARG_THRESHOLD) && pos + 4 <= length) {
+    memcpy(&args->threshold, &body[pos], sizeof(args->threshold));
+    pos += 4;
+    args->found |= COMMAND_ARG_THRESHOLD;
+  }
+  if ((wanted & COMMAND_ARG_CALIBRATION) && pos + 1 <= length) {
+    uint8_t keys = body[pos++];
+
+    /* All announced values must be present */
+    for (uint8_t i = 0; i < COMMS_CALIBRATION_KEY_COUNT; i++) {
+      if ((keys & (1U << i)) == 0) {
+        continue;
+      }
+      if (pos + sizeof(int32_t) > length) {
+        return;
+      }
+      memcpy(&args->calibration_values[i], &body[pos], sizeof(int32_t));
+      pos += sizeof(int32_t);
+    }
+    args->calibration_keys = keys & ((1U << COMMS_CALIBRATION_KEY_COUNT) - 1U);
+    args->found |= COMMAND_ARG_CALIBRATION;
+  }
+  if ((wanted & COMMAND_ARG_POINTS) && pos + 1 <= length) {
+    uint8_t count = body[pos++];
+
+    if (count > ANALOG_CAL_MAX_POINTS || pos + count * sizeof(AnalogCalPoint) > length) {
+      return;
+    }
+    memcpy(args->points, &body[pos], count * sizeof(AnalogCalPoint));
+    pos += count * sizeof(AnalogCalPoint);
+    args->point_values = (uint8_t)(2U * count);
+    args->found |= COMMAND_ARG_POINTS;
+  }
+  if ((wanted & COMMAND_ARG_CURRENT) && pos + 4 <= length) {
+    memcpy(&args->current, &body[pos], sizeof(args->current));
+    pos += 4;
+    args->found |= COMMAND_ARG_CURRENT;
+  }
+  if ((wanted & COMMAND_ARG_OFFSET) && pos + 4 <= length) {
+    memcpy(&args->offset, &body[pos], sizeof(args->offset));
+    pos += 4;
+    args->found |= COMMAND_ARG_OFFSET;
+  }
+  if ((wanted & COMMAND_ARG_PERIOD) && pos + 4 <= length) {
+    memcpy(&args->period, &body[pos], sizeof(args->period));
+    pos += 4;
+    args->found |= COMMAND_ARG_PERIOD;
+  }
+  if ((wanted & COMMAND_ARG_WIDTH) && pos + 4 <= length) {
+    memcpy(&args->width, &body[pos], sizeof(args->width));
+    pos += 4;
+    args->found |= COMMAND_ARG_WIDTH;
+  }
+  if ((wanted & COMMAND_ARG_ADDRESS) && pos + 1 <= length) {
+    args->address = body[pos++];
+    args->found |= COMMAND_ARG_ADDRESS;
+  }
+  if ((wanted & COMMAND_ARG_BUS) && pos + 1 <= length) {
+    args->bus = (body[pos++] != 0);
+    args->found |= COMMAND_ARG_BUS;
+  }
+  if ((wanted & COMMAND_ARG_SYNC) && pos + 1 <= length) {
+    args->sync = (body[pos++] != 0);
+    args->found |= COMMAND_ARG_SYNC;
+  }
+  if ((wanted & COMMAND_ARG_CHECKED) && pos + 1 <= length) {
+    args->checked = (body[pos++] != 0);
+    args->found |= COMMAND_ARG_CHECKED;
+  }
+  if ((wanted & COMMAND_ARG_CHANNEL) && pos + 2 <= length) {
+    memcpy(&args->channel, &body[pos], sizeof(args->channel));
+    pos += 2;
+    args->found |= COMMAND_ARG_CHANNEL;
+  }
+  if ((wanted & COMMAND_ARG_MASK) && pos + 4 <= length) {
+    memcpy(&args->mask, &body[pos], sizeof(args->mask));
+    pos += 4;
+    args->found |= COMMAND_ARG_MASK;
+  }
+  if ((wanted & COMMAND_ARG_VALUES) && pos + 2 <= length) {
+    while (pos + 2 <= length && args->value_count < VAL_LIGHT_COUNT) {
+      memcpy(&args->values[args->value_count++], &body[pos], sizeof(args->values[0]));
+      pos += 2;
+    }
+    if (pos < length) {
+      args->value_count = VAL_LIGHT_COUNT + 1;
+    }
+    args->found |= COMMAND_ARG_VALUES;
+  }
+  if ((wanted & COMMAND_ARG_ON_CHANGE) && pos + 1 <= length) {
+    uint8_t keys = body[pos++];
+
+    /* All announced values must be present */
+    for (uint8_t i = 0; i < COMMS_ON_CHANGE_KEY_COUNT; i++) {
+      if ((keys & (1U << i)) == 0) {
+        continue;
+      }
+      if (pos + sizeof(int32_t) > length) {
+        return;
+      }
+      memcpy(&args->on_change_values[i], &body[pos], sizeof(int32_t));
+      pos += sizeof(int32_t);
+    }
+    args->on_change_keys = keys & ((1U << COMMS_ON_CHANGE_KEY_COUNT) - 1U);
+    args->found |= COMMAND_ARG_ON_CHANGE;
+  }
+  if ((wanted & COMMAND_ARG_FREQUENCY) && pos + 4 <= length) {
+    memcpy(&args->frequency, &body[pos], sizeof(args->frequency));
+    pos += 4;
+    args->found |= COMMAND_ARG_FREQUENCY;
+  }
+  if ((wanted & COMMAND_ARG_DITHER) && pos + 1 <= length) {
+    args->dither = (body[pos++] != 0);
+    args->found |= COMMAND_ARG_DITHER;
+  }
+  if ((wanted & COMMAND_ARG_TIMEOUT) && pos + 2 <= length) {
+    uint16_t timeout;
+
+    memcpy(&timeout, &body[pos], sizeof(timeout));
+    pos += 2;
+    args->timeout = timeout;
+    args->found |= COMMAND_ARG_TIMEOUT;
+  }
+  if ((wanted & COMMAND_ARG_SCENE) && pos + 1 <= length) {
+    args->scene = body[pos++];
+    args->found |= COMMAND_ARG_SCENE;
+  }
+  if ((wanted & COMMAND_ARG_LIMIT) && pos + 1 <= length) {
+    args->limit = body[pos++];
+    args->found |= COMMAND_ARG_LIMIT;
+  }
+  if ((wanted & COMMAND_ARG_SINCE) && pos + 4 <= length) {
+    memcpy(&args->since, &body[pos], sizeof(args->since));
+    pos += 4;
+    args->found |= COMMAND_ARG_SINCE;
+  }
+  if ((wanted & COMMAND_ARG_UNTIL) && pos + 4 <= length) {
+    memcpy(&args->until, &body[pos], sizeof(args->until));
+    pos += 4;
+    args->found |= COMMAND_ARG_UNTIL;
+  }
+  if ((wanted & COMMAND_ARG_TIME) && pos + 8 <= length) {
+    memcpy(&args->time, &body[pos], sizeof(args->time));
+    pos += 8;
+    args->found |= COMMAND_ARG_TIME;
+  }
+  if ((wanted & COMMAND_ARG_RTT) && pos + 4 <= length) {
+    memcpy(&args->rtt, &body[pos], sizeof(args->rtt));
+    pos += 4;
+    args->found |= COMMAND_ARG_RTT;
+  }
+  if ((wanted & COMMAND_ARG_SIZE) && pos + 4 <= length) {
+    memcpy(&args->size, &body[pos], sizeof(args->size));
+    pos += 4;
+    args->found |= COMMAND_ARG_SIZE;
+  }
+  if ((wanted & COMMAND_ARG_CRC) && pos + 4 <= length) {
+    memcpy(&args->crc, &body[pos], sizeof(args->crc));
+    pos += 4;
+    args->found |= COMMAND_ARG_CRC;
+  }
+  if ((wanted & COMMAND_ARG_SHAPE) && pos + 1 <= length) {
+    args->shape = body[pos++];
+    args->found |= COMMAND_ARG_SHAPE;
+  }
+  if ((wanted & COMMAND_ARG_NOISE) && pos + 4 <= length) {
+    memcpy(&args->noise, &body[pos], sizeof(args->noise));
+    pos += 4;
+    args->found |= COMMAND_ARG_NOISE;
+  }
+  if ((wanted & COMMAND_ARG_SLEW) && pos + 2 <= length) {
+    memcpy(&args->slew, &body[pos], sizeof(args->slew));
+    pos += 2;
+    args->found |= COMMAND_ARG_SLEW;
+  }
+  if ((wanted & COMMAND_ARG_CCT) && pos + 2 <= length) {
+    memcpy(&args->cct, &body[pos], sizeof(args->cct));
+    pos += 2;
+    args->found |= COMMAND_ARG_CCT;
+  }
+  if ((wanted & COMMAND_ARG_TINT) && pos + 2 <= length) {
+    memcpy(&args->tint, &body[pos], sizeof(args->tint));
+    pos += 2;
+    args->found |= COMMAND_ARG_TINT;
+  }
+  if ((wanted & COMMAND_ARG_X) && pos + 2 <= length) {
+    memcpy(&args->x, &body[pos], sizeof(args->x));
+    pos += 2;
+    args->found |= COMMAND_ARG_X;
+  }
+  if ((wanted & COMMAND_ARG_Y) && pos + 2 <= length) {
+    memcpy(&args->y, &body[pos], sizeof(args->y));
+    pos += 2;
+    args->found |= COMMAND_ARG_Y;
+  }
+  if ((wanted & COMMAND_ARG_FLUX) && pos + 2 <= length) {
+    memcpy(&args->flux, &body[pos], sizeof(args->flux));
+    pos += 2;
+    args->found |= COMMAND_ARG_FLUX;
+  }
+  if ((wanted & COMMAND_ARG_EFFECT) && pos + 1 <= length) {
+    args->effect = body[pos++];
+    args->found |= COMMAND_ARG_EFFECT;
+  }
+  if ((wanted & COMMAND_ARG_DEPTH) && pos + 2 <= length) {
+    memcpy(&args->depth, &body[pos], sizeof(args->depth));
+    pos += 2;
+    args->found |= COMMAND_ARG_DEPTH;
+  }
+  if ((wanted & COMMAND_ARG_GROUP) && pos + 1 <= length) {
+    args->group = body[pos++];
+    args->found |= COMMAND_ARG_GROUP;
+  }
+  if ((wanted & COMMAND_ARG_BUS_GROUPS) && pos + 2 <= length) {
+    memcpy(&args->bus_groups, &body[pos], sizeof(args->bus_groups));
+    pos += 2;
+    args->found |= COMMAND_ARG_BUS_GROUPS;
+  }
+  if ((wanted & COMMAND_ARG_INPUT) && pos + 1 <= length) {
+    args->input = body[pos++];
+    args->found |= COMMAND_ARG_INPUT;
+  }
+  if ((wanted & COMMAND_ARG_THEN) && pos + 1 <= length) {
+    args->then = body[pos++];
+    args->found |= COMMAND_ARG_THEN;
+  }
+  if ((wanted & COMMAND_ARG_HYSTERESIS) && pos + 4 <= length) {
+    memcpy(&args->hysteresis, &body[pos], sizeof(args->hysteresis));
+    pos += 4;
+    args->found |= COMMAND_ARG_HYSTERESIS;
+  }
+  if ((wanted & COMMAND_ARG_ENABLE) && pos + 1 <= length) {
+    args->enable = (body[pos++] != 0);
+    args->found |= COMMAND_ARG_ENABLE;
+  }
+  if ((wanted & COMMAND_ARG_DATA) && pos + 1 <= length) {
+    uint8_t count = body[pos++];
+
+    if (count > COMMS_CONFIG_IMPORT_CHUNK || pos + count > length) {
+      return;
+    }
+    memcpy(args->data, &body[pos], count);
+    pos += count;
+    args->data_length = count;
+    args->found |= COMMAND_ARG_DATA;
+  }
+  if ((wanted & COMMAND_ARG_FLOW) && pos + 1 <= length) {
+    args->flow = (body[pos++] != 0);
+    args->found |= COMMAND_ARG_FLOW;
+  }
+  if ((wanted & COMMAND_ARG_STREAM) && pos + 1 <= length) {
+    args->stream = body[pos++];
+    args->found |= COMMAND_ARG_STREAM;
+  }
+  if ((wanted & COMMAND_ARG_HOURS) && pos + 2 <= length) {
+    memcpy(&args->hours, &body[pos], sizeof(args->hours));
+    pos += 2;
+    args->found |= COMMAND_ARG_HOURS;
+  }
+  if ((wanted & COMMAND_ARG_AGEING) && pos + 1 <= length) {
+    uint8_t count = body[pos++];
+
+    if (count > LED_DRIVER_AGEING_POINTS || pos + count * sizeof(args->ageing[0]) > length) {
+      return;
+    }
+    memcpy(args->ageing, &body[pos], count * sizeof(args->ageing[0]));
+    pos += count * sizeof(args->ageing[0]);
+    args->ageing_count = count;
+    args->found |= COMMAND_ARG_AGEING;
+  }
+}
+
+/**
+  * @brief  Send a binary response to the command being handled
+  * @param  status: Status byte of the response
+  * @param  body: Body following the status byte, only sent with VAL_OK
+  * @param  body_length: Body length
+  * @retval None
+  */
+static void COMMS_Handler_SendBinaryResponse(VAL_Status status, const void* body, size_t body_length) {
+  uint8_t data[COMMS_BIN_MAX_PAYLOAD - COMMS_BIN_HEADER_SIZE - COMMS_BIN_CRC_SIZE];
+  uint32_t probe_start = Profiler_Start();
+
+  if (status != VAL_OK || body == NULL) {
+    body_length = 0;
+  }
+  if (body_length > sizeof(data) - 1) {
+    status = VAL_ERROR;
+    body_length = 0;
+  }
+  if (status != VAL_OK) {
+    reply.status = status;
+  }
+
+  data[0] = (uint8_t)status;
+  if (body_length > 0) {
+    memcpy(&data[1], body, body_length);
+  }
+
+  size_t length = COMMS_Binary_EncodeFrame(COMMS_BIN_TYPE_RESP, reply.seq, reply.code,
+                                           data, body_length + 1,
+                                           (uint8_t*)txBuffer, TX_BUFFER_SIZE);
+  if (length > 0) {
+    COMMS_Handler_Transmit(txBuffer, length, probe_start);
+  }
+}
+
+/**
+  * @brief  Convert sensor readings to the binary fixed point layout
+  * @param  data: Sensor readings
+  * @param  packed: Pointer to store the packed readings
+  * @retval None
+  */
+static void COMMS_Handler_PackSensor(const LightSensorData_t* data, COMMS_Bin_Sensor_t* packed) {
+  float current = data->current + 0.5f;
+  float temperature = data->temperature * 100.0f;
+
+  packed->current_ma = (current <= 0.0f) ? 0 :
+                       (current >= 65535.0f) ? 65535 : (uint16_t)current;
+  packed->temperature_cdeg = (temperature <= -32768.0f) ? -32768 :
+                             (temperature >= 32767.0f) ? 32767 :
+                             (int16_t)(temperature + ((temperature < 0.0f) ? -0.5f : 0.5f));
+}
+
+/**
+  * @brief  system/ping command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemPing(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendPingResponse(msg_id);
+}
+
+/**
+  * @brief  system/perf command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemPerf(const char* msg_id, const COMMS_Command_Args_t* args) {
+  /* Report first, so the reset does not hide the numbers being asked for */
+  COMMS_Handler_SendPerfResponse(msg_id);
+  if (args->found & COMMAND_ARG_RESET) {
+    Profiler_Reset();
+  }
+}
+
+/**
+  * @brief  system/boot_time command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemBootTime(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendBootTimeResponse(msg_id);
+}
+
+/**
+  * @brief  system/resources command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemResources(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendResourcesResponse(msg_id);
+}
+
+/**
+  * @brief  system/cpu command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemCpu(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendCpuResponse(msg_id);
+}
+
+/**
+  * @brief  system/trace command handler
+  * @note   Without "from" the oldest entries still kept are sent
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemTrace(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendTraceResponse(msg_id, (args->found & COMMAND_ARG_FROM) ? args->from : 0);
+}
+
+/**
+  * @brief  system/crash_report command handler
+  * @note   Without "from" the summary is sent, with it the trace entries
+  *         kept with the crash, as system/trace
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemCrashReport(const char* msg_id, const COMMS_Command_Args_t* args) {
+  if (args->found & COMMAND_ARG_FROM) {
+    COMMS_Handler_SendCrashTraceResponse(msg_id, args->from);
+  } else {
+    COMMS_Handler_SendCrashReportResponse(msg_id);
+  }
+}
+
+/**
+  * @brief  system/kernel_trace command handler
+  * @note   "enable" switches scheduler recording on or off first. Without
+  *         "from" the state, the recording cost and the task numbers are
+  *         sent, with it the entries, as system/trace; "reset" clears the
+  *         cost figures once reported.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemKernelTrace(const char* msg_id, const COMMS_Command_Args_t* args) {
+  if (args->found & COMMAND_ARG_ENABLE) {
+    Trace_KernelEnable(args->enable);
+  }
+
+  if (args->found & COMMAND_ARG_FROM) {
+    COMMS_Handler_SendKernelEntriesResponse(msg_id, args->from);
+  } else {
+    COMMS_Handler_SendKernelTraceResponse(msg_id);
+  }
+
+  if (args->found & COMMAND_ARG_RESET) {
+    Trace_KernelReset();
+  }
+}
+
+/**
+  * @brief  system/latency command handler
+  * @note   Reports and clears the latency histograms. "from" is the
+  *         command table index to go on from; the host asks again from
+  *         "next" until it is "total".
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemLatency(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendLatencyResponse(msg_id, (args->found & COMMAND_ARG_FROM) ? args->from : 0);
+}
+
+/**
+  * @brief  system/log_level command handler
+  * @note   Without "level" the current level is reported
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemLogLevel(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_OK;
+
+  if (args->found & COMMAND_ARG_LEVEL) {
+    status = Logger_SetLevel((Logger_Level_t)args->level);
+  }
+
+  COMMS_Handler_SendLogLevelResponse(msg_id, status);
+}
+
+/**
+  * @brief  system/link command handler
+  * @note   "checked" switches checked mode and restarts the sequence
+  *         numbers; "reset" clears the counters once reported
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemLink(const char* msg_id, const COMMS_Command_Args_t* args) {
+  if (args->found & COMMAND_ARG_CHECKED) {
+    link_checked = args->checked;
+    json_seq_seen = false;
+    bin_seq_seen = false;
+  }
+
+  /* Report first, so the reset does not hide the numbers being asked for */
+  COMMS_Handler_SendLinkResponse(msg_id);
+  if (args->found & COMMAND_ARG_RESET) {
+    memset(&link_stats, 0, sizeof(link_stats));
+  }
+}
+
+/**
+  * @brief  system/deadlines command handler
+  * @note   "reset" clears the task figures once reported; the last reset
+  *         record is kept
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemDeadlines(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendDeadlinesResponse(msg_id);
+  if (args->found & COMMAND_ARG_RESET) {
+    Supervisor_ResetStats();
+  }
+}
+
+/**
+  * @brief  system/queues command handler
+  * @note   "reset" clears the figures once reported
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemQueues(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendQueuesResponse(msg_id);
+  if (args->found & COMMAND_ARG_RESET) {
+    Queues_ResetStats();
+  }
+}
+
+/**
+  * @brief  system/loop_timing command handler
+  * @note   "reset" clears the figures once reported
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemLoopTiming(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendLoopTimingResponse(msg_id);
+  if (args->found & COMMAND_ARG_RESET) {
+    Jitter_Reset();
+  }
+}
+
+/**
+  * @brief  system/time_sync command handler
+  * @note   "time" is the host clock when it sent the command, "rtt" the
+  *         round trip it measured for the previous one
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemTimeSync(const char* msg_id, const COMMS_Command_Args_t* args) {
+  Clock_SyncResult_t result = { 0 };
+  VAL_Status status = VAL_PARAM;
+
+  if (args->found & COMMAND_ARG_TIME) {
+    status = Clock_Sync(args->time, (args->found & COMMAND_ARG_RTT) ? args->rtt : 0, &result);
+  }
+
+  COMMS_Handler_SendTimeSyncResponse(msg_id, status, &result);
+}
+
+/**
+  * @brief  system/update command handler
+  * @note   The response goes out before the reset into the boot loader;
+  *         from then on the device answers only the update commands until
+  *         it resets again
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemUpdate(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_PARAM;
+
+  if ((args->found & (COMMAND_ARG_SIZE | COMMAND_ARG_CRC)) == (COMMAND_ARG_SIZE | COMMAND_ARG_CRC)) {
+    status = Update_Prepare(args->size);
+  }
+
+  COMMS_Handler_SendUpdateResponse(msg_id, status, args->size);
+  if (status != VAL_OK) {
+    return;
+  }
+
+  VAL_Serial_Flush(COMMS_BAUD_FLUSH_TIMEOUT_MS);
+  Update_Run(args->size, args->crc, device_address);
+}
+
+/**
+  * @brief  system/capabilities command handler
+  * @note   "from" is the index of the first command listed; the page size
+  *         differs between JSON and binary, the host goes on from "from"
+  *         plus the commands it got until "total"
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemCapabilities(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendCapabilitiesResponse(msg_id, (args->found & COMMAND_ARG_FROM) ? args->from : 0);
+}
+
+/**
+  * @brief  system/get_state command handler
+  * @note   Intensities, alarms, readings and derating in one response, from
+  *         the same publication of the light state
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemGetState(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendStateResponse(msg_id);
+}
+
+/**
+  * @brief  system/selftest command handler
+  * @note   The corpus runs through the decoder this command is still in, so
+  *         the task starts it once the command is finished
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemSelfTest(const char* msg_id, const COMMS_Command_Args_t* args) {
+  selftest_reply = reply;
+  strncpy(selftest_id, msg_id, sizeof(selftest_id) - 1);
+  selftest_id[sizeof(selftest_id) - 1] = '\0';
+  selftest_pending = true;
+}
+
+#ifdef BENCHMARK
+/**
+  * @brief  system/inject_fault command handler
+  * @note   Benchmark builds only; the light trips as if over current
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemInjectFault(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_ERROR;
+
+  if (args->found & COMMAND_ARG_ID) {
+    status = SYS_Coordinator_InjectLightFault(args->id);
+  }
+
+  if (reply.binary) {
+    COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    return;
+  }
+
+  if (status != VAL_OK) {
+    COMMS_Handler_SendErrorResponse(msg_id, "system", "inject_fault", "Invalid light ID");
+    return;
+  }
+
+  COMMS_Handler_SendFixedResponse(msg_id, "system", "inject_fault", RESP_STATUS_OK);
+}
+
+/**
+  * @brief  system/irq_latency command handler
+  * @note   Benchmark builds only. The first call starts the probe and
+  *         reports no figures; "reset" clears them once reported. The flash
+  *         stalls are the longest times interrupts could not run at all.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemIrqLatency(const char* msg_id, const COMMS_Command_Args_t* args) {
+  static const char* const level_names[VAL_IRQ_LEVEL_COUNT] = { "safety", "sampling", "comms" };
+  static const uint8_t level_priorities[VAL_IRQ_LEVEL_COUNT] = {
+    VAL_IRQ_PRIORITY_SAFETY, VAL_IRQ_PRIORITY_SAMPLING, VAL_IRQ_PRIORITY_COMMS
+  };
+  VAL_Timers_Latency_t latency[VAL_IRQ_LEVEL_COUNT];
+  Profiler_WakeupStats_t wakeups[PROFILER_WAKEUP_COUNT];
+  VAL_DataStore_FlashStats_t flash;
+  bool running = VAL_Timers_IsLatencyProbeRunning();
+  JSON_Writer_t writer;
+
+  if (!running) {
+    VAL_Timers_StartLatencyProbe();
+  }
+  for (uint8_t i = 0; i < VAL_IRQ_LEVEL_COUNT; i++) {
+    VAL_Timers_GetLatency((VAL_IrqLevel_t)i, &latency[i]);
+  }
+  for (uint8_t i = 0; i < PROFILER_WAKEUP_COUNT; i++) {
+    Profiler_GetWakeup((Profiler_Wakeup_t)i, &wakeups[i]);
+  }
+  VAL_DataStore_GetFlashStats(&flash);
+  if (args->found & COMMAND_ARG_RESET) {
+    VAL_Timers_ResetLatency();
+    Profiler_ResetWakeup();
+    VAL_DataStore_ResetFlashStats();
+  }
+
+  if (reply.binary) {
+    uint8_t body[1 + VAL_IRQ_LEVEL_COUNT * sizeof(COMMS_Bin_IrqLatency_t) +
+                 PROFILER_WAKEUP_COUNT * sizeof(COMMS_Bin_Wakeup_t) + sizeof(COMMS_Bin_FlashStall_t)];
+    size_t length = 1 + VAL_IRQ_LEVEL_COUNT * sizeof(COMMS_Bin_IrqLatency_t);
+
+    body[0] = running ? 1U : 0U;
+    for (uint8_t i = 0; i < VAL_IRQ_LEVEL_COUNT; i++) {
+      COMMS_Bin_IrqLatency_t level;
+
+      level.priority = level_priorities[i];
+      level.count = latency[i].count;
+      level.min_ns = latency[i].min_ns;
+      level.max_ns = latency[i].max_ns;
+      memcpy(&body[1 + i * sizeof(level)], &level, sizeof(level));
+    }
+    for (uint8_t i = 0; i < PROFILER_WAKEUP_COUNT; i++) {
+      COMMS_Bin_Wakeup_t wakeup = { wakeups[i].count, wakeups[i].min_ns, wakeups[i].max_ns };
+
+      memcpy(&body[length], &wakeup, sizeof(wakeup));
+      length += sizeof(wakeup);
+    }
+    COMMS_Bin_FlashStall_t stall = {
+      flash.erases, flash.erase_max_us, flash.programs, flash.program_max_us, flash.deferred
+    };
+    memcpy(&body[length], &stall, sizeof(stall));
+    length += sizeof(stall);
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, length);
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "system", "irq_latency");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"running\":");
+  JSON_Writer_Bool(&writer, running);
+  JSON_Writer_Literal(&writer, ",\"levels\":[");
+  for (uint8_t i = 0; i < VAL_IRQ_LEVEL_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"name\":");
+    JSON_Writer_String(&writer, level_names[i]);
+    JSON_Writer_Literal(&writer, ",\"priority\":");
+    JSON_Writer_Uint(&writer, level_priorities[i]);
+    JSON_Writer_Literal(&writer, ",\"count\":");
+    JSON_Writer_Uint(&writer, latency[i].count);
+    JSON_Writer_Literal(&writer, ",\"min_ns\":");
+    JSON_Writer_Uint(&writer, latency[i].min_ns);
+    JSON_Writer_Literal(&writer, ",\"max_ns\":");
+    JSON_Writer_Uint(&writer, latency[i].max_ns);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Literal(&writer, "],\"wakeups\":[");
+  for (uint8_t i = 0; i < PROFILER_WAKEUP_COUNT; i++) {
+    if (i > 0) {
+      JSON_Writer_Char(&writer, ',');
+    }
+    JSON_Writer_Literal(&writer, "{\"name\":");
+    JSON_Writer_String(&writer, Profiler_GetWakeupName((Profiler_Wakeup_t)i));
+    JSON_Writer_Literal(&writer, ",\"count\":");
+    JSON_Writer_Uint(&writer, wakeups[i].count);
+    JSON_Writer_Literal(&writer, ",\"min_ns\":");
+    JSON_Writer_Uint(&writer, wakeups[i].min_ns);
+    JSON_Writer_Literal(&writer, ",\"max_ns\":");
+    JSON_Writer_Uint(&writer, wakeups[i].max_ns);
+    JSON_Writer_Char(&writer, '}');
+  }
+  JSON_Writer_Literal(&writer, "],\"flash\":{\"erases\":");
+  JSON_Writer_Uint(&writer, flash.erases);
+  JSON_Writer_Literal(&writer, ",\"erase_max_us\":");
+  JSON_Writer_Uint(&writer, flash.erase_max_us);
+  JSON_Writer_Literal(&writer, ",\"programs\":");
+  JSON_Writer_Uint(&writer, flash.programs);
+  JSON_Writer_Literal(&writer, ",\"program_max_us\":");
+  JSON_Writer_Uint(&writer, flash.program_max_us);
+  JSON_Writer_Literal(&writer, ",\"deferred\":");
+  JSON_Writer_Uint(&writer, flash.deferred);
+  JSON_Writer_Char(&writer, '}');
+
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+  * @brief  bench/synthetic command handler
+  * @note   Benchmark builds only. With a "shape" other than "off", the
+  *         current of light "id" is replaced by a waveform to "current" mA,
+  *         starting "offset" us from now; "width" is the ramp or spike
+  *         length, "period" repeats spikes and "noise" adds uniform noise
+  *         of that peak in mA. "off" returns to the real samples. Every
+  *         call reports the progress and the time of each stage from the
+  *         edge, as a real over-current would run through them.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdBenchSynthetic(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_OK;
+
+  if (args->found & COMMAND_ARG_SHAPE) {
+    status = COMMS_Handler_StartSynthetic(args);
+  }
+
+  COMMS_Handler_SendSyntheticResponse(msg_id, status);
+}
+
+/**
+  * @brief  Start or stop the synthetic source as bench/synthetic asks
+  * @param  args: Decoded command arguments, "shape" included
+  * @retval VAL_Status: VAL_OK if started or stopped, VAL_PARAM for invalid settings
+  */
+static VAL_Status COMMS_Handler_StartSynthetic(const COMMS_Command_Args_t* args) {
+  /* Indexed by COMMS_SYNTH_* value - 1 */
+  static const AnalogSynthShape shapes[COMMS_SYNTH_SHAPE_COUNT - 1] = {
+    ANALOG_SYNTH_STEP, ANALOG_SYNTH_RAMP, ANALOG_SYNTH_SPIKE, ANALOG_SYNTH_NOISE
+  };
+  uint64_t rate_hz = VAL_Analog_GetSampleRate();
+  uint32_t required = COMMAND_ARG_ID | COMMAND_ARG_CURRENT;
+  int32_t noise = (args->found & COMMAND_ARG_NOISE) ? args->noise : 0;
+  AnalogSynthWave wave = {0};
+  LED_Driver_AlarmInfo_t info;
+  uint32_t level;
+  VAL_Status status;
+
+  if (args->shape == COMMS_SYNTH_OFF) {
+    VAL_Analog_StopSynthetic();
+    return VAL_OK;
+  }
+  if (args->shape >= COMMS_SYNTH_SHAPE_COUNT || (args->found & required) != required || noise < 0 ||
+      SYS_Coordinator_GetAlarmInfo(args->id, &info) != VAL_OK) {
+    return VAL_PARAM;
+  }
+
+  /* Levels in raw counts, the noise as their change per mA */
+  level = VAL_Analog_CurrentToCounts(args->id, args->current);
+  wave.shape = shapes[args->shape - 1];
+  wave.light_id = args->id;
+  wave.input = ANALOG_INPUT_CURRENT;
+  wave.level = (level > UINT16_MAX) ? UINT16_MAX : (uint16_t)level;
+  level = VAL_Analog_CurrentToCounts(args->id, noise) - VAL_Analog_CurrentToCounts(args->id, 0);
+  wave.noise = (level > UINT16_MAX) ? UINT16_MAX : (uint16_t)level;
+  wave.delay_scans = (args->found & COMMAND_ARG_OFFSET) ? (uint32_t)(args->offset * rate_hz / 1000000U) : 0;
+  wave.length_scans = (args->found & COMMAND_ARG_WIDTH) ? (uint32_t)(args->width * rate_hz / 1000000U) : 0;
+  wave.period_scans = (args->found & COMMAND_ARG_PERIOD) ? (uint32_t)(args->period * rate_hz / 1000000U) : 0;
+
+  /* A spike is at least one scan */
+  if (wave.shape == ANALOG_SYNTH_SPIKE && wave.length_scans == 0) {
+    wave.length_scans = 1;
+  }
+
+  status = VAL_Analog_StartSynthetic(&wave);
+  if (status == VAL_OK) {
+    synth_light = args->id;
+    synth_trips = info.trip_count;
+  }
+
+  return status;
+}
+
+/**
+  * @brief  bench/crc command handler
+  * @note   Benchmark builds only. Times the CRC16-CCITT, the CRC-32 and
+  *         the Modbus CRC-16 of the first "size" bytes of flash (BENCH_CRC_BYTES if left out) in
+  *         software, on the CRC unit written by the CPU and on the unit fed
+  *         by DMA, and checks that all three agree.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdBenchCrc(const char* msg_id, const COMMS_Command_Args_t* args) {
+  static const char* const type_names[VAL_CRC_TYPE_COUNT] = { "crc16", "crc32", "crc16_modbus" };
+  COMMS_Bin_BenchCrc_t results[VAL_CRC_TYPE_COUNT];
+  const uint8_t* block = (const uint8_t*)FLASH_BASE;
+  uint32_t size = (args->found & COMMAND_ARG_SIZE) ? args->size : BENCH_CRC_BYTES;
+  JSON_Writer_t writer;
+
+  if (size == 0 || size > BENCH_CRC_MAX_BYTES) {
+    if (reply.binary) {
+      COMMS_Handler_SendBinaryResponse(VAL_PARAM, NULL, 0);
+      return;
+    }
+    COMMS_Handler_SendErrorResponse(msg_id, "bench", "crc", "Invalid size");
+    return;
+  }
+
+  for (uint8_t i = 0; i < VAL_CRC_TYPE_COUNT; i++) {
+    VAL_Crc_Type_t type = (VAL_Crc_Type_t)i;
+    VAL_Status status = VAL_ERROR;
+    uint32_t dma_crc = 0;
+    uint32_t start = VAL_SysClock_GetMicros();
+
+    results[i].crc = VAL_Crc_ComputeSoftware(type, block, size);
+    results[i].software_us = VAL_SysClock_GetMicros() - start;
+
+    start = VAL_SysClock_GetMicros();
+    uint32_t cpu_crc = VAL_Crc_Compute(type, block, size);
+    results[i].cpu_us = VAL_SysClock_GetMicros() - start;
+
+    start = VAL_SysClock_GetMicros();
+    if (VAL_Crc_StartDma(type, block, size) == VAL_OK) {
+      while ((status = VAL_Crc_PollDma(&dma_crc)) == VAL_BUSY) {
+      }
+    }
+    results[i].dma_us = VAL_SysClock_GetMicros() - start;
+
+    results[i].match = (status == VAL_OK && cpu_crc == results[i].crc && dma_crc == results[i].crc) ? 1U : 0U;
+  }
+
+  if (reply.binary) {
+    uint8_t body[sizeof(size) + sizeof(results)];
+
+    memcpy(body, &size, sizeof(size));
+    memcpy(&body[sizeof(size)], results, sizeof(results));
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, sizeof(body));
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "bench", "crc");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"size\":");
+  JSON_Writer_Uint(&writer, size);
+  for (uint8_t i = 0; i < VAL_CRC_TYPE_COUNT; i++) {
+    JSON_Writer_Char(&writer, ',');
+    JSON_Writer_String(&writer, type_names[i]);
+    JSON_Writer_Literal(&writer, ":{\"crc\":");
+    JSON_Writer_Uint(&writer, results[i].crc);
+    JSON_Writer_Literal(&writer, ",\"match\":");
+    JSON_Writer_Bool(&writer, results[i].match);
+    JSON_Writer_Literal(&writer, ",\"software_us\":");
+    JSON_Writer_Uint(&writer, results[i].software_us);
+    JSON_Writer_Literal(&writer, ",\"cpu_us\":");
+    JSON_Writer_Uint(&writer, results[i].cpu_us);
+    JSON_Writer_Literal(&writer, ",\"dma_us\":");
+    JSON_Writer_Uint(&writer, results[i].dma_us);
+    JSON_Writer_Literal(&writer, ",\"software_us_per_kb\":");
+    JSON_Writer_Fixed(&writer, (float)results[i].software_us * 1024.0f / (float)size, 2);
+    JSON_Writer_Literal(&writer, ",\"cpu_us_per_kb\":");
+    JSON_Writer_Fixed(&writer, (float)results[i].cpu_us * 1024.0f / (float)size, 2);
+    JSON_Writer_Literal(&writer, ",\"dma_us_per_kb\":");
+    JSON_Writer_Fixed(&writer, (float)results[i].dma_us * 1024.0f / (float)size, 2);
+    JSON_Writer_Char(&writer, '}');
+  }
+
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+  * @brief  bench/copy command handler
+  * @note   Benchmark builds only. Times a RAM to RAM copy of "size" bytes
+  *         (VAL_DMA_COPY_MIN_BYTES if left out) with memcpy and with
+  *         VAL_DMA_Start, once with both ends word aligned and once with
+  *         the destination a byte off, and checks both copies.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdBenchCopy(const char* msg_id, const COMMS_Command_Args_t* args) {
+  static const char* const layout_names[] = { "word", "byte" };
+  COMMS_Bin_BenchCopy_t results[2];
+  uint32_t size = (args->found & COMMAND_ARG_SIZE) ? args->size : BENCH_COPY_BYTES;
+  JSON_Writer_t writer;
+
+  if (size == 0 || size > BENCH_COPY_MAX_BYTES) {
+    if (reply.binary) {
+      COMMS_Handler_SendBinaryResponse(VAL_PARAM, NULL, 0);
+      return;
+    }
+    COMMS_Handler_SendErrorResponse(msg_id, "bench", "copy", "Invalid size");
+    return;
+  }
+
+  for (uint32_t i = 0; i < 2U; i++) {
+    COMMS_Handler_BenchCopyRun(i, size, &results[i]);
+  }
+
+  if (reply.binary) {
+    uint8_t body[sizeof(size) + sizeof(results)];
+
+    memcpy(body, &size, sizeof(size));
+    memcpy(&body[sizeof(size)], results, sizeof(results));
+    COMMS_Handler_SendBinaryResponse(VAL_OK, body, sizeof(body));
+    return;
+  }
+
+  uint32_t probe_start = Profiler_Start();
+  COMMS_Handler_BeginResponse(&writer, msg_id, "bench", "copy");
+  JSON_Writer_Literal(&writer, RESP_STATUS_OK ",\"size\":");
+  JSON_Writer_Uint(&writer, size);
+  JSON_Writer_Literal(&writer, ",\"threshold\":");
+  JSON_Writer_Uint(&writer, VAL_DMA_COPY_MIN_BYTES);
+  for (uint8_t i = 0; i < 2U; i++) {
+    JSON_Writer_Char(&writer, ',');
+    JSON_Writer_String(&writer, layout_names[i]);
+    JSON_Writer_Literal(&writer, ":{\"match\":");
+    JSON_Writer_Bool(&writer, results[i].match);
+    JSON_Writer_Literal(&writer, ",\"cpu_cycles\":");
+    JSON_Writer_Uint(&writer, results[i].cpu_cycles);
+    JSON_Writer_Literal(&writer, ",\"setup_cycles\":");
+    JSON_Writer_Uint(&writer, results[i].setup_cycles);
+    JSON_Writer_Literal(&writer, ",\"irq_cycles\":");
+    JSON_Writer_Uint(&writer, results[i].irq_cycles);
+    JSON_Writer_Literal(&writer, ",\"dma_cycles\":");
+    JSON_Writer_Uint(&writer, results[i].dma_cycles);
+    JSON_Writer_Char(&writer, '}');
+  }
+
+  COMMS_Handler_EndResponse(&writer, probe_start);
+}
+
+/**
+  * @brief  Completion callback of the bench/copy DMA runs
+  * @param  context: Unused
+  * @param  status: Outcome of the copy
+  * @retval None
+  */
+static void COMMS_Handler_BenchCopyDone(void* context, VAL_Status status) {
+  bench_copy_cycles = VAL_SysClock_GetCycles();
+  bench_copy_status = status;
+  bench_copy_done = true;
+}
+
+/**
+  * @brief  Time one layout of bench/copy, both ways, keeping the shortest runs
+  * @note   The task spins on the cycle counter while the DMA runs: the
+  *         completion interrupt shows as the gap between the last reading
+  *         before the callback and the first one after it
+  * @param  offset: Byte offset of the destination from word alignment
+  * @param  size: Bytes to copy, at most BENCH_COPY_MAX_BYTES
+  * @param  result: Pointer to store the figures
+  * @retval None
+  */
+static void COMMS_Handler_BenchCopyRun(uint32_t offset, uint32_t size, COMMS_Bin_BenchCopy_t* result) {
+  uint8_t* src = bench_copy_buffer;
+  uint8_t* dest = &bench_copy_buffer[BENCH_COPY_MAX_BYTES + 4U + offset];
+
+  result->cpu_cycles = UINT32_MAX;
+  result->setup_cycles = UINT32_MAX;
+  result->irq_cycles = UINT32_MAX;
+  result->dma_cycles = UINT32_MAX;
+  result->match = 1;
+
+  for (uint32_t round = 0; round < BENCH_COPY_ROUNDS; round++) {
+    uint32_t start;
+    uint32_t elapsed;
+    uint32_t last;
+    VAL_Status status;
+
+    for (uint32_t i = 0; i < size; i++) {
+      src[i] = (uint8_t)(i * 7U + round);
+    }
+
+    memset(dest, 0, size);
+    start = VAL_SysClock_GetCycles();
+    memcpy(dest, src, size);
+    elapsed = VAL_SysClock_GetCycles() - start;
+    if (elapsed < result->cpu_cycles) {
+      result->cpu_cycles = elapsed;
+    }
+    if (memcmp(dest, src, size) != 0) {
+      result->match = 0;
+    }
+
+    memset(dest, 0, size);
+    bench_copy_done = false;
+    start = VAL_SysClock_GetCycles();
+    status = VAL_DMA_Start(dest, src, size, COMMS_Handler_BenchCopyDone, NULL);
+    last = VAL_SysClock_GetCycles();
+    elapsed = last - start;
+    if (status != VAL_OK) {
+      result->match = 0;
+      break;
+    }
+    while (!bench_copy_done) {
+      last = VAL_SysClock_GetCycles();
+    }
+
+    if (elapsed < result->setup_cycles) {
+      result->setup_cycles = elapsed;
+    }
+    elapsed = VAL_SysClock_GetCycles() - last;
+    if (elapsed < result->irq_cycles) {
+      result->irq_cycles = elapsed;
+    }
+    elapsed = bench_copy_cycles - start;
+    if (elapsed < result->dma_cycles) {
+      result->dma_cycles = elapsed;
+    }
+    if (bench_copy_status != VAL_OK || memcmp(dest, src, size) != 0) {
+      result->match = 0;
+    }
+  }
+}
+#endif
+
+/**
+  * @brief  system/set_baud command handler
+  * @note   The response goes out at the current rate before switching.
+  *         "flow" alone changes the flow control at the current rate; it
+  *         falls back with the rate if the host does not follow.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSystemSetBaud(const char* msg_id, const COMMS_Command_Args_t* args) {
+  uint32_t current = VAL_Serial_GetBaudRate();
+  uint8_t current_flow = VAL_Serial_GetFlowControl();
+  uint32_t baud = (args->found & COMMAND_ARG_BAUD) ? args->baud : current;
+  uint8_t flow = (args->found & COMMAND_ARG_FLOW) ? (args->flow ? 1U : 0U) : current_flow;
+  VAL_Status status = VAL_PARAM;
+
+  if (args->found & (COMMAND_ARG_BAUD | COMMAND_ARG_FLOW)) {
+    status = VAL_Serial_CheckBaudRate(baud);
+  }
+  /* RTS is the driver enable of the bus */
+  if (status == VAL_OK && flow && bus_mode) {
+    status = VAL_BUSY;
+  }
+
+  COMMS_Handler_SendSetBaudResponse(msg_id, status, baud, flow != 0U);
+  if (status != VAL_OK || (baud == current && flow == current_flow)) {
+    return;
+  }
+
+  if (VAL_Serial_Flush(COMMS_BAUD_FLUSH_TIMEOUT_MS) != VAL_OK ||
+      VAL_Serial_SetBaudRate(baud) != VAL_OK ||
+      VAL_Serial_SetFlowControl(flow) != VAL_OK) {
+    /* Stay on, or return to, the settings the host is listening with */
+    VAL_Serial_SetFlowControl(current_flow);
+    VAL_Serial_SetBaudRate(current);
+    return;
+  }
+
+  /* Chained switches fall back to the last confirmed settings */
+  if (link_fallback_baud == 0) {
+    link_fallback_baud = current;
+    link_fallback_flow = current_flow;
+  }
+  link_switch_tick = xTaskGetTickCount();
+}
+
+/**
+  * @brief  light/get command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightGet(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendLightIntensityResponse(msg_id, args->id);
+}
+
+/**
+  * @brief  light/get_all command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightGetAll(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendLightIntensityResponse(msg_id, 0);
+}
+
+/**
+  * @brief  light/set command handler
+  * @note   With "group" in place of "id", all lights of the group change in
+  *         the same PWM period
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightSet(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_ERROR;
+
+  /* Set light intensity if parameters are valid */
+  if ((args->found & (COMMAND_ARG_GROUP | COMMAND_ARG_INTENSITY)) ==
+      (COMMAND_ARG_GROUP | COMMAND_ARG_INTENSITY)) {
+    status = SYS_Coordinator_SetGroupIntensity(args->group, args->intensity);
+  } else if ((args->found & (COMMAND_ARG_ID | COMMAND_ARG_INTENSITY)) ==
+             (COMMAND_ARG_ID | COMMAND_ARG_INTENSITY)) {
+    status = SYS_Coordinator_SetLightIntensity(args->id, args->intensity);
+  }
+
+  COMMS_Handler_SendSetLightResponse(msg_id, status);
+}
+
+/**
+  * @brief  light/set_all command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightSetAll(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_ERROR;
+  uint8_t intensities[VAL_LIGHT_COUNT];
+
+  /* Set all light intensities if parameters are valid */
+  if (args->found & COMMAND_ARG_INTENSITIES) {
+    memcpy(intensities, args->intensities, sizeof(intensities));
+    status = SYS_Coordinator_SetAllLightIntensities(intensities);
+  }
+
+  COMMS_Handler_SendSetAllLightsResponse(msg_id, status);
+}
+
+/**
+  * @brief  light/get_permille command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightGetPermille(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendLightPermilleResponse(msg_id, args->id);
+}
+
+/**
+  * @brief  light/get_all_permille command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightGetAllPermille(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendLightPermilleResponse(msg_id, 0);
+}
+
+/**
+  * @brief  light/set_permille command handler
+  * @note   "group" can take the place of "id", as for light/set
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightSetPermille(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_ERROR;
+
+  if ((args->found & (COMMAND_ARG_GROUP | COMMAND_ARG_PERMILLE)) ==
+      (COMMAND_ARG_GROUP | COMMAND_ARG_PERMILLE)) {
+    status = SYS_Coordinator_SetGroupPermille(args->group, args->permille);
+  } else if ((args->found & (COMMAND_ARG_ID | COMMAND_ARG_PERMILLE)) ==
+             (COMMAND_ARG_ID | COMMAND_ARG_PERMILLE)) {
+    status = SYS_Coordinator_SetLightPermille(args->id, args->permille);
+  }
+
+  COMMS_Handler_SendSetPermilleResponse(msg_id, "set_permille", status);
+}
+
+/**
+  * @brief  light/set_current command handler
+  * @note   Regulates the light to "current" mA until the next intensity
+  *         command on it
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightSetCurrent(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_ERROR;
+
+  if ((args->found & (COMMAND_ARG_ID | COMMAND_ARG_CURRENT)) ==
+      (COMMAND_ARG_ID | COMMAND_ARG_CURRENT)) {
+    status = SYS_Coordinator_SetLightCurrent(args->id, args->current);
+  }
+
+  COMMS_Handler_SendSetPermilleResponse(msg_id, "set_current", status);
+}
+
+/**
+  * @brief  light/stage command handler
+  * @note   Holds "permilles" until light/commit, or with "sync":true a
+  *         rising edge on the sync line; the lights keep their intensities
+  *         meanwhile. Sent to the broadcast address, it stages all devices.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightStage(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_ERROR;
+
+  if (args->found & COMMAND_ARG_PERMILLES) {
+    status = SYS_Coordinator_StageLights(args->permilles, args->sync);
+  }
+
+  COMMS_Handler_SendSetPermilleResponse(msg_id, "stage", status);
+}
+
+/**
+  * @brief  light/commit command handler
+  * @note   Applies the staged intensities from a new PWM period. Sent to the
+  *         broadcast address, all devices switch on the same frame.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightCommit(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = SYS_Coordinator_CommitLights();
+
+  if (status == VAL_ERROR && !reply.binary) {
+    COMMS_Handler_SendErrorResponse(msg_id, "light", "commit", "Nothing staged");
+    return;
+  }
+
+  COMMS_Handler_SendSetPermilleResponse(msg_id, "commit", status);
+}
+
+/**
+  * @brief  light/set_all_permille command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightSetAllPermille(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_ERROR;
+
+  if (args->found & COMMAND_ARG_PERMILLES) {
+    status = SYS_Coordinator_SetAllLightPermille(args->permilles);
+  }
+
+  COMMS_Handler_SendSetPermilleResponse(msg_id, "set_all_permille", status);
+}
+
+/**
+  * @brief  light/set_mask command handler
+  * @note   Sets only the lights in "mask" from the packed "values", all in
+  *         the same PWM period; the others keep their outputs
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightSetMask(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_ERROR;
+  uint32_t required = COMMAND_ARG_MASK | COMMAND_ARG_VALUES;
+
+  if ((args->found & required) == required) {
+    status = SYS_Coordinator_SetMaskedLightPermille(args->mask, args->values, args->value_count);
+  }
+
+  COMMS_Handler_SendSetPermilleResponse(msg_id, "set_mask", status);
+}
+
+/**
+  * @brief  light/set_color command handler
+  * @note   Mixes the white of "cct" kelvin, off the locus by "tint", or
+  *         without "cct" (or 0) the chromaticity "x", "y", with the brightest light at
+  *         "permille" (default 1000), and sets all lights at once
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightSetColor(const char* msg_id, const COMMS_Command_Args_t* args) {
+  uint16_t permille[VAL_LIGHT_COUNT] = {0};
+  uint16_t level = (args->found & COMMAND_ARG_PERMILLE) ? args->permille : VAL_PWM_PERMILLE_MAX;
+  VAL_Status status = VAL_PARAM;
+
+  if ((args->found & COMMAND_ARG_CCT) && args->cct != 0) {
+    status = Color_MixCct(args->cct, (args->found & COMMAND_ARG_TINT) ? args->tint : 0, level, permille);
+  } else if ((args->found & (COMMAND_ARG_X | COMMAND_ARG_Y)) == (COMMAND_ARG_X | COMMAND_ARG_Y)) {
+    status = Color_MixXy(args->x, args->y, level, permille);
+  }
+
+  if (status == VAL_OK) {
+    status = SYS_Coordinator_SetAllLightPermille(permille);
+  }
+
+  COMMS_Handler_SendSetColorResponse(msg_id, status, permille);
+}
+
+/**
+  * @brief  light/effect command handler
+  * @note   Modulates the lights with "effect" every "period" us, from their
+  *         "permilles" (default the present intensities) down by "depth"
+  *         permille of each (default 1000, to off) and back; "width" is the
+  *         on-time of a square wave (default half the period). Runs until
+  *         "off" or any other light command, "off" leaves the lights where
+  *         the effect had them. With "group" only its lights are modulated,
+  *         the others hold their intensities.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightEffect(const char* msg_id, const COMMS_Command_Args_t* args) {
+  Effect_Config_t effect = {0};
+  uint16_t permille[VAL_LIGHT_COUNT];
+  uint32_t mask = CONFIG_LIGHTS_ALL;
+  VAL_Status status = VAL_PARAM;
+
+  if ((args->found & COMMAND_ARG_EFFECT) && args->effect < COMMS_EFFECT_COUNT) {
+    effect.shape = (Effect_Shape_t)args->effect;
+    effect.period_us = (args->found & COMMAND_ARG_PERIOD) ? args->period : 0;
+    effect.width_us = (args->found & COMMAND_ARG_WIDTH) ? args->width : 0;
+    effect.depth_permille = (args->found & COMMAND_ARG_DEPTH) ? args->depth : EFFECT_UNITY;
+
+    if (args->found & COMMAND_ARG_PERMILLES) {
+      memcpy(permille, args->permilles, sizeof(permille));
+      status = VAL_OK;
+    } else {
+      status = SYS_Coordinator_GetAllLightPermille(permille);
+    }
+
+    if (status == VAL_OK && (args->found & COMMAND_ARG_GROUP)) {
+      status = SYS_Coordinator_GetLightGroup(args->group, &mask);
+    }
+
+    if (status == VAL_OK) {
+      for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        if (!(mask & (1UL << i))) {
+          permille[i] = LED_DRIVER_PERMILLE_HOLD;
+        }
+      }
+      status = SYS_Coordinator_StartEffect(permille, &effect);
+    }
+  }
+
+  COMMS_Handler_SendEffectResponse(msg_id, status);
+}
+
+/**
+  * @brief  light/strobe command handler
+  * @note   Fires all lights at "permilles" for "width" microseconds every
+  *         "period" microseconds, timed by hardware; strobe/status reports
+  *         the pulses and strobe/stop or any other light command ends it
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightStrobe(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_PARAM;
+  uint32_t required = COMMAND_ARG_PERMILLES | COMMAND_ARG_PERIOD | COMMAND_ARG_WIDTH;
+
+  if ((args->found & required) == required && args->period != 0) {
+    status = SYS_Coordinator_StartStrobe(args->width, args->period, args->permilles, false);
+  }
+
+  COMMS_Handler_SendStrobeStatusResponse(msg_id, "light", "strobe", status);
+}
+
+/**
+  * @brief  light/set_pwm_freq command handler
+  * @note   Moves the PWM to "frequency" Hz with the intensities kept, e.g.
+  *         away from a camera's line rate, and/or switches dithering with
+  *         "dither"; the response reports the frequency reached with whole
+  *         timer counts
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightSetPwmFreq(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_PARAM;
+
+  if (args->found & COMMAND_ARG_FREQUENCY) {
+    status = SYS_Coordinator_SetPwmFrequency(args->frequency);
+  }
+  if ((args->found & COMMAND_ARG_DITHER) && (status == VAL_OK || (args->found & COMMAND_ARG_FREQUENCY) == 0)) {
+    status = SYS_Coordinator_SetDither(args->dither);
+  }
+
+  COMMS_Handler_SendSetPwmFreqResponse(msg_id, status);
+}
+
+/**
+  * @brief  light/fade command handler
+  * @note   The curve defaults to linear. With "group" in place of "id" its
+  *         lights fade together.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightFade(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_ERROR;
+  uint64_t required = COMMAND_ARG_PERMILLE | COMMAND_ARG_DURATION;
+
+  if ((args->found & required) == required && (args->found & (COMMAND_ARG_ID | COMMAND_ARG_GROUP))) {
+    LED_Driver_FadeCurve_t curve = LED_DRIVER_FADE_CURVE_COUNT;
+
+    if (!(args->found & COMMAND_ARG_CURVE) || args->curve == COMMS_CURVE_LINEAR) {
+      curve = LED_DRIVER_FADE_LINEAR;
+    } else if (args->curve == COMMS_CURVE_EASE) {
+      curve = LED_DRIVER_FADE_EASE;
+    } else if (args->curve == COMMS_CURVE_PERCEPTUAL) {
+      curve = LED_DRIVER_FADE_PERCEPTUAL;
+    }
+
+    if (args->found & COMMAND_ARG_GROUP) {
+      uint32_t mask;
+
+      status = SYS_Coordinator_GetLightGroup(args->group, &mask);
+      if (status == VAL_OK) {
+        status = SYS_Coordinator_FadeMaskedLights(mask, args->permille, args->duration, curve);
+      }
+    } else {
+      status = SYS_Coordinator_FadeLight(args->id, args->permille, args->duration, curve);
+    }
+  }
+
+  COMMS_Handler_SendSetPermilleResponse(msg_id, "fade", status);
+}
+
+/**
+  * @brief  light/set_curve command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdLightSetCurve(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_ERROR;
+
+  if ((args->found & (COMMAND_ARG_ID | COMMAND_ARG_CURVE)) == (COMMAND_ARG_ID | COMMAND_ARG_CURVE)) {
+    if (args->curve == COMMS_CURVE_LINEAR) {
+      status = SYS_Coordinator_SetLightCurve(args->id, LED_DRIVER_CURVE_LINEAR);
+    } else if (args->curve == COMMS_CURVE_GAMMA) {
+      status = SYS_Coordinator_SetLightCurve(args->id, LED_DRIVER_CURVE_GAMMA);
+    }
+  }
+
+  COMMS_Handler_SendSetPermilleResponse(msg_id, "set_curve", status);
+}
+
+/**
+  * @brief  status/get_sensors command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdStatusGetSensors(const char* msg_id, const COMMS_Command_Args_t* args) {
+  if (args->id >= 1 && args->id <= VAL_LIGHT_COUNT) {
+    /* Send sensor data response for specific light */
+    COMMS_Handler_SendSensorDataResponse(msg_id, args->id);
+  } else {
+    /* Invalid light ID */
+    COMMS_Handler_SendErrorResponse(msg_id, "status", "get_sensors", "Invalid light ID");
+  }
+}
+
+/**
+  * @brief  status/get_all_sensors command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdStatusGetAllSensors(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendAllSensorDataResponse(msg_id);
+}
+
+/**
+  * @brief  status/get_stats command handler
+  * @note   "reset" starts the statistics over once they are read
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdStatusGetStats(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendStatsResponse(msg_id, (args->found & COMMAND_ARG_RESET) != 0);
+}
+
+/**
+  * @brief  status/get_usage command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdStatusGetUsage(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendUsageResponse(msg_id);
+}
+
+/**
+  * @brief  status/get_flicker command handler
+  * @note   "scans" sets the window and starts the measurement over
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdStatusGetFlicker(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_OK;
+
+  if (args->found & COMMAND_ARG_SCANS) {
+    status = SYS_Coordinator_SetFlickerWindow(args->scans);
+  }
+
+  COMMS_Handler_SendFlickerResponse(msg_id, status);
+}
+
+/**
+  * @brief  status/set_stats_window command handler
+  * @note   "scans" per window, 0 to cover all scans until a reset
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdStatusSetStatsWindow(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_PARAM;
+
+  if (args->found & COMMAND_ARG_SCANS) {
+    status = VAL_Analog_SetStatsWindow(args->scans);
+  }
+
+  COMMS_Handler_SendStatsWindowResponse(msg_id, status, args->scans);
+}
+
+/**
+  * @brief  status/block_scans command handler
+  * @note   "scans" per ADC block, left out to only read it; sampling
+  *         restarts when it changes
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdStatusBlockScans(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_OK;
+
+  if (args->found & COMMAND_ARG_SCANS) {
+    status = (args->scans <= UINT8_MAX) ? VAL_Analog_SetBlockScans((uint8_t)args->scans) : VAL_PARAM;
+  }
+
+  COMMS_Handler_SendBlockScansResponse(msg_id, status);
+}
+
+/**
+  * @brief  alarm/clear command handler
+  * @note   "lights" clears a set of lights in one go, "id" one light or
+  *         all of them with 0. Every light is checked against the same
+  *         alarm state and the response reports each one.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdAlarmClear(const char* msg_id, const COMMS_Command_Args_t* args) {
+  uint32_t mask;
+  uint32_t failed = 0;
+
+  if (args->found & COMMAND_ARG_LIGHTS) {
+    mask = args->lights;
+  } else if ((args->found & COMMAND_ARG_ID) && args->id == 0) {
+    mask = (1UL << VAL_LIGHT_COUNT) - 1U;
+  } else if ((args->found & COMMAND_ARG_ID) && args->id <= VAL_LIGHT_COUNT) {
+    mask = 1UL << (args->id - 1);
+  } else {
+    mask = 0;
+  }
+
+  if (mask == 0 || (mask >> VAL_LIGHT_COUNT) != 0) {
+    COMMS_Handler_SendErrorResponse(msg_id, "alarm", "clear", "Invalid parameters");
+    return;
+  }
+
+  VAL_Status status = SYS_Coordinator_ClearLightAlarms(mask, &failed);
+  COMMS_Handler_SendAlarmClearResponse(msg_id, (uint8_t)mask, (uint8_t)failed, status);
+}
+
+/**
+  * @brief  alarm/status command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdAlarmStatus(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendAlarmStatusResponse(msg_id);
+}
+
+/**
+  * @brief  alarm/history command handler
+  * @note   "from" skips that many matching entries, newest first; "since"
+  *         and "until" keep the entries logged in that range of
+  *         milliseconds after their start-up
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdAlarmHistory(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendAlarmHistoryResponse(msg_id, args);
+}
+
+/**
+  * @brief  alarm/recording command handler
+  * @note   "reset" arms the recorder again once the recording is reported,
+  *         also after a host capture took the buffer
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdAlarmRecording(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendRecordingResponse(msg_id);
+  if (args->found & COMMAND_ARG_RESET) {
+    (void)Recorder_Arm();
+  }
+}
+
+/**
+  * @brief  alarm/blackout command handler
+  * @note   A binary frame had the outputs cut in the RX interrupt already;
+  *         this stops the sequence, a strobe, fades and effects for good
+  *         and sets every light to 0 through the coordinator
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdAlarmBlackout(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendBlackoutResponse(msg_id, SYS_Coordinator_Blackout());
+}
+
+/**
+  * @brief  telemetry/subscribe command handler
+  * @note   Without a "stream" the subscription is stream 1. Samples are
+  *         sent in the format of this command, whatever the host uses later.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdTelemetrySubscribe(const char* msg_id, const COMMS_Command_Args_t* args) {
+  uint8_t stream = (args->found & COMMAND_ARG_STREAM) ? args->stream : 1U;
+  /* Without a field list all fields are streamed */
+  uint8_t fields = (args->found & COMMAND_ARG_FIELDS) ? args->fields : COMMS_TELEMETRY_ALL;
+  VAL_Status status = VAL_PARAM;
+  SYS_Coordinator_OnChange_t on_change = { true, 0, 0, 0 };
+  bool report_on_change = (args->found & COMMAND_ARG_ON_CHANGE) != 0;
+
+  /* Any report-on-change key selects the mode; the others default to 0 */
+  if (report_on_change) {
+    on_change.current_ma = args->on_change_values[0];
+    on_change.temperature_cdeg = args->on_change_values[1];
+    on_change.heartbeat_ms = (args->on_change_values[2] < 0) ? UINT32_MAX :
+                             (uint32_t)args->on_change_values[2];
+  }
+
+  if ((args->found & COMMAND_ARG_RATE) && args->rate > 0 && fields != 0 &&
+      stream >= 1U && stream <= COMMS_TELEMETRY_STREAMS) {
+    /* Set first, the coordinator task may serve the stream right away */
+    telemetry_binary[stream - 1] = reply.binary;
+    status = SYS_Coordinator_SetTelemetry(stream, args->rate, fields, report_on_change ? &on_change : NULL);
+  }
+
+  COMMS_Handler_SendTelemetryResponse(msg_id, "subscribe", status, stream, args->rate, fields);
+}
+
+/**
+  * @brief  telemetry/unsubscribe command handler
+  * @note   Without a "stream" all streams stop
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdTelemetryUnsubscribe(const char* msg_id, const COMMS_Command_Args_t* args) {
+  uint8_t stream = (args->found & COMMAND_ARG_STREAM) ? args->stream : 0U;
+  VAL_Status status = VAL_OK;
+
+  if (stream != 0) {
+    status = SYS_Coordinator_SetTelemetry(stream, 0, 0, NULL);
+  } else {
+    for (uint8_t i = 1; i <= COMMS_TELEMETRY_STREAMS && status == VAL_OK; i++) {
+      status = SYS_Coordinator_SetTelemetry(i, 0, 0, NULL);
+    }
+  }
+
+  COMMS_Handler_SendTelemetryResponse(msg_id, "unsubscribe", status, stream, 0, 0);
+}
+
+/**
+  * @brief  config/get command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigGet(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendConfigResponse(msg_id);
+}
+
+/**
+  * @brief  config/set command handler, run in place inside a batch
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigSet(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSetConfigResponse(msg_id, COMMS_Handler_WorkConfigSet(args));
+}
+
+/**
+  * @brief  Apply and store new settings for config/set
+  * @note   Runs in the worker task outside a batch, as storing may erase
+  *         flash. Limits apply to the light given by "id", or to all lights
+  *         when it is 0 or absent. Keys left out keep their present value.
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_SetConfig, VAL_PARAM for invalid arguments
+  */
+static VAL_Status COMMS_Handler_WorkConfigSet(const COMMS_Command_Args_t* args) {
+  Config_Settings_t settings;
+  uint8_t first = 0;
+  uint8_t last = VAL_LIGHT_COUNT - 1;
+  uint8_t keys = args->config_keys;
+  VAL_Status status;
+
+  if (!(args->found & COMMAND_ARG_CONFIG) || keys == 0 ||
+      ((args->found & COMMAND_ARG_ID) && args->id > VAL_LIGHT_COUNT)) {
+    return VAL_PARAM;
+  }
+
+  if ((args->found & COMMAND_ARG_ID) && args->id != 0) {
+    first = last = args->id - 1;
+  }
+
+  status = SYS_Coordinator_GetConfig(&settings);
+  if (status == VAL_OK) {
+    for (uint8_t i = first; i <= last; i++) {
+      LED_Driver_Limits_t* limits = &settings.limits[i];
+
+      if (keys & COMMS_CONFIG_CURRENT_WARN) {
+        limits->current_warn_ma = args->config_values[0];
+      }
+      if (keys & COMMS_CONFIG_CURRENT_MAX) {
+        limits->current_max_ma = args->config_values[1];
+      }
+      if (keys & COMMS_CONFIG_CURRENT_TRIP) {
+        limits->current_trip_ma = args->config_values[2];
+      }
+      if (keys & COMMS_CONFIG_TEMPERATURE_WARN) {
+        limits->temperature_warn_cdeg = args->config_values[3];
+      }
+      if (keys & COMMS_CONFIG_TEMPERATURE_MAX) {
+        limits->temperature_max_cdeg = args->config_values[4];
+      }
+    }
+
+    /* Out-of-range scales are passed on as 0 and rejected */
+    if (keys & COMMS_CONFIG_CURRENT_SCALE) {
+      int32_t scale = args->config_values[5];
+      settings.current_ma_per_mv = (scale < 0 || scale > UINT16_MAX) ? 0 : (uint16_t)scale;
+    }
+    if (keys & COMMS_CONFIG_TEMPERATURE_SCALE) {
+      int32_t scale = args->config_values[6];
+      settings.temperature_cdeg_per_mv = (scale < 0 || scale > UINT16_MAX) ? 0 : (uint16_t)scale;
+    }
+
+    /* Out-of-range phases are passed on as UINT16_MAX and rejected */
+    if (keys & COMMS_CONFIG_SAMPLE_PHASE) {
+      int32_t phase = args->config_values[7];
+      settings.sample_phase_permille = (phase < 0 || phase > UINT16_MAX) ? UINT16_MAX : (uint16_t)phase;
+    }
+
+    status = SYS_Coordinator_SetConfig(&settings);
+  }
+
+  return status;
+}
+
+/**
+  * @brief  config/get_calibration command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigGetCalibration(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendCalibrationResponse(msg_id, (args->found & COMMAND_ARG_ID) ? args->id : 0);
+}
+
+/**
+  * @brief  config/set_calibration command handler, run in place inside a batch
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigSetCalibration(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSetCalibrationResponse(msg_id, COMMS_Handler_WorkConfigSetCalibration(args));
+}
+
+/**
+  * @brief  Apply and store a new sensor calibration for config/set_calibration
+  * @note   Runs in the worker task outside a batch, as storing may erase
+  *         flash. Replaces the whole calibration of light "id"; keys left out
+  *         take their default and a missing "points" selects the linear scale.
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_SetCalibration, VAL_PARAM for invalid arguments
+  */
+static VAL_Status COMMS_Handler_WorkConfigSetCalibration(const COMMS_Command_Args_t* args) {
+  AnalogCalibration calibration = {
+    ANALOG_CAL_GAIN_UNITY, 0, ANALOG_CAL_GAIN_UNITY, 0, 0, {{0}}
+  };
+  uint8_t keys = args->calibration_keys;
+
+  if (!(args->found & COMMAND_ARG_ID) ||
+      ((args->found & COMMAND_ARG_POINTS) && (args->point_values % 2) != 0)) {
+    return VAL_PARAM;
+  }
+
+  /* Out-of-range gains are passed on as 0 and offsets as the nearest limit */
+  if (keys & COMMS_CALIBRATION_CURRENT_GAIN) {
+    int32_t gain = args->calibration_values[0];
+    calibration.current_gain = (gain < 0 || gain > UINT16_MAX) ? 0 : (uint16_t)gain;
+  }
+  if (keys & COMMS_CALIBRATION_CURRENT_OFFSET) {
+    int32_t offset = args->calibration_values[1];
+    calibration.current_offset_ma = (offset < INT16_MIN) ? INT16_MIN :
+                                    (offset > INT16_MAX) ? INT16_MAX : (int16_t)offset;
+  }
+  if (keys & COMMS_CALIBRATION_TEMPERATURE_GAIN) {
+    int32_t gain = args->calibration_values[2];
+    calibration.temperature_gain = (gain < 0 || gain > UINT16_MAX) ? 0 : (uint16_t)gain;
+  }
+  if (keys & COMMS_CALIBRATION_TEMPERATURE_OFFSET) {
+    int32_t offset = args->calibration_values[3];
+    calibration.temperature_offset_cdeg = (offset < INT16_MIN) ? INT16_MIN :
+                                          (offset > INT16_MAX) ? INT16_MAX : (int16_t)offset;
+  }
+
+  if (args->found & COMMAND_ARG_POINTS) {
+    calibration.point_count = args->point_values / 2;
+    memcpy(calibration.points, args->points, calibration.point_count * sizeof(AnalogCalPoint));
+  }
+
+  return SYS_Coordinator_SetCalibration(args->id, &calibration);
+}
+
+/**
+  * @brief  config/set_address command handler
+  * @note   Refused inside a batch, see COMMS_Handler_RunBatch
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigSetAddress(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSetAddressResponse(msg_id, COMMS_Handler_WorkConfigSetAddress(args));
+}
+
+/**
+  * @brief  Store a new device address and link kind for config/set_address
+  * @note   Runs in the worker task outside a batch, as storing may erase
+  *         flash. The link switches once the response is sent. A value left
+  *         out keeps its present setting.
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_SetConfig, VAL_PARAM for invalid arguments
+  */
+static VAL_Status COMMS_Handler_WorkConfigSetAddress(const COMMS_Command_Args_t* args) {
+  Config_Settings_t settings;
+  VAL_Status status;
+
+  if (!(args->found & (COMMAND_ARG_ADDRESS | COMMAND_ARG_BUS))) {
+    return VAL_PARAM;
+  }
+
+  status = SYS_Coordinator_GetConfig(&settings);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* The broadcast address is past CONFIG_ADDRESS_MAX and rejected */
+  if (args->found & COMMAND_ARG_ADDRESS) {
+    settings.address = args->address;
+  }
+  if (args->found & COMMAND_ARG_BUS) {
+    settings.bus = args->bus ? 1U : 0U;
+  }
+
+  return SYS_Coordinator_SetConfig(&settings);
+}
+
+/**
+  * @brief  config/set_failsafe command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigSetFailsafe(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSetFailsafeResponse(msg_id, COMMS_Handler_WorkConfigSetFailsafe(args));
+}
+
+/**
+  * @brief  Store a new failsafe timeout and scene for config/set_failsafe
+  * @note   Runs in the worker task outside a batch, as storing may erase
+  *         flash. A value left out keeps its present setting; the scene
+  *         need not be saved yet, all lights go off until it is.
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_SetConfig, VAL_PARAM for invalid arguments
+  */
+static VAL_Status COMMS_Handler_WorkConfigSetFailsafe(const COMMS_Command_Args_t* args) {
+  Config_Settings_t settings;
+  VAL_Status status;
+
+  if (!(args->found & (COMMAND_ARG_TIMEOUT | COMMAND_ARG_SCENE))) {
+    return VAL_PARAM;
+  }
+  if ((args->found & COMMAND_ARG_TIMEOUT) && args->timeout > UINT16_MAX) {
+    return VAL_PARAM;
+  }
+
+  status = SYS_Coordinator_GetConfig(&settings);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  if (args->found & COMMAND_ARG_TIMEOUT) {
+    settings.failsafe_ms = (uint16_t)args->timeout;
+  }
+  if (args->found & COMMAND_ARG_SCENE) {
+    settings.failsafe_scene = args->scene;
+  }
+
+  /* Also applied when storing failed, only staged until config/commit */
+  status = SYS_Coordinator_SetConfig(&settings);
+  if (status != VAL_PARAM && !SYS_Coordinator_IsConfigStaged()) {
+    COMMS_Handler_SetFailsafe(settings.failsafe_ms, settings.failsafe_scene);
+  }
+
+  return status;
+}
+
+/**
+  * @brief  config/set_slew command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigSetSlew(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSetSlewResponse(msg_id, COMMS_Handler_WorkConfigSetSlew(args));
+}
+
+/**
+  * @brief  Store a new PWM slew limit for config/set_slew
+  * @note   Runs in the worker task outside a batch, as storing may erase
+  *         flash. The limit applies to the light given by "id", or to all
+  *         lights when it is 0 or absent; 0 turns slewing off.
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_SetConfig, VAL_PARAM for invalid arguments
+  */
+static VAL_Status COMMS_Handler_WorkConfigSetSlew(const COMMS_Command_Args_t* args) {
+  Config_Settings_t settings;
+  uint8_t first = 0;
+  uint8_t last = VAL_LIGHT_COUNT - 1;
+  VAL_Status status;
+
+  if (!(args->found & COMMAND_ARG_SLEW) || args->slew > VAL_PWM_SLEW_MAX ||
+      ((args->found & COMMAND_ARG_ID) && args->id > VAL_LIGHT_COUNT)) {
+    return VAL_PARAM;
+  }
+
+  if ((args->found & COMMAND_ARG_ID) && args->id != 0) {
+    first = last = args->id - 1;
+  }
+
+  status = SYS_Coordinator_GetConfig(&settings);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  for (uint8_t i = first; i <= last; i++) {
+    settings.slew_permille_per_ms[i] = args->slew;
+  }
+
+  return SYS_Coordinator_SetConfig(&settings);
+}
+
+/**
+  * @brief  config/set_ageing command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigSetAgeing(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSetAgeingResponse(msg_id, COMMS_Handler_WorkConfigSetAgeing(args));
+}
+
+/**
+  * @brief  Store a new ageing curve for config/set_ageing
+  * @note   Runs in the worker task outside a batch, as storing may erase
+  *         flash. The curve applies to the light given by "id", or to all
+  *         lights when it is 0 or absent. "hours" of 0 turns the
+  *         compensation off; otherwise "ageing" gives the output left at
+  *         each point, and points left out repeat the last one given.
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_SetConfig, VAL_PARAM for invalid arguments
+  */
+static VAL_Status COMMS_Handler_WorkConfigSetAgeing(const COMMS_Command_Args_t* args) {
+  Config_Settings_t settings;
+  LED_Driver_Ageing_t curve;
+  uint8_t first = 0;
+  uint8_t last = VAL_LIGHT_COUNT - 1;
+  VAL_Status status;
+
+  if (!(args->found & COMMAND_ARG_HOURS) || ((args->found & COMMAND_ARG_ID) && args->id > VAL_LIGHT_COUNT) ||
+      (args->hours != 0 && (args->ageing_count == 0 || args->ageing_count > LED_DRIVER_AGEING_POINTS))) {
+    return VAL_PARAM;
+  }
+
+  if ((args->found & COMMAND_ARG_ID) && args->id != 0) {
+    first = last = args->id - 1;
+  }
+
+  memset(&curve, 0, sizeof(curve));
+  if (args->hours != 0) {
+    curve.step_hours = args->hours;
+    for (uint8_t n = 0; n < LED_DRIVER_AGEING_POINTS; n++) {
+      curve.output_permille[n] = args->ageing[(n < args->ageing_count) ? n : args->ageing_count - 1];
+    }
+  }
+
+  status = SYS_Coordinator_GetConfig(&settings);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  for (uint8_t i = first; i <= last; i++) {
+    settings.ageing[i] = curve;
+  }
+
+  return SYS_Coordinator_SetConfig(&settings);
+}
+
+/**
+  * @brief  config/set_trim command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigSetTrim(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSetTrimResponse(msg_id, COMMS_Handler_WorkConfigSetTrim(args));
+}
+
+/**
+  * @brief  Store new output trims for config/set_trim
+  * @note   Runs in the worker task outside a batch, as storing may erase
+  *         flash. Sets only the lights in "mask" from the packed "values";
+  *         the others keep their trims.
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_SetConfig, VAL_PARAM for invalid arguments
+  */
+static VAL_Status COMMS_Handler_WorkConfigSetTrim(const COMMS_Command_Args_t* args) {
+  Config_Settings_t settings;
+  uint32_t required = COMMAND_ARG_MASK | COMMAND_ARG_VALUES;
+  uint8_t used = 0;
+  VAL_Status status;
+
+  if ((args->found & required) != required || args->mask == 0 || (args->mask & ~CONFIG_LIGHTS_ALL) != 0 ||
+      args->value_count != (uint8_t)__builtin_popcount(args->mask)) {
+    return VAL_PARAM;
+  }
+
+  status = SYS_Coordinator_GetConfig(&settings);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (args->mask & (1U << i)) {
+      settings.trim_permille[i] = args->values[used++];
+    }
+  }
+
+  return SYS_Coordinator_SetConfig(&settings);
+}
+
+/**
+  * @brief  config/set_primary command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigSetPrimary(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSetPrimaryResponse(msg_id, COMMS_Handler_WorkConfigSetPrimary(args));
+}
+
+/**
+  * @brief  Store the measured colour of a light for config/set_primary
+  * @note   Runs in the worker task outside a batch, as storing may erase
+  *         flash. "x", "y" and "flux" replace those of light "id"; the ones
+  *         left out are kept.
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_SetConfig, VAL_PARAM for invalid arguments
+  */
+static VAL_Status COMMS_Handler_WorkConfigSetPrimary(const COMMS_Command_Args_t* args) {
+  Config_Settings_t settings;
+  Color_Primary_t* primary;
+  VAL_Status status;
+
+  if (!(args->found & COMMAND_ARG_ID) || args->id < 1 || args->id > VAL_LIGHT_COUNT) {
+    return VAL_PARAM;
+  }
+
+  status = SYS_Coordinator_GetConfig(&settings);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  primary = &settings.primaries[args->id - 1];
+  if (args->found & COMMAND_ARG_X) {
+    primary->x = args->x;
+  }
+  if (args->found & COMMAND_ARG_Y) {
+    primary->y = args->y;
+  }
+  if (args->found & COMMAND_ARG_FLUX) {
+    primary->flux_lm = args->flux;
+  }
+
+  /* Refused by Config_Apply if the primaries span no gamut */
+  return SYS_Coordinator_SetConfig(&settings);
+}
+
+/**
+  * @brief  config/get_groups command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigGetGroups(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendGroupsResponse(msg_id, "get_groups", VAL_OK);
+}
+
+/**
+  * @brief  config/set_groups command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigSetGroups(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSetGroupsResponse(msg_id, COMMS_Handler_WorkConfigSetGroups(args));
+}
+
+/**
+  * @brief  Store a light group and the bus groups joined for config/set_groups
+  * @note   Runs in the worker task outside a batch, as storing may erase
+  *         flash. "mask" becomes the lights of light "group", 0 empties it;
+  *         "bus_groups" replaces the multicast groups the device answers to.
+  *         Either may be left out.
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_SetConfig, VAL_PARAM for invalid arguments
+  */
+static VAL_Status COMMS_Handler_WorkConfigSetGroups(const COMMS_Command_Args_t* args) {
+  Config_Settings_t settings;
+  VAL_Status status;
+  /* A binary group 0 only carries the arguments through to "bus_groups" */
+  bool set_group = (args->found & (COMMAND_ARG_GROUP | COMMAND_ARG_MASK)) == (COMMAND_ARG_GROUP | COMMAND_ARG_MASK) &&
+                   args->group != 0;
+
+  if (!set_group && !(args->found & COMMAND_ARG_BUS_GROUPS)) {
+    return VAL_PARAM;
+  }
+  if (set_group && (args->group > CONFIG_LIGHT_GROUPS || args->mask > UINT8_MAX)) {
+    return VAL_PARAM;
+  }
+
+  status = SYS_Coordinator_GetConfig(&settings);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  if (set_group) {
+    settings.light_groups[args->group - 1] = (uint8_t)args->mask;
+  }
+  if (args->found & COMMAND_ARG_BUS_GROUPS) {
+    settings.bus_groups = args->bus_groups;
+  }
+
+  /* Also applied when storing failed, only staged until config/commit */
+  status = SYS_Coordinator_SetConfig(&settings);
+  if (status != VAL_PARAM && !SYS_Coordinator_IsConfigStaged()) {
+    COMMS_Handler_SetBusGroups(settings.bus_groups);
+  }
+
+  return status;
+}
+
+/**
+  * @brief  config/set_power_on command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigSetPowerOn(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSetPowerOnResponse(msg_id, COMMS_Handler_WorkConfigSetPowerOn(args));
+}
+
+/**
+  * @brief  Store what the lights come up with for config/set_power_on
+  * @note   Runs in the worker task outside a batch, as storing may erase
+  *         flash. A "scene" other than 0 selects that scene, else "enable"
+  *         selects the last intensities (true) or all off (false). The scene
+  *         need not be saved yet, all lights come up off until it is.
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_SetConfig, VAL_PARAM for invalid arguments
+  */
+static VAL_Status COMMS_Handler_WorkConfigSetPowerOn(const COMMS_Command_Args_t* args) {
+  Config_Settings_t settings;
+  VAL_Status status;
+
+  if (!(args->found & (COMMAND_ARG_SCENE | COMMAND_ARG_ENABLE))) {
+    return VAL_PARAM;
+  }
+
+  status = SYS_Coordinator_GetConfig(&settings);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  if ((args->found & COMMAND_ARG_SCENE) && args->scene != 0) {
+    settings.power_on = RESTORE_SCENE;
+    settings.power_on_scene = args->scene;
+  } else {
+    settings.power_on = ((args->found & COMMAND_ARG_ENABLE) && args->enable) ? RESTORE_LAST : RESTORE_OFF;
+    settings.power_on_scene = 0;
+  }
+
+  return SYS_Coordinator_SetConfig(&settings);
+}
+
+/**
+  * @brief  config/set_stop_mode command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigSetStopMode(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSetStopModeResponse(msg_id, COMMS_Handler_WorkConfigSetStopMode(args));
+}
+
+/**
+  * @brief  Store whether the idle MCU may enter stop mode for config/set_stop_mode
+  * @note   Runs in the worker task outside a batch, as storing may erase
+  *         flash. Off by default: unless the board has the LPUART1 listener,
+  *         the first byte sent after a stop is lost (app_power.c).
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_SetConfig, VAL_PARAM for invalid arguments
+  */
+static VAL_Status COMMS_Handler_WorkConfigSetStopMode(const COMMS_Command_Args_t* args) {
+  Config_Settings_t settings;
+  VAL_Status status;
+
+  if (!(args->found & COMMAND_ARG_ENABLE)) {
+    return VAL_PARAM;
+  }
+
+  status = SYS_Coordinator_GetConfig(&settings);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  settings.stop_mode = args->enable ? 1U : 0U;
+  return SYS_Coordinator_SetConfig(&settings);
+}
+
+/**
+  * @brief  config/begin command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigBegin(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendBeginConfigResponse(msg_id, COMMS_Handler_WorkConfigBegin(args));
+}
+
+/**
+  * @brief  Start staging settings for config/begin
+  * @note   Runs in the worker task, in order with the changes it stages
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_BeginConfig
+  */
+static VAL_Status COMMS_Handler_WorkConfigBegin(const COMMS_Command_Args_t* args) {
+  return SYS_Coordinator_BeginConfig();
+}
+
+/**
+  * @brief  config/commit command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigCommit(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendCommitConfigResponse(msg_id, COMMS_Handler_WorkConfigCommit(args));
+}
+
+/**
+  * @brief  Apply and store the staged settings for config/commit
+  * @note   Runs in the worker task outside a batch, as storing may erase
+  *         flash
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_CommitConfig
+  */
+static VAL_Status COMMS_Handler_WorkConfigCommit(const COMMS_Command_Args_t* args) {
+  return SYS_Coordinator_CommitConfig();
+}
+
+/**
+  * @brief  config/abort command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigAbort(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendAbortConfigResponse(msg_id, COMMS_Handler_WorkConfigAbort(args));
+}
+
+/**
+  * @brief  Drop the staged settings for config/abort
+  * @note   Runs in the worker task, in order with the changes it drops
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: VAL_OK
+  */
+static VAL_Status COMMS_Handler_WorkConfigAbort(const COMMS_Command_Args_t* args) {
+  SYS_Coordinator_AbortConfig();
+  return VAL_OK;
+}
+
+/**
+  * @brief  config/export command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigExport(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendExportConfigResponse(msg_id, (args->found & COMMAND_ARG_FROM) ? args->from : 0);
+}
+
+/**
+  * @brief  config/import command handler, run in place inside a batch
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdConfigImport(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendImportConfigResponse(msg_id, COMMS_Handler_WorkConfigImport(args));
+}
+
+/**
+  * @brief  Receive part of a configuration export for config/import
+  * @note   Runs in the worker task outside a batch, as the last part
+  *         stores the records that changed
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_ImportConfig, VAL_PARAM without
+  *         "from" and "data"
+  */
+static VAL_Status COMMS_Handler_WorkConfigImport(const COMMS_Command_Args_t* args) {
+  import_received = 0;
+  import_complete = false;
+
+  if ((args->found & (COMMAND_ARG_FROM | COMMAND_ARG_DATA)) != (COMMAND_ARG_FROM | COMMAND_ARG_DATA)) {
+    return VAL_PARAM;
+  }
+
+  return SYS_Coordinator_ImportConfig(args->from, args->data, args->data_length,
+                                      &import_received, &import_complete);
+}
+
+/**
+  * @brief  scene/get command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSceneGet(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSceneResponse(msg_id, (args->found & COMMAND_ARG_ID) ? args->id : 0);
+}
+
+/**
+  * @brief  scene/save command handler, run in place inside a batch
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSceneSave(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSaveSceneResponse(msg_id, COMMS_Handler_WorkSceneSave(args));
+}
+
+/**
+  * @brief  Save a scene for scene/save
+  * @note   Runs in the worker task outside a batch, as storing may erase
+  *         flash. Without "permilles" the present intensities are saved;
+  *         "duration" defaults to 0 and "curve" to linear.
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As SYS_Coordinator_SaveScene, VAL_PARAM for invalid arguments
+  */
+static VAL_Status COMMS_Handler_WorkSceneSave(const COMMS_Command_Args_t* args) {
+  Config_Scene_t data = {0};
+
+  if (!(args->found & COMMAND_ARG_ID)) {
+    return VAL_PARAM;
+  }
+
+  if (args->found & COMMAND_ARG_PERMILLES) {
+    memcpy(data.permille, args->permilles, sizeof(data.permille));
+  } else if (SYS_Coordinator_GetAllLightPermille(data.permille) != VAL_OK) {
+    return VAL_ERROR;
+  }
+
+  if (args->found & COMMAND_ARG_DURATION) {
+    data.duration_ms = args->duration;
+  }
+
+  /* Only the fade curves apply, they share their values with COMMS_CURVE_* */
+  data.curve = LED_DRIVER_FADE_LINEAR;
+  if (args->found & COMMAND_ARG_CURVE) {
+    if (args->curve == COMMS_CURVE_EASE) {
+      data.curve = LED_DRIVER_FADE_EASE;
+    } else if (args->curve == COMMS_CURVE_PERCEPTUAL) {
+      data.curve = LED_DRIVER_FADE_PERCEPTUAL;
+    } else if (args->curve != COMMS_CURVE_LINEAR) {
+      return VAL_PARAM;
+    }
+  }
+
+  return SYS_Coordinator_SaveScene(args->id, &data);
+}
+
+/**
+  * @brief  scene/recall command handler
+  * @note   Applies the RAM copy of the scene, all lights in the same PWM
+  *         period or in one fade
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSceneRecall(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_PARAM;
+  uint32_t mask = CONFIG_LIGHTS_ALL;
+
+  if (args->found & COMMAND_ARG_ID) {
+    status = VAL_OK;
+    if (args->found & COMMAND_ARG_GROUP) {
+      status = SYS_Coordinator_GetLightGroup(args->group, &mask);
+    }
+    if (status == VAL_OK) {
+      status = SYS_Coordinator_RecallScene(args->id, mask);
+    }
+  }
+
+  COMMS_Handler_SendSceneStatusResponse(msg_id, "recall", status);
+}
+
+/**
+  * @brief  capture/start command handler
+  * @note   "trigger" defaults to now. The rising and falling triggers compare
+  *         the current of light "id" with "threshold" in mA.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdCaptureStart(const char* msg_id, const COMMS_Command_Args_t* args) {
+  /* Indexed by COMMS_CAPTURE_* value */
+  static const AnalogCaptureTrigger triggers[COMMS_CAPTURE_TRIGGER_COUNT] = {
+    ANALOG_CAPTURE_IMMEDIATE, ANALOG_CAPTURE_EXTERNAL, ANALOG_CAPTURE_RISING, ANALOG_CAPTURE_FALLING
+  };
+  AnalogCaptureConfig config = {0};
+  VAL_Status status = VAL_PARAM;
+  uint8_t trigger = (args->found & COMMAND_ARG_TRIGGER) ? args->trigger : COMMS_CAPTURE_NOW;
+  bool threshold = (trigger == COMMS_CAPTURE_RISING || trigger == COMMS_CAPTURE_FALLING);
+
+  if ((args->found & COMMAND_ARG_SCANS) && trigger < COMMS_CAPTURE_TRIGGER_COUNT &&
+      (!threshold || ((args->found & COMMAND_ARG_ID) && (args->found & COMMAND_ARG_THRESHOLD)))) {
+    config.scans = args->scans;
+    config.trigger = triggers[trigger];
+    config.light_id = args->id;
+    config.input = ANALOG_INPUT_CURRENT;
+    config.threshold_counts = threshold ? VAL_Analog_CurrentToCounts(args->id, args->threshold) : 0;
+    status = VAL_Analog_StartCapture(&config);
+  }
+
+  COMMS_Handler_SendCaptureStartResponse(msg_id, status, args->scans);
+}
+
+/**
+  * @brief  capture/read command handler
+  * @note   Without "from" the recording is read from its first scan
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdCaptureRead(const char* msg_id, const COMMS_Command_Args_t* args) {
+  uint32_t from = (args->found & COMMAND_ARG_FROM) ? args->from : 0;
+
+  COMMS_Handler_SendCaptureReadResponse(msg_id, (from > UINT16_MAX) ? UINT16_MAX : (uint16_t)from);
+}
+
+/**
+  * @brief  capture/read_packed command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdCaptureReadPacked(const char* msg_id, const COMMS_Command_Args_t* args) {
+  uint32_t from = (args->found & COMMAND_ARG_FROM) ? args->from : 0;
+
+  COMMS_Handler_SendCapturePackedResponse(msg_id, (from > UINT16_MAX) ? UINT16_MAX : (uint16_t)from);
+}
+
+/**
+  * @brief  sequence/clear command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSequenceClear(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSequenceStatusResponse(msg_id, "clear", SYS_Coordinator_ClearSequence());
+}
+
+/**
+  * @brief  sequence/add command handler
+  * @note   Appends a cue at "offset" microseconds from the start of a pass.
+  *         A negative entry in "permilles" keeps that light; "duration"
+  *         defaults to 0 and "curve" to linear.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSequenceAdd(const char* msg_id, const COMMS_Command_Args_t* args) {
+  Sequencer_Cue_t cue = {0};
+  VAL_Status status = VAL_PARAM;
+  uint32_t required = COMMAND_ARG_PERMILLES | COMMAND_ARG_OFFSET;
+
+  if ((args->found & required) == required) {
+    memcpy(cue.permille, args->permilles, sizeof(cue.permille));
+    cue.offset_us = args->offset;
+    cue.duration_ms = (args->found & COMMAND_ARG_DURATION) ? args->duration : 0;
+
+    /* Only the fade curves apply */
+    cue.curve = LED_DRIVER_FADE_CURVE_COUNT;
+    if (!(args->found & COMMAND_ARG_CURVE) || args->curve == COMMS_CURVE_LINEAR) {
+      cue.curve = LED_DRIVER_FADE_LINEAR;
+    } else if (args->curve == COMMS_CURVE_EASE) {
+      cue.curve = LED_DRIVER_FADE_EASE;
+    } else if (args->curve == COMMS_CURVE_PERCEPTUAL) {
+      cue.curve = LED_DRIVER_FADE_PERCEPTUAL;
+    }
+
+    status = SYS_Coordinator_AddCue(&cue);
+  }
+
+  COMMS_Handler_SendSequenceStatusResponse(msg_id, "add", status);
+}
+
+/**
+  * @brief  sequence/start command handler
+  * @note   Plays once without "period", else repeats every "period"
+  *         microseconds
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSequenceStart(const char* msg_id, const COMMS_Command_Args_t* args) {
+  uint32_t period = (args->found & COMMAND_ARG_PERIOD) ? args->period : 0;
+
+  COMMS_Handler_SendSequenceStatusResponse(msg_id, "start", SYS_Coordinator_StartSequence(period));
+}
+
+/**
+  * @brief  sequence/stop command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSequenceStop(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSequenceStatusResponse(msg_id, "stop", SYS_Coordinator_StopSequence());
+}
+
+/**
+  * @brief  sequence/status command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdSequenceStatus(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSequenceResponse(msg_id);
+}
+
+/**
+  * @brief  strobe/start command handler
+  * @note   Fires all lights at "permilles" for "width" microseconds on each
+  *         edge of the trigger input; "trigger" is "rising" (default) or
+  *         "falling"
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdStrobeStart(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_PARAM;
+  uint32_t required = COMMAND_ARG_PERMILLES | COMMAND_ARG_WIDTH;
+  uint8_t edge = (args->found & COMMAND_ARG_TRIGGER) ? args->trigger : COMMS_CAPTURE_RISING;
+
+  if ((args->found & required) == required &&
+      (edge == COMMS_CAPTURE_RISING || edge == COMMS_CAPTURE_FALLING)) {
+    status = SYS_Coordinator_StartStrobe(args->width, 0, args->permilles, edge == COMMS_CAPTURE_FALLING);
+  }
+
+  COMMS_Handler_SendStrobeStatusResponse(msg_id, "strobe", "start", status);
+}
+
+/**
+  * @brief  strobe/stop command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdStrobeStop(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendStrobeStatusResponse(msg_id, "strobe", "stop", SYS_Coordinator_StopStrobe());
+}
+
+/**
+  * @brief  strobe/status command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdStrobeStatus(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendStrobeResponse(msg_id);
+}
+
+/**
+  * @brief  dmx/start command handler
+  * @note   The response goes out before the line switches to DMX512; the
+  *         host link returns once the desk has been silent for a second
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdDmxStart(const char* msg_id, const COMMS_Command_Args_t* args) {
+  VAL_Status status = VAL_PARAM;
+
+  if (args->found & COMMAND_ARG_CHANNEL) {
+    status = SYS_Coordinator_CheckDmx(args->channel);
+  }
+
+  COMMS_Handler_SendDmxStartResponse(msg_id, status, args->channel);
+  if (status != VAL_OK) {
+    return;
+  }
+
+  VAL_Serial_Flush(COMMS_BAUD_FLUSH_TIMEOUT_MS);
+  status = SYS_Coordinator_StartDmx(args->channel);
+  if (status != VAL_OK) {
+    LOGGER_LOG(LOGGER_LEVEL_ERROR, LOGGER_MSG_DMX_SWITCH_FAILED, status, 0);
+  }
+}
+
+/**
+  * @brief  dmx/status command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdDmxStatus(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendDmxResponse(msg_id);
+}
+
+/**
+  * @brief  modbus/start command handler
+  * @note   The response goes out before the line switches to Modbus RTU.
+  *         The address defaults to the device address when that is a valid
+  *         slave address, the baud rate to MODBUS_BAUD_DEFAULT and the
+  *         timeout to MODBUS_TIMEOUT_MS.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdModbusStart(const char* msg_id, const COMMS_Command_Args_t* args) {
+  uint8_t address = 0;
+  uint32_t baud = (args->found & COMMAND_ARG_BAUD) ? args->baud : MODBUS_BAUD_DEFAULT;
+  uint32_t timeout_ms = (args->found & COMMAND_ARG_TIMEOUT) ? args->timeout : MODBUS_TIMEOUT_MS;
+  Config_Settings_t settings;
+  VAL_Status status;
+
+  if (args->found & COMMAND_ARG_ADDRESS) {
+    address = args->address;
+  } else if (SYS_Coordinator_GetConfig(&settings) == VAL_OK) {
+    address = settings.address;
+  }
+
+  status = Modbus_Check(address, baud, timeout_ms);
+  COMMS_Handler_SendModbusStartResponse(msg_id, status, address, baud, timeout_ms);
+  if (status != VAL_OK) {
+    return;
+  }
+
+  VAL_Serial_Flush(COMMS_BAUD_FLUSH_TIMEOUT_MS);
+  status = Modbus_Start(address, baud, timeout_ms);
+  if (status != VAL_OK) {
+    LOGGER_LOG(LOGGER_LEVEL_ERROR, LOGGER_MSG_MODBUS_SWITCH_FAILED, status, 0);
+  }
+}
+
+/**
+  * @brief  modbus/status command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdModbusStatus(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendModbusResponse(msg_id);
+}
+
+/**
+  * @brief  rules/add command handler
+  * @note   Watches "input" of light "id" against "threshold", crossed
+  *         upwards or, with "trigger" "falling", downwards, and re-armed
+  *         "hysteresis" back; "then" sets or fades the lights in "mask"
+  *         (default all) to "permille", recalls "scene", runs the macro
+  *         numbered "scene" or only sends a rules/fired event. "duration"
+  *         defaults to 0 and "curve" to linear.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdRulesAdd(const char* msg_id, const COMMS_Command_Args_t* args) {
+  Rules_Rule_t rule = {0};
+  VAL_Status status = VAL_PARAM;
+  uint64_t required = COMMAND_ARG_ID | COMMAND_ARG_INPUT | COMMAND_ARG_THRESHOLD | COMMAND_ARG_THEN;
+  uint8_t edge = (args->found & COMMAND_ARG_TRIGGER) ? args->trigger : COMMS_CAPTURE_RISING;
+
+  /* The lights need an intensity to go to */
+  if ((args->found & COMMAND_ARG_THEN) && (args->then == COMMS_RULE_SET || args->then == COMMS_RULE_FADE)) {
+    required |= COMMAND_ARG_PERMILLE;
+  }
+
+  if ((args->found & required) == required && args->input < COMMS_RULE_INPUT_COUNT &&
+      args->then < COMMS_RULE_ACTION_COUNT &&
+      (edge == COMMS_CAPTURE_RISING || edge == COMMS_CAPTURE_FALLING)) {
+    rule.input = (Rules_Input_t)args->input;
+    rule.light_id = args->id;
+    rule.falling = (edge == COMMS_CAPTURE_FALLING);
+    rule.threshold = args->threshold;
+    rule.hysteresis = (args->found & COMMAND_ARG_HYSTERESIS) ? args->hysteresis : 0;
+    rule.action = (Rules_Action_t)args->then;
+    rule.mask = (uint8_t)((args->found & COMMAND_ARG_MASK) ? args->mask : CONFIG_LIGHTS_ALL);
+    rule.permille = args->permille;
+    rule.duration_ms = (args->found & COMMAND_ARG_DURATION) ? args->duration : 0;
+    rule.scene = (args->found & COMMAND_ARG_SCENE) ? args->scene : 0;
+    rule.macro = rule.scene;
+
+    /* Only the fade curves apply */
+    rule.curve = LED_DRIVER_FADE_CURVE_COUNT;
+    if (!(args->found & COMMAND_ARG_CURVE) || args->curve == COMMS_CURVE_LINEAR) {
+      rule.curve = LED_DRIVER_FADE_LINEAR;
+    } else if (args->curve == COMMS_CURVE_EASE) {
+      rule.curve = LED_DRIVER_FADE_EASE;
+    } else if (args->curve == COMMS_CURVE_PERCEPTUAL) {
+      rule.curve = LED_DRIVER_FADE_PERCEPTUAL;
+    }
+
+    /* A mask wider than the lights must not wrap into a valid one */
+    if (!(args->found & COMMAND_ARG_MASK) || (args->mask & ~CONFIG_LIGHTS_ALL) == 0) {
+      status = SYS_Coordinator_AddRule(&rule);
+    }
+  }
+
+  COMMS_Handler_SendRulesStatusResponse(msg_id, "add", status);
+}
+
+/**
+  * @brief  rules/clear command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdRulesClear(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendRulesStatusResponse(msg_id, "clear", SYS_Coordinator_ClearRules());
+}
+
+/**
+  * @brief  rules/status command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdRulesStatus(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendRulesResponse(msg_id);
+}
+
+/**
+  * @brief  macro/save command handler, run in place inside a batch
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdMacroSave(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSaveMacroResponse(msg_id, COMMS_Handler_WorkMacroSave(args));
+}
+
+/**
+  * @brief  Receive part of a command macro for macro/save
+  * @note   Runs in the worker task outside a batch, as the last part
+  *         stores the macro. Parts come in order from "from" 0; one shorter
+  *         than COMMS_CONFIG_IMPORT_CHUNK is the last, and the commands are
+  *         checked then, so a macro never holds one that cannot run.
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: VAL_OK if received or stored, VAL_PARAM for invalid
+  *         arguments or commands, as SYS_Coordinator_SaveMacro otherwise
+  */
+static VAL_Status COMMS_Handler_WorkMacroSave(const COMMS_Command_Args_t* args) {
+  uint64_t required = COMMAND_ARG_ID | COMMAND_ARG_FROM | COMMAND_ARG_DATA;
+  uint8_t macro = args->id;
+
+  if ((args->found & required) != required || macro < 1 || macro > CONFIG_MACRO_COUNT) {
+    return VAL_PARAM;
+  }
+
+  if (args->from == 0) {
+    memset(&macro_staged, 0, sizeof(macro_staged));
+    macro_staged_id = macro;
+  } else if (macro != macro_staged_id || args->from != macro_staged.length) {
+    return VAL_PARAM;
+  }
+
+  if (args->data_length > CONFIG_MACRO_BYTES - macro_staged.length) {
+    macro_staged_id = 0;
+    return VAL_PARAM;
+  }
+
+  memcpy(&macro_staged.commands[macro_staged.length], args->data, args->data_length);
+  macro_staged.length += args->data_length;
+  macro_received = macro_staged.length;
+
+  /* More parts to come */
+  if (args->data_length == COMMS_CONFIG_IMPORT_CHUNK) {
+    return VAL_OK;
+  }
+
+  macro_staged_id = 0;
+  if (COMMS_Handler_CheckMacro(&macro_staged) != VAL_OK) {
+    return VAL_PARAM;
+  }
+
+  return SYS_Coordinator_SaveMacro(macro, &macro_staged);
+}
+
+/**
+  * @brief  macro/run command handler, run in place inside a batch
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdMacroRun(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendRunMacroResponse(msg_id, COMMS_Handler_ExecuteMacro(args->id));
+}
+
+/**
+  * @brief  Run a stored command macro for macro/run or a rule
+  * @note   Runs in the worker task outside a batch, so a long macro does
+  *         not hold up the commands that follow it
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: As COMMS_Handler_ExecuteMacro
+  */
+static VAL_Status COMMS_Handler_WorkMacroRun(const COMMS_Command_Args_t* args) {
+  VAL_Status status;
+
+  xSemaphoreTake(response_lock, portMAX_DELAY);
+  status = COMMS_Handler_ExecuteMacro(args->id);
+  xSemaphoreGive(response_lock);
+
+  return status;
+}
+
+/**
+  * @brief  macro/get command handler
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdMacroGet(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendMacroResponse(msg_id, (args->found & COMMAND_ARG_ID) ? args->id : 0);
+}
+
+/**
+  * @brief  Find the command a macro may hold for a binary code
+  * @note   Slow commands are left out, they would wait for the worker task
+  *         that runs the macro, and so are those a batch refuses
+  * @param  code: Binary command code
+  * @retval const COMMS_Command_t*: Command table entry, NULL if not allowed
+  */
+static const COMMS_Command_t* COMMS_Handler_MacroCommand(uint8_t code) {
+  uint8_t index = bin_command_index[code];
+
+  if (index == COMMAND_SLOT_EMPTY) {
+    return NULL;
+  }
+
+  const COMMS_Command_t* command = &command_table[index];
+  if (command->work != NULL || command->handler == COMMS_Handler_CmdSystemSetBaud ||
+      command->handler == COMMS_Handler_CmdConfigSetAddress ||
+      command->handler == COMMS_Handler_CmdSystemSelfTest) {
+    return NULL;
+  }
+
+  return command;
+}
+
+/**
+  * @brief  Check the commands of a macro and count them
+  * @param  data: Macro to check, its steps are set here
+  * @retval VAL_Status: VAL_OK if every command may run in a macro,
+  *         VAL_PARAM otherwise
+  */
+static VAL_Status COMMS_Handler_CheckMacro(Config_Macro_t* data) {
+  uint16_t pos = 0;
+
+  data->steps = 0;
+  while (pos + 2U <= data->length) {
+    uint16_t next = pos + 2U + data->commands[pos + 1U];
+
+    if (next > data->length || COMMS_Handler_MacroCommand(data->commands[pos]) == NULL) {
+      return VAL_PARAM;
+    }
+    pos = next;
+    data->steps++;
+  }
+
+  return (pos == data->length) ? VAL_OK : VAL_PARAM;
+}
+
+/**
+  * @brief  Run the commands of a stored macro, one after the other
+  * @note   Called with response_lock held. The arguments were stored in
+  *         binary form, so they are only decoded here, never parsed. Each
+  *         command runs as a silent binary one, whatever the host speaks,
+  *         so its status is known without a response; the outcome is left
+  *         in macro_result.
+  * @param  macro: Macro number (1-CONFIG_MACRO_COUNT)
+  * @retval VAL_Status: VAL_OK once run, whether or not its commands
+  *         succeeded, VAL_ERROR if the macro was never saved, VAL_PARAM if
+  *         invalid
+  */
+static VAL_Status COMMS_Handler_ExecuteMacro(uint8_t macro) {
+  COMMS_Reply_t saved = reply;
+  uint16_t pos = 0;
+
+  memset(&macro_result, 0, sizeof(macro_result));
+  macro_result.macro = macro;
+
+  VAL_Status status = SYS_Coordinator_GetMacro(macro, &macro_running);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  reply.binary = true;
+  reply.cbor = false;
+  reply.silent = true;
+  reply.no_ack = false;
+  reply.id_numeric = true;
+  reply.id_number = 0;
+
+  while (pos + 2U <= macro_running.length) {
+    uint8_t code = macro_running.commands[pos];
+    uint8_t length = macro_running.commands[pos + 1U];
+    const COMMS_Command_t* command = COMMS_Handler_MacroCommand(code);
+
+    reply.code = code;
+    reply.status = VAL_OK;
+    macro_result.steps++;
+
+    /* Checked when saved; a firmware update may have changed the table since */
+    if (command == NULL) {
+      reply.status = VAL_PARAM;
+    } else {
+      COMMS_Handler_DecodeBinaryArgs(&macro_running.commands[pos + 2U], length, command->args, &macro_args);
+      macro_args.found &= command->args;
+      command->handler("", &macro_args);
+    }
+
+    if (reply.status != VAL_OK) {
+      macro_result.failed++;
+      if (macro_result.first_failed == 0) {
+        macro_result.first_failed = macro_result.steps;
+      }
+    }
+    pos += 2U + length;
+  }
+
+  reply = saved;
+  return VAL_OK;
+}
+
+/**
+  * @brief  diag/spectrum command handler, run in place inside a batch
+  * @note   A batch runs with the scheduler suspended, so the capture could
+  *         not be waited for; the command is answered busy there
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdDiagSpectrum(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_SendSpectrumResponse(msg_id, VAL_BUSY);
+}
+
+/**
+  * @brief  Capture and analyze the current of a light for diag/spectrum
+  * @note   Runs in the worker task, below the sampling interrupt and the
+  *         coordinator, so the analysis never delays the alarms. Records
+  *         SPECTRUM_SIZE scans through the raw capture, replacing any
+  *         recording (an armed alarm recorder is armed again after), then finds the largest "limit" peaks (default 4).
+  *         Sampling rates that would take longer than
+  *         SPECTRUM_CAPTURE_MAX_MS are refused.
+  * @param  args: Decoded command arguments
+  * @retval VAL_Status: VAL_OK if analyzed, VAL_PARAM for invalid arguments,
+  *         VAL_BUSY while another capture is armed or running, VAL_TIMEOUT
+  *         if the capture did not complete
+  */
+static VAL_Status COMMS_Handler_WorkDiagSpectrum(const COMMS_Command_Args_t* args) {
+  uint16_t chunk[SPECTRUM_CHUNK_SCANS * ANALOG_CHANNEL_COUNT];
+  AnalogCaptureConfig config = {0};
+  AnalogCaptureStatus capture;
+  uint8_t peaks = (args->found & COMMAND_ARG_LIMIT) ? args->limit : SPECTRUM_PEAKS_DEFAULT;
+  uint32_t rate_hz = VAL_Analog_GetSampleRate();
+  VAL_Status status;
+
+  if (!(args->found & COMMAND_ARG_ID) || args->id < 1 || args->id > VAL_LIGHT_COUNT ||
+      peaks < 1 || peaks > SPECTRUM_PEAKS_MAX ||
+      rate_hz == 0 || SPECTRUM_SIZE * 1000U / rate_hz > SPECTRUM_CAPTURE_MAX_MS) {
+    return VAL_PARAM;
+  }
+
+  /* Leave a capture the host started alone; the alarm recorder gives way
+   * while it waits for a trip, and is armed again after */
+  VAL_Analog_GetCaptureStatus(&capture);
+  bool recorder = (capture.trigger == ANALOG_CAPTURE_FAULT && capture.state == ANALOG_CAPTURE_ARMED);
+  if (!recorder && (capture.state == ANALOG_CAPTURE_ARMED || capture.state == ANALOG_CAPTURE_RUNNING)) {
+    return VAL_BUSY;
+  }
+
+  config.scans = SPECTRUM_SIZE;
+  config.trigger = ANALOG_CAPTURE_IMMEDIATE;
+  config.light_id = args->id;
+  config.input = ANALOG_INPUT_CURRENT;
+  status = VAL_Analog_StartCapture(&config);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* Twice the recording time before giving up */
+  TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(2U * SPECTRUM_CAPTURE_MAX_MS);
+  do {
+    vTaskDelay(pdMS_TO_TICKS(SPECTRUM_POLL_MS));
+    VAL_Analog_GetCaptureStatus(&capture);
+    if (capture.state == ANALOG_CAPTURE_DONE) {
+      break;
+    }
+  } while ((int32_t)(deadline - xTaskGetTickCount()) > 0);
+
+  if (capture.state != ANALOG_CAPTURE_DONE || capture.scans < SPECTRUM_SIZE) {
+    if (recorder) {
+      (void)Recorder_Arm();
+    }
+    return VAL_TIMEOUT;
+  }
+
+  /* Only the current of the light is kept */
+  uint8_t rank = VAL_Channels[args->id - 1].current_rank;
+  for (uint16_t scan = 0; scan < SPECTRUM_SIZE; scan += SPECTRUM_CHUNK_SCANS) {
+    uint16_t count = VAL_Analog_ReadCapture(scan, SPECTRUM_CHUNK_SCANS, chunk);
+
+    for (uint16_t i = 0; i < count; i++) {
+      spectrum_samples[scan + i] = chunk[i * ANALOG_CHANNEL_COUNT + rank];
+    }
+  }
+  if (recorder) {
+    (void)Recorder_Arm();
+  }
+
+  spectrum_light = args->id;
+  spectrum_rate_hz = rate_hz;
+  return Spectrum_Analyze(spectrum_samples, peaks, &spectrum_result);
+}
+
+#ifdef COMMS_LINK_BENCH
+/**
+  * @brief  bench/echo command handler
+  * @note   The next size bytes received are sent straight back, then the
+  *         command is answered with the timing
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdBenchEcho(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_StartBench(msg_id, args, BENCH_MODE_ECHO);
+}
+
+/**
+  * @brief  bench/sink command handler
+  * @note   The next size bytes received are counted and dropped, then the
+  *         command is answered with the timing
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdBenchSink(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_StartBench(msg_id, args, BENCH_MODE_SINK);
+}
+
+/**
+  * @brief  bench/source command handler
+  * @note   Sends size bytes of pattern lines as fast as the link takes them,
+  *         then answers the command with the timing
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @retval None
+  */
+static void COMMS_Handler_CmdBenchSource(const char* msg_id, const COMMS_Command_Args_t* args) {
+  COMMS_Handler_StartBench(msg_id, args, BENCH_MODE_SOURCE);
+}
+
+/**
+  * @brief  Start a link self-benchmark run
+  * @note   The response follows once the run is over. Line ends right after
+  *         the command are not part of an echo or sink run, and one falls
+  *         silent for BENCH_IDLE_MS ends it short.
+  * @param  msg_id: Message ID to respond to
+  * @param  args: Decoded command arguments
+  * @param  mode: COMMS_Bench_Mode_t of the run
+  * @retval None
+  */
+static void COMMS_Handler_StartBench(const char* msg_id, const COMMS_Command_Args_t* args, uint8_t mode) {
+  VAL_Status status = VAL_OK;
+
+  if (!(args->found & COMMAND_ARG_SIZE) || args->size == 0 || args->size > BENCH_MAX_BYTES) {
+    status = VAL_PARAM;
+  } else if (bench.mode != BENCH_MODE_IDLE || reply.silent) {
+    /* A broadcast run would have every device on the bus answer at once */
+    status = VAL_BUSY;
+  }
+
+  if (status != VAL_OK) {
+    if (reply.binary) {
+      COMMS_Handler_SendBinaryResponse(status, NULL, 0);
+    } else {
+      COMMS_Handler_SendErrorResponse(msg_id, "bench", bench_mode_names[mode],
+                                      (status == VAL_PARAM) ? "Invalid size" : "Benchmark running");
+    }
+    return;
+  }
+
+  memset(&bench, 0, sizeof(bench));
+  bench.mode = mode;
+  bench.size = args->size;
+  bench.overflow = link_stats.overflow;
+  bench.last_tick = xTaskGetTickCount();
+  bench.reply = reply;
+  strncpy(bench.id, msg_id, sizeof(bench.id) - 1);
+
+  if (mode == BENCH_MODE_SOURCE) {
+    for (uint32_t i = 0; i < BENCH_SOURCE_CHUNK; i++) {
+      uint32_t column = i % BENCH_LINE_LENGTH;
+
+      bench_block[i] = (column == BENCH_LINE_LENGTH - 1) ? '\n' : (uint8_t)('0' + column % 10);
+    }
+  }
+}
+
+/**
+  * @brief  Shorten the receive wait of the task for a running benchmark
+  * @param  wait: Wait the link needs otherwise, in ticks
+  * @retval TickType_t: No wait while sending, at most the idle timeout
+  *         while receiving
+  */
+static TickType_t COMMS_Handler_BenchWait(TickType_t wait) {
+  if (bench.mode == BENCH_MODE_SOURCE) {
+    return 0;
+  }
+  if (bench.mode != BENCH_MODE_IDLE && wait > pdMS_TO_TICKS(BENCH_IDLE_MS)) {
+    return pdMS_TO_TICKS(BENCH_IDLE_MS);
+  }
+  return wait;
+}
+
+/**
+  * @brief  Take received bytes for an echo or sink run
+  * @param  data: Received bytes
+  * @param  length: Number of received bytes, at least one
+  * @retval size_t: Bytes taken, at least one; the rest are decoded as usual
+  */
+static size_t COMMS_Handler_BenchReceive(const char* data, size_t length) {
+  uint32_t now = VAL_SysClock_GetMicros();
+  size_t taken = 0;
+  size_t count;
+
+  if (bench.bytes == 0) {
+    while (taken < length && (data[taken] == '\n' || data[taken] == '\r')) {
+      taken++;
+    }
+  }
+
+  count = length - taken;
+  if (count > bench.size - bench.bytes) {
+    count = bench.size - bench.bytes;
+  }
+  if (count == 0) {
+    return taken;
+  }
+
+  if (bench.bytes == 0) {
+    bench.start_us = now;
+  }
+  if (bench.mode == BENCH_MODE_ECHO) {
+    TxPool_SendDirect((const uint8_t*)&data[taken], count, TX_PRIORITY_RESPONSE, BENCH_IDLE_MS);
+
+    uint32_t turnaround_us = VAL_SysClock_GetMicros() - now;
+    if (turnaround_us > bench.turnaround_max_us) {
+      bench.turnaround_max_us = turnaround_us;
+    }
+  }
+  bench.bytes += count;
+  bench.last_us = now;
+  bench.last_tick = xTaskGetTickCount();
+
+  /* The host is still there, the failsafe must not trip mid-run */
+  link_frame_tick = bench.last_tick;
+
+  if (bench.bytes == bench.size) {
+    COMMS_Handler_BenchPoll();
+  }
+  return taken + count;
+}
+
+/**
+  * @brief  Move a running benchmark on and answer it once it is over
+  * @note   A source run queues one block per call, so the task checks in
+  *         with the supervisor between blocks
+  * @retval None
+  */
+static void COMMS_Handler_BenchPoll(void) {
+  if (bench.mode == BENCH_MODE_IDLE) {
+    return;
+  }
+
+  if (bench.mode == BENCH_MODE_SOURCE) {
+    uint32_t count = bench.size - bench.bytes;
+
+    if (count > BENCH_SOURCE_CHUNK) {
+      count = BENCH_SOURCE_CHUNK;
+    }
+    if (bench.bytes == 0) {
+      bench.start_us = VAL_SysClock_GetMicros();
+    }
+    if (TxPool_SendDirect(bench_block, count, TX_PRIORITY_RESPONSE, BENCH_IDLE_MS) == VAL_OK) {
+      bench.bytes += count;
+      if (bench.bytes < bench.size) {
+        return;
+      }
+    }
+
+    /* Up to the last byte on the line */
+    Transport_Flush(BENCH_IDLE_MS);
+    bench.last_us = VAL_SysClock_GetMicros();
+  } else if (bench.bytes < bench.size &&
+             (xTaskGetTickCount() - bench.last_tick) < pdMS_TO_TICKS(BENCH_IDLE_MS)) {
+    return;
+  }
+
+  COMMS_Reply_t current = reply;
+  reply = bench.reply;
+  COMMS_Handler_SendBenchResponse(bench.id);
+  reply = current;
+  bench.mode = BENCH_MODE_IDLE;
+}
+#endif
+
+/**
+  * @brief  Serial RX callback - Called for each block received by the DMA
+  * @note   Runs in interrupt context. Only queues the raw bytes for the
+  *         communications task, which decodes them, once an emergency
+  *         command among them has had the outputs cut.
+  * @param  data: Received bytes
+  * @param  length: Number of received bytes
+  * @retval None
+  */
+VAL_RAMFUNC static void COMMS_Handler_SerialRxCallback(const uint8_t* data, uint16_t length) {
+  BaseType_t higher_priority_task_woken = pdFALSE;
+  uint32_t received = Profiler_Start();
+
+#ifdef BENCHMARK
+  Profiler_WakeupMark(PROFILER_WAKEUP_RX);
+#endif
+  COMMS_Handler_FastScan(data, length, received);
+  if (xStreamBufferSendFromISR(rx_stream, data, length, &higher_priority_task_woken) < length) {
+    rx_overflow = 1;
+  }
+
+  portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+/**
+  * @brief  Follow the binary frames of an RX block for emergency commands
+  * @note   Interrupt context. Only frames short enough for an emergency
+  *         command are kept, so JSON text costs one memchr per block and
+  *         longer frames are skipped from their ninth byte on. A match has
+  *         the outputs cut at once and is timed from the block callback.
+  * @param  data: Received bytes
+  * @param  length: Number of received bytes
+  * @param  received: Cycle counter on entry to the callback
+  * @retval None
+  */
+VAL_RAMFUNC static void COMMS_Handler_FastScan(const uint8_t* data, uint16_t length, uint32_t received) {
+  const uint8_t* end = data + length;
+
+  while (data < end) {
+    if (!fast_collecting) {
+      /* Frames start after a delimiter, JSON text has none */
+      data = memchr(data, COMMS_BIN_DELIMITER, (size_t)(end - data));
+      if (data == NULL) {
+        return;
+      }
+      data++;
+      fast_collecting = true;
+      fast_length = 0;
+      continue;
+    }
+
+    uint8_t byte = *data++;
+    if (byte != COMMS_BIN_DELIMITER) {
+      if (fast_length < COMMS_BIN_FAST_FRAME_MAX) {
+        fast_frame[fast_length++] = byte;
+      } else {
+        fast_collecting = false;
+      }
+      continue;
+    }
+
+    /* The delimiter closes this frame and opens the next one */
+    if (fast_length > 0) {
+      uint8_t index = COMMS_Handler_FastMatch();
+
+      if (index != COMMAND_SLOT_EMPTY && SYS_Coordinator_BlackoutFromISR() == VAL_OK) {
+        Latency_RecordCommand(index, Profiler_Start() - received);
+        fast_pending++;
+      }
+    }
+    fast_length = 0;
+  }
+}
+
+/**
+  * @brief  Check the frame collected by COMMS_Handler_FastScan
+  * @note   Interrupt context. The frame is decoded from a copy, with the
+  *         same CRC and address checks as COMMS_Handler_ProcessFrame; the
+  *         task still decodes the queued bytes itself.
+  * @retval uint8_t: Command table index of an emergency command addressed
+  *         to this device, COMMAND_SLOT_EMPTY otherwise
+  */
+VAL_RAMFUNC static uint8_t COMMS_Handler_FastMatch(void) {
+  uint8_t payload[COMMS_BIN_FAST_FRAME_MAX];
+  size_t length;
+  uint8_t code;
+
+  memcpy(payload, fast_frame, fast_length);
+  if (COMMS_Binary_DecodeFrame(payload, fast_length, &length) != VAL_OK) {
+    return COMMAND_SLOT_EMPTY;
+  }
+
+  switch (payload[0] & (uint8_t)~COMMS_BIN_TYPE_NOACK) {
+    case COMMS_BIN_TYPE_CMD:
+      if (bus_mode) {
+        return COMMAND_SLOT_EMPTY;
+      }
+      code = payload[2];
+      break;
+    case COMMS_BIN_TYPE_ADDR_CMD:
+      if (length < COMMS_BIN_HEADER_SIZE + 1 || !COMMS_Handler_IsAddressed(payload[1])) {
+        return COMMAND_SLOT_EMPTY;
+      }
+      code = payload[3];
+      break;
+    default:
+      return COMMAND_SLOT_EMPTY;
+  }
+
+  uint8_t index = bin_command_index[code];
+  if (index == COMMAND_SLOT_EMPTY || command_table[index].command_class != COMMS_CLASS_EMERGENCY) {
+    return COMMAND_SLOT_EMPTY;
+  }
+
+  return index;
 }
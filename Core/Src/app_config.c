@@ -0,0 +1,982 @@
+/**
+  ******************************************************************************
+  * @file    app_config.c
+  * @brief   Application layer persistent configuration
+  ******************************************************************************
+  * @attention
+  *
+  * This module owns the settings that can be changed at run time and survive
+  * a reset: the analog sensor scale, the alarm limits, PWM slew limit,
+  * colour primary, ageing curve and output trim of each light, the point of the PWM period at which
+  * currents are sampled, the device address on a shared serial link, the
+  * failsafe on a silent link, the light groups and bus groups and what the
+  * lights come up with at power-on. They are stored as one record through
+  * the data store. Limits are converted to ADC counts by the LED driver when
+  * applied, so the alarm path never works in engineering units.
+  *
+  * The sensor calibration of each light is stored as a record of its own,
+  * since all of them together exceed the largest record. Limits are
+  * converted again whenever a calibration changes.
+  *
+  * Scenes are stored one record each too. They are read where they are
+  * stored: each record is checked once, at start-up or when the store has
+  * moved it, and a recall then reads it through a pointer into flash, with
+  * no RAM copy kept of any scene. Command macros are kept the same way;
+  * only their framing is checked here, the communications handler checks
+  * the commands in them before they are saved.
+  *
+  * A light group is kept as the mask of its lights, so a command for a group
+  * costs no more than one for a single light; a bus group is a bit of the
+  * mask of multicast addresses the device answers to.
+  *
+  * The power-on mode is handed to the restore module, which keeps what the
+  * lights come up with in the RTC backup registers, read long before the
+  * data store: for a power-on scene its intensities are copied there when
+  * the mode or the scene is stored.
+  *
+  * The settings kept here rather than in the module they configure sit in
+  * two slots: new settings are built in the slot not in use, and a pointer
+  * switch puts them in use, so a reader sees either set whole.
+  *
+  * Several changes can be staged: after Config_Begin, Config_Set only
+  * checks the new settings and keeps them in RAM, and Config_Get returns
+  * them, so each change builds on the last. Config_Commit then applies
+  * the whole set at once and stores it with one write; as any record of
+  * the data store, it replaces the previous one only once fully written.
+  * Calibrations and scenes are stored as they are changed, staged or not.
+  *
+  * The whole configuration, settings, calibrations, saved scenes and
+  * macros and the rules table, can be exported as one block with its layout versions and
+  * a CRC-32, and read in parts from a snapshot. An import is received in
+  * parts into a RAM copy; only once complete, with a matching CRC and every
+  * section valid, is it applied, then each record that differs stored as
+  * usual. A supply loss while storing leaves every record either old or
+  * new. Imported macros are checked for their framing only; their commands
+  * were checked when saved on the unit exported. Rules are only ever kept
+  * in RAM: an import replaces the table in use, and a reset empties it as
+  * it does for rules added by the host.
+  *
+  * Storing erases a flash page, which stalls the CPU; settings are only
+  * written when the host changes them.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_config.h"
+#include "app_restore.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint8_t address;                            /* Serial link, applied by the communications handler */
+  uint8_t bus;
+  uint16_t failsafe_ms;
+  uint8_t failsafe_scene;
+  uint8_t light_groups[CONFIG_LIGHT_GROUPS];  /* Masks of the lights */
+  uint16_t bus_groups;                        /* Multicast groups joined */
+  uint8_t power_on;                           /* Applied through the restore module */
+  uint8_t power_on_scene;
+  uint8_t stop_mode;                          /* Read by the idle task (app_power.c) */
+} Config_Held_t;
+
+/* Whole configuration as exported, checked as one before any of it is used */
+typedef struct {
+  uint32_t magic;                             /* CONFIG_EXPORT_MAGIC */
+  uint8_t config_version;                     /* Layouts of the sections, as stored */
+  uint8_t calibration_version;
+  uint8_t scene_version;
+  uint8_t scene_mask;                         /* Scenes saved, bit 0 for scene 1 */
+  uint16_t size;                              /* Whole export, this header included */
+  uint8_t rule_version;
+  uint8_t macro_version;
+  uint32_t crc;                               /* CRC-32 of everything after the header */
+  Config_Settings_t settings;
+  AnalogCalibration calibrations[VAL_LIGHT_COUNT];
+  Config_Scene_t scenes[CONFIG_SCENE_COUNT];  /* Zero if not saved */
+  uint8_t rule_count;                         /* Rules in the table, in order */
+  Rules_Rule_t rules[RULES_MAX];              /* Zero past the rule count */
+  uint8_t macro_mask;                         /* Macros saved, bit 0 for macro 1 */
+  Config_Macro_t macros[CONFIG_MACRO_COUNT];  /* Zero if not saved */
+} Config_Export_t;
+
+/* Private define ------------------------------------------------------------*/
+#define CONFIG_EXPORT_MAGIC   0x58454643U     /* "CFEX" */
+#define CONFIG_EXPORT_HEADER  offsetof(Config_Export_t, settings)
+
+_Static_assert(sizeof(Config_Settings_t) <= VAL_DATA_STORE_CONFIG_MAX, "Settings exceed the largest record");
+_Static_assert(sizeof(Config_Export_t) <= UINT16_MAX, "Configuration export too large for its size field");
+_Static_assert(CONFIG_SCENE_COUNT <= 8, "Scene mask of the export too narrow");
+_Static_assert(RULES_MAX <= UINT8_MAX, "Rule count of the export too narrow");
+_Static_assert(CONFIG_MACRO_COUNT <= 8, "Macro mask of the export too narrow");
+_Static_assert(sizeof(Config_Macro_t) <= VAL_DATA_STORE_CONFIG_MAX, "Macro exceeds the largest record");
+
+/* Private variables ---------------------------------------------------------*/
+/* Scenes in flash, NULL if never saved, and the store layout they were found in */
+static const Config_Scene_t* volatile scenes[CONFIG_SCENE_COUNT];
+static volatile uint32_t scenes_generation = 0;
+
+/* Command macros in flash, NULL if never saved, as the scenes */
+static const Config_Macro_t* volatile macros[CONFIG_MACRO_COUNT];
+static volatile uint32_t macros_generation = 0;
+
+/* Settings kept in use here, two slots switched by held */
+static Config_Held_t held_slots[2];
+static const Config_Held_t* volatile held = &held_slots[0];
+
+/* Settings collected since Config_Begin, until committed or aborted */
+static Config_Settings_t staged;
+static volatile bool staging = false;
+
+/* Snapshot read by Config_Export, and an import being received */
+static Config_Export_t exported;
+static Config_Export_t imported;
+static uint16_t imported_length = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static VAL_Status Config_Collect(Config_Settings_t* settings);
+static VAL_Status Config_Check(const Config_Settings_t* settings);
+static VAL_Status Config_Apply(const Config_Settings_t* settings);
+static VAL_Status Config_RefreshLimits(void);
+static VAL_Status Config_ValidateScene(const Config_Scene_t* data);
+static void Config_MapScene(uint8_t scene);
+static void Config_MapScenes(void);
+static VAL_Status Config_ValidateMacro(const Config_Macro_t* data);
+static void Config_MapMacro(uint8_t macro);
+static void Config_MapMacros(void);
+static void Config_ApplyPowerOn(void);
+static VAL_Status Config_ImportAll(const Config_Export_t* blob);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Apply the settings stored in flash, if any
+ * @note   Called by the coordinator once the LED driver is initialized
+ * @retval VAL_Status: VAL_OK; the defaults stay in use if nothing valid is stored
+ */
+VAL_Status Config_Init(void) {
+  Config_Settings_t stored;
+  AnalogCalibration calibration;
+  uint8_t calibrated = 0;
+
+  Config_MapScenes();
+  Config_MapMacros();
+
+  /* Colour mixing starts from the nominal primaries */
+  if (Color_Init() != VAL_OK) {
+    return VAL_ERROR;
+  }
+
+  /* Calibrations first, the limits are converted with them */
+  for (uint8_t i = 1; i <= VAL_LIGHT_COUNT; i++) {
+    if (VAL_DataStore_LoadCalibration(i, CONFIG_CALIBRATION_VERSION, &calibration,
+                                      sizeof(calibration)) == VAL_OK &&
+        VAL_Analog_SetCalibration(i, &calibration) == VAL_OK) {
+      calibrated = 1;
+    }
+  }
+
+  if (VAL_DataStore_LoadConfig(CONFIG_VERSION, &stored, sizeof(stored)) != VAL_OK) {
+    if (calibrated) {
+      Config_RefreshLimits();
+    }
+    /* A record left by older settings must not bring lights up */
+    Config_ApplyPowerOn();
+    return VAL_OK;
+  }
+
+  /* A record written by a build with other rules is ignored */
+  Config_Apply(&stored);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the settings in use, or those staged
+ * @param  settings: Pointer to store the settings
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if settings is NULL
+ */
+VAL_Status Config_Get(Config_Settings_t* settings) {
+  if (settings == NULL) {
+    return VAL_PARAM;
+  }
+
+  if (staging) {
+    *settings = staged;
+    return VAL_OK;
+  }
+
+  return Config_Collect(settings);
+}
+
+/**
+ * @brief  Apply new settings and store them in flash, or stage them
+ * @param  settings: New settings
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         applied but not stored
+ */
+VAL_Status Config_Set(const Config_Settings_t* settings) {
+  VAL_Status status;
+
+  if (settings == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* Ranges are checked now, what takes applying to check at the commit */
+  if (staging) {
+    status = Config_Check(settings);
+    if (status == VAL_OK) {
+      staged = *settings;
+    }
+    return status;
+  }
+
+  status = Config_Apply(settings);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  return VAL_DataStore_SaveConfig(CONFIG_VERSION, settings, sizeof(*settings));
+}
+
+/**
+ * @brief  Start staging changes, from the settings in use
+ * @retval VAL_Status: VAL_OK if successful, VAL_BUSY if already staging
+ */
+VAL_Status Config_Begin(void) {
+  if (staging) {
+    return VAL_BUSY;
+  }
+
+  Config_Collect(&staged);
+  staging = true;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Apply the staged settings at once and store them with one write
+ * @note   Refused settings stay staged, to be corrected or aborted
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if nothing is staged or
+ *         the settings are invalid, VAL_ERROR if applied but not stored
+ */
+VAL_Status Config_Commit(void) {
+  VAL_Status status;
+
+  if (!staging) {
+    return VAL_PARAM;
+  }
+
+  status = Config_Apply(&staged);
+  if (status != VAL_OK) {
+    return status;
+  }
+  staging = false;
+
+  return VAL_DataStore_SaveConfig(CONFIG_VERSION, &staged, sizeof(staged));
+}
+
+/**
+ * @brief  Drop the staged settings, the ones in use stay
+ * @retval None
+ */
+void Config_Abort(void) {
+  staging = false;
+}
+
+/**
+ * @brief  Check whether changes are being staged
+ * @retval bool: true between Config_Begin and Config_Commit or Config_Abort
+ */
+bool Config_IsStaging(void) {
+  return staging;
+}
+
+/**
+ * @brief  Get the lights of a light group
+ * @param  group: Group number (1-CONFIG_LIGHT_GROUPS)
+ * @param  mask: Pointer to store the lights, bit 0 for light 1
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid or the group
+ *         has no lights
+ */
+VAL_Status Config_GetLightGroup(uint8_t group, uint32_t* mask) {
+  const Config_Held_t* in_use = held;
+
+  if (mask == NULL || group < 1 || group > CONFIG_LIGHT_GROUPS || in_use->light_groups[group - 1] == 0) {
+    return VAL_PARAM;
+  }
+
+  *mask = in_use->light_groups[group - 1];
+  return VAL_OK;
+}
+
+/**
+ * @brief  Check whether the settings in use let the MCU enter stop mode
+ * @note   Called from the idle task with interrupts disabled
+ * @retval bool: true if enabled with config/set_stop_mode
+ */
+bool Config_IsStopModeEnabled(void) {
+  return held->stop_mode != 0;
+}
+
+/**
+ * @brief  Get the sensor calibration of a light
+ * @param  light_id: Light ID (1-VAL_LIGHT_COUNT)
+ * @param  calibration: Pointer to store the calibration
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status Config_GetCalibration(uint8_t light_id, AnalogCalibration* calibration) {
+  return VAL_Analog_GetCalibration(light_id, calibration);
+}
+
+/**
+ * @brief  Apply a new sensor calibration to a light and store it in flash
+ * @param  light_id: Light ID (1-VAL_LIGHT_COUNT)
+ * @param  calibration: New calibration
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         applied but not stored
+ */
+VAL_Status Config_SetCalibration(uint8_t light_id, const AnalogCalibration* calibration) {
+  VAL_Status status;
+
+  status = VAL_Analog_SetCalibration(light_id, calibration);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  status = Config_RefreshLimits();
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  return VAL_DataStore_SaveCalibration(light_id, CONFIG_CALIBRATION_VERSION,
+                                       calibration, sizeof(*calibration));
+}
+
+/**
+ * @brief  Get a scene, read in place from its flash record
+ * @note   The record was checked when mapped; it is only looked for again
+ *         after the store has been compacted
+ * @param  scene: Scene number (1-CONFIG_SCENE_COUNT)
+ * @param  data: Pointer to store the scene
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR if the scene was never
+ *         saved, VAL_PARAM if invalid
+ */
+VAL_Status Config_GetScene(uint8_t scene, Config_Scene_t* data) {
+  if (scene < 1 || scene > CONFIG_SCENE_COUNT || data == NULL) {
+    return VAL_PARAM;
+  }
+
+  if (scenes_generation != VAL_DataStore_GetGeneration()) {
+    Config_MapScenes();
+  }
+
+  /* Records are never changed in place, a new save only moves the pointer */
+  const Config_Scene_t* stored = scenes[scene - 1];
+  if (stored == NULL) {
+    return VAL_ERROR;
+  }
+
+  *data = *stored;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Save a scene and store it in flash
+ * @param  scene: Scene number (1-CONFIG_SCENE_COUNT)
+ * @param  data: New scene
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         not stored, the previous scene stays in use
+ */
+VAL_Status Config_SetScene(uint8_t scene, const Config_Scene_t* data) {
+  VAL_Status status;
+
+  if (scene < 1 || scene > CONFIG_SCENE_COUNT || data == NULL) {
+    return VAL_PARAM;
+  }
+
+  status = Config_ValidateScene(data);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  status = VAL_DataStore_SaveScene(scene, CONFIG_SCENE_VERSION, data, sizeof(*data));
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* A compaction moved all scenes, an append only this one */
+  if (scenes_generation != VAL_DataStore_GetGeneration()) {
+    Config_MapScenes();
+  } else {
+    Config_MapScene(scene);
+  }
+
+  if (held->power_on == RESTORE_SCENE && scene == held->power_on_scene) {
+    Config_ApplyPowerOn();
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get a command macro, read in place from its flash record
+ * @note   As Config_GetScene
+ * @param  macro: Macro number (1-CONFIG_MACRO_COUNT)
+ * @param  data: Pointer to store the macro
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR if the macro was never
+ *         saved or is cleared, VAL_PARAM if invalid
+ */
+VAL_Status Config_GetMacro(uint8_t macro, Config_Macro_t* data) {
+  if (macro < 1 || macro > CONFIG_MACRO_COUNT || data == NULL) {
+    return VAL_PARAM;
+  }
+
+  if (macros_generation != VAL_DataStore_GetGeneration()) {
+    Config_MapMacros();
+  }
+
+  const Config_Macro_t* stored = macros[macro - 1];
+  if (stored == NULL || stored->length == 0) {
+    return VAL_ERROR;
+  }
+
+  *data = *stored;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Save a command macro and store it in flash
+ * @param  macro: Macro number (1-CONFIG_MACRO_COUNT)
+ * @param  data: New macro, a length of 0 clears it
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         not stored, the previous macro stays in use
+ */
+VAL_Status Config_SetMacro(uint8_t macro, const Config_Macro_t* data) {
+  VAL_Status status;
+
+  if (macro < 1 || macro > CONFIG_MACRO_COUNT || data == NULL) {
+    return VAL_PARAM;
+  }
+
+  status = Config_ValidateMacro(data);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  status = VAL_DataStore_SaveMacro(macro, CONFIG_MACRO_VERSION, data, sizeof(*data));
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  if (macros_generation != VAL_DataStore_GetGeneration()) {
+    Config_MapMacros();
+  } else {
+    Config_MapMacro(macro);
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Check a rule, and that the scene, macro or curve it names exist
+ * @param  rule: Rule to check
+ * @retval VAL_Status: VAL_OK if it can be added, VAL_PARAM if invalid
+ */
+VAL_Status Config_CheckRule(const Rules_Rule_t* rule) {
+  /* The actions must be able to run when the rule fires */
+  if (rule == NULL || (rule->action == RULES_ACTION_SCENE && rule->scene > CONFIG_SCENE_COUNT) ||
+      (rule->action == RULES_ACTION_MACRO && rule->macro > CONFIG_MACRO_COUNT) ||
+      (rule->action == RULES_ACTION_FADE && rule->curve >= LED_DRIVER_FADE_CURVE_COUNT)) {
+    return VAL_PARAM;
+  }
+
+  return Rules_Check(rule);
+}
+
+/**
+ * @brief  Read part of an export of the whole configuration
+ * @note   Offset 0 takes a new snapshot of the settings in use, the
+ *         calibrations, the saved scenes and macros and the rules; later
+ *         offsets read from it, so the parts fit together even if the
+ *         configuration changes between them
+ * @param  offset: Byte offset into the export
+ * @param  data: Buffer to store the bytes
+ * @param  max: Size of the buffer
+ * @param  length: Pointer to store the bytes read, 0 past the end
+ * @param  size: Pointer to store the size of the whole export
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid or no
+ *         snapshot was taken
+ */
+VAL_Status Config_Export(uint32_t offset, uint8_t* data, uint16_t max, uint16_t* length, uint16_t* size) {
+  if (data == NULL || length == NULL || size == NULL) {
+    return VAL_PARAM;
+  }
+
+  if (offset == 0) {
+    /* Zeroed first, so padding and unsaved scenes do not change the CRC */
+    memset(&exported, 0, sizeof(exported));
+    if (Config_Collect(&exported.settings) != VAL_OK) {
+      return VAL_ERROR;
+    }
+    for (uint8_t i = 1; i <= VAL_LIGHT_COUNT; i++) {
+      VAL_Analog_GetCalibration(i, &exported.calibrations[i - 1]);
+    }
+    for (uint8_t i = 1; i <= CONFIG_SCENE_COUNT; i++) {
+      if (Config_GetScene(i, &exported.scenes[i - 1]) == VAL_OK) {
+        exported.scene_mask |= (uint8_t)(1U << (i - 1));
+      }
+    }
+    for (uint8_t i = 1; i <= CONFIG_MACRO_COUNT; i++) {
+      if (Config_GetMacro(i, &exported.macros[i - 1]) == VAL_OK) {
+        exported.macro_mask |= (uint8_t)(1U << (i - 1));
+      }
+    }
+    /* Rules may be added from another task meanwhile */
+    taskENTER_CRITICAL();
+    while (Rules_GetRule(exported.rule_count, &exported.rules[exported.rule_count]) == VAL_OK) {
+      exported.rule_count++;
+    }
+    taskEXIT_CRITICAL();
+    exported.magic = CONFIG_EXPORT_MAGIC;
+    exported.config_version = CONFIG_VERSION;
+    exported.calibration_version = CONFIG_CALIBRATION_VERSION;
+    exported.scene_version = CONFIG_SCENE_VERSION;
+    exported.rule_version = RULES_VERSION;
+    exported.macro_version = CONFIG_MACRO_VERSION;
+    exported.size = sizeof(exported);
+    exported.crc = VAL_Crc_Compute(VAL_CRC_32, (const uint8_t*)&exported + CONFIG_EXPORT_HEADER,
+                                   sizeof(exported) - CONFIG_EXPORT_HEADER);
+  }
+
+  if (exported.magic != CONFIG_EXPORT_MAGIC || offset > exported.size) {
+    return VAL_PARAM;
+  }
+
+  *length = (exported.size - offset < max) ? (uint16_t)(exported.size - offset) : max;
+  memcpy(data, (const uint8_t*)&exported + offset, *length);
+  *size = exported.size;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Receive part of an export, and import it once complete
+ * @note   Parts are received in RAM in order, offset 0 starting over. The
+ *         last one checks the whole export, then applies and stores it;
+ *         nothing is changed if any of it is refused. Scenes and macros
+ *         not saved in the export are left as they are; its rules replace
+ *         the table.
+ * @param  offset: Byte offset of the part, the bytes received so far
+ * @param  data: Bytes of the part
+ * @param  length: Number of bytes
+ * @param  received: Pointer to store the bytes received, the whole export
+ *         once imported
+ * @param  complete: Pointer to store true if this was the last part,
+ *         whether or not the export was imported
+ * @retval VAL_Status: VAL_OK if received or imported, VAL_PARAM if out of
+ *         order or the export is invalid, VAL_BUSY if settings are staged,
+ *         VAL_ERROR if imported but not all of it stored
+ */
+VAL_Status Config_Import(uint32_t offset, const uint8_t* data, uint16_t length, uint16_t* received, bool* complete) {
+  if ((data == NULL && length > 0) || received == NULL || complete == NULL) {
+    return VAL_PARAM;
+  }
+
+  if (offset == 0) {
+    imported_length = 0;
+  }
+  *received = imported_length;
+  *complete = false;
+
+  if (offset != imported_length || length > sizeof(imported) - offset) {
+    return VAL_PARAM;
+  }
+
+  memcpy((uint8_t*)&imported + offset, data, length);
+  imported_length += length;
+  *received = imported_length;
+
+  /* A header from another build is refused before the rest is sent */
+  if (imported_length >= CONFIG_EXPORT_HEADER &&
+      (imported.magic != CONFIG_EXPORT_MAGIC || imported.size != sizeof(imported) ||
+       imported.config_version != CONFIG_VERSION ||
+       imported.calibration_version != CONFIG_CALIBRATION_VERSION ||
+       imported.scene_version != CONFIG_SCENE_VERSION || imported.rule_version != RULES_VERSION ||
+       imported.macro_version != CONFIG_MACRO_VERSION)) {
+    imported_length = 0;
+    return VAL_PARAM;
+  }
+
+  if (imported_length < sizeof(imported)) {
+    return VAL_OK;
+  }
+
+  imported_length = 0;
+  *complete = true;
+  return Config_ImportAll(&imported);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Check the ranges of settings, without applying them
+ * @note   The scale, limits, primaries and ageing curves are checked by
+ *         their modules when applied, the trims here as well so staged
+ *         ones are refused at once
+ * @param  settings: Settings to check
+ * @retval VAL_Status: VAL_OK if in range, VAL_PARAM otherwise
+ */
+static VAL_Status Config_Check(const Config_Settings_t* settings) {
+  if (settings->sample_phase_permille >= VAL_PWM_PERMILLE_MAX ||
+      settings->address > CONFIG_ADDRESS_MAX || settings->bus > 1 ||
+      settings->failsafe_scene > CONFIG_SCENE_COUNT ||
+      (settings->bus_groups >> CONFIG_BUS_GROUPS) != 0 ||
+      settings->power_on >= RESTORE_MODE_COUNT || settings->power_on_scene > CONFIG_SCENE_COUNT ||
+      (settings->power_on == RESTORE_SCENE && settings->power_on_scene == 0) ||
+      settings->stop_mode > 1) {
+    return VAL_PARAM;
+  }
+  for (uint8_t i = 0; i < CONFIG_LIGHT_GROUPS; i++) {
+    if ((settings->light_groups[i] & ~CONFIG_LIGHTS_ALL) != 0) {
+      return VAL_PARAM;
+    }
+  }
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (settings->slew_permille_per_ms[i] > VAL_PWM_SLEW_MAX ||
+        settings->trim_permille[i] < LED_DRIVER_TRIM_MIN_PERMILLE ||
+        settings->trim_permille[i] > LED_DRIVER_TRIM_MAX_PERMILLE) {
+      return VAL_PARAM;
+    }
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Gather the settings in use from the modules they configure
+ * @param  settings: Pointer to store the settings
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+static VAL_Status Config_Collect(Config_Settings_t* settings) {
+  const Config_Held_t* in_use = held;
+
+  VAL_Analog_GetScale(&settings->current_ma_per_mv, &settings->temperature_cdeg_per_mv);
+  settings->sample_phase_permille = LED_Driver_GetSamplePhase();
+  settings->address = in_use->address;
+  settings->bus = in_use->bus;
+  settings->failsafe_ms = in_use->failsafe_ms;
+  settings->failsafe_scene = in_use->failsafe_scene;
+  memcpy(settings->light_groups, in_use->light_groups, sizeof(settings->light_groups));
+  settings->bus_groups = in_use->bus_groups;
+  settings->power_on = in_use->power_on;
+  settings->power_on_scene = in_use->power_on_scene;
+  settings->stop_mode = in_use->stop_mode;
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    settings->slew_permille_per_ms[i] = VAL_PWM_GetSlewLimit(i + 1);
+  }
+  Color_GetPrimaries(settings->primaries);
+  LED_Driver_GetAgeing(settings->ageing);
+  LED_Driver_GetTrims(settings->trim_permille);
+  return LED_Driver_GetLimits(settings->limits);
+}
+
+/**
+ * @brief  Apply settings, leaving the previous ones in use if any is invalid
+ * @note   The scale goes first, the limits are converted to counts with it
+ * @param  settings: Settings to apply
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+ */
+static VAL_Status Config_Apply(const Config_Settings_t* settings) {
+  Config_Held_t* next = (held == &held_slots[0]) ? &held_slots[1] : &held_slots[0];
+  uint16_t current_scale;
+  uint16_t temperature_scale;
+  VAL_Status status;
+
+  status = Config_Check(settings);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* Checked and built as a whole, nothing else is changed when refused */
+  status = Color_SetPrimaries(settings->primaries);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  VAL_Analog_GetScale(&current_scale, &temperature_scale);
+
+  status = VAL_Analog_SetScale(settings->current_ma_per_mv, settings->temperature_cdeg_per_mv);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  status = LED_Driver_SetLimits(settings->limits);
+  if (status != VAL_OK) {
+    VAL_Analog_SetScale(current_scale, temperature_scale);
+    return status;
+  }
+
+  status = LED_Driver_SetSamplePhase(settings->sample_phase_permille);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  status = LED_Driver_SetAgeing(settings->ageing);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  status = LED_Driver_SetTrims(settings->trim_permille);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    VAL_PWM_SetSlewLimit(i + 1, settings->slew_permille_per_ms[i]);
+  }
+
+  next->address = settings->address;
+  next->bus = settings->bus;
+  next->failsafe_ms = settings->failsafe_ms;
+  next->failsafe_scene = settings->failsafe_scene;
+  memcpy(next->light_groups, settings->light_groups, sizeof(next->light_groups));
+  next->bus_groups = settings->bus_groups;
+  next->power_on = settings->power_on;
+  next->power_on_scene = settings->power_on_scene;
+  next->stop_mode = settings->stop_mode;
+  held = next;
+  Config_ApplyPowerOn();
+  return VAL_OK;
+}
+
+/**
+ * @brief  Hand the power-on mode to the restore module
+ * @note   A power-on scene never saved brings all lights up off
+ * @retval None
+ */
+static void Config_ApplyPowerOn(void) {
+  const Config_Held_t* in_use = held;
+  Config_Scene_t data;
+
+  if (in_use->power_on == RESTORE_SCENE && Config_GetScene(in_use->power_on_scene, &data) == VAL_OK) {
+    Restore_SetMode(RESTORE_SCENE, in_use->power_on_scene, data.permille);
+  } else {
+    Restore_SetMode((Restore_Mode_t)in_use->power_on, in_use->power_on_scene, NULL);
+  }
+}
+
+/**
+ * @brief  Check that a scene can be applied
+ * @param  data: Scene to check
+ * @retval VAL_Status: VAL_OK if valid, VAL_PARAM otherwise
+ */
+static VAL_Status Config_ValidateScene(const Config_Scene_t* data) {
+  if (data->duration_ms > LED_DRIVER_FADE_MAX_MS || data->curve >= LED_DRIVER_FADE_CURVE_COUNT) {
+    return VAL_PARAM;
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (data->permille[i] > VAL_PWM_PERMILLE_MAX) {
+      return VAL_PARAM;
+    }
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Find the stored record of a scene and check it
+ * @param  scene: Scene number (1-CONFIG_SCENE_COUNT)
+ * @retval None
+ */
+static void Config_MapScene(uint8_t scene) {
+  const void* record;
+
+  if (VAL_DataStore_MapScene(scene, CONFIG_SCENE_VERSION, sizeof(Config_Scene_t), &record) == VAL_OK &&
+      Config_ValidateScene((const Config_Scene_t*)record) == VAL_OK) {
+    scenes[scene - 1] = (const Config_Scene_t*)record;
+  } else {
+    scenes[scene - 1] = NULL;
+  }
+}
+
+/**
+ * @brief  Find the stored records of all scenes, after start-up or a compaction
+ * @note   A pointer into the page compacted from stays readable until the
+ *         next compaction, so a recall racing this reads an intact scene
+ * @retval None
+ */
+static void Config_MapScenes(void) {
+  uint32_t generation = VAL_DataStore_GetGeneration();
+
+  for (uint8_t i = 1; i <= CONFIG_SCENE_COUNT; i++) {
+    Config_MapScene(i);
+  }
+  scenes_generation = generation;
+}
+
+/**
+ * @brief  Check that the commands of a macro are framed as a batch body
+ * @param  data: Macro to check
+ * @retval VAL_Status: VAL_OK if valid, VAL_PARAM otherwise
+ */
+static VAL_Status Config_ValidateMacro(const Config_Macro_t* data) {
+  uint16_t pos = 0;
+  uint8_t steps = 0;
+
+  if (data->length > CONFIG_MACRO_BYTES) {
+    return VAL_PARAM;
+  }
+
+  /* Code and argument length, then the arguments */
+  while (pos + 2U <= data->length) {
+    pos += 2U + data->commands[pos + 1U];
+    steps++;
+  }
+
+  return (pos == data->length && steps == data->steps) ? VAL_OK : VAL_PARAM;
+}
+
+/**
+ * @brief  Find the stored record of a command macro and check it
+ * @param  macro: Macro number (1-CONFIG_MACRO_COUNT)
+ * @retval None
+ */
+static void Config_MapMacro(uint8_t macro) {
+  const void* record;
+
+  if (VAL_DataStore_MapMacro(macro, CONFIG_MACRO_VERSION, sizeof(Config_Macro_t), &record) == VAL_OK &&
+      Config_ValidateMacro((const Config_Macro_t*)record) == VAL_OK) {
+    macros[macro - 1] = (const Config_Macro_t*)record;
+  } else {
+    macros[macro - 1] = NULL;
+  }
+}
+
+/**
+ * @brief  Find the stored records of all command macros, after start-up or
+ *         a compaction
+ * @retval None
+ */
+static void Config_MapMacros(void) {
+  uint32_t generation = VAL_DataStore_GetGeneration();
+
+  for (uint8_t i = 1; i <= CONFIG_MACRO_COUNT; i++) {
+    Config_MapMacro(i);
+  }
+  macros_generation = generation;
+}
+
+/**
+ * @brief  Convert the alarm limits in use to counts again
+ * @note   Needed after a calibration change, as after a scale change
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+static VAL_Status Config_RefreshLimits(void) {
+  LED_Driver_Limits_t limits[VAL_LIGHT_COUNT];
+
+  if (LED_Driver_GetLimits(limits) != VAL_OK || LED_Driver_SetLimits(limits) != VAL_OK) {
+    return VAL_ERROR;
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Check a received export, then apply and store all of it
+ * @note   Calibrations go first, the limits of the settings are converted
+ *         with them; if the settings are refused the calibrations in use
+ *         before are put back. The rules, checked with the rest, then
+ *         replace the table; they are not stored. Only records that differ
+ *         from those stored are written.
+ * @param  blob: Complete export, header checked
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid, VAL_BUSY if
+ *         settings are staged, VAL_ERROR if applied but not all stored
+ */
+static VAL_Status Config_ImportAll(const Config_Export_t* blob) {
+  AnalogCalibration previous[VAL_LIGHT_COUNT];
+  Config_Scene_t scene;
+  Config_Macro_t macro;
+  VAL_Status status = VAL_OK;
+  uint8_t light = 0;
+
+  if (staging) {
+    return VAL_BUSY;
+  }
+
+  if (VAL_Crc_Compute(VAL_CRC_32, (const uint8_t*)blob + CONFIG_EXPORT_HEADER,
+                      sizeof(*blob) - CONFIG_EXPORT_HEADER) != blob->crc ||
+      Config_Check(&blob->settings) != VAL_OK) {
+    return VAL_PARAM;
+  }
+  for (uint8_t i = 0; i < CONFIG_SCENE_COUNT; i++) {
+    if ((blob->scene_mask & (1U << i)) && Config_ValidateScene(&blob->scenes[i]) != VAL_OK) {
+      return VAL_PARAM;
+    }
+  }
+  if (blob->rule_count > RULES_MAX) {
+    return VAL_PARAM;
+  }
+  for (uint8_t i = 0; i < blob->rule_count; i++) {
+    if (Config_CheckRule(&blob->rules[i]) != VAL_OK) {
+      return VAL_PARAM;
+    }
+  }
+  for (uint8_t i = 0; i < CONFIG_MACRO_COUNT; i++) {
+    if ((blob->macro_mask & (1U << i)) && Config_ValidateMacro(&blob->macros[i]) != VAL_OK) {
+      return VAL_PARAM;
+    }
+  }
+
+  for (uint8_t i = 1; i <= VAL_LIGHT_COUNT; i++) {
+    VAL_Analog_GetCalibration(i, &previous[i - 1]);
+  }
+  while (light < VAL_LIGHT_COUNT && VAL_Analog_SetCalibration(light + 1, &blob->calibrations[light]) == VAL_OK) {
+    light++;
+  }
+  if (light < VAL_LIGHT_COUNT || Config_Apply(&blob->settings) != VAL_OK) {
+    for (uint8_t i = 1; i <= VAL_LIGHT_COUNT; i++) {
+      VAL_Analog_SetCalibration(i, &previous[i - 1]);
+    }
+    Config_RefreshLimits();
+    return VAL_PARAM;
+  }
+
+  /* Replaced whole, the coordinator evaluates the table on every sample */
+  taskENTER_CRITICAL();
+  (void)Rules_Clear();
+  for (uint8_t i = 0; i < blob->rule_count; i++) {
+    (void)Rules_Add(&blob->rules[i]);
+  }
+  taskEXIT_CRITICAL();
+
+  /* Applied as a whole; each record below replaces its own once written */
+  for (uint8_t i = 1; i <= VAL_LIGHT_COUNT; i++) {
+    if (memcmp(&previous[i - 1], &blob->calibrations[i - 1], sizeof(previous[0])) != 0 &&
+        VAL_DataStore_SaveCalibration(i, CONFIG_CALIBRATION_VERSION, &blob->calibrations[i - 1],
+                                      sizeof(blob->calibrations[0])) != VAL_OK) {
+      status = VAL_ERROR;
+    }
+  }
+  for (uint8_t i = 1; i <= CONFIG_SCENE_COUNT; i++) {
+    if ((blob->scene_mask & (1U << (i - 1))) &&
+        (Config_GetScene(i, &scene) != VAL_OK || memcmp(&scene, &blob->scenes[i - 1], sizeof(scene)) != 0) &&
+        Config_SetScene(i, &blob->scenes[i - 1]) != VAL_OK) {
+      status = VAL_ERROR;
+    }
+  }
+  for (uint8_t i = 1; i <= CONFIG_MACRO_COUNT; i++) {
+    if ((blob->macro_mask & (1U << (i - 1))) &&
+        (Config_GetMacro(i, &macro) != VAL_OK || memcmp(&macro, &blob->macros[i - 1], sizeof(macro)) != 0) &&
+        Config_SetMacro(i, &blob->macros[i - 1]) != VAL_OK) {
+      status = VAL_ERROR;
+    }
+  }
+  if (VAL_DataStore_SaveConfig(CONFIG_VERSION, &blob->settings, sizeof(blob->settings)) != VAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  return status;
+}
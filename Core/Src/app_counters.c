@@ -0,0 +1,205 @@
+/**
+  ******************************************************************************
+  * @file    app_counters.c
+  * @brief   Application layer reset-survivable event counters
+  ******************************************************************************
+  * @attention
+  *
+  * Boots, watchdog resets, alarm trips and link drops are counted over the
+  * life of the device. They change far more often than flash should be
+  * written, so the counters live in the RTC backup registers, which keep
+  * their values through resets: counting is a register write. A checksum
+  * register after them tells valid counters from a cleared backup domain.
+  *
+  * The error log task folds the counters into the data store with the
+  * usage checkpoint, only when they changed. When the supply goes the
+  * backup registers are lost; at the next start-up the stored counters are
+  * added to what was counted since, so at most one checkpoint interval of
+  * events is lost.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_counters.h"
+#include "val.h"
+#include "stm32l4xx_hal.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define COUNTERS_BACKUP_FIRST    0U                /* Backup register of the first counter */
+#define COUNTERS_BACKUP_CHECK    (COUNTERS_BACKUP_FIRST + COUNTERS_COUNT)
+#define COUNTERS_MAGIC           0x544E4443U       /* "CDNT" */
+#define COUNTERS_FNV_BASIS       2166136261U
+#define COUNTERS_FNV_PRIME       16777619U
+
+_Static_assert(COUNTERS_BACKUP_CHECK < VAL_RTC_BACKUP_COUNT, "Too many counters for the backup registers");
+
+/* Private variables ---------------------------------------------------------*/
+static const char* const counter_names[COUNTERS_COUNT] = {
+  [COUNTERS_BOOTS]           = "boots",
+  [COUNTERS_WATCHDOG_RESETS] = "watchdog_resets",
+  [COUNTERS_ALARM_TRIPS]     = "alarm_trips",
+  [COUNTERS_LINK_DROPS]      = "link_drops",
+};
+
+/* Mirrors the backup registers, which the checksum is computed from */
+static volatile uint32_t counters[COUNTERS_COUNT];
+
+/* The backup registers held valid counters at start-up */
+static bool retained = false;
+
+/* Counters last stored; error log task only after start-up */
+static uint32_t counters_saved[COUNTERS_COUNT];
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t Counters_Checksum(const volatile uint32_t* values);
+static void Counters_WriteBackup(void);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Take over the counters kept in the RTC backup registers and count the boot
+ * @note   Called right after VAL_Init, before anything counts
+ * @retval None
+ */
+void Counters_Init(void) {
+  for (uint8_t i = 0; i < COUNTERS_COUNT; i++) {
+    counters[i] = VAL_RTC_ReadBackup(COUNTERS_BACKUP_FIRST + i);
+  }
+
+  retained = (VAL_RTC_ReadBackup(COUNTERS_BACKUP_CHECK) == Counters_Checksum(counters));
+  if (!retained) {
+    memset((void*)counters, 0, sizeof(counters));
+  }
+
+  Counters_Increment(COUNTERS_BOOTS);
+}
+
+/**
+ * @brief  Add the stored counters if the backup registers were lost
+ * @note   Called once the data store runs. Backup registers that survived
+ *         are at least as recent as the store, which is only read to tell
+ *         the first checkpoint whether anything changed.
+ * @retval None
+ */
+void Counters_Restore(void) {
+  if (VAL_DataStore_LoadCounters(COUNTERS_VERSION, counters_saved, sizeof(counters_saved)) != VAL_OK) {
+    memset(counters_saved, 0, sizeof(counters_saved));
+    return;
+  }
+
+  if (!retained) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint8_t i = 0; i < COUNTERS_COUNT; i++) {
+      counters[i] += counters_saved[i];
+    }
+    Counters_WriteBackup();
+    __set_PRIMASK(primask);
+    retained = true;
+  }
+}
+
+/**
+ * @brief  Count one event
+ * @note   Safe to call from interrupts, a backup register write
+ * @param  id: Counter to increment
+ * @retval None
+ */
+void Counters_Increment(Counters_Id_t id) {
+  if (id >= COUNTERS_COUNT) {
+    return;
+  }
+
+  /* The counter and the checksum change together */
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  counters[id]++;
+  VAL_RTC_WriteBackup(COUNTERS_BACKUP_FIRST + id, counters[id]);
+  VAL_RTC_WriteBackup(COUNTERS_BACKUP_CHECK, Counters_Checksum(counters));
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Get all counters
+ * @param  values: Array to store the counters, COUNTERS_COUNT entries
+ * @retval None
+ */
+void Counters_GetAll(uint32_t* values) {
+  if (values == NULL) {
+    return;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t i = 0; i < COUNTERS_COUNT; i++) {
+    values[i] = counters[i];
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Get the name of a counter
+ * @param  id: Counter
+ * @retval const char*: Name, "unknown" if out of range
+ */
+const char* Counters_GetName(Counters_Id_t id) {
+  if (id >= COUNTERS_COUNT) {
+    return "unknown";
+  }
+
+  return counter_names[id];
+}
+
+/**
+ * @brief  Store the counters in flash, unless they are the ones stored last
+ * @note   Error log task only, the one that makes background writes
+ * @retval VAL_Status: VAL_OK if stored or unchanged, VAL_BUSY if flash was
+ *         in use, VAL_ERROR if the write failed
+ */
+VAL_Status Counters_Save(void) {
+  uint32_t pending[COUNTERS_COUNT];
+
+  Counters_GetAll(pending);
+  if (memcmp(pending, counters_saved, sizeof(counters_saved)) == 0) {
+    return VAL_OK;
+  }
+
+  VAL_Status status = VAL_DataStore_SaveCounters(COUNTERS_VERSION, pending, sizeof(pending));
+  if (status == VAL_OK) {
+    memcpy(counters_saved, pending, sizeof(counters_saved));
+  }
+
+  return status;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Compute the checksum register value of a set of counters
+ * @note   FNV-1a over the words; a cleared backup domain never matches
+ * @param  values: Counters, COUNTERS_COUNT entries
+ * @retval uint32_t: Checksum
+ */
+static uint32_t Counters_Checksum(const volatile uint32_t* values) {
+  uint32_t hash = COUNTERS_FNV_BASIS ^ COUNTERS_MAGIC;
+
+  for (uint8_t i = 0; i < COUNTERS_COUNT; i++) {
+    hash = (hash ^ values[i]) * COUNTERS_FNV_PRIME;
+  }
+
+  return hash;
+}
+
+/**
+ * @brief  Write all counters and their checksum to the backup registers
+ * @note   Interrupts disabled by the caller
+ * @retval None
+ */
+static void Counters_WriteBackup(void) {
+  for (uint8_t i = 0; i < COUNTERS_COUNT; i++) {
+    VAL_RTC_WriteBackup(COUNTERS_BACKUP_FIRST + i, counters[i]);
+  }
+  VAL_RTC_WriteBackup(COUNTERS_BACKUP_CHECK, Counters_Checksum(counters));
+}
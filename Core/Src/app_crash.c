@@ -0,0 +1,303 @@
+/**
+  ******************************************************************************
+  * @file    app_crash.c
+  * @brief   Application layer crash capture for post-mortem analysis
+  ******************************************************************************
+  * @attention
+  *
+  * A fault, a failed configASSERT or a stack overflow writes a report to
+  * RAM2 that the startup code does not initialize, and resets at once
+  * instead of spinning until the watchdog expires. After the restart the
+  * report is read back with system/crash_report; it is kept for one run.
+  *
+  * The report holds the exception frame and the SCB fault registers, the
+  * task that was running, the least free stack of every task and the last
+  * CRASH_TRACE_ENTRIES commands and alarms. Nothing is collected before a
+  * crash: the task list is kept by the FreeRTOS create and delete trace
+  * hooks, and the stack figures come from the fill pattern at crash time.
+  *
+  * The fault handlers are naked and branch to Crash_FaultEntry, which takes
+  * the frame from MSP or PSP as EXC_RETURN says. A frame outside RAM, e.g.
+  * after a stack pointer overrun, is not read. The report is marked valid
+  * before the task stacks are walked, so a fault while walking them, which
+  * locks the core up until the watchdog resets it, still leaves the rest.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_crash.h"
+#include "app_logger.h"
+#include "val.h"
+#include "task.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define CRASH_RECORD_MAGIC   0x48535243U  /* "CRSH" */
+
+/* Stacks are in SRAM1 or in the SRAM2 alias that follows it */
+#define CRASH_RAM_START      SRAM1_BASE
+#define CRASH_RAM_END        (SRAM1_BASE + SRAM1_SIZE_MAX + SRAM2_SIZE)
+
+#define CRASH_FRAME_WORDS    8U      /* R0-R3, R12, LR, PC, xPSR */
+#define CRASH_FRAME_FPU      0x68U   /* Frame with the FPU registers */
+#define CRASH_EXC_FRAME      0x10U   /* EXC_RETURN bit, set without FPU registers */
+#define CRASH_EXC_THREAD     0x08U   /* EXC_RETURN bit, set when returning to a task */
+#define CRASH_XPSR_ALIGN     0x200U  /* xPSR bit, set if the frame was padded */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint32_t magic;            /* CRASH_RECORD_MAGIC if report is valid */
+  Crash_Report_t report;
+} Crash_Record_t;
+
+/* Private variables ---------------------------------------------------------*/
+/* Survives the reset done after a crash */
+static Crash_Record_t crash_record __attribute__((section(".noinit")));
+
+/* The record was valid at start-up; a new crash overwrites it and resets */
+static bool crash_valid = false;
+
+/* Tasks created and not deleted, kept by the trace hooks */
+static TaskHandle_t crash_tasks[RESOURCES_MAX_TASKS];
+static uint8_t crash_task_count = 0;
+
+static const char* const cause_names[CRASH_CAUSE_COUNT] = {
+  "none",
+  "assert",
+  "stack_overflow",
+  "hard_fault",
+  "mem_fault",
+  "bus_fault",
+  "usage_fault"
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void Crash_Fault(const uint32_t* frame, uint32_t exc_return) __attribute__((used, noreturn));
+static void Crash_Finish(Crash_Cause_t cause, uint32_t line) __attribute__((noreturn));
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Take over the crash report left by the previous run
+ * @note   Logs the crash; the record is marked read, so it is reported for
+ *         one run only
+ * @retval VAL_Status: VAL_OK
+ */
+VAL_Status Crash_Init(void) {
+  Crash_Report_t* report = &crash_record.report;
+
+  crash_valid = (crash_record.magic == CRASH_RECORD_MAGIC &&
+                 report->cause > CRASH_CAUSE_NONE && report->cause < CRASH_CAUSE_COUNT &&
+                 report->task_count <= RESOURCES_MAX_TASKS &&
+                 report->trace_count <= CRASH_TRACE_ENTRIES);
+  crash_record.magic = 0;
+
+  if (crash_valid) {
+    report->task[sizeof(report->task) - 1] = '\0';
+    for (uint8_t i = 0; i < report->task_count; i++) {
+      report->tasks[i].name[sizeof(report->tasks[i].name) - 1] = '\0';
+    }
+    Logger_Log(LOGGER_LEVEL_ERROR, LOGGER_MSG_CRASH,
+               (uint32_t)Crash_GetCauseName((Crash_Cause_t)report->cause), report->pc);
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the crash that caused the last reset
+ * @retval const Crash_Report_t*: Report, NULL if the last reset was not a crash
+ */
+const Crash_Report_t* Crash_GetReport(void) {
+  return crash_valid ? &crash_record.report : NULL;
+}
+
+/**
+ * @brief  Get the protocol name of a crash cause
+ * @param  cause: Cause
+ * @retval const char*: Cause name, "unknown" for invalid values
+ */
+const char* Crash_GetCauseName(Crash_Cause_t cause) {
+  if (cause >= CRASH_CAUSE_COUNT) {
+    return "unknown";
+  }
+
+  return cause_names[cause];
+}
+
+/**
+ * @brief  Record a failed configASSERT and reset
+ * @note   The caller's address stands in for the faulting instruction
+ * @param  line: Source line of the assert
+ * @retval None
+ */
+void Crash_Assert(uint32_t line) {
+  Crash_Report_t* report = &crash_record.report;
+
+  __disable_irq();
+
+  memset(report->r, 0, sizeof(report->r));
+  report->lr = 0;
+  report->pc = (uint32_t)__builtin_return_address(0);
+  report->xpsr = __get_xPSR();
+  report->sp = (__get_CONTROL() & CONTROL_SPSEL_Msk) ? __get_PSP() : __get_MSP();
+  report->in_handler = (__get_IPSR() != 0U) ? 1U : 0U;
+
+  Crash_Finish(CRASH_CAUSE_ASSERT, line);
+}
+
+/**
+ * @brief  Record a stack overflow of the running task and reset
+ * @note   Called from the FreeRTOS stack overflow hook, in the context switch
+ *         before the task is switched out
+ * @retval None
+ */
+void Crash_StackOverflow(void) {
+  Crash_Report_t* report = &crash_record.report;
+
+  __disable_irq();
+
+  memset(report->r, 0, sizeof(report->r));
+  report->lr = 0;
+  report->pc = 0;
+  report->xpsr = 0;
+  report->sp = __get_PSP();
+  report->in_handler = 0;
+
+  Crash_Finish(CRASH_CAUSE_STACK_OVERFLOW, 0);
+}
+
+/**
+ * @brief  Fault entry, picks the stack the exception frame is on
+ * @note   Entered by a branch from the naked fault handlers, with LR still
+ *         holding EXC_RETURN
+ * @retval None
+ */
+#ifdef SIMULATION
+void Crash_FaultEntry(void) {
+  /* No exception frame on the host (Sim/) */
+  Crash_Fault(NULL, 0);
+}
+#else
+__attribute__((naked)) void Crash_FaultEntry(void) {
+  __asm volatile (
+    "tst lr, #4        \n"
+    "ite eq            \n"
+    "mrseq r0, msp     \n"
+    "mrsne r0, psp     \n"
+    "mov r1, lr        \n"
+    "b Crash_Fault     \n"
+  );
+}
+#endif
+
+/**
+ * @brief  Add a task to those whose stack use is recorded
+ * @note   traceTASK_CREATE hook, called inside a kernel critical section;
+ *         tasks beyond RESOURCES_MAX_TASKS are not recorded
+ * @param  task: Task handle
+ * @retval None
+ */
+void Crash_TaskCreated(void* task) {
+  if (crash_task_count < RESOURCES_MAX_TASKS) {
+    crash_tasks[crash_task_count++] = (TaskHandle_t)task;
+  }
+}
+
+/**
+ * @brief  Remove a deleted task
+ * @note   traceTASK_DELETE hook, called inside a kernel critical section
+ * @param  task: Task handle
+ * @retval None
+ */
+void Crash_TaskDeleted(void* task) {
+  for (uint8_t i = 0; i < crash_task_count; i++) {
+    if (crash_tasks[i] == (TaskHandle_t)task) {
+      crash_tasks[i] = crash_tasks[--crash_task_count];
+      return;
+    }
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Record a fault from its exception frame and reset
+ * @param  frame: Exception frame on the stack in use when the fault occurred
+ * @param  exc_return: EXC_RETURN of the fault handler
+ * @retval None
+ */
+static void Crash_Fault(const uint32_t* frame, uint32_t exc_return) {
+  Crash_Report_t* report = &crash_record.report;
+  uint32_t address = (uint32_t)frame;
+  uint32_t cause = __get_IPSR() & IPSR_ISR_Msk;
+
+  __disable_irq();
+
+  if (address >= CRASH_RAM_START && address <= CRASH_RAM_END - CRASH_FRAME_WORDS * 4U) {
+    memcpy(report->r, frame, sizeof(report->r));
+    report->lr = frame[5];
+    report->pc = frame[6];
+    report->xpsr = frame[7];
+    report->sp = address + ((exc_return & CRASH_EXC_FRAME) ? CRASH_FRAME_WORDS * 4U : CRASH_FRAME_FPU) +
+                 ((report->xpsr & CRASH_XPSR_ALIGN) ? 4U : 0U);
+  } else {
+    memset(report->r, 0, sizeof(report->r));
+    report->lr = 0;
+    report->pc = 0;
+    report->xpsr = 0;
+    report->sp = address;
+  }
+  report->in_handler = (exc_return & CRASH_EXC_THREAD) ? 0U : 1U;
+
+  if (cause < CRASH_CAUSE_HARD_FAULT || cause >= CRASH_CAUSE_COUNT) {
+    cause = CRASH_CAUSE_HARD_FAULT;
+  }
+  Crash_Finish((Crash_Cause_t)cause, 0);
+}
+
+/**
+ * @brief  Complete the report and reset
+ * @note   Called with interrupts disabled and the frame registers stored
+ * @param  cause: Cause of the crash
+ * @param  line: Source line of an assert, else 0
+ * @retval None
+ */
+static void Crash_Finish(Crash_Cause_t cause, uint32_t line) {
+  Crash_Report_t* report = &crash_record.report;
+  uint32_t next = Trace_GetNext();
+
+  report->cause = (uint8_t)cause;
+  report->line = line;
+  report->tick_ms = HAL_GetTick();
+  report->cfsr = SCB->CFSR;
+  report->hfsr = SCB->HFSR;
+  report->mmfar = SCB->MMFAR;
+  report->bfar = SCB->BFAR;
+
+  report->task[0] = '\0';
+  if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) {
+    strncpy(report->task, pcTaskGetName(NULL), sizeof(report->task) - 1);
+    report->task[sizeof(report->task) - 1] = '\0';
+  }
+
+  report->trace_count = Trace_Read((next > CRASH_TRACE_ENTRIES) ? next - CRASH_TRACE_ENTRIES : 0,
+                                   report->trace, CRASH_TRACE_ENTRIES, &report->trace_first);
+
+  /* Valid from here on; the stack walk below may fault on a corrupted task */
+  report->task_count = 0;
+  crash_record.magic = CRASH_RECORD_MAGIC;
+
+  for (uint8_t i = 0; i < crash_task_count; i++) {
+    Resources_Task_t* task = &report->tasks[i];
+
+    strncpy(task->name, pcTaskGetName(crash_tasks[i]), sizeof(task->name) - 1);
+    task->name[sizeof(task->name) - 1] = '\0';
+    task->stack_free = (uint32_t)uxTaskGetStackHighWaterMark(crash_tasks[i]) * sizeof(StackType_t);
+    report->task_count++;
+  }
+
+  __DSB();
+  NVIC_SystemReset();
+}
@@ -0,0 +1,217 @@
+/**
+  ******************************************************************************
+  * @file    app_effect.c
+  * @brief   Application layer waveform generators for light effects
+  ******************************************************************************
+  * @attention
+  *
+  * An effect modulates the lights between a crest and a trough with a
+  * periodic waveform, computed one row at a time as the PWM plays the rows
+  * (see LED_Driver_StartEffect). A row costs a few integer operations, so
+  * an effect may run for as long as it likes without a task or a timer:
+  *
+  * - The position in the period is a 32-bit phase accumulator, advanced by
+  *   the row time over the period, so it wraps on its own and long periods
+  *   keep their rate to a part in 2^32.
+  * - The sine is a quarter wave of 65 entries, mirrored for the other
+  *   quadrants and interpolated, within 0.05% of the full scale.
+  * - The triangle and the square follow from the phase directly; the square
+  *   is on while the phase is under the width.
+  * - Flicker draws a random dip per row from a xorshift generator, squared
+  *   so that small dips are common and deep ones rare, and smooths the
+  *   dips with a first-order filter whose time constant is the period.
+  *
+  * Every waveform starts at its crest, so an effect starts where the lights
+  * are asked to be.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_effect.h"
+#include <stddef.h>
+
+/* Private define ------------------------------------------------------------*/
+#define EFFECT_SINE_ENTRIES   65U          /* Quarter wave, both ends included */
+#define EFFECT_SINE_ONE       32767        /* Full scale of the table */
+#define EFFECT_QUARTER        0x40000000UL /* Phase of a quarter period */
+#define EFFECT_HALF           0x80000000UL
+#define EFFECT_NOISE_SEED     0x2545F491UL
+#define EFFECT_NOISE_BITS     10U          /* Resolution of a flicker dip */
+
+/* Private variables ---------------------------------------------------------*/
+/* sin(pi/2 * i/64) in Q15 */
+static const int16_t sine_quarter[EFFECT_SINE_ENTRIES] = {
+      0,   804,  1608,  2410,  3212,  4011,  4808,  5602,
+   6393,  7179,  7962,  8739,  9512, 10278, 11039, 11793,
+  12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+  18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+  23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+  27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+  30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+  32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+  32767,
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static int32_t Effect_Sine(uint32_t phase);
+static uint16_t Effect_Flicker(Effect_Generator_t* generator);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Check an effect configuration
+ * @param  config: Effect to check
+ * @retval VAL_Status: VAL_OK if it can be played, VAL_PARAM otherwise
+ */
+VAL_Status Effect_Validate(const Effect_Config_t* config) {
+  if (config == NULL || config->shape == EFFECT_SHAPE_OFF || config->shape >= EFFECT_SHAPE_COUNT ||
+      config->period_us < EFFECT_PERIOD_MIN_US || config->period_us > EFFECT_PERIOD_MAX_US ||
+      config->width_us > config->period_us || config->depth_permille > EFFECT_UNITY) {
+    return VAL_PARAM;
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Start a generator at the crest of an effect
+ * @param  generator: Generator to start
+ * @param  config: Effect to generate
+ * @param  row_ns: Time each row of output lasts, in nanoseconds
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status Effect_Start(Effect_Generator_t* generator, const Effect_Config_t* config, uint32_t row_ns) {
+  if (generator == NULL || Effect_Validate(config) != VAL_OK || row_ns == 0) {
+    return VAL_PARAM;
+  }
+
+  uint64_t period_ns = (uint64_t)config->period_us * 1000U;
+  if (row_ns > period_ns) {
+    return VAL_PARAM;
+  }
+
+  generator->shape = config->shape;
+  generator->phase = 0;
+  generator->increment = (uint32_t)(((uint64_t)row_ns << 32) / period_ns);
+
+  /* A square as wide as the period stays on */
+  if (config->width_us == 0) {
+    generator->threshold = EFFECT_HALF;
+  } else if (config->width_us == config->period_us) {
+    generator->threshold = UINT32_MAX;
+  } else {
+    generator->threshold = (uint32_t)(((uint64_t)config->width_us << 32) / config->period_us);
+  }
+
+  generator->noise = EFFECT_NOISE_SEED;
+  generator->alpha_q16 = (uint32_t)(((uint64_t)row_ns << 16) / period_ns);
+  generator->level_q16 = (int32_t)(EFFECT_UNITY << 16);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the modulation of the next row and advance by one row
+ * @param  generator: Started generator
+ * @retval uint16_t: Modulation, EFFECT_UNITY at the crest and 0 at the trough
+ */
+uint16_t Effect_Step(Effect_Generator_t* generator) {
+  uint32_t phase = generator->phase;
+  uint16_t modulation;
+
+  switch (generator->shape) {
+    case EFFECT_SHAPE_SINE:
+      /* cos(phase) from 1 down to -1 and back, mapped to 0-1000 */
+      modulation = (uint16_t)(((Effect_Sine(phase + EFFECT_QUARTER) + EFFECT_SINE_ONE) * (int32_t)EFFECT_UNITY +
+                               EFFECT_SINE_ONE) / (2 * EFFECT_SINE_ONE));
+      break;
+
+    case EFFECT_SHAPE_TRIANGLE:
+      if (phase < EFFECT_HALF) {
+        modulation = (uint16_t)(EFFECT_UNITY - (((uint64_t)phase * EFFECT_UNITY) >> 31));
+      } else {
+        modulation = (uint16_t)(((uint64_t)(phase - EFFECT_HALF) * EFFECT_UNITY) >> 31);
+      }
+      break;
+
+    case EFFECT_SHAPE_SQUARE:
+      modulation = (phase < generator->threshold) ? EFFECT_UNITY : 0;
+      break;
+
+    case EFFECT_SHAPE_FLICKER:
+      modulation = Effect_Flicker(generator);
+      break;
+
+    default:
+      modulation = EFFECT_UNITY;
+      break;
+  }
+
+  generator->phase = phase + generator->increment;
+
+  return modulation;
+}
+
+/**
+ * @brief  Get the intensity of a light for a modulation
+ * @param  crest_permille: Intensity at the crest (0-1000)
+ * @param  depth_permille: Trough below the crest, in permille of the crest
+ * @param  modulation: Modulation from Effect_Step
+ * @retval uint16_t: Intensity (0-1000)
+ */
+uint16_t Effect_Level(uint16_t crest_permille, uint16_t depth_permille, uint16_t modulation) {
+  uint32_t swing = ((uint32_t)crest_permille * depth_permille + EFFECT_UNITY / 2U) / EFFECT_UNITY;
+  uint32_t trough = crest_permille - swing;
+
+  return (uint16_t)(trough + (swing * modulation + EFFECT_UNITY / 2U) / EFFECT_UNITY);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Sine of a phase from the quarter-wave table
+ * @param  phase: Full circle 2^32
+ * @retval int32_t: Sine in Q15, +-EFFECT_SINE_ONE
+ */
+static int32_t Effect_Sine(uint32_t phase) {
+  uint32_t quadrant = phase >> 30;
+  uint32_t offset = phase & (EFFECT_QUARTER - 1U);
+
+  /* The second and fourth quadrants run the table backwards */
+  if (quadrant & 1U) {
+    offset = EFFECT_QUARTER - offset;
+  }
+
+  uint32_t index = offset >> 24;
+  int32_t value = sine_quarter[index];
+  if (index < EFFECT_SINE_ENTRIES - 1U) {
+    int32_t fraction = (int32_t)((offset >> 16) & 0xFFU);
+    value += ((sine_quarter[index + 1U] - value) * fraction) >> 8;
+  }
+
+  return (quadrant & 2U) ? -value : value;
+}
+
+/**
+ * @brief  Advance the flicker of a generator by one row
+ * @param  generator: Started generator
+ * @retval uint16_t: Modulation, EFFECT_UNITY without a dip
+ */
+static uint16_t Effect_Flicker(Effect_Generator_t* generator) {
+  uint32_t noise = generator->noise;
+
+  noise ^= noise << 13;
+  noise ^= noise >> 17;
+  noise ^= noise << 5;
+  generator->noise = noise;
+
+  /* Squared, so most rows dip a little and few dip deep */
+  uint32_t draw = noise >> (32U - EFFECT_NOISE_BITS);
+  uint32_t dip = (draw * draw) >> EFFECT_NOISE_BITS;
+  int32_t target_q16 = (int32_t)((EFFECT_UNITY - ((dip * EFFECT_UNITY) >> EFFECT_NOISE_BITS)) << 16);
+
+  generator->level_q16 += (int32_t)(((int64_t)(target_q16 - generator->level_q16) * generator->alpha_q16) >> 16);
+
+  return (uint16_t)((generator->level_q16 + 0x8000) >> 16);
+}
@@ -0,0 +1,314 @@
+/**
+  ******************************************************************************
+  * @file    app_integrity.c
+  * @brief   Application layer background memory integrity checks
+  ******************************************************************************
+  * @attention
+  *
+  * Three checks run from the FreeRTOS idle hook, a slice at a time, so they
+  * only ever use time no task wants:
+  *
+  * - The firmware image in flash (VAL_Memory_GetImage), INTEGRITY_SLICE_BYTES
+  *   into a CRC-32 per slice. The first complete pass is the reference; a
+  *   later pass with another CRC is a changed image.
+  * - The records of the key/value store (VAL_DataStore_GetKvExtent), the
+  *   same way. A save adds records and a compaction moves them, so a pass
+  *   whose region moved meanwhile is dropped, and a pass over a region not
+  *   seen before becomes the new reference.
+  * - The spare RAM (VAL_Memory_GetSpareRam), INTEGRITY_SLICE_WORDS per
+  *   slice. The first pass writes a pattern, XORed with each word's address
+  *   so address faults show too; every later pass checks the word and
+  *   writes its complement, so every bit is seen to hold both values. A
+  *   changed word is a bit flip, or the interrupt stack grown past its
+  *   reservation.
+  *
+  * The checks take turns, one slice per idle entry. A slice holds the CRC
+  * unit for a few microseconds (val_crc.c); a task that preempts it meanwhile
+  * computes its own CRC in software. No interrupt is masked: the RAM slice
+  * only suspends the scheduler, for the heap break to stay put while its
+  * words are read and written, as malloc runs in tasks only. With tickless
+  * idle the hook runs once per wakeup before the MCU sleeps again, so a
+  * pass takes longer the less often the system wakes.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_integrity.h"
+#include "app_logger.h"
+#include "val.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdbool.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define INTEGRITY_RAM_PATTERN    0xA5C35A3CU  /* Pattern of the first check, complemented per pass */
+#define INTEGRITY_FLASH_CHECKS   2            /* The flash checks come first in Integrity_Check_t */
+
+/* Private typedef -----------------------------------------------------------*/
+/* CRC of a flash region, in parts */
+typedef struct {
+  const uint8_t* start;      /* Region of the pass in progress */
+  size_t length;
+  size_t offset;             /* Bytes done, 0 before the pass starts */
+  uint32_t crc;              /* CRC so far */
+  TickType_t started;
+  bool referenced;           /* A complete pass is the reference */
+  const uint8_t* ref_start;  /* Region of the reference */
+  size_t ref_length;
+  uint32_t reference;
+} Integrity_Flash_t;
+
+/* Pattern test of the spare RAM */
+typedef struct {
+  uint32_t* next;            /* Next word, NULL before the pass starts */
+  uint32_t* floor;           /* Lowest word kept, raised as the heap grows */
+  uint32_t pattern;          /* Expected in this pass, XORed with the address */
+  bool painted;              /* The pattern is in every word */
+  uint32_t changed;          /* Words found changed in this pass */
+  uint32_t first_changed;    /* Address of the first of them */
+  TickType_t started;
+} Integrity_Ram_t;
+
+/* Private variables ---------------------------------------------------------*/
+/* Idle task only */
+static Integrity_Flash_t flash_checks[INTEGRITY_FLASH_CHECKS];
+static Integrity_Ram_t ram_check = { NULL, NULL, INTEGRITY_RAM_PATTERN, false, 0, 0, 0 };
+static uint8_t next_check = 0;
+
+/* Written by the idle task, read by others, with the scheduler suspended */
+static Integrity_Result_t check_results[INTEGRITY_CHECK_COUNT];
+static TickType_t finished[INTEGRITY_CHECK_COUNT];
+
+static const char* const check_names[INTEGRITY_CHECK_COUNT] = {
+  "image",
+  "config",
+  "ram"
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static VAL_Status Integrity_GetRegion(Integrity_Check_t check, const uint8_t** start, size_t* length);
+static void Integrity_StepFlash(Integrity_Check_t check);
+static void Integrity_StepRam(void);
+static void Integrity_Publish(Integrity_Check_t check, size_t bytes, uint32_t crc, uint32_t errors,
+                              TickType_t started);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Get the results of the background checks
+ * @param  results: Array of INTEGRITY_CHECK_COUNT entries to store them
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if results is NULL
+ */
+VAL_Status Integrity_GetResults(Integrity_Result_t* results) {
+  TickType_t ended[INTEGRITY_CHECK_COUNT];
+  TickType_t now;
+
+  if (results == NULL) {
+    return VAL_PARAM;
+  }
+
+  vTaskSuspendAll();
+  memcpy(results, check_results, sizeof(check_results));
+  memcpy(ended, finished, sizeof(ended));
+  now = xTaskGetTickCount();
+  (void)xTaskResumeAll();
+
+  for (uint8_t i = 0; i < INTEGRITY_CHECK_COUNT; i++) {
+    results[i].age_ms = (results[i].passes > 0) ? (uint32_t)(now - ended[i]) * portTICK_PERIOD_MS : 0;
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the name of a check as reported to the host
+ * @param  check: Check to query
+ * @retval const char*: Check name, "unknown" for invalid values
+ */
+const char* Integrity_GetCheckName(Integrity_Check_t check) {
+  if (check >= INTEGRITY_CHECK_COUNT) {
+    return "unknown";
+  }
+
+  return check_names[check];
+}
+
+/**
+ * @brief  FreeRTOS idle hook, runs one slice of the next check
+ * @note   Called by the idle task each time round its loop; must not block
+ * @retval None
+ */
+void vApplicationIdleHook(void) {
+  Integrity_Check_t check = (Integrity_Check_t)next_check;
+
+  next_check = (uint8_t)((next_check + 1U) % INTEGRITY_CHECK_COUNT);
+
+  if (check == INTEGRITY_CHECK_RAM) {
+    Integrity_StepRam();
+  } else {
+    Integrity_StepFlash(check);
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Get the region a flash check covers at present
+ * @param  check: INTEGRITY_CHECK_IMAGE or INTEGRITY_CHECK_CONFIG
+ * @param  start: Pointer to store the first byte
+ * @param  length: Pointer to store the number of bytes
+ * @retval VAL_Status: VAL_OK if there is one, VAL_ERROR otherwise
+ */
+static VAL_Status Integrity_GetRegion(Integrity_Check_t check, const uint8_t** start, size_t* length) {
+  uint16_t records;
+
+  if (check == INTEGRITY_CHECK_IMAGE) {
+    return VAL_Memory_GetImage(start, length);
+  }
+
+  if (VAL_DataStore_GetKvExtent(start, &records) != VAL_OK) {
+    return VAL_ERROR;
+  }
+  *length = records;
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Run one slice of a flash check
+ * @param  check: INTEGRITY_CHECK_IMAGE or INTEGRITY_CHECK_CONFIG
+ * @retval None
+ */
+static void Integrity_StepFlash(Integrity_Check_t check) {
+  Integrity_Flash_t* job = &flash_checks[check];
+  const uint8_t* start;
+  size_t length;
+  size_t count;
+  bool failed = false;
+
+  if (job->offset == 0) {
+    if (Integrity_GetRegion(check, &job->start, &job->length) != VAL_OK || job->length == 0) {
+      return;
+    }
+    job->started = xTaskGetTickCount();
+  }
+
+  count = job->length - job->offset;
+  if (count > INTEGRITY_SLICE_BYTES) {
+    count = INTEGRITY_SLICE_BYTES;
+  }
+  job->crc = (job->offset == 0) ? VAL_Crc_Compute(VAL_CRC_32, job->start, count)
+                                : VAL_Crc_Extend(VAL_CRC_32, job->crc, job->start + job->offset, count);
+  job->offset += count;
+  if (job->offset < job->length) {
+    return;
+  }
+  job->offset = 0;
+
+  /* Records saved or moved during the pass: start again on the new ones */
+  if (Integrity_GetRegion(check, &start, &length) != VAL_OK || start != job->start || length != job->length) {
+    return;
+  }
+
+  if (job->referenced && job->ref_start == job->start && job->ref_length == job->length) {
+    failed = (job->crc != job->reference);
+  } else {
+    job->referenced = true;
+    job->ref_start = job->start;
+    job->ref_length = job->length;
+    job->reference = job->crc;
+  }
+
+  /* Logged once, the count shows whether it stays */
+  if (failed && check_results[check].errors == 0) {
+    LOGGER_LOG(LOGGER_LEVEL_ERROR, LOGGER_MSG_INTEGRITY_FAILED, check_names[check], job->crc);
+  }
+  Integrity_Publish(check, job->length, job->crc, failed ? 1U : 0U, job->started);
+}
+
+/**
+ * @brief  Run one slice of the spare RAM check
+ * @retval None
+ */
+static void Integrity_StepRam(void) {
+  uint32_t* start;
+  uint32_t* end;
+  uint32_t* stop;
+  size_t bytes;
+
+  /* Nothing can take heap while the words are read and written */
+  vTaskSuspendAll();
+  if (VAL_Memory_GetSpareRam(&start, &end) != VAL_OK) {
+    (void)xTaskResumeAll();
+    return;
+  }
+
+  /* Words the heap took are left to it */
+  if (ram_check.floor < start) {
+    ram_check.floor = start;
+  }
+  if (ram_check.next == NULL) {
+    ram_check.next = ram_check.floor;
+    ram_check.changed = 0;
+    ram_check.started = xTaskGetTickCount();
+  } else if (ram_check.next < ram_check.floor) {
+    ram_check.next = ram_check.floor;
+  }
+
+  stop = ram_check.next + INTEGRITY_SLICE_WORDS;
+  if (stop > end) {
+    stop = end;
+  }
+  for (uint32_t* word = ram_check.next; word < stop; word++) {
+    uint32_t expected = ram_check.pattern ^ (uint32_t)(uintptr_t)word;
+
+    if (ram_check.painted && *word != expected) {
+      if (ram_check.changed++ == 0) {
+        ram_check.first_changed = (uint32_t)(uintptr_t)word;
+      }
+    }
+    *word = ~expected;
+  }
+  ram_check.next = stop;
+  (void)xTaskResumeAll();
+
+  if (stop < end) {
+    return;
+  }
+
+  bytes = (size_t)(end - ram_check.floor) * sizeof(uint32_t);
+  if (ram_check.changed > 0 && check_results[INTEGRITY_CHECK_RAM].errors == 0) {
+    LOGGER_LOG(LOGGER_LEVEL_ERROR, LOGGER_MSG_INTEGRITY_FAILED, check_names[INTEGRITY_CHECK_RAM],
+               ram_check.first_changed);
+  }
+  Integrity_Publish(INTEGRITY_CHECK_RAM, bytes, 0, ram_check.changed, ram_check.started);
+
+  ram_check.pattern = ~ram_check.pattern;
+  ram_check.painted = true;
+  ram_check.next = NULL;
+}
+
+/**
+ * @brief  Store the result of a complete pass
+ * @param  check: Check that completed
+ * @param  bytes: Bytes covered
+ * @param  crc: CRC of the pass, 0 for the RAM check
+ * @param  errors: Errors found in the pass
+ * @param  started: Tick count at the start of the pass
+ * @retval None
+ */
+static void Integrity_Publish(Integrity_Check_t check, size_t bytes, uint32_t crc, uint32_t errors,
+                              TickType_t started) {
+  TickType_t now = xTaskGetTickCount();
+
+  vTaskSuspendAll();
+  check_results[check].bytes = (uint32_t)bytes;
+  check_results[check].passes++;
+  check_results[check].errors += errors;
+  check_results[check].crc = crc;
+  check_results[check].pass_ms = (uint32_t)(now - started) * portTICK_PERIOD_MS;
+  finished[check] = now;
+  (void)xTaskResumeAll();
+}
@@ -0,0 +1,227 @@
+/**
+  ******************************************************************************
+  * @file    app_jitter.c
+  * @brief   Application layer control loop period jitter tracker
+  ******************************************************************************
+  * @attention
+  *
+  * The sampling and control loops run once per ADC block, so their period
+  * is set by the scan rate; what varies is when each iteration actually
+  * starts. The adc_block probe of the profiler sees the spread of the
+  * intervals, but not which way they went or how often. This module takes
+  * the start time of every iteration from the microsecond timebase and
+  * compares the interval since the previous one with the nominal period.
+  *
+  * An interval under the period counts as early and one on or over it as
+  * late, each in a log2 histogram of the error: bucket 0 holds errors under
+  * JITTER_FIRST_US, bucket n those under JITTER_FIRST_US << n, and the last
+  * one everything longer. An iteration late by a whole period or more means
+  * blocks were processed together or lost; missed counts those periods.
+  *
+  * Stopping the ADC for stop mode is not a deadline miss, and a restart
+  * after an ADC error is counted with the ADC errors already: the caller
+  * resyncs, and the interval across the gap is not measured. A change of
+  * the scan rate does the same by itself.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_jitter.h"
+#include "val.h"
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  Jitter_Stats_t stats;
+  uint32_t last_us;           /* Start of the previous iteration */
+  uint8_t synced;             /* last_us is valid */
+  uint32_t window_early_us;   /* Worst errors since Jitter_TakeWindow */
+  uint32_t window_late_us;
+} Jitter_Tracker_t;
+
+/* Private variables ---------------------------------------------------------*/
+static Jitter_Tracker_t trackers[JITTER_LOOP_COUNT];
+
+static const char* const loop_names[JITTER_LOOP_COUNT] = {
+  "sampling",
+  "control",
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t Jitter_Bucket(uint32_t error_us);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Initialize the jitter tracker
+ * @retval VAL_Status: VAL_OK
+ */
+VAL_Status Jitter_Init(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  memset(trackers, 0, sizeof(trackers));
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Record the start of a loop iteration
+ * @note   Called from the ADC block interrupt
+ * @param  loop: Loop that started
+ * @param  start_us: VAL_SysClock_GetMicros when it started
+ * @param  period_us: Nominal period of the loop
+ * @retval None
+ */
+void Jitter_Mark(Jitter_Loop_t loop, uint32_t start_us, uint32_t period_us) {
+  Jitter_Tracker_t* tracker;
+  uint32_t interval;
+  uint32_t error;
+
+  if (loop >= JITTER_LOOP_COUNT || period_us == 0) {
+    return;
+  }
+
+  tracker = &trackers[loop];
+  if (!tracker->synced || period_us != tracker->stats.period_us) {
+    tracker->stats.period_us = period_us;
+    tracker->last_us = start_us;
+    tracker->synced = 1;
+    return;
+  }
+
+  interval = start_us - tracker->last_us;
+  tracker->last_us = start_us;
+  tracker->stats.iterations++;
+
+  if (interval < period_us) {
+    error = period_us - interval;
+    tracker->stats.early[Jitter_Bucket(error)]++;
+    if (error > tracker->stats.max_early_us) {
+      tracker->stats.max_early_us = error;
+    }
+    if (error > tracker->window_early_us) {
+      tracker->window_early_us = error;
+    }
+  } else {
+    error = interval - period_us;
+    tracker->stats.late[Jitter_Bucket(error)]++;
+    if (error > tracker->stats.max_late_us) {
+      tracker->stats.max_late_us = error;
+    }
+    if (error > tracker->window_late_us) {
+      tracker->window_late_us = error;
+    }
+    tracker->stats.missed += error / period_us;
+  }
+}
+
+/**
+ * @brief  Forget the last start of every loop, after the loops were stopped
+ * @retval None
+ */
+void Jitter_Resync(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  for (uint8_t i = 0; i < JITTER_LOOP_COUNT; i++) {
+    trackers[i].synced = 0;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Get the figures of a loop
+ * @param  loop: Loop to query
+ * @param  stats: Pointer to store the figures
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status Jitter_GetStats(Jitter_Loop_t loop, Jitter_Stats_t* stats) {
+  uint32_t primask;
+
+  if (loop >= JITTER_LOOP_COUNT || stats == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  *stats = trackers[loop].stats;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the worst errors of a loop since the previous call and clear them
+ * @param  loop: Loop to query
+ * @param  window: Pointer to store the figures
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status Jitter_TakeWindow(Jitter_Loop_t loop, Jitter_Window_t* window) {
+  Jitter_Tracker_t* tracker;
+  uint32_t primask;
+
+  if (loop >= JITTER_LOOP_COUNT || window == NULL) {
+    return VAL_PARAM;
+  }
+
+  tracker = &trackers[loop];
+  primask = __get_PRIMASK();
+  __disable_irq();
+  window->max_early_us = (tracker->window_early_us > UINT16_MAX) ? UINT16_MAX : (uint16_t)tracker->window_early_us;
+  window->max_late_us = (tracker->window_late_us > UINT16_MAX) ? UINT16_MAX : (uint16_t)tracker->window_late_us;
+  window->missed = tracker->stats.missed;
+  tracker->window_early_us = 0;
+  tracker->window_late_us = 0;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Clear the figures of all loops
+ * @note   The periods and last starts are kept, so the next interval counts
+ * @retval None
+ */
+void Jitter_Reset(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  for (uint8_t i = 0; i < JITTER_LOOP_COUNT; i++) {
+    uint32_t period_us = trackers[i].stats.period_us;
+
+    memset(&trackers[i].stats, 0, sizeof(trackers[i].stats));
+    trackers[i].stats.period_us = period_us;
+    trackers[i].window_early_us = 0;
+    trackers[i].window_late_us = 0;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Get the name of a loop
+ * @param  loop: Loop
+ * @retval const char*: Name, "unknown" for an invalid loop
+ */
+const char* Jitter_GetLoopName(Jitter_Loop_t loop) {
+  if (loop >= JITTER_LOOP_COUNT) {
+    return "unknown";
+  }
+
+  return loop_names[loop];
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Find the histogram bucket of a period error
+ * @param  error_us: Error in microseconds
+ * @retval uint32_t: Bucket index
+ */
+static uint32_t Jitter_Bucket(uint32_t error_us) {
+  uint32_t bucket = 32U - __CLZ(error_us / JITTER_FIRST_US);
+
+  return (bucket < JITTER_BUCKET_COUNT) ? bucket : (JITTER_BUCKET_COUNT - 1U);
+}
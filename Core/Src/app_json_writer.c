@@ -0,0 +1,246 @@
+/**
+  ******************************************************************************
+  * @file    app_json_writer.c
+  * @brief   Application layer JSON text writer
+  ******************************************************************************
+  * @attention
+  *
+  * This module formats JSON responses and events without snprintf. Numbers
+  * are converted with integer arithmetic only; fixed-point values are scaled
+  * once and then printed as two integers.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_json_writer.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define JSON_WRITER_MAX_DECIMALS      6
+
+/* Private variables ---------------------------------------------------------*/
+static const uint32_t decimal_scale[JSON_WRITER_MAX_DECIMALS + 1] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/* Private function prototypes -----------------------------------------------*/
+static void JSON_Writer_Digits(JSON_Writer_t* writer, uint32_t value, uint8_t min_digits);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Start writing into a buffer
+  * @param  writer: Writer to initialize
+  * @param  buffer: Destination buffer
+  * @param  size: Size of the destination buffer
+  * @retval None
+  */
+void JSON_Writer_Init(JSON_Writer_t* writer, char* buffer, size_t size) {
+  writer->buffer = buffer;
+  writer->size = size;
+  writer->length = 0;
+  writer->overflow = false;
+}
+
+/**
+  * @brief  Append raw bytes, e.g. a constant JSON fragment
+  * @param  writer: Writer
+  * @param  text: Bytes to append
+  * @param  length: Number of bytes
+  * @retval None
+  */
+void JSON_Writer_Append(JSON_Writer_t* writer, const char* text, size_t length) {
+  if (writer->overflow || length > writer->size - writer->length) {
+    writer->overflow = true;
+    return;
+  }
+
+  memcpy(&writer->buffer[writer->length], text, length);
+  writer->length += length;
+}
+
+/**
+  * @brief  Append a single character
+  * @param  writer: Writer
+  * @param  c: Character to append
+  * @retval None
+  */
+void JSON_Writer_Char(JSON_Writer_t* writer, char c) {
+  if (writer->overflow || writer->length >= writer->size) {
+    writer->overflow = true;
+    return;
+  }
+
+  writer->buffer[writer->length++] = c;
+}
+
+/**
+  * @brief  Append the escaped contents of a string, without quotes
+  * @note   Quotes, backslashes and control characters are escaped; other
+  *         bytes, including UTF-8 sequences, are copied unchanged.
+  * @param  writer: Writer
+  * @param  str: NUL terminated string
+  * @retval None
+  */
+void JSON_Writer_Text(JSON_Writer_t* writer, const char* str) {
+  const char* run = str;
+
+  for (; *str != '\0'; str++) {
+    uint8_t c = (uint8_t)*str;
+
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+
+    /* Copy the plain run before the character in one go */
+    JSON_Writer_Append(writer, run, (size_t)(str - run));
+    run = str + 1;
+
+    if (c == '"' || c == '\\') {
+      char escape[2] = { '\\', (char)c };
+      JSON_Writer_Append(writer, escape, sizeof(escape));
+    } else {
+      char escape[6] = { '\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0x0F] };
+      JSON_Writer_Append(writer, escape, sizeof(escape));
+    }
+  }
+
+  JSON_Writer_Append(writer, run, (size_t)(str - run));
+}
+
+/**
+  * @brief  Append a quoted and escaped string value
+  * @param  writer: Writer
+  * @param  str: NUL terminated string
+  * @retval None
+  */
+void JSON_Writer_String(JSON_Writer_t* writer, const char* str) {
+  JSON_Writer_Char(writer, '"');
+  JSON_Writer_Text(writer, str);
+  JSON_Writer_Char(writer, '"');
+}
+
+/**
+  * @brief  Append an unsigned integer
+  * @param  writer: Writer
+  * @param  value: Value to append
+  * @retval None
+  */
+void JSON_Writer_Uint(JSON_Writer_t* writer, uint32_t value) {
+  JSON_Writer_Digits(writer, value, 1);
+}
+
+/**
+  * @brief  Append a 64-bit unsigned integer
+  * @param  writer: Writer
+  * @param  value: Value to append
+  * @retval None
+  */
+void JSON_Writer_Uint64(JSON_Writer_t* writer, uint64_t value) {
+  if (value <= UINT32_MAX) {
+    JSON_Writer_Digits(writer, (uint32_t)value, 1);
+    return;
+  }
+
+  /* Nine digits at a time; the upper part needs at most one more step */
+  uint64_t upper = value / 1000000000U;
+  JSON_Writer_Uint64(writer, upper);
+  JSON_Writer_Digits(writer, (uint32_t)(value - upper * 1000000000U), 9);
+}
+
+/**
+  * @brief  Append a signed integer
+  * @param  writer: Writer
+  * @param  value: Value to append
+  * @retval None
+  */
+void JSON_Writer_Int(JSON_Writer_t* writer, int32_t value) {
+  if (value < 0) {
+    JSON_Writer_Char(writer, '-');
+    /* Negate in unsigned arithmetic, INT32_MIN has no positive counterpart */
+    JSON_Writer_Digits(writer, 0U - (uint32_t)value, 1);
+  } else {
+    JSON_Writer_Digits(writer, (uint32_t)value, 1);
+  }
+}
+
+/**
+  * @brief  Append true or false
+  * @param  writer: Writer
+  * @param  value: Value to append
+  * @retval None
+  */
+void JSON_Writer_Bool(JSON_Writer_t* writer, bool value) {
+  if (value) {
+    JSON_Writer_Literal(writer, "true");
+  } else {
+    JSON_Writer_Literal(writer, "false");
+  }
+}
+
+/**
+  * @brief  Append a number with a fixed count of decimals, rounded
+  * @note   Values whose scaled magnitude does not fit 32 bits, NaN and
+  *         infinities are written as null, which JSON can represent.
+  * @param  writer: Writer
+  * @param  value: Value to append
+  * @param  decimals: Number of decimals (0-6)
+  * @retval None
+  */
+void JSON_Writer_Fixed(JSON_Writer_t* writer, float value, uint8_t decimals) {
+  uint32_t scale;
+  float scaled;
+  uint32_t magnitude;
+  bool negative;
+
+  if (decimals > JSON_WRITER_MAX_DECIMALS) {
+    decimals = JSON_WRITER_MAX_DECIMALS;
+  }
+  scale = decimal_scale[decimals];
+
+  negative = (value < 0.0f);
+  scaled = (negative ? -value : value) * (float)scale + 0.5f;
+
+  /* Also false for NaN */
+  if (!(scaled < 4294967040.0f)) {
+    JSON_Writer_Literal(writer, "null");
+    return;
+  }
+
+  magnitude = (uint32_t)scaled;
+  if (negative && magnitude != 0) {
+    JSON_Writer_Char(writer, '-');
+  }
+
+  JSON_Writer_Digits(writer, magnitude / scale, 1);
+  if (decimals > 0) {
+    JSON_Writer_Char(writer, '.');
+    JSON_Writer_Digits(writer, magnitude % scale, decimals);
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Append the decimal digits of a value
+  * @param  writer: Writer
+  * @param  value: Value to append
+  * @param  min_digits: Minimum number of digits, padded with leading zeros
+  * @retval None
+  */
+static void JSON_Writer_Digits(JSON_Writer_t* writer, uint32_t value, uint8_t min_digits) {
+  char digits[10];
+  uint8_t count = 0;
+
+  /* Digits are produced least significant first */
+  do {
+    digits[sizeof(digits) - 1 - count] = (char)('0' + (value % 10));
+    value /= 10;
+    count++;
+  } while (value != 0 || count < min_digits);
+
+  JSON_Writer_Append(writer, &digits[sizeof(digits) - count], count);
+}
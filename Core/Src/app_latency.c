@@ -0,0 +1,261 @@
+/**
+  ******************************************************************************
+  * @file    app_latency.c
+  * @brief   Application layer command latency histograms
+  ******************************************************************************
+  * @attention
+  *
+  * The profiler keeps min/max/average per probe, which hides the tail: the
+  * rare response that waits out the TX timeout disappears in the average.
+  * This module keeps a log2 histogram instead, one per command table entry
+  * from the frame received to its response queued, and one per transport
+  * from the response queued to its last byte sent.
+  *
+  * Bucket 0 holds measurements under LATENCY_FIRST_US, bucket n those under
+  * LATENCY_FIRST_US << n, and the last one everything longer. Counts
+  * saturate at 65535; the host reads them often enough with reset-on-read.
+  * A percentile is reported as the upper bound of the bucket it falls in,
+  * so it is at most a factor of two high, and never above the maximum.
+  *
+  * A response is timed on the transport by the byte counts of the transport:
+  * it is sent once as many bytes have gone out as had been queued with it.
+  * One response is timed at a time; one queued while another is still in
+  * flight counts for its command only.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_latency.h"
+#include "val.h"
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint16_t buckets[LATENCY_BUCKET_COUNT];
+  uint32_t max_us;
+} Latency_Histogram_t;
+
+/* Private variables ---------------------------------------------------------*/
+static Latency_Histogram_t commands[LATENCY_COMMAND_SLOTS];
+static Latency_Histogram_t transports[TRANSPORT_COUNT];
+
+/* Response being timed on the transport */
+static volatile uint8_t tx_pending = 0;
+static uint8_t tx_transport;
+static uint32_t tx_start;            /* Cycle counter when queued */
+static uint32_t tx_mark;             /* Transport bytes queued up to its end */
+
+/* Private function prototypes -----------------------------------------------*/
+static void Latency_Add(Latency_Histogram_t* histogram, uint32_t elapsed);
+static VAL_Status Latency_Take(Latency_Histogram_t* histogram, Latency_Summary_t* summary);
+static uint32_t Latency_Percentile(const Latency_Histogram_t* histogram, uint32_t count, uint32_t percent);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Initialize the latency histograms
+ * @retval VAL_Status: VAL_OK
+ */
+VAL_Status Latency_Init(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  memset(commands, 0, sizeof(commands));
+  memset(transports, 0, sizeof(transports));
+  tx_pending = 0;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Record the time from a command frame received to its response queued
+ * @param  slot: Command table index of the command
+ * @param  elapsed: Duration in cycles
+ * @retval None
+ */
+void Latency_RecordCommand(uint8_t slot, uint32_t elapsed) {
+  if (slot >= LATENCY_COMMAND_SLOTS) {
+    return;
+  }
+
+  Latency_Add(&commands[slot], elapsed);
+}
+
+/**
+ * @brief  Note that a response was just queued on the active transport
+ * @note   Ignored while an earlier response is still being timed
+ * @retval None
+ */
+void Latency_ResponseQueued(void) {
+  uint32_t now = VAL_SysClock_GetCycles();
+  uint32_t primask;
+
+  if (tx_pending) {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  tx_transport = (uint8_t)Transport_GetActive();
+  tx_start = now;
+  tx_mark = Transport_GetTxQueued();
+  /* Sent already, before the completion could look for it */
+  if ((int32_t)(Transport_GetTxSent() - tx_mark) >= 0) {
+    Latency_Add(&transports[tx_transport], VAL_SysClock_GetCycles() - now);
+  } else {
+    tx_pending = 1;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Time the queued response once the transport has sent it
+ * @retval None
+ */
+void Latency_TxComplete(void) {
+  if (!tx_pending || (int32_t)(Transport_GetTxSent() - tx_mark) < 0) {
+    return;
+  }
+
+  Latency_Add(&transports[tx_transport], VAL_SysClock_GetCycles() - tx_start);
+  tx_pending = 0;
+}
+
+/**
+ * @brief  Get the figures of a command and clear its histogram
+ * @param  slot: Command table index of the command
+ * @param  summary: Pointer to store the figures
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status Latency_TakeCommand(uint8_t slot, Latency_Summary_t* summary) {
+  if (slot >= LATENCY_COMMAND_SLOTS) {
+    return VAL_PARAM;
+  }
+
+  return Latency_Take(&commands[slot], summary);
+}
+
+/**
+ * @brief  Get the figures of a transport and clear its histogram
+ * @param  id: Transport to query
+ * @param  summary: Pointer to store the figures
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status Latency_TakeTransport(Transport_Id_t id, Latency_Summary_t* summary) {
+  if (id >= TRANSPORT_COUNT) {
+    return VAL_PARAM;
+  }
+
+  return Latency_Take(&transports[id], summary);
+}
+
+/**
+ * @brief  Get the number of measurements of a command since the last read
+ * @param  slot: Command table index of the command
+ * @retval uint32_t: Measurements, 0 for an invalid slot
+ */
+uint32_t Latency_GetCommandCount(uint8_t slot) {
+  uint32_t count = 0;
+
+  if (slot >= LATENCY_COMMAND_SLOTS) {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+    count += commands[slot].buckets[i];
+  }
+
+  return count;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Count a measurement in its bucket
+ * @note   Called from tasks, the TX completion and the RX interrupt
+ * @param  histogram: Histogram to count in
+ * @param  elapsed: Duration in cycles
+ * @retval None
+ */
+static void Latency_Add(Latency_Histogram_t* histogram, uint32_t elapsed) {
+  uint32_t us = VAL_SysClock_CyclesToMicros(elapsed);
+  uint32_t bucket = 32U - __CLZ(us / LATENCY_FIRST_US);
+  uint32_t primask;
+
+  if (bucket >= LATENCY_BUCKET_COUNT) {
+    bucket = LATENCY_BUCKET_COUNT - 1U;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if (histogram->buckets[bucket] != UINT16_MAX) {
+    histogram->buckets[bucket]++;
+  }
+  if (us > histogram->max_us) {
+    histogram->max_us = us;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Summarize a histogram and clear it
+ * @param  histogram: Histogram to read
+ * @param  summary: Pointer to store the figures
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+ */
+static VAL_Status Latency_Take(Latency_Histogram_t* histogram, Latency_Summary_t* summary) {
+  Latency_Histogram_t copy;
+  uint32_t primask;
+
+  if (summary == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* Copy and clear atomically, a measurement may come in from an interrupt */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  copy = *histogram;
+  memset(histogram, 0, sizeof(*histogram));
+  __set_PRIMASK(primask);
+
+  summary->count = 0;
+  for (uint8_t i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+    summary->count += copy.buckets[i];
+  }
+  summary->p50_us = Latency_Percentile(&copy, summary->count, 50);
+  summary->p90_us = Latency_Percentile(&copy, summary->count, 90);
+  summary->p99_us = Latency_Percentile(&copy, summary->count, 99);
+  summary->max_us = copy.max_us;
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Find the bucket a percentile falls in
+ * @param  histogram: Histogram to search
+ * @param  count: Measurements in the histogram
+ * @param  percent: Percentile, 1 to 100
+ * @retval uint32_t: Upper bound of its bucket in microseconds, at most the
+ *         maximum; 0 if there are no measurements
+ */
+static uint32_t Latency_Percentile(const Latency_Histogram_t* histogram, uint32_t count, uint32_t percent) {
+  uint32_t rank = (count * percent + 99U) / 100U;
+  uint32_t seen = 0;
+
+  if (count == 0) {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < LATENCY_BUCKET_COUNT - 1U; i++) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      uint32_t bound = (uint32_t)LATENCY_FIRST_US << i;
+
+      return (bound < histogram->max_us) ? bound : histogram->max_us;
+    }
+  }
+
+  return histogram->max_us;
+}
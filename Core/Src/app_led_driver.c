@@ -3,63 +3,519 @@
   * @file    app_led_driver.c
   * @brief   LED Driver implementation for Wiseled_LBR
   ******************************************************************************
+  * @attention
+  *
+  * Each light has an alarm state machine, stepped from the ADC interrupt on
+  * every completed block so alarms do not depend on how often anything polls:
+  * a limit must be exceeded for trip_samples readings in a row to trip, and a
+  * tripped light is released once both readings stay under the limits minus
+  * the hysteresis for release_samples readings. A released light is cleared
+  * by the host or, with auto_recover, after a backoff that doubles with every
+  * automatic recovery. The hardware over-current cutoffs trip at once: the
+  * ADC watchdogs on a single conversion, the comparators on the lights that
+  * have one through the TIM1 break, which stops all outputs until the
+  * tripped light is turned off and the others are restarted.
+  *
+  * The same readings are checked for plausibility, so a broken sensor is
+  * not taken for an overload: a temperature at a rail, or changing faster
+  * than a light can heat up, and a current that does not follow the PWM
+  * output, raise ERROR_SENSOR_FAULT through the same state machine.
+  *
+  * Before it comes to an over-temperature alarm, thermal derating limits
+  * the output: a PI controller stepped with the alarms on every block holds
+  * each light at its warning temperature by scaling the duty cycle down.
+  * The requested intensity is kept and reported; only the PWM output is
+  * scaled. Derating stops at a floor, so a light that still heats up
+  * reaches the maximum temperature and trips as before. Changing the output
+  * while derating stops a running fade where it is.
+  *
+  * The LED supply cannot deliver every light's maximum current at once, so
+  * a current budget caps their total: when the filtered currents add up to
+  * more than VAL_SUPPLY_CURRENT_MAX_MA, every output is scaled by the same
+  * factor, on top of its derating, and all of them are committed in one PWM
+  * period. The factor follows the draw the lights would have at the full
+  * output, so it falls at once to what the supply delivers and rises back
+  * by BUDGET_RISE_PERMILLE per block as the demand drops. After a change it
+  * holds until the filtered currents have followed.
+  *
+  * The same factor sheds load when the MCU supply sags (val_pvd.c): the
+  * PVD interrupt, raised as VDD falls under VAL_SUPPLY_WARN_MV, cuts it to
+  * SUPPLY_SHED_PERMILLE at once and commits every output past the slew
+  * limits, so the cut lands on the next PWM period. A fade or effect stops
+  * where it is and staged values are dropped; regulated lights drop by the
+  * same ratio and regulate on from there. The factor holds while the
+  * supply stays low and rises as after a budget cut once it recovers.
+  * A strobe is left alone.
+  *
+  * A light can also be regulated to a constant current instead of a fixed
+  * duty cycle: a PID controller stepped after the alarms writes the TIM1
+  * compare value directly, at the full timer resolution, to hold the
+  * filtered current at the target. Its output is clamped to the configured
+  * range, with the derate factor applied to the upper end, and the integral
+  * is clamped to the same range against windup. Any intensity or fade
+  * command and any alarm return the light to open-loop operation. While
+  * another light fades the fade table holds the output, so the controller
+  * pauses until the fade ends.
+  *
+  * In strobe mode the PWM timer fires the lights on an external trigger
+  * edge by itself (val_pwm.c). The continuous outputs are off and cannot be
+  * set meanwhile; alarms still turn a light off. The ADC samples at its
+  * free-running rate while strobing, as the PWM timer no longer runs
+  * periodically. A free-running strobe, repeated by a rate timer instead
+  * of the trigger input, triggers the scans itself from within the
+  * pulses, so the sensor checks compare the currents to the pulse
+  * intensities as they do to continuous ones.
+  *
+  * Intensities can also be staged ahead and committed later, by command or
+  * by an edge on the sync line, to change several devices in the same
+  * moment. The staged values wait in the PWM preload registers
+  * (VAL_PWM_ArmLatch); the intensities reported stay the ones in use until
+  * the commit. Derating and regulation hold meanwhile, and any other output
+  * change, an alarm included, drops the staged values.
+  *
+  * Every block also adds to the usage counters of each light, for
+  * maintenance: the filtered current and the PWM duty cycle, each times the
+  * block length in microseconds, and the time spent above the warning
+  * temperature. 64-bit counts in these units last for centuries at the
+  * largest currents. The block length is the nominal one of the scan rate,
+  * rounded to a microsecond (under 0.02% off at any rate); strobe pulses
+  * are not counted as duty cycle.
+  *
+  * The duty cycle count also drives the ageing compensation: it gives the
+  * hours each light has run at full output, and the ageing curve of the
+  * light the output it has left after them. The on-time that makes up for
+  * the loss becomes the output scale of the PWM channel (val_pwm.c), part
+  * of its curve lookup, so every write costs what it did before. It is
+  * worked out again only when a light crosses into another full-output
+  * hour, and the steady output re-applied then; a fade, strobe or staged
+  * output puts that off to the next check. Regulated lights hold their
+  * current and need none.
+  *
+  * An output trim per light, measured at commissioning, matches it to the
+  * other units of an installation. It multiplies into the same output
+  * scale, so every set, fade, scene and effect is matched at no cost.
+  *
+  * The temperature trend of each light predicts an over-temperature alarm
+  * before it trips: every TREND_POINT_MS of blocks the filtered temperature
+  * is added to a window of TREND_POINTS, and a least squares line through
+  * the window gives the rise rate. The sums of the fit are slid along with
+  * the window in integers, so each point costs the same few operations
+  * and the sums never drift. When the time to the maximum temperature at
+  * that rate falls below LED_DRIVER_THERMAL_HORIZON_MS, a thermal warning
+  * event is raised once; it re-arms as the projection moves past twice the
+  * horizon or the light stops heating up.
+  *
+  * Effects (app_effect.c) modulate the lights with a waveform for as long
+  * as they run, through the fade table played as a loop: the DMA plays one
+  * half of EFFECT_ROWS rows while the loop interrupt computes the other,
+  * two interrupts of a few microseconds per table. Each row is limited to
+  * the slew limit of the light, so a square wave has edges the supply can
+  * take. Derate and budget changes do not stop an effect as they stop a
+  * fade; the rows computed next take them, within one table, and the budget
+  * holds for that long before it looks at the currents again.
+  *
+  * Flicker is measured from the raw current samples of every block, once
+  * per change of the outputs: the first window after an intensity, a
+  * regulated current, the PWM frequency or dithering changes takes the
+  * average of each light, the second its extremes and the area above that
+  * average, all in integer counts. Percent flicker and the flicker index
+  * follow from those once per window; the blocks after that only compare
+  * the settings. The scans sample the PWM period at their own rate, so a
+  * window of many periods covers every phase of it unless the scans are
+  * locked to the PWM (sample_phase), when it only sees slower modulation.
+  *
+  * An emergency blackout (LED_Driver_Blackout) comes from the RX interrupt
+  * of alarm/blackout, ahead of the coordinator queue. In one masked section
+  * it stops a fade or effect, a strobe at the timer, the current loops and
+  * staged values, and writes every compare to zero past its preload, so the
+  * outputs go dark within the running PWM period and nothing driven from an
+  * interrupt turns them on again. Alarms are left as they are.
+  *
+  ******************************************************************************
   */
 
 /* Includes ------------------------------------------------------------------*/
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
 #include "app_led_driver.h"
 #include "val.h"
+#include "app_profiler.h"
+#include "app_trace.h"
+#include "app_counters.h"
+#include "app_jitter.h"
+#include "app_restore.h"
 
 /* Private define ------------------------------------------------------------*/
-#define NUM_LIGHT_SOURCES 3
+#define NUM_LIGHT_SOURCES VAL_LIGHT_COUNT
+#define PERMILLE_PER_PERCENT (VAL_PWM_PERMILLE_MAX / 100)
+
+/* Lower limits, common to all lights. Upper limits and the hardware cutoff
+ * are per light in the board channel table (VAL_Channels). */
+#define LIGHT_CURRENT_MIN_MA   0      /* Minimum allowed current in mA */
+#define LIGHT_TEMP_MIN_CDEG    0      /* Minimum allowed temperature in centi-degrees */
+
+/* Ageing compensation: duty cycle count of one hour at full output, and
+ * the bucket that makes the next check work the scale out again */
+#define AGEING_PERMILLE_US_PER_HOUR  ((uint64_t)VAL_PWM_PERMILLE_MAX * 3600000000ULL)
+#define AGEING_HOURS_NONE            UINT32_MAX
+
+/* Sensor plausibility, common to all lights */
+#define SENSOR_RAIL_DIVIDER        256    /* Within 1/256 of full scale of a rail is stuck */
+#define SENSOR_TEMP_STEP_CDEG      500    /* Largest believable change per block, 5 degrees */
+#define SENSOR_TEMP_STEP_BASE_CDEG 2500   /* Step measured from 25 degrees */
+#define SENSOR_CURRENT_ON_MA       500    /* Current that means the output is on */
+#define SENSOR_CURRENT_OFF_MA      100    /* Current under which a driven output is off */
+#define SENSOR_DUTY_ON_PERMILLE    500    /* Duty cycle that must draw current */
+#define SENSOR_MISMATCH_BLOCKS     25     /* Blocks current and PWM disagree, covers the filter */
+
+/* Default alarm evaluation */
+#define ALARM_TRIP_SAMPLES         3      /* 12 ms at 1 kHz scans */
+#define ALARM_RELEASE_SAMPLES      25     /* 100 ms at 1 kHz scans */
+#define ALARM_HYSTERESIS_PERMILLE  50     /* Release 5% under the limits */
+#define ALARM_HYSTERESIS_MAX       500
+#define ALARM_RECOVER_DELAY_MS     1000
+#define ALARM_RECOVER_MAX_DELAY_MS 60000
+
+/* Default thermal derating */
+#define DERATE_ENABLED             true
+#define DERATE_KP                  100    /* 10% less output per degree over the setpoint */
+#define DERATE_KI                  20     /* And 2% more per degree-second */
+#define DERATE_MIN_PERMILLE        200    /* Lowest derate factor */
+#define DERATE_GAIN_MAX            1000
+#define DERATE_ERROR_MAX_CDEG      10000  /* Errors are clamped to +-100 degrees */
+#define DERATE_UNITY               1000U
+
+/* Supply current budget */
+#define BUDGET_MIN_PERMILLE        100    /* Lowest budget factor, the per-light limits act below */
+#define BUDGET_RISE_PERMILLE       4      /* Largest rise per block, under 1 s from the floor at 1 kHz scans */
+#define BUDGET_SETTLE_BLOCKS       3      /* Blocks the median filter takes to follow a change */
+#define SUPPLY_SHED_PERMILLE       500    /* Budget factor while the MCU supply is under its warning level */
+
+/* Default constant-current regulation. Duty cycles are in 1/65536 of the
+ * period (Q16); 1000 mA of error give 24% proportional output. */
+#define LOOP_INTERVAL_BLOCKS       1      /* Step on every block */
+#define LOOP_KP                    16
+#define LOOP_KI                    1000   /* 1.5% duty per mA-second */
+#define LOOP_KD                    0
+#define LOOP_OUTPUT_MIN_PERMILLE   0
+#define LOOP_OUTPUT_MAX_PERMILLE   1000
+#define LOOP_DUTY_UNITY            0x10000
+
+/* Temperature trend, a 8 s window */
+#define TREND_POINTS               32U
+#define TREND_POINT_US             250000U
+#define TREND_SUM_X                (TREND_POINTS * (TREND_POINTS - 1U) / 2U)
+#define TREND_DENOMINATOR          (TREND_POINTS * TREND_POINTS * (TREND_POINTS * TREND_POINTS - 1U) / 12U)
+
+/* Flicker metrics in these parts of one */
+#define FLICKER_UNITY              10000U
+
+/* Fades are played from a compare table, one row per step */
+#define FADE_STEP_MS           10     /* Preferred step length */
+#define FADE_MAX_STEPS         256    /* Table rows, longer fades use longer steps */
+
+/* Effects loop over the start of the fade table, computed half by half */
+#define EFFECT_ROWS            32U    /* Table rows, two halves */
+#define EFFECT_ROW_US          2000U  /* Preferred row length, a table lasts 64 ms */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint32_t full_scale;      /* ADC full scale the thresholds were computed for */
+  uint32_t current_warn[NUM_LIGHT_SOURCES];
+  uint32_t current_max[NUM_LIGHT_SOURCES];
+  uint32_t current_release[NUM_LIGHT_SOURCES];
+  uint32_t current_min[NUM_LIGHT_SOURCES];
+  uint32_t temp_warn[NUM_LIGHT_SOURCES];
+  uint32_t temp_max[NUM_LIGHT_SOURCES];
+  uint32_t temp_release[NUM_LIGHT_SOURCES];
+  uint32_t temp_min[NUM_LIGHT_SOURCES];
+  uint32_t temp_step[NUM_LIGHT_SOURCES];
+  uint32_t current_on[NUM_LIGHT_SOURCES];
+  uint32_t current_off[NUM_LIGHT_SOURCES];
+  uint32_t rail_margin;     /* Counts from a rail that read as stuck */
+} LED_Driver_Thresholds_t;
+
+/* One evaluation of a light's readings */
+typedef struct {
+  uint8_t violation;        /* ERROR_x of an exceeded limit or sensor fault, 0 if none */
+  bool warning;             /* A warning threshold is exceeded */
+  bool released;            /* Both readings are under the release thresholds */
+} LED_Driver_Reading_t;
+
+typedef struct {
+  LED_Driver_AlarmState_t state;
+  uint8_t pending;          /* Violation being counted towards a trip */
+  uint8_t count;            /* Consecutive readings towards the next transition */
+  uint8_t recoveries;       /* Automatic recoveries in a row, sets the backoff */
+  uint16_t trip_count;      /* Alarms raised since start-up */
+  uint16_t restore_permille;/* Intensity before the trip, restored on recovery */
+  uint32_t tick;            /* Time of the last trip or recovery */
+  uint64_t trip_us;         /* Time of the last trip, microseconds since start-up */
+  uint64_t violation_us;    /* Time of the first reading of the pending violation */
+  uint32_t violation_cycles;/* Cycle counter at the first reading of the pending violation */
+} LED_Driver_AlarmMachine_t;
+
+/* Plausibility state of the inputs of one light */
+typedef struct {
+  uint32_t previous_temp;   /* Temperature counts of the previous block */
+  bool primed;              /* previous_temp holds a reading */
+  uint8_t mismatch;         /* Blocks in a row current and PWM disagreed */
+} LED_Driver_SensorCheck_t;
 
-/* Current limits for each light source in mA */
-#define LIGHT_CURRENT_MAX   25.0f  /* 25A maximum current */
-#define LIGHT_CURRENT_MIN   0.0f    /* Minimum allowed current */
+/* Temperature trend of one light, a sliding least squares fit */
+typedef struct {
+  int32_t points[TREND_POINTS];/* Temperatures in centi-degrees, oldest at head */
+  uint8_t head;
+  uint8_t count;            /* Points in the window, up to TREND_POINTS */
+  int32_t sum_y;            /* Sum of the points */
+  int32_t sum_xy;           /* Sum of the points times their age rank, 0 for the oldest */
+  LED_Driver_ThermalTrend_t trend;
+} LED_Driver_TrendWindow_t;
 
-/* Temperature limits for each light source in Celsius */
-#define LIGHT_TEMP_MAX      85.0f   /* Maximum allowed temperature */
-#define LIGHT_TEMP_MIN      0.0f    /* Minimum allowed temperature */
+/* Output settings a flicker measurement holds for */
+typedef struct {
+  int32_t level[NUM_LIGHT_SOURCES];  /* Regulated current, or the intensity in open loop */
+  uint32_t pwm_hz;
+  bool dither;
+} LED_Driver_FlickerKey_t;
+
+/* Raw current counts of one light over the window in progress */
+typedef struct {
+  uint16_t min;
+  uint16_t max;
+  uint32_t sum;
+  uint32_t above;           /* Sum of the samples' excess over the reference */
+  uint16_t reference;       /* Average of the settling window */
+} LED_Driver_FlickerWindow_t;
+
+/* Constant-current controller of one light */
+typedef struct {
+  volatile int32_t target_ma;/* Regulated current, 0 in open-loop operation */
+  int64_t integral_q16;     /* Integral term, Q16 duty cycle scaled by 65536 */
+  int32_t previous_ma;      /* Current at the previous step, for the derivative */
+  bool primed;              /* previous_ma holds a reading */
+  uint8_t countdown;        /* Blocks to the next step */
+  uint32_t compare;         /* Compare value last written */
+  uint32_t fine;            /* On-time driven in 1/VAL_PWM_DITHER_STEPS counts */
+} LED_Driver_CurrentLoop_t;
 
 /* Private variables ---------------------------------------------------------*/
-static uint8_t current_intensities[NUM_LIGHT_SOURCES] = {0, 0, 0};
+static uint16_t current_permille[NUM_LIGHT_SOURCES] = {0};
+
+static uint8_t light_alarms[NUM_LIGHT_SOURCES] = {0};
+
+static LED_Driver_EventCallback event_callback = NULL;
+
+/* Alarm limits in engineering units, the channel table values until changed */
+static LED_Driver_Limits_t limits[NUM_LIGHT_SOURCES];
+
+/* Alarm limits in raw ADC counts, refreshed when the ADC resolution changes */
+static LED_Driver_Thresholds_t thresholds = {0};
+
+/* Current sampling point in the PWM period, 0 for free-running scans */
+static uint16_t sample_phase_permille = 0;
+
+static LED_Driver_AlarmMachine_t alarm_machines[NUM_LIGHT_SOURCES];
+static LED_Driver_AlarmConfig_t alarm_config = {
+  ALARM_TRIP_SAMPLES, ALARM_RELEASE_SAMPLES, ALARM_HYSTERESIS_PERMILLE,
+  false, ALARM_RECOVER_DELAY_MS, ALARM_RECOVER_MAX_DELAY_MS
+};
+
+/* Running fade; the table is read by DMA until the fade ends */
+static uint16_t fade_table[FADE_MAX_STEPS][NUM_LIGHT_SOURCES];
+static volatile bool fade_active = false;
+static uint8_t fade_mask;              /* Lights the fade moves, one bit per index */
+
+/* Running effect, played from the fade table while fade_active */
+static volatile bool effect_active = false;
+static Effect_Generator_t effect_generator;
+static uint16_t effect_depth = 0;
+static uint16_t effect_crest[NUM_LIGHT_SOURCES];      /* Intensity at the crest */
+static uint16_t effect_hold[NUM_LIGHT_SOURCES];       /* Compare values of the lights outside the mask */
+static uint16_t effect_last[NUM_LIGHT_SOURCES];       /* Compare values of the last row computed */
+static uint16_t effect_step_max[NUM_LIGHT_SOURCES];   /* Largest change per row, 0 for no limit */
+static uint32_t effect_table_us = 0;   /* Time one pass of the table takes */
+
+/* Thermal derating: factor applied to each output and the controller state */
+static LED_Driver_DerateConfig_t derate_config = {
+  DERATE_ENABLED, DERATE_KP, DERATE_KI, DERATE_MIN_PERMILLE
+};
+static uint16_t derate_permille[NUM_LIGHT_SOURCES] = {
+  [0 ... NUM_LIGHT_SOURCES - 1] = DERATE_UNITY
+};
+static int32_t derate_integral_q16[NUM_LIGHT_SOURCES];  /* Integral term, permille in Q16 */
+static int32_t derate_ki_step_q16 = 0;   /* Integral gain per block and centi-degree */
+static uint32_t derate_block_hz = 0;     /* Block rate derate_ki_step_q16 is computed for */
+static uint16_t fade_derate[NUM_LIGHT_SOURCES];  /* Derate and budget factors the fade table was built with */
+
+/* Supply current budget, the factor applies to every light */
+static volatile int32_t budget_limit_ma = VAL_SUPPLY_CURRENT_MAX_MA;  /* 0 for no limit */
+static int32_t budget_total_ma = 0;     /* Sum of the filtered currents at the last block */
+static uint16_t budget_permille = DERATE_UNITY;
+static uint8_t budget_settle = 0;       /* Blocks to hold after a change */
+static volatile bool supply_low = false; /* MCU supply under its warning level */
+
+/* Constant-current regulation */
+static LED_Driver_CurrentLoopConfig_t loop_config = {
+  LOOP_INTERVAL_BLOCKS, LOOP_KP, LOOP_KI, LOOP_KD, LOOP_OUTPUT_MIN_PERMILLE, LOOP_OUTPUT_MAX_PERMILLE
+};
+static LED_Driver_CurrentLoop_t current_loops[NUM_LIGHT_SOURCES];
+static uint32_t loop_ki_step_q16 = 0;  /* Integral gain per step and mA */
+static uint32_t loop_step_hz = 0;      /* Step rate loop_ki_step_q16 is computed for */
+
+/* Dithering of steady outputs below one timer count */
+static volatile bool dither_enabled = false;
+static uint32_t dither_on_time[NUM_LIGHT_SOURCES];  /* On-times the dither table holds */
+
+/* Staged intensities, applied by the PWM latch */
+static uint16_t staged_permille[NUM_LIGHT_SOURCES];
+static uint8_t staged_lights = 0;      /* Lights staged, one bit per index */
+
+/* Strobe pulse, valid while VAL_PWM_IsStrobeActive() */
+static uint32_t strobe_duration_us = 0;
+static uint32_t strobe_period_us = 0;  /* 0 when fired by the trigger input */
+static bool strobe_falling_edge = false;
+
+/* Strobe cut at the timer by LED_Driver_Blackout; LED_Driver_StopStrobe
+ * restores the sampling it left behind */
+static volatile bool strobe_cut = false;
+static bool strobe_cut_free_running = false;
+
+/* Cycle counter at the previous sample block, 0 before the first */
+static uint32_t block_cycles = 0;
+
+/* Usage counters, written by the ADC interrupt only */
+static LED_Driver_Usage_t usage[NUM_LIGHT_SOURCES];
+static uint32_t usage_block_us = 0;    /* Block length at usage_rate_hz */
+static uint32_t usage_rate_hz = 0;     /* Scan rate usage_block_us is computed for */
+static uint8_t usage_scans = 0;        /* Block size usage_block_us is computed for */
+
+/* Ageing compensation, and the full-output hour each scale was worked out
+ * for; coordinator task only, the curves are replaced whole */
+static LED_Driver_Ageing_t ageing[NUM_LIGHT_SOURCES];
+static uint32_t ageing_hours[NUM_LIGHT_SOURCES] = {
+  [0 ... NUM_LIGHT_SOURCES - 1] = AGEING_HOURS_NONE
+};
 
-/* Sensor data storage */
-static LightSensorData_t light_sensor_data[NUM_LIGHT_SOURCES] = {
-    {1, 0.0f, 0.0f},  // First light, initialized with ID and zero values
-    {2, 0.0f, 0.0f},  // Second light
-    {3, 0.0f, 0.0f}   // Third light
+/* Output trims, applied with the ageing compensation; coordinator task
+ * only, replaced whole */
+static uint16_t trims[NUM_LIGHT_SOURCES] = {
+  [0 ... NUM_LIGHT_SOURCES - 1] = VAL_PWM_SCALE_UNITY
 };
 
-static uint8_t light_alarms[NUM_LIGHT_SOURCES] = {0, 0, 0};
+/* Sensor plausibility, written by the ADC interrupt only */
+static LED_Driver_SensorCheck_t sensor_checks[NUM_LIGHT_SOURCES];
+
+/* Temperature trends, written by the ADC interrupt only */
+static LED_Driver_TrendWindow_t trends[NUM_LIGHT_SOURCES];
+static uint32_t trend_elapsed_us = 0;  /* Block time since the last point */
+
+/* Flicker measurement, written by the ADC interrupt only */
+static LED_Driver_FlickerKey_t flicker_key;
+static LED_Driver_FlickerWindow_t flicker_windows[NUM_LIGHT_SOURCES];
+static LED_Driver_FlickerStatus_t flicker_status = { LED_DRIVER_FLICKER_SETTLING, LED_DRIVER_FLICKER_WINDOW_DEFAULT, 0 };
+static LED_Driver_Flicker_t flicker[NUM_LIGHT_SOURCES];
+static uint16_t flicker_scans = 0;     /* Scans in the window in progress */
+
+#ifdef BENCHMARK
+/* Lights read as over current until their alarm trips, one bit per index */
+static volatile uint8_t injected_faults = 0;
+#endif
 
 /* Private function prototypes -----------------------------------------------*/
 static VAL_Status LED_Driver_ValidateLightId(uint8_t light_id);
-static void LED_Driver_CheckAlarmConditions(void);
-static VAL_Status LED_Driver_UpdateSensorReadings(void);
+static void LED_Driver_BlockCallback(const AnalogSampleBlock* block);
+static uint32_t LED_Driver_StepAlarm(uint8_t index, uint32_t now);
+static void LED_Driver_StepDerate(uint8_t index);
+static uint16_t LED_Driver_Derated(uint8_t index, uint16_t permille);
+static void LED_Driver_StepBudget(void);
+static void LED_Driver_SupplyCallback(bool low);
+static void LED_Driver_StepDither(void);
+static void LED_Driver_StepCurrentLoop(uint8_t index);
+static void LED_Driver_StopRegulation(uint8_t index);
+static void LED_Driver_StepUsage(uint8_t index);
+static uint16_t LED_Driver_AgeingScale(const LED_Driver_Ageing_t* curve, uint32_t hours);
+static uint32_t LED_Driver_StepTrend(void);
+static void LED_Driver_AddTrendPoint(uint8_t index);
+static void LED_Driver_StepFlicker(const AnalogSampleBlock* block);
+static void LED_Driver_RestartFlicker(void);
+static void LED_Driver_EndFlickerWindow(void);
+static uint32_t LED_Driver_RaiseAlarm(uint8_t index, uint8_t code);
+static uint32_t LED_Driver_RecoverAlarm(uint8_t index, uint32_t now);
+static uint32_t LED_Driver_RecoverDelay(const LED_Driver_AlarmMachine_t* machine);
+static void LED_Driver_SetAlarmState(uint8_t index, LED_Driver_AlarmState_t state, uint8_t code);
+static void LED_Driver_NotifyEvent(uint32_t events);
+static void LED_Driver_UpdateThresholds(void);
+static void LED_Driver_RefreshThresholds(uint32_t full_scale);
+static void LED_Driver_ComputeThresholds(uint32_t full_scale);
+static void LED_Driver_ReadLimits(uint8_t index, LED_Driver_Reading_t* reading);
+static bool LED_Driver_CheckSensors(uint8_t index, uint32_t current_counts, uint32_t temp_counts);
+static void LED_Driver_ApplyOutput(uint8_t index, uint16_t permille, VAL_Status* status);
+static void LED_Driver_WatchdogCallback(uint8_t light_id);
+static VAL_Status LED_Driver_StartFade(uint8_t mask, const uint16_t* targets, uint16_t duration_ms,
+                                       LED_Driver_FadeCurve_t curve);
+static void LED_Driver_CancelFade(void);
+static void LED_Driver_FadeCompleteCallback(void);
+static void LED_Driver_FillEffect(uint16_t first_row, uint16_t rows);
+static void LED_Driver_RefreshEffectHold(void);
+static float LED_Driver_FadeCurve(LED_Driver_FadeCurve_t curve, float x);
+static void LED_Driver_LatchCallback(void);
+static void LED_Driver_AlignOutputs(bool staggered);
 
 /* Public functions ----------------------------------------------------------*/
 
 /**
- * @brief  Initialize the LED driver
+ * @note   PWM is started by VAL_Init and the analog inputs by VAL_Analog_Init beforehand
+ * @note   PWM and analog inputs are started by VAL_Init beforehand
  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
  */
 VAL_Status LED_Driver_Init(void) {
-  /* Initialize analog sensors */
-  VAL_Status analog_status = VAL_Analog_Init();
-  if (analog_status != VAL_OK) {
-    return analog_status;
-  }
-
   /* Set initial values for all lights */
   for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
-    current_intensities[i] = 0;
+    const VAL_Channel_t* channel = &VAL_Channels[i];
+
+    current_permille[i] = 0;
     light_alarms[i] = 0;
+
+    limits[i].current_warn_ma = channel->current_warn_ma;
+    limits[i].current_max_ma = channel->current_max_ma;
+    limits[i].current_trip_ma = channel->current_trip_ma;
+    limits[i].temperature_warn_cdeg = channel->temperature_warn_cdeg;
+    limits[i].temperature_max_cdeg = channel->temperature_max_cdeg;
   }
+  memset(alarm_machines, 0, sizeof(alarm_machines));
+  memset(current_loops, 0, sizeof(current_loops));
+  memset(trends, 0, sizeof(trends));
+  memset(sensor_checks, 0, sizeof(sensor_checks));
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    trends[i].trend.time_to_limit_ms = UINT32_MAX;
+  }
+  memset(&flicker_key, 0, sizeof(flicker_key));
+  LED_Driver_RestartFlicker();
+  budget_permille = DERATE_UNITY;
+  budget_settle = 0;
 
-  /* Initialize PWM channels to 0% intensity */
+  LED_Driver_RefreshThresholds(VAL_Analog_GetFullScaleCounts());
+
+  /* Lights restored at start-up carry on, the others start at 0%; the
+   * watchdogs guard them all from here */
+  Restore_GetIntensities(current_permille);
   for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
-    VAL_PWM_SetIntensity(i + 1, 0);
+    VAL_PWM_SetPermille(i + 1, current_permille[i]);
+  }
+
+  VAL_PWM_SetRampCallback(LED_Driver_FadeCompleteCallback);
+  VAL_PWM_SetLoopCallback(LED_Driver_FillEffect);
+  VAL_PWM_SetLatchCallback(LED_Driver_LatchCallback);
+
+  /* Alarms are evaluated on every completed ADC block from now on */
+  VAL_Analog_SetBlockCallback(LED_Driver_BlockCallback);
+
+  /* Load is shed on a supply sag from here */
+  if (VAL_SUPPLY_WARN_MV > 0) {
+    VAL_Pvd_Enable(LED_Driver_SupplyCallback, VAL_SUPPLY_WARN_MV);
   }
 
   return VAL_OK;
@@ -67,11 +523,28 @@ VAL_Status LED_Driver_Init(void) {
 
 /**
  * @brief  Set the intensity for a specific light source
- * @param  lightId: Light source ID (1-3)
+ * @param  lightId: Light source ID (1-VAL_LIGHT_COUNT)
  * @param  intensity: Intensity value (0-100)
  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
  */
 VAL_Status LED_Driver_SetIntensity(uint8_t light_id, uint8_t intensity) {
+  if (intensity > 100) {
+    return VAL_ERROR;
+  }
+
+  return LED_Driver_SetIntensityPermille(light_id, (uint16_t)intensity * PERMILLE_PER_PERCENT);
+}
+
+/**
+ * @brief  Set the intensity for a specific light source in permille
+ * @note   Coordinator task, which owns the lights. Interrupts queue their
+ *         changes with SYS_Coordinator_SetLightPermilleFromISR instead.
+ * @param  lightId: Light source ID (1-VAL_LIGHT_COUNT)
+ * @param  permille: Intensity value (0-1000)
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_SetIntensityPermille(uint8_t light_id, uint16_t permille) {
+  uint32_t probe_start = Profiler_Start();
   VAL_Status status;
 
   /* Validate input */
@@ -80,30 +553,34 @@ VAL_Status LED_Driver_SetIntensity(uint8_t light_id, uint8_t intensity) {
     return status;
   }
 
-  if (intensity > 100) {
+  if (permille > VAL_PWM_PERMILLE_MAX) {
     return VAL_ERROR;
   }
 
+  if (VAL_PWM_IsStrobeActive()) {
+    return VAL_BUSY;
+  }
+
+  LED_Driver_CancelFade();
+  LED_Driver_StopRegulation(light_id - 1);
+
   /* Check if there's an active alarm for this light */
   if (light_alarms[light_id - 1]) {
     /* Cannot set intensity when light has an active alarm */
     return VAL_ERROR;
   }
 
-  /* Update sensor data first */
-  status = LED_Driver_UpdateSensorReadings();
-  if (status != VAL_OK) {
-    return status;
-  }
-
   /* Store current intensity */
-  current_intensities[light_id - 1] = intensity;
-
-  /* Check for potential alarm conditions */
-  LED_Driver_CheckAlarmConditions();
+  current_permille[light_id - 1] = permille;
 
   /* Set the actual PWM output for the light source */
-  return VAL_PWM_SetIntensity(light_id, intensity);
+  status = VAL_OK;
+  LED_Driver_ApplyOutput(light_id - 1, permille, &status);
+  Profiler_Stop(PROFILER_PROBE_PWM_UPDATE, probe_start);
+
+  LED_Driver_NotifyEvent(LED_DRIVER_EVENT_INTENSITY_CHANGED);
+
+  return status;
 }
 
 /**
@@ -112,23 +589,49 @@ VAL_Status LED_Driver_SetIntensity(uint8_t light_id, uint8_t intensity) {
  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
  */
 VAL_Status LED_Driver_SetAllIntensities(uint8_t *intensities) {
+  uint16_t permille[NUM_LIGHT_SOURCES];
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    permille[i] = (uint16_t)intensities[i] * PERMILLE_PER_PERCENT;
+  }
+
+  return LED_Driver_SetAllIntensitiesPermille(permille);
+}
+
+/**
+ * @brief  Set intensities for all light sources in permille
+ * @note   A light given LED_DRIVER_PERMILLE_HOLD keeps its output; if it was
+ *         fading it stops where it is. Also called from the sequencer cue
+ *         interrupt, at the priority of the ADC interrupt.
+ * @param  permille: Array of intensity values (0-1000, or LED_DRIVER_PERMILLE_HOLD)
+ * @retval VAL_Status: VAL_OK if successful, VAL_BUSY while strobing,
+ *         VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_SetAllIntensitiesPermille(const uint16_t* permille) {
+  uint32_t probe_start = Profiler_Start();
   VAL_Status status = VAL_OK;
   VAL_Status pwm_status = VAL_OK;
 
-  /* Update sensor data first */
-  status = LED_Driver_UpdateSensorReadings();
-  if (status != VAL_OK) {
-    return status;
+  if (VAL_PWM_IsStrobeActive()) {
+    return VAL_BUSY;
   }
 
+  LED_Driver_CancelFade();
+
   for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
-    /* Skip lights with active alarms instead of failing the whole operation */
-    if (!light_alarms[i]) {
+    /* Skip out of range values and lights with active alarms instead of
+     * failing the whole operation */
+    if (permille[i] == LED_DRIVER_PERMILLE_HOLD) {
+      continue;
+    } else if (permille[i] > VAL_PWM_PERMILLE_MAX) {
+      status = VAL_ERROR;
+    } else if (!light_alarms[i]) {
       /* Update internal state */
-      current_intensities[i] = intensities[i];
+      LED_Driver_StopRegulation(i);
+      current_permille[i] = permille[i];
 
-      /* Set the actual PWM output */
-      VAL_Status light_status = VAL_PWM_SetIntensity(i + 1, intensities[i]);
+      /* Stage the PWM output, all lights are committed together */
+      VAL_Status light_status = VAL_PWM_StagePermille(i + 1, LED_Driver_Derated(i, permille[i]));
       if (light_status != VAL_OK) {
         /* Return error but continue setting other lights */
         status = VAL_ERROR;
@@ -137,196 +640,2915 @@ VAL_Status LED_Driver_SetAllIntensities(uint8_t *intensities) {
     }
   }
 
-  /* Check alarm conditions */
-  LED_Driver_CheckAlarmConditions();
+  /* All channels change in the same PWM period, no colour glitch */
+  VAL_PWM_CommitAll();
+  Profiler_Stop(PROFILER_PROBE_PWM_UPDATE, probe_start);
+
+  /* An alarm raised by the watchdog meanwhile keeps its output off */
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (light_alarms[i]) {
+      current_permille[i] = 0;
+      VAL_PWM_StopChannel(i + 1);
+    }
+  }
+
+  LED_Driver_NotifyEvent(LED_DRIVER_EVENT_INTENSITY_CHANGED);
 
   return status;
 }
 
 /**
- * @brief  Get the current intensity of a specific light source
- * @param  lightId: Light source ID (1-3)
- * @param  intensity: Pointer to store the retrieved intensity
- * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ * @brief  Fade a light source to a target intensity in the background
+ * @note   The other lights hold their intensity. The fade runs from DMA and
+ *         needs no CPU time once started.
+ * @param  light_id: Light source ID (1-VAL_LIGHT_COUNT)
+ * @param  permille: Target intensity (0-1000)
+ * @param  duration_ms: Fade duration in milliseconds (0 sets it at once)
+ * @param  curve: Fade curve
+ * @retval VAL_Status: VAL_OK if the fade started, VAL_ERROR otherwise
  */
-VAL_Status LED_Driver_GetIntensity(uint8_t light_id, uint8_t* intensity) {
-  /* Validate light ID */
-  if (light_id < 1 || light_id > NUM_LIGHT_SOURCES) {
+VAL_Status LED_Driver_FadeTo(uint8_t light_id, uint16_t permille, uint16_t duration_ms,
+                             LED_Driver_FadeCurve_t curve) {
+  uint16_t targets[NUM_LIGHT_SOURCES];
+  VAL_Status status;
+
+  /* Validate input */
+  status = LED_Driver_ValidateLightId(light_id);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  if (permille > VAL_PWM_PERMILLE_MAX || duration_ms > LED_DRIVER_FADE_MAX_MS ||
+      curve >= LED_DRIVER_FADE_CURVE_COUNT) {
     return VAL_ERROR;
   }
 
-  /* Retrieve the intensity */
-  *intensity = current_intensities[light_id - 1];
+  if (duration_ms == 0) {
+    return LED_Driver_SetIntensityPermille(light_id, permille);
+  }
 
-  return VAL_OK;
+  if (VAL_PWM_IsStrobeActive()) {
+    return VAL_BUSY;
+  }
+
+  LED_Driver_CancelFade();
+  LED_Driver_StopRegulation(light_id - 1);
+
+  /* Cannot fade a light with an active alarm */
+  if (light_alarms[light_id - 1]) {
+    return VAL_ERROR;
+  }
+
+  memcpy(targets, current_permille, sizeof(targets));
+  targets[light_id - 1] = permille;
+
+  return LED_Driver_StartFade((uint8_t)(1U << (light_id - 1)), targets, duration_ms, curve);
 }
 
 /**
- * @brief  Get intensities for all light sources
- * @param  intensities: Array to store retrieved intensities
- * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ * @brief  Fade all light sources to new intensities together
+ * @note   One fade table moves every light, so they start and end in the
+ *         same PWM period. Lights with an active alarm are skipped, as by
+ *         LED_Driver_SetAllIntensitiesPermille, and held lights stay where
+ *         they are.
+ * @param  permille: Target intensity per light (0-1000, or LED_DRIVER_PERMILLE_HOLD)
+ * @param  duration_ms: Fade duration in milliseconds (0 sets them at once)
+ * @param  curve: Fade curve
+ * @retval VAL_Status: VAL_OK if the fade started, VAL_ERROR otherwise
  */
-VAL_Status LED_Driver_GetAllIntensities(uint8_t* intensities) {
-  /* Copy current intensities to the provided array */
-  memcpy(intensities, current_intensities, NUM_LIGHT_SOURCES * sizeof(uint8_t));
-  return VAL_OK;
+VAL_Status LED_Driver_FadeAllTo(const uint16_t* permille, uint16_t duration_ms, LED_Driver_FadeCurve_t curve) {
+  uint16_t targets[NUM_LIGHT_SOURCES];
+  uint8_t mask = 0;
+
+  if (permille == NULL || duration_ms > LED_DRIVER_FADE_MAX_MS || curve >= LED_DRIVER_FADE_CURVE_COUNT) {
+    return VAL_ERROR;
+  }
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (permille[i] > VAL_PWM_PERMILLE_MAX && permille[i] != LED_DRIVER_PERMILLE_HOLD) {
+      return VAL_ERROR;
+    }
+  }
+
+  if (duration_ms == 0) {
+    return LED_Driver_SetAllIntensitiesPermille(permille);
+  }
+
+  if (VAL_PWM_IsStrobeActive()) {
+    return VAL_BUSY;
+  }
+
+  LED_Driver_CancelFade();
+
+  memcpy(targets, current_permille, sizeof(targets));
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (!light_alarms[i] && permille[i] != LED_DRIVER_PERMILLE_HOLD) {
+      LED_Driver_StopRegulation(i);
+      targets[i] = permille[i];
+      mask |= (uint8_t)(1U << i);
+    }
+  }
+
+  if (mask == 0) {
+    return VAL_OK;
+  }
+
+  return LED_Driver_StartFade(mask, targets, duration_ms, curve);
 }
 
 /**
- * @brief  Get current sensor readings
- * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ * @brief  Modulate light sources with an effect until stopped
+ * @note   The crest and trough of each light follow from its intensity
+ *         here and the depth. Lights with an active alarm are skipped and
+ *         held lights stay where they are; the others leave constant-current
+ *         operation. Reads return the crests while the effect runs.
+ * @param  permille: Crest intensity per light (0-1000, or LED_DRIVER_PERMILLE_HOLD)
+ * @param  effect: Waveform, period and depth
+ * @retval VAL_Status: VAL_OK if the effect started, VAL_BUSY while strobing,
+ *         VAL_ERROR otherwise
  */
-static VAL_Status LED_Driver_UpdateSensorReadings(void) {
+VAL_Status LED_Driver_StartEffect(const uint16_t* permille, const Effect_Config_t* effect) {
+  uint16_t start[NUM_LIGHT_SOURCES];
+  uint8_t mask = 0;
   VAL_Status status;
 
-  /* Get sensor data from analog inputs */
-  status = VAL_Analog_GetAllSensorData((LightSensorData*)light_sensor_data);
+  if (permille == NULL || Effect_Validate(effect) != VAL_OK) {
+    return VAL_ERROR;
+  }
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (permille[i] > VAL_PWM_PERMILLE_MAX && permille[i] != LED_DRIVER_PERMILLE_HOLD) {
+      return VAL_ERROR;
+    }
+  }
 
-  /* Check alarm conditions */
-  LED_Driver_CheckAlarmConditions();
+  if (VAL_PWM_IsStrobeActive()) {
+    return VAL_BUSY;
+  }
 
-  return status;
-}
+  LED_Driver_CancelFade();
 
-/**
- * @brief  Check for and handle alarm conditions
- * @retval None
- */
-static void LED_Driver_CheckAlarmConditions(void) {
   for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
-    /* Disable light if current exceeds max or falls below min */
-    if (light_sensor_data[i].current > LIGHT_CURRENT_MAX ||
-        light_sensor_data[i].current < LIGHT_CURRENT_MIN) {
-      /* Set alarm and turn off light */
-      light_alarms[i] = ERROR_OVER_CURRENT;
-      current_intensities[i] = 0;
+    if (!light_alarms[i] && permille[i] != LED_DRIVER_PERMILLE_HOLD) {
+      LED_Driver_StopRegulation(i);
+      mask |= (uint8_t)(1U << i);
+    }
+  }
+
+  if (mask == 0) {
+    return VAL_OK;
+  }
+
+  /* Rows of whole PWM periods, as close to EFFECT_ROW_US as the frequency allows */
+  uint32_t frequency = VAL_PWM_GetFrequency();
+  uint32_t periods = (EFFECT_ROW_US * frequency + 500000U) / 1000000U;
+  if (periods == 0) {
+    periods = 1;
+  }
+  uint32_t row_ns = (uint32_t)(((uint64_t)periods * 1000000000U) / frequency);
+
+  if (Effect_Start(&effect_generator, effect, row_ns) != VAL_OK) {
+    return VAL_ERROR;
+  }
+  effect_depth = effect->depth_permille;
+  effect_table_us = row_ns / 1000U * EFFECT_ROWS;
+
+  /* The table starts from the present outputs. L permille of the period
+   * per ms is L * period * row_ns / 10^9 counts per row. */
+  fade_mask = mask;
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    uint16_t limit = VAL_PWM_GetSlewLimit(i + 1);
+
+    if (light_alarms[i]) {
+      effect_hold[i] = 0;
+    } else if (current_loops[i].target_ma != 0) {
+      effect_hold[i] = VAL_PWM_RampCompare(i + 1, current_loops[i].compare);
+    } else {
+      effect_hold[i] = VAL_PWM_PermilleToCompare(i + 1, LED_Driver_Derated(i, current_permille[i]));
+    }
+    effect_last[i] = effect_hold[i];
+    effect_crest[i] = (mask & (1U << i)) ? permille[i] : current_permille[i];
+
+    effect_step_max[i] = 0;
+    if (limit != VAL_PWM_SLEW_OFF) {
+      uint64_t counts = ((uint64_t)limit * VAL_PWM_GetChannelPeriod(i + 1) * row_ns) / 1000000000U;
+      effect_step_max[i] = (counts == 0) ? 1U : (counts > UINT16_MAX) ? UINT16_MAX : (uint16_t)counts;
+    }
+  }
+  LED_Driver_FillEffect(0, EFFECT_ROWS);
 
-      /* Turn off the actual PWM output */
-      VAL_PWM_SetIntensity(i + 1, 0);
+  /* Reads report the crests while the effect runs */
+  memcpy(start, current_permille, sizeof(start));
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (mask & (1U << i)) {
+      current_permille[i] = permille[i];
     }
+  }
+  fade_active = true;
+  effect_active = true;
 
-    /* Disable light if temperature exceeds max or falls below min */
-    if (light_sensor_data[i].temperature > LIGHT_TEMP_MAX ||
-        light_sensor_data[i].temperature < LIGHT_TEMP_MIN) {
-      /* Set alarm and turn off light */
-      light_alarms[i] = ERROR_OVER_TEMPERATURE;
-      current_intensities[i] = 0;
+  status = VAL_PWM_StartLoop(&fade_table[0][0], EFFECT_ROWS, periods);
+  if (status != VAL_OK) {
+    fade_active = false;
+    effect_active = false;
+    memcpy(current_permille, start, sizeof(start));
+    return VAL_ERROR;
+  }
 
-      /* Turn off the actual PWM output */
-      VAL_PWM_SetIntensity(i + 1, 0);
+  /* The watchdog may have tripped meanwhile, keep the output off then */
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if ((mask & (1U << i)) && light_alarms[i]) {
+      VAL_PWM_StopChannel(i + 1);
+      LED_Driver_CancelFade();
+      current_permille[i] = 0;
+      return VAL_ERROR;
     }
   }
+
+  LED_Driver_NotifyEvent(LED_DRIVER_EVENT_INTENSITY_CHANGED);
+
+  return VAL_OK;
 }
 
 /**
- * @brief  Validate light source ID
- * @param  lightId: Light source ID to validate
- * @retval VAL_Status: VAL_OK if valid, VAL_ERROR otherwise
+ * @brief  Stop a running effect, keeping the lights where it left them
+ * @retval VAL_Status: VAL_OK
  */
-static VAL_Status LED_Driver_ValidateLightId(uint8_t light_id) {
-  if (light_id < 1 || light_id > NUM_LIGHT_SOURCES) {
-    return VAL_ERROR;
+VAL_Status LED_Driver_StopEffect(void) {
+  if (effect_active) {
+    LED_Driver_CancelFade();
   }
+
   return VAL_OK;
 }
 
 /**
- * @brief  Get sensor readings for a specific light source
- * @param  lightId: Light source ID (1-3)
- * @param  sensorData: Pointer to store the retrieved sensor data
- * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ * @brief  Check whether an effect is running
+ * @retval bool: true from LED_Driver_StartEffect until an output change,
+ *         an alarm or LED_Driver_StopEffect
  */
-VAL_Status LED_Driver_GetSensorData(uint8_t light_id, LightSensorData_t* sensor_data) {
-  /* Validate input */
-  VAL_Status status = LED_Driver_ValidateLightId(light_id);
-  if (status != VAL_OK) {
-    return status;
-  }
+bool LED_Driver_IsEffectActive(void) {
+  return effect_active;
+}
 
-  if (sensor_data == NULL) {
+/**
+ * @brief  Stage new intensities for all light sources, applied together by
+ *         LED_Driver_CommitStage or a sync line edge
+ * @note   The lights keep their intensities until then. A running fade stops
+ *         where it is, staged lights leave constant-current operation, and
+ *         lights with an active alarm are skipped. Staging again replaces
+ *         the staged lights and keeps the others.
+ * @param  permille: Intensity per light (0-1000, or LED_DRIVER_PERMILLE_HOLD)
+ * @param  sync_input: true to also commit on a rising edge of the sync line
+ * @retval VAL_Status: VAL_OK if staged, VAL_BUSY while strobing, VAL_ERROR
+ *         otherwise
+ */
+VAL_Status LED_Driver_StagePermille(const uint16_t* permille, bool sync_input) {
+  VAL_Status status = VAL_OK;
+
+  if (permille == NULL) {
     return VAL_ERROR;
   }
 
-  /* Update sensor data first */
-  status = LED_Driver_UpdateSensorReadings();
-  if (status != VAL_OK) {
-    return status;
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (permille[i] > VAL_PWM_PERMILLE_MAX && permille[i] != LED_DRIVER_PERMILLE_HOLD) {
+      return VAL_ERROR;
+    }
   }
 
-  /* Copy the sensor data for the specified light */
-  *sensor_data = light_sensor_data[light_id - 1];
+  if (VAL_PWM_IsStrobeActive()) {
+    return VAL_BUSY;
+  }
 
-  return VAL_OK;
-}
+  LED_Driver_CancelFade();
 
-/**
- * @brief  Get sensor readings for all light sources
- * @param  sensorData: Array to store the retrieved sensor data (must be size 3)
- * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
- */
-VAL_Status LED_Driver_GetAllSensorData(LightSensorData_t* sensor_data) {
-  /* Validate input */
-  if (sensor_data == NULL) {
-    return VAL_ERROR;
+  /* Only extend a set still armed, the previous one may have been dropped */
+  if (!VAL_PWM_IsLatchArmed()) {
+    staged_lights = 0;
   }
 
-  /* Update sensor data first */
-  VAL_Status status = LED_Driver_UpdateSensorReadings();
-  if (status != VAL_OK) {
-    return status;
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (permille[i] == LED_DRIVER_PERMILLE_HOLD || light_alarms[i]) {
+      continue;
+    }
+
+    LED_Driver_StopRegulation(i);
+    if (VAL_PWM_StagePermille(i + 1, LED_Driver_Derated(i, permille[i])) != VAL_OK) {
+      status = VAL_ERROR;
+      continue;
+    }
+    staged_permille[i] = permille[i];
+    staged_lights |= (uint8_t)(1U << i);
   }
 
-  /* Copy all sensor data to the provided array */
-  memcpy(sensor_data, light_sensor_data, NUM_LIGHT_SOURCES * sizeof(LightSensorData_t));
+  if (VAL_PWM_ArmLatch(sync_input) != VAL_OK) {
+    return VAL_ERROR;
+  }
 
-  return VAL_OK;
+  return status;
 }
 
 /**
- * @brief  Clear alarm for a specific light source
- * @param  lightId: Light source ID (1-3)
+ * @brief  Apply the staged intensities now, from the next PWM period
+ * @note   Safe to call from interrupts
+ * @retval VAL_Status: VAL_OK if applied, VAL_ERROR if nothing is staged
+ */
+VAL_Status LED_Driver_CommitStage(void) {
+  return VAL_PWM_Latch();
+}
+
+/**
+ * @brief  Check whether intensities are staged and not yet committed
+ * @retval bool: true while staged
+ */
+bool LED_Driver_IsStaged(void) {
+  return VAL_PWM_IsLatchArmed();
+}
+
+/**
+ * @brief  Select how intensities map to the PWM duty cycle of a light source
+ * @param  light_id: Light source ID (1-VAL_LIGHT_COUNT)
+ * @param  curve: Output curve
  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
  */
-VAL_Status LED_Driver_ClearAlarm(uint8_t light_id) {
+VAL_Status LED_Driver_SetOutputCurve(uint8_t light_id, LED_Driver_OutputCurve_t curve) {
+  VAL_Status status;
+
   /* Validate input */
-  VAL_Status status = LED_Driver_ValidateLightId(light_id);
+  status = LED_Driver_ValidateLightId(light_id);
   if (status != VAL_OK) {
     return status;
   }
 
-  /* Update sensor data to ensure we're checking current conditions */
-  status = LED_Driver_UpdateSensorReadings();
+  if (curve >= LED_DRIVER_CURVE_COUNT) {
+    return VAL_ERROR;
+  }
+
+  LED_Driver_CancelFade();
+
+  status = VAL_PWM_SetCurve(light_id, (curve == LED_DRIVER_CURVE_GAMMA) ?
+                            VAL_PWM_CURVE_GAMMA : VAL_PWM_CURVE_LINEAR);
   if (status != VAL_OK) {
     return status;
   }
 
-  /* Check if conditions are still in alarm state */
-  if (light_sensor_data[light_id - 1].current > LIGHT_CURRENT_MAX ||
-      light_sensor_data[light_id - 1].temperature > LIGHT_TEMP_MAX ||
-      light_sensor_data[light_id - 1].current < LIGHT_CURRENT_MIN ||
-      light_sensor_data[light_id - 1].temperature < LIGHT_TEMP_MIN) {
-    /* Cannot clear alarm - conditions are still present */
-    return VAL_ERROR;
+  /* Re-apply the intensity through the new curve; the current controller
+   * writes compare values and does not use it */
+  if (!light_alarms[light_id - 1] && current_loops[light_id - 1].target_ma == 0) {
+    LED_Driver_ApplyOutput(light_id - 1, current_permille[light_id - 1], &status);
   }
 
-  /* Clear the alarm */
-  light_alarms[light_id - 1] = 0;
-
-  return VAL_OK;
+  return status;
 }
 
 /**
- * @brief  Get alarm status for all light sources
- * @param  alarms: Array to store alarm status (must be size 3)
+ * @brief  Get the current intensity of a specific light source
+ * @param  lightId: Light source ID (1-VAL_LIGHT_COUNT)
+ * @param  intensity: Pointer to store the retrieved intensity
  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
  */
-VAL_Status LED_Driver_GetAlarmStatus(uint8_t* alarms) {
-  /* Validate input */
-  if (alarms == NULL) {
+VAL_Status LED_Driver_GetIntensity(uint8_t light_id, uint8_t* intensity) {
+  /* Validate light ID */
+  if (light_id < 1 || light_id > NUM_LIGHT_SOURCES) {
     return VAL_ERROR;
   }
 
-  /* Copy alarm status to the provided array */
-  memcpy(alarms, light_alarms, NUM_LIGHT_SOURCES * sizeof(uint8_t));
+  /* Retrieve the intensity, rounded to the nearest percent */
+  *intensity = (uint8_t)((current_permille[light_id - 1] + PERMILLE_PER_PERCENT / 2) / PERMILLE_PER_PERCENT);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the current intensity of a specific light source in permille
+ * @param  lightId: Light source ID (1-VAL_LIGHT_COUNT)
+ * @param  permille: Pointer to store the retrieved intensity
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_GetIntensityPermille(uint8_t light_id, uint16_t* permille) {
+  /* Validate light ID */
+  if (light_id < 1 || light_id > NUM_LIGHT_SOURCES) {
+    return VAL_ERROR;
+  }
+
+  *permille = current_permille[light_id - 1];
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get intensities for all light sources
+ * @param  intensities: Array to store retrieved intensities
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_GetAllIntensities(uint8_t* intensities) {
+  /* Copy current intensities to the provided array, in percent */
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    intensities[i] = (uint8_t)((current_permille[i] + PERMILLE_PER_PERCENT / 2) / PERMILLE_PER_PERCENT);
+  }
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get intensities for all light sources in permille
+ * @param  permille: Array to store retrieved intensities
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_GetAllIntensitiesPermille(uint16_t* permille) {
+  memcpy(permille, current_permille, sizeof(current_permille));
+  return VAL_OK;
+}
+
+/**
+ * @brief  Check whether all outputs are off with nothing left to monitor
+ * @note   Safe to call with interrupts disabled
+ * @retval bool: true if no output is on, fading, strobing, staged or in an
+ *         alarm state
+ */
+bool LED_Driver_IsIdle(void) {
+  if (fade_active || VAL_PWM_IsStrobeActive() || VAL_PWM_IsLatchArmed()) {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (current_permille[i] != 0 || current_loops[i].target_ma != 0 ||
+        alarm_machines[i].state != LED_DRIVER_ALARM_NORMAL) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief  Check whether a fade or a current loop is driving the outputs
+ * @note   Safe to call with interrupts disabled
+ * @retval bool: true while fading or while any light holds a target current
+ */
+bool LED_Driver_IsControlActive(void) {
+  if (fade_active) {
+    return true;
+  }
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (current_loops[i].target_ma != 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+#ifdef BENCHMARK
+/**
+ * @brief  Make a light read as over current until its alarm trips
+ * @note   Benchmark builds only, for measuring the alarm reaction time.
+ *         The trip follows the normal debouncing.
+ * @param  light_id: Light source ID (1-VAL_LIGHT_COUNT)
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_InjectFault(uint8_t light_id) {
+  VAL_Status status = LED_Driver_ValidateLightId(light_id);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* Cleared from the ADC interrupt when the alarm trips */
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  injected_faults |= (uint8_t)(1U << (light_id - 1));
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+#endif
+
+/**
+ * @brief  Step the alarm state machines, called from the ADC interrupt
+ * @note   Compares filtered ADC counts against precomputed count thresholds,
+ *         so no conversion is done on this path. Skipped while the
+ *         thresholds do not match the ADC resolution.
+ * @param  block: Completed block; the filtered readings include it, the
+ *         flicker measurement takes its raw samples
+ * @retval None
+ */
+static void LED_Driver_BlockCallback(const AnalogSampleBlock* block) {
+  uint32_t events = 0;
+  uint32_t now = HAL_GetTick();
+  uint32_t cycles = Profiler_Start();
+  uint32_t sample_rate = VAL_Analog_GetSampleRate();
+  uint32_t period_us = (sample_rate != 0) ? (block->scan_count * 1000000U) / sample_rate : 0;
+  uint32_t primask;
+
+  /* The interval includes time spent in stop mode */
+  if (block_cycles != 0) {
+    Profiler_Record(PROFILER_PROBE_ADC_BLOCK, cycles - block_cycles);
+  }
+  block_cycles = cycles;
+  Jitter_Mark(JITTER_LOOP_SAMPLING, block->start_us, period_us);
+
+  if (thresholds.full_scale != VAL_Analog_GetFullScaleCounts()) {
+    return;
+  }
+
+  /* Outputs held by a comparator trip resume once its input is released */
+  VAL_PWM_RecoverBreak();
+
+  Jitter_Mark(JITTER_LOOP_CONTROL, VAL_SysClock_GetMicros(), period_us);
+
+  /* The cutoff preempts this interrupt; one light at a time is stepped
+   * with it held off, so an alarm never lands between reading a light's
+   * state and writing its output */
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    primask = __get_PRIMASK();
+    __disable_irq();
+    events |= LED_Driver_StepAlarm(i, now);
+    LED_Driver_StepDerate(i);
+    LED_Driver_StepCurrentLoop(i);
+    __set_PRIMASK(primask);
+    LED_Driver_StepUsage(i);
+  }
+
+  /* All lights at once, as the commit */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  LED_Driver_StepBudget();
+  LED_Driver_StepDither();
+  __set_PRIMASK(primask);
+
+  events |= LED_Driver_StepTrend();
+  LED_Driver_StepFlicker(block);
+
+  if (events != 0) {
+    LED_Driver_NotifyEvent(events);
+  }
+}
+
+/**
+ * @brief  Advance the thermal derating controller of a light by one reading
+ * @note   Regulates the filtered temperature to the warning limit. The
+ *         integral is clamped to the derating range, so it does not wind
+ *         up while the light runs cool or sits at the floor.
+ * @param  index: Light source index (0 to VAL_LIGHT_COUNT - 1)
+ * @retval None
+ */
+static void LED_Driver_StepDerate(uint8_t index) {
+  int32_t temperature_cdeg;
+  int32_t factor = DERATE_UNITY;
+
+  if (derate_config.enabled) {
+    int32_t range = (int32_t)DERATE_UNITY - derate_config.min_permille;
+    uint32_t block_hz = VAL_Analog_GetSampleRate() / VAL_Analog_GetBlockScans();
+
+    /* Integral per block, follows a change of the scan rate */
+    if (block_hz != derate_block_hz && block_hz != 0) {
+      derate_block_hz = block_hz;
+      derate_ki_step_q16 = (int32_t)(((uint32_t)derate_config.ki_permille_per_deg_s << 16) / (100U * block_hz));
+    }
+
+    VAL_Analog_GetTemperatureCentiDeg(index + 1, &temperature_cdeg);
+    int32_t error = temperature_cdeg - limits[index].temperature_warn_cdeg;
+    if (error > DERATE_ERROR_MAX_CDEG) {
+      error = DERATE_ERROR_MAX_CDEG;
+    } else if (error < -DERATE_ERROR_MAX_CDEG) {
+      error = -DERATE_ERROR_MAX_CDEG;
+    }
+
+    int64_t integral = derate_integral_q16[index] + (int64_t)derate_ki_step_q16 * error;
+    if (integral < 0) {
+      integral = 0;
+    } else if (integral > ((int64_t)range << 16)) {
+      integral = (int64_t)range << 16;
+    }
+    derate_integral_q16[index] = (int32_t)integral;
+
+    int32_t reduction = derate_config.kp_permille_per_deg * error / 100 + (int32_t)(integral >> 16);
+    if (reduction < 0) {
+      reduction = 0;
+    } else if (reduction > range) {
+      reduction = range;
+    }
+    factor = (int32_t)DERATE_UNITY - reduction;
+  }
+
+  /* The staged values hold the factor they were staged with */
+  if (factor == derate_permille[index] || VAL_PWM_IsLatchArmed()) {
+    return;
+  }
+
+  uint16_t before = LED_Driver_Derated(index, current_permille[index]);
+  derate_permille[index] = (uint16_t)factor;
+  uint16_t after = LED_Driver_Derated(index, current_permille[index]);
+
+  /* An effect computes its next rows with the new factor */
+  if (effect_active) {
+    LED_Driver_RefreshEffectHold();
+    return;
+  }
+
+  /* A fade table holds the old factor, stop it where it is. A regulated
+   * light picks up the new factor as its output limit on the next step. */
+  if (after != before && light_alarms[index] == 0 && current_loops[index].target_ma == 0) {
+    LED_Driver_CancelFade();
+    VAL_PWM_SetPermille(index + 1, LED_Driver_Derated(index, current_permille[index]));
+  }
+}
+
+/**
+ * @brief  Scale an intensity by the present derate and budget factors of a light
+ * @param  index: Light source index (0 to VAL_LIGHT_COUNT - 1)
+ * @param  permille: Requested intensity (0-1000)
+ * @retval uint16_t: Intensity to drive the output with
+ */
+static uint16_t LED_Driver_Derated(uint8_t index, uint16_t permille) {
+  uint32_t factor = (uint32_t)derate_permille[index] * budget_permille;
+  uint32_t unity = DERATE_UNITY * DERATE_UNITY;
+
+  return (uint16_t)(((uint32_t)permille * factor + unity / 2U) / unity);
+}
+
+/**
+ * @brief  Advance the supply current budget by one block
+ * @note   Called from the ADC interrupt with interrupts disabled, after the
+ *         lights were stepped. Assumes each current follows its duty cycle,
+ *         so the total at the full output is the measured one divided by
+ *         the factor in use.
+ * @retval None
+ */
+static void LED_Driver_StepBudget(void) {
+  int32_t total_ma = 0;
+  int32_t current_ma;
+  int32_t factor = DERATE_UNITY;
+  int32_t limit_ma = budget_limit_ma;
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    VAL_Analog_GetCurrentMilliAmps(i + 1, &current_ma);
+    if (current_ma > 0) {
+      total_ma += current_ma;
+    }
+  }
+  budget_total_ma = total_ma;
+
+  /* The readings still lag the last change */
+  if (budget_settle > 0) {
+    budget_settle--;
+    return;
+  }
+
+  if (limit_ma > 0) {
+    int64_t demand_ma = (int64_t)total_ma * DERATE_UNITY / budget_permille;
+
+    if (demand_ma > limit_ma) {
+      factor = (int32_t)((int64_t)limit_ma * DERATE_UNITY / demand_ma);
+      if (factor < BUDGET_MIN_PERMILLE) {
+        factor = BUDGET_MIN_PERMILLE;
+      }
+    }
+  }
+
+  /* Held down while the supply is low */
+  if (supply_low && factor > SUPPLY_SHED_PERMILLE) {
+    factor = SUPPLY_SHED_PERMILLE;
+  }
+
+  /* Cut at once, give back slowly */
+  if (factor > budget_permille + BUDGET_RISE_PERMILLE) {
+    factor = budget_permille + BUDGET_RISE_PERMILLE;
+  }
+
+  /* The staged values hold the factor they were staged with; the strobe
+   * drives the outputs by itself */
+  if (factor == budget_permille || VAL_PWM_IsLatchArmed() || VAL_PWM_IsStrobeActive()) {
+    return;
+  }
+
+  /* An effect computes its next rows with the new factor, the readings
+   * follow a table later */
+  if (effect_active) {
+    uint32_t blocks = BUDGET_SETTLE_BLOCKS + effect_table_us / 1000U *
+                      (VAL_Analog_GetSampleRate() / VAL_Analog_GetBlockScans()) / 1000U;
+
+    budget_permille = (uint16_t)factor;
+    budget_settle = (blocks > UINT8_MAX) ? UINT8_MAX : (uint8_t)blocks;
+    LED_Driver_RefreshEffectHold();
+    return;
+  }
+
+  /* A fade table holds the old factor, stop it where it is */
+  LED_Driver_CancelFade();
+  budget_permille = (uint16_t)factor;
+  budget_settle = BUDGET_SETTLE_BLOCKS;
+
+  /* Regulated lights take the factor into their output limit on the next step */
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (light_alarms[i] == 0 && current_loops[i].target_ma == 0) {
+      VAL_PWM_StagePermille(i + 1, LED_Driver_Derated(i, current_permille[i]));
+    }
+  }
+  VAL_PWM_CommitAll();
+}
+
+/**
+ * @brief  MCU supply crossed its warning level, called from the PVD interrupt
+ * @note   Also called from LED_Driver_Init if the supply is low already.
+ *         Under the level every output is cut through the budget factor on
+ *         the next PWM period; back over it, the factor rises again with the
+ *         budget steps.
+ * @param  low: true as the supply falls under the level, false as it recovers
+ * @retval None
+ */
+static void LED_Driver_SupplyCallback(bool low) {
+  uint32_t primask = __get_PRIMASK();
+
+  /* Against the cutoff, which preempts this interrupt */
+  __disable_irq();
+  supply_low = low;
+
+  /* A factor as low already stays; the strobe drives the outputs by itself */
+  if (low && budget_permille > SUPPLY_SHED_PERMILLE && !VAL_PWM_IsStrobeActive()) {
+    uint32_t before = budget_permille;
+
+    /* Fade and effect tables hold the old factor, stop them where they are */
+    LED_Driver_CancelFade();
+    budget_permille = SUPPLY_SHED_PERMILLE;
+    budget_settle = BUDGET_SETTLE_BLOCKS;
+
+    /* Any staged values go with the commit */
+    staged_lights = 0;
+    for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+      if (light_alarms[i] == 0 && current_loops[i].target_ma == 0) {
+        VAL_PWM_StagePermille(i + 1, LED_Driver_Derated(i, current_permille[i]));
+      }
+    }
+    VAL_PWM_CommitAllNow();
+
+    /* Regulated lights bypass the curve, scale their output and integral */
+    for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+      LED_Driver_CurrentLoop_t* loop = &current_loops[i];
+
+      if (light_alarms[i] != 0 || loop->target_ma == 0) {
+        continue;
+      }
+
+      loop->compare = loop->compare * SUPPLY_SHED_PERMILLE / before;
+      loop->fine = loop->fine * SUPPLY_SHED_PERMILLE / before;
+      loop->integral_q16 = loop->integral_q16 * SUPPLY_SHED_PERMILLE / (int64_t)before;
+      VAL_PWM_SetCompare(i + 1, loop->compare);
+    }
+  }
+
+  __set_PRIMASK(primask);
+
+  LED_Driver_NotifyEvent(LED_DRIVER_EVENT_POWER_WARNING);
+}
+
+/**
+ * @brief  Dither the steady outputs to their on-times below one count
+ * @note   Called from the block interrupt with interrupts disabled, after
+ *         the other steps. Every direct output write stops the dither
+ *         cycle; it starts again from the state here on the next block.
+ *         Fades, staged and strobed outputs are left alone.
+ * @retval None
+ */
+static void LED_Driver_StepDither(void) {
+  uint32_t on_time[NUM_LIGHT_SOURCES];
+
+  /* A slew would end at once, the cycle starts once it is through */
+  if (!dither_enabled || fade_active || VAL_PWM_IsLatchArmed() || VAL_PWM_IsStrobeActive() ||
+      VAL_PWM_IsSlewActive()) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (light_alarms[i]) {
+      on_time[i] = 0;
+    } else if (current_loops[i].target_ma != 0) {
+      on_time[i] = current_loops[i].fine;
+    } else {
+      on_time[i] = VAL_PWM_PermilleToFineCompare(i + 1, LED_Driver_Derated(i, current_permille[i]));
+    }
+  }
+
+  /* The table only changes with the targets */
+  if (VAL_PWM_IsDitherActive() && memcmp(on_time, dither_on_time, sizeof(on_time)) == 0) {
+    return;
+  }
+
+  if (VAL_PWM_SetDither(on_time) == VAL_OK) {
+    memcpy(dither_on_time, on_time, sizeof(on_time));
+  }
+}
+
+/**
+ * @brief  Advance the constant-current controller of a light
+ * @note   Called from the ADC interrupt on every block, steps every
+ *         interval_blocks blocks. The derivative acts on the measured
+ *         current, so a new target causes no kick.
+ * @param  index: Light source index (0 to VAL_LIGHT_COUNT - 1)
+ * @retval None
+ */
+static void LED_Driver_StepCurrentLoop(uint8_t index) {
+  LED_Driver_CurrentLoop_t* loop = &current_loops[index];
+  int32_t current_ma;
+
+  if (loop->target_ma == 0 || light_alarms[index] != 0 || fade_active || VAL_PWM_IsLatchArmed()) {
+    return;
+  }
+
+  if (loop->countdown > 1) {
+    loop->countdown--;
+    return;
+  }
+  loop->countdown = loop_config.interval_blocks;
+
+  /* Integral per step, follows a change of the scan rate */
+  uint32_t step_hz = VAL_Analog_GetSampleRate() / (VAL_Analog_GetBlockScans() * loop_config.interval_blocks);
+  if (step_hz == 0) {
+    step_hz = 1;
+  }
+  if (step_hz != loop_step_hz) {
+    loop_step_hz = step_hz;
+    loop_ki_step_q16 = (uint32_t)(((uint64_t)loop_config.ki << 16) / step_hz);
+  }
+
+  /* Derating lowers the upper limit, and wins over the lower one */
+  int32_t out_min = (int32_t)(((uint32_t)loop_config.output_min_permille << 16) / VAL_PWM_PERMILLE_MAX);
+  int32_t out_max = (int32_t)(((uint32_t)LED_Driver_Derated(index, loop_config.output_max_permille) << 16) /
+                              VAL_PWM_PERMILLE_MAX);
+  if (out_min > out_max) {
+    out_min = out_max;
+  }
+
+  VAL_Analog_GetCurrentMilliAmps(index + 1, &current_ma);
+  int32_t error = loop->target_ma - current_ma;
+
+  int64_t integral = loop->integral_q16 + (int64_t)loop_ki_step_q16 * error;
+  if (integral < ((int64_t)out_min << 16)) {
+    integral = (int64_t)out_min << 16;
+  } else if (integral > ((int64_t)out_max << 16)) {
+    integral = (int64_t)out_max << 16;
+  }
+  loop->integral_q16 = integral;
+
+  int64_t output = (int64_t)loop_config.kp * error + (integral >> 16);
+  if (loop->primed) {
+    output -= (int64_t)loop_config.kd * (current_ma - loop->previous_ma) * (int32_t)step_hz;
+  }
+  loop->previous_ma = current_ma;
+  loop->primed = true;
+
+  if (output < out_min) {
+    output = out_min;
+  } else if (output > out_max) {
+    output = out_max;
+  }
+
+  /* Reads report the duty cycle the controller drives */
+  uint32_t duty = (uint32_t)output;
+  loop->compare = (duty * VAL_PWM_GetChannelPeriod(index + 1)) >> 16;
+  loop->fine = (uint32_t)(((uint64_t)duty * VAL_PWM_GetChannelPeriod(index + 1)) >> (16U - VAL_PWM_DITHER_BITS));
+
+  /* While dithering the table carries the output, see LED_Driver_StepDither */
+  if (!VAL_PWM_IsDitherActive()) {
+    VAL_PWM_SetCompare(index + 1, loop->compare);
+  }
+  current_permille[index] = (uint16_t)((duty * VAL_PWM_PERMILLE_MAX + LOOP_DUTY_UNITY / 2) >> 16);
+}
+
+/**
+ * @brief  Add one block to the usage counters of a light
+ * @param  index: Light source index (0 to VAL_LIGHT_COUNT - 1)
+ * @retval None
+ */
+static void LED_Driver_StepUsage(uint8_t index) {
+  LED_Driver_Usage_t* counters = &usage[index];
+  uint32_t rate_hz = VAL_Analog_GetSampleRate();
+  uint8_t scans = VAL_Analog_GetBlockScans();
+  uint32_t current_counts = 0;
+  uint32_t temp_counts = 0;
+  int32_t current_ma;
+
+  /* Block length, follows a change of the scan rate or block size */
+  if ((rate_hz != usage_rate_hz || scans != usage_scans) && rate_hz != 0) {
+    usage_rate_hz = rate_hz;
+    usage_scans = scans;
+    usage_block_us = (scans * 1000000U + rate_hz / 2U) / rate_hz;
+  }
+
+  VAL_Analog_GetCurrentMilliAmps(index + 1, &current_ma);
+  if (current_ma > 0) {
+    counters->charge_ma_us += (uint64_t)(uint32_t)current_ma * usage_block_us;
+  }
+
+  if (!VAL_PWM_IsStrobeActive()) {
+    uint32_t period = VAL_PWM_GetChannelPeriod(index + 1);
+    uint32_t duty_permille = VAL_PWM_GetCompare(index + 1) * VAL_PWM_PERMILLE_MAX / period;
+
+    counters->duty_permille_us += (uint64_t)duty_permille * usage_block_us;
+  }
+
+  VAL_Analog_GetRawCounts(index + 1, &current_counts, &temp_counts);
+  if (temp_counts > thresholds.temp_warn[index]) {
+    counters->over_warning_us += usage_block_us;
+  }
+}
+
+/**
+ * @brief  Work out the output scale that makes up for the ageing of a light
+ * @param  curve: Ageing curve of the light, checked
+ * @param  hours: Full-output hours of the light
+ * @retval uint16_t: Output scale in permille, VAL_PWM_SCALE_UNITY with the curve off
+ */
+static uint16_t LED_Driver_AgeingScale(const LED_Driver_Ageing_t* curve, uint32_t hours) {
+  uint32_t point;
+  uint32_t output;
+
+  if (curve->step_hours == 0) {
+    return VAL_PWM_SCALE_UNITY;
+  }
+
+  point = hours / curve->step_hours;
+  if (point >= LED_DRIVER_AGEING_POINTS) {
+    output = curve->output_permille[LED_DRIVER_AGEING_POINTS - 1];
+  } else {
+    uint32_t from = (point == 0) ? VAL_PWM_PERMILLE_MAX : curve->output_permille[point - 1];
+    uint32_t into = hours - point * curve->step_hours;
+
+    output = from - ((from - curve->output_permille[point]) * into + curve->step_hours / 2U) / curve->step_hours;
+  }
+
+  /* At least LED_DRIVER_AGEING_MIN_PERMILLE, so at most VAL_PWM_SCALE_MAX */
+  return (uint16_t)((VAL_PWM_SCALE_UNITY * VAL_PWM_PERMILLE_MAX + output / 2U) / output);
+}
+
+/**
+ * @brief  Advance the temperature trends by one block
+ * @note   Call after LED_Driver_StepUsage, which keeps the block length
+ * @retval uint32_t: LED_DRIVER_EVENT_THERMAL_WARNING if a warning was raised
+ */
+static uint32_t LED_Driver_StepTrend(void) {
+  uint32_t events = 0;
+
+  trend_elapsed_us += usage_block_us;
+  if (trend_elapsed_us < TREND_POINT_US) {
+    return 0;
+  }
+  trend_elapsed_us -= TREND_POINT_US;
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    LED_Driver_ThermalTrend_t* trend = &trends[i].trend;
+    bool warning = trend->warning;
+
+    LED_Driver_AddTrendPoint(i);
+
+    /* Raised once, re-armed with hysteresis */
+    if (!warning && trend->time_to_limit_ms < LED_DRIVER_THERMAL_HORIZON_MS) {
+      trend->warning = true;
+      trend->warnings++;
+      events |= LED_DRIVER_EVENT_THERMAL_WARNING;
+    } else if (warning && trend->time_to_limit_ms > 2U * LED_DRIVER_THERMAL_HORIZON_MS) {
+      trend->warning = false;
+    }
+  }
+
+  return events;
+}
+
+/**
+ * @brief  Add the present temperature of a light to its trend window
+ * @note   Sliding the window by one point lowers the rank of the others
+ *         by one, so sum_xy loses sum_y of the points kept
+ * @param  index: Light source index (0 to VAL_LIGHT_COUNT - 1)
+ * @retval None
+ */
+static void LED_Driver_AddTrendPoint(uint8_t index) {
+  LED_Driver_TrendWindow_t* window = &trends[index];
+  LED_Driver_ThermalTrend_t* trend = &window->trend;
+  int32_t temperature_cdeg = 0;
+
+  VAL_Analog_GetTemperatureCentiDeg(index + 1, &temperature_cdeg);
+
+  if (window->count < TREND_POINTS) {
+    window->points[window->count] = temperature_cdeg;
+    window->sum_xy += (int32_t)window->count * temperature_cdeg;
+    window->sum_y += temperature_cdeg;
+    window->count++;
+  } else {
+    int32_t oldest = window->points[window->head];
+
+    window->sum_xy -= window->sum_y - oldest;
+    window->sum_xy += (int32_t)(TREND_POINTS - 1U) * temperature_cdeg;
+    window->sum_y += temperature_cdeg - oldest;
+    window->points[window->head] = temperature_cdeg;
+    window->head = (uint8_t)((window->head + 1U) % TREND_POINTS);
+  }
+
+  trend->temperature_cdeg = temperature_cdeg;
+  trend->slope_cdeg_per_s = 0;
+  trend->time_to_limit_ms = UINT32_MAX;
+
+  /* No prediction until the window is full */
+  if (window->count < TREND_POINTS) {
+    return;
+  }
+
+  int64_t numerator = (int64_t)TREND_POINTS * window->sum_xy - (int64_t)TREND_SUM_X * window->sum_y;
+  int64_t slope = numerator * 1000000 / ((int64_t)TREND_DENOMINATOR * TREND_POINT_US);
+  trend->slope_cdeg_per_s = (int32_t)slope;
+
+  int32_t margin_cdeg = limits[index].temperature_max_cdeg - temperature_cdeg;
+  if (margin_cdeg <= 0) {
+    trend->time_to_limit_ms = 0;
+  } else if (slope > 0) {
+    int64_t time_ms = (int64_t)margin_cdeg * 1000 / slope;
+    trend->time_to_limit_ms = (time_ms < UINT32_MAX) ? (uint32_t)time_ms : UINT32_MAX;
+  }
+}
+
+/**
+ * @brief  Add the raw current samples of a block to the flicker measurement
+ * @note   Starts over when the settings of LED_Driver_FlickerKey_t change;
+ *         once a window has been measured only the comparison is left
+ * @param  block: Completed block
+ * @retval None
+ */
+static void LED_Driver_StepFlicker(const AnalogSampleBlock* block) {
+  LED_Driver_FlickerKey_t key;
+
+  /* Zeroed padding, the keys are compared as bytes */
+  memset(&key, 0, sizeof(key));
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    int32_t target_ma = current_loops[i].target_ma;
+    key.level[i] = (target_ma != 0) ? target_ma : (int32_t)current_permille[i];
+  }
+  key.pwm_hz = VAL_PWM_GetFrequency();
+  key.dither = dither_enabled;
+
+  if (memcmp(&key, &flicker_key, sizeof(key)) != 0) {
+    memcpy(&flicker_key, &key, sizeof(key));
+    LED_Driver_RestartFlicker();
+  }
+
+  for (uint8_t scan = 0; scan < block->scan_count && flicker_status.state != LED_DRIVER_FLICKER_DONE; scan++) {
+    const uint16_t* samples = &block->samples[scan * ANALOG_CHANNEL_COUNT];
+
+    for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+      LED_Driver_FlickerWindow_t* window = &flicker_windows[i];
+      uint16_t sample = samples[VAL_Channels[i].current_rank];
+
+      if (sample < window->min) {
+        window->min = sample;
+      }
+      if (sample > window->max) {
+        window->max = sample;
+      }
+      window->sum += sample;
+      if (sample > window->reference) {
+        window->above += sample - window->reference;
+      }
+    }
+
+    if (++flicker_scans >= flicker_status.window_scans) {
+      LED_Driver_EndFlickerWindow();
+    }
+  }
+}
+
+/**
+ * @brief  Start the flicker measurement over with a settling window
+ * @note   Call from the ADC interrupt or with interrupts disabled
+ * @retval None
+ */
+static void LED_Driver_RestartFlicker(void) {
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    flicker_windows[i].min = UINT16_MAX;
+    flicker_windows[i].max = 0;
+    flicker_windows[i].sum = 0;
+    flicker_windows[i].above = 0;
+    flicker_windows[i].reference = UINT16_MAX;
+  }
+  memset(flicker, 0, sizeof(flicker));
+  flicker_scans = 0;
+  flicker_status.state = LED_DRIVER_FLICKER_SETTLING;
+}
+
+/**
+ * @brief  Close a flicker window: keep the averages of a settling window,
+ *         or compute the metrics of a measuring one
+ * @note   The currents are proportional to the counts above those of 0 mA,
+ *         so both metrics are taken relative to them
+ * @retval None
+ */
+static void LED_Driver_EndFlickerWindow(void) {
+  uint32_t scans = flicker_scans;
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    LED_Driver_FlickerWindow_t* window = &flicker_windows[i];
+
+    if (flicker_status.state == LED_DRIVER_FLICKER_SETTLING) {
+      window->reference = (uint16_t)((window->sum + scans / 2U) / scans);
+    } else {
+      uint32_t zero = VAL_Analog_CurrentToCounts(i + 1, 0);
+      if (zero > window->min) {
+        zero = window->min;
+      }
+
+      uint32_t span = (uint32_t)window->max + window->min - 2U * zero;
+      uint32_t total = window->sum - scans * zero;
+
+      flicker[i].percent_centi = (span != 0) ?
+        (uint16_t)(((uint32_t)(window->max - window->min) * FLICKER_UNITY) / span) : 0;
+      flicker[i].index_e4 = (total != 0) ?
+        (uint16_t)(((uint64_t)window->above * FLICKER_UNITY) / total) : 0;
+    }
+
+    window->min = UINT16_MAX;
+    window->max = 0;
+    window->sum = 0;
+    window->above = 0;
+  }
+
+  flicker_scans = 0;
+  if (flicker_status.state == LED_DRIVER_FLICKER_SETTLING) {
+    flicker_status.state = LED_DRIVER_FLICKER_MEASURING;
+  } else {
+    flicker_status.state = LED_DRIVER_FLICKER_DONE;
+    flicker_status.measurements++;
+  }
+}
+
+/**
+ * @brief  Return a light to open-loop operation
+ * @note   The output keeps its present duty cycle until it is written
+ * @param  index: Light source index (0 to VAL_LIGHT_COUNT - 1)
+ * @retval None
+ */
+static void LED_Driver_StopRegulation(uint8_t index) {
+  current_loops[index].target_ma = 0;
+}
+
+/**
+ * @brief  Advance the alarm state machine of a light by one reading
+ * @param  index: Light source index (0 to VAL_LIGHT_COUNT - 1)
+ * @param  now: Current tick in milliseconds
+ * @retval uint32_t: LED_DRIVER_EVENT_x flags to notify
+ */
+static uint32_t LED_Driver_StepAlarm(uint8_t index, uint32_t now) {
+  LED_Driver_AlarmMachine_t* machine = &alarm_machines[index];
+  LED_Driver_Reading_t reading;
+
+  LED_Driver_ReadLimits(index, &reading);
+
+  switch (machine->state) {
+    case LED_DRIVER_ALARM_NORMAL:
+    case LED_DRIVER_ALARM_WARNING: {
+      /* Count consecutive readings over the same limit */
+      if (reading.violation == 0) {
+        machine->pending = 0;
+        machine->count = 0;
+      } else {
+        if (reading.violation != machine->pending) {
+          machine->pending = reading.violation;
+          machine->count = 0;
+        }
+        if (machine->count == 0) {
+          machine->violation_cycles = Profiler_Start();
+          machine->violation_us = VAL_SysClock_GetMicros64();
+        }
+        if (++machine->count >= alarm_config.trip_samples) {
+          uint32_t events = LED_Driver_RaiseAlarm(index, reading.violation);
+          Profiler_Stop(PROFILER_PROBE_ALARM_REACTION, machine->violation_cycles);
+          return events;
+        }
+      }
+
+      /* A clean run as long as the longest backoff forgives earlier trips */
+      if (machine->recoveries > 0 && (now - machine->tick) >= alarm_config.recover_max_delay_ms) {
+        machine->recoveries = 0;
+      }
+
+      LED_Driver_AlarmState_t state = (reading.warning || reading.violation != 0) ?
+                                      LED_DRIVER_ALARM_WARNING : LED_DRIVER_ALARM_NORMAL;
+      if (state != machine->state) {
+        LED_Driver_SetAlarmState(index, state, reading.violation);
+        return LED_DRIVER_EVENT_ALARM_CHANGED;
+      }
+      return 0;
+    }
+
+    case LED_DRIVER_ALARM_TRIPPED:
+      if (!reading.released) {
+        machine->count = 0;
+      } else if (++machine->count >= alarm_config.release_samples) {
+        LED_Driver_SetAlarmState(index, LED_DRIVER_ALARM_RELEASED, light_alarms[index]);
+        return LED_DRIVER_EVENT_ALARM_CHANGED;
+      }
+      return 0;
+
+    case LED_DRIVER_ALARM_RELEASED:
+      /* The condition came back before the alarm was cleared */
+      if (!reading.released) {
+        LED_Driver_SetAlarmState(index, LED_DRIVER_ALARM_TRIPPED, light_alarms[index]);
+        machine->count = 0;
+        return LED_DRIVER_EVENT_ALARM_CHANGED;
+      }
+      if (alarm_config.auto_recover && (now - machine->tick) >= LED_Driver_RecoverDelay(machine)) {
+        return LED_Driver_RecoverAlarm(index, now);
+      }
+      return 0;
+
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief  Raise an alarm and turn the light off
+ * @note   Called from interrupt context, by the state machine and the
+ *         hardware over-current cutoff. A new trip fires the capture armed
+ *         by the alarm recorder (app_recorder.c).
+ * @param  index: Light source index (0 to VAL_LIGHT_COUNT - 1)
+ * @param  code: ERROR_OVER_CURRENT or ERROR_OVER_TEMPERATURE
+ * @retval uint32_t: LED_DRIVER_EVENT_x flags to notify
+ */
+VAL_RAMFUNC static uint32_t LED_Driver_RaiseAlarm(uint8_t index, uint8_t code) {
+  LED_Driver_AlarmMachine_t* machine = &alarm_machines[index];
+  uint32_t events = 0;
+  uint32_t primask = __get_PRIMASK();
+
+  /* The cutoff and the block interrupt may both trip the same light */
+  __disable_irq();
+
+  /* Cut the output first, bookkeeping follows */
+  VAL_PWM_StopChannel(index + 1);
+
+  if (light_alarms[index] != 0) {
+    /* Already off; a released light is tripped again */
+    if (machine->state == LED_DRIVER_ALARM_RELEASED) {
+      LED_Driver_SetAlarmState(index, LED_DRIVER_ALARM_TRIPPED, light_alarms[index]);
+      machine->count = 0;
+      events = LED_DRIVER_EVENT_ALARM_CHANGED;
+    }
+    __set_PRIMASK(primask);
+    return events;
+  }
+
+  /* A fade would keep driving the light, stop it where it is */
+  LED_Driver_CancelFade();
+
+  /* A regulated light is restored at its last duty cycle, in open loop */
+  LED_Driver_StopRegulation(index);
+  machine->restore_permille = current_permille[index];
+  LED_Driver_SetAlarmState(index, LED_DRIVER_ALARM_TRIPPED, code);
+  machine->tick = HAL_GetTick();
+  machine->trip_us = VAL_SysClock_GetMicros64();
+  /* The hardware cutoff trips without a reading over the limit */
+  if (machine->pending != code || machine->count == 0) {
+    machine->violation_us = machine->trip_us;
+  }
+  machine->pending = 0;
+  machine->count = 0;
+  if (machine->trip_count < UINT16_MAX) {
+    machine->trip_count++;
+  }
+  Counters_Increment(COUNTERS_ALARM_TRIPS);
+
+  /* Freeze the alarm recorder with the scans that led here */
+  VAL_Analog_TriggerFaultCapture();
+
+  light_alarms[index] = code;
+  current_permille[index] = 0;
+
+#ifdef BENCHMARK
+  injected_faults &= (uint8_t)~(1U << index);
+#endif
+
+  __set_PRIMASK(primask);
+
+  return LED_DRIVER_EVENT_ALARM_CHANGED | LED_DRIVER_EVENT_INTENSITY_CHANGED;
+}
+
+/**
+ * @brief  Clear a released alarm automatically and restore the intensity
+ * @param  index: Light source index (0 to VAL_LIGHT_COUNT - 1)
+ * @param  now: Current tick in milliseconds
+ * @retval uint32_t: LED_DRIVER_EVENT_x flags to notify
+ */
+static uint32_t LED_Driver_RecoverAlarm(uint8_t index, uint32_t now) {
+  LED_Driver_AlarmMachine_t* machine = &alarm_machines[index];
+
+  LED_Driver_SetAlarmState(index, LED_DRIVER_ALARM_NORMAL, light_alarms[index]);
+  machine->count = 0;
+  machine->tick = now;
+  if (LED_Driver_RecoverDelay(machine) < alarm_config.recover_max_delay_ms) {
+    machine->recoveries++;
+  }
+
+  light_alarms[index] = 0;
+  VAL_Analog_RearmCurrentWatchdog(index + 1);
+  VAL_Comparator_Rearm(index + 1);
+
+  /* Writing a compare value stops any fade, keep the fade state in step */
+  LED_Driver_CancelFade();
+  current_permille[index] = machine->restore_permille;
+  VAL_PWM_SetPermille(index + 1, LED_Driver_Derated(index, machine->restore_permille));
+
+  return LED_DRIVER_EVENT_ALARM_CHANGED | LED_DRIVER_EVENT_INTENSITY_CHANGED;
+}
+
+/**
+ * @brief  Get the backoff before the next automatic recovery of a light
+ * @param  machine: Alarm state machine of the light
+ * @retval uint32_t: Delay from the trip in milliseconds
+ */
+static uint32_t LED_Driver_RecoverDelay(const LED_Driver_AlarmMachine_t* machine) {
+  uint32_t delay = alarm_config.recover_delay_ms;
+
+  for (uint8_t i = 0; i < machine->recoveries && delay < alarm_config.recover_max_delay_ms; i++) {
+    delay *= 2U;
+  }
+
+  return (delay > alarm_config.recover_max_delay_ms) ? alarm_config.recover_max_delay_ms : delay;
+}
+
+/**
+ * @brief  Move the alarm state machine of a light to a new state
+ * @note   Every transition is traced, so the alarm history can be read back
+ * @param  index: Light source index (0 to VAL_LIGHT_COUNT - 1)
+ * @param  state: New state
+ * @param  code: ERROR_OVER_x code behind the transition, 0 if none
+ * @retval None
+ */
+static void LED_Driver_SetAlarmState(uint8_t index, LED_Driver_AlarmState_t state, uint8_t code) {
+  alarm_machines[index].state = state;
+  Trace_Record(TRACE_TYPE_ALARM, index + 1, (uint8_t)state, code, 0);
+}
+
+/**
+ * @brief  Recompute count thresholds if the ADC resolution has changed
+ * @note   Task context only, the hardware cutoff is reconfigured too
+ * @retval None
+ */
+static void LED_Driver_UpdateThresholds(void) {
+  uint32_t full_scale = VAL_Analog_GetFullScaleCounts();
+
+  if (thresholds.full_scale == full_scale) {
+    return;
+  }
+
+  LED_Driver_RefreshThresholds(full_scale);
+}
+
+/**
+ * @brief  Recompute count thresholds and hardware cutoffs unconditionally
+ * @note   Task context only
+ * @param  full_scale: ADC full scale the thresholds are computed for
+ * @retval None
+ */
+static void LED_Driver_RefreshThresholds(uint32_t full_scale) {
+  int32_t trip_ma[NUM_LIGHT_SOURCES];
+
+  LED_Driver_ComputeThresholds(full_scale);
+
+  /* Hardware cutoff limits are in counts too, so they follow the same change */
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    trip_ma[i] = limits[i].current_trip_ma;
+  }
+  VAL_Analog_EnableCurrentWatchdog(LED_Driver_WatchdogCallback, trip_ma);
+  VAL_Comparator_Enable(LED_Driver_WatchdogCallback, trip_ma);
+}
+
+/**
+ * @brief  Compute the count thresholds for an ADC full scale
+ * @note   Published at once, the block interrupt never sees a mix
+ * @param  full_scale: ADC full scale the thresholds are computed for
+ * @retval None
+ */
+static void LED_Driver_ComputeThresholds(uint32_t full_scale) {
+  LED_Driver_Thresholds_t computed;
+  uint32_t keep = 1000U - alarm_config.hysteresis_permille;
+  uint32_t margin = full_scale / SENSOR_RAIL_DIVIDER;
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    const LED_Driver_Limits_t* light = &limits[i];
+
+    /* Each light converts through its own calibration */
+    uint8_t id = i + 1;
+
+    computed.current_warn[i] = VAL_Analog_CurrentToCounts(id, light->current_warn_ma);
+    computed.current_max[i] = VAL_Analog_CurrentToCounts(id, light->current_max_ma);
+    computed.current_release[i] = VAL_Analog_CurrentToCounts(id, light->current_max_ma * (int32_t)keep / 1000);
+    /* The minimum is the zero offset, which noise reads under by a few
+     * counts with the output off; only a reading a rail margin under it
+     * is implausible */
+    uint32_t current_min = VAL_Analog_CurrentToCounts(id, LIGHT_CURRENT_MIN_MA);
+    computed.current_min[i] = (current_min > margin) ? (current_min - margin) : 0U;
+    computed.temp_warn[i] = VAL_Analog_TemperatureToCounts(id, light->temperature_warn_cdeg);
+    computed.temp_max[i] = VAL_Analog_TemperatureToCounts(id, light->temperature_max_cdeg);
+    computed.temp_release[i] = VAL_Analog_TemperatureToCounts(id, light->temperature_max_cdeg * (int32_t)keep / 1000);
+    computed.temp_min[i] = VAL_Analog_TemperatureToCounts(id, LIGHT_TEMP_MIN_CDEG);
+
+    uint32_t step_base = VAL_Analog_TemperatureToCounts(id, SENSOR_TEMP_STEP_BASE_CDEG);
+    uint32_t step_top = VAL_Analog_TemperatureToCounts(id, SENSOR_TEMP_STEP_BASE_CDEG + SENSOR_TEMP_STEP_CDEG);
+    computed.temp_step[i] = (step_top > step_base) ? (step_top - step_base) : 1U;
+    computed.current_on[i] = VAL_Analog_CurrentToCounts(id, SENSOR_CURRENT_ON_MA);
+    computed.current_off[i] = VAL_Analog_CurrentToCounts(id, SENSOR_CURRENT_OFF_MA);
+  }
+  computed.rail_margin = margin;
+  computed.full_scale = full_scale;
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  thresholds = computed;
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Write a PWM output, honouring an alarm raised meanwhile
+ * @note   The watchdog interrupt may trip between the alarm check and the
+ *         PWM write; re-checking afterwards keeps the output off in that case.
+ * @param  index: Light source index (0 to VAL_LIGHT_COUNT - 1)
+ * @param  permille: Intensity value (0-1000), before derating
+ * @param  status: Set to the PWM status if the write failed
+ * @retval None
+ */
+static void LED_Driver_ApplyOutput(uint8_t index, uint16_t permille, VAL_Status* status) {
+  VAL_Status pwm_status = VAL_PWM_SetPermille(index + 1, LED_Driver_Derated(index, permille));
+  if (pwm_status != VAL_OK) {
+    *status = pwm_status;
+  }
+
+  if (light_alarms[index]) {
+    current_permille[index] = 0;
+    VAL_PWM_StopChannel(index + 1);
+  }
+}
+
+/**
+ * @brief  Hardware over-current trip, called from the ADC watchdog or the
+ *         comparator interrupt
+ * @param  light_id: Light source ID (1-VAL_LIGHT_COUNT)
+ * @retval None
+ */
+VAL_RAMFUNC static void LED_Driver_WatchdogCallback(uint8_t light_id) {
+  /* No debouncing, the cutoff sits above the software limit */
+  uint32_t events = LED_Driver_RaiseAlarm(light_id - 1, ERROR_OVER_CURRENT);
+
+  /* A comparator trip broke all outputs; with the tripped light off the
+   * others run on, else the block interrupt retries */
+  VAL_PWM_RecoverBreak();
+
+  if (events != 0) {
+    LED_Driver_NotifyEvent(events);
+  }
+}
+
+/**
+ * @brief  Build the fade table for a set of lights and start playing it
+ * @note   The lights in the mask must have no alarm and no regulation. The
+ *         other lights hold their output.
+ * @param  mask: Lights to fade, one bit per index
+ * @param  targets: Target intensity per light (0-1000), used for the mask
+ * @param  duration_ms: Fade duration in milliseconds (1-LED_DRIVER_FADE_MAX_MS)
+ * @param  curve: Fade curve
+ * @retval VAL_Status: VAL_OK if the fade started, VAL_ERROR otherwise
+ */
+static VAL_Status LED_Driver_StartFade(uint8_t mask, const uint16_t* targets, uint16_t duration_ms,
+                                       LED_Driver_FadeCurve_t curve) {
+  uint16_t hold[NUM_LIGHT_SOURCES];
+  uint16_t start[NUM_LIGHT_SOURCES];
+  VAL_Status status;
+
+  /* The table is played as given, so it keeps to the slew limits itself,
+   * on average over the fade */
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (mask & (1U << i)) {
+      uint32_t slew_ms = VAL_PWM_GetSlewTime(i + 1, LED_Driver_Derated(i, current_permille[i]),
+                                             LED_Driver_Derated(i, targets[i]));
+      if (slew_ms > duration_ms) {
+        duration_ms = (uint16_t)slew_ms;
+      }
+    }
+  }
+
+  /* Aim for FADE_STEP_MS per row, fewer rows than that get longer steps */
+  uint32_t steps = duration_ms / FADE_STEP_MS;
+  if (steps == 0) {
+    steps = 1;
+  } else if (steps > FADE_MAX_STEPS) {
+    steps = FADE_MAX_STEPS;
+  }
+
+  uint32_t periods = ((uint32_t)duration_ms * VAL_PWM_GetFrequency() + steps * 500U) / (steps * 1000U);
+  if (periods == 0) {
+    periods = 1;
+  }
+
+  /* Build the table: the fading lights follow the curve, the rest hold.
+   * Regulated lights hold the compare value their controller last wrote. */
+  memcpy(start, current_permille, sizeof(start));
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (light_alarms[i]) {
+      hold[i] = 0;
+    } else if (current_loops[i].target_ma != 0) {
+      hold[i] = VAL_PWM_RampCompare(i + 1, current_loops[i].compare);
+    } else {
+      hold[i] = VAL_PWM_PermilleToCompare(i + 1, LED_Driver_Derated(i, current_permille[i]));
+    }
+  }
+
+  for (uint32_t step = 0; step < steps; step++) {
+    float y = LED_Driver_FadeCurve(curve, (float)(step + 1) / (float)steps);
+
+    memcpy(fade_table[step], hold, sizeof(hold));
+    for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+      float from = (float)start[i];
+      float to = (float)targets[i];
+      float value;
+
+      if ((mask & (1U << i)) == 0) {
+        continue;
+      }
+
+      if (curve == LED_DRIVER_FADE_PERCEPTUAL) {
+        /* Interpolate in the square root domain, perceived brightness */
+        float root = sqrtf(from) + (sqrtf(to) - sqrtf(from)) * y;
+        value = root * root;
+      } else {
+        value = from + (to - from) * y;
+      }
+
+      fade_table[step][i] = VAL_PWM_PermilleToCompare(i + 1, LED_Driver_Derated(i, (uint16_t)(value + 0.5f)));
+    }
+  }
+
+  /* Reads report the targets while fading */
+  fade_mask = mask;
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (mask & (1U << i)) {
+      fade_derate[i] = LED_Driver_Derated(i, DERATE_UNITY);
+      current_permille[i] = targets[i];
+    }
+  }
+  fade_active = true;
+
+  status = VAL_PWM_StartRamp(&fade_table[0][0], (uint16_t)steps, periods);
+  if (status != VAL_OK) {
+    fade_active = false;
+    memcpy(current_permille, start, sizeof(start));
+    return VAL_ERROR;
+  }
+
+  /* The watchdog may have tripped meanwhile, keep the output off then */
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if ((mask & (1U << i)) && light_alarms[i]) {
+      VAL_PWM_StopChannel(i + 1);
+      LED_Driver_CancelFade();
+      current_permille[i] = 0;
+      return VAL_ERROR;
+    }
+  }
+
+  LED_Driver_NotifyEvent(LED_DRIVER_EVENT_INTENSITY_CHANGED);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Stop a running fade, keeping the faded lights where they are
+ * @note   Called from task and interrupt context
+ * @retval None
+ */
+static void LED_Driver_CancelFade(void) {
+  uint16_t permille;
+
+  if (!fade_active) {
+    return;
+  }
+
+  VAL_PWM_StopRamp();
+  fade_active = false;
+  effect_active = false;
+
+  /* Reads returned the targets, report the values the fade stopped at,
+   * before the derating the table was built with */
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if ((fade_mask & (1U << i)) == 0 || VAL_PWM_GetPermille(i + 1, &permille) != VAL_OK) {
+      continue;
+    }
+
+    uint32_t requested = (fade_derate[i] == 0) ? current_permille[i] :
+                         ((uint32_t)permille * DERATE_UNITY + fade_derate[i] / 2U) / fade_derate[i];
+    current_permille[i] = (requested > VAL_PWM_PERMILLE_MAX) ? VAL_PWM_PERMILLE_MAX : (uint16_t)requested;
+  }
+
+  LED_Driver_NotifyEvent(LED_DRIVER_EVENT_INTENSITY_CHANGED);
+}
+
+/**
+ * @brief  Fade finished, called from the DMA interrupt
+ * @retval None
+ */
+static void LED_Driver_FadeCompleteCallback(void) {
+  fade_active = false;
+  effect_active = false;
+}
+
+/**
+ * @brief  Compute rows of the effect table, called from the DMA interrupt
+ * @note   Also called once to fill the table before the loop starts. The
+ *         rows are computed in order, one generator step each.
+ * @param  first_row: First row to compute
+ * @param  rows: Number of rows
+ * @retval None
+ */
+static void LED_Driver_FillEffect(uint16_t first_row, uint16_t rows) {
+  for (uint32_t row = first_row; row < (uint32_t)first_row + rows; row++) {
+    uint16_t modulation = Effect_Step(&effect_generator);
+
+    for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+      if ((fade_mask & (1U << i)) == 0) {
+        fade_table[row][i] = effect_hold[i];
+        continue;
+      }
+
+      uint16_t level = Effect_Level(effect_crest[i], effect_depth, modulation);
+      int32_t target = VAL_PWM_PermilleToCompare(i + 1, LED_Driver_Derated(i, level));
+      int32_t last = effect_last[i];
+      int32_t step_max = effect_step_max[i];
+
+      if (step_max != 0 && target > last + step_max) {
+        target = last + step_max;
+      } else if (step_max != 0 && target < last - step_max) {
+        target = last - step_max;
+      }
+
+      effect_last[i] = (uint16_t)target;
+      fade_table[row][i] = (uint16_t)target;
+    }
+  }
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (fade_mask & (1U << i)) {
+      fade_derate[i] = LED_Driver_Derated(i, DERATE_UNITY);
+    }
+  }
+}
+
+/**
+ * @brief  Update the held outputs of a running effect to the present factors
+ * @note   Called from the block interrupt; the rows computed next hold them
+ * @retval None
+ */
+static void LED_Driver_RefreshEffectHold(void) {
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if ((fade_mask & (1U << i)) == 0 && light_alarms[i] == 0 && current_loops[i].target_ma == 0) {
+      effect_hold[i] = VAL_PWM_PermilleToCompare(i + 1, LED_Driver_Derated(i, current_permille[i]));
+    }
+  }
+}
+
+/**
+ * @brief  Align the outputs for the sampling mode
+ * @note   Not while strobing; the strobe runs all outputs leading anyway and
+ *         puts back the alignment it found
+ * @param  staggered: As in the channel table if true, all leading otherwise
+ * @retval None
+ */
+static void LED_Driver_AlignOutputs(bool staggered) {
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    bool trailing = staggered && VAL_Channels[i].pwm_trailing;
+
+    VAL_PWM_SetAlignment(i + 1, trailing ? VAL_PWM_ALIGN_TRAILING : VAL_PWM_ALIGN_LEADING);
+  }
+}
+
+/**
+ * @brief  Staged intensities latched, called from the context that committed
+ *         them, the sync line interrupt included
+ * @retval None
+ */
+static void LED_Driver_LatchCallback(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  /* Against the cutoff, which preempts the sync line interrupt */
+  __disable_irq();
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if ((staged_lights & (1U << i)) == 0) {
+      continue;
+    }
+
+    /* An alarm raised meanwhile keeps its output off */
+    if (light_alarms[i]) {
+      current_permille[i] = 0;
+      VAL_PWM_StopChannel(i + 1);
+    } else {
+      current_permille[i] = staged_permille[i];
+    }
+  }
+  staged_lights = 0;
+  __set_PRIMASK(primask);
+
+  LED_Driver_NotifyEvent(LED_DRIVER_EVENT_INTENSITY_CHANGED);
+}
+
+/**
+ * @brief  Evaluate a fade curve
+ * @param  curve: Fade curve
+ * @param  x: Fade progress (0-1)
+ * @retval float: Curve value (0-1)
+ */
+static float LED_Driver_FadeCurve(LED_Driver_FadeCurve_t curve, float x) {
+  switch (curve) {
+    case LED_DRIVER_FADE_EASE:
+      return x * x * (3.0f - 2.0f * x);
+    case LED_DRIVER_FADE_LINEAR:
+    case LED_DRIVER_FADE_PERCEPTUAL:
+    default:
+      return x;
+  }
+}
+
+/**
+ * @brief  Check a light source against its thresholds
+ * @note   Temperature takes precedence when both limits are exceeded
+ * @param  index: Light source index (0 to VAL_LIGHT_COUNT - 1)
+ * @param  reading: Pointer to store the evaluation
+ * @retval None
+ */
+static void LED_Driver_ReadLimits(uint8_t index, LED_Driver_Reading_t* reading) {
+  uint32_t current_counts = 0;
+  uint32_t temp_counts = 0;
+
+  VAL_Analog_GetRawCounts(index + 1, &current_counts, &temp_counts);
+
+  /* Readings under the minimum cannot be real, as implausible ones */
+  bool fault = LED_Driver_CheckSensors(index, current_counts, temp_counts) ||
+               temp_counts < thresholds.temp_min[index] ||
+               current_counts < thresholds.current_min[index];
+
+  /* A faulty input is not reported as the overload it may look like */
+  if (fault) {
+    reading->violation = ERROR_SENSOR_FAULT;
+  } else if (temp_counts > thresholds.temp_max[index]) {
+    reading->violation = ERROR_OVER_TEMPERATURE;
+  } else if (current_counts > thresholds.current_max[index]) {
+    reading->violation = ERROR_OVER_CURRENT;
+  } else {
+    reading->violation = 0;
+  }
+
+  reading->warning = temp_counts > thresholds.temp_warn[index] ||
+                     current_counts > thresholds.current_warn[index];
+  reading->released = !fault &&
+                      temp_counts <= thresholds.temp_release[index] &&
+                      current_counts <= thresholds.current_release[index];
+
+#ifdef BENCHMARK
+  if (injected_faults & (1U << index)) {
+    reading->violation = ERROR_OVER_CURRENT;
+    reading->warning = true;
+    reading->released = false;
+  }
+#endif
+}
+
+/**
+ * @brief  Check the inputs of a light for readings no working sensor gives
+ * @note   Called once per block. A temperature stuck at a rail or jumping
+ *         faster than the light can heat up is a broken thermistor; a
+ *         current that does not follow the PWM output for
+ *         SENSOR_MISMATCH_BLOCKS is a broken current sense or output. An
+ *         over-current trips long before a mismatch is counted up.
+ * @param  index: Light source index (0 to VAL_LIGHT_COUNT - 1)
+ * @param  current_counts: Filtered current counts of the block
+ * @param  temp_counts: Filtered temperature counts of the block
+ * @retval bool: true if a reading is implausible
+ */
+static bool LED_Driver_CheckSensors(uint8_t index, uint32_t current_counts, uint32_t temp_counts) {
+  LED_Driver_SensorCheck_t* check = &sensor_checks[index];
+  uint32_t margin = thresholds.rail_margin;
+  bool fault = false;
+
+  if (temp_counts <= margin || temp_counts >= thresholds.full_scale - margin) {
+    fault = true;
+  }
+
+  if (check->primed) {
+    uint32_t step = (temp_counts > check->previous_temp) ?
+                    (temp_counts - check->previous_temp) : (check->previous_temp - temp_counts);
+    if (step > thresholds.temp_step[index]) {
+      fault = true;
+    }
+  }
+  check->previous_temp = temp_counts;
+  check->primed = true;
+
+  /* Strobe pulses are too short for the filtered current to follow,
+   * unless each scan is taken within one */
+  if (!VAL_PWM_IsStrobeActive() || VAL_PWM_IsStrobeFreeRunning()) {
+    uint32_t compare = VAL_PWM_GetCompare(index + 1);
+    uint32_t duty_permille = compare * VAL_PWM_PERMILLE_MAX / VAL_PWM_GetChannelPeriod(index + 1);
+    bool mismatch = (compare == 0 && current_counts > thresholds.current_on[index]) ||
+                    (duty_permille >= SENSOR_DUTY_ON_PERMILLE &&
+                     current_counts < thresholds.current_off[index]);
+
+    if (!mismatch) {
+      check->mismatch = 0;
+    } else if (check->mismatch < SENSOR_MISMATCH_BLOCKS) {
+      check->mismatch++;
+    }
+    if (check->mismatch >= SENSOR_MISMATCH_BLOCKS) {
+      fault = true;
+    }
+  } else {
+    check->mismatch = 0;
+  }
+
+  return fault;
+}
+
+/**
+ * @brief  Forward events to the registered event callback
+ * @note   An output change also fires a raw capture armed for it
+ * @param  events: LED_DRIVER_EVENT_x flags
+ * @retval None
+ */
+static void LED_Driver_NotifyEvent(uint32_t events) {
+  if (events & LED_DRIVER_EVENT_INTENSITY_CHANGED) {
+    VAL_Analog_TriggerCapture();
+  }
+
+  if (event_callback != NULL) {
+    event_callback(events);
+  }
+}
+
+/**
+ * @brief  Validate light source ID
+ * @param  lightId: Light source ID to validate
+ * @retval VAL_Status: VAL_OK if valid, VAL_ERROR otherwise
+ */
+static VAL_Status LED_Driver_ValidateLightId(uint8_t light_id) {
+  if (light_id < 1 || light_id > NUM_LIGHT_SOURCES) {
+    return VAL_ERROR;
+  }
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get sensor readings for a specific light source
+ * @note   Converted from the filtered ADC readings on each call; the driver
+ *         keeps no copy.
+ * @param  lightId: Light source ID (1-VAL_LIGHT_COUNT)
+ * @param  sensorData: Pointer to store the retrieved sensor data
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_GetSensorData(uint8_t light_id, LightSensorData_t* sensor_data) {
+  /* Validate input */
+  VAL_Status status = LED_Driver_ValidateLightId(light_id);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  if (sensor_data == NULL) {
+    return VAL_ERROR;
+  }
+
+  return VAL_Analog_GetSensorData(light_id, (LightSensorData*)sensor_data);
+}
+
+/**
+ * @brief  Refresh the alarm thresholds and get sensor readings for all light sources
+ * @note   Meant for the sampling path: follows a change of the ADC resolution,
+ *         then converts the filtered ADC readings straight into the caller's
+ *         array. The alarms themselves are evaluated in the ADC interrupt.
+ * @param  sensorData: Array to store the retrieved sensor data (must hold VAL_LIGHT_COUNT entries)
+ * @param  stamp: Pointer to store when the readings were taken, or NULL
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_GetAllSensorData(LightSensorData_t* sensor_data, LightSampleStamp_t* stamp) {
+  uint32_t probe_start = Profiler_Start();
+
+  /* Validate input */
+  if (sensor_data == NULL) {
+    return VAL_ERROR;
+  }
+
+  LED_Driver_UpdateThresholds();
+
+  VAL_Status status = VAL_Analog_GetAllSensorData((LightSensorData*)sensor_data, (AnalogSampleStamp*)stamp);
+
+  Profiler_Stop(PROFILER_PROBE_SENSOR_UPDATE, probe_start);
+
+  return status;
+}
+
+/**
+ * @brief  Clear alarm for a specific light source
+ * @note   Only a released alarm can be cleared: the readings must have stayed
+ *         under the release thresholds for release_samples readings. The
+ *         light stays off and the automatic recovery backoff starts over.
+ * @param  lightId: Light source ID (1-VAL_LIGHT_COUNT)
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_ClearAlarm(uint8_t light_id) {
+  /* Validate input */
+  VAL_Status status = LED_Driver_ValidateLightId(light_id);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  return LED_Driver_ClearAlarms(1UL << (light_id - 1), NULL);
+}
+
+/**
+ * @brief  Clear the alarms of a set of light sources together
+ * @note   As LED_Driver_ClearAlarm for each light, with every light checked
+ *         against the same alarm state: the interrupt that steps the state
+ *         machines is held off for the whole set, and one alarm change is
+ *         notified for all of them.
+ * @param  mask: Bit n for light n+1, none above VAL_LIGHT_COUNT
+ * @param  failed: Set to the lights whose alarm stays, or NULL
+ * @retval VAL_Status: VAL_OK if all are clear, VAL_ERROR if any alarm stays,
+ *         VAL_PARAM for an empty or invalid mask
+ */
+VAL_Status LED_Driver_ClearAlarms(uint32_t mask, uint32_t* failed) {
+  uint32_t stayed = 0;
+  bool changed = false;
+  uint32_t primask;
+
+  if (failed != NULL) {
+    *failed = 0;
+  }
+  if (mask == 0 || (mask >> NUM_LIGHT_SOURCES) != 0) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    LED_Driver_AlarmMachine_t* machine = &alarm_machines[i];
+
+    /* Not asked for, or nothing to clear */
+    if ((mask & (1UL << i)) == 0 || light_alarms[i] == 0) {
+      continue;
+    }
+
+    if (machine->state != LED_DRIVER_ALARM_RELEASED) {
+      /* Cannot clear alarm - conditions are still present */
+      stayed |= 1UL << i;
+      continue;
+    }
+
+    /* Clear the alarm and re-arm the hardware cutoff */
+    LED_Driver_SetAlarmState(i, LED_DRIVER_ALARM_NORMAL, light_alarms[i]);
+    machine->count = 0;
+    machine->recoveries = 0;
+    light_alarms[i] = 0;
+    VAL_Analog_RearmCurrentWatchdog(i + 1);
+    VAL_Comparator_Rearm(i + 1);
+    changed = true;
+  }
+
+  __set_PRIMASK(primask);
+
+  if (changed) {
+    LED_Driver_NotifyEvent(LED_DRIVER_EVENT_ALARM_CHANGED);
+  }
+  if (failed != NULL) {
+    *failed = stayed;
+  }
+
+  return (stayed == 0) ? VAL_OK : VAL_ERROR;
+}
+
+/**
+ * @brief  Get alarm status for all light sources
+ * @param  alarms: Array to store alarm status (must hold VAL_LIGHT_COUNT entries)
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_GetAlarmStatus(uint8_t* alarms) {
+  /* Validate input */
+  if (alarms == NULL) {
+    return VAL_ERROR;
+  }
+
+  /* Copy alarm status to the provided array */
+  memcpy(alarms, light_alarms, NUM_LIGHT_SOURCES * sizeof(uint8_t));
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the alarm state machine of a light source
+ * @param  lightId: Light source ID (1-VAL_LIGHT_COUNT)
+ * @param  info: Pointer to store the alarm state
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_GetAlarmInfo(uint8_t light_id, LED_Driver_AlarmInfo_t* info) {
+  LED_Driver_AlarmMachine_t machine;
+  uint8_t code;
+  uint32_t primask;
+
+  /* Validate input */
+  if (LED_Driver_ValidateLightId(light_id) != VAL_OK || info == NULL) {
+    return VAL_ERROR;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  machine = alarm_machines[light_id - 1];
+  code = light_alarms[light_id - 1];
+  __set_PRIMASK(primask);
+
+  info->state = machine.state;
+  info->code = code;
+  info->trip_count = machine.trip_count;
+  info->trip_us = machine.trip_us;
+  info->violation_us = machine.violation_us;
+  info->recover_in_ms = 0;
+
+  /* Recovery is due once the light is released and the backoff has passed */
+  if (alarm_config.auto_recover && code != 0) {
+    uint32_t elapsed = HAL_GetTick() - machine.tick;
+    uint32_t delay = LED_Driver_RecoverDelay(&machine);
+    info->recover_in_ms = (elapsed < delay) ? (delay - elapsed) : 0;
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Change how readings are debounced and alarms released
+ * @param  config: New configuration
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status LED_Driver_SetAlarmConfig(const LED_Driver_AlarmConfig_t* config) {
+  uint32_t primask;
+
+  if (config == NULL || config->trip_samples == 0 || config->release_samples == 0 ||
+      config->hysteresis_permille > ALARM_HYSTERESIS_MAX ||
+      config->recover_delay_ms == 0 || config->recover_delay_ms > config->recover_max_delay_ms) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  alarm_config = *config;
+  __set_PRIMASK(primask);
+
+  /* Release thresholds depend on the hysteresis */
+  if (thresholds.full_scale == VAL_Analog_GetFullScaleCounts()) {
+    LED_Driver_ComputeThresholds(thresholds.full_scale);
+  } else {
+    LED_Driver_UpdateThresholds();
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the alarm configuration
+ * @param  config: Pointer to store the configuration
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if config is NULL
+ */
+VAL_Status LED_Driver_GetAlarmConfig(LED_Driver_AlarmConfig_t* config) {
+  if (config == NULL) {
+    return VAL_PARAM;
+  }
+
+  *config = alarm_config;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Replace the alarm limits of all light sources
+ * @note   Task context only. The count thresholds and hardware cutoffs are
+ *         recomputed at once, also after a change of the analog scale.
+ * @param  new_limits: Limits per light, VAL_LIGHT_COUNT entries
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status LED_Driver_SetLimits(const LED_Driver_Limits_t* new_limits) {
+  if (new_limits == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* Reject the whole set if any light is inconsistent */
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    const LED_Driver_Limits_t* light = &new_limits[i];
+
+    if (light->current_warn_ma <= 0 || light->current_warn_ma > light->current_max_ma ||
+        light->current_max_ma > light->current_trip_ma ||
+        light->temperature_warn_cdeg <= 0 || light->temperature_warn_cdeg > light->temperature_max_cdeg) {
+      return VAL_PARAM;
+    }
+  }
+
+  /* The coordinator task may be recomputing the thresholds from them */
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  memcpy(limits, new_limits, sizeof(limits));
+  __set_PRIMASK(primask);
+
+  LED_Driver_RefreshThresholds(VAL_Analog_GetFullScaleCounts());
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the alarm limits of all light sources
+ * @param  out_limits: Array to store the limits (must hold VAL_LIGHT_COUNT entries)
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if out_limits is NULL
+ */
+VAL_Status LED_Driver_GetLimits(LED_Driver_Limits_t* out_limits) {
+  if (out_limits == NULL) {
+    return VAL_PARAM;
+  }
+
+  memcpy(out_limits, limits, sizeof(limits));
+  return VAL_OK;
+}
+
+/**
+ * @brief  Change the thermal derating controller
+ * @note   Restarts the controllers of all lights from no derating
+ * @param  config: New configuration
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status LED_Driver_SetDerateConfig(const LED_Driver_DerateConfig_t* config) {
+  uint32_t primask;
+
+  if (config == NULL || config->kp_permille_per_deg > DERATE_GAIN_MAX ||
+      config->ki_permille_per_deg_s > DERATE_GAIN_MAX || config->min_permille > DERATE_UNITY) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  derate_config = *config;
+  derate_block_hz = 0;
+  memset(derate_integral_q16, 0, sizeof(derate_integral_q16));
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the thermal derating configuration
+ * @param  config: Pointer to store the configuration
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if config is NULL
+ */
+VAL_Status LED_Driver_GetDerateConfig(LED_Driver_DerateConfig_t* config) {
+  if (config == NULL) {
+    return VAL_PARAM;
+  }
+
+  *config = derate_config;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the derate factor applied to each light source
+ * @param  factors: Array to store the factors in permille, 1000 for the full
+ *         output (must hold VAL_LIGHT_COUNT entries)
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if factors is NULL
+ */
+VAL_Status LED_Driver_GetDerating(uint16_t* factors) {
+  if (factors == NULL) {
+    return VAL_PARAM;
+  }
+
+  memcpy(factors, derate_permille, sizeof(derate_permille));
+  return VAL_OK;
+}
+
+/**
+ * @brief  Set the largest total current of all lights
+ * @param  limit_ma: Total current in mA, 0 for no limit
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if negative
+ */
+VAL_Status LED_Driver_SetCurrentBudget(int32_t limit_ma) {
+  if (limit_ma < 0) {
+    return VAL_PARAM;
+  }
+
+  /* Picked up by the next block */
+  budget_limit_ma = limit_ma;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the supply current budget and the factor it applies
+ * @param  budget: Pointer to store the budget
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if budget is NULL
+ */
+VAL_Status LED_Driver_GetCurrentBudget(LED_Driver_Budget_t* budget) {
+  uint32_t primask;
+
+  if (budget == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  budget->limit_ma = budget_limit_ma;
+  budget->total_ma = budget_total_ma;
+  budget->permille = budget_permille;
+  budget->supply_low = supply_low;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Dither the steady outputs for resolution below one timer count
+ * @note   Each light alternates between the compare values around its
+ *         on-time over VAL_PWM_DITHER_STEPS PWM periods, which adds
+ *         VAL_PWM_DITHER_BITS of resolution for deep dimming and regulation,
+ *         at a ripple of one count at the PWM frequency over
+ *         VAL_PWM_DITHER_STEPS. Starts on the next sample block; fades,
+ *         staged intensities and the strobe play undithered.
+ * @param  enable: true to dither, false for one compare value per light
+ * @retval VAL_Status: VAL_OK
+ */
+VAL_Status LED_Driver_SetDither(bool enable) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  dither_enabled = enable;
+
+  /* Round every light back to the nearest count */
+  if (!enable && VAL_PWM_IsDitherActive()) {
+    VAL_PWM_StopRamp();
+    for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+      if (light_alarms[i] != 0) {
+        continue;
+      }
+      if (current_loops[i].target_ma != 0) {
+        VAL_PWM_SetCompare(i + 1, current_loops[i].compare);
+      } else {
+        VAL_PWM_StagePermille(i + 1, LED_Driver_Derated(i, current_permille[i]));
+      }
+    }
+    VAL_PWM_CommitAll();
+  }
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Check whether steady outputs are dithered
+ * @retval bool: true if enabled with LED_Driver_SetDither
+ */
+bool LED_Driver_IsDitherEnabled(void) {
+  return dither_enabled;
+}
+
+/**
+ * @brief  Regulate a light source to a constant current
+ * @note   The controller starts from the present duty cycle. An intensity
+ *         or fade command, or an alarm, returns the light to open loop.
+ * @param  light_id: Light source ID (1-VAL_LIGHT_COUNT)
+ * @param  current_ma: Target current, up to the light's maximum current
+ *         limit; 0 turns the light off in open loop
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_SetCurrent(uint8_t light_id, int32_t current_ma) {
+  VAL_Status status;
+
+  /* Validate input */
+  status = LED_Driver_ValidateLightId(light_id);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  uint8_t index = light_id - 1;
+  if (current_ma < 0 || current_ma > limits[index].current_max_ma) {
+    return VAL_ERROR;
+  }
+
+  if (current_ma == 0) {
+    return LED_Driver_SetIntensityPermille(light_id, 0);
+  }
+
+  if (VAL_PWM_IsStrobeActive()) {
+    return VAL_BUSY;
+  }
+
+  LED_Driver_CancelFade();
+
+  /* The block interrupt steps the controller and may raise an alarm */
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  if (light_alarms[index]) {
+    __set_PRIMASK(primask);
+    return VAL_ERROR;
+  }
+
+  /* Bumpless start: the integral holds the duty cycle driven now */
+  LED_Driver_CurrentLoop_t* loop = &current_loops[index];
+  if (loop->target_ma == 0) {
+    uint16_t duty_permille = LED_Driver_Derated(index, current_permille[index]);
+
+    loop->integral_q16 = (int64_t)(((uint32_t)duty_permille << 16) / VAL_PWM_PERMILLE_MAX) << 16;
+    loop->compare = VAL_PWM_GetCompare(light_id);
+    loop->fine = loop->compare << VAL_PWM_DITHER_BITS;
+    loop->primed = false;
+    loop->countdown = 1;
+  }
+  loop->target_ma = current_ma;
+  __set_PRIMASK(primask);
+
+  LED_Driver_NotifyEvent(LED_DRIVER_EVENT_INTENSITY_CHANGED);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the constant-current target of a light source
+ * @param  light_id: Light source ID (1-VAL_LIGHT_COUNT)
+ * @param  current_ma: Pointer to store the target; 0 in open-loop operation
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status LED_Driver_GetCurrentTarget(uint8_t light_id, int32_t* current_ma) {
+  if (LED_Driver_ValidateLightId(light_id) != VAL_OK || current_ma == NULL) {
+    return VAL_ERROR;
+  }
+
+  *current_ma = current_loops[light_id - 1].target_ma;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Change the constant-current controller
+ * @note   Running controllers continue with the new gains and limits
+ * @param  config: New configuration
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status LED_Driver_SetCurrentLoopConfig(const LED_Driver_CurrentLoopConfig_t* config) {
+  uint32_t primask;
+
+  if (config == NULL || config->interval_blocks == 0 ||
+      config->output_min_permille > config->output_max_permille ||
+      config->output_max_permille > VAL_PWM_PERMILLE_MAX) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  loop_config = *config;
+  loop_step_hz = 0;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the constant-current controller configuration
+ * @param  config: Pointer to store the configuration
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if config is NULL
+ */
+VAL_Status LED_Driver_GetCurrentLoopConfig(LED_Driver_CurrentLoopConfig_t* config) {
+  if (config == NULL) {
+    return VAL_PARAM;
+  }
+
+  *config = loop_config;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Sample the currents at a fixed point of the PWM period
+ * @note   One scan samples all currents, so the outputs are all leading-edge
+ *         aligned meanwhile: on from the start of the period, and a phase
+ *         below the lowest duty cycle in use reads the on-state current.
+ *         Free-running sampling staggers them again as in the channel table.
+ * @param  phase_permille: Sampling point as a fraction of the period (1-999),
+ *         or 0 to sample at the free-running scan rate
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if out of range,
+ *         VAL_ERROR if the ADC could not be reconfigured
+ */
+VAL_Status LED_Driver_SetSamplePhase(uint16_t phase_permille) {
+  VAL_Status status;
+
+  status = VAL_PWM_SetAdcTrigger(phase_permille);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* Only switch the ADC trigger when entering or leaving synchronous mode */
+  if ((phase_permille == 0) != (sample_phase_permille == 0)) {
+    LED_Driver_AlignOutputs(phase_permille == 0);
+    status = VAL_Analog_SyncToPwm((phase_permille != 0) ? VAL_PWM_GetFrequency() : 0);
+  }
+
+  sample_phase_permille = phase_permille;
+
+  return status;
+}
+
+/**
+ * @brief  Change the PWM frequency, e.g. to avoid banding on a camera
+ * @note   Duty cycles and so intensities are kept, the change latches on one
+ *         PWM period boundary. A running fade is cancelled, its steps were
+ *         timed in periods. Synchronous sampling follows the new frequency.
+ * @param  freq_hz: Frequency (VAL_PWM_FREQ_MIN_HZ-VAL_PWM_FREQ_MAX_HZ)
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if out of range,
+ *         VAL_BUSY while strobing or a latch is armed, VAL_ERROR if the ADC
+ *         could not be reconfigured
+ */
+VAL_Status LED_Driver_SetPwmFrequency(uint32_t freq_hz) {
+  VAL_Status status;
+
+  if (freq_hz < VAL_PWM_FREQ_MIN_HZ || freq_hz > VAL_PWM_FREQ_MAX_HZ) {
+    return VAL_PARAM;
+  }
+
+  LED_Driver_CancelFade();
+
+  status = VAL_PWM_SetFrequency(freq_hz);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* The scan rate is derived from the PWM frequency while synchronized */
+  if (sample_phase_permille != 0) {
+    status = VAL_Analog_SyncToPwm(VAL_PWM_GetFrequency());
+  }
+
+  return status;
+}
+
+/**
+ * @brief  Get the PWM frequency
+ * @retval uint32_t: Frequency in Hz
+ */
+uint32_t LED_Driver_GetPwmFrequency(void) {
+  return VAL_PWM_GetFrequency();
+}
+
+/**
+ * @brief  Fire all light sources from the external trigger input or at a rate
+ * @note   Pulse intensities are derated by the factors in effect now. A
+ *         light with an active alarm stays dark, as does one whose alarm
+ *         trips while strobing, until the strobe is started again.
+ *         Synchronous sampling is suspended until LED_Driver_StopStrobe;
+ *         a free-running strobe samples once per pulse instead.
+ * @param  duration_us: Pulse length (1 to VAL_PWM_STROBE_MAX_US)
+ * @param  period_us: Pulse period (above the length, up to
+ *         VAL_PWM_STROBE_PERIOD_MAX_US), 0 to fire on the trigger input
+ * @param  permille: Intensity per light during the pulse (0-1000)
+ * @param  falling_edge: Fire on the falling instead of the rising edge
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid,
+ *         VAL_BUSY if the rate timer is in use, VAL_ERROR if the ADC could
+ *         not be reconfigured
+ */
+VAL_Status LED_Driver_StartStrobe(uint32_t duration_us, uint32_t period_us, const uint16_t* permille,
+                                  bool falling_edge) {
+  VAL_PWM_StrobeConfig_t config;
+  bool was_active = VAL_PWM_IsStrobeActive();
+  bool was_free_running = VAL_PWM_IsStrobeFreeRunning();
+  VAL_Status status;
+
+  if (permille == NULL) {
+    return VAL_PARAM;
+  }
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (permille[i] > VAL_PWM_PERMILLE_MAX) {
+      return VAL_PARAM;
+    }
+  }
+
+  LED_Driver_CancelFade();
+
+  config.duration_us = duration_us;
+  config.period_us = period_us;
+  config.falling_edge = falling_edge;
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    LED_Driver_StopRegulation(i);
+    config.permille[i] = light_alarms[i] ? 0 : LED_Driver_Derated(i, permille[i]);
+  }
+
+  status = VAL_PWM_StartStrobe(&config);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  strobe_duration_us = duration_us;
+  strobe_period_us = period_us;
+  strobe_falling_edge = falling_edge;
+  memset(current_permille, 0, sizeof(current_permille));
+
+  /* The PWM timer no longer triggers the ADC; the rate timer may */
+  if (period_us != 0) {
+    status = VAL_Analog_SyncToStrobe((1000000U + period_us / 2U) / period_us);
+  } else if (was_free_running || (!was_active && sample_phase_permille != 0)) {
+    status = VAL_Analog_SyncToPwm(0);
+  }
+
+  LED_Driver_NotifyEvent(LED_DRIVER_EVENT_INTENSITY_CHANGED);
+
+  return status;
+}
+
+/**
+ * @brief  Return to continuous operation with all light sources off
+ * @note   Synchronous sampling resumes at its configured phase, also after
+ *         LED_Driver_Blackout stopped the strobe
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR if the ADC could not
+ *         be reconfigured
+ */
+VAL_Status LED_Driver_StopStrobe(void) {
+  bool was_free_running = strobe_cut ? strobe_cut_free_running : VAL_PWM_IsStrobeFreeRunning();
+  VAL_Status status = VAL_OK;
+
+  if (!VAL_PWM_IsStrobeActive() && !strobe_cut) {
+    return VAL_OK;
+  }
+
+  VAL_PWM_StopStrobe();
+  strobe_cut = false;
+
+  /* The sampling mode may have changed while strobing */
+  LED_Driver_AlignOutputs(sample_phase_permille == 0);
+
+  if (sample_phase_permille != 0) {
+    status = VAL_PWM_SetAdcTrigger(sample_phase_permille);
+    if (status == VAL_OK) {
+      status = VAL_Analog_SyncToPwm(VAL_PWM_GetFrequency());
+    }
+  } else if (was_free_running) {
+    status = VAL_Analog_SyncToPwm(0);
+  }
+
+  return status;
+}
+
+/**
+ * @brief  Turn all light sources off at once, ahead of any queued command
+ * @note   Safe to call from interrupts; called from the RX interrupt of an
+ *         emergency command. A fade or effect, a strobe, the current loops
+ *         and staged values stop, and every compare is written to zero past
+ *         its preload in one masked section. A strobe is only stopped at the
+ *         timer; LED_Driver_StopStrobe restores the sampling afterwards.
+ *         Alarms are left as they are.
+ * @retval None
+ */
+VAL_RAMFUNC void LED_Driver_Blackout(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if (VAL_PWM_IsStrobeActive()) {
+    strobe_cut_free_running = VAL_PWM_IsStrobeFreeRunning();
+    strobe_cut = true;
+    VAL_PWM_StopStrobe();
+  }
+  (void)VAL_PWM_StopRamp();
+  fade_active = false;
+  effect_active = false;
+  staged_lights = 0;
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    LED_Driver_StopRegulation(i);
+    current_permille[i] = 0;
+    VAL_PWM_StopChannel(i + 1);
+  }
+  __set_PRIMASK(primask);
+
+  LED_Driver_NotifyEvent(LED_DRIVER_EVENT_INTENSITY_CHANGED);
+}
+
+/**
+ * @brief  Get the strobe configuration and counts
+ * @param  status: Pointer to store the state
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status LED_Driver_GetStrobeStatus(LED_Driver_StrobeStatus_t* status) {
+  VAL_PWM_StrobeStats_t stats;
+
+  if (status == NULL) {
+    return VAL_PARAM;
+  }
+
+  VAL_PWM_GetStrobeStats(&stats);
+  status->active = VAL_PWM_IsStrobeActive();
+  status->falling_edge = strobe_falling_edge;
+  status->duration_us = strobe_duration_us;
+  status->period_us = strobe_period_us;
+  status->triggers = stats.triggers;
+  status->pulses = stats.pulses;
+  status->missed = stats.missed;
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the current sampling point within the PWM period
+ * @retval uint16_t: Sampling point in permille of the period, 0 if free-running
+ */
+uint16_t LED_Driver_GetSamplePhase(void) {
+  return sample_phase_permille;
+}
+
+/**
+ * @brief  Get the usage counters of all light sources
+ * @param  counters: Array to store the counters, VAL_LIGHT_COUNT entries
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if counters is NULL
+ */
+VAL_Status LED_Driver_GetUsage(LED_Driver_Usage_t* counters) {
+  uint32_t primask;
+
+  if (counters == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* 64-bit counts are not updated in one access */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  memcpy(counters, usage, sizeof(usage));
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the temperature trend of a light source
+ * @param  light_id: Light source ID (1-VAL_LIGHT_COUNT)
+ * @param  trend: Pointer to store the trend
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status LED_Driver_GetThermalTrend(uint8_t light_id, LED_Driver_ThermalTrend_t* trend) {
+  uint32_t primask;
+
+  if (LED_Driver_ValidateLightId(light_id) != VAL_OK || trend == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  *trend = trends[light_id - 1].trend;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Set the window of the flicker measurement and measure again
+ * @param  window_scans: Raw samples per window (LED_DRIVER_FLICKER_WINDOW_MIN-65535);
+ *         the sums of 16-bit samples over one fit 32 bits
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if too short
+ */
+VAL_Status LED_Driver_SetFlickerWindow(uint16_t window_scans) {
+  uint32_t primask;
+
+  if (window_scans < LED_DRIVER_FLICKER_WINDOW_MIN) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  flicker_status.window_scans = window_scans;
+  LED_Driver_RestartFlicker();
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the flicker of all light sources at their present outputs
+ * @param  status: Pointer to store the progress
+ * @param  metrics: Array to store the metrics, VAL_LIGHT_COUNT entries
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if a pointer is NULL
+ */
+VAL_Status LED_Driver_GetFlicker(LED_Driver_FlickerStatus_t* status, LED_Driver_Flicker_t* metrics) {
+  uint32_t primask;
+
+  if (status == NULL || metrics == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  *status = flicker_status;
+  memcpy(metrics, flicker, sizeof(flicker));
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Add counts to the usage counters of all light sources
+ * @param  counters: Counts to add, VAL_LIGHT_COUNT entries
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if counters is NULL
+ */
+VAL_Status LED_Driver_AddUsage(const LED_Driver_Usage_t* counters) {
+  uint32_t primask;
+
+  if (counters == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    usage[i].charge_ma_us += counters[i].charge_ma_us;
+    usage[i].duty_permille_us += counters[i].duty_permille_us;
+    usage[i].over_warning_us += counters[i].over_warning_us;
+  }
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Replace the ageing curves of all light sources
+ * @note   Taken up by the next LED_Driver_UpdateAgeing
+ * @param  curves: Curve per light, VAL_LIGHT_COUNT entries
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status LED_Driver_SetAgeing(const LED_Driver_Ageing_t* curves) {
+  uint32_t primask;
+
+  if (curves == NULL) {
+    return VAL_PARAM;
+  }
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    uint16_t previous = VAL_PWM_PERMILLE_MAX;
+
+    if (curves[i].step_hours == 0) {
+      continue;
+    }
+    for (uint8_t n = 0; n < LED_DRIVER_AGEING_POINTS; n++) {
+      uint16_t output = curves[i].output_permille[n];
+      if (output < LED_DRIVER_AGEING_MIN_PERMILLE || output > previous) {
+        return VAL_PARAM;
+      }
+      previous = output;
+    }
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  memcpy(ageing, curves, sizeof(ageing));
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    ageing_hours[i] = AGEING_HOURS_NONE;
+  }
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the ageing curves of all light sources
+ * @param  curves: Array to store the curves, VAL_LIGHT_COUNT entries
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if curves is NULL
+ */
+VAL_Status LED_Driver_GetAgeing(LED_Driver_Ageing_t* curves) {
+  uint32_t primask;
+
+  if (curves == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  memcpy(curves, ageing, sizeof(ageing));
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Replace the output trims of all light sources
+ * @note   Taken up by the next LED_Driver_UpdateAgeing
+ * @param  values: Trim per light in permille, VAL_LIGHT_COUNT entries
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status LED_Driver_SetTrims(const uint16_t* values) {
+  uint32_t primask;
+
+  if (values == NULL) {
+    return VAL_PARAM;
+  }
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (values[i] < LED_DRIVER_TRIM_MIN_PERMILLE || values[i] > LED_DRIVER_TRIM_MAX_PERMILLE) {
+      return VAL_PARAM;
+    }
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    if (trims[i] != values[i]) {
+      trims[i] = values[i];
+      ageing_hours[i] = AGEING_HOURS_NONE;
+    }
+  }
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the output trims of all light sources
+ * @param  values: Array to store the trims in permille, VAL_LIGHT_COUNT entries
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if values is NULL
+ */
+VAL_Status LED_Driver_GetTrims(uint16_t* values) {
+  uint32_t primask;
+
+  if (values == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  memcpy(values, trims, sizeof(trims));
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Follow the usage counters with the ageing compensation
+ * @note   Coordinator task only. A light whose full-output hour has not
+ *         changed costs one division; one whose scale changes has its
+ *         steady output re-applied through it, as for a curve change.
+ *         The trim of a light multiplies into the same scale.
+ * @retval None
+ */
+void LED_Driver_UpdateAgeing(void) {
+  LED_Driver_Usage_t counters[NUM_LIGHT_SOURCES];
+  LED_Driver_Ageing_t curve;
+  uint16_t trim;
+  VAL_Status status = VAL_OK;
+  uint32_t primask;
+
+  /* Tables and latched values were built with the scale in use; the
+   * hours are looked at again on the next check */
+  if (fade_active || VAL_PWM_IsStrobeActive() || VAL_PWM_IsLatchArmed()) {
+    return;
+  }
+
+  LED_Driver_GetUsage(counters);
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    uint32_t hours = (uint32_t)(counters[i].duty_permille_us / AGEING_PERMILLE_US_PER_HOUR);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    bool due = (hours != ageing_hours[i]);
+    ageing_hours[i] = hours;
+    curve = ageing[i];
+    trim = trims[i];
+    __set_PRIMASK(primask);
+
+    if (!due) {
+      continue;
+    }
+
+    /* The ageing scale (unity up) times the trim (unity down) stays
+     * within VAL_PWM_SCALE_MIN and VAL_PWM_SCALE_MAX */
+    uint16_t scale = (uint16_t)(((uint32_t)LED_Driver_AgeingScale(&curve, hours) * trim +
+                                 VAL_PWM_SCALE_UNITY / 2U) / VAL_PWM_SCALE_UNITY);
+    if (scale == VAL_PWM_GetOutputScale(i + 1) || VAL_PWM_SetOutputScale(i + 1, scale) != VAL_OK) {
+      continue;
+    }
+
+    /* The current controller writes compare values and does not use it */
+    if (!light_alarms[i] && current_loops[i].target_ma == 0) {
+      LED_Driver_ApplyOutput(i, current_permille[i], &status);
+    }
+  }
+}
+
+/**
+ * @brief  Get the on-time the ageing compensation and the trim give each light source
+ * @param  scales: Array to store the output scales in permille, VAL_LIGHT_COUNT entries
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if scales is NULL
+ */
+VAL_Status LED_Driver_GetAgeingScales(uint16_t* scales) {
+  if (scales == NULL) {
+    return VAL_PARAM;
+  }
+
+  for (uint8_t i = 0; i < NUM_LIGHT_SOURCES; i++) {
+    scales[i] = VAL_PWM_GetOutputScale(i + 1);
+  }
+
   return VAL_OK;
 }
+
+/**
+ * @brief  Register a callback notified when intensities or alarms change
+ * @param  callback: Callback function, called from task and interrupt context, or NULL
+ * @retval None
+ */
+void LED_Driver_SetEventCallback(LED_Driver_EventCallback callback) {
+  event_callback = callback;
+}
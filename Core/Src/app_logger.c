@@ -0,0 +1,378 @@
+/**
+  ******************************************************************************
+  * @file    app_logger.c
+  * @brief   Application layer deferred logging
+  ******************************************************************************
+  * @attention
+  *
+  * Callers only store a message ID, two arguments and a timestamp in a RAM
+  * ring; formatting and sending happen later in the logger task, below all
+  * other application tasks. Logging therefore costs a caller a few
+  * instructions with interrupts disabled, never waits, and is safe from
+  * interrupts that may use FreeRTOS. When the ring is full the message is
+  * dropped and counted; the count is reported once there is room again.
+  *
+  * Messages below LOGGER_COMPILE_LEVEL are removed by the LOGGER_LOG macro
+  * at compile time, messages below the runtime level (system/log_level) are
+  * dropped when logged.
+  *
+  * Messages reach the host as system/log events in the format of the last
+  * command, so they never split a JSON or binary frame.
+  *
+  * While a debugger has ITM stimulus port LOGGER_SWO_PORT enabled, messages
+  * go out over SWO instead and USART1 carries the protocol only. They are
+  * not formatted: each is a Logger_SwoRecord_t the host decodes with the
+  * formats above; for LOGGER_MSG_TEXT the first argument is the address of
+  * the string in flash, looked up in the ELF file. The task then also polls
+  * the command and alarm trace and sends each new entry on
+  * LOGGER_SWO_TRACE_PORT as its sequence number and the Trace_Entry_t.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_logger.h"
+#include "app_comms_handler.h"
+#include "app_supervisor.h"
+#include "app_trace.h"
+#include "app_queues.h"
+#include "val.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "cmsis_os.h"
+#include <stdio.h>
+
+/* Private define ------------------------------------------------------------*/
+/* Below the communications handler; sending may wait for TX queue space */
+#define LOGGER_STACK_SIZE          256
+#define LOGGER_PRIORITY            osPriorityLow
+
+#define LOGGER_RING_SIZE           16   /* Pending messages, a power of two */
+#define LOGGER_TEXT_SIZE           80   /* Formatted message, including NUL */
+
+#define LOGGER_SWO_PORT            1U   /* ITM stimulus port of the messages */
+#define LOGGER_SWO_TRACE_PORT      2U   /* ITM stimulus port of the trace */
+#define LOGGER_SWO_POLL_MS         10U  /* Trace poll period under a debugger */
+#define LOGGER_SWO_TRACE_BATCH     8U   /* Trace entries read at a time */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint32_t tick_ms;          /* HAL tick when logged */
+  uint32_t args[2];
+  uint8_t level;             /* Logger_Level_t */
+  uint8_t msg;               /* Logger_Msg_t */
+} Logger_Entry_t;
+
+/* A message on LOGGER_SWO_PORT, little-endian */
+typedef struct __attribute__((packed)) {
+  uint8_t msg;               /* Logger_Msg_t */
+  uint8_t level;             /* Logger_Level_t */
+  uint16_t seq;              /* Counts every record, gaps show lost ones */
+  uint32_t tick_ms;
+  uint32_t args[2];
+} Logger_SwoRecord_t;
+
+/* A trace entry on LOGGER_SWO_TRACE_PORT */
+typedef struct __attribute__((packed)) {
+  uint32_t seq;              /* Trace entry number */
+  Trace_Entry_t entry;
+} Logger_SwoTrace_t;
+
+/* Private variables ---------------------------------------------------------*/
+static TaskHandle_t logger_task_handle = NULL;
+static uint32_t logger_stack[LOGGER_STACK_SIZE];
+static osStaticThreadDef_t logger_tcb;
+
+static Logger_Entry_t logger_ring[LOGGER_RING_SIZE] VAL_SRAM2_BSS;
+static volatile uint32_t logger_head = 0;    /* Entries written */
+static volatile uint32_t logger_tail = 0;    /* Entries sent (logger task only) */
+static volatile uint32_t logger_dropped = 0; /* Entries lost since last reported */
+static volatile Logger_Level_t logger_level = LOGGER_LEVEL_INFO;
+
+static char logger_text[LOGGER_TEXT_SIZE];
+
+static uint16_t logger_swo_seq = 0;
+static uint32_t logger_trace_next = 0;        /* Next trace entry to send over SWO */
+
+/* printf formats indexed by Logger_Msg_t, arguments as uint32_t */
+static const char* const logger_formats[LOGGER_MSG_COUNT] = {
+  [LOGGER_MSG_TEXT]                  = "%s",  /* Formatted from the string argument */
+  [LOGGER_MSG_SYSTEM_READY]          = "Wiseled_LBR System ready!",
+  [LOGGER_MSG_SENSOR_SYNC_FAILED]    = "Failed to get sensor data, status %lu",
+  [LOGGER_MSG_INTENSITY_SYNC_FAILED] = "Failed to get intensities, status %lu",
+  [LOGGER_MSG_ALARM_SYNC_FAILED]     = "Failed to get alarms, status %lu",
+  [LOGGER_MSG_ADC_ERROR]             = "ADC error 0x%08lX, DMA error 0x%08lX",
+  [LOGGER_MSG_ADC_RECOVERY_FAILED]   = "ADC restart failed, status %lu",
+  [LOGGER_MSG_DROPPED]               = "%lu log messages dropped",
+  [LOGGER_MSG_DEADLINE_MISS]         = "Task %s %lu us over its deadline",
+  [LOGGER_MSG_WATCHDOG_RESET]        = "Watchdog reset, task %s %lu ms over its deadline",
+  [LOGGER_MSG_DMX_SWITCH_FAILED]     = "DMX512 link switch failed, status %lu",
+  [LOGGER_MSG_DMX_SIGNAL_LOST]       = "DMX512 signal lost after %lu packets, %lu dropped",
+  [LOGGER_MSG_CRASH]                 = "Reset after %s at 0x%08lX, see system/crash_report",
+  [LOGGER_MSG_LINK_FAILSAFE]         = "Host link silent for %lu ms, failsafe scene %lu",
+  [LOGGER_MSG_MODBUS_SWITCH_FAILED]  = "Modbus link switch failed, status %lu",
+  [LOGGER_MSG_MODBUS_ENDED]          = "Modbus session ended after %lu requests, %lu ms silent",
+  [LOGGER_MSG_SUPPLY_LOW]            = "Supply under %lu mV, outputs shed to %lu permille",
+  [LOGGER_MSG_SUPPLY_RECOVERED]      = "Supply back over %lu mV, outputs rising from %lu permille",
+  [LOGGER_MSG_INTEGRITY_FAILED]      = "Integrity check %s failed, 0x%08lX",
+};
+
+static const char* const level_names[LOGGER_LEVEL_NONE + 1] = {
+  "debug", "info", "warning", "error", "none"
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void Logger_Task(void const *argument);
+static void Logger_Send(const Logger_Entry_t* entry);
+static void Logger_SendTrace(void);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Initialize the logger and start its task
+ * @note   Messages logged earlier are kept and sent once the task runs
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status Logger_Init(void) {
+  osThreadStaticDef(LoggerTask, Logger_Task, LOGGER_PRIORITY, 0, LOGGER_STACK_SIZE,
+                    logger_stack, &logger_tcb);
+  logger_task_handle = osThreadCreate(osThread(LoggerTask), NULL);
+
+  if (logger_task_handle == NULL) {
+    return VAL_ERROR;
+  }
+  (void)Queues_Register(logger_ring, "log", QUEUES_KIND_RING, LOGGER_RING_SIZE);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Queue a message for the logger task
+ * @note   Called from task and interrupt context
+ * @param  level: Message level
+ * @param  msg: Message format
+ * @param  arg0: First format argument
+ * @param  arg1: Second format argument
+ * @retval VAL_Status: VAL_OK if queued or filtered, VAL_BUSY if the ring was
+ *         full, VAL_PARAM for an invalid message
+ */
+VAL_Status Logger_Log(Logger_Level_t level, Logger_Msg_t msg, uint32_t arg0, uint32_t arg1) {
+  uint32_t tick = HAL_GetTick();
+  uint32_t primask;
+
+  if (msg >= LOGGER_MSG_COUNT) {
+    return VAL_PARAM;
+  }
+  if (level < logger_level || level >= LOGGER_LEVEL_NONE) {
+    return VAL_OK;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  if (logger_head - logger_tail >= LOGGER_RING_SIZE) {
+    logger_dropped++;
+    Queues_NoteFailed(logger_ring);
+    __set_PRIMASK(primask);
+    return VAL_BUSY;
+  }
+
+  Logger_Entry_t* entry = &logger_ring[logger_head & (LOGGER_RING_SIZE - 1U)];
+  entry->tick_ms = tick;
+  entry->args[0] = arg0;
+  entry->args[1] = arg1;
+  entry->level = (uint8_t)level;
+  entry->msg = (uint8_t)msg;
+  logger_head++;
+  Queues_NoteLevel(logger_ring, logger_head - logger_tail);
+
+  __set_PRIMASK(primask);
+
+  /* Wake the task; before Logger_Init the message just waits */
+  if (logger_task_handle != NULL) {
+    if (xPortIsInsideInterrupt()) {
+      BaseType_t higher_priority_task_woken = pdFALSE;
+      vTaskNotifyGiveFromISR(logger_task_handle, &higher_priority_task_woken);
+      portYIELD_FROM_ISR(higher_priority_task_woken);
+    } else {
+      xTaskNotifyGive(logger_task_handle);
+    }
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Log an informational text
+ * @param  event: Constant string; only the pointer is stored
+ * @retval VAL_Status: VAL_OK if queued or filtered, VAL_BUSY if the ring was full
+ */
+VAL_Status Logger_LogEvent(const char* event) {
+  if (event == NULL) {
+    return VAL_PARAM;
+  }
+
+  return Logger_Log(LOGGER_LEVEL_INFO, LOGGER_MSG_TEXT, (uint32_t)event, 0);
+}
+
+/**
+ * @brief  Log an error text
+ * @param  severity: Logger_Level_t of the error
+ * @param  error: Constant string; only the pointer is stored
+ * @retval VAL_Status: VAL_OK if queued or filtered, VAL_BUSY if the ring was full
+ */
+VAL_Status Logger_LogError(uint8_t severity, const char* error) {
+  if (error == NULL || severity >= LOGGER_LEVEL_NONE) {
+    return VAL_PARAM;
+  }
+
+  return Logger_Log((Logger_Level_t)severity, LOGGER_MSG_TEXT, (uint32_t)error, 0);
+}
+
+/**
+ * @brief  Set the lowest level sent to the host
+ * @note   Messages already queued are still sent
+ * @param  level: Level, LOGGER_LEVEL_NONE to send nothing
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM for an invalid level
+ */
+VAL_Status Logger_SetLevel(Logger_Level_t level) {
+  if (level > LOGGER_LEVEL_NONE) {
+    return VAL_PARAM;
+  }
+
+  logger_level = level;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the lowest level sent to the host
+ * @retval Logger_Level_t: Current runtime level
+ */
+Logger_Level_t Logger_GetLevel(void) {
+  return logger_level;
+}
+
+/**
+ * @brief  Get the protocol name of a level
+ * @param  level: Level
+ * @retval const char*: Level name, "none" for LOGGER_LEVEL_NONE and invalid levels
+ */
+const char* Logger_GetLevelName(Logger_Level_t level) {
+  if (level > LOGGER_LEVEL_NONE) {
+    return level_names[LOGGER_LEVEL_NONE];
+  }
+
+  return level_names[level];
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Logger task, formats and sends queued messages
+ * @param  argument: Not used
+ * @retval None
+ */
+static void Logger_Task(void const *argument) {
+  Logger_Entry_t entry;
+  uint32_t primask;
+  uint32_t dropped;
+
+  for (;;) {
+    /* The trace has no notification, so poll it while a debugger may read it */
+    ulTaskNotifyTake(pdTRUE, VAL_SWO_IsDebuggerAttached() ?
+                     pdMS_TO_TICKS(LOGGER_SWO_POLL_MS) : portMAX_DELAY);
+    Supervisor_Begin(SUPERVISOR_TASK_LOGGER);
+
+    while (logger_tail != logger_head) {
+      /* The slot is only reused once the tail has moved past it */
+      entry = logger_ring[logger_tail & (LOGGER_RING_SIZE - 1U)];
+      logger_tail++;
+
+      Logger_Send(&entry);
+    }
+
+    /* Report losses now that the ring has room again */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    dropped = logger_dropped;
+    logger_dropped = 0;
+    __set_PRIMASK(primask);
+
+    if (dropped != 0) {
+      entry.tick_ms = HAL_GetTick();
+      entry.args[0] = dropped;
+      entry.args[1] = 0;
+      entry.level = LOGGER_LEVEL_WARNING;
+      entry.msg = LOGGER_MSG_DROPPED;
+      Logger_Send(&entry);
+    }
+
+    Logger_SendTrace();
+    Supervisor_End(SUPERVISOR_TASK_LOGGER);
+  }
+}
+
+/**
+ * @brief  Format a message and send it to the host
+ * @param  entry: Message to send
+ * @retval None
+ */
+static void Logger_Send(const Logger_Entry_t* entry) {
+  int length;
+
+  if (VAL_SWO_IsPortEnabled(LOGGER_SWO_PORT)) {
+    Logger_SwoRecord_t record = {
+      entry->msg, entry->level, logger_swo_seq++, entry->tick_ms,
+      { entry->args[0], entry->args[1] }
+    };
+
+    (void)VAL_SWO_Write(LOGGER_SWO_PORT, &record, sizeof(record));
+    return;
+  }
+
+  if (entry->msg == LOGGER_MSG_TEXT) {
+    length = snprintf(logger_text, LOGGER_TEXT_SIZE, "%s", (const char*)entry->args[0]);
+  } else {
+    length = snprintf(logger_text, LOGGER_TEXT_SIZE, logger_formats[entry->msg],
+                      entry->args[0], entry->args[1]);
+  }
+  if (length < 0) {
+    return;
+  }
+
+  /* A truncated message is still sent */
+  COMMS_Handler_SendLogEvent((Logger_Level_t)entry->level, entry->tick_ms, logger_text);
+}
+
+/**
+ * @brief  Send the trace entries recorded since the last call over SWO
+ * @note   Entries overwritten before they were read are skipped; the
+ *         sequence numbers show the gap
+ * @retval None
+ */
+static void Logger_SendTrace(void) {
+  Trace_Entry_t entries[LOGGER_SWO_TRACE_BATCH];
+  Logger_SwoTrace_t record;
+  uint32_t first;
+  uint8_t count;
+
+  if (!VAL_SWO_IsPortEnabled(LOGGER_SWO_TRACE_PORT)) {
+    /* Start from the present once a debugger enables the port */
+    logger_trace_next = Trace_GetNext();
+    return;
+  }
+
+  do {
+    count = Trace_Read(logger_trace_next, entries, LOGGER_SWO_TRACE_BATCH, &first);
+
+    for (uint8_t i = 0; i < count; i++) {
+      record.seq = first + i;
+      record.entry = entries[i];
+      if (VAL_SWO_Write(LOGGER_SWO_TRACE_PORT, &record, sizeof(record)) != VAL_OK) {
+        return;
+      }
+    }
+
+    logger_trace_next = first + count;
+  } while (count == LOGGER_SWO_TRACE_BATCH);
+}
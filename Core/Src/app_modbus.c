@@ -0,0 +1,602 @@
+/**
+  ******************************************************************************
+  * @file    app_modbus.c
+  * @brief   Application layer Modbus RTU slave
+  ******************************************************************************
+  * @attention
+  *
+  * A PLC can take over the serial link as a Modbus RTU master, as a DMX512
+  * desk can: modbus/start answers on the host protocol, then the line
+  * switches to 8E1 at the bus rate (val_serial_comms.c) until the master
+  * has been silent for the session timeout or writes the release
+  * register. Host messages are held meanwhile and the link failsafe waits.
+  *
+  * Requests are served in the UART interrupt that ends the frame, so the
+  * reply starts within the processing time of a single request, well
+  * inside the 3.5 character gap the master leaves before its next one, and
+  * independent of what the tasks are doing. The frame CRC, and that of the
+  * reply, runs on the CRC unit (VAL_CRC_16_MODBUS).
+  *
+  * The registers are the existing state, without a copy of their own.
+  * Reads take one snapshot of the published light state per request
+  * (SYS_Coordinator_GetSnapshot, a seqlock that never blocks), so all
+  * registers of one read come from the same publication. Writes are queued
+  * to the coordinator task as the host's are: the intensities written by
+  * one request change in the same PWM period, and a cleared alarm whose
+  * cause persists comes back. The configuration is read as it was when the
+  * session started, which it stays until the host link returns; it is
+  * read only here, changing it takes a flash write (config/set on the host
+  * link).
+  *
+  * Registers are big-endian, as Modbus sends them; the register map is in
+  * app_modbus.h. A read or write that touches an unmapped register is
+  * refused whole with exception 02. Broadcasts (address 0) are applied
+  * and not answered.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_modbus.h"
+#include "app_sys_coordinator.h"
+#include "app_config.h"
+#include "app_logger.h"
+#include "val.h"
+#include "val_crc.h"
+#include "val_serial_comms.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define MODBUS_FC_READ_HOLDING      0x03U
+#define MODBUS_FC_READ_INPUT        0x04U
+#define MODBUS_FC_WRITE_SINGLE      0x06U
+#define MODBUS_FC_WRITE_MULTIPLE    0x10U
+#define MODBUS_EXCEPTION            0x80U  /* Set in the function code of an exception response */
+
+#define MODBUS_EX_ILLEGAL_FUNCTION  0x01U
+#define MODBUS_EX_ILLEGAL_ADDRESS   0x02U
+#define MODBUS_EX_ILLEGAL_VALUE     0x03U
+#define MODBUS_EX_DEVICE_BUSY       0x06U
+
+#define MODBUS_BROADCAST            0U
+#define MODBUS_FRAME_MAX            256U   /* Address, PDU and CRC */
+#define MODBUS_FRAME_MIN            4U     /* Address, function code and CRC */
+#define MODBUS_CRC_SIZE             2U
+#define MODBUS_READ_MAX             125U   /* Registers per read */
+#define MODBUS_WRITE_MAX            123U   /* Registers per write multiple */
+#define MODBUS_FIXED_LENGTH         6U     /* Address, function code and two words */
+#define MODBUS_WRITE_HEADER         7U     /* Write multiple up to its byte count */
+
+_Static_assert(VAL_LIGHT_COUNT <= MODBUS_INPUT_SENSORS - MODBUS_INPUT_PERMILLE, "Permille block overlaps the sensors");
+_Static_assert(MODBUS_INPUT_SENSORS + MODBUS_SENSOR_REGISTERS * VAL_LIGHT_COUNT <= MODBUS_INPUT_CONFIG,
+               "Sensor block overlaps the configuration");
+_Static_assert(MODBUS_CONFIG_REGISTERS <= MODBUS_INPUT_LIMITS - MODBUS_INPUT_CONFIG, "Configuration overlaps the limits");
+_Static_assert(VAL_LIGHT_COUNT <= MODBUS_HOLDING_ALARM - MODBUS_HOLDING_PERMILLE, "Permille block overlaps the alarms");
+
+/* Private variables ---------------------------------------------------------*/
+/* Session; set by the task before the line switches, read by the UART interrupt */
+static volatile bool modbus_active = false;
+static volatile bool release_requested = false;
+static uint8_t modbus_address;
+static uint32_t modbus_baud = MODBUS_BAUD_DEFAULT;
+static uint32_t modbus_timeout_ms = MODBUS_TIMEOUT_MS;
+static volatile TickType_t last_tick;
+static Config_Settings_t session_config;
+
+/* Counts of the present or last session */
+static volatile uint32_t requests;
+static volatile uint32_t exceptions;
+static volatile uint32_t crc_errors;
+static volatile uint32_t ignored;
+static volatile uint32_t dropped;
+static volatile uint32_t max_response_us;
+
+/* Reply being built, UART interrupt only */
+static uint8_t reply[MODBUS_FRAME_MAX];
+
+/* Private function prototypes -----------------------------------------------*/
+static void Modbus_FrameCallback(const uint8_t* frame, uint16_t length);
+static uint16_t Modbus_Process(const uint8_t* request, uint16_t length, uint8_t* response);
+static uint16_t Modbus_Exception(uint8_t* response, uint8_t code);
+static bool Modbus_ReadHolding(uint16_t address, const SYS_Coordinator_Snapshot_t* snapshot, uint16_t* value);
+static bool Modbus_ReadInput(uint16_t address, const SYS_Coordinator_Snapshot_t* snapshot, uint16_t* value);
+static uint8_t Modbus_Write(uint16_t start, uint16_t count, const uint8_t* data);
+static uint16_t Modbus_Clamp(int32_t value, int32_t min, int32_t max);
+static uint16_t Modbus_Get16(const uint8_t* data);
+static void Modbus_Put16(uint8_t* data, uint16_t value);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Check whether a Modbus session can start with these settings
+ * @param  address: Slave address (MODBUS_ADDRESS_MIN-MODBUS_ADDRESS_MAX)
+ * @param  baud: Bus baud rate
+ * @param  timeout_ms: Master silence before the host link returns, not 0
+ * @retval VAL_Status: VAL_OK if it can, VAL_PARAM for an invalid setting,
+ *         VAL_BUSY if DMX512 or Modbus mode is running
+ */
+VAL_Status Modbus_Check(uint8_t address, uint32_t baud, uint32_t timeout_ms) {
+  SYS_Coordinator_DmxStatus_t dmx;
+
+  if (address < MODBUS_ADDRESS_MIN || address > MODBUS_ADDRESS_MAX || timeout_ms == 0 ||
+      VAL_Serial_CheckBaudRate(baud) != VAL_OK) {
+    return VAL_PARAM;
+  }
+
+  SYS_Coordinator_GetDmxStatus(&dmx);
+  return (modbus_active || dmx.active) ? VAL_BUSY : VAL_OK;
+}
+
+/**
+ * @brief  Hand the serial link over to a Modbus RTU master
+ * @note   Task context; flush the host response first
+ * @param  address: Slave address (MODBUS_ADDRESS_MIN-MODBUS_ADDRESS_MAX)
+ * @param  baud: Bus baud rate
+ * @param  timeout_ms: Master silence before the host link returns
+ * @retval VAL_Status: As Modbus_Check, else as VAL_Serial_StartModbus
+ */
+VAL_Status Modbus_Start(uint8_t address, uint32_t baud, uint32_t timeout_ms) {
+  VAL_Status status = Modbus_Check(address, baud, timeout_ms);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* Unchanged until the host link returns, config/set cannot arrive meanwhile */
+  Config_Get(&session_config);
+
+  taskENTER_CRITICAL();
+  modbus_address = address;
+  modbus_baud = baud;
+  modbus_timeout_ms = timeout_ms;
+  requests = 0;
+  exceptions = 0;
+  crc_errors = 0;
+  ignored = 0;
+  dropped = 0;
+  max_response_us = 0;
+  release_requested = false;
+  last_tick = xTaskGetTickCount();
+  modbus_active = true;
+  taskEXIT_CRITICAL();
+
+  status = VAL_Serial_StartModbus(baud, Modbus_FrameCallback);
+  if (status != VAL_OK) {
+    modbus_active = false;
+  }
+
+  return status;
+}
+
+/**
+ * @brief  Return to the host link once the master is silent or has released it
+ * @note   Called from the coordinator task on every wakeup
+ * @retval None
+ */
+void Modbus_CheckSignal(void) {
+  VAL_Status status;
+  uint32_t silent_ms;
+
+  if (!modbus_active) {
+    return;
+  }
+
+  silent_ms = (uint32_t)(xTaskGetTickCount() - last_tick) * portTICK_PERIOD_MS;
+  if (!release_requested && silent_ms < modbus_timeout_ms) {
+    return;
+  }
+
+  dropped = VAL_Serial_GetModbusDropped();
+  status = VAL_Serial_StopModbus();
+  modbus_active = false;
+
+  if (release_requested) {
+    LOGGER_LOG(LOGGER_LEVEL_INFO, LOGGER_MSG_MODBUS_ENDED, requests, 0);
+  } else {
+    LOGGER_LOG(LOGGER_LEVEL_WARNING, LOGGER_MSG_MODBUS_ENDED, requests, silent_ms);
+  }
+  if (status != VAL_OK) {
+    LOGGER_LOG(LOGGER_LEVEL_ERROR, LOGGER_MSG_MODBUS_SWITCH_FAILED, status, 0);
+  }
+}
+
+/**
+ * @brief  Check whether a Modbus master has the link
+ * @retval bool: true during a session
+ */
+bool Modbus_IsActive(void) {
+  return modbus_active;
+}
+
+/**
+ * @brief  Get the session state and counts
+ * @param  status: Pointer to store them
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status Modbus_GetStatus(Modbus_Status_t* status) {
+  if (status == NULL) {
+    return VAL_PARAM;
+  }
+
+  taskENTER_CRITICAL();
+  status->active = modbus_active;
+  status->address = modbus_address;
+  status->baud = modbus_baud;
+  status->timeout_ms = modbus_timeout_ms;
+  status->requests = requests;
+  status->exceptions = exceptions;
+  status->crc_errors = crc_errors;
+  status->ignored = ignored;
+  status->dropped = modbus_active ? VAL_Serial_GetModbusDropped() : dropped;
+  status->max_response_us = max_response_us;
+  taskEXIT_CRITICAL();
+
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Serve a frame, called from the UART interrupt at its inter-frame gap
+ * @param  frame: Address to CRC
+ * @param  length: Bytes in the frame
+ * @retval None
+ */
+static void Modbus_FrameCallback(const uint8_t* frame, uint16_t length) {
+  uint32_t start = VAL_SysClock_GetMicros();
+  uint16_t reply_length;
+  uint16_t crc;
+
+  if (length < MODBUS_FRAME_MIN) {
+    ignored++;
+    return;
+  }
+
+  crc = (uint16_t)(frame[length - 2U] | (frame[length - 1U] << 8));
+  if ((uint16_t)VAL_Crc_Compute(VAL_CRC_16_MODBUS, frame, length - MODBUS_CRC_SIZE) != crc) {
+    crc_errors++;
+    return;
+  }
+  if (frame[0] != modbus_address && frame[0] != MODBUS_BROADCAST) {
+    ignored++;
+    return;
+  }
+
+  last_tick = xTaskGetTickCountFromISR();
+  reply_length = Modbus_Process(frame, length - MODBUS_CRC_SIZE, reply);
+  requests++;
+  if (frame[0] == MODBUS_BROADCAST) {
+    return;
+  }
+  if (reply[1] & MODBUS_EXCEPTION) {
+    exceptions++;
+  }
+
+  /* CRC low byte first, unlike the registers */
+  crc = (uint16_t)VAL_Crc_Compute(VAL_CRC_16_MODBUS, reply, reply_length);
+  reply[reply_length++] = (uint8_t)crc;
+  reply[reply_length++] = (uint8_t)(crc >> 8);
+  (void)VAL_Serial_SendModbus(reply, reply_length);
+
+  uint32_t elapsed = VAL_SysClock_GetMicros() - start;
+  if (elapsed > max_response_us) {
+    max_response_us = elapsed;
+  }
+}
+
+/**
+ * @brief  Carry out a request and build the reply
+ * @param  request: Address and PDU, CRC checked and left out
+ * @param  length: Bytes in request
+ * @param  response: Buffer of MODBUS_FRAME_MAX bytes for the reply
+ * @retval uint16_t: Reply length, CRC not included
+ */
+static uint16_t Modbus_Process(const uint8_t* request, uint16_t length, uint8_t* response) {
+  SYS_Coordinator_Snapshot_t snapshot;
+  uint8_t function = request[1];
+  uint16_t start;
+  uint16_t count;
+  uint8_t code;
+
+  response[0] = request[0];
+  response[1] = function;
+
+  switch (function) {
+    case MODBUS_FC_READ_HOLDING:
+    case MODBUS_FC_READ_INPUT:
+      if (length != MODBUS_FIXED_LENGTH) {
+        return Modbus_Exception(response, MODBUS_EX_ILLEGAL_VALUE);
+      }
+      start = Modbus_Get16(&request[2]);
+      count = Modbus_Get16(&request[4]);
+      if (count == 0 || count > MODBUS_READ_MAX) {
+        return Modbus_Exception(response, MODBUS_EX_ILLEGAL_VALUE);
+      }
+
+      /* One publication for the whole read */
+      SYS_Coordinator_GetSnapshot(&snapshot);
+      for (uint16_t i = 0; i < count; i++) {
+        uint32_t address = (uint32_t)start + i;
+        uint16_t value = 0;
+        bool mapped = (address <= UINT16_MAX) &&
+                      ((function == MODBUS_FC_READ_INPUT)
+                           ? Modbus_ReadInput((uint16_t)address, &snapshot, &value)
+                           : Modbus_ReadHolding((uint16_t)address, &snapshot, &value));
+
+        if (!mapped) {
+          return Modbus_Exception(response, MODBUS_EX_ILLEGAL_ADDRESS);
+        }
+        Modbus_Put16(&response[3U + 2U * i], value);
+      }
+      response[2] = (uint8_t)(2U * count);
+      return (uint16_t)(3U + 2U * count);
+
+    case MODBUS_FC_WRITE_SINGLE:
+      if (length != MODBUS_FIXED_LENGTH) {
+        return Modbus_Exception(response, MODBUS_EX_ILLEGAL_VALUE);
+      }
+      code = Modbus_Write(Modbus_Get16(&request[2]), 1, &request[4]);
+      if (code != 0) {
+        return Modbus_Exception(response, code);
+      }
+      /* The reply echoes the request */
+      memcpy(response, request, MODBUS_FIXED_LENGTH);
+      return MODBUS_FIXED_LENGTH;
+
+    case MODBUS_FC_WRITE_MULTIPLE:
+      if (length < MODBUS_WRITE_HEADER) {
+        return Modbus_Exception(response, MODBUS_EX_ILLEGAL_VALUE);
+      }
+      start = Modbus_Get16(&request[2]);
+      count = Modbus_Get16(&request[4]);
+      if (count == 0 || count > MODBUS_WRITE_MAX || request[6] != 2U * count ||
+          length != MODBUS_WRITE_HEADER + 2U * count) {
+        return Modbus_Exception(response, MODBUS_EX_ILLEGAL_VALUE);
+      }
+      code = Modbus_Write(start, count, &request[MODBUS_WRITE_HEADER]);
+      if (code != 0) {
+        return Modbus_Exception(response, code);
+      }
+      /* Address, function code, start and count */
+      memcpy(response, request, MODBUS_FIXED_LENGTH);
+      return MODBUS_FIXED_LENGTH;
+
+    default:
+      return Modbus_Exception(response, MODBUS_EX_ILLEGAL_FUNCTION);
+  }
+}
+
+/**
+ * @brief  Build an exception reply
+ * @param  response: Reply, address and function code already in place
+ * @param  code: MODBUS_EX_* exception code
+ * @retval uint16_t: Reply length, CRC not included
+ */
+static uint16_t Modbus_Exception(uint8_t* response, uint8_t code) {
+  response[1] |= MODBUS_EXCEPTION;
+  response[2] = code;
+
+  return 3U;
+}
+
+/**
+ * @brief  Read a holding register
+ * @param  address: Register address
+ * @param  snapshot: Light state of the request
+ * @param  value: Pointer to store the value
+ * @retval bool: false if the register is not mapped
+ */
+static bool Modbus_ReadHolding(uint16_t address, const SYS_Coordinator_Snapshot_t* snapshot, uint16_t* value) {
+  uint16_t offset = (uint16_t)(address - MODBUS_HOLDING_PERMILLE);
+
+  if (offset < VAL_LIGHT_COUNT) {
+    *value = snapshot->permille[offset];
+    return true;
+  }
+
+  offset = (uint16_t)(address - MODBUS_HOLDING_ALARM);
+  if (offset < VAL_LIGHT_COUNT) {
+    *value = snapshot->alarms[offset];
+    return true;
+  }
+
+  if (address == MODBUS_HOLDING_RELEASE) {
+    *value = 0;
+    return true;
+  }
+
+  return false;
+}
+
+/**
+ * @brief  Read an input register
+ * @param  address: Register address
+ * @param  snapshot: Light state of the request
+ * @param  value: Pointer to store the value
+ * @retval bool: false if the register is not mapped
+ */
+static bool Modbus_ReadInput(uint16_t address, const SYS_Coordinator_Snapshot_t* snapshot, uint16_t* value) {
+  const Config_Settings_t* config = &session_config;
+  uint16_t offset;
+
+  if (address == MODBUS_INPUT_LIGHTS) {
+    *value = VAL_LIGHT_COUNT;
+    return true;
+  }
+  if (address == MODBUS_INPUT_SEQUENCE) {
+    *value = (uint16_t)(snapshot->sequence >> 16);
+    return true;
+  }
+  if (address == MODBUS_INPUT_SEQUENCE + 1U) {
+    *value = (uint16_t)snapshot->sequence;
+    return true;
+  }
+
+  offset = (uint16_t)(address - MODBUS_INPUT_PERMILLE);
+  if (offset < VAL_LIGHT_COUNT) {
+    *value = snapshot->permille[offset];
+    return true;
+  }
+
+  offset = (uint16_t)(address - MODBUS_INPUT_SENSORS);
+  if (offset < MODBUS_SENSOR_REGISTERS * VAL_LIGHT_COUNT) {
+    uint8_t light = (uint8_t)(offset / MODBUS_SENSOR_REGISTERS);
+    const LightSensorData_t* sensors = &snapshot->sensors[light];
+
+    switch (offset % MODBUS_SENSOR_REGISTERS) {
+      case MODBUS_SENSOR_CURRENT:
+        *value = Modbus_Clamp((int32_t)(sensors->current + 0.5f), 0, UINT16_MAX);
+        break;
+      case MODBUS_SENSOR_TEMPERATURE:
+        *value = Modbus_Clamp((int32_t)(sensors->temperature * 10.0f + ((sensors->temperature < 0.0f) ? -0.5f : 0.5f)),
+                              INT16_MIN, INT16_MAX);
+        break;
+      case MODBUS_SENSOR_DERATE:
+        *value = snapshot->derate[light];
+        break;
+      default:
+        *value = snapshot->alarms[light];
+        break;
+    }
+    return true;
+  }
+
+  offset = (uint16_t)(address - MODBUS_INPUT_CONFIG);
+  if (offset < MODBUS_CONFIG_REGISTERS) {
+    switch (offset) {
+      case MODBUS_CONFIG_CURRENT_SCALE:     *value = config->current_ma_per_mv; break;
+      case MODBUS_CONFIG_TEMPERATURE_SCALE: *value = config->temperature_cdeg_per_mv; break;
+      case MODBUS_CONFIG_SAMPLE_PHASE:      *value = config->sample_phase_permille; break;
+      case MODBUS_CONFIG_ADDRESS:           *value = config->address; break;
+      case MODBUS_CONFIG_BUS:               *value = config->bus; break;
+      case MODBUS_CONFIG_FAILSAFE_MS:       *value = config->failsafe_ms; break;
+      case MODBUS_CONFIG_FAILSAFE_SCENE:    *value = config->failsafe_scene; break;
+      case MODBUS_CONFIG_POWER_ON:          *value = config->power_on; break;
+      case MODBUS_CONFIG_POWER_ON_SCENE:    *value = config->power_on_scene; break;
+      case MODBUS_CONFIG_BUS_GROUPS:        *value = config->bus_groups; break;
+      default:                              *value = config->stop_mode; break;
+    }
+    return true;
+  }
+
+  offset = (uint16_t)(address - MODBUS_INPUT_LIMITS);
+  if (offset < MODBUS_LIMIT_REGISTERS * VAL_LIGHT_COUNT) {
+    uint8_t light = (uint8_t)(offset / MODBUS_LIMIT_REGISTERS);
+    const LED_Driver_Limits_t* limits = &config->limits[light];
+
+    switch (offset % MODBUS_LIMIT_REGISTERS) {
+      case MODBUS_LIMIT_CURRENT_WARN:     *value = Modbus_Clamp(limits->current_warn_ma, 0, UINT16_MAX); break;
+      case MODBUS_LIMIT_CURRENT_MAX:      *value = Modbus_Clamp(limits->current_max_ma, 0, UINT16_MAX); break;
+      case MODBUS_LIMIT_CURRENT_TRIP:     *value = Modbus_Clamp(limits->current_trip_ma, 0, UINT16_MAX); break;
+      case MODBUS_LIMIT_TEMPERATURE_WARN: *value = Modbus_Clamp(limits->temperature_warn_cdeg, INT16_MIN, INT16_MAX); break;
+      case MODBUS_LIMIT_TEMPERATURE_MAX:  *value = Modbus_Clamp(limits->temperature_max_cdeg, INT16_MIN, INT16_MAX); break;
+      default:                            *value = config->slew_permille_per_ms[light]; break;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+/**
+ * @brief  Write holding registers
+ * @note   A write stays inside one block of the map; the intensities of
+ *         one write are queued as one command
+ * @param  start: First register
+ * @param  count: Registers to write
+ * @param  data: Big-endian values
+ * @retval uint8_t: 0 if queued, else the MODBUS_EX_* exception code
+ */
+static uint8_t Modbus_Write(uint16_t start, uint16_t count, const uint8_t* data) {
+  uint32_t end = (uint32_t)start + count;
+  uint16_t values[VAL_LIGHT_COUNT];
+  uint16_t offset;
+
+  offset = (uint16_t)(start - MODBUS_HOLDING_PERMILLE);
+  if (offset < VAL_LIGHT_COUNT) {
+    if (end > MODBUS_HOLDING_PERMILLE + VAL_LIGHT_COUNT) {
+      return MODBUS_EX_ILLEGAL_ADDRESS;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+      values[i] = Modbus_Get16(&data[2U * i]);
+      if (values[i] > VAL_PWM_PERMILLE_MAX) {
+        return MODBUS_EX_ILLEGAL_VALUE;
+      }
+    }
+    if (SYS_Coordinator_SetMaskedLightPermilleFromISR(((1UL << count) - 1UL) << offset, values,
+                                                      (uint8_t)count) != VAL_OK) {
+      return MODBUS_EX_DEVICE_BUSY;
+    }
+    return 0;
+  }
+
+  offset = (uint16_t)(start - MODBUS_HOLDING_ALARM);
+  if (offset < VAL_LIGHT_COUNT) {
+    if (end > MODBUS_HOLDING_ALARM + VAL_LIGHT_COUNT) {
+      return MODBUS_EX_ILLEGAL_ADDRESS;
+    }
+    /* Alarms can only be cleared */
+    for (uint16_t i = 0; i < count; i++) {
+      if (Modbus_Get16(&data[2U * i]) != 0) {
+        return MODBUS_EX_ILLEGAL_VALUE;
+      }
+    }
+    if (SYS_Coordinator_ClearLightAlarmsFromISR(((1UL << count) - 1UL) << offset) != VAL_OK) {
+      return MODBUS_EX_DEVICE_BUSY;
+    }
+    return 0;
+  }
+
+  if (start == MODBUS_HOLDING_RELEASE && count == 1) {
+    uint16_t value = Modbus_Get16(data);
+
+    if (value > 1U) {
+      return MODBUS_EX_ILLEGAL_VALUE;
+    }
+    /* The coordinator task switches back once the reply is out */
+    if (value == 1U) {
+      release_requested = true;
+    }
+    return 0;
+  }
+
+  return MODBUS_EX_ILLEGAL_ADDRESS;
+}
+
+/**
+ * @brief  Limit a value to a register's range
+ * @param  value: Value to limit
+ * @param  min: Lowest value, negative for a signed register
+ * @param  max: Highest value
+ * @retval uint16_t: Register contents, two's complement if signed
+ */
+static uint16_t Modbus_Clamp(int32_t value, int32_t min, int32_t max) {
+  if (value < min) {
+    value = min;
+  } else if (value > max) {
+    value = max;
+  }
+
+  return (uint16_t)value;
+}
+
+/**
+ * @brief  Read a big-endian register value
+ * @param  data: Two bytes, high first
+ * @retval uint16_t: Value
+ */
+static uint16_t Modbus_Get16(const uint8_t* data) {
+  return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+/**
+ * @brief  Store a big-endian register value
+ * @param  data: Two bytes, high first
+ * @param  value: Value
+ * @retval None
+ */
+static void Modbus_Put16(uint8_t* data, uint16_t value) {
+  data[0] = (uint8_t)(value >> 8);
+  data[1] = (uint8_t)value;
+}
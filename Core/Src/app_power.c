@@ -0,0 +1,279 @@
+/**
+  ******************************************************************************
+  * @file    app_power.c
+  * @brief   Application layer idle power management
+  ******************************************************************************
+  * @attention
+  *
+  * FreeRTOS calls vPortSuppressTicksAndSleep from the idle task when no task
+  * is due for at least two ticks (configUSE_TICKLESS_IDLE 2). The core then
+  * sleeps until the next interrupt, which is at most one tick away while the
+  * outputs are in use.
+  *
+  * Stop mode is off unless enabled with config/set_stop_mode
+  * (Config_IsStopModeEnabled), as a host may lose a byte to it, see below;
+  * the MCU then only sleeps, with every peripheral clocked. When enabled,
+  * all lights are off, no cue sequence is playing (its timer stops in
+  * STOP2), no telemetry is streamed and the serial link has been quiet for
+  * POWER_SERIAL_AWAKE_MS, the tick sources and the analog sampling are
+  * stopped and the MCU enters STOP2 until the next task is due, or until a
+  * start bit arrives. There is no output current to watch then,
+  * and the ADC does not run in stop mode, so the analog watchdog is not a
+  * wake source. Sampling is restarted before any task runs again, so it is
+  * active by the time a light can be switched on.
+  *
+  * The first byte after a stop only wakes the MCU and is lost; the link
+  * then stays awake for POWER_SERIAL_AWAKE_MS. A board with the LPUART1
+  * listener (VAL_BOARD_SERIAL_WAKE) receives that frame instead, so the
+  * command that woke the unit is queued as any other and nothing needs
+  * to be sent again.
+  *
+  * The time from deciding to stop to the stop, and from the wake-up to
+  * the return to the idle task, is kept as a worst case in the statistics
+  * (entry_max_us, exit_max_us), with the suspend and resume of the tick
+  * and the sampling included.
+  *
+  * Before sleeping, the idle task also picks the core clock level
+  * (val_sys_clock.c) for the work at hand: 64 MHz while telemetry is
+  * streamed, a cue sequence plays, a fade or current loop drives the
+  * lights, a Modbus master has the link (its replies are built in the
+  * receive interrupt) or the board has an SPI slave link (app_spi_link.c,
+  * which also keeps it out of stop mode), so the control paths keep their
+  * margin; 4 MHz once the lights are idle and the link has been quiet for
+  * POWER_CLOCK_LOW_MS, as a command then takes longer to run; 32 MHz
+  * otherwise. The idle task runs
+  * as soon as the tasks are done with the event that changed the need, so
+  * the level follows within a tick. A change the peripherals cannot
+  * follow yet, e.g. in the middle of a serial frame, is tried again the
+  * next time.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_power.h"
+#include "app_config.h"
+#include "app_led_driver.h"
+#include "app_sequencer.h"
+#include "app_modbus.h"
+#include "app_spi_link.h"
+#include "app_sys_coordinator.h"
+#include "app_transport.h"
+#include "app_jitter.h"
+#include "val.h"
+#include "val_low_power.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdbool.h>
+
+/* Private variables ---------------------------------------------------------*/
+static Power_Stats_t power_stats = {0};
+static uint32_t serial_wake_tick = 0;
+static bool serial_woken = false;
+
+/* Private function prototypes -----------------------------------------------*/
+static bool Power_CanStop(void);
+static void Power_UpdateClock(void);
+static VAL_SysClock_Level_t Power_SelectClockLevel(void);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Get the stop mode statistics since start-up
+ * @param  stats: Pointer to store the statistics
+ * @retval None
+ */
+void Power_GetStats(Power_Stats_t* stats) {
+  if (stats == NULL) {
+    return;
+  }
+
+  taskENTER_CRITICAL();
+  *stats = power_stats;
+  taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief  FreeRTOS tickless idle, called by the idle task
+ * @note   Runs with the scheduler suspended
+ * @param  expected_idle: Ticks until the next task is due
+ * @retval None
+ */
+void vPortSuppressTicksAndSleep(TickType_t expected_idle) {
+  TickType_t max_ticks = pdMS_TO_TICKS(VAL_LOW_POWER_MAX_STOP_MS);
+  VAL_LowPower_Wake_t wake = VAL_LOW_POWER_WAKE_OTHER;
+  uint32_t stopped_ms = 0;
+  TickType_t stopped_ticks;
+  uint32_t suspend_start;
+  uint32_t suspend_cycles;
+  uint32_t resume_start;
+  uint32_t entry_us;
+  uint32_t exit_us;
+  bool stopped;
+
+  /* Before interrupts are disabled, the PLL may have to lock */
+  Power_UpdateClock();
+
+  __disable_irq();
+  __DSB();
+  __ISB();
+
+  /* A task may have been readied since the idle task decided to sleep */
+  if (eTaskConfirmSleepModeStatus() == eAbortSleep) {
+    __enable_irq();
+    return;
+  }
+
+  if (expected_idle < pdMS_TO_TICKS(POWER_STOP_MIN_MS) || !Power_CanStop()) {
+    /* The SysTick keeps running and wakes the core within one tick */
+    __DSB();
+    __WFI();
+    __ISB();
+    __enable_irq();
+    return;
+  }
+
+  if (expected_idle > max_ticks) {
+    expected_idle = max_ticks;
+  }
+
+  suspend_start = VAL_SysClock_GetCycles();
+  SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+  HAL_SuspendTick();
+  VAL_Analog_Suspend();
+  suspend_cycles = VAL_SysClock_GetCycles() - suspend_start;
+
+  stopped = VAL_LowPower_Stop((uint32_t)expected_idle * 1000U / configTICK_RATE_HZ, &wake, &stopped_ms) == VAL_OK;
+  resume_start = VAL_SysClock_GetCycles();
+
+  Jitter_Resync();
+  VAL_Analog_Resume();
+  HAL_ResumeTick();
+
+  /* The last tick is counted by the SysTick once restarted */
+  stopped_ticks = pdMS_TO_TICKS(stopped_ms);
+  if (stopped_ticks >= expected_idle) {
+    stopped_ticks = expected_idle - 1;
+  }
+  vTaskStepTick(stopped_ticks);
+
+  SysTick->VAL = 0;
+  SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+
+  if (stopped) {
+    /* The clock is the same before and after, so the app parts convert at it */
+    VAL_LowPower_GetLatency(&entry_us, &exit_us);
+    entry_us += VAL_SysClock_CyclesToMicros(suspend_cycles);
+    exit_us += VAL_SysClock_CyclesToMicros(VAL_SysClock_GetCycles() - resume_start);
+
+    power_stats.stops++;
+    power_stats.stopped_ms += stopped_ms;
+    if (entry_us > power_stats.entry_max_us) {
+      power_stats.entry_max_us = entry_us;
+    }
+    if (exit_us > power_stats.exit_max_us) {
+      power_stats.exit_max_us = exit_us;
+    }
+    if (wake == VAL_LOW_POWER_WAKE_SERIAL) {
+      power_stats.serial_wakes++;
+      serial_wake_tick = HAL_GetTick();
+      serial_woken = true;
+    }
+  }
+
+  __enable_irq();
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Check whether nothing needs the clocks to keep running
+ * @note   Called with interrupts disabled
+ * @retval bool: true if stop mode may be entered
+ */
+static bool Power_CanStop(void) {
+#ifdef BENCHMARK
+  /* Wake-up latency would dominate the measured timings */
+  return false;
+#endif
+
+  /* The host has to accept the lost byte, see the file header */
+  if (!Config_IsStopModeEnabled()) {
+    return false;
+  }
+
+  if (!SYS_Coordinator_IsReady() || !LED_Driver_IsIdle() || Sequencer_IsRunning() ||
+      SYS_Coordinator_IsTelemetryActive() || Transport_IsBusy() || Modbus_IsActive()) {
+    return false;
+  }
+
+#if VAL_SPI_SLAVE_ENABLED
+  /* SPI1 cannot wake the MCU, and the host clocks when it likes */
+  if (SpiLink_IsActive()) {
+    return false;
+  }
+#endif
+
+  if (Transport_GetIdleTime() < POWER_SERIAL_AWAKE_MS) {
+    return false;
+  }
+
+  /* The byte that woke the MCU was lost, or with the listener the frame
+   * is still being received; the next one is not received yet */
+  if (serial_woken) {
+    if ((HAL_GetTick() - serial_wake_tick) < POWER_SERIAL_AWAKE_MS) {
+      return false;
+    }
+    serial_woken = false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief  Switch the core clock to the level the present work needs
+ * @note   Called from the idle task with the scheduler suspended
+ * @retval None
+ */
+static void Power_UpdateClock(void) {
+  VAL_SysClock_Level_t level = Power_SelectClockLevel();
+
+  if (level != VAL_SysClock_GetLevel() && VAL_SysClock_SetLevel(level) == VAL_OK) {
+    taskENTER_CRITICAL();
+    power_stats.clock_changes++;
+    taskEXIT_CRITICAL();
+  }
+}
+
+/**
+ * @brief  Choose the core clock level for the present work
+ * @retval VAL_SysClock_Level_t: Level to run at
+ */
+static VAL_SysClock_Level_t Power_SelectClockLevel(void) {
+#ifdef BENCHMARK
+  /* Timings are compared at one clock */
+  return VAL_SYSCLOCK_LEVEL_NOMINAL;
+#endif
+
+  if (!SYS_Coordinator_IsReady()) {
+    return VAL_SYSCLOCK_LEVEL_NOMINAL;
+  }
+
+  if (SYS_Coordinator_IsTelemetryActive() || Sequencer_IsRunning() || LED_Driver_IsControlActive() ||
+      Modbus_IsActive()) {
+    return VAL_SYSCLOCK_LEVEL_HIGH;
+  }
+
+#if VAL_SPI_SLAVE_ENABLED
+  /* A slave follows at most half of PCLK2 */
+  if (SpiLink_IsActive()) {
+    return VAL_SYSCLOCK_LEVEL_HIGH;
+  }
+#endif
+
+  if (LED_Driver_IsIdle() && Transport_GetIdleTime() >= POWER_CLOCK_LOW_MS) {
+    return VAL_SYSCLOCK_LEVEL_LOW;
+  }
+
+  return VAL_SYSCLOCK_LEVEL_NOMINAL;
+}
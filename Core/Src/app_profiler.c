@@ -0,0 +1,313 @@
+/**
+  ******************************************************************************
+  * @file    app_profiler.c
+  * @brief   Application layer latency profiler
+  ******************************************************************************
+  * @attention
+  *
+  * This module keeps min/max/average timing for a fixed set of named probe
+  * points, measured with the DWT cycle counter. Probes may be stopped from
+  * tasks and interrupts.
+  *
+  * Benchmark builds also time the interrupt to task handoffs: the task arms
+  * a wakeup before it blocks, the interrupt stamps it just before the
+  * notification and the task records the difference once it runs. A
+  * notification sent while the task was busy is not stamped, so the figure
+  * is the wakeup alone, context switch and higher priority work included.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_profiler.h"
+#include "val.h"
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint32_t count;
+  uint32_t min_cycles;
+  uint32_t max_cycles;
+  uint64_t total_cycles;
+} Profiler_Probe_Data_t;
+
+#ifdef BENCHMARK
+typedef struct {
+  uint32_t count;
+  uint32_t min_cycles;
+  uint32_t max_cycles;
+} Profiler_Wakeup_Data_t;
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+static Profiler_Probe_Data_t probes[PROFILER_PROBE_COUNT];
+
+#ifdef BENCHMARK
+static Profiler_Wakeup_Data_t wakeups[PROFILER_WAKEUP_COUNT];
+static volatile uint32_t wakeup_stamps[PROFILER_WAKEUP_COUNT];
+static volatile uint8_t wakeup_armed = 0;   /* Bit n: task n waits, not stamped yet */
+static volatile uint8_t wakeup_marked = 0;  /* Bit n: stamped, task not run yet */
+
+static const char* const wakeup_names[PROFILER_WAKEUP_COUNT] = {
+  "rx",
+  "adc",
+  "tx"
+};
+#endif
+
+static const char* const probe_names[PROFILER_PROBE_COUNT] = {
+  "command",
+  "json_parse",
+  "response_format",
+  "serial_send",
+  "sensor_update",
+  "frame_decode",
+  "adc_block",
+  "alarm_reaction",
+  "pwm_update"
+};
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Initialize the profiler
+ * @note   The cycle counter itself is started by VAL_SysClock_Init
+ * @retval VAL_Status: VAL_OK
+ */
+VAL_Status Profiler_Init(void) {
+  Profiler_Reset();
+  return VAL_OK;
+}
+
+/**
+ * @brief  Take the start timestamp of a measurement
+ * @retval uint32_t: Cycle counter value to pass to Profiler_Stop
+ */
+uint32_t Profiler_Start(void) {
+  return VAL_SysClock_GetCycles();
+}
+
+/**
+ * @brief  Record the time elapsed since a start timestamp
+ * @param  probe: Probe to account the measurement to
+ * @param  start: Value returned by Profiler_Start
+ * @retval None
+ */
+void Profiler_Stop(Profiler_Probe_t probe, uint32_t start) {
+  Profiler_Record(probe, VAL_SysClock_GetCycles() - start);
+}
+
+/**
+ * @brief  Record a measurement taken by the caller
+ * @note   For work that is spread over several calls, e.g. accumulated
+ *         with Profiler_Start/VAL_SysClock_GetCycles differences
+ * @param  probe: Probe to account the measurement to
+ * @param  elapsed: Duration in cycles
+ * @retval None
+ */
+void Profiler_Record(Profiler_Probe_t probe, uint32_t elapsed) {
+  uint32_t primask;
+
+  if (probe >= PROFILER_PROBE_COUNT) {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  Profiler_Probe_Data_t* data = &probes[probe];
+  if (data->count == 0 || elapsed < data->min_cycles) {
+    data->min_cycles = elapsed;
+  }
+  if (elapsed > data->max_cycles) {
+    data->max_cycles = elapsed;
+  }
+  data->total_cycles += elapsed;
+  data->count++;
+
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Get the statistics of a probe
+ * @param  probe: Probe to query
+ * @param  stats: Pointer to store the statistics
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status Profiler_GetStats(Profiler_Probe_t probe, Profiler_Stats_t* stats) {
+  Profiler_Probe_Data_t data;
+  uint32_t primask;
+
+  if (probe >= PROFILER_PROBE_COUNT || stats == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* Copy atomically, a probe may be updated from an interrupt */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  data = probes[probe];
+  __set_PRIMASK(primask);
+
+  stats->count = data.count;
+  stats->min_us = VAL_SysClock_CyclesToMicros(data.min_cycles);
+  stats->max_us = VAL_SysClock_CyclesToMicros(data.max_cycles);
+  stats->avg_us = (data.count > 0) ?
+                  VAL_SysClock_CyclesToMicros((uint32_t)(data.total_cycles / data.count)) : 0;
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the name of a probe as reported to the host
+ * @param  probe: Probe to query
+ * @retval const char*: Probe name, "unknown" for invalid probes
+ */
+const char* Profiler_GetName(Profiler_Probe_t probe) {
+  if (probe >= PROFILER_PROBE_COUNT) {
+    return "unknown";
+  }
+
+  return probe_names[probe];
+}
+
+/**
+ * @brief  Clear the statistics of all probes
+ * @retval None
+ */
+void Profiler_Reset(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  memset(probes, 0, sizeof(probes));
+  __set_PRIMASK(primask);
+}
+
+#ifdef BENCHMARK
+/**
+ * @brief  Note that a task is about to block waiting for a handoff
+ * @param  wakeup: Handoff the task waits for
+ * @retval None
+ */
+void Profiler_WakeupArm(Profiler_Wakeup_t wakeup) {
+  uint32_t primask;
+
+  if (wakeup >= PROFILER_WAKEUP_COUNT) {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  wakeup_marked &= (uint8_t)~(1U << wakeup);
+  wakeup_armed |= (uint8_t)(1U << wakeup);
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Stamp a handoff just before the interrupt notifies the task
+ * @note   Interrupt context. Ignored unless the task is waiting.
+ * @param  wakeup: Handoff being signalled
+ * @retval None
+ */
+void Profiler_WakeupMark(Profiler_Wakeup_t wakeup) {
+  uint32_t primask;
+
+  if (wakeup >= PROFILER_WAKEUP_COUNT) {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if (wakeup_armed & (1U << wakeup)) {
+    wakeup_stamps[wakeup] = VAL_SysClock_GetCycles();
+    wakeup_armed &= (uint8_t)~(1U << wakeup);
+    wakeup_marked |= (uint8_t)(1U << wakeup);
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Record the wakeup latency once the woken task runs
+ * @note   Call right after the blocking call returns; a timeout or another
+ *         event records nothing
+ * @param  wakeup: Handoff the task waited for
+ * @retval None
+ */
+void Profiler_WakeupDone(Profiler_Wakeup_t wakeup) {
+  uint32_t now = VAL_SysClock_GetCycles();
+  uint32_t primask;
+
+  if (wakeup >= PROFILER_WAKEUP_COUNT) {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if (wakeup_marked & (1U << wakeup)) {
+    Profiler_Wakeup_Data_t* data = &wakeups[wakeup];
+    uint32_t elapsed = now - wakeup_stamps[wakeup];
+
+    if (data->count == 0 || elapsed < data->min_cycles) {
+      data->min_cycles = elapsed;
+    }
+    if (elapsed > data->max_cycles) {
+      data->max_cycles = elapsed;
+    }
+    data->count++;
+  }
+  wakeup_armed &= (uint8_t)~(1U << wakeup);
+  wakeup_marked &= (uint8_t)~(1U << wakeup);
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Get the wakeup latency figures of a handoff
+ * @param  wakeup: Handoff to query
+ * @param  stats: Pointer to store the figures
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+ */
+VAL_Status Profiler_GetWakeup(Profiler_Wakeup_t wakeup, Profiler_WakeupStats_t* stats) {
+  Profiler_Wakeup_Data_t data;
+  uint32_t primask;
+
+  if (wakeup >= PROFILER_WAKEUP_COUNT || stats == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  data = wakeups[wakeup];
+  __set_PRIMASK(primask);
+
+  stats->count = data.count;
+  stats->min_ns = (uint32_t)((uint64_t)data.min_cycles * 1000000000U / SystemCoreClock);
+  stats->max_ns = (uint32_t)((uint64_t)data.max_cycles * 1000000000U / SystemCoreClock);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the name of a handoff as reported to the host
+ * @param  wakeup: Handoff to query
+ * @retval const char*: Handoff name, "unknown" for invalid values
+ */
+const char* Profiler_GetWakeupName(Profiler_Wakeup_t wakeup) {
+  if (wakeup >= PROFILER_WAKEUP_COUNT) {
+    return "unknown";
+  }
+
+  return wakeup_names[wakeup];
+}
+
+/**
+ * @brief  Clear the wakeup latency figures
+ * @note   Waits in progress are still measured
+ * @retval None
+ */
+void Profiler_ResetWakeup(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  memset(wakeups, 0, sizeof(wakeups));
+  __set_PRIMASK(primask);
+}
+#endif
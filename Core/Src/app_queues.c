@@ -0,0 +1,519 @@
+/**
+  ******************************************************************************
+  * @file    app_queues.c
+  * @brief   Application layer queue, buffer and mutex contention figures
+  ******************************************************************************
+  * @attention
+  *
+  * Every queue, stream buffer and mutex between the tasks is registered
+  * here where it is created, together with the application's own buffers
+  * that tasks and interrupts fill: the log ring and the TX slot pool. For
+  * each, this module keeps the most it held at once, the sends it refused,
+  * and how often and how long senders had to wait for room, so buffer
+  * sizes and queue depths can be set from measured data.
+  *
+  * The FreeRTOS objects are watched through the kernel trace hooks
+  * (FreeRTOSConfig.h), which run on every queue and stream buffer call; a
+  * call on an object not registered costs a scan of at most
+  * QUEUES_MAX_OBJECTS handles. The application buffers report themselves
+  * with Queues_NoteLevel, Queues_NoteFailed and Queues_NoteBlocked.
+  *
+  * A wait starts in the blocking hook and ends in the hook of the same
+  * task's next send, or take for a mutex, on that object, as the task
+  * retries once it runs again; it includes any time the woken task waited
+  * for the CPU. Only waits for room are counted: a receiver waiting on an
+  * empty queue is idle, not held up. For a mutex, a take that has to wait
+  * is the contention, and a take that times out a failure.
+  *
+  * The figures are updated with interrupts disabled for a few
+  * instructions, from any context.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_queues.h"
+#include "val.h"
+#include "task.h"
+#include "queue.h"
+#include "stream_buffer.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define QUEUES_MAX_WAITERS       8      /* Tasks timed while waiting at once */
+#define QUEUES_NONE              0xFFU
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  const void* object;
+  Queues_Stats_t stats;
+} Queues_Entry_t;
+
+typedef struct {
+  TaskHandle_t task;         /* NULL while the slot is free */
+  uint8_t index;             /* Object waited on */
+  uint32_t start_us;
+} Queues_Waiter_t;
+
+/* Private variables ---------------------------------------------------------*/
+static Queues_Entry_t queue_entries[QUEUES_MAX_OBJECTS];
+static volatile uint8_t queue_count = 0;
+
+static Queues_Waiter_t queue_waiters[QUEUES_MAX_WAITERS];
+
+static const char* const kind_names[QUEUES_KIND_COUNT] = {
+  "queue",
+  "stream",
+  "mutex",
+  "ring",
+  "pool"
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t Queues_Find(const void* object);
+static void Queues_RecordLevel(uint8_t index, uint32_t level);
+static void Queues_RecordFailed(uint8_t index);
+static void Queues_BeginWait(uint8_t index);
+static void Queues_EndWait(uint8_t index);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Watch a queue, stream buffer, mutex or application buffer
+ * @note   Call once, after creating it and before it is used. FreeRTOS
+ *         queues and mutexes are also added to the kernel queue registry.
+ * @param  object: Handle of the FreeRTOS object, or address of the buffer
+ * @param  name: Constant name reported for it
+ * @param  kind: What it is
+ * @param  capacity: Items, bytes or slots it holds, 1 for a mutex
+ * @retval VAL_Status: VAL_OK if successful, VAL_BUSY if QUEUES_MAX_OBJECTS
+ *         are watched, VAL_PARAM for invalid arguments
+ */
+VAL_Status Queues_Register(const void* object, const char* name, Queues_Kind_t kind, uint32_t capacity) {
+  uint32_t primask;
+  uint8_t index;
+
+  if (object == NULL || name == NULL || kind >= QUEUES_KIND_COUNT) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  index = queue_count;
+  if (index >= QUEUES_MAX_OBJECTS) {
+    __set_PRIMASK(primask);
+    return VAL_BUSY;
+  }
+  memset(&queue_entries[index], 0, sizeof(queue_entries[index]));
+  queue_entries[index].object = object;
+  queue_entries[index].stats.name = name;
+  queue_entries[index].stats.kind = (uint8_t)kind;
+  queue_entries[index].stats.capacity = capacity;
+  queue_count = index + 1U;
+
+  __set_PRIMASK(primask);
+
+  /* Names the object for debuggers that read the registry */
+  if (kind == QUEUES_KIND_QUEUE || kind == QUEUES_KIND_MUTEX) {
+    vQueueAddToRegistry((QueueHandle_t)object, name);
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Record the fill level of an application buffer after adding to it
+ * @note   Any context; ignored for an object not registered
+ * @param  object: Address given to Queues_Register
+ * @param  level: Items or slots held
+ * @retval None
+ */
+void Queues_NoteLevel(const void* object, uint32_t level) {
+  uint8_t index = Queues_Find(object);
+
+  if (index != QUEUES_NONE) {
+    Queues_RecordLevel(index, level);
+  }
+}
+
+/**
+ * @brief  Record an add refused by a full application buffer
+ * @note   Any context; ignored for an object not registered
+ * @param  object: Address given to Queues_Register
+ * @retval None
+ */
+void Queues_NoteFailed(const void* object) {
+  uint8_t index = Queues_Find(object);
+
+  if (index != QUEUES_NONE) {
+    Queues_RecordFailed(index);
+  }
+}
+
+/**
+ * @brief  Record a wait for room in an application buffer
+ * @note   Any context; ignored for an object not registered
+ * @param  object: Address given to Queues_Register
+ * @param  us: Time waited in microseconds
+ * @retval None
+ */
+void Queues_NoteBlocked(const void* object, uint32_t us) {
+  uint8_t index = Queues_Find(object);
+  Queues_Stats_t* stats;
+  uint32_t primask;
+
+  if (index == QUEUES_NONE) {
+    return;
+  }
+  stats = &queue_entries[index].stats;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  stats->blocks++;
+  stats->block_us += us;
+  if (us > stats->block_max_us) {
+    stats->block_max_us = us;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Get the figures of the watched objects, in registration order
+ * @param  stats: Array to store them
+ * @param  max_objects: Size of the array
+ * @retval uint8_t: Number of entries stored
+ */
+uint8_t Queues_GetStats(Queues_Stats_t* stats, uint8_t max_objects) {
+  uint8_t count = queue_count;
+  uint32_t primask;
+
+  if (stats == NULL) {
+    return 0;
+  }
+  if (count > max_objects) {
+    count = max_objects;
+  }
+
+  /* One object at a time, for the interrupts to wait no longer */
+  for (uint8_t i = 0; i < count; i++) {
+    primask = __get_PRIMASK();
+    __disable_irq();
+    stats[i] = queue_entries[i].stats;
+    __set_PRIMASK(primask);
+  }
+
+  return count;
+}
+
+/**
+ * @brief  Clear the figures of all watched objects
+ * @note   Waits in progress are still timed to their end
+ * @retval None
+ */
+void Queues_ResetStats(void) {
+  uint8_t count = queue_count;
+  uint32_t primask;
+
+  for (uint8_t i = 0; i < count; i++) {
+    Queues_Stats_t* stats = &queue_entries[i].stats;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    stats->high_water = 0;
+    stats->fails = 0;
+    stats->blocks = 0;
+    stats->block_us = 0;
+    stats->block_max_us = 0;
+    __set_PRIMASK(primask);
+  }
+}
+
+/**
+ * @brief  Get the name of a kind as reported to the host
+ * @param  kind: Kind to query
+ * @retval const char*: Kind name, "unknown" for invalid values
+ */
+const char* Queues_GetKindName(Queues_Kind_t kind) {
+  if (kind >= QUEUES_KIND_COUNT) {
+    return "unknown";
+  }
+
+  return kind_names[kind];
+}
+
+/**
+ * @brief  traceQUEUE_SEND hook, an item or a mutex given in a task
+ * @note   Runs before the item is copied in
+ * @param  object: Queue or mutex
+ * @retval None
+ */
+void Queues_KernelSent(const void* object) {
+  uint8_t index = Queues_Find(object);
+
+  if (index == QUEUES_NONE) {
+    return;
+  }
+  if (queue_entries[index].stats.kind == QUEUES_KIND_QUEUE) {
+    Queues_RecordLevel(index, (uint32_t)uxQueueMessagesWaitingFromISR((QueueHandle_t)object) + 1U);
+  }
+  Queues_EndWait(index);
+}
+
+/**
+ * @brief  traceQUEUE_SEND_FROM_ISR hook
+ * @note   Runs before the item is copied in
+ * @param  object: Queue or semaphore
+ * @retval None
+ */
+void Queues_KernelSentFromIsr(const void* object) {
+  uint8_t index = Queues_Find(object);
+
+  if (index != QUEUES_NONE && queue_entries[index].stats.kind == QUEUES_KIND_QUEUE) {
+    Queues_RecordLevel(index, (uint32_t)uxQueueMessagesWaitingFromISR((QueueHandle_t)object) + 1U);
+  }
+}
+
+/**
+ * @brief  traceQUEUE_SEND_FAILED and stream buffer send failure hook
+ * @note   Task context: the queue was still full when the wait ended
+ * @param  object: Queue or stream buffer
+ * @retval None
+ */
+void Queues_KernelSendFailed(const void* object) {
+  uint8_t index = Queues_Find(object);
+
+  if (index != QUEUES_NONE) {
+    Queues_RecordFailed(index);
+    Queues_EndWait(index);
+  }
+}
+
+/**
+ * @brief  traceQUEUE_SEND_FROM_ISR_FAILED hook
+ * @param  object: Queue or semaphore
+ * @retval None
+ */
+void Queues_KernelSendFailedFromIsr(const void* object) {
+  uint8_t index = Queues_Find(object);
+
+  if (index != QUEUES_NONE) {
+    Queues_RecordFailed(index);
+  }
+}
+
+/**
+ * @brief  traceSTREAM_BUFFER_SEND hook, bytes written in a task
+ * @param  object: Stream buffer
+ * @param  sent: Bytes written
+ * @param  length: Bytes asked to write; fewer is a failure
+ * @retval None
+ */
+void Queues_KernelStreamSent(const void* object, uint32_t sent, uint32_t length) {
+  uint8_t index = Queues_Find(object);
+
+  if (index == QUEUES_NONE) {
+    return;
+  }
+  Queues_RecordLevel(index, (uint32_t)xStreamBufferBytesAvailable((StreamBufferHandle_t)object));
+  if (sent < length) {
+    Queues_RecordFailed(index);
+  }
+  Queues_EndWait(index);
+}
+
+/**
+ * @brief  traceSTREAM_BUFFER_SEND_FROM_ISR hook
+ * @param  object: Stream buffer
+ * @param  sent: Bytes written
+ * @param  length: Bytes asked to write; fewer is a failure
+ * @retval None
+ */
+void Queues_KernelStreamSentFromIsr(const void* object, uint32_t sent, uint32_t length) {
+  uint8_t index = Queues_Find(object);
+
+  if (index == QUEUES_NONE) {
+    return;
+  }
+  Queues_RecordLevel(index, (uint32_t)xStreamBufferBytesAvailable((StreamBufferHandle_t)object));
+  if (sent < length) {
+    Queues_RecordFailed(index);
+  }
+}
+
+/**
+ * @brief  traceQUEUE_RECEIVE hook, an item or a mutex taken in a task
+ * @param  object: Queue or mutex
+ * @retval None
+ */
+void Queues_KernelReceived(const void* object) {
+  uint8_t index = Queues_Find(object);
+
+  if (index != QUEUES_NONE && queue_entries[index].stats.kind == QUEUES_KIND_MUTEX) {
+    Queues_EndWait(index);
+  }
+}
+
+/**
+ * @brief  traceQUEUE_RECEIVE_FAILED hook, nothing to take in a task
+ * @param  object: Queue or mutex
+ * @retval None
+ */
+void Queues_KernelReceiveFailed(const void* object) {
+  uint8_t index = Queues_Find(object);
+
+  if (index != QUEUES_NONE && queue_entries[index].stats.kind == QUEUES_KIND_MUTEX) {
+    Queues_RecordFailed(index);
+    Queues_EndWait(index);
+  }
+}
+
+/**
+ * @brief  traceBLOCKING_ON_QUEUE_SEND and stream buffer send hook
+ * @param  object: Queue or stream buffer waited on
+ * @retval None
+ */
+void Queues_KernelBlockedSend(const void* object) {
+  uint8_t index = Queues_Find(object);
+
+  if (index != QUEUES_NONE) {
+    Queues_BeginWait(index);
+  }
+}
+
+/**
+ * @brief  traceBLOCKING_ON_QUEUE_RECEIVE hook
+ * @note   Only a mutex taken by another task counts
+ * @param  object: Queue or mutex waited on
+ * @retval None
+ */
+void Queues_KernelBlockedReceive(const void* object) {
+  uint8_t index = Queues_Find(object);
+
+  if (index != QUEUES_NONE && queue_entries[index].stats.kind == QUEUES_KIND_MUTEX) {
+    Queues_BeginWait(index);
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Look up a registered object
+ * @param  object: Handle or address given to Queues_Register
+ * @retval uint8_t: Its index, QUEUES_NONE if it is not registered
+ */
+static uint8_t Queues_Find(const void* object) {
+  uint8_t count = queue_count;
+
+  for (uint8_t i = 0; i < count; i++) {
+    if (queue_entries[i].object == object) {
+      return i;
+    }
+  }
+
+  return QUEUES_NONE;
+}
+
+/**
+ * @brief  Raise the high-water mark of an object
+ * @param  index: Object index
+ * @param  level: Items, bytes or slots held now
+ * @retval None
+ */
+static void Queues_RecordLevel(uint8_t index, uint32_t level) {
+  Queues_Stats_t* stats = &queue_entries[index].stats;
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if (level > stats->high_water) {
+    stats->high_water = level;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Count a failure of an object
+ * @param  index: Object index
+ * @retval None
+ */
+static void Queues_RecordFailed(uint8_t index) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  queue_entries[index].stats.fails++;
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Start timing the running task's wait on an object
+ * @note   A task blocking again after a wakeup that found no room goes on
+ *         with the wait it started first
+ * @param  index: Object index
+ * @retval None
+ */
+static void Queues_BeginWait(uint8_t index) {
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  uint32_t now = VAL_SysClock_GetMicros();
+  uint8_t free_slot = QUEUES_NONE;
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+
+  for (uint8_t i = 0; i < QUEUES_MAX_WAITERS; i++) {
+    if (queue_waiters[i].task == task) {
+      if (queue_waiters[i].index == index) {
+        __set_PRIMASK(primask);
+        return;
+      }
+      /* Left over from a wait that ended unseen */
+      queue_waiters[i].task = NULL;
+    }
+    if (queue_waiters[i].task == NULL && free_slot == QUEUES_NONE) {
+      free_slot = i;
+    }
+  }
+
+  queue_entries[index].stats.blocks++;
+  if (free_slot != QUEUES_NONE) {
+    queue_waiters[free_slot].task = task;
+    queue_waiters[free_slot].index = index;
+    queue_waiters[free_slot].start_us = now;
+  }
+
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Stop timing the running task's wait on an object, if it waited
+ * @param  index: Object index
+ * @retval None
+ */
+static void Queues_EndWait(uint8_t index) {
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  uint32_t now = VAL_SysClock_GetMicros();
+  uint32_t primask;
+
+  /* No task runs yet; free slots hold NULL too */
+  if (task == NULL) {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  for (uint8_t i = 0; i < QUEUES_MAX_WAITERS; i++) {
+    if (queue_waiters[i].task == task && queue_waiters[i].index == index) {
+      Queues_Stats_t* stats = &queue_entries[index].stats;
+      uint32_t waited = now - queue_waiters[i].start_us;
+
+      stats->block_us += waited;
+      if (waited > stats->block_max_us) {
+        stats->block_max_us = waited;
+      }
+      queue_waiters[i].task = NULL;
+      break;
+    }
+  }
+
+  __set_PRIMASK(primask);
+}
@@ -0,0 +1,264 @@
+/**
+  ******************************************************************************
+  * @file    app_recorder.c
+  * @brief   Application layer black-box recorder of the scans around an alarm
+  ******************************************************************************
+  * @attention
+  *
+  * An alarm event only carries the reading that tripped it. The recorder
+  * keeps the raw scans around the trip: it arms the raw capture (val_analog.c)
+  * with RECORDER_PRE_SCANS scans before a fault trigger, so the block
+  * interrupt keeps the latest scans of every channel in the capture buffer
+  * in RAM2, one copy per scan and no other work. A new trip in the LED
+  * driver fires the trigger from the interrupt that raised it; the capture
+  * then records the rest of its scans and stops. The recording stays
+  * frozen until the host arms the recorder again, so a trip that follows
+  * does not overwrite the one that started it. Host captures use the same
+  * buffer and replace the recorder until then.
+  *
+  * The raw scans are read with capture/read. They are lost at a reset, and
+  * the flash has no room for them, so the error log task reduces them to
+  * the minimum, mean and maximum of every channel before and after the
+  * trip and stores that in the data store, a 116-byte background write
+  * per recording. The stored summary is served after a restart.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_recorder.h"
+#include "app_counters.h"
+#include "val.h"
+#include "stm32l4xx_hal.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define RECORDER_CHUNK_SCANS     8U    /* Scans read from the capture at a time */
+
+_Static_assert(RECORDER_PRE_SCANS < RECORDER_SCANS, "The recorder needs scans after the trip");
+
+/* Private variables ---------------------------------------------------------*/
+/* Last recording; replaced whole in a masked section, by the error log task only */
+static Recorder_Summary_t summary;
+static bool summary_recorded = false;
+static bool summary_stored = false;
+
+/* The recording in progress: the trip that froze it, as noted by the
+ * coordinator, and whether its summary was made */
+static uint64_t armed_us = 0;
+static uint64_t noted_us = 0;
+static uint8_t noted_light = 0;
+static uint8_t noted_code = 0;
+static bool summarized = false;
+
+/* Error log task only, kept off its small stack */
+static Recorder_Summary_t pending;
+static uint16_t chunk[RECORDER_CHUNK_SCANS * ANALOG_CHANNEL_COUNT];
+static uint32_t sums[RECORDER_WINDOW_COUNT][ANALOG_CHANNEL_COUNT];
+
+/* Private function prototypes -----------------------------------------------*/
+static void Recorder_Summarize(const AnalogCaptureStatus* capture);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Take over the stored summary and arm the recorder
+ * @note   Called once the data store runs
+ * @retval None
+ */
+void Recorder_Init(void) {
+  if (VAL_DataStore_LoadRecording(RECORDER_VERSION, &summary, sizeof(summary)) == VAL_OK) {
+    summary_recorded = true;
+    summary_stored = true;
+  }
+
+  (void)Recorder_Arm();
+}
+
+/**
+ * @brief  Start holding the latest scans for the next trip
+ * @note   Replaces the raw capture in progress, a host capture included
+ * @retval VAL_Status: VAL_OK if armed, VAL_ERROR otherwise
+ */
+VAL_Status Recorder_Arm(void) {
+  AnalogCaptureConfig config = {0};
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  armed_us = VAL_SysClock_GetMicros64();
+  noted_light = 0;
+  noted_code = 0;
+  summarized = false;
+  __set_PRIMASK(primask);
+
+  config.scans = RECORDER_SCANS;
+  config.pre_scans = RECORDER_PRE_SCANS;
+  config.trigger = ANALOG_CAPTURE_FAULT;
+
+  return (VAL_Analog_StartCapture(&config) == VAL_OK) ? VAL_OK : VAL_ERROR;
+}
+
+/**
+ * @brief  Tell the recorder about a newly raised alarm
+ * @note   Coordinator task. The earliest trip since the recorder was armed
+ *         is the one that froze it.
+ * @param  lightId: Light that tripped
+ * @param  code: Alarm raised (ErrorType_t)
+ * @param  tripUs: Time of the trip, VAL_SysClock_GetMicros64
+ * @retval None
+ */
+void Recorder_NoteAlarm(uint8_t lightId, uint8_t code, uint64_t tripUs) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if (!summarized && tripUs >= armed_us && (noted_light == 0 || tripUs < noted_us)) {
+    noted_us = tripUs;
+    noted_light = lightId;
+    noted_code = code;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Summarize a completed recording and store the summary in flash
+ * @note   Error log task only, the one that makes background writes
+ * @retval VAL_Status: VAL_OK if stored or nothing is due, VAL_BUSY while the
+ *         recording is still running or flash was in use, VAL_ERROR if the
+ *         write failed
+ */
+VAL_Status Recorder_Save(void) {
+  AnalogCaptureStatus capture;
+
+  VAL_Analog_GetCaptureStatus(&capture);
+  if (capture.trigger == ANALOG_CAPTURE_FAULT) {
+    if (capture.state == ANALOG_CAPTURE_RUNNING) {
+      return VAL_BUSY;
+    }
+    if (capture.state == ANALOG_CAPTURE_DONE && !summarized) {
+      Recorder_Summarize(&capture);
+    }
+  }
+
+  /* A summary the erase gate held back is still stored after re-arming */
+  if (!summary_recorded || summary_stored) {
+    return VAL_OK;
+  }
+
+  VAL_Status status = VAL_DataStore_SaveRecording(RECORDER_VERSION, &summary, sizeof(summary));
+  if (status == VAL_OK) {
+    summary_stored = true;
+  }
+
+  return status;
+}
+
+/**
+ * @brief  Get the recorder state and the summary of the last recording
+ * @param  status: Pointer to store the status
+ * @retval None
+ */
+void Recorder_GetStatus(Recorder_Status_t* status) {
+  AnalogCaptureStatus capture;
+
+  if (status == NULL) {
+    return;
+  }
+
+  VAL_Analog_GetCaptureStatus(&capture);
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (capture.trigger != ANALOG_CAPTURE_FAULT || capture.state == ANALOG_CAPTURE_IDLE) {
+    status->state = RECORDER_OFF;
+  } else if (capture.state == ANALOG_CAPTURE_ARMED) {
+    status->state = RECORDER_ARMED;
+  } else {
+    /* Done once the summary describes it */
+    status->state = summarized ? RECORDER_DONE : RECORDER_RECORDING;
+  }
+  status->recorded = summary_recorded;
+  status->stored = summary_stored;
+  status->summary = summary;
+  __set_PRIMASK(primask);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Reduce the completed recording to the summary of its windows
+ * @note   Error log task only
+ * @param  capture: Status of the completed capture
+ * @retval None
+ */
+static void Recorder_Summarize(const AnalogCaptureStatus* capture) {
+  uint32_t counters[COUNTERS_COUNT];
+  uint16_t counts[RECORDER_WINDOW_COUNT];
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  uint64_t armed = armed_us;
+  __set_PRIMASK(primask);
+
+  memset(&pending, 0, sizeof(pending));
+  memset(sums, 0, sizeof(sums));
+  for (uint8_t w = 0; w < RECORDER_WINDOW_COUNT; w++) {
+    memset(pending.windows[w].min, 0xFF, sizeof(pending.windows[w].min));
+  }
+
+  counts[RECORDER_WINDOW_BEFORE] = capture->trigger_scan;
+  counts[RECORDER_WINDOW_AFTER] = capture->scans - capture->trigger_scan;
+
+  for (uint16_t scan = 0; scan < capture->scans; scan += RECORDER_CHUNK_SCANS) {
+    uint16_t count = VAL_Analog_ReadCapture(scan, RECORDER_CHUNK_SCANS, chunk);
+
+    for (uint16_t i = 0; i < count; i++) {
+      Recorder_Window_t* window = &pending.windows[(scan + i < capture->trigger_scan) ?
+                                                     RECORDER_WINDOW_BEFORE : RECORDER_WINDOW_AFTER];
+      uint32_t* sum = sums[(scan + i < capture->trigger_scan) ? RECORDER_WINDOW_BEFORE : RECORDER_WINDOW_AFTER];
+
+      for (uint8_t ch = 0; ch < ANALOG_CHANNEL_COUNT; ch++) {
+        uint16_t sample = chunk[i * ANALOG_CHANNEL_COUNT + ch];
+
+        if (sample < window->min[ch]) {
+          window->min[ch] = sample;
+        }
+        if (sample > window->max[ch]) {
+          window->max[ch] = sample;
+        }
+        sum[ch] += sample;
+      }
+    }
+  }
+
+  for (uint8_t w = 0; w < RECORDER_WINDOW_COUNT; w++) {
+    for (uint8_t ch = 0; ch < ANALOG_CHANNEL_COUNT; ch++) {
+      if (counts[w] == 0) {
+        pending.windows[w].min[ch] = 0;
+      } else {
+        pending.windows[w].mean[ch] = (uint16_t)((sums[w][ch] + counts[w] / 2U) / counts[w]);
+      }
+    }
+  }
+
+  Counters_GetAll(counters);
+  pending.boot = counters[COUNTERS_BOOTS];
+  pending.first_sample = capture->first_sample;
+  pending.pre_scans = counts[RECORDER_WINDOW_BEFORE];
+  pending.post_scans = counts[RECORDER_WINDOW_AFTER];
+  pending.rate_hz = (uint16_t)VAL_Analog_GetSampleRate();
+
+  /* Armed again meanwhile: the scans read belong to no recording */
+  __disable_irq();
+  if (armed != armed_us) {
+    __set_PRIMASK(primask);
+    return;
+  }
+  pending.trip_ms = (uint32_t)(noted_us / 1000U);
+  pending.light_id = noted_light;
+  pending.code = noted_code;
+  summary = pending;
+  summary_recorded = true;
+  summary_stored = false;
+  summarized = true;
+  __set_PRIMASK(primask);
+}
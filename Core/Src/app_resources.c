@@ -0,0 +1,287 @@
+/**
+  ******************************************************************************
+  * @file    app_resources.c
+  * @brief   Application layer RAM and CPU usage monitoring
+  ******************************************************************************
+  * @attention
+  *
+  * This module reports how much of each task stack and of the FreeRTOS heap
+  * has been used, so stack sizes can be set from measured data.
+  *
+  * FreeRTOS checks the stack of a task when it is switched out
+  * (configCHECK_FOR_STACK_OVERFLOW 2). An overflow has already corrupted
+  * memory, so the hook only records the task name in RAM2, which the startup
+  * code does not initialize, and resets through the crash capture
+  * (app_crash.c). The PWM outputs return to their reset state, and the name
+  * is reported after the restart.
+  *
+  * CPU load comes from the FreeRTOS run-time counters, which count
+  * microseconds from VAL_SysClock_GetMicros. Interrupt handlers add their
+  * DWT cycle count to a per-interrupt total on exit. Both are reported as
+  * the change since the previous query. The time of an interrupt is also
+  * included in the task it interrupted, and a nested interrupt is also
+  * included in the one it preempted.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_resources.h"
+#include "app_crash.h"
+#include "val.h"
+#include "task.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define RESOURCES_OVERFLOW_MAGIC  0x4B4F5453U  /* "STOK" */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint32_t magic;            /* RESOURCES_OVERFLOW_MAGIC if name is valid */
+  char name[configMAX_TASK_NAME_LEN];
+} Resources_Overflow_t;
+
+/* Private variables ---------------------------------------------------------*/
+/* Survives the reset done by the overflow hook */
+static Resources_Overflow_t overflow_record __attribute__((section(".noinit")));
+
+/* Record taken over at start-up, empty name if none */
+static char overflow_task[configMAX_TASK_NAME_LEN];
+
+/* Snapshot buffer for uxTaskGetSystemState (comms task only) */
+static TaskStatus_t task_status[RESOURCES_MAX_TASKS];
+
+/* Cycles spent in each interrupt since start-up */
+static volatile uint64_t isr_cycles[RESOURCES_ISR_COUNT];
+
+/* Counters at the previous Resources_GetCpuLoad call */
+static TaskHandle_t load_tasks[RESOURCES_MAX_TASKS];
+static uint32_t load_task_time[RESOURCES_MAX_TASKS];
+static uint8_t load_task_count = 0;
+static uint32_t load_total_time = 0;
+static uint64_t load_isr_cycles[RESOURCES_ISR_COUNT];
+
+static const char* const isr_names[RESOURCES_ISR_COUNT] = {
+  "uart",
+  "uart_dma",
+  "adc_dma",
+  "adc",
+  "pwm_dma",
+  "tick",
+  "cue",
+  "strobe",
+  "sync",
+  "dma_copy"
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t LoadPermille(uint64_t part, uint32_t total);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Take over the stack overflow record left by the previous run
+ * @note   The record is cleared, so it is reported for one run only
+ * @retval VAL_Status: VAL_OK
+ */
+VAL_Status Resources_Init(void) {
+  overflow_task[0] = '\0';
+
+  if (overflow_record.magic == RESOURCES_OVERFLOW_MAGIC) {
+    memcpy(overflow_task, overflow_record.name, sizeof(overflow_task));
+    overflow_task[sizeof(overflow_task) - 1] = '\0';
+  }
+  overflow_record.magic = 0;
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the stack usage of all tasks
+ * @param  tasks: Array to store the task entries
+ * @param  max_tasks: Size of the array
+ * @retval uint8_t: Number of entries stored
+ */
+uint8_t Resources_GetTasks(Resources_Task_t* tasks, uint8_t max_tasks) {
+  UBaseType_t count;
+
+  if (tasks == NULL) {
+    return 0;
+  }
+
+  /* Returns 0 if there are more tasks than entries */
+  count = uxTaskGetSystemState(task_status, RESOURCES_MAX_TASKS, NULL);
+  if (count > max_tasks) {
+    count = max_tasks;
+  }
+
+  for (UBaseType_t i = 0; i < count; i++) {
+    strncpy(tasks[i].name, task_status[i].pcTaskName, sizeof(tasks[i].name) - 1);
+    tasks[i].name[sizeof(tasks[i].name) - 1] = '\0';
+    tasks[i].stack_free = (uint32_t)task_status[i].usStackHighWaterMark * sizeof(StackType_t);
+    tasks[i].number = (uint8_t)task_status[i].xTaskNumber;
+  }
+
+  return (uint8_t)count;
+}
+
+/**
+ * @brief  Get the FreeRTOS heap usage
+ * @param  heap: Pointer to store the heap figures
+ * @retval None
+ */
+void Resources_GetHeap(Resources_Heap_t* heap) {
+  if (heap == NULL) {
+    return;
+  }
+
+  heap->free = xPortGetFreeHeapSize();
+  heap->min_free = xPortGetMinimumEverFreeHeapSize();
+}
+
+/**
+ * @brief  Get the task whose stack overflowed before the last reset
+ * @retval const char*: Task name, NULL if the last reset was not caused by
+ *         a stack overflow
+ */
+const char* Resources_GetStackOverflow(void) {
+  return (overflow_task[0] != '\0') ? overflow_task : NULL;
+}
+
+/**
+ * @brief  Get the CPU load of all tasks and interrupts since the previous call
+ * @note   The first call reports the load since start-up
+ * @param  load: Pointer to store the interval and interrupt figures
+ * @param  tasks: Array to store the task entries
+ * @param  max_tasks: Size of the array
+ * @retval uint8_t: Number of task entries stored
+ */
+uint8_t Resources_GetCpuLoad(Resources_CpuLoad_t* load, Resources_Load_t* tasks, uint8_t max_tasks) {
+  uint32_t total_time = load_total_time;  /* Not written if the snapshot fails */
+  uint32_t interval;
+  uint32_t primask;
+  uint64_t cycles[RESOURCES_ISR_COUNT];
+  UBaseType_t count;
+  uint8_t stored = 0;
+
+  if (load == NULL || tasks == NULL) {
+    return 0;
+  }
+
+  count = uxTaskGetSystemState(task_status, RESOURCES_MAX_TASKS, &total_time);
+
+  /* 64-bit totals are not updated atomically */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t i = 0; i < RESOURCES_ISR_COUNT; i++) {
+    cycles[i] = isr_cycles[i];
+  }
+  __set_PRIMASK(primask);
+
+  interval = total_time - load_total_time;
+  load->interval_us = interval;
+
+  for (uint8_t i = 0; i < RESOURCES_ISR_COUNT; i++) {
+    uint64_t us = (cycles[i] - load_isr_cycles[i]) / (SystemCoreClock / 1000000U);
+    load->isr_permille[i] = LoadPermille(us, interval);
+    load_isr_cycles[i] = cycles[i];
+  }
+
+  for (UBaseType_t i = 0; i < count && stored < max_tasks; i++) {
+    uint32_t previous = 0;
+
+    /* Tasks created since the previous call count from zero */
+    for (uint8_t j = 0; j < load_task_count; j++) {
+      if (load_tasks[j] == task_status[i].xHandle) {
+        previous = load_task_time[j];
+        break;
+      }
+    }
+
+    strncpy(tasks[stored].name, task_status[i].pcTaskName, sizeof(tasks[stored].name) - 1);
+    tasks[stored].name[sizeof(tasks[stored].name) - 1] = '\0';
+    tasks[stored].permille = LoadPermille(task_status[i].ulRunTimeCounter - previous, interval);
+    stored++;
+  }
+
+  for (UBaseType_t i = 0; i < count; i++) {
+    load_tasks[i] = task_status[i].xHandle;
+    load_task_time[i] = task_status[i].ulRunTimeCounter;
+  }
+  load_task_count = (uint8_t)count;
+  load_total_time = total_time;
+
+  return stored;
+}
+
+/**
+ * @brief  Get the name of an interrupt as reported to the host
+ * @param  isr: Interrupt to query
+ * @retval const char*: Interrupt name, "unknown" for invalid values
+ */
+const char* Resources_GetIsrName(Resources_Isr_t isr) {
+  if (isr >= RESOURCES_ISR_COUNT) {
+    return "unknown";
+  }
+
+  return isr_names[isr];
+}
+
+/**
+ * @brief  Account the time spent in an interrupt handler
+ * @note   Called at the end of the handlers in stm32l4xx_it.c
+ * @param  isr: Interrupt that ran
+ * @param  start_cycles: VAL_SysClock_GetCycles() at handler entry
+ * @retval None
+ */
+void Resources_IsrDone(Resources_Isr_t isr, uint32_t start_cycles) {
+  uint32_t elapsed = VAL_SysClock_GetCycles() - start_cycles;
+  uint32_t primask;
+
+  if (isr >= RESOURCES_ISR_COUNT) {
+    return;
+  }
+
+  /* The UART DMA channels share a total and can preempt each other */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  isr_cycles[isr] += elapsed;
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  FreeRTOS stack overflow hook
+ * @note   Called from the context switch with the task's stack already
+ *         overrun; records the task and the crash report, and resets
+ * @param  xTask: Task whose stack overflowed
+ * @param  pcTaskName: Its name
+ * @retval None
+ */
+void vApplicationStackOverflowHook(xTaskHandle xTask, signed char *pcTaskName) {
+  __disable_irq();
+
+  strncpy(overflow_record.name, (const char*)pcTaskName, sizeof(overflow_record.name) - 1);
+  overflow_record.name[sizeof(overflow_record.name) - 1] = '\0';
+  overflow_record.magic = RESOURCES_OVERFLOW_MAGIC;
+
+  Crash_StackOverflow();
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Convert a part of an interval to permille
+ * @param  part: Time spent, in microseconds
+ * @param  total: Interval length, in microseconds
+ * @retval uint16_t: Share of the interval, limited to 1000
+ */
+static uint16_t LoadPermille(uint64_t part, uint32_t total) {
+  uint64_t permille;
+
+  if (total == 0) {
+    return 0;
+  }
+
+  permille = (part * 1000U) / total;
+  return (permille > 1000U) ? 1000U : (uint16_t)permille;
+}
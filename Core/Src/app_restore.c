@@ -0,0 +1,301 @@
+/**
+  ******************************************************************************
+  * @file    app_restore.c
+  * @brief   Application layer power-on restore of the light intensities
+  ******************************************************************************
+  * @attention
+  *
+  * After a reset or a brownout the lights would come up dark until the
+  * host sets them again. With a power-on mode other than off, the
+  * intensities to come up with are kept in the RTC backup registers, after
+  * the lifetime counters: the last ones set, rewritten by the coordinator
+  * whenever they change, or those of the power-on scene, written when the
+  * mode or the scene is stored. A CRC-32 register after them tells a valid
+  * record from a cleared backup domain. Reading it needs neither the flash
+  * data store nor the scheduler, so the lights come back within the first
+  * milliseconds of start-up, before the serial link is up.
+  *
+  * That early, the ADC is not running and the alarm limits stored in flash
+  * are not known. Only lights guarded by a comparator are switched on
+  * then, with the comparators armed at the trip currents of the channel
+  * table; a trip turns its light off, which stays off. The zero-current
+  * offsets are not captured with lights on, so they stay 0 and the
+  * currents read high. The other lights come up in LED_Driver_Init, once
+  * their ADC watchdog is armed, and the stored limits replace the channel
+  * defaults a little later as usual.
+  *
+  * Should switching the lights on be what brings the supply down, the
+  * device would never get past start-up. The record counts the start-ups
+  * that restored without reaching ready; from RESTORE_MAX_ATTEMPTS on the
+  * lights stay off until one does.
+  *
+  * The backup registers are lost with the supply and backup battery; a
+  * power-on scene is then recalled from flash by the coordinator, the
+  * last intensities are lost.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_restore.h"
+#include "val.h"
+#include "stm32l4xx_hal.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define RESTORE_BACKUP_FIRST     8U                /* After the lifetime counters */
+#define RESTORE_LEVEL_WORDS      ((VAL_LIGHT_COUNT + 1U) / 2U)  /* Two intensities per register */
+#define RESTORE_WORDS            (1U + RESTORE_LEVEL_WORDS)
+#define RESTORE_BACKUP_CHECK     (RESTORE_BACKUP_FIRST + RESTORE_WORDS)
+#define RESTORE_MAGIC            0x52535452U       /* "RTSR" */
+
+/* Fields of the first record word */
+#define RESTORE_MODE(word)       ((word) & 0xFFU)
+#define RESTORE_SCENE(word)      (((word) >> 8) & 0xFFU)
+#define RESTORE_ATTEMPTS(word)   (((word) >> 16) & 0xFFU)
+#define RESTORE_HEADER(mode, scene, attempts) \
+  ((uint32_t)(mode) | ((uint32_t)(scene) << 8) | ((uint32_t)(attempts) << 16))
+
+_Static_assert(RESTORE_BACKUP_CHECK < VAL_RTC_BACKUP_COUNT, "Power-on record too long for the backup registers");
+
+/* Private variables ---------------------------------------------------------*/
+static const char* const mode_names[RESTORE_MODE_COUNT] = {
+  [RESTORE_OFF]   = "off",
+  [RESTORE_LAST]  = "last",
+  [RESTORE_SCENE] = "scene",
+};
+
+/* Mirrors the backup registers, which the check is computed from */
+static uint32_t record[RESTORE_WORDS];
+
+/* Intensities switched on at start-up, or left for the LED driver */
+static volatile uint16_t restored[VAL_LIGHT_COUNT];
+static bool active = false;
+static bool retained = false;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Restore_SetLevels(const uint16_t* permille);
+static void Restore_WriteBackup(void);
+static uint32_t Restore_Check(void);
+static void Restore_TripCallback(uint8_t light_id);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Read the power-on record and bring up the lights it holds
+ * @note   Called right after VAL_Init and Counters_Init, before the
+ *         scheduler. Only lights guarded by a comparator are switched on
+ *         here, the others by LED_Driver_Init.
+ * @retval None
+ */
+void Restore_Init(void) {
+  int32_t trip_ma[VAL_LIGHT_COUNT];
+  uint32_t attempts;
+  bool any = false;
+
+  for (uint8_t i = 0; i < RESTORE_WORDS; i++) {
+    record[i] = VAL_RTC_ReadBackup(RESTORE_BACKUP_FIRST + i);
+  }
+
+  retained = (VAL_RTC_ReadBackup(RESTORE_BACKUP_CHECK) == Restore_Check()) &&
+             RESTORE_MODE(record[0]) < RESTORE_MODE_COUNT;
+  if (!retained) {
+    memset(record, 0, sizeof(record));
+    Restore_WriteBackup();
+    return;
+  }
+
+  attempts = RESTORE_ATTEMPTS(record[0]);
+  if (RESTORE_MODE(record[0]) == RESTORE_OFF || attempts >= RESTORE_MAX_ATTEMPTS) {
+    return;
+  }
+
+  /* Counted before any light goes on, in case that is what resets */
+  record[0] = RESTORE_HEADER(RESTORE_MODE(record[0]), RESTORE_SCENE(record[0]), attempts + 1U);
+  Restore_WriteBackup();
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    uint16_t permille = (uint16_t)(record[1 + i / 2] >> ((i % 2) * 16));
+
+    restored[i] = (permille > VAL_PWM_PERMILLE_MAX) ? VAL_PWM_PERMILLE_MAX : permille;
+    trip_ma[i] = VAL_Channels[i].current_trip_ma;
+    any = any || restored[i] != 0;
+  }
+  if (!any) {
+    return;
+  }
+
+  /* The trip levels are converted at the default scale, the ADC is not running yet */
+  VAL_Analog_InitScale();
+  if (VAL_Comparator_Enable(Restore_TripCallback, trip_ma) != VAL_OK) {
+    memset((void*)restored, 0, sizeof(restored));
+    return;
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (VAL_Channels[i].comparator != 0 && restored[i] != 0) {
+      VAL_PWM_SetPermille(i + 1, restored[i]);
+    }
+  }
+  active = true;
+}
+
+/**
+ * @brief  Check whether any light was restored at this start-up
+ * @retval bool: true if at least one light came up on
+ */
+bool Restore_IsActive(void) {
+  return active;
+}
+
+/**
+ * @brief  Check whether a valid power-on record was found at start-up
+ * @retval bool: false if the backup domain was lost
+ */
+bool Restore_IsRetained(void) {
+  return retained;
+}
+
+/**
+ * @brief  Get the intensities restored at start-up
+ * @param  permille: Array to store the intensities, VAL_LIGHT_COUNT entries;
+ *         all 0 if nothing was restored or a light tripped since
+ * @retval None
+ */
+void Restore_GetIntensities(uint16_t* permille) {
+  if (permille == NULL) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    permille[i] = active ? restored[i] : 0;
+  }
+}
+
+/**
+ * @brief  Select what the lights come up with
+ * @note   The start-up count is kept
+ * @param  mode: Restore_Mode_t
+ * @param  scene: Scene number for RESTORE_SCENE
+ * @param  permille: Intensities of the scene, VAL_LIGHT_COUNT entries, or
+ *         NULL to keep the last ones for RESTORE_LAST; all off if NULL for
+ *         RESTORE_SCENE
+ * @retval None
+ */
+void Restore_SetMode(Restore_Mode_t mode, uint8_t scene, const uint16_t* permille) {
+  static const uint16_t off[VAL_LIGHT_COUNT];
+  uint32_t primask;
+
+  if (mode >= RESTORE_MODE_COUNT) {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  record[0] = RESTORE_HEADER(mode, (mode == RESTORE_SCENE) ? scene : 0U, RESTORE_ATTEMPTS(record[0]));
+  if (mode != RESTORE_LAST || permille != NULL) {
+    Restore_SetLevels((mode == RESTORE_OFF || permille == NULL) ? off : permille);
+  }
+  Restore_WriteBackup();
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Record the intensities in use, for RESTORE_LAST
+ * @note   Coordinator task; the record is only written when they changed
+ * @param  permille: Intensity per light (0-1000), VAL_LIGHT_COUNT entries
+ * @retval None
+ */
+void Restore_Record(const uint16_t* permille) {
+  uint32_t levels[RESTORE_LEVEL_WORDS];
+  uint32_t primask;
+
+  if (permille == NULL || RESTORE_MODE(record[0]) != RESTORE_LAST) {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  memcpy(levels, &record[1], sizeof(levels));
+  Restore_SetLevels(permille);
+  if (memcmp(levels, &record[1], sizeof(levels)) != 0) {
+    Restore_WriteBackup();
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Mark the start-up as complete, so the next one restores again
+ * @retval None
+ */
+void Restore_Confirm(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if (RESTORE_ATTEMPTS(record[0]) != 0) {
+    record[0] = RESTORE_HEADER(RESTORE_MODE(record[0]), RESTORE_SCENE(record[0]), 0U);
+    Restore_WriteBackup();
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Get the name of a mode
+ * @param  mode: Mode
+ * @retval const char*: Name, "unknown" for an invalid mode
+ */
+const char* Restore_GetModeName(Restore_Mode_t mode) {
+  if (mode >= RESTORE_MODE_COUNT) {
+    return "unknown";
+  }
+
+  return mode_names[mode];
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Pack intensities into the record mirror, two per word
+ * @param  permille: Intensity per light, VAL_LIGHT_COUNT entries
+ * @retval None
+ */
+static void Restore_SetLevels(const uint16_t* permille) {
+  memset(&record[1], 0, RESTORE_LEVEL_WORDS * sizeof(uint32_t));
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    record[1 + i / 2] |= (uint32_t)permille[i] << ((i % 2) * 16);
+  }
+}
+
+/**
+ * @brief  Write the record mirror and its check to the backup registers
+ * @note   Called with interrupts disabled or before the scheduler
+ * @retval None
+ */
+static void Restore_WriteBackup(void) {
+  for (uint8_t i = 0; i < RESTORE_WORDS; i++) {
+    VAL_RTC_WriteBackup(RESTORE_BACKUP_FIRST + i, record[i]);
+  }
+  VAL_RTC_WriteBackup(RESTORE_BACKUP_CHECK, Restore_Check());
+}
+
+/**
+ * @brief  Compute the check register of the record mirror
+ * @retval uint32_t: CRC-32 of the record, mixed with a magic so a cleared
+ *         domain does not pass
+ */
+static uint32_t Restore_Check(void) {
+  return VAL_Crc_Compute(VAL_CRC_32, record, sizeof(record)) ^ RESTORE_MAGIC;
+}
+
+/**
+ * @brief  Comparator trip before the LED driver took over
+ * @note   Comparator interrupt. The break stopped all outputs; the tripped
+ *         light stays off and the others run on.
+ * @param  light_id: Light that tripped (1-VAL_LIGHT_COUNT)
+ * @retval None
+ */
+VAL_RAMFUNC static void Restore_TripCallback(uint8_t light_id) {
+  restored[light_id - 1] = 0;
+  VAL_PWM_SetPermille(light_id, 0);
+  VAL_PWM_RecoverBreak();
+}
@@ -0,0 +1,184 @@
+/**
+  ******************************************************************************
+  * @file    app_rules.c
+  * @brief   Application layer condition/action rules run on every scan
+  ******************************************************************************
+  * @attention
+  *
+  * A rule watches one value of one light, the filtered current or
+  * temperature or the alarm code, and acts when a threshold is crossed:
+  * it sets or fades some lights, recalls a scene, runs a stored command
+  * macro or tells the host. Local control such as dimming a light that
+  * runs hot then costs no round trip through the host.
+  *
+  * Rules are compiled when added. The threshold is converted to the unit
+  * of the scan values and, for a falling rule, negated together with the
+  * value, so that every rule fires when its scaled value reaches
+  * its threshold and re-arms below the threshold less the hysteresis. An
+  * evaluation is then one multiply and one compare per rule, the same cost
+  * on every scan whatever fires; the coordinator runs the actions.
+  *
+  * A rule fires once each time its condition starts to hold, not on every
+  * scan it holds, so an action is not repeated while a light stays hot.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_rules.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/* A rule as evaluated */
+typedef struct {
+  uint8_t slot;               /* Index of the watched value in the scan */
+  float sign;                 /* -1 for a falling rule, 1 otherwise */
+  float on;                   /* Fires at or above this, signed value */
+  float off;                  /* Re-arms below this */
+} Rules_Compiled_t;
+
+/* Private variables ---------------------------------------------------------*/
+/* Unit of a threshold per scan value unit, indexed by Rules_Input_t */
+static const float input_scale[RULES_INPUT_COUNT] = { 1.0f, 0.01f, 1.0f };
+
+static Rules_Rule_t rules[RULES_MAX];
+static Rules_Compiled_t compiled[RULES_MAX];
+static uint8_t rule_count = 0;
+static uint32_t rules_active = 0;
+static uint32_t scans = 0;
+static uint32_t hits[RULES_MAX];
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Check a rule, without adding it
+ * @param  rule: Rule to check
+ * @retval VAL_Status: VAL_OK if it can be added, VAL_PARAM if invalid
+ */
+VAL_Status Rules_Check(const Rules_Rule_t* rule) {
+  if (rule == NULL || rule->input >= RULES_INPUT_COUNT || rule->action >= RULES_ACTION_COUNT ||
+      rule->light_id < 1 || rule->light_id > VAL_LIGHT_COUNT || rule->hysteresis < 0) {
+    return VAL_PARAM;
+  }
+  if ((rule->action == RULES_ACTION_SET || rule->action == RULES_ACTION_FADE) &&
+      (rule->mask == 0 || (rule->mask >> VAL_LIGHT_COUNT) != 0 || rule->permille > 1000U)) {
+    return VAL_PARAM;
+  }
+  if ((rule->action == RULES_ACTION_SCENE && rule->scene == 0) ||
+      (rule->action == RULES_ACTION_MACRO && rule->macro == 0)) {
+    return VAL_PARAM;
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Compile a rule and append it to the table
+ * @param  rule: Rule to add
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR
+ *         if the table is full
+ */
+VAL_Status Rules_Add(const Rules_Rule_t* rule) {
+  if (Rules_Check(rule) != VAL_OK) {
+    return VAL_PARAM;
+  }
+  if (rule_count >= RULES_MAX) {
+    return VAL_ERROR;
+  }
+
+  Rules_Compiled_t* entry = &compiled[rule_count];
+  float scale = input_scale[rule->input];
+
+  entry->slot = (uint8_t)(rule->input * VAL_LIGHT_COUNT + rule->light_id - 1U);
+  entry->sign = rule->falling ? -1.0f : 1.0f;
+  entry->on = entry->sign * (float)rule->threshold * scale;
+  entry->off = entry->on - (float)rule->hysteresis * scale;
+
+  rules[rule_count] = *rule;
+  hits[rule_count] = 0;
+  rule_count++;
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Empty the table and reset the counters
+ * @retval VAL_Status: VAL_OK
+ */
+VAL_Status Rules_Clear(void) {
+  rule_count = 0;
+  rules_active = 0;
+  scans = 0;
+  memset(hits, 0, sizeof(hits));
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get a rule as it was added
+ * @param  index: Rule index (0 to the rule count - 1)
+ * @param  rule: Pointer to store the rule
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status Rules_GetRule(uint8_t index, Rules_Rule_t* rule) {
+  if (rule == NULL || index >= rule_count) {
+    return VAL_PARAM;
+  }
+
+  *rule = rules[index];
+  return VAL_OK;
+}
+
+/**
+ * @brief  Evaluate all rules against one scan
+ * @param  inputs: Values of the scan
+ * @retval uint32_t: Rules that fired, bit 0 for rule 1
+ */
+uint32_t Rules_Evaluate(const Rules_Inputs_t* inputs) {
+  uint32_t active = rules_active;
+  uint32_t fired = 0;
+
+  if (inputs == NULL) {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < rule_count; i++) {
+    const Rules_Compiled_t* entry = &compiled[i];
+    float value = inputs->values[entry->slot] * entry->sign;
+    uint32_t bit = 1UL << i;
+
+    if (!(active & bit)) {
+      if (value >= entry->on) {
+        active |= bit;
+        fired |= bit;
+        hits[i]++;
+      }
+    } else if (value < entry->off) {
+      active &= ~bit;
+    }
+  }
+
+  rules_active = active;
+  scans++;
+
+  return fired;
+}
+
+/**
+ * @brief  Get the table size and the counters
+ * @param  status: Pointer to store them
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status Rules_GetStatus(Rules_Status_t* status) {
+  if (status == NULL) {
+    return VAL_PARAM;
+  }
+
+  status->rule_count = rule_count;
+  status->scans = scans;
+  status->active = rules_active;
+  memcpy(status->hits, hits, sizeof(status->hits));
+
+  return VAL_OK;
+}
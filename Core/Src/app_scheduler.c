@@ -0,0 +1,204 @@
+/**
+  ******************************************************************************
+  * @file    app_scheduler.c
+  * @brief   Application layer periodic job scheduler
+  ******************************************************************************
+  * @attention
+  *
+  * Periodic housekeeping runs from one task and one table instead of a
+  * timeout in every task that has some: each entry of jobs[] is a short
+  * function with a period and a phase, the offset of its first run from
+  * start-up. The task sleeps until the next job is due, runs every job
+  * that is, and sleeps again; with nothing due it does not wake up, so the
+  * MCU can stay stopped between runs (see app_power.c).
+  *
+  * Jobs run one after the other in table order and must not block. Work
+  * that takes longer, or needs its own task's state, is a job that wakes
+  * that task, as the coordinator poll and the usage checkpoint do. A job
+  * that falls behind by more than its period drops the missed runs rather
+  * than running them back to back; they are counted as skipped.
+  *
+  * Each job's run count and total and longest run time are kept for
+  * system/cpu. Phases keep jobs with the same period from running in the
+  * same tick.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_scheduler.h"
+#include "app_supervisor.h"
+#include "app_sys_coordinator.h"
+#include "val.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "cmsis_os.h"
+#include <stdbool.h>
+
+/* Private define ------------------------------------------------------------*/
+/* Below every task it wakes, jobs only hand work on */
+#define SCHEDULER_STACK_SIZE     128
+#define SCHEDULER_PRIORITY       osPriorityLow
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  const char* name;
+  uint32_t period_ms;
+  uint32_t phase_ms;                /* First run after start-up */
+  void (*run)(void);
+} Scheduler_Job_t;
+
+typedef struct {
+  TickType_t due;                   /* Tick of the next run */
+  uint32_t runs;
+  uint32_t skipped;
+  uint32_t total_us;
+  uint32_t max_us;
+} Scheduler_State_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const Scheduler_Job_t jobs[] = {
+  { "coord_poll",  SYS_COORD_POLL_MS,             SYS_COORD_POLL_MS / 2U,        SYS_Coordinator_Poll },
+  { "usage_save",  SYS_COORD_USAGE_CHECKPOINT_MS, SYS_COORD_USAGE_CHECKPOINT_MS, SYS_Coordinator_RequestUsageSave },
+};
+
+#define SCHEDULER_JOB_COUNT      (sizeof(jobs) / sizeof(jobs[0]))
+
+_Static_assert(SCHEDULER_JOB_COUNT <= SCHEDULER_MAX_JOBS, "Too many scheduler jobs");
+
+static Scheduler_State_t states[SCHEDULER_JOB_COUNT];
+static TaskHandle_t schedulerTaskHandle = NULL;
+static uint32_t schedulerStack[SCHEDULER_STACK_SIZE];
+static osStaticThreadDef_t schedulerTcb;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Scheduler_Task(void const *argument);
+static void Scheduler_Run(uint8_t index, TickType_t now);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Start the scheduler task, which runs the periodic jobs
+ * @note   The phases count from this call
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status Scheduler_Init(void) {
+  TickType_t now = xTaskGetTickCount();
+
+  for (uint8_t i = 0; i < SCHEDULER_JOB_COUNT; i++) {
+    states[i].due = now + pdMS_TO_TICKS(jobs[i].phase_ms);
+  }
+
+  osThreadStaticDef(SchedulerTask, Scheduler_Task, SCHEDULER_PRIORITY, 0, SCHEDULER_STACK_SIZE,
+                    schedulerStack, &schedulerTcb);
+  schedulerTaskHandle = osThreadCreate(osThread(SchedulerTask), NULL);
+
+  if (schedulerTaskHandle == NULL) {
+    return VAL_ERROR;
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the run figures of all periodic jobs
+ * @param  stats: Array to store the job entries
+ * @param  max_jobs: Size of the array
+ * @retval uint8_t: Number of entries stored, in table order
+ */
+uint8_t Scheduler_GetJobs(Scheduler_JobStats_t* stats, uint8_t max_jobs) {
+  uint8_t count = 0;
+
+  if (stats == NULL) {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < SCHEDULER_JOB_COUNT && count < max_jobs; i++, count++) {
+    stats[count].name = jobs[i].name;
+    stats[count].period_ms = jobs[i].period_ms;
+
+    /* The figures of one run change together */
+    taskENTER_CRITICAL();
+    stats[count].runs = states[i].runs;
+    stats[count].skipped = states[i].skipped;
+    stats[count].total_us = states[i].total_us;
+    stats[count].max_us = states[i].max_us;
+    taskEXIT_CRITICAL();
+  }
+
+  return count;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Scheduler task, runs each job when it is due
+ * @param  argument: Not used
+ * @retval None
+ */
+static void Scheduler_Task(void const *argument) {
+  for (;;) {
+    TickType_t now = xTaskGetTickCount();
+    TickType_t wait = portMAX_DELAY;
+
+    /* Ticks wrap, so compare the distance to each due tick */
+    for (uint8_t i = 0; i < SCHEDULER_JOB_COUNT; i++) {
+      TickType_t left = states[i].due - now;
+
+      if ((int32_t)left <= 0) {
+        wait = 0;
+        break;
+      }
+      if (left < wait) {
+        wait = left;
+      }
+    }
+
+    if (wait > 0) {
+      vTaskDelay(wait);
+    }
+
+    Supervisor_Begin(SUPERVISOR_TASK_SCHEDULER);
+    now = xTaskGetTickCount();
+    for (uint8_t i = 0; i < SCHEDULER_JOB_COUNT; i++) {
+      if ((int32_t)(now - states[i].due) >= 0) {
+        Scheduler_Run(i, now);
+      }
+    }
+    Supervisor_End(SUPERVISOR_TASK_SCHEDULER);
+  }
+}
+
+/**
+ * @brief  Run a due job, record its time and set its next run
+ * @param  index: Job to run
+ * @param  now: Tick the task woke up at
+ * @retval None
+ */
+static void Scheduler_Run(uint8_t index, TickType_t now) {
+  const Scheduler_Job_t* job = &jobs[index];
+  Scheduler_State_t* state = &states[index];
+  TickType_t period = pdMS_TO_TICKS(job->period_ms);
+  uint32_t start = VAL_SysClock_GetMicros();
+
+  job->run();
+
+  uint32_t elapsed = VAL_SysClock_GetMicros() - start;
+  uint32_t missed = 0;
+
+  /* Keep the phase; runs missed by a whole period are dropped */
+  state->due += period;
+  if ((int32_t)(now - state->due) >= 0) {
+    missed = (now - state->due) / period + 1U;
+    state->due += missed * period;
+  }
+
+  taskENTER_CRITICAL();
+  state->runs++;
+  state->skipped += missed;
+  state->total_us += elapsed;
+  if (elapsed > state->max_us) {
+    state->max_us = elapsed;
+  }
+  taskEXIT_CRITICAL();
+}
@@ -0,0 +1,210 @@
+/**
+  ******************************************************************************
+  * @file    app_sequencer.c
+  * @brief   Application layer cue sequencer
+  ******************************************************************************
+  * @attention
+  *
+  * This module plays a list of cues uploaded by the host. Each cue sets a
+  * target per light at a time offset from the start of the pass, at once
+  * or as a fade. Passes play once or repeat with a fixed period.
+  *
+  * Cues are timed by the cue timer (val_timers.c), one alarm per cue at
+  * the pass start plus the cue offset. Times are absolute, so interrupt
+  * latency never adds up over a long sequence, and a cue that falls due
+  * while the previous one is still applied follows right after it. The
+  * cue is applied in the timer interrupt through the LED driver, which
+  * runs at the same priority as the ADC block interrupt that also drives it;
+  * all lights change in the same PWM period or start one fade together.
+  *
+  * The list can only change while stopped. While running, the sequence
+  * owns the outputs; the coordinator stops it before any host command
+  * that sets a light.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_sequencer.h"
+#include "app_led_driver.h"
+#include "val.h"
+#include "val_timers.h"
+
+/* Private variables ---------------------------------------------------------*/
+static Sequencer_Cue_t cues[SEQUENCER_MAX_CUES];
+static uint8_t cue_count = 0;
+
+/* Written by the task only while the cue interrupt is off */
+static volatile bool running = false;
+static volatile uint8_t next_cue = 0;
+static uint32_t period_us = 0;
+static uint32_t pass_start_us = 0;   /* Cue timer count at the start of the pass */
+static volatile uint32_t passes = 0;
+static volatile uint32_t late_max_us = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Sequencer_CueCallback(void);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Append a cue to the list
+ * @param  cue: Cue to add; offsets must not decrease along the list
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid or out of
+ *         order, VAL_ERROR if the list is full, VAL_BUSY while running
+ */
+VAL_Status Sequencer_AddCue(const Sequencer_Cue_t* cue) {
+  if (cue == NULL || cue->offset_us > SEQUENCER_MAX_TIME_US || cue->duration_ms > LED_DRIVER_FADE_MAX_MS ||
+      cue->curve >= LED_DRIVER_FADE_CURVE_COUNT) {
+    return VAL_PARAM;
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (cue->permille[i] > VAL_PWM_PERMILLE_MAX && cue->permille[i] != LED_DRIVER_PERMILLE_HOLD) {
+      return VAL_PARAM;
+    }
+  }
+
+  if (running) {
+    return VAL_BUSY;
+  }
+
+  if (cue_count > 0 && cue->offset_us < cues[cue_count - 1].offset_us) {
+    return VAL_PARAM;
+  }
+
+  if (cue_count >= SEQUENCER_MAX_CUES) {
+    return VAL_ERROR;
+  }
+
+  cues[cue_count++] = *cue;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Stop the sequence and empty the cue list
+ * @retval VAL_Status: VAL_OK
+ */
+VAL_Status Sequencer_Clear(void) {
+  Sequencer_Stop();
+  cue_count = 0;
+  passes = 0;
+  late_max_us = 0;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Play the cue list from the start
+ * @note   A running sequence restarts. The first pass starts now, so a cue
+ *         at offset 0 applies at once.
+ * @param  period: Time from the start of one pass to the next, 0 to play once
+ * @retval VAL_Status: VAL_OK if started, VAL_PARAM if the period does not
+ *         exceed the last cue offset or is too long, VAL_ERROR if the list
+ *         is empty or the timer failed
+ */
+VAL_Status Sequencer_Start(uint32_t period) {
+  if (cue_count == 0) {
+    return VAL_ERROR;
+  }
+
+  if (period != 0 && (period <= cues[cue_count - 1].offset_us || period > SEQUENCER_MAX_TIME_US)) {
+    return VAL_PARAM;
+  }
+
+  Sequencer_Stop();
+
+  period_us = period;
+  next_cue = 0;
+  passes = 0;
+  late_max_us = 0;
+
+  /* The timer counts from 0, the first pass starts with it */
+  pass_start_us = 0;
+  running = true;
+  if (VAL_Timers_StartCueTimer(Sequencer_CueCallback) != VAL_OK) {
+    running = false;
+    return VAL_ERROR;
+  }
+  VAL_Timers_SetCueAlarm(pass_start_us + cues[0].offset_us);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Stop the sequence; the lights keep their intensities
+ * @note   A transition already started runs to its end
+ * @retval VAL_Status: VAL_OK
+ */
+VAL_Status Sequencer_Stop(void) {
+  VAL_Timers_StopCueTimer();
+  running = false;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Check whether a sequence is playing
+ * @retval bool: true while running
+ */
+bool Sequencer_IsRunning(void) {
+  return running;
+}
+
+/**
+ * @brief  Get the sequencer state
+ * @param  status: Pointer to store the state
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status Sequencer_GetStatus(Sequencer_Status_t* status) {
+  uint32_t primask;
+
+  if (status == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  status->running = running;
+  status->cue_count = cue_count;
+  status->next_cue = next_cue;
+  status->period_us = period_us;
+  status->passes = passes;
+  status->late_max_us = late_max_us;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Apply the cue that fell due and arm the alarm for the next one
+ * @note   Called from the cue timer interrupt
+ * @retval None
+ */
+static void Sequencer_CueCallback(void) {
+  const Sequencer_Cue_t* cue = &cues[next_cue];
+  uint32_t late = VAL_Timers_GetCueTime() - (pass_start_us + cue->offset_us);
+
+  if (late > late_max_us) {
+    late_max_us = late;
+  }
+
+  /* Lights with an alarm are skipped by the driver */
+  (void)LED_Driver_FadeAllTo(cue->permille, cue->duration_ms, (LED_Driver_FadeCurve_t)cue->curve);
+
+  if (next_cue + 1U < cue_count) {
+    next_cue++;
+  } else if (period_us != 0) {
+    /* Counts wrap with the timer; the alarm compares the difference, which
+     * stays within SEQUENCER_MAX_TIME_US */
+    next_cue = 0;
+    pass_start_us += period_us;
+    passes++;
+  } else {
+    passes++;
+    Sequencer_Stop();
+    return;
+  }
+
+  VAL_Timers_SetCueAlarm(pass_start_us + cues[next_cue].offset_us);
+}
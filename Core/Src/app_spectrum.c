@@ -0,0 +1,239 @@
+/**
+  ******************************************************************************
+  * @file    app_spectrum.c
+  * @brief   Application layer spectrum analysis of sampled inputs
+  ******************************************************************************
+  * @attention
+  *
+  * A failing LED driver shows as a change in the ripple of its current
+  * long before the current itself is out of range: a dying output
+  * capacitor lets the switching ripple through, a loose connection adds
+  * noise. The analysis finds the largest tones of a block of samples
+  * taken at the scan rate, so they can be compared with those of a
+  * healthy unit.
+  *
+  * The block is centred on its average, scaled to the full Q15 range and
+  * multiplied by a Hann window, so that a tone between two bins still
+  * shows as one peak. A radix-2 complex FFT in Q15 follows, halving at
+  * every stage so that it cannot overflow; the twiddle factors come from
+  * half a cosine period built once in floating point. All of it runs in
+  * the calling task, the sampling interrupt only records the block.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_spectrum.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SPECTRUM_Q15_MAX    0x7FFF
+#define SPECTRUM_WINDOW_GAIN 4.0f   /* Tone amplitude per bin magnitude: two sides, Hann, 1/N */
+
+/* Private variables ---------------------------------------------------------*/
+static int16_t cosine[SPECTRUM_BINS + 1U];   /* cos(2 pi k / SPECTRUM_SIZE) in Q15 */
+static bool cosine_ready = false;
+static int16_t real[SPECTRUM_SIZE];
+static int16_t imaginary[SPECTRUM_SIZE];
+
+_Static_assert((SPECTRUM_SIZE & (SPECTRUM_SIZE - 1U)) == 0, "SPECTRUM_SIZE must be a power of two");
+
+/* Private function prototypes -----------------------------------------------*/
+static int32_t Spectrum_Cos(uint32_t k);
+static int32_t Spectrum_Sin(uint32_t k);
+static void Spectrum_Transform(void);
+static uint32_t Spectrum_Power(uint32_t bin);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Find the largest tones in a block of samples
+ * @param  samples: SPECTRUM_SIZE samples, evenly spaced, in counts
+ * @param  peaks: Largest peaks wanted (1-SPECTRUM_PEAKS_MAX)
+ * @param  result: Pointer to store the analysis
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status Spectrum_Analyze(const uint16_t* samples, uint8_t peaks, Spectrum_Result_t* result) {
+  uint32_t powers[SPECTRUM_PEAKS_MAX];
+  uint32_t sum = 0;
+  int64_t deviation_sum = 0;
+  int64_t deviation_squares = 0;
+  int32_t deviation_max = 0;
+  int8_t shift = 0;
+
+  if (samples == NULL || result == NULL || peaks == 0 || peaks > SPECTRUM_PEAKS_MAX) {
+    return VAL_PARAM;
+  }
+
+  if (!cosine_ready) {
+    for (uint32_t k = 0; k <= SPECTRUM_BINS; k++) {
+      cosine[k] = (int16_t)lrintf(SPECTRUM_Q15_MAX * cosf(6.28318531f * (float)k / (float)SPECTRUM_SIZE));
+    }
+    cosine_ready = true;
+  }
+
+  /* Deviations from the rounded average keep the sums exact */
+  for (uint32_t n = 0; n < SPECTRUM_SIZE; n++) {
+    sum += samples[n];
+  }
+  int32_t mean = (int32_t)((sum + SPECTRUM_SIZE / 2U) / SPECTRUM_SIZE);
+
+  for (uint32_t n = 0; n < SPECTRUM_SIZE; n++) {
+    int32_t deviation = (int32_t)samples[n] - mean;
+    int32_t magnitude = (deviation < 0) ? -deviation : deviation;
+
+    deviation_sum += deviation;
+    deviation_squares += (int64_t)deviation * deviation;
+    if (magnitude > deviation_max) {
+      deviation_max = magnitude;
+    }
+  }
+
+  float offset = (float)deviation_sum / (float)SPECTRUM_SIZE;
+  float variance = (float)deviation_squares / (float)SPECTRUM_SIZE - offset * offset;
+
+  result->mean = (float)mean + offset;
+  result->ripple_rms = (variance > 0.0f) ? sqrtf(variance) : 0.0f;
+  result->peak_count = 0;
+
+  /* A flat block has no tones */
+  if (deviation_max == 0) {
+    return VAL_OK;
+  }
+
+  /* Scale the largest deviation into the top bit of Q15 */
+  while (deviation_max > SPECTRUM_Q15_MAX) {
+    deviation_max >>= 1;
+    shift--;
+  }
+  while ((deviation_max << 1) <= SPECTRUM_Q15_MAX) {
+    deviation_max <<= 1;
+    shift++;
+  }
+
+  for (uint32_t n = 0; n < SPECTRUM_SIZE; n++) {
+    int32_t deviation = (int32_t)samples[n] - mean;
+    int32_t scaled = (shift >= 0) ? (deviation << shift) : (deviation >> -shift);
+    int32_t window = (SPECTRUM_Q15_MAX - Spectrum_Cos(n) + 1) >> 1;
+
+    real[n] = (int16_t)((scaled * window) >> 15);
+    imaginary[n] = 0;
+  }
+
+  Spectrum_Transform();
+
+  /* Local maxima above DC, kept largest first */
+  for (uint32_t bin = 1; bin < SPECTRUM_BINS; bin++) {
+    uint32_t power = Spectrum_Power(bin);
+    uint8_t at;
+
+    if (power == 0 || power <= Spectrum_Power(bin - 1U) || power < Spectrum_Power(bin + 1U)) {
+      continue;
+    }
+
+    at = result->peak_count;
+    while (at > 0 && powers[at - 1U] < power) {
+      at--;
+    }
+    if (at >= peaks) {
+      continue;
+    }
+    for (uint8_t i = (result->peak_count < peaks) ? result->peak_count : (uint8_t)(peaks - 1U); i > at; i--) {
+      powers[i] = powers[i - 1U];
+      result->peaks[i] = result->peaks[i - 1U];
+    }
+    powers[at] = power;
+    result->peaks[at].bin = (uint16_t)bin;
+    if (result->peak_count < peaks) {
+      result->peak_count++;
+    }
+  }
+
+  for (uint8_t i = 0; i < result->peak_count; i++) {
+    result->peaks[i].amplitude = ldexpf(SPECTRUM_WINDOW_GAIN * sqrtf((float)powers[i]), -shift);
+  }
+
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Cosine of a multiple of the fundamental
+ * @param  k: Multiple (0 to SPECTRUM_SIZE - 1)
+ * @retval int32_t: cos(2 pi k / SPECTRUM_SIZE) in Q15
+ */
+static int32_t Spectrum_Cos(uint32_t k) {
+  return cosine[(k <= SPECTRUM_BINS) ? k : SPECTRUM_SIZE - k];
+}
+
+/**
+ * @brief  Sine of a multiple of the fundamental
+ * @param  k: Multiple (0 to SPECTRUM_BINS - 1)
+ * @retval int32_t: sin(2 pi k / SPECTRUM_SIZE) in Q15
+ */
+static int32_t Spectrum_Sin(uint32_t k) {
+  uint32_t quarter = SPECTRUM_SIZE / 4U;
+
+  return cosine[(k < quarter) ? quarter - k : k - quarter];
+}
+
+/**
+ * @brief  Transform real and imaginary in place
+ * @note   Each stage halves, so the bins are the DFT over SPECTRUM_SIZE
+ * @retval None
+ */
+static void Spectrum_Transform(void) {
+  /* Bit-reversed order first */
+  for (uint32_t n = 1, j = 0; n < SPECTRUM_SIZE; n++) {
+    uint32_t bit = SPECTRUM_SIZE >> 1;
+
+    while (j & bit) {
+      j ^= bit;
+      bit >>= 1;
+    }
+    j |= bit;
+
+    if (n < j) {
+      int16_t swap = real[n];
+      real[n] = real[j];
+      real[j] = swap;
+      swap = imaginary[n];
+      imaginary[n] = imaginary[j];
+      imaginary[j] = swap;
+    }
+  }
+
+  for (uint32_t length = 2; length <= SPECTRUM_SIZE; length <<= 1) {
+    uint32_t half = length >> 1;
+    uint32_t step = SPECTRUM_SIZE / length;
+
+    for (uint32_t k = 0; k < half; k++) {
+      /* e^(-j 2 pi k / length) */
+      int32_t twiddle_real = Spectrum_Cos(k * step);
+      int32_t twiddle_imaginary = -Spectrum_Sin(k * step);
+
+      for (uint32_t i = k; i < SPECTRUM_SIZE; i += length) {
+        uint32_t j = i + half;
+        int32_t product_real = (real[j] * twiddle_real - imaginary[j] * twiddle_imaginary) >> 15;
+        int32_t product_imaginary = (real[j] * twiddle_imaginary + imaginary[j] * twiddle_real) >> 15;
+
+        real[j] = (int16_t)((real[i] - product_real) >> 1);
+        imaginary[j] = (int16_t)((imaginary[i] - product_imaginary) >> 1);
+        real[i] = (int16_t)((real[i] + product_real) >> 1);
+        imaginary[i] = (int16_t)((imaginary[i] + product_imaginary) >> 1);
+      }
+    }
+  }
+}
+
+/**
+ * @brief  Squared magnitude of a transformed bin
+ * @param  bin: Bin (0 to SPECTRUM_BINS)
+ * @retval uint32_t: Real squared plus imaginary squared
+ */
+static uint32_t Spectrum_Power(uint32_t bin) {
+  return (uint32_t)(real[bin] * real[bin]) + (uint32_t)(imaginary[bin] * imaginary[bin]);
+}
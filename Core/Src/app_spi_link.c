@@ -0,0 +1,695 @@
+/**
+  ******************************************************************************
+  * @file    app_spi_link.c
+  * @brief   Application layer SPI slave control link
+  ******************************************************************************
+  * @attention
+  *
+  * A host MCU next to the board drives it over SPI1 as a set of registers
+  * (app_spi_link.h), with the host protocol as one of them, on boards whose
+  * profile wires the link (val_board.h). It is then the transport the
+  * protocol runs over (TRANSPORT_SPI): SPI_LINK_REG_MESSAGE carries the
+  * same JSON, binary or CBOR messages as the UART, into the same parser,
+  * and the replies and events the protocol queues wait there for the host
+  * to read them. Without such a profile none of this module is built.
+  *
+  * Each NSS-framed transaction starts with a register byte. A write
+  * carries its data in the rest of the transaction. A read only selects
+  * the register: its data is prepared when the transaction ends and comes
+  * out in the next one, after a status byte and the data length. Every
+  * reply starts with the status, so one transaction both issues a command
+  * and collects the result of the previous one.
+  *
+  * The transactions are served in the NSS interrupt (val_spi_slave.c), as
+  * the Modbus requests are in the UART one: a read takes one snapshot of
+  * the published light state (SYS_Coordinator_GetSnapshot, a seqlock that
+  * never blocks), and intensity writes and alarm clears are queued to the
+  * coordinator task, so a reply is ready within microseconds whatever the
+  * tasks are doing. SPI_LINK_REG_STAGE holds intensities here until
+  * SPI_LINK_REG_COMMIT queues them as one command, applied in the same PWM
+  * period.
+  *
+  * The message and event registers are consumed as far as the host clocks
+  * them out: what it did not clock before raising NSS stays for the next
+  * read. The coordinator task queues an event for each alarm change and
+  * each derate move of SPI_LINK_DERATE_STEP, and the IRQ output is
+  * asserted while events or messages wait.
+  *
+  * The link keeps the MCU out of stop mode and at its high clock level
+  * (app_power.c), as a slave cannot tell when the host will clock.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_spi_link.h"
+
+#if VAL_SPI_SLAVE_ENABLED
+
+#include "app_sys_coordinator.h"
+#include "val.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SPI_LINK_MESSAGE_RING     1024U   /* Bytes, as the UART transmit ring */
+#define SPI_LINK_EVENT_FIFO       32U     /* Events */
+#define SPI_LINK_DERATE_STEP      10U     /* Permille a derate moves before it is an event */
+#define SPI_LINK_DERATE_NONE      1000U   /* Derate factor of a light at full output */
+#define SPI_LINK_DATA_MAX         (VAL_SPI_SLAVE_FRAME_MAX - SPI_LINK_REPLY_HEADER)
+#define SPI_LINK_NO_READ          0xFFU
+
+_Static_assert(SPI_LINK_DATA_MAX <= UINT8_MAX, "Data length is one byte");
+_Static_assert(4U + SPI_LINK_SNAPSHOT_LIGHT * VAL_LIGHT_COUNT <= SPI_LINK_DATA_MAX, "Snapshot exceeds a transaction");
+_Static_assert(VAL_LIGHT_COUNT <= 32U, "Alarm clear mask is 32 bits");
+
+/* Private variables ---------------------------------------------------------*/
+static Transport_RxCallback_t rx_callback = NULL;
+static Transport_TxCallback_t tx_callback = NULL;
+static bool link_active = false;
+
+/* Messages queued by the protocol, read out of SPI_LINK_REG_MESSAGE */
+static uint8_t message_ring[SPI_LINK_MESSAGE_RING];
+static volatile uint16_t message_head = 0;   /* Next byte to read out */
+static volatile uint16_t message_count = 0;
+static volatile uint32_t tx_queued = 0;
+static volatile uint32_t tx_sent = 0;
+
+/* Events, queued by the coordinator task and popped in the NSS interrupt */
+static uint8_t events[SPI_LINK_EVENT_FIFO][SPI_LINK_EVENT_SIZE];
+static volatile uint8_t event_head = 0;
+static volatile uint8_t event_count = 0;
+static volatile bool event_overflow = false;
+static uint8_t last_alarms[VAL_LIGHT_COUNT];
+static uint16_t last_derate[VAL_LIGHT_COUNT];
+
+/* Staged intensities, NSS interrupt only */
+static uint16_t staged[VAL_LIGHT_COUNT];
+static uint32_t staged_mask = 0;
+
+/* Read selected by the last transaction, its data in the reply being clocked */
+static uint8_t pending_register = SPI_LINK_NO_READ;
+static uint16_t pending_length = 0;
+static bool refused = false;
+
+static volatile uint32_t refused_count = 0;
+static volatile uint32_t events_dropped = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t SpiLink_Transaction(const uint8_t* rx, uint16_t length, bool lost, uint8_t* reply, uint16_t max);
+static void SpiLink_Consume(uint16_t clocked);
+static bool SpiLink_Write(uint8_t reg, const uint8_t* data, uint16_t length);
+static bool SpiLink_GetPermille(const uint8_t* data, uint16_t length, uint16_t* values, uint8_t* count);
+static int32_t SpiLink_Read(uint8_t reg, uint8_t wanted, uint8_t* data, uint16_t max);
+static uint16_t SpiLink_ReadMessage(uint8_t* data, uint16_t max);
+static uint8_t SpiLink_Status(void);
+static void SpiLink_PushEvent(uint8_t type, uint8_t light, uint16_t value);
+static void SpiLink_UpdateIrq(void);
+static void SpiLink_Put16(uint8_t* data, uint16_t value);
+static void SpiLink_Put32(uint8_t* data, uint32_t value);
+static uint16_t SpiLink_Clamp(int32_t value, int32_t min, int32_t max);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Start the SPI slave link, transport init of TRANSPORT_SPI
+ * @param  callback: Called with the bytes written to SPI_LINK_REG_MESSAGE
+ * @retval VAL_Status: As VAL_SpiSlave_Init
+ */
+VAL_Status SpiLink_Init(Transport_RxCallback_t callback) {
+  VAL_Status status;
+
+  rx_callback = callback;
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    last_derate[i] = SPI_LINK_DERATE_NONE;
+  }
+  status = VAL_SpiSlave_Init(SpiLink_Transaction);
+  link_active = (status == VAL_OK);
+
+  return status;
+}
+
+/**
+ * @brief  Set the function called when the host has read queued bytes
+ * @param  callback: Function to call from interrupt context, or NULL
+ * @retval None
+ */
+void SpiLink_SetTxCallback(Transport_TxCallback_t callback) {
+  tx_callback = callback;
+}
+
+/**
+ * @brief  Queue a message for SPI_LINK_REG_MESSAGE, without waiting
+ * @note   Safe to call from tasks and interrupts; the message is copied
+ * @param  segments: Buffers of the message, in order
+ * @param  count: Number of segments
+ * @retval VAL_Status: VAL_OK if queued, VAL_BUSY if there is no room for it yet,
+ *         VAL_PARAM for invalid arguments
+ */
+VAL_Status SpiLink_SendSegments(const VAL_Serial_Segment_t* segments, uint8_t count) {
+  uint32_t total = 0;
+  uint32_t primask;
+  uint16_t tail;
+
+  if (segments == NULL || count == 0) {
+    return VAL_PARAM;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    total += segments[i].length;
+  }
+  if (total == 0 || total > SPI_LINK_MESSAGE_RING) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  if ((SPI_LINK_MESSAGE_RING - message_count) < total) {
+    __set_PRIMASK(primask);
+    return VAL_BUSY;
+  }
+
+  tail = (uint16_t)((message_head + message_count) % SPI_LINK_MESSAGE_RING);
+  for (uint8_t i = 0; i < count; i++) {
+    const uint8_t* data = segments[i].data;
+
+    for (uint16_t j = 0; j < segments[i].length; j++) {
+      message_ring[tail] = data[j];
+      tail = (uint16_t)((tail + 1U) % SPI_LINK_MESSAGE_RING);
+    }
+  }
+  message_count = (uint16_t)(message_count + total);
+  tx_queued += total;
+  SpiLink_UpdateIrq();
+
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the longest message that can be queued
+ * @retval uint16_t: Bytes
+ */
+uint16_t SpiLink_GetMtu(void) {
+  return SPI_LINK_MESSAGE_RING;
+}
+
+/**
+ * @brief  Check whether queued bytes wait for the host
+ * @retval bool: true until the host has read them all
+ */
+bool SpiLink_IsBusy(void) {
+  return message_count != 0;
+}
+
+/**
+ * @brief  Get the time since the last transaction
+ * @retval uint32_t: Milliseconds
+ */
+uint32_t SpiLink_GetIdleTime(void) {
+  return VAL_SpiSlave_GetIdleTime();
+}
+
+/**
+ * @brief  Wait until the host has read everything queued
+ * @note   Task context; the host reads at its own pace
+ * @param  timeout: Maximum time to wait in milliseconds
+ * @retval VAL_Status: VAL_OK if read, VAL_TIMEOUT otherwise
+ */
+VAL_Status SpiLink_Flush(uint32_t timeout) {
+  TickType_t start = xTaskGetTickCount();
+
+  while (message_count != 0) {
+    if ((uint32_t)(xTaskGetTickCount() - start) * portTICK_PERIOD_MS >= timeout) {
+      return VAL_TIMEOUT;
+    }
+    vTaskDelay(1);
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Get the number of bytes queued since start-up
+ * @retval uint32_t: Bytes, wrapping
+ */
+uint32_t SpiLink_GetTxQueued(void) {
+  return tx_queued;
+}
+
+/**
+ * @brief  Get the number of bytes the host has read since start-up
+ * @retval uint32_t: Bytes, wrapping
+ */
+uint32_t SpiLink_GetTxSent(void) {
+  return tx_sent;
+}
+
+/**
+ * @brief  Queue events for the alarm and derate changes of the last publication
+ * @note   Called from the coordinator task on every wakeup
+ * @retval None
+ */
+void SpiLink_Poll(void) {
+  SYS_Coordinator_Snapshot_t snapshot;
+
+  if (!link_active || SYS_Coordinator_GetSnapshot(&snapshot) != VAL_OK) {
+    return;
+  }
+
+  taskENTER_CRITICAL();
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    uint16_t derate = snapshot.derate[i];
+    uint16_t moved = (derate > last_derate[i]) ? (uint16_t)(derate - last_derate[i])
+                                               : (uint16_t)(last_derate[i] - derate);
+
+    if (snapshot.alarms[i] != last_alarms[i]) {
+      last_alarms[i] = snapshot.alarms[i];
+      SpiLink_PushEvent(SPI_LINK_EVENT_ALARM, (uint8_t)(i + 1U), last_alarms[i]);
+    }
+    /* Full output is reported however small the last step */
+    if (moved >= SPI_LINK_DERATE_STEP || (moved != 0 && derate == SPI_LINK_DERATE_NONE)) {
+      last_derate[i] = derate;
+      SpiLink_PushEvent(SPI_LINK_EVENT_DERATE, (uint8_t)(i + 1U), derate);
+    }
+  }
+  SpiLink_UpdateIrq();
+  taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief  Check whether the SPI slave link has been started
+ * @retval bool: true once started
+ */
+bool SpiLink_IsActive(void) {
+  return link_active;
+}
+
+/**
+ * @brief  Get the link counts
+ * @param  stats: Pointer to store them
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if stats is NULL
+ */
+VAL_Status SpiLink_GetStats(SpiLink_Stats_t* stats) {
+  if (stats == NULL) {
+    return VAL_PARAM;
+  }
+
+  stats->transactions = VAL_SpiSlave_GetTransactionCount();
+  stats->lost = VAL_SpiSlave_GetErrorCount();
+  stats->refused = refused_count;
+  stats->events_dropped = events_dropped;
+  stats->max_turnaround_us = VAL_SpiSlave_GetMaxTurnaroundUs();
+
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Serve a transaction, called from the NSS interrupt as it ends
+ * @param  rx: Bytes the host sent
+ * @param  length: Bytes clocked, of rx and of the last reply
+ * @param  lost: The transaction overran the buffer
+ * @param  reply: Buffer for the reply of the next transaction
+ * @param  max: Size of reply
+ * @retval uint16_t: Reply length
+ */
+static uint16_t SpiLink_Transaction(const uint8_t* rx, uint16_t length, bool lost, uint8_t* reply, uint16_t max) {
+  uint8_t reg = SPI_LINK_NO_READ;
+  int32_t data_length = 0;
+
+  /* The host has what it clocked of the last reply */
+  SpiLink_Consume(length);
+  refused = false;
+
+  if (length != 0 && !lost) {
+    reg = rx[0] & (uint8_t)~SPI_LINK_READ;
+    if (rx[0] & SPI_LINK_READ) {
+      data_length = SpiLink_Read(reg, (length > 1U) ? rx[1] : 0U, &reply[SPI_LINK_REPLY_HEADER],
+                                 max - SPI_LINK_REPLY_HEADER);
+      if (data_length < 0) {
+        refused = true;
+        data_length = 0;
+      }
+    } else {
+      refused = !SpiLink_Write(reg, &rx[1], (uint16_t)(length - 1U));
+      reg = SPI_LINK_NO_READ;
+    }
+  }
+  if (refused) {
+    refused_count++;
+    reg = SPI_LINK_NO_READ;
+  }
+
+  pending_register = reg;
+  pending_length = (uint16_t)data_length;
+
+  reply[0] = SpiLink_Status() | (lost ? SPI_LINK_STATUS_LOST : 0U);
+  reply[1] = (uint8_t)data_length;
+  SpiLink_UpdateIrq();
+
+  return (uint16_t)(SPI_LINK_REPLY_HEADER + data_length);
+}
+
+/**
+ * @brief  Drop what the host read of the message and event registers
+ * @param  clocked: Bytes of the last reply the host clocked out
+ * @retval None
+ */
+static void SpiLink_Consume(uint16_t clocked) {
+  uint16_t delivered;
+
+  if (pending_register == SPI_LINK_NO_READ || clocked <= SPI_LINK_REPLY_HEADER) {
+    return;
+  }
+
+  delivered = (uint16_t)(clocked - SPI_LINK_REPLY_HEADER);
+  if (delivered > pending_length) {
+    delivered = pending_length;
+  }
+
+  if (pending_register == SPI_LINK_REG_MESSAGE && delivered != 0) {
+    message_head = (uint16_t)((message_head + delivered) % SPI_LINK_MESSAGE_RING);
+    message_count = (uint16_t)(message_count - delivered);
+    tx_sent += delivered;
+    if (tx_callback != NULL) {
+      tx_callback();
+    }
+  } else if (pending_register == SPI_LINK_REG_EVENTS) {
+    uint8_t popped = (uint8_t)(delivered / SPI_LINK_EVENT_SIZE);
+
+    event_head = (uint8_t)((event_head + popped) % SPI_LINK_EVENT_FIFO);
+    event_count = (uint8_t)(event_count - popped);
+    event_overflow = false;
+  }
+}
+
+/**
+ * @brief  Carry out a register write
+ * @param  reg: Register
+ * @param  data: Bytes after the register byte
+ * @param  length: Bytes in data
+ * @retval bool: false if refused
+ */
+static bool SpiLink_Write(uint8_t reg, const uint8_t* data, uint16_t length) {
+  uint16_t values[VAL_LIGHT_COUNT];
+  uint8_t count;
+
+  switch (reg) {
+    case SPI_LINK_REG_PERMILLE:
+      if (!SpiLink_GetPermille(data, length, values, &count)) {
+        return false;
+      }
+      /* Lights 1 to count change in the same PWM period */
+      return SYS_Coordinator_SetMaskedLightPermilleFromISR((1UL << count) - 1UL, values, count) == VAL_OK;
+
+    case SPI_LINK_REG_STAGE:
+      if (!SpiLink_GetPermille(data, length, values, &count)) {
+        return false;
+      }
+      memcpy(staged, values, count * sizeof(values[0]));
+      staged_mask |= (1UL << count) - 1UL;
+      return true;
+
+    case SPI_LINK_REG_COMMIT:
+      if (length != 0) {
+        return false;
+      }
+      if (staged_mask == 0) {
+        return true;
+      }
+      count = 0;
+      for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        if (staged_mask & (1UL << i)) {
+          values[count++] = staged[i];
+        }
+      }
+      if (SYS_Coordinator_SetMaskedLightPermilleFromISR(staged_mask, values, count) != VAL_OK) {
+        return false;
+      }
+      staged_mask = 0;
+      return true;
+
+    case SPI_LINK_REG_ALARMS: {
+      uint32_t mask;
+
+      if (length != 4U) {
+        return false;
+      }
+      mask = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+      if (mask >> VAL_LIGHT_COUNT) {
+        return false;
+      }
+      return (mask == 0) || SYS_Coordinator_ClearLightAlarmsFromISR(mask) == VAL_OK;
+    }
+
+    case SPI_LINK_REG_MESSAGE:
+      if (length != 0 && rx_callback != NULL) {
+        rx_callback(data, length);
+      }
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief  Decode the intensities of a permille or stage write
+ * @param  data: Two bytes per light from light 1, big-endian
+ * @param  length: Bytes in data
+ * @param  values: Array of VAL_LIGHT_COUNT to store them
+ * @param  count: Pointer to store the number of lights written
+ * @retval bool: false for a bad length or a value above 1000
+ */
+static bool SpiLink_GetPermille(const uint8_t* data, uint16_t length, uint16_t* values, uint8_t* count) {
+  if (length == 0 || (length & 1U) != 0 || length > 2U * VAL_LIGHT_COUNT) {
+    return false;
+  }
+
+  *count = (uint8_t)(length / 2U);
+  for (uint8_t i = 0; i < *count; i++) {
+    values[i] = (uint16_t)((data[2U * i] << 8) | data[2U * i + 1U]);
+    if (values[i] > VAL_PWM_PERMILLE_MAX) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief  Prepare the data of a register read
+ * @param  reg: Register
+ * @param  wanted: Bytes the host asked for, 0 for all
+ * @param  data: Buffer for the data
+ * @param  max: Size of data
+ * @retval int32_t: Data length, -1 for an unknown register
+ */
+static int32_t SpiLink_Read(uint8_t reg, uint8_t wanted, uint8_t* data, uint16_t max) {
+  SYS_Coordinator_Snapshot_t snapshot;
+  uint16_t length = 0;
+
+  if (wanted != 0 && wanted < max) {
+    max = wanted;
+  }
+
+  switch (reg) {
+    case SPI_LINK_REG_INFO:
+      data[0] = SPI_LINK_VERSION;
+      data[1] = VAL_LIGHT_COUNT;
+      SpiLink_Put16(&data[2], VAL_SPI_SLAVE_FRAME_MAX);
+      SpiLink_Put16(&data[4], SPI_LINK_MESSAGE_RING);
+      length = 6U;
+      break;
+
+    case SPI_LINK_REG_STATS:
+      SpiLink_Put32(&data[0], VAL_SpiSlave_GetTransactionCount());
+      SpiLink_Put32(&data[4], VAL_SpiSlave_GetErrorCount());
+      SpiLink_Put32(&data[8], refused_count);
+      SpiLink_Put32(&data[12], events_dropped);
+      SpiLink_Put32(&data[16], VAL_SpiSlave_GetMaxTurnaroundUs());
+      length = 20U;
+      break;
+
+    case SPI_LINK_REG_PERMILLE:
+    case SPI_LINK_REG_STAGE:
+      SYS_Coordinator_GetSnapshot(&snapshot);
+      for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        bool held = (reg == SPI_LINK_REG_STAGE) && (staged_mask & (1UL << i));
+
+        SpiLink_Put16(&data[2U * i], held ? staged[i] : snapshot.permille[i]);
+      }
+      length = 2U * VAL_LIGHT_COUNT;
+      break;
+
+    case SPI_LINK_REG_SNAPSHOT:
+      /* One publication for the whole read */
+      SYS_Coordinator_GetSnapshot(&snapshot);
+      SpiLink_Put32(&data[0], snapshot.sequence);
+      for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        uint8_t* light = &data[4U + SPI_LINK_SNAPSHOT_LIGHT * i];
+        float temperature = snapshot.sensors[i].temperature;
+
+        SpiLink_Put16(&light[0], snapshot.permille[i]);
+        SpiLink_Put16(&light[2], SpiLink_Clamp((int32_t)(snapshot.sensors[i].current + 0.5f), 0, UINT16_MAX));
+        SpiLink_Put16(&light[4], SpiLink_Clamp((int32_t)(temperature * 10.0f + ((temperature < 0.0f) ? -0.5f : 0.5f)),
+                                               INT16_MIN, INT16_MAX));
+        SpiLink_Put16(&light[6], snapshot.derate[i]);
+        light[8] = snapshot.alarms[i];
+        light[9] = 0;
+      }
+      length = 4U + SPI_LINK_SNAPSHOT_LIGHT * VAL_LIGHT_COUNT;
+      break;
+
+    case SPI_LINK_REG_ALARMS:
+      SYS_Coordinator_GetSnapshot(&snapshot);
+      memcpy(data, snapshot.alarms, VAL_LIGHT_COUNT);
+      length = VAL_LIGHT_COUNT;
+      break;
+
+    case SPI_LINK_REG_EVENTS:
+      /* Whole events only; they stay queued until clocked out */
+      for (uint8_t i = 0; i < event_count && length + SPI_LINK_EVENT_SIZE <= max; i++) {
+        memcpy(&data[length], events[(event_head + i) % SPI_LINK_EVENT_FIFO], SPI_LINK_EVENT_SIZE);
+        length += SPI_LINK_EVENT_SIZE;
+      }
+      return length;
+
+    case SPI_LINK_REG_MESSAGE:
+      return SpiLink_ReadMessage(data, max);
+
+    default:
+      return -1;
+  }
+
+  return (length < max) ? length : max;
+}
+
+/**
+ * @brief  Copy out queued protocol bytes, leaving them queued
+ * @param  data: Buffer for the bytes
+ * @param  max: Size of data
+ * @retval uint16_t: Bytes copied
+ */
+static uint16_t SpiLink_ReadMessage(uint8_t* data, uint16_t max) {
+  uint32_t primask = __get_PRIMASK();
+  uint16_t length;
+  uint16_t first;
+
+  __disable_irq();
+  length = (message_count < max) ? message_count : max;
+  first = (uint16_t)(SPI_LINK_MESSAGE_RING - message_head);
+  if (first > length) {
+    first = length;
+  }
+  memcpy(data, &message_ring[message_head], first);
+  memcpy(&data[first], message_ring, length - first);
+  __set_PRIMASK(primask);
+
+  return length;
+}
+
+/**
+ * @brief  Build the status byte of a reply
+ * @retval uint8_t: SPI_LINK_STATUS_* bits
+ */
+static uint8_t SpiLink_Status(void) {
+  uint8_t status = 0;
+
+  if (event_count != 0) {
+    status |= SPI_LINK_STATUS_EVENTS;
+  }
+  if (message_count != 0) {
+    status |= SPI_LINK_STATUS_MESSAGE;
+  }
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (last_alarms[i] != 0) {
+      status |= SPI_LINK_STATUS_ALARM;
+    }
+  }
+  if (refused) {
+    status |= SPI_LINK_STATUS_ERROR;
+  }
+  if (event_overflow) {
+    status |= SPI_LINK_STATUS_OVERFLOW;
+  }
+
+  return status;
+}
+
+/**
+ * @brief  Queue an event, dropping it if the FIFO is full
+ * @note   Called with the NSS interrupt masked
+ * @param  type: SPI_LINK_EVENT_*
+ * @param  light: Light ID
+ * @param  value: Event value
+ * @retval None
+ */
+static void SpiLink_PushEvent(uint8_t type, uint8_t light, uint16_t value) {
+  uint8_t* event;
+
+  if (event_count >= SPI_LINK_EVENT_FIFO) {
+    event_overflow = true;
+    events_dropped++;
+    return;
+  }
+
+  event = events[(event_head + event_count) % SPI_LINK_EVENT_FIFO];
+  event[0] = type;
+  event[1] = light;
+  SpiLink_Put16(&event[2], value);
+  event_count++;
+}
+
+/**
+ * @brief  Assert the IRQ output while events or messages wait
+ * @retval None
+ */
+static void SpiLink_UpdateIrq(void) {
+  VAL_SpiSlave_SetIrq(event_count != 0 || message_count != 0);
+}
+
+/**
+ * @brief  Store a big-endian 16-bit value
+ * @param  data: Two bytes, high first
+ * @param  value: Value
+ * @retval None
+ */
+static void SpiLink_Put16(uint8_t* data, uint16_t value) {
+  data[0] = (uint8_t)(value >> 8);
+  data[1] = (uint8_t)value;
+}
+
+/**
+ * @brief  Store a big-endian 32-bit value
+ * @param  data: Four bytes, high first
+ * @param  value: Value
+ * @retval None
+ */
+static void SpiLink_Put32(uint8_t* data, uint32_t value) {
+  SpiLink_Put16(&data[0], (uint16_t)(value >> 16));
+  SpiLink_Put16(&data[2], (uint16_t)value);
+}
+
+/**
+ * @brief  Limit a value to a 16-bit field
+ * @param  value: Value to limit
+ * @param  min: Lowest value, negative for a signed field
+ * @param  max: Highest value
+ * @retval uint16_t: Field contents, two's complement if signed
+ */
+static uint16_t SpiLink_Clamp(int32_t value, int32_t min, int32_t max) {
+  if (value < min) {
+    value = min;
+  } else if (value > max) {
+    value = max;
+  }
+
+  return (uint16_t)value;
+}
+
+#endif /* VAL_SPI_SLAVE_ENABLED */
@@ -0,0 +1,295 @@
+/**
+  ******************************************************************************
+  * @file    app_supervisor.c
+  * @brief   Application layer task deadline supervision
+  ******************************************************************************
+  * @attention
+  *
+  * Every long-lived task brackets each work item, from the return of its
+  * blocking wait to its next wait, with Supervisor_Begin and
+  * Supervisor_End. A work item longer than the task's deadline is a
+  * performance bug: it is counted, and logged as a warning with the time
+  * over the deadline.
+  *
+  * The FreeRTOS tick hook checks the tasks every SUPERVISOR_CHECK_MS and
+  * refreshes the independent watchdog as long as no work item has run past
+  * its task's limit. A task over its limit is taken to be stuck: the task
+  * and its time over the deadline are recorded in RAM2, which the startup
+  * code does not initialize, and the watchdog is left to reset the MCU.
+  * If interrupts stop altogether, the watchdog resets with no record.
+  *
+  * The record is written to the error log after the restart, once the data
+  * store runs again; flash is not written by a system that has stalled.
+  *
+  * The watchdog keeps counting during stop mode, in which the tick does
+  * not run, so SUPERVISOR_WATCHDOG_MS is above VAL_LOW_POWER_MAX_STOP_MS.
+  * The deadlines hold at the 4 MHz clock level too.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_supervisor.h"
+#include "app_logger.h"
+#include "app_sys_coordinator.h"
+#include "app_counters.h"
+#include "val.h"
+#include "val_watchdog.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SUPERVISOR_CHECK_MS       10           /* Tick hook check period */
+#define SUPERVISOR_RECORD_MAGIC   0x4B545344U  /* "DSTK" */
+
+#if SUPERVISOR_WATCHDOG_MS <= VAL_LOW_POWER_MAX_STOP_MS + SUPERVISOR_CHECK_MS
+#error "SUPERVISOR_WATCHDOG_MS must cover the longest stop"
+#endif
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  const char* name;
+  uint32_t deadline_ms;
+  uint32_t limit_ms;
+} Supervisor_Budget_t;
+
+typedef struct {
+  uint32_t magic;            /* SUPERVISOR_RECORD_MAGIC if valid */
+  uint32_t task;             /* Supervisor_Task_t over its limit */
+  uint32_t over_ms;          /* Time past its deadline at the last check */
+} Supervisor_Record_t;
+
+/* Private variables ---------------------------------------------------------*/
+/* Limits allow for a response waiting on the TX pool at a low baud rate
+ * and for page erases, which stall the CPU */
+static const Supervisor_Budget_t budgets[SUPERVISOR_TASK_COUNT] = {
+  [SUPERVISOR_TASK_COORDINATOR] = { "coordinator",  50, 2000 },
+  [SUPERVISOR_TASK_COMMS]       = { "comms",       100, 3000 },
+  [SUPERVISOR_TASK_WORKER]      = { "worker",      250, 3000 },
+  [SUPERVISOR_TASK_LOGGER]      = { "logger",      100, 3000 },
+  [SUPERVISOR_TASK_ERROR_LOG]   = { "error_log",   250, 3000 },
+  [SUPERVISOR_TASK_SCHEDULER]   = { "scheduler",    10, 1000 },
+};
+
+/* Survives the watchdog reset */
+static Supervisor_Record_t reset_record __attribute__((section(".noinit")));
+
+/* Record taken over at start-up */
+static Supervisor_Reset_t last_reset = { false, SUPERVISOR_TASK_COUNT, 0 };
+
+/* Written by the task, read by the tick hook */
+static volatile uint32_t work_start[SUPERVISOR_TASK_COUNT];
+static volatile bool work_busy[SUPERVISOR_TASK_COUNT];
+
+static Supervisor_Stats_t stats[SUPERVISOR_TASK_COUNT];
+static volatile bool watchdog_running = false;
+static bool limit_exceeded = false;
+static TickType_t check_tick = 0;
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Take over the reset record left by the previous run
+ * @note   Called before the scheduler starts; the record is cleared, so it is
+ *         reported for one run only
+ * @retval VAL_Status: VAL_OK
+ */
+VAL_Status Supervisor_Init(void) {
+  VAL_Watchdog_Init();
+
+  last_reset.watchdog = VAL_Watchdog_CausedReset();
+  if (last_reset.watchdog) {
+    Counters_Increment(COUNTERS_WATCHDOG_RESETS);
+  }
+  if (reset_record.magic == SUPERVISOR_RECORD_MAGIC && reset_record.task < SUPERVISOR_TASK_COUNT) {
+    last_reset.task = (uint8_t)reset_record.task;
+    last_reset.over_ms = reset_record.over_ms;
+  }
+  reset_record.magic = 0;
+
+  for (uint8_t i = 0; i < SUPERVISOR_TASK_COUNT; i++) {
+    stats[i].deadline_ms = budgets[i].deadline_ms;
+    stats[i].limit_ms = budgets[i].limit_ms;
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Log the reset record and start the watchdog
+ * @note   Called once all tasks run; the watchdog cannot be stopped again
+ * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status Supervisor_Start(void) {
+  if (last_reset.watchdog || last_reset.task != SUPERVISOR_TASK_COUNT) {
+    LOGGER_LOG(LOGGER_LEVEL_WARNING, LOGGER_MSG_WATCHDOG_RESET,
+               Supervisor_GetTaskName((Supervisor_Task_t)last_reset.task), last_reset.over_ms);
+
+    /* The task number is stored as the light ID, 0 if no task was stuck */
+    SYS_Coordinator_LogSystemError(ERROR_DEADLINE,
+                                   (last_reset.task < SUPERVISOR_TASK_COUNT) ? last_reset.task + 1U : 0U,
+                                   (float)last_reset.over_ms, VAL_DATA_STORE_ACTION_RESET);
+  }
+
+  check_tick = xTaskGetTickCount();
+  if (VAL_Watchdog_Start(SUPERVISOR_WATCHDOG_MS) != VAL_OK) {
+    return VAL_ERROR;
+  }
+  watchdog_running = true;
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Mark the start of a work item of a task
+ * @param  task: Task starting work, after its blocking wait returned
+ * @retval None
+ */
+void Supervisor_Begin(Supervisor_Task_t task) {
+  if (task >= SUPERVISOR_TASK_COUNT) {
+    return;
+  }
+
+  work_start[task] = VAL_SysClock_GetMicros();
+  work_busy[task] = true;
+}
+
+/**
+ * @brief  Mark the end of a work item and check it against the deadline
+ * @param  task: Task done with its work, before its next blocking wait
+ * @retval None
+ */
+void Supervisor_End(Supervisor_Task_t task) {
+  uint32_t elapsed;
+  uint32_t deadline_us;
+  uint32_t primask;
+
+  if (task >= SUPERVISOR_TASK_COUNT || !work_busy[task]) {
+    return;
+  }
+
+  elapsed = VAL_SysClock_GetMicros() - work_start[task];
+  work_busy[task] = false;
+  deadline_us = budgets[task].deadline_ms * 1000U;
+
+  /* Supervisor_ResetStats runs in another task */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  stats[task].runs++;
+  if (elapsed > stats[task].worst_us) {
+    stats[task].worst_us = elapsed;
+  }
+  if (elapsed > deadline_us) {
+    stats[task].misses++;
+    stats[task].last_over_us = elapsed - deadline_us;
+  }
+  __set_PRIMASK(primask);
+
+  if (elapsed > deadline_us) {
+    LOGGER_LOG(LOGGER_LEVEL_WARNING, LOGGER_MSG_DEADLINE_MISS,
+               budgets[task].name, elapsed - deadline_us);
+  }
+}
+
+/**
+ * @brief  Get the deadline figures of a task
+ * @param  task: Task to query
+ * @param  task_stats: Pointer to store the figures
+ * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status Supervisor_GetStats(Supervisor_Task_t task, Supervisor_Stats_t* task_stats) {
+  uint32_t primask;
+
+  if (task >= SUPERVISOR_TASK_COUNT || task_stats == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  *task_stats = stats[task];
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Clear the run, miss and worst time figures of all tasks
+ * @retval None
+ */
+void Supervisor_ResetStats(void) {
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t i = 0; i < SUPERVISOR_TASK_COUNT; i++) {
+    stats[i].runs = 0;
+    stats[i].misses = 0;
+    stats[i].worst_us = 0;
+    stats[i].last_over_us = 0;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Get the cause of the last reset, as far as the watchdog is concerned
+ * @param  reset: Pointer to store the record
+ * @retval None
+ */
+void Supervisor_GetReset(Supervisor_Reset_t* reset) {
+  if (reset == NULL) {
+    return;
+  }
+
+  *reset = last_reset;
+}
+
+/**
+ * @brief  Get the name of a task as reported to the host
+ * @param  task: Task to query
+ * @retval const char*: Task name, "none" for SUPERVISOR_TASK_COUNT
+ */
+const char* Supervisor_GetTaskName(Supervisor_Task_t task) {
+  if (task >= SUPERVISOR_TASK_COUNT) {
+    return "none";
+  }
+
+  return budgets[task].name;
+}
+
+/**
+ * @brief  FreeRTOS tick hook, checks the work items and feeds the watchdog
+ * @note   Called from the tick interrupt. Ticks skipped in stop mode are not
+ *         seen here, so the period is measured on the tick count.
+ * @retval None
+ */
+void vApplicationTickHook(void) {
+  TickType_t now_tick = xTaskGetTickCountFromISR();
+  uint32_t now;
+
+  if (!watchdog_running || (now_tick - check_tick) < pdMS_TO_TICKS(SUPERVISOR_CHECK_MS)) {
+    return;
+  }
+  check_tick = now_tick;
+
+  now = VAL_SysClock_GetMicros();
+  for (uint8_t i = 0; i < SUPERVISOR_TASK_COUNT && !limit_exceeded; i++) {
+    uint32_t elapsed_ms = (now - work_start[i]) / 1000U;
+
+    if (work_busy[i] && elapsed_ms >= budgets[i].limit_ms) {
+      reset_record.task = i;
+      reset_record.magic = SUPERVISOR_RECORD_MAGIC;
+      limit_exceeded = true;
+    }
+  }
+
+  if (!limit_exceeded) {
+    VAL_Watchdog_Refresh();
+    return;
+  }
+
+  /* Keep the time current until the watchdog expires */
+  if (work_busy[reset_record.task]) {
+    reset_record.over_ms = (now - work_start[reset_record.task]) / 1000U -
+                           budgets[reset_record.task].deadline_ms;
+  }
+}
@@ -7,41 +7,289 @@
   *
   * This module implements a minimal system coordinator.
   *
+  * The coordinator task sleeps on its task notification. The analog layer
+  * signals new samples from the ADC interrupt and the LED driver signals
+  * intensity and alarm changes; a slow poll from the scheduler
+  * (app_scheduler.c) acts as a fallback.
+  * ADC errors only stop sampling in the interrupt; the task restarts it.
+  * Telemetry subscriptions are served from the sample-ready event, so a
+  * sample is pushed right after the sensor data it carries was refreshed.
+  * Up to COMMS_TELEMETRY_STREAMS run at once, each with its own
+  * rate and fields; the state is read once per event for all streams due,
+  * so only the encoding is paid per stream. A report-on-change
+  * subscription compares each due sample with the last one it sent and
+  * skips it unless a streamed value changed, or a reading moved past its
+  * deadband, until the heartbeat expires.
+  *
+  * The coordinator task is the only task that changes the light outputs.
+  * Command handlers post a small fixed-size command (set, fade, current,
+  * clear, stage, commit) to its queue and wait for the result; the task
+  * runs the commands in order, so they never meet each other or a DMX
+  * update halfway through the LED driver. Interrupts still act on the
+  * driver directly, the alarm evaluation, the sequencer cues and the
+  * blackout of the RX fast path, inside its masked sections. State is read
+  * from the published snapshot.
+  *
+  * A playing cue sequence owns the light outputs. Every request that sets
+  * a light stops it first, so the host always takes over.
+  *
+  * In DMX512 mode a lighting desk owns both the outputs and the serial
+  * line. The packet interrupt only copies the lights' channels and wakes
+  * the task, as it runs at the comms level below the LED driver; the task
+  * stages and commits them together, one PWM update per packet. When the
+  * desk has been silent for SYS_COORD_DMX_TIMEOUT_MS the host link comes
+  * back and the lights hold their last levels.
+  *
+  * Intensities, sensor readings and alarms are kept in one state structure
+  * behind a latched sequence lock. Tasks publish changes; readers in any
+  * context, interrupts included, copy a consistent snapshot without locking.
+  *
+  * The LED driver's usage counters survive restarts through the data store:
+  * the stored counts are added back at start-up, and the error log task
+  * saves them when the scheduler asks for it, every
+  * SYS_COORD_USAGE_CHECKPOINT_MS, unless they are the ones saved last. That is one 80-byte record per hour of operation: even with
+  * the other keys filling half a page, each page is erased about once a
+  * day of continuous use, decades within the flash endurance. At most the
+  * last hour of counts is lost on power-off. The lifetime event counters
+  * (app_counters.c) are saved in the same pass, a 16-byte record when they
+  * changed.
+  *
+  * A page erase stalls every interrupt for its whole duration, so the
+  * erases of these background writes wait until the outputs have nothing
+  * to follow: all lights off, or no fade, current loop or cue sequence
+  * running. The log task then retries every SYS_COORD_LOG_RETRY_MS; after
+  * SYS_COORD_ERASE_DEFER_MS the erase goes ahead anyway, so a show that
+  * never pauses does not fill the log queue.
+  *
   ******************************************************************************
   */
 
 /* Includes ------------------------------------------------------------------*/
 #include "app_sys_coordinator.h"
 #include "app_led_driver.h"  // For LED intensity functions
+#include "app_config.h"
+#include "app_logger.h"
+#include "app_sequencer.h"
+#include "app_supervisor.h"
+#include "app_counters.h"
+#include "app_recorder.h"
+#include "app_profiler.h"
+#include "app_jitter.h"
+#include "app_restore.h"
+#include "app_transport.h"
+#include "app_modbus.h"
+#include "app_spi_link.h"
+#include "app_queues.h"
 #include "val.h"
 #include "FreeRTOS.h"
 #include "task.h"
+#include "queue.h"
 #include "cmsis_os.h"
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
 
 /* Private define ------------------------------------------------------------*/
+/* Above the communications handler: sensor and alarm updates from the ADC
+ * are taken over before any command is answered (see docs/tasks.md) */
 #define SYS_COORDINATOR_STACK_SIZE    256
-#define SYS_COORDINATOR_PRIORITY      osPriorityNormal
+#define SYS_COORDINATOR_PRIORITY      osPriorityAboveNormal
+
+/* Error log flushing runs below all other tasks, it may erase flash */
+#define SYS_COORD_LOG_STACK_SIZE      128
+#define SYS_COORD_LOG_PRIORITY        osPriorityLow
+#define SYS_COORD_LOG_RETRY_MS        100   /* Retry period while flash is in use */
+#define SYS_COORD_ERASE_DEFER_MS      30000 /* Longest wait for quiet outputs before an erase */
+
+#define SYS_COORD_USAGE_VERSION       1
+
+/* Task notification bits */
+#define SYS_COORD_EVT_SAMPLE_READY        0x01U
+#define SYS_COORD_EVT_ALARM_CHANGED       0x02U
+#define SYS_COORD_EVT_INTENSITY_CHANGED   0x04U
+#define SYS_COORD_EVT_ADC_ERROR           0x08U
+#define SYS_COORD_EVT_DMX_PACKET          0x10U
+#define SYS_COORD_EVT_THERMAL_WARNING     0x20U
+#define SYS_COORD_EVT_COMMAND             0x40U
+#define SYS_COORD_EVT_POWER_WARNING       0x80U
+#define SYS_COORD_EVT_POLL                0x100U  /* Scheduler's resync, see SYS_Coordinator_Poll */
+#define SYS_COORD_EVT_ALL                 (SYS_COORD_EVT_SAMPLE_READY | \
+                                           SYS_COORD_EVT_ALARM_CHANGED | \
+                                           SYS_COORD_EVT_INTENSITY_CHANGED | \
+                                           SYS_COORD_EVT_ADC_ERROR | \
+                                           SYS_COORD_EVT_DMX_PACKET | \
+                                           SYS_COORD_EVT_THERMAL_WARNING | \
+                                           SYS_COORD_EVT_COMMAND | \
+                                           SYS_COORD_EVT_POWER_WARNING | \
+                                           SYS_COORD_EVT_POLL)
+
+/* Light commands waiting for the task; the communications and worker
+ * tasks each wait for one at most */
+#define SYS_COORD_COMMAND_DEPTH           4
+#define SYS_COORD_COMMAND_TIMEOUT_MS      100   /* Wait for room in the queue */
+
+/* Ageing compensation check; a light moves on by a full-output hour at most
+ * once an hour */
+#define SYS_COORD_AGEING_CHECK_MS           1000
+
+/* Minimum interval between sample-ready notifications from the ADC in ms */
+#define SYS_COORDINATOR_SAMPLE_INTERVAL_MS  20
+
+/* Telemetry cannot be pushed faster than sensor data is refreshed */
+#define SYS_COORDINATOR_TELEMETRY_MAX_HZ    (1000 / SYS_COORDINATOR_SAMPLE_INTERVAL_MS)
+
+/* Telemetry backs off while the link cannot keep up: a TX queue filled past
+ * the high mark, in permille, or a sample without a TX slot doubles the
+ * samples skipped per sample sent; a run of samples sent below the low
+ * mark halves it again */
+#define SYS_COORDINATOR_TELEMETRY_FILL_HIGH     500
+#define SYS_COORDINATOR_TELEMETRY_FILL_LOW      125
+#define SYS_COORDINATOR_TELEMETRY_DECIMATE_MAX  16
+#define SYS_COORDINATOR_TELEMETRY_RECOVER       8
+
+/* Longest silence of a report-on-change subscription without a heartbeat */
+#define SYS_COORDINATOR_HEARTBEAT_MS        1000
+#define SYS_COORDINATOR_HEARTBEAT_MAX_MS    60000
+
+/* Intensities are kept in permille, the percent API is derived from it */
+#define SYS_COORD_PERMILLE_PER_PERCENT    (VAL_PWM_PERMILLE_MAX / 100)
+
+/* DMX512: one 8-bit channel per light, a universe of 512 channels */
+#define SYS_COORD_DMX_CHANNELS            512U
+#define SYS_COORD_DMX_LEVEL_MAX           255U
+#define SYS_COORD_DMX_START_CODE          0x00U  /* Dimmer levels; others are ignored */
+#define SYS_COORD_DMX_TIMEOUT_MS          1000   /* Silence before the host link returns */
+
+/* Private typedef -----------------------------------------------------------*/
+/* Light state shared between the coordinator, command handlers and telemetry */
+typedef struct {
+  uint16_t permille[VAL_LIGHT_COUNT];         /* Intensities (0-1000) */
+  uint8_t alarms[VAL_LIGHT_COUNT];            /* Alarm codes, 0 for none */
+  LightSensorData_t sensors[VAL_LIGHT_COUNT]; /* Latest sensor readings */
+  LightSampleStamp_t sensors_stamp;           /* When they were taken */
+  uint16_t derate[VAL_LIGHT_COUNT];           /* Derate factors in permille */
+} SYS_Coordinator_State_t;
+
+/* One telemetry subscription, a period of 0 means the stream is free */
+typedef struct {
+  TickType_t period;
+  uint8_t fields;
+  TickType_t last;                            /* Due time of the last sample */
+  SYS_Coordinator_OnChange_t on_change;
+  TickType_t sent;                            /* When a sample last went out */
+  uint8_t skipped;                            /* Due samples skipped for the link */
+  SYS_Coordinator_State_t reported;           /* Last sample sent, task only */
+} SYS_Coordinator_Telemetry_t;
+
+/* Light commands run by the coordinator task */
+typedef enum {
+  SYS_COORD_CMD_SET_LIGHT,
+  SYS_COORD_CMD_SET_ALL,
+  SYS_COORD_CMD_FADE_LIGHT,
+  SYS_COORD_CMD_FADE_ALL,
+  SYS_COORD_CMD_SET_CURRENT,
+  SYS_COORD_CMD_CLEAR_ALARM,
+  SYS_COORD_CMD_STAGE,
+  SYS_COORD_CMD_COMMIT,
+  SYS_COORD_CMD_EFFECT
+} SYS_Coordinator_CommandType_t;
+
+typedef struct {
+  uint8_t type;                               /* SYS_Coordinator_CommandType_t */
+  uint8_t light_id;                           /* Light of the single-light commands */
+  uint8_t option;                             /* Fade curve, or sync input of a stage */
+  uint16_t duration_ms;                       /* Fade duration */
+  int32_t current_ma;                         /* Target current */
+  uint16_t permille[VAL_LIGHT_COUNT];         /* Intensities, the first only for one light */
+  Effect_Config_t effect;                     /* Effect to start, shape off to stop it */
+  uint32_t mask;                              /* Lights of an alarm clear */
+  uint32_t* failed;                           /* Lights whose alarm stays, NULL from ISRs */
+  TaskHandle_t sender;                        /* Notified once the result is stored, NULL from ISRs */
+  VAL_Status* result;
+} SYS_Coordinator_Command_t;
 
 /* Private variables ---------------------------------------------------------*/
 static TaskHandle_t sysCoordinatorTaskHandle = NULL;
+static TaskHandle_t logTaskHandle = NULL;
+static uint32_t sysCoordinatorStack[SYS_COORDINATOR_STACK_SIZE];
+static osStaticThreadDef_t sysCoordinatorTcb;
+static uint32_t logTaskStack[SYS_COORD_LOG_STACK_SIZE];
+static osStaticThreadDef_t logTaskTcb;
+static volatile bool coordinator_ready = false;
+
+static QueueHandle_t command_queue = NULL;
+static StaticQueue_t command_queue_control;
+static uint8_t command_queue_storage[SYS_COORD_COMMAND_DEPTH * sizeof(SYS_Coordinator_Command_t)];
+
+/* The single store of the light state as seen by the rest of the system.
+ * Writers edit copy 0 while readers are steered to copy 1, then copy it
+ * over; the sequence parity selects the copy readers may use. */
+static SYS_Coordinator_State_t state_copies[2];
+static volatile uint32_t state_sequence = 0;
 
-/* Private light intensity state storage */
-static uint8_t current_intensities[3] = {0, 0, 0};
+static uint8_t previous_light_alarms[VAL_LIGHT_COUNT] = {0};
+static uint16_t previous_thermal_warnings[VAL_LIGHT_COUNT] = {0};
+static bool previous_supply_low = false;
+static uint32_t previous_supply_warnings = 0;
 
-/* Private sensor data storage */
-static LightSensorData_t current_sensor_data[3] = {
-  {1, 0.0f, 0.0f},  // First light, initialized with ID and zero values
-  {2, 0.0f, 0.0f},  // Second light
-  {3, 0.0f, 0.0f}   // Third light
-};
+/* Telemetry subscriptions; the settings are written by the comms task
+ * inside critical sections */
+static SYS_Coordinator_Telemetry_t telemetry[COMMS_TELEMETRY_STREAMS];
 
-static uint8_t light_alarms[3] = {0, 0, 0};
-static uint8_t previous_light_alarms[3] = {0, 0, 0};
+/* Slowing down for the link, shared by all streams, coordinator task only:
+ * one due sample in telemetry_decimate is sent */
+static uint8_t telemetry_decimate = 1;
+static uint8_t telemetry_calm = 0;
+
+/* DMX512 session; levels and counts are written by the packet interrupt */
+static volatile bool dmx_active = false;
+static uint16_t dmx_channel = 1;
+static volatile uint8_t dmx_levels[VAL_LIGHT_COUNT];
+static volatile uint32_t dmx_packets = 0;
+static volatile uint32_t dmx_ignored = 0;
+static uint32_t dmx_dropped = 0;
+static volatile TickType_t dmx_last_tick;
+
+/* Usage counters last saved, and the ones being saved; log task only */
+static LED_Driver_Usage_t usage_saved[VAL_LIGHT_COUNT];
+static LED_Driver_Usage_t usage_pending[VAL_LIGHT_COUNT];
+static volatile bool usage_save_due = false;
+
+/* First refused background erase; log task only */
+static bool erase_deferred = false;
+static TickType_t erase_deferred_tick;
 
 /* Private function prototypes -----------------------------------------------*/
 static void SYS_Coordinator_Task(void const *argument);
+static void SYS_Coordinator_LogTask(void const *argument);
+static void SYS_Coordinator_SampleReadyCallback(void);
+static void SYS_Coordinator_AnalogErrorCallback(uint32_t adc_error, uint32_t dma_error);
+static void SYS_Coordinator_LedEventCallback(uint32_t events);
+static void SYS_Coordinator_DmxPacketCallback(const uint8_t* packet, uint16_t length);
+static void SYS_Coordinator_ApplyDmx(void);
+static void SYS_Coordinator_CheckDmxSignal(void);
+static void SYS_Coordinator_CheckNewAlarms(void);
+static void SYS_Coordinator_CheckThermalWarnings(void);
+static void SYS_Coordinator_ReportPowerWarning(void);
+static void SYS_Coordinator_RunRules(const LightSensorData_t* sensors);
+static VAL_Status SYS_Coordinator_SaveUsage(void);
+static bool SYS_Coordinator_MayErase(void);
+static void SYS_Coordinator_ServeTelemetry(void);
+static void SYS_Coordinator_PaceTelemetry(uint16_t fill);
+static bool SYS_Coordinator_TelemetryChanged(const SYS_Coordinator_State_t* state,
+                                             const SYS_Coordinator_Telemetry_t* stream);
+static uint8_t SYS_Coordinator_PermilleToPercent(uint16_t permille);
+static SYS_Coordinator_State_t* SYS_Coordinator_BeginUpdate(void);
+static void SYS_Coordinator_EndUpdate(void);
+static uint32_t SYS_Coordinator_ReadState(SYS_Coordinator_State_t* state);
+static void SYS_Coordinator_ReleaseOutputs(void);
+static VAL_Status SYS_Coordinator_PostCommand(SYS_Coordinator_Command_t* command);
+static VAL_Status SYS_Coordinator_PostCommandFromISR(SYS_Coordinator_Command_t* command);
+static VAL_Status SYS_Coordinator_FillMasked(SYS_Coordinator_Command_t* command, uint32_t mask,
+                                             const uint16_t* values, uint8_t count);
+static void SYS_Coordinator_RunCommands(void);
+static VAL_Status SYS_Coordinator_ExecuteCommand(const SYS_Coordinator_Command_t* command);
+static void SYS_Coordinator_PublishPermille(const uint16_t* permille);
 
 /* Public functions ----------------------------------------------------------*/
 
@@ -50,32 +298,125 @@ static void SYS_Coordinator_Task(void const *argument);
  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
  */
 VAL_Status SYS_Coordinator_Init(void) {
+  /* The coordinator owns the LED driver */
+  if (LED_Driver_Init() != VAL_OK) {
+    return VAL_ERROR;
+  }
+
+  /* Stored limits and sensor scale replace the defaults */
+  if (Config_Init() != VAL_OK) {
+    return VAL_ERROR;
+  }
+
+  /* The host reaches the device at the stored address from here on */
+  Config_Settings_t settings;
+  if (Config_Get(&settings) == VAL_OK) {
+    COMMS_Handler_SetAddress(settings.address, settings.bus != 0);
+    COMMS_Handler_SetFailsafe(settings.failsafe_ms, settings.failsafe_scene);
+    COMMS_Handler_SetBusGroups(settings.bus_groups);
+  }
+
+  /* Usage keeps counting from the last checkpoint */
+  if (VAL_DataStore_LoadUsage(SYS_COORD_USAGE_VERSION, usage_saved, sizeof(usage_saved)) == VAL_OK) {
+    LED_Driver_AddUsage(usage_saved);
+  }
+  Counters_Restore();
+  Recorder_Init();
+
+  SYS_Coordinator_State_t* state = SYS_Coordinator_BeginUpdate();
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    state->sensors[i].light_id = i + 1;
+    state->derate[i] = VAL_PWM_PERMILLE_MAX;
+  }
+  SYS_Coordinator_EndUpdate();
+
+  command_queue = xQueueCreateStatic(SYS_COORD_COMMAND_DEPTH, sizeof(SYS_Coordinator_Command_t),
+                                     command_queue_storage, &command_queue_control);
+  (void)Queues_Register(command_queue, "coordinator", QUEUES_KIND_QUEUE, SYS_COORD_COMMAND_DEPTH);
+
   /* Create system coordinator task */
-  osThreadDef(SysCoordTask, SYS_Coordinator_Task, SYS_COORDINATOR_PRIORITY, 0, SYS_COORDINATOR_STACK_SIZE);
+  osThreadStaticDef(SysCoordTask, SYS_Coordinator_Task, SYS_COORDINATOR_PRIORITY, 0, SYS_COORDINATOR_STACK_SIZE,
+                    sysCoordinatorStack, &sysCoordinatorTcb);
   sysCoordinatorTaskHandle = osThreadCreate(osThread(SysCoordTask), NULL);
 
   if (sysCoordinatorTaskHandle == NULL) {
     return VAL_ERROR;
   }
 
+  /* Create error log flush task */
+  osThreadStaticDef(SysLogTask, SYS_Coordinator_LogTask, SYS_COORD_LOG_PRIORITY, 0, SYS_COORD_LOG_STACK_SIZE,
+                    logTaskStack, &logTaskTcb);
+  logTaskHandle = osThreadCreate(osThread(SysLogTask), NULL);
+
+  if (logTaskHandle == NULL) {
+    return VAL_ERROR;
+  }
+  VAL_DataStore_SetEraseGate(SYS_Coordinator_MayErase);
+
+  /* Event sources only signal once the task exists */
+  LED_Driver_SetEventCallback(SYS_Coordinator_LedEventCallback);
+  VAL_Analog_SetSampleCallback(SYS_Coordinator_SampleReadyCallback,
+                               SYS_COORDINATOR_SAMPLE_INTERVAL_MS);
+  VAL_Analog_SetErrorCallback(SYS_Coordinator_AnalogErrorCallback);
+
+  coordinator_ready = true;
+
+  /* The backup registers went with the supply, but the power-on scene is in flash */
+  if (!Restore_IsRetained() && settings.power_on == RESTORE_SCENE) {
+    SYS_Coordinator_RecallScene(settings.power_on_scene, CONFIG_LIGHTS_ALL);
+  }
   return VAL_OK;
 }
 
+/**
+ * @brief  Wake the coordinator task to resynchronize after a lost event
+ * @note   Scheduler job. Runs posted commands, reads the alarms and
+ *         intensities again and retries a failed ADC recovery; the work
+ *         that follows the samples stays on their cadence.
+ * @retval None
+ */
+void SYS_Coordinator_Poll(void) {
+  if (coordinator_ready) {
+    xTaskNotify(sysCoordinatorTaskHandle, SYS_COORD_EVT_POLL, eSetBits);
+  }
+}
+
+/**
+ * @brief  Have the error log task checkpoint the usage counters
+ * @note   Scheduler job; the task retries while flash is in use
+ * @retval None
+ */
+void SYS_Coordinator_RequestUsageSave(void) {
+  if (coordinator_ready) {
+    usage_save_due = true;
+    xTaskNotifyGive(logTaskHandle);
+  }
+}
+
+/**
+ * @brief  Check whether the coordinator has finished initializing
+ * @note   The communications handler answers before start-up completes
+ * @retval bool: true once light, sensor and alarm requests are served
+ */
+bool SYS_Coordinator_IsReady(void) {
+  return coordinator_ready;
+}
+
 /**
  * @brief Get the current intensity of a specific light source
- * @param lightId Light source ID (1-3)
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
  * @param intensity Pointer to store the retrieved intensity
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
 VAL_Status SYS_Coordinator_GetLightIntensity(uint8_t light_id, uint8_t* intensity) {
-  /* Validate light ID */
-  if (light_id < 1 || light_id > 3) {
-    return VAL_ERROR;
+  uint16_t permille;
+
+  VAL_Status status = SYS_Coordinator_GetLightPermille(light_id, &permille);
+  if (status == VAL_OK) {
+    *intensity = SYS_Coordinator_PermilleToPercent(permille);
   }
 
-  /* Retrieve the current intensity for the specified light */
-  *intensity = current_intensities[light_id - 1];
-  return VAL_OK;
+  return status;
 }
 
 /**
@@ -84,35 +425,28 @@ VAL_Status SYS_Coordinator_GetLightIntensity(uint8_t light_id, uint8_t* intensit
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
 VAL_Status SYS_Coordinator_GetAllLightIntensities(uint8_t* intensities) {
-  /* Copy the current intensities to the provided array */
-  memcpy(intensities, current_intensities, 3 * sizeof(uint8_t));
+  SYS_Coordinator_State_t state;
+
+  SYS_Coordinator_ReadState(&state);
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    intensities[i] = SYS_Coordinator_PermilleToPercent(state.permille[i]);
+  }
   return VAL_OK;
 }
 
 /**
  * @brief Set the intensity for a specific light source
- * @param lightId Light source ID (1-3)
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
  * @param intensity Intensity value (0-100)
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
 VAL_Status SYS_Coordinator_SetLightIntensity(uint8_t light_id, uint8_t intensity) {
-  /* Validate light ID */
-  if (light_id < 1 || light_id > 3) {
-    return VAL_ERROR;
-  }
-
   /* Validate intensity */
   if (intensity > 100) {
     return VAL_ERROR;
   }
 
-  /* Set the intensity for the specified light */
-  VAL_Status status = LED_Driver_SetIntensity(light_id, intensity);
-  if (status == VAL_OK) {
-    current_intensities[light_id - 1] = intensity;
-  }
-
-  return status;
+  return SYS_Coordinator_SetLightPermille(light_id, (uint16_t)intensity * SYS_COORD_PERMILLE_PER_PERCENT);
 }
 
 /**
@@ -121,143 +455,2108 @@ VAL_Status SYS_Coordinator_SetLightIntensity(uint8_t light_id, uint8_t intensity
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
 VAL_Status SYS_Coordinator_SetAllLightIntensities(uint8_t* intensities) {
+  uint16_t permille[VAL_LIGHT_COUNT];
+
   /* Validate input */
   if (intensities == NULL) {
     return VAL_ERROR;
   }
 
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (intensities[i] > 100) {
+      return VAL_ERROR;
+    }
+    permille[i] = (uint16_t)intensities[i] * SYS_COORD_PERMILLE_PER_PERCENT;
+  }
+
+  return SYS_Coordinator_SetAllLightPermille(permille);
+}
+
+/**
+ * @brief Get the current intensity of a specific light source in permille
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param permille Pointer to store the retrieved intensity (0-1000)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_GetLightPermille(uint8_t light_id, uint16_t* permille) {
+  SYS_Coordinator_State_t state;
+
+  /* Validate light ID */
+  if (light_id < 1 || light_id > VAL_LIGHT_COUNT) {
+    return VAL_ERROR;
+  }
+
+  /* Retrieve the current intensity for the specified light */
+  SYS_Coordinator_ReadState(&state);
+  *permille = state.permille[light_id - 1];
+  return VAL_OK;
+}
+
+/**
+ * @brief Get the current intensities of all light sources in permille
+ * @param permille Array to store the retrieved intensities (0-1000)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_GetAllLightPermille(uint16_t* permille) {
+  SYS_Coordinator_State_t state;
+
+  /* Copy the current intensities to the provided array */
+  SYS_Coordinator_ReadState(&state);
+  memcpy(permille, state.permille, sizeof(state.permille));
+  return VAL_OK;
+}
+
+/**
+ * @brief Set the intensity for a specific light source in permille
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param permille Intensity value (0-1000)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_SetLightPermille(uint8_t light_id, uint16_t permille) {
+  /* Validate light ID */
+  if (light_id < 1 || light_id > VAL_LIGHT_COUNT) {
+    return VAL_ERROR;
+  }
+
+  /* Validate intensity */
+  if (permille > VAL_PWM_PERMILLE_MAX) {
+    return VAL_ERROR;
+  }
+
+  /* Set the intensity for the specified light */
+  SYS_Coordinator_Command_t command = { .type = SYS_COORD_CMD_SET_LIGHT, .light_id = light_id };
+  command.permille[0] = permille;
+  return SYS_Coordinator_PostCommand(&command);
+}
+
+/**
+ * @brief Set intensities for all light sources in permille
+ * @param permille Array of intensity values (0-1000)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_SetAllLightPermille(const uint16_t* permille) {
+  /* Validate input */
+  if (permille == NULL) {
+    return VAL_ERROR;
+  }
+
+  /* The driver would take LED_DRIVER_PERMILLE_HOLD, the state cannot */
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (permille[i] > VAL_PWM_PERMILLE_MAX) {
+      return VAL_ERROR;
+    }
+  }
+
   /* Set intensities for all light sources */
-  VAL_Status status = LED_Driver_SetAllIntensities(intensities);
-  if (status == VAL_OK) {
-    memcpy(current_intensities, intensities, 3 * sizeof(uint8_t));
+  SYS_Coordinator_Command_t command = { .type = SYS_COORD_CMD_SET_ALL };
+  memcpy(command.permille, permille, sizeof(command.permille));
+  return SYS_Coordinator_PostCommand(&command);
+}
+
+/**
+ * @brief Queue the intensity of a specific light source from an interrupt
+ * @note Returns without waiting; the coordinator task applies the command
+ *       as SYS_Coordinator_SetLightPermille would
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param permille Intensity value (0-1000)
+ * @return VAL_Status VAL_OK once queued, VAL_ERROR for invalid arguments,
+ *         VAL_BUSY if the queue is full or the coordinator is not running
+ */
+VAL_Status SYS_Coordinator_SetLightPermilleFromISR(uint8_t light_id, uint16_t permille) {
+  if (light_id < 1 || light_id > VAL_LIGHT_COUNT || permille > VAL_PWM_PERMILLE_MAX) {
+    return VAL_ERROR;
   }
 
-  return status;
+  SYS_Coordinator_Command_t command = { .type = SYS_COORD_CMD_SET_LIGHT, .light_id = light_id };
+  command.permille[0] = permille;
+  return SYS_Coordinator_PostCommandFromISR(&command);
 }
 
 /**
- * @brief Get sensor data for a specific light source
- * @param lightId Light source ID (1-3)
- * @param sensorData Pointer to store sensor readings
+ * @brief Queue the intensities of all light sources from an interrupt
+ * @note Returns without waiting; the coordinator task applies the command
+ *       as SYS_Coordinator_SetAllLightPermille would
+ * @param permille Array of intensity values (0-1000)
+ * @return VAL_Status VAL_OK once queued, VAL_ERROR for invalid arguments,
+ *         VAL_BUSY if the queue is full or the coordinator is not running
+ */
+VAL_Status SYS_Coordinator_SetAllLightPermilleFromISR(const uint16_t* permille) {
+  if (permille == NULL) {
+    return VAL_ERROR;
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (permille[i] > VAL_PWM_PERMILLE_MAX) {
+      return VAL_ERROR;
+    }
+  }
+
+  SYS_Coordinator_Command_t command = { .type = SYS_COORD_CMD_SET_ALL };
+  memcpy(command.permille, permille, sizeof(command.permille));
+  return SYS_Coordinator_PostCommandFromISR(&command);
+}
+
+/**
+ * @brief Set the intensities of some light sources in permille, together
+ * @note The other lights keep their outputs
+ * @param mask Lights to set, bit 0 for light 1
+ * @param values Intensity per bit set in mask, lowest bit first (0-1000)
+ * @param count Number of values, must match the bits set
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
-VAL_Status SYS_Coordinator_GetLightSensorData(uint8_t light_id, LightSensorData_t* sensor_data) {
-  /* Validate input parameters */
-  if (light_id < 1 || light_id > 3 || sensor_data == NULL) {
+VAL_Status SYS_Coordinator_SetMaskedLightPermille(uint32_t mask, const uint16_t* values, uint8_t count) {
+  SYS_Coordinator_Command_t command = { .type = SYS_COORD_CMD_SET_ALL };
+
+  if (SYS_Coordinator_FillMasked(&command, mask, values, count) != VAL_OK) {
     return VAL_ERROR;
   }
 
-  /* Get sensor data from LED driver */
-  VAL_Status status = LED_Driver_GetSensorData(light_id, sensor_data);
+  /* All masked lights change in the same PWM period */
+  return SYS_Coordinator_PostCommand(&command);
+}
 
-  /* If successful, update our cached copy */
-  if (status == VAL_OK) {
-    current_sensor_data[light_id - 1] = *sensor_data;
+/**
+ * @brief Queue the intensities of some light sources from an interrupt
+ * @note Returns without waiting; the coordinator task applies the command
+ *       as SYS_Coordinator_SetMaskedLightPermille would
+ * @param mask Lights to set, bit 0 for light 1
+ * @param values Intensity per bit set in mask, lowest bit first (0-1000)
+ * @param count Number of values, must match the bits set
+ * @return VAL_Status VAL_OK once queued, VAL_ERROR for invalid arguments,
+ *         VAL_BUSY if the queue is full or the coordinator is not running
+ */
+VAL_Status SYS_Coordinator_SetMaskedLightPermilleFromISR(uint32_t mask, const uint16_t* values, uint8_t count) {
+  SYS_Coordinator_Command_t command = { .type = SYS_COORD_CMD_SET_ALL };
+
+  if (SYS_Coordinator_FillMasked(&command, mask, values, count) != VAL_OK) {
+    return VAL_ERROR;
   }
 
-  return status;
+  return SYS_Coordinator_PostCommandFromISR(&command);
 }
 
 /**
- * @brief Get sensor data for all light sources
- * @param sensorData Array to store sensor readings (must be size 3)
+ * @brief Set the intensity of all light sources of a group, together
+ * @param group Light group (1-CONFIG_LIGHT_GROUPS)
+ * @param intensity Intensity value (0-100)
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
-VAL_Status SYS_Coordinator_GetAllLightSensorData(LightSensorData_t* sensor_data) {
-  /* Validate input parameter */
-  if (sensor_data == NULL) {
+VAL_Status SYS_Coordinator_SetGroupIntensity(uint8_t group, uint8_t intensity) {
+  /* Validate intensity */
+  if (intensity > 100) {
     return VAL_ERROR;
   }
 
-  memcpy(sensor_data, current_sensor_data, 3 * sizeof(LightSensorData_t));
+  return SYS_Coordinator_SetGroupPermille(group, (uint16_t)intensity * SYS_COORD_PERMILLE_PER_PERCENT);
+}
 
-  return VAL_OK;
+/**
+ * @brief Set the intensity of all light sources of a group in permille, together
+ * @note The group is a stored mask, so this costs what SetMaskedLightPermille does
+ * @param group Light group (1-CONFIG_LIGHT_GROUPS)
+ * @param permille Intensity value (0-1000)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_SetGroupPermille(uint8_t group, uint16_t permille) {
+  uint16_t values[VAL_LIGHT_COUNT];
+  uint32_t mask;
+
+  if (Config_GetLightGroup(group, &mask) != VAL_OK) {
+    return VAL_ERROR;
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    values[i] = permille;
+  }
+  return SYS_Coordinator_SetMaskedLightPermille(mask, values, (uint8_t)__builtin_popcount(mask));
 }
 
 /**
- * @brief Clear alarm for a specific light source
- * @param lightId Light source ID (1-3)
+ * @brief Fade a light source to a target intensity in the background
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param permille Target intensity (0-1000)
+ * @param durationMs Fade duration in milliseconds
+ * @param curve Fade curve
+ * @return VAL_Status VAL_OK if the fade started, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_FadeLight(uint8_t light_id, uint16_t permille, uint16_t duration_ms,
+                                     LED_Driver_FadeCurve_t curve) {
+  /* Validate light ID */
+  if (light_id < 1 || light_id > VAL_LIGHT_COUNT) {
+    return VAL_ERROR;
+  }
+
+  SYS_Coordinator_Command_t command = {
+    .type = SYS_COORD_CMD_FADE_LIGHT, .light_id = light_id, .option = (uint8_t)curve, .duration_ms = duration_ms
+  };
+  command.permille[0] = permille;
+  return SYS_Coordinator_PostCommand(&command);
+}
+
+/**
+ * @brief Fade some light sources to one target intensity, together
+ * @note The other lights keep their outputs, or their fades
+ * @param mask Lights to fade, bit 0 for light 1
+ * @param permille Target intensity (0-1000)
+ * @param durationMs Fade duration in milliseconds
+ * @param curve Fade curve
+ * @return VAL_Status VAL_OK if the fade started, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_FadeMaskedLights(uint32_t mask, uint16_t permille, uint16_t duration_ms,
+                                            LED_Driver_FadeCurve_t curve) {
+  SYS_Coordinator_Command_t command = {
+    .type = SYS_COORD_CMD_FADE_ALL, .option = (uint8_t)curve, .duration_ms = duration_ms
+  };
+
+  /* Validate input */
+  if (mask == 0 || (mask & ~CONFIG_LIGHTS_ALL) != 0 || permille > VAL_PWM_PERMILLE_MAX) {
+    return VAL_ERROR;
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    command.permille[i] = (mask & (1UL << i)) ? permille : LED_DRIVER_PERMILLE_HOLD;
+  }
+  return SYS_Coordinator_PostCommand(&command);
+}
+
+/**
+ * @brief Modulate light sources with an effect until stopped
+ * @param permille Crest intensity per light (0-1000, or LED_DRIVER_PERMILLE_HOLD)
+ * @param effect Effect to start, EFFECT_SHAPE_OFF to stop a running one
+ * @return VAL_Status As LED_Driver_StartEffect, VAL_PARAM for an invalid effect
+ */
+VAL_Status SYS_Coordinator_StartEffect(const uint16_t* permille, const Effect_Config_t* effect) {
+  if (permille == NULL || effect == NULL) {
+    return VAL_ERROR;
+  }
+
+  if (effect->shape != EFFECT_SHAPE_OFF && Effect_Validate(effect) != VAL_OK) {
+    return VAL_PARAM;
+  }
+
+  SYS_Coordinator_Command_t command = { .type = SYS_COORD_CMD_EFFECT, .effect = *effect };
+  memcpy(command.permille, permille, sizeof(command.permille));
+  return SYS_Coordinator_PostCommand(&command);
+}
+
+/**
+ * @brief Select how intensities map to the PWM duty cycle of a light source
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param curve Output curve
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
-VAL_Status SYS_Coordinator_ClearLightAlarm(uint8_t light_id) {
+VAL_Status SYS_Coordinator_SetLightCurve(uint8_t light_id, LED_Driver_OutputCurve_t curve) {
   /* Validate light ID */
-  if (light_id < 1 || light_id > 3) {
+  if (light_id < 1 || light_id > VAL_LIGHT_COUNT) {
     return VAL_ERROR;
   }
 
-  /* Attempt to clear the alarm in the LED driver */
-  return LED_Driver_ClearAlarm(light_id);
+  return LED_Driver_SetOutputCurve(light_id, curve);
 }
 
 /**
- * @brief Get alarm status for all light sources
- * @param alarms Array to store alarm status (must be size 3)
+ * @brief Regulate a light source to a constant current
+ * @note The duty cycle the controller drives is synchronized with the samples
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param currentMa Target current in mA, 0 turns the light off
  * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
  */
-VAL_Status SYS_Coordinator_GetAlarmStatus(uint8_t* alarms) {
-  /* Validate input parameter */
-  if (alarms == NULL) {
+VAL_Status SYS_Coordinator_SetLightCurrent(uint8_t light_id, int32_t current_ma) {
+  /* Validate light ID */
+  if (light_id < 1 || light_id > VAL_LIGHT_COUNT) {
     return VAL_ERROR;
   }
 
-  /* Get alarm status from LED driver */
-  memcpy(alarms, light_alarms, sizeof(alarms));
-  return VAL_OK;
+  SYS_Coordinator_Command_t command = {
+    .type = SYS_COORD_CMD_SET_CURRENT, .light_id = light_id, .current_ma = current_ma
+  };
+  return SYS_Coordinator_PostCommand(&command);
 }
 
-/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief Stage new intensities for all light sources
+ * @note The state follows the intensity event of the commit
+ * @param permille Intensity per light (0-1000, or LED_DRIVER_PERMILLE_HOLD)
+ * @param syncInput true to also commit on a rising edge of the sync line
+ * @return VAL_Status As LED_Driver_StagePermille
+ */
+VAL_Status SYS_Coordinator_StageLights(const uint16_t* permille, bool sync_input) {
+  if (permille == NULL) {
+    return VAL_ERROR;
+  }
+
+  SYS_Coordinator_Command_t command = { .type = SYS_COORD_CMD_STAGE, .option = sync_input ? 1U : 0U };
+  memcpy(command.permille, permille, sizeof(command.permille));
+  return SYS_Coordinator_PostCommand(&command);
+}
 
 /**
- * @brief  System coordinator task
- * @param  argument: Task argument
- * @retval None
+ * @brief Apply the staged intensities to all light sources at once
+ * @return VAL_Status As LED_Driver_CommitStage
  */
-static void SYS_Coordinator_Task(void const *argument) {
-    /* Initialize */
-    VAL_Status status;
+VAL_Status SYS_Coordinator_CommitLights(void) {
+  SYS_Coordinator_Command_t command = { .type = SYS_COORD_CMD_COMMIT };
 
-    /* Task main loop */
-    for (;;) {
-        /* Synchronize all light intensities */
-        status = LED_Driver_GetAllIntensities(current_intensities);
-        if(status != VAL_OK)
-          VAL_Serial_Printf("Failed to get intensities\n");
+  return SYS_Coordinator_PostCommand(&command);
+}
 
-        /* Synchronize all sensor data */
-        status = LED_Driver_GetAllSensorData(current_sensor_data);
-        if(status != VAL_OK)
-          VAL_Serial_Printf("Failed to get sensor data\n");
+/**
+ * @brief Change the PWM frequency of all light sources
+ * @note The intensities are kept; a running fade is cancelled
+ * @param freqHz Frequency (VAL_PWM_FREQ_MIN_HZ-VAL_PWM_FREQ_MAX_HZ)
+ * @return VAL_Status As LED_Driver_SetPwmFrequency
+ */
+VAL_Status SYS_Coordinator_SetPwmFrequency(uint32_t freq_hz) {
+  return LED_Driver_SetPwmFrequency(freq_hz);
+}
 
-        /* Synchronize all alarms */
-        status = LED_Driver_GetAlarmStatus(light_alarms);
-        if(status != VAL_OK)
-          VAL_Serial_Printf("Failed to get alarms\n");
-
-        /* Check for new alarm conditions */
-        for (uint8_t i = 0; i < 3; i++) {
-            if (light_alarms[i] != 0 && previous_light_alarms[i] == 0) {
-                /* New alarm detected - send event notification */
-                float value = 0.0f;
-
-                /* Use the appropriate sensor value based on alarm type */
-                if (light_alarms[i] == 1) { /* ERROR_OVER_CURRENT */
-                    value = current_sensor_data[i].current;
-                } else if (light_alarms[i] == 2) { /* ERROR_OVER_TEMPERATURE */
-                    value = current_sensor_data[i].temperature;
-                }
+/**
+ * @brief Get the PWM frequency of the light sources
+ * @return uint32_t Frequency in Hz
+ */
+uint32_t SYS_Coordinator_GetPwmFrequency(void) {
+  return LED_Driver_GetPwmFrequency();
+}
 
-                /* Send alarm event notification */
-                COMMS_Handler_SendAlarmEvent(i + 1, light_alarms[i], value);
+/**
+ * @brief Dither the steady outputs of the light sources below one timer count
+ * @param enable true to dither, false for one compare value per light
+ * @return VAL_Status As LED_Driver_SetDither
+ */
+VAL_Status SYS_Coordinator_SetDither(bool enable) {
+  return LED_Driver_SetDither(enable);
+}
 
-                /* Log the alarm event */
-//                VAL_Serial_Printf("Alarm triggered for light %d: type %d, value %.1f\n",
-//                                 i + 1, light_alarms[i], value);
-            }
+/**
+ * @brief Check whether the steady outputs are dithered
+ * @return bool true if enabled
+ */
+bool SYS_Coordinator_IsDitherEnabled(void) {
+  return LED_Driver_IsDitherEnabled();
+}
 
-            /* Update previous alarm state */
-            previous_light_alarms[i] = light_alarms[i];
-        }
+#ifdef BENCHMARK
+/**
+ * @brief Make a light read as over current until its alarm trips
+ * @note Benchmark builds only
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_InjectLightFault(uint8_t light_id) {
+  return LED_Driver_InjectFault(light_id);
+}
+#endif
+
+/**
+ * @brief Add an error that is not a light alarm to the persistent error log
+ * @note Only queued; the log task stores it
+ * @param errorType Type of error
+ * @param source Source of the error, stored as the light ID
+ * @param value Value that describes the error
+ * @param action Action taken (VAL_DATA_STORE_ACTION_x)
+ * @return VAL_Status VAL_OK if queued, VAL_BUSY if the log queue is full
+ */
+VAL_Status SYS_Coordinator_LogSystemError(ErrorType_t error_type, uint8_t source, float value, uint8_t action) {
+  VAL_Status status = VAL_DataStore_LogErrorEvent(source, error_type, value, action);
+
+  if (status == VAL_OK && logTaskHandle != NULL) {
+    xTaskNotifyGive(logTaskHandle);
+  }
+
+  return status;
+}
+
+/**
+ * @brief Get sensor data for a specific light source
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param sensorData Pointer to store sensor readings
+ * @param stamp Pointer to store when the readings were taken, or NULL
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_GetLightSensorData(uint8_t light_id, LightSensorData_t* sensor_data,
+                                              LightSampleStamp_t* stamp) {
+  SYS_Coordinator_State_t state;
+
+  /* Validate input parameters */
+  if (light_id < 1 || light_id > VAL_LIGHT_COUNT || sensor_data == NULL) {
+    return VAL_ERROR;
+  }
+
+  /* Readings as last synchronized by the coordinator task */
+  SYS_Coordinator_ReadState(&state);
+  *sensor_data = state.sensors[light_id - 1];
+  if (stamp != NULL) {
+    *stamp = state.sensors_stamp;
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief Get sensor data for all light sources
+ * @param sensorData Array to store sensor readings (must hold VAL_LIGHT_COUNT entries)
+ * @param stamp Pointer to store when the readings were taken, or NULL
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_GetAllLightSensorData(LightSensorData_t* sensor_data, LightSampleStamp_t* stamp) {
+  SYS_Coordinator_State_t state;
+
+  /* Validate input parameter */
+  if (sensor_data == NULL) {
+    return VAL_ERROR;
+  }
+
+  SYS_Coordinator_ReadState(&state);
+  memcpy(sensor_data, state.sensors, sizeof(state.sensors));
+  if (stamp != NULL) {
+    *stamp = state.sensors_stamp;
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief Get intensities, alarms, sensor readings and derating all from one
+ *        publication of the light state
+ * @param snapshot Pointer to store the state
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR if snapshot is NULL
+ */
+VAL_Status SYS_Coordinator_GetSnapshot(SYS_Coordinator_Snapshot_t* snapshot) {
+  SYS_Coordinator_State_t state;
+
+  if (snapshot == NULL) {
+    return VAL_ERROR;
+  }
+
+  snapshot->sequence = SYS_Coordinator_ReadState(&state) / 2U;
+  memcpy(snapshot->permille, state.permille, sizeof(state.permille));
+  memcpy(snapshot->alarms, state.alarms, sizeof(state.alarms));
+  memcpy(snapshot->derate, state.derate, sizeof(state.derate));
+  memcpy(snapshot->sensors, state.sensors, sizeof(state.sensors));
+  snapshot->sensors_stamp = state.sensors_stamp;
+
+  return VAL_OK;
+}
+
+/**
+ * @brief Get the usage counters of all light sources, restored ones included
+ * @param usage Array to store the counters (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if usage is NULL
+ */
+VAL_Status SYS_Coordinator_GetUsage(LED_Driver_Usage_t* usage) {
+  return LED_Driver_GetUsage(usage);
+}
+
+/**
+ * @brief Get the on-time the ageing compensation adds to each light source
+ * @param scales Array to store the output scales in permille (must hold
+ *        VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if scales is NULL
+ */
+VAL_Status SYS_Coordinator_GetAgeingScales(uint16_t* scales) {
+  return LED_Driver_GetAgeingScales(scales);
+}
+
+/**
+ * @brief Get the flicker of all light sources at their present outputs
+ * @param status Pointer to store the progress
+ * @param metrics Array to store the metrics (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if a pointer is NULL
+ */
+VAL_Status SYS_Coordinator_GetFlicker(LED_Driver_FlickerStatus_t* status, LED_Driver_Flicker_t* metrics) {
+  return LED_Driver_GetFlicker(status, metrics);
+}
+
+/**
+ * @brief Set the window of the flicker measurement and measure again
+ * @param windowScans Raw samples per window (LED_DRIVER_FLICKER_WINDOW_MIN-65535)
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if too short
+ */
+VAL_Status SYS_Coordinator_SetFlickerWindow(uint16_t window_scans) {
+  return LED_Driver_SetFlickerWindow(window_scans);
+}
+
+/**
+ * @brief Clear alarm for a specific light source
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_ClearLightAlarm(uint8_t light_id) {
+  /* Validate light ID */
+  if (light_id < 1 || light_id > VAL_LIGHT_COUNT) {
+    return VAL_ERROR;
+  }
+
+  return SYS_Coordinator_ClearLightAlarms(1UL << (light_id - 1), NULL);
+}
+
+/**
+ * @brief Clear the alarms of a set of light sources in one command
+ * @note The LED driver checks every light against the same alarm state
+ * @param mask Bit n for light n+1, none above VAL_LIGHT_COUNT
+ * @param failed Set to the lights whose alarm stays, or NULL
+ * @return VAL_Status VAL_OK if all are clear, VAL_ERROR if any alarm stays
+ *         or the mask is empty or invalid
+ */
+VAL_Status SYS_Coordinator_ClearLightAlarms(uint32_t mask, uint32_t* failed) {
+  if (failed != NULL) {
+    *failed = 0;
+  }
+  if (mask == 0 || (mask >> VAL_LIGHT_COUNT) != 0) {
+    return VAL_ERROR;
+  }
+
+  /* Attempt to clear the alarms in the LED driver */
+  SYS_Coordinator_Command_t command = { .type = SYS_COORD_CMD_CLEAR_ALARM, .mask = mask, .failed = failed };
+  return SYS_Coordinator_PostCommand(&command);
+}
+
+/**
+ * @brief Queue the clearing of a light source's alarm from an interrupt
+ * @note Returns without waiting; the coordinator task applies the command
+ *       as SYS_Coordinator_ClearLightAlarm would, so an alarm whose cause
+ *       is still present stays
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @return VAL_Status VAL_OK once queued, VAL_ERROR for an invalid ID,
+ *         VAL_BUSY if the queue is full or the coordinator is not running
+ */
+VAL_Status SYS_Coordinator_ClearLightAlarmFromISR(uint8_t light_id) {
+  if (light_id < 1 || light_id > VAL_LIGHT_COUNT) {
+    return VAL_ERROR;
+  }
+
+  return SYS_Coordinator_ClearLightAlarmsFromISR(1UL << (light_id - 1));
+}
+
+/**
+ * @brief Queue the clearing of a set of light sources' alarms from an interrupt
+ * @note One queue entry for the whole set, applied as
+ *       SYS_Coordinator_ClearLightAlarms would
+ * @param mask Bit n for light n+1, none above VAL_LIGHT_COUNT
+ * @return VAL_Status VAL_OK once queued, VAL_ERROR for an empty or invalid
+ *         mask, VAL_BUSY if the queue is full or the coordinator is not running
+ */
+VAL_Status SYS_Coordinator_ClearLightAlarmsFromISR(uint32_t mask) {
+  if (mask == 0 || (mask >> VAL_LIGHT_COUNT) != 0) {
+    return VAL_ERROR;
+  }
+
+  SYS_Coordinator_Command_t command = { .type = SYS_COORD_CMD_CLEAR_ALARM, .mask = mask };
+  return SYS_Coordinator_PostCommandFromISR(&command);
+}
+
+/**
+ * @brief Get the alarm state machine of a light source
+ * @note Read from the LED driver, the state changes in the ADC interrupt
+ * @param lightId Light source ID (1-VAL_LIGHT_COUNT)
+ * @param info Pointer to store the alarm state
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_GetAlarmInfo(uint8_t light_id, LED_Driver_AlarmInfo_t* info) {
+  return LED_Driver_GetAlarmInfo(light_id, info);
+}
+
+/**
+ * @brief Get the persistent settings in use, or those staged
+ * @param settings Pointer to store the settings
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if settings is NULL
+ */
+VAL_Status SYS_Coordinator_GetConfig(Config_Settings_t* settings) {
+  return Config_Get(settings);
+}
+
+/**
+ * @brief Apply new persistent settings and store them in flash
+ * @note Storing stalls the CPU for a flash page erase
+ * @param settings New settings
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         applied but not stored
+ */
+VAL_Status SYS_Coordinator_SetConfig(const Config_Settings_t* settings) {
+  return Config_Set(settings);
+}
+
+/**
+ * @brief Start staging settings changes, applied together by
+ *        SYS_Coordinator_CommitConfig
+ * @note Until then SYS_Coordinator_SetConfig only checks and keeps them
+ * @return VAL_Status As Config_Begin
+ */
+VAL_Status SYS_Coordinator_BeginConfig(void) {
+  return Config_Begin();
+}
+
+/**
+ * @brief Apply the staged settings at once and store them in flash
+ * @note Storing stalls the CPU for a flash page erase
+ * @return VAL_Status As Config_Commit
+ */
+VAL_Status SYS_Coordinator_CommitConfig(void) {
+  return Config_Commit();
+}
+
+/**
+ * @brief Drop the staged settings
+ * @return None
+ */
+void SYS_Coordinator_AbortConfig(void) {
+  Config_Abort();
+}
+
+/**
+ * @brief Check whether settings changes are being staged
+ * @return bool true if SYS_Coordinator_GetConfig returns staged settings
+ */
+bool SYS_Coordinator_IsConfigStaged(void) {
+  return Config_IsStaging();
+}
+
+/**
+ * @brief Get the sensor calibration of a light
+ * @param light_id Light source ID (1-VAL_LIGHT_COUNT)
+ * @param calibration Pointer to store the calibration
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid
+ */
+VAL_Status SYS_Coordinator_GetCalibration(uint8_t light_id, AnalogCalibration* calibration) {
+  return Config_GetCalibration(light_id, calibration);
+}
+
+/**
+ * @brief Apply a new sensor calibration to a light and store it in flash
+ * @note Storing stalls the CPU for a flash page erase
+ * @param light_id Light source ID (1-VAL_LIGHT_COUNT)
+ * @param calibration New calibration
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         applied but not stored
+ */
+VAL_Status SYS_Coordinator_SetCalibration(uint8_t light_id, const AnalogCalibration* calibration) {
+  return Config_SetCalibration(light_id, calibration);
+}
+
+/**
+ * @brief Get a saved scene
+ * @param scene Scene number (1-CONFIG_SCENE_COUNT)
+ * @param data Pointer to store the scene
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR if never saved, VAL_PARAM if invalid
+ */
+VAL_Status SYS_Coordinator_GetScene(uint8_t scene, Config_Scene_t* data) {
+  return Config_GetScene(scene, data);
+}
+
+/**
+ * @brief Save a scene and store it in flash
+ * @note Storing stalls the CPU for a flash page erase
+ * @param scene Scene number (1-CONFIG_SCENE_COUNT)
+ * @param data New scene
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         not stored, the previous scene stays in use
+ */
+VAL_Status SYS_Coordinator_SaveScene(uint8_t scene, const Config_Scene_t* data) {
+  return Config_SetScene(scene, data);
+}
+
+/**
+ * @brief Get a saved command macro
+ * @param macro Macro number (1-CONFIG_MACRO_COUNT)
+ * @param data Pointer to store the macro
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR if never saved or
+ *         cleared, VAL_PARAM if invalid
+ */
+VAL_Status SYS_Coordinator_GetMacro(uint8_t macro, Config_Macro_t* data) {
+  return Config_GetMacro(macro, data);
+}
+
+/**
+ * @brief Save a command macro and store it in flash
+ * @param macro Macro number (1-CONFIG_MACRO_COUNT)
+ * @param data New macro, its commands already checked
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR if
+ *         not stored, the previous macro stays in use
+ */
+VAL_Status SYS_Coordinator_SaveMacro(uint8_t macro, const Config_Macro_t* data) {
+  return Config_SetMacro(macro, data);
+}
+
+/**
+ * @brief Read part of an export of the whole configuration
+ * @param offset Byte offset into the export, 0 takes a new snapshot
+ * @param data Buffer to store the bytes
+ * @param max Size of the buffer
+ * @param length Pointer to store the bytes read
+ * @param size Pointer to store the size of the whole export
+ * @return VAL_Status As Config_Export
+ */
+VAL_Status SYS_Coordinator_ExportConfig(uint32_t offset, uint8_t* data, uint16_t max, uint16_t* length, uint16_t* size) {
+  return Config_Export(offset, data, max, length, size);
+}
+
+/**
+ * @brief Receive part of an export, and import it once complete
+ * @note The last part stores every record that changed, each stalling the
+ *       CPU for a flash page erase
+ * @param offset Byte offset of the part, 0 starts over
+ * @param data Bytes of the part
+ * @param length Number of bytes
+ * @param received Pointer to store the bytes received
+ * @param complete Pointer to store true if this was the last part
+ * @return VAL_Status As Config_Import
+ */
+VAL_Status SYS_Coordinator_ImportConfig(uint32_t offset, const uint8_t* data, uint16_t length, uint16_t* received, bool* complete) {
+  return Config_Import(offset, data, length, received, complete);
+}
+
+/**
+ * @brief Apply a saved scene to some or all light sources at once
+ * @note Taken from the RAM copy; the lights change in the same PWM period,
+ *       or fade together with the scene's fade time. Lights outside the
+ *       mask keep their outputs.
+ * @param scene Scene number (1-CONFIG_SCENE_COUNT)
+ * @param mask Lights to apply the scene to, bit 0 for light 1
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_RecallScene(uint8_t scene, uint32_t mask) {
+  Config_Scene_t data;
+
+  if (mask == 0 || (mask & ~CONFIG_LIGHTS_ALL) != 0 || Config_GetScene(scene, &data) != VAL_OK) {
+    return VAL_ERROR;
+  }
+
+  SYS_Coordinator_Command_t command = {
+    .type = SYS_COORD_CMD_FADE_ALL, .option = data.curve, .duration_ms = data.duration_ms
+  };
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    command.permille[i] = (mask & (1UL << i)) ? data.permille[i] : LED_DRIVER_PERMILLE_HOLD;
+  }
+  return SYS_Coordinator_PostCommand(&command);
+}
+
+/**
+ * @brief Get the lights of a light group
+ * @param group Group number (1-CONFIG_LIGHT_GROUPS)
+ * @param mask Pointer to store the lights, bit 0 for light 1
+ * @return VAL_Status As Config_GetLightGroup
+ */
+VAL_Status SYS_Coordinator_GetLightGroup(uint8_t group, uint32_t* mask) {
+  return Config_GetLightGroup(group, mask);
+}
+
+/**
+ * @brief Put the lights in their failsafe state, the host link went silent
+ * @note Called from the communications task. A scene fades with its own
+ *       fade time; all lights off, and a scene that was never saved, cut
+ *       the outputs at once. A DMX512 desk or a Modbus master has the link
+ *       meanwhile and keeps the lights.
+ * @param scene Scene to recall (1-CONFIG_SCENE_COUNT), 0 to turn all lights off
+ * @return VAL_Status VAL_OK if successful, VAL_BUSY while DMX512 or Modbus
+ *         is active, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_EnterFailsafe(uint8_t scene) {
+  if (dmx_active || Modbus_IsActive()) {
+    return VAL_BUSY;
+  }
+
+  if (scene != 0 && SYS_Coordinator_RecallScene(scene, CONFIG_LIGHTS_ALL) == VAL_OK) {
+    return VAL_OK;
+  }
+
+  SYS_Coordinator_Command_t command = { .type = SYS_COORD_CMD_SET_ALL };
+  return SYS_Coordinator_PostCommand(&command);
+}
+
+/**
+ * @brief Turn all light sources off and stop whatever drives them
+ * @note  alarm/blackout: the cue sequence and a strobe stop, then every
+ *        light is set to 0, which ends fades, effects and current loops.
+ *        Unlike the failsafe no scene is recalled.
+ * @return VAL_Status VAL_OK if successful, VAL_BUSY while DMX512 or Modbus
+ *         is active, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_Blackout(void) {
+  uint16_t permille[VAL_LIGHT_COUNT] = { 0 };
+
+  if (dmx_active || Modbus_IsActive()) {
+    return VAL_BUSY;
+  }
+
+  Sequencer_Stop();
+  (void)LED_Driver_StopStrobe();
+  return SYS_Coordinator_SetAllLightPermille(permille);
+}
+
+/**
+ * @brief Turn all light sources off from an interrupt, ahead of the queue
+ * @note  The fast path of alarm/blackout, from the RX interrupt. The cue
+ *        sequence stops and the driver cuts every output in place
+ *        (LED_Driver_Blackout); a set-all to 0 is then queued, so the task
+ *        publishes the state and turns off again whatever a command it was
+ *        running at that moment wrote.
+ * @return VAL_Status VAL_OK once the outputs are off, VAL_BUSY if the
+ *         coordinator is not running or DMX512 or Modbus is active
+ */
+VAL_Status SYS_Coordinator_BlackoutFromISR(void) {
+  SYS_Coordinator_Command_t command = { .type = SYS_COORD_CMD_SET_ALL };
+
+  if (!coordinator_ready || dmx_active || Modbus_IsActive()) {
+    return VAL_BUSY;
+  }
+
+  Sequencer_Stop();
+  LED_Driver_Blackout();
+
+  /* With the queue full the command itself sets them from the task */
+  (void)SYS_Coordinator_PostCommandFromISR(&command);
+  return VAL_OK;
+}
+
+/**
+ * @brief Append a cue to the sequence
+ * @param cue Cue to add
+ * @return VAL_Status As Sequencer_AddCue
+ */
+VAL_Status SYS_Coordinator_AddCue(const Sequencer_Cue_t* cue) {
+  return Sequencer_AddCue(cue);
+}
+
+/**
+ * @brief Stop the sequence and empty its cue list
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status SYS_Coordinator_ClearSequence(void) {
+  return Sequencer_Clear();
+}
+
+/**
+ * @brief Play the sequence from the start
+ * @param periodUs Loop period in microseconds, 0 to play once
+ * @return VAL_Status As Sequencer_Start
+ */
+VAL_Status SYS_Coordinator_StartSequence(uint32_t period_us) {
+  LED_Driver_StopStrobe();
+  return Sequencer_Start(period_us);
+}
+
+/**
+ * @brief Stop the sequence, the lights keep their intensities
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status SYS_Coordinator_StopSequence(void) {
+  return Sequencer_Stop();
+}
+
+/**
+ * @brief Get the sequence state
+ * @param status Pointer to store the state
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status SYS_Coordinator_GetSequenceStatus(Sequencer_Status_t* status) {
+  return Sequencer_GetStatus(status);
+}
+
+/**
+ * @brief Fire all light sources from the external trigger input or at a rate
+ * @param durationUs Pulse length in microseconds
+ * @param periodUs Pulse period in microseconds, 0 to fire on the trigger input
+ * @param permille Intensity per light during the pulse (0-1000)
+ * @param fallingEdge Fire on the falling instead of the rising edge
+ * @return VAL_Status As LED_Driver_StartStrobe
+ */
+VAL_Status SYS_Coordinator_StartStrobe(uint32_t duration_us, uint32_t period_us, const uint16_t* permille,
+                                       bool falling_edge) {
+  Sequencer_Stop();
+  VAL_Status status = LED_Driver_StartStrobe(duration_us, period_us, permille, falling_edge);
+  if (status == VAL_OK) {
+    memset(SYS_Coordinator_BeginUpdate()->permille, 0, sizeof(state_copies[0].permille));
+    SYS_Coordinator_EndUpdate();
+  }
+
+  return status;
+}
+
+/**
+ * @brief Return to continuous operation with all light sources off
+ * @return VAL_Status As LED_Driver_StopStrobe
+ */
+VAL_Status SYS_Coordinator_StopStrobe(void) {
+  return LED_Driver_StopStrobe();
+}
+
+/**
+ * @brief Get the strobe configuration and counts
+ * @param status Pointer to store the state
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status SYS_Coordinator_GetStrobeStatus(LED_Driver_StrobeStatus_t* status) {
+  return LED_Driver_GetStrobeStatus(status);
+}
+
+/**
+ * @brief Append a rule to the rules table
+ * @param rule Rule to add
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if invalid, VAL_ERROR
+ *         if the table is full
+ */
+VAL_Status SYS_Coordinator_AddRule(const Rules_Rule_t* rule) {
+  VAL_Status status;
+
+  if (Config_CheckRule(rule) != VAL_OK) {
+    return VAL_PARAM;
+  }
+
+  /* The coordinator evaluates the table on every sample */
+  taskENTER_CRITICAL();
+  status = Rules_Add(rule);
+  taskEXIT_CRITICAL();
+
+  return status;
+}
+
+/**
+ * @brief Empty the rules table
+ * @return VAL_Status VAL_OK
+ */
+VAL_Status SYS_Coordinator_ClearRules(void) {
+  taskENTER_CRITICAL();
+  (void)Rules_Clear();
+  taskEXIT_CRITICAL();
+
+  return VAL_OK;
+}
+
+/**
+ * @brief Get the rules table size and counters
+ * @param status Pointer to store them
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status SYS_Coordinator_GetRulesStatus(Rules_Status_t* status) {
+  VAL_Status result;
+
+  taskENTER_CRITICAL();
+  result = Rules_GetStatus(status);
+  taskEXIT_CRITICAL();
+
+  return result;
+}
+
+/**
+ * @brief Check whether DMX512 mode can start at a channel
+ * @param channel DMX channel of light 1; the others follow it
+ * @return VAL_Status VAL_OK if it can, VAL_PARAM if the lights would not fit
+ *         into the 512 channels, VAL_BUSY if DMX512 or Modbus mode is running
+ */
+VAL_Status SYS_Coordinator_CheckDmx(uint16_t channel) {
+  if (channel < 1 || channel > SYS_COORD_DMX_CHANNELS - VAL_LIGHT_COUNT + 1) {
+    return VAL_PARAM;
+  }
+
+  return (dmx_active || Modbus_IsActive()) ? VAL_BUSY : VAL_OK;
+}
+
+/**
+ * @brief Hand the lights and the serial link over to a DMX512 desk
+ * @note The host link stops until no packet has arrived for a second; the
+ *       lights then keep the last levels received
+ * @param channel DMX channel of light 1; the others follow it
+ * @return VAL_Status As SYS_Coordinator_CheckDmx, else as VAL_Serial_StartDmx
+ */
+VAL_Status SYS_Coordinator_StartDmx(uint16_t channel) {
+  VAL_Status status = SYS_Coordinator_CheckDmx(channel);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  SYS_Coordinator_ReleaseOutputs();
+
+  taskENTER_CRITICAL();
+  dmx_channel = channel;
+  dmx_packets = 0;
+  dmx_ignored = 0;
+  dmx_dropped = 0;
+  dmx_last_tick = xTaskGetTickCount();
+  dmx_active = true;
+  taskEXIT_CRITICAL();
+
+  status = VAL_Serial_StartDmx(SYS_Coordinator_DmxPacketCallback);
+  if (status != VAL_OK) {
+    dmx_active = false;
+  }
+
+  return status;
+}
+
+/**
+ * @brief Get the DMX512 state and the counts of the last session
+ * @param status Pointer to store the state
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM if status is NULL
+ */
+VAL_Status SYS_Coordinator_GetDmxStatus(SYS_Coordinator_DmxStatus_t* status) {
+  if (status == NULL) {
+    return VAL_PARAM;
+  }
+
+  taskENTER_CRITICAL();
+  status->active = dmx_active;
+  status->channel = dmx_channel;
+  status->packets = dmx_packets;
+  status->ignored = dmx_ignored;
+  status->dropped = dmx_active ? VAL_Serial_GetDmxDropped() : dmx_dropped;
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    status->levels[i] = dmx_levels[i];
+  }
+  taskEXIT_CRITICAL();
+
+  return VAL_OK;
+}
+
+/**
+ * @brief Get alarm status for all light sources
+ * @param alarms Array to store alarm status (must hold VAL_LIGHT_COUNT entries)
+ * @return VAL_Status VAL_OK if successful, VAL_ERROR otherwise
+ */
+VAL_Status SYS_Coordinator_GetAlarmStatus(uint8_t* alarms) {
+  SYS_Coordinator_State_t state;
+
+  /* Validate input parameter */
+  if (alarms == NULL) {
+    return VAL_ERROR;
+  }
+
+  /* Alarm status as last synchronized from the LED driver */
+  SYS_Coordinator_ReadState(&state);
+  memcpy(alarms, state.alarms, sizeof(state.alarms));
+  return VAL_OK;
+}
+
+/**
+ * @brief Start, change or stop a periodic telemetry stream
+ * @param stream Stream number (1-COMMS_TELEMETRY_STREAMS)
+ * @param rateHz Samples per second, 0 to stop
+ * @param fields COMMS_TELEMETRY_* fields to stream
+ * @param onChange Deadbands and heartbeat to send samples only on change,
+ *        NULL to send every sample
+ * @return VAL_Status VAL_OK if successful, VAL_PARAM for an unknown stream,
+ *         an unsupported rate, a negative deadband or a heartbeat over a
+ *         minute
+ */
+VAL_Status SYS_Coordinator_SetTelemetry(uint8_t stream, uint8_t rate_hz, uint8_t fields,
+                                        const SYS_Coordinator_OnChange_t* on_change) {
+  SYS_Coordinator_OnChange_t settings = { false, 0, 0, 0 };
+  SYS_Coordinator_Telemetry_t* subscription;
+
+  if (stream == 0 || stream > COMMS_TELEMETRY_STREAMS ||
+      rate_hz > SYS_COORDINATOR_TELEMETRY_MAX_HZ) {
+    return VAL_PARAM;
+  }
+  subscription = &telemetry[stream - 1];
+  if (on_change != NULL) {
+    if (on_change->current_ma < 0 || on_change->temperature_cdeg < 0 ||
+        on_change->heartbeat_ms > SYS_COORDINATOR_HEARTBEAT_MAX_MS) {
+      return VAL_PARAM;
+    }
+    settings = *on_change;
+    settings.enabled = true;
+    if (settings.heartbeat_ms == 0) {
+      settings.heartbeat_ms = SYS_COORDINATOR_HEARTBEAT_MS;
+    }
+  }
+
+  /* The coordinator task reads all values together; the first sample is
+   * sent whatever it holds */
+  taskENTER_CRITICAL();
+  subscription->period = (rate_hz > 0) ? pdMS_TO_TICKS(1000 / rate_hz) : 0;
+  subscription->fields = fields & COMMS_TELEMETRY_ALL;
+  subscription->on_change = settings;
+  subscription->last = xTaskGetTickCount() - subscription->period;
+  subscription->sent = xTaskGetTickCount() - pdMS_TO_TICKS(settings.heartbeat_ms);
+  subscription->skipped = 0;
+  taskEXIT_CRITICAL();
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Check whether any telemetry stream is running
+ * @retval bool: true if samples are being streamed
+ */
+bool SYS_Coordinator_IsTelemetryActive(void) {
+  for (uint8_t i = 0; i < COMMS_TELEMETRY_STREAMS; i++) {
+    if (telemetry[i].period != 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Convert a permille intensity to the nearest percent
+ * @param  permille: Intensity value (0-1000)
+ * @retval uint8_t: Intensity value (0-100)
+ */
+static uint8_t SYS_Coordinator_PermilleToPercent(uint16_t permille) {
+    return (uint8_t)((permille + SYS_COORD_PERMILLE_PER_PERCENT / 2) / SYS_COORD_PERMILLE_PER_PERCENT);
+}
+
+/**
+ * @brief  System coordinator task
+ * @param  argument: Task argument
+ * @retval None
+ */
+static void SYS_Coordinator_Task(void const *argument) {
+    /* Initialize */
+    VAL_Status status;
+    uint32_t events;
+    LightSensorData_t sensors[VAL_LIGHT_COUNT];
+    LightSampleStamp_t sensors_stamp;
+    uint16_t derate[VAL_LIGHT_COUNT];
+    uint16_t permille[VAL_LIGHT_COUNT];
+    uint8_t alarms[VAL_LIGHT_COUNT];
+    TickType_t ageing_checked = xTaskGetTickCount();
+    bool adc_down = false;
+
+    /* Task main loop */
+    for (;;) {
+        /* Sleep until an event arrives, or the scheduler's poll */
+#ifdef BENCHMARK
+        Profiler_WakeupArm(PROFILER_WAKEUP_ADC);
+#endif
+        (void)xTaskNotifyWait(0, SYS_COORD_EVT_ALL, &events, portMAX_DELAY);
+#ifdef BENCHMARK
+        Profiler_WakeupDone(PROFILER_WAKEUP_ADC);
+#endif
+        Supervisor_Begin(SUPERVISOR_TASK_COORDINATOR);
+
+        /* Levels from the desk go out before anything else is synchronized */
+        if (events & SYS_COORD_EVT_DMX_PACKET) {
+            SYS_Coordinator_ApplyDmx();
+        }
+        SYS_Coordinator_CheckDmxSignal();
+        Modbus_CheckSignal();
+#if VAL_SPI_SLAVE_ENABLED
+        SpiLink_Poll();
+#endif
+
+        /* Then the light commands of the host, in the order posted */
+        if (events & (SYS_COORD_EVT_COMMAND | SYS_COORD_EVT_POLL)) {
+            SYS_Coordinator_RunCommands();
+        }
+
+        /* Restart sampling after an ADC error first; the poll retries
+         * until it succeeds */
+        if ((events & SYS_COORD_EVT_ADC_ERROR) || (adc_down && (events & SYS_COORD_EVT_POLL))) {
+            status = VAL_Analog_Recover();
+            Jitter_Resync();
+            adc_down = (status != VAL_OK);
+            if (status != VAL_OK)
+              LOGGER_LOG(LOGGER_LEVEL_ERROR, LOGGER_MSG_ADC_RECOVERY_FAILED, status, 0);
+        }
+
+        /* Synchronize all sensor data and the derating that follows it;
+         * alarms are evaluated in the ADC interrupt */
+        if (events & SYS_COORD_EVT_SAMPLE_READY) {
+            status = LED_Driver_GetAllSensorData(sensors, &sensors_stamp);
+            if(status != VAL_OK)
+              LOGGER_LOG(LOGGER_LEVEL_ERROR, LOGGER_MSG_SENSOR_SYNC_FAILED, status, 0);
+            (void)LED_Driver_GetDerating(derate);
+
+            SYS_Coordinator_State_t* state = SYS_Coordinator_BeginUpdate();
+            memcpy(state->sensors, sensors, sizeof(sensors));
+            state->sensors_stamp = sensors_stamp;
+            memcpy(state->derate, derate, sizeof(derate));
+            SYS_Coordinator_EndUpdate();
+        }
+
+        /* An alarm may have changed meanwhile; pick that up now */
+        uint32_t pending_events = 0;
+        if (xTaskNotifyWait(0, SYS_COORD_EVT_ALL, &pending_events, 0) == pdTRUE) {
+            events |= pending_events;
+        }
+
+        /* Synchronize all light intensities; regulated lights change their
+         * duty cycle without an event, so follow the samples too */
+        if (events & (SYS_COORD_EVT_INTENSITY_CHANGED | SYS_COORD_EVT_SAMPLE_READY |
+                      SYS_COORD_EVT_POLL)) {
+            status = LED_Driver_GetAllIntensitiesPermille(permille);
+            if(status != VAL_OK)
+              LOGGER_LOG(LOGGER_LEVEL_ERROR, LOGGER_MSG_INTENSITY_SYNC_FAILED, status, 0);
+
+            memcpy(SYS_Coordinator_BeginUpdate()->permille, permille, sizeof(permille));
+            SYS_Coordinator_EndUpdate();
+
+            /* Kept through a reset, for the power-on mode "last" */
+            if (events & (SYS_COORD_EVT_INTENSITY_CHANGED | SYS_COORD_EVT_SAMPLE_READY)) {
+                Restore_Record(permille);
+            }
+        }
+
+        /* Synchronize all alarms */
+        if (events & (SYS_COORD_EVT_ALARM_CHANGED | SYS_COORD_EVT_POLL)) {
+            status = LED_Driver_GetAlarmStatus(alarms);
+            if(status != VAL_OK)
+              LOGGER_LOG(LOGGER_LEVEL_ERROR, LOGGER_MSG_ALARM_SYNC_FAILED, status, 0);
+
+            memcpy(SYS_Coordinator_BeginUpdate()->alarms, alarms, sizeof(alarms));
+            SYS_Coordinator_EndUpdate();
+
+            SYS_Coordinator_CheckNewAlarms();
+        }
+
+        /* Follow the usage with the ageing compensation; the scheduler's
+         * poll keeps this going while nothing else wakes the task */
+        if ((xTaskGetTickCount() - ageing_checked) >= pdMS_TO_TICKS(SYS_COORD_AGEING_CHECK_MS)) {
+            ageing_checked = xTaskGetTickCount();
+            LED_Driver_UpdateAgeing();
+        }
+
+        /* Warn the host of lights heading for an over-temperature trip */
+        if (events & SYS_COORD_EVT_THERMAL_WARNING) {
+            SYS_Coordinator_CheckThermalWarnings();
+        }
+
+        /* The outputs were shed or are coming back, say why */
+        if (events & SYS_COORD_EVT_POWER_WARNING) {
+            SYS_Coordinator_ReportPowerWarning();
+        }
+
+        /* Act on the rules with the values just synchronized */
+        if (events & SYS_COORD_EVT_SAMPLE_READY) {
+            SYS_Coordinator_RunRules(sensors);
+        }
+
+        /* Push telemetry with the freshly synchronized data */
+        if (events & SYS_COORD_EVT_SAMPLE_READY) {
+            SYS_Coordinator_ServeTelemetry();
+        }
+        Supervisor_End(SUPERVISOR_TASK_COORDINATOR);
+    }
+}
+
+/**
+ * @brief  Send a telemetry sample to every subscription that is due
+ * @note   The state is read once for all of them. While the link cannot
+ *         keep up, whole samples are skipped at a steady ratio rather than
+ *         lost wherever the queue happens to be full; each sample carries
+ *         the rate that results.
+ * @retval None
+ */
+static void SYS_Coordinator_ServeTelemetry(void) {
+    COMMS_Telemetry_Stream_t due[COMMS_TELEMETRY_STREAMS];
+    uint8_t index[COMMS_TELEMETRY_STREAMS];
+    uint8_t count = 0;
+    bool state_read = false;
+    bool busy = false;
+    SYS_Coordinator_State_t state;
+    uint8_t intensities[VAL_LIGHT_COUNT];
+    TickType_t now = xTaskGetTickCount();
+
+    for (uint8_t i = 0; i < COMMS_TELEMETRY_STREAMS; i++) {
+        SYS_Coordinator_Telemetry_t* stream = &telemetry[i];
+        TickType_t period;
+        uint8_t fields;
+
+        taskENTER_CRITICAL();
+        period = stream->period;
+        fields = stream->fields;
+        taskEXIT_CRITICAL();
+
+        if (period == 0 || (now - stream->last) < period) {
+            continue;
+        }
+
+        /* Keep the average rate, but do not try to catch up after a stall */
+        stream->last += period;
+        if ((now - stream->last) >= period) {
+            stream->last = now;
+        }
+
+        if (++stream->skipped < telemetry_decimate) {
+            continue;
+        }
+        stream->skipped = 0;
+
+        if (!state_read) {
+            SYS_Coordinator_ReadState(&state);
+            state_read = true;
+        }
+
+        /* Nothing worth a sample yet; the heartbeat shows the stream is alive */
+        if (!SYS_Coordinator_TelemetryChanged(&state, stream)) {
+            continue;
+        }
+
+        due[count].stream = i + 1;
+        due[count].fields = fields;
+        due[count].rate_centihz = (uint16_t)((100U * configTICK_RATE_HZ) / (period * telemetry_decimate));
+        due[count].status = VAL_ERROR;
+        index[count++] = i;
+    }
+
+    if (count == 0) {
+        return;
+    }
+    SYS_Coordinator_PaceTelemetry(Transport_GetTxFill());
+
+    for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        intensities[i] = SYS_Coordinator_PermilleToPercent(state.permille[i]);
+    }
+
+    /* A sample that found no room is compared again with the one before */
+    COMMS_Handler_SendTelemetry(due, count, intensities, state.sensors, state.alarms);
+    for (uint8_t i = 0; i < count; i++) {
+        SYS_Coordinator_Telemetry_t* stream = &telemetry[index[i]];
+
+        if (due[i].status == VAL_OK) {
+            stream->reported = state;
+            taskENTER_CRITICAL();
+            stream->sent = now;
+            taskEXIT_CRITICAL();
+        } else if (due[i].status == VAL_BUSY) {
+            busy = true;
+        }
+    }
+    if (busy) {
+        SYS_Coordinator_PaceTelemetry(1000);
+    }
+}
+
+/**
+ * @brief  Adapt the telemetry rate to how full the TX queue is
+ * @note   Called for every sample about to be sent
+ * @param  fill: TX queue fill in permille, 1000 when a sample found no room
+ * @retval None
+ */
+static void SYS_Coordinator_PaceTelemetry(uint16_t fill) {
+    if (fill >= SYS_COORDINATOR_TELEMETRY_FILL_HIGH) {
+        if (telemetry_decimate < SYS_COORDINATOR_TELEMETRY_DECIMATE_MAX) {
+            telemetry_decimate *= 2;
+        }
+        telemetry_calm = 0;
+    } else if (fill > SYS_COORDINATOR_TELEMETRY_FILL_LOW) {
+        telemetry_calm = 0;
+    } else if (telemetry_decimate > 1 && ++telemetry_calm >= SYS_COORDINATOR_TELEMETRY_RECOVER) {
+        telemetry_decimate /= 2;
+        telemetry_calm = 0;
+    }
+}
+
+/**
+ * @brief  Check whether a due sample is worth sending to a stream
+ * @note   Always for a plain subscription; on change, when it differs from
+ *         the last sample the stream sent in any streamed field, readings
+ *         only once they move past the deadband, or the heartbeat expired
+ * @param  state: State the sample would carry
+ * @param  stream: Subscription
+ * @retval bool: true if the sample is worth sending
+ */
+static bool SYS_Coordinator_TelemetryChanged(const SYS_Coordinator_State_t* state,
+                                             const SYS_Coordinator_Telemetry_t* stream) {
+    const SYS_Coordinator_State_t* sent = &stream->reported;
+    SYS_Coordinator_OnChange_t on_change;
+    uint8_t fields;
+    TickType_t last_sent;
+
+    taskENTER_CRITICAL();
+    on_change = stream->on_change;
+    fields = stream->fields;
+    last_sent = stream->sent;
+    taskEXIT_CRITICAL();
+
+    if (!on_change.enabled ||
+        (xTaskGetTickCount() - last_sent) >= pdMS_TO_TICKS(on_change.heartbeat_ms)) {
+        return true;
+    }
+
+    for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        if ((fields & COMMS_TELEMETRY_INTENSITY) &&
+            SYS_Coordinator_PermilleToPercent(state->permille[i]) !=
+            SYS_Coordinator_PermilleToPercent(sent->permille[i])) {
+            return true;
+        }
+        if ((fields & COMMS_TELEMETRY_ALARMS) && state->alarms[i] != sent->alarms[i]) {
+            return true;
+        }
+        if ((fields & COMMS_TELEMETRY_DERATE) && state->derate[i] != sent->derate[i]) {
+            return true;
+        }
+        if ((fields & COMMS_TELEMETRY_CURRENT) &&
+            fabsf(state->sensors[i].current - sent->sensors[i].current) >
+            (float)on_change.current_ma) {
+            return true;
+        }
+        if ((fields & COMMS_TELEMETRY_TEMPERATURE) &&
+            fabsf(state->sensors[i].temperature - sent->sensors[i].temperature) * 100.0f >
+            (float)on_change.temperature_cdeg) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief  Error log task, stores queued log entries, usage checkpoints and
+ *         alarm recordings in flash
+ * @note   Lowest application priority: a page erase stalls the CPU, and
+ *         nothing else waits for it
+ * @param  argument: Task argument
+ * @retval None
+ */
+static void SYS_Coordinator_LogTask(void const *argument) {
+    const TickType_t retry_ticks = pdMS_TO_TICKS(SYS_COORD_LOG_RETRY_MS);
+    TickType_t wait = portMAX_DELAY;
+
+    for (;;) {
+        /* Woken per logged alarm and by the checkpoint job; entries queued
+         * meanwhile go in one batch */
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        Supervisor_Begin(SUPERVISOR_TASK_ERROR_LOG);
+        wait = (VAL_DataStore_FlushErrorLogs() == VAL_BUSY) ? retry_ticks : portMAX_DELAY;
+
+        /* Woken by the alarm that froze a recording; it is summarized and
+         * stored once the scans after the trip are in */
+        if (Recorder_Save() == VAL_BUSY) {
+            wait = retry_ticks;
+        }
+
+        if (usage_save_due) {
+            /* The lifetime counters go with the usage, at the same rate */
+            VAL_Status status = SYS_Coordinator_SaveUsage();
+            if (status != VAL_BUSY) {
+                status = Counters_Save();
+            }
+            if (status == VAL_BUSY) {
+                wait = retry_ticks;
+            } else {
+                usage_save_due = false;
+            }
+        }
+        Supervisor_End(SUPERVISOR_TASK_ERROR_LOG);
+    }
+}
+
+/**
+ * @brief  Store the usage counters, unless they are the ones stored last
+ * @note   Error log task only
+ * @retval VAL_Status: VAL_OK if stored or unchanged, VAL_BUSY if flash was
+ *         in use, VAL_ERROR if the write failed
+ */
+static VAL_Status SYS_Coordinator_SaveUsage(void) {
+    LED_Driver_GetUsage(usage_pending);
+    if (memcmp(usage_pending, usage_saved, sizeof(usage_saved)) == 0) {
+        return VAL_OK;
+    }
+
+    VAL_Status status = VAL_DataStore_SaveUsage(SYS_COORD_USAGE_VERSION, usage_pending,
+                                                sizeof(usage_pending));
+    if (status == VAL_OK) {
+        memcpy(usage_saved, usage_pending, sizeof(usage_saved));
+    }
+
+    return status;
+}
+
+/**
+ * @brief  Erase gate of the data store, defers erases while the outputs are busy
+ * @note   Error log task only, the one that makes background writes
+ * @retval bool: true if a page may be erased now
+ */
+static bool SYS_Coordinator_MayErase(void) {
+    TickType_t now = xTaskGetTickCount();
+
+    if (LED_Driver_IsIdle() || (!LED_Driver_IsControlActive() && !Sequencer_IsRunning())) {
+        erase_deferred = false;
+        return true;
+    }
+
+    if (!erase_deferred) {
+        erase_deferred = true;
+        erase_deferred_tick = now;
+        return false;
+    }
+
+    /* Waited long enough, the queued entries must not be lost */
+    if ((now - erase_deferred_tick) >= pdMS_TO_TICKS(SYS_COORD_ERASE_DEFER_MS)) {
+        erase_deferred = false;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief  Send event notifications for newly raised alarms
+ * @retval None
+ */
+static void SYS_Coordinator_CheckNewAlarms(void) {
+    SYS_Coordinator_State_t state;
+    COMMS_Alarm_Source_t new_alarms[VAL_LIGHT_COUNT];
+    uint8_t new_count = 0;
+
+    SYS_Coordinator_ReadState(&state);
+    for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        if (state.alarms[i] != 0 && previous_light_alarms[i] == 0) {
+            /* New alarm detected - send event notification */
+            float value = 0.0f;
+
+            /* Use the appropriate sensor value based on alarm type */
+            if (state.alarms[i] == 1) { /* ERROR_OVER_CURRENT */
+                value = state.sensors[i].current;
+            } else if (state.alarms[i] == 2) { /* ERROR_OVER_TEMPERATURE */
+                value = state.sensors[i].temperature;
+            }
+
+            /* The event carries the time of the trip, not of this poll */
+            LED_Driver_AlarmInfo_t info;
+            uint64_t trip_us = 0;
+            if (LED_Driver_GetAlarmInfo(i + 1, &info) == VAL_OK) {
+                trip_us = info.trip_us;
+            }
+
+            /* Alarms of the same sample go out as one event */
+            new_alarms[new_count].light_id = i + 1;
+            new_alarms[new_count].error_type = state.alarms[i];
+            new_alarms[new_count].value = value;
+            new_alarms[new_count].trip_us = trip_us;
+            new_count++;
+            Recorder_NoteAlarm(i + 1, state.alarms[i], trip_us);
+
+            /* Log the alarm event; only queued, the log task stores it */
+            VAL_DataStore_SetActiveError(i + 1, (ErrorType_t)state.alarms[i], value);
+            VAL_DataStore_LogErrorEvent(i + 1, (ErrorType_t)state.alarms[i], value,
+                                        VAL_DATA_STORE_ACTION_LIGHT_DISABLED);
+            xTaskNotifyGive(logTaskHandle);
+        } else if (state.alarms[i] == 0 && previous_light_alarms[i] != 0) {
+            VAL_DataStore_ClearActiveError(i + 1);
+        }
+
+        /* Update previous alarm state */
+        previous_light_alarms[i] = state.alarms[i];
+    }
+
+    if (new_count > 0) {
+        COMMS_Handler_SendAlarmEvents(new_alarms, new_count);
+    }
+}
+
+/**
+ * @brief  Send event notifications for newly raised thermal warnings
+ * @retval None
+ */
+static void SYS_Coordinator_CheckThermalWarnings(void) {
+    LED_Driver_ThermalTrend_t trend;
+
+    for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        if (LED_Driver_GetThermalTrend(i + 1, &trend) != VAL_OK ||
+            trend.warnings == previous_thermal_warnings[i]) {
+            continue;
+        }
+
+        previous_thermal_warnings[i] = trend.warnings;
+        COMMS_Handler_SendThermalWarning(i + 1, &trend);
+    }
+}
+
+/**
+ * @brief  Log and send an event for a crossing of the supply warning level
+ * @note   The scheduler's poll sets every event bit, so only a change of
+ *         the state or of the warning count since the last report is sent;
+ *         a dip and recovery between two reports still shows in the count
+ * @retval None
+ */
+static void SYS_Coordinator_ReportPowerWarning(void) {
+    LED_Driver_Budget_t budget;
+    uint32_t warnings = VAL_Pvd_GetWarningCount();
+
+    if (LED_Driver_GetCurrentBudget(&budget) != VAL_OK ||
+        (budget.supply_low == previous_supply_low && warnings == previous_supply_warnings)) {
+        return;
+    }
+
+    previous_supply_low = budget.supply_low;
+    previous_supply_warnings = warnings;
+
+    if (budget.supply_low) {
+        LOGGER_LOG(LOGGER_LEVEL_WARNING, LOGGER_MSG_SUPPLY_LOW, VAL_Pvd_GetThreshold(), budget.permille);
+    } else {
+        LOGGER_LOG(LOGGER_LEVEL_INFO, LOGGER_MSG_SUPPLY_RECOVERED, VAL_Pvd_GetThreshold(), budget.permille);
+    }
+    COMMS_Handler_SendPowerWarning(&budget);
+}
+
+/**
+ * @brief  Evaluate the rules against the latest samples and run the actions
+ *         of those that fired
+ * @note   Light actions are posted from this task and so run at once; a
+ *         macro is queued for the communications worker task
+ * @param  sensors: Sensor data per light, as just synchronized
+ * @retval None
+ */
+static void SYS_Coordinator_RunRules(const LightSensorData_t* sensors) {
+    static Rules_Inputs_t inputs;
+    SYS_Coordinator_State_t state;
+    Rules_Rule_t rule;
+    uint16_t values[VAL_LIGHT_COUNT];
+    uint32_t fired;
+
+    (void)SYS_Coordinator_ReadState(&state);
+    for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        inputs.values[RULES_INPUT_CURRENT * VAL_LIGHT_COUNT + i] = sensors[i].current;
+        inputs.values[RULES_INPUT_TEMPERATURE * VAL_LIGHT_COUNT + i] = sensors[i].temperature;
+        inputs.values[RULES_INPUT_ALARM * VAL_LIGHT_COUNT + i] = (float)state.alarms[i];
+    }
+
+    taskENTER_CRITICAL();
+    fired = Rules_Evaluate(&inputs);
+    taskEXIT_CRITICAL();
+
+    for (uint8_t i = 0; fired != 0; i++, fired >>= 1) {
+        if (!(fired & 1U)) {
+            continue;
+        }
+
+        taskENTER_CRITICAL();
+        VAL_Status status = Rules_GetRule(i, &rule);
+        taskEXIT_CRITICAL();
+        if (status != VAL_OK) {
+            continue;
+        }
+
+        /* The desk owns the lights while DMX512 is active */
+        if (rule.action != RULES_ACTION_EVENT && dmx_active) {
+            continue;
+        }
+
+        switch (rule.action) {
+            case RULES_ACTION_SET:
+                for (uint8_t j = 0; j < VAL_LIGHT_COUNT; j++) {
+                    values[j] = rule.permille;
+                }
+                (void)SYS_Coordinator_SetMaskedLightPermille(rule.mask, values,
+                                                             (uint8_t)__builtin_popcount(rule.mask));
+                break;
+
+            case RULES_ACTION_FADE:
+                (void)SYS_Coordinator_FadeMaskedLights(rule.mask, rule.permille, rule.duration_ms,
+                                                       (LED_Driver_FadeCurve_t)rule.curve);
+                break;
+
+            case RULES_ACTION_SCENE:
+                (void)SYS_Coordinator_RecallScene(rule.scene, CONFIG_LIGHTS_ALL);
+                break;
+
+            case RULES_ACTION_MACRO:
+                (void)COMMS_Handler_RunMacro(rule.macro);
+                break;
+
+            case RULES_ACTION_EVENT:
+            default:
+                (void)COMMS_Handler_SendRuleEvent(i + 1,
+                    inputs.values[rule.input * VAL_LIGHT_COUNT + rule.light_id - 1]);
+                break;
+        }
+    }
+}
+
+/**
+ * @brief  Start changing the shared light state
+ * @note   Writers are tasks. Suspending the scheduler serialises them without
+ *         masking interrupts; nothing may block until the matching
+ *         SYS_Coordinator_EndUpdate. Readers use copy 1 meanwhile.
+ * @retval SYS_Coordinator_State_t*: Copy to modify in place
+ */
+static SYS_Coordinator_State_t* SYS_Coordinator_BeginUpdate(void) {
+    vTaskSuspendAll();
+    state_sequence++;                   /* Odd: readers use copy 1 */
+    __DMB();
+    return &state_copies[0];
+}
+
+/**
+ * @brief  Publish the changes made since SYS_Coordinator_BeginUpdate
+ * @note   Each copy is written while the sequence steers readers to the
+ *         other one, so a reader always finds a stable copy, even an
+ *         interrupt that preempted the writer.
+ * @retval None
+ */
+static void SYS_Coordinator_EndUpdate(void) {
+    __DMB();
+    state_sequence++;                   /* Even: readers use copy 0 */
+    __DMB();
+    state_copies[1] = state_copies[0];
+
+    (void)xTaskResumeAll();
+}
+
+/**
+ * @brief  Take a consistent snapshot of the shared light state
+ * @note   Never blocks; safe from tasks and interrupts. Retries only if a
+ *         publication completed while copying.
+ * @param  state: Pointer to store the snapshot
+ * @retval uint32_t: Sequence of the snapshot, two per publication
+ */
+static uint32_t SYS_Coordinator_ReadState(SYS_Coordinator_State_t* state) {
+    uint32_t sequence;
+
+    do {
+        sequence = state_sequence;
+        __DMB();
+        *state = state_copies[sequence & 1U];
+        __DMB();
+    } while (sequence != state_sequence);
+
+    return sequence;
+}
+
+/**
+ * @brief  Stop whatever drives the outputs on its own, before a host
+ *         command sets a light
+ * @note   Both the sequence and the strobe leave the lights to their own
+ *         timer; a strobe leaves them off
+ * @retval None
+ */
+static void SYS_Coordinator_ReleaseOutputs(void) {
+    Sequencer_Stop();
+    LED_Driver_StopStrobe();
+}
+
+/**
+ * @brief  Have the coordinator task run a light command and wait for it
+ * @note   Runs the command at once in the coordinator task itself, and
+ *         before the task exists. Arguments are validated by the caller.
+ * @param  command: Command to run; sender and result are filled in here
+ * @retval VAL_Status: Result of the command, VAL_BUSY if the queue stayed full
+ */
+static VAL_Status SYS_Coordinator_PostCommand(SYS_Coordinator_Command_t* command) {
+    VAL_Status result = VAL_ERROR;
+    TaskHandle_t sender = xTaskGetCurrentTaskHandle();
+
+    /* Waits for the result; interrupts use PostCommandFromISR */
+    VAL_ASSERT_TASK_CONTEXT();
+
+    if (!coordinator_ready || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING ||
+        sender == sysCoordinatorTaskHandle) {
+        return SYS_Coordinator_ExecuteCommand(command);
+    }
+
+    command->sender = sender;
+    command->result = &result;
+    if (xQueueSendToBack(command_queue, command, pdMS_TO_TICKS(SYS_COORD_COMMAND_TIMEOUT_MS)) != pdPASS) {
+        return VAL_BUSY;
+    }
+    xTaskNotify(sysCoordinatorTaskHandle, SYS_COORD_EVT_COMMAND, eSetBits);
+
+    /* Only the coordinator gives; other notifications of the sender, such
+     * as from its RX stream buffer, leave the count at zero */
+    while (ulTaskNotifyTake(pdTRUE, portMAX_DELAY) == 0) {
+    }
+
+    return result;
+}
+
+/**
+ * @brief  Queue a light command for the coordinator task from an interrupt
+ * @note   Nothing waits for the result, the command carries no sender.
+ *         Arguments are validated by the caller.
+ * @param  command: Command to queue
+ * @retval VAL_Status: VAL_OK once queued, VAL_BUSY if the queue is full or
+ *         the coordinator task is not running yet
+ */
+static VAL_Status SYS_Coordinator_PostCommandFromISR(SYS_Coordinator_Command_t* command) {
+    BaseType_t woken = pdFALSE;
+
+    if (!coordinator_ready) {
+        return VAL_BUSY;
+    }
+
+    command->sender = NULL;
+    command->result = NULL;
+    if (xQueueSendToBackFromISR(command_queue, command, &woken) != pdPASS) {
+        return VAL_BUSY;
+    }
+    xTaskNotifyFromISR(sysCoordinatorTaskHandle, SYS_COORD_EVT_COMMAND, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+
+    return VAL_OK;
+}
+
+/**
+ * @brief  Fill the intensities of a set-all command from a light mask
+ * @note   Unmasked lights are held by the driver
+ * @param  command: Command to fill
+ * @param  mask: Lights to set, bit 0 for light 1
+ * @param  values: Intensity per bit set in mask, lowest bit first
+ * @param  count: Number of values
+ * @retval VAL_Status: VAL_OK if filled, VAL_ERROR for invalid arguments
+ */
+static VAL_Status SYS_Coordinator_FillMasked(SYS_Coordinator_Command_t* command, uint32_t mask,
+                                             const uint16_t* values, uint8_t count) {
+    uint8_t used = 0;
+
+    if (values == NULL || mask == 0 || (mask >> VAL_LIGHT_COUNT) != 0) {
+        return VAL_ERROR;
+    }
+
+    for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        command->permille[i] = LED_DRIVER_PERMILLE_HOLD;
+        if (mask & (1UL << i)) {
+            if (used == count || values[used] > VAL_PWM_PERMILLE_MAX) {
+                return VAL_ERROR;
+            }
+            command->permille[i] = values[used++];
+        }
+    }
+
+    return (used == count) ? VAL_OK : VAL_ERROR;
+}
+
+/**
+ * @brief  Run the queued light commands and hand back their results
+ * @retval None
+ */
+static void SYS_Coordinator_RunCommands(void) {
+    SYS_Coordinator_Command_t command;
+
+    while (xQueueReceive(command_queue, &command, 0) == pdPASS) {
+        VAL_Status result = SYS_Coordinator_ExecuteCommand(&command);
+
+        if (command.sender != NULL) {
+            *command.result = result;
+            xTaskNotifyGive(command.sender);
+        }
+    }
+}
+
+/**
+ * @brief  Apply a light command to the LED driver and publish the result
+ * @note   Coordinator task only, once running. Every command but the commit
+ *         stops the sequence and the strobe first.
+ * @param  command: Command to run
+ * @retval VAL_Status: As the LED driver function it calls
+ */
+static VAL_Status SYS_Coordinator_ExecuteCommand(const SYS_Coordinator_Command_t* command) {
+    VAL_Status status = VAL_ERROR;
+    uint8_t index = command->light_id - 1;
+
+    if (command->type != SYS_COORD_CMD_COMMIT && command->type != SYS_COORD_CMD_CLEAR_ALARM) {
+        SYS_Coordinator_ReleaseOutputs();
+    }
+
+    switch (command->type) {
+        case SYS_COORD_CMD_SET_LIGHT:
+            status = LED_Driver_SetIntensityPermille(command->light_id, command->permille[0]);
+            if (status == VAL_OK) {
+                SYS_Coordinator_BeginUpdate()->permille[index] = command->permille[0];
+                SYS_Coordinator_EndUpdate();
+            }
+            break;
+
+        case SYS_COORD_CMD_SET_ALL:
+            status = LED_Driver_SetAllIntensitiesPermille(command->permille);
+            if (status == VAL_OK) {
+                SYS_Coordinator_PublishPermille(command->permille);
+            }
+            break;
+
+        case SYS_COORD_CMD_FADE_LIGHT:
+            status = LED_Driver_FadeTo(command->light_id, command->permille[0], command->duration_ms,
+                                       (LED_Driver_FadeCurve_t)command->option);
+            if (status == VAL_OK) {
+                SYS_Coordinator_BeginUpdate()->permille[index] = command->permille[0];
+                SYS_Coordinator_EndUpdate();
+            }
+            break;
+
+        case SYS_COORD_CMD_FADE_ALL:
+            status = LED_Driver_FadeAllTo(command->permille, command->duration_ms,
+                                          (LED_Driver_FadeCurve_t)command->option);
+            if (status == VAL_OK) {
+                SYS_Coordinator_PublishPermille(command->permille);
+            }
+            break;
+
+        case SYS_COORD_CMD_SET_CURRENT:
+            status = LED_Driver_SetCurrent(command->light_id, command->current_ma);
+            break;
+
+        case SYS_COORD_CMD_CLEAR_ALARM:
+            status = LED_Driver_ClearAlarms(command->mask, command->failed);
+            break;
+
+        case SYS_COORD_CMD_STAGE:
+            status = LED_Driver_StagePermille(command->permille, command->option != 0);
+            break;
+
+        case SYS_COORD_CMD_COMMIT:
+            status = LED_Driver_CommitStage();
+            break;
+
+        case SYS_COORD_CMD_EFFECT:
+            if (command->effect.shape == EFFECT_SHAPE_OFF) {
+                status = LED_Driver_StopEffect();
+            } else {
+                status = LED_Driver_StartEffect(command->permille, &command->effect);
+                if (status == VAL_OK) {
+                    SYS_Coordinator_PublishPermille(command->permille);
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return status;
+}
+
+/**
+ * @brief  Publish new intensities, skipping held lights
+ * @param  permille: Intensity per light (0-1000, or LED_DRIVER_PERMILLE_HOLD)
+ * @retval None
+ */
+static void SYS_Coordinator_PublishPermille(const uint16_t* permille) {
+    SYS_Coordinator_State_t* state = SYS_Coordinator_BeginUpdate();
+
+    for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        if (permille[i] != LED_DRIVER_PERMILLE_HOLD) {
+            state->permille[i] = permille[i];
+        }
+    }
+    SYS_Coordinator_EndUpdate();
+}
+
+/**
+ * @brief  Analog sample-ready callback, called from the ADC interrupt
+ * @retval None
+ */
+static void SYS_Coordinator_SampleReadyCallback(void) {
+    BaseType_t higher_priority_task_woken = pdFALSE;
+
+#ifdef BENCHMARK
+    Profiler_WakeupMark(PROFILER_WAKEUP_ADC);
+#endif
+    xTaskNotifyFromISR(sysCoordinatorTaskHandle, SYS_COORD_EVT_SAMPLE_READY,
+                       eSetBits, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+/**
+ * @brief  Stage and commit the light levels of the latest DMX512 packet
+ * @note   A packet arriving meanwhile is applied on its own event
+ * @retval None
+ */
+static void SYS_Coordinator_ApplyDmx(void) {
+    uint16_t permille[VAL_LIGHT_COUNT];
+
+    if (!dmx_active) {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        permille[i] = (uint16_t)((dmx_levels[i] * VAL_PWM_PERMILLE_MAX + SYS_COORD_DMX_LEVEL_MAX / 2) /
+                                 SYS_COORD_DMX_LEVEL_MAX);
+    }
+    taskEXIT_CRITICAL();
+
+    /* All lights change at the same PWM period boundary */
+    if (LED_Driver_StagePermille(permille, false) == VAL_OK) {
+        LED_Driver_CommitStage();
+    }
+}
+
+/**
+ * @brief  Return to the host link once the DMX512 desk has gone silent
+ * @retval None
+ */
+static void SYS_Coordinator_CheckDmxSignal(void) {
+    VAL_Status status;
+
+    if (!dmx_active ||
+        (xTaskGetTickCount() - dmx_last_tick) < pdMS_TO_TICKS(SYS_COORD_DMX_TIMEOUT_MS)) {
+        return;
+    }
+
+    dmx_dropped = VAL_Serial_GetDmxDropped();
+    status = VAL_Serial_StopDmx();
+    dmx_active = false;
+
+    LOGGER_LOG(LOGGER_LEVEL_WARNING, LOGGER_MSG_DMX_SIGNAL_LOST, dmx_packets, dmx_dropped);
+    if (status != VAL_OK) {
+        LOGGER_LOG(LOGGER_LEVEL_ERROR, LOGGER_MSG_DMX_SWITCH_FAILED, status, 0);
+    }
+}
+
+/**
+ * @brief  DMX512 packet callback, called from the UART interrupt
+ * @note   Runs at the comms level, so it must not touch the LED driver
+ * @param  packet: Start code followed by the channel values
+ * @param  length: Bytes in the packet
+ * @retval None
+ */
+static void SYS_Coordinator_DmxPacketCallback(const uint8_t* packet, uint16_t length) {
+    BaseType_t higher_priority_task_woken = pdFALSE;
+
+    if (packet[0] != SYS_COORD_DMX_START_CODE || length < dmx_channel + VAL_LIGHT_COUNT) {
+        dmx_ignored++;
+        return;
+    }
+
+    for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        dmx_levels[i] = packet[dmx_channel + i];
+    }
+    dmx_packets++;
+    dmx_last_tick = xTaskGetTickCountFromISR();
+
+    xTaskNotifyFromISR(sysCoordinatorTaskHandle, SYS_COORD_EVT_DMX_PACKET,
+                       eSetBits, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+/**
+ * @brief  Analog error callback, called from the ADC or DMA interrupt
+ * @param  adc_error: HAL_ADC_ERROR_x bits, 0 for a DMA error
+ * @param  dma_error: HAL_DMA_ERROR_x bits, 0 for an ADC error
+ * @retval None
+ */
+static void SYS_Coordinator_AnalogErrorCallback(uint32_t adc_error, uint32_t dma_error) {
+    BaseType_t higher_priority_task_woken = pdFALSE;
+
+    LOGGER_LOG(LOGGER_LEVEL_ERROR, LOGGER_MSG_ADC_ERROR, adc_error, dma_error);
+
+    /* Sampling, and with it alarm evaluation, is stopped until the task restarts it */
+    xTaskNotifyFromISR(sysCoordinatorTaskHandle, SYS_COORD_EVT_ADC_ERROR,
+                       eSetBits, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+/**
+ * @brief  LED driver event callback, called from task or interrupt context
+ * @param  events: LED_DRIVER_EVENT_x flags
+ * @retval None
+ */
+static void SYS_Coordinator_LedEventCallback(uint32_t events) {
+    uint32_t bits = 0;
+
+    if (events & LED_DRIVER_EVENT_INTENSITY_CHANGED) {
+        bits |= SYS_COORD_EVT_INTENSITY_CHANGED;
+    }
+    if (events & LED_DRIVER_EVENT_ALARM_CHANGED) {
+        bits |= SYS_COORD_EVT_ALARM_CHANGED;
+    }
+    if (events & LED_DRIVER_EVENT_THERMAL_WARNING) {
+        bits |= SYS_COORD_EVT_THERMAL_WARNING;
+    }
+    if (events & LED_DRIVER_EVENT_POWER_WARNING) {
+        bits |= SYS_COORD_EVT_POWER_WARNING;
+    }
 
-        osDelay(100); /* Update every 100 milliseconds */
+    if (xPortIsInsideInterrupt()) {
+        BaseType_t higher_priority_task_woken = pdFALSE;
+        xTaskNotifyFromISR(sysCoordinatorTaskHandle, bits, eSetBits, &higher_priority_task_woken);
+        portYIELD_FROM_ISR(higher_priority_task_woken);
+    } else {
+        xTaskNotify(sysCoordinatorTaskHandle, bits, eSetBits);
     }
 }
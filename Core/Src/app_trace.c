@@ -0,0 +1,357 @@
+/**
+  ******************************************************************************
+  * @file    app_trace.c
+  * @brief   Application layer command, alarm and scheduler trace
+  ******************************************************************************
+  * @attention
+  *
+  * This module keeps the last TRACE_ENTRY_COUNT commands and alarm state
+  * changes in a ring in SRAM2, so the history before a field problem can be
+  * read back with system/trace.
+  *
+  * Entries are numbered from start-up; entry n is stored at
+  * trace_ring[n % TRACE_ENTRY_COUNT] and trace_next is the number the next
+  * entry gets. Both can also be read over SWD, e.g. from a halted or
+  * faulted target.
+  *
+  * Recording is called from the communications task and from the ADC
+  * interrupt. It takes a few instructions with interrupts disabled and
+  * never waits, so it stays enabled in production builds.
+  *
+  * Scheduler events go to a second ring of TRACE_KERNEL_ENTRY_COUNT
+  * entries, numbered the same way: context switches, interrupt entry and
+  * exit, tasks blocking on a queue, semaphore, stream buffer or
+  * notification, and mutex priority inheritance. They come at every tick
+  * and interrupt, so they would push the commands and alarms out of the
+  * first ring within milliseconds, and they are only recorded while
+  * system/kernel_trace has them switched on. The hooks are called from the
+  * FreeRTOS trace macros (FreeRTOSConfig.h) and the interrupt handlers and
+  * return after one load while off. Entries are stamped with the DWT cycle
+  * counter, not microseconds, to keep the division out of every interrupt;
+  * the host converts at the core clock. Each recording measures its own
+  * cycles, so the cost of the trace is reported with it.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_trace.h"
+#include "val.h"
+
+/* Private variables ---------------------------------------------------------*/
+static Trace_Entry_t trace_ring[TRACE_ENTRY_COUNT] VAL_SRAM2_BSS;
+static uint32_t trace_next = 0;
+
+static Trace_KernelEntry_t kernel_ring[TRACE_KERNEL_ENTRY_COUNT];
+static uint32_t kernel_next = 0;
+static volatile bool kernel_enabled = false;
+static uint8_t kernel_task = 0;          /* Task switched in last */
+static uint32_t kernel_records = 0;
+static uint64_t kernel_cost_cycles = 0;
+static uint64_t kernel_since_us = 0;     /* Start of the cost figures */
+static uint64_t kernel_stopped_us = 0;   /* When recording stopped, while off */
+
+_Static_assert((TRACE_KERNEL_ENTRY_COUNT & (TRACE_KERNEL_ENTRY_COUNT - 1U)) == 0U, "Ring size must be a power of two");
+
+/* Private function prototypes -----------------------------------------------*/
+static void Trace_KernelRecord(Trace_KernelEvent_t event, uint8_t task, uint16_t object);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Record a trace entry, overwriting the oldest once the ring is full
+ * @note   Called from task and interrupt context
+ * @param  type: Entry type
+ * @param  code: Command code or light ID
+ * @param  status: Command status or alarm state
+ * @param  detail: Format flag or error code
+ * @param  cycles: Command duration in cycles, 0 for alarms
+ * @retval None
+ */
+void Trace_Record(Trace_Type_t type, uint8_t code, uint8_t status, uint8_t detail, uint32_t cycles) {
+  uint32_t time_us = VAL_SysClock_GetMicros();
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+
+  Trace_Entry_t* entry = &trace_ring[trace_next & (TRACE_ENTRY_COUNT - 1U)];
+  entry->time_us = time_us;
+  entry->cycles = cycles;
+  entry->type = (uint8_t)type;
+  entry->code = code;
+  entry->status = status;
+  entry->detail = detail;
+  trace_next++;
+
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Copy recorded entries, oldest first
+ * @note   Entries already overwritten are skipped; compare first with from
+ *         to detect the gap
+ * @param  from: Sequence number of the first entry wanted
+ * @param  entries: Array to store the entries
+ * @param  max_entries: Size of the array
+ * @param  first: Pointer to store the sequence number of the first entry copied
+ * @retval uint8_t: Number of entries copied
+ */
+uint8_t Trace_Read(uint32_t from, Trace_Entry_t* entries, uint8_t max_entries, uint32_t* first) {
+  uint32_t primask;
+  uint32_t oldest;
+  uint32_t count;
+
+  if (entries == NULL || first == NULL) {
+    return 0;
+  }
+
+  /* Copy in one go, so no entry changes while it is copied */
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  oldest = (trace_next > TRACE_ENTRY_COUNT) ? trace_next - TRACE_ENTRY_COUNT : 0;
+  if (from < oldest) {
+    from = oldest;
+  }
+  count = (from < trace_next) ? trace_next - from : 0;
+  if (count > max_entries) {
+    count = max_entries;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    entries[i] = trace_ring[(from + i) & (TRACE_ENTRY_COUNT - 1U)];
+  }
+
+  __set_PRIMASK(primask);
+
+  *first = from;
+  return (uint8_t)count;
+}
+
+/**
+ * @brief  Get the sequence number the next entry will get
+ * @retval uint32_t: Number of entries recorded since start-up
+ */
+uint32_t Trace_GetNext(void) {
+  return trace_next;
+}
+
+/**
+ * @brief  Start or stop recording scheduler events
+ * @note   Starting clears the recording cost figures; the entries stay
+ * @param  enable: true to record
+ * @retval None
+ */
+void Trace_KernelEnable(bool enable) {
+  uint64_t now_us = VAL_SysClock_GetMicros64();
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if (enable && !kernel_enabled) {
+    kernel_records = 0;
+    kernel_cost_cycles = 0;
+    kernel_since_us = now_us;
+  } else if (!enable && kernel_enabled) {
+    kernel_stopped_us = now_us;
+  }
+  kernel_enabled = enable;
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Clear the recording cost figures
+ * @retval None
+ */
+void Trace_KernelReset(void) {
+  uint64_t now_us = VAL_SysClock_GetMicros64();
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  kernel_records = 0;
+  kernel_cost_cycles = 0;
+  kernel_since_us = now_us;
+  kernel_stopped_us = now_us;
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Get the scheduler trace state and what recording costs
+ * @param  status: Pointer to store the status
+ * @retval None
+ */
+void Trace_KernelGetStatus(Trace_KernelStatus_t* status) {
+  uint64_t now_us = VAL_SysClock_GetMicros64();
+  uint32_t primask;
+
+  if (status == NULL) {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  status->enabled = kernel_enabled;
+  status->next = kernel_next;
+  status->records = kernel_records;
+  status->cost_cycles = kernel_cost_cycles;
+  status->elapsed_us = (kernel_enabled ? now_us : kernel_stopped_us) - kernel_since_us;
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Copy recorded scheduler entries, oldest first
+ * @note   As Trace_Read; stop recording first to read a consistent stretch
+ * @param  from: Sequence number of the first entry wanted
+ * @param  entries: Array to store the entries
+ * @param  max_entries: Size of the array
+ * @param  first: Pointer to store the sequence number of the first entry copied
+ * @retval uint8_t: Number of entries copied
+ */
+uint8_t Trace_KernelRead(uint32_t from, Trace_KernelEntry_t* entries, uint8_t max_entries, uint32_t* first) {
+  uint32_t primask;
+  uint32_t oldest;
+  uint32_t count;
+
+  if (entries == NULL || first == NULL) {
+    return 0;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  oldest = (kernel_next > TRACE_KERNEL_ENTRY_COUNT) ? kernel_next - TRACE_KERNEL_ENTRY_COUNT : 0;
+  if (from < oldest) {
+    from = oldest;
+  }
+  count = (from < kernel_next) ? kernel_next - from : 0;
+  if (count > max_entries) {
+    count = max_entries;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    entries[i] = kernel_ring[(from + i) & (TRACE_KERNEL_ENTRY_COUNT - 1U)];
+  }
+
+  __set_PRIMASK(primask);
+
+  *first = from;
+  return (uint8_t)count;
+}
+
+/**
+ * @brief  traceTASK_SWITCHED_IN hook
+ * @note   Context switch, interrupts masked
+ * @param  task: Task number of the task switched in
+ * @param  priority: Its priority
+ * @retval None
+ */
+void Trace_KernelSwitchedIn(uint32_t task, uint32_t priority) {
+  kernel_task = (uint8_t)task;
+  Trace_KernelRecord(TRACE_KERNEL_SWITCH_IN, (uint8_t)task, (uint16_t)priority);
+}
+
+/**
+ * @brief  traceTASK_SWITCHED_OUT hook
+ * @note   Context switch, interrupts masked
+ * @param  task: Task number of the task switched out
+ * @param  priority: Its priority
+ * @retval None
+ */
+void Trace_KernelSwitchedOut(uint32_t task, uint32_t priority) {
+  Trace_KernelRecord(TRACE_KERNEL_SWITCH_OUT, (uint8_t)task, (uint16_t)priority);
+}
+
+/**
+ * @brief  traceISR_ENTER hook, first thing in an interrupt handler
+ * @retval None
+ */
+void Trace_KernelIsrEnter(void) {
+  Trace_KernelRecord(TRACE_KERNEL_ISR_ENTER, kernel_task, (uint16_t)(__get_IPSR() & 0x1FFU));
+}
+
+/**
+ * @brief  traceISR_EXIT hook, last thing in an interrupt handler
+ * @retval None
+ */
+void Trace_KernelIsrExit(void) {
+  Trace_KernelRecord(TRACE_KERNEL_ISR_EXIT, kernel_task, (uint16_t)(__get_IPSR() & 0x1FFU));
+}
+
+/**
+ * @brief  traceBLOCKING_ON_QUEUE_RECEIVE and stream buffer receive hook
+ * @param  object: Queue, semaphore, mutex or stream buffer waited on
+ * @retval None
+ */
+void Trace_KernelBlockedReceive(const void* object) {
+  Trace_KernelRecord(TRACE_KERNEL_BLOCK_RECEIVE, kernel_task, (uint16_t)(uintptr_t)object);
+}
+
+/**
+ * @brief  traceBLOCKING_ON_QUEUE_SEND and stream buffer send hook
+ * @param  object: Queue or stream buffer waited on
+ * @retval None
+ */
+void Trace_KernelBlockedSend(const void* object) {
+  Trace_KernelRecord(TRACE_KERNEL_BLOCK_SEND, kernel_task, (uint16_t)(uintptr_t)object);
+}
+
+/**
+ * @brief  traceTASK_NOTIFY_TAKE_BLOCK and traceTASK_NOTIFY_WAIT_BLOCK hook
+ * @retval None
+ */
+void Trace_KernelBlockedNotify(void) {
+  Trace_KernelRecord(TRACE_KERNEL_BLOCK_NOTIFY, kernel_task, 0);
+}
+
+/**
+ * @brief  traceTASK_PRIORITY_INHERIT hook
+ * @param  task: Task number of the mutex holder
+ * @param  priority: Priority it inherits
+ * @retval None
+ */
+void Trace_KernelInherit(uint32_t task, uint32_t priority) {
+  Trace_KernelRecord(TRACE_KERNEL_INHERIT, (uint8_t)task, (uint16_t)priority);
+}
+
+/**
+ * @brief  traceTASK_PRIORITY_DISINHERIT hook
+ * @param  task: Task number of the mutex holder
+ * @param  priority: Priority it returns to
+ * @retval None
+ */
+void Trace_KernelDisinherit(uint32_t task, uint32_t priority) {
+  Trace_KernelRecord(TRACE_KERNEL_DISINHERIT, (uint8_t)task, (uint16_t)priority);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Record a scheduler entry if recording is on, and count its cost
+ * @note   Any context, interrupts included
+ * @param  event: Entry event
+ * @param  task: Task number
+ * @param  object: Per event
+ * @retval None
+ */
+static void Trace_KernelRecord(Trace_KernelEvent_t event, uint8_t task, uint16_t object) {
+  uint32_t start;
+  uint32_t primask;
+
+  if (!kernel_enabled) {
+    return;
+  }
+
+  start = VAL_SysClock_GetCycles();
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  Trace_KernelEntry_t* entry = &kernel_ring[kernel_next & (TRACE_KERNEL_ENTRY_COUNT - 1U)];
+  entry->cycles = start;
+  entry->event = (uint8_t)event;
+  entry->task = task;
+  entry->object = object;
+  kernel_next++;
+  kernel_records++;
+  kernel_cost_cycles += VAL_SysClock_GetCycles() - start;
+
+  __set_PRIMASK(primask);
+}
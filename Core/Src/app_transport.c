@@ -0,0 +1,229 @@
+/**
+  ******************************************************************************
+  * @file    app_transport.c
+  * @brief   Application layer host link transport
+  ******************************************************************************
+  * @attention
+  *
+  * The protocol code (app_comms_handler, app_tx_pool) reaches the host link
+  * through this module only: it receives blocks of bytes through a
+  * callback and queues messages, gathered from segments, without waiting.
+  * Each transport is a table of the operations the protocol needs (see
+  * Transport_Ops_t); the active one is chosen when the link is started.
+  *
+  * The protocol sizes what it sends to Transport_GetMtu, the longest
+  * message a transport takes in one send, and looks at Transport_IsBusy
+  * and Transport_GetIdleTime for the state of the link, e.g. before the
+  * MCU is stopped. Settings that only make sense for one transport, such
+  * as the UART baud rate or its RS-485 mode, stay with its VAL driver.
+  *
+  * USART1 is the transport of this board; an RS-485 bus is USART1 with
+  * the driver enable output, not a transport of its own. A board profile
+  * with an SPI slave link adds TRANSPORT_SPI (app_spi_link.c), which the
+  * protocol then starts on. A new one, a USB CDC interface for example,
+  * adds a table to transports[] and its Transport_Id_t.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_transport.h"
+#include "app_spi_link.h"
+#include "val.h"
+#include <stddef.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/* Operations of one transport */
+typedef struct {
+  const char* name;
+  VAL_Status (*init)(Transport_RxCallback_t rx_callback);
+  void (*set_tx_callback)(Transport_TxCallback_t callback);
+  VAL_Status (*send_segments)(const VAL_Serial_Segment_t* segments, uint8_t count);
+  uint16_t (*get_mtu)(void);
+  bool (*is_busy)(void);
+  uint32_t (*get_idle_time)(void);
+  VAL_Status (*flush)(uint32_t timeout);
+  uint32_t (*get_tx_queued)(void);
+  uint32_t (*get_tx_sent)(void);
+} Transport_Ops_t;
+
+/* Private function prototypes -----------------------------------------------*/
+static bool Transport_UartIsBusy(void);
+
+/* Private variables ---------------------------------------------------------*/
+static const Transport_Ops_t transports[TRANSPORT_COUNT] = {
+  [TRANSPORT_UART] = {
+    "uart",
+    VAL_Serial_InitDMA,
+    VAL_Serial_SetTxCompleteCallback,
+    VAL_Serial_SendSegmentsAsync,
+    VAL_Serial_GetMaxMessage,
+    Transport_UartIsBusy,
+    VAL_Serial_GetIdleTime,
+    VAL_Serial_Flush,
+    VAL_Serial_GetTxQueued,
+    VAL_Serial_GetTxSent
+  },
+#if VAL_SPI_SLAVE_ENABLED
+  [TRANSPORT_SPI] = {
+    "spi",
+    SpiLink_Init,
+    SpiLink_SetTxCallback,
+    SpiLink_SendSegments,
+    SpiLink_GetMtu,
+    SpiLink_IsBusy,
+    SpiLink_GetIdleTime,
+    SpiLink_Flush,
+    SpiLink_GetTxQueued,
+    SpiLink_GetTxSent
+  },
+#endif
+};
+
+static const Transport_Ops_t* active = &transports[TRANSPORT_DEFAULT];
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Start a transport and make it the one messages are sent over
+ * @param  id: Transport to start
+ * @param  rx_callback: Called with every block of received bytes
+ * @retval VAL_Status: VAL_OK if started, VAL_PARAM for an unknown transport,
+ *         else as the transport's initialization
+ */
+VAL_Status Transport_Init(Transport_Id_t id, Transport_RxCallback_t rx_callback) {
+  if (id >= TRANSPORT_COUNT || rx_callback == NULL) {
+    return VAL_PARAM;
+  }
+
+  active = &transports[id];
+  return active->init(rx_callback);
+}
+
+/**
+ * @brief  Set the function called when room frees up in the transmit queue
+ * @param  callback: Function to call from interrupt context, or NULL
+ * @retval None
+ */
+void Transport_SetTxCallback(Transport_TxCallback_t callback) {
+  active->set_tx_callback(callback);
+}
+
+/**
+ * @brief  Queue a message gathered from several buffers, without waiting
+ * @note   Safe to call from tasks and interrupts
+ * @param  segments: Buffers of the message, in order
+ * @param  count: Number of segments
+ * @retval VAL_Status: VAL_OK if queued, VAL_BUSY if there is no room for it yet,
+ *         VAL_PARAM for invalid arguments
+ */
+VAL_Status Transport_SendSegments(const VAL_Serial_Segment_t* segments, uint8_t count) {
+  return active->send_segments(segments, count);
+}
+
+/**
+ * @brief  Queue a message without waiting, as Transport_SendSegments
+ * @param  data: Message
+ * @param  length: Message length
+ * @retval VAL_Status: As Transport_SendSegments
+ */
+VAL_Status Transport_Send(const uint8_t* data, uint16_t length) {
+  VAL_Serial_Segment_t segment = { data, length };
+
+  return active->send_segments(&segment, 1);
+}
+
+/**
+ * @brief  Get the longest message the transport takes in one send
+ * @retval uint16_t: Bytes
+ */
+uint16_t Transport_GetMtu(void) {
+  return active->get_mtu();
+}
+
+/**
+ * @brief  Check whether messages are still queued or being sent
+ * @retval bool: true while the transport is sending
+ */
+bool Transport_IsBusy(void) {
+  return active->is_busy();
+}
+
+/**
+ * @brief  Get the time since the last byte was received
+ * @retval uint32_t: Milliseconds
+ */
+uint32_t Transport_GetIdleTime(void) {
+  return active->get_idle_time();
+}
+
+/**
+ * @brief  Wait until everything queued has been sent
+ * @note   Must not be called from interrupt context
+ * @param  timeout: Maximum time to wait in milliseconds
+ * @retval VAL_Status: VAL_OK if sent, VAL_TIMEOUT otherwise
+ */
+VAL_Status Transport_Flush(uint32_t timeout) {
+  return active->flush(timeout);
+}
+
+/**
+ * @brief  Get the number of bytes queued since start-up
+ * @note   Wraps around. Read right after queueing a message, it marks the
+ *         end of that message for Transport_GetTxSent.
+ * @retval uint32_t: Bytes
+ */
+uint32_t Transport_GetTxQueued(void) {
+  return active->get_tx_queued();
+}
+
+/**
+ * @brief  Get the number of bytes sent since start-up
+ * @note   Wraps around; safe to call from interrupts
+ * @retval uint32_t: Bytes
+ */
+uint32_t Transport_GetTxSent(void) {
+  return active->get_tx_sent();
+}
+
+/**
+ * @brief  Get how full the transmit queue is
+ * @note   Producers that can send less often, such as telemetry, back off
+ *         on it before sends start to fail
+ * @retval uint16_t: Bytes queued and not sent yet, in permille of
+ *         Transport_GetMtu, at most 1000
+ */
+uint16_t Transport_GetTxFill(void) {
+  uint32_t pending = active->get_tx_queued() - active->get_tx_sent();
+  uint32_t mtu = active->get_mtu();
+  uint32_t fill = (mtu != 0U) ? (pending * 1000U) / mtu : 1000U;
+
+  return (fill > 1000U) ? 1000U : (uint16_t)fill;
+}
+
+/**
+ * @brief  Get the transport messages are sent over
+ * @retval Transport_Id_t: Active transport
+ */
+Transport_Id_t Transport_GetActive(void) {
+  return (Transport_Id_t)(active - transports);
+}
+
+/**
+ * @brief  Get the protocol name of a transport
+ * @param  id: Transport
+ * @retval const char*: Name, "unknown" for an invalid transport
+ */
+const char* Transport_GetName(Transport_Id_t id) {
+  return (id < TRANSPORT_COUNT) ? transports[id].name : "unknown";
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Check whether the UART is still sending
+ * @retval bool: true while data is queued or in flight
+ */
+static bool Transport_UartIsBusy(void) {
+  return VAL_Serial_IsBusy() != 0;
+}
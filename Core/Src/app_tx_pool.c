@@ -0,0 +1,416 @@
+/**
+  ******************************************************************************
+  * @file    app_tx_pool.c
+  * @brief   Application layer outbound message pool and priority queue
+  ******************************************************************************
+  * @attention
+  *
+  * Events are formatted into slots taken from a small fixed pool instead of
+  * a buffer owned by one task, so any task may send them and several can be
+  * formatted or waiting at the same time.
+  *
+  * A queued slot waits until the transport (app_transport) has room for it
+  * and is released once the transport has taken it; for the UART the bytes
+  * in flight are held by its TX ring, which the DMA sends from directly. Waiting
+  * messages go out most urgent first (TxPool_Priority_t), in order of
+  * queueing within a priority. Room is looked for whenever a message is
+  * queued and each time a DMA transfer completes, so an alarm waits at most
+  * for the transfer in progress.
+  *
+  * Responses are formatted into the communications task's own buffer, as
+  * config/get is longer than a slot, and sent with TxPool_SendDirect, or
+  * with TxPool_SendSegments when gathered from constant text and formatted
+  * fields. While one waits for room, only more urgent messages may go
+  * ahead of it. The waiting task blocks on its task notification, given by
+  * the TX completion interrupt, rather than polling for room.
+  *
+  * The last free slot is kept for alarms, so telemetry and log messages
+  * piling up under load cannot hold back an alarm; they are dropped instead.
+  *
+  * Slots are claimed and released with interrupts disabled for a few
+  * instructions; claiming and queueing never wait.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_tx_pool.h"
+#include "app_transport.h"
+#include "app_profiler.h"
+#include "app_latency.h"
+#include "app_queues.h"
+#include "val.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TX_POOL_ALL_FREE         ((1U << TX_POOL_SLOT_COUNT) - 1U)
+#define TX_POOL_ALARM_RESERVE    1    /* Free slots only alarms may take */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint32_t order;            /* Queueing order */
+  uint16_t length;           /* Bytes formatted */
+  uint8_t priority;          /* TxPool_Priority_t */
+} TxPool_Slot_t;
+
+/* Private variables ---------------------------------------------------------*/
+static char pool_buffers[TX_POOL_SLOT_COUNT][TX_POOL_SLOT_SIZE];
+static TxPool_Slot_t pool_slots[TX_POOL_SLOT_COUNT];
+static uint32_t pool_free = TX_POOL_ALL_FREE;   /* Bit n set: slot n free */
+static uint32_t pool_queued = 0;                /* Bit n set: slot n waits to be sent */
+static uint32_t pool_order = 0;
+static uint8_t pool_min_free = TX_POOL_SLOT_COUNT;
+
+/* Queued messages with a priority below the bound may be sent */
+static volatile uint8_t pump_bound = TX_PRIORITY_COUNT;  /* Lowered by TxPool_SendDirect */
+static volatile uint8_t pump_request = 0;                /* Bound asked for, 0 if none */
+static volatile uint8_t pump_active = 0;
+
+/* Task waiting in TxPool_SendSegments for room, NULL if none */
+static TaskHandle_t volatile pool_waiter = NULL;
+
+/* Private function prototypes -----------------------------------------------*/
+static void TxPool_Pump(uint8_t bound);
+static void TxPool_PumpAll(void);
+static void TxPool_TxComplete(void);
+static TxPool_Handle_t TxPool_NextQueued(uint8_t bound);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Initialize the pool and hook it to the transport's TX completion
+ * @retval None
+ */
+void TxPool_Init(void) {
+  (void)Queues_Register(pool_slots, "tx_pool", QUEUES_KIND_POOL, TX_POOL_SLOT_COUNT);
+  Transport_SetTxCallback(TxPool_TxComplete);
+}
+
+/**
+ * @brief  Take a free message slot
+ * @note   Called from task and interrupt context
+ * @param  priority: Priority the message will be sent with
+ * @retval TxPool_Handle_t: Slot handle, TX_POOL_INVALID if no slot is free
+ *         for this priority
+ */
+TxPool_Handle_t TxPool_Acquire(TxPool_Priority_t priority) {
+  TxPool_Handle_t handle = TX_POOL_INVALID;
+  uint32_t primask = __get_PRIMASK();
+  uint8_t reserve = (priority == TX_PRIORITY_ALARM) ? 0 : TX_POOL_ALARM_RESERVE;
+
+  if (priority >= TX_PRIORITY_COUNT) {
+    return TX_POOL_INVALID;
+  }
+
+  __disable_irq();
+
+  if ((uint8_t)__builtin_popcount(pool_free) > reserve) {
+    handle = (TxPool_Handle_t)__builtin_ctz(pool_free);
+    pool_free &= ~(1U << handle);
+    pool_slots[handle].priority = (uint8_t)priority;
+
+    uint8_t free_count = (uint8_t)__builtin_popcount(pool_free);
+    if (free_count < pool_min_free) {
+      pool_min_free = free_count;
+    }
+    Queues_NoteLevel(pool_slots, TX_POOL_SLOT_COUNT - free_count);
+  } else {
+    Queues_NoteFailed(pool_slots);
+  }
+
+  __set_PRIMASK(primask);
+
+  return handle;
+}
+
+/**
+ * @brief  Get the buffer of a slot
+ * @param  handle: Slot handle
+ * @retval char*: TX_POOL_SLOT_SIZE bytes to format into, NULL for an invalid handle
+ */
+char* TxPool_GetBuffer(TxPool_Handle_t handle) {
+  if (handle >= TX_POOL_SLOT_COUNT) {
+    return NULL;
+  }
+
+  return pool_buffers[handle];
+}
+
+/**
+ * @brief  Queue the message of a slot; the slot is released once it is sent
+ * @note   Never waits. An invalid length releases the slot.
+ * @param  handle: Slot handle
+ * @param  length: Number of bytes formatted into the slot
+ * @retval VAL_Status: VAL_OK if queued, VAL_PARAM for an invalid handle or length
+ */
+VAL_Status TxPool_Queue(TxPool_Handle_t handle, size_t length) {
+  uint32_t primask;
+
+  if (handle >= TX_POOL_SLOT_COUNT) {
+    return VAL_PARAM;
+  }
+  if (length == 0 || length > TX_POOL_SLOT_SIZE) {
+    TxPool_Release(handle);
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  pool_slots[handle].length = (uint16_t)length;
+  pool_slots[handle].order = pool_order++;
+  pool_queued |= (1U << handle);
+  __set_PRIMASK(primask);
+
+  TxPool_PumpAll();
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Release a slot without sending it
+ * @param  handle: Slot handle
+ * @retval None
+ */
+void TxPool_Release(TxPool_Handle_t handle) {
+  uint32_t primask;
+
+  if (handle >= TX_POOL_SLOT_COUNT) {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  pool_queued &= ~(1U << handle);
+  pool_free |= (1U << handle);
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Send a message from the caller's buffer, ahead of less urgent queued messages
+ * @note   Called from one task only, the communications task. Waits like
+ *         VAL_Serial_Send; queued messages more urgent than this one go first.
+ * @param  data: Message
+ * @param  length: Message length
+ * @param  priority: Priority of the message
+ * @param  timeout: Maximum time to wait for TX queue space in milliseconds
+ * @retval VAL_Status: VAL_OK if queued, VAL_TIMEOUT if the queue stayed full,
+ *         VAL_PARAM for invalid arguments
+ */
+VAL_Status TxPool_SendDirect(const uint8_t* data, size_t length, TxPool_Priority_t priority,
+                             uint32_t timeout) {
+  VAL_Serial_Segment_t segment = { data, (uint16_t)length };
+
+  if (data == NULL || length == 0 || length > UINT16_MAX) {
+    return VAL_PARAM;
+  }
+
+  return TxPool_SendSegments(&segment, 1, priority, timeout);
+}
+
+/**
+ * @brief  Send a message gathered from several buffers, as TxPool_SendDirect
+ * @note   Called from one task only, the communications task
+ * @param  segments: Buffers of the message, in order
+ * @param  count: Number of segments
+ * @param  priority: Priority of the message
+ * @param  timeout: Maximum time to wait for TX queue space in milliseconds
+ * @retval VAL_Status: VAL_OK if queued, VAL_TIMEOUT if the queue stayed full,
+ *         VAL_PARAM for invalid arguments
+ */
+VAL_Status TxPool_SendSegments(const VAL_Serial_Segment_t* segments, uint8_t count,
+                               TxPool_Priority_t priority, uint32_t timeout) {
+  uint32_t start_tick = HAL_GetTick();
+  uint32_t wait_start = 0;
+  bool waited = false;
+  uint32_t elapsed;
+  uint32_t primask;
+  uint8_t previous_bound;
+  VAL_Status status;
+
+  VAL_ASSERT_TASK_CONTEXT();
+
+  if (segments == NULL || count == 0 || priority >= TX_PRIORITY_COUNT) {
+    return VAL_PARAM;
+  }
+
+  /* Hold back less urgent queued messages until this one is in */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  previous_bound = pump_bound;
+  if (priority < pump_bound) {
+    pump_bound = (uint8_t)priority;
+  }
+  /* Set before looking for room, so a transfer ending meanwhile wakes us */
+  pool_waiter = xTaskGetCurrentTaskHandle();
+  __set_PRIMASK(primask);
+
+  for (;;) {
+    TxPool_Pump((uint8_t)priority);
+
+    if (TxPool_NextQueued((uint8_t)priority) == TX_POOL_INVALID) {
+      status = Transport_SendSegments(segments, count);
+      if (status != VAL_BUSY) {
+        break;
+      }
+    }
+
+    elapsed = HAL_GetTick() - start_tick;
+    if (elapsed >= timeout) {
+      status = VAL_TIMEOUT;
+      break;
+    }
+
+    /* Sleep until the next transfer completes */
+    if (!waited) {
+      waited = true;
+      wait_start = VAL_SysClock_GetMicros();
+    }
+#ifdef BENCHMARK
+    Profiler_WakeupArm(PROFILER_WAKEUP_TX);
+#endif
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout - elapsed));
+#ifdef BENCHMARK
+    Profiler_WakeupDone(PROFILER_WAKEUP_TX);
+#endif
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  pump_bound = previous_bound;
+  pool_waiter = NULL;
+  __set_PRIMASK(primask);
+
+  if (waited) {
+    Queues_NoteBlocked(pool_slots, VAL_SysClock_GetMicros() - wait_start);
+  }
+
+  /* A completion after the last wait would otherwise wake the next wait of
+   * this task, e.g. on its RX stream */
+  ulTaskNotifyTake(pdTRUE, 0);
+
+  /* Whatever was held back may follow now */
+  TxPool_PumpAll();
+
+  return status;
+}
+
+/**
+ * @brief  Get the fewest free slots seen since start-up
+ * @retval uint8_t: Low-water mark of free slots
+ */
+uint8_t TxPool_GetMinFree(void) {
+  return pool_min_free;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Hand queued messages to the serial driver while it has room
+ * @note   Called from task and interrupt context. Only one caller sends at a
+ *         time; a call meanwhile is taken over by the one already sending.
+ * @param  bound: Send queued messages with a priority below this
+ * @retval None
+ */
+static void TxPool_Pump(uint8_t bound) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+
+  if (bound > pump_request) {
+    pump_request = bound;
+  }
+  if (pump_active) {
+    __set_PRIMASK(primask);
+    return;
+  }
+  pump_active = 1;
+
+  while (pump_request != 0) {
+    uint8_t limit = pump_request;
+    pump_request = 0;
+    __set_PRIMASK(primask);
+
+    for (;;) {
+      TxPool_Handle_t handle = TxPool_NextQueued(limit);
+      if (handle == TX_POOL_INVALID) {
+        break;
+      }
+
+      /* Room is looked for again when the current DMA transfer completes */
+      if (Transport_Send((const uint8_t*)pool_buffers[handle], pool_slots[handle].length) == VAL_BUSY) {
+        break;
+      }
+      TxPool_Release(handle);
+    }
+
+    __disable_irq();
+  }
+
+  pump_active = 0;
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Hand all queued messages to the serial driver while it has room
+ * @note   Called from task and interrupt context
+ * @retval None
+ */
+static void TxPool_PumpAll(void) {
+  TxPool_Pump(TX_PRIORITY_COUNT);
+}
+
+/**
+ * @brief  Transport TX completion callback, called from interrupt context
+ * @note   Refills the transport, times a sent response, then wakes the
+ *         task waiting for room
+ * @retval None
+ */
+static void TxPool_TxComplete(void) {
+  BaseType_t higher_priority_task_woken = pdFALSE;
+  TaskHandle_t waiter;
+
+  TxPool_PumpAll();
+  Latency_TxComplete();
+
+  waiter = pool_waiter;
+  if (waiter != NULL) {
+#ifdef BENCHMARK
+    Profiler_WakeupMark(PROFILER_WAKEUP_TX);
+#endif
+    vTaskNotifyGiveFromISR(waiter, &higher_priority_task_woken);
+  }
+  portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+/**
+ * @brief  Find the queued message to send next
+ * @param  bound: Only consider priorities below this; pump_bound also applies
+ * @retval TxPool_Handle_t: Most urgent, oldest queued slot, TX_POOL_INVALID if none
+ */
+static TxPool_Handle_t TxPool_NextQueued(uint8_t bound) {
+  TxPool_Handle_t best = TX_POOL_INVALID;
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+
+  if (bound > pump_bound) {
+    bound = pump_bound;
+  }
+
+  for (TxPool_Handle_t i = 0; i < TX_POOL_SLOT_COUNT; i++) {
+    if ((pool_queued & (1U << i)) == 0 || pool_slots[i].priority >= bound) {
+      continue;
+    }
+    if (best == TX_POOL_INVALID ||
+        pool_slots[i].priority < pool_slots[best].priority ||
+        (pool_slots[i].priority == pool_slots[best].priority &&
+         (int32_t)(pool_slots[i].order - pool_slots[best].order) < 0)) {
+      best = i;
+    }
+  }
+
+  __set_PRIMASK(primask);
+
+  return best;
+}
@@ -0,0 +1,586 @@
+/**
+  ******************************************************************************
+  * @file    app_update.c
+  * @brief   Application layer firmware update over the binary protocol
+  ******************************************************************************
+  * @attention
+  *
+  * system/update resets the MCU into the resident boot loader, which
+  * receives a new image over the host link at the baud rate in use and
+  * programs it after itself (see val_update.c). The boot loader's flash,
+  * the first VAL_UPDATE_BOOT_SIZE bytes, and the data store are left as
+  * they are. The image is a whole build, linked from the start of the
+  * flash: its own boot loader part only goes into the CRC, a new boot
+  * loader needs ST-LINK.
+  *
+  * The host streams the image in COMMS_BIN_UPDATE_WRITE frames of up to
+  * COMMS_UPDATE_CHUNK_MAX bytes, in order, waiting for each response. A
+  * page is erased when the first chunk reaching into it comes, or ahead of
+  * it, right after the response to the chunk before, so the erase and the
+  * next chunk arriving overlap; reception continues into the DMA ring
+  * meanwhile. Each chunk is programmed in double words straight from the
+  * receive buffer.
+  *
+  * The firmware's first double word, the initial stack pointer and the
+  * reset vector, is kept back in RAM. COMMS_BIN_UPDATE_FINISH checks the
+  * CRC-32 of the whole image, that double word included, and that the
+  * vector table points into SRAM1 and into the image; only then is the
+  * double word programmed and the MCU reset into the new firmware. Until
+  * then the firmware's vector table reads erased, so an update cut short by
+  * a reset or a power loss never starts half an image: the boot loader
+  * stays and takes the image again, announced by a COMMS_BIN_SYSTEM_UPDATE
+  * of its own. 10 s without a frame reset the MCU, into the old firmware as
+  * long as none of it was erased, or back into the boot loader.
+  *
+  * Everything that runs in the boot loader is VAL_UPDATEFUNC code. The
+  * COBS and CRC16 framing of app_comms_binary.c is repeated here for that
+  * reason: the boot loader may not call into the firmware after it.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_update.h"
+#include "app_comms_binary.h"
+#include "val.h"
+#include "val_update.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Private define ------------------------------------------------------------*/
+#define UPDATE_HEAD_OFFSET       VAL_UPDATE_BOOT_SIZE
+#define UPDATE_HEAD_SIZE         8U   /* Firmware's first double word, programmed last */
+#define UPDATE_CRC16_POLY        0x1021U
+
+/* Decoded command, device address included, and a response with the
+   largest body, the COMMS_Bin_Update_t of system/update */
+#define UPDATE_PAYLOAD_MAX       (1U + COMMS_BIN_HEADER_SIZE + sizeof(uint32_t) + COMMS_UPDATE_CHUNK_MAX + \
+                                  COMMS_BIN_CRC_SIZE)
+#define UPDATE_FRAME_SIZE        COMMS_BIN_FRAME_SIZE(UPDATE_PAYLOAD_MAX)
+#define UPDATE_RESPONSE_SIZE     (COMMS_BIN_HEADER_SIZE + 1U + sizeof(COMMS_Bin_Update_t) + COMMS_BIN_CRC_SIZE)
+#define UPDATE_RESPONSE_FRAME    COMMS_BIN_FRAME_SIZE(UPDATE_RESPONSE_SIZE)
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint32_t size;                    /* Image size in bytes, 0 until announced */
+  uint32_t crc;                     /* CRC-32 of the image */
+  uint32_t next;                    /* Offset of the chunk expected next */
+  uint32_t erased;                  /* Flash erased below this offset */
+  uint8_t head[UPDATE_HEAD_SIZE];   /* Firmware's first double word */
+  uint8_t address;                  /* Device address of COMMS_BIN_TYPE_ADDR_CMD frames */
+  uint8_t* frame;                   /* Receive buffer, UPDATE_FRAME_SIZE bytes */
+  uint16_t frame_length;
+  bool frame_overflow;              /* Frame longer than the buffer, dropped */
+} Update_State_t;
+
+/* Private variables ---------------------------------------------------------*/
+/* Set by Update_Boot, the startup code has not run */
+static Update_State_t update;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Update_Loop(void) __attribute__((noreturn));
+static void Update_ProcessFrame(void);
+static VAL_Status Update_Start(const uint8_t* body, size_t length);
+static VAL_Status Update_Write(const uint8_t* body, size_t length);
+static VAL_Status Update_Finish(void);
+static void Update_EraseAhead(void);
+static void Update_Restart(void);
+static void Update_Respond(uint8_t seq, uint8_t code, VAL_Status status);
+static VAL_Status Update_DecodeFrame(uint8_t* frame, size_t length, size_t* payload_length);
+static size_t Update_EncodeFrame(const uint8_t* payload, size_t length, uint8_t* frame);
+static uint16_t Update_Crc16(const uint8_t* data, size_t length);
+static uint32_t Update_ReadU32(const uint8_t* data);
+static void Update_WriteU32(uint8_t* data, uint32_t value);
+
+#ifndef SIMULATION
+/* Boot loader vector table, at the start of the flash. Nothing else is
+   enabled there, so any fault ends up in the HardFault entry and resets. */
+extern uint32_t _estack[];
+
+__attribute__((section(".boot_vector"), used)) static void (*const update_boot_vectors[])(void) = {
+  (void (*)(void))_estack,
+  Update_Boot,
+  VAL_Update_Fault,   /* NMI */
+  VAL_Update_Fault,   /* HardFault */
+};
+#endif
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+ * @brief  Get the largest image an update takes
+ * @retval uint32_t: Bytes of flash below the data store
+ */
+uint32_t Update_GetMaxSize(void) {
+  return VAL_DataStore_GetBaseAddress() - FLASH_BASE;
+}
+
+/**
+ * @brief  Check an update request and take the flash for it
+ * @note   Communications task only. Once this succeeds the data store
+ *         cannot write any more, and Update_Run must follow.
+ * @param  size: Image size in bytes
+ * @retval VAL_Status: VAL_OK if the update can run, VAL_PARAM if the size is
+ *         out of range or the boot loader cannot make the baud rate in use,
+ *         VAL_BUSY while the data store writes
+ */
+VAL_Status Update_Prepare(uint32_t size) {
+  if (size < UPDATE_MIN_SIZE || size > Update_GetMaxSize()) {
+    return VAL_PARAM;
+  }
+
+  return VAL_Update_Prepare(UPDATE_FRAME_SIZE);
+}
+
+/**
+ * @brief  Reset into the boot loader, which receives the image
+ * @note   Never returns
+ * @param  size: Image size in bytes, as given to Update_Prepare
+ * @param  crc: CRC-32 of the image, as zlib computes it
+ * @param  address: Device address answered in COMMS_BIN_TYPE_ADDR_CMD frames
+ * @retval None
+ */
+void Update_Run(uint32_t size, uint32_t crc, uint8_t address) {
+  /* No task runs again; interrupts are turned off by VAL_Update_Request */
+  vTaskSuspendAll();
+  VAL_Update_Request(size, crc, address);
+}
+
+/**
+ * @brief  Boot loader reset handler
+ * @note   Starts the firmware unless an update was requested or the
+ *         firmware is not whole; then waits for the image
+ * @retval None
+ */
+VAL_UPDATEFUNC void Update_Boot(void) {
+  VAL_Update_Request_t request;
+
+  if (!VAL_Update_TakeRequest(&request)) {
+    VAL_Update_StartApplication();
+  }
+
+  update.frame = VAL_Update_Enter(&request);
+  update.address = request.address;
+  update.frame_length = 0;
+  update.frame_overflow = false;
+
+  /* The firmware checked the request; without one, system/update announces it */
+  update.size = 0;
+  update.crc = request.crc;
+  if (request.size >= UPDATE_MIN_SIZE && request.size <= VAL_UPDATE_IMAGE_MAX) {
+    update.size = request.size;
+  }
+  Update_Restart();
+
+  Update_Loop();
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief  Receive and answer frames until the update ends with a reset
+ * @retval None
+ */
+VAL_UPDATEFUNC static void Update_Loop(void) {
+  uint32_t last_frame = VAL_Update_GetTick();
+
+  for (;;) {
+    uint32_t now = VAL_Update_GetTick();
+    uint8_t byte;
+
+    VAL_Update_Feed();
+
+    if (!VAL_Update_ReadByte(&byte)) {
+      /* The boot loader starts the old firmware if it is still whole */
+      if (now - last_frame >= UPDATE_IDLE_TIMEOUT_MS) {
+        VAL_Update_Reset();
+      }
+      continue;
+    }
+
+    if (byte != COMMS_BIN_DELIMITER) {
+      if (update.frame_length < UPDATE_FRAME_SIZE) {
+        update.frame[update.frame_length++] = byte;
+      } else {
+        update.frame_overflow = true;
+      }
+      continue;
+    }
+
+    if (update.frame_length > 0U && !update.frame_overflow) {
+      Update_ProcessFrame();
+      last_frame = VAL_Update_GetTick();
+    }
+    update.frame_length = 0;
+    update.frame_overflow = false;
+  }
+}
+
+/**
+ * @brief  Decode, run and answer the frame in the receive buffer
+ * @note   Frames that are damaged, or not commands for this device, are
+ *         dropped without an answer, as the communications handler does
+ * @retval None
+ */
+VAL_UPDATEFUNC static void Update_ProcessFrame(void) {
+  uint8_t* payload = update.frame;
+  size_t length;
+  VAL_Status status;
+
+  if (Update_DecodeFrame(payload, update.frame_length, &length) != VAL_OK) {
+    return;
+  }
+
+  payload[0] &= (uint8_t)~COMMS_BIN_TYPE_NOACK;
+  if (payload[0] == COMMS_BIN_TYPE_ADDR_CMD) {
+    if (length < COMMS_BIN_HEADER_SIZE + 1U || payload[1] != update.address) {
+      return;
+    }
+
+    /* Skip the address, the rest has the layout of a command frame */
+    payload++;
+    length--;
+  } else if (payload[0] != COMMS_BIN_TYPE_CMD) {
+    return;
+  }
+
+  uint8_t seq = payload[1];
+  uint8_t code = payload[2];
+
+  if (code == COMMS_BIN_UPDATE_WRITE) {
+    status = Update_Write(&payload[COMMS_BIN_HEADER_SIZE], length - COMMS_BIN_HEADER_SIZE);
+  } else if (code == COMMS_BIN_UPDATE_FINISH) {
+    status = Update_Finish();
+  } else if (code == COMMS_BIN_SYSTEM_UPDATE) {
+    status = Update_Start(&payload[COMMS_BIN_HEADER_SIZE], length - COMMS_BIN_HEADER_SIZE);
+  } else {
+    status = VAL_PARAM;
+  }
+
+  Update_Respond(seq, code, status);
+  if (code == COMMS_BIN_UPDATE_FINISH && status == VAL_OK) {
+    VAL_Update_Reset();
+  }
+
+  Update_EraseAhead();
+}
+
+/**
+ * @brief  Announce an image, as system/update does in the firmware
+ * @param  body: uint32 size, uint32 CRC-32 of the image
+ * @param  length: Body length
+ * @retval VAL_Status: VAL_OK if the image is expected from offset 0 now,
+ *         VAL_PARAM if the size is out of range; the image before stays
+ */
+VAL_UPDATEFUNC static VAL_Status Update_Start(const uint8_t* body, size_t length) {
+  if (length < 2U * sizeof(uint32_t)) {
+    return VAL_PARAM;
+  }
+
+  uint32_t size = Update_ReadU32(body);
+  if (size < UPDATE_MIN_SIZE || size > VAL_UPDATE_IMAGE_MAX) {
+    return VAL_PARAM;
+  }
+
+  update.size = size;
+  update.crc = Update_ReadU32(&body[sizeof(uint32_t)]);
+  Update_Restart();
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Program one chunk of the image
+ * @note   The boot loader part only goes into the CRC, in the order it comes
+ * @param  body: uint32 offset, then the image data
+ * @param  length: Body length
+ * @retval VAL_Status: VAL_OK if programmed or written before, VAL_PARAM if out
+ *         of order, badly sized or no image was announced, VAL_ERROR if the
+ *         flash failed; the image then starts again from offset 0
+ */
+VAL_UPDATEFUNC static VAL_Status Update_Write(const uint8_t* body, size_t length) {
+  if (length < sizeof(uint32_t)) {
+    return VAL_PARAM;
+  }
+
+  uint32_t offset = Update_ReadU32(body);
+  const uint8_t* data = &body[sizeof(uint32_t)];
+  uint32_t count = (uint32_t)(length - sizeof(uint32_t));
+
+  /* A resent chunk whose response was lost */
+  if (offset < update.next) {
+    return VAL_OK;
+  }
+  if (offset != update.next || count == 0U || count > COMMS_UPDATE_CHUNK_MAX ||
+      count > update.size - offset || ((count % 8U) != 0U && offset + count != update.size)) {
+    return VAL_PARAM;
+  }
+
+  while (update.erased < offset + count) {
+    if (VAL_Update_ErasePage(FLASH_BASE + update.erased) != VAL_OK) {
+      Update_Restart();
+      return VAL_ERROR;
+    }
+    update.erased += FLASH_PAGE_SIZE;
+  }
+
+  /* The boot loader part is checked, not written */
+  uint32_t skip = 0;
+  if (offset < UPDATE_HEAD_OFFSET) {
+    skip = UPDATE_HEAD_OFFSET - offset;
+    if (skip > count) {
+      skip = count;
+    }
+    VAL_Update_CrcAdd(data, skip);
+  }
+
+  /* The firmware's first double word waits for the image check */
+  if (offset + skip == UPDATE_HEAD_OFFSET && skip < count) {
+    for (uint32_t i = 0; i < UPDATE_HEAD_SIZE; i++) {
+      update.head[i] = data[skip + i];
+    }
+    skip += UPDATE_HEAD_SIZE;
+  }
+
+  uint32_t whole = (count - skip) & ~7U;
+  VAL_Status status = VAL_Update_Program(FLASH_BASE + offset + skip, &data[skip], whole);
+
+  /* The last chunk is padded to a double word with erased bytes */
+  if (status == VAL_OK && skip + whole < count) {
+    uint8_t last[8];
+
+    for (uint32_t i = 0; i < sizeof(last); i++) {
+      last[i] = (skip + whole + i < count) ? data[skip + whole + i] : 0xFFU;
+    }
+    status = VAL_Update_Program(FLASH_BASE + offset + skip + whole, last, sizeof(last));
+  }
+
+  if (status != VAL_OK) {
+    Update_Restart();
+    return VAL_ERROR;
+  }
+
+  update.next = offset + count;
+  return VAL_OK;
+}
+
+/**
+ * @brief  Check the received image and program the firmware's first double word
+ * @retval VAL_Status: VAL_OK if the image is complete and programmed,
+ *         VAL_PARAM if chunks are missing or the vector table does not fit
+ *         this MCU, VAL_ERROR if the CRC does not match or the flash failed.
+ *         Unless chunks are missing, the image then starts again from offset 0
+ */
+VAL_UPDATEFUNC static VAL_Status Update_Finish(void) {
+  if (update.size == 0U || update.next != update.size) {
+    return VAL_PARAM;
+  }
+
+  /* The CRC has the boot loader part already */
+  VAL_Update_CrcAdd(update.head, UPDATE_HEAD_SIZE);
+  VAL_Update_CrcAdd((const uint8_t*)(FLASH_BASE + UPDATE_HEAD_OFFSET + UPDATE_HEAD_SIZE),
+                    update.size - UPDATE_HEAD_OFFSET - UPDATE_HEAD_SIZE);
+  if (VAL_Update_CrcGet() != update.crc) {
+    Update_Restart();
+    return VAL_ERROR;
+  }
+
+  /* Initial stack pointer in SRAM1, Thumb reset handler inside the firmware */
+  uint32_t stack = Update_ReadU32(&update.head[0]);
+  uint32_t reset = Update_ReadU32(&update.head[4]);
+  if (stack <= SRAM1_BASE || stack > SRAM1_BASE + SRAM1_SIZE_MAX || (reset & 1U) == 0U ||
+      reset < FLASH_BASE + UPDATE_HEAD_OFFSET + UPDATE_HEAD_SIZE || reset >= FLASH_BASE + update.size) {
+    Update_Restart();
+    return VAL_PARAM;
+  }
+
+  if (VAL_Update_Program(FLASH_BASE + UPDATE_HEAD_OFFSET, update.head, UPDATE_HEAD_SIZE) != VAL_OK) {
+    Update_Restart();
+    return VAL_ERROR;
+  }
+
+  return VAL_OK;
+}
+
+/**
+ * @brief  Erase the page the next chunk reaches into, if not done yet
+ * @note   Called after a response, while the host sends the next chunk
+ * @retval None
+ */
+VAL_UPDATEFUNC static void Update_EraseAhead(void) {
+  if (update.erased < update.size && update.erased < update.next + COMMS_UPDATE_CHUNK_MAX) {
+    if (VAL_Update_ErasePage(FLASH_BASE + update.erased) == VAL_OK) {
+      update.erased += FLASH_PAGE_SIZE;
+    }
+  }
+}
+
+/**
+ * @brief  Expect the image from offset 0 again, erasing the flash again
+ * @retval None
+ */
+VAL_UPDATEFUNC static void Update_Restart(void) {
+  update.next = 0;
+  update.erased = UPDATE_HEAD_OFFSET;
+  for (uint32_t i = 0; i < UPDATE_HEAD_SIZE; i++) {
+    update.head[i] = 0xFFU;
+  }
+  VAL_Update_CrcReset();
+}
+
+/**
+ * @brief  Send the response to an updater command
+ * @param  seq: Sequence number of the command
+ * @param  code: Code of the command
+ * @param  status: Status byte, followed by a COMMS_Bin_Update_t for
+ *         system/update and by the offset expected next otherwise
+ * @retval None
+ */
+VAL_UPDATEFUNC static void Update_Respond(uint8_t seq, uint8_t code, VAL_Status status) {
+  uint8_t payload[UPDATE_RESPONSE_SIZE];
+  uint8_t frame[UPDATE_RESPONSE_FRAME];
+  size_t length = COMMS_BIN_HEADER_SIZE;
+
+  payload[0] = COMMS_BIN_TYPE_RESP;
+  payload[1] = seq;
+  payload[2] = code;
+  payload[length++] = (uint8_t)status;
+  if (code == COMMS_BIN_SYSTEM_UPDATE) {
+    Update_WriteU32(&payload[length], update.size);
+    length += sizeof(uint32_t);
+    payload[length++] = (uint8_t)(COMMS_UPDATE_CHUNK_MAX & 0xFFU);
+    payload[length++] = (uint8_t)(COMMS_UPDATE_CHUNK_MAX >> 8);
+  } else {
+    Update_WriteU32(&payload[length], update.next);
+    length += sizeof(uint32_t);
+  }
+
+  uint16_t crc = Update_Crc16(payload, length);
+  payload[length] = (uint8_t)(crc & 0xFFU);
+  payload[length + 1U] = (uint8_t)(crc >> 8);
+
+  VAL_Update_Send(frame, Update_EncodeFrame(payload, length + COMMS_BIN_CRC_SIZE, frame));
+}
+
+/**
+ * @brief  Decode a COBS frame (without delimiters) in place and check its CRC
+ * @note   COMMS_Binary_DecodeFrame, in updater code
+ * @param  frame: Encoded bytes between the delimiters; decoded in place
+ * @param  length: Number of encoded bytes
+ * @param  payload_length: Pointer to store the payload length, CRC excluded
+ * @retval VAL_Status: VAL_OK if the frame is valid, VAL_ERROR if the CRC
+ *         does not match, VAL_PARAM if the frame is malformed
+ */
+VAL_UPDATEFUNC static VAL_Status Update_DecodeFrame(uint8_t* frame, size_t length, size_t* payload_length) {
+  size_t in = 0;
+  size_t out = 0;
+
+  while (in < length) {
+    uint8_t code = frame[in++];
+
+    if (code == 0 || in + code - 1 > length) {
+      return VAL_PARAM;
+    }
+
+    for (uint8_t i = 1; i < code; i++) {
+      frame[out++] = frame[in++];
+    }
+
+    /* A code below 0xFF stands for a zero, except at the end of the frame */
+    if (code != 0xFF && in < length) {
+      frame[out++] = 0;
+    }
+  }
+
+  if (out < COMMS_BIN_HEADER_SIZE + COMMS_BIN_CRC_SIZE) {
+    return VAL_PARAM;
+  }
+
+  out -= COMMS_BIN_CRC_SIZE;
+  uint16_t crc = (uint16_t)frame[out] | ((uint16_t)frame[out + 1] << 8);
+  if (Update_Crc16(frame, out) != crc) {
+    return VAL_ERROR;
+  }
+
+  *payload_length = out;
+  return VAL_OK;
+}
+
+/**
+ * @brief  COBS encode a payload between two delimiters
+ * @param  payload: Header, body and CRC
+ * @param  length: Payload length
+ * @param  frame: Buffer of COMMS_BIN_FRAME_SIZE(length) bytes
+ * @retval size_t: Encoded frame length
+ */
+VAL_UPDATEFUNC static size_t Update_EncodeFrame(const uint8_t* payload, size_t length, uint8_t* frame) {
+  size_t out = 0;
+  frame[out++] = COMMS_BIN_DELIMITER;
+
+  size_t code_pos = out++;
+  uint8_t run = 1;
+
+  for (size_t i = 0; i < length; i++) {
+    if (payload[i] == 0) {
+      frame[code_pos] = run;
+      code_pos = out++;
+      run = 1;
+    } else {
+      frame[out++] = payload[i];
+      if (++run == 0xFF) {
+        frame[code_pos] = run;
+        code_pos = out++;
+        run = 1;
+      }
+    }
+  }
+
+  frame[code_pos] = run;
+  frame[out++] = COMMS_BIN_DELIMITER;
+
+  return out;
+}
+
+/**
+ * @brief  Compute the CRC16-CCITT of a buffer
+ * @note   COMMS_Binary_CRC16, in updater code
+ * @param  data: Data to checksum
+ * @param  length: Number of bytes
+ * @retval uint16_t: CRC value
+ */
+VAL_UPDATEFUNC static uint16_t Update_Crc16(const uint8_t* data, size_t length) {
+  uint16_t crc = COMMS_BIN_CRC16_INIT;
+
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000U) ? (uint16_t)((crc << 1) ^ UPDATE_CRC16_POLY) : (uint16_t)(crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+/**
+ * @brief  Read a little-endian uint32 from any alignment
+ * @param  data: First byte
+ * @retval uint32_t: Value
+ */
+VAL_UPDATEFUNC static uint32_t Update_ReadU32(const uint8_t* data) {
+  return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/**
+ * @brief  Write a little-endian uint32 to any alignment
+ * @param  data: First byte
+ * @param  value: Value
+ * @retval None
+ */
+VAL_UPDATEFUNC static void Update_WriteU32(uint8_t* data, uint32_t value) {
+  data[0] = (uint8_t)value;
+  data[1] = (uint8_t)(value >> 8);
+  data[2] = (uint8_t)(value >> 16);
+  data[3] = (uint8_t)(value >> 24);
+}
@@ -22,6 +22,17 @@
 #include "val.h"
 #include "app_comms_handler.h"
 #include "app_sys_coordinator.h"
+#include "app_profiler.h"
+#include "app_latency.h"
+#include "app_jitter.h"
+#include "app_boot.h"
+#include "app_resources.h"
+#include "app_crash.h"
+#include "app_logger.h"
+#include "app_supervisor.h"
+#include "app_scheduler.h"
+#include "app_counters.h"
+#include "app_restore.h"
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
@@ -35,7 +46,23 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
-
+#define INIT_TASK_STACK_SIZE    256
+
+/* Analog and data store initialization run in their own tasks, below the
+ * communications handler so it keeps answering while they work */
+#define INIT_STAGE_STACK_SIZE   128
+#define INIT_STAGE_PRIORITY     osPriorityBelowNormal
+
+/* Init task notification bits, one per stage task */
+#define INIT_DONE_ANALOG        0x01U
+#define INIT_DONE_DATA_STORE    0x02U
+#define INIT_DONE_ALL           (INIT_DONE_ANALOG | INIT_DONE_DATA_STORE)
+#define INIT_FAILED             0x80U
+
+/* Zero-current offsets, averaged with the outputs still off:
+ * 64 ms at the default scan rate */
+#define INIT_ZERO_SCANS         64U
+#define INIT_ZERO_TIMEOUT_MS    500U
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -47,6 +74,14 @@
 
 /* USER CODE BEGIN PV */
 static TaskHandle_t init_task_handle = NULL;
+
+/* Task stacks and control blocks, all allocated statically */
+static uint32_t init_task_stack[INIT_TASK_STACK_SIZE];
+static osStaticThreadDef_t init_task_tcb;
+static uint32_t init_analog_stack[INIT_STAGE_STACK_SIZE];
+static osStaticThreadDef_t init_analog_tcb;
+static uint32_t init_data_store_stack[INIT_STAGE_STACK_SIZE];
+static osStaticThreadDef_t init_data_store_tcb;
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -55,6 +90,9 @@ void MX_FREERTOS_Init(void);
 static void System_Init(void);
 static void System_Error(void);
 static void Init_Task(void *argument);
+static void Init_AnalogTask(void const *argument);
+static void Init_DataStoreTask(void const *argument);
+static bool Init_FpuContextSaved(void);
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
@@ -67,14 +105,36 @@ static void Init_Task(void *argument);
 static void System_Init(void) {
   VAL_Status status;
 
-  /* Initialize all Vendor Abstraction Layer modules */
+  /* Outputs off and clock running; slow modules wait for the scheduler */
   status = VAL_Init();
   if (status != VAL_OK) {
     System_Error();
   }
+  Boot_Mark(BOOT_STAGE_OUTPUTS_SAFE);
+
+  /* Lifetime counters sit in the RTC backup registers, which VAL_Init opened */
+  Counters_Init();
+
+  /* Lights kept on through a reset come back before anything slow runs */
+  Restore_Init();
+
+  /* Initialize latency probes before any task can record into them */
+  Profiler_Init();
+  Latency_Init();
+  Jitter_Init();
+
+  /* Pick up a crash report left by the last reset */
+  Crash_Init();
+
+  /* Pick up a stack overflow that caused the last reset */
+  Resources_Init();
+
+  /* Pick up a stuck task that caused the last reset */
+  Supervisor_Init();
 
   /* Create initialization task to complete initialization after FreeRTOS starts */
-  osThreadDef(InitTask, Init_Task, osPriorityHigh, 0, 256);
+  osThreadStaticDef(InitTask, Init_Task, osPriorityHigh, 0, INIT_TASK_STACK_SIZE,
+                    init_task_stack, &init_task_tcb);
   init_task_handle = osThreadCreate(osThread(InitTask), NULL);
 
   if (init_task_handle == NULL) {
@@ -89,27 +149,134 @@ static void System_Init(void) {
   */
 static void Init_Task(void *argument) {
   VAL_Status status;
+  uint32_t done = 0;
+  uint32_t events;
+
+  Boot_Mark(BOOT_STAGE_SCHEDULER);
+
+  /* Tasks and interrupts share the FPU registers */
+  if (!Init_FpuContextSaved()) {
+    System_Error();
+  }
 
-  /* Initialize communications handler */
+  /* Bring up the serial link first, so the host gets answers during start-up */
   status = COMMS_Handler_Handler_Init();
   if (status != VAL_OK) {
     System_Error();
   }
+  Boot_Mark(BOOT_STAGE_SERIAL);
 
-  /* Initialize System Coordinator*/
+  /* Logging needs the serial link; messages from interrupts may come earlier */
+  if (Logger_Init() != VAL_OK) {
+    System_Error();
+  }
+
+  /* Initialize analog inputs and data store side by side */
+  osThreadStaticDef(InitAnalog, Init_AnalogTask, INIT_STAGE_PRIORITY, 0, INIT_STAGE_STACK_SIZE,
+                    init_analog_stack, &init_analog_tcb);
+  osThreadStaticDef(InitDataStore, Init_DataStoreTask, INIT_STAGE_PRIORITY, 0, INIT_STAGE_STACK_SIZE,
+                    init_data_store_stack, &init_data_store_tcb);
+  if (osThreadCreate(osThread(InitAnalog), NULL) == NULL ||
+      osThreadCreate(osThread(InitDataStore), NULL) == NULL) {
+    System_Error();
+  }
+
+  while ((done & INIT_DONE_ALL) != INIT_DONE_ALL) {
+    xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+    if (events & INIT_FAILED) {
+      System_Error();
+    }
+    done |= events;
+  }
+
+  /* Initialize System Coordinator, it needs sensors and stored settings */
   status = SYS_Coordinator_Init();
   if (status != VAL_OK) {
 	  System_Error();
   }
+  Boot_Mark(BOOT_STAGE_COORDINATOR);
+
+  /* Periodic jobs wake the coordinator and the error log task */
+  if (Scheduler_Init() != VAL_OK) {
+    System_Error();
+  }
 
   /* Send system ready message */
-  VAL_Serial_Printf("Wiseled_LBR System ready!\r\n");
+  LOGGER_LOG(LOGGER_LEVEL_INFO, LOGGER_MSG_SYSTEM_READY, 0, 0);
+  Boot_Mark(BOOT_STAGE_READY);
+  Restore_Confirm();
+
+  /* All tasks run now; from here a stuck task resets the MCU */
+  if (Supervisor_Start() != VAL_OK) {
+    System_Error();
+  }
 
   /* Delete the init task as it's no longer needed */
   vTaskDelete(NULL);
 
 }
 
+/**
+  * @brief Analog inputs initialization task
+  * @param  argument: Not used
+  * @retval None
+  */
+static void Init_AnalogTask(void const *argument) {
+  uint32_t result = INIT_DONE_ANALOG;
+
+  if (VAL_Analog_Init() != VAL_OK) {
+    result = INIT_FAILED;
+  } else {
+    /* Before the coordinator converts any threshold; a light that reads
+     * too high keeps a zero offset, which only makes it read high. Lights
+     * restored on have no zero to capture, all keep the zero offset then */
+    if (!Restore_IsActive() && VAL_Analog_StartZeroCapture(INIT_ZERO_SCANS) == VAL_OK) {
+      for (uint32_t waited = 0;
+           waited < INIT_ZERO_TIMEOUT_MS && VAL_Analog_ApplyZeroCapture() == VAL_BUSY;
+           waited++) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+      }
+    }
+    Boot_Mark(BOOT_STAGE_ANALOG);
+  }
+
+  xTaskNotify(init_task_handle, result, eSetBits);
+  vTaskDelete(NULL);
+}
+
+/**
+  * @brief Data store initialization task
+  * @param  argument: Not used
+  * @retval None
+  */
+static void Init_DataStoreTask(void const *argument) {
+  uint32_t result = INIT_DONE_DATA_STORE;
+
+  if (VAL_DataStore_Init() != VAL_OK) {
+    result = INIT_FAILED;
+  } else {
+    Boot_Mark(BOOT_STAGE_DATA_STORE);
+  }
+
+  xTaskNotify(init_task_handle, result, eSetBits);
+  vTaskDelete(NULL);
+}
+
+/**
+  * @brief Check that the FPU is enabled and its context is stacked lazily
+  * @note  SystemInit grants access to CP10/CP11 and the scheduler start sets
+  *        ASPEN and LSPEN. Without them, an interrupt using the FPU would
+  *        overwrite the registers of the task it interrupted, and a task
+  *        switch would not save them.
+  * @retval bool: true if both are set up
+  */
+static bool Init_FpuContextSaved(void) {
+  uint32_t cp_access = (3UL << 20U) | (3UL << 22U);
+  uint32_t lazy_stacking = FPU_FPCCR_ASPEN_Msk | FPU_FPCCR_LSPEN_Msk;
+
+  return (SCB->CPACR & cp_access) == cp_access && (FPU->FPCCR & lazy_stacking) == lazy_stacking;
+}
+
 /**
   * @brief Handle system initialization error
   * @retval None
@@ -44,6 +44,16 @@ defined in linker script */
 .word	_sbss
 /* end address for the .bss section. defined in linker script */
 .word	_ebss
+/* start address for the initialization values of the .ramfunc section */
+.word	_siramfunc
+/* start address for the .ramfunc section in SRAM2 */
+.word	_sramfunc
+/* end address for the .ramfunc section in SRAM2 */
+.word	_eramfunc
+/* start address for the .sram2_bss section */
+.word	_ssram2_bss
+/* end address for the .sram2_bss section */
+.word	_esram2_bss
 
 .equ  BootRAM,        0xF1E0F85F
 /**
@@ -95,6 +105,37 @@ LoopFillZerobss:
   cmp r2, r4
   bcc FillZerobss
 
+/* Copy the code run from SRAM2 */
+  ldr r0, =_sramfunc
+  ldr r1, =_eramfunc
+  ldr r2, =_siramfunc
+  movs r3, #0
+  b LoopCopyRamFunc
+
+CopyRamFunc:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyRamFunc:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyRamFunc
+
+/* Zero fill the SRAM2 bss segment. */
+  ldr r2, =_ssram2_bss
+  ldr r4, =_esram2_bss
+  movs r3, #0
+  b LoopFillZeroSram2
+
+FillZeroSram2:
+  str  r3, [r2]
+  adds r2, r2, #4
+
+LoopFillZeroSram2:
+  cmp r2, r4
+  bcc FillZeroSram2
+
 /* Call static constructors */
     bl __libc_init_array
 /* Call the application's entry point.*/
@@ -53,10 +53,26 @@ void BusFault_Handler(void);
 void UsageFault_Handler(void);
 void DebugMon_Handler(void);
 void DMA1_Channel1_IRQHandler(void);
+void DMA1_Channel4_IRQHandler(void);
+void DMA1_Channel5_IRQHandler(void);
+void DMA1_Channel6_IRQHandler(void);
 void ADC1_IRQHandler(void);
 void USART1_IRQHandler(void);
 void TIM7_IRQHandler(void);
 /* USER CODE BEGIN EFP */
+void LPTIM1_IRQHandler(void);
+void TIM2_IRQHandler(void);
+void TIM1_UP_TIM16_IRQHandler(void);
+void TIM1_TRG_COM_IRQHandler(void);
+void TIM1_BRK_TIM15_IRQHandler(void);
+void EXTI9_5_IRQHandler(void);
+void EXTI15_10_IRQHandler(void);
+void COMP_IRQHandler(void);
+void PVD_PVM_IRQHandler(void);
+void DMA2_Channel2_IRQHandler(void);
+void DMA1_Channel2_IRQHandler(void);
+void EXTI0_IRQHandler(void);
+void EXTI4_IRQHandler(void);
 
 /* USER CODE END EFP */
 
@@ -21,7 +21,41 @@
 #include "adc.h"
 
 /* USER CODE BEGIN 0 */
-
+#include "val_board.h"
+
+/* Regular sequence, expanded from the board profile: all current inputs,
+ * all temperature inputs, then VREFINT and the die sensor (val_analog.h).
+ * The current inputs come from low-impedance amplifiers and take the short
+ * sampling time; the dividers and the internal channels need the long one. */
+typedef struct {
+  uint32_t channel;
+  uint32_t sampling_time;
+} ADC_SequenceEntry_t;
+
+#define ADC_CURRENT_ENTRY(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, temp_pin, \
+                          awd, comp, cie_x, cie_y, lumens, curve) \
+  { (current_input), VAL_BOARD_CURRENT_SAMPLING },
+#define ADC_TEMPERATURE_ENTRY(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, temp_pin, \
+                              awd, comp, cie_x, cie_y, lumens, curve) \
+  { (temp_input), VAL_BOARD_TEMPERATURE_SAMPLING },
+
+static const ADC_SequenceEntry_t adc_sequence[] = {
+  VAL_BOARD_LIGHTS(ADC_CURRENT_ENTRY)
+  VAL_BOARD_LIGHTS(ADC_TEMPERATURE_ENTRY)
+  { ADC_CHANNEL_VREFINT, VAL_BOARD_TEMPERATURE_SAMPLING },
+  { ADC_CHANNEL_TEMPSENSOR, VAL_BOARD_TEMPERATURE_SAMPLING },
+};
+
+#define ADC_SEQUENCE_LENGTH (sizeof(adc_sequence) / sizeof(adc_sequence[0]))
+
+static const uint32_t adc_ranks[] = {
+  ADC_REGULAR_RANK_1,  ADC_REGULAR_RANK_2,  ADC_REGULAR_RANK_3,  ADC_REGULAR_RANK_4,
+  ADC_REGULAR_RANK_5,  ADC_REGULAR_RANK_6,  ADC_REGULAR_RANK_7,  ADC_REGULAR_RANK_8,
+  ADC_REGULAR_RANK_9,  ADC_REGULAR_RANK_10, ADC_REGULAR_RANK_11, ADC_REGULAR_RANK_12,
+  ADC_REGULAR_RANK_13, ADC_REGULAR_RANK_14, ADC_REGULAR_RANK_15, ADC_REGULAR_RANK_16
+};
+
+_Static_assert(ADC_SEQUENCE_LENGTH <= sizeof(adc_ranks) / sizeof(adc_ranks[0]), "Board profile exceeds the ADC sequence");
 /* USER CODE END 0 */
 
 ADC_HandleTypeDef hadc1;
@@ -50,11 +84,11 @@ void MX_ADC1_Init(void)
   hadc1.Init.ScanConvMode = ADC_SCAN_ENABLE;
   hadc1.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
   hadc1.Init.LowPowerAutoWait = DISABLE;
-  hadc1.Init.ContinuousConvMode = ENABLE;
-  hadc1.Init.NbrOfConversion = 6;
+  hadc1.Init.ContinuousConvMode = DISABLE;
+  hadc1.Init.NbrOfConversion = ADC_SEQUENCE_LENGTH;
   hadc1.Init.DiscontinuousConvMode = DISABLE;
-  hadc1.Init.ExternalTrigConv = ADC_SOFTWARE_START;
-  hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_NONE;
+  hadc1.Init.ExternalTrigConv = ADC_EXTERNALTRIG_T6_TRGO;
+  hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
   hadc1.Init.DMAContinuousRequests = ENABLE;
   hadc1.Init.Overrun = ADC_OVR_DATA_OVERWRITTEN;
   hadc1.Init.OversamplingMode = DISABLE;
@@ -63,62 +97,20 @@ void MX_ADC1_Init(void)
     Error_Handler();
   }
 
-  /** Configure Regular Channel
+  /** Configure Regular Channels, in the order of the board profile
   */
-  sConfig.Channel = ADC_CHANNEL_6;
-  sConfig.Rank = ADC_REGULAR_RANK_1;
-  sConfig.SamplingTime = ADC_SAMPLETIME_247CYCLES_5;  // Increased sampling time
   sConfig.SingleDiff = ADC_SINGLE_ENDED;
   sConfig.OffsetNumber = ADC_OFFSET_NONE;
   sConfig.Offset = 0;
-  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
-  {
-    Error_Handler();
-  }
-
-  /** Configure Regular Channel
-  */
-  sConfig.Channel = ADC_CHANNEL_8;
-  sConfig.Rank = ADC_REGULAR_RANK_2;
-  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
-  {
-    Error_Handler();
-  }
-
-  /** Configure Regular Channel
-  */
-  sConfig.Channel = ADC_CHANNEL_9;
-  sConfig.Rank = ADC_REGULAR_RANK_3;
-  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
-  {
-    Error_Handler();
-  }
-
-  /** Configure Regular Channel
-  */
-  sConfig.Channel = ADC_CHANNEL_10;
-  sConfig.Rank = ADC_REGULAR_RANK_4;
-  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
-  {
-    Error_Handler();
-  }
-
-  /** Configure Regular Channel
-  */
-  sConfig.Channel = ADC_CHANNEL_11;
-  sConfig.Rank = ADC_REGULAR_RANK_5;
-  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+  for (uint32_t i = 0; i < ADC_SEQUENCE_LENGTH; i++)
   {
-    Error_Handler();
-  }
-
-  /** Configure Regular Channel
-  */
-  sConfig.Channel = ADC_CHANNEL_12;
-  sConfig.Rank = ADC_REGULAR_RANK_6;
-  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
-  {
-    Error_Handler();
+    sConfig.Channel = adc_sequence[i].channel;
+    sConfig.Rank = adc_ranks[i];
+    sConfig.SamplingTime = adc_sequence[i].sampling_time;
+    if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+    {
+      Error_Handler();
+    }
   }
   /* USER CODE BEGIN ADC1_Init 2 */
 
@@ -164,18 +156,12 @@ void HAL_ADC_MspInit(ADC_HandleTypeDef* adcHandle)
 
     __HAL_RCC_GPIOA_CLK_ENABLE();
     /**ADC1 GPIO Configuration
-    PA1     ------> ADC1_IN6
-    PA3     ------> ADC1_IN8
-    PA4     ------> ADC1_IN9
-    PA5     ------> ADC1_IN10
-    PA6     ------> ADC1_IN11
-    PA7     ------> ADC1_IN12
+    Current and temperature inputs of the board profile (val_board.h)
     */
-    GPIO_InitStruct.Pin = LED1_ADC_Current_Pin|LED2_ADC_Current_Pin|LED3_ADC_Current_Pin|LED1_ADC_Temperature_Pin
-                          |LED2_ADC_Temperature_Pin|LED3_ADC_Temperature_Pin;
+    GPIO_InitStruct.Pin = VAL_BOARD_ANALOG_PINS;
     GPIO_InitStruct.Mode = GPIO_MODE_ANALOG_ADC_CONTROL;
     GPIO_InitStruct.Pull = GPIO_NOPULL;
-    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+    HAL_GPIO_Init(VAL_BOARD_GPIO, &GPIO_InitStruct);
 
     /* ADC1 DMA Init */
     /* ADC1 Init */
@@ -184,8 +170,8 @@ void HAL_ADC_MspInit(ADC_HandleTypeDef* adcHandle)
     hdma_adc1.Init.Direction = DMA_PERIPH_TO_MEMORY;
     hdma_adc1.Init.PeriphInc = DMA_PINC_DISABLE;
     hdma_adc1.Init.MemInc = DMA_MINC_ENABLE;
-    hdma_adc1.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
-    hdma_adc1.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    hdma_adc1.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    hdma_adc1.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
     hdma_adc1.Init.Mode = DMA_CIRCULAR;
     hdma_adc1.Init.Priority = DMA_PRIORITY_VERY_HIGH;
     if (HAL_DMA_Init(&hdma_adc1) != HAL_OK)
@@ -216,15 +202,9 @@ void HAL_ADC_MspDeInit(ADC_HandleTypeDef* adcHandle)
     __HAL_RCC_ADC_CLK_DISABLE();
 
     /**ADC1 GPIO Configuration
-    PA1     ------> ADC1_IN6
-    PA3     ------> ADC1_IN8
-    PA4     ------> ADC1_IN9
-    PA5     ------> ADC1_IN10
-    PA6     ------> ADC1_IN11
-    PA7     ------> ADC1_IN12
+    Current and temperature inputs of the board profile (val_board.h)
     */
-    HAL_GPIO_DeInit(GPIOA, LED1_ADC_Current_Pin|LED2_ADC_Current_Pin|LED3_ADC_Current_Pin|LED1_ADC_Temperature_Pin
-                          |LED2_ADC_Temperature_Pin|LED3_ADC_Temperature_Pin);
+    HAL_GPIO_DeInit(VAL_BOARD_GPIO, VAL_BOARD_ANALOG_PINS);
 
     /* ADC1 DMA DeInit */
     HAL_DMA_DeInit(adcHandle->DMA_Handle);
@@ -22,6 +22,20 @@
 #include "stm32l4xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "app_resources.h"
+#include "app_crash.h"
+#include "FreeRTOS.h"  /* traceISR_ENTER and traceISR_EXIT */
+#include "val_sys_clock.h"
+#include "val_low_power.h"
+#include "val_timers.h"
+#include "val_pwm.h"
+#include "val_comparator.h"
+#include "val_pvd.h"
+#include "val_dma.h"
+#include "val_ext_adc.h"
+#include "val_i2c_temp.h"
+#include "val_spi_slave.h"
+#include "val_serial_comms.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -57,6 +71,9 @@
 /* External variables --------------------------------------------------------*/
 extern DMA_HandleTypeDef hdma_adc1;
 extern ADC_HandleTypeDef hadc1;
+extern DMA_HandleTypeDef hdma_usart1_rx;
+extern DMA_HandleTypeDef hdma_usart1_tx;
+extern DMA_HandleTypeDef hdma_tim1_up;
 extern UART_HandleTypeDef huart1;
 extern TIM_HandleTypeDef htim7;
 
@@ -85,61 +102,45 @@ void NMI_Handler(void)
 /**
   * @brief This function handles Hard fault interrupt.
   */
-void HardFault_Handler(void)
+__attribute__((naked)) void HardFault_Handler(void)
 {
   /* USER CODE BEGIN HardFault_IRQn 0 */
-
+  /* Records a crash report and resets */
+  CRASH_FAULT_ENTRY();
   /* USER CODE END HardFault_IRQn 0 */
-  while (1)
-  {
-    /* USER CODE BEGIN W1_HardFault_IRQn 0 */
-    /* USER CODE END W1_HardFault_IRQn 0 */
-  }
 }
 
 /**
   * @brief This function handles Memory management fault.
   */
-void MemManage_Handler(void)
+__attribute__((naked)) void MemManage_Handler(void)
 {
   /* USER CODE BEGIN MemoryManagement_IRQn 0 */
-
+  /* Records a crash report and resets */
+  CRASH_FAULT_ENTRY();
   /* USER CODE END MemoryManagement_IRQn 0 */
-  while (1)
-  {
-    /* USER CODE BEGIN W1_MemoryManagement_IRQn 0 */
-    /* USER CODE END W1_MemoryManagement_IRQn 0 */
-  }
 }
 
 /**
   * @brief This function handles Prefetch fault, memory access fault.
   */
-void BusFault_Handler(void)
+__attribute__((naked)) void BusFault_Handler(void)
 {
   /* USER CODE BEGIN BusFault_IRQn 0 */
-
+  /* Records a crash report and resets */
+  CRASH_FAULT_ENTRY();
   /* USER CODE END BusFault_IRQn 0 */
-  while (1)
-  {
-    /* USER CODE BEGIN W1_BusFault_IRQn 0 */
-    /* USER CODE END W1_BusFault_IRQn 0 */
-  }
 }
 
 /**
   * @brief This function handles Undefined instruction or illegal state.
   */
-void UsageFault_Handler(void)
+__attribute__((naked)) void UsageFault_Handler(void)
 {
   /* USER CODE BEGIN UsageFault_IRQn 0 */
-
+  /* Records a crash report and resets */
+  CRASH_FAULT_ENTRY();
   /* USER CODE END UsageFault_IRQn 0 */
-  while (1)
-  {
-    /* USER CODE BEGIN W1_UsageFault_IRQn 0 */
-    /* USER CODE END W1_UsageFault_IRQn 0 */
-  }
 }
 
 /**
@@ -168,25 +169,77 @@ void DebugMon_Handler(void)
 void DMA1_Channel1_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Channel1_IRQn 0 */
-
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
   /* USER CODE END DMA1_Channel1_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_adc1);
   /* USER CODE BEGIN DMA1_Channel1_IRQn 1 */
-
+  Resources_IsrDone(RESOURCES_ISR_ADC_DMA, isr_start);
+  traceISR_EXIT();
   /* USER CODE END DMA1_Channel1_IRQn 1 */
 }
 
+/**
+  * @brief This function handles DMA1 channel4 global interrupt.
+  */
+void DMA1_Channel4_IRQHandler(void)
+{
+  /* USER CODE BEGIN DMA1_Channel4_IRQn 0 */
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  /* USER CODE END DMA1_Channel4_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_usart1_tx);
+  /* USER CODE BEGIN DMA1_Channel4_IRQn 1 */
+  Resources_IsrDone(RESOURCES_ISR_UART_DMA, isr_start);
+  traceISR_EXIT();
+  /* USER CODE END DMA1_Channel4_IRQn 1 */
+}
+
+/**
+  * @brief This function handles DMA1 channel5 global interrupt.
+  */
+void DMA1_Channel5_IRQHandler(void)
+{
+  /* USER CODE BEGIN DMA1_Channel5_IRQn 0 */
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  /* USER CODE END DMA1_Channel5_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_usart1_rx);
+  /* USER CODE BEGIN DMA1_Channel5_IRQn 1 */
+  Resources_IsrDone(RESOURCES_ISR_UART_DMA, isr_start);
+  traceISR_EXIT();
+  /* USER CODE END DMA1_Channel5_IRQn 1 */
+}
+
+/**
+  * @brief This function handles DMA1 channel6 global interrupt.
+  */
+void DMA1_Channel6_IRQHandler(void)
+{
+  /* USER CODE BEGIN DMA1_Channel6_IRQn 0 */
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  /* USER CODE END DMA1_Channel6_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_tim1_up);
+  /* USER CODE BEGIN DMA1_Channel6_IRQn 1 */
+  Resources_IsrDone(RESOURCES_ISR_PWM_DMA, isr_start);
+  traceISR_EXIT();
+  /* USER CODE END DMA1_Channel6_IRQn 1 */
+}
+
 /**
   * @brief This function handles ADC1 global interrupt.
   */
 void ADC1_IRQHandler(void)
 {
   /* USER CODE BEGIN ADC1_IRQn 0 */
-
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
   /* USER CODE END ADC1_IRQn 0 */
   HAL_ADC_IRQHandler(&hadc1);
   /* USER CODE BEGIN ADC1_IRQn 1 */
-
+  Resources_IsrDone(RESOURCES_ISR_ADC, isr_start);
+  traceISR_EXIT();
   /* USER CODE END ADC1_IRQn 1 */
 }
 
@@ -196,11 +249,13 @@ void ADC1_IRQHandler(void)
 void USART1_IRQHandler(void)
 {
   /* USER CODE BEGIN USART1_IRQn 0 */
-
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
   /* USER CODE END USART1_IRQn 0 */
   HAL_UART_IRQHandler(&huart1);
   /* USER CODE BEGIN USART1_IRQn 1 */
-
+  Resources_IsrDone(RESOURCES_ISR_UART, isr_start);
+  traceISR_EXIT();
   /* USER CODE END USART1_IRQn 1 */
 }
 
@@ -210,14 +265,218 @@ void USART1_IRQHandler(void)
 void TIM7_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM7_IRQn 0 */
-
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
   /* USER CODE END TIM7_IRQn 0 */
   HAL_TIM_IRQHandler(&htim7);
   /* USER CODE BEGIN TIM7_IRQn 1 */
-
+  Resources_IsrDone(RESOURCES_ISR_TICK, isr_start);
+  traceISR_EXIT();
   /* USER CODE END TIM7_IRQn 1 */
 }
 
 /* USER CODE BEGIN 1 */
 
+/**
+  * @brief This function handles LPTIM1 global interrupt, the stop mode wake timer.
+  */
+void LPTIM1_IRQHandler(void)
+{
+  traceISR_ENTER();
+  VAL_LowPower_IRQHandler();
+  traceISR_EXIT();
+}
+
+/**
+  * @brief This function handles TIM2 global interrupt, the cue timer.
+  */
+void TIM2_IRQHandler(void)
+{
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  VAL_Timers_CueIRQHandler();
+  Resources_IsrDone(RESOURCES_ISR_CUE, isr_start);
+  traceISR_EXIT();
+}
+
+/**
+  * @brief This function handles TIM1 update and TIM16 global interrupts, the strobe pulse end.
+  */
+void TIM1_UP_TIM16_IRQHandler(void)
+{
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  VAL_PWM_StrobeIRQHandler();
+  Resources_IsrDone(RESOURCES_ISR_STROBE, isr_start);
+  traceISR_EXIT();
+}
+
+/**
+  * @brief This function handles TIM1 trigger and commutation interrupts, the strobe trigger edge.
+  */
+void TIM1_TRG_COM_IRQHandler(void)
+{
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  VAL_PWM_StrobeIRQHandler();
+  Resources_IsrDone(RESOURCES_ISR_STROBE, isr_start);
+  traceISR_EXIT();
+}
+
+/**
+  * @brief This function handles EXTI line[9:5] interrupts, the serial RX wake line.
+  */
+void EXTI9_5_IRQHandler(void)
+{
+  traceISR_ENTER();
+  VAL_LowPower_IRQHandler();
+  traceISR_EXIT();
+}
+
+/**
+  * @brief This function handles EXTI line[15:10] interrupts, the PWM sync line.
+  */
+void EXTI15_10_IRQHandler(void)
+{
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  VAL_PWM_SyncIRQHandler();
+  Resources_IsrDone(RESOURCES_ISR_SYNC, isr_start);
+  traceISR_EXIT();
+}
+
+/**
+  * @brief This function handles COMP1 and COMP2 interrupts through EXTI lines 21 and 22, the over-current trip.
+  */
+void COMP_IRQHandler(void)
+{
+  traceISR_ENTER();
+  VAL_Comparator_IRQHandler();
+  traceISR_EXIT();
+}
+
+/**
+  * @brief This function handles the PVD interrupt through EXTI line 16, the supply voltage warning.
+  */
+void PVD_PVM_IRQHandler(void)
+{
+  traceISR_ENTER();
+  VAL_Pvd_IRQHandler();
+  traceISR_EXIT();
+}
+
+/**
+  * @brief This function handles DMA2 channel2 global interrupt, the memory to memory copies.
+  */
+void DMA2_Channel2_IRQHandler(void)
+{
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  VAL_DMA_IRQHandler();
+  Resources_IsrDone(RESOURCES_ISR_DMA_COPY, isr_start);
+  traceISR_EXIT();
+}
+
+#if VAL_EXT_ADC_CHANNEL_COUNT > 0
+/**
+  * @brief This function handles DMA1 channel2 global interrupt, the external ADC blocks.
+  */
+void DMA1_Channel2_IRQHandler(void)
+{
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  VAL_ExtAdc_IRQHandler();
+  Resources_IsrDone(RESOURCES_ISR_ADC_DMA, isr_start);
+  traceISR_EXIT();
+}
+#endif
+
+#if VAL_I2C_TEMP_ENABLED
+/**
+  * @brief This function handles LPTIM2 global interrupt, the I2C temperature read timer.
+  */
+void LPTIM2_IRQHandler(void)
+{
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  VAL_I2CTemp_TimerIRQHandler();
+  Resources_IsrDone(RESOURCES_ISR_ADC_DMA, isr_start);
+  traceISR_EXIT();
+}
+
+/**
+  * @brief This function handles the I2C event interrupt of the temperature sensors.
+  */
+void VAL_I2CTemp_EventIRQHandler(void)
+{
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  VAL_I2CTemp_IRQHandler();
+  Resources_IsrDone(RESOURCES_ISR_ADC_DMA, isr_start);
+  traceISR_EXIT();
+}
+
+/**
+  * @brief This function handles the I2C error interrupt of the temperature sensors.
+  */
+void VAL_I2CTemp_ErrorIRQHandler(void)
+{
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  VAL_I2CTemp_IRQHandler();
+  Resources_IsrDone(RESOURCES_ISR_ADC_DMA, isr_start);
+  traceISR_EXIT();
+}
+#endif
+
+#if VAL_SPI_SLAVE_ENABLED
+/**
+  * @brief This function handles the EXTI line of the SPI slave NSS, the end of a host transaction.
+  */
+void VAL_SpiSlave_NssIRQHandler(void)
+{
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  VAL_SpiSlave_IRQHandler();
+  Resources_IsrDone(RESOURCES_ISR_UART, isr_start);
+  traceISR_EXIT();
+}
+#endif
+
+#if VAL_SERIAL_WAKE_ENABLED
+/**
+  * @brief This function handles LPUART1 global interrupt, the stop mode serial listener.
+  */
+void LPUART1_IRQHandler(void)
+{
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  VAL_Serial_WakeIRQHandler();
+  Resources_IsrDone(RESOURCES_ISR_UART, isr_start);
+  traceISR_EXIT();
+}
+
+/**
+  * @brief This function handles DMA2 channel7 global interrupt, the stop mode serial listener RX.
+  */
+void DMA2_Channel7_IRQHandler(void)
+{
+  traceISR_ENTER();
+  uint32_t isr_start = VAL_SysClock_GetCycles();
+  VAL_Serial_WakeIRQHandler();
+  Resources_IsrDone(RESOURCES_ISR_UART, isr_start);
+  traceISR_EXIT();
+}
+#endif
+
+#ifdef BENCHMARK
+/**
+  * @brief This function handles TIM1 break and TIM15 global interrupts, the latency probe.
+  */
+void TIM1_BRK_TIM15_IRQHandler(void)
+{
+  VAL_Timers_LatencyIRQHandler();
+}
+#endif
+
 /* USER CODE END 1 */
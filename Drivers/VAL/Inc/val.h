@@ -21,6 +21,9 @@ extern "C" {
 /* Includes ------------------------------------------------------------------*/
 #include "stm32l4xx_hal.h"
 #include "val_status.h"
+#include "val_sections.h"
+#include "val_context.h"
+#include "val_channels.h"
 #include "val_serial_comms.h"
 #include "val_pwm.h"
 #include "val_analog.h"
@@ -28,10 +31,23 @@ extern "C" {
 #include "val_pins.h"
 #include "val_sys_clock.h"
 #include "val_timers.h"
+#include "val_low_power.h"
+#include "val_rtc.h"
+#include "val_watchdog.h"
+#include "val_comparator.h"
+#include "val_pvd.h"
+#include "val_swo.h"
+#include "val_crc.h"
+#include "val_dma.h"
+#include "val_memory.h"
 
 /* Exported functions prototypes ---------------------------------------------*/
 /**
-  * @brief  Initialize all VAL modules
+  * @brief  Initialize the VAL modules needed before the scheduler starts
+  * @note   Leaves the PWM outputs running at 0%. The serial port, analog
+  *         inputs and data store are initialized by the application once the
+  *         scheduler runs (VAL_Serial_InitDMA, VAL_Analog_Init,
+  *         VAL_DataStore_Init).
   * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
   */
 static inline VAL_Status VAL_Init(void) {
@@ -46,30 +62,44 @@ static inline VAL_Status VAL_Init(void) {
     return status;
   }
   
+  /* Force the light outputs off before anything else */
+  status = VAL_PWM_Init();
+  if (status != VAL_OK) {
+    return status;
+  }
+
   /* Initialize GPIO pins */
   status = VAL_Pins_Init();
   if (status != VAL_OK) {
     return status;
   }
 
-  /* Initialize PWM */
-  status = VAL_PWM_Init();
+  /* Diagnostics over SWO take PB3 from the board LED under a debugger */
+  VAL_SWO_Init();
+
+  /* Prepare the stop mode wake sources */
+  status = VAL_LowPower_Init();
   if (status != VAL_OK) {
     return status;
   }
-  
-  /* Initialize analog inputs */
-  status = VAL_Analog_Init();
+
+  /* CRC unit for the frame and image checks */
+  status = VAL_Crc_Init();
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* DMA channel for bulk copies */
+  status = VAL_DMA_Init();
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* Wall-clock time, kept through resets */
+  status = VAL_RTC_Init();
   if (status != VAL_OK) {
     return status;
   }
-  
-  /* Initialize data storage */
-  // TODO
-//  status = VAL_DataStore_Init();
-//  if (status != VAL_OK) {
-//    return status;
-//  }
   
   return VAL_OK;
 }
@@ -15,21 +15,249 @@ extern "C" {
 
 /* Includes ------------------------------------------------------------------*/
 #include <stdint.h>
+#include <stdbool.h>
 #include "val_status.h"
+#include "val_channels.h"
 
 /* Exported types ------------------------------------------------------------*/
 typedef struct {
-  uint8_t light_id;       /* Light ID (1-3) */
+  uint8_t light_id;       /* Light ID (1-VAL_LIGHT_COUNT) */
   float current;         /* Current in milliamps */
   float temperature;     /* Temperature in degrees Celsius */
+  float current_raw;     /* Latest unfiltered current */
+  float temperature_raw; /* Latest unfiltered temperature */
 } LightSensorData;
 
+typedef struct {
+  uint8_t light_id;          /* Light ID (1-VAL_LIGHT_COUNT) */
+  int32_t current_ma;        /* Current in milliamps */
+  int32_t temperature_cdeg;  /* Temperature in hundredths of a degree Celsius */
+} LightSensorDataFixed;
+
+typedef struct {
+  uint16_t oversampling_ratio;  /* Hardware oversampling ratio: 1 (off), 2, 4 ... 256 */
+  uint8_t oversampling_shift;   /* Right shift applied to the oversampled sum (0-8) */
+  uint8_t scan_average;         /* Number of scans averaged in software (1-ANALOG_MAX_SCAN_AVERAGE) */
+} AnalogConfig;
+
+typedef enum {
+  ANALOG_FILTER_BOXCAR = 0,  /* Mean of the last scan_average scans */
+  ANALOG_FILTER_EMA,         /* Exponential moving average */
+  ANALOG_FILTER_MEDIAN5,     /* Median of the last 5 scans */
+  ANALOG_FILTER_COUNT
+} AnalogFilterType;
+
+typedef enum {
+  ANALOG_INPUT_CURRENT = 0,
+  ANALOG_INPUT_TEMPERATURE
+} AnalogInput;
+
+typedef struct {
+  AnalogFilterType type;
+  uint8_t ema_shift;     /* EMA weight of a new scan is 1/2^shift (1-ANALOG_MAX_EMA_SHIFT) */
+} AnalogFilter;
+
+/* Temperature calibration table point */
+typedef struct {
+  uint16_t mv;           /* Voltage at the ADC pin */
+  int16_t cdeg;          /* Temperature at that voltage, centi-degrees */
+} AnalogCalPoint;
+
+/* Exported constants --------------------------------------------------------*/
+#define ANALOG_MAX_SCAN_AVERAGE 16
+#define ANALOG_MAX_EMA_SHIFT 8
+#define ANALOG_MEDIAN_TAPS 5
+#define ANALOG_MAX_SCALE_PER_MV 1000  /* Largest conversion factor per mV at the ADC pin */
+#define ANALOG_CHANNEL_COUNT (2 * VAL_LIGHT_COUNT + 2)  /* All currents, all temperatures, then the internal channels */
+#define ANALOG_RANK_VREFINT (2 * VAL_LIGHT_COUNT)       /* Internal reference voltage */
+#define ANALOG_RANK_DIE_TEMPERATURE (2 * VAL_LIGHT_COUNT + 1)  /* Internal temperature sensor */
+#define ANALOG_SCANS_PER_BLOCK 4    /* Default scans per DMA half buffer */
+#define ANALOG_MAX_BLOCK_SCANS 16   /* Largest block, VAL_Analog_SetBlockScans */
+#define ANALOG_CAPTURE_MAX_SCANS 768  /* Raw capture length, 12 KB of RAM2 with three lights */
+#define ANALOG_CAL_MAX_POINTS 16    /* Temperature calibration table points per light */
+#define ANALOG_CAL_GAIN_UNITY 10000U  /* Calibration gain of 1.0 */
+#define ANALOG_ZERO_MAX_SCANS 1024  /* Scans averaged for the zero-current offsets */
+
+/* Per-light calibration, applied on top of the VAL_Analog_SetScale factors */
+typedef struct {
+  uint16_t current_gain;            /* Per ANALOG_CAL_GAIN_UNITY, non-zero */
+  int16_t current_offset_ma;        /* Added after the gain */
+  uint16_t temperature_gain;        /* Per ANALOG_CAL_GAIN_UNITY, non-zero */
+  int16_t temperature_offset_cdeg;  /* Added after the gain */
+  uint8_t point_count;              /* Table points (2-ANALOG_CAL_MAX_POINTS), 0 for the linear scale */
+  AnalogCalPoint points[ANALOG_CAL_MAX_POINTS];  /* Rising in voltage and temperature */
+} AnalogCalibration;
+
+/* When the readings were taken, and the MCU readings of the same scans */
+typedef struct {
+  uint32_t sequence;        /* Scans completed up to the readings, see VAL_Analog_GetSampleCount */
+  uint32_t timestamp_us;    /* VAL_SysClock_GetMicros at the end of the last scan block */
+  uint16_t supply_mv;       /* VDDA measured with VREFINT */
+  int16_t mcu_temperature_cdeg;  /* MCU die temperature, centi-degrees */
+} AnalogSampleStamp;
+
+typedef struct {
+  uint32_t first_sample;    /* Scan count of the first scan in the block */
+  uint8_t scan_count;       /* Number of scans in the block */
+  const uint16_t* samples;  /* scan_count x ANALOG_CHANNEL_COUNT raw samples */
+  uint32_t start_us;        /* VAL_SysClock_GetMicros when processing of the block began */
+} AnalogSampleBlock;
+
+/* What starts a raw capture */
+typedef enum {
+  ANALOG_CAPTURE_IMMEDIATE = 0,  /* The next block */
+  ANALOG_CAPTURE_EXTERNAL,       /* The block in progress at VAL_Analog_TriggerCapture */
+  ANALOG_CAPTURE_RISING,         /* The first scan at or above the threshold after one below */
+  ANALOG_CAPTURE_FALLING,        /* The first scan below the threshold after one at or above */
+  ANALOG_CAPTURE_FAULT,          /* The block in progress at VAL_Analog_TriggerFaultCapture */
+  ANALOG_CAPTURE_TRIGGER_COUNT
+} AnalogCaptureTrigger;
+
+typedef enum {
+  ANALOG_CAPTURE_IDLE = 0,       /* No capture started since initialization */
+  ANALOG_CAPTURE_ARMED,          /* Waiting for the trigger */
+  ANALOG_CAPTURE_RUNNING,        /* Recording */
+  ANALOG_CAPTURE_DONE            /* All scans recorded */
+} AnalogCaptureState;
+
+typedef struct {
+  uint16_t scans;                /* Scans to record (1-ANALOG_CAPTURE_MAX_SCANS) */
+  uint16_t pre_scans;            /* Of those, scans kept from before the trigger (below scans, 0 for IMMEDIATE) */
+  AnalogCaptureTrigger trigger;
+  uint8_t light_id;              /* Input compared with the threshold, RISING and FALLING only */
+  AnalogInput input;
+  uint32_t threshold_counts;     /* Raw counts, see VAL_Analog_CurrentToCounts */
+} AnalogCaptureConfig;
+
+typedef struct {
+  AnalogCaptureState state;
+  AnalogCaptureTrigger trigger;
+  uint16_t scans;                /* Scans recorded so far */
+  uint16_t scans_wanted;         /* Scans the capture was started with */
+  uint16_t trigger_scan;         /* Index of the first scan from the trigger on */
+  uint32_t first_sample;         /* Scan count of the first recorded scan */
+} AnalogCaptureStatus;
+
+/* Statistics of one input over the raw scans of a window */
+typedef struct {
+  int32_t min;                   /* Milliamps or centi-degrees */
+  int32_t max;
+  int32_t mean;
+  int32_t rms;                   /* Root mean square */
+} AnalogStatsReading;
+
+typedef struct {
+  uint8_t light_id;              /* Light ID (1-VAL_LIGHT_COUNT) */
+  AnalogStatsReading current;
+  AnalogStatsReading temperature;
+} AnalogLightStats;
+
+typedef struct {
+  uint32_t scans;                /* Scans covered, 0 if none yet */
+  uint32_t window_scans;         /* Scans per window, 0 for one run since the last reset */
+  uint32_t first_sample;         /* Scan count of the first scan covered */
+  AnalogLightStats lights[VAL_LIGHT_COUNT];
+} AnalogStats;
+
+/* ADC errors since start-up, by HAL_ADC_ERROR_x type */
+typedef struct {
+  uint32_t overrun;           /* HAL_ADC_ERROR_OVR */
+  uint32_t dma;               /* HAL_ADC_ERROR_DMA and DMA channel errors */
+  uint32_t internal;          /* HAL_ADC_ERROR_INTERNAL */
+  uint32_t other;             /* Injected queue overflow and unknown errors */
+  uint32_t recoveries;        /* Restarts by VAL_Analog_Recover */
+} AnalogErrorCounts;
+
+#ifdef BENCHMARK
+/* Synthetic waveforms, substituted for one input from its edge on */
+typedef enum {
+  ANALOG_SYNTH_STEP = 0,         /* level from the edge on */
+  ANALOG_SYNTH_RAMP,             /* Last real sample to level over length_scans, then level */
+  ANALOG_SYNTH_SPIKE,            /* level for length_scans, every period_scans if not 0 */
+  ANALOG_SYNTH_NOISE,            /* level plus noise from the edge on, meant for noise > 0 */
+  ANALOG_SYNTH_SHAPE_COUNT
+} AnalogSynthShape;
+
+typedef struct {
+  AnalogSynthShape shape;
+  uint8_t light_id;              /* Light ID (1-VAL_LIGHT_COUNT) */
+  AnalogInput input;
+  uint16_t level;                /* Raw counts, see VAL_Analog_CurrentToCounts */
+  uint16_t noise;                /* Peak counts of uniform noise on the synthetic samples */
+  uint32_t delay_scans;          /* Real scans before the edge */
+  uint32_t length_scans;         /* Ramp or spike length */
+  uint32_t period_scans;         /* Spike repetition, 0 for a single spike */
+} AnalogSynthWave;
+
+typedef struct {
+  bool active;
+  uint32_t scans;                /* Scans since the start */
+  uint32_t edge_sample;          /* Scan count of the edge, once edge_us is set */
+  uint64_t edge_us;              /* Time the edge scan was taken, 0 before the edge */
+  uint64_t block_us;             /* Time its block reached the filters */
+} AnalogSynthStatus;
+#endif
+
+typedef void (*AnalogSampleCallback)(void);
+typedef void (*AnalogBlockCallback)(const AnalogSampleBlock* block);
+typedef void (*AnalogWatchdogCallback)(uint8_t light_id);
+typedef void (*AnalogErrorCallback)(uint32_t adc_error, uint32_t dma_error);
+
 /* Exported functions prototypes ---------------------------------------------*/
 VAL_Status VAL_Analog_Init(void);
+void VAL_Analog_InitScale(void);
 VAL_Status VAL_Analog_GetCurrent(uint8_t light_id, float* current);
 VAL_Status VAL_Analog_GetTemperature(uint8_t light_id, float* temperature);
 VAL_Status VAL_Analog_GetSensorData(uint8_t light_id, LightSensorData* sensor_data);
-VAL_Status VAL_Analog_GetAllSensorData(LightSensorData sensor_data[]);
+VAL_Status VAL_Analog_GetAllSensorData(LightSensorData sensor_data[], AnalogSampleStamp* stamp);
+VAL_Status VAL_Analog_GetCurrentMilliAmps(uint8_t light_id, int32_t* current_ma);
+VAL_Status VAL_Analog_GetTemperatureCentiDeg(uint8_t light_id, int32_t* temperature_cdeg);
+VAL_Status VAL_Analog_GetAllSensorDataFixed(LightSensorDataFixed sensor_data[]);
+VAL_Status VAL_Analog_GetRawCounts(uint8_t light_id, uint32_t* current_counts, uint32_t* temperature_counts);
+uint32_t VAL_Analog_CurrentToCounts(uint8_t light_id, int32_t current_ma);
+uint32_t VAL_Analog_TemperatureToCounts(uint8_t light_id, int32_t temperature_cdeg);
+uint32_t VAL_Analog_GetFullScaleCounts(void);
+VAL_Status VAL_Analog_GetSupplyMilliVolts(uint32_t* supply_mv);
+VAL_Status VAL_Analog_GetDieTemperatureCentiDeg(int32_t* temperature_cdeg);
+VAL_Status VAL_Analog_Config(const AnalogConfig* config);
+VAL_Status VAL_Analog_GetConfig(AnalogConfig* config);
+VAL_Status VAL_Analog_SetFilter(uint8_t light_id, AnalogInput input, const AnalogFilter* filter);
+VAL_Status VAL_Analog_GetFilter(uint8_t light_id, AnalogInput input, AnalogFilter* filter);
+VAL_Status VAL_Analog_SetScale(uint16_t current_ma_per_mv, uint16_t temperature_cdeg_per_mv);
+VAL_Status VAL_Analog_GetScale(uint16_t* current_ma_per_mv, uint16_t* temperature_cdeg_per_mv);
+VAL_Status VAL_Analog_SetCalibration(uint8_t light_id, const AnalogCalibration* calibration);
+VAL_Status VAL_Analog_GetCalibration(uint8_t light_id, AnalogCalibration* calibration);
+VAL_Status VAL_Analog_SetSampleRate(uint32_t rate_hz);
+uint32_t VAL_Analog_GetSampleRate(void);
+VAL_Status VAL_Analog_SetBlockScans(uint8_t scans);
+uint8_t VAL_Analog_GetBlockScans(void);
+void VAL_Analog_UpdateClock(void);
+VAL_Status VAL_Analog_SyncToPwm(uint32_t pwm_frequency_hz);
+VAL_Status VAL_Analog_SyncToStrobe(uint32_t pulse_hz);
+uint32_t VAL_Analog_GetSampleCount(void);
+VAL_Status VAL_Analog_SetSampleCallback(AnalogSampleCallback callback, uint32_t min_interval_ms);
+VAL_Status VAL_Analog_SetBlockCallback(AnalogBlockCallback callback);
+VAL_Status VAL_Analog_SetErrorCallback(AnalogErrorCallback callback);
+VAL_Status VAL_Analog_Recover(void);
+VAL_Status VAL_Analog_GetErrorCounts(AnalogErrorCounts* counts);
+VAL_Status VAL_Analog_StartCapture(const AnalogCaptureConfig* config);
+void VAL_Analog_TriggerCapture(void);
+void VAL_Analog_TriggerFaultCapture(void);
+VAL_Status VAL_Analog_GetCaptureStatus(AnalogCaptureStatus* status);
+uint16_t VAL_Analog_ReadCapture(uint16_t first_scan, uint16_t max_scans, uint16_t* samples);
+VAL_Status VAL_Analog_SetStatsWindow(uint32_t window_scans);
+VAL_Status VAL_Analog_GetStats(AnalogStats* stats, uint8_t reset);
+VAL_Status VAL_Analog_StartZeroCapture(uint16_t scans);
+VAL_Status VAL_Analog_ApplyZeroCapture(void);
+#ifdef BENCHMARK
+VAL_Status VAL_Analog_StartSynthetic(const AnalogSynthWave* wave);
+void VAL_Analog_StopSynthetic(void);
+VAL_Status VAL_Analog_GetSyntheticStatus(AnalogSynthStatus* status);
+#endif
+VAL_Status VAL_Analog_EnableCurrentWatchdog(AnalogWatchdogCallback callback, const int32_t* trip_ma);
+VAL_Status VAL_Analog_RearmCurrentWatchdog(uint8_t light_id);
+VAL_Status VAL_Analog_Suspend(void);
+VAL_Status VAL_Analog_Resume(void);
 VAL_Status VAL_Analog_DeInit(void);
 
 #ifdef __cplusplus
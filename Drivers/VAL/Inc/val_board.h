@@ -0,0 +1,177 @@
+/**
+  ******************************************************************************
+  * @file    val_board.h
+  * @brief   Board profile selection and the tables derived from it
+  ******************************************************************************
+  * @attention
+  *
+  * The board profile is chosen at build time with VAL_BOARD_PROFILE, the
+  * header to include (default "val_board_lbr3.h"). A profile lists its
+  * lights in VAL_BOARD_LIGHTS, an X-macro taking one entry per light (see
+  * val_board_lbr3.h for the fields), and defines the board-wide limits,
+  * sense scaling and sampling times.
+  *
+  * Lights run on TIM1 unless their entry names TIM15 or TIM16, each of
+  * which then drives its lights at a frequency of its own, set by the
+  * profile (VAL_BOARD_TIM15_PWM_HZ, VAL_BOARD_TIM16_PWM_HZ; 8 kHz, as TIM1
+  * at reset, when not given). A profile without such a light builds the
+  * same code as before; see val_pwm.c for what the other timers cost.
+  *
+  * Everything per light is expanded from that list at compile time: the
+  * light count, the VAL_Channels table (val_channels.c), the ADC regular
+  * sequence (adc.c), the GPIO sets (adc.c, tim.c, val_pwm.c) and the colour list of
+  * system/capabilities. A variant is a new profile header; the code paths
+  * are the same for all of them and hold no runtime board dispatch.
+  *
+  * A profile may add an external SPI ADC for inputs ADC1 has no room for
+  * (val_ext_adc.c), by defining VAL_BOARD_EXT_ADC_CHANNELS and:
+  *   VAL_BOARD_EXT_ADC_COMMAND(ch)  16-bit SPI frame selecting input ch
+  *   VAL_BOARD_EXT_ADC_LATENCY      Frames from a command to its result
+  *   VAL_BOARD_EXT_ADC_DATA_MASK    Result bits of a received frame
+  *   VAL_BOARD_EXT_ADC_SPI_HZ       Highest SPI clock of the device
+  *   VAL_BOARD_EXT_ADC_SCK, _MISO, _MOSI, _NSS  SPI1 pins, as
+  *                                  VAL_BOARD_PA(n) or VAL_BOARD_PB(n)
+  * Without it, none of that driver is built.
+  *
+  * A profile may likewise wire SPI1 as a slave control link to a host MCU
+  * (val_spi_slave.c), by defining VAL_BOARD_SPI_SLAVE as 1 and:
+  *   VAL_BOARD_SPI_SLAVE_SCK, _MISO, _MOSI  SPI1 pins
+  *   VAL_BOARD_SPI_SLAVE_NSS        SPI1 NSS, PA4 or PB0 (its EXTI line
+  *                                  ends each transaction)
+  *   VAL_BOARD_SPI_SLAVE_IRQ        Event request output to the host
+  * The host protocol then runs over it instead of USART1. SPI1 serves one
+  * of the two, not both.
+  *
+  * A profile sets VAL_BOARD_SERIAL_WAKE to 1 when the host RX line also
+  * reaches PA3 (LPUART1_RX). LPUART1 then listens in STOP2 and receives the
+  * frame that wakes the MCU (val_serial_comms.c); without it the first
+  * byte after a stop only wakes the MCU and is lost.
+  *
+  * A profile whose LED boards carry digital I2C temperature sensors
+  * instead of the thermistor dividers (val_i2c_temp.c) defines
+  * VAL_BOARD_I2C_TEMP as 1 and:
+  *   VAL_BOARD_I2C_TEMP_ADDRESSES   7-bit sensor addresses in light ID
+  *                                  order, comma separated
+  *   VAL_BOARD_I2C_TEMP_REGISTER    Register holding the temperature
+  *   VAL_BOARD_I2C_TEMP_CDEG(raw)   Centi-degrees from the 16-bit register,
+  *                                  MSB first; for an LM75-type sensor
+  *                                  (((int16_t)(raw) >> 4) * 25 / 4)
+  *   VAL_BOARD_I2C_TEMP_SCL, _SDA   PA9 and PA10 (I2C1) or PA7 and PB4
+  *                                  (I2C3)
+  *   VAL_BOARD_I2C_TEMP_PERIOD_MS   Read period of each sensor, 100 ms
+  *                                  when not given
+  * The temperature inputs of the light entries are then still scanned but
+  * no longer read; they may name any spare ADC input.
+  *
+  * VAL_BOARD_SUPPLY_WARN_MV sets the MCU supply level under which the
+  * outputs are shed (val_pvd.c), 2900 mV when not given: under a 3.3 V
+  * regulator it trips when the regulator drops out, well above the
+  * brown-out reset. 0 leaves the supply unwatched.
+  *
+  * The limits also come as counts of the nominal 12-bit reference, checked
+  * against the ADC range when the tables are built. The thresholds the
+  * alarms compare against are still converted at runtime, through the
+  * calibration of each light and the resolution in use.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_BOARD_H
+#define __VAL_BOARD_H
+
+/* Includes ------------------------------------------------------------------*/
+#ifndef VAL_BOARD_PROFILE
+#define VAL_BOARD_PROFILE "val_board_lbr3.h"
+#endif
+#include VAL_BOARD_PROFILE
+
+/* Exported macro ------------------------------------------------------------*/
+/* Expanders of a VAL_BOARD_LIGHTS entry */
+#define VAL_BOARD_ONE(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, temp_pin, \
+                      awd, comp, cie_x, cie_y, lumens, curve) + 1
+#define VAL_BOARD_PWM_PIN(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, temp_pin, \
+                          awd, comp, cie_x, cie_y, lumens, curve) | (pwm_pin)
+#define VAL_BOARD_ANALOG_PIN(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, temp_pin, \
+                             awd, comp, cie_x, cie_y, lumens, curve) | (current_pin) | (temp_pin)
+#define VAL_BOARD_COLOUR_JSON(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, temp_pin, \
+                              awd, comp, cie_x, cie_y, lumens, curve) ",\"" #name "\""
+#define VAL_BOARD_PWM_PIN_SUM(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, \
+                              temp_pin, awd, comp, cie_x, cie_y, lumens, curve) + (pwm_pin)
+#define VAL_BOARD_TIM1_PWM_PIN(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, \
+                               temp_pin, awd, comp, cie_x, cie_y, lumens, curve) | (((tim) == 1) ? (pwm_pin) : 0U)
+#define VAL_BOARD_AUX_PWM(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, temp_pin, \
+                          awd, comp, cie_x, cie_y, lumens, curve) + ((tim) != 1)
+#define VAL_BOARD_ON_TIM15(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, temp_pin, \
+                           awd, comp, cie_x, cie_y, lumens, curve) | ((tim) == 15)
+#define VAL_BOARD_ON_TIM16(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, temp_pin, \
+                           awd, comp, cie_x, cie_y, lumens, curve) | ((tim) == 16)
+
+/* Nominal 12-bit counts of a current or temperature at the reference */
+#define VAL_BOARD_ADC_FULL_SCALE 4095
+#define VAL_BOARD_CURRENT_COUNTS(ma) \
+  ((ma) * VAL_BOARD_ADC_FULL_SCALE / (VAL_BOARD_CURRENT_MA_PER_MV * VAL_BOARD_ADC_REFERENCE_MV))
+#define VAL_BOARD_TEMPERATURE_COUNTS(cdeg) \
+  ((cdeg) * VAL_BOARD_ADC_FULL_SCALE / (VAL_BOARD_TEMPERATURE_CDEG_PER_MV * VAL_BOARD_ADC_REFERENCE_MV))
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_BOARD_LIGHT_COUNT (0 VAL_BOARD_LIGHTS(VAL_BOARD_ONE))  /* Usable in #if */
+#define VAL_BOARD_PWM_PINS (0U VAL_BOARD_LIGHTS(VAL_BOARD_PWM_PIN))
+#define VAL_BOARD_TIM1_PWM_PINS (0U VAL_BOARD_LIGHTS(VAL_BOARD_TIM1_PWM_PIN))
+#define VAL_BOARD_AUX_PWM_PINS (VAL_BOARD_PWM_PINS & ~VAL_BOARD_TIM1_PWM_PINS)
+#define VAL_BOARD_ANALOG_PINS (0U VAL_BOARD_LIGHTS(VAL_BOARD_ANALOG_PIN))
+
+/* Lights on TIM15 and TIM16, usable in #if */
+#define VAL_BOARD_AUX_PWM_LIGHTS (0 VAL_BOARD_LIGHTS(VAL_BOARD_AUX_PWM))
+#define VAL_BOARD_USES_TIM15 (0 VAL_BOARD_LIGHTS(VAL_BOARD_ON_TIM15))
+#define VAL_BOARD_USES_TIM16 (0 VAL_BOARD_LIGHTS(VAL_BOARD_ON_TIM16))
+
+#ifndef VAL_BOARD_TIM15_PWM_HZ
+#define VAL_BOARD_TIM15_PWM_HZ 8000U
+#endif
+#ifndef VAL_BOARD_TIM16_PWM_HZ
+#define VAL_BOARD_TIM16_PWM_HZ 8000U
+#endif
+
+#ifndef VAL_BOARD_EXT_ADC_CHANNELS
+#define VAL_BOARD_EXT_ADC_CHANNELS 0
+#endif
+
+#ifndef VAL_BOARD_SPI_SLAVE
+#define VAL_BOARD_SPI_SLAVE 0
+#endif
+
+#ifndef VAL_BOARD_SERIAL_WAKE
+#define VAL_BOARD_SERIAL_WAKE 0
+#endif
+
+#ifndef VAL_BOARD_I2C_TEMP
+#define VAL_BOARD_I2C_TEMP 0
+#endif
+#ifndef VAL_BOARD_I2C_TEMP_PERIOD_MS
+#define VAL_BOARD_I2C_TEMP_PERIOD_MS 100U
+#endif
+
+#ifndef VAL_BOARD_SUPPLY_WARN_MV
+#define VAL_BOARD_SUPPLY_WARN_MV 2900
+#endif
+
+/* Pins of the external ADC, the SPI slave and the I2C sensors, as the
+ * port index times 16 plus the pin number */
+#define VAL_BOARD_PA(n) (n)
+#define VAL_BOARD_PB(n) (16 + (n))
+#define VAL_BOARD_PIN_PORT(code) (((code) < 16) ? GPIOA : GPIOB)
+#define VAL_BOARD_PIN_MASK(code) (1U << ((code) & 15U))
+#define VAL_BOARD_PA_MASK(code)  (((code) < 16) ? (1U << (code)) : 0U)  /* 0 for a PBn pin */
+
+/* Colours in light ID order, each with a leading comma: skip the first
+ * character for the elements of a JSON array */
+#define VAL_BOARD_COLOURS_JSON VAL_BOARD_LIGHTS(VAL_BOARD_COLOUR_JSON)
+
+#define VAL_BOARD_CURRENT_WARN_COUNTS VAL_BOARD_CURRENT_COUNTS(VAL_BOARD_CURRENT_WARN_MA)
+#define VAL_BOARD_CURRENT_MAX_COUNTS  VAL_BOARD_CURRENT_COUNTS(VAL_BOARD_CURRENT_MAX_MA)
+#define VAL_BOARD_CURRENT_TRIP_COUNTS VAL_BOARD_CURRENT_COUNTS(VAL_BOARD_CURRENT_TRIP_MA)
+#define VAL_BOARD_TEMP_WARN_COUNTS    VAL_BOARD_TEMPERATURE_COUNTS(VAL_BOARD_TEMP_WARN_CDEG)
+#define VAL_BOARD_TEMP_MAX_COUNTS     VAL_BOARD_TEMPERATURE_COUNTS(VAL_BOARD_TEMP_MAX_CDEG)
+
+#endif /* __VAL_BOARD_H */
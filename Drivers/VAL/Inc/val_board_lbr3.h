@@ -0,0 +1,89 @@
+/**
+  ******************************************************************************
+  * @file    val_board_lbr3.h
+  * @brief   Board profile of the three-light LBR fixture
+  ******************************************************************************
+  * @attention
+  *
+  * The single description of the hardware: val_board.h expands it into the
+  * channel table, the ADC sequence, the PWM pin sets and the nominal limit
+  * counts. Nothing else names a pin, an ADC input or a timer channel of a
+  * light.
+  *
+  * One VAL_BOARD_LIGHTS entry per light, in light ID order:
+  *   colour        Name in diagnostics and responses, a bare word
+  *   timer         PWM timer: 1, or 15 or 16 for a light at its own
+  *                 frequency (VAL_BOARD_TIM15_PWM_HZ, VAL_BOARD_TIM16_PWM_HZ)
+  *   pwm_channel   Output of that timer; on TIM1 the channel of the light
+  *                 ID, TIM15 CH1 (PA2) or CH2 (PA3), TIM16 CH1 (PA6)
+  *   pwm_pin       GPIO of the output, on VAL_BOARD_GPIO
+  *   trailing      Pulse ends with the period instead of starting with it
+  *   current_adc   ADC input of the current sense amplifier
+  *   current_pin   GPIO of that input
+  *   temp_adc      ADC input of the temperature divider
+  *   temp_pin      GPIO of that input
+  *   watchdog      ADC analog watchdog guarding the current (1-3), 0 for none
+  *   comparator    COMP breaking the outputs (1-2), 0 for none; COMP1 and
+  *                 COMP2 only reach PA1 and PA3 (see val_comparator.c)
+  *   chroma_x/y    Nominal CIE 1931 chromaticity at full output, 1/10000
+  *   flux_lm       Nominal luminous flux at full duty cycle
+  *   gamma         Gamma compare table (val_pwm_curves.h)
+  *
+  * All three lights share TIM1 and its frequency, which light/set_pwm_freq
+  * changes. Green runs trailing-edge, so its pulse fills the end of the
+  * period while white and red start at its beginning. Colours are the nominal ones of the
+  * LED bins, white at 6500 K; config/set_primary stores measured values.
+  *
+  * There is no external ADC and no SPI slave link: the SPI1 clock can only
+  * be on PA1 or PA5, both sense inputs here, or on PB3, the RS-485 driver
+  * enable. Nor is there a stop mode serial listener: PA3, the only
+  * LPUART1 RX pin, is the green current input. The temperatures come from
+  * thermistors: I2C1 would need PA9 and PA10, the green and red outputs,
+  * and I2C3 PA7, the red temperature input.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_BOARD_LBR3_H
+#define __VAL_BOARD_LBR3_H
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_BOARD_NAME "lbr3"
+
+/*  colour tim pwm_channel    pwm_pin     trailing current_adc    current_pin temp_adc        temp_pin   wd cmp chroma_x/y  flux_lm gamma */
+#define VAL_BOARD_LIGHTS(X) \
+  X(white, 1, TIM_CHANNEL_1, GPIO_PIN_8,  false,  ADC_CHANNEL_6, GPIO_PIN_1, ADC_CHANNEL_10, GPIO_PIN_5, 1, 1, 3127, 3290, 1000, VAL_PWM_GammaWhite) \
+  X(green, 1, TIM_CHANNEL_2, GPIO_PIN_9,  true,   ADC_CHANNEL_8, GPIO_PIN_3, ADC_CHANNEL_11, GPIO_PIN_6, 2, 2, 1700, 7000, 600,  VAL_PWM_GammaGreen) \
+  X(red,   1, TIM_CHANNEL_3, GPIO_PIN_10, false,  ADC_CHANNEL_9, GPIO_PIN_4, ADC_CHANNEL_12, GPIO_PIN_7, 3, 0, 7000, 2990, 300,  VAL_PWM_GammaRed)
+
+/* All PWM outputs and analog inputs are on one port */
+#define VAL_BOARD_GPIO GPIOA
+
+/* Limits shared by all lights. The hardware cutoff acts on single
+ * conversions, so it sits above the averaged software limit to avoid trips
+ * on noise. */
+#define VAL_BOARD_CURRENT_WARN_MA     22500  /* 22.5A warning */
+#define VAL_BOARD_CURRENT_MAX_MA      25000  /* 25A maximum current */
+#define VAL_BOARD_CURRENT_TRIP_MA     27500
+#define VAL_BOARD_TEMP_WARN_CDEG      7500   /* Warning temperature (75°C) */
+#define VAL_BOARD_TEMP_MAX_CDEG       8500   /* Maximum allowed temperature (85°C) */
+
+/* Full scale in 20 ms: too fast to see, slow enough for the supply to
+ * follow without an inrush peak reaching the hardware cutoff */
+#define VAL_BOARD_SLEW_PERMILLE_PER_MS 50
+
+/* LED supply rating, less than all lights at their maximum */
+#define VAL_BOARD_SUPPLY_CURRENT_MAX_MA 60000
+
+/* Sense scaling at the ADC pins */
+#define VAL_BOARD_ADC_REFERENCE_MV        3300U  /* Nominal VDDA */
+#define VAL_BOARD_CURRENT_MA_PER_MV       10U    /* 3.3V = 33A */
+#define VAL_BOARD_TEMPERATURE_CDEG_PER_MV 10U    /* 3.3V = 330°C */
+
+/* Sampling times: the current inputs come from low-impedance amplifiers,
+ * the temperature dividers and the internal channels need the long one */
+#define VAL_BOARD_CURRENT_SAMPLING     ADC_SAMPLETIME_24CYCLES_5
+#define VAL_BOARD_TEMPERATURE_SAMPLING ADC_SAMPLETIME_247CYCLES_5
+
+#endif /* __VAL_BOARD_LBR3_H */
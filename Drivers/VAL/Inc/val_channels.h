@@ -0,0 +1,64 @@
+/**
+  ******************************************************************************
+  * @file    val_channels.h
+  * @brief   Header for val_channels.c module
+  ******************************************************************************
+  * @attention
+  *
+  * Every layer sizes its per-light state with VAL_LIGHT_COUNT and takes the
+  * hardware mapping and limits of a light from VAL_Channels. Both are
+  * generated from the board profile (val_board.h); adding a light means
+  * adding an entry to VAL_BOARD_LIGHTS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_CHANNELS_H
+#define __VAL_CHANNELS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_board.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_LIGHT_COUNT VAL_BOARD_LIGHT_COUNT   /* Entries in VAL_Channels, light IDs 1-VAL_LIGHT_COUNT */
+#define VAL_SUPPLY_CURRENT_MAX_MA VAL_BOARD_SUPPLY_CURRENT_MAX_MA  /* LED supply rating */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  const char* colour;               /* Colour of the fixture, for diagnostics */
+  uint8_t pwm_timer;                /* PWM timer: 1, 15 or 16 (TIMx) */
+  uint32_t pwm_channel;             /* Output channel of that timer (TIM_CHANNEL_x) */
+  bool pwm_trailing;                /* Pulse ends with the period instead of starting with it */
+  uint8_t current_rank;             /* Position of the current input in an ADC scan (0-based) */
+  uint8_t temperature_rank;         /* Position of the temperature input in an ADC scan (0-based) */
+  uint32_t current_adc_channel;     /* ADC input of the current sense (ADC_CHANNEL_x) */
+  uint8_t watchdog;                 /* ADC analog watchdog guarding the current (1-3), 0 for none */
+  uint8_t comparator;               /* Comparator breaking the outputs on over-current (1-2), 0 for none */
+  int32_t current_warn_ma;          /* Over-current warning, output stays on */
+  int32_t current_max_ma;           /* Software over-current limit */
+  int32_t current_trip_ma;          /* Hardware cutoff, checked on single conversions */
+  int32_t temperature_warn_cdeg;    /* Over-temperature warning, output stays on */
+  int32_t temperature_max_cdeg;     /* Software over-temperature limit */
+  uint16_t slew_permille_per_ms;    /* Default slew limit of the duty cycle, 0 for none */
+  uint16_t chroma_x;                /* Default CIE 1931 chromaticity at full output, 1/10000 */
+  uint16_t chroma_y;
+  uint16_t flux_lm;                 /* Default luminous flux at full duty cycle */
+  const uint16_t* gamma_table;      /* Gamma compare table, VAL_PWM_CURVE_ENTRIES values */
+} VAL_Channel_t;
+
+/* Exported variables --------------------------------------------------------*/
+/* Board channel table, indexed by light ID - 1 */
+extern const VAL_Channel_t VAL_Channels[VAL_LIGHT_COUNT];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_CHANNELS_H */
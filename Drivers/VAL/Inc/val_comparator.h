@@ -0,0 +1,32 @@
+/**
+  ******************************************************************************
+  * @file    val_comparator.h
+  * @brief   Header for val_comparator.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_COMPARATOR_H
+#define __VAL_COMPARATOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef void (*VAL_ComparatorCallback)(uint8_t light_id);
+
+/* Exported functions prototypes ---------------------------------------------*/
+VAL_Status VAL_Comparator_Enable(VAL_ComparatorCallback callback, const int32_t* trip_ma);
+VAL_Status VAL_Comparator_Rearm(uint8_t light_id);
+void VAL_Comparator_IRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_COMPARATOR_H */
@@ -0,0 +1,62 @@
+/**
+  ******************************************************************************
+  * @file    val_context.h
+  * @brief   Execution context checks of the Vendor Abstraction Layer
+  ******************************************************************************
+  * @attention
+  *
+  * Each VAL entry point is either safe from any context, and then only
+  * touches registers or queues data under a short PRIMASK section, or is
+  * task context only, because it waits: for the tick, for the TX queue or
+  * for the flash. A wait in an interrupt holds off every interrupt of the
+  * same or lower urgency, and the HAL tick cannot advance meanwhile.
+  *
+  * Task-only functions start with VAL_ASSERT_TASK_CONTEXT(). In Debug
+  * builds a call from an interrupt stops there on a breakpoint; without a
+  * debugger attached the breakpoint faults, and the crash report names the
+  * caller. Release builds compile the check out. The test is the one
+  * FreeRTOS xPortIsInsideInterrupt makes, IPSR non-zero, so the VAL does
+  * not depend on the kernel for it.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_CONTEXT_H
+#define __VAL_CONTEXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include "stm32l4xx.h"
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  Check whether the caller runs in an interrupt handler
+  * @retval bool: true in any exception or interrupt handler
+  */
+static inline bool VAL_IsInterrupt(void) {
+  return __get_IPSR() != 0U;
+}
+
+/* Exported macro ------------------------------------------------------------*/
+/* Stop Debug builds at a waiting call made from an interrupt */
+#ifdef DEBUG
+#define VAL_ASSERT_TASK_CONTEXT() \
+  do { \
+    if (VAL_IsInterrupt()) { \
+      __BKPT(0); \
+    } \
+  } while (0)
+#else
+#define VAL_ASSERT_TASK_CONTEXT() ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_CONTEXT_H */
@@ -0,0 +1,50 @@
+/**
+  ******************************************************************************
+  * @file    val_crc.h
+  * @brief   Header for val_crc.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_CRC_H
+#define __VAL_CRC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_CRC16_POLY      0x1021U       /* CRC16-CCITT, MSB first */
+#define VAL_CRC16_INIT      0xFFFFU
+#define VAL_CRC16_MODBUS_POLY 0x8005U     /* CRC-16/MODBUS, reflected, same initial value */
+#define VAL_CRC32_POLY      0x04C11DB7U   /* zlib CRC-32, reflected, inverted result */
+#define VAL_CRC32_INIT      0xFFFFFFFFU
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  VAL_CRC_16_CCITT = 0,   /* Binary frame trailer (app_comms_binary.h) */
+  VAL_CRC_32,             /* Firmware image check, the value zlib's crc32 gives */
+  VAL_CRC_16_MODBUS,      /* Modbus RTU frame trailer (app_modbus.c) */
+  VAL_CRC_TYPE_COUNT
+} VAL_Crc_Type_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+VAL_Status VAL_Crc_Init(void);
+uint32_t VAL_Crc_Compute(VAL_Crc_Type_t type, const void* data, size_t length);
+uint32_t VAL_Crc_Extend(VAL_Crc_Type_t type, uint32_t crc, const void* data, size_t length);
+uint32_t VAL_Crc_ComputeSoftware(VAL_Crc_Type_t type, const void* data, size_t length);
+
+/* Large blocks: DMA2 channel 1 feeds the unit while the caller does other work */
+VAL_Status VAL_Crc_StartDma(VAL_Crc_Type_t type, const void* data, size_t length);
+VAL_Status VAL_Crc_PollDma(uint32_t* crc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_CRC_H */
@@ -15,17 +15,81 @@ extern "C" {
 
 /* Includes ------------------------------------------------------------------*/
 #include <stdint.h>
+#include <stdbool.h>
 #include "val_status.h"
 
+/* Exported constants --------------------------------------------------------*/
+#define VAL_DATA_STORE_CONFIG_MAX 244  /* Largest configuration or calibration in bytes */
+#define VAL_DATA_STORE_SCENES     8    /* Scene records, numbered from 1 */
+#define VAL_DATA_STORE_MACROS     4    /* Command macro records, numbered from 1 */
+#define VAL_DATA_STORE_PAGES      6    /* Flash pages, the error log ring then the key/value pages */
+
+/* Error log action_taken values */
+#define VAL_DATA_STORE_ACTION_LIGHT_DISABLED 1
+#define VAL_DATA_STORE_ACTION_RESET          2
+
+/* Exported types ------------------------------------------------------------*/
+/* Called per error event by VAL_DataStore_VisitErrorLogs, returns false to stop */
+typedef bool (*VAL_DataStore_LogVisitor)(const ErrorLogEntry_t* entry, void* context);
+
+/* Asked before a background write erases a page, returns false to defer it */
+typedef bool (*VAL_DataStore_EraseGate)(void);
+
+/* Flash stalls since start-up or the last reset */
+typedef struct {
+  uint32_t erases;          /* Pages erased, one stall each */
+  uint32_t erase_max_us;
+  uint32_t programs;        /* Double words programmed, one stall each */
+  uint32_t program_max_us;
+  uint32_t deferred;        /* Background erases the gate refused */
+} VAL_DataStore_FlashStats_t;
+
+/* Flash wear and write timing since start-up */
+typedef struct {
+  uint32_t page_erases[VAL_DATA_STORE_PAGES];  /* Per page, from VAL_DataStore_GetBaseAddress up */
+  uint32_t erase_total_us;  /* Wraps */
+  uint32_t writes;          /* Program sequences, one record or page header each */
+  uint32_t write_total_us;  /* Wraps */
+  uint32_t write_max_us;    /* Longest sequence, interrupts between its double words included */
+  uint8_t queued;           /* Error log entries waiting for the flush task */
+  uint8_t queued_max;       /* Most entries waiting at once */
+  uint32_t queue_full;      /* Entries lost to a full queue */
+} VAL_DataStore_Wear_t;
+
 /* Exported functions prototypes ---------------------------------------------*/
 VAL_Status VAL_DataStore_Init(void);
+VAL_Status VAL_DataStore_LoadConfig(uint16_t version, void* data, uint16_t size);
+VAL_Status VAL_DataStore_SaveConfig(uint16_t version, const void* data, uint16_t size);
+VAL_Status VAL_DataStore_LoadCalibration(uint8_t lightId, uint16_t version, void* data, uint16_t size);
+VAL_Status VAL_DataStore_SaveCalibration(uint8_t lightId, uint16_t version, const void* data, uint16_t size);
+VAL_Status VAL_DataStore_LoadScene(uint8_t scene, uint16_t version, void* data, uint16_t size);
+VAL_Status VAL_DataStore_SaveScene(uint8_t scene, uint16_t version, const void* data, uint16_t size);
+VAL_Status VAL_DataStore_MapScene(uint8_t scene, uint16_t version, uint16_t size, const void** data);
+VAL_Status VAL_DataStore_MapMacro(uint8_t macro, uint16_t version, uint16_t size, const void** data);
+VAL_Status VAL_DataStore_SaveMacro(uint8_t macro, uint16_t version, const void* data, uint16_t size);
+uint32_t VAL_DataStore_GetGeneration(void);
+VAL_Status VAL_DataStore_GetKvExtent(const uint8_t** start, uint16_t* length);
+VAL_Status VAL_DataStore_LoadUsage(uint16_t version, void* data, uint16_t size);
+VAL_Status VAL_DataStore_SaveUsage(uint16_t version, const void* data, uint16_t size);
+VAL_Status VAL_DataStore_LoadCounters(uint16_t version, void* data, uint16_t size);
+VAL_Status VAL_DataStore_SaveCounters(uint16_t version, const void* data, uint16_t size);
+VAL_Status VAL_DataStore_LoadRecording(uint16_t version, void* data, uint16_t size);
+VAL_Status VAL_DataStore_SaveRecording(uint16_t version, const void* data, uint16_t size);
 uint16_t VAL_DataStore_GetErrorCount(void);
 uint8_t VAL_DataStore_GetErrorLogs(ErrorLogEntry_t *logs, uint8_t maxCount);
+uint16_t VAL_DataStore_VisitErrorLogs(VAL_DataStore_LogVisitor visitor, void* context);
 VAL_Status VAL_DataStore_ClearErrorLogs(void);
 VAL_Status VAL_DataStore_GetStatusLog(StatusLog_t *statusLog);
 VAL_Status VAL_DataStore_SetActiveError(uint8_t lightId, ErrorType_t errorType, float value);
 VAL_Status VAL_DataStore_ClearActiveError(uint8_t lightId);
 VAL_Status VAL_DataStore_LogErrorEvent(uint8_t lightId, ErrorType_t errorType, float value, uint8_t action);
+VAL_Status VAL_DataStore_FlushErrorLogs(void);
+void VAL_DataStore_SetEraseGate(VAL_DataStore_EraseGate gate);
+void VAL_DataStore_GetFlashStats(VAL_DataStore_FlashStats_t* stats);
+void VAL_DataStore_ResetFlashStats(void);
+void VAL_DataStore_GetWear(VAL_DataStore_Wear_t* wear);
+VAL_Status VAL_DataStore_HoldFlash(void);
+uint32_t VAL_DataStore_GetBaseAddress(void);
 
 #ifdef __cplusplus
 }
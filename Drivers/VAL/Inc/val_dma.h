@@ -0,0 +1,40 @@
+/**
+  ******************************************************************************
+  * @file    val_dma.h
+  * @brief   Header for val_dma.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_DMA_H
+#define __VAL_DMA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_DMA_COPY_MIN_BYTES    256U    /* Shorter copies run on the CPU, see bench/copy */
+
+/* Exported types ------------------------------------------------------------*/
+/* Copy finished, from interrupt context or from the caller for a CPU copy */
+typedef void (*VAL_DMA_Callback_t)(void* context, VAL_Status status);
+
+/* Exported functions prototypes ---------------------------------------------*/
+VAL_Status VAL_DMA_Init(void);
+VAL_Status VAL_DMA_Copy(void* dest, const void* src, size_t length, VAL_DMA_Callback_t callback, void* context);
+VAL_Status VAL_DMA_Start(void* dest, const void* src, size_t length, VAL_DMA_Callback_t callback, void* context);
+bool VAL_DMA_IsBusy(void);
+void VAL_DMA_IRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_DMA_H */
@@ -0,0 +1,45 @@
+/**
+  ******************************************************************************
+  * @file    val_ext_adc.h
+  * @brief   Header for val_ext_adc.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_EXT_ADC_H
+#define __VAL_EXT_ADC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+#include "val_board.h"
+#include "val_analog.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_EXT_ADC_CHANNEL_COUNT VAL_BOARD_EXT_ADC_CHANNELS
+
+#if VAL_EXT_ADC_CHANNEL_COUNT > 0
+/* Exported functions prototypes ---------------------------------------------*/
+VAL_Status VAL_ExtAdc_Init(void);
+VAL_Status VAL_ExtAdc_Start(uint32_t rate_hz, uint8_t block_scans);
+void VAL_ExtAdc_Stop(void);
+VAL_Status VAL_ExtAdc_SetSampleRate(uint32_t rate_hz);
+uint32_t VAL_ExtAdc_GetSampleRate(void);
+void VAL_ExtAdc_UpdateClock(void);
+VAL_Status VAL_ExtAdc_SetBlockCallback(AnalogBlockCallback callback);
+VAL_Status VAL_ExtAdc_GetCounts(uint8_t input, uint32_t* counts);
+uint32_t VAL_ExtAdc_GetSampleCount(void);
+uint32_t VAL_ExtAdc_GetErrorCount(void);
+void VAL_ExtAdc_IRQHandler(void);
+VAL_Status VAL_ExtAdc_DeInit(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_EXT_ADC_H */
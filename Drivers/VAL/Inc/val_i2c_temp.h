@@ -0,0 +1,51 @@
+/**
+  ******************************************************************************
+  * @file    val_i2c_temp.h
+  * @brief   Header for val_i2c_temp.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_I2C_TEMP_H
+#define __VAL_I2C_TEMP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+#include "val_board.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_I2C_TEMP_ENABLED VAL_BOARD_I2C_TEMP
+
+#if VAL_I2C_TEMP_ENABLED
+/* I2C3 reaches its SCL on PA7 only, I2C1 on PA9 */
+#if VAL_BOARD_I2C_TEMP_SCL == VAL_BOARD_PA(7)
+#define VAL_I2CTemp_EventIRQHandler I2C3_EV_IRQHandler
+#define VAL_I2CTemp_ErrorIRQHandler I2C3_ER_IRQHandler
+#else
+#define VAL_I2CTemp_EventIRQHandler I2C1_EV_IRQHandler
+#define VAL_I2CTemp_ErrorIRQHandler I2C1_ER_IRQHandler
+#endif
+
+/* Exported functions prototypes ---------------------------------------------*/
+VAL_Status VAL_I2CTemp_Init(void);
+VAL_Status VAL_I2CTemp_Start(void);
+void VAL_I2CTemp_Stop(void);
+void VAL_I2CTemp_UpdateClock(void);
+VAL_Status VAL_I2CTemp_GetTemperature(uint8_t lightId, int32_t* temperature_cdeg);
+uint32_t VAL_I2CTemp_GetReadCount(void);
+uint32_t VAL_I2CTemp_GetErrorCount(void);
+void VAL_I2CTemp_TimerIRQHandler(void);
+void VAL_I2CTemp_IRQHandler(void);
+VAL_Status VAL_I2CTemp_DeInit(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_I2C_TEMP_H */
@@ -0,0 +1,64 @@
+/**
+  ******************************************************************************
+  * @file    val_irq_priority.h
+  * @brief   Interrupt priority map of the Vendor Abstraction Layer
+  ******************************************************************************
+  * @attention
+  *
+  * Interrupts are grouped into three levels, each preempting the ones
+  * below it (lower numbers are more urgent, NVIC priority group 4):
+  *
+  *   Safety    5  ADC1: analog watchdog over-current cutoff, COMP (EXTI
+  *                21/22): comparator trip through the TIM1 break
+  *   Sampling  6  DMA1 channel 1 (ADC blocks), DMA1 channel 2 (external
+  *                ADC blocks), DMA1 channel 6 (fade ramp), TIM1 update and
+  *                trigger (strobe), EXTI15_10 (sync line), TIM2 (cue timer),
+  *                PVD (EXTI16, supply voltage warning), LPTIM2 and I2C1 or
+  *                I2C3 (I2C temperature sensors, on boards with them)
+  *   Comms     7  USART1, DMA1 channels 4 and 5 (serial transmit, receive),
+  *                EXTI0 or EXTI4 (SPI slave NSS, on boards with one)
+  *   Lowest   15  TIM7 (HAL tick), LPTIM1 and EXTI (wake-up), DMA2
+  *                channel 2 (copy completion), PendSV
+  *
+  * All sampling interrupts share one level because they step the same LED
+  * driver state; none of them preempts another. The cutoff preempts all
+  * of them and only turns a light off, in a critical section, so the code
+  * it interrupts rechecks the alarm after writing an output. Serial
+  * interrupts only move bytes (DMA and a stream buffer), the commands are
+  * parsed in a task.
+  *
+  * Every level calls FreeRTOS FromISR functions, so none may be more urgent
+  * than configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY; freertos.c checks this
+  * at compile time. The CubeMX generated init code (adc.c, dma.c, usart.c)
+  * takes the same numbers from the .ioc file, change both together.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_IRQ_PRIORITY_H
+#define __VAL_IRQ_PRIORITY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_IRQ_PRIORITY_SAFETY    5U
+#define VAL_IRQ_PRIORITY_SAMPLING  6U
+#define VAL_IRQ_PRIORITY_COMMS     7U
+#define VAL_IRQ_PRIORITY_LOWEST    15U
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  VAL_IRQ_LEVEL_SAFETY = 0,
+  VAL_IRQ_LEVEL_SAMPLING,
+  VAL_IRQ_LEVEL_COMMS,
+  VAL_IRQ_LEVEL_COUNT
+} VAL_IrqLevel_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_IRQ_PRIORITY_H */
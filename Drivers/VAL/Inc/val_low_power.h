@@ -0,0 +1,41 @@
+/**
+  ******************************************************************************
+  * @file    val_low_power.h
+  * @brief   Header for val_low_power.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_LOW_POWER_H
+#define __VAL_LOW_POWER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_status.h"
+#include "stm32l4xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_LOW_POWER_MAX_STOP_MS  1900  /* Longest stop, within the 16-bit wake timer */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  VAL_LOW_POWER_WAKE_TIMER = 0,   /* Requested stop time elapsed */
+  VAL_LOW_POWER_WAKE_SERIAL,      /* Start bit or byte on the serial RX line */
+  VAL_LOW_POWER_WAKE_OTHER        /* Any other enabled interrupt */
+} VAL_LowPower_Wake_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+VAL_Status VAL_LowPower_Init(void);
+VAL_Status VAL_LowPower_Stop(uint32_t max_ms, VAL_LowPower_Wake_t* wake, uint32_t* stopped_ms);
+void VAL_LowPower_GetLatency(uint32_t* entry_us, uint32_t* exit_us);
+void VAL_LowPower_IRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_LOW_POWER_H */
@@ -0,0 +1,29 @@
+/**
+  ******************************************************************************
+  * @file    val_memory.h
+  * @brief   Header for val_memory.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_MEMORY_H
+#define __VAL_MEMORY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include "val_status.h"
+
+/* Exported functions prototypes ---------------------------------------------*/
+VAL_Status VAL_Memory_GetImage(const uint8_t** start, size_t* length);
+VAL_Status VAL_Memory_GetSpareRam(uint32_t** start, uint32_t** end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_MEMORY_H */
@@ -0,0 +1,41 @@
+/**
+  ******************************************************************************
+  * @file    val_pvd.h
+  * @brief   Header for val_pvd.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_PVD_H
+#define __VAL_PVD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+#include "val_board.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_SUPPLY_WARN_MV VAL_BOARD_SUPPLY_WARN_MV  /* Supply warning level of the board */
+
+/* Exported types ------------------------------------------------------------*/
+/* Called with true as the supply falls under the level, false as it recovers */
+typedef void (*VAL_PvdCallback)(bool low);
+
+/* Exported functions prototypes ---------------------------------------------*/
+VAL_Status VAL_Pvd_Enable(VAL_PvdCallback callback, uint32_t threshold_mv);
+bool VAL_Pvd_IsLow(void);
+uint32_t VAL_Pvd_GetThreshold(void);
+uint32_t VAL_Pvd_GetWarningCount(void);
+void VAL_Pvd_IRQHandler(void);
+VAL_Status VAL_Pvd_Disable(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_PVD_H */
@@ -15,14 +15,115 @@ extern "C" {
 
 /* Includes ------------------------------------------------------------------*/
 #include <stdint.h>
+#include <stdbool.h>
 #include "val_status.h"
+#include "val_channels.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_PWM_PERMILLE_MAX 1000  /* Full scale of the fine intensity API */
+#define VAL_PWM_ADC_TRIGGER_OFF 0U /* No ADC trigger from the PWM timer */
+#define VAL_PWM_STROBE_MAX_US 1000000U  /* Longest strobe pulse */
+#define VAL_PWM_STROBE_PERIOD_MAX_US 65536U  /* Longest free-running strobe period, 15.3 Hz */
+#define VAL_PWM_FREQ_MIN_HZ 1000U  /* PWM frequency range of VAL_PWM_SetFrequency */
+#define VAL_PWM_FREQ_MAX_HZ 40000U
+#define VAL_PWM_DITHER_BITS 4U     /* On-time bits below one count when dithering */
+#define VAL_PWM_DITHER_STEPS (1U << VAL_PWM_DITHER_BITS)  /* Periods per dither cycle */
+#define VAL_PWM_SLEW_OFF 0U        /* No slew limit on a channel */
+#define VAL_PWM_SLEW_MAX 1000U     /* Fastest slew limit, full scale in one millisecond */
+#define VAL_PWM_SCALE_MIN 500U     /* Smallest output scale, half the on-time */
+#define VAL_PWM_SCALE_UNITY 1000U  /* Output scale of a channel as its curve gives it */
+#define VAL_PWM_SCALE_MAX 2000U    /* Largest output scale, twice the on-time */
+
+/* Exported types ------------------------------------------------------------*/
+typedef void (*VAL_PWM_RampCallback)(void);
+typedef void (*VAL_PWM_LatchCallback)(void);
+typedef void (*VAL_PWM_LoopCallback)(uint16_t first_row, uint16_t rows);
+
+/* Mapping from intensity to compare value */
+typedef enum {
+  VAL_PWM_CURVE_LINEAR = 0,   /* Proportional to the duty cycle */
+  VAL_PWM_CURVE_GAMMA,        /* Per-channel gamma table with turn-on offset */
+  VAL_PWM_CURVE_COUNT
+} VAL_PWM_Curve_t;
+
+/* Position of a channel's pulse in the PWM period */
+typedef enum {
+  VAL_PWM_ALIGN_LEADING = 0,  /* On from the start of the period */
+  VAL_PWM_ALIGN_TRAILING,     /* On until the end of the period */
+  VAL_PWM_ALIGN_COUNT
+} VAL_PWM_Align_t;
+
+/* Pulse fired by the external trigger input, or repeated by the rate timer */
+typedef struct {
+  uint32_t duration_us;                 /* Pulse length (1 to VAL_PWM_STROBE_MAX_US) */
+  uint32_t period_us;                   /* Pulse repetition period, 0 to fire on the trigger input */
+  uint16_t permille[VAL_LIGHT_COUNT];   /* Intensity of each channel during the pulse */
+  bool falling_edge;                    /* Fire on the falling instead of the rising edge */
+} VAL_PWM_StrobeConfig_t;
+
+typedef struct {
+  uint32_t triggers;          /* Trigger edges seen */
+  uint32_t pulses;            /* Pulses completed */
+  uint32_t missed;            /* Edges that came while a pulse was running */
+} VAL_PWM_StrobeStats_t;
 
 /* Exported functions prototypes ---------------------------------------------*/
 VAL_Status VAL_PWM_Init(void);
 VAL_Status VAL_PWM_SetIntensity(uint8_t channel, uint8_t intensity);
 VAL_Status VAL_PWM_GetIntensity(uint8_t channel, uint8_t* intensity);
 VAL_Status VAL_PWM_SetAllIntensities(const uint8_t intensities[]);
+VAL_Status VAL_PWM_StageIntensity(uint8_t channel, uint8_t intensity);
+VAL_Status VAL_PWM_SetPermille(uint8_t channel, uint16_t permille);
+VAL_Status VAL_PWM_GetPermille(uint8_t channel, uint16_t* permille);
+VAL_Status VAL_PWM_StagePermille(uint8_t channel, uint16_t permille);
+VAL_Status VAL_PWM_CommitAll(void);
+VAL_Status VAL_PWM_CommitAllNow(void);
+VAL_Status VAL_PWM_ArmLatch(bool sync);
+VAL_Status VAL_PWM_Latch(void);
+bool VAL_PWM_IsLatchArmed(void);
+void VAL_PWM_SetLatchCallback(VAL_PWM_LatchCallback callback);
+void VAL_PWM_SyncIRQHandler(void);
 VAL_Status VAL_PWM_StopChannel(uint8_t channel);
+VAL_Status VAL_PWM_SetCompare(uint8_t channel, uint32_t compare);
+uint32_t VAL_PWM_GetCompare(uint8_t channel);
+VAL_Status VAL_PWM_SetBreakSources(uint8_t comparators);
+bool VAL_PWM_RecoverBreak(void);
+void VAL_PWM_Shutdown(void);
+uint32_t VAL_PWM_GetPeriod(void);
+uint32_t VAL_PWM_GetChannelPeriod(uint8_t channel);
+uint16_t VAL_PWM_PermilleToCompare(uint8_t channel, uint16_t permille);
+uint16_t VAL_PWM_RampCompare(uint8_t channel, uint32_t compare);
+uint16_t VAL_PWM_DutyToPermille(uint8_t channel, uint16_t duty_permille);
+VAL_Status VAL_PWM_SetAlignment(uint8_t channel, VAL_PWM_Align_t align);
+VAL_Status VAL_PWM_GetAlignment(uint8_t channel, VAL_PWM_Align_t* align);
+VAL_Status VAL_PWM_SetCurve(uint8_t channel, VAL_PWM_Curve_t curve);
+VAL_Status VAL_PWM_GetCurve(uint8_t channel, VAL_PWM_Curve_t* curve);
+VAL_Status VAL_PWM_SetOutputScale(uint8_t channel, uint16_t scale_permille);
+uint16_t VAL_PWM_GetOutputScale(uint8_t channel);
+uint32_t VAL_PWM_GetFrequency(void);
+uint32_t VAL_PWM_GetChannelFrequency(uint8_t channel);
+VAL_Status VAL_PWM_SetFrequency(uint32_t freq_hz);
+void VAL_PWM_UpdateClock(void);
+VAL_Status VAL_PWM_SetAdcTrigger(uint16_t phase_permille);
+VAL_Status VAL_PWM_StartRamp(const uint16_t* table, uint16_t steps, uint32_t step_periods);
+VAL_Status VAL_PWM_StartLoop(const uint16_t* table, uint16_t steps, uint32_t step_periods);
+VAL_Status VAL_PWM_StopRamp(void);
+VAL_Status VAL_PWM_SetDither(const uint32_t* on_time);
+bool VAL_PWM_IsDitherActive(void);
+uint32_t VAL_PWM_PermilleToFineCompare(uint8_t channel, uint16_t permille);
+bool VAL_PWM_IsRampActive(void);
+VAL_Status VAL_PWM_SetSlewLimit(uint8_t channel, uint16_t permille_per_ms);
+uint16_t VAL_PWM_GetSlewLimit(uint8_t channel);
+uint32_t VAL_PWM_GetSlewTime(uint8_t channel, uint16_t from_permille, uint16_t to_permille);
+bool VAL_PWM_IsSlewActive(void);
+void VAL_PWM_SetRampCallback(VAL_PWM_RampCallback callback);
+void VAL_PWM_SetLoopCallback(VAL_PWM_LoopCallback callback);
+VAL_Status VAL_PWM_StartStrobe(const VAL_PWM_StrobeConfig_t* config);
+VAL_Status VAL_PWM_StopStrobe(void);
+bool VAL_PWM_IsStrobeActive(void);
+bool VAL_PWM_IsStrobeFreeRunning(void);
+VAL_Status VAL_PWM_GetStrobeStats(VAL_PWM_StrobeStats_t* stats);
+void VAL_PWM_StrobeIRQHandler(void);
 VAL_Status VAL_PWM_DeInit(void);
 
 #ifdef __cplusplus
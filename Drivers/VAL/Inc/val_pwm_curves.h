@@ -0,0 +1,35 @@
+/**
+  ******************************************************************************
+  * @file    val_pwm_curves.h
+  * @brief   Header for val_pwm_curves.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_PWM_CURVES_H
+#define __VAL_PWM_CURVES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "val_pwm.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_PWM_CURVE_ENTRIES   (VAL_PWM_PERMILLE_MAX + 1)
+#define VAL_PWM_CURVE_PERIOD    4000  /* TIM1 counts per period the tables are built for */
+
+/* Exported variables --------------------------------------------------------*/
+/* Gamma corrected compare values per LED colour in 1/VAL_PWM_DITHER_STEPS
+ * counts, indexed by permille */
+extern const uint16_t VAL_PWM_GammaWhite[VAL_PWM_CURVE_ENTRIES];
+extern const uint16_t VAL_PWM_GammaGreen[VAL_PWM_CURVE_ENTRIES];
+extern const uint16_t VAL_PWM_GammaRed[VAL_PWM_CURVE_ENTRIES];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_PWM_CURVES_H */
@@ -0,0 +1,42 @@
+/**
+  ******************************************************************************
+  * @file    val_rtc.h
+  * @brief   Header for val_rtc.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_RTC_H
+#define __VAL_RTC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_RTC_TIME_MIN_MS         978307200000ULL   /* 2001-01-01, first date of the calendar */
+#define VAL_RTC_TIME_MAX_MS         4102444799999ULL  /* 2099-12-31, last date of the calendar */
+#define VAL_RTC_CALIBRATION_MAX_PPB 487000            /* Smooth calibration range, either way */
+#define VAL_RTC_BACKUP_COUNT        32                /* 32-bit backup registers */
+
+/* Exported functions prototypes ---------------------------------------------*/
+VAL_Status VAL_RTC_Init(void);
+bool VAL_RTC_IsSet(void);
+uint64_t VAL_RTC_GetTime(void);
+VAL_Status VAL_RTC_SetTime(uint64_t time_ms);
+VAL_Status VAL_RTC_Adjust(int32_t delta_ms);
+VAL_Status VAL_RTC_SetCalibration(int32_t ppb);
+int32_t VAL_RTC_GetCalibration(void);
+uint32_t VAL_RTC_ReadBackup(uint8_t index);
+VAL_Status VAL_RTC_WriteBackup(uint8_t index, uint32_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_RTC_H */
@@ -0,0 +1,57 @@
+/**
+  ******************************************************************************
+  * @file    val_sections.h
+  * @brief   Memory placement attributes of the Vendor Abstraction Layer
+  ******************************************************************************
+  * @attention
+  *
+  * SRAM2 (RAM2 in the linker script) sits on the Cortex-M4 code bus, so
+  * code placed there runs without flash wait states and without waiting
+  * for the flash accelerator. Its timing is the same on every call, cache
+  * hit or miss, and it does not compete with data accesses to SRAM1.
+  *
+  * VAL_RAMFUNC puts a function into the .ramfunc section, copied to SRAM2
+  * by the startup code. It is meant for the few interrupt paths whose
+  * latency matters, the space left in SRAM2 is small. Calls between flash
+  * and SRAM2 go through linker veneers, a few cycles each.
+  *
+  * VAL_SRAM2_BSS puts a variable into the .sram2_bss section, zeroed by the
+  * startup code like .bss. Use it for buffers that are read back after a
+  * fault, such as the trace and log rings: SRAM2 is parity checked and
+  * stays apart from the stacks and heap in SRAM1.
+  *
+  * VAL_UPDATEFUNC puts a function into the .update section, the firmware
+  * updater. It is linked into the resident boot loader at the start of the
+  * flash, which runs before the startup code and stays when an update
+  * erases the firmware after it (val_update.c). Such a function may only
+  * call other VAL_UPDATEFUNC functions and force-inline helpers, must not
+  * read constant data from the firmware's flash and must not count on
+  * initialized or zeroed variables; the optimize flag keeps the compiler
+  * from turning its loops into calls to memcpy or memset.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_SECTIONS_H
+#define __VAL_SECTIONS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Exported macro ------------------------------------------------------------*/
+/* Run a function from SRAM2; kept out of line so it is not inlined into flash code */
+#define VAL_RAMFUNC    __attribute__((section(".ramfunc"), noinline))
+
+/* Link a function into the resident boot loader */
+#define VAL_UPDATEFUNC __attribute__((section(".update"), noinline, optimize("no-tree-loop-distribute-patterns")))
+
+/* Place a zero-initialized variable in SRAM2 */
+#define VAL_SRAM2_BSS  __attribute__((section(".sram2_bss")))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_SECTIONS_H */
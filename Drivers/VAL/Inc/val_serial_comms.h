@@ -16,15 +16,58 @@ extern "C" {
 /* Includes ------------------------------------------------------------------*/
 #include <stdint.h>
 #include "val_status.h"
+#include "val_board.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_SERIAL_WAKE_ENABLED  VAL_BOARD_SERIAL_WAKE
 
 /* Exported types ------------------------------------------------------------*/
 typedef void (*SerialRxCallback)(uint8_t byte);
+typedef void (*SerialRxBlockCallback)(const uint8_t* data, uint16_t length);
+typedef void (*SerialTxCompleteCallback)(void);
+typedef void (*SerialDmxCallback)(const uint8_t* packet, uint16_t length);
+typedef void (*SerialFrameCallback)(const uint8_t* frame, uint16_t length);
+
+/* One buffer of a message sent with VAL_Serial_SendSegmentsAsync */
+typedef struct {
+  const uint8_t* data;
+  uint16_t length;
+} VAL_Serial_Segment_t;
 
 /* Exported functions prototypes ---------------------------------------------*/
 VAL_Status VAL_Serial_Init(SerialRxCallback callback);
+VAL_Status VAL_Serial_InitDMA(SerialRxBlockCallback callback);
 VAL_Status VAL_Serial_Send(const uint8_t* data, uint16_t length, uint32_t timeout);
+VAL_Status VAL_Serial_SendAsync(const uint8_t* data, uint16_t length);
+VAL_Status VAL_Serial_SendSegmentsAsync(const VAL_Serial_Segment_t* segments, uint8_t count);
+void VAL_Serial_SetTxCompleteCallback(SerialTxCompleteCallback callback);
 VAL_Status VAL_Serial_Printf(const char* format, ...);
 uint8_t VAL_Serial_IsBusy(void);
+uint32_t VAL_Serial_GetTxQueued(void);
+uint32_t VAL_Serial_GetTxSent(void);
+uint32_t VAL_Serial_GetIdleTime(void);
+uint16_t VAL_Serial_GetMaxMessage(void);
+VAL_Status VAL_Serial_Flush(uint32_t timeout);
+VAL_Status VAL_Serial_CheckBaudRate(uint32_t baud_rate);
+VAL_Status VAL_Serial_CheckClock(uint32_t pclk);
+void VAL_Serial_UpdateClock(void);
+VAL_Status VAL_Serial_SetBaudRate(uint32_t baud_rate);
+uint32_t VAL_Serial_GetBaudRate(void);
+VAL_Status VAL_Serial_SetRS485(uint8_t enable);
+VAL_Status VAL_Serial_SetFlowControl(uint8_t enable);
+uint8_t VAL_Serial_GetFlowControl(void);
+VAL_Status VAL_Serial_StartDmx(SerialDmxCallback callback);
+VAL_Status VAL_Serial_StopDmx(void);
+uint32_t VAL_Serial_GetDmxDropped(void);
+VAL_Status VAL_Serial_StartModbus(uint32_t baud_rate, SerialFrameCallback callback);
+VAL_Status VAL_Serial_StopModbus(void);
+VAL_Status VAL_Serial_SendModbus(const uint8_t* frame, uint16_t length);
+uint32_t VAL_Serial_GetModbusDropped(void);
+#if VAL_SERIAL_WAKE_ENABLED
+VAL_Status VAL_Serial_ArmWake(void);
+uint8_t VAL_Serial_ResumeWake(void);
+void VAL_Serial_WakeIRQHandler(void);
+#endif
 
 #ifdef __cplusplus
 }
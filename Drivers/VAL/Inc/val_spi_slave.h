@@ -0,0 +1,58 @@
+/**
+  ******************************************************************************
+  * @file    val_spi_slave.h
+  * @brief   Header for val_spi_slave.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_SPI_SLAVE_H
+#define __VAL_SPI_SLAVE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+#include "val_board.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_SPI_SLAVE_ENABLED    VAL_BOARD_SPI_SLAVE
+
+#if VAL_SPI_SLAVE_ENABLED
+#define VAL_SPI_SLAVE_FRAME_MAX  256U   /* Bytes of one transaction, each way */
+
+/* EXTI line of NSS, whose handler ends the transactions */
+#if (VAL_BOARD_SPI_SLAVE_NSS & 15) == 4
+#define VAL_SpiSlave_NssIRQHandler EXTI4_IRQHandler
+#else
+#define VAL_SpiSlave_NssIRQHandler EXTI0_IRQHandler
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+/* A transaction ended: rx holds the length bytes the host sent, as many
+ * as it clocked of the last reply; lost if it overran the buffer, its
+ * bytes then cut short. The reply clocked out by the next one is written
+ * to reply. Returns the reply length; the host reads zeros beyond it. */
+typedef uint16_t (*VAL_SpiSlave_Callback_t)(const uint8_t* rx, uint16_t length, bool lost, uint8_t* reply,
+                                            uint16_t max);
+
+/* Exported functions prototypes ---------------------------------------------*/
+VAL_Status VAL_SpiSlave_Init(VAL_SpiSlave_Callback_t callback);
+void VAL_SpiSlave_SetIrq(bool asserted);
+uint32_t VAL_SpiSlave_GetIdleTime(void);
+uint32_t VAL_SpiSlave_GetTransactionCount(void);
+uint32_t VAL_SpiSlave_GetErrorCount(void);
+uint32_t VAL_SpiSlave_GetMaxTurnaroundUs(void);
+void VAL_SpiSlave_IRQHandler(void);
+VAL_Status VAL_SpiSlave_DeInit(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_SPI_SLAVE_H */
@@ -15,6 +15,7 @@ extern "C" {
 
 /* Includes ------------------------------------------------------------------*/
 #include <stdint.h>
+#include "val_channels.h"
 
 /* Exported types ------------------------------------------------------------*/
 typedef enum {
@@ -29,21 +30,23 @@ typedef enum {
 typedef enum {
   ERROR_OVER_CURRENT = 1,
   ERROR_OVER_TEMPERATURE = 2,
-  ERROR_SYSTEM = 3
+  ERROR_SYSTEM = 3,
+  ERROR_DEADLINE = 4,             /* A task stalled; light_id is the task, value the ms over */
+  ERROR_SENSOR_FAULT = 5          /* A current or temperature input reads implausibly */
 } ErrorType_t;
 
 /* Status log structure */
 typedef struct {
-  uint8_t active_errors;          /* Bitmap of lights with active errors (bits 0-2) */
-  uint8_t error_types[3];         /* Error type for each light (0-2) */
-  float error_values[3];          /* Measured values that caused errors */
-  uint32_t error_timestamps[3];   /* Timestamps when errors occurred */
+  uint8_t active_errors;                        /* Bitmap of lights with active errors, bit 0 is light 1 */
+  uint8_t error_types[VAL_LIGHT_COUNT];         /* Error type for each light */
+  float error_values[VAL_LIGHT_COUNT];          /* Measured values that caused errors */
+  uint32_t error_timestamps[VAL_LIGHT_COUNT];   /* Timestamps when errors occurred */
 } StatusLog_t;
 
 /* Error log entry */
 typedef struct {
   uint32_t timestamp;            /* System time when error occurred (milliseconds) */
-  uint8_t light_id;               /* Light source ID (1-3) */
+  uint8_t light_id;               /* Light source ID (1-VAL_LIGHT_COUNT) */
   uint8_t error_type;             /* Type of error (using ErrorType_t) */
   float measured_value;           /* The value that caused the error */
   uint8_t action_taken;           /* Action taken (e.g., 1 = disabled light) */
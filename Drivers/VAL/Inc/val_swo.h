@@ -0,0 +1,34 @@
+/**
+  ******************************************************************************
+  * @file    val_swo.h
+  * @brief   Header for val_swo.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_SWO_H
+#define __VAL_SWO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_SWO_PORT_COUNT  32U  /* ITM stimulus ports */
+
+/* Exported functions prototypes ---------------------------------------------*/
+void VAL_SWO_Init(void);
+bool VAL_SWO_IsDebuggerAttached(void);
+bool VAL_SWO_IsPortEnabled(uint8_t port);
+VAL_Status VAL_SWO_Write(uint8_t port, const void* data, uint16_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_SWO_H */
@@ -18,12 +18,26 @@ extern "C" {
 #include "val_status.h"
 #include "stm32l4xx_hal.h"
 
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+  VAL_SYSCLOCK_LEVEL_LOW = 0,  /* 4 MHz from the MSI, PLL off */
+  VAL_SYSCLOCK_LEVEL_NOMINAL,  /* 32 MHz, the PLL divided by 2 */
+  VAL_SYSCLOCK_LEVEL_HIGH,     /* 64 MHz from the PLL */
+  VAL_SYSCLOCK_LEVEL_COUNT
+} VAL_SysClock_Level_t;
+
 /* Exported functions prototypes ---------------------------------------------*/
 VAL_Status VAL_SysClock_Init(void);
 uint32_t VAL_SysClock_GetTick(void);
 VAL_Status VAL_SysClock_Delay(uint32_t delay);
 uint32_t VAL_SysClock_GetFrequency(void);
 uint32_t VAL_SysClock_GetMicros(void);
+uint64_t VAL_SysClock_GetMicros64(void);
+uint32_t VAL_SysClock_GetCycles(void);
+uint32_t VAL_SysClock_CyclesToMicros(uint32_t cycles);
+void VAL_SysClock_AdvanceTime(uint32_t ms);
+VAL_Status VAL_SysClock_SetLevel(VAL_SysClock_Level_t level);
+VAL_SysClock_Level_t VAL_SysClock_GetLevel(void);
 
 #ifdef __cplusplus
 }
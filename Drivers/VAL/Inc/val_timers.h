@@ -15,13 +15,45 @@ extern "C" {
 
 /* Includes ------------------------------------------------------------------*/
 #include <stdint.h>
+#include <stdbool.h>
 #include "val_status.h"
+#include "val_irq_priority.h"
 #include "stm32l4xx_hal.h"
 
+/* Exported types ------------------------------------------------------------*/
+typedef void (*VAL_Timers_Callback)(void);
+
+#ifdef BENCHMARK
+/* Interrupt latency at one level, from the compare event to the handler */
+typedef struct {
+  uint32_t count;   /* Interrupts measured */
+  uint32_t min_ns;  /* 0 if none measured */
+  uint32_t max_ns;
+} VAL_Timers_Latency_t;
+#endif
+
 /* Exported functions prototypes ---------------------------------------------*/
 VAL_Status VAL_Timers_Init(void);
 VAL_Status VAL_Timers_DeInit(void);
 
+/* Cue timer: free-running microsecond counter with a one-shot alarm */
+VAL_Status VAL_Timers_StartCueTimer(VAL_Timers_Callback callback);
+void VAL_Timers_StopCueTimer(void);
+uint32_t VAL_Timers_GetCueTime(void);
+void VAL_Timers_SetCueAlarm(uint32_t time_us);
+void VAL_Timers_CueIRQHandler(void);
+void VAL_Timers_UpdateClock(void);
+
+#ifdef BENCHMARK
+/* Latency probe: a compare interrupt taken at each level in turn */
+VAL_Status VAL_Timers_StartLatencyProbe(void);
+void VAL_Timers_StopLatencyProbe(void);
+bool VAL_Timers_IsLatencyProbeRunning(void);
+VAL_Status VAL_Timers_GetLatency(VAL_IrqLevel_t level, VAL_Timers_Latency_t* latency);
+void VAL_Timers_ResetLatency(void);
+void VAL_Timers_LatencyIRQHandler(void);
+#endif
+
 /* Timer callback declarations moved from main.c */
 void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim);
 
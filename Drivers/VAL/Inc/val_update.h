@@ -0,0 +1,59 @@
+/**
+  ******************************************************************************
+  * @file    val_update.h
+  * @brief   Header for val_update.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_UPDATE_H
+#define __VAL_UPDATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "val_status.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_UPDATE_RX_RING_SIZE  4096U     /* USART1 reception during a flash erase, with room to spare */
+#define VAL_UPDATE_BOOT_SIZE     0x2000U   /* Resident boot loader, pages 0-3, never erased by an update */
+#define VAL_UPDATE_IMAGE_MAX     0x3D000U  /* Flash below the data store */
+
+/* Exported types ------------------------------------------------------------*/
+/* Update handed over from the firmware through the RTC backup registers */
+typedef struct {
+  uint32_t size;      /* Image size in bytes, 0 if none was requested */
+  uint32_t crc;       /* CRC-32 of the image */
+  uint32_t baud;      /* Baud rate of the host link */
+  uint8_t address;    /* Device address of COMMS_BIN_TYPE_ADDR_CMD frames */
+  bool rs485;         /* RS-485 driver enable on PB3 */
+} VAL_Update_Request_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+VAL_Status VAL_Update_Prepare(size_t work_size);
+void VAL_Update_Request(uint32_t size, uint32_t crc, uint8_t address) __attribute__((noreturn));
+bool VAL_Update_TakeRequest(VAL_Update_Request_t* request);
+void VAL_Update_StartApplication(void);
+uint8_t* VAL_Update_Enter(const VAL_Update_Request_t* request);
+bool VAL_Update_ReadByte(uint8_t* byte);
+void VAL_Update_Send(const uint8_t* data, size_t length);
+VAL_Status VAL_Update_ErasePage(uint32_t address);
+VAL_Status VAL_Update_Program(uint32_t address, const uint8_t* data, size_t length);
+void VAL_Update_CrcReset(void);
+void VAL_Update_CrcAdd(const uint8_t* data, size_t length);
+uint32_t VAL_Update_CrcGet(void);
+uint32_t VAL_Update_GetTick(void);
+void VAL_Update_Feed(void);
+void VAL_Update_Reset(void) __attribute__((noreturn));
+void VAL_Update_Fault(void) __attribute__((noreturn));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_UPDATE_H */
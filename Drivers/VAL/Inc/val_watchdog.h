@@ -0,0 +1,35 @@
+/**
+  ******************************************************************************
+  * @file    val_watchdog.h
+  * @brief   Header for val_watchdog.c module
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VAL_WATCHDOG_H
+#define __VAL_WATCHDOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "val_status.h"
+#include "stm32l4xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VAL_WATCHDOG_MAX_TIMEOUT_MS  32000  /* Longest timeout at the nominal LSI rate */
+
+/* Exported functions prototypes ---------------------------------------------*/
+void VAL_Watchdog_Init(void);
+VAL_Status VAL_Watchdog_Start(uint32_t timeout_ms);
+void VAL_Watchdog_Refresh(void);
+bool VAL_Watchdog_CausedReset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VAL_WATCHDOG_H */
@@ -9,51 +9,469 @@
   * input reading used by the Wiseled_LBR system for current and 
   * temperature monitoring.
   *
+  * Each scan of all current and temperature inputs is triggered by the TIM6 update event (TRGO), so
+  * samples are taken at a fixed, configurable rate and every completed scan
+  * corresponds to a known point in time (scan count / sample rate).
+  *
+  * The current inputs come from low-impedance sense amplifiers and settle
+  * within a short sampling time; the temperature dividers and the internal
+  * channels need the long one. Each rank has its own (adc.c), so a scan
+  * takes VAL_LIGHT_COUNT x (24.5 + 247.5) + 2 x 247.5 sampling cycles
+  * instead of 247.5 for all of them, which raises the highest scan rate.
+  *
+  * Alternatively the scan follows the PWM (VAL_Analog_SyncToPwm): TIM1 TRGO2
+  * starts it at a fixed point of the period, so the currents are sampled at
+  * the same phase of the LED drive every time. A scan lasts longer than a PWM
+  * period and the ADC ignores triggers while converting, so only every Nth
+  * period is sampled; the short sampling time of the current ranks keeps
+  * all three close to the trigger point. A free-running strobe triggers the
+  * scans the same way from its rate timer (VAL_Analog_SyncToStrobe), on the
+  * falling edge of TIM15 TRGO, which VAL_PWM_StartStrobe places within the
+  * on-time of the pulse, so the currents are read while the lights are lit.
+  *
+  * Noise is reduced in two stages, both set through VAL_Analog_Config:
+  * hardware oversampling inside the ADC (ratio/shift, up to 16-bit results)
+  * and a software moving average over the last N scans.
+  *
+  * Each input then reads through its own filter, set with VAL_Analog_SetFilter:
+  * the moving average above (boxcar), an exponential moving average or a
+  * 5-tap median. The median is the default, so a single noisy scan cannot
+  * trip an alarm. All filters are updated incrementally on every scan, which
+  * costs a few integer operations per channel, so switching filters takes
+  * effect immediately. The latest unfiltered scan stays available.
+  *
+  * Readings are recomputed only when their inputs moved. The block
+  * interrupt marks a channel dirty when a scan changed its filter state,
+  * i.e. a sample differs from the one it pushed out of the history; the
+  * filtered counts of a clean channel are served from a cache, so a steady
+  * input costs no median sort. The sensor data of each light is converted
+  * once per block at most (the scan count is its sequence number), and an
+  * input that moved no more than RECONVERT_DEADBAND counts keeps its last
+  * conversion. The deadband only applies to reported readings; alarms,
+  * derating and the current loop read the filtered counts.
+  *
+  * VREFINT and the internal temperature sensor are converted at the end of
+  * every scan. Once per block the filtered VREFINT reading gives the actual
+  * analog supply (VDDA), against the factory value measured at 3.0 V, and a
+  * Q16 ratio to the nominal ADC_REFERENCE_MV. Light readings and alarm
+  * inputs are multiplied by it before conversion, so they are in counts of
+  * the nominal reference and stay right when the supply sags under load.
+  * The hardware watchdogs and raw captures see uncorrected counts; a sagging
+  * supply raises those, so the watchdogs only trip earlier.
+  *
+  * Conversions are integer only: raw counts are scaled to milliamps and
+  * centi-degrees with Q16 factors precomputed whenever the resolution
+  * changes, and thresholds can be converted back to counts the same way.
+  * Built with ANALOG_USE_FPU, the supply correction, the conversions to
+  * milliamps and centi-degrees and the EMA filter use single-precision
+  * floating point on the FPU instead, with the same tables and rounding;
+  * thresholds are still converted to counts in integer. The EMA then runs
+  * in the block interrupt on the FPU, which relies on its lazy context
+  * stacking. Compare both with the sensor_update probe before picking one.
+  *
+  * Each light has its own calibration (VAL_Analog_SetCalibration): a gain
+  * and offset for both inputs and an optional table of up to
+  * ANALOG_CAL_MAX_POINTS voltage/temperature points for non-linear sensors.
+  * Currents stay a Q16 factor plus offset. Temperatures go through a table
+  * of CAL_SEGMENTS equal count ranges, each a base value and Q16 slope
+  * precomputed from the calibration, so a reading costs one shift to find
+  * its segment and one multiply. Tables must rise with the voltage, as the
+  * alarm limits are compared in counts.
+  *
+  * The ADC analog watchdogs AWD1/2/3 guard the current channels in hardware,
+  * as assigned in the board channel table (val_channels.c). A conversion above the limit raises the ADC interrupt right
+  * away, without waiting for a block or any task to run.
+  *
+  * DMA fills a ping-pong buffer of two blocks of scans, ANALOG_SCANS_PER_BLOCK
+  * each unless VAL_Analog_SetBlockScans changes it.
+  * Results are at most 16 bits, oversampled ones included, so DMA moves
+  * halfwords and samples stay uint16_t from the buffer through the block
+  * consumers, the filters and the raw capture.
+  * The half-transfer and transfer-complete interrupts process the block that
+  * has just been completed while DMA writes the other one, so readers never
+  * see a scan that is still being written. Between them the CPU sleeps:
+  * nothing polls the ADC, so a longer block means fewer wakeups at the same
+  * scan rate, and the alarms, derating and current loop, which step once
+  * per block, react that much later. The hardware watchdogs do not wait
+  * for a block.
+  *
+  * A raw capture records up to ANALOG_CAPTURE_MAX_SCANS consecutive scans,
+  * every channel unfiltered, at the full scan rate into a buffer of its own
+  * in RAM2 (.capture section). It starts at once, on an external trigger
+  * such as an output change, or when an input crosses a threshold, and is
+  * copied out of the completed blocks by the same interrupt. A capture can
+  * keep scans from before its trigger: while armed the buffer is a ring
+  * that the interrupt keeps overwriting, one scan copy and an index step
+  * per scan, and the trigger only sets how many scans are still recorded,
+  * so the oldest ones are overwritten down to the scans wanted before it.
+  * A fault trigger of its own (VAL_Analog_TriggerFaultCapture) keeps such
+  * a capture apart from the ones armed for output changes.
+  *
+  * The same interrupt keeps running statistics of the light inputs over
+  * the raw scans: minimum, maximum, sum and sum of squares in counts, so a
+  * scan costs a compare, an add and a multiply per input. With a window
+  * set, every window_scans scans the totals are set aside and restarted;
+  * VAL_Analog_GetStats converts them only when they are read. Built with
+  * ANALOG_USE_SIMD, two scans are added at a time with the Cortex-M4 dual
+  * 16-bit instructions: USUB16 and SEL update the minimum and maximum of
+  * two adjacent inputs in one step each, and SMLALD adds the two scans of
+  * one input to its sum and sum of squares in one step each. The products
+  * are signed, so results wider than 15 bits take the scalar path.
+  *
+  * The current sense amplifiers do not read exactly zero without current.
+  * With all outputs off, VAL_Analog_StartZeroCapture averages the raw
+  * current inputs over a number of scans in the block interrupt, and
+  * VAL_Analog_ApplyZeroCapture subtracts the averages from every current
+  * conversion, and adds them back when thresholds are converted to counts,
+  * on top of the calibration offset. They are kept as a fraction of the
+  * full scale, so they stay right when the resolution changes. The ADC's
+  * own offset calibration runs before, in MX_ADC1_Init.
+  *
+  * Benchmark builds can substitute a synthetic waveform for one input
+  * (VAL_Analog_StartSynthetic): a step, ramp, spike train or noise, written
+  * over the DMA samples of each completed block before the filters read
+  * them. Everything downstream runs as for a real signal, so the alarm
+  * reaction and false trips can be measured from a known edge; the time
+  * the edge scan was taken is kept for that.
+  *
+  * A board with an external SPI ADC (val_ext_adc.c) samples it along:
+  * started, stopped and paced with the scans here, at the same rate and
+  * block length, into blocks of the same format.
+  *
+  * A board with digital I2C temperature sensors (val_i2c_temp.c) reads
+  * the temperatures of the lights from them instead: their centi-degrees
+  * are converted back to counts through the calibration of the light, so
+  * readings, alarms and sensor checks stay in counts as for a thermistor.
+  * A sensor without a reading gives zero counts, an open input. The
+  * temperature ranks are still scanned and captured, and a synthetic
+  * waveform on one of them is not seen.
+  *
   ******************************************************************************
   */
 
 /* Includes ------------------------------------------------------------------*/
 #include "val_analog.h"
-#include "val_serial_comms.h"
+#include "val_sys_clock.h"
+#include "val_sections.h"
+#include "val_ext_adc.h"
+#include "val_i2c_temp.h"
 #include "adc.h"
 #include "dma.h"
+#include "tim.h"
+#include <stdbool.h>
 #include <string.h>
 #include <math.h>
 
 /* Private define ------------------------------------------------------------*/
-#define ADC_CHANNEL_COUNT 6
-#define LIGHT_COUNT 3
-#define ADC_BUFFER_SIZE ADC_CHANNEL_COUNT
-#define ADC_RESOLUTION 4095.0f  /* 12-bit ADC */
-#define ADC_REFERENCE 3.3f      /* Reference voltage in volts */
+#define ADC_CHANNEL_COUNT ANALOG_CHANNEL_COUNT
+#define WATCHDOG_COUNT 3  /* AWD1-3 */
+#define ADC_SCAN_BLOCKS 2  /* Ping-pong halves */
+#define ADC_BUFFER_SIZE (ADC_SCAN_BLOCKS * ANALOG_MAX_BLOCK_SCANS * ADC_CHANNEL_COUNT)
+#define ADC_RESOLUTION 4095U    /* 12-bit ADC */
+#define ADC_MAX_RESULT 0xFFFFU  /* Oversampled results are limited to 16 bits */
+#define ADC_REFERENCE_MV VAL_BOARD_ADC_REFERENCE_MV  /* Reference voltage in millivolts */
+
+/* Scan trigger timer: TIM6 counts at 1 MHz (32 MHz / (31 + 1)) at any system clock */
+#define SAMPLE_TIMER_CLOCK_HZ 1000000U
+#define SAMPLE_RATE_DEFAULT_HZ 1000U
+#define SAMPLE_RATE_MIN_HZ 16U      /* 16-bit auto-reload limit at 1 MHz */
+#define SAMPLE_RATE_MAX_HZ 2000U    /* 1411 cycles at 4 MHz = 353 us per scan, 70% busy */
+
+/* Conversion time per input in half ADC cycles, sampling plus 12.5 for the conversion */
+#define ADC_CLOCK_HZ 4000000U                 /* 32 MHz / 8 */
+#define SCAN_CURRENT_HALF_CYCLES 74U          /* (24.5 + 12.5) x 2 */
+#define SCAN_TEMPERATURE_HALF_CYCLES 520U     /* (247.5 + 12.5) x 2 */
+#define SCAN_INTERNAL_HALF_CYCLES 520U        /* VREFINT and die temperature, as the temperatures */
+#define INTERNAL_CHANNEL_COUNT 2U
+
+/* Supply correction: VDDA readings outside the operating range are ignored */
+#define SUPPLY_MIN_MV 1710U
+#define SUPPLY_MAX_MV 3600U
+#define SUPPLY_RATIO_UNITY 0x10000U   /* Q16 */
+
+/* Temperature conversion: the ADC range is split into CAL_SEGMENTS equal parts */
+#define CAL_SEGMENTS 64U
+#define CAL_UV_PER_MV 1000    /* Table interpolation is done in microvolts */
+
+/* Default sensor conversion factors, per millivolt at the ADC pin, from the board profile */
+#define CURRENT_CONVERSION_FACTOR VAL_BOARD_CURRENT_MA_PER_MV
+#define TEMPERATURE_CONVERSION_FACTOR VAL_BOARD_TEMPERATURE_CDEG_PER_MV
+
+/* Reported readings are reconverted once an input moved by more than this,
+ * in 12-bit counts (scaled to the oversampled resolution) */
+#define RECONVERT_DEADBAND 1U
+#define SCAN_CHANNEL_MASK ((1UL << ADC_CHANNEL_COUNT) - 1U)
+
+/* Statistics cover the light inputs, the ranks before VREFINT */
+#define STATS_INPUT_COUNT ANALOG_RANK_VREFINT
 
-/* Simplified sensor conversion factors */
-#define CURRENT_CONVERSION_FACTOR 10.0f       /* 3.3V = 33A, so each volt is 10A */
-#define TEMPERATURE_CONVERSION_FACTOR 100.0f  /* 3.3V = 330°C, so each volt is 100°C */
+/* A zero reading above 1/16 of the full scale is a light left on or a fault */
+#define ZERO_MAX_FRACTION_Q16 0x1000U
+
+#ifdef BENCHMARK
+/* Synthetic noise restarts from the same state, so runs repeat exactly */
+#define SYNTH_NOISE_SEED 0x2545F491U
+#endif
+
+#ifdef ANALOG_USE_SIMD
+#if !(defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1))
+#error "ANALOG_USE_SIMD needs the DSP instructions of the Cortex-M4"
+#endif
+/* Dual 16-bit statistics: pairs of adjacent inputs, in signed 16-bit lanes */
+#define STATS_SIMD_MAX_COUNTS 0x7FFFU
+#define STATS_SIMD_ONES 0x00010001UL
+#endif
 
 /* Private typedef -----------------------------------------------------------*/
+/* Inputs of a light's sensor data, in the order they are converted */
 typedef enum {
-  CHANNEL_CURRENT_1 = 0,
-  CHANNEL_CURRENT_2 = 1,
-  CHANNEL_CURRENT_3 = 2,
-  CHANNEL_TEMP_1 = 3,
-  CHANNEL_TEMP_2 = 4,
-  CHANNEL_TEMP_3 = 5
-} AdcChannelIndex;
+  READING_CURRENT = 0,
+  READING_TEMPERATURE,
+  READING_CURRENT_RAW,
+  READING_TEMPERATURE_RAW,
+  READING_COUNT
+} ReadingInput;
+
+/* Last conversion of a light's sensor data */
+typedef struct {
+  uint32_t sequence;              /* sample_count at the conversion */
+  uint32_t generation;            /* conversion_generation at the conversion */
+  uint32_t counts[READING_COUNT]; /* Supply corrected counts converted */
+  int32_t values[READING_COUNT];  /* Milliamps or centi-degrees */
+  bool valid;
+} ConvertedReading;
+
+/* Statistics of the light inputs over a run of raw scans, in counts */
+typedef struct {
+  uint32_t scans;                         /* 0 until the first scan */
+  uint32_t first_sample;                  /* Scan count of the first scan */
+  uint16_t min[STATS_INPUT_COUNT];
+  uint16_t max[STATS_INPUT_COUNT];
+  uint64_t sum[STATS_INPUT_COUNT];
+  uint64_t sum_squares[STATS_INPUT_COUNT];
+} StatsWindow;
+
+/* Linear piece of a temperature conversion */
+typedef struct {
+  int32_t base;           /* Centi-degrees at the first count of the segment */
+  int32_t slope_q16;      /* Centi-degrees per count in Q16 */
+#ifdef ANALOG_USE_FPU
+  float slope;            /* Centi-degrees per count */
+#endif
+} TemperatureSegment;
 
 /* Private variables ---------------------------------------------------------*/
-static volatile uint32_t adc_buffer[ADC_BUFFER_SIZE];
+static volatile uint16_t adc_buffer[ADC_BUFFER_SIZE];
 static volatile uint8_t conversion_complete = 0;
+static volatile uint32_t sample_count = 0;
+static volatile uint32_t sample_micros = 0;    /* Time of the last completed block */
+static uint32_t sample_rate_hz = SAMPLE_RATE_DEFAULT_HZ;
+static uint8_t block_scans = ANALOG_SCANS_PER_BLOCK;  /* Scans per ping-pong half */
+
+/* Scans triggered by the PWM or strobe rate timer instead of TIM6, at this
+ * trigger rate; 0 when TIM6 paces them */
+static uint32_t sync_trigger_hz = 0;
+static uint32_t sync_rate_hz = 0;    /* Resulting scan rate */
+
+/* Filtering configuration */
+static AnalogConfig analog_config = {1, 0, 1};
+static uint32_t adc_full_scale = ADC_RESOLUTION;
+
+/* Sensor conversion factors, per millivolt at the ADC pin */
+static uint16_t current_ma_per_mv = CURRENT_CONVERSION_FACTOR;
+static uint16_t temperature_cdeg_per_mv = TEMPERATURE_CONVERSION_FACTOR;
+
+/* Per-light calibration, indexed by light ID - 1 */
+static AnalogCalibration calibrations[VAL_LIGHT_COUNT] = {
+  [0 ... VAL_LIGHT_COUNT - 1] = {ANALOG_CAL_GAIN_UNITY, 0, ANALOG_CAL_GAIN_UNITY, 0, 0, {{0}}}
+};
+
+/* Q16 current factors for the current full scale, per light */
+static uint32_t current_ma_per_count_q16[VAL_LIGHT_COUNT];
+static uint32_t counts_per_ma_q16[VAL_LIGHT_COUNT];
+#ifdef ANALOG_USE_FPU
+static float current_ma_per_count[VAL_LIGHT_COUNT];
+#endif
+
+/* Temperature conversion per light; counts >> segment_shift is the segment */
+static TemperatureSegment temperature_segments[VAL_LIGHT_COUNT][CAL_SEGMENTS];
+static uint8_t segment_shift = 0;
+
+/* Factory calibration of the internal channels, 12-bit counts at 3.0 V */
+static uint16_t vrefint_cal = 0;
+static uint16_t ts_cal1 = 0;
+static uint16_t ts_cal2 = 0;
+
+/* Analog supply from VREFINT and the ratio to ADC_REFERENCE_MV, updated per block */
+static volatile uint32_t supply_mv = ADC_REFERENCE_MV;
+static volatile uint32_t supply_ratio_q16 = SUPPLY_RATIO_UNITY;
+#ifdef ANALOG_USE_FPU
+static volatile float supply_ratio = 1.0f;
+#endif
+
+/* Moving average over the last scan_average scans, updated per scan */
+static uint16_t scan_history[ANALOG_MAX_SCAN_AVERAGE][ADC_CHANNEL_COUNT];
+static volatile uint32_t scan_sum[ADC_CHANNEL_COUNT];
+static volatile uint8_t scan_fill = 0;
+static uint8_t scan_index = 0;
+
+/* Latest scan, median history and EMA (counts << 8), updated per scan */
+static uint16_t scan_raw[ADC_CHANNEL_COUNT];
+static uint16_t median_history[ANALOG_MEDIAN_TAPS][ADC_CHANNEL_COUNT];
+static uint8_t median_fill = 0;
+static uint8_t median_index = 0;
+#ifdef ANALOG_USE_FPU
+static float ema_values[ADC_CHANNEL_COUNT];
+static float ema_weights[ADC_CHANNEL_COUNT];   /* 2^-ema_shift of the channel filter */
+#else
+static uint32_t ema_q8[ADC_CHANNEL_COUNT];
+#endif
+
+/* Filtered counts per rank, valid while the rank's bit in channel_dirty is clear */
+static uint32_t filtered_counts[ADC_CHANNEL_COUNT];
+static volatile uint32_t channel_dirty = SCAN_CHANNEL_MASK;
+
+/* Sensor data per light, reused while its inputs stay within the deadband */
+static ConvertedReading converted[VAL_LIGHT_COUNT];
+static uint32_t conversion_generation = 0;   /* Bumped when the conversion changes */
+static uint32_t reconvert_deadband = RECONVERT_DEADBAND;
+
+/* Filter read by each scan rank */
+static AnalogFilter channel_filters[ADC_CHANNEL_COUNT] = {
+  [0 ... ADC_CHANNEL_COUNT - 1] = {ANALOG_FILTER_MEDIAN5, 3}
+};
+
+/* New-sample notification, rate limited because the ADC converts continuously */
+static AnalogSampleCallback sample_callback = NULL;
+static uint32_t sample_interval_ms = 0;
+static uint32_t last_sample_tick = 0;
+
+/* Batch consumer of completed blocks */
+static AnalogBlockCallback block_callback = NULL;
+
+/* Conversion and DMA errors; the ADC stays stopped until VAL_Analog_Recover */
+static AnalogErrorCallback error_callback = NULL;
+static AnalogErrorCounts error_counts = {0};
+static volatile uint8_t recovery_pending = 0;
+
+/* Hardware over-current watchdogs, indexed by watchdog number - 1 */
+static AnalogWatchdogCallback watchdog_callback = NULL;
+static const uint32_t watchdog_numbers[WATCHDOG_COUNT] = {
+  ADC_ANALOGWATCHDOG_1, ADC_ANALOGWATCHDOG_2, ADC_ANALOGWATCHDOG_3
+};
+static const uint32_t watchdog_its[WATCHDOG_COUNT] = {
+  ADC_IT_AWD1, ADC_IT_AWD2, ADC_IT_AWD3
+};
+static const uint32_t watchdog_flags[WATCHDOG_COUNT] = {
+  ADC_FLAG_AWD1, ADC_FLAG_AWD2, ADC_FLAG_AWD3
+};
+static uint8_t watchdog_lights[WATCHDOG_COUNT];  /* Light ID per watchdog, 0 if unused */
+
+/* Raw capture, recorded by the block interrupt */
+static uint16_t capture_buffer[ANALOG_CAPTURE_MAX_SCANS][ADC_CHANNEL_COUNT] __attribute__((section(".capture")));
+static volatile AnalogCaptureState capture_state = ANALOG_CAPTURE_IDLE;
+static volatile uint16_t capture_count = 0;    /* Scans recorded */
+static uint16_t capture_scans = 0;             /* Scans wanted, the ring length */
+static uint16_t capture_pre_scans = 0;         /* Of those, scans from before the trigger */
+static uint16_t capture_head = 0;              /* Slot of the next scan */
+static uint16_t capture_post = 0;              /* Scans recorded from the trigger on */
+static uint32_t capture_end_sample = 0;        /* Scan count after the last recorded scan */
+static AnalogCaptureTrigger capture_trigger = ANALOG_CAPTURE_IMMEDIATE;
+static uint8_t capture_rank = 0;               /* Scan rank compared with the threshold */
+static uint32_t capture_threshold = 0;
+static uint8_t capture_primed = 0;             /* capture_above holds a previous scan */
+static uint8_t capture_above = 0;
+
+/* Statistics, accumulated by the block interrupt */
+static StatsWindow stats_live;                 /* Being accumulated */
+static StatsWindow stats_done;                 /* Last completed window */
+static uint32_t stats_window_scans = 0;        /* 0: one run until reset */
+
+/* Zero-current offsets, captured with the outputs off */
+static uint32_t zero_fraction_q16[VAL_LIGHT_COUNT];   /* Of the full scale */
+static uint32_t current_zero_counts[VAL_LIGHT_COUNT]; /* At the present full scale */
+static uint32_t zero_sum[VAL_LIGHT_COUNT];
+static volatile uint16_t zero_count = 0;      /* Scans added */
+static uint16_t zero_scans = 0;               /* Scans wanted, 0 when idle */
+
+#ifdef BENCHMARK
+/* Synthetic source, written into the completed block by its interrupt */
+static AnalogSynthWave synth_wave;
+static volatile bool synth_active = false;
+static uint8_t synth_rank = 0;
+static uint32_t synth_scans = 0;               /* Scans since the start */
+static uint16_t synth_from = 0;                /* Last real sample, where a ramp starts */
+static uint32_t synth_noise_state = SYNTH_NOISE_SEED;
+static uint32_t synth_edge_sample = 0;
+static uint64_t synth_edge_us = 0;
+static uint64_t synth_block_us = 0;
+#endif
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t GetFilteredCounts(uint8_t rank);
+static uint32_t ComputeFilteredCounts(uint8_t rank);
+static uint32_t GetMedianCounts(uint8_t rank);
+static uint32_t GetLatestCounts(uint8_t rank);
+static uint32_t GetTemperatureCounts(uint8_t index, bool latest);
+static uint32_t CorrectSupply(uint32_t counts);
+static void UpdateSupply(void);
+static int32_t ScaleCounts(uint32_t counts, uint32_t factor_q16);
+static int32_t CountsToCurrent(uint8_t index, uint32_t counts);
+static int32_t CountsToTemperature(uint8_t index, uint32_t counts);
+static int32_t EvaluateTemperature(uint8_t index, int64_t counts);
+#ifdef ANALOG_USE_FPU
+static int32_t RoundToInt(float value);
+#endif
+static void UpdateTemperatureTable(uint8_t index);
+static const ConvertedReading* ConvertSensorData(uint8_t index);
+static void FillSensorData(uint8_t index, LightSensorData* sensorData);
+static uint8_t GetInputRank(uint8_t lightId, AnalogInput input);
+static void UpdateScaleFactors(void);
+static void ProcessScanBlock(uint8_t block);
+static void ResetScanAverage(void);
+static VAL_Status ApplyOversampling(uint16_t ratio, uint8_t shift);
+static void StopSampling(void);
+static VAL_Status StartSampling(void);
+static void UpdateSyncRate(void);
+static VAL_Status SyncToTrigger(uint32_t trigger, uint32_t edge, uint32_t trigger_hz);
+static void HandleWatchdog(uint8_t watchdog);
+static void CaptureBlock(const uint16_t* samples, uint32_t first_sample);
+static inline void CaptureScan(const uint16_t* scan);
+static void FireCapture(AnalogCaptureTrigger trigger);
+static void AccumulateStats(const uint16_t* samples, uint32_t first_sample);
+static void AccumulateStatsScan(StatsWindow* window, const uint16_t* scan_samples);
+#ifdef ANALOG_USE_SIMD
+static void AccumulateStatsPair(StatsWindow* window, const uint16_t* first, const uint16_t* second);
+#endif
+static void ConvertStats(uint8_t index, AnalogInput input, const StatsWindow* window,
+                         AnalogStatsReading* reading);
+static int32_t ConvertStatsCounts(uint8_t index, AnalogInput input, uint32_t counts);
+static uint32_t SquareRoot(uint64_t value);
+static void ResetStats(void);
+static void AccumulateZero(const uint16_t* samples);
+#ifdef BENCHMARK
+static void SynthesizeBlock(uint16_t* samples, uint32_t first_sample);
+#endif
 
 /* Public functions ----------------------------------------------------------*/
 
+/**
+  * @brief  Compute the conversion factors at the default scale, before
+  *         the ADC is started
+  * @note   Lets current limits be converted to counts in the first
+  *         milliseconds of start-up; VAL_Analog_Init computes them again.
+  *         The zero offsets are 0, so a light reads high until captured.
+  * @retval None
+  */
+void VAL_Analog_InitScale(void) {
+  UpdateScaleFactors();
+}
+
 /**
   * @brief  Initialize the analog module
   * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
   */
 VAL_Status VAL_Analog_Init(void) {
-  VAL_Serial_Printf("Starting ADC initialization...\r\n");
-
   /* Stop any ongoing conversions first */
   HAL_ADC_Stop_DMA(&hadc1);
 
@@ -63,193 +481,2398 @@ VAL_Status VAL_Analog_Init(void) {
   /* Reset ADC */
   __HAL_ADC_RESET_HANDLE_STATE(&hadc1);
 
-  /* Initialize ADC */
+  UpdateScaleFactors();
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    UpdateTemperatureTable(i);
+  }
+
+  /* Read once, they live in system memory */
+  vrefint_cal = *VREFINT_CAL_ADDR;
+  ts_cal1 = *TEMPSENSOR_CAL1_ADDR;
+  ts_cal2 = *TEMPSENSOR_CAL2_ADDR;
+  supply_mv = ADC_REFERENCE_MV;
+  supply_ratio_q16 = SUPPLY_RATIO_UNITY;
+#ifdef ANALOG_USE_FPU
+  supply_ratio = 1.0f;
+  for (uint8_t ch = 0; ch < ADC_CHANNEL_COUNT; ch++) {
+    ema_weights[ch] = 1.0f / (float)(1U << channel_filters[ch].ema_shift);
+  }
+#endif
+
+  /* Initialize ADC and its scan trigger timer */
+  sync_trigger_hz = 0;
   MX_ADC1_Init();
-  
-  /* Small delay to let ADC stabilize */
-  HAL_Delay(10);
+  MX_TIM6_Init();
+  VAL_Analog_SetSampleRate(sample_rate_hz);
+
+  /* HAL_ADC_Init already waited for the ADC voltage regulator to settle */
 
   /* Clear any pending flags */
   __HAL_ADC_CLEAR_FLAG(&hadc1, (ADC_FLAG_EOC | ADC_FLAG_EOS | ADC_FLAG_OVR));
   
   /* Start ADC in DMA mode */
-  if (HAL_ADC_Start_DMA(&hadc1, (uint32_t*)adc_buffer, ADC_BUFFER_SIZE) != HAL_OK) {
-    VAL_Serial_Printf("Failed to start ADC DMA\r\n");
+  if (HAL_ADC_Start_DMA(&hadc1, (uint32_t*)adc_buffer, ADC_SCAN_BLOCKS * block_scans * ADC_CHANNEL_COUNT) != HAL_OK) {
     return VAL_ERROR;
   }
   
   HAL_ADC_Start(&hadc1);
 
-  VAL_Serial_Printf("ADC initialization completed successfully\r\n");
+  /* Conversions begin with the first trigger from TIM6 */
+  if (HAL_TIM_Base_Start(&htim6) != HAL_OK) {
+    return VAL_ERROR;
+  }
+
+#if VAL_EXT_ADC_CHANNEL_COUNT > 0
+  VAL_ExtAdc_Init();
+  VAL_ExtAdc_Start(sample_rate_hz, block_scans);
+#endif
+#if VAL_I2C_TEMP_ENABLED
+  VAL_I2CTemp_Init();
+  VAL_I2CTemp_Start();
+#endif
+
   return VAL_OK;
 }
 
 /**
   * @brief  Get current reading for a specific light
-  * @param  lightId: Light ID (1-3)
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
   * @param  current: Pointer to store current value in Amps
   * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
   */
 VAL_Status VAL_Analog_GetCurrent(uint8_t lightId, float* current) {
+  int32_t current_ma;
+
   /* Check parameters */
-  if (lightId < 1 || lightId > LIGHT_COUNT || current == NULL) {
+  if (current == NULL) {
     return VAL_PARAM;
   }
-  
-  /* Map light ID to ADC channel */
-  AdcChannelIndex channelIndex = CHANNEL_CURRENT_1 + (lightId - 1);
-  
-  /* Get raw ADC value */
-  uint32_t adcValue = adc_buffer[channelIndex];
-  
-  /* Convert to voltage */
-  float voltage = (adcValue / ADC_RESOLUTION) * ADC_REFERENCE;
-  
-  /* Simple linear conversion: 3.3V = 33A */
-  *current = voltage * CURRENT_CONVERSION_FACTOR;
-  
-  return VAL_OK;
+
+  VAL_Status status = VAL_Analog_GetCurrentMilliAmps(lightId, &current_ma);
+  if (status == VAL_OK) {
+    *current = current_ma * 0.001f;
+  }
+
+  return status;
 }
 
 /**
   * @brief  Get temperature reading for a specific light
-  * @param  lightId: Light ID (1-3)
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
   * @param  temperature: Pointer to store temperature value in degrees Celsius
   * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
   */
 VAL_Status VAL_Analog_GetTemperature(uint8_t lightId, float* temperature) {
+  int32_t temperature_cdeg;
+
   /* Check parameters */
-  if (lightId < 1 || lightId > LIGHT_COUNT || temperature == NULL) {
+  if (temperature == NULL) {
     return VAL_PARAM;
   }
-  
-  /* Map light ID to ADC channel */
-  AdcChannelIndex channelIndex = CHANNEL_TEMP_1 + (lightId - 1);
-  
-  /* Get raw ADC value */
-  uint32_t adcValue = adc_buffer[channelIndex];
-  
-  /* Convert to voltage */
-  float voltage = (adcValue / ADC_RESOLUTION) * ADC_REFERENCE;
-  
-  /* Simple linear conversion: 3.3V = 330°C */
-  *temperature = voltage * TEMPERATURE_CONVERSION_FACTOR;
-  
+
+  VAL_Status status = VAL_Analog_GetTemperatureCentiDeg(lightId, &temperature_cdeg);
+  if (status == VAL_OK) {
+    *temperature = temperature_cdeg * 0.01f;
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Get current reading for a specific light in fixed point
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @param  current_ma: Pointer to store current value in milliamps
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_Analog_GetCurrentMilliAmps(uint8_t lightId, int32_t* current_ma) {
+  /* Check parameters */
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT || current_ma == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* Scale filtered counts: 3.3V = 33A before calibration */
+  *current_ma = CountsToCurrent(lightId - 1,
+                                CorrectSupply(GetFilteredCounts(VAL_Channels[lightId - 1].current_rank)));
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get temperature reading for a specific light in fixed point
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @param  temperature_cdeg: Pointer to store temperature in centi-degrees Celsius
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_Analog_GetTemperatureCentiDeg(uint8_t lightId, int32_t* temperature_cdeg) {
+  /* Check parameters */
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT || temperature_cdeg == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* Through the calibrated segment table: 3.3V = 330°C when uncalibrated */
+  *temperature_cdeg = CountsToTemperature(lightId - 1, GetTemperatureCounts(lightId - 1, false));
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get filtered counts for a specific light
+  * @note   Compare against thresholds from VAL_Analog_CurrentToCounts and
+  *         VAL_Analog_TemperatureToCounts; no conversion is needed. Counts
+  *         are corrected to the nominal reference voltage, as the thresholds.
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @param  current_counts: Pointer to store current counts, or NULL
+  * @param  temperature_counts: Pointer to store temperature counts, or NULL
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_Analog_GetRawCounts(uint8_t lightId, uint32_t* current_counts, uint32_t* temperature_counts) {
+  /* Check parameters */
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT) {
+    return VAL_PARAM;
+  }
+
+  if (current_counts != NULL) {
+    *current_counts = CorrectSupply(GetFilteredCounts(VAL_Channels[lightId - 1].current_rank));
+  }
+  if (temperature_counts != NULL) {
+    *temperature_counts = GetTemperatureCounts(lightId - 1, false);
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Convert a current to averaged ADC counts at the present resolution
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT), whose calibration is used
+  * @param  current_ma: Current in milliamps
+  * @retval uint32_t: Equivalent counts, clamped to the ADC range; 0 for an
+  *         invalid light
+  */
+uint32_t VAL_Analog_CurrentToCounts(uint8_t lightId, int32_t current_ma) {
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT) {
+    return 0;
+  }
+
+  current_ma -= calibrations[lightId - 1].current_offset_ma;
+  if (current_ma <= 0) {
+    return current_zero_counts[lightId - 1];
+  }
+
+  uint64_t counts = ((uint64_t)current_ma * counts_per_ma_q16[lightId - 1] + 0x8000U) >> 16;
+  counts += current_zero_counts[lightId - 1];
+  return (counts > adc_full_scale) ? adc_full_scale : (uint32_t)counts;
+}
+
+/**
+  * @brief  Convert a temperature to averaged ADC counts at the present resolution
+  * @note   Searches the segment table; meant for thresholds, not per scan
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT), whose calibration is used
+  * @param  temperature_cdeg: Temperature in centi-degrees Celsius
+  * @retval uint32_t: Equivalent counts, clamped to the ADC range; 0 for an
+  *         invalid light
+  */
+uint32_t VAL_Analog_TemperatureToCounts(uint8_t lightId, int32_t temperature_cdeg) {
+  const TemperatureSegment* segments;
+  uint32_t segment = CAL_SEGMENTS - 1U;
+  int64_t counts;
+
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT) {
+    return 0;
+  }
+
+  segments = temperature_segments[lightId - 1];
+  if (temperature_cdeg <= segments[0].base) {
+    return 0;
+  }
+
+  /* Segments rise with the counts; take the last one starting at or below */
+  while (segment > 0 && segments[segment].base > temperature_cdeg) {
+    segment--;
+  }
+
+  counts = (int64_t)segment << segment_shift;
+  if (segments[segment].slope_q16 > 0) {
+    counts += (((int64_t)(temperature_cdeg - segments[segment].base) << 16) +
+               segments[segment].slope_q16 / 2) / segments[segment].slope_q16;
+  }
+
+  return (counts > adc_full_scale) ? adc_full_scale : (uint32_t)counts;
+}
+
+/**
+  * @brief  Get the count value corresponding to the reference voltage
+  * @note   Changes with the oversampling configuration; thresholds converted
+  *         to counts must be recomputed when it does.
+  * @retval uint32_t: Full-scale counts
+  */
+uint32_t VAL_Analog_GetFullScaleCounts(void) {
+  return adc_full_scale;
+}
+
+/**
+  * @brief  Get the analog supply voltage, measured with the internal reference
+  * @note   ADC_REFERENCE_MV until the first block has been processed
+  * @param  supplyMv: Pointer to store VDDA in millivolts
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM for a NULL pointer
+  */
+VAL_Status VAL_Analog_GetSupplyMilliVolts(uint32_t* supplyMv) {
+  if (supplyMv == NULL) {
+    return VAL_PARAM;
+  }
+
+  *supplyMv = supply_mv;
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the MCU die temperature from the internal sensor
+  * @note   Interpolates between the two factory calibration points, after
+  *         scaling the filtered reading from the measured supply to the
+  *         3.0 V they were taken at
+  * @param  temperatureCdeg: Pointer to store the temperature in centi-degrees Celsius
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM for a NULL pointer
+  */
+VAL_Status VAL_Analog_GetDieTemperatureCentiDeg(int32_t* temperatureCdeg) {
+  if (temperatureCdeg == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* Sensor counts at 3.0 V and 12 bits, as num / den */
+  int64_t num = (int64_t)GetFilteredCounts(ANALOG_RANK_DIE_TEMPERATURE) * ADC_RESOLUTION * supply_mv;
+  int64_t den = (int64_t)adc_full_scale * TEMPSENSOR_CAL_VREFANALOG;
+
+  if (ts_cal2 <= ts_cal1) {
+    *temperatureCdeg = 0;
+    return VAL_OK;
+  }
+
+  *temperatureCdeg = (int32_t)(TEMPSENSOR_CAL1_TEMP * 100L +
+                               (num - (int64_t)ts_cal1 * den) * (TEMPSENSOR_CAL2_TEMP - TEMPSENSOR_CAL1_TEMP) *
+                               100L / ((int64_t)(ts_cal2 - ts_cal1) * den));
   return VAL_OK;
 }
 
 /**
   * @brief  Get all sensor readings for a specific light
-  * @param  lightId: Light ID (1-3)
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
   * @param  sensorData: Pointer to store sensor data
   * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
   */
 VAL_Status VAL_Analog_GetSensorData(uint8_t lightId, LightSensorData* sensorData) {
+  uint32_t primask;
+
   /* Check parameters */
-  if (lightId < 1 || lightId > LIGHT_COUNT || sensorData == NULL) {
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT || sensorData == NULL) {
     return VAL_PARAM;
   }
   
-  /* Get current and temperature readings */
-  VAL_Status status = VAL_Analog_GetCurrent(lightId, &sensorData->current);
-  if (status != VAL_OK) {
-    return status;
-  }
-  
-  status = VAL_Analog_GetTemperature(lightId, &sensorData->temperature);
-  if (status != VAL_OK) {
-    return status;
-  }
+  /* Read current and temperature from the same scans */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  FillSensorData(lightId - 1, sensorData);
+  __set_PRIMASK(primask);
 
   return VAL_OK;
 }
 
 /**
   * @brief  Get sensor readings for all lights
-  * @param  sensorData: Array to store sensor data (must be at least LIGHT_COUNT elements)
+  * @param  sensorData: Array to store sensor data (must be at least VAL_LIGHT_COUNT elements)
+  * @param  stamp: Pointer to store when the readings were taken, or NULL
   * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
   */
-VAL_Status VAL_Analog_GetAllSensorData(LightSensorData sensorData[]) {
-  VAL_Status overallStatus = VAL_OK;
+VAL_Status VAL_Analog_GetAllSensorData(LightSensorData sensorData[], AnalogSampleStamp* stamp) {
+  uint32_t primask;
 
-  /* Get sensor data for each light */
-  for (uint8_t i = 0; i < LIGHT_COUNT; i++) {
-    /* Explicitly initialize the sensor data entry */
-    sensorData[i].current = 0.0f;
-    sensorData[i].temperature = 0.0f;
+  if (sensorData == NULL) {
+    return VAL_PARAM;
+  }
 
-    /* Get sensor data for this specific light */
-    VAL_Status lightStatus = VAL_Analog_GetSensorData(i + 1, &sensorData[i]);
+  /* Hold off block processing so all lights come from the same scans */
+  primask = __get_PRIMASK();
+  __disable_irq();
 
-    if (lightStatus != VAL_OK) {
-      /* Track if any light's sensor data retrieval failed */
-      overallStatus = VAL_ERROR;
-    }
+  /* Converted at most once per block */
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    FillSensorData(i, &sensorData[i]);
   }
-  
-  return overallStatus;
+
+  if (stamp != NULL) {
+    int32_t die_cdeg;
+
+    VAL_Analog_GetDieTemperatureCentiDeg(&die_cdeg);
+    stamp->sequence = sample_count;
+    stamp->timestamp_us = sample_micros;
+    stamp->supply_mv = (uint16_t)supply_mv;
+    stamp->mcu_temperature_cdeg = (die_cdeg < INT16_MIN) ? INT16_MIN :
+                                  (die_cdeg > INT16_MAX) ? INT16_MAX : (int16_t)die_cdeg;
+  }
+
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
 }
 
 /**
-  * @brief  De-initialize the analog module
-  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  * @brief  Get fixed-point sensor readings for all lights
+  * @param  sensorData: Array to store sensor data (must be at least VAL_LIGHT_COUNT elements)
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
   */
-VAL_Status VAL_Analog_DeInit(void) {
-  /* Stop ADC conversion */
-  HAL_ADC_Stop_DMA(&hadc1);
-  
+VAL_Status VAL_Analog_GetAllSensorDataFixed(LightSensorDataFixed sensorData[]) {
+  uint32_t primask;
+
+  if (sensorData == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* Hold off block processing so all lights come from the same scans */
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    const ConvertedReading* reading = ConvertSensorData(i);
+
+    sensorData[i].light_id = i + 1;
+    sensorData[i].current_ma = reading->values[READING_CURRENT];
+    sensorData[i].temperature_cdeg = reading->values[READING_TEMPERATURE];
+  }
+
+  __set_PRIMASK(primask);
+
   return VAL_OK;
 }
 
-/* Private functions ---------------------------------------------------------*/
-
 /**
-  * @brief  ADC conversion complete callback
-  * @param  hadc: ADC handle
-  * @retval None
+  * @brief  Configure hardware oversampling and software scan averaging
+  * @note   Briefly stops sampling while the ADC is reconfigured. The scan
+  *         rate times the oversampling ratio must not exceed SAMPLE_RATE_MAX_HZ.
+  * @param  config: New configuration
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid,
+  *         VAL_ERROR if the ADC could not be restarted
   */
-void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) {
-	//TODO: implement safety limits check
+VAL_Status VAL_Analog_Config(const AnalogConfig* config) {
+  uint16_t ratio;
+  VAL_Status status;
+
+  if (config == NULL) {
+    return VAL_PARAM;
+  }
+
+  ratio = config->oversampling_ratio;
+
+  /* Ratio must be a power of two between 1 and 256, shift at most 8 */
+  if (ratio == 0 || ratio > 256 || (ratio & (ratio - 1)) != 0 ||
+      config->oversampling_shift > 8) {
+    return VAL_PARAM;
+  }
+
+  /* Result must fit in 16 bits */
+  if (((4096UL * ratio) >> config->oversampling_shift) > (ADC_MAX_RESULT + 1UL)) {
+    return VAL_PARAM;
+  }
+
+  if (config->scan_average == 0 || config->scan_average > ANALOG_MAX_SCAN_AVERAGE) {
+    return VAL_PARAM;
+  }
+
+  /* Oversampled scans take ratio times longer */
+  if (sample_rate_hz * ratio > SAMPLE_RATE_MAX_HZ) {
+    return VAL_PARAM;
+  }
+
+  status = ApplyOversampling(ratio, config->oversampling_shift);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  analog_config = *config;
+  adc_full_scale = (ADC_RESOLUTION * ratio) >> config->oversampling_shift;
+  UpdateScaleFactors();
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    UpdateTemperatureTable(i);
+  }
+  UpdateSyncRate();
+  ResetScanAverage();
+  ResetStats();
+
+  return VAL_OK;
 }
 
 /**
-  * @brief  ADC error callback
-  * @param  hadc: ADC handle
-  * @retval None
+  * @brief  Get the current filtering configuration
+  * @param  config: Pointer to store the configuration
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if config is NULL
   */
-void HAL_ADC_ErrorCallback(ADC_HandleTypeDef* hadc) {
-  // Get error code
-  uint32_t errorCode = HAL_ADC_GetError(hadc);
+VAL_Status VAL_Analog_GetConfig(AnalogConfig* config) {
+  if (config == NULL) {
+    return VAL_PARAM;
+  }
 
-  // Print specific error information
-  VAL_Serial_Printf("ADC Error occurred, code: 0x%08lX\r\n", errorCode);
+  *config = analog_config;
+  return VAL_OK;
+}
 
-  if (errorCode & HAL_ADC_ERROR_INTERNAL) VAL_Serial_Printf("- Internal error\r\n");
-  if (errorCode & HAL_ADC_ERROR_OVR) VAL_Serial_Printf("- Overrun error\r\n");
-  if (errorCode & HAL_ADC_ERROR_DMA) VAL_Serial_Printf("- DMA transfer error\r\n");
-  if (errorCode & HAL_ADC_ERROR_JQOVF) VAL_Serial_Printf("- Injected queue overflow error\r\n");
+/**
+  * @brief  Select the filter one input of a light reads through
+  * @note   All filters run on every scan, so the new one applies right away
+  *         without a settling time. The boxcar length is the scan_average
+  *         of VAL_Analog_Config and is shared by all inputs.
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @param  input: Current or temperature input
+  * @param  filter: Filter type and, for the EMA, its weight
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+  */
+VAL_Status VAL_Analog_SetFilter(uint8_t lightId, AnalogInput input, const AnalogFilter* filter) {
+  uint8_t rank = GetInputRank(lightId, input);
+  uint32_t primask;
 
-  // More thorough error recovery
-  HAL_ADC_Stop_DMA(hadc);
+  if (rank >= ADC_CHANNEL_COUNT || filter == NULL || filter->type >= ANALOG_FILTER_COUNT) {
+    return VAL_PARAM;
+  }
 
-  // Clear all flags
-  __HAL_ADC_CLEAR_FLAG(hadc, (ADC_FLAG_EOC | ADC_FLAG_EOS | ADC_FLAG_OVR));
-  if (hadc->DMA_Handle != NULL) {
-    __HAL_DMA_CLEAR_FLAG(hadc->DMA_Handle, (DMA_FLAG_TC1 | DMA_FLAG_HT1 | DMA_FLAG_TE1));
+  /* The EMA is always updated, so its shift must be valid for every type */
+  if (filter->ema_shift > ANALOG_MAX_EMA_SHIFT ||
+      (filter->type == ANALOG_FILTER_EMA && filter->ema_shift == 0)) {
+    return VAL_PARAM;
   }
 
-  // Wait a moment
-  HAL_Delay(10);
+  primask = __get_PRIMASK();
+  __disable_irq();
+  channel_filters[rank] = *filter;
+#ifdef ANALOG_USE_FPU
+  ema_weights[rank] = 1.0f / (float)(1U << filter->ema_shift);
+#endif
+  channel_dirty |= 1UL << rank;
+  __set_PRIMASK(primask);
 
-  // Restart ADC with DMA
-  HAL_ADC_Start_DMA(hadc, (uint32_t*)adc_buffer, ADC_BUFFER_SIZE);
+  return VAL_OK;
 }
 
 /**
-  * @brief  DMA error callback
-  * @param  hdma: DMA handle
-  * @retval None
+  * @brief  Get the filter one input of a light reads through
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @param  input: Current or temperature input
+  * @param  filter: Pointer to store the filter
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
   */
-void HAL_DMA_ErrorCallback(DMA_HandleTypeDef *hdma) {
-  VAL_Serial_Printf("DMA Error occurred, code: 0x%08lX\r\n", HAL_DMA_GetError(hdma));
+VAL_Status VAL_Analog_GetFilter(uint8_t lightId, AnalogInput input, AnalogFilter* filter) {
+  uint8_t rank = GetInputRank(lightId, input);
+
+  if (rank >= ADC_CHANNEL_COUNT || filter == NULL) {
+    return VAL_PARAM;
+  }
+
+  *filter = channel_filters[rank];
+  return VAL_OK;
+}
+
+/**
+  * @brief  Set the sensor conversion factors
+  * @note   Thresholds converted to counts must be recomputed afterwards, as
+  *         after a resolution change.
+  * @param  currentMaPerMv: Current in mA per mV at the ADC pin
+  * @param  temperatureCdegPerMv: Temperature in centi-degrees per mV at the ADC pin
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+  */
+VAL_Status VAL_Analog_SetScale(uint16_t currentMaPerMv, uint16_t temperatureCdegPerMv) {
+  uint32_t primask;
+
+  if (currentMaPerMv == 0 || currentMaPerMv > ANALOG_MAX_SCALE_PER_MV ||
+      temperatureCdegPerMv == 0 || temperatureCdegPerMv > ANALOG_MAX_SCALE_PER_MV) {
+    return VAL_PARAM;
+  }
+
+  /* The interrupt converts with these factors, change them together */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  current_ma_per_mv = currentMaPerMv;
+  temperature_cdeg_per_mv = temperatureCdegPerMv;
+  UpdateScaleFactors();
+  __set_PRIMASK(primask);
+
+  /* Tables are rebuilt a segment at a time, not with interrupts held off */
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    UpdateTemperatureTable(i);
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the sensor conversion factors
+  * @param  currentMaPerMv: Pointer to store the current factor in mA per mV
+  * @param  temperatureCdegPerMv: Pointer to store the temperature factor in centi-degrees per mV
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if a pointer is NULL
+  */
+VAL_Status VAL_Analog_GetScale(uint16_t* currentMaPerMv, uint16_t* temperatureCdegPerMv) {
+  if (currentMaPerMv == NULL || temperatureCdegPerMv == NULL) {
+    return VAL_PARAM;
+  }
+
+  *currentMaPerMv = current_ma_per_mv;
+  *temperatureCdegPerMv = temperature_cdeg_per_mv;
+  return VAL_OK;
+}
+
+/**
+  * @brief  Set the calibration of one light
+  * @note   Thresholds converted to counts must be recomputed afterwards, as
+  *         after a scale change. Readings taken while the temperature table
+  *         is rebuilt may mix old and new segments.
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @param  calibration: New calibration; table points must rise in both
+  *         voltage and temperature
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+  */
+VAL_Status VAL_Analog_SetCalibration(uint8_t lightId, const AnalogCalibration* calibration) {
+  uint32_t primask;
+
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT || calibration == NULL ||
+      calibration->current_gain == 0 || calibration->temperature_gain == 0 ||
+      calibration->point_count == 1 || calibration->point_count > ANALOG_CAL_MAX_POINTS) {
+    return VAL_PARAM;
+  }
+
+  for (uint8_t i = 1; i < calibration->point_count; i++) {
+    if (calibration->points[i].mv <= calibration->points[i - 1].mv ||
+        calibration->points[i].cdeg <= calibration->points[i - 1].cdeg) {
+      return VAL_PARAM;
+    }
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  calibrations[lightId - 1] = *calibration;
+  UpdateScaleFactors();
+  __set_PRIMASK(primask);
+
+  UpdateTemperatureTable(lightId - 1);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the calibration of one light
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @param  calibration: Pointer to store the calibration
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+  */
+VAL_Status VAL_Analog_GetCalibration(uint8_t lightId, AnalogCalibration* calibration) {
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT || calibration == NULL) {
+    return VAL_PARAM;
+  }
+
+  *calibration = calibrations[lightId - 1];
+  return VAL_OK;
+}
+
+/**
+  * @brief  Set the rate at which the scan is triggered
+  * @note   While synchronized to the PWM the rate is kept for when
+  *         free-running resumes
+  * @param  rate_hz: Scan rate in Hz (SAMPLE_RATE_MIN_HZ to SAMPLE_RATE_MAX_HZ,
+  *         divided by the oversampling ratio)
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if out of range
+  */
+VAL_Status VAL_Analog_SetSampleRate(uint32_t rate_hz) {
+  if (rate_hz < SAMPLE_RATE_MIN_HZ || rate_hz * analog_config.oversampling_ratio > SAMPLE_RATE_MAX_HZ) {
+    return VAL_PARAM;
+  }
+
+  sample_rate_hz = rate_hz;
+
+  /* Preload is enabled, so the new period applies from the next update */
+  __HAL_TIM_SET_AUTORELOAD(&htim6, (SAMPLE_TIMER_CLOCK_HZ / rate_hz) - 1U);
+#if VAL_EXT_ADC_CHANNEL_COUNT > 0
+  if (sync_trigger_hz == 0) {
+    VAL_ExtAdc_SetSampleRate(rate_hz);
+  }
+#endif
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Set the number of scans processed per block
+  * @note   Must not be called from interrupt context. Sampling restarts
+  *         with the first half of the buffer; the scans of the block in
+  *         progress are dropped.
+  * @param  scans: Scans per block (1 to ANALOG_MAX_BLOCK_SCANS)
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if out of range,
+  *         VAL_ERROR if sampling could not be restarted
+  */
+VAL_Status VAL_Analog_SetBlockScans(uint8_t scans) {
+  if (scans == 0 || scans > ANALOG_MAX_BLOCK_SCANS) {
+    return VAL_PARAM;
+  }
+  if (scans == block_scans) {
+    return VAL_OK;
+  }
+
+  /* The DMA transfer length changes with it */
+  StopSampling();
+  block_scans = scans;
+  __HAL_ADC_CLEAR_FLAG(&hadc1, (ADC_FLAG_EOC | ADC_FLAG_EOS | ADC_FLAG_OVR));
+
+  return StartSampling();
+}
+
+/**
+  * @brief  Get the number of scans processed per block
+  * @retval uint8_t: Scans per block
+  */
+uint8_t VAL_Analog_GetBlockScans(void) {
+  return block_scans;
+}
+
+/**
+  * @brief  Set the scan trigger prescaler for the present system clock
+  * @note   Called by VAL_SysClock_SetLevel with interrupts disabled. The
+  *         prescaler is preloaded, so the rate holds from the next update;
+  *         the scan in progress ends early or late, once.
+  * @retval None
+  */
+void VAL_Analog_UpdateClock(void) {
+  uint32_t clock_hz = HAL_RCC_GetPCLK1Freq();
+
+  /* APB1 timers run at twice PCLK1 when it is divided */
+  if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) {
+    clock_hz *= 2U;
+  }
+
+  __HAL_TIM_SET_PRESCALER(&htim6, clock_hz / SAMPLE_TIMER_CLOCK_HZ - 1U);
+}
+
+/**
+  * @brief  Get the scan rate
+  * @retval uint32_t: Scan rate in Hz, set by the trigger rate while synchronized
+  */
+uint32_t VAL_Analog_GetSampleRate(void) {
+  return (sync_trigger_hz != 0) ? sync_rate_hz : sample_rate_hz;
+}
+
+/**
+  * @brief  Trigger scans from the PWM timer instead of TIM6
+  * @note   The trigger point is set with VAL_PWM_SetAdcTrigger. Scans start on
+  *         the first trigger after the previous scan has finished, so the
+  *         scan rate is the PWM frequency divided by the number of periods
+  *         a scan spans.
+  * @param  pwm_frequency_hz: PWM frequency, or 0 to return to TIM6 triggering
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR if the ADC could not
+  *         be reconfigured
+  */
+VAL_Status VAL_Analog_SyncToPwm(uint32_t pwm_frequency_hz) {
+  return SyncToTrigger((pwm_frequency_hz != 0) ? ADC_EXTERNALTRIG_T1_TRGO2 : ADC_EXTERNALTRIG_T6_TRGO,
+                       ADC_EXTERNALTRIGCONVEDGE_RISING, pwm_frequency_hz);
+}
+
+/**
+  * @brief  Trigger scans from the rate timer of a free-running strobe
+  * @note   Started with VAL_PWM_StartStrobe. Each pulse triggers a scan
+  *         within its on-time, as long as the previous scan has finished,
+  *         so pulses faster than a scan are sampled every Nth one.
+  * @param  pulse_hz: Pulse rate, or 0 to return to TIM6 triggering
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR if the ADC could not
+  *         be reconfigured
+  */
+VAL_Status VAL_Analog_SyncToStrobe(uint32_t pulse_hz) {
+  return SyncToTrigger((pulse_hz != 0) ? ADC_EXTERNALTRIG_T15_TRGO : ADC_EXTERNALTRIG_T6_TRGO,
+                       (pulse_hz != 0) ? ADC_EXTERNALTRIGCONVEDGE_FALLING : ADC_EXTERNALTRIGCONVEDGE_RISING,
+                       pulse_hz);
+}
+
+/**
+  * @brief  Get the number of scans completed since initialization
+  * @note   Divide by the sample rate to get the time of the latest scan
+  * @retval uint32_t: Completed scan count
+  */
+uint32_t VAL_Analog_GetSampleCount(void) {
+  return sample_count;
+}
+
+/**
+  * @brief  Register a callback signalling that fresh sensor samples are ready
+  * @param  callback: Callback function, called from interrupt context, or NULL
+  * @param  min_interval_ms: Minimum time between two callbacks in milliseconds
+  * @retval VAL_Status: VAL_OK if successful
+  */
+VAL_Status VAL_Analog_SetSampleCallback(AnalogSampleCallback callback, uint32_t min_interval_ms) {
+  sample_callback = NULL;
+  sample_interval_ms = min_interval_ms;
+  last_sample_tick = HAL_GetTick();
+  sample_callback = callback;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Register a consumer for completed blocks of raw samples
+  * @note   The callback runs in interrupt context. The block stays valid until
+  *         DMA returns to it, one block later.
+  * @param  callback: Callback function or NULL
+  * @retval VAL_Status: VAL_OK if successful
+  */
+VAL_Status VAL_Analog_SetBlockCallback(AnalogBlockCallback callback) {
+  block_callback = callback;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Start a raw capture, replacing the previous one
+  * @note   An IMMEDIATE capture records from the next completed block.
+  *         With pre_scans the capture holds the latest scans while armed,
+  *         so it may have fewer than pre_scans before the trigger if that
+  *         comes soon after the start.
+  * @param  config: Capture length and trigger
+  * @retval VAL_Status: VAL_OK if started or armed, VAL_PARAM for invalid settings
+  */
+VAL_Status VAL_Analog_StartCapture(const AnalogCaptureConfig* config) {
+  uint8_t rank = 0;
+  uint32_t primask;
+
+  if (config == NULL || config->scans == 0 || config->scans > ANALOG_CAPTURE_MAX_SCANS ||
+      config->trigger >= ANALOG_CAPTURE_TRIGGER_COUNT || config->pre_scans >= config->scans ||
+      (config->trigger == ANALOG_CAPTURE_IMMEDIATE && config->pre_scans != 0)) {
+    return VAL_PARAM;
+  }
+  if (config->trigger == ANALOG_CAPTURE_RISING || config->trigger == ANALOG_CAPTURE_FALLING) {
+    rank = GetInputRank(config->light_id, config->input);
+    if (rank >= ADC_CHANNEL_COUNT) {
+      return VAL_PARAM;
+    }
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  capture_scans = config->scans;
+  capture_pre_scans = config->pre_scans;
+  capture_count = 0;
+  capture_head = 0;
+  capture_post = 0;
+  capture_trigger = config->trigger;
+  capture_rank = rank;
+  capture_threshold = config->threshold_counts;
+  capture_primed = 0;
+  capture_state = (config->trigger == ANALOG_CAPTURE_IMMEDIATE) ? ANALOG_CAPTURE_RUNNING : ANALOG_CAPTURE_ARMED;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Fire an armed EXTERNAL capture
+  * @note   Recording starts with the block DMA is filling, so the scans just
+  *         before the event are included. Safe from interrupt context and a
+  *         no-op for any other capture state or trigger.
+  * @retval None
+  */
+void VAL_Analog_TriggerCapture(void) {
+  FireCapture(ANALOG_CAPTURE_EXTERNAL);
+}
+
+/**
+  * @brief  Fire an armed FAULT capture
+  * @note   As VAL_Analog_TriggerCapture, for the capture armed to record a
+  *         fault; output changes leave it armed.
+  * @retval None
+  */
+void VAL_Analog_TriggerFaultCapture(void) {
+  FireCapture(ANALOG_CAPTURE_FAULT);
+}
+
+/**
+  * @brief  Set how many scans the statistics cover
+  * @note   Restarts the statistics
+  * @param  window_scans: Scans per window, 0 for one run from the last reset
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_Analog_SetStatsWindow(uint32_t window_scans) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  stats_window_scans = window_scans;
+  stats_live.scans = 0;
+  stats_done.scans = 0;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Start averaging the current inputs for their zero-current offsets
+  * @note   All outputs must stay off until VAL_Analog_ApplyZeroCapture
+  *         succeeds. The offsets in use are kept until then.
+  * @param  scans: Scans to average (1-ANALOG_ZERO_MAX_SCANS)
+  * @retval VAL_Status: VAL_OK if started, VAL_PARAM if out of range
+  */
+VAL_Status VAL_Analog_StartZeroCapture(uint16_t scans) {
+  uint32_t primask;
+
+  if (scans == 0 || scans > ANALOG_ZERO_MAX_SCANS) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    zero_sum[i] = 0;
+  }
+  zero_count = 0;
+  zero_scans = scans;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Apply the zero-current offsets once their scans are averaged
+  * @note   Thresholds converted to counts must be recomputed afterwards, as
+  *         after a calibration change. A light whose average is too high to
+  *         be an offset keeps its previous one.
+  * @retval VAL_Status: VAL_OK if applied to all lights, VAL_BUSY while
+  *         averaging, VAL_ERROR if a light was rejected or no capture was
+  *         started
+  */
+VAL_Status VAL_Analog_ApplyZeroCapture(void) {
+  VAL_Status status = VAL_OK;
+  uint32_t primask;
+
+  if (zero_scans == 0) {
+    return VAL_ERROR;
+  }
+  if (zero_count < zero_scans) {
+    return VAL_BUSY;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    /* In counts of the nominal reference, as the readings it is taken from */
+    uint32_t mean = CorrectSupply((zero_sum[i] + zero_scans / 2U) / zero_scans);
+    uint32_t fraction = (uint32_t)(((uint64_t)mean << 16) / adc_full_scale);
+
+    if (fraction > ZERO_MAX_FRACTION_Q16) {
+      status = VAL_ERROR;
+      continue;
+    }
+    zero_fraction_q16[i] = fraction;
+  }
+  zero_scans = 0;
+  UpdateScaleFactors();
+  __set_PRIMASK(primask);
+
+  return status;
+}
+
+#ifdef BENCHMARK
+/**
+  * @brief  Substitute a synthetic waveform for one input, replacing the previous one
+  * @note   Benchmark builds only. The block interrupt writes the waveform
+  *         over the DMA samples before anything reads them, so filters,
+  *         alarms, captures and statistics all see it; the hardware
+  *         watchdogs and comparators still see the real input. It runs
+  *         until VAL_Analog_StopSynthetic.
+  * @param  wave: Waveform and the input it replaces
+  * @retval VAL_Status: VAL_OK if started, VAL_PARAM for invalid settings
+  */
+VAL_Status VAL_Analog_StartSynthetic(const AnalogSynthWave* wave) {
+  uint8_t rank;
+  uint32_t primask;
+
+  if (wave == NULL || wave->shape >= ANALOG_SYNTH_SHAPE_COUNT ||
+      (wave->shape == ANALOG_SYNTH_SPIKE && wave->length_scans == 0)) {
+    return VAL_PARAM;
+  }
+  rank = GetInputRank(wave->light_id, wave->input);
+  if (rank >= ADC_CHANNEL_COUNT) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  synth_wave = *wave;
+  synth_rank = rank;
+  synth_scans = 0;
+  synth_from = scan_raw[rank];
+  synth_noise_state = SYNTH_NOISE_SEED;
+  synth_edge_sample = 0;
+  synth_edge_us = 0;
+  synth_block_us = 0;
+  synth_active = true;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Return the synthetic input to its real samples
+  * @note   The filters flush the waveform out within their history
+  * @retval None
+  */
+void VAL_Analog_StopSynthetic(void) {
+  synth_active = false;
+}
+
+/**
+  * @brief  Get the progress of the synthetic source
+  * @param  status: Pointer to store the state and the edge timestamps
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM for a NULL pointer
+  */
+VAL_Status VAL_Analog_GetSyntheticStatus(AnalogSynthStatus* status) {
+  uint32_t primask;
+
+  if (status == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  status->active = synth_active;
+  status->scans = synth_scans;
+  status->edge_sample = synth_edge_sample;
+  status->edge_us = synth_edge_us;
+  status->block_us = synth_block_us;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+#endif
+
+/**
+  * @brief  Get the statistics of the light inputs
+  * @note   With a window, those of the last completed window; otherwise of
+  *         all scans since the last reset. The RMS adds the spread to the
+  *         mean, each converted like a reading, so it is exact for the
+  *         linear current input and follows the table for temperatures.
+  * @param  stats: Pointer to store the statistics
+  * @param  reset: Non-zero to start over once read
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM for a NULL pointer
+  */
+VAL_Status VAL_Analog_GetStats(AnalogStats* stats, uint8_t reset) {
+  StatsWindow window;
+  uint32_t primask;
+
+  if (stats == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  stats->window_scans = stats_window_scans;
+  window = (stats_window_scans != 0) ? stats_done : stats_live;
+  if (reset) {
+    stats_live.scans = 0;
+    stats_done.scans = 0;
+  }
+  __set_PRIMASK(primask);
+
+  memset(stats->lights, 0, sizeof(stats->lights));
+  stats->scans = window.scans;
+  stats->first_sample = window.first_sample;
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    stats->lights[i].light_id = i + 1;
+    if (window.scans != 0) {
+      ConvertStats(i, ANALOG_INPUT_CURRENT, &window, &stats->lights[i].current);
+      ConvertStats(i, ANALOG_INPUT_TEMPERATURE, &window, &stats->lights[i].temperature);
+    }
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the progress of the raw capture
+  * @param  status: Pointer to store the capture state
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM for a NULL pointer
+  */
+VAL_Status VAL_Analog_GetCaptureStatus(AnalogCaptureStatus* status) {
+  uint32_t primask;
+
+  if (status == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  status->state = capture_state;
+  status->trigger = capture_trigger;
+  status->scans = capture_count;
+  status->scans_wanted = capture_scans;
+  status->trigger_scan = (capture_state == ANALOG_CAPTURE_ARMED) ? capture_count :
+                         (uint16_t)(capture_count - capture_post);
+  status->first_sample = capture_end_sample - capture_count;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Copy recorded scans out of the raw capture
+  * @note   Recorded scans never change until the next capture is started,
+  *         so they can be read while recording continues. A capture with
+  *         scans from before its trigger overwrites them until it is done,
+  *         and reads nothing before.
+  * @param  first_scan: Index of the first scan to copy
+  * @param  max_scans: Largest number of scans to copy
+  * @param  samples: Buffer for max_scans x ANALOG_CHANNEL_COUNT raw samples,
+  *         each scan in channel rank order
+  * @retval uint16_t: Number of scans copied, 0 past the recorded ones
+  */
+uint16_t VAL_Analog_ReadCapture(uint16_t first_scan, uint16_t max_scans, uint16_t* samples) {
+  uint16_t recorded = capture_count;
+  uint16_t slot;
+  uint16_t count;
+  uint16_t part;
+
+  if (samples == NULL || first_scan >= recorded ||
+      (capture_pre_scans != 0 && capture_state != ANALOG_CAPTURE_DONE)) {
+    return 0;
+  }
+
+  count = recorded - first_scan;
+  if (count > max_scans) {
+    count = max_scans;
+  }
+
+  /* Without scans from before the trigger the ring never wraps; with them
+   * it is done, and the oldest scan is the one it would write next */
+  slot = first_scan;
+  if (capture_pre_scans != 0) {
+    slot += (capture_head >= recorded) ? capture_head - recorded : capture_head + capture_scans - recorded;
+  }
+  if (slot >= capture_scans) {
+    slot -= capture_scans;
+  }
+  part = capture_scans - slot;
+  if (part > count) {
+    part = count;
+  }
+  memcpy(samples, capture_buffer[slot], (size_t)part * sizeof(capture_buffer[0]));
+  memcpy(&samples[part * ADC_CHANNEL_COUNT], capture_buffer[0], (size_t)(count - part) * sizeof(capture_buffer[0]));
+
+  return count;
+}
+
+/**
+  * @brief  Register a handler for ADC and DMA errors
+  * @note   The callback runs in interrupt context and must not block. After
+  *         an error sampling stays stopped; the handler should have a task
+  *         call VAL_Analog_Recover.
+  * @param  callback: Callback function or NULL
+  * @retval VAL_Status: VAL_OK if successful
+  */
+VAL_Status VAL_Analog_SetErrorCallback(AnalogErrorCallback callback) {
+  error_callback = callback;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Restart sampling after an ADC or DMA error
+  * @note   Must not be called from interrupt context. Does nothing unless an
+  *         error stopped sampling, so it may also be called periodically.
+  * @retval VAL_Status: VAL_OK if sampling runs, VAL_ERROR otherwise
+  */
+VAL_Status VAL_Analog_Recover(void) {
+  VAL_Status status;
+
+  if (!recovery_pending) {
+    return VAL_OK;
+  }
+
+  /* An error during the restart requests another one */
+  recovery_pending = 0;
+
+  StopSampling();
+  __HAL_ADC_CLEAR_FLAG(&hadc1, (ADC_FLAG_EOC | ADC_FLAG_EOS | ADC_FLAG_OVR));
+  if (hadc1.DMA_Handle != NULL) {
+    __HAL_DMA_CLEAR_FLAG(hadc1.DMA_Handle, (DMA_FLAG_TC1 | DMA_FLAG_HT1 | DMA_FLAG_TE1));
+  }
+
+  status = StartSampling();
+  if (status != VAL_OK) {
+    recovery_pending = 1;
+    return status;
+  }
+
+  error_counts.recoveries++;
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the ADC error counters
+  * @param  counts: Pointer to store the counters since start-up
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM for a NULL pointer
+  */
+VAL_Status VAL_Analog_GetErrorCounts(AnalogErrorCounts* counts) {
+  uint32_t primask;
+
+  if (counts == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  *counts = error_counts;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Enable the hardware over-current watchdogs on the current channels
+  * @note   Each light with a watchdog in the channel table trips at its
+  *         entry in tripMa, converted at the present full scale; call again
+  *         after the resolution or the scale changes. The watchdogs act on individual
+  *         conversions, not on the averaged value. Briefly stops sampling
+  *         while reconfiguring. A tripped watchdog stays silent until re-armed.
+  * @param  callback: Called from the ADC interrupt with the light ID on a trip
+  * @param  tripMa: Trip current in mA per light, VAL_LIGHT_COUNT entries
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  */
+VAL_Status VAL_Analog_EnableCurrentWatchdog(AnalogWatchdogCallback callback, const int32_t* tripMa) {
+  ADC_AnalogWDGConfTypeDef watchdog_config = {0};
+  VAL_Status status = VAL_OK;
+
+  if (tripMa == NULL) {
+    return VAL_PARAM;
+  }
+
+  watchdog_callback = callback;
+
+  /* Watchdogs can only be configured while no conversion is ongoing */
+  StopSampling();
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    const VAL_Channel_t* channel = &VAL_Channels[i];
+
+    if (channel->watchdog < 1 || channel->watchdog > WATCHDOG_COUNT) {
+      continue;
+    }
+
+    /* With oversampling the watchdog compares the 12 MSBs of the 16-bit result */
+    uint32_t threshold = VAL_Analog_CurrentToCounts(i + 1, tripMa[i]);
+    if (hadc1.Init.OversamplingMode == ENABLE) {
+      threshold >>= 4;
+    }
+    if (threshold > ADC_RESOLUTION) {
+      threshold = ADC_RESOLUTION;
+    }
+
+    uint8_t index = channel->watchdog - 1;
+    watchdog_lights[index] = i + 1;
+
+    watchdog_config.WatchdogNumber = watchdog_numbers[index];
+    watchdog_config.WatchdogMode = ADC_ANALOGWATCHDOG_SINGLE_REG;
+    watchdog_config.Channel = channel->current_adc_channel;
+    watchdog_config.ITMode = ENABLE;
+    watchdog_config.HighThreshold = threshold;
+    watchdog_config.LowThreshold = 0;
+
+    __HAL_ADC_CLEAR_FLAG(&hadc1, watchdog_flags[index]);
+    if (HAL_ADC_AnalogWDGConfig(&hadc1, &watchdog_config) != HAL_OK) {
+      status = VAL_ERROR;
+    }
+  }
+
+  if (StartSampling() != VAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Re-arm the over-current watchdog of a light after a trip
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_Analog_RearmCurrentWatchdog(uint8_t lightId) {
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT) {
+    return VAL_PARAM;
+  }
+
+  /* Lights without a watchdog have nothing to re-arm */
+  uint8_t watchdog = VAL_Channels[lightId - 1].watchdog;
+  if (watchdog < 1 || watchdog > WATCHDOG_COUNT) {
+    return VAL_OK;
+  }
+
+  __HAL_ADC_CLEAR_FLAG(&hadc1, watchdog_flags[watchdog - 1]);
+  __HAL_ADC_ENABLE_IT(&hadc1, watchdog_its[watchdog - 1]);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Stop sampling before the ADC loses its clock in stop mode
+  * @note   Readings and alarm inputs keep their last values until resumed
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_Analog_Suspend(void) {
+  StopSampling();
+#if VAL_I2C_TEMP_ENABLED
+  VAL_I2CTemp_Stop();
+#endif
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Restart sampling after VAL_Analog_Suspend
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  */
+VAL_Status VAL_Analog_Resume(void) {
+  __HAL_ADC_CLEAR_FLAG(&hadc1, (ADC_FLAG_EOC | ADC_FLAG_EOS | ADC_FLAG_OVR));
+#if VAL_I2C_TEMP_ENABLED
+  VAL_I2CTemp_Start();
+#endif
+
+  return StartSampling();
+}
+
+/**
+  * @brief  De-initialize the analog module
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  */
+VAL_Status VAL_Analog_DeInit(void) {
+  /* Stop scan trigger and ADC conversion */
+  HAL_TIM_Base_Stop(&htim6);
+  HAL_ADC_Stop_DMA(&hadc1);
+#if VAL_EXT_ADC_CHANNEL_COUNT > 0
+  VAL_ExtAdc_DeInit();
+#endif
+#if VAL_I2C_TEMP_ENABLED
+  VAL_I2CTemp_DeInit();
+#endif
+  
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Get the filtered counts of an ADC channel
+  * @note   Only recomputed after a block changed the channel; the cache is
+  *         written in the same critical section the filter state is read
+  *         in, so a block processed meanwhile is never overwritten
+  * @param  rank: Position of the channel in the scan
+  * @retval uint32_t: Filtered value in (oversampled) ADC counts
+  */
+static uint32_t GetFilteredCounts(uint8_t rank) {
+  uint32_t bit = 1UL << rank;
+  uint32_t counts;
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if ((channel_dirty & bit) == 0U) {
+    counts = filtered_counts[rank];
+  } else {
+    counts = ComputeFilteredCounts(rank);
+    filtered_counts[rank] = counts;
+    channel_dirty &= ~bit;
+  }
+  __set_PRIMASK(primask);
+
+  return counts;
+}
+
+/**
+  * @brief  Compute the filtered counts of an ADC channel
+  * @note   Called with interrupts disabled
+  * @param  rank: Position of the channel in the scan
+  * @retval uint32_t: Filtered value in (oversampled) ADC counts
+  */
+static uint32_t ComputeFilteredCounts(uint8_t rank) {
+  AnalogFilterType type = channel_filters[rank].type;
+  uint32_t sum = scan_sum[rank];
+  uint8_t fill = scan_fill;
+#ifdef ANALOG_USE_FPU
+  uint32_t ema = (uint32_t)(ema_values[rank] * 256.0f + 0.5f);
+#else
+  uint32_t ema = ema_q8[rank];
+#endif
+
+  /* Nothing to report until the first block has been processed */
+  if (fill == 0) {
+    return 0;
+  }
+
+  switch (type) {
+    case ANALOG_FILTER_EMA:
+      return (ema + 0x80U) >> 8;
+    case ANALOG_FILTER_MEDIAN5:
+      return GetMedianCounts(rank);
+    default:
+      return (sum + fill / 2U) / fill;
+  }
+}
+
+/**
+  * @brief  Get the median of the last ANALOG_MEDIAN_TAPS scans of an ADC channel
+  * @note   Until the history is full, the median of the scans taken so far
+  * @param  rank: Position of the channel in the scan
+  * @retval uint32_t: Median value in (oversampled) ADC counts
+  */
+static uint32_t GetMedianCounts(uint8_t rank) {
+  uint16_t values[ANALOG_MEDIAN_TAPS];
+  uint8_t count;
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  count = median_fill;
+  for (uint8_t i = 0; i < count; i++) {
+    values[i] = median_history[i][rank];
+  }
+  __set_PRIMASK(primask);
+
+  if (count == 0) {
+    return 0;
+  }
+
+  /* Insertion sort, at most ANALOG_MEDIAN_TAPS values */
+  for (uint8_t i = 1; i < count; i++) {
+    uint16_t value = values[i];
+    uint8_t j = i;
+    while (j > 0 && values[j - 1] > value) {
+      values[j] = values[j - 1];
+      j--;
+    }
+    values[j] = value;
+  }
+
+  /* Even counts only occur while filling, average the two middle values */
+  return ((uint32_t)values[(count - 1) / 2] + values[count / 2] + 1U) / 2U;
+}
+
+/**
+  * @brief  Get the counts of an ADC channel in the latest scan, unfiltered
+  * @param  rank: Position of the channel in the scan
+  * @retval uint32_t: Latest value in (oversampled) ADC counts
+  */
+static uint32_t GetLatestCounts(uint8_t rank) {
+  return scan_raw[rank];
+}
+
+/**
+  * @brief  Get the temperature counts of a light, corrected for the supply
+  * @note   With I2C sensors, the last reading of the sensor converted to
+  *         counts, filtered or not; 0 while it has none
+  * @param  index: Light index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  latest: The latest scan instead of the filtered value
+  * @retval uint32_t: Value in counts of the nominal ADC_REFERENCE_MV
+  */
+static uint32_t GetTemperatureCounts(uint8_t index, bool latest) {
+#if VAL_I2C_TEMP_ENABLED
+  int32_t temperature_cdeg;
+
+  (void)latest;
+  if (VAL_I2CTemp_GetTemperature(index + 1, &temperature_cdeg) != VAL_OK) {
+    return 0;
+  }
+  return VAL_Analog_TemperatureToCounts(index + 1, temperature_cdeg);
+#else
+  uint8_t rank = VAL_Channels[index].temperature_rank;
+
+  return CorrectSupply(latest ? GetLatestCounts(rank) : GetFilteredCounts(rank));
+#endif
+}
+
+/**
+  * @brief  Correct counts of an external input for the measured supply
+  * @param  counts: Value in (oversampled) ADC counts of the actual VDDA
+  * @retval uint32_t: Value in counts of the nominal ADC_REFERENCE_MV
+  */
+static uint32_t CorrectSupply(uint32_t counts) {
+#ifdef ANALOG_USE_FPU
+  return (uint32_t)((float)counts * supply_ratio + 0.5f);
+#else
+  return (uint32_t)(((uint64_t)counts * supply_ratio_q16 + 0x8000U) >> 16);
+#endif
+}
+
+/**
+  * @brief  Measure the analog supply from the filtered VREFINT reading
+  * @note   Called once per block; keeps the previous value while there is
+  *         no reading or it is out of the operating range
+  * @retval None
+  */
+static void UpdateSupply(void) {
+  uint32_t counts = GetFilteredCounts(ANALOG_RANK_VREFINT);
+
+  if (counts == 0 || vrefint_cal == 0) {
+    return;
+  }
+
+#ifdef ANALOG_USE_FPU
+  /* VDDA = 3.0 V x VREFINT_CAL / reading, both at 12 bits */
+  float vdda_mv = (float)VREFINT_CAL_VREF * vrefint_cal * adc_full_scale / ((float)ADC_RESOLUTION * counts);
+
+  if (vdda_mv < SUPPLY_MIN_MV || vdda_mv > SUPPLY_MAX_MV) {
+    return;
+  }
+
+  supply_mv = (uint32_t)(vdda_mv + 0.5f);
+  supply_ratio = vdda_mv / ADC_REFERENCE_MV;
+#else
+  /* VDDA = 3.0 V x VREFINT_CAL / reading, both at 12 bits */
+  uint64_t reference = (uint64_t)VREFINT_CAL_VREF * vrefint_cal * adc_full_scale;
+  uint32_t mv = (uint32_t)((reference + (uint64_t)ADC_RESOLUTION * counts / 2U) /
+                           ((uint64_t)ADC_RESOLUTION * counts));
+
+  if (mv < SUPPLY_MIN_MV || mv > SUPPLY_MAX_MV) {
+    return;
+  }
+
+  supply_mv = mv;
+  supply_ratio_q16 = (uint32_t)((reference << 16) / ((uint64_t)ADC_RESOLUTION * counts * ADC_REFERENCE_MV));
+#endif
+}
+
+/**
+  * @brief  Scale counts to an engineering value with a Q16 factor
+  * @param  counts: Value in (oversampled) ADC counts
+  * @param  factor_q16: Units per count in Q16
+  * @retval int32_t: Rounded value in the factor's unit
+  */
+static int32_t ScaleCounts(uint32_t counts, uint32_t factor_q16) {
+  uint64_t scaled = (uint64_t)counts * factor_q16;
+  return (int32_t)((scaled + 0x8000U) >> 16);
+}
+
+#ifdef ANALOG_USE_FPU
+/**
+  * @brief  Round to the nearest integer, halves away from zero
+  * @param  value: Value to round
+  * @retval int32_t: Rounded value
+  */
+static int32_t RoundToInt(float value) {
+  return (int32_t)(value + ((value < 0.0f) ? -0.5f : 0.5f));
+}
+#endif
+
+/**
+  * @brief  Convert counts of a current input to milliamps
+  * @param  index: Light index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  counts: Value in (oversampled) ADC counts
+  * @retval int32_t: Calibrated current in milliamps
+  */
+static int32_t CountsToCurrent(uint8_t index, uint32_t counts) {
+  counts = (counts > current_zero_counts[index]) ? counts - current_zero_counts[index] : 0;
+
+#ifdef ANALOG_USE_FPU
+  return RoundToInt((float)counts * current_ma_per_count[index]) + calibrations[index].current_offset_ma;
+#else
+  return ScaleCounts(counts, current_ma_per_count_q16[index]) + calibrations[index].current_offset_ma;
+#endif
+}
+
+/**
+  * @brief  Convert counts of a temperature input through its segment table
+  * @param  index: Light index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  counts: Value in (oversampled) ADC counts
+  * @retval int32_t: Calibrated temperature in centi-degrees
+  */
+static int32_t CountsToTemperature(uint8_t index, uint32_t counts) {
+  uint32_t segment = counts >> segment_shift;
+
+  /* Only past the end while the tables are rebuilt for a higher resolution */
+  if (segment >= CAL_SEGMENTS) {
+    segment = CAL_SEGMENTS - 1U;
+  }
+
+  const TemperatureSegment* entry = &temperature_segments[index][segment];
+  uint32_t offset = counts - (segment << segment_shift);
+
+#ifdef ANALOG_USE_FPU
+  return entry->base + RoundToInt((float)offset * entry->slope);
+#else
+  return entry->base + (int32_t)(((int64_t)offset * entry->slope_q16 + 0x8000) >> 16);
+#endif
+}
+
+/**
+  * @brief  Compute a calibrated temperature exactly, to build the segment table
+  * @param  index: Light index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  counts: Value in (oversampled) ADC counts, may exceed the full scale
+  * @retval int32_t: Temperature in centi-degrees; beyond the table ends its
+  *         first and last pieces are extended
+  */
+static int32_t EvaluateTemperature(uint8_t index, int64_t counts) {
+  const AnalogCalibration* calibration = &calibrations[index];
+  int64_t uv = counts * ADC_REFERENCE_MV * CAL_UV_PER_MV / adc_full_scale;
+  int64_t cdeg;
+
+  if (calibration->point_count < 2) {
+    cdeg = uv * temperature_cdeg_per_mv / CAL_UV_PER_MV;
+  } else {
+    uint8_t i = 0;
+
+    while (i + 2 < calibration->point_count &&
+           uv >= (int64_t)calibration->points[i + 1].mv * CAL_UV_PER_MV) {
+      i++;
+    }
+
+    const AnalogCalPoint* low = &calibration->points[i];
+    const AnalogCalPoint* high = &calibration->points[i + 1];
+    cdeg = low->cdeg + (uv - (int64_t)low->mv * CAL_UV_PER_MV) * (high->cdeg - low->cdeg) /
+                       ((int64_t)(high->mv - low->mv) * CAL_UV_PER_MV);
+  }
+
+  return (int32_t)(cdeg * calibration->temperature_gain / ANALOG_CAL_GAIN_UNITY +
+                   calibration->temperature_offset_cdeg);
+}
+
+/**
+  * @brief  Rebuild the temperature segment table of one light
+  * @note   Each segment is written with interrupts held off, so a reading
+  *         never sees half of one
+  * @param  index: Light index (0 to VAL_LIGHT_COUNT - 1)
+  * @retval None
+  */
+static void UpdateTemperatureTable(uint8_t index) {
+  int32_t start = EvaluateTemperature(index, 0);
+
+  for (uint32_t i = 0; i < CAL_SEGMENTS; i++) {
+    int32_t end = EvaluateTemperature(index, (int64_t)(i + 1U) << segment_shift);
+    int64_t slope = ((int64_t)(end - start) << 16) >> segment_shift;
+    TemperatureSegment segment;
+
+    segment.base = start;
+    segment.slope_q16 = (slope > INT32_MAX) ? INT32_MAX : (int32_t)slope;
+#ifdef ANALOG_USE_FPU
+    segment.slope = (float)(end - start) / (float)(1U << segment_shift);
+#endif
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    temperature_segments[index][i] = segment;
+    conversion_generation++;
+    __set_PRIMASK(primask);
+
+    start = end;
+  }
+}
+
+/**
+  * @brief  Get the scan rank of one input of a light
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @param  input: Current or temperature input
+  * @retval uint8_t: Scan rank, ADC_CHANNEL_COUNT if invalid
+  */
+static uint8_t GetInputRank(uint8_t lightId, AnalogInput input) {
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT) {
+    return ADC_CHANNEL_COUNT;
+  }
+
+  switch (input) {
+    case ANALOG_INPUT_CURRENT:
+      return VAL_Channels[lightId - 1].current_rank;
+    case ANALOG_INPUT_TEMPERATURE:
+      return VAL_Channels[lightId - 1].temperature_rank;
+    default:
+      return ADC_CHANNEL_COUNT;
+  }
+}
+
+/**
+  * @brief  Convert the sensor data of a light, reusing the last conversion
+  * @note   Called with interrupts disabled. Nothing is converted again
+  *         for the blocks already seen; after a new block only the inputs
+  *         that moved by more than the deadband, or all of them after a
+  *         scale or calibration change.
+  * @param  index: Light index (0 to VAL_LIGHT_COUNT - 1)
+  * @retval const ConvertedReading*: Milliamps and centi-degrees of the light
+  */
+static const ConvertedReading* ConvertSensorData(uint8_t index) {
+  ConvertedReading* reading = &converted[index];
+  const VAL_Channel_t* channel = &VAL_Channels[index];
+
+  if (!reading->valid || reading->sequence != sample_count || reading->generation != conversion_generation) {
+    bool stale = !reading->valid || reading->generation != conversion_generation;
+    uint32_t counts[READING_COUNT];
+
+    counts[READING_CURRENT] = CorrectSupply(GetFilteredCounts(channel->current_rank));
+    counts[READING_TEMPERATURE] = GetTemperatureCounts(index, false);
+    counts[READING_CURRENT_RAW] = CorrectSupply(GetLatestCounts(channel->current_rank));
+    counts[READING_TEMPERATURE_RAW] = GetTemperatureCounts(index, true);
+
+    for (uint8_t i = 0; i < READING_COUNT; i++) {
+      uint32_t delta = (counts[i] > reading->counts[i]) ? counts[i] - reading->counts[i] :
+                                                          reading->counts[i] - counts[i];
+      if (!stale && delta <= reconvert_deadband) {
+        continue;
+      }
+
+      reading->counts[i] = counts[i];
+      reading->values[i] = (i == READING_CURRENT || i == READING_CURRENT_RAW) ?
+                           CountsToCurrent(index, counts[i]) : CountsToTemperature(index, counts[i]);
+    }
+
+    reading->sequence = sample_count;
+    reading->generation = conversion_generation;
+    reading->valid = true;
+  }
+
+  return reading;
+}
+
+/**
+  * @brief  Fill in the sensor data of a light from its last conversion
+  * @note   Called with interrupts disabled
+  * @param  index: Light index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  sensorData: Pointer to store the sensor data
+  * @retval None
+  */
+static void FillSensorData(uint8_t index, LightSensorData* sensorData) {
+  const ConvertedReading* reading = ConvertSensorData(index);
+
+  sensorData->light_id = index + 1;
+  sensorData->current = reading->values[READING_CURRENT] * 0.001f;
+  sensorData->temperature = reading->values[READING_TEMPERATURE] * 0.01f;
+  sensorData->current_raw = reading->values[READING_CURRENT_RAW] * 0.001f;
+  sensorData->temperature_raw = reading->values[READING_TEMPERATURE_RAW] * 0.01f;
+}
+
+/**
+  * @brief  Precompute the Q16 current factors and the segment size for the
+  *         current full scale
+  * @note   The temperature tables must be rebuilt afterwards
+  * @retval None
+  */
+static void UpdateScaleFactors(void) {
+  /* Engineering value at ADC full scale */
+  uint32_t current_full_scale_ma = ADC_REFERENCE_MV * current_ma_per_mv;
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    /* Calibrated full scale in 1/ANALOG_CAL_GAIN_UNITY mA */
+    uint64_t full_scale = (uint64_t)current_full_scale_ma * calibrations[i].current_gain;
+    uint64_t counts = (uint64_t)adc_full_scale * ANALOG_CAL_GAIN_UNITY;
+
+    current_ma_per_count_q16[i] = (uint32_t)((full_scale << 16) / counts);
+    counts_per_ma_q16[i] = (uint32_t)((counts << 16) / full_scale);
+#ifdef ANALOG_USE_FPU
+    current_ma_per_count[i] = (float)full_scale / (float)counts;
+#endif
+    current_zero_counts[i] = (uint32_t)(((uint64_t)zero_fraction_q16[i] * adc_full_scale + 0x8000U) >> 16);
+  }
+
+  /* Smallest power-of-two segment that covers the ADC range in CAL_SEGMENTS */
+  segment_shift = 0;
+  while ((adc_full_scale >> segment_shift) >= CAL_SEGMENTS) {
+    segment_shift++;
+  }
+
+  /* Same deadband in volts at every resolution */
+  reconvert_deadband = (RECONVERT_DEADBAND * adc_full_scale + ADC_RESOLUTION / 2U) / ADC_RESOLUTION;
+  conversion_generation++;
+}
+
+/**
+  * @brief  Discard the moving average, median and EMA history
+  * @retval None
+  */
+static void ResetScanAverage(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  memset((void*)scan_sum, 0, sizeof(scan_sum));
+  scan_fill = 0;
+  scan_index = 0;
+  median_fill = 0;
+  median_index = 0;
+  channel_dirty = SCAN_CHANNEL_MASK;
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Reconfigure ADC hardware oversampling
+  * @param  ratio: Oversampling ratio (1 disables oversampling)
+  * @param  shift: Right shift of the accumulated result
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  */
+static VAL_Status ApplyOversampling(uint16_t ratio, uint8_t shift) {
+  VAL_Status status = VAL_OK;
+
+  /* Oversampling can only be changed while no conversion is ongoing */
+  StopSampling();
+
+  if (ratio > 1) {
+    hadc1.Init.OversamplingMode = ENABLE;
+    /* ADC_OVERSAMPLING_RATIO_x encodes log2(ratio) - 1 in the OVSR field */
+    hadc1.Init.Oversampling.Ratio = (uint32_t)(__builtin_ctz(ratio) - 1) << ADC_CFGR2_OVSR_Pos;
+    hadc1.Init.Oversampling.RightBitShift = (uint32_t)shift << ADC_CFGR2_OVSS_Pos;
+    hadc1.Init.Oversampling.TriggeredMode = ADC_TRIGGEREDMODE_SINGLE_TRIGGER;
+    hadc1.Init.Oversampling.OversamplingStopReset = ADC_REGOVERSAMPLING_CONTINUED_MODE;
+  } else {
+    hadc1.Init.OversamplingMode = DISABLE;
+  }
+
+  if (HAL_ADC_Init(&hadc1) != HAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  /* Resume sampling even if reconfiguration failed */
+  if (StartSampling() != VAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Stop the scan trigger and the ADC so it can be reconfigured
+  * @retval None
+  */
+static void StopSampling(void) {
+  HAL_TIM_Base_Stop(&htim6);
+  HAL_ADC_Stop_DMA(&hadc1);
+#if VAL_EXT_ADC_CHANNEL_COUNT > 0
+  VAL_ExtAdc_Stop();
+#endif
+}
+
+/**
+  * @brief  Restart ADC DMA reception and the scan trigger
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  */
+static VAL_Status StartSampling(void) {
+  VAL_Status status = VAL_OK;
+
+  if (HAL_ADC_Start_DMA(&hadc1, (uint32_t*)adc_buffer, ADC_SCAN_BLOCKS * block_scans * ADC_CHANNEL_COUNT) != HAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  /* While synchronized, the triggering timer is already running */
+  if (sync_trigger_hz == 0 && HAL_TIM_Base_Start(&htim6) != HAL_OK) {
+    status = VAL_ERROR;
+  }
+#if VAL_EXT_ADC_CHANNEL_COUNT > 0
+  VAL_ExtAdc_Start(VAL_Analog_GetSampleRate(), block_scans);
+#endif
+
+  return status;
+}
+
+/**
+  * @brief  Change the scan trigger
+  * @param  trigger: ADC external trigger source
+  * @param  edge: Edge of the trigger that starts a scan
+  * @param  trigger_hz: Trigger rate, 0 for TIM6
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR if the ADC could not
+  *         be reconfigured
+  */
+static VAL_Status SyncToTrigger(uint32_t trigger, uint32_t edge, uint32_t trigger_hz) {
+  VAL_Status status = VAL_OK;
+
+  /* The trigger source can only be changed while no conversion is ongoing */
+  StopSampling();
+
+  sync_trigger_hz = trigger_hz;
+  hadc1.Init.ExternalTrigConv = trigger;
+  hadc1.Init.ExternalTrigConvEdge = edge;
+  if (HAL_ADC_Init(&hadc1) != HAL_OK) {
+    status = VAL_ERROR;
+  }
+  UpdateSyncRate();
+
+  /* Resume sampling even if reconfiguration failed */
+  if (StartSampling() != VAL_OK) {
+    status = VAL_ERROR;
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Recompute the scan rate of PWM-synchronous triggering
+  * @note   A scan of VAL_LIGHT_COUNT short current and long temperature
+  *         conversions and the internal channels, each repeated by the
+  *         oversampling ratio, is followed
+  *         by the first trigger after it ends
+  * @retval None
+  */
+static void UpdateSyncRate(void) {
+  uint64_t scan_half_cycles = ((uint64_t)VAL_LIGHT_COUNT * (SCAN_CURRENT_HALF_CYCLES + SCAN_TEMPERATURE_HALF_CYCLES) +
+                               INTERNAL_CHANNEL_COUNT * SCAN_INTERNAL_HALF_CYCLES) * analog_config.oversampling_ratio;
+  uint32_t periods;
+
+  if (sync_trigger_hz == 0) {
+    sync_rate_hz = 0;
+    return;
+  }
+
+  periods = (uint32_t)((scan_half_cycles * sync_trigger_hz) / (2ULL * ADC_CLOCK_HZ)) + 1U;
+  sync_rate_hz = sync_trigger_hz / periods;
+#if VAL_EXT_ADC_CHANNEL_COUNT > 0
+  VAL_ExtAdc_SetSampleRate(sync_rate_hz);
+#endif
+}
+
+/**
+  * @brief  Handle an over-current watchdog trip
+  * @param  watchdog: Watchdog index (0-2)
+  * @retval None
+  */
+VAL_RAMFUNC static void HandleWatchdog(uint8_t watchdog) {
+  /* One notification per trip; the condition usually persists for many scans */
+  __HAL_ADC_DISABLE_IT(&hadc1, watchdog_its[watchdog]);
+
+  if (watchdog_callback != NULL && watchdog_lights[watchdog] != 0) {
+    watchdog_callback(watchdog_lights[watchdog]);
+  }
+}
+
+/**
+  * @brief  Record a completed block into the raw capture, if one is running or armed
+  * @param  samples: First scan of the block
+  * @param  first_sample: Scan count of the first scan
+  * @retval None
+  */
+static void CaptureBlock(const uint16_t* samples, uint32_t first_sample) {
+  uint8_t scan = 0;
+
+  /* Recording starts with the scan that crossed the threshold; scans
+   * before it are only held when some are wanted */
+  if (capture_state == ANALOG_CAPTURE_ARMED) {
+    if (capture_trigger == ANALOG_CAPTURE_EXTERNAL || capture_trigger == ANALOG_CAPTURE_FAULT) {
+      if (capture_pre_scans == 0) {
+        return;
+      }
+      for (; scan < block_scans; scan++) {
+        CaptureScan(&samples[scan * ADC_CHANNEL_COUNT]);
+      }
+      capture_end_sample = first_sample + scan;
+      return;
+    }
+    for (; scan < block_scans; scan++) {
+      uint8_t above = (samples[scan * ADC_CHANNEL_COUNT + capture_rank] >= capture_threshold) ? 1 : 0;
+      uint8_t rising = (capture_trigger == ANALOG_CAPTURE_RISING) ? 1 : 0;
+      uint8_t crossed = capture_primed && above != capture_above && above == rising;
+
+      capture_above = above;
+      capture_primed = 1;
+      if (crossed) {
+        capture_state = ANALOG_CAPTURE_RUNNING;
+        break;
+      }
+      if (capture_pre_scans != 0) {
+        CaptureScan(&samples[scan * ADC_CHANNEL_COUNT]);
+      }
+    }
+  }
+
+  if (capture_state != ANALOG_CAPTURE_RUNNING) {
+    if (capture_pre_scans != 0) {
+      capture_end_sample = first_sample + scan;
+    }
+    return;
+  }
+
+  /* Scans are stored as DMA wrote them */
+  for (; scan < block_scans && capture_post < capture_scans - capture_pre_scans; scan++) {
+    CaptureScan(&samples[scan * ADC_CHANNEL_COUNT]);
+    capture_post++;
+  }
+  capture_end_sample = first_sample + scan;
+  if (capture_post >= capture_scans - capture_pre_scans) {
+    capture_state = ANALOG_CAPTURE_DONE;
+  }
+}
+
+/**
+  * @brief  Store one scan in the raw capture ring
+  * @param  scan: ADC_CHANNEL_COUNT samples in rank order
+  * @retval None
+  */
+static inline void CaptureScan(const uint16_t* scan) {
+  memcpy(capture_buffer[capture_head], scan, sizeof(capture_buffer[0]));
+  capture_head = (capture_head + 1U < capture_scans) ? capture_head + 1U : 0U;
+  if (capture_count < capture_scans) {
+    capture_count++;
+  }
+}
+
+/**
+  * @brief  Start recording an armed capture waiting for a given trigger
+  * @param  trigger: ANALOG_CAPTURE_EXTERNAL or ANALOG_CAPTURE_FAULT
+  * @retval None
+  */
+static void FireCapture(AnalogCaptureTrigger trigger) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if (capture_state == ANALOG_CAPTURE_ARMED && capture_trigger == trigger) {
+    capture_state = ANALOG_CAPTURE_RUNNING;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Add a completed block to the running statistics
+  * @param  samples: First scan of the block
+  * @param  first_sample: Scan count of the first scan
+  * @retval None
+  */
+VAL_RAMFUNC static void AccumulateStats(const uint16_t* samples, uint32_t first_sample) {
+  StatsWindow* window = &stats_live;
+#ifdef ANALOG_USE_SIMD
+  bool dual = (adc_full_scale <= STATS_SIMD_MAX_COUNTS);
+#endif
+
+  for (uint8_t scan = 0; scan < block_scans;) {
+    const uint16_t* scan_samples = &samples[scan * ADC_CHANNEL_COUNT];
+
+    /* A run without a window stops short of overflowing */
+    if (window->scans == UINT32_MAX) {
+      return;
+    }
+    if (window->scans == 0) {
+      window->first_sample = first_sample + scan;
+      for (uint8_t ch = 0; ch < STATS_INPUT_COUNT; ch++) {
+        window->min[ch] = UINT16_MAX;
+        window->max[ch] = 0;
+        window->sum[ch] = 0;
+        window->sum_squares[ch] = 0;
+      }
+    }
+
+#ifdef ANALOG_USE_SIMD
+    /* Two scans at once, unless the window ends after the first */
+    uint32_t room = (stats_window_scans != 0) ? stats_window_scans - window->scans : UINT32_MAX - window->scans;
+    if (dual && scan + 1U < block_scans && room >= 2U) {
+      AccumulateStatsPair(window, scan_samples, scan_samples + ADC_CHANNEL_COUNT);
+      window->scans += 2U;
+      scan += 2U;
+    } else
+#endif
+    {
+      AccumulateStatsScan(window, scan_samples);
+      window->scans++;
+      scan++;
+    }
+
+    if (stats_window_scans != 0 && window->scans >= stats_window_scans) {
+      stats_done = *window;
+      window->scans = 0;
+    }
+  }
+}
+
+/**
+  * @brief  Add one scan to the running statistics
+  * @param  window: Statistics being accumulated, started
+  * @param  scan_samples: Samples of the scan
+  * @retval None
+  */
+VAL_RAMFUNC static void AccumulateStatsScan(StatsWindow* window, const uint16_t* scan_samples) {
+  for (uint8_t ch = 0; ch < STATS_INPUT_COUNT; ch++) {
+    uint16_t value = scan_samples[ch];
+
+    if (value < window->min[ch]) {
+      window->min[ch] = value;
+    }
+    if (value > window->max[ch]) {
+      window->max[ch] = value;
+    }
+    window->sum[ch] += value;
+    window->sum_squares[ch] += (uint32_t)value * value;
+  }
+}
+
+#ifdef ANALOG_USE_SIMD
+_Static_assert((STATS_INPUT_COUNT % 2U) == 0, "Statistics inputs are added in pairs");
+
+/**
+  * @brief  Add two consecutive scans to the running statistics
+  * @note   Samples must be at most STATS_SIMD_MAX_COUNTS. Each word holds
+  *         two adjacent inputs; the Cortex-M4 reads it unaligned if need be.
+  * @param  window: Statistics being accumulated, started
+  * @param  first: Samples of the earlier scan
+  * @param  second: Samples of the later scan
+  * @retval None
+  */
+VAL_RAMFUNC static void AccumulateStatsPair(StatsWindow* window, const uint16_t* first, const uint16_t* second) {
+  for (uint8_t ch = 0; ch < STATS_INPUT_COUNT; ch += 2U) {
+    uint32_t a, b, min, max;
+
+    memcpy(&a, &first[ch], sizeof(a));
+    memcpy(&b, &second[ch], sizeof(b));
+    memcpy(&min, &window->min[ch], sizeof(min));
+    memcpy(&max, &window->max[ch], sizeof(max));
+
+    /* USUB16 sets a GE flag per halfword that is not below, SEL picks by it */
+    (void)__USUB16(min, a);
+    min = __SEL(a, min);
+    (void)__USUB16(min, b);
+    min = __SEL(b, min);
+    (void)__USUB16(a, max);
+    max = __SEL(a, max);
+    (void)__USUB16(b, max);
+    max = __SEL(b, max);
+
+    memcpy(&window->min[ch], &min, sizeof(min));
+    memcpy(&window->max[ch], &max, sizeof(max));
+
+    /* The two scans of each input in one word, summed and squared at once */
+    uint32_t even = __PKHBT(a, b, 16);
+    uint32_t odd = __PKHTB(b, a, 16);
+
+    window->sum[ch] = __SMLALD(even, STATS_SIMD_ONES, window->sum[ch]);
+    window->sum[ch + 1U] = __SMLALD(odd, STATS_SIMD_ONES, window->sum[ch + 1U]);
+    window->sum_squares[ch] = __SMLALD(even, even, window->sum_squares[ch]);
+    window->sum_squares[ch + 1U] = __SMLALD(odd, odd, window->sum_squares[ch + 1U]);
+  }
+}
+#endif
+
+/**
+  * @brief  Convert the statistics of one input to milliamps or centi-degrees
+  * @param  index: Light index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  input: Current or temperature input
+  * @param  window: Statistics in counts, at least one scan
+  * @param  reading: Pointer to store the converted statistics
+  * @retval None
+  */
+static void ConvertStats(uint8_t index, AnalogInput input, const StatsWindow* window,
+                         AnalogStatsReading* reading) {
+  uint8_t rank = GetInputRank(index + 1, input);
+  uint32_t scans = window->scans;
+  uint32_t mean = (uint32_t)((window->sum[rank] + scans / 2U) / scans);
+  uint64_t mean_squares = window->sum_squares[rank] / scans;
+  uint64_t square_of_mean = (uint64_t)mean * mean;
+  uint32_t deviation = (mean_squares > square_of_mean) ? SquareRoot(mean_squares - square_of_mean) : 0;
+
+  reading->min = ConvertStatsCounts(index, input, window->min[rank]);
+  reading->max = ConvertStatsCounts(index, input, window->max[rank]);
+  reading->mean = ConvertStatsCounts(index, input, mean);
+
+  /* RMS^2 = mean^2 + deviation^2, taken after the conversion */
+  int64_t spread = ConvertStatsCounts(index, input, mean + deviation) - reading->mean;
+  int64_t sum = (int64_t)reading->mean * reading->mean + spread * spread;
+  reading->rms = (int32_t)SquareRoot((uint64_t)sum);
+}
+
+/**
+  * @brief  Convert counts of a light input as its readings are converted
+  * @param  index: Light index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  input: Current or temperature input
+  * @param  counts: Raw counts
+  * @retval int32_t: Milliamps or centi-degrees
+  */
+static int32_t ConvertStatsCounts(uint8_t index, AnalogInput input, uint32_t counts) {
+  counts = CorrectSupply(counts);
+
+  return (input == ANALOG_INPUT_CURRENT) ? CountsToCurrent(index, counts) :
+                                           CountsToTemperature(index, counts);
+}
+
+/**
+  * @brief  Integer square root
+  * @param  value: Radicand
+  * @retval uint32_t: Largest integer whose square does not exceed it
+  */
+static uint32_t SquareRoot(uint64_t value) {
+  uint64_t root = 0;
+  uint64_t bit = 1ULL << 62;
+
+  while (bit > value) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  return (uint32_t)root;
+}
+
+/**
+  * @brief  Add a completed block to the zero-current averages
+  * @param  samples: First scan of the block
+  * @retval None
+  */
+VAL_RAMFUNC static void AccumulateZero(const uint16_t* samples) {
+  for (uint8_t scan = 0; scan < block_scans && zero_count < zero_scans; scan++) {
+    const uint16_t* scan_samples = &samples[scan * ADC_CHANNEL_COUNT];
+
+    for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+      zero_sum[i] += scan_samples[VAL_Channels[i].current_rank];
+    }
+    zero_count++;
+  }
+}
+
+/**
+  * @brief  Start the statistics over, after the counts changed meaning
+  * @retval None
+  */
+static void ResetStats(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  stats_live.scans = 0;
+  stats_done.scans = 0;
+  __set_PRIMASK(primask);
+}
+
+#ifdef BENCHMARK
+/**
+  * @brief  Write the synthetic waveform over the input it replaces
+  * @note   DMA is filling the other half, so the block can be written
+  * @param  samples: First scan of the completed block
+  * @param  first_sample: Scan count of the first scan
+  * @retval None
+  */
+VAL_RAMFUNC static void SynthesizeBlock(uint16_t* samples, uint32_t first_sample) {
+  uint64_t now_us = VAL_SysClock_GetMicros64();
+  uint32_t rate_hz = VAL_Analog_GetSampleRate();
+
+  for (uint8_t scan = 0; scan < block_scans; scan++, synth_scans++) {
+    uint16_t* sample = &samples[scan * ADC_CHANNEL_COUNT + synth_rank];
+    uint32_t phase;
+    int32_t value = synth_wave.level;
+
+    /* Real samples up to the edge */
+    if (synth_scans < synth_wave.delay_scans) {
+      synth_from = *sample;
+      continue;
+    }
+    phase = synth_scans - synth_wave.delay_scans;
+
+    /* Scans are evenly spaced and the last one of the block has just completed */
+    if (phase == 0) {
+      synth_edge_sample = first_sample + scan;
+      synth_edge_us = now_us;
+      if (rate_hz != 0) {
+        synth_edge_us -= (uint64_t)(block_scans - 1U - scan) * 1000000U / rate_hz;
+      }
+      synth_block_us = now_us;
+    }
+
+    if (synth_wave.shape == ANALOG_SYNTH_RAMP && phase < synth_wave.length_scans) {
+      value = synth_from + (int32_t)(((int64_t)synth_wave.level - synth_from) * phase / synth_wave.length_scans);
+    } else if (synth_wave.shape == ANALOG_SYNTH_SPIKE) {
+      if (synth_wave.period_scans != 0) {
+        phase %= synth_wave.period_scans;
+      }
+      /* Real samples between spikes */
+      if (phase >= synth_wave.length_scans) {
+        continue;
+      }
+    }
+
+    if (synth_wave.noise != 0) {
+      /* xorshift32 */
+      synth_noise_state ^= synth_noise_state << 13;
+      synth_noise_state ^= synth_noise_state >> 17;
+      synth_noise_state ^= synth_noise_state << 5;
+      value += (int32_t)(synth_noise_state % (2U * synth_wave.noise + 1U)) - synth_wave.noise;
+    }
+
+    if (value < 0) {
+      value = 0;
+    } else if ((uint32_t)value > adc_full_scale) {
+      value = (int32_t)adc_full_scale;
+    }
+    *sample = (uint16_t)value;
+  }
+}
+#endif
+
+/**
+  * @brief  Process one completed block of scans
+  * @param  block: Index of the completed ping-pong half (0 or 1)
+  * @retval None
+  */
+VAL_RAMFUNC static void ProcessScanBlock(uint8_t block) {
+  const uint16_t* samples = (const uint16_t*)&adc_buffer[block * block_scans * ADC_CHANNEL_COUNT];
+  uint32_t start_us = VAL_SysClock_GetMicros();
+  uint32_t first_sample = sample_count;
+  uint32_t changed = 0;
+
+#ifdef BENCHMARK
+  if (synth_active) {
+    SynthesizeBlock((uint16_t*)samples, first_sample);
+  }
+#endif
+
+  for (uint8_t scan = 0; scan < block_scans; scan++) {
+    const uint16_t* scan_samples = &samples[scan * ADC_CHANNEL_COUNT];
+    bool filling = (scan_fill < analog_config.scan_average) || (median_fill < ANALOG_MEDIAN_TAPS);
+
+    /* Update all filters with this scan */
+    for (uint8_t ch = 0; ch < ADC_CHANNEL_COUNT; ch++) {
+      uint16_t value = scan_samples[ch];
+
+      /* A sample equal to the ones it replaces leaves boxcar and median as they were */
+      if (filling || value != scan_history[scan_index][ch] || value != median_history[median_index][ch]) {
+        changed |= 1UL << ch;
+      }
+
+      if (scan_fill >= analog_config.scan_average) {
+        scan_sum[ch] -= scan_history[scan_index][ch];
+      }
+      scan_history[scan_index][ch] = value;
+      scan_sum[ch] += value;
+
+      scan_raw[ch] = value;
+      median_history[median_index][ch] = value;
+
+      /* EMA starts from the first scan after a reset */
+#ifdef ANALOG_USE_FPU
+      if (median_fill == 0) {
+        ema_values[ch] = (float)value;
+      } else {
+        float ema = ema_values[ch] + ((float)value - ema_values[ch]) * ema_weights[ch];
+        if (ema != ema_values[ch]) {
+          changed |= 1UL << ch;
+        }
+        ema_values[ch] = ema;
+      }
+#else
+      if (median_fill == 0) {
+        ema_q8[ch] = (uint32_t)value << 8;
+      } else {
+        int32_t delta = ((int32_t)value << 8) - (int32_t)ema_q8[ch];
+        if ((delta >> channel_filters[ch].ema_shift) != 0) {
+          changed |= 1UL << ch;
+        }
+        ema_q8[ch] = (uint32_t)((int32_t)ema_q8[ch] + (delta >> channel_filters[ch].ema_shift));
+      }
+#endif
+    }
+    if (scan_fill < analog_config.scan_average) {
+      scan_fill++;
+    }
+    scan_index = (scan_index + 1) % analog_config.scan_average;
+    if (median_fill < ANALOG_MEDIAN_TAPS) {
+      median_fill++;
+    }
+    median_index = (median_index + 1) % ANALOG_MEDIAN_TAPS;
+  }
+
+  sample_count += block_scans;
+  sample_micros = VAL_SysClock_GetMicros();
+  channel_dirty |= changed;
+
+  /* Before the consumers, so alarms see the supply of this block */
+  UpdateSupply();
+
+  if (capture_state == ANALOG_CAPTURE_ARMED || capture_state == ANALOG_CAPTURE_RUNNING) {
+    CaptureBlock(samples, first_sample);
+  }
+  AccumulateStats(samples, first_sample);
+  if (zero_count < zero_scans) {
+    AccumulateZero(samples);
+  }
+
+  /* Hand the whole block to the batch consumer */
+  if (block_callback != NULL) {
+    AnalogSampleBlock sample_block = {first_sample, block_scans, samples, start_us};
+    block_callback(&sample_block);
+  }
+
+  /* Signal fresh samples, at most once per configured interval */
+  if (sample_callback != NULL) {
+    uint32_t now = HAL_GetTick();
+    if ((now - last_sample_tick) >= sample_interval_ms) {
+      last_sample_tick = now;
+      sample_callback();
+    }
+  }
+}
+
+/**
+  * @brief  ADC conversion half complete callback, first block is ready
+  * @param  hadc: ADC handle
+  * @retval None
+  */
+VAL_RAMFUNC void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc) {
+  ProcessScanBlock(0);
+}
+
+/**
+  * @brief  ADC conversion complete callback, second block is ready
+  * @param  hadc: ADC handle
+  * @retval None
+  */
+VAL_RAMFUNC void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) {
+  ProcessScanBlock(1);
+}
+
+/**
+  * @brief  Analog watchdog 1 callback, current channel assigned to it
+  * @param  hadc: ADC handle
+  * @retval None
+  */
+VAL_RAMFUNC void HAL_ADC_LevelOutOfWindowCallback(ADC_HandleTypeDef* hadc) {
+  HandleWatchdog(0);
+}
+
+/**
+  * @brief  Analog watchdog 2 callback, current channel assigned to it
+  * @param  hadc: ADC handle
+  * @retval None
+  */
+VAL_RAMFUNC void HAL_ADCEx_LevelOutOfWindow2Callback(ADC_HandleTypeDef* hadc) {
+  HandleWatchdog(1);
+}
+
+/**
+  * @brief  Analog watchdog 3 callback, current channel assigned to it
+  * @param  hadc: ADC handle
+  * @retval None
+  */
+VAL_RAMFUNC void HAL_ADCEx_LevelOutOfWindow3Callback(ADC_HandleTypeDef* hadc) {
+  HandleWatchdog(2);
+}
+
+/**
+  * @brief  ADC error callback
+  * @note   Only counts the error and stops the scan trigger; sampling is
+  *         restarted from task context by VAL_Analog_Recover
+  * @param  hadc: ADC handle
+  * @retval None
+  */
+void HAL_ADC_ErrorCallback(ADC_HandleTypeDef* hadc) {
+  uint32_t error = HAL_ADC_GetError(hadc);
+
+  if (error & HAL_ADC_ERROR_OVR) {
+    error_counts.overrun++;
+  }
+  if (error & HAL_ADC_ERROR_DMA) {
+    error_counts.dma++;
+  }
+  if (error & HAL_ADC_ERROR_INTERNAL) {
+    error_counts.internal++;
+  }
+  if ((error & ~(HAL_ADC_ERROR_OVR | HAL_ADC_ERROR_DMA | HAL_ADC_ERROR_INTERNAL)) != 0 || error == 0) {
+    error_counts.other++;
+  }
+
+  /* No more scan triggers; the restart is left to VAL_Analog_Recover */
+  HAL_TIM_Base_Stop(&htim6);
+  recovery_pending = 1;
+
+  if (error_callback != NULL) {
+    error_callback(error, 0);
+  }
+}
+
+/**
+  * @brief  DMA error callback
+  * @param  hdma: DMA handle
+  * @retval None
+  */
+void HAL_DMA_ErrorCallback(DMA_HandleTypeDef *hdma) {
+  if (error_callback != NULL) {
+    error_callback(0, HAL_DMA_GetError(hdma));
+  }
 }
@@ -0,0 +1,97 @@
+/**
+  ******************************************************************************
+  * @file    val_channels.c
+  * @brief   Board description of the light channels
+  ******************************************************************************
+  * @attention
+  *
+  * The channel table is expanded from the board profile (val_board.h), one
+  * entry per VAL_BOARD_LIGHTS entry. The ranks follow the regular sequence
+  * adc.c builds from the same list: all current inputs first, then all
+  * temperature inputs. What the profile must respect is checked here at
+  * compile time: lights on TIM1 on the channel of their ID, since fades
+  * write CCR1 onwards in a single DMA burst, and CH4 left for the ADC
+  * trigger; lights on TIM15 and TIM16 on an output of theirs, each output
+  * used once, and TIM2 left to the cue timer (val_timers.c); ADC watchdogs
+  * 1-3 and comparators only on the pins they reach (see val_comparator.c);
+  * limits in order and within the ADC range.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_channels.h"
+#include "val_pwm_curves.h"
+#include "stm32l4xx_hal.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Position of each light in the profile, by colour */
+#define CHANNEL_INDEX(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, temp_pin, \
+                      awd, comp, cie_x, cie_y, lumens, curve) CHANNEL_INDEX_##name,
+enum {
+  VAL_BOARD_LIGHTS(CHANNEL_INDEX)
+  CHANNEL_COUNT
+};
+
+/* Private define ------------------------------------------------------------*/
+#define CHANNEL_CHECK(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, temp_pin, \
+                      awd, comp, cie_x, cie_y, lumens, curve) \
+  _Static_assert((tim) == 1 || (tim) == 15 || (tim) == 16, \
+                 #name ": lights run on TIM1, TIM15 or TIM16; TIM2 is the cue timer"); \
+  _Static_assert((tim) != 1 || ((tim_channel) == TIM_CHANNEL_1 + 4U * CHANNEL_INDEX_##name && \
+                                (pwm_pin) == (GPIO_PIN_8 << CHANNEL_INDEX_##name)), \
+                 #name ": TIM1 channels must be consecutive from CH1 (PA8)"); \
+  _Static_assert((tim) != 15 || ((tim_channel) == TIM_CHANNEL_1 && (pwm_pin) == GPIO_PIN_2) || \
+                 ((tim_channel) == TIM_CHANNEL_2 && (pwm_pin) == GPIO_PIN_3), \
+                 #name ": TIM15 outputs are CH1 on PA2 and CH2 on PA3"); \
+  _Static_assert((tim) != 16 || ((tim_channel) == TIM_CHANNEL_1 && (pwm_pin) == GPIO_PIN_6), \
+                 #name ": the TIM16 output is CH1 on PA6"); \
+  _Static_assert((awd) <= 3, #name ": the ADC has analog watchdogs 1-3"); \
+  _Static_assert((comp) == 0 || ((comp) == 1 && (current_pin) == GPIO_PIN_1) || \
+                 ((comp) == 2 && (current_pin) == GPIO_PIN_3), \
+                 #name ": COMP1 only reaches PA1 and COMP2 PA3"); \
+  _Static_assert((cie_x) + (cie_y) <= 10000, #name ": chromaticity outside the diagram");
+
+/* Ranks as in adc.c; VAL_LIGHT_COUNT does not expand inside the list */
+#define CHANNEL_ENTRY(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, temp_pin, \
+                      awd, comp, cie_x, cie_y, lumens, curve) \
+  { \
+    .colour = #name, \
+    .pwm_timer = (tim), \
+    .pwm_channel = (tim_channel), \
+    .pwm_trailing = (trailing), \
+    .current_rank = CHANNEL_INDEX_##name, \
+    .temperature_rank = CHANNEL_COUNT + CHANNEL_INDEX_##name, \
+    .current_adc_channel = (current_input), \
+    .watchdog = (awd), \
+    .comparator = (comp), \
+    .current_warn_ma = VAL_BOARD_CURRENT_WARN_MA, \
+    .current_max_ma = VAL_BOARD_CURRENT_MAX_MA, \
+    .current_trip_ma = VAL_BOARD_CURRENT_TRIP_MA, \
+    .temperature_warn_cdeg = VAL_BOARD_TEMP_WARN_CDEG, \
+    .temperature_max_cdeg = VAL_BOARD_TEMP_MAX_CDEG, \
+    .slew_permille_per_ms = VAL_BOARD_SLEW_PERMILLE_PER_MS, \
+    .chroma_x = (cie_x), \
+    .chroma_y = (cie_y), \
+    .flux_lm = (lumens), \
+    .gamma_table = (curve) \
+  },
+
+_Static_assert(CHANNEL_COUNT == VAL_LIGHT_COUNT, "Light count out of step with the profile");
+_Static_assert(VAL_LIGHT_COUNT >= 1 && VAL_LIGHT_COUNT <= 3, "TIM1 drives up to three lights, CH4 triggers the ADC");
+_Static_assert(2 * VAL_LIGHT_COUNT + 2 <= 16, "The regular ADC sequence has 16 ranks");
+_Static_assert(VAL_BOARD_CURRENT_WARN_MA < VAL_BOARD_CURRENT_MAX_MA &&
+               VAL_BOARD_CURRENT_MAX_MA < VAL_BOARD_CURRENT_TRIP_MA, "Current limits out of order");
+_Static_assert(VAL_BOARD_CURRENT_TRIP_COUNTS < VAL_BOARD_ADC_FULL_SCALE, "Hardware cutoff beyond the ADC range");
+_Static_assert(VAL_BOARD_TEMP_WARN_CDEG < VAL_BOARD_TEMP_MAX_CDEG, "Temperature limits out of order");
+_Static_assert(VAL_BOARD_TEMP_MAX_COUNTS < VAL_BOARD_ADC_FULL_SCALE, "Temperature limit beyond the ADC range");
+_Static_assert(VAL_BOARD_SUPPLY_CURRENT_MAX_MA >= VAL_BOARD_CURRENT_MAX_MA, "Supply cannot carry one light at its limit");
+_Static_assert((VAL_BOARD_PWM_PINS & VAL_BOARD_ANALOG_PINS) == 0U, "A pin is both a PWM output and an analog input");
+_Static_assert((0U VAL_BOARD_LIGHTS(VAL_BOARD_PWM_PIN_SUM)) == VAL_BOARD_PWM_PINS, "Two lights share a PWM output");
+
+VAL_BOARD_LIGHTS(CHANNEL_CHECK)
+
+/* Exported variables --------------------------------------------------------*/
+const VAL_Channel_t VAL_Channels[VAL_LIGHT_COUNT] = {
+  VAL_BOARD_LIGHTS(CHANNEL_ENTRY)
+};
@@ -0,0 +1,239 @@
+/**
+  ******************************************************************************
+  * @file    val_comparator.c
+  * @brief   Vendor Abstraction Layer for the comparator over-current trip
+  ******************************************************************************
+  * @attention
+  *
+  * COMP1 and COMP2 watch the current sense inputs of the lights with a
+  * comparator in the channel table and drive the TIM1 break input: above
+  * the trip level the outputs go low in hardware, within the break filter
+  * time, without waiting for a conversion or an interrupt. The ADC
+  * watchdogs only see a light once per scan, the comparators all the time.
+  *
+  * Each comparator compares its pin against a DAC channel in internal mode,
+  * so the DAC pins (PA4, PA5) stay free for the ADC. The DAC and the ADC
+  * use the same reference, so a trip level is the 12-bit ADC count of the
+  * trip current:
+  *
+  *   COMP1  PA1 (IO3)  against DAC channel 1
+  *   COMP2  PA3 (IO3)  against DAC channel 2
+  *
+  * The L432 has no comparator on PA4, so a light there is guarded by its
+  * ADC watchdog only.
+  *
+  * The break clears MOE and so stops all outputs, not only the one that
+  * tripped. The rising edge of a comparator output also raises an EXTI
+  * interrupt at the safety level, which names the light, so the caller
+  * can turn that one off and restart the others with VAL_PWM_RecoverBreak.
+  * A tripped comparator stays silent until re-armed, as the watchdogs.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_comparator.h"
+#include "val_analog.h"
+#include "val_channels.h"
+#include "val_pwm.h"
+#include "val_sections.h"
+#include "val_sys_clock.h"
+#include "val_irq_priority.h"
+#include "stm32l4xx_hal.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Private define ------------------------------------------------------------*/
+#define COMPARATOR_COUNT       2U      /* COMP1-2 */
+#define COMPARATOR_DAC_MAX     0x0FFFU /* 12-bit DAC */
+#define COMPARATOR_STARTUP_US  10U     /* Comparator start-up and DAC settling */
+#define COMPARATOR_PRIORITY    VAL_IRQ_PRIORITY_SAFETY
+
+/* Medium hysteresis, high-speed mode, non-inverted output */
+#define COMPARATOR_CSR_COMMON  (COMP_CSR_HYST_1 | COMP_CSR_EN)
+
+/* DAC channels in normal mode, buffer off, connected to on-chip peripherals only */
+#define COMPARATOR_DAC_MODE    ((3U << DAC_MCR_MODE1_Pos) | (3U << DAC_MCR_MODE2_Pos))
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  COMP_TypeDef* comp;
+  uint32_t inputs;                  /* INPSEL and INMSEL of the CSR */
+  uint32_t exti_line;               /* EXTI line of the comparator output */
+} Comparator_t;
+
+/* Private variables ---------------------------------------------------------*/
+/* Indexed by comparator number - 1 */
+static const Comparator_t comparators[COMPARATOR_COUNT] = {
+  { COMP1, COMP_CSR_INPSEL_1 | COMP_CSR_INMSEL_2, EXTI_IMR1_IM21 },
+  { COMP2, COMP_CSR_INPSEL_1 | COMP_CSR_INMSEL_2 | COMP_CSR_INMSEL_0, EXTI_IMR1_IM22 }
+};
+
+static VAL_ComparatorCallback trip_callback = NULL;
+static uint8_t comparator_lights[COMPARATOR_COUNT];  /* Light ID per comparator, 0 if unused */
+static bool started = false;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Comparator_Start(void);
+static void Comparator_SetLevel(uint8_t index, uint32_t level);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Enable the comparator over-current trip on the current inputs
+  * @note   Each light with a comparator in the channel table trips at its
+  *         entry in tripMa, converted at the present full scale; call again
+  *         after the scale or the calibration changes. Task context only.
+  *         The comparators are re-armed and connected to the TIM1 break.
+  * @param  callback: Called from the comparator interrupt with the light ID on a trip
+  * @param  tripMa: Trip current in mA per light, VAL_LIGHT_COUNT entries
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_Comparator_Enable(VAL_ComparatorCallback callback, const int32_t* tripMa) {
+  uint32_t full_scale = VAL_Analog_GetFullScaleCounts();
+  uint8_t sources = 0;
+
+  if (tripMa == NULL || full_scale == 0) {
+    return VAL_PARAM;
+  }
+
+  trip_callback = callback;
+
+  /* The comparators sit behind the SYSCFG clock */
+  if (!started) {
+    __HAL_RCC_SYSCFG_CLK_ENABLE();
+    __HAL_RCC_DAC1_CLK_ENABLE();
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    uint8_t comparator = VAL_Channels[i].comparator;
+
+    if (comparator < 1 || comparator > COMPARATOR_COUNT) {
+      continue;
+    }
+
+    /* The DAC compares at 12 bits whatever the ADC resolution */
+    uint64_t counts = VAL_Analog_CurrentToCounts(i + 1, tripMa[i]);
+    uint32_t level = (uint32_t)((counts * COMPARATOR_DAC_MAX + full_scale / 2U) / full_scale);
+    if (level > COMPARATOR_DAC_MAX) {
+      level = COMPARATOR_DAC_MAX;
+    }
+
+    uint8_t index = comparator - 1;
+    comparator_lights[index] = i + 1;
+    Comparator_SetLevel(index, level);
+    comparators[index].comp->CSR = comparators[index].inputs | COMPARATOR_CSR_COMMON;
+    sources |= 1U << index;
+  }
+
+  if (!started) {
+    Comparator_Start();
+  }
+
+  for (uint8_t i = 0; i < COMPARATOR_COUNT; i++) {
+    if (comparator_lights[i] != 0) {
+      VAL_Comparator_Rearm(comparator_lights[i]);
+    }
+  }
+
+  return VAL_PWM_SetBreakSources(sources);
+}
+
+/**
+  * @brief  Re-arm the comparator trip interrupt of a light
+  * @note   Safe to call from interrupts. The break itself acts whenever the
+  *         comparator output is high, armed or not.
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_Comparator_Rearm(uint8_t lightId) {
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT) {
+    return VAL_PARAM;
+  }
+
+  /* Lights without a comparator have nothing to re-arm */
+  uint8_t comparator = VAL_Channels[lightId - 1].comparator;
+  if (comparator < 1 || comparator > COMPARATOR_COUNT || !started) {
+    return VAL_OK;
+  }
+
+  uint32_t line = comparators[comparator - 1].exti_line;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  EXTI->PR1 = line;
+  EXTI->IMR1 |= line;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Handle the comparator interrupt, a rising comparator output
+  * @note   Call from COMP_IRQHandler
+  * @retval None
+  */
+VAL_RAMFUNC void VAL_Comparator_IRQHandler(void) {
+  for (uint8_t i = 0; i < COMPARATOR_COUNT; i++) {
+    uint32_t line = comparators[i].exti_line;
+
+    if ((EXTI->PR1 & line) == 0U) {
+      continue;
+    }
+
+    /* Silent until re-armed */
+    EXTI->IMR1 &= ~line;
+    EXTI->PR1 = line;
+
+    if (trip_callback != NULL && comparator_lights[i] != 0) {
+      trip_callback(comparator_lights[i]);
+    }
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Start the DAC and the comparator interrupt
+  * @note   The comparators are configured before; waits for them to settle,
+  *         so the break is not connected to a starting output
+  * @retval None
+  */
+static void Comparator_Start(void) {
+  /* The mode can only be written with both channels disabled */
+  DAC1->MCR = (DAC1->MCR & ~(DAC_MCR_MODE1 | DAC_MCR_MODE2)) | COMPARATOR_DAC_MODE;
+  DAC1->CR |= DAC_CR_EN1 | DAC_CR_EN2;
+
+  uint32_t start = VAL_SysClock_GetMicros();
+  while ((VAL_SysClock_GetMicros() - start) < COMPARATOR_STARTUP_US) {
+  }
+
+  /* Rising edges only, a falling output needs no action */
+  for (uint8_t i = 0; i < COMPARATOR_COUNT; i++) {
+    uint32_t line = comparators[i].exti_line;
+
+    EXTI->IMR1 &= ~line;
+    EXTI->FTSR1 &= ~line;
+    EXTI->RTSR1 |= line;
+    EXTI->PR1 = line;
+  }
+
+  HAL_NVIC_SetPriority(COMP_IRQn, COMPARATOR_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(COMP_IRQn);
+
+  started = true;
+}
+
+/**
+  * @brief  Write the trip level of a comparator
+  * @param  index: Comparator number - 1
+  * @param  level: 12-bit DAC value
+  * @retval None
+  */
+static void Comparator_SetLevel(uint8_t index, uint32_t level) {
+  /* Software trigger is off: the output follows the holding register */
+  if (index == 0) {
+    DAC1->DHR12R1 = level;
+  } else {
+    DAC1->DHR12R2 = level;
+  }
+}
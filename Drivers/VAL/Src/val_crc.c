@@ -0,0 +1,375 @@
+/**
+  ******************************************************************************
+  * @file    val_crc.c
+  * @brief   Vendor Abstraction Layer for the CRC calculation unit
+  ******************************************************************************
+  * @attention
+  *
+  * The CRC unit is programmed for each computation, so one unit serves all
+  * checks in use: the CRC16-CCITT of the binary frames (16-bit polynomial,
+  * input and output as written), the zlib CRC-32 of firmware images (bits
+  * reversed by byte on input and over the whole result, final inversion in
+  * software) and the CRC-16 of Modbus RTU frames (16-bit polynomial,
+  * reflected as the CRC-32, no inversion). The CPU writes whole words,
+  * byte-swapped so the unit takes the bytes in memory order, then the last
+  * bytes one at a time; a word costs four AHB cycles, against a software
+  * loop of eight shifts per byte.
+  *
+  * Any task or interrupt may compute a CRC. Whoever finds the unit taken
+  * by another computation it preempted, or by a DMA run, computes in
+  * software instead and gets the same value, so no interrupt is masked
+  * for longer than it takes to claim the unit.
+  *
+  * A long region can also be checked in parts, each VAL_Crc_Extend call
+  * carrying on from the CRC of the bytes before: the unit starts from that
+  * value instead of the initial one, so no part holds it for long.
+  *
+  * Large blocks can be handed to DMA2 channel 1 instead, a memory to memory
+  * transfer into the data register one byte at a time, so the block needs
+  * no alignment and flash or RAM both work. That is no faster than the CPU
+  * loop but leaves the CPU to other work; the caller polls for the result.
+  * Channel 2 of DMA2 belongs to val_dma.c, which also clocks the controller.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_crc.h"
+#include "stm32l4xx_hal.h"
+#include <stdbool.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define CRC_DMA                 DMA2_Channel1
+#define CRC_DMA_MAX_BYTES       0xFFFFU       /* CNDTR is 16 bits, longer blocks run in parts */
+#define CRC32_POLY_REFLECTED    0xEDB88320U   /* VAL_CRC32_POLY with its bits reversed */
+#define CRC16_MODBUS_POLY_REFLECTED 0xA001U   /* VAL_CRC16_MODBUS_POLY with its bits reversed */
+
+/* Private types -------------------------------------------------------------*/
+typedef enum {
+  CRC_OWNER_NONE = 0,
+  CRC_OWNER_CPU,
+  CRC_OWNER_DMA
+} Crc_Owner_t;
+
+/* Private variables ---------------------------------------------------------*/
+static volatile Crc_Owner_t owner = CRC_OWNER_NONE;
+
+/* DMA run in progress, owner CRC_OWNER_DMA */
+static VAL_Crc_Type_t dma_type;
+static const uint8_t* dma_next;   /* First byte of the next part */
+static size_t dma_left;           /* Bytes not handed to the DMA yet */
+
+/* Private function prototypes -----------------------------------------------*/
+static bool Crc_Claim(Crc_Owner_t who);
+static uint32_t Crc_Initial(VAL_Crc_Type_t type);
+static uint32_t Crc_Run(VAL_Crc_Type_t type, uint32_t crc, const uint8_t* bytes, size_t length);
+static uint32_t Crc_Software(VAL_Crc_Type_t type, uint32_t crc, const uint8_t* bytes, size_t length);
+static void Crc_Configure(VAL_Crc_Type_t type, uint32_t crc);
+static uint32_t Crc_Result(VAL_Crc_Type_t type);
+static void Crc_StartDmaPart(void);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Clock the CRC unit and the DMA controller that can feed it
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_Crc_Init(void) {
+  __HAL_RCC_CRC_CLK_ENABLE();
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  CRC_DMA->CCR = 0;
+  DMA2->IFCR = DMA_IFCR_CGIF1;
+  owner = CRC_OWNER_NONE;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Compute the CRC of a buffer on the CPU
+  * @note   Uses the CRC unit if it is free, the software loop otherwise;
+  *         both give the same value. Any context.
+  * @param  type: CRC to compute
+  * @param  data: Bytes, in RAM or flash
+  * @param  length: Number of bytes
+  * @retval uint32_t: CRC, 16-bit ones in the low half
+  */
+uint32_t VAL_Crc_Compute(VAL_Crc_Type_t type, const void* data, size_t length) {
+  if (type >= VAL_CRC_TYPE_COUNT || (data == NULL && length > 0)) {
+    return 0;
+  }
+
+  return Crc_Run(type, Crc_Initial(type), (const uint8_t*)data, length);
+}
+
+/**
+  * @brief  Carry a CRC on over the bytes that follow
+  * @note   As VAL_Crc_Compute, which gives the CRC of the first part
+  * @param  type: CRC to compute
+  * @param  crc: CRC of the bytes before, from VAL_Crc_Compute or VAL_Crc_Extend
+  * @param  data: Bytes that follow, in RAM or flash
+  * @param  length: Number of bytes
+  * @retval uint32_t: CRC of all the bytes so far, 16-bit ones in the low half
+  */
+uint32_t VAL_Crc_Extend(VAL_Crc_Type_t type, uint32_t crc, const void* data, size_t length) {
+  if (type >= VAL_CRC_TYPE_COUNT || (data == NULL && length > 0)) {
+    return 0;
+  }
+
+  return Crc_Run(type, crc, (const uint8_t*)data, length);
+}
+
+/**
+  * @brief  Compute the CRC of a buffer in software
+  * @note   The reference the unit is checked against, and its stand-in
+  *         while it is taken
+  * @param  type: CRC to compute
+  * @param  data: Bytes, in RAM or flash
+  * @param  length: Number of bytes
+  * @retval uint32_t: CRC, 16-bit ones in the low half
+  */
+uint32_t VAL_Crc_ComputeSoftware(VAL_Crc_Type_t type, const void* data, size_t length) {
+  if (type >= VAL_CRC_TYPE_COUNT) {
+    return 0;
+  }
+
+  return Crc_Software(type, Crc_Initial(type), (const uint8_t*)data, length);
+}
+
+/**
+  * @brief  Start computing the CRC of a block by DMA
+  * @note   Poll with VAL_Crc_PollDma from the same caller until it is done.
+  *         The block must stay unchanged until then. Meanwhile
+  *         VAL_Crc_Compute runs in software.
+  * @param  type: CRC to compute
+  * @param  data: Bytes, in RAM or flash, any alignment
+  * @param  length: Number of bytes, at least 1
+  * @retval VAL_Status: VAL_OK if started, VAL_BUSY if the unit is in use,
+  *         VAL_PARAM if invalid
+  */
+VAL_Status VAL_Crc_StartDma(VAL_Crc_Type_t type, const void* data, size_t length) {
+  if (type >= VAL_CRC_TYPE_COUNT || data == NULL || length == 0) {
+    return VAL_PARAM;
+  }
+
+  if (!Crc_Claim(CRC_OWNER_DMA)) {
+    return VAL_BUSY;
+  }
+
+  Crc_Configure(type, Crc_Initial(type));
+  dma_type = type;
+  dma_next = (const uint8_t*)data;
+  dma_left = length;
+  Crc_StartDmaPart();
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Check on the DMA run started by VAL_Crc_StartDma
+  * @param  crc: Pointer to store the CRC once done, 16-bit ones in the low half
+  * @retval VAL_Status: VAL_OK once done, VAL_BUSY while running, VAL_ERROR
+  *         if no run was started or the transfer failed; the unit is free
+  *         again after VAL_OK or VAL_ERROR
+  */
+VAL_Status VAL_Crc_PollDma(uint32_t* crc) {
+  uint32_t flags;
+
+  if (owner != CRC_OWNER_DMA) {
+    return VAL_ERROR;
+  }
+
+  flags = DMA2->ISR;
+  if (flags & DMA_ISR_TEIF1) {
+    CRC_DMA->CCR = 0;
+    DMA2->IFCR = DMA_IFCR_CGIF1;
+    owner = CRC_OWNER_NONE;
+    return VAL_ERROR;
+  }
+  if ((flags & DMA_ISR_TCIF1) == 0U) {
+    return VAL_BUSY;
+  }
+
+  if (dma_left > 0U) {
+    Crc_StartDmaPart();
+    return VAL_BUSY;
+  }
+
+  CRC_DMA->CCR = 0;
+  DMA2->IFCR = DMA_IFCR_CGIF1;
+  if (crc != NULL) {
+    *crc = Crc_Result(dma_type);
+  }
+  owner = CRC_OWNER_NONE;
+
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Take the CRC unit if nothing else has it
+  * @param  who: CRC_OWNER_CPU or CRC_OWNER_DMA
+  * @retval bool: true if taken
+  */
+static bool Crc_Claim(Crc_Owner_t who) {
+  bool claimed = false;
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if (owner == CRC_OWNER_NONE) {
+    owner = who;
+    claimed = true;
+  }
+  __set_PRIMASK(primask);
+
+  return claimed;
+}
+
+/**
+  * @brief  Get the CRC of no bytes, the value a computation starts from
+  * @param  type: CRC to compute
+  * @retval uint32_t: CRC as returned, 16-bit ones in the low half
+  */
+static uint32_t Crc_Initial(VAL_Crc_Type_t type) {
+  /* The CRC-32 is inverted on the way out */
+  return (type == VAL_CRC_32) ? (VAL_CRC32_INIT ^ 0xFFFFFFFFU) : VAL_CRC16_INIT;
+}
+
+/**
+  * @brief  Carry a CRC on over a buffer, on the unit if it is free
+  * @param  type: CRC to compute
+  * @param  crc: CRC of the bytes before
+  * @param  bytes: Bytes that follow
+  * @param  length: Number of bytes
+  * @retval uint32_t: CRC, 16-bit ones in the low half
+  */
+static uint32_t Crc_Run(VAL_Crc_Type_t type, uint32_t crc, const uint8_t* bytes, size_t length) {
+  if (!Crc_Claim(CRC_OWNER_CPU)) {
+    return Crc_Software(type, crc, bytes, length);
+  }
+
+  Crc_Configure(type, crc);
+
+  /* Byte-swapped words: the unit shifts a word in from its top bit */
+  for (; length >= 4U; length -= 4U, bytes += 4U) {
+    uint32_t word;
+
+    memcpy(&word, bytes, sizeof(word));
+    CRC->DR = __REV(word);
+  }
+  for (; length > 0U; length--) {
+    *(volatile uint8_t*)&CRC->DR = *bytes++;
+  }
+
+  crc = Crc_Result(type);
+  owner = CRC_OWNER_NONE;
+
+  return crc;
+}
+
+/**
+  * @brief  Carry a CRC on over a buffer in software
+  * @param  type: CRC to compute
+  * @param  crc: CRC of the bytes before
+  * @param  bytes: Bytes that follow
+  * @param  length: Number of bytes
+  * @retval uint32_t: CRC, 16-bit ones in the low half
+  */
+static uint32_t Crc_Software(VAL_Crc_Type_t type, uint32_t crc, const uint8_t* bytes, size_t length) {
+  if (type == VAL_CRC_16_CCITT) {
+    uint16_t state = (uint16_t)crc;
+
+    for (size_t i = 0; i < length; i++) {
+      state ^= (uint16_t)bytes[i] << 8;
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        state = (state & 0x8000U) ? (uint16_t)((state << 1) ^ VAL_CRC16_POLY) : (uint16_t)(state << 1);
+      }
+    }
+    return state;
+  }
+
+  if (type == VAL_CRC_32) {
+    uint32_t state = crc ^ 0xFFFFFFFFU;
+
+    for (size_t i = 0; i < length; i++) {
+      state ^= bytes[i];
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        state = (state & 1U) ? ((state >> 1) ^ CRC32_POLY_REFLECTED) : (state >> 1);
+      }
+    }
+    return state ^ 0xFFFFFFFFU;
+  }
+
+  if (type == VAL_CRC_16_MODBUS) {
+    uint16_t state = (uint16_t)crc;
+
+    for (size_t i = 0; i < length; i++) {
+      state ^= bytes[i];
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        state = (state & 1U) ? (uint16_t)((state >> 1) ^ CRC16_MODBUS_POLY_REFLECTED) : (uint16_t)(state >> 1);
+      }
+    }
+    return state;
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  Program the unit for a CRC and start it from a CRC so far
+  * @note   The unit takes everything in byte-reversed words or single bytes,
+  *         so one input setting serves both. Its register holds the CRC
+  *         before the output reversal and inversion, which are undone here.
+  * @param  type: CRC to compute
+  * @param  crc: CRC of the bytes before, as returned
+  * @retval None
+  */
+static void Crc_Configure(VAL_Crc_Type_t type, uint32_t crc) {
+  if (type == VAL_CRC_16_CCITT) {
+    CRC->POL = VAL_CRC16_POLY;
+    CRC->INIT = crc & 0xFFFFU;
+    CRC->CR = CRC_CR_POLYSIZE_0 | CRC_CR_RESET;
+  } else if (type == VAL_CRC_16_MODBUS) {
+    CRC->POL = VAL_CRC16_MODBUS_POLY;
+    CRC->INIT = __RBIT(crc) >> 16;
+    CRC->CR = CRC_CR_POLYSIZE_0 | CRC_CR_REV_IN_0 | CRC_CR_REV_OUT | CRC_CR_RESET;
+  } else {
+    CRC->POL = VAL_CRC32_POLY;
+    CRC->INIT = __RBIT(crc ^ 0xFFFFFFFFU);
+    CRC->CR = CRC_CR_REV_IN_0 | CRC_CR_REV_OUT | CRC_CR_RESET;
+  }
+}
+
+/**
+  * @brief  Read the CRC of the bytes written since Crc_Configure
+  * @param  type: CRC being computed
+  * @retval uint32_t: CRC, 16-bit ones in the low half
+  */
+static uint32_t Crc_Result(VAL_Crc_Type_t type) {
+  if (type == VAL_CRC_16_CCITT || type == VAL_CRC_16_MODBUS) {
+    return CRC->DR & 0xFFFFU;
+  }
+
+  return CRC->DR ^ 0xFFFFFFFFU;
+}
+
+/**
+  * @brief  Hand the next part of the block to the DMA
+  * @retval None
+  */
+static void Crc_StartDmaPart(void) {
+  size_t count = (dma_left > CRC_DMA_MAX_BYTES) ? CRC_DMA_MAX_BYTES : dma_left;
+
+  CRC_DMA->CCR = 0;
+  DMA2->IFCR = DMA_IFCR_CGIF1;
+  CRC_DMA->CPAR = (uint32_t)&CRC->DR;
+  CRC_DMA->CMAR = (uint32_t)dma_next;
+  CRC_DMA->CNDTR = count;
+  dma_next += count;
+  dma_left -= count;
+
+  /* Memory to memory, memory read, byte wide on both sides, no request line */
+  CRC_DMA->CCR = DMA_CCR_MEM2MEM | DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_EN;
+}
@@ -6,13 +6,1438 @@
   * @attention
   *
   * This module provides a hardware-independent interface for data storage
-  * used by the Wiseled_LBR system for error logging.
+  * used by the Wiseled_LBR system for error logging and configuration.
+  *
+  * The configuration lives in a log-structured key/value store over two
+  * flash pages. Saving appends a record (key, version, length, payload and a
+  * checksum) to the active page; the newest valid record of a key is the
+  * current value. Only when the active page is full are the newest records
+  * compacted into the other page, which is the one erase per page fill.
+  * A page becomes active once its header, written after the copied records,
+  * carries a higher generation than the other page, so a reset during
+  * compaction leaves the old page in use. Torn or foreign records fail the
+  * checksum and read back as "not stored". The configuration, the
+  * calibration of each light, each scene, each command macro, the usage
+  * counters and the summary of the last alarm recording are separate keys,
+  * so one can be replaced without rewriting the others.
+  *
+  * Flash is memory-mapped, so read-mostly values need no RAM copy:
+  * VAL_DataStore_MapScene and VAL_DataStore_MapMacro check a record once
+  * and return a pointer to its payload in place. Records only move when
+  * the store is compacted, which bumps VAL_DataStore_GetGeneration; the
+  * old page is not erased before the compaction after that one, so a
+  * pointer stays readable for the whole of one compaction while its owner
+  * maps it again.
+  *
+  * The error log is an append-only ring of 16-byte records over the
+  * DATA_STORE_LOG_PAGES pages below the configuration page. Logging only
+  * queues the entry in RAM, from any context; VAL_DataStore_FlushErrorLogs
+  * programs the queued entries from a low-priority task, one batch per page
+  * at most. When the ring wraps the oldest page is erased, so every page is
+  * erased once per DATA_STORE_LOG_PAGES page fills. At start-up the write
+  * position is found again from the record sequence numbers.
+  *
+  * Code runs from the same flash, so the CPU stalls while a double word is
+  * programmed (about 80 us) and for the whole of a page erase (about 25 ms),
+  * interrupts included. Writes go one double word per HAL call, so the
+  * longer stall is the erase. The ones a background writer starts, the
+  * log ring and the usage counters, first ask the gate set with
+  * VAL_DataStore_SetEraseGate: when it refuses, the write is left for later
+  * and reports VAL_BUSY. Writes the host asks for are not gated. The counts
+  * and the longest stall of each kind are kept for VAL_DataStore_GetFlashStats.
+  *
+  * For the wear, VAL_DataStore_GetWear counts the erases of each page since
+  * start-up, with the time spent erasing, times each program sequence (a
+  * record or a page header) from unlock to lock, and follows the depth of
+  * the error log queue, the backlog of the flush task. The log ring wears
+  * its pages evenly; the key/value pages take turns, one erase per
+  * compaction, so VAL_DataStore_GetGeneration is their wear since the
+  * store was first written.
   *
   ******************************************************************************
   */
 
 /* Includes ------------------------------------------------------------------*/
 #include "val_data_store.h"
+#include "val_channels.h"
+#include "val_sys_clock.h"
+#include "val_context.h"
+#include "main.h"
 #include <string.h>
-#include "ee.h" /* NimaLTD EEPROM emulation library */
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Private define ------------------------------------------------------------*/
+#define FNV_OFFSET_BASIS          2166136261U
+#define FNV_PRIME                 16777619U
+
+/* Key/value store pages, the last flash pages kept out of the linker image */
+#define DATA_STORE_KV_ADDRESS     0x0803F000U
+#define DATA_STORE_KV_PAGES       2
+#define DATA_STORE_KV_MAGIC       0x5347564BU  /* "KVGS" */
+#define DATA_STORE_KV_ERASED_KEY  0xFFFFU
+#define DATA_STORE_KV_ALIGN(n)    (((n) + 7U) & ~7U)  /* Double word programming unit */
+
+/* Keys of the values kept in the store */
+#define DATA_STORE_KEY_CONFIG     1
+#define DATA_STORE_KEY_USAGE      2
+#define DATA_STORE_KEY_COUNTERS   3
+#define DATA_STORE_KEY_RECORDING  4
+#define DATA_STORE_KEY_CALIBRATION 0x100U  /* Plus light ID - 1 */
+#define DATA_STORE_KEY_SCENE      0x200U  /* Plus scene number - 1 */
+#define DATA_STORE_KEY_MACRO      0x300U  /* Plus macro number - 1 */
+
+/* Error log flash ring, directly below the key/value store */
+#define DATA_STORE_LOG_PAGES      4
+#define DATA_STORE_LOG_ADDRESS    (DATA_STORE_KV_ADDRESS - DATA_STORE_LOG_PAGES * FLASH_PAGE_SIZE)
+#define DATA_STORE_LOG_SLOTS      (FLASH_PAGE_SIZE / sizeof(DataStore_LogRecord_t))  /* Per page */
+#define DATA_STORE_LOG_ERASED     0xFFFFFFFFU
+
+/* Entries waiting in RAM for the flush task */
+#define DATA_STORE_LOG_QUEUE      16
+
+_Static_assert(DATA_STORE_LOG_PAGES + DATA_STORE_KV_PAGES == VAL_DATA_STORE_PAGES, "Store pages miscounted");
+
+/* Private typedef -----------------------------------------------------------*/
+/* First double word of a key/value page, programmed once the page is complete */
+typedef struct {
+  uint32_t magic;
+  uint32_t generation;    /* The valid page with the highest generation is active */
+} DataStore_KvPage_t;
+
+/* Key/value record header, followed by the payload padded to a double word */
+typedef struct {
+  uint16_t key;           /* DATA_STORE_KEY_*, DATA_STORE_KV_ERASED_KEY past the last record */
+  uint16_t version;       /* Layout version chosen by the owner */
+  uint16_t length;        /* Payload bytes */
+  uint16_t check;         /* FNV-1a over key, version, length and payload, folded to 16 bits */
+} DataStore_KvRecord_t;
+
+/* Error log record, programmed as two double words */
+typedef struct {
+  uint32_t sequence;      /* Increments per record, DATA_STORE_LOG_ERASED in an empty slot */
+  uint32_t timestamp;
+  float measured_value;
+  uint8_t light_id;
+  uint8_t error_type;
+  uint8_t action_taken;
+  uint8_t check;          /* Low byte of the FNV-1a over the bytes before it */
+} DataStore_LogRecord_t;
+
+/* Array filled by VAL_DataStore_GetErrorLogs */
+typedef struct {
+  ErrorLogEntry_t* logs;
+  uint8_t max_count;
+  uint8_t found;
+} DataStore_Collect_t;
+
+/* Private variables ---------------------------------------------------------*/
+/* Active key/value page and the offset of its first free byte */
+static int8_t kv_page = -1;
+static uint16_t kv_offset = 0;
+static uint32_t kv_generation = 0;
+
+/* Record image being programmed, header and largest payload */
+static uint64_t kv_buffer[(sizeof(DataStore_KvRecord_t) + DATA_STORE_KV_ALIGN(VAL_DATA_STORE_CONFIG_MAX)) / 8];
+
+/* Set while a task programs or erases flash; HAL_FLASH_Lock by one task
+ * would otherwise end the other's unlocked period */
+static volatile bool flash_busy = false;
+
+/* Flash ring write position and number of valid records in it */
+static uint8_t log_page = 0;
+static uint16_t log_slot = 0;
+static uint32_t log_sequence = 1;
+static uint16_t log_count = 0;
+
+/* RAM queue, filled from any context and drained by the flush task */
+static DataStore_LogRecord_t log_queue[DATA_STORE_LOG_QUEUE];
+static volatile uint8_t log_queue_head = 0;   /* Next entry to fill */
+static volatile uint8_t log_queue_tail = 0;   /* Next entry to program */
+
+static StatusLog_t status_log;
+
+/* Asked before a background erase, NULL to always erase */
+static VAL_DataStore_EraseGate erase_gate = NULL;
+static VAL_DataStore_FlashStats_t flash_stats;
+static VAL_DataStore_Wear_t wear;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t DataStore_Checksum(uint32_t hash, const uint8_t* data, uint16_t size);
+static bool DataStore_AcquireFlash(void);
+static void DataStore_ReleaseFlash(void);
+static VAL_Status DataStore_Program(uint32_t address, const uint64_t* words, uint16_t count);
+static VAL_Status DataStore_EraseFlash(uint32_t address, uint8_t count);
+static uint32_t DataStore_KvPageAddress(uint8_t page);
+static const DataStore_KvRecord_t* DataStore_KvNext(uint8_t page, uint16_t* offset);
+static bool DataStore_KvIsValid(const DataStore_KvRecord_t* entry);
+static const DataStore_KvRecord_t* DataStore_KvFind(uint8_t page, uint16_t key,
+                                                    const DataStore_KvRecord_t* after);
+static VAL_Status DataStore_KvAppend(uint8_t page, uint16_t* offset, uint16_t key, uint16_t version,
+                                     const void* data, uint16_t length);
+static VAL_Status DataStore_KvCompact(uint16_t key, uint16_t version, const void* data, uint16_t length);
+static VAL_Status DataStore_KvLoad(uint16_t key, uint16_t version, void* data, uint16_t size);
+static VAL_Status DataStore_KvMap(uint16_t key, uint16_t version, uint16_t size, const void** data);
+static VAL_Status DataStore_KvSave(uint16_t key, uint16_t version, const void* data, uint16_t size,
+                                   bool background);
+static bool DataStore_MayErase(void);
+static void DataStore_RecordStall(uint32_t* count, uint32_t* max_us, uint32_t start);
+static void DataStore_ScanKv(void);
+static const DataStore_LogRecord_t* DataStore_LogRecordAt(uint8_t page, uint16_t slot);
+static bool DataStore_IsValidRecord(const DataStore_LogRecord_t* entry);
+static void DataStore_ToEntry(const DataStore_LogRecord_t* record, ErrorLogEntry_t* entry);
+static bool DataStore_CollectEntry(const ErrorLogEntry_t* entry, void* context);
+static bool DataStore_IsErasedRecord(const DataStore_LogRecord_t* entry);
+static uint16_t DataStore_CountPage(uint8_t page);
+static void DataStore_ScanLog(void);
+static VAL_Status DataStore_ErasePages(uint8_t first, uint8_t count);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Initialize the data store
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_DataStore_Init(void) {
+  memset(&status_log, 0, sizeof(status_log));
+  DataStore_ScanKv();
+  DataStore_ScanLog();
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Read the stored configuration
+  * @param  version: Layout version the caller expects
+  * @param  data: Buffer to store the configuration
+  * @param  size: Size of the configuration in bytes
+  * @retval VAL_Status: VAL_OK if a valid configuration of this version and
+  *         size was read, VAL_ERROR if none is stored, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_LoadConfig(uint16_t version, void* data, uint16_t size) {
+  return DataStore_KvLoad(DATA_STORE_KEY_CONFIG, version, data, size);
+}
+
+/**
+  * @brief  Replace the stored configuration
+  * @note   Appends one record. When the page is full the store is compacted
+  *         into the other page first, which erases it; code executes from
+  *         the same bank, so everything including interrupts stalls for the
+  *         erase time (about 25 ms).
+  * @param  version: Layout version of the configuration
+  * @param  data: Configuration to store
+  * @param  size: Size of the configuration in bytes
+  * @retval VAL_Status: VAL_OK if written, VAL_BUSY if flash was in use,
+  *         VAL_ERROR if the write failed, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_SaveConfig(uint16_t version, const void* data, uint16_t size) {
+  return DataStore_KvSave(DATA_STORE_KEY_CONFIG, version, data, size, false);
+}
+
+/**
+  * @brief  Read the stored calibration of a light
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @param  version: Layout version the caller expects
+  * @param  data: Buffer to store the calibration
+  * @param  size: Size of the calibration in bytes
+  * @retval VAL_Status: VAL_OK if a valid calibration of this version and
+  *         size was read, VAL_ERROR if none is stored, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_LoadCalibration(uint8_t lightId, uint16_t version, void* data, uint16_t size) {
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT) {
+    return VAL_PARAM;
+  }
+
+  return DataStore_KvLoad(DATA_STORE_KEY_CALIBRATION + lightId - 1U, version, data, size);
+}
+
+/**
+  * @brief  Replace the stored calibration of a light
+  * @note   Same flash behaviour as VAL_DataStore_SaveConfig
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @param  version: Layout version of the calibration
+  * @param  data: Calibration to store
+  * @param  size: Size of the calibration in bytes
+  * @retval VAL_Status: VAL_OK if written, VAL_BUSY if flash was in use,
+  *         VAL_ERROR if the write failed, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_SaveCalibration(uint8_t lightId, uint16_t version, const void* data, uint16_t size) {
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT) {
+    return VAL_PARAM;
+  }
+
+  return DataStore_KvSave(DATA_STORE_KEY_CALIBRATION + lightId - 1U, version, data, size, false);
+}
+
+/**
+  * @brief  Read a stored scene
+  * @param  scene: Scene number (1-VAL_DATA_STORE_SCENES)
+  * @param  version: Layout version the caller expects
+  * @param  data: Buffer to store the scene
+  * @param  size: Size of the scene in bytes
+  * @retval VAL_Status: VAL_OK if a valid scene of this version and size was
+  *         read, VAL_ERROR if none is stored, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_LoadScene(uint8_t scene, uint16_t version, void* data, uint16_t size) {
+  if (scene < 1 || scene > VAL_DATA_STORE_SCENES) {
+    return VAL_PARAM;
+  }
+
+  return DataStore_KvLoad(DATA_STORE_KEY_SCENE + scene - 1U, version, data, size);
+}
+
+/**
+  * @brief  Find a stored scene in flash, without copying it
+  * @note   The record is checked here, once; the pointer is valid until the
+  *         generation changes, see VAL_DataStore_GetGeneration
+  * @param  scene: Scene number (1-VAL_DATA_STORE_SCENES)
+  * @param  version: Layout version the caller expects
+  * @param  size: Size of the scene in bytes
+  * @param  data: Pointer to store the address of the scene in flash
+  * @retval VAL_Status: VAL_OK if a valid scene of this version and size was
+  *         found, VAL_ERROR if none is stored, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_MapScene(uint8_t scene, uint16_t version, uint16_t size, const void** data) {
+  if (scene < 1 || scene > VAL_DATA_STORE_SCENES) {
+    return VAL_PARAM;
+  }
+
+  return DataStore_KvMap(DATA_STORE_KEY_SCENE + scene - 1U, version, size, data);
+}
+
+/**
+  * @brief  Replace a stored scene
+  * @note   Same flash behaviour as VAL_DataStore_SaveConfig
+  * @param  scene: Scene number (1-VAL_DATA_STORE_SCENES)
+  * @param  version: Layout version of the scene
+  * @param  data: Scene to store
+  * @param  size: Size of the scene in bytes
+  * @retval VAL_Status: VAL_OK if written, VAL_BUSY if flash was in use,
+  *         VAL_ERROR if the write failed, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_SaveScene(uint8_t scene, uint16_t version, const void* data, uint16_t size) {
+  if (scene < 1 || scene > VAL_DATA_STORE_SCENES) {
+    return VAL_PARAM;
+  }
+
+  return DataStore_KvSave(DATA_STORE_KEY_SCENE + scene - 1U, version, data, size, false);
+}
+
+/**
+  * @brief  Find a stored command macro in flash, without copying it
+  * @note   As VAL_DataStore_MapScene
+  * @param  macro: Macro number (1-VAL_DATA_STORE_MACROS)
+  * @param  version: Layout version the caller expects
+  * @param  size: Size of the macro in bytes
+  * @param  data: Pointer to store the address of the macro in flash
+  * @retval VAL_Status: VAL_OK if a valid macro of this version and size was
+  *         found, VAL_ERROR if none is stored, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_MapMacro(uint8_t macro, uint16_t version, uint16_t size, const void** data) {
+  if (macro < 1 || macro > VAL_DATA_STORE_MACROS) {
+    return VAL_PARAM;
+  }
+
+  return DataStore_KvMap(DATA_STORE_KEY_MACRO + macro - 1U, version, size, data);
+}
+
+/**
+  * @brief  Replace a stored command macro
+  * @note   Same flash behaviour as VAL_DataStore_SaveConfig
+  * @param  macro: Macro number (1-VAL_DATA_STORE_MACROS)
+  * @param  version: Layout version of the macro
+  * @param  data: Macro to store
+  * @param  size: Size of the macro in bytes
+  * @retval VAL_Status: VAL_OK if written, VAL_BUSY if flash was in use,
+  *         VAL_ERROR if the write failed, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_SaveMacro(uint8_t macro, uint16_t version, const void* data, uint16_t size) {
+  if (macro < 1 || macro > VAL_DATA_STORE_MACROS) {
+    return VAL_PARAM;
+  }
+
+  return DataStore_KvSave(DATA_STORE_KEY_MACRO + macro - 1U, version, data, size, false);
+}
+
+/**
+  * @brief  Read the stored usage counters
+  * @param  version: Layout version the caller expects
+  * @param  data: Buffer to store the counters
+  * @param  size: Size of the counters in bytes
+  * @retval VAL_Status: VAL_OK if valid counters of this version and size
+  *         were read, VAL_ERROR if none are stored, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_LoadUsage(uint16_t version, void* data, uint16_t size) {
+  return DataStore_KvLoad(DATA_STORE_KEY_USAGE, version, data, size);
+}
+
+/**
+  * @brief  Replace the stored usage counters
+  * @note   Same flash behaviour as VAL_DataStore_SaveConfig, but a
+  *         background write: compacting waits for the erase gate. Every save
+  *         takes a record of the page, so callers checkpoint rarely.
+  * @param  version: Layout version of the counters
+  * @param  data: Counters to store
+  * @param  size: Size of the counters in bytes
+  * @retval VAL_Status: VAL_OK if written, VAL_BUSY if flash was in use or the
+  *         gate deferred the compaction, VAL_ERROR if the write failed,
+  *         VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_SaveUsage(uint16_t version, const void* data, uint16_t size) {
+  return DataStore_KvSave(DATA_STORE_KEY_USAGE, version, data, size, true);
+}
+
+/**
+  * @brief  Read the stored event counters
+  * @param  version: Layout version the caller expects
+  * @param  data: Buffer to store the counters
+  * @param  size: Size of the counters in bytes
+  * @retval VAL_Status: VAL_OK if valid counters of this version and size
+  *         were read, VAL_ERROR if none are stored, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_LoadCounters(uint16_t version, void* data, uint16_t size) {
+  return DataStore_KvLoad(DATA_STORE_KEY_COUNTERS, version, data, size);
+}
+
+/**
+  * @brief  Replace the stored event counters
+  * @note   A background write, as VAL_DataStore_SaveUsage
+  * @param  version: Layout version of the counters
+  * @param  data: Counters to store
+  * @param  size: Size of the counters in bytes
+  * @retval VAL_Status: VAL_OK if written, VAL_BUSY if flash was in use or the
+  *         gate deferred the compaction, VAL_ERROR if the write failed,
+  *         VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_SaveCounters(uint16_t version, const void* data, uint16_t size) {
+  return DataStore_KvSave(DATA_STORE_KEY_COUNTERS, version, data, size, true);
+}
+
+/**
+  * @brief  Read the stored alarm recording summary
+  * @param  version: Layout version the caller expects
+  * @param  data: Buffer to store the summary
+  * @param  size: Size of the summary in bytes
+  * @retval VAL_Status: VAL_OK if a valid summary of this version and size
+  *         was read, VAL_ERROR if none is stored, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_LoadRecording(uint16_t version, void* data, uint16_t size) {
+  return DataStore_KvLoad(DATA_STORE_KEY_RECORDING, version, data, size);
+}
+
+/**
+  * @brief  Replace the stored alarm recording summary
+  * @note   A background write, as VAL_DataStore_SaveUsage
+  * @param  version: Layout version of the summary
+  * @param  data: Summary to store
+  * @param  size: Size of the summary in bytes
+  * @retval VAL_Status: VAL_OK if written, VAL_BUSY if flash was in use or the
+  *         gate deferred the compaction, VAL_ERROR if the write failed,
+  *         VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_SaveRecording(uint16_t version, const void* data, uint16_t size) {
+  return DataStore_KvSave(DATA_STORE_KEY_RECORDING, version, data, size, true);
+}
+
+/**
+  * @brief  Get the layout generation of the key/value store
+  * @note   Changes whenever the store is compacted and records move; a
+  *         pointer from VAL_DataStore_MapScene or VAL_DataStore_MapMacro
+  *         must be mapped again then
+  * @retval uint32_t: Generation, 0 while nothing is stored
+  */
+uint32_t VAL_DataStore_GetGeneration(void) {
+  return kv_generation;
+}
+
+/**
+  * @brief  Get the records of the active key/value page, for a check of
+  *         the flash they are in
+  * @note   Records are only ever added past the end, and a compaction
+  *         leaves the old page readable (see VAL_DataStore_GetGeneration),
+  *         so the bytes returned stay as they are while they are read
+  * @param  start: Pointer to store the first byte, the page header
+  * @param  length: Pointer to store the bytes up to the first free one
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if a pointer is NULL,
+  *         VAL_ERROR while nothing is stored
+  */
+VAL_Status VAL_DataStore_GetKvExtent(const uint8_t** start, uint16_t* length) {
+  int8_t page;
+  uint16_t offset;
+  uint32_t primask;
+
+  if (start == NULL || length == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* A save in another task moves both */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  page = kv_page;
+  offset = kv_offset;
+  __set_PRIMASK(primask);
+
+  if (page < 0) {
+    return VAL_ERROR;
+  }
+
+  *start = (const uint8_t*)DataStore_KvPageAddress((uint8_t)page);
+  *length = offset;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Queue an error event for the persistent log
+  * @note   Never waits for flash, callable from interrupts. The entry is
+  *         stored by the next VAL_DataStore_FlushErrorLogs.
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT), or the source of an error
+  *         that is not tied to a light
+  * @param  errorType: Type of error
+  * @param  value: Measured value that caused the error
+  * @param  action: Action taken (VAL_DATA_STORE_ACTION_x)
+  * @retval VAL_Status: VAL_OK if queued, VAL_BUSY if the queue is full,
+  *         VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_LogErrorEvent(uint8_t lightId, ErrorType_t errorType, float value, uint8_t action) {
+  DataStore_LogRecord_t* entry;
+  uint32_t primask;
+
+  if ((errorType == ERROR_OVER_CURRENT || errorType == ERROR_OVER_TEMPERATURE) &&
+      (lightId < 1 || lightId > VAL_LIGHT_COUNT)) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  uint8_t next = (log_queue_head + 1) % DATA_STORE_LOG_QUEUE;
+  if (next == log_queue_tail) {
+    wear.queue_full++;
+    __set_PRIMASK(primask);
+    return VAL_BUSY;
+  }
+
+  /* The sequence number and check byte are assigned when programmed */
+  entry = &log_queue[log_queue_head];
+  entry->timestamp = HAL_GetTick();
+  entry->measured_value = value;
+  entry->light_id = lightId;
+  entry->error_type = (uint8_t)errorType;
+  entry->action_taken = action;
+  log_queue_head = next;
+
+  uint8_t queued = (log_queue_head + DATA_STORE_LOG_QUEUE - log_queue_tail) % DATA_STORE_LOG_QUEUE;
+  if (queued > wear.queued_max) {
+    wear.queued_max = queued;
+  }
+
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Program the queued error events into flash
+  * @note   Task context only, from a low-priority task. Each batch ends at a
+  *         page boundary; starting a used page erases it first, which stalls
+  *         the CPU for the erase time, so it waits for the erase gate.
+  * @retval VAL_Status: VAL_OK if the queue is empty, VAL_BUSY if flash was in
+  *         use or the gate deferred the erase, VAL_ERROR if programming failed
+  */
+VAL_Status VAL_DataStore_FlushErrorLogs(void) {
+  VAL_Status status = VAL_OK;
+
+  VAL_ASSERT_TASK_CONTEXT();
+
+  while (log_queue_tail != log_queue_head && status == VAL_OK) {
+    if (!DataStore_AcquireFlash()) {
+      return VAL_BUSY;
+    }
+
+    /* Entering a page that still holds old records drops them */
+    if (log_slot == 0 && DataStore_CountPage(log_page) > 0) {
+      if (!DataStore_MayErase()) {
+        DataStore_ReleaseFlash();
+        return VAL_BUSY;
+      }
+      if (DataStore_ErasePages(log_page, 1) != VAL_OK) {
+        DataStore_ReleaseFlash();
+        return VAL_ERROR;
+      }
+    }
+
+    /* One batch: the queued entries that fit in the current page */
+    while (log_queue_tail != log_queue_head && log_slot < DATA_STORE_LOG_SLOTS) {
+      DataStore_LogRecord_t entry = log_queue[log_queue_tail];
+      uint32_t address = (uint32_t)DataStore_LogRecordAt(log_page, log_slot);
+      uint64_t words[2];
+
+      entry.sequence = log_sequence;
+      entry.check = (uint8_t)DataStore_Checksum(FNV_OFFSET_BASIS, (const uint8_t*)&entry, sizeof(entry) - 1);
+      memcpy(words, &entry, sizeof(words));
+
+      /* A failed slot is skipped, it never reads back as a valid record */
+      log_slot++;
+      status = DataStore_Program(address, words, 2);
+      if (status != VAL_OK) {
+        break;
+      }
+
+      log_sequence++;
+      if (log_count < DATA_STORE_LOG_PAGES * DATA_STORE_LOG_SLOTS) {
+        log_count++;
+      }
+      log_queue_tail = (log_queue_tail + 1) % DATA_STORE_LOG_QUEUE;
+    }
+
+    DataStore_ReleaseFlash();
+
+    if (log_slot >= DATA_STORE_LOG_SLOTS) {
+      log_page = (log_page + 1) % DATA_STORE_LOG_PAGES;
+      log_slot = 0;
+    }
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Get the number of logged error events
+  * @retval uint16_t: Events in flash and still queued
+  */
+uint16_t VAL_DataStore_GetErrorCount(void) {
+  uint8_t queued = (log_queue_head + DATA_STORE_LOG_QUEUE - log_queue_tail) % DATA_STORE_LOG_QUEUE;
+
+  return log_count + queued;
+}
+
+/**
+  * @brief  Read the most recent error events, newest first
+  * @note   Task context only
+  * @param  logs: Array to store the events
+  * @param  maxCount: Number of entries the array holds
+  * @retval uint8_t: Number of events stored in logs
+  */
+uint8_t VAL_DataStore_GetErrorLogs(ErrorLogEntry_t *logs, uint8_t maxCount) {
+  DataStore_Collect_t collect = { logs, maxCount, 0 };
+
+  if (logs == NULL || maxCount == 0) {
+    return 0;
+  }
+
+  VAL_DataStore_VisitErrorLogs(DataStore_CollectEntry, &collect);
+
+  return collect.found;
+}
+
+/**
+  * @brief  Walk the error events newest first, one at a time
+  * @note   Task context only. Each event is read in place, from the RAM
+  *         queue and then from the flash ring, and handed to the visitor as
+  *         a copy of that one entry; the log itself is never copied. Events
+  *         logged during the walk are not visited.
+  * @param  visitor: Called per event, returns false to end the walk
+  * @param  context: Passed to the visitor
+  * @retval uint16_t: Number of events visited
+  */
+uint16_t VAL_DataStore_VisitErrorLogs(VAL_DataStore_LogVisitor visitor, void* context) {
+  ErrorLogEntry_t entry;
+  uint16_t visited = 0;
+  uint32_t primask;
+
+  if (visitor == NULL) {
+    return 0;
+  }
+
+  /* Both ends of the walk together, so an entry being flushed is seen once */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  uint8_t index = log_queue_head;
+  uint8_t tail = log_queue_tail;
+  uint8_t page = log_page;
+  uint16_t slot = log_slot;
+  __set_PRIMASK(primask);
+
+  /* Queued entries are the newest */
+  while (index != tail) {
+    index = (index + DATA_STORE_LOG_QUEUE - 1) % DATA_STORE_LOG_QUEUE;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    DataStore_ToEntry(&log_queue[index], &entry);
+    __set_PRIMASK(primask);
+
+    visited++;
+    if (!visitor(&entry, context)) {
+      return visited;
+    }
+  }
+
+  /* Then walk the flash ring backwards from the write position */
+  for (uint32_t i = 0; i < DATA_STORE_LOG_PAGES * DATA_STORE_LOG_SLOTS; i++) {
+    if (slot == 0) {
+      page = (page + DATA_STORE_LOG_PAGES - 1) % DATA_STORE_LOG_PAGES;
+      slot = DATA_STORE_LOG_SLOTS;
+    }
+    slot--;
+
+    const DataStore_LogRecord_t* record = DataStore_LogRecordAt(page, slot);
+    if (!DataStore_IsValidRecord(record)) {
+      continue;
+    }
+    DataStore_ToEntry(record, &entry);
+
+    visited++;
+    if (!visitor(&entry, context)) {
+      break;
+    }
+  }
+
+  return visited;
+}
+
+/**
+  * @brief  Erase the error log
+  * @note   Task context only; stalls the CPU for DATA_STORE_LOG_PAGES erases
+  * @retval VAL_Status: VAL_OK if successful, VAL_BUSY if flash was in use,
+  *         VAL_ERROR otherwise
+  */
+VAL_Status VAL_DataStore_ClearErrorLogs(void) {
+  VAL_Status status;
+  uint32_t primask;
+
+  VAL_ASSERT_TASK_CONTEXT();
+
+  if (!DataStore_AcquireFlash()) {
+    return VAL_BUSY;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  log_queue_tail = log_queue_head;
+  __set_PRIMASK(primask);
+
+  status = DataStore_ErasePages(0, DATA_STORE_LOG_PAGES);
+  log_page = 0;
+  log_slot = 0;
+  log_count = 0;
+
+  DataStore_ReleaseFlash();
+
+  return status;
+}
+
+/**
+  * @brief  Get the errors active on each light
+  * @param  statusLog: Pointer to store the status
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if statusLog is NULL
+  */
+VAL_Status VAL_DataStore_GetStatusLog(StatusLog_t *statusLog) {
+  uint32_t primask;
+
+  if (statusLog == NULL) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  *statusLog = status_log;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Record the error active on a light
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @param  errorType: Type of error
+  * @param  value: Measured value that caused the error
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_SetActiveError(uint8_t lightId, ErrorType_t errorType, float value) {
+  uint32_t primask;
+
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  status_log.active_errors |= (uint8_t)(1U << (lightId - 1));
+  status_log.error_types[lightId - 1] = (uint8_t)errorType;
+  status_log.error_values[lightId - 1] = value;
+  status_log.error_timestamps[lightId - 1] = HAL_GetTick();
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Clear the error active on a light
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DataStore_ClearActiveError(uint8_t lightId) {
+  uint32_t primask;
+
+  if (lightId < 1 || lightId > VAL_LIGHT_COUNT) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  status_log.active_errors &= (uint8_t)~(1U << (lightId - 1));
+  status_log.error_types[lightId - 1] = 0;
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Set the function asked before a background write erases a page
+  * @note   Called from the writing task, with the flash controller held;
+  *         it must not block. A refused erase is tried again by the next
+  *         flush or save.
+  * @param  gate: Returns true if a page may be erased now, NULL to always erase
+  * @retval None
+  */
+void VAL_DataStore_SetEraseGate(VAL_DataStore_EraseGate gate) {
+  erase_gate = gate;
+}
+
+/**
+  * @brief  Get the flash program and erase figures
+  * @param  stats: Structure to store the figures
+  * @retval None
+  */
+void VAL_DataStore_GetFlashStats(VAL_DataStore_FlashStats_t* stats) {
+  uint32_t primask;
+
+  if (stats == NULL) {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  *stats = flash_stats;
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Clear the flash program and erase figures
+  * @retval None
+  */
+void VAL_DataStore_ResetFlashStats(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  memset(&flash_stats, 0, sizeof(flash_stats));
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Get the flash wear and write timing since start-up
+  * @param  wear_out: Pointer to store the figures
+  * @retval None
+  */
+void VAL_DataStore_GetWear(VAL_DataStore_Wear_t* wear_out) {
+  uint32_t primask;
+
+  if (wear_out == NULL) {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  *wear_out = wear;
+  wear_out->queued = (log_queue_head + DATA_STORE_LOG_QUEUE - log_queue_tail) % DATA_STORE_LOG_QUEUE;
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Take the flash controller for good, before a firmware update
+  * @note   Every write after this one reports VAL_BUSY; only a reset gives
+  *         the controller back.
+  * @retval VAL_Status: VAL_OK if taken, VAL_BUSY while a task programs or
+  *         erases
+  */
+VAL_Status VAL_DataStore_HoldFlash(void) {
+  return DataStore_AcquireFlash() ? VAL_OK : VAL_BUSY;
+}
+
+/**
+  * @brief  Get the lowest flash address of the store
+  * @note   Flash from FLASH_BASE up to this address holds the firmware
+  * @retval uint32_t: Address of the first error log page
+  */
+uint32_t VAL_DataStore_GetBaseAddress(void) {
+  return DATA_STORE_LOG_ADDRESS;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Continue the FNV-1a checksum over a buffer
+  * @param  hash: FNV_OFFSET_BASIS, or the result over the preceding data
+  * @param  data: Data to checksum
+  * @param  size: Number of bytes
+  * @retval uint32_t: Checksum
+  */
+static uint32_t DataStore_Checksum(uint32_t hash, const uint8_t* data, uint16_t size) {
+  for (uint16_t i = 0; i < size; i++) {
+    hash = (hash ^ data[i]) * FNV_PRIME;
+  }
+
+  return hash;
+}
+
+/**
+  * @brief  Claim the flash controller for a program or erase sequence
+  * @retval bool: true if claimed, false if another task holds it
+  */
+static bool DataStore_AcquireFlash(void) {
+  bool acquired = false;
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if (!flash_busy) {
+    flash_busy = true;
+    acquired = true;
+  }
+  __set_PRIMASK(primask);
+
+  return acquired;
+}
+
+/**
+  * @brief  Release the flash controller
+  * @retval None
+  */
+static void DataStore_ReleaseFlash(void) {
+  flash_busy = false;
+}
+
+/**
+  * @brief  Ask the erase gate whether a background write may erase now
+  * @retval bool: true to erase, false to defer; deferrals are counted
+  */
+static bool DataStore_MayErase(void) {
+  if (erase_gate == NULL || erase_gate()) {
+    return true;
+  }
+
+  flash_stats.deferred++;
+  return false;
+}
+
+/**
+  * @brief  Count a flash stall and keep the longest one
+  * @param  count: Counter of this kind of stall
+  * @param  max_us: Longest stall of this kind
+  * @param  start: Microseconds when the stall began
+  * @retval None
+  */
+static void DataStore_RecordStall(uint32_t* count, uint32_t* max_us, uint32_t start) {
+  uint32_t elapsed = VAL_SysClock_GetMicros() - start;
+
+  (*count)++;
+  if (elapsed > *max_us) {
+    *max_us = elapsed;
+  }
+}
+
+/**
+  * @brief  Get a slot of the error log ring
+  * @param  page: Ring page (0 to DATA_STORE_LOG_PAGES - 1)
+  * @param  slot: Slot in the page (0 to DATA_STORE_LOG_SLOTS - 1)
+  * @retval const DataStore_LogRecord_t*: Record in flash
+  */
+static const DataStore_LogRecord_t* DataStore_LogRecordAt(uint8_t page, uint16_t slot) {
+  return (const DataStore_LogRecord_t*)(DATA_STORE_LOG_ADDRESS + page * FLASH_PAGE_SIZE +
+                                          slot * sizeof(DataStore_LogRecord_t));
+}
+
+/**
+  * @brief  Check that a slot holds a completely programmed record
+  * @param  entry: Record in flash
+  * @retval bool: true if valid
+  */
+static bool DataStore_IsValidRecord(const DataStore_LogRecord_t* entry) {
+  return entry->sequence != DATA_STORE_LOG_ERASED &&
+         entry->check == (uint8_t)DataStore_Checksum(FNV_OFFSET_BASIS, (const uint8_t*)entry, sizeof(*entry) - 1);
+}
+
+/**
+  * @brief  Convert a log record to the entry handed out
+  * @param  record: Record, queued or in flash
+  * @param  entry: Pointer to store the entry
+  * @retval None
+  */
+static void DataStore_ToEntry(const DataStore_LogRecord_t* record, ErrorLogEntry_t* entry) {
+  entry->timestamp = record->timestamp;
+  entry->light_id = record->light_id;
+  entry->error_type = record->error_type;
+  entry->measured_value = record->measured_value;
+  entry->action_taken = record->action_taken;
+}
+
+/**
+  * @brief  Append an event to the array of VAL_DataStore_GetErrorLogs
+  * @param  entry: Event
+  * @param  context: DataStore_Collect_t
+  * @retval bool: true while the array has room
+  */
+static bool DataStore_CollectEntry(const ErrorLogEntry_t* entry, void* context) {
+  DataStore_Collect_t* collect = (DataStore_Collect_t*)context;
+
+  collect->logs[collect->found++] = *entry;
+  return collect->found < collect->max_count;
+}
+
+/**
+  * @brief  Check that a slot was never programmed
+  * @param  entry: Record in flash
+  * @retval bool: true if all bytes are erased
+  */
+static bool DataStore_IsErasedRecord(const DataStore_LogRecord_t* entry) {
+  const uint32_t* words = (const uint32_t*)entry;
+
+  for (uint8_t i = 0; i < sizeof(*entry) / sizeof(uint32_t); i++) {
+    if (words[i] != DATA_STORE_LOG_ERASED) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+  * @brief  Count the programmed slots of a ring page
+  * @param  page: Ring page (0 to DATA_STORE_LOG_PAGES - 1)
+  * @retval uint16_t: Slots up to the first erased one
+  */
+static uint16_t DataStore_CountPage(uint8_t page) {
+  uint16_t slot = 0;
+
+  /* Pages fill from the start, the first erased slot ends the used part */
+  while (slot < DATA_STORE_LOG_SLOTS && !DataStore_IsErasedRecord(DataStore_LogRecordAt(page, slot))) {
+    slot++;
+  }
+
+  return slot;
+}
+
+/**
+  * @brief  Find the write position of the error log ring
+  * @note   The page whose first record has the highest sequence number is
+  *         the one being filled
+  * @retval None
+  */
+static void DataStore_ScanLog(void) {
+  uint32_t newest = 0;
+
+  log_page = 0;
+  log_slot = 0;
+  log_sequence = 1;
+  log_count = 0;
+
+  for (uint8_t page = 0; page < DATA_STORE_LOG_PAGES; page++) {
+    const DataStore_LogRecord_t* first = DataStore_LogRecordAt(page, 0);
+    uint16_t used = DataStore_CountPage(page);
+
+    for (uint16_t slot = 0; slot < used; slot++) {
+      const DataStore_LogRecord_t* entry = DataStore_LogRecordAt(page, slot);
+
+      if (DataStore_IsValidRecord(entry)) {
+        log_count++;
+        if (entry->sequence >= log_sequence) {
+          log_sequence = entry->sequence + 1;
+        }
+      }
+    }
+
+    if (used > 0 && DataStore_IsValidRecord(first) && first->sequence > newest) {
+      newest = first->sequence;
+      log_page = page;
+      log_slot = used;
+    }
+  }
+
+  if (log_slot >= DATA_STORE_LOG_SLOTS) {
+    log_page = (log_page + 1) % DATA_STORE_LOG_PAGES;
+    log_slot = 0;
+  }
+}
+
+/**
+  * @brief  Erase pages of the error log ring
+  * @note   The caller holds the flash controller
+  * @param  first: First ring page
+  * @param  count: Number of pages
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  */
+static VAL_Status DataStore_ErasePages(uint8_t first, uint8_t count) {
+  /* Records in the erased pages leave the log */
+  for (uint8_t page = first; page < first + count; page++) {
+    for (uint16_t slot = 0; slot < DATA_STORE_LOG_SLOTS; slot++) {
+      if (DataStore_IsValidRecord(DataStore_LogRecordAt(page, slot)) && log_count > 0) {
+        log_count--;
+      }
+    }
+  }
+
+  return DataStore_EraseFlash(DATA_STORE_LOG_ADDRESS + first * FLASH_PAGE_SIZE, count);
+}
+
+/**
+  * @brief  Program double words into erased flash
+  * @note   The caller holds the flash controller
+  * @param  address: Flash address, double word aligned
+  * @param  words: Data to program
+  * @param  count: Number of double words
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  */
+static VAL_Status DataStore_Program(uint32_t address, const uint64_t* words, uint16_t count) {
+  VAL_Status status = VAL_OK;
+  uint32_t write_start = VAL_SysClock_GetMicros();
+  uint32_t elapsed;
+
+  HAL_FLASH_Unlock();
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+
+  /* Interrupts run between the double words, each stalls the CPU once */
+  for (uint16_t i = 0; i < count; i++) {
+    uint32_t start = VAL_SysClock_GetMicros();
+    HAL_StatusTypeDef result = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, address + i * 8U, words[i]);
+
+    DataStore_RecordStall(&flash_stats.programs, &flash_stats.program_max_us, start);
+    if (result != HAL_OK) {
+      status = VAL_ERROR;
+      break;
+    }
+  }
+
+  HAL_FLASH_Lock();
+
+  elapsed = VAL_SysClock_GetMicros() - write_start;
+  wear.writes++;
+  wear.write_total_us += elapsed;
+  if (elapsed > wear.write_max_us) {
+    wear.write_max_us = elapsed;
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Erase flash pages
+  * @note   The caller holds the flash controller
+  * @param  address: Address of the first page
+  * @param  count: Number of pages
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  */
+static VAL_Status DataStore_EraseFlash(uint32_t address, uint8_t count) {
+  FLASH_EraseInitTypeDef erase = {0};
+  uint32_t error = 0;
+  uint32_t start;
+  HAL_StatusTypeDef result;
+
+  erase.TypeErase = FLASH_TYPEERASE_PAGES;
+  erase.Banks = FLASH_BANK_1;
+  erase.Page = (address - FLASH_BASE) / FLASH_PAGE_SIZE;
+  erase.NbPages = count;
+
+  HAL_FLASH_Unlock();
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+  start = VAL_SysClock_GetMicros();
+  result = HAL_FLASHEx_Erase(&erase, &error);
+  DataStore_RecordStall(&flash_stats.erases, &flash_stats.erase_max_us, start);
+  HAL_FLASH_Lock();
+
+  /* A failed erase is counted too, the page was worn all the same */
+  wear.erase_total_us += VAL_SysClock_GetMicros() - start;
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t page = (address - DATA_STORE_LOG_ADDRESS) / FLASH_PAGE_SIZE + i;
+
+    if (page < VAL_DATA_STORE_PAGES) {
+      wear.page_erases[page]++;
+    }
+  }
+
+  return (result == HAL_OK && error == 0xFFFFFFFFU) ? VAL_OK : VAL_ERROR;
+}
+
+/**
+  * @brief  Get the address of a key/value page
+  * @param  page: Page (0 to DATA_STORE_KV_PAGES - 1)
+  * @retval uint32_t: Flash address
+  */
+static uint32_t DataStore_KvPageAddress(uint8_t page) {
+  return DATA_STORE_KV_ADDRESS + page * FLASH_PAGE_SIZE;
+}
+
+/**
+  * @brief  Step to the next record of a key/value page
+  * @param  page: Page to walk
+  * @param  offset: Offset of the record to return, advanced past it
+  * @retval const DataStore_KvRecord_t*: Record, NULL past the last one
+  */
+static const DataStore_KvRecord_t* DataStore_KvNext(uint8_t page, uint16_t* offset) {
+  const DataStore_KvRecord_t* entry;
+
+  if (*offset + sizeof(DataStore_KvRecord_t) > FLASH_PAGE_SIZE) {
+    return NULL;
+  }
+
+  entry = (const DataStore_KvRecord_t*)(DataStore_KvPageAddress(page) + *offset);
+  if (entry->key == DATA_STORE_KV_ERASED_KEY) {
+    return NULL;
+  }
+
+  /* A corrupted length ends the walk; the page then counts as full */
+  uint32_t next = *offset + sizeof(DataStore_KvRecord_t) + DATA_STORE_KV_ALIGN(entry->length);
+  *offset = (next > FLASH_PAGE_SIZE) ? FLASH_PAGE_SIZE : (uint16_t)next;
+
+  return (next > FLASH_PAGE_SIZE) ? NULL : entry;
+}
+
+/**
+  * @brief  Check the checksum of a key/value record
+  * @param  entry: Record in flash
+  * @retval bool: true if the record and its payload are intact
+  */
+static bool DataStore_KvIsValid(const DataStore_KvRecord_t* entry) {
+  uint32_t hash = DataStore_Checksum(FNV_OFFSET_BASIS, (const uint8_t*)entry, offsetof(DataStore_KvRecord_t, check));
+
+  hash = DataStore_Checksum(hash, (const uint8_t*)(entry + 1), entry->length);
+  return entry->check == (uint16_t)(hash ^ (hash >> 16));
+}
+
+/**
+  * @brief  Find the newest valid record of a key
+  * @param  page: Page to search
+  * @param  key: Key to look for
+  * @param  after: Only look at records after this one, NULL for the whole page
+  * @retval const DataStore_KvRecord_t*: Record, NULL if there is none
+  */
+static const DataStore_KvRecord_t* DataStore_KvFind(uint8_t page, uint16_t key,
+                                                    const DataStore_KvRecord_t* after) {
+  const DataStore_KvRecord_t* found = NULL;
+  const DataStore_KvRecord_t* entry;
+  uint16_t offset = sizeof(DataStore_KvPage_t);
+
+  while ((entry = DataStore_KvNext(page, &offset)) != NULL) {
+    if (entry > after && entry->key == key && DataStore_KvIsValid(entry)) {
+      found = entry;
+    }
+  }
+
+  return found;
+}
+
+/**
+  * @brief  Program a record at the end of a key/value page
+  * @note   The caller holds the flash controller and has checked the room
+  * @param  page: Page to append to
+  * @param  offset: Offset of the first free byte, advanced past the record
+  * @param  key: Record key
+  * @param  version: Layout version of the value
+  * @param  data: Value
+  * @param  length: Value length in bytes
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  */
+static VAL_Status DataStore_KvAppend(uint8_t page, uint16_t* offset, uint16_t key, uint16_t version,
+                                     const void* data, uint16_t length) {
+  DataStore_KvRecord_t* entry = (DataStore_KvRecord_t*)kv_buffer;
+  uint16_t size = sizeof(DataStore_KvRecord_t) + DATA_STORE_KV_ALIGN(length);
+  uint32_t hash;
+  VAL_Status status;
+
+  memset(kv_buffer, 0xFF, sizeof(kv_buffer));
+  entry->key = key;
+  entry->version = version;
+  entry->length = length;
+  memcpy(entry + 1, data, length);
+
+  hash = DataStore_Checksum(FNV_OFFSET_BASIS, (const uint8_t*)entry, offsetof(DataStore_KvRecord_t, check));
+  hash = DataStore_Checksum(hash, (const uint8_t*)(entry + 1), length);
+  entry->check = (uint16_t)(hash ^ (hash >> 16));
+
+  /* The space is used even if programming fails, it is not blank anymore */
+  status = DataStore_Program(DataStore_KvPageAddress(page) + *offset, kv_buffer, size / 8U);
+  *offset += size;
+
+  return status;
+}
+
+/**
+  * @brief  Move the newest records into the other page, then append a value
+  * @note   The caller holds the flash controller. The target page only
+  *         becomes active when its header is programmed, after the records.
+  * @param  key: Key of the new value
+  * @param  version: Layout version of the new value
+  * @param  data: New value
+  * @param  length: New value length in bytes
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  */
+static VAL_Status DataStore_KvCompact(uint16_t key, uint16_t version, const void* data, uint16_t length) {
+  uint8_t target = (kv_page < 0) ? 0 : (uint8_t)((kv_page + 1) % DATA_STORE_KV_PAGES);
+  uint16_t offset = sizeof(DataStore_KvPage_t);
+  DataStore_KvPage_t header = { DATA_STORE_KV_MAGIC, kv_generation + 1 };
+  uint64_t header_word;
+
+  if (DataStore_EraseFlash(DataStore_KvPageAddress(target), 1) != VAL_OK) {
+    return VAL_ERROR;
+  }
+
+  /* Keep the newest valid record of every other key */
+  if (kv_page >= 0) {
+    const DataStore_KvRecord_t* entry;
+    uint16_t walk = sizeof(DataStore_KvPage_t);
+
+    while ((entry = DataStore_KvNext(kv_page, &walk)) != NULL) {
+      if (entry->key == key || !DataStore_KvIsValid(entry) ||
+          DataStore_KvFind(kv_page, entry->key, entry) != NULL) {
+        continue;
+      }
+      if (DataStore_KvAppend(target, &offset, entry->key, entry->version, entry + 1, entry->length) != VAL_OK) {
+        return VAL_ERROR;
+      }
+    }
+  }
+
+  if (DataStore_KvAppend(target, &offset, key, version, data, length) != VAL_OK) {
+    return VAL_ERROR;
+  }
+
+  memcpy(&header_word, &header, sizeof(header_word));
+  if (DataStore_Program(DataStore_KvPageAddress(target), &header_word, 1) != VAL_OK) {
+    return VAL_ERROR;
+  }
+
+  kv_page = (int8_t)target;
+  kv_offset = offset;
+  kv_generation = header.generation;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Read the newest record of a key
+  * @param  key: DATA_STORE_KEY_* value
+  * @param  version: Layout version the caller expects
+  * @param  data: Buffer to store the payload
+  * @param  size: Payload size in bytes
+  * @retval VAL_Status: VAL_OK if a valid record of this version and size was
+  *         read, VAL_ERROR if none is stored, VAL_PARAM if invalid
+  */
+static VAL_Status DataStore_KvLoad(uint16_t key, uint16_t version, void* data, uint16_t size) {
+  const void* payload;
+  VAL_Status status;
+
+  if (data == NULL) {
+    return VAL_PARAM;
+  }
+
+  status = DataStore_KvMap(key, version, size, &payload);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  memcpy(data, payload, size);
+  return VAL_OK;
+}
+
+/**
+  * @brief  Find the payload of the newest record of a key in flash
+  * @param  key: DATA_STORE_KEY_* value
+  * @param  version: Layout version the caller expects
+  * @param  size: Payload size in bytes
+  * @param  data: Pointer to store the payload address, double word aligned
+  * @retval VAL_Status: VAL_OK if a valid record of this version and size was
+  *         found, VAL_ERROR if none is stored, VAL_PARAM if invalid
+  */
+static VAL_Status DataStore_KvMap(uint16_t key, uint16_t version, uint16_t size, const void** data) {
+  const DataStore_KvRecord_t* entry;
+
+  if (data == NULL || size == 0 || size > VAL_DATA_STORE_CONFIG_MAX) {
+    return VAL_PARAM;
+  }
+
+  if (kv_page < 0) {
+    return VAL_ERROR;
+  }
+
+  entry = DataStore_KvFind(kv_page, key, NULL);
+  if (entry == NULL || entry->version != version || entry->length != size) {
+    return VAL_ERROR;
+  }
+
+  *data = entry + 1;
+  return VAL_OK;
+}
+
+/**
+  * @brief  Append a new record of a key, compacting first if the page is full
+  * @param  key: DATA_STORE_KEY_* value
+  * @param  version: Layout version of the payload
+  * @param  data: Payload to store
+  * @param  size: Payload size in bytes
+  * @param  background: true to ask the erase gate before compacting
+  * @retval VAL_Status: VAL_OK if written, VAL_BUSY if flash was in use or the
+  *         gate deferred the compaction, VAL_ERROR if the write failed,
+  *         VAL_PARAM if invalid
+  */
+static VAL_Status DataStore_KvSave(uint16_t key, uint16_t version, const void* data, uint16_t size,
+                                   bool background) {
+  VAL_Status status;
+
+  VAL_ASSERT_TASK_CONTEXT();
+
+  if (data == NULL || size == 0 || size > VAL_DATA_STORE_CONFIG_MAX) {
+    return VAL_PARAM;
+  }
+
+  if (!DataStore_AcquireFlash()) {
+    return VAL_BUSY;
+  }
+
+  if (kv_page >= 0 &&
+      kv_offset + sizeof(DataStore_KvRecord_t) + DATA_STORE_KV_ALIGN(size) <= FLASH_PAGE_SIZE) {
+    status = DataStore_KvAppend(kv_page, &kv_offset, key, version, data, size);
+  } else if (background && !DataStore_MayErase()) {
+    status = VAL_BUSY;
+  } else {
+    status = DataStore_KvCompact(key, version, data, size);
+  }
+
+  DataStore_ReleaseFlash();
+
+  return status;
+}
+
+/**
+  * @brief  Find the active key/value page and its first free byte
+  * @retval None
+  */
+static void DataStore_ScanKv(void) {
+  kv_page = -1;
+  kv_offset = 0;
+  kv_generation = 0;
+
+  for (uint8_t page = 0; page < DATA_STORE_KV_PAGES; page++) {
+    const DataStore_KvPage_t* header = (const DataStore_KvPage_t*)DataStore_KvPageAddress(page);
+
+    if (header->magic == DATA_STORE_KV_MAGIC && (kv_page < 0 || header->generation > kv_generation)) {
+      kv_page = (int8_t)page;
+      kv_generation = header->generation;
+    }
+  }
 
+  if (kv_page >= 0) {
+    kv_offset = sizeof(DataStore_KvPage_t);
+    while (DataStore_KvNext(kv_page, &kv_offset) != NULL) {
+    }
+  }
+}
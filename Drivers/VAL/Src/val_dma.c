@@ -0,0 +1,263 @@
+/**
+  ******************************************************************************
+  * @file    val_dma.c
+  * @brief   Vendor Abstraction Layer for memory to memory DMA copies
+  ******************************************************************************
+  * @attention
+  *
+  * DMA2 channel 2 copies blocks in memory to memory mode, leaving the CPU to
+  * other work; the caller is told by a callback from the channel interrupt.
+  * The channel reads from the peripheral side (CPAR) and writes to the
+  * memory side (CMAR), both incrementing, so the source may be in flash.
+  *
+  * The widest unit both addresses can share is used: words if source and
+  * destination sit at the same offset in a word, half-words at the same
+  * offset in a half-word, bytes otherwise. The bytes before the first
+  * aligned unit and after the last one are copied by the CPU when the copy
+  * is started, the rest in parts of up to 65535 units chained from the
+  * interrupt.
+  *
+  * Setting up the channel and taking the completion interrupt cost a fixed
+  * number of cycles, so a short copy is cheaper on the CPU. VAL_DMA_Copy
+  * only hands a copy to the DMA from VAL_DMA_COPY_MIN_BYTES on, and copies
+  * on the CPU while the channel is taken; bench/copy measures where the
+  * crossover lies. VAL_DMA_Start always uses the channel.
+  *
+  * The interrupt runs at the lowest level: a completion is only a
+  * notification, and nothing time critical waits on it.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_dma.h"
+#include "val_irq_priority.h"
+#include "stm32l4xx_hal.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define COPY_DMA                DMA2_Channel2
+#define COPY_DMA_IRQn           DMA2_Channel2_IRQn
+#define COPY_DMA_PRIORITY       VAL_IRQ_PRIORITY_LOWEST
+#define COPY_DMA_MAX_ITEMS      0xFFFFU       /* CNDTR is 16 bits, longer copies run in parts */
+
+/* Private variables ---------------------------------------------------------*/
+static volatile bool busy = false;
+
+/* Copy in progress, busy */
+static const uint8_t* copy_src;     /* Next part */
+static uint8_t* copy_dest;
+static size_t copy_items;           /* Units not handed to the DMA yet */
+static uint32_t copy_unit;          /* Bytes per unit, 1, 2 or 4 */
+static uint32_t copy_size_bits;     /* PSIZE and MSIZE for the unit */
+static VAL_DMA_Callback_t copy_callback;
+static void* copy_context;
+
+/* Private function prototypes -----------------------------------------------*/
+static bool Dma_Claim(void);
+static void Dma_StartPart(void);
+static void Dma_Finish(VAL_Status status);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Clock DMA2 and enable the copy channel interrupt
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_DMA_Init(void) {
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  COPY_DMA->CCR = 0;
+  DMA2->IFCR = DMA_IFCR_CGIF2;
+  busy = false;
+
+  HAL_NVIC_SetPriority(COPY_DMA_IRQn, COPY_DMA_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(COPY_DMA_IRQn);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Copy a block, by DMA if it is long enough and the channel is free
+  * @note   A CPU copy is done before this returns and calls the callback
+  *         from here; a DMA copy calls it from the interrupt. Either way
+  *         the destination must not be used until the callback. Any context.
+  * @param  dest: Destination, RAM, must not overlap the source
+  * @param  src: Source, RAM or flash, unchanged until the callback
+  * @param  length: Number of bytes
+  * @param  callback: Called once the copy is done, or NULL
+  * @param  context: Passed to the callback
+  * @retval VAL_Status: VAL_OK if copied or started, VAL_PARAM if invalid
+  */
+VAL_Status VAL_DMA_Copy(void* dest, const void* src, size_t length, VAL_DMA_Callback_t callback, void* context) {
+  if ((dest == NULL || src == NULL) && length > 0) {
+    return VAL_PARAM;
+  }
+
+  if (length >= VAL_DMA_COPY_MIN_BYTES &&
+      VAL_DMA_Start(dest, src, length, callback, context) == VAL_OK) {
+    return VAL_OK;
+  }
+
+  memcpy(dest, src, length);
+  if (callback != NULL) {
+    callback(context, VAL_OK);
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Start copying a block by DMA, whatever its length
+  * @note   The unaligned ends are copied before this returns. If nothing is
+  *         left for the DMA the callback is called from here.
+  * @param  dest: Destination, RAM, must not overlap the source
+  * @param  src: Source, RAM or flash, unchanged until the callback
+  * @param  length: Number of bytes, at least 1
+  * @param  callback: Called once the copy is done, or NULL
+  * @param  context: Passed to the callback
+  * @retval VAL_Status: VAL_OK if started, VAL_BUSY if the channel is in use,
+  *         VAL_PARAM if invalid
+  */
+VAL_Status VAL_DMA_Start(void* dest, const void* src, size_t length, VAL_DMA_Callback_t callback, void* context) {
+  uint8_t* to = (uint8_t*)dest;
+  const uint8_t* from = (const uint8_t*)src;
+  uintptr_t offset = (uintptr_t)to ^ (uintptr_t)from;
+  size_t head;
+  size_t tail;
+
+  if (dest == NULL || src == NULL || length == 0) {
+    return VAL_PARAM;
+  }
+
+  if (!Dma_Claim()) {
+    return VAL_BUSY;
+  }
+
+  if ((offset & 3U) == 0U) {
+    copy_unit = 4U;
+    copy_size_bits = DMA_CCR_PSIZE_1 | DMA_CCR_MSIZE_1;
+  } else if ((offset & 1U) == 0U) {
+    copy_unit = 2U;
+    copy_size_bits = DMA_CCR_PSIZE_0 | DMA_CCR_MSIZE_0;
+  } else {
+    copy_unit = 1U;
+    copy_size_bits = 0;
+  }
+
+  /* Bytes up to the first aligned unit and after the last one */
+  head = (copy_unit - ((uintptr_t)to & (copy_unit - 1U))) & (copy_unit - 1U);
+  if (head > length) {
+    head = length;
+  }
+  tail = (length - head) & (copy_unit - 1U);
+  memcpy(to, from, head);
+  memcpy(&to[length - tail], &from[length - tail], tail);
+
+  copy_src = &from[head];
+  copy_dest = &to[head];
+  copy_items = (length - head - tail) / copy_unit;
+  copy_callback = callback;
+  copy_context = context;
+
+  if (copy_items == 0U) {
+    Dma_Finish(VAL_OK);
+    return VAL_OK;
+  }
+
+  Dma_StartPart();
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Check whether a DMA copy is in progress
+  * @retval bool: true until its callback is called
+  */
+bool VAL_DMA_IsBusy(void) {
+  return busy;
+}
+
+/**
+  * @brief  Copy channel interrupt, chains the parts and reports the end
+  * @retval None
+  */
+void VAL_DMA_IRQHandler(void) {
+  uint32_t flags = DMA2->ISR;
+
+  if (flags & DMA_ISR_TEIF2) {
+    Dma_Finish(VAL_ERROR);
+    return;
+  }
+  if ((flags & DMA_ISR_TCIF2) == 0U) {
+    DMA2->IFCR = DMA_IFCR_CGIF2;
+    return;
+  }
+
+  if (copy_items > 0U) {
+    Dma_StartPart();
+    return;
+  }
+
+  Dma_Finish(VAL_OK);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Take the copy channel if it is free
+  * @retval bool: true if taken
+  */
+static bool Dma_Claim(void) {
+  bool claimed = false;
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if (!busy) {
+    busy = true;
+    claimed = true;
+  }
+  __set_PRIMASK(primask);
+
+  return claimed;
+}
+
+/**
+  * @brief  Hand the next part of the copy to the DMA
+  * @retval None
+  */
+static void Dma_StartPart(void) {
+  size_t count = (copy_items > COPY_DMA_MAX_ITEMS) ? COPY_DMA_MAX_ITEMS : copy_items;
+
+  COPY_DMA->CCR = 0;
+  DMA2->IFCR = DMA_IFCR_CGIF2;
+  COPY_DMA->CPAR = (uint32_t)copy_src;
+  COPY_DMA->CMAR = (uint32_t)copy_dest;
+  COPY_DMA->CNDTR = count;
+  copy_src += count * copy_unit;
+  copy_dest += count * copy_unit;
+  copy_items -= count;
+
+  /* Memory to memory, read from CPAR, both sides incrementing, no request line */
+  COPY_DMA->CCR = DMA_CCR_MEM2MEM | DMA_CCR_PINC | DMA_CCR_MINC | copy_size_bits |
+                  DMA_CCR_TCIE | DMA_CCR_TEIE | DMA_CCR_EN;
+}
+
+/**
+  * @brief  Stop the channel, free it and call the callback
+  * @note   Freed first, so the callback may start the next copy
+  * @param  status: VAL_OK if the copy is complete, VAL_ERROR on a bus error
+  * @retval None
+  */
+static void Dma_Finish(VAL_Status status) {
+  VAL_DMA_Callback_t callback = copy_callback;
+  void* context = copy_context;
+
+  COPY_DMA->CCR = 0;
+  DMA2->IFCR = DMA_IFCR_CGIF2;
+  busy = false;
+
+  if (callback != NULL) {
+    callback(context, status);
+  }
+}
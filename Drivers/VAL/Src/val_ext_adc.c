@@ -0,0 +1,468 @@
+/**
+  ******************************************************************************
+  * @file    val_ext_adc.c
+  * @brief   Vendor Abstraction Layer for an external SPI ADC
+  ******************************************************************************
+  * @attention
+  *
+  * Inputs beyond what ADC1 has free can come from a multi-channel SPI ADC
+  * on SPI1, described by the board profile (val_board.h): one 16-bit frame
+  * per conversion, whose command selects the input converted for a later
+  * frame, VAL_BOARD_EXT_ADC_LATENCY frames on. Without such a profile none
+  * of this module is built.
+  *
+  * Conversions need no CPU. TIM16 counts at 1 MHz, as the TIM6 scan
+  * trigger, and its update requests a DMA transfer of the next command
+  * from a circular table into the SPI data register; SPI1 clocks the frame
+  * out with a pulse on NSS between frames (NSSP), which is what starts the
+  * conversion on such devices. The frame received at the same time goes
+  * to a second circular DMA channel, into a ping-pong buffer laid out as
+  * the internal one: blocks of scans, one sample per input in each. The
+  * command table is rotated by the latency, so column N of a scan holds
+  * input N; only the first scan after a start has stale columns, and its
+  * block is dropped.
+  *
+  * val_analog starts, stops and paces this driver with its own sampling,
+  * at the same scan rate and block length, so a block of each comes in
+  * every block period. TIM16 divides the scan period between the frames;
+  * rounded to whole microseconds, the external scan rate may differ from
+  * the internal one by a fraction of a percent, and the blocks are not
+  * aligned. While the internal scans follow the PWM or a strobe, the
+  * external ones keep their own timer at the resulting rate.
+  *
+  * The half-transfer and transfer-complete interrupts hand each completed
+  * block on in the AnalogSampleBlock format of val_analog, masked to the
+  * result bits, and keep the mean of every input over the block; that one
+  * pass is all the CPU spends per sample. The interrupt shares the
+  * sampling level with the internal ADC blocks.
+  *
+  * TIM16 is taken for the frames, so a profile with an external ADC
+  * cannot put a light on it (val_pwm.c). The SPI clock is the fastest the
+  * APB2 clock divides down to within VAL_BOARD_EXT_ADC_SPI_HZ, recomputed
+  * when the system clock changes.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_ext_adc.h"
+
+#if VAL_EXT_ADC_CHANNEL_COUNT > 0
+
+#include "val_sys_clock.h"
+#include "val_irq_priority.h"
+#include "stm32l4xx_hal.h"
+#include <stdbool.h>
+
+/* Private define ------------------------------------------------------------*/
+#define EXT_CHANNELS VAL_EXT_ADC_CHANNEL_COUNT
+#define EXT_SCAN_BLOCKS 2  /* Ping-pong halves */
+#define EXT_BUFFER_SIZE (EXT_SCAN_BLOCKS * ANALOG_MAX_BLOCK_SCANS * EXT_CHANNELS)
+
+#define EXT_SPI                 SPI1
+#define EXT_FRAME_TIMER         TIM16
+#define EXT_FRAME_TIMER_HZ      1000000U       /* Count rate, as the TIM6 scan trigger */
+#define EXT_TX_DMA              DMA1_Channel3  /* TIM16_UP, request 4 */
+#define EXT_TX_DMA_REQUEST      4U
+#define EXT_RX_DMA              DMA1_Channel2  /* SPI1_RX, request 1 */
+#define EXT_RX_DMA_REQUEST      1U
+#define EXT_RX_DMA_IRQn         DMA1_Channel2_IRQn
+#define EXT_DMA_PRIORITY        VAL_IRQ_PRIORITY_SAMPLING
+#define EXT_RATE_MIN_HZ         16U            /* As the internal scans */
+#define EXT_RATE_MAX_HZ         2000U
+#define EXT_BUSY_TIMEOUT        1000U          /* Polls of BSY, a frame takes far fewer */
+#define EXT_SPI_MAX_BR          7U             /* f/256 */
+
+#define EXT_PINS_ON_A           (VAL_BOARD_PA_MASK(VAL_BOARD_EXT_ADC_SCK) | VAL_BOARD_PA_MASK(VAL_BOARD_EXT_ADC_MISO) | \
+                                 VAL_BOARD_PA_MASK(VAL_BOARD_EXT_ADC_MOSI) | VAL_BOARD_PA_MASK(VAL_BOARD_EXT_ADC_NSS))
+
+/* SPI1 (AF5) reaches these pins only */
+_Static_assert(VAL_BOARD_EXT_ADC_SCK == VAL_BOARD_PA(1) || VAL_BOARD_EXT_ADC_SCK == VAL_BOARD_PA(5) ||
+               VAL_BOARD_EXT_ADC_SCK == VAL_BOARD_PB(3), "SPI1 SCK is PA1, PA5 or PB3");
+_Static_assert(VAL_BOARD_EXT_ADC_MISO == VAL_BOARD_PA(6) || VAL_BOARD_EXT_ADC_MISO == VAL_BOARD_PA(11) ||
+               VAL_BOARD_EXT_ADC_MISO == VAL_BOARD_PB(4), "SPI1 MISO is PA6, PA11 or PB4");
+_Static_assert(VAL_BOARD_EXT_ADC_MOSI == VAL_BOARD_PA(7) || VAL_BOARD_EXT_ADC_MOSI == VAL_BOARD_PA(12) ||
+               VAL_BOARD_EXT_ADC_MOSI == VAL_BOARD_PB(5), "SPI1 MOSI is PA7, PA12 or PB5");
+_Static_assert(VAL_BOARD_EXT_ADC_NSS == VAL_BOARD_PA(4) || VAL_BOARD_EXT_ADC_NSS == VAL_BOARD_PA(15) ||
+               VAL_BOARD_EXT_ADC_NSS == VAL_BOARD_PB(0), "SPI1 NSS is PA4, PA15 or PB0");
+_Static_assert((EXT_PINS_ON_A & (VAL_BOARD_ANALOG_PINS | VAL_BOARD_PWM_PINS)) == 0,
+               "External ADC pins taken by a light");
+_Static_assert(!VAL_BOARD_USES_TIM16, "TIM16 paces the external ADC frames");
+_Static_assert(EXT_CHANNELS <= 16, "At most 16 external ADC inputs");
+
+/* Private variables ---------------------------------------------------------*/
+static uint16_t ext_commands[EXT_CHANNELS];      /* Sent in turn, rotated by the latency */
+static uint16_t ext_buffer[EXT_BUFFER_SIZE];
+static uint8_t ext_block_scans = ANALOG_SCANS_PER_BLOCK;
+static uint32_t ext_rate_wanted_hz = EXT_RATE_MIN_HZ;   /* As last started or set */
+static uint32_t ext_rate_hz = 0;                 /* Scan rate reached, 0 while stopped */
+static bool ext_running = false;
+
+static volatile uint32_t ext_scan_count = 0;
+static volatile uint32_t ext_errors = 0;
+static volatile uint8_t ext_skip_blocks = 0;
+static volatile uint32_t ext_means[EXT_CHANNELS];  /* Over the last block */
+static volatile bool ext_valid = false;
+static AnalogBlockCallback ext_block_callback = NULL;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t ExtAdc_TimerClock(void);
+static uint32_t ExtAdc_SpiPrescaler(void);
+static uint32_t ExtAdc_FramePeriod(uint32_t rate_hz);
+static void ExtAdc_WaitIdle(void);
+static void ExtAdc_ProcessBlock(uint8_t block);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Set up the pins, clocks and the command table
+  * @note   Conversions start with VAL_ExtAdc_Start
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_ExtAdc_Init(void) {
+  GPIO_InitTypeDef gpio = {0};
+  static const uint8_t pins[] = {
+    VAL_BOARD_EXT_ADC_SCK, VAL_BOARD_EXT_ADC_MISO, VAL_BOARD_EXT_ADC_MOSI, VAL_BOARD_EXT_ADC_NSS
+  };
+
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  __HAL_RCC_GPIOB_CLK_ENABLE();
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  __HAL_RCC_SPI1_CLK_ENABLE();
+  __HAL_RCC_TIM16_CLK_ENABLE();
+
+  gpio.Mode = GPIO_MODE_AF_PP;
+  gpio.Pull = GPIO_NOPULL;
+  gpio.Speed = GPIO_SPEED_FREQ_HIGH;
+  gpio.Alternate = GPIO_AF5_SPI1;
+  for (uint8_t i = 0; i < sizeof(pins); i++) {
+    gpio.Pin = VAL_BOARD_PIN_MASK(pins[i]);
+    HAL_GPIO_Init(VAL_BOARD_PIN_PORT(pins[i]), &gpio);
+  }
+
+  /* Frame k carries the result of the command sent in frame k - latency */
+  for (uint8_t i = 0; i < EXT_CHANNELS; i++) {
+    ext_commands[i] = (uint16_t)VAL_BOARD_EXT_ADC_COMMAND((i + VAL_BOARD_EXT_ADC_LATENCY) % EXT_CHANNELS);
+  }
+
+  HAL_NVIC_SetPriority(EXT_RX_DMA_IRQn, EXT_DMA_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(EXT_RX_DMA_IRQn);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Start conversions, from the first half of the buffer
+  * @note   Restarts if running. The scan count restarts from 0 and the
+  *         readings stay invalid until the second block.
+  * @param  rate_hz: Scan rate, limited to EXT_RATE_MIN_HZ-EXT_RATE_MAX_HZ
+  * @param  block_scans: Scans per block (1 to ANALOG_MAX_BLOCK_SCANS)
+  * @retval VAL_Status: VAL_OK if started, VAL_PARAM if the block length is out of range
+  */
+VAL_Status VAL_ExtAdc_Start(uint32_t rate_hz, uint8_t block_scans) {
+  if (block_scans == 0 || block_scans > ANALOG_MAX_BLOCK_SCANS) {
+    return VAL_PARAM;
+  }
+
+  VAL_ExtAdc_Stop();
+
+  ext_block_scans = block_scans;
+  ext_rate_wanted_hz = rate_hz;
+  ext_scan_count = 0;
+  ext_valid = false;
+  ext_skip_blocks = (VAL_BOARD_EXT_ADC_LATENCY != 0) ? 1U : 0U;
+
+  /* 16-bit frames, NSS pulsed between them, received frames to the DMA */
+  EXT_SPI->CR1 = 0;
+  EXT_SPI->CR2 = (15U << SPI_CR2_DS_Pos) | SPI_CR2_SSOE | SPI_CR2_NSSP | SPI_CR2_RXDMAEN;
+  EXT_SPI->CR1 = SPI_CR1_MSTR | (ExtAdc_SpiPrescaler() << SPI_CR1_BR_Pos) | SPI_CR1_SPE;
+
+  MODIFY_REG(DMA1_CSELR->CSELR, DMA_CSELR_C2S | DMA_CSELR_C3S,
+             (EXT_RX_DMA_REQUEST << DMA_CSELR_C2S_Pos) | (EXT_TX_DMA_REQUEST << DMA_CSELR_C3S_Pos));
+
+  /* Received frames into the ping-pong buffer, both halves per lap */
+  DMA1->IFCR = DMA_IFCR_CGIF2 | DMA_IFCR_CGIF3;
+  EXT_RX_DMA->CPAR = (uint32_t)&EXT_SPI->DR;
+  EXT_RX_DMA->CMAR = (uint32_t)ext_buffer;
+  EXT_RX_DMA->CNDTR = EXT_SCAN_BLOCKS * block_scans * EXT_CHANNELS;
+  EXT_RX_DMA->CCR = DMA_CCR_PL_1 | DMA_CCR_PSIZE_0 | DMA_CCR_MSIZE_0 | DMA_CCR_MINC | DMA_CCR_CIRC |
+                    DMA_CCR_HTIE | DMA_CCR_TCIE | DMA_CCR_TEIE | DMA_CCR_EN;
+
+  /* One command per timer update */
+  EXT_TX_DMA->CPAR = (uint32_t)&EXT_SPI->DR;
+  EXT_TX_DMA->CMAR = (uint32_t)ext_commands;
+  EXT_TX_DMA->CNDTR = EXT_CHANNELS;
+  EXT_TX_DMA->CCR = DMA_CCR_PL_1 | DMA_CCR_DIR | DMA_CCR_PSIZE_0 | DMA_CCR_MSIZE_0 | DMA_CCR_MINC |
+                    DMA_CCR_CIRC | DMA_CCR_TEIE | DMA_CCR_EN;
+
+  EXT_FRAME_TIMER->CR1 = TIM_CR1_ARPE;
+  EXT_FRAME_TIMER->PSC = ExtAdc_TimerClock() / EXT_FRAME_TIMER_HZ - 1U;
+  EXT_FRAME_TIMER->ARR = ExtAdc_FramePeriod(rate_hz) - 1U;
+  EXT_FRAME_TIMER->EGR = TIM_EGR_UG;
+  EXT_FRAME_TIMER->SR = 0;
+  EXT_FRAME_TIMER->DIER = TIM_DIER_UDE;
+  EXT_FRAME_TIMER->CR1 |= TIM_CR1_CEN;
+
+  ext_rate_hz = EXT_FRAME_TIMER_HZ / (ExtAdc_FramePeriod(rate_hz) * EXT_CHANNELS);
+  ext_running = true;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Stop conversions after the frame in progress
+  * @note   The readings keep their last values
+  * @retval None
+  */
+void VAL_ExtAdc_Stop(void) {
+  EXT_FRAME_TIMER->CR1 &= ~TIM_CR1_CEN;
+  EXT_FRAME_TIMER->DIER = 0;
+  ExtAdc_WaitIdle();
+
+  EXT_TX_DMA->CCR = 0;
+  EXT_RX_DMA->CCR = 0;
+  DMA1->IFCR = DMA_IFCR_CGIF2 | DMA_IFCR_CGIF3;
+  EXT_SPI->CR1 = 0;
+  EXT_SPI->CR2 = 0;
+  HAL_NVIC_ClearPendingIRQ(EXT_RX_DMA_IRQn);
+
+  ext_rate_hz = 0;
+  ext_running = false;
+}
+
+/**
+  * @brief  Change the scan rate without a restart
+  * @note   The period is preloaded and applies from the next frame
+  * @param  rate_hz: Scan rate, limited to EXT_RATE_MIN_HZ-EXT_RATE_MAX_HZ
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_ExtAdc_SetSampleRate(uint32_t rate_hz) {
+  uint32_t period = ExtAdc_FramePeriod(rate_hz);
+
+  ext_rate_wanted_hz = rate_hz;
+  if (ext_running) {
+    EXT_FRAME_TIMER->ARR = period - 1U;
+    ext_rate_hz = EXT_FRAME_TIMER_HZ / (period * EXT_CHANNELS);
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the scan rate reached
+  * @retval uint32_t: Scans per second, 0 while stopped
+  */
+uint32_t VAL_ExtAdc_GetSampleRate(void) {
+  return ext_rate_hz;
+}
+
+/**
+  * @brief  Keep the frame rate and the SPI clock after a system clock change
+  * @note   Called by VAL_SysClock_SetLevel with interrupts disabled. The
+  *         frames pause while the SPI clock is changed.
+  * @retval None
+  */
+void VAL_ExtAdc_UpdateClock(void) {
+  EXT_FRAME_TIMER->PSC = ExtAdc_TimerClock() / EXT_FRAME_TIMER_HZ - 1U;
+
+  if (!ext_running) {
+    return;
+  }
+
+  /* BR only changes with the SPI disabled, between frames */
+  EXT_FRAME_TIMER->CR1 &= ~TIM_CR1_CEN;
+  ExtAdc_WaitIdle();
+  EXT_SPI->CR1 &= ~SPI_CR1_SPE;
+  MODIFY_REG(EXT_SPI->CR1, SPI_CR1_BR, ExtAdc_SpiPrescaler() << SPI_CR1_BR_Pos);
+  EXT_SPI->CR1 |= SPI_CR1_SPE;
+  EXT_FRAME_TIMER->CR1 |= TIM_CR1_CEN;
+}
+
+/**
+  * @brief  Set the function called with every completed block
+  * @param  callback: Called from the block interrupt, NULL for none
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_ExtAdc_SetBlockCallback(AnalogBlockCallback callback) {
+  ext_block_callback = callback;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the reading of an input: its mean over the last block
+  * @param  input: Input of the external ADC (1-VAL_EXT_ADC_CHANNEL_COUNT)
+  * @param  counts: Mean in counts of the device, masked to its result bits
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid,
+  *         VAL_ERROR before the first block
+  */
+VAL_Status VAL_ExtAdc_GetCounts(uint8_t input, uint32_t* counts) {
+  if (input < 1 || input > EXT_CHANNELS || counts == NULL) {
+    return VAL_PARAM;
+  }
+  if (!ext_valid) {
+    return VAL_ERROR;
+  }
+
+  *counts = ext_means[input - 1];
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the number of scans completed since the last start
+  * @retval uint32_t: Scan count
+  */
+uint32_t VAL_ExtAdc_GetSampleCount(void) {
+  return ext_scan_count;
+}
+
+/**
+  * @brief  Get the number of DMA errors since start-up
+  * @note   Each restarted the conversions
+  * @retval uint32_t: Error count
+  */
+uint32_t VAL_ExtAdc_GetErrorCount(void) {
+  return ext_errors;
+}
+
+/**
+  * @brief  Receive DMA interrupt: hand on the block just completed
+  * @retval None
+  */
+void VAL_ExtAdc_IRQHandler(void) {
+  uint32_t flags = DMA1->ISR;
+
+  if (flags & (DMA_ISR_TEIF2 | DMA_ISR_TEIF3)) {
+    /* The channel disabled itself */
+    ext_errors++;
+    VAL_ExtAdc_Start(ext_rate_wanted_hz, ext_block_scans);
+    return;
+  }
+
+  if (flags & DMA_ISR_HTIF2) {
+    DMA1->IFCR = DMA_IFCR_CHTIF2;
+    ExtAdc_ProcessBlock(0);
+  }
+  if (flags & DMA_ISR_TCIF2) {
+    DMA1->IFCR = DMA_IFCR_CTCIF2;
+    ExtAdc_ProcessBlock(1);
+  }
+}
+
+/**
+  * @brief  Stop conversions and release the pins and clocks
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_ExtAdc_DeInit(void) {
+  static const uint8_t pins[] = {
+    VAL_BOARD_EXT_ADC_SCK, VAL_BOARD_EXT_ADC_MISO, VAL_BOARD_EXT_ADC_MOSI, VAL_BOARD_EXT_ADC_NSS
+  };
+
+  VAL_ExtAdc_Stop();
+  HAL_NVIC_DisableIRQ(EXT_RX_DMA_IRQn);
+  for (uint8_t i = 0; i < sizeof(pins); i++) {
+    HAL_GPIO_DeInit(VAL_BOARD_PIN_PORT(pins[i]), VAL_BOARD_PIN_MASK(pins[i]));
+  }
+  __HAL_RCC_SPI1_CLK_DISABLE();
+  __HAL_RCC_TIM16_CLK_DISABLE();
+
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Get the TIM16 input clock
+  * @retval uint32_t: APB2 timer clock in Hz, twice PCLK2 when it is divided
+  */
+static uint32_t ExtAdc_TimerClock(void) {
+  uint32_t clock_hz = HAL_RCC_GetPCLK2Freq();
+
+  if ((RCC->CFGR & RCC_CFGR_PPRE2) != RCC_CFGR_PPRE2_DIV1) {
+    clock_hz *= 2U;
+  }
+
+  return clock_hz;
+}
+
+/**
+  * @brief  Get the SPI baud rate divider for the present clock
+  * @retval uint32_t: BR field, the smallest divider within VAL_BOARD_EXT_ADC_SPI_HZ
+  */
+static uint32_t ExtAdc_SpiPrescaler(void) {
+  uint32_t clock_hz = HAL_RCC_GetPCLK2Freq();
+  uint32_t br = 0;
+
+  while (br < EXT_SPI_MAX_BR && (clock_hz >> (br + 1U)) > VAL_BOARD_EXT_ADC_SPI_HZ) {
+    br++;
+  }
+
+  return br;
+}
+
+/**
+  * @brief  Get the frame period for a scan rate
+  * @param  rate_hz: Scan rate, limited to EXT_RATE_MIN_HZ-EXT_RATE_MAX_HZ
+  * @retval uint32_t: Timer counts between frames
+  */
+static uint32_t ExtAdc_FramePeriod(uint32_t rate_hz) {
+  if (rate_hz < EXT_RATE_MIN_HZ) {
+    rate_hz = EXT_RATE_MIN_HZ;
+  } else if (rate_hz > EXT_RATE_MAX_HZ) {
+    rate_hz = EXT_RATE_MAX_HZ;
+  }
+
+  return EXT_FRAME_TIMER_HZ / (rate_hz * EXT_CHANNELS);
+}
+
+/**
+  * @brief  Wait for the frame in progress to end
+  * @retval None
+  */
+static void ExtAdc_WaitIdle(void) {
+  for (uint32_t polls = 0; polls < EXT_BUSY_TIMEOUT && (EXT_SPI->SR & SPI_SR_BSY) != 0U; polls++) {
+  }
+}
+
+/**
+  * @brief  Mask, average and hand on a completed block
+  * @param  block: Half of the buffer (0 or 1)
+  * @retval None
+  */
+static void ExtAdc_ProcessBlock(uint8_t block) {
+  uint16_t* samples = &ext_buffer[block * ext_block_scans * EXT_CHANNELS];
+  uint32_t sums[EXT_CHANNELS] = {0};
+  AnalogSampleBlock info;
+
+  info.start_us = VAL_SysClock_GetMicros();
+  info.first_sample = ext_scan_count;
+  info.scan_count = ext_block_scans;
+  info.samples = samples;
+  ext_scan_count += ext_block_scans;
+
+  /* The first scan after a start holds results of no command */
+  if (ext_skip_blocks != 0) {
+    ext_skip_blocks--;
+    return;
+  }
+
+  for (uint8_t scan = 0; scan < ext_block_scans; scan++) {
+    for (uint8_t ch = 0; ch < EXT_CHANNELS; ch++) {
+      uint16_t value = *samples & (uint16_t)VAL_BOARD_EXT_ADC_DATA_MASK;
+
+      *samples++ = value;
+      sums[ch] += value;
+    }
+  }
+  for (uint8_t ch = 0; ch < EXT_CHANNELS; ch++) {
+    ext_means[ch] = (sums[ch] + ext_block_scans / 2U) / ext_block_scans;
+  }
+  ext_valid = true;
+
+  if (ext_block_callback != NULL) {
+    ext_block_callback(&info);
+  }
+}
+
+#endif /* VAL_EXT_ADC_CHANNEL_COUNT > 0 */
@@ -0,0 +1,471 @@
+/**
+  ******************************************************************************
+  * @file    val_i2c_temp.c
+  * @brief   Vendor Abstraction Layer for digital I2C temperature sensors
+  ******************************************************************************
+  * @attention
+  *
+  * Some LED boards carry a digital temperature sensor on I2C instead of
+  * the thermistor divider, one per light, described by the board profile
+  * (val_board.h): the 7-bit address of each in light ID order, the
+  * register holding the temperature and its conversion to centi-degrees.
+  * Without such a profile none of this module is built.
+  *
+  * No task ever waits on the bus. LPTIM2, counting the LSE, paces a
+  * round-robin: each match starts the read of the next sensor, so every
+  * one is read once per VAL_BOARD_I2C_TEMP_PERIOD_MS. A read is a write of
+  * the register pointer, a repeated start and two bytes back, MSB first,
+  * stepped by the event interrupt (TXIS, TC, RXNE, STOPF), five interrupts
+  * of a few instructions each; the last one converts the value and
+  * publishes it. Reads are too short for DMA to pay off, which would also
+  * take two more channels. On a start the first round is chained, one read
+  * right after the other, so all readings are there within about a
+  * millisecond instead of a period.
+  *
+  * val_analog takes the temperature of each light from here instead of its
+  * ADC input and converts it to counts through the calibration of the
+  * light, so the sensor snapshot, the alarms, the derating and the
+  * telemetry read it as before. A sensor that did not answer
+  * I2C_TEMP_MAX_FAILS reads in a row (NACK, bus error, or a read still
+  * running at the next match, then aborted) has no reading; val_analog
+  * gives it as zero counts, an open input, which the sensor checks of the
+  * LED driver take as a fault. So does a sensor never read since start-up.
+  *
+  * The bus runs at 100 kHz from PCLK1, its timing recomputed when the
+  * system clock changes. LPTIM2 does not run in STOP2; val_analog stops
+  * the reads with the sampling and restarts them on resume. Both
+  * interrupts share the sampling level with the ADC blocks that read the
+  * results.
+  *
+  * I2C1 reaches the pins on PA9 (SCL) and PA10 (SDA), I2C3 on PA7 and PB4;
+  * PB6 and PB7 are USART1. With I2C3, PB4 cannot also be the CTS input of
+  * the serial flow control.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_i2c_temp.h"
+
+#if VAL_I2C_TEMP_ENABLED
+
+#include "val_channels.h"
+#include "val_irq_priority.h"
+#include "stm32l4xx_hal.h"
+#include <stdbool.h>
+
+/* Private define ------------------------------------------------------------*/
+#define I2C_TEMP_SENSORS        VAL_LIGHT_COUNT
+#define I2C_TEMP_TIMER          LPTIM2
+#define I2C_TEMP_TIMER_IRQn     LPTIM2_IRQn
+#define I2C_TEMP_TIMER_HZ       32768U   /* LSE */
+#define I2C_TEMP_READ_TICKS     ((I2C_TEMP_TIMER_HZ * VAL_BOARD_I2C_TEMP_PERIOD_MS) / (1000U * I2C_TEMP_SENSORS))
+#define I2C_TEMP_MIN_TICKS      164U     /* 5 ms, many times a read */
+#define I2C_TEMP_PRIORITY       VAL_IRQ_PRIORITY_SAMPLING
+#define I2C_TEMP_MAX_FAILS      3U       /* Reads in a row without an answer before a sensor has no reading */
+#define I2C_TEMP_DATA_BYTES     2U
+
+/* Standard mode timing, in ns, and the prescaled clock it is counted in */
+#define I2C_TEMP_PRESC_HZ       4000000U
+#define I2C_TEMP_PRESC_MAX      16U
+#define I2C_TEMP_SCL_LOW_NS     5000U
+#define I2C_TEMP_SCL_HIGH_NS    4000U
+#define I2C_TEMP_SETUP_NS       1250U
+#define I2C_TEMP_HOLD_NS        500U
+
+#define I2C_TEMP_ERRORS         (I2C_ISR_BERR | I2C_ISR_ARLO | I2C_ISR_OVR | I2C_ISR_PECERR | I2C_ISR_TIMEOUT)
+#define I2C_TEMP_ALL_FLAGS      (I2C_ICR_ADDRCF | I2C_ICR_NACKCF | I2C_ICR_STOPCF | I2C_ICR_BERRCF | \
+                                 I2C_ICR_ARLOCF | I2C_ICR_OVRCF | I2C_ICR_PECCF | I2C_ICR_TIMOUTCF | \
+                                 I2C_ICR_ALERTCF)
+
+#if VAL_BOARD_I2C_TEMP_SCL == VAL_BOARD_PA(7)
+#define I2C_TEMP_I2C            I2C3
+#define I2C_TEMP_EV_IRQn        I2C3_EV_IRQn
+#define I2C_TEMP_ER_IRQn        I2C3_ER_IRQn
+#define I2C_TEMP_AF             GPIO_AF4_I2C3
+#define I2C_TEMP_CLK_ENABLE()   do { __HAL_RCC_I2C3_CONFIG(RCC_I2C3CLKSOURCE_PCLK1); __HAL_RCC_I2C3_CLK_ENABLE(); } while (0)
+#define I2C_TEMP_CLK_DISABLE()  __HAL_RCC_I2C3_CLK_DISABLE()
+_Static_assert(VAL_BOARD_I2C_TEMP_SDA == VAL_BOARD_PB(4), "I2C3 SDA is PB4");
+#else
+#define I2C_TEMP_I2C            I2C1
+#define I2C_TEMP_EV_IRQn        I2C1_EV_IRQn
+#define I2C_TEMP_ER_IRQn        I2C1_ER_IRQn
+#define I2C_TEMP_AF             GPIO_AF4_I2C1
+#define I2C_TEMP_CLK_ENABLE()   do { __HAL_RCC_I2C1_CONFIG(RCC_I2C1CLKSOURCE_PCLK1); __HAL_RCC_I2C1_CLK_ENABLE(); } while (0)
+#define I2C_TEMP_CLK_DISABLE()  __HAL_RCC_I2C1_CLK_DISABLE()
+_Static_assert(VAL_BOARD_I2C_TEMP_SCL == VAL_BOARD_PA(9), "I2C1 SCL is PA9, I2C3 SCL PA7; PB6 is USART1");
+_Static_assert(VAL_BOARD_I2C_TEMP_SDA == VAL_BOARD_PA(10), "I2C1 SDA is PA10; PB7 is USART1");
+#endif
+
+#define I2C_TEMP_PINS_ON_A      (VAL_BOARD_PA_MASK(VAL_BOARD_I2C_TEMP_SCL) | VAL_BOARD_PA_MASK(VAL_BOARD_I2C_TEMP_SDA))
+
+_Static_assert((I2C_TEMP_PINS_ON_A & (VAL_BOARD_ANALOG_PINS | VAL_BOARD_PWM_PINS)) == 0,
+               "I2C temperature sensor pins taken by a light");
+_Static_assert(I2C_TEMP_READ_TICKS >= I2C_TEMP_MIN_TICKS, "I2C temperature period too short for the sensor count");
+_Static_assert(I2C_TEMP_READ_TICKS <= 0xFFFFU, "I2C temperature period beyond the LPTIM2 range");
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t i2c_addresses[] = { VAL_BOARD_I2C_TEMP_ADDRESSES };
+_Static_assert(sizeof(i2c_addresses) == I2C_TEMP_SENSORS, "One I2C temperature sensor per light");
+
+static volatile int32_t i2c_temperature_cdeg[I2C_TEMP_SENSORS];
+static volatile uint8_t i2c_fails[I2C_TEMP_SENSORS];   /* Reads in a row without an answer */
+static uint8_t i2c_data[I2C_TEMP_DATA_BYTES];
+static uint8_t i2c_received = 0;
+static uint8_t i2c_sensor = 0;        /* Index of the read in progress or last done */
+static uint8_t i2c_priming = 0;       /* Reads left in the chained first round */
+static bool i2c_busy = false;
+static bool i2c_failed = false;       /* The read in progress got a NACK */
+static bool i2c_ready = false;        /* Clocked and configured */
+static volatile uint32_t i2c_reads = 0;
+static volatile uint32_t i2c_errors = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t I2CTemp_Timing(void);
+static void I2CTemp_ReadNext(void);
+static void I2CTemp_Abort(void);
+static void I2CTemp_Finish(bool answered);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Set up the pins, clocks, the bus timing and the read timer
+  * @note   Reads start with VAL_I2CTemp_Start; until then no sensor has
+  *         a reading
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_I2CTemp_Init(void) {
+  GPIO_InitTypeDef gpio = {0};
+  static const uint8_t pins[] = { VAL_BOARD_I2C_TEMP_SCL, VAL_BOARD_I2C_TEMP_SDA };
+
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  __HAL_RCC_GPIOB_CLK_ENABLE();
+  I2C_TEMP_CLK_ENABLE();
+  __HAL_RCC_LPTIM2_CONFIG(RCC_LPTIM2CLKSOURCE_LSE);
+  __HAL_RCC_LPTIM2_CLK_ENABLE();
+
+  /* Open drain; the internal pull-ups only hold the lines up while the
+   * board ones are missing, they are too weak for the bus */
+  gpio.Mode = GPIO_MODE_AF_OD;
+  gpio.Pull = GPIO_PULLUP;
+  gpio.Speed = GPIO_SPEED_FREQ_LOW;
+  gpio.Alternate = I2C_TEMP_AF;
+  for (uint8_t i = 0; i < sizeof(pins); i++) {
+    gpio.Pin = VAL_BOARD_PIN_MASK(pins[i]);
+    HAL_GPIO_Init(VAL_BOARD_PIN_PORT(pins[i]), &gpio);
+  }
+
+  I2C_TEMP_I2C->CR1 = 0;
+  I2C_TEMP_I2C->TIMINGR = I2CTemp_Timing();
+  I2C_TEMP_I2C->CR1 = I2C_CR1_TXIE | I2C_CR1_RXIE | I2C_CR1_TCIE | I2C_CR1_STOPIE | I2C_CR1_NACKIE |
+                      I2C_CR1_ERRIE | I2C_CR1_PE;
+
+  I2C_TEMP_TIMER->CR = 0;
+  I2C_TEMP_TIMER->CFGR = 0;                 /* Prescaler 1, software start */
+  I2C_TEMP_TIMER->IER = LPTIM_IER_ARRMIE;   /* Only writable while disabled */
+
+  for (uint8_t i = 0; i < I2C_TEMP_SENSORS; i++) {
+    i2c_fails[i] = I2C_TEMP_MAX_FAILS;
+  }
+  i2c_ready = true;
+
+  HAL_NVIC_SetPriority(I2C_TEMP_EV_IRQn, I2C_TEMP_PRIORITY, 0);
+  HAL_NVIC_SetPriority(I2C_TEMP_ER_IRQn, I2C_TEMP_PRIORITY, 0);
+  HAL_NVIC_SetPriority(I2C_TEMP_TIMER_IRQn, I2C_TEMP_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(I2C_TEMP_EV_IRQn);
+  HAL_NVIC_EnableIRQ(I2C_TEMP_ER_IRQn);
+  HAL_NVIC_EnableIRQ(I2C_TEMP_TIMER_IRQn);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Start the round-robin reads, the first round back to back
+  * @note   Restarts if running. The readings are kept: a sensor that had
+  *         one keeps it until its next read.
+  * @retval VAL_Status: VAL_OK if started, VAL_ERROR before VAL_I2CTemp_Init
+  */
+VAL_Status VAL_I2CTemp_Start(void) {
+  uint32_t primask;
+
+  if (!i2c_ready) {
+    return VAL_ERROR;
+  }
+
+  VAL_I2CTemp_Stop();
+
+  I2C_TEMP_TIMER->CR = LPTIM_CR_ENABLE;
+  I2C_TEMP_TIMER->ICR = LPTIM_ICR_ARRMCF | LPTIM_ICR_ARROKCF;
+  I2C_TEMP_TIMER->ARR = I2C_TEMP_READ_TICKS - 1U;
+  while ((I2C_TEMP_TIMER->ISR & LPTIM_ISR_ARROK) == 0U) {
+  }
+  I2C_TEMP_TIMER->CR |= LPTIM_CR_CNTSTRT;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  i2c_sensor = I2C_TEMP_SENSORS - 1U;
+  i2c_priming = I2C_TEMP_SENSORS;
+  I2CTemp_ReadNext();
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Stop the reads, aborting the one in progress
+  * @note   The readings keep their values
+  * @retval None
+  */
+void VAL_I2CTemp_Stop(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  I2C_TEMP_TIMER->CR = 0;
+  HAL_NVIC_ClearPendingIRQ(I2C_TEMP_TIMER_IRQn);
+  i2c_priming = 0;
+  if (i2c_busy) {
+    I2CTemp_Abort();
+    i2c_busy = false;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Keep the bus at 100 kHz after a system clock change
+  * @note   Called by VAL_SysClock_SetLevel with interrupts disabled. A
+  *         read in progress is aborted and counts as unanswered.
+  * @retval None
+  */
+void VAL_I2CTemp_UpdateClock(void) {
+  if (!i2c_ready) {
+    return;
+  }
+
+  /* TIMINGR only changes with the peripheral disabled */
+  I2C_TEMP_I2C->CR1 &= ~I2C_CR1_PE;
+  I2C_TEMP_I2C->TIMINGR = I2CTemp_Timing();
+  I2C_TEMP_I2C->CR1 |= I2C_CR1_PE;
+
+  if (i2c_busy) {
+    I2CTemp_Finish(false);
+  }
+}
+
+/**
+  * @brief  Get the last reading of the sensor of a light
+  * @param  lightId: Light ID (1-VAL_LIGHT_COUNT)
+  * @param  temperature_cdeg: Pointer to store temperature in centi-degrees Celsius
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid,
+  *         VAL_ERROR if the sensor has no reading
+  */
+VAL_Status VAL_I2CTemp_GetTemperature(uint8_t lightId, int32_t* temperature_cdeg) {
+  if (lightId < 1 || lightId > I2C_TEMP_SENSORS || temperature_cdeg == NULL) {
+    return VAL_PARAM;
+  }
+  if (i2c_fails[lightId - 1] >= I2C_TEMP_MAX_FAILS) {
+    return VAL_ERROR;
+  }
+
+  *temperature_cdeg = i2c_temperature_cdeg[lightId - 1];
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the number of reads answered since start-up
+  * @retval uint32_t: Read count
+  */
+uint32_t VAL_I2CTemp_GetReadCount(void) {
+  return i2c_reads;
+}
+
+/**
+  * @brief  Get the number of reads without an answer since start-up
+  * @retval uint32_t: Error count
+  */
+uint32_t VAL_I2CTemp_GetErrorCount(void) {
+  return i2c_errors;
+}
+
+/**
+  * @brief  LPTIM2 interrupt: start the read of the next sensor
+  * @note   A read still running has hung on the bus and is aborted
+  * @retval None
+  */
+void VAL_I2CTemp_TimerIRQHandler(void) {
+  I2C_TEMP_TIMER->ICR = LPTIM_ICR_ARRMCF;
+
+  if (i2c_busy) {
+    I2CTemp_Abort();
+    I2CTemp_Finish(false);
+  }
+  if (!i2c_busy) {
+    I2CTemp_ReadNext();
+  }
+}
+
+/**
+  * @brief  I2C event and error interrupt: step the read in progress
+  * @note   After a NACK the peripheral sends the stop itself; a bus error
+  *         or a lost arbitration has none, the read is aborted
+  * @retval None
+  */
+void VAL_I2CTemp_IRQHandler(void) {
+  uint32_t isr = I2C_TEMP_I2C->ISR;
+
+  if (isr & I2C_TEMP_ERRORS) {
+    I2C_TEMP_I2C->ICR = I2C_TEMP_ALL_FLAGS;
+    if (i2c_busy) {
+      I2CTemp_Abort();
+      I2CTemp_Finish(false);
+    }
+    return;
+  }
+
+  if (isr & I2C_ISR_NACKF) {
+    I2C_TEMP_I2C->ICR = I2C_ICR_NACKCF;
+    i2c_failed = true;
+  }
+  if (isr & I2C_ISR_TXIS) {
+    I2C_TEMP_I2C->TXDR = VAL_BOARD_I2C_TEMP_REGISTER;
+  }
+  if (isr & I2C_ISR_RXNE) {
+    uint8_t value = (uint8_t)I2C_TEMP_I2C->RXDR;
+
+    if (i2c_received < I2C_TEMP_DATA_BYTES) {
+      i2c_data[i2c_received++] = value;
+    }
+  }
+  if (isr & I2C_ISR_TC) {
+    /* Register pointer sent: repeated start to read the value back */
+    I2C_TEMP_I2C->CR2 = ((uint32_t)i2c_addresses[i2c_sensor] << 1) | I2C_CR2_RD_WRN |
+                        (I2C_TEMP_DATA_BYTES << I2C_CR2_NBYTES_Pos) | I2C_CR2_AUTOEND | I2C_CR2_START;
+  }
+  if (isr & I2C_ISR_STOPF) {
+    I2C_TEMP_I2C->ICR = I2C_ICR_STOPCF;
+    if (i2c_busy) {
+      I2CTemp_Finish(!i2c_failed && i2c_received == I2C_TEMP_DATA_BYTES);
+    }
+  }
+}
+
+/**
+  * @brief  Stop the reads and release the pins and clocks
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_I2CTemp_DeInit(void) {
+  static const uint8_t pins[] = { VAL_BOARD_I2C_TEMP_SCL, VAL_BOARD_I2C_TEMP_SDA };
+
+  VAL_I2CTemp_Stop();
+  HAL_NVIC_DisableIRQ(I2C_TEMP_EV_IRQn);
+  HAL_NVIC_DisableIRQ(I2C_TEMP_ER_IRQn);
+  HAL_NVIC_DisableIRQ(I2C_TEMP_TIMER_IRQn);
+  I2C_TEMP_I2C->CR1 = 0;
+  i2c_ready = false;
+
+  for (uint8_t i = 0; i < sizeof(pins); i++) {
+    HAL_GPIO_DeInit(VAL_BOARD_PIN_PORT(pins[i]), VAL_BOARD_PIN_MASK(pins[i]));
+  }
+  I2C_TEMP_CLK_DISABLE();
+  __HAL_RCC_LPTIM2_CLK_DISABLE();
+
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Compute the standard mode bus timing for the present PCLK1
+  * @note   The prescaled clock is about 4 MHz, at most PCLK1 / 16 above
+  *         64 MHz; each period is rounded up to whole prescaled clocks
+  * @retval uint32_t: TIMINGR value
+  */
+static uint32_t I2CTemp_Timing(void) {
+  uint64_t clock_hz = HAL_RCC_GetPCLK1Freq();
+  uint32_t presc = (uint32_t)((clock_hz + I2C_TEMP_PRESC_HZ - 1U) / I2C_TEMP_PRESC_HZ);
+  uint64_t ns_per_tick;
+  uint32_t scll, sclh, scldel, sdadel;
+
+  if (presc == 0) {
+    presc = 1;
+  } else if (presc > I2C_TEMP_PRESC_MAX) {
+    presc = I2C_TEMP_PRESC_MAX;
+  }
+
+  /* In 1/1000 ns, so that the rounding stays on the safe side */
+  ns_per_tick = (presc * 1000000000000ULL) / clock_hz;
+  scll = (uint32_t)((I2C_TEMP_SCL_LOW_NS * 1000ULL + ns_per_tick - 1U) / ns_per_tick);
+  sclh = (uint32_t)((I2C_TEMP_SCL_HIGH_NS * 1000ULL + ns_per_tick - 1U) / ns_per_tick);
+  scldel = (uint32_t)((I2C_TEMP_SETUP_NS * 1000ULL + ns_per_tick - 1U) / ns_per_tick);
+  sdadel = (uint32_t)((I2C_TEMP_HOLD_NS * 1000ULL + ns_per_tick - 1U) / ns_per_tick);
+
+  /* SCLL, SCLH and SCLDEL count one more than written */
+  scll = (scll > 256U) ? 255U : scll - 1U;
+  sclh = (sclh > 256U) ? 255U : sclh - 1U;
+  scldel = (scldel > 16U) ? 15U : ((scldel > 0U) ? scldel - 1U : 0U);
+  sdadel = (sdadel > 15U) ? 15U : sdadel;
+
+  return ((presc - 1U) << I2C_TIMINGR_PRESC_Pos) | (scldel << I2C_TIMINGR_SCLDEL_Pos) |
+         (sdadel << I2C_TIMINGR_SDADEL_Pos) | (sclh << I2C_TIMINGR_SCLH_Pos) | (scll << I2C_TIMINGR_SCLL_Pos);
+}
+
+/**
+  * @brief  Start the read of the next sensor in turn
+  * @note   Called with interrupts disabled or from the driver interrupts
+  * @retval None
+  */
+static void I2CTemp_ReadNext(void) {
+  i2c_sensor = (uint8_t)((i2c_sensor + 1U) % I2C_TEMP_SENSORS);
+  i2c_received = 0;
+  i2c_failed = false;
+  i2c_busy = true;
+
+  /* Write the register pointer; TC then turns the bus around */
+  I2C_TEMP_I2C->ICR = I2C_TEMP_ALL_FLAGS;
+  I2C_TEMP_I2C->CR2 = ((uint32_t)i2c_addresses[i2c_sensor] << 1) | (1U << I2C_CR2_NBYTES_Pos) | I2C_CR2_START;
+}
+
+/**
+  * @brief  Abort the read in progress and release the bus
+  * @note   Clearing PE resets the peripheral state and its flags; it has
+  *         to stay clear for three APB clocks
+  * @retval None
+  */
+static void I2CTemp_Abort(void) {
+  I2C_TEMP_I2C->CR1 &= ~I2C_CR1_PE;
+  for (uint8_t i = 0; i < 3U; i++) {
+    (void)I2C_TEMP_I2C->CR1;
+  }
+  I2C_TEMP_I2C->CR2 = 0;
+  I2C_TEMP_I2C->CR1 |= I2C_CR1_PE;
+}
+
+/**
+  * @brief  Publish the reading of a finished read, or count it unanswered
+  * @note   During the first round the next read follows at once
+  * @param  answered: The sensor returned both bytes
+  * @retval None
+  */
+static void I2CTemp_Finish(bool answered) {
+  uint8_t index = i2c_sensor;
+
+  i2c_busy = false;
+  if (answered) {
+    uint16_t raw = (uint16_t)((i2c_data[0] << 8) | i2c_data[1]);
+
+    i2c_temperature_cdeg[index] = (int32_t)(VAL_BOARD_I2C_TEMP_CDEG(raw));
+    i2c_fails[index] = 0;
+    i2c_reads++;
+  } else {
+    i2c_errors++;
+    if (i2c_fails[index] < I2C_TEMP_MAX_FAILS) {
+      i2c_fails[index]++;
+    }
+  }
+
+  if (i2c_priming != 0 && --i2c_priming != 0) {
+    I2CTemp_ReadNext();
+  }
+}
+
+#endif /* VAL_I2C_TEMP_ENABLED */
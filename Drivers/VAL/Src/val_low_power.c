@@ -0,0 +1,247 @@
+/**
+  ******************************************************************************
+  * @file    val_low_power.c
+  * @brief   Vendor Abstraction Layer for low-power stop mode
+  ******************************************************************************
+  * @attention
+  *
+  * This module puts the MCU into STOP2 for a bounded time. LPTIM1, clocked
+  * by the LSE, keeps running in STOP2 and wakes the core when the time has
+  * elapsed; it also measures how long the core was stopped.
+  *
+  * USART1 cannot receive in STOP2, so a falling edge on its RX pin (PB7)
+  * wakes the core through EXTI line 7 instead. The byte carrying that edge
+  * is lost, unless the board has the LPUART1 listener of val_serial_comms.c,
+  * which receives the frame instead and is then the serial wake source.
+  *
+  * The time from the call to the stop and from the wake-up to the return
+  * is counted in core cycles for VAL_LowPower_GetLatency. The wake-up part
+  * runs mostly on the MSI, before the PLL has locked, and is converted at
+  * that clock, which makes it an upper bound. The regulator start-up
+  * before the first instruction is not included.
+  *
+  * The PLL is off after STOP2 and the core runs from the MSI; it is switched
+  * back to the PLL before returning, unless at the low clock level of
+  * val_sys_clock.c. All other clock settings are retained.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_low_power.h"
+#include "val_sys_clock.h"
+#include "val_serial_comms.h"
+
+/* Private define ------------------------------------------------------------*/
+#define LPTIM_CLOCK_HZ        32768U              /* LSE */
+#define LPTIM_MAX_COUNT       0xFFFFU
+#define WAKE_CLOCK_HZ         4000000U            /* MSI range 6 */
+
+/* USART1 RX, PB7 (see usart.c) */
+#define RX_WAKE_LINE          EXTI_IMR1_IM7
+#define RX_WAKE_IRQn          EXTI9_5_IRQn
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t count_carry = 0;   /* LPTIM counts x 1000 not yet reported */
+static uint32_t last_entry_us = 0; /* Last stop, call to stop */
+static uint32_t last_exit_us = 0;  /* Last stop, wake-up to return */
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t ReadCounter(void);
+static void RestoreSystemClock(void);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Initialize the stop mode wake sources
+  * @note   Needs the LSE, which SystemClock_Config starts
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  */
+VAL_Status VAL_LowPower_Init(void) {
+  if (__HAL_RCC_GET_FLAG(RCC_FLAG_LSERDY) == 0U) {
+    return VAL_ERROR;
+  }
+
+  /* Wake timer, one compare match per stop */
+  __HAL_RCC_LPTIM1_CONFIG(RCC_LPTIM1CLKSOURCE_LSE);
+  __HAL_RCC_LPTIM1_CLK_ENABLE();
+  LPTIM1->CR = 0;
+  LPTIM1->CFGR = 0;                       /* Prescaler 1, software start */
+  LPTIM1->IER = LPTIM_IER_CMPMIE;         /* Only writable while disabled */
+  EXTI->IMR2 |= EXTI_IMR2_IM32;           /* LPTIM1 wake-up line */
+
+  /* RX pin edge, only unmasked while stopped */
+  __HAL_RCC_SYSCFG_CLK_ENABLE();
+  MODIFY_REG(SYSCFG->EXTICR[1], SYSCFG_EXTICR2_EXTI7, SYSCFG_EXTICR2_EXTI7_PB);
+  EXTI->FTSR1 |= RX_WAKE_LINE;
+  EXTI->IMR1 &= ~RX_WAKE_LINE;
+
+  HAL_NVIC_SetPriority(LPTIM1_IRQn, 15, 0);
+  HAL_NVIC_EnableIRQ(LPTIM1_IRQn);
+  HAL_NVIC_SetPriority(RX_WAKE_IRQn, 15, 0);
+  HAL_NVIC_EnableIRQ(RX_WAKE_IRQn);
+
+  /* Wake up on the MSI, the PLL input */
+  __HAL_RCC_WAKEUPSTOP_CLK_CONFIG(RCC_STOP_WAKEUPCLOCK_MSI);
+
+#ifdef DEBUG
+  /* Keep the debugger connected while stopped, at the cost of a higher
+     stop current */
+  HAL_DBGMCU_EnableDBGStopMode();
+#endif
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Stop the core until a wake source fires
+  * @note   Must be called with interrupts disabled; the wake interrupts stay
+  *         pending and run once the caller enables interrupts again. The
+  *         caller stops the tick sources and any peripheral that must not
+  *         lose its clock mid-operation.
+  * @param  max_ms: Longest time to stop, at most VAL_LOW_POWER_MAX_STOP_MS
+  * @param  wake: Pointer to store what ended the stop
+  * @param  stopped_ms: Pointer to store the time spent stopped
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+  */
+VAL_Status VAL_LowPower_Stop(uint32_t max_ms, VAL_LowPower_Wake_t* wake, uint32_t* stopped_ms) {
+  uint32_t start = VAL_SysClock_GetCycles();
+  uint32_t stop_cycles;
+  uint32_t wake_cycles;
+  uint32_t wake_hz;
+  uint32_t counts;
+  uint32_t total;
+  uint8_t serial_woke = 0;
+  uint8_t listening = 0;
+
+  if (max_ms == 0 || max_ms > VAL_LOW_POWER_MAX_STOP_MS || wake == NULL || stopped_ms == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* ARR and CMP are written through the LPTIM clock domain */
+  LPTIM1->ICR = LPTIM_ICR_CMPMCF | LPTIM_ICR_ARRMCF | LPTIM_ICR_CMPOKCF | LPTIM_ICR_ARROKCF;
+  LPTIM1->CR = LPTIM_CR_ENABLE;
+  LPTIM1->ARR = LPTIM_MAX_COUNT;
+  while ((LPTIM1->ISR & LPTIM_ISR_ARROK) == 0U) {
+  }
+  LPTIM1->CMP = (max_ms * LPTIM_CLOCK_HZ) / 1000U;
+  while ((LPTIM1->ISR & LPTIM_ISR_CMPOK) == 0U) {
+  }
+  LPTIM1->CR |= LPTIM_CR_CNTSTRT;
+
+  EXTI->PR1 = RX_WAKE_LINE;
+#if VAL_SERIAL_WAKE_ENABLED
+  listening = (VAL_Serial_ArmWake() == VAL_OK) ? 1U : 0U;
+#endif
+  if (!listening) {
+    EXTI->IMR1 |= RX_WAKE_LINE;
+  }
+
+  stop_cycles = VAL_SysClock_GetCycles();
+  HAL_PWREx_EnterSTOP2Mode(PWR_STOPENTRY_WFI);
+  wake_cycles = VAL_SysClock_GetCycles();
+
+#if VAL_SERIAL_WAKE_ENABLED
+  /* Before the next byte, so before the PLL is waited for */
+  serial_woke = VAL_Serial_ResumeWake();
+#endif
+
+  RestoreSystemClock();
+
+  EXTI->IMR1 &= ~RX_WAKE_LINE;
+
+  if ((LPTIM1->ISR & LPTIM_ISR_CMPM) != 0U && !serial_woke) {
+    *wake = VAL_LOW_POWER_WAKE_TIMER;
+  } else if (serial_woke || (EXTI->PR1 & RX_WAKE_LINE) != 0U) {
+    *wake = VAL_LOW_POWER_WAKE_SERIAL;
+  } else {
+    *wake = VAL_LOW_POWER_WAKE_OTHER;
+  }
+  counts = ReadCounter();
+
+  /* Disabling also resets the counter */
+  LPTIM1->CR = 0;
+  LPTIM1->ICR = LPTIM_ICR_CMPMCF;
+  EXTI->PR1 = RX_WAKE_LINE;
+  HAL_NVIC_ClearPendingIRQ(LPTIM1_IRQn);
+  HAL_NVIC_ClearPendingIRQ(RX_WAKE_IRQn);
+
+  /* Report whole milliseconds and carry the rest to the next stop */
+  total = counts * 1000U + count_carry;
+  *stopped_ms = total / LPTIM_CLOCK_HZ;
+  count_carry = total % LPTIM_CLOCK_HZ;
+
+  VAL_SysClock_AdvanceTime(*stopped_ms);
+
+  /* The AHB divider is kept through the stop */
+  wake_hz = WAKE_CLOCK_HZ >> AHBPrescTable[(RCC->CFGR & RCC_CFGR_HPRE) >> RCC_CFGR_HPRE_Pos];
+  last_entry_us = VAL_SysClock_CyclesToMicros(stop_cycles - start);
+  last_exit_us = (uint32_t)(((uint64_t)(VAL_SysClock_GetCycles() - wake_cycles) * 1000000U) / wake_hz);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the software latency of the last stop
+  * @param  entry_us: Pointer to store the time from the call to the stop
+  * @param  exit_us: Pointer to store the time from the wake-up to the return,
+  *         counted at the wake-up clock
+  * @retval None
+  */
+void VAL_LowPower_GetLatency(uint32_t* entry_us, uint32_t* exit_us) {
+  if (entry_us != NULL) {
+    *entry_us = last_entry_us;
+  }
+  if (exit_us != NULL) {
+    *exit_us = last_exit_us;
+  }
+}
+
+/**
+  * @brief  Handle the wake interrupts
+  * @note   Normally cleared by VAL_LowPower_Stop before they are taken
+  * @retval None
+  */
+void VAL_LowPower_IRQHandler(void) {
+  LPTIM1->ICR = LPTIM_ICR_CMPMCF | LPTIM_ICR_ARRMCF;
+  EXTI->PR1 = RX_WAKE_LINE;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Read the LPTIM counter
+  * @note   The counter runs asynchronously; two equal reads are needed
+  * @retval uint32_t: Counter value
+  */
+static uint32_t ReadCounter(void) {
+  uint32_t first;
+  uint32_t second = LPTIM1->CNT;
+
+  do {
+    first = second;
+    second = LPTIM1->CNT;
+  } while (first != second);
+
+  return second;
+}
+
+/**
+  * @brief  Switch the system clock back to the PLL after a stop
+  * @note   The low clock level runs from the MSI the MCU wakes up on; the
+  *         AHB divider of the other levels is kept through the stop
+  * @retval None
+  */
+static void RestoreSystemClock(void) {
+  if (VAL_SysClock_GetLevel() == VAL_SYSCLOCK_LEVEL_LOW) {
+    return;
+  }
+
+  __HAL_RCC_PLL_ENABLE();
+  while (__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY) == 0U) {
+  }
+
+  __HAL_RCC_SYSCLK_CONFIG(RCC_SYSCLKSOURCE_PLLCLK);
+  while (__HAL_RCC_GET_SYSCLK_SOURCE() != RCC_SYSCLKSOURCE_STATUS_PLLCLK) {
+  }
+}
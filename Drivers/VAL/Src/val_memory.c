@@ -0,0 +1,82 @@
+/**
+  ******************************************************************************
+  * @file    val_memory.c
+  * @brief   Vendor Abstraction Layer for the memory map of the firmware
+  ******************************************************************************
+  * @attention
+  *
+  * Where the linker put things, for checks that read memory as a whole.
+  *
+  * The image is everything programmed into flash, from the boot loader's
+  * vector table to the end of the .ramfunc load image (_eimage), the last
+  * section loaded. The error log and the key/value store above it change
+  * at run time and are not part of it.
+  *
+  * The spare RAM is what nothing owns in SRAM1: from the newlib heap break
+  * up to the stack that main and the interrupts use, less the
+  * _Min_Stack_Size the linker reserves for it. The break only moves up, as
+  * malloc takes memory from the C library (sysmem.c), so a word past it
+  * now can be taken later; the caller checks the break again before
+  * counting a word as changed.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_memory.h"
+#include "stm32l4xx_hal.h"
+
+/* Linker script symbols */
+extern uint8_t _eimage[];
+extern uint8_t _estack[];
+extern uint8_t _Min_Stack_Size[];
+
+/* Newlib heap break, sysmem.c */
+extern void* _sbrk(ptrdiff_t incr);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Get the bytes of the running firmware image in flash
+  * @param  start: Pointer to store the first byte
+  * @param  length: Pointer to store the number of bytes
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if a pointer is NULL
+  */
+VAL_Status VAL_Memory_GetImage(const uint8_t** start, size_t* length) {
+  if (start == NULL || length == NULL) {
+    return VAL_PARAM;
+  }
+
+  *start = (const uint8_t*)FLASH_BASE;
+  *length = (size_t)((uint32_t)_eimage - FLASH_BASE);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the RAM no one uses at present
+  * @note   Task context; the start moves up as the C library heap grows
+  * @param  start: Pointer to store the first word
+  * @param  end: Pointer to store the word after the last
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if a pointer is NULL,
+  *         VAL_ERROR if the heap has taken all of it
+  */
+VAL_Status VAL_Memory_GetSpareRam(uint32_t** start, uint32_t** end) {
+  uint32_t first;
+  uint32_t limit;
+
+  if (start == NULL || end == NULL) {
+    return VAL_PARAM;
+  }
+
+  first = ((uint32_t)_sbrk(0) + 3U) & ~3U;
+  limit = ((uint32_t)_estack - (uint32_t)_Min_Stack_Size) & ~3U;
+  if (first >= limit) {
+    return VAL_ERROR;
+  }
+
+  *start = (uint32_t*)first;
+  *end = (uint32_t*)limit;
+
+  return VAL_OK;
+}
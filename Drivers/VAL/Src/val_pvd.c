@@ -0,0 +1,168 @@
+/**
+  ******************************************************************************
+  * @file    val_pvd.c
+  * @brief   Vendor Abstraction Layer for the supply voltage warning
+  ******************************************************************************
+  * @attention
+  *
+  * The programmable voltage detector (PVD) compares VDD against one of
+  * seven levels in hardware, all the time and in stop mode too, without
+  * a conversion. Its output drives EXTI line 16 on both edges, so the
+  * interrupt comes as the supply falls under the level and again as it
+  * recovers, with the detector's own hysteresis (about 100 mV) between
+  * the two. VDDA is the same pin on the L432, so the VREFINT measurement
+  * of val_analog.c reads the same supply, once per block.
+  *
+  * The interrupt runs at the sampling level, as the caller steps the LED
+  * driver state from it. A level is chosen by its typical falling
+  * threshold, the highest one not above the one asked for:
+  *
+  *   Level      0     1     2     3     4     5     6
+  *   mV      2000  2150  2310  2450  2590  2750  2840
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_pvd.h"
+#include "val_sys_clock.h"
+#include "val_irq_priority.h"
+#include "stm32l4xx_hal.h"
+#include <stddef.h>
+
+/* Private define ------------------------------------------------------------*/
+#define PVD_LEVEL_COUNT   7U
+#define PVD_EXTI_LINE     EXTI_IMR1_IM16
+#define PVD_PRIORITY      VAL_IRQ_PRIORITY_SAMPLING
+#define PVD_STARTUP_US    50U     /* Detector settling after enable, with margin */
+
+/* Private variables ---------------------------------------------------------*/
+static const uint16_t pvd_levels_mv[PVD_LEVEL_COUNT] = {2000, 2150, 2310, 2450, 2590, 2750, 2840};
+
+static VAL_PvdCallback warn_callback = NULL;
+static uint32_t threshold_mv = 0;     /* Level in use, 0 while off */
+static volatile bool supply_low = false;
+static volatile uint32_t warnings = 0;
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Start watching the supply voltage
+  * @note   Task context only. A supply already under the level is reported
+  *         at once, to the callback from the caller's context.
+  * @param  callback: Called from the interrupt on every crossing of the level
+  * @param  thresholdMv: Falling level in mV, 2000 or more
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_Pvd_Enable(VAL_PvdCallback callback, uint32_t thresholdMv) {
+  uint32_t level = 0;
+
+  if (thresholdMv < pvd_levels_mv[0]) {
+    return VAL_PARAM;
+  }
+
+  while (level + 1U < PVD_LEVEL_COUNT && pvd_levels_mv[level + 1U] <= thresholdMv) {
+    level++;
+  }
+
+  HAL_NVIC_DisableIRQ(PVD_PVM_IRQn);
+  __HAL_RCC_PWR_CLK_ENABLE();
+
+  warn_callback = callback;
+  MODIFY_REG(PWR->CR2, PWR_CR2_PLS, level << PWR_CR2_PLS_Pos);
+  PWR->CR2 |= PWR_CR2_PVDE;
+  threshold_mv = pvd_levels_mv[level];
+
+  /* Both edges: under the level and back */
+  EXTI->RTSR1 |= PVD_EXTI_LINE;
+  EXTI->FTSR1 |= PVD_EXTI_LINE;
+  uint32_t start = VAL_SysClock_GetMicros();
+  while ((VAL_SysClock_GetMicros() - start) < PVD_STARTUP_US) {
+  }
+  EXTI->PR1 = PVD_EXTI_LINE;
+  EXTI->IMR1 |= PVD_EXTI_LINE;
+
+  supply_low = (PWR->SR2 & PWR_SR2_PVDO) != 0U;
+  if (supply_low) {
+    warnings++;
+  }
+
+  HAL_NVIC_SetPriority(PVD_PVM_IRQn, PVD_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(PVD_PVM_IRQn);
+
+  if (supply_low && warn_callback != NULL) {
+    warn_callback(true);
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Check whether the supply is under the warning level
+  * @retval bool: true while it is, false if it is not or nothing watches it
+  */
+bool VAL_Pvd_IsLow(void) {
+  return supply_low;
+}
+
+/**
+  * @brief  Get the warning level in use
+  * @retval uint32_t: Typical falling threshold in mV, 0 while not watching
+  */
+uint32_t VAL_Pvd_GetThreshold(void) {
+  return threshold_mv;
+}
+
+/**
+  * @brief  Get the number of times the supply fell under the level
+  * @retval uint32_t: Count since start-up
+  */
+uint32_t VAL_Pvd_GetWarningCount(void) {
+  return warnings;
+}
+
+/**
+  * @brief  Handle the PVD interrupt, a crossing of the warning level
+  * @note   Call from PVD_PVM_IRQHandler. Edges that cancel out before the
+  *         interrupt is served are not reported.
+  * @retval None
+  */
+void VAL_Pvd_IRQHandler(void) {
+  if ((EXTI->PR1 & PVD_EXTI_LINE) == 0U) {
+    return;
+  }
+  EXTI->PR1 = PVD_EXTI_LINE;
+
+  bool low = (PWR->SR2 & PWR_SR2_PVDO) != 0U;
+  if (low == supply_low) {
+    return;
+  }
+
+  supply_low = low;
+  if (low) {
+    warnings++;
+  }
+
+  if (warn_callback != NULL) {
+    warn_callback(low);
+  }
+}
+
+/**
+  * @brief  Stop watching the supply voltage
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_Pvd_Disable(void) {
+  HAL_NVIC_DisableIRQ(PVD_PVM_IRQn);
+  EXTI->IMR1 &= ~PVD_EXTI_LINE;
+  EXTI->RTSR1 &= ~PVD_EXTI_LINE;
+  EXTI->FTSR1 &= ~PVD_EXTI_LINE;
+  EXTI->PR1 = PVD_EXTI_LINE;
+  PWR->CR2 &= ~PWR_CR2_PVDE;
+
+  warn_callback = NULL;
+  threshold_mv = 0;
+  supply_low = false;
+
+  return VAL_OK;
+}
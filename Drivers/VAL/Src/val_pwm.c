@@ -8,23 +8,339 @@
   * This module provides a hardware-independent interface for PWM
   * control used by the Wiseled_LBR system for light intensity control.
   *
+  * Compare registers are preloaded and latch on the timer update event.
+  * Intensities staged with VAL_PWM_StageIntensity are written together by
+  * VAL_PWM_CommitAll with update events held off, so all channels change on
+  * the same PWM period boundary.
+  *
+  * VAL_PWM_ArmLatch goes a step further for several devices changing
+  * together: the staged values are written to the preload registers and
+  * update events stay held off until VAL_PWM_Latch, which may be called
+  * from an interrupt. The latch also restarts the PWM period, so devices
+  * that latch at the same moment run in phase from then on; the period
+  * in progress is cut short once. Optionally a rising edge on PA12, a sync
+  * line shared by the devices, latches from the EXTI interrupt. Any other
+  * write to the outputs first puts back the values in use when armed.
+  *
+  * TIM1 counts at 32 MHz with 4000 counts per period, i.e. 8 kHz with just
+  * under 12 bits of resolution. Intensities are given in permille (0-1000);
+  * the percent API is a wrapper over it. When the system clock changes,
+  * VAL_PWM_UpdateClock sets the prescaler to keep the count rate, from the
+  * next period on. Below 32 MHz the counter runs slower, at the same duty
+  * cycles; the low clock level is only used with all lights off.
+  * VAL_PWM_SetFrequency changes the period instead, e.g. away from a
+  * camera's line rate: the count rate stays, so resolution is the most the
+  * 32 MHz count gives at each frequency, 15 bits at 1 kHz and under 10 at
+  * 40 kHz. The on-times are rescaled to the same duty cycles and latch
+  * together with the new period on one update event.
+  *
+  * Ramps are played without CPU involvement: on each update event the DMA
+  * writes the next row of a compare table into CCR1 onwards through a TIM1 DMA
+  * burst, and the repetition counter sets how many PWM periods each row
+  * lasts. Any direct write to a channel stops a running ramp first.
+  *
+  * A loop plays a table the same way but in circular mode, until stopped,
+  * for output computed as it plays: the half-transfer and transfer-complete
+  * interrupts hand the half of the table just played to the loop callback
+  * to be written anew while the DMA plays the other half. Two interrupts
+  * per table, however many periods its rows last.
+  *
+  * Dithering adds VAL_PWM_DITHER_BITS of on-time resolution below one
+  * count, for deep dimming: the same DMA burst plays a table of
+  * VAL_PWM_DITHER_STEPS rows in circular mode, one row per period, in which
+  * each channel alternates between the two compare values around its
+  * on-time, first-order sigma-delta style, so the mean over the cycle is
+  * the fine on-time. No interrupt runs per period or per cycle; a new set
+  * of on-times is written into the table in place. A direct write stops
+  * dithering as it stops a ramp.
+  *
+  * Each channel may have a slew limit, the fastest change of its duty
+  * cycle in permille of the period per millisecond (default from the
+  * channel table), as a step from off to full scale draws an inrush the
+  * supply and the current trip see. VAL_PWM_SetPermille and
+  * VAL_PWM_CommitAll reach a target further away than one period allows
+  * through a slew: a ramp of up to PWM_SLEW_STEPS rows from the present
+  * compare values, played as any other ramp but without the ramp callback.
+  * The limit holds on average over the slew, each row is a step. A write
+  * during a slew starts a new one from where the outputs are, the other
+  * channels go on towards their targets. VAL_PWM_StopChannel is never
+  * slewed; nor are VAL_PWM_SetCompare, whose closed-loop callers set their
+  * own pace, latched values, which must change at one moment on all
+  * devices, and ramps and dither tables, played as given. The latter and
+  * the strobe take over from a slew in progress, a latch completes it.
+  *
+  * Each channel maps permille to compare values either linearly or through
+  * its gamma table from val_pwm_curves.c, selected with VAL_PWM_SetCurve.
+  * An output scale (VAL_PWM_SetOutputScale) stretches or shortens the
+  * on-times of the curve, e.g. to make up for a light source that has lost
+  * output with age, or to match it to the other units of an installation.
+  * It is folded into the curve lookup as one multiply in Q16, which
+  * takes the place of the division rescaling a table to another period,
+  * so the conversion costs no more with a scale than without. On-times
+  * past the period saturate at full scale.
+  *
+  * Channels switching on together at the start of every period add up to
+  * a current peak on the supply. A channel may be trailing-edge aligned
+  * instead (VAL_PWM_SetAlignment, default from the channel table): PWM
+  * mode 2 with the complement of its compare value, so its pulse ends with
+  * the period. Leading and trailing pulses do not overlap until their duty
+  * cycles add up to more than the period. Asymmetric and center-aligned
+  * modes would give any phase, but TIM1 pairs channels for the former and
+  * the latter halves the resolution. Compare values stay the on-time in
+  * counts across the API; only ramp tables hold register values, which
+  * VAL_PWM_PermilleToCompare and VAL_PWM_RampCompare return.
+  *
+  * TIM1 can also trigger the ADC at a fixed point of every period: CH4,
+  * which has no output pin, compares in PWM mode 2 and its reference is
+  * routed to TRGO2, so a rising edge occurs when the counter reaches CCR4.
+  * A phase measures from the start of the period, so it reads the on-state
+  * of leading channels.
+  *
+  * Strobe mode hands the outputs to an external trigger on PA12 (TIM1_ETR),
+  * e.g. a camera frame sync: TIM1 becomes a one-pulse timer in trigger
+  * slave mode, so the edge itself starts the pulse, with no interrupt or
+  * task in the path. The counter counts down and rests at ARR between
+  * pulses, where PWM mode 1 outputs are low for any compare value up to
+  * ARR; a compare of 0 still turns a channel off, so alarms keep working.
+  * All channels are leading meanwhile, PWM mode 2 would be high at rest.
+  * Long pulses repeat a period of at most the normal PWM length through the
+  * repetition counter, so the channels are dimmed at no lower a frequency
+  * than in continuous mode. Interrupts only count edges and pulses. While
+  * strobing, writes of continuous intensities are refused with VAL_BUSY.
+  *
+  * A free-running strobe takes the trigger from TIM15 instead of the pin:
+  * it counts microseconds and its TRGO is OC1REF in PWM mode 1, high
+  * from each update until CCR1: the rising edge at the update starts the
+  * TIM1 pulse through ITR0, so the rate is exact to the timer clock and the
+  * pulse as exact as from an edge. The falling edge at CCR1 lies within the
+  * on-time of every lit channel in the first PWM period of the pulse (the
+  * counter counts down, so outputs are high during the last compare counts
+  * of each period), and triggers the ADC there (VAL_Analog_SyncToStrobe).
+  * In benchmark builds TIM15 also runs the latency probe; the two exclude
+  * each other.
+  *
+  * The comparators (val_comparator.c) may drive the TIM1 break input: an
+  * active break clears MOE, and the outputs go low in hardware. Automatic
+  * output is off, so they stay low until VAL_PWM_RecoverBreak sets MOE
+  * again, which only takes once the break input is released.
+  *
+  * The board profile may put lights on TIM15 or TIM16 instead, at a
+  * frequency of their own for drivers that want a lower one or cameras a
+  * higher one: same count rate, their own period, prescaler kept by
+  * VAL_PWM_UpdateClock; VAL_PWM_SetFrequency and the strobe stay with TIM1.
+  * Their compares go through an output table rather than fixed addresses.
+  * Ramps, slews, loops and dither still play through the TIM1 burst, which
+  * writes the unused TIM1 compare of such a light; the TIM1 update
+  * interrupt, enabled only while a table plays, copies it to the light's
+  * own timer, which applies it at its next update, within a row of the
+  * TIM1 lights. A latch releases all timers together and restarts them:
+  * TIM15 is a reset-mode slave of TIM1 TRGO, so the TIM1 UG restarts it in
+  * the same clock, TIM16 has no slave mode and follows in the next
+  * instructions. Other commits hold the updates of all timers while
+  * writing, and each timer applies them on its own next period boundary.
+  * The comparators break all of them, and the ADC trigger stays on TIM1,
+  * so synchronous sampling sees these lights at any phase of their period.
+  * While strobing they stay dark. TIM15 then cannot be the rate timer of a
+  * free-running strobe nor run the latency probe; TIM2 stays the cue
+  * timer. A profile with all lights on TIM1 builds none of this.
+  *
+  * Channel numbers are light IDs; the timer, output and gamma table of each
+  * come from the board channel table (val_channels.c).
+  *
   ******************************************************************************
   */
 
 /* Includes ------------------------------------------------------------------*/
 #include "val_pwm.h"
+#include "val_pwm_curves.h"
+#include "val_channels.h"
+#include "val_sections.h"
+#include "val_irq_priority.h"
 #include "tim.h"
+#ifdef BENCHMARK
+#include "val_timers.h"
+#endif
 
 /* Private define ------------------------------------------------------------*/
-#define PWM_CHANNEL_COUNT 3
 #define PWM_MAX_INTENSITY 100
+#define PWM_PERMILLE_PER_PERCENT (VAL_PWM_PERMILLE_MAX / PWM_MAX_INTENSITY)
+#define PWM_MAX_REPETITION 0x10000U  /* 16-bit repetition counter */
+#define PWM_COUNTER_HZ 32000000U     /* Count rate the curves and period are set for */
+#define PWM_SLEW_STEPS 32U           /* Rows of a slew ramp, each a step of 1/32 */
+
+#if VAL_BOARD_AUX_PWM_LIGHTS == 0
+/* Compare register of a channel index. The board profile puts light N on
+ * TIM1 CHN (checked in val_channels.c), so the register is addressed
+ * directly rather than through the channel table. */
+#define PWM_TIMER(index) TIM1
+#define PWM_CCR(index) ((&TIM1->CCR1)[(index)])
+
+/* Mode register of a channel index; the odd channels use its upper half */
+#define PWM_CCMR(index) ((&TIM1->CCMR1)[(index) >> 1])
+#define PWM_CCMR_SHIFT(index) (((index) & 1U) * 8U)
+#else
+/* Registers of a channel index, on the timer of its light */
+#define PWM_TIMER(index) (pwm_outputs[(index)].timer)
+#define PWM_CCR(index) (*pwm_outputs[(index)].ccr)
+#define PWM_CCMR(index) (*pwm_outputs[(index)].ccmr)
+#define PWM_CCMR_SHIFT(index) (pwm_outputs[(index)].shift)
+
+/* TIM1 compare of a channel index, where the DMA burst writes table rows */
+#define PWM_SLOT(index) ((&TIM1->CCR1)[(index)])
+
+#define PWM_OUTPUT(name, tim, tim_channel, pwm_pin, trailing, current_input, current_pin, temp_input, temp_pin, \
+                   awd, comp, cie_x, cie_y, lumens, curve) \
+  { TIM##tim, &TIM##tim->CCR1 + ((tim_channel) >> 2), &TIM##tim->CCMR1 + ((tim_channel) >> 3), \
+    (uint8_t)((((tim_channel) >> 2) & 1U) * 8U) },
+
+#define PWM_AUX_TIMER_COUNT (sizeof(pwm_aux_timers) / sizeof(pwm_aux_timers[0]))
+
+_Static_assert(VAL_BOARD_TIM15_PWM_HZ >= VAL_PWM_FREQ_MIN_HZ && VAL_BOARD_TIM15_PWM_HZ <= VAL_PWM_FREQ_MAX_HZ &&
+               VAL_BOARD_TIM16_PWM_HZ >= VAL_PWM_FREQ_MIN_HZ && VAL_BOARD_TIM16_PWM_HZ <= VAL_PWM_FREQ_MAX_HZ,
+               "TIM15 and TIM16 frequencies out of the PWM range");
+#endif
+
+/* Counts per period of a channel index, from the preloaded ARR of its
+ * timer as the compares are */
+#define PWM_PERIOD(index) (PWM_TIMER(index)->ARR + 1U)
+
+/* Strobe trigger input */
+#define PWM_STROBE_PORT       GPIOA
+#define PWM_STROBE_PIN        GPIO_PIN_12  /* TIM1_ETR */
+#define PWM_STROBE_ETR_FILTER (3U << TIM_SMCR_ETF_Pos)  /* 8 clocks, 250 ns at 32 MHz, 125 ns at 64 MHz */
+#define PWM_STROBE_PRIORITY   VAL_IRQ_PRIORITY_SAMPLING
+
+/* Free-running strobe rate timer; its TRGO is TIM1 ITR0 */
+#define PWM_RATE_TIMER        TIM15
+#define PWM_RATE_TIMER_HZ     1000000U
+
+/* The sync line shares the strobe input pin */
+#define PWM_SYNC_IRQn         EXTI15_10_IRQn
+
+/* Break input: 8 samples at a quarter of the timer clock, 1 us at 32 MHz,
+ * as the switching edges ring on the current sense */
+#define PWM_BREAK_FILTER      (7U << TIM_BDTR_BKF_Pos)
+#define PWM_BREAK_SOURCES     (TIM1_OR2_BKINE | TIM1_OR2_BKCMP1E | TIM1_OR2_BKCMP2E | \
+                               TIM1_OR2_BKINP | TIM1_OR2_BKCMP1P | TIM1_OR2_BKCMP2P)
+
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  TIM_TypeDef* timer;
+  volatile uint32_t* ccr;
+  volatile uint32_t* ccmr;
+  uint8_t shift;           /* Of the OCx fields in the CCMR register */
+} PWM_Output_t;
+
+typedef struct {
+  TIM_TypeDef* timer;
+  uint32_t freq_hz;
+} PWM_AuxTimer_t;
+#endif
 
 /* Private variables ---------------------------------------------------------*/
-static const uint32_t pwmChannels[PWM_CHANNEL_COUNT] = {
-  TIM_CHANNEL_1,  /* LED1 - White */
-  TIM_CHANNEL_2,  /* LED2 - Green */
-  TIM_CHANNEL_3   /* LED3 - Red */
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+static const PWM_Output_t pwm_outputs[VAL_LIGHT_COUNT] = {
+  VAL_BOARD_LIGHTS(PWM_OUTPUT)
+};
+
+/* Timers other than TIM1 driving lights; the OR2 break bits and BDTR are
+ * laid out as on TIM1 */
+static const PWM_AuxTimer_t pwm_aux_timers[] = {
+#if VAL_BOARD_USES_TIM15
+  {TIM15, VAL_BOARD_TIM15_PWM_HZ},
+#endif
+#if VAL_BOARD_USES_TIM16
+  {TIM16, VAL_BOARD_TIM16_PWM_HZ},
+#endif
+};
+#endif
+
+/* Compare values waiting for VAL_PWM_CommitAll */
+static uint32_t staged_compares[VAL_LIGHT_COUNT];
+static uint32_t staged_mask = 0;
+
+/* Intensity to compare mapping of each channel, linear at reset */
+static VAL_PWM_Curve_t channel_curves[VAL_LIGHT_COUNT];
+
+/* Output scale of each channel, and that scale in Q16 times the table
+ * period ratio for the period it was last computed for; a period of 0
+ * makes the next conversion compute it */
+static uint16_t output_scales[VAL_LIGHT_COUNT] = {
+  [0 ... VAL_LIGHT_COUNT - 1] = VAL_PWM_SCALE_UNITY
 };
+static volatile uint32_t gain_periods[VAL_LIGHT_COUNT];
+static volatile uint32_t fine_gains_q16[VAL_LIGHT_COUNT];
+
+/* Ramp playback */
+static volatile bool ramp_active = false;
+static VAL_PWM_RampCallback ramp_callback = NULL;
+
+/* Loop playback, a ramp table played circularly */
+static VAL_PWM_LoopCallback loop_callback = NULL;
+static uint16_t loop_steps = 0;
+
+/* Dither cycle, read by DMA circularly while dither_active */
+static uint16_t dither_table[VAL_PWM_DITHER_STEPS][VAL_LIGHT_COUNT];
+static volatile bool dither_active = false;
+
+/* Slew limiting; slew_active while the targets are not reached yet, even
+ * with the ramp stopped for a write that resumes it */
+static uint16_t slew_limits[VAL_LIGHT_COUNT];       /* Permille of the period per ms */
+static uint16_t slew_table[PWM_SLEW_STEPS][VAL_LIGHT_COUNT];
+static uint32_t slew_targets[VAL_LIGHT_COUNT];      /* Register values the slew ends at */
+static volatile bool slew_active = false;
+
+/* Strobe mode */
+static volatile bool strobe_active = false;
+static uint32_t continuous_period = 0;   /* Counts per period to return to */
+static volatile uint32_t strobe_triggers = 0;
+static volatile uint32_t strobe_pulses = 0;
+static volatile uint32_t strobe_missed = 0;
+static volatile bool strobe_free_running = false;  /* Triggered by the rate timer */
+
+/* Preloaded values waiting for VAL_PWM_Latch */
+static volatile bool latch_armed = false;
+static volatile bool latch_on_sync = false;
+static uint32_t latch_restore[VAL_LIGHT_COUNT];   /* Compares in use when armed */
+static VAL_PWM_LatchCallback latch_callback = NULL;
+
+/* A break cleared MOE and the outputs are still held low */
+static volatile bool break_pending = false;
+
+/* Trailing-edge channels, one bit per index; PWM mode 2 unless strobing */
+static uint8_t trailing_mask = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t PermilleToCompare(uint8_t index, uint16_t permille);
+static uint32_t PermilleToFine(uint8_t index, uint16_t permille);
+static uint32_t PWM_FineGain(uint8_t index, uint32_t period);
+static uint16_t CompareToPermille(uint8_t index, uint32_t compare);
+static uint32_t PWM_ToRegister(uint8_t index, uint32_t compare);
+static uint32_t PWM_FromRegister(uint8_t index, uint32_t value);
+static void PWM_SetMode(uint8_t index, bool trailing);
+static void PWM_AbortRamp(void);
+static void PWM_StopPlayback(void);
+static VAL_Status PWM_PlayRamp(const uint16_t* table, uint16_t steps, uint32_t step_periods);
+static void PWM_WriteSlewed(uint32_t mask, const uint32_t* values);
+static void PWM_RampCompleteCallback(DMA_HandleTypeDef* hdma);
+static void PWM_LoopHalfCallback(DMA_HandleTypeDef* hdma);
+static void PWM_LoopCompleteCallback(DMA_HandleTypeDef* hdma);
+static void PWM_LoopErrorCallback(DMA_HandleTypeDef* hdma);
+static uint32_t PWM_GetInputClock(void);
+static uint32_t PWM_GetTimerClock(void);
+static void PWM_StopRateTimer(void);
+static void PWM_DropLatch(void);
+static void PWM_StopSync(void);
+static void PWM_HoldUpdates(void);
+static void PWM_ReleaseUpdates(void);
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+static void PWM_InitAuxTimers(void);
+static void PWM_DeInitAuxTimers(void);
+static void PWM_StartFollowing(void);
+static void PWM_StopFollowing(void);
+static void PWM_FollowRow(void);
+#endif
 
 /* Public functions ----------------------------------------------------------*/
 
@@ -35,70 +351,81 @@ static const uint32_t pwmChannels[PWM_CHANNEL_COUNT] = {
 VAL_Status VAL_PWM_Init(void) {
   /* Initialize PWM timer */
   MX_TIM1_Init();
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  PWM_InitAuxTimers();
+#endif
   
-  /* Start PWM generation for all channels */
-  if (HAL_TIM_PWM_Start(&htim1, TIM_CHANNEL_1) != HAL_OK) {
-    return VAL_ERROR;
+  /* Alignment before the compare values, they depend on it */
+  trailing_mask = 0;
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (VAL_Channels[i].pwm_trailing) {
+      trailing_mask |= (uint8_t)(1U << i);
+    }
+    PWM_SetMode(i, VAL_Channels[i].pwm_trailing);
   }
   
-  if (HAL_TIM_PWM_Start(&htim1, TIM_CHANNEL_2) != HAL_OK) {
-    HAL_TIM_PWM_Stop(&htim1, TIM_CHANNEL_1);
-    return VAL_ERROR;
+  /* Zero all channels before the outputs are enabled */
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    VAL_PWM_SetIntensity(i + 1, 0);
+    slew_limits[i] = VAL_Channels[i].slew_permille_per_ms;
   }
   
-  if (HAL_TIM_PWM_Start(&htim1, TIM_CHANNEL_3) != HAL_OK) {
-    HAL_TIM_PWM_Stop(&htim1, TIM_CHANNEL_1);
-    HAL_TIM_PWM_Stop(&htim1, TIM_CHANNEL_2);
-    return VAL_ERROR;
+  /* Start PWM generation for all TIM1 channels, undoing the started ones on
+   * failure; the other timers run already */
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (VAL_Channels[i].pwm_timer == 1 && HAL_TIM_PWM_Start(&htim1, VAL_Channels[i].pwm_channel) != HAL_OK) {
+      while (i-- > 0) {
+        if (VAL_Channels[i].pwm_timer == 1) {
+          HAL_TIM_PWM_Stop(&htim1, VAL_Channels[i].pwm_channel);
+        }
+      }
+      return VAL_ERROR;
+    }
   }
   
-  /* Initialize all channels to 0% intensity */
-  for (uint8_t i = 0; i < PWM_CHANNEL_COUNT; i++) {
-    VAL_PWM_SetIntensity(i + 1, 0);
-  }
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  /* Carries played rows over to the other timers, see PWM_FollowRow */
+  HAL_NVIC_SetPriority(TIM1_UP_TIM16_IRQn, PWM_STROBE_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(TIM1_UP_TIM16_IRQn);
+#endif
   
   return VAL_OK;
 }
 
 /**
   * @brief  Set PWM intensity for a specific channel
-  * @param  channel: Channel number (1-3)
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
   * @param  intensity: Intensity value (0-100)
   * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
   */
 VAL_Status VAL_PWM_SetIntensity(uint8_t channel, uint8_t intensity) {
-  /* Check parameters */
-  if (channel < 1 || channel > PWM_CHANNEL_COUNT) {
-    return VAL_PARAM;
-  }
-  
   if (intensity > PWM_MAX_INTENSITY) {
     intensity = PWM_MAX_INTENSITY;
   }
   
-  /* Set PWM duty cycle */
-  __HAL_TIM_SET_COMPARE(&htim1, pwmChannels[channel - 1], intensity);
-  
-  return VAL_OK;
+  return VAL_PWM_SetPermille(channel, (uint16_t)intensity * PWM_PERMILLE_PER_PERCENT);
 }
 
 /**
   * @brief  Get current PWM intensity for a specific channel
-  * @param  channel: Channel number (1-3)
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
   * @param  intensity: Pointer to store intensity value (0-100)
   * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
   */
 VAL_Status VAL_PWM_GetIntensity(uint8_t channel, uint8_t* intensity) {
-  /* Check parameters */
-  if (channel < 1 || channel > PWM_CHANNEL_COUNT || intensity == NULL) {
+  uint16_t permille;
+  
+  if (intensity == NULL) {
     return VAL_PARAM;
   }
   
-  /* Get current PWM duty cycle */
-  uint32_t compare = __HAL_TIM_GET_COMPARE(&htim1, pwmChannels[channel - 1]);
+  VAL_Status status = VAL_PWM_GetPermille(channel, &permille);
+  if (status != VAL_OK) {
+    return status;
+  }
   
-  /* Convert compare value to intensity */
-  *intensity = (uint8_t)compare;
+  /* Round to the nearest percent */
+  *intensity = (uint8_t)((permille + PWM_PERMILLE_PER_PERCENT / 2) / PWM_PERMILLE_PER_PERCENT);
   
   return VAL_OK;
 }
@@ -111,43 +438,2078 @@ VAL_Status VAL_PWM_GetIntensity(uint8_t channel, uint8_t* intensity) {
 VAL_Status VAL_PWM_SetAllIntensities(const uint8_t intensities[]) {
   VAL_Status status = VAL_OK;
   
-  /* Set intensity for each channel */
-  for (uint8_t i = 0; i < PWM_CHANNEL_COUNT; i++) {
-    VAL_Status channelStatus = VAL_PWM_SetIntensity(i + 1, intensities[i]);
+  /* Stage each channel, then latch them all in the same PWM period */
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    VAL_Status channelStatus = VAL_PWM_StageIntensity(i + 1, intensities[i]);
     if (channelStatus != VAL_OK) {
       status = channelStatus;
     }
   }
   
+  VAL_PWM_CommitAll();
+  
   return status;
 }
 
+/**
+  * @brief  Stage a PWM intensity to be applied by VAL_PWM_CommitAll
+  * @note   The output does not change until the commit
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  intensity: Intensity value (0-100)
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_PWM_StageIntensity(uint8_t channel, uint8_t intensity) {
+  if (intensity > PWM_MAX_INTENSITY) {
+    intensity = PWM_MAX_INTENSITY;
+  }
+  
+  return VAL_PWM_StagePermille(channel, (uint16_t)intensity * PWM_PERMILLE_PER_PERCENT);
+}
+
+/**
+  * @brief  Set PWM intensity for a specific channel in permille
+  * @note   Never waits, safe from any context. Slewed when the step is
+  *         larger than the slew limit allows in one period.
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  permille: Intensity value (0-1000), larger values are clamped
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise, VAL_BUSY
+  *         while strobing
+  */
+VAL_Status VAL_PWM_SetPermille(uint8_t channel, uint16_t permille) {
+  uint32_t values[VAL_LIGHT_COUNT];
+  
+  /* Check parameters */
+  if (channel < 1 || channel > VAL_LIGHT_COUNT) {
+    return VAL_PARAM;
+  }
+  
+  if (strobe_active) {
+    return VAL_BUSY;
+  }
+  
+  PWM_DropLatch();
+  
+  /* Set PWM duty cycle; a running ramp would overwrite it on the next update
+   * and is stopped */
+  values[channel - 1] = PWM_ToRegister(channel - 1, PermilleToCompare(channel - 1, permille));
+  PWM_WriteSlewed(1UL << (channel - 1), values);
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get current PWM intensity for a specific channel in permille
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  permille: Pointer to store intensity value (0-1000)
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_PWM_GetPermille(uint8_t channel, uint16_t* permille) {
+  /* Check parameters */
+  if (channel < 1 || channel > VAL_LIGHT_COUNT || permille == NULL) {
+    return VAL_PARAM;
+  }
+  
+  *permille = CompareToPermille(channel - 1, VAL_PWM_GetCompare(channel));
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Stage a PWM intensity in permille to be applied by VAL_PWM_CommitAll
+  * @note   The output does not change until the commit
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  permille: Intensity value (0-1000), larger values are clamped
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_PWM_StagePermille(uint8_t channel, uint16_t permille) {
+  /* Check parameters */
+  if (channel < 1 || channel > VAL_LIGHT_COUNT) {
+    return VAL_PARAM;
+  }
+  
+  staged_compares[channel - 1] = PWM_ToRegister(channel - 1, PermilleToCompare(channel - 1, permille));
+  staged_mask |= 1UL << (channel - 1);
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Apply all staged intensities on the same PWM period boundary
+  * @note   Update events are disabled while the preload registers are
+  *         written, so a period boundary can never split the update. The
+  *         new values latch together on the next update event; a slew
+  *         moves all its channels in the same periods too.
+  * @retval VAL_Status: VAL_OK, VAL_BUSY while strobing; the staged values
+  *         are dropped either way
+  */
+VAL_Status VAL_PWM_CommitAll(void) {
+  if (strobe_active) {
+    staged_mask = 0;
+    return VAL_BUSY;
+  }
+  
+  PWM_DropLatch();
+  
+  PWM_WriteSlewed(staged_mask, staged_compares);
+  staged_mask = 0;
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Apply all staged intensities on the next PWM period boundary,
+  *         past the slew limits
+  * @note   For shedding load, where every step goes down and waiting for a
+  *         slew is what the supply cannot afford. Safe to call from
+  *         interrupts. A running ramp, dither or slew stops; the channels
+  *         not staged stay where it left them.
+  * @retval VAL_Status: VAL_OK, VAL_BUSY while strobing; the staged values
+  *         are dropped either way
+  */
+VAL_Status VAL_PWM_CommitAllNow(void) {
+  uint32_t primask;
+  
+  if (strobe_active) {
+    staged_mask = 0;
+    return VAL_BUSY;
+  }
+  
+  PWM_DropLatch();
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  if (ramp_active || dither_active) {
+    PWM_AbortRamp();
+  }
+  slew_active = false;
+  
+  PWM_HoldUpdates();
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (staged_mask & (1U << i)) {
+      PWM_CCR(i) = staged_compares[i];
+    }
+  }
+  PWM_ReleaseUpdates();
+  staged_mask = 0;
+  
+  __set_PRIMASK(primask);
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Write the staged intensities to the preload registers and hold
+  *         them until VAL_PWM_Latch
+  * @note   The outputs keep their values meanwhile. Arming again replaces
+  *         the staged channels and keeps the values to go back to.
+  * @param  sync: true to also latch on a rising edge of the sync line (PA12)
+  * @retval VAL_Status: VAL_OK if armed, VAL_BUSY while strobing; the staged
+  *         values are dropped then
+  */
+VAL_Status VAL_PWM_ArmLatch(bool sync) {
+  GPIO_InitTypeDef gpio = {0};
+  uint32_t primask;
+  
+  if (strobe_active) {
+    staged_mask = 0;
+    return VAL_BUSY;
+  }
+  
+  PWM_StopPlayback();
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  PWM_HoldUpdates();
+  
+  /* Reading a compare returns the preload, equal to the value in use
+   * while no latch is armed */
+  if (!latch_armed) {
+    for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+      latch_restore[i] = PWM_CCR(i);
+    }
+  }
+  
+  /* The other channels of a slew in progress reach their targets with the latch */
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (staged_mask & (1U << i)) {
+      PWM_CCR(i) = staged_compares[i];
+    } else if (slew_active) {
+      PWM_CCR(i) = slew_targets[i];
+    }
+  }
+  slew_active = false;
+  staged_mask = 0;
+  latch_armed = true;
+  __set_PRIMASK(primask);
+  
+  if (sync && !latch_on_sync) {
+    /* The line rests low between sync pulses */
+    gpio.Pin = PWM_STROBE_PIN;
+    gpio.Mode = GPIO_MODE_IT_RISING;
+    gpio.Pull = GPIO_PULLDOWN;
+    HAL_GPIO_Init(PWM_STROBE_PORT, &gpio);
+    __HAL_GPIO_EXTI_CLEAR_IT(PWM_STROBE_PIN);
+    latch_on_sync = true;
+    HAL_NVIC_SetPriority(PWM_SYNC_IRQn, PWM_STROBE_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(PWM_SYNC_IRQn);
+  } else if (!sync) {
+    PWM_StopSync();
+  }
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Apply the armed intensities now and restart the PWM period
+  * @note   Safe to call from interrupts. The period in progress is cut
+  *         short, the new one starts with the new values. Calls the latch
+  *         callback.
+  * @retval VAL_Status: VAL_OK if latched, VAL_ERROR if nothing was armed
+  */
+VAL_Status VAL_PWM_Latch(void) {
+  uint32_t primask;
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  if (!latch_armed) {
+    __set_PRIMASK(primask);
+    return VAL_ERROR;
+  }
+  
+  /* UG only loads the shadow registers with update events enabled. TIM15
+   * restarts with TIM1 as its slave, TIM16 has no slave mode. */
+  PWM_ReleaseUpdates();
+  htim1.Instance->EGR = TIM_EGR_UG;
+#if VAL_BOARD_USES_TIM16
+  TIM16->EGR = TIM_EGR_UG;
+#endif
+  latch_armed = false;
+  
+  __set_PRIMASK(primask);
+  
+  PWM_StopSync();
+  if (latch_callback != NULL) {
+    latch_callback();
+  }
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Check whether intensities are armed for VAL_PWM_Latch
+  * @retval bool: true while armed
+  */
+bool VAL_PWM_IsLatchArmed(void) {
+  return latch_armed;
+}
+
+/**
+  * @brief  Set the function called once armed intensities have latched
+  * @note   Called from the context that latched, the sync line interrupt
+  *         included
+  * @param  callback: Function to call, NULL for none
+  * @retval None
+  */
+void VAL_PWM_SetLatchCallback(VAL_PWM_LatchCallback callback) {
+  latch_callback = callback;
+}
+
+/**
+  * @brief  Latch the armed intensities on a sync line edge, called from the
+  *         EXTI interrupt
+  * @retval None
+  */
+void VAL_PWM_SyncIRQHandler(void) {
+  if (__HAL_GPIO_EXTI_GET_IT(PWM_STROBE_PIN) == 0U) {
+    return;
+  }
+  
+  __HAL_GPIO_EXTI_CLEAR_IT(PWM_STROBE_PIN);
+  (void)VAL_PWM_Latch();
+}
+
 /**
   * @brief  Stop PWM output for a specific channel
-  * @param  channel: Channel number (1-3)
+  * @note   Safe to call from interrupts; a running ramp is stopped and an
+  *         armed latch dropped. Never slewed, the output goes off at once,
+  *         whatever the period of its timer; a slew of the other channels
+  *         goes on.
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
   * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
   */
-VAL_Status VAL_PWM_StopChannel(uint8_t channel) {
+VAL_RAMFUNC VAL_Status VAL_PWM_StopChannel(uint8_t channel) {
+  uint32_t primask;
+  
   /* Check parameters */
-  if (channel < 1 || channel > PWM_CHANNEL_COUNT) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT) {
     return VAL_PARAM;
   }
   
-  /* Set intensity to 0 and stop PWM generation */
-  __HAL_TIM_SET_COMPARE(&htim1, pwmChannels[channel - 1], 0);
+  PWM_StopPlayback();
+  PWM_DropLatch();
+  
+  /* Set intensity to 0 past the preload, which would wait for the update */
+  uint32_t preload = TIM_CCMR1_OC1PE << PWM_CCMR_SHIFT(channel - 1);
+  primask = __get_PRIMASK();
+  __disable_irq();
+  PWM_CCMR(channel - 1) &= ~preload;
+  PWM_CCR(channel - 1) = PWM_ToRegister(channel - 1, 0);
+  PWM_CCMR(channel - 1) |= preload;
+  __set_PRIMASK(primask);
+  
+  if (slew_active) {
+    slew_targets[channel - 1] = PWM_ToRegister(channel - 1, 0);
+    PWM_WriteSlewed(0, NULL);
+  }
   
   return VAL_OK;
 }
 
 /**
-  * @brief  De-initialize the PWM module
-  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  * @brief  Write the timer compare value of a channel directly
+  * @note   Bypasses the channel curve, for closed-loop control at the full
+  *         timer resolution. Safe to call from interrupts; a running ramp
+  *         is stopped. Not slewed, a slew of the other channels goes on.
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  compare: On-time in counts, whatever the alignment; clamped to
+  *         the period (constant high)
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise, VAL_BUSY
+  *         while strobing
   */
-VAL_Status VAL_PWM_DeInit(void) {
-  /* Stop PWM generation for all channels */
-  HAL_TIM_PWM_Stop(&htim1, TIM_CHANNEL_1);
-  HAL_TIM_PWM_Stop(&htim1, TIM_CHANNEL_2);
-  HAL_TIM_PWM_Stop(&htim1, TIM_CHANNEL_3);
+VAL_Status VAL_PWM_SetCompare(uint8_t channel, uint32_t compare) {
+  /* Check parameters */
+  if (channel < 1 || channel > VAL_LIGHT_COUNT) {
+    return VAL_PARAM;
+  }
+  
+  uint32_t period = PWM_PERIOD(channel - 1);
+  
+  if (strobe_active) {
+    return VAL_BUSY;
+  }
+  
+  PWM_StopPlayback();
+  PWM_DropLatch();
+  
+  uint32_t value = PWM_ToRegister(channel - 1, (compare > period) ? period : compare);
+  PWM_CCR(channel - 1) = value;
+  
+  if (slew_active) {
+    slew_targets[channel - 1] = value;
+    PWM_WriteSlewed(0, NULL);
+  }
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the compare value a channel is driven with
+  * @note   Read from the timer, so it includes fades and the output curve
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @retval uint32_t: On-time in counts, up to VAL_PWM_GetChannelPeriod; 0 for an invalid channel
+  */
+uint32_t VAL_PWM_GetCompare(uint8_t channel) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT) {
+    return 0;
+  }
+
+  return PWM_FromRegister(channel - 1, PWM_CCR(channel - 1));
+}
+
+/**
+  * @brief  Select the comparators that break the PWM outputs
+  * @note   On every timer driving a light. The BKIN pin is not used; with
+  *         no comparator selected the break is disabled
+  * @param  comparators: Bit 0 for COMP1, bit 1 for COMP2
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_PWM_SetBreakSources(uint8_t comparators) {
+  uint32_t sources = 0;
+
+  if (comparators > 0x3U) {
+    return VAL_PARAM;
+  }
+
+  if (comparators & 0x1U) {
+    sources |= TIM1_OR2_BKCMP1E;
+  }
+  if (comparators & 0x2U) {
+    sources |= TIM1_OR2_BKCMP2E;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  /* Non-inverted comparator outputs, break active high */
+  htim1.Instance->OR2 = (htim1.Instance->OR2 & ~PWM_BREAK_SOURCES) | sources;
+  if (sources != 0) {
+    htim1.Instance->BDTR = (htim1.Instance->BDTR & ~TIM_BDTR_BKF) |
+                           TIM_BDTR_BKE | TIM_BDTR_BKP | PWM_BREAK_FILTER;
+  } else {
+    htim1.Instance->BDTR &= ~TIM_BDTR_BKE;
+  }
   
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  /* A trip cuts the lights on the other timers as well */
+  for (uint8_t t = 0; t < PWM_AUX_TIMER_COUNT; t++) {
+    TIM_TypeDef* timer = pwm_aux_timers[t].timer;
+    
+    timer->OR2 = (timer->OR2 & ~PWM_BREAK_SOURCES) | sources;
+    if (sources != 0) {
+      timer->BDTR = (timer->BDTR & ~TIM_BDTR_BKF) | TIM_BDTR_BKE | TIM_BDTR_BKP | PWM_BREAK_FILTER;
+    } else {
+      timer->BDTR &= ~TIM_BDTR_BKE;
+    }
+  }
+#endif
+
+  __set_PRIMASK(primask);
+
   return VAL_OK;
 }
+
+/**
+  * @brief  Enable the outputs again after a break
+  * @note   Safe to call from interrupts, cheap when no break occurred. The
+  *         outputs stay off while the break input is still active; call
+  *         again later in that case.
+  * @retval bool: true if the outputs are enabled
+  */
+VAL_RAMFUNC bool VAL_PWM_RecoverBreak(void) {
+  bool enabled = true;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  if ((htim1.Instance->SR & TIM_SR_BIF) != 0U) {
+    htim1.Instance->SR = ~(uint32_t)TIM_SR_BIF;
+    break_pending = true;
+  }
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  for (uint8_t t = 0; t < PWM_AUX_TIMER_COUNT; t++) {
+    if ((pwm_aux_timers[t].timer->SR & TIM_SR_BIF) != 0U) {
+      pwm_aux_timers[t].timer->SR = ~(uint32_t)TIM_SR_BIF;
+      break_pending = true;
+    }
+  }
+#endif
+
+  if (break_pending) {
+    /* MOE cannot be set while the break input is active */
+    htim1.Instance->BDTR |= TIM_BDTR_MOE;
+    enabled = (htim1.Instance->BDTR & TIM_BDTR_MOE) != 0U;
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+    for (uint8_t t = 0; t < PWM_AUX_TIMER_COUNT; t++) {
+      pwm_aux_timers[t].timer->BDTR |= TIM_BDTR_MOE;
+      enabled = enabled && (pwm_aux_timers[t].timer->BDTR & TIM_BDTR_MOE) != 0U;
+    }
+#endif
+    break_pending = !enabled;
+  }
+
+  __set_PRIMASK(primask);
+
+  return enabled;
+}
+
+/**
+  * @brief  Turn all outputs off at once, for good
+  * @note   Clears the main output enable like a break, but without a break
+  *         pending, so VAL_PWM_RecoverBreak does not enable them again.
+  *         Only a reset brings the outputs back; used before a firmware
+  *         update takes over the MCU.
+  * @retval None
+  */
+void VAL_PWM_Shutdown(void) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  break_pending = false;
+  htim1.Instance->BDTR &= ~(TIM_BDTR_MOE | TIM_BDTR_AOE);
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  for (uint8_t t = 0; t < PWM_AUX_TIMER_COUNT; t++) {
+    pwm_aux_timers[t].timer->BDTR &= ~(TIM_BDTR_MOE | TIM_BDTR_AOE);
+  }
+#endif
+
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Get the PWM period of the lights on TIM1
+  * @retval uint32_t: Timer counts per period; a compare value this high is constant high
+  */
+uint32_t VAL_PWM_GetPeriod(void) {
+  return __HAL_TIM_GET_AUTORELOAD(&htim1) + 1;
+}
+
+/**
+  * @brief  Get the PWM period of a channel, on the timer of its light
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @retval uint32_t: Timer counts per period, the scale of its compare
+  *         values; 0 for an invalid channel
+  */
+uint32_t VAL_PWM_GetChannelPeriod(uint8_t channel) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT) {
+    return 0;
+  }
+  
+  return PWM_PERIOD(channel - 1);
+}
+
+/**
+  * @brief  Get the PWM frequency of a channel, on the timer of its light
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @retval uint32_t: Number of PWM periods per second, 0 for an invalid channel
+  */
+uint32_t VAL_PWM_GetChannelFrequency(uint8_t channel) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT) {
+    return 0;
+  }
+  
+  return PWM_GetInputClock() / (PWM_TIMER(channel - 1)->PSC + 1U) / PWM_PERIOD(channel - 1);
+}
+
+/**
+  * @brief  Convert a permille intensity to a compare value for ramp tables
+  * @note   Uses the curve and the alignment selected for the channel
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  permille: Intensity value (0-1000), larger values are clamped
+  * @retval uint16_t: Compare value, 0 for an invalid channel
+  */
+uint16_t VAL_PWM_PermilleToCompare(uint8_t channel, uint16_t permille) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT) {
+    return 0;
+  }
+  
+  return (uint16_t)PWM_ToRegister(channel - 1, PermilleToCompare(channel - 1, permille));
+}
+
+/**
+  * @brief  Convert an on-time to a compare value for ramp tables
+  * @note   Uses the alignment selected for the channel
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  compare: On-time in counts, as VAL_PWM_SetCompare
+  * @retval uint16_t: Compare value, 0 for an invalid channel
+  */
+uint16_t VAL_PWM_RampCompare(uint8_t channel, uint32_t compare) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT) {
+    return 0;
+  }
+  
+  uint32_t period = PWM_PERIOD(channel - 1);
+  return (uint16_t)PWM_ToRegister(channel - 1, (compare > period) ? period : compare);
+}
+
+/**
+  * @brief  Convert a duty cycle to the permille intensity giving it
+  * @note   Inverse of the curve selected for the channel, for callers that
+  *         work out light output, which follows the duty cycle
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  duty_permille: Duty cycle (0-1000), larger values are clamped
+  * @retval uint16_t: Intensity value (0-1000), 0 for an invalid channel
+  */
+uint16_t VAL_PWM_DutyToPermille(uint8_t channel, uint16_t duty_permille) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT) {
+    return 0;
+  }
+  
+  uint32_t period = PWM_PERIOD(channel - 1);
+  if (duty_permille > VAL_PWM_PERMILLE_MAX) {
+    duty_permille = VAL_PWM_PERMILLE_MAX;
+  }
+  
+  return CompareToPermille(channel - 1, ((uint32_t)duty_permille * period + VAL_PWM_PERMILLE_MAX / 2U) / VAL_PWM_PERMILLE_MAX);
+}
+
+/**
+  * @brief  Select where in the period the pulse of a channel sits
+  * @note   Takes effect at once with the same on-time; the period in
+  *         progress may be cut short or stretched once. A running ramp is
+  *         stopped, its table was built for the old alignment; a slew
+  *         starts again.
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  align: VAL_PWM_ALIGN_LEADING or VAL_PWM_ALIGN_TRAILING
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise, VAL_BUSY
+  *         while strobing
+  */
+VAL_Status VAL_PWM_SetAlignment(uint8_t channel, VAL_PWM_Align_t align) {
+  uint32_t primask;
+  
+  if (channel < 1 || channel > VAL_LIGHT_COUNT || align >= VAL_PWM_ALIGN_COUNT) {
+    return VAL_PARAM;
+  }
+  
+  if (strobe_active) {
+    return VAL_BUSY;
+  }
+  
+  uint8_t index = channel - 1;
+  uint8_t bit = (uint8_t)(1U << index);
+  bool trailing = (align == VAL_PWM_ALIGN_TRAILING);
+  if (((trailing_mask & bit) != 0) == trailing) {
+    return VAL_OK;
+  }
+  
+  PWM_StopPlayback();
+  PWM_DropLatch();
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  uint32_t compare = VAL_PWM_GetCompare(channel);
+  uint32_t target = PWM_FromRegister(index, slew_targets[index]);
+  trailing_mask = trailing ? (trailing_mask | bit) : (trailing_mask & ~bit);
+  
+  /* Compare and mode together: the preload would hold the compare back a period */
+  uint32_t preload = TIM_CCMR1_OC1PE << PWM_CCMR_SHIFT(index);
+  PWM_CCMR(index) &= ~preload;
+  PWM_CCR(index) = PWM_ToRegister(index, compare);
+  PWM_SetMode(index, trailing);
+  PWM_CCMR(index) |= preload;
+  
+  slew_targets[index] = PWM_ToRegister(index, target);
+  if (slew_active) {
+    PWM_WriteSlewed(0, NULL);
+  }
+  
+  __set_PRIMASK(primask);
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get where in the period the pulse of a channel sits
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  align: Pointer to store the alignment
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_PWM_GetAlignment(uint8_t channel, VAL_PWM_Align_t* align) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT || align == NULL) {
+    return VAL_PARAM;
+  }
+  
+  *align = (trailing_mask & (1U << (channel - 1))) ? VAL_PWM_ALIGN_TRAILING : VAL_PWM_ALIGN_LEADING;
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Select how intensities map to compare values for a channel
+  * @note   Takes effect on the next intensity write
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  curve: VAL_PWM_CURVE_LINEAR or VAL_PWM_CURVE_GAMMA
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_PWM_SetCurve(uint8_t channel, VAL_PWM_Curve_t curve) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT || curve >= VAL_PWM_CURVE_COUNT) {
+    return VAL_PARAM;
+  }
+  
+  channel_curves[channel - 1] = curve;
+  gain_periods[channel - 1] = 0;
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the intensity curve of a channel
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  curve: Pointer to store the curve
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_PWM_GetCurve(uint8_t channel, VAL_PWM_Curve_t* curve) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT || curve == NULL) {
+    return VAL_PARAM;
+  }
+  
+  *curve = channel_curves[channel - 1];
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Set the output scale of a channel, stretching or shortening its on-times
+  * @note   Takes effect on the next intensity write; compare values,
+  *         ramps and dither tables given as counts are not scaled
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  scale_permille: On-time in permille of what the curve gives
+  *         (VAL_PWM_SCALE_MIN-VAL_PWM_SCALE_MAX)
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_PWM_SetOutputScale(uint8_t channel, uint16_t scale_permille) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT ||
+      scale_permille < VAL_PWM_SCALE_MIN || scale_permille > VAL_PWM_SCALE_MAX) {
+    return VAL_PARAM;
+  }
+  
+  output_scales[channel - 1] = scale_permille;
+  gain_periods[channel - 1] = 0;
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the output scale of a channel
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @retval uint16_t: Permille, VAL_PWM_SCALE_UNITY for an invalid channel
+  */
+uint16_t VAL_PWM_GetOutputScale(uint8_t channel) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT) {
+    return VAL_PWM_SCALE_UNITY;
+  }
+  
+  return output_scales[channel - 1];
+}
+
+/**
+  * @brief  Get the PWM frequency of the lights on TIM1
+  * @retval uint32_t: Number of PWM periods per second
+  */
+uint32_t VAL_PWM_GetFrequency(void) {
+  return PWM_GetTimerClock() / (__HAL_TIM_GET_AUTORELOAD(&htim1) + 1);
+}
+
+/**
+  * @brief  Set the PWM frequency of the lights on TIM1, keeping the duty
+  *         cycle of every channel
+  * @note   The period is rounded to whole counts at PWM_COUNTER_HZ. The
+  *         new period, the rescaled compare values of the TIM1 channels and of
+  *         the ADC trigger are written with update events held off, so they
+  *         latch together on the next one and no period mixes old and new.
+  *         A running ramp is stopped, its table holds compares for the old
+  *         period; a slew starts again for the new one. Not while strobing
+  *         or latch armed.
+  * @param  freq_hz: Frequency (VAL_PWM_FREQ_MIN_HZ-VAL_PWM_FREQ_MAX_HZ)
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if out of range,
+  *         VAL_BUSY while strobing or latch armed
+  */
+VAL_Status VAL_PWM_SetFrequency(uint32_t freq_hz) {
+  uint32_t primask;
+  
+  if (freq_hz < VAL_PWM_FREQ_MIN_HZ || freq_hz > VAL_PWM_FREQ_MAX_HZ) {
+    return VAL_PARAM;
+  }
+  
+  if (strobe_active || latch_armed) {
+    return VAL_BUSY;
+  }
+  
+  uint32_t period = (PWM_COUNTER_HZ + freq_hz / 2U) / freq_hz;
+  
+  PWM_StopPlayback();
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  uint32_t old_period = __HAL_TIM_GET_AUTORELOAD(&htim1) + 1U;
+  uint32_t compares[VAL_LIGHT_COUNT];
+  uint32_t targets[VAL_LIGHT_COUNT];
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    compares[i] = VAL_PWM_GetCompare(i + 1);
+    targets[i] = PWM_FromRegister(i, slew_targets[i]);
+  }
+  
+  htim1.Instance->CR1 |= TIM_CR1_UDIS;
+  
+  /* ARR is preloaded as the compares, PWM_ToRegister reads the new value */
+  __HAL_TIM_SET_AUTORELOAD(&htim1, period - 1U);
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (PWM_TIMER(i) != TIM1) {
+      continue;
+    }
+    uint32_t compare = (compares[i] * period + old_period / 2U) / old_period;
+    PWM_CCR(i) = PWM_ToRegister(i, compare);
+    slew_targets[i] = PWM_ToRegister(i, (targets[i] * period + old_period / 2U) / old_period);
+  }
+  htim1.Instance->CCR4 = (htim1.Instance->CCR4 * period + old_period / 2U) / old_period;
+  
+  htim1.Instance->CR1 &= ~TIM_CR1_UDIS;
+  
+  if (slew_active) {
+    PWM_WriteSlewed(0, NULL);
+  }
+  __set_PRIMASK(primask);
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Set the PWM timer prescalers for the present system clock
+  * @note   Called by VAL_SysClock_SetLevel with interrupts disabled, not
+  *         while strobing or latch armed. The prescaler is preloaded, so the
+  *         period in progress ends at the new clock with the old prescaler,
+  *         once shorter or longer.
+  * @retval None
+  */
+void VAL_PWM_UpdateClock(void) {
+  uint32_t clock = PWM_GetInputClock();
+
+  __HAL_TIM_SET_PRESCALER(&htim1, (clock > PWM_COUNTER_HZ) ? (clock / PWM_COUNTER_HZ - 1U) : 0U);
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  for (uint8_t t = 0; t < PWM_AUX_TIMER_COUNT; t++) {
+    pwm_aux_timers[t].timer->PSC = htim1.Instance->PSC;
+  }
+#endif
+
+  /* The rate timer shares the clock and keeps counting microseconds */
+  if (strobe_free_running) {
+    PWM_RATE_TIMER->PSC = (clock > PWM_RATE_TIMER_HZ) ? (clock / PWM_RATE_TIMER_HZ - 1U) : 0U;
+  }
+}
+
+/**
+  * @brief  Trigger the ADC at a fixed point of every PWM period
+  * @note   Leading outputs are high from the start of the period until their
+  *         compare value, so a phase below the duty cycle samples during
+  *         their on-time; trailing ones from the complement to the end.
+  *         Lights on TIM15 and TIM16 are sampled at any phase of their
+  *         own period. CCR4 is preloaded and moves on the next period boundary.
+  * @param  phase_permille: Trigger point as a fraction of the period (1-999),
+  *         or VAL_PWM_ADC_TRIGGER_OFF to stop triggering
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if out of range,
+  *         VAL_ERROR if the compare channel could not be configured,
+  *         VAL_BUSY while strobing
+  */
+VAL_Status VAL_PWM_SetAdcTrigger(uint16_t phase_permille) {
+  TIM_OC_InitTypeDef config = {0};
+  uint32_t period = __HAL_TIM_GET_AUTORELOAD(&htim1) + 1U;
+
+  if (phase_permille >= VAL_PWM_PERMILLE_MAX) {
+    return VAL_PARAM;
+  }
+
+  if (strobe_active) {
+    return VAL_BUSY;
+  }
+
+  if (phase_permille == VAL_PWM_ADC_TRIGGER_OFF) {
+    MODIFY_REG(htim1.Instance->CR2, TIM_CR2_MMS2, TIM_TRGO2_RESET);
+    return VAL_OK;
+  }
+
+  /* Compare only: CC4 output stays disabled */
+  config.OCMode = TIM_OCMODE_PWM2;
+  config.Pulse = (period * phase_permille + VAL_PWM_PERMILLE_MAX / 2U) / VAL_PWM_PERMILLE_MAX;
+  config.OCPolarity = TIM_OCPOLARITY_HIGH;
+  config.OCNPolarity = TIM_OCNPOLARITY_HIGH;
+  config.OCFastMode = TIM_OCFAST_DISABLE;
+  config.OCIdleState = TIM_OCIDLESTATE_RESET;
+  config.OCNIdleState = TIM_OCNIDLESTATE_RESET;
+  if (HAL_TIM_PWM_ConfigChannel(&htim1, &config, TIM_CHANNEL_4) != HAL_OK) {
+    return VAL_ERROR;
+  }
+
+  MODIFY_REG(htim1.Instance->CR2, TIM_CR2_MMS2, TIM_TRGO2_OC4REF);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Play a compare table on all channels using DMA
+  * @note   The table must stay valid until the ramp ends. Each row holds the
+  *         compare values of all channels in order and is applied for step_periods
+  *         PWM periods. The last row stays in place when the ramp ends.
+  *         Played as given, without slew limiting.
+  * @param  table: Compare values, steps rows of VAL_LIGHT_COUNT values
+  * @param  steps: Number of rows
+  * @param  step_periods: PWM periods per row (1-65536)
+  * @retval VAL_Status: VAL_OK if started, VAL_PARAM or VAL_ERROR otherwise,
+  *         VAL_BUSY while strobing
+  */
+VAL_Status VAL_PWM_StartRamp(const uint16_t* table, uint16_t steps, uint32_t step_periods) {
+  VAL_Status status;
+  uint32_t primask;
+  
+  if (table == NULL || steps == 0 || step_periods == 0 || step_periods > PWM_MAX_REPETITION) {
+    return VAL_PARAM;
+  }
+  
+  if (strobe_active) {
+    return VAL_BUSY;
+  }
+  
+  VAL_PWM_StopRamp();
+  PWM_DropLatch();
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  status = PWM_PlayRamp(table, steps, step_periods);
+  __set_PRIMASK(primask);
+  
+  return status;
+}
+
+/**
+  * @brief  Play a compare table on all channels over and over using DMA
+  * @note   Safe to call from interrupts. As VAL_PWM_StartRamp, but the
+  *         table is played circularly until VAL_PWM_StopRamp or a direct
+  *         write to a channel, and the loop callback is called from the DMA
+  *         interrupt with each half once played, the first half after half
+  *         the table. Rows it rewrites are played next time round; the
+  *         callback has the time the other half plays for.
+  *         VAL_PWM_IsRampActive is true throughout.
+  * @param  table: Compare values, steps rows of VAL_LIGHT_COUNT values
+  * @param  steps: Number of rows (2-65535)
+  * @param  step_periods: PWM periods per row (1-65536)
+  * @retval VAL_Status: VAL_OK if started, VAL_PARAM or VAL_ERROR otherwise,
+  *         VAL_BUSY while strobing
+  */
+VAL_Status VAL_PWM_StartLoop(const uint16_t* table, uint16_t steps, uint32_t step_periods) {
+  DMA_HandleTypeDef* hdma = htim1.hdma[TIM_DMA_ID_UPDATE];
+  VAL_Status status = VAL_OK;
+  uint32_t primask;
+  
+  if (table == NULL || steps < 2 || step_periods == 0 || step_periods > PWM_MAX_REPETITION) {
+    return VAL_PARAM;
+  }
+  
+  if (strobe_active) {
+    return VAL_BUSY;
+  }
+  
+  VAL_PWM_StopRamp();
+  PWM_DropLatch();
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  loop_steps = steps;
+  hdma->XferCpltCallback = PWM_LoopCompleteCallback;
+  hdma->XferHalfCpltCallback = PWM_LoopHalfCallback;
+  hdma->XferErrorCallback = PWM_LoopErrorCallback;
+  hdma->Instance->CCR |= DMA_CCR_CIRC;
+  
+  if (HAL_DMA_Start_IT(hdma, (uint32_t)table, (uint32_t)&htim1.Instance->DMAR,
+                       (uint32_t)steps * VAL_LIGHT_COUNT) != HAL_OK) {
+    hdma->Instance->CCR &= ~DMA_CCR_CIRC;
+    status = VAL_ERROR;
+  } else {
+    htim1.Instance->RCR = step_periods - 1;
+    htim1.Instance->DCR = TIM_DMABASE_CCR1 | ((VAL_LIGHT_COUNT - 1U) << TIM_DCR_DBL_Pos);
+    __HAL_TIM_ENABLE_DMA(&htim1, TIM_DMA_UPDATE);
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+    PWM_StartFollowing();
+#endif
+    ramp_active = true;
+  }
+  
+  __set_PRIMASK(primask);
+  
+  return status;
+}
+
+/**
+  * @brief  Stop a running ramp, slew or dither, keeping the outputs at their current values
+  * @note   Safe to call from interrupts. A dithered channel is left at one
+  *         of its two compare values.
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_PWM_StopRamp(void) {
+  uint32_t primask = __get_PRIMASK();
+  
+  __disable_irq();
+  PWM_StopPlayback();
+  slew_active = false;
+  __set_PRIMASK(primask);
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Check whether a ramp is running
+  * @retval bool: true while a ramp or a slew is being played
+  */
+bool VAL_PWM_IsRampActive(void) {
+  return ramp_active;
+}
+
+/**
+  * @brief  Set the slew limit of a channel
+  * @note   Applies from the next write; a slew in progress keeps its pace
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  permille_per_ms: Fastest duty cycle change in permille of the
+  *         period per millisecond (1-VAL_PWM_SLEW_MAX), VAL_PWM_SLEW_OFF for
+  *         no limit
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM otherwise
+  */
+VAL_Status VAL_PWM_SetSlewLimit(uint8_t channel, uint16_t permille_per_ms) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT || permille_per_ms > VAL_PWM_SLEW_MAX) {
+    return VAL_PARAM;
+  }
+  
+  slew_limits[channel - 1] = permille_per_ms;
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the slew limit of a channel
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @retval uint16_t: Permille of the period per millisecond, VAL_PWM_SLEW_OFF
+  *         for no limit or an invalid channel
+  */
+uint16_t VAL_PWM_GetSlewLimit(uint8_t channel) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT) {
+    return VAL_PWM_SLEW_OFF;
+  }
+  
+  return slew_limits[channel - 1];
+}
+
+/**
+  * @brief  Get the time the slew limit of a channel takes for a change
+  * @note   For callers building ramps of their own, e.g. fades
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  from_permille: Intensity to start from (0-1000)
+  * @param  to_permille: Intensity to end at (0-1000)
+  * @retval uint32_t: Milliseconds, rounded up; 0 without a limit or for an
+  *         invalid channel
+  */
+uint32_t VAL_PWM_GetSlewTime(uint8_t channel, uint16_t from_permille, uint16_t to_permille) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT || slew_limits[channel - 1] == VAL_PWM_SLEW_OFF) {
+    return 0;
+  }
+  
+  uint32_t from = PermilleToCompare(channel - 1, from_permille);
+  uint32_t to = PermilleToCompare(channel - 1, to_permille);
+  uint32_t delta = (to > from) ? (to - from) : (from - to);
+  uint32_t counts_per_s = (uint32_t)slew_limits[channel - 1] * PWM_PERIOD(channel - 1);
+  
+  /* A limit of L permille per ms is L * period counts per second */
+  return (delta * 1000U + counts_per_s - 1U) / counts_per_s;
+}
+
+/**
+  * @brief  Check whether a slew is moving the outputs
+  * @retval bool: true until the slew reaches its targets
+  */
+bool VAL_PWM_IsSlewActive(void) {
+  return slew_active && ramp_active;
+}
+
+/**
+  * @brief  Dither all channels to on-times finer than one count
+  * @note   Safe to call from interrupts. While dithering, a new call only
+  *         rewrites the table, the cycle in progress may mix old and new
+  *         rows once. Otherwise a running ramp is stopped and the cycle
+  *         starts on the next update event. Stopped by VAL_PWM_StopRamp and
+  *         any direct write to a channel.
+  * @note   Lights on TIM15 and TIM16 take a row per TIM1 period, so at
+  *         another frequency their mean only approximates the fine on-time.
+  * @param  on_time: On-time per channel in 1/VAL_PWM_DITHER_STEPS counts,
+  *         VAL_LIGHT_COUNT entries, see VAL_PWM_PermilleToFineCompare;
+  *         values beyond the period are clamped
+  * @retval VAL_Status: VAL_OK if dithering, VAL_PARAM if on_time is NULL,
+  *         VAL_BUSY while strobing or latch armed, VAL_ERROR if the DMA
+  *         could not be started
+  */
+VAL_Status VAL_PWM_SetDither(const uint32_t* on_time) {
+  DMA_HandleTypeDef* hdma = htim1.hdma[TIM_DMA_ID_UPDATE];
+  VAL_Status status = VAL_OK;
+  uint32_t primask;
+  
+  if (on_time == NULL) {
+    return VAL_PARAM;
+  }
+  
+  if (strobe_active || latch_armed) {
+    return VAL_BUSY;
+  }
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  /* The table takes over from a slew in progress */
+  if (ramp_active) {
+    PWM_AbortRamp();
+  }
+  slew_active = false;
+  
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    uint32_t period = PWM_PERIOD(i);
+    uint32_t fine = (on_time[i] > (period << VAL_PWM_DITHER_BITS)) ? (period << VAL_PWM_DITHER_BITS)
+                                                                  : on_time[i];
+    uint32_t base = fine >> VAL_PWM_DITHER_BITS;
+    uint32_t fraction = fine & (VAL_PWM_DITHER_STEPS - 1U);
+    
+    /* Spread the longer periods evenly over the cycle */
+    for (uint32_t row = 0; row < VAL_PWM_DITHER_STEPS; row++) {
+      uint32_t carry = (((row + 1U) * fraction) >> VAL_PWM_DITHER_BITS) -
+                       ((row * fraction) >> VAL_PWM_DITHER_BITS);
+      dither_table[row][i] = (uint16_t)PWM_ToRegister(i, base + carry);
+    }
+  }
+  
+  if (!dither_active) {
+    /* Circular on the DMA side, so no interrupt is needed to go round */
+    hdma->XferCpltCallback = NULL;
+    hdma->XferHalfCpltCallback = NULL;
+    hdma->XferErrorCallback = NULL;
+    hdma->Instance->CCR |= DMA_CCR_CIRC;
+    
+    if (HAL_DMA_Start(hdma, (uint32_t)dither_table, (uint32_t)&htim1.Instance->DMAR,
+                      VAL_PWM_DITHER_STEPS * VAL_LIGHT_COUNT) != HAL_OK) {
+      hdma->Instance->CCR &= ~DMA_CCR_CIRC;
+      status = VAL_ERROR;
+    } else {
+      htim1.Instance->RCR = 0;
+      htim1.Instance->DCR = TIM_DMABASE_CCR1 | ((VAL_LIGHT_COUNT - 1U) << TIM_DCR_DBL_Pos);
+      __HAL_TIM_ENABLE_DMA(&htim1, TIM_DMA_UPDATE);
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+      PWM_StartFollowing();
+#endif
+      dither_active = true;
+    }
+  }
+  
+  __set_PRIMASK(primask);
+  
+  return status;
+}
+
+/**
+  * @brief  Check whether the channels are being dithered
+  * @retval bool: true while the dither cycle is played
+  */
+bool VAL_PWM_IsDitherActive(void) {
+  return dither_active;
+}
+
+/**
+  * @brief  Convert a permille intensity to a fine on-time for dithering
+  * @note   Uses the curve selected for the channel
+  * @param  channel: Channel number (1-VAL_LIGHT_COUNT)
+  * @param  permille: Intensity value (0-1000), larger values are clamped
+  * @retval uint32_t: On-time in 1/VAL_PWM_DITHER_STEPS counts, 0 for an invalid channel
+  */
+uint32_t VAL_PWM_PermilleToFineCompare(uint8_t channel, uint16_t permille) {
+  if (channel < 1 || channel > VAL_LIGHT_COUNT) {
+    return 0;
+  }
+  
+  return PermilleToFine(channel - 1, permille);
+}
+
+/**
+  * @brief  Set the function called from the DMA interrupt when a ramp ends
+  * @note   Not called for ramps stopped by VAL_PWM_StopRamp or a channel write
+  * @param  callback: Function to call, or NULL to disable
+  * @retval None
+  */
+void VAL_PWM_SetRampCallback(VAL_PWM_RampCallback callback) {
+  ramp_callback = callback;
+}
+
+/**
+  * @brief  Set the function called from the DMA interrupt to refill a loop
+  * @param  callback: Function to call, or NULL to disable
+  * @retval None
+  */
+void VAL_PWM_SetLoopCallback(VAL_PWM_LoopCallback callback) {
+  loop_callback = callback;
+}
+
+/**
+  * @brief  Hand the outputs to the external trigger input or the rate timer
+  * @note   Each edge on PA12 fires one pulse of all channels at the given
+  *         intensities, started by the timer hardware. Edges during a pulse
+  *         are ignored and counted as missed. With a period, TIM15 fires
+  *         the pulses instead, the first one at once, and PA12 is not used.
+  *         A running ramp is stopped and the TIM1 ADC trigger is turned
+  *         off. Calling it again while strobing replaces the pulse; the
+  *         counts restart from zero. Lights on TIM15 and TIM16 stay
+  *         dark.
+  * @param  config: Pulse length, period, intensities and trigger edge
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if the pulse is too
+  *         short or too long for the timer or not shorter than the period,
+  *         VAL_BUSY if the latency probe (benchmark builds) or a light holds
+  *         TIM15
+  */
+VAL_Status VAL_PWM_StartStrobe(const VAL_PWM_StrobeConfig_t* config) {
+  GPIO_InitTypeDef gpio = {0};
+  uint32_t max_period;
+  uint64_t counts;
+  uint32_t periods;
+  uint32_t period;
+  uint32_t on_min;
+  uint32_t sample_us = 0;
+  uint32_t primask;
+  
+  if (config == NULL || config->duration_us == 0 || config->duration_us > VAL_PWM_STROBE_MAX_US) {
+    return VAL_PARAM;
+  }
+  
+  /* The pulse must end before the next one starts */
+  if (config->period_us != 0 &&
+      (config->period_us > VAL_PWM_STROBE_PERIOD_MAX_US || config->period_us <= config->duration_us)) {
+    return VAL_PARAM;
+  }
+  
+#if VAL_BOARD_USES_TIM15
+  if (config->period_us != 0) {
+    return VAL_BUSY;
+  }
+#endif
+#ifdef BENCHMARK
+  if (config->period_us != 0 && VAL_Timers_IsLatencyProbeRunning()) {
+    return VAL_BUSY;
+  }
+#endif
+  
+  /* Split the pulse into equal periods no longer than the PWM period */
+  max_period = strobe_active ? continuous_period : __HAL_TIM_GET_AUTORELOAD(&htim1) + 1U;
+  counts = ((uint64_t)config->duration_us * PWM_GetTimerClock() + 500000U) / 1000000U;
+  periods = (uint32_t)((counts + max_period - 1U) / max_period);
+  if (counts < 2U || periods > PWM_MAX_REPETITION) {
+    return VAL_PARAM;
+  }
+  period = (uint32_t)(counts / periods);
+  
+  VAL_PWM_StopRamp();
+  PWM_DropLatch();
+  
+  /* The input rests at the level opposite to the edge */
+  if (config->period_us == 0) {
+    gpio.Pin = PWM_STROBE_PIN;
+    gpio.Mode = GPIO_MODE_AF_PP;
+    gpio.Pull = config->falling_edge ? GPIO_PULLUP : GPIO_PULLDOWN;
+    gpio.Speed = GPIO_SPEED_FREQ_LOW;
+    gpio.Alternate = GPIO_AF1_TIM1;
+    HAL_GPIO_Init(PWM_STROBE_PORT, &gpio);
+  } else if (strobe_active && !strobe_free_running) {
+    HAL_GPIO_DeInit(PWM_STROBE_PORT, PWM_STROBE_PIN);
+  }
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  if (!strobe_active) {
+    continuous_period = __HAL_TIM_GET_AUTORELOAD(&htim1) + 1U;
+  }
+  
+  PWM_StopRateTimer();
+  htim1.Instance->CR1 &= ~TIM_CR1_CEN;
+  htim1.Instance->SMCR = 0;
+  htim1.Instance->DIER &= ~(TIM_DIER_TIE | TIM_DIER_UIE);
+  MODIFY_REG(htim1.Instance->CR2, TIM_CR2_MMS2, TIM_TRGO2_RESET);
+  
+  /* Compares are mapped at the pulse period; up to ARR keeps the rest level low */
+  htim1.Instance->ARR = period - 1U;
+  htim1.Instance->RCR = periods - 1U;
+  on_min = period;
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    PWM_SetMode(i, false);
+    if (PWM_TIMER(i) != TIM1) {
+      PWM_CCR(i) = 0;
+      continue;
+    }
+    uint32_t compare = PermilleToCompare(i, config->permille[i]);
+    if (compare > period - 1U) {
+      compare = period - 1U;
+    }
+    PWM_CCR(i) = compare;
+    if (compare != 0 && compare < on_min) {
+      on_min = compare;
+    }
+  }
+  
+  /* Down-counting one-pulse mode; the update loads the shadow registers and
+   * parks the counter at ARR without raising an interrupt */
+  htim1.Instance->CR1 |= TIM_CR1_DIR | TIM_CR1_OPM | TIM_CR1_URS;
+  htim1.Instance->EGR = TIM_EGR_UG;
+  htim1.Instance->SR = ~(uint32_t)(TIM_SR_UIF | TIM_SR_TIF);
+  
+  strobe_triggers = 0;
+  strobe_pulses = 0;
+  strobe_missed = 0;
+  strobe_active = true;
+  strobe_free_running = (config->period_us != 0);
+  
+  if (!strobe_free_running) {
+    /* Edges on ETR start the counter from now on */
+    htim1.Instance->SMCR = PWM_STROBE_ETR_FILTER | (config->falling_edge ? TIM_SMCR_ETP : 0U) |
+                           TIM_TS_ETRF | TIM_SLAVEMODE_TRIGGER;
+  } else {
+    /* ADC trigger in the middle of the shortest on-time of the first period */
+    uint32_t clock = PWM_GetInputClock();
+    sample_us = (uint32_t)(((uint64_t)(period - on_min / 2U) * 1000000U + PWM_GetTimerClock() / 2U) /
+                           PWM_GetTimerClock());
+    
+    __HAL_RCC_TIM15_CLK_ENABLE();
+    PWM_RATE_TIMER->PSC = (clock > PWM_RATE_TIMER_HZ) ? (clock / PWM_RATE_TIMER_HZ - 1U) : 0U;
+    PWM_RATE_TIMER->ARR = config->period_us - 1U;
+    PWM_RATE_TIMER->CCR1 = (sample_us != 0) ? sample_us : 1U;
+    PWM_RATE_TIMER->CCMR1 = TIM_OCMODE_PWM1;    /* Reference only, CC1 output stays disabled */
+    PWM_RATE_TIMER->CR2 = TIM_TRGO_OC1REF;
+    PWM_RATE_TIMER->EGR = TIM_EGR_UG;
+    PWM_RATE_TIMER->SR = 0;
+    
+    /* The update edge of the rate timer starts the counter from now on,
+     * beginning with the reference rising as the rate timer starts */
+    htim1.Instance->SMCR = TIM_TS_ITR0 | TIM_SLAVEMODE_TRIGGER;
+    PWM_RATE_TIMER->CR1 = TIM_CR1_CEN;
+  }
+  htim1.Instance->DIER |= TIM_DIER_TIE | TIM_DIER_UIE;
+  
+  __set_PRIMASK(primask);
+  
+  HAL_NVIC_SetPriority(TIM1_UP_TIM16_IRQn, PWM_STROBE_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(TIM1_UP_TIM16_IRQn);
+  HAL_NVIC_SetPriority(TIM1_TRG_COM_IRQn, PWM_STROBE_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(TIM1_TRG_COM_IRQn);
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Return to continuous PWM with all channels off
+  * @note   A pulse in progress is cut short. The ADC trigger stays off.
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_PWM_StopStrobe(void) {
+  bool free_running = strobe_free_running;
+  uint32_t primask;
+  
+  if (!strobe_active) {
+    return VAL_OK;
+  }
+  
+  HAL_NVIC_DisableIRQ(TIM1_TRG_COM_IRQn);
+  HAL_NVIC_DisableIRQ(TIM1_UP_TIM16_IRQn);
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  PWM_StopRateTimer();
+  htim1.Instance->SMCR = 0;
+  htim1.Instance->CR1 &= ~(TIM_CR1_CEN | TIM_CR1_DIR | TIM_CR1_OPM | TIM_CR1_URS);
+  htim1.Instance->DIER &= ~(TIM_DIER_TIE | TIM_DIER_UIE);
+  
+  htim1.Instance->ARR = continuous_period - 1U;
+  htim1.Instance->RCR = 0;
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    PWM_SetMode(i, (trailing_mask & (1U << i)) != 0);
+    PWM_CCR(i) = PWM_ToRegister(i, 0);
+  }
+  htim1.Instance->EGR = TIM_EGR_UG;
+  htim1.Instance->SR = ~(uint32_t)(TIM_SR_UIF | TIM_SR_TIF);
+  htim1.Instance->CR1 |= TIM_CR1_CEN;
+  
+  strobe_active = false;
+  
+  __set_PRIMASK(primask);
+  
+  HAL_NVIC_ClearPendingIRQ(TIM1_TRG_COM_IRQn);
+  HAL_NVIC_ClearPendingIRQ(TIM1_UP_TIM16_IRQn);
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  HAL_NVIC_EnableIRQ(TIM1_UP_TIM16_IRQn);
+#endif
+  if (!free_running) {
+    HAL_GPIO_DeInit(PWM_STROBE_PORT, PWM_STROBE_PIN);
+  }
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Check whether the outputs follow the external trigger
+  * @retval bool: true in strobe mode
+  */
+bool VAL_PWM_IsStrobeActive(void) {
+  return strobe_active;
+}
+
+/**
+  * @brief  Check whether the rate timer fires the strobe pulses
+  * @retval bool: true in strobe mode with a period
+  */
+bool VAL_PWM_IsStrobeFreeRunning(void) {
+  return strobe_free_running;
+}
+
+/**
+  * @brief  Get the trigger and pulse counts since the strobe was configured
+  * @param  stats: Pointer to store the counts
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if stats is NULL
+  */
+VAL_Status VAL_PWM_GetStrobeStats(VAL_PWM_StrobeStats_t* stats) {
+  uint32_t primask;
+  
+  if (stats == NULL) {
+    return VAL_PARAM;
+  }
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  stats->triggers = strobe_triggers;
+  stats->pulses = strobe_pulses;
+  stats->missed = strobe_missed;
+  __set_PRIMASK(primask);
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Count strobe edges and pulses, called from the TIM1 update and
+  *         trigger interrupts
+  * @note   The end of a pulse is handled before an edge flagged in the same
+  *         call, so a pulse shorter than the interrupt latency still counts
+  *         the next edge as fired. Out of strobe mode the update carries a
+  *         played row over to the lights on TIM15 and TIM16.
+  * @retval None
+  */
+void VAL_PWM_StrobeIRQHandler(void) {
+  uint32_t flags = htim1.Instance->SR & htim1.Instance->DIER & (TIM_SR_UIF | TIM_SR_TIF);
+  
+  htim1.Instance->SR = ~flags;
+  
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  if (!strobe_active) {
+    if (flags & TIM_SR_UIF) {
+      PWM_FollowRow();
+    }
+    return;
+  }
+#endif
+  
+  if (flags & TIM_SR_UIF) {
+    strobe_pulses++;
+  }
+  
+  if (flags & TIM_SR_TIF) {
+    /* An edge that found a pulse still running did not start one */
+    if ((int32_t)(strobe_triggers - strobe_missed - strobe_pulses) > 0) {
+      strobe_missed++;
+    }
+    strobe_triggers++;
+  }
+}
+
+/**
+  * @brief  De-initialize the PWM module
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  */
+VAL_Status VAL_PWM_DeInit(void) {
+  VAL_PWM_StopStrobe();
+  PWM_DropLatch();
+  
+  /* Stop PWM generation for all channels */
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (VAL_Channels[i].pwm_timer == 1) {
+      HAL_TIM_PWM_Stop(&htim1, VAL_Channels[i].pwm_channel);
+    }
+  }
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  HAL_NVIC_DisableIRQ(TIM1_UP_TIM16_IRQn);
+  PWM_DeInitAuxTimers();
+#endif
+  VAL_PWM_SetAdcTrigger(VAL_PWM_ADC_TRIGGER_OFF);
+  
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Put back the values in use when the latch was armed
+  * @note   Safe to call from interrupts; does nothing unless armed
+  * @retval None
+  */
+static void PWM_DropLatch(void) {
+  uint32_t primask;
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  if (latch_armed) {
+    for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+      PWM_CCR(i) = latch_restore[i];
+    }
+    PWM_ReleaseUpdates();
+    latch_armed = false;
+  }
+  
+  __set_PRIMASK(primask);
+  
+  PWM_StopSync();
+}
+
+/**
+  * @brief  Stop latching on the sync line and release the pin
+  * @note   Safe to call from interrupts
+  * @retval None
+  */
+static void PWM_StopSync(void) {
+  if (!latch_on_sync) {
+    return;
+  }
+  
+  HAL_NVIC_DisableIRQ(PWM_SYNC_IRQn);
+  latch_on_sync = false;
+  HAL_GPIO_DeInit(PWM_STROBE_PORT, PWM_STROBE_PIN);
+  __HAL_GPIO_EXTI_CLEAR_IT(PWM_STROBE_PIN);
+  HAL_NVIC_ClearPendingIRQ(PWM_SYNC_IRQn);
+}
+
+/**
+  * @brief  Stop the ramp DMA and return to one update per period
+  * @note   Called with interrupts disabled. A ramp step may last many
+  *         periods, so an update is forced to make the next compare write
+  *         latch within one period; this cuts the running period short
+  *         once. The outputs keep the last row written; a burst cut short
+  *         may leave channels one row apart.
+  * @retval None
+  */
+static void PWM_AbortRamp(void) {
+  DMA_HandleTypeDef* hdma = htim1.hdma[TIM_DMA_ID_UPDATE];
+  
+  __HAL_TIM_DISABLE_DMA(&htim1, TIM_DMA_UPDATE);
+  HAL_DMA_Abort(hdma);
+  hdma->Instance->CCR &= ~DMA_CCR_CIRC;
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  PWM_StopFollowing();
+#endif
+  
+  /* A dither row lasts one period already */
+  if (ramp_active) {
+    htim1.Instance->RCR = 0;
+    htim1.Instance->EGR = TIM_EGR_UG;
+  }
+  ramp_active = false;
+  dither_active = false;
+}
+
+/**
+  * @brief  Stop a running ramp or dither, leaving a slew to be resumed
+  * @note   Safe to call from interrupts
+  * @retval None
+  */
+static void PWM_StopPlayback(void) {
+  uint32_t primask = __get_PRIMASK();
+  
+  __disable_irq();
+  if (ramp_active || dither_active) {
+    PWM_AbortRamp();
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Start playing a compare table from the next update event
+  * @note   Called with interrupts disabled and nothing playing
+  * @param  table: Compare values, steps rows of VAL_LIGHT_COUNT values
+  * @param  steps: Number of rows
+  * @param  step_periods: PWM periods per row (1-65536)
+  * @retval VAL_Status: VAL_OK if started, VAL_ERROR otherwise
+  */
+static VAL_Status PWM_PlayRamp(const uint16_t* table, uint16_t steps, uint32_t step_periods) {
+  DMA_HandleTypeDef* hdma = htim1.hdma[TIM_DMA_ID_UPDATE];
+  
+  hdma->XferCpltCallback = PWM_RampCompleteCallback;
+  hdma->XferHalfCpltCallback = NULL;
+  hdma->XferErrorCallback = PWM_RampCompleteCallback;
+  
+  if (HAL_DMA_Start_IT(hdma, (uint32_t)table, (uint32_t)&htim1.Instance->DMAR,
+                       (uint32_t)steps * VAL_LIGHT_COUNT) != HAL_OK) {
+    return VAL_ERROR;
+  }
+  
+  /* The repetition counter loads on the next update, together with the
+   * first row written by the DMA request of that same update */
+  htim1.Instance->RCR = step_periods - 1;
+  htim1.Instance->DCR = TIM_DMABASE_CCR1 | ((VAL_LIGHT_COUNT - 1U) << TIM_DCR_DBL_Pos);
+  __HAL_TIM_ENABLE_DMA(&htim1, TIM_DMA_UPDATE);
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  PWM_StartFollowing();
+#endif
+  ramp_active = true;
+  
+  return VAL_OK;
+}
+
+/**
+  * @brief  Move channels to new compare values within their slew limits
+  * @note   Safe to call from interrupts. A running ramp or dither is
+  *         stopped. Channels outside the mask go on towards the targets of
+  *         a slew in progress, or stay. The slowest channel sets the
+  *         length, the limited ones move in the same rows; targets one
+  *         period reaches are written with update events held off.
+  * @param  mask: Channels to change, one bit per index
+  * @param  values: Register values, indexed by channel, used for the mask
+  * @retval None
+  */
+static void PWM_WriteSlewed(uint32_t mask, const uint32_t* values) {
+  uint32_t frequency = VAL_PWM_GetFrequency();
+  uint32_t from[VAL_LIGHT_COUNT];
+  uint32_t periods = 0;
+  uint32_t primask;
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  if (ramp_active || dither_active) {
+    PWM_AbortRamp();
+  }
+  
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    from[i] = PWM_CCR(i);
+    if (mask & (1U << i)) {
+      slew_targets[i] = values[i];
+    } else if (!slew_active) {
+      slew_targets[i] = from[i];
+    }
+    
+    /* L permille per ms is L * period / 1000 counts of the channel's own
+     * period in 1000 / frequency TIM1 periods, which the rows last;
+     * delta * frequency stays below the counter clock */
+    uint32_t delta = (slew_targets[i] > from[i]) ? (slew_targets[i] - from[i]) : (from[i] - slew_targets[i]);
+    if (slew_limits[i] != VAL_PWM_SLEW_OFF && delta != 0) {
+      uint32_t counts = (uint32_t)slew_limits[i] * PWM_PERIOD(i);
+      uint32_t needed = (delta * frequency + counts - 1U) / counts;
+      if (needed > periods) {
+        periods = needed;
+      }
+    }
+  }
+  
+  slew_active = false;
+  
+  if (periods > 1U) {
+    uint32_t steps = (periods < PWM_SLEW_STEPS) ? periods : PWM_SLEW_STEPS;
+    uint32_t step_periods = (periods + steps - 1U) / steps;
+    
+    for (uint32_t row = 0; row < steps; row++) {
+      for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+        int32_t change = (int32_t)slew_targets[i] - (int32_t)from[i];
+        
+        /* Channels without a limit take their step in the first row */
+        if (slew_limits[i] == VAL_PWM_SLEW_OFF) {
+          slew_table[row][i] = (uint16_t)slew_targets[i];
+        } else {
+          slew_table[row][i] = (uint16_t)((int32_t)from[i] + change * (int32_t)(row + 1U) / (int32_t)steps);
+        }
+      }
+    }
+    
+    if (step_periods <= PWM_MAX_REPETITION &&
+        PWM_PlayRamp(&slew_table[0][0], (uint16_t)steps, step_periods) == VAL_OK) {
+      slew_active = true;
+      __set_PRIMASK(primask);
+      return;
+    }
+  }
+  
+  /* Within one period, or the DMA could not start: straight to the targets */
+  PWM_HoldUpdates();
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    PWM_CCR(i) = slew_targets[i];
+  }
+  PWM_ReleaseUpdates();
+  
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Ramp DMA transfer complete or error, called from the DMA interrupt
+  * @note   The last row latches on the next update event, the repetition
+  *         counter returns to one period at the same time
+  * @param  hdma: DMA handle
+  * @retval None
+  */
+static void PWM_RampCompleteCallback(DMA_HandleTypeDef* hdma) {
+  (void)hdma;
+  
+  __HAL_TIM_DISABLE_DMA(&htim1, TIM_DMA_UPDATE);
+  htim1.Instance->RCR = 0;
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  /* The last row is written, its update may not come through any more */
+  PWM_FollowRow();
+  PWM_StopFollowing();
+#endif
+  ramp_active = false;
+  
+  /* A slew is no fade, it ends without the callback */
+  if (slew_active) {
+    slew_active = false;
+    return;
+  }
+  
+  if (ramp_callback != NULL) {
+    ramp_callback();
+  }
+}
+
+/**
+  * @brief  Loop DMA half transfer, called from the DMA interrupt
+  * @param  hdma: DMA handle
+  * @retval None
+  */
+static void PWM_LoopHalfCallback(DMA_HandleTypeDef* hdma) {
+  (void)hdma;
+  
+  /* The half transfer flag rises at half the transfers, rounded down */
+  uint16_t half = (uint16_t)((((uint32_t)loop_steps * VAL_LIGHT_COUNT) / 2U) / VAL_LIGHT_COUNT);
+  
+  if (loop_callback != NULL) {
+    loop_callback(0, half);
+  }
+}
+
+/**
+  * @brief  Loop DMA transfer complete, called from the DMA interrupt
+  * @note   The DMA is back at the first row already
+  * @param  hdma: DMA handle
+  * @retval None
+  */
+static void PWM_LoopCompleteCallback(DMA_HandleTypeDef* hdma) {
+  (void)hdma;
+  
+  uint16_t half = (uint16_t)((((uint32_t)loop_steps * VAL_LIGHT_COUNT) / 2U) / VAL_LIGHT_COUNT);
+  
+  if (loop_callback != NULL) {
+    loop_callback(half, (uint16_t)(loop_steps - half));
+  }
+}
+
+/**
+  * @brief  Loop DMA transfer error, called from the DMA interrupt
+  * @note   The channel is disabled by then; the loop ends as a ramp does,
+  *         with the ramp callback
+  * @param  hdma: DMA handle
+  * @retval None
+  */
+static void PWM_LoopErrorCallback(DMA_HandleTypeDef* hdma) {
+  hdma->Instance->CCR &= ~DMA_CCR_CIRC;
+  PWM_RampCompleteCallback(hdma);
+}
+
+/**
+  * @brief  Get the clock of the APB2 timers, before their prescalers
+  * @retval uint32_t: Clock in Hz
+  */
+static uint32_t PWM_GetInputClock(void) {
+  uint32_t clock = HAL_RCC_GetPCLK2Freq();
+  
+  /* Timer clocks run at twice the APB clock when it is divided */
+  if ((RCC->CFGR & RCC_CFGR_PPRE2) != RCC_HCLK_DIV1) {
+    clock *= 2;
+  }
+  
+  return clock;
+}
+
+/**
+  * @brief  Get the TIM1 counter clock
+  * @retval uint32_t: Counts per second
+  */
+static uint32_t PWM_GetTimerClock(void) {
+  return PWM_GetInputClock() / (htim1.Instance->PSC + 1);
+}
+
+/**
+  * @brief  Stop the rate timer of a free-running strobe
+  * @note   Called with interrupts disabled
+  * @retval None
+  */
+static void PWM_StopRateTimer(void) {
+  if (!strobe_free_running) {
+    return;
+  }
+  
+  PWM_RATE_TIMER->CR1 = 0;
+  PWM_RATE_TIMER->CR2 = 0;
+  PWM_RATE_TIMER->CCMR1 = 0;
+  __HAL_RCC_TIM15_CLK_DISABLE();
+  strobe_free_running = false;
+}
+
+/**
+  * @brief  Convert a permille intensity to a compare value of a channel
+  * @note   Full scale gives a compare value above ARR, i.e. a constant high
+  *         output in PWM mode 1. A channel with an output scale above
+  *         VAL_PWM_SCALE_UNITY gets there at a lower intensity, one below
+  *         it not at all.
+  * @param  index: Channel index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  permille: Intensity value, clamped to 0-1000
+  * @retval uint32_t: Compare value
+  */
+static uint32_t PermilleToCompare(uint8_t index, uint16_t permille) {
+  uint32_t fine = PermilleToFine(index, permille);
+  
+  return (fine + (VAL_PWM_DITHER_STEPS / 2U)) >> VAL_PWM_DITHER_BITS;
+}
+
+/**
+  * @brief  Convert a permille intensity to an on-time finer than one count
+  * @param  index: Channel index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  permille: Intensity value (0-1000), larger values are clamped
+  * @retval uint32_t: On-time in 1/VAL_PWM_DITHER_STEPS counts, up to the period
+  */
+static uint32_t PermilleToFine(uint8_t index, uint16_t permille) {
+  uint32_t period = PWM_PERIOD(index);
+  uint32_t full = period << VAL_PWM_DITHER_BITS;
+  uint32_t fine;
+  
+  if (permille > VAL_PWM_PERMILLE_MAX) {
+    permille = VAL_PWM_PERMILLE_MAX;
+  }
+  
+  /* The tables hold the same fraction of a count; the gain takes them to
+   * the period and the output scale of the channel */
+  fine = (channel_curves[index] == VAL_PWM_CURVE_GAMMA) ? VAL_Channels[index].gamma_table[permille] : permille;
+  fine = (uint32_t)(((uint64_t)fine * PWM_FineGain(index, period) + 0x8000U) >> 16);
+  
+  return (fine > full) ? full : fine;
+}
+
+/**
+  * @brief  Get the factor from curve values to on-times of a channel
+  * @note   Computed again after a change of the period, the curve or the
+  *         output scale, with interrupts off so an interrupted update
+  *         cannot leave a stale factor behind
+  * @param  index: Channel index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  period: Counts per period of the channel
+  * @retval uint32_t: Factor in Q16, fine on-time per gamma table entry or per permille
+  */
+static uint32_t PWM_FineGain(uint8_t index, uint32_t period) {
+  if (gain_periods[index] != period) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    
+    uint64_t scaled = ((uint64_t)period * output_scales[index]) << 16;
+    uint32_t divisor = (channel_curves[index] == VAL_PWM_CURVE_GAMMA) ?
+        VAL_PWM_CURVE_PERIOD * VAL_PWM_SCALE_UNITY :
+        (VAL_PWM_PERMILLE_MAX * VAL_PWM_SCALE_UNITY) >> VAL_PWM_DITHER_BITS;
+    
+    fine_gains_q16[index] = (uint32_t)((scaled + divisor / 2U) / divisor);
+    gain_periods[index] = period;
+    __set_PRIMASK(primask);
+  }
+  
+  return fine_gains_q16[index];
+}
+
+/**
+  * @brief  Convert an on-time to the compare register value of a channel
+  * @note   A trailing channel compares in PWM mode 2, high from the register
+  *         value to the end of the period
+  * @param  index: Channel index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  compare: On-time in counts, up to the period
+  * @retval uint32_t: Register value
+  */
+static uint32_t PWM_ToRegister(uint8_t index, uint32_t compare) {
+  uint32_t period = PWM_PERIOD(index);
+  
+  if ((trailing_mask & (1U << index)) == 0) {
+    return compare;
+  }
+  
+  return (compare >= period) ? 0U : period - compare;
+}
+
+/**
+  * @brief  Convert a compare register value of a channel to its on-time
+  * @param  index: Channel index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  value: Register value
+  * @retval uint32_t: On-time in counts
+  */
+static uint32_t PWM_FromRegister(uint8_t index, uint32_t value) {
+  /* The complement is its own inverse */
+  return PWM_ToRegister(index, value);
+}
+
+/**
+  * @brief  Set the output compare mode of a channel
+  * @note   PWM modes 1 and 2 differ in the lowest OCxM bit only
+  * @param  index: Channel index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  trailing: PWM mode 2 if true, PWM mode 1 otherwise
+  * @retval None
+  */
+static void PWM_SetMode(uint8_t index, bool trailing) {
+  uint32_t bit = TIM_CCMR1_OC1M_0 << PWM_CCMR_SHIFT(index);
+  
+  if (trailing) {
+    PWM_CCMR(index) |= bit;
+  } else {
+    PWM_CCMR(index) &= ~bit;
+  }
+}
+
+/**
+  * @brief  Convert a compare value of a channel back to a permille intensity
+  * @note   For gamma curves this is the lowest intensity giving at least the
+  *         compare value, found by binary search; flat parts of a table map
+  *         to their first entry. The output scale is taken out again.
+  * @param  index: Channel index (0 to VAL_LIGHT_COUNT - 1)
+  * @param  compare: Compare value
+  * @retval uint16_t: Intensity value (0-1000)
+  */
+static uint16_t CompareToPermille(uint8_t index, uint32_t compare) {
+  uint32_t period = PWM_PERIOD(index);
+  uint32_t gain = PWM_FineGain(index, period);
+  
+  if (compare >= period) {
+    return VAL_PWM_PERMILLE_MAX;
+  }
+  
+  if (channel_curves[index] == VAL_PWM_CURVE_GAMMA) {
+    const uint16_t* table = VAL_Channels[index].gamma_table;
+    uint16_t low = 0;
+    uint16_t high = VAL_PWM_PERMILLE_MAX;
+    
+    /* The lowest entry that rounds to the compare value or above */
+    uint32_t fine = (compare == 0) ? 0 : (compare << VAL_PWM_DITHER_BITS) - (VAL_PWM_DITHER_STEPS / 2U);
+    while (low < high) {
+      uint16_t mid = (uint16_t)((low + high) / 2);
+      if ((((uint64_t)table[mid] * gain + 0x8000U) >> 16) < fine) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return low;
+  }
+  
+  /* Rounded to the nearest permille, at most full scale */
+  uint32_t permille = (uint32_t)((((uint64_t)compare << (16U + VAL_PWM_DITHER_BITS)) + gain / 2U) / gain);
+  return (uint16_t)((permille > VAL_PWM_PERMILLE_MAX) ? VAL_PWM_PERMILLE_MAX : permille);
+}
+
+/**
+  * @brief  Hold off the update events of all PWM timers
+  * @note   Called with interrupts disabled
+  * @retval None
+  */
+static void PWM_HoldUpdates(void) {
+  htim1.Instance->CR1 |= TIM_CR1_UDIS;
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  for (uint8_t t = 0; t < PWM_AUX_TIMER_COUNT; t++) {
+    pwm_aux_timers[t].timer->CR1 |= TIM_CR1_UDIS;
+  }
+#endif
+}
+
+/**
+  * @brief  Let all PWM timers apply their preloads on their next update
+  * @note   Called with interrupts disabled
+  * @retval None
+  */
+static void PWM_ReleaseUpdates(void) {
+  htim1.Instance->CR1 &= ~TIM_CR1_UDIS;
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+  for (uint8_t t = 0; t < PWM_AUX_TIMER_COUNT; t++) {
+    pwm_aux_timers[t].timer->CR1 &= ~TIM_CR1_UDIS;
+  }
+#endif
+}
+
+#if VAL_BOARD_AUX_PWM_LIGHTS > 0
+/**
+  * @brief  Start the PWM timers of the lights not on TIM1
+  * @note   Same count rate as TIM1, at the period of the profile. The
+  *         outputs start off, in PWM mode 1 with the compare preloaded.
+  * @retval None
+  */
+static void PWM_InitAuxTimers(void) {
+  GPIO_InitTypeDef gpio = {0};
+  
+#if VAL_BOARD_USES_TIM15
+  __HAL_RCC_TIM15_CLK_ENABLE();
+  /* TIM1 TRGO is its UG: a latch restarts both periods in the same clock */
+  TIM15->SMCR = TIM_TS_ITR0 | TIM_SLAVEMODE_RESET;
+#endif
+#if VAL_BOARD_USES_TIM16
+  __HAL_RCC_TIM16_CLK_ENABLE();
+#endif
+  
+  for (uint8_t t = 0; t < PWM_AUX_TIMER_COUNT; t++) {
+    TIM_TypeDef* timer = pwm_aux_timers[t].timer;
+    
+    timer->CR1 = TIM_CR1_ARPE;
+    timer->PSC = htim1.Instance->PSC;
+    timer->ARR = (PWM_COUNTER_HZ + pwm_aux_timers[t].freq_hz / 2U) / pwm_aux_timers[t].freq_hz - 1U;
+    timer->BDTR = TIM_BDTR_MOE;
+  }
+  
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (PWM_TIMER(i) == TIM1) {
+      continue;
+    }
+    uint32_t shift = PWM_CCMR_SHIFT(i);
+    PWM_CCMR(i) = (PWM_CCMR(i) & ~(0xFFU << shift)) | ((TIM_OCMODE_PWM1 | TIM_CCMR1_OC1PE) << shift);
+    PWM_CCR(i) = 0;
+    PWM_TIMER(i)->CCER |= TIM_CCER_CC1E << VAL_Channels[i].pwm_channel;
+  }
+  
+  for (uint8_t t = 0; t < PWM_AUX_TIMER_COUNT; t++) {
+    pwm_aux_timers[t].timer->EGR = TIM_EGR_UG;
+    pwm_aux_timers[t].timer->CR1 |= TIM_CR1_CEN;
+  }
+  
+  /* AF14 is TIM15 and TIM16 alike */
+  gpio.Pin = VAL_BOARD_AUX_PWM_PINS;
+  gpio.Mode = GPIO_MODE_AF_PP;
+  gpio.Pull = GPIO_NOPULL;
+  gpio.Speed = GPIO_SPEED_FREQ_HIGH;
+  gpio.Alternate = GPIO_AF14_TIM15;
+  HAL_GPIO_Init(VAL_BOARD_GPIO, &gpio);
+}
+
+/**
+  * @brief  Stop the PWM timers of the lights not on TIM1
+  * @retval None
+  */
+static void PWM_DeInitAuxTimers(void) {
+  HAL_GPIO_DeInit(VAL_BOARD_GPIO, VAL_BOARD_AUX_PWM_PINS);
+  
+  for (uint8_t t = 0; t < PWM_AUX_TIMER_COUNT; t++) {
+    pwm_aux_timers[t].timer->CR1 = 0;
+    pwm_aux_timers[t].timer->CCER = 0;
+    pwm_aux_timers[t].timer->BDTR = 0;
+  }
+  
+#if VAL_BOARD_USES_TIM15
+  TIM15->SMCR = 0;
+  __HAL_RCC_TIM15_CLK_DISABLE();
+#endif
+#if VAL_BOARD_USES_TIM16
+  __HAL_RCC_TIM16_CLK_DISABLE();
+#endif
+}
+
+/**
+  * @brief  Have the TIM1 update interrupt carry table rows over
+  * @note   Called with interrupts disabled as a table starts playing
+  * @retval None
+  */
+static void PWM_StartFollowing(void) {
+  htim1.Instance->SR = ~(uint32_t)TIM_SR_UIF;
+  htim1.Instance->DIER |= TIM_DIER_UIE;
+}
+
+/**
+  * @brief  Stop carrying table rows over
+  * @note   Called with interrupts disabled
+  * @retval None
+  */
+static void PWM_StopFollowing(void) {
+  htim1.Instance->DIER &= ~TIM_DIER_UIE;
+}
+
+/**
+  * @brief  Copy the row the DMA burst wrote to the lights not on TIM1
+  * @note   From the TIM1 update interrupt, which the burst of the same
+  *         update has completed by; once per row, or per period while
+  *         dithering. Each timer applies the row on its next update.
+  * @retval None
+  */
+static void PWM_FollowRow(void) {
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (PWM_TIMER(i) != TIM1) {
+      PWM_CCR(i) = PWM_SLOT(i);
+    }
+  }
+}
+#endif
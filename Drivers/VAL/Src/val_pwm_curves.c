@@ -0,0 +1,292 @@
+/**
+  ******************************************************************************
+  * @file    val_pwm_curves.c
+  * @brief   Intensity to compare value lookup tables for the PWM channels
+  ******************************************************************************
+  * @attention
+  *
+  * One table per LED colour maps an intensity in permille to a TIM1 compare
+  * value for a period of VAL_PWM_CURVE_PERIOD counts, in sixteenths of a
+  * count (VAL_PWM_DITHER_STEPS) so that dithering can reach the steps of the
+  * curve at deep dimming, which are much finer than one count:
+  *
+  *   compare(0)    = 0
+  *   compare(p)    = round(16 * (offset + (period - offset) * (p / 1000) ^ gamma))
+  *   compare(1000) = 16 * period (constant high)
+  *
+  * The offset is the compare value at which the LED starts to emit, the
+  * gamma is the perceptual response of its colour. Both are placeholders
+  * until the fixtures are characterised; regenerate the tables from the
+  * formula above when they change. Channels reference their table through the
+  * board channel table (val_channels.c).
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_pwm_curves.h"
+
+/* Exported variables --------------------------------------------------------*/
+/* White: gamma 2.2, offset 12 */
+const uint16_t VAL_PWM_GammaWhite[VAL_PWM_CURVE_ENTRIES] = {
+      0,   192,   192,   192,   192,   193,   193,   193,   194,   194,   195,   195,
+    196,   197,   197,   198,   199,   200,   201,   202,   204,   205,   206,   208,
+    209,   211,   213,   215,   216,   218,   220,   223,   225,   227,   230,   232,
+    235,   237,   240,   243,   246,   249,   252,   255,   258,   261,   265,   268,
+    272,   276,   280,   284,   288,   292,   296,   300,   304,   309,   313,   318,
+    323,   328,   333,   338,   343,   348,   353,   359,   364,   370,   376,   382,
+    387,   393,   400,   406,   412,   419,   425,   432,   438,   445,   452,   459,
+    466,   474,   481,   488,   496,   504,   511,   519,   527,   535,   543,   552,
+    560,   569,   577,   586,   595,   604,   613,   622,   631,   640,   650,   659,
+    669,   679,   689,   699,   709,   719,   729,   740,   750,   761,   771,   782,
+    793,   804,   816,   827,   838,   850,   861,   873,   885,   897,   909,   921,
+    934,   946,   958,   971,   984,   997,  1010,  1023,  1036,  1049,  1063,  1076,
+   1090,  1104,  1118,  1132,  1146,  1160,  1174,  1189,  1203,  1218,  1233,  1248,
+   1263,  1278,  1293,  1309,  1324,  1340,  1356,  1371,  1387,  1404,  1420,  1436,
+   1453,  1469,  1486,  1503,  1520,  1537,  1554,  1571,  1588,  1606,  1624,  1641,
+   1659,  1677,  1695,  1713,  1732,  1750,  1769,  1788,  1806,  1825,  1844,  1864,
+   1883,  1902,  1922,  1942,  1961,  1981,  2001,  2022,  2042,  2062,  2083,  2103,
+   2124,  2145,  2166,  2187,  2209,  2230,  2251,  2273,  2295,  2317,  2339,  2361,
+   2383,  2406,  2428,  2451,  2473,  2496,  2519,  2542,  2566,  2589,  2613,  2636,
+   2660,  2684,  2708,  2732,  2756,  2781,  2805,  2830,  2854,  2879,  2904,  2929,
+   2955,  2980,  3006,  3031,  3057,  3083,  3109,  3135,  3161,  3188,  3214,  3241,
+   3268,  3295,  3322,  3349,  3376,  3404,  3431,  3459,  3487,  3515,  3543,  3571,
+   3599,  3628,  3656,  3685,  3714,  3743,  3772,  3801,  3831,  3860,  3890,  3919,
+   3949,  3979,  4009,  4040,  4070,  4101,  4131,  4162,  4193,  4224,  4255,  4287,
+   4318,  4350,  4381,  4413,  4445,  4477,  4510,  4542,  4574,  4607,  4640,  4673,
+   4706,  4739,  4772,  4806,  4839,  4873,  4907,  4941,  4975,  5009,  5043,  5078,
+   5113,  5147,  5182,  5217,  5252,  5288,  5323,  5359,  5394,  5430,  5466,  5502,
+   5539,  5575,  5611,  5648,  5685,  5722,  5759,  5796,  5833,  5871,  5908,  5946,
+   5984,  6022,  6060,  6098,  6137,  6175,  6214,  6253,  6292,  6331,  6370,  6409,
+   6449,  6488,  6528,  6568,  6608,  6648,  6689,  6729,  6770,  6810,  6851,  6892,
+   6933,  6975,  7016,  7057,  7099,  7141,  7183,  7225,  7267,  7310,  7352,  7395,
+   7438,  7480,  7523,  7567,  7610,  7653,  7697,  7741,  7785,  7829,  7873,  7917,
+   7962,  8006,  8051,  8096,  8141,  8186,  8231,  8277,  8322,  8368,  8414,  8460,
+   8506,  8552,  8599,  8645,  8692,  8739,  8786,  8833,  8880,  8927,  8975,  9022,
+   9070,  9118,  9166,  9215,  9263,  9311,  9360,  9409,  9458,  9507,  9556,  9605,
+   9655,  9705,  9754,  9804,  9854,  9904,  9955, 10005, 10056, 10107, 10158, 10209,
+  10260, 10311, 10363, 10414, 10466, 10518, 10570, 10622, 10675, 10727, 10780, 10833,
+  10885, 10939, 10992, 11045, 11099, 11152, 11206, 11260, 11314, 11368, 11422, 11477,
+  11532, 11586, 11641, 11696, 11752, 11807, 11862, 11918, 11974, 12030, 12086, 12142,
+  12198, 12255, 12312, 12368, 12425, 12483, 12540, 12597, 12655, 12712, 12770, 12828,
+  12886, 12944, 13003, 13061, 13120, 13179, 13238, 13297, 13356, 13416, 13475, 13535,
+  13595, 13655, 13715, 13775, 13836, 13896, 13957, 14018, 14079, 14140, 14202, 14263,
+  14325, 14386, 14448, 14510, 14573, 14635, 14697, 14760, 14823, 14886, 14949, 15012,
+  15075, 15139, 15203, 15267, 15330, 15395, 15459, 15523, 15588, 15653, 15717, 15782,
+  15848, 15913, 15978, 16044, 16110, 16176, 16242, 16308, 16374, 16441, 16507, 16574,
+  16641, 16708, 16775, 16843, 16910, 16978, 17046, 17114, 17182, 17250, 17319, 17387,
+  17456, 17525, 17594, 17663, 17732, 17802, 17872, 17941, 18011, 18081, 18152, 18222,
+  18292, 18363, 18434, 18505, 18576, 18647, 18719, 18790, 18862, 18934, 19006, 19078,
+  19151, 19223, 19296, 19368, 19441, 19514, 19588, 19661, 19735, 19808, 19882, 19956,
+  20030, 20105, 20179, 20254, 20328, 20403, 20478, 20554, 20629, 20705, 20780, 20856,
+  20932, 21008, 21084, 21161, 21237, 21314, 21391, 21468, 21545, 21623, 21700, 21778,
+  21855, 21933, 22012, 22090, 22168, 22247, 22325, 22404, 22483, 22563, 22642, 22721,
+  22801, 22881, 22961, 23041, 23121, 23201, 23282, 23363, 23444, 23525, 23606, 23687,
+  23769, 23850, 23932, 24014, 24096, 24178, 24261, 24343, 24426, 24509, 24592, 24675,
+  24758, 24842, 24925, 25009, 25093, 25177, 25262, 25346, 25431, 25515, 25600, 25685,
+  25770, 25856, 25941, 26027, 26113, 26199, 26285, 26371, 26457, 26544, 26631, 26718,
+  26805, 26892, 26979, 27067, 27154, 27242, 27330, 27418, 27507, 27595, 27684, 27772,
+  27861, 27950, 28040, 28129, 28219, 28308, 28398, 28488, 28578, 28669, 28759, 28850,
+  28941, 29031, 29123, 29214, 29305, 29397, 29489, 29580, 29673, 29765, 29857, 29950,
+  30042, 30135, 30228, 30321, 30415, 30508, 30602, 30695, 30789, 30883, 30978, 31072,
+  31167, 31261, 31356, 31451, 31547, 31642, 31737, 31833, 31929, 32025, 32121, 32217,
+  32314, 32410, 32507, 32604, 32701, 32798, 32896, 32993, 33091, 33189, 33287, 33385,
+  33484, 33582, 33681, 33780, 33879, 33978, 34077, 34177, 34276, 34376, 34476, 34576,
+  34676, 34777, 34877, 34978, 35079, 35180, 35281, 35383, 35484, 35586, 35688, 35790,
+  35892, 35994, 36097, 36200, 36302, 36405, 36509, 36612, 36715, 36819, 36923, 37027,
+  37131, 37235, 37340, 37444, 37549, 37654, 37759, 37864, 37969, 38075, 38181, 38287,
+  38393, 38499, 38605, 38712, 38818, 38925, 39032, 39139, 39247, 39354, 39462, 39570,
+  39678, 39786, 39894, 40002, 40111, 40220, 40329, 40438, 40547, 40657, 40766, 40876,
+  40986, 41096, 41206, 41316, 41427, 41538, 41649, 41760, 41871, 41982, 42094, 42205,
+  42317, 42429, 42541, 42654, 42766, 42879, 42992, 43105, 43218, 43331, 43445, 43558,
+  43672, 43786, 43900, 44014, 44129, 44243, 44358, 44473, 44588, 44703, 44819, 44934,
+  45050, 45166, 45282, 45398, 45515, 45631, 45748, 45865, 45982, 46099, 46217, 46334,
+  46452, 46570, 46688, 46806, 46924, 47043, 47162, 47281, 47400, 47519, 47638, 47758,
+  47877, 47997, 48117, 48237, 48358, 48478, 48599, 48720, 48841, 48962, 49083, 49205,
+  49326, 49448, 49570, 49692, 49814, 49937, 50060, 50182, 50305, 50428, 50552, 50675,
+  50799, 50923, 51047, 51171, 51295, 51419, 51544, 51669, 51794, 51919, 52044, 52170,
+  52295, 52421, 52547, 52673, 52799, 52926, 53052, 53179, 53306, 53433, 53560, 53688,
+  53815, 53943, 54071, 54199, 54327, 54456, 54584, 54713, 54842, 54971, 55100, 55230,
+  55359, 55489, 55619, 55749, 55879, 56010, 56140, 56271, 56402, 56533, 56664, 56796,
+  56927, 57059, 57191, 57323, 57455, 57588, 57720, 57853, 57986, 58119, 58252, 58386,
+  58519, 58653, 58787, 58921, 59055, 59190, 59324, 59459, 59594, 59729, 59864, 60000,
+  60135, 60271, 60407, 60543, 60679, 60816, 60952, 61089, 61226, 61363, 61500, 61638,
+  61775, 61913, 62051, 62189, 62328, 62466, 62605, 62743, 62882, 63021, 63161, 63300,
+  63440, 63580, 63720, 63860, 64000
+};
+
+/* Green: gamma 2.4, offset 8 */
+const uint16_t VAL_PWM_GammaGreen[VAL_PWM_CURVE_ENTRIES] = {
+      0,   128,   128,   128,   128,   128,   128,   128,   129,   129,   129,   129,
+    130,   130,   130,   131,   131,   132,   132,   133,   133,   134,   135,   135,
+    136,   137,   138,   139,   140,   141,   142,   143,   145,   146,   147,   148,
+    150,   151,   153,   155,   156,   158,   160,   162,   163,   165,   167,   170,
+    172,   174,   176,   179,   181,   183,   186,   189,   191,   194,   197,   200,
+    203,   206,   209,   212,   215,   218,   222,   225,   229,   232,   236,   240,
+    244,   247,   251,   255,   260,   264,   268,   272,   277,   281,   286,   291,
+    295,   300,   305,   310,   315,   320,   325,   331,   336,   342,   347,   353,
+    359,   364,   370,   376,   382,   388,   395,   401,   407,   414,   420,   427,
+    434,   441,   448,   455,   462,   469,   476,   484,   491,   499,   506,   514,
+    522,   530,   538,   546,   554,   562,   571,   579,   588,   597,   605,   614,
+    623,   632,   641,   651,   660,   669,   679,   688,   698,   708,   718,   728,
+    738,   748,   759,   769,   780,   790,   801,   812,   823,   834,   845,   856,
+    867,   879,   890,   902,   914,   925,   937,   949,   962,   974,   986,   999,
+   1011,  1024,  1037,  1050,  1062,  1076,  1089,  1102,  1116,  1129,  1143,  1156,
+   1170,  1184,  1198,  1212,  1227,  1241,  1256,  1270,  1285,  1300,  1315,  1330,
+   1345,  1360,  1375,  1391,  1407,  1422,  1438,  1454,  1470,  1486,  1503,  1519,
+   1535,  1552,  1569,  1586,  1603,  1620,  1637,  1654,  1672,  1689,  1707,  1724,
+   1742,  1760,  1778,  1797,  1815,  1834,  1852,  1871,  1890,  1909,  1928,  1947,
+   1966,  1985,  2005,  2025,  2044,  2064,  2084,  2104,  2125,  2145,  2165,  2186,
+   2207,  2228,  2249,  2270,  2291,  2312,  2334,  2355,  2377,  2399,  2421,  2443,
+   2465,  2487,  2510,  2532,  2555,  2578,  2601,  2624,  2647,  2670,  2694,  2717,
+   2741,  2765,  2789,  2813,  2837,  2861,  2886,  2911,  2935,  2960,  2985,  3010,
+   3035,  3061,  3086,  3112,  3137,  3163,  3189,  3215,  3242,  3268,  3295,  3321,
+   3348,  3375,  3402,  3429,  3456,  3484,  3511,  3539,  3567,  3595,  3623,  3651,
+   3679,  3708,  3737,  3765,  3794,  3823,  3852,  3882,  3911,  3941,  3970,  4000,
+   4030,  4060,  4090,  4121,  4151,  4182,  4212,  4243,  4274,  4306,  4337,  4368,
+   4400,  4432,  4463,  4495,  4528,  4560,  4592,  4625,  4657,  4690,  4723,  4756,
+   4789,  4823,  4856,  4890,  4924,  4958,  4992,  5026,  5060,  5095,  5129,  5164,
+   5199,  5234,  5269,  5305,  5340,  5376,  5411,  5447,  5483,  5520,  5556,  5592,
+   5629,  5666,  5703,  5740,  5777,  5814,  5852,  5889,  5927,  5965,  6003,  6041,
+   6079,  6118,  6156,  6195,  6234,  6273,  6312,  6352,  6391,  6431,  6471,  6510,
+   6551,  6591,  6631,  6672,  6712,  6753,  6794,  6835,  6876,  6918,  6959,  7001,
+   7043,  7085,  7127,  7169,  7212,  7254,  7297,  7340,  7383,  7426,  7469,  7513,
+   7556,  7600,  7644,  7688,  7732,  7777,  7821,  7866,  7911,  7956,  8001,  8046,
+   8092,  8137,  8183,  8229,  8275,  8321,  8367,  8414,  8461,  8507,  8554,  8601,
+   8649,  8696,  8744,  8791,  8839,  8887,  8935,  8984,  9032,  9081,  9130,  9179,
+   9228,  9277,  9326,  9376,  9426,  9476,  9526,  9576,  9626,  9677,  9727,  9778,
+   9829,  9880,  9932,  9983, 10035, 10086, 10138, 10190, 10243, 10295, 10348, 10400,
+  10453, 10506, 10559, 10613, 10666, 10720, 10774, 10828, 10882, 10936, 10991, 11045,
+  11100, 11155, 11210, 11265, 11321, 11376, 11432, 11488, 11544, 11600, 11657, 11713,
+  11770, 11827, 11884, 11941, 11998, 12056, 12114, 12171, 12229, 12288, 12346, 12404,
+  12463, 12522, 12581, 12640, 12699, 12759, 12819, 12878, 12938, 12998, 13059, 13119,
+  13180, 13241, 13302, 13363, 13424, 13485, 13547, 13609, 13671, 13733, 13795, 13858,
+  13920, 13983, 14046, 14109, 14172, 14236, 14299, 14363, 14427, 14491, 14555, 14620,
+  14684, 14749, 14814, 14879, 14945, 15010, 15076, 15141, 15207, 15274, 15340, 15406,
+  15473, 15540, 15607, 15674, 15741, 15809, 15876, 15944, 16012, 16080, 16149, 16217,
+  16286, 16355, 16424, 16493, 16562, 16632, 16701, 16771, 16841, 16911, 16982, 17052,
+  17123, 17194, 17265, 17336, 17408, 17479, 17551, 17623, 17695, 17767, 17840, 17913,
+  17985, 18058, 18131, 18205, 18278, 18352, 18426, 18500, 18574, 18648, 18723, 18798,
+  18872, 18948, 19023, 19098, 19174, 19250, 19326, 19402, 19478, 19554, 19631, 19708,
+  19785, 19862, 19939, 20017, 20095, 20172, 20251, 20329, 20407, 20486, 20565, 20643,
+  20723, 20802, 20881, 20961, 21041, 21121, 21201, 21281, 21362, 21443, 21524, 21605,
+  21686, 21767, 21849, 21931, 22013, 22095, 22177, 22260, 22343, 22425, 22508, 22592,
+  22675, 22759, 22842, 22926, 23011, 23095, 23179, 23264, 23349, 23434, 23519, 23605,
+  23690, 23776, 23862, 23948, 24034, 24121, 24208, 24294, 24381, 24469, 24556, 24644,
+  24731, 24819, 24908, 24996, 25084, 25173, 25262, 25351, 25440, 25530, 25619, 25709,
+  25799, 25889, 25980, 26070, 26161, 26252, 26343, 26434, 26526, 26617, 26709, 26801,
+  26893, 26986, 27078, 27171, 27264, 27357, 27450, 27544, 27638, 27732, 27826, 27920,
+  28014, 28109, 28204, 28299, 28394, 28489, 28585, 28681, 28776, 28873, 28969, 29065,
+  29162, 29259, 29356, 29453, 29551, 29648, 29746, 29844, 29942, 30041, 30139, 30238,
+  30337, 30436, 30536, 30635, 30735, 30835, 30935, 31035, 31135, 31236, 31337, 31438,
+  31539, 31641, 31742, 31844, 31946, 32048, 32151, 32253, 32356, 32459, 32562, 32665,
+  32769, 32873, 32977, 33081, 33185, 33289, 33394, 33499, 33604, 33709, 33815, 33920,
+  34026, 34132, 34239, 34345, 34452, 34558, 34665, 34773, 34880, 34987, 35095, 35203,
+  35311, 35420, 35528, 35637, 35746, 35855, 35964, 36074, 36184, 36294, 36404, 36514,
+  36624, 36735, 36846, 36957, 37068, 37180, 37292, 37403, 37516, 37628, 37740, 37853,
+  37966, 38079, 38192, 38305, 38419, 38533, 38647, 38761, 38876, 38990, 39105, 39220,
+  39335, 39451, 39566, 39682, 39798, 39914, 40031, 40147, 40264, 40381, 40498, 40616,
+  40733, 40851, 40969, 41087, 41206, 41324, 41443, 41562, 41681, 41801, 41920, 42040,
+  42160, 42280, 42401, 42521, 42642, 42763, 42884, 43006, 43127, 43249, 43371, 43493,
+  43616, 43738, 43861, 43984, 44107, 44231, 44354, 44478, 44602, 44726, 44851, 44975,
+  45100, 45225, 45350, 45476, 45601, 45727, 45853, 45980, 46106, 46233, 46359, 46487,
+  46614, 46741, 46869, 46997, 47125, 47253, 47382, 47510, 47639, 47768, 47898, 48027,
+  48157, 48287, 48417, 48547, 48678, 48808, 48939, 49070, 49202, 49333, 49465, 49597,
+  49729, 49862, 49994, 50127, 50260, 50393, 50527, 50660, 50794, 50928, 51062, 51197,
+  51331, 51466, 51601, 51736, 51872, 52008, 52144, 52280, 52416, 52552, 52689, 52826,
+  52963, 53101, 53238, 53376, 53514, 53652, 53790, 53929, 54068, 54207, 54346, 54485,
+  54625, 54765, 54905, 55045, 55186, 55326, 55467, 55608, 55750, 55891, 56033, 56175,
+  56317, 56459, 56602, 56745, 56888, 57031, 57174, 57318, 57462, 57606, 57750, 57894,
+  58039, 58184, 58329, 58474, 58620, 58766, 58912, 59058, 59204, 59351, 59497, 59644,
+  59792, 59939, 60087, 60235, 60383, 60531, 60679, 60828, 60977, 61126, 61275, 61425,
+  61575, 61725, 61875, 62025, 62176, 62327, 62478, 62629, 62781, 62932, 63084, 63236,
+  63389, 63541, 63694, 63847, 64000
+};
+
+/* Red: gamma 2.0, offset 20 */
+const uint16_t VAL_PWM_GammaRed[VAL_PWM_CURVE_ENTRIES] = {
+      0,   320,   320,   321,   321,   322,   322,   323,   324,   325,   326,   328,
+    329,   331,   332,   334,   336,   338,   341,   343,   345,   348,   351,   354,
+    357,   360,   363,   366,   370,   374,   377,   381,   385,   389,   394,   398,
+    403,   407,   412,   417,   422,   427,   432,   438,   443,   449,   455,   461,
+    467,   473,   479,   486,   492,   499,   506,   513,   520,   527,   534,   542,
+    549,   557,   565,   573,   581,   589,   597,   606,   614,   623,   632,   641,
+    650,   659,   669,   678,   688,   698,   707,   717,   728,   738,   748,   759,
+    769,   780,   791,   802,   813,   824,   836,   847,   859,   871,   883,   895,
+    907,   919,   932,   944,   957,   970,   983,   996,  1009,  1022,  1036,  1049,
+   1063,  1077,  1091,  1105,  1119,  1133,  1148,  1162,  1177,  1192,  1207,  1222,
+   1237,  1252,  1268,  1283,  1299,  1315,  1331,  1347,  1363,  1380,  1396,  1413,
+   1430,  1446,  1463,  1481,  1498,  1515,  1533,  1550,  1568,  1586,  1604,  1622,
+   1640,  1659,  1677,  1696,  1715,  1734,  1753,  1772,  1791,  1811,  1830,  1850,
+   1870,  1890,  1910,  1930,  1950,  1971,  1991,  2012,  2033,  2054,  2075,  2096,
+   2117,  2139,  2160,  2182,  2204,  2226,  2248,  2270,  2293,  2315,  2338,  2360,
+   2383,  2406,  2429,  2453,  2476,  2499,  2523,  2547,  2571,  2595,  2619,  2643,
+   2667,  2692,  2717,  2741,  2766,  2791,  2817,  2842,  2867,  2893,  2918,  2944,
+   2970,  2996,  3022,  3049,  3075,  3102,  3128,  3155,  3182,  3209,  3236,  3264,
+   3291,  3319,  3346,  3374,  3402,  3430,  3458,  3487,  3515,  3544,  3573,  3601,
+   3630,  3659,  3689,  3718,  3748,  3777,  3807,  3837,  3867,  3897,  3927,  3957,
+   3988,  4019,  4049,  4080,  4111,  4142,  4174,  4205,  4237,  4268,  4300,  4332,
+   4364,  4396,  4428,  4461,  4493,  4526,  4559,  4592,  4625,  4658,  4691,  4725,
+   4758,  4792,  4826,  4860,  4894,  4928,  4962,  4997,  5031,  5066,  5101,  5136,
+   5171,  5206,  5241,  5277,  5313,  5348,  5384,  5420,  5456,  5492,  5529,  5565,
+   5602,  5639,  5675,  5712,  5750,  5787,  5824,  5862,  5899,  5937,  5975,  6013,
+   6051,  6089,  6128,  6166,  6205,  6244,  6283,  6322,  6361,  6400,  6440,  6479,
+   6519,  6559,  6599,  6639,  6679,  6719,  6760,  6800,  6841,  6882,  6923,  6964,
+   7005,  7046,  7088,  7129,  7171,  7213,  7255,  7297,  7339,  7381,  7424,  7466,
+   7509,  7552,  7595,  7638,  7681,  7725,  7768,  7812,  7856,  7900,  7944,  7988,
+   8032,  8076,  8121,  8165,  8210,  8255,  8300,  8345,  8391,  8436,  8481,  8527,
+   8573,  8619,  8665,  8711,  8757,  8804,  8850,  8897,  8944,  8991,  9038,  9085,
+   9132,  9180,  9227,  9275,  9323,  9371,  9419,  9467,  9515,  9564,  9612,  9661,
+   9710,  9759,  9808,  9857,  9907,  9956, 10006, 10055, 10105, 10155, 10205, 10256,
+  10306, 10357, 10407, 10458, 10509, 10560, 10611, 10662, 10714, 10765, 10817, 10869,
+  10920, 10972, 11025, 11077, 11129, 11182, 11234, 11287, 11340, 11393, 11446, 11500,
+  11553, 11607, 11660, 11714, 11768, 11822, 11876, 11931, 11985, 12040, 12094, 12149,
+  12204, 12259, 12315, 12370, 12425, 12481, 12537, 12592, 12648, 12705, 12761, 12817,
+  12874, 12930, 12987, 13044, 13101, 13158, 13215, 13273, 13330, 13388, 13445, 13503,
+  13561, 13620, 13678, 13736, 13795, 13853, 13912, 13971, 14030, 14089, 14148, 14208,
+  14267, 14327, 14387, 14447, 14507, 14567, 14627, 14688, 14748, 14809, 14870, 14931,
+  14992, 15053, 15114, 15176, 15237, 15299, 15361, 15423, 15485, 15547, 15610, 15672,
+  15735, 15797, 15860, 15923, 15986, 16050, 16113, 16176, 16240, 16304, 16368, 16432,
+  16496, 16560, 16624, 16689, 16754, 16818, 16883, 16948, 17013, 17079, 17144, 17210,
+  17275, 17341, 17407, 17473, 17539, 17605, 17672, 17738, 17805, 17872, 17939, 18006,
+  18073, 18140, 18208, 18275, 18343, 18411, 18479, 18547, 18615, 18683, 18752, 18820,
+  18889, 18958, 19027, 19096, 19165, 19235, 19304, 19374, 19443, 19513, 19583, 19653,
+  19724, 19794, 19864, 19935, 20006, 20077, 20148, 20219, 20290, 20361, 20433, 20505,
+  20576, 20648, 20720, 20792, 20865, 20937, 21010, 21082, 21155, 21228, 21301, 21374,
+  21447, 21521, 21594, 21668, 21742, 21816, 21890, 21964, 22038, 22113, 22187, 22262,
+  22337, 22412, 22487, 22562, 22638, 22713, 22789, 22864, 22940, 23016, 23092, 23168,
+  23245, 23321, 23398, 23475, 23551, 23628, 23706, 23783, 23860, 23938, 24015, 24093,
+  24171, 24249, 24327, 24405, 24484, 24562, 24641, 24720, 24799, 24878, 24957, 25036,
+  25115, 25195, 25275, 25354, 25434, 25514, 25595, 25675, 25755, 25836, 25917, 25997,
+  26078, 26159, 26241, 26322, 26403, 26485, 26567, 26648, 26730, 26812, 26895, 26977,
+  27059, 27142, 27225, 27308, 27391, 27474, 27557, 27640, 27724, 27807, 27891, 27975,
+  28059, 28143, 28227, 28312, 28396, 28481, 28566, 28651, 28736, 28821, 28906, 28991,
+  29077, 29163, 29248, 29334, 29420, 29506, 29593, 29679, 29766, 29852, 29939, 30026,
+  30113, 30200, 30288, 30375, 30463, 30550, 30638, 30726, 30814, 30902, 30991, 31079,
+  31168, 31256, 31345, 31434, 31523, 31612, 31702, 31791, 31881, 31971, 32060, 32150,
+  32240, 32331, 32421, 32512, 32602, 32693, 32784, 32875, 32966, 33057, 33149, 33240,
+  33332, 33423, 33515, 33607, 33700, 33792, 33884, 33977, 34069, 34162, 34255, 34348,
+  34441, 34535, 34628, 34722, 34815, 34909, 35003, 35097, 35191, 35285, 35380, 35474,
+  35569, 35664, 35759, 35854, 35949, 36045, 36140, 36236, 36331, 36427, 36523, 36619,
+  36715, 36812, 36908, 37005, 37102, 37198, 37295, 37393, 37490, 37587, 37685, 37782,
+  37880, 37978, 38076, 38174, 38272, 38371, 38469, 38568, 38667, 38765, 38864, 38964,
+  39063, 39162, 39262, 39362, 39461, 39561, 39661, 39761, 39862, 39962, 40063, 40163,
+  40264, 40365, 40466, 40567, 40669, 40770, 40872, 40973, 41075, 41177, 41279, 41381,
+  41484, 41586, 41689, 41792, 41894, 41997, 42100, 42204, 42307, 42411, 42514, 42618,
+  42722, 42826, 42930, 43034, 43138, 43243, 43348, 43452, 43557, 43662, 43767, 43873,
+  43978, 44084, 44189, 44295, 44401, 44507, 44613, 44719, 44826, 44932, 45039, 45146,
+  45253, 45360, 45467, 45574, 45682, 45789, 45897, 46005, 46113, 46221, 46329, 46437,
+  46546, 46654, 46763, 46872, 46981, 47090, 47199, 47308, 47418, 47527, 47637, 47747,
+  47857, 47967, 48077, 48188, 48298, 48409, 48519, 48630, 48741, 48852, 48964, 49075,
+  49187, 49298, 49410, 49522, 49634, 49746, 49858, 49971, 50083, 50196, 50309, 50421,
+  50534, 50648, 50761, 50874, 50988, 51102, 51215, 51329, 51443, 51558, 51672, 51786,
+  51901, 52015, 52130, 52245, 52360, 52476, 52591, 52706, 52822, 52938, 53053, 53169,
+  53285, 53402, 53518, 53634, 53751, 53868, 53985, 54102, 54219, 54336, 54453, 54571,
+  54688, 54806, 54924, 55042, 55160, 55278, 55397, 55515, 55634, 55753, 55872, 55991,
+  56110, 56229, 56348, 56468, 56588, 56707, 56827, 56947, 57068, 57188, 57308, 57429,
+  57549, 57670, 57791, 57912, 58033, 58155, 58276, 58398, 58519, 58641, 58763, 58885,
+  59007, 59130, 59252, 59375, 59498, 59620, 59743, 59866, 59990, 60113, 60237, 60360,
+  60484, 60608, 60732, 60856, 60980, 61104, 61229, 61354, 61478, 61603, 61728, 61853,
+  61979, 62104, 62229, 62355, 62481, 62607, 62733, 62859, 62985, 63112, 63238, 63365,
+  63492, 63618, 63746, 63873, 64000
+};
@@ -0,0 +1,416 @@
+/**
+  ******************************************************************************
+  * @file    val_rtc.c
+  * @brief   Vendor Abstraction Layer for the real-time clock
+  ******************************************************************************
+  * @attention
+  *
+  * The RTC runs from the LSE, which SystemClock_Config starts, and sits in
+  * the backup domain: once set, it keeps counting through resets and stop
+  * modes, and only loses the time when the supply goes. Time is given in
+  * milliseconds since 1970-01-01 UTC; the calendar holds 2001 to 2099,
+  * since a year of 00 reads as never set.
+  *
+  * The prescalers divide the 32768 Hz LSE by 32 and 1024, so the sub-second
+  * counter resolves 1/1024 s. The counters are read directly (BYPSHAD)
+  * rather than through the shadow registers, which would need to
+  * resynchronize after every stop; a read is repeated if a counter moved
+  * on meanwhile.
+  *
+  * Small corrections use the shift control, which moves the sub-second
+  * counter by less than a second without stopping the calendar; a rate
+  * error is trimmed with the smooth digital calibration, which adds or
+  * masks LSE pulses over each 32 s cycle, in steps of 0.954 ppm up to
+  * about 487 ppm either way. Both, like the time, survive a reset.
+  *
+  * The 32 backup registers belong to the same domain: they keep their
+  * values through resets and are cleared only with it, when the supply
+  * goes. A write is a plain register write, with no flash cycle behind it.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_rtc.h"
+#include "val_sys_clock.h"
+#include "stm32l4xx_hal.h"
+
+/* Private define ------------------------------------------------------------*/
+#define RTC_PREDIV_A          31U     /* 32768 Hz / 32 = 1024 Hz */
+#define RTC_PREDIV_S          1023U   /* 1024 Hz / 1024 = 1 Hz */
+#define RTC_PRER_VALUE        ((RTC_PREDIV_A << RTC_PRER_PREDIV_A_Pos) | RTC_PREDIV_S)
+#define RTC_INIT_TIMEOUT_US   10000U  /* Initialization mode entry, under two RTC clocks */
+
+#define RTC_SECONDS_PER_DAY   86400U
+#define RTC_CAL_CYCLE_PULSES  1048576LL  /* LSE pulses per 32 s calibration cycle */
+#define RTC_CAL_PLUS_PULSES   512        /* Pulses CALP inserts per cycle */
+
+/* Private function prototypes -----------------------------------------------*/
+static void RTC_Unlock(void);
+static void RTC_Lock(void);
+static bool RTC_EnterInit(void);
+static void RTC_ExitInit(void);
+static uint32_t RTC_ToBcd(uint32_t value);
+static uint32_t RTC_FromBcd(uint32_t bcd);
+static int32_t RTC_DaysFromCivil(int32_t year, uint32_t month, uint32_t day);
+static void RTC_CivilFromDays(int32_t days, int32_t* year, uint32_t* month, uint32_t* day);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Start the RTC on the LSE, keeping the time it already holds
+  * @note   Needs the LSE, which SystemClock_Config starts
+  * @retval VAL_Status: VAL_OK if running, VAL_ERROR if the LSE is not ready
+  *         or the RTC runs from another source
+  */
+VAL_Status VAL_RTC_Init(void) {
+  uint32_t source;
+
+  if (__HAL_RCC_GET_FLAG(RCC_FLAG_LSERDY) == 0U) {
+    return VAL_ERROR;
+  }
+
+  HAL_PWR_EnableBkUpAccess();
+  __HAL_RCC_RTCAPB_CLK_ENABLE();
+
+  /* The source only changes with a backup domain reset, which stops the LSE */
+  source = RCC->BDCR & RCC_BDCR_RTCSEL;
+  if (source == 0U) {
+    MODIFY_REG(RCC->BDCR, RCC_BDCR_RTCSEL, RCC_BDCR_RTCSEL_0);
+  } else if (source != RCC_BDCR_RTCSEL_0) {
+    return VAL_ERROR;
+  }
+  __HAL_RCC_RTC_ENABLE();
+
+  RTC_Unlock();
+  RTC->CR |= RTC_CR_BYPSHAD;
+
+  /* Only right after a power-up, the calendar keeps counting otherwise */
+  if (RTC->PRER != RTC_PRER_VALUE) {
+    if (!RTC_EnterInit()) {
+      RTC_Lock();
+      return VAL_ERROR;
+    }
+    /* Two separate writes, synchronous divider first */
+    RTC->PRER = RTC_PREDIV_S;
+    RTC->PRER = RTC_PRER_VALUE;
+    RTC_ExitInit();
+  }
+  RTC_Lock();
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Check whether the calendar holds a time
+  * @retval bool: true once set, also after a reset
+  */
+bool VAL_RTC_IsSet(void) {
+  return (RTC->ISR & RTC_ISR_INITS) != 0U;
+}
+
+/**
+  * @brief  Get the current time
+  * @note   Safe to call from interrupts
+  * @retval uint64_t: Milliseconds since 1970-01-01 UTC, 0 if never set
+  */
+uint64_t VAL_RTC_GetTime(void) {
+  uint32_t ssr;
+  uint32_t tr;
+  uint32_t dr;
+
+  if (!VAL_RTC_IsSet()) {
+    return 0;
+  }
+
+  do {
+    ssr = RTC->SSR;
+    tr = RTC->TR;
+    dr = RTC->DR;
+  } while (ssr != RTC->SSR || tr != RTC->TR || dr != RTC->DR);
+
+  int32_t days = RTC_DaysFromCivil(2000 + (int32_t)RTC_FromBcd((dr & (RTC_DR_YT | RTC_DR_YU)) >> RTC_DR_YU_Pos),
+                                   RTC_FromBcd((dr & (RTC_DR_MT | RTC_DR_MU)) >> RTC_DR_MU_Pos),
+                                   RTC_FromBcd((dr & (RTC_DR_DT | RTC_DR_DU)) >> RTC_DR_DU_Pos));
+  uint32_t seconds = RTC_FromBcd((tr & (RTC_TR_HT | RTC_TR_HU)) >> RTC_TR_HU_Pos) * 3600U +
+                     RTC_FromBcd((tr & (RTC_TR_MNT | RTC_TR_MNU)) >> RTC_TR_MNU_Pos) * 60U +
+                     RTC_FromBcd((tr & (RTC_TR_ST | RTC_TR_SU)) >> RTC_TR_SU_Pos);
+
+  /* The counter runs down; past PREDIV_S right after a shift, it is still
+   * in the previous second */
+  int32_t fraction_ms = ((int32_t)RTC_PREDIV_S - (int32_t)(ssr & RTC_SSR_SS)) * 1000 /
+                        (int32_t)(RTC_PREDIV_S + 1U);
+
+  return ((uint64_t)days * RTC_SECONDS_PER_DAY + seconds) * 1000U + (int64_t)fraction_ms;
+}
+
+/**
+  * @brief  Set the time
+  * @note   Task context only. The calendar stops for up to two RTC clocks.
+  * @param  time_ms: Milliseconds since 1970-01-01 UTC, within VAL_RTC_TIME_MIN_MS
+  *         and VAL_RTC_TIME_MAX_MS
+  * @retval VAL_Status: VAL_OK if set, VAL_PARAM if out of range, VAL_ERROR if
+  *         the RTC did not enter initialization mode
+  */
+VAL_Status VAL_RTC_SetTime(uint64_t time_ms) {
+  int32_t year;
+  uint32_t month;
+  uint32_t day;
+
+  if (time_ms < VAL_RTC_TIME_MIN_MS || time_ms > VAL_RTC_TIME_MAX_MS) {
+    return VAL_PARAM;
+  }
+
+  uint32_t seconds = (uint32_t)(time_ms / 1000U);
+  uint32_t fraction_ms = (uint32_t)(time_ms % 1000U);
+  int32_t days = (int32_t)(seconds / RTC_SECONDS_PER_DAY);
+  uint32_t second_of_day = seconds % RTC_SECONDS_PER_DAY;
+
+  RTC_CivilFromDays(days, &year, &month, &day);
+
+  /* 1970-01-01 was a Thursday; the RTC counts Monday as 1 */
+  uint32_t weekday = (uint32_t)((days + 3) % 7) + 1U;
+
+  RTC_Unlock();
+  if (!RTC_EnterInit()) {
+    RTC_Lock();
+    return VAL_ERROR;
+  }
+
+  RTC->TR = (RTC_ToBcd(second_of_day / 3600U) << RTC_TR_HU_Pos) |
+            (RTC_ToBcd(second_of_day / 60U % 60U) << RTC_TR_MNU_Pos) |
+            (RTC_ToBcd(second_of_day % 60U) << RTC_TR_SU_Pos);
+  RTC->DR = (RTC_ToBcd((uint32_t)(year - 2000)) << RTC_DR_YU_Pos) |
+            (weekday << RTC_DR_WDU_Pos) |
+            (RTC_ToBcd(month) << RTC_DR_MU_Pos) |
+            (RTC_ToBcd(day) << RTC_DR_DU_Pos);
+  RTC_ExitInit();
+  RTC_Lock();
+
+  /* The second starts counting on leaving initialization mode */
+  return VAL_RTC_Adjust((int32_t)fraction_ms);
+}
+
+/**
+  * @brief  Move the time forwards or backwards by less than a second
+  * @note   Task context only. The calendar keeps counting; the shift takes
+  *         effect within a millisecond.
+  * @param  delta_ms: Correction in milliseconds, -999 to 999, positive to advance
+  * @retval VAL_Status: VAL_OK if started, VAL_BUSY while the previous shift
+  *         is pending, VAL_PARAM if out of range, VAL_ERROR if never set
+  */
+VAL_Status VAL_RTC_Adjust(int32_t delta_ms) {
+  uint32_t magnitude;
+  uint32_t counts;
+
+  if (delta_ms <= -1000 || delta_ms >= 1000) {
+    return VAL_PARAM;
+  }
+  if (!VAL_RTC_IsSet()) {
+    return VAL_ERROR;
+  }
+  if (RTC->ISR & RTC_ISR_SHPF) {
+    return VAL_BUSY;
+  }
+
+  magnitude = (uint32_t)((delta_ms < 0) ? -delta_ms : delta_ms);
+  counts = (magnitude * (RTC_PREDIV_S + 1U) + 500U) / 1000U;
+  if (counts == 0U) {
+    return VAL_OK;
+  }
+
+  /* A shift only subtracts; advancing adds a second and takes the rest back */
+  RTC_Unlock();
+  if (delta_ms > 0) {
+    RTC->SHIFTR = RTC_SHIFTR_ADD1S | (RTC_PREDIV_S + 1U - counts);
+  } else {
+    RTC->SHIFTR = counts;
+  }
+  RTC_Lock();
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Trim the RTC rate with the smooth digital calibration
+  * @param  ppb: Rate change in parts per billion, positive to run faster,
+  *         within VAL_RTC_CALIBRATION_MAX_PPB either way
+  * @retval VAL_Status: VAL_OK if set, VAL_BUSY while the previous setting
+  *         is being applied, VAL_PARAM if out of range
+  */
+VAL_Status VAL_RTC_SetCalibration(int32_t ppb) {
+  int32_t pulses;
+  uint32_t calr;
+
+  if (ppb < -VAL_RTC_CALIBRATION_MAX_PPB || ppb > VAL_RTC_CALIBRATION_MAX_PPB) {
+    return VAL_PARAM;
+  }
+  if (RTC->ISR & RTC_ISR_RECALPF) {
+    return VAL_BUSY;
+  }
+
+  /* Rounded to the nearest pulse per 32 s cycle */
+  int64_t scaled = (int64_t)ppb * RTC_CAL_CYCLE_PULSES;
+  pulses = (int32_t)((scaled + ((scaled < 0) ? -500000000LL : 500000000LL)) / 1000000000LL);
+
+  /* CALP inserts 512 pulses, CALM masks up to 511 */
+  if (pulses > 0) {
+    calr = RTC_CALR_CALP | (uint32_t)(RTC_CAL_PLUS_PULSES - pulses);
+  } else {
+    calr = (uint32_t)(-pulses);
+  }
+
+  RTC_Unlock();
+  RTC->CALR = calr;
+  RTC_Lock();
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the smooth calibration in effect
+  * @retval int32_t: Rate change in parts per billion, positive if faster
+  */
+int32_t VAL_RTC_GetCalibration(void) {
+  uint32_t calr = RTC->CALR;
+  int32_t pulses = ((calr & RTC_CALR_CALP) ? RTC_CAL_PLUS_PULSES : 0) - (int32_t)(calr & RTC_CALR_CALM);
+
+  return (int32_t)((int64_t)pulses * 1000000000LL / RTC_CAL_CYCLE_PULSES);
+}
+
+/**
+  * @brief  Read a backup register
+  * @note   Safe to call from interrupts
+  * @param  index: Register number (0 to VAL_RTC_BACKUP_COUNT - 1)
+  * @retval uint32_t: Register value, 0 if the index is out of range
+  */
+uint32_t VAL_RTC_ReadBackup(uint8_t index) {
+  if (index >= VAL_RTC_BACKUP_COUNT) {
+    return 0;
+  }
+
+  return (&RTC->BKP0R)[index];
+}
+
+/**
+  * @brief  Write a backup register
+  * @note   Safe to call from interrupts. Needs VAL_RTC_Init, which leaves
+  *         backup domain access enabled; the write protection does not
+  *         cover these registers.
+  * @param  index: Register number (0 to VAL_RTC_BACKUP_COUNT - 1)
+  * @param  value: Value to keep
+  * @retval VAL_Status: VAL_OK if written, VAL_PARAM if the index is out of range
+  */
+VAL_Status VAL_RTC_WriteBackup(uint8_t index, uint32_t value) {
+  if (index >= VAL_RTC_BACKUP_COUNT) {
+    return VAL_PARAM;
+  }
+
+  (&RTC->BKP0R)[index] = value;
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Remove the RTC register write protection
+  * @retval None
+  */
+static void RTC_Unlock(void) {
+  RTC->WPR = 0xCAU;
+  RTC->WPR = 0x53U;
+}
+
+/**
+  * @brief  Restore the RTC register write protection
+  * @retval None
+  */
+static void RTC_Lock(void) {
+  RTC->WPR = 0xFFU;
+}
+
+/**
+  * @brief  Stop the calendar for writing, registers unlocked
+  * @retval bool: true once in initialization mode, false on timeout
+  */
+static bool RTC_EnterInit(void) {
+  uint32_t start = VAL_SysClock_GetMicros();
+
+  /* The other bits are flags cleared by writing 0, so write them as 1 */
+  RTC->ISR = 0xFFFFFFFFU;
+  while ((RTC->ISR & RTC_ISR_INITF) == 0U) {
+    if ((VAL_SysClock_GetMicros() - start) > RTC_INIT_TIMEOUT_US) {
+      RTC->ISR &= ~RTC_ISR_INIT;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+  * @brief  Restart the calendar after initialization mode
+  * @retval None
+  */
+static void RTC_ExitInit(void) {
+  RTC->ISR &= ~RTC_ISR_INIT;
+}
+
+/**
+  * @brief  Convert 0-99 to packed BCD
+  * @param  value: Binary value
+  * @retval uint32_t: Tens in bits 4-7, units in bits 0-3
+  */
+static uint32_t RTC_ToBcd(uint32_t value) {
+  return ((value / 10U) << 4) | (value % 10U);
+}
+
+/**
+  * @brief  Convert packed BCD to binary
+  * @param  bcd: Tens in bits 4-7, units in bits 0-3
+  * @retval uint32_t: Binary value
+  */
+static uint32_t RTC_FromBcd(uint32_t bcd) {
+  return (bcd >> 4) * 10U + (bcd & 0x0FU);
+}
+
+/**
+  * @brief  Count the days from 1970-01-01 to a date
+  * @note   Proleptic Gregorian calendar, years counted from March so the
+  *         leap day ends the year
+  * @param  year: Year
+  * @param  month: Month (1-12)
+  * @param  day: Day of the month (1-31)
+  * @retval int32_t: Days since 1970-01-01
+  */
+static int32_t RTC_DaysFromCivil(int32_t year, uint32_t month, uint32_t day) {
+  year -= (month <= 2U) ? 1 : 0;
+  int32_t era = year / 400;
+  uint32_t year_of_era = (uint32_t)(year - era * 400);
+  uint32_t month_of_year = (month > 2U) ? month - 3U : month + 9U;
+  uint32_t day_of_year = (153U * month_of_year + 2U) / 5U + day - 1U;
+  uint32_t day_of_era = year_of_era * 365U + year_of_era / 4U - year_of_era / 100U + day_of_year;
+
+  return era * 146097 + (int32_t)day_of_era - 719468;
+}
+
+/**
+  * @brief  Find the date a number of days after 1970-01-01
+  * @param  days: Days since 1970-01-01, not negative
+  * @param  year: Pointer to store the year
+  * @param  month: Pointer to store the month (1-12)
+  * @param  day: Pointer to store the day of the month (1-31)
+  * @retval None
+  */
+static void RTC_CivilFromDays(int32_t days, int32_t* year, uint32_t* month, uint32_t* day) {
+  days += 719468;
+  int32_t era = days / 146097;
+  uint32_t day_of_era = (uint32_t)(days - era * 146097);
+  uint32_t year_of_era = (day_of_era - day_of_era / 1460U + day_of_era / 36524U - day_of_era / 146096U) / 365U;
+  uint32_t day_of_year = day_of_era - (365U * year_of_era + year_of_era / 4U - year_of_era / 100U);
+  uint32_t mp = (5U * day_of_year + 2U) / 153U;
+
+  *day = day_of_year - (153U * mp + 2U) / 5U + 1U;
+  *month = (mp < 10U) ? mp + 3U : mp - 9U;
+  *year = (int32_t)year_of_era + era * 400 + ((*month <= 2U) ? 1 : 0);
+}
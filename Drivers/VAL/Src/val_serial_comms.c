@@ -8,27 +8,243 @@
   * This module provides a hardware-independent interface for serial
   * communication used by the Wiseled_LBR system.
   *
+  * Two reception modes are available:
+  *  - Interrupt mode (VAL_Serial_Init): one interrupt and callback per byte.
+  *  - DMA mode (VAL_Serial_InitDMA): USART1 RX feeds a circular DMA buffer and
+  *    idle-line, half-transfer and transfer-complete events hand every newly
+  *    received block to the callback in a single call.
+  *
+  * Transmission is always non-blocking: data is copied into a TX ring buffer
+  * and drained by USART1 TX DMA in the background. Bytes queued before the
+  * UART is initialized are sent as soon as initialization completes. A
+  * message may be given as several segments, e.g. constant text and a few
+  * formatted fields, queued in one go.
+  *
+  * The DMA works through a chain of (pointer, length) entries, one transfer
+  * each, advanced by the transfer complete interrupt. Entries point into the
+  * TX ring for copied data, or straight at a segment in flash, which cannot
+  * change while it is sent; such segments are not copied at all. Segments
+  * shorter than SERIAL_TX_INPLACE_MIN are copied anyway, as a transfer of
+  * their own would cost more than the copy. Consecutive copies share one
+  * entry while its transfer has not started.
+  *
+  * The baud rate can be changed at runtime. Bytes queued while the UART is
+  * being reconfigured are held back and sent at the new rate. When the
+  * system clock changes, VAL_Serial_UpdateClock recomputes the divider for
+  * the new APB2 clock; the clock is only changed while the link is idle
+  * (VAL_Serial_CheckClock), as the UART is briefly disabled for it.
+  *
+  * For an RS-485 bus the UART drives the transceiver's driver enable on PB3
+  * (USART1_DE) by itself: DE rises a bit time before the first start bit
+  * and falls a bit time after the last stop bit, so the bus is released
+  * with no software in the path. PB3 is the LD3 line, which then lights
+  * while transmitting instead of serving as the board LED.
+  *
+  * On a point-to-point link RTS/CTS flow control can be enabled instead
+  * (VAL_Serial_SetFlowControl): the receiver raises RTS on PB3 while it has
+  * no room, and transmission pauses between bytes while the host holds CTS
+  * on PB4 high. RTS is the same USART1 function as the driver enable, so
+  * the two modes exclude each other. A host that never asserts CTS stalls
+  * the TX DMA; turning flow control off then drops the transfer in flight
+  * and sends its entry again from the start.
+  *
+  * In DMX512 mode (VAL_Serial_StartDmx) the same receiver, behind the
+  * RS-485 transceiver, listens to a lighting desk at 250 kbaud, 8N2. The
+  * break that starts every packet arrives as a framing error: the DMA has
+  * then stored the previous packet, start code first, followed by the
+  * break's zero byte, and the callback receives it before reception
+  * restarts at the top of the buffer. Nothing is transmitted in this mode;
+  * queued messages are held until VAL_Serial_StopDmx restores the host
+  * link.
+  *
+  * In Modbus RTU mode (VAL_Serial_StartModbus) the link runs 8E1 at the
+  * bus rate and the UART receiver timeout marks the end of each frame: it
+  * fires after 3.5 characters of silence (a fixed 1750 us above 19200
+  * baud), which HAL reports as a blocking error once the DMA has stored the
+  * frame, so the callback gets whole frames with no per-byte interrupt.
+  * Replies go straight to the TX DMA from a buffer of their own while the
+  * host messages stay held as in DMX512 mode, and the receiver is off
+  * while a reply is on the bus, so a transceiver that echoes it is not
+  * heard as a request.
+  *
+  * USART1 stops in STOP2, so a board with VAL_BOARD_SERIAL_WAKE set wires
+  * the host RX line to PA3 as well, where LPUART1 listens while the MCU is
+  * stopped (VAL_Serial_ArmWake). It runs from the HSI16, which the STOP2
+  * logic starts on demand at a start bit: the LSE is too slow for the host
+  * baud rate. The first complete byte wakes the MCU; VAL_Serial_ResumeWake
+  * then keeps the HSI16 on and lets DMA2 channel 7 take the rest of the
+  * frame into a buffer of its own, handed to the same block callback as
+  * the USART1 reception. The first idle line hands the link back to
+  * USART1, whose receiver is off meanwhile so no byte is seen twice. A
+  * byte that starts within the microseconds of the handover is lost. The
+  * listener is not armed in DMX512 or Modbus mode, under flow control, or
+  * at a rate the LPUART divider cannot reach from 16 MHz.
+  *
   ******************************************************************************
   */
 
 /* Includes ------------------------------------------------------------------*/
 #include "val_serial_comms.h"
+#include "val_sections.h"
+#include "val_context.h"
+#include "val_irq_priority.h"
 #include "usart.h"
+#include "dma.h"
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
 
 /* Private define ------------------------------------------------------------*/
 #define SERIAL_TX_BUFFER_SIZE 256
+#define SERIAL_RX_DMA_BUFFER_SIZE 256
+#define SERIAL_TX_RING_SIZE 1024
+#define SERIAL_TX_CHAIN_SIZE 32   /* DMA transfers queued */
+#define SERIAL_TX_INPLACE_MIN 16  /* Shortest flash segment sent in place */
+
+/* Baud rate limits; the error bound is what a typical receiver tolerates */
+#define SERIAL_MIN_BAUD_RATE 1200
+#define SERIAL_MAX_BAUD_ERROR_PERMILLE 20
+#define SERIAL_TX_IDLE_TIMEOUT_MS 100
+
+/* RS-485 driver enable, guard times in 1/16 bit (1/8 bit when oversampling by 8) */
+#define SERIAL_DE_PIN LD3_Pin
+#define SERIAL_DE_PORT LD3_GPIO_Port
+#define SERIAL_DE_GUARD_TIME 16
+
+/* RTS/CTS flow control; RTS shares PB3 with the driver enable */
+#define SERIAL_RTS_PIN LD3_Pin
+#define SERIAL_RTS_PORT LD3_GPIO_Port
+#define SERIAL_CTS_PIN GPIO_PIN_4
+#define SERIAL_CTS_PORT GPIOB
+
+/* DMX512 line settings; a packet is the start code and up to 512 slots */
+#define SERIAL_DMX_BAUD_RATE 250000
+#define SERIAL_DMX_PACKET_SIZE 513
+/* Room for the break byte and one spare, so a full packet never wraps the DMA */
+#define SERIAL_DMX_BUFFER_SIZE (SERIAL_DMX_PACKET_SIZE + 2)
+
+/* Modbus RTU frames, address to CRC; one spare so a full frame never wraps the DMA */
+#define SERIAL_MODBUS_FRAME_SIZE 256
+#define SERIAL_MODBUS_BUFFER_SIZE (SERIAL_MODBUS_FRAME_SIZE + 1)
+#define SERIAL_MODBUS_FIXED_GAP_BAUD 19200   /* Above it the gap is fixed */
+#define SERIAL_MODBUS_GAP_BITS 39            /* 3.5 characters of 11 bits */
+#define SERIAL_MODBUS_FIXED_GAP_US 1750
+
+#if VAL_SERIAL_WAKE_ENABLED
+/* Stop mode listener on LPUART1, see above */
+#define SERIAL_WAKE_BUFFER_SIZE 128
+#define SERIAL_WAKE_PIN GPIO_PIN_3
+#define SERIAL_WAKE_PORT GPIOA
+#define SERIAL_WAKE_CLOCK_HZ 16000000U      /* HSI16 */
+#define SERIAL_WAKE_BRR_MIN 0x300U          /* LPUART divider range */
+#define SERIAL_WAKE_BRR_MAX 0xFFFFFU
+#define SERIAL_WAKE_DMA DMA2_Channel7       /* LPUART1_RX, request 4 */
+#define SERIAL_WAKE_DMA_REQUEST 4U
+#define SERIAL_WAKE_EXTI_LINE EXTI_IMR1_IM31 /* LPUART1 wake-up */
+#define SERIAL_WAKE_READY_POLLS 1000U      /* HSI16 and receiver start-up */
+
+_Static_assert((SERIAL_WAKE_PIN & (VAL_BOARD_ANALOG_PINS | VAL_BOARD_PWM_PINS)) == 0U,
+               "PA3, the LPUART1 RX pin, is taken by a light");
+#endif
+
+/* Private typedef -----------------------------------------------------------*/
+/* One DMA transfer of the TX chain */
+typedef struct {
+  const uint8_t* data;
+  uint16_t length;
+  uint8_t in_ring;            // The bytes are held in tx_ring, released once sent
+} SerialTxEntry_t;
+
+/* Line settings of a reception mode */
+typedef struct {
+  uint32_t baud_rate;
+  uint32_t word_length;
+  uint32_t stop_bits;
+  uint32_t parity;
+} SerialLine_t;
+
+/* Stop mode listener state */
+typedef enum {
+  SERIAL_WAKE_OFF = 0,        // USART1 has the line
+  SERIAL_WAKE_ARMED,          // LPUART1 waits for a byte, MCU stopped
+  SERIAL_WAKE_LISTENING       // LPUART1 DMA takes the frame that woke the MCU
+} SerialWakeState_t;
 
 /* Private variables ---------------------------------------------------------*/
 static uint8_t txBuffer[SERIAL_TX_BUFFER_SIZE];
-static volatile uint8_t tx_busy = 0;
+static volatile uint8_t printf_busy = 0;
 static SerialRxCallback rx_callback = NULL;
 static uint8_t rx_buffer[1];  // Single byte buffer for continuous reception
 
+/* DMA reception state */
+static SerialRxBlockCallback rx_block_callback = NULL;
+static uint8_t rx_dma_buffer[SERIAL_RX_DMA_BUFFER_SIZE];
+static uint16_t rx_dma_read_pos = 0;
+static volatile uint32_t rx_last_tick = 0;  // HAL tick of the last received byte
+
+/* DMX512 reception state */
+static SerialDmxCallback dmx_callback = NULL;  // Set while in DMX512 mode
+static uint8_t dmx_buffer[SERIAL_DMX_BUFFER_SIZE];
+static volatile uint8_t dmx_overrun = 0;       // Packet longer than the buffer
+static volatile uint32_t dmx_dropped = 0;      // Packets lost to line errors
+
+/* Modbus RTU state */
+static SerialFrameCallback modbus_callback = NULL;  // Set while in Modbus mode
+static uint8_t modbus_buffer[SERIAL_MODBUS_BUFFER_SIZE];
+static uint8_t modbus_tx_buffer[SERIAL_MODBUS_FRAME_SIZE];
+static volatile uint16_t modbus_tx_length = 0;      // Reply on the bus
+static volatile uint8_t modbus_overrun = 0;         // Frame longer than the buffer
+static volatile uint32_t modbus_dropped = 0;        // Frames lost to line errors
+
+#if VAL_SERIAL_WAKE_ENABLED
+/* Stop mode listener state */
+static uint8_t wake_buffer[SERIAL_WAKE_BUFFER_SIZE];
+static uint16_t wake_read_pos = 0;
+static volatile SerialWakeState_t wake_state = SERIAL_WAKE_OFF;
+static uint8_t wake_hsi_was_on = 0;          // HSI16 was running before the listener
+#endif
+
+/* Host link settings to restore after DMX512 or Modbus mode */
+static SerialLine_t host_line;
+
+/* DMA transmission state */
+static uint8_t tx_ring[SERIAL_TX_RING_SIZE];
+static volatile uint16_t tx_head = 0;        // Next free byte
+static volatile uint16_t tx_count = 0;       // Bytes held in the ring, including in flight
+static SerialTxEntry_t tx_chain[SERIAL_TX_CHAIN_SIZE];
+static volatile uint8_t tx_chain_head = 0;   // Next free entry
+static volatile uint8_t tx_chain_tail = 0;   // Entry being sent, or next to send
+static volatile uint8_t tx_chain_count = 0;  // Entries queued, including in flight
+static volatile uint16_t tx_dma_length = 0;  // Bytes handed to the current DMA transfer
+static volatile uint8_t tx_ready = 0;        // UART initialized, DMA may be started
+static volatile uint32_t tx_queued_bytes = 0; // Bytes ever queued, wrapping
+static volatile uint32_t tx_sent_bytes = 0;   // Bytes ever sent, wrapping
+static SerialTxCompleteCallback tx_complete_callback = NULL;
+
 /* Private function prototypes -----------------------------------------------*/
-static void StartReceive(void);
+static HAL_StatusTypeDef StartReceive(void);
+static HAL_StatusTypeDef StartReceiveDMA(void);
+static HAL_StatusTypeDef StartReceiveDmx(void);
+static void ReceiveDmxBreak(void);
+static HAL_StatusTypeDef StartReceiveModbus(void);
+static void ReceiveModbusFrame(void);
+static uint8_t IsLineTaken(void);
+static HAL_StatusTypeDef SetLine(const SerialLine_t* line);
+static void StartTransmitDMA(void);
+static uint8_t IsInPlace(const VAL_Serial_Segment_t* segment);
+static void QueueEntry(const uint8_t* data, uint16_t length, uint8_t in_ring);
+static void QueueCopy(const uint8_t* data, uint16_t length);
+static void StartPendingTransmit(void);
+static VAL_Status HoldTransmit(void);
+static VAL_Status RestartReceive(void);
+
+#if VAL_SERIAL_WAKE_ENABLED
+static void InitWake(void);
+static void StopWake(void);
+#endif
+
+static VAL_Status CheckBaudRate(uint32_t baud_rate, uint32_t pclk);
+static uint32_t GetOversampling(uint32_t baud_rate, uint32_t pclk);
 
 /* Public functions ----------------------------------------------------------*/
 
@@ -38,43 +254,178 @@ static void StartReceive(void);
   * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
   */
 VAL_Status VAL_Serial_Init(SerialRxCallback callback) {
+  /* DMA controller must be clocked before the UART MSP links its channels */
+  MX_DMA_Init();
+
   /* Initialize UART peripheral */
   MX_USART1_UART_Init();
+  StartPendingTransmit();
 
   /* Store callback function */
   rx_callback = callback;
 
   /* Start continuous reception if callback is provided */
-  if (rx_callback != NULL) {
-    StartReceive();
+  if (rx_callback != NULL && StartReceive() != HAL_OK) {
+    return VAL_ERROR;
   }
 
   return VAL_OK;
 }
 
+/**
+  * @brief  Initialize the serial communication module in DMA reception mode
+  * @param  callback: Callback receiving each newly arrived block of bytes.
+  *         Called from interrupt context.
+  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  */
+VAL_Status VAL_Serial_InitDMA(SerialRxBlockCallback callback) {
+  if (callback == NULL) {
+    return VAL_PARAM;
+  }
+
+  /* DMA controller must be clocked before the UART MSP links its channels */
+  MX_DMA_Init();
+
+  /* Initialize UART peripheral */
+  MX_USART1_UART_Init();
+  StartPendingTransmit();
+
+  /* Store callback function */
+  rx_callback = NULL;
+  rx_block_callback = callback;
+
+  /* Start circular reception with idle-line detection */
+  if (StartReceiveDMA() != HAL_OK) {
+    rx_block_callback = NULL;
+    return VAL_ERROR;
+  }
+
+#if VAL_SERIAL_WAKE_ENABLED
+  InitWake();
+#endif
+
+  return VAL_OK;
+}
+
 /**
   * @brief  Send data over serial interface
+  * @note   Data is queued for DMA transmission. The call only waits, up to
+  *         timeout, when the TX queue does not have room for the data.
+  *         From interrupt context the call never waits.
   * @param  data: Pointer to data buffer
   * @param  length: Length of data to send
-  * @param  timeout: Timeout in milliseconds
-  * @retval VAL_Status: VAL_OK if successful, VAL_ERROR otherwise
+  * @param  timeout: Maximum time to wait for queue space in milliseconds
+  * @retval VAL_Status: VAL_OK if queued, VAL_TIMEOUT if the queue stayed full,
+  *         VAL_PARAM for invalid arguments, VAL_BUSY if full in interrupt context
   */
 VAL_Status VAL_Serial_Send(const uint8_t* data, uint16_t length, uint32_t timeout) {
-  HAL_StatusTypeDef status;
+  uint32_t start_tick = HAL_GetTick();
+  VAL_Status status;
+
+  while ((status = VAL_Serial_SendAsync(data, length)) == VAL_BUSY) {
+    /* The tick cannot advance while an interrupt waits, so never spin there */
+    if (VAL_IsInterrupt()) {
+      return VAL_BUSY;
+    }
+
+    if ((HAL_GetTick() - start_tick) >= timeout) {
+      return VAL_TIMEOUT;
+    }
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Queue data for non-blocking transmission
+  * @note   Safe to call from tasks and interrupts. The data is copied, so the
+  *         caller's buffer may be reused as soon as the call returns.
+  * @param  data: Pointer to data buffer
+  * @param  length: Length of data to send
+  * @retval VAL_Status: VAL_OK if queued, VAL_BUSY if the TX queue is full,
+  *         VAL_PARAM for invalid arguments
+  */
+VAL_Status VAL_Serial_SendAsync(const uint8_t* data, uint16_t length) {
+  VAL_Serial_Segment_t segment = { data, length };
 
-  /* Check if previous transmission is ongoing */
-  if (tx_busy) {
+  return VAL_Serial_SendSegmentsAsync(&segment, 1);
+}
+
+/**
+  * @brief  Queue a message made of several buffers for non-blocking transmission
+  * @note   Safe to call from tasks and interrupts. The segments are queued in
+  *         order, all or none, so they go out as one message. Segments in
+  *         RAM are copied and may be reused as soon as the call returns;
+  *         segments in flash are sent from where they are.
+  * @param  segments: Buffers of the message, in order
+  * @param  count: Number of segments
+  * @retval VAL_Status: VAL_OK if queued, VAL_BUSY if the TX queue is full,
+  *         VAL_PARAM for invalid arguments
+  */
+VAL_Status VAL_Serial_SendSegmentsAsync(const VAL_Serial_Segment_t* segments, uint8_t count) {
+  uint32_t primask;
+  uint32_t length = 0;
+  uint32_t copied = 0;
+
+  if (segments == NULL || count == 0 || count > SERIAL_TX_CHAIN_SIZE / 2) {
+    return VAL_PARAM;
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    if (segments[i].data == NULL && segments[i].length != 0) {
+      return VAL_PARAM;
+    }
+    length += segments[i].length;
+    if (!IsInPlace(&segments[i])) {
+      copied += segments[i].length;
+    }
+  }
+
+  if (length == 0 || copied > SERIAL_TX_RING_SIZE) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  /* A copy that wraps around the ring end takes two entries */
+  if ((SERIAL_TX_RING_SIZE - tx_count) < copied ||
+      (SERIAL_TX_CHAIN_SIZE - tx_chain_count) < 2U * count) {
+    __set_PRIMASK(primask);
     return VAL_BUSY;
   }
 
-  tx_busy = 1;
+  for (uint8_t i = 0; i < count; i++) {
+    if (segments[i].length == 0) {
+      continue;
+    }
+    if (IsInPlace(&segments[i])) {
+      QueueEntry(segments[i].data, segments[i].length, 0);
+    } else {
+      QueueCopy(segments[i].data, segments[i].length);
+    }
+  }
+  tx_queued_bytes += length;
+
+  /* Kick the DMA if it is idle; otherwise the completion interrupt continues */
+  if (tx_dma_length == 0) {
+    StartTransmitDMA();
+  }
 
-  /* Send data via UART */
-  status = HAL_UART_Transmit(&huart1, (uint8_t*)data, length, timeout);
+  __set_PRIMASK(primask);
 
-  tx_busy = 0;
+  return VAL_OK;
+}
 
-  return (status == HAL_OK) ? VAL_OK : VAL_ERROR;
+/**
+  * @brief  Register a callback for each completed TX transfer
+  * @note   The transmitted bytes are free again when it is called; the queue
+  *         has drained if VAL_Serial_IsBusy() returns 0
+  * @param  callback: Callback function, called from interrupt context, or NULL
+  * @retval None
+  */
+void VAL_Serial_SetTxCompleteCallback(SerialTxCompleteCallback callback) {
+  tx_complete_callback = callback;
 }
 
 /**
@@ -86,11 +437,18 @@ VAL_Status VAL_Serial_Send(const uint8_t* data, uint16_t length, uint32_t timeou
 VAL_Status VAL_Serial_Printf(const char* format, ...) {
   va_list args;
   int length;
+  uint32_t primask;
+  VAL_Status status;
 
-  /* Check if previous transmission is ongoing */
-  if (tx_busy) {
+  /* Claim the shared format buffer */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if (printf_busy) {
+    __set_PRIMASK(primask);
     return VAL_BUSY;
   }
+  printf_busy = 1;
+  __set_PRIMASK(primask);
 
   /* Format string */
   va_start(args, format);
@@ -98,47 +456,1128 @@ VAL_Status VAL_Serial_Printf(const char* format, ...) {
   va_end(args);
 
   if (length < 0 || length >= SERIAL_TX_BUFFER_SIZE) {
+    printf_busy = 0;
+    return VAL_ERROR;
+  }
+
+  /* Queue formatted string; the buffer is free again once copied */
+  status = VAL_Serial_Send(txBuffer, length, 1000);
+  printf_busy = 0;
+
+  return status;
+}
+
+/**
+  * @brief  Wait until all queued data has been transmitted
+  * @note   Must not be called from interrupt context
+  * @param  timeout: Maximum time to wait in milliseconds
+  * @retval VAL_Status: VAL_OK if the TX queue is empty, VAL_TIMEOUT otherwise
+  */
+VAL_Status VAL_Serial_Flush(uint32_t timeout) {
+  uint32_t start_tick;
+
+  VAL_ASSERT_TASK_CONTEXT();
+  start_tick = HAL_GetTick();
+
+  while (tx_chain_count != 0) {
+    if ((HAL_GetTick() - start_tick) >= timeout) {
+      return VAL_TIMEOUT;
+    }
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Check whether a baud rate can be generated accurately
+  * @param  baud_rate: Requested baud rate
+  * @retval VAL_Status: VAL_OK if supported, VAL_PARAM otherwise
+  */
+VAL_Status VAL_Serial_CheckBaudRate(uint32_t baud_rate) {
+  return CheckBaudRate(baud_rate, HAL_RCC_GetPCLK2Freq());
+}
+
+/**
+  * @brief  Check whether the UART can follow a change of its clock now
+  * @note   Called with interrupts disabled, before the clock changes
+  * @param  pclk: APB2 clock to change to, in Hz
+  * @retval VAL_Status: VAL_OK if it can, VAL_PARAM if the baud rate cannot
+  *         be generated from that clock, VAL_BUSY while a byte is sent or
+  *         received
+  */
+VAL_Status VAL_Serial_CheckClock(uint32_t pclk) {
+  if (CheckBaudRate(huart1.Init.BaudRate, pclk) != VAL_OK) {
+    return VAL_PARAM;
+  }
+
+  /* The chain entry is released once the last stop bit is out */
+  if (tx_chain_count != 0 || (huart1.Instance->ISR & USART_ISR_BUSY) != 0U) {
+    return VAL_BUSY;
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Set the baud rate divider for the present APB2 clock
+  * @note   Called by VAL_SysClock_SetLevel with interrupts disabled, after
+  *         VAL_Serial_CheckClock passed. The divider only changes with the
+  *         UART disabled; reception carries on into the same DMA buffer.
+  * @retval None
+  */
+void VAL_Serial_UpdateClock(void) {
+  uint32_t pclk = HAL_RCC_GetPCLK2Freq();
+  uint32_t baud_rate = huart1.Init.BaudRate;
+  uint32_t divider;
+
+  huart1.Init.OverSampling = GetOversampling(baud_rate, pclk);
+  if (huart1.Init.OverSampling == UART_OVERSAMPLING_16) {
+    divider = (pclk + (baud_rate / 2)) / baud_rate;
+  } else {
+    /* BRR[3] must stay clear, the fraction is shifted down by one */
+    divider = ((2 * pclk) + (baud_rate / 2)) / baud_rate;
+    divider = (divider & 0xFFF0U) | ((divider & 0x000FU) >> 1);
+  }
+
+  __HAL_UART_DISABLE(&huart1);
+  MODIFY_REG(huart1.Instance->CR1, USART_CR1_OVER8, huart1.Init.OverSampling);
+  huart1.Instance->BRR = divider;
+  __HAL_UART_ENABLE(&huart1);
+}
+
+/**
+  * @brief  Change the UART baud rate
+  * @note   Waits for the transfer in flight to finish. Data still queued is
+  *         sent at the new rate, so flush first if it must go out at the old
+  *         one. Reception restarts in the mode it was running in.
+  *         Must not be called from interrupt context.
+  * @param  baud_rate: New baud rate
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if the rate is not
+  *         supported, VAL_TIMEOUT if transmission did not stop, VAL_BUSY in
+  *         DMX512 or Modbus mode, VAL_ERROR otherwise
+  */
+VAL_Status VAL_Serial_SetBaudRate(uint32_t baud_rate) {
+  VAL_Status status;
+
+  VAL_ASSERT_TASK_CONTEXT();
+
+  if (IsLineTaken()) {
+    return VAL_BUSY;
+  }
+
+  status = VAL_Serial_CheckBaudRate(baud_rate);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  status = HoldTransmit();
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* Reconfigure; the MSP and DMA links are kept as the handle is not reset */
+  HAL_UART_AbortReceive(&huart1);
+  huart1.Init.BaudRate = baud_rate;
+  huart1.Init.OverSampling = GetOversampling(baud_rate, HAL_RCC_GetPCLK2Freq());
+  if (HAL_UART_Init(&huart1) != HAL_OK) {
+    return VAL_ERROR;
+  }
+
+  status = RestartReceive();
+  StartPendingTransmit();
+
+  return status;
+}
+
+/**
+  * @brief  Switch between a point-to-point link and an RS-485 bus
+  * @note   Waits for the transfer in flight to finish, like
+  *         VAL_Serial_SetBaudRate, and keeps the baud rate. On the bus the
+  *         UART drives the transceiver's driver enable on PB3, active high.
+  *         Must not be called from interrupt context.
+  * @param  enable: 1 to drive the driver enable, 0 for a point-to-point link
+  * @retval VAL_Status: VAL_OK if successful, VAL_TIMEOUT if transmission did
+  *         not stop, VAL_BUSY in DMX512 or Modbus mode or with flow control
+  *         on, VAL_ERROR otherwise
+  */
+VAL_Status VAL_Serial_SetRS485(uint8_t enable) {
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+  VAL_Status status;
+
+  if (IsLineTaken() || (enable && VAL_Serial_GetFlowControl())) {
+    return VAL_BUSY;
+  }
+
+  status = HoldTransmit();
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* DEM and the guard times can only change with the UART disabled */
+  HAL_UART_AbortReceive(&huart1);
+  __HAL_UART_DISABLE(&huart1);
+
+  GPIO_InitStruct.Pin = SERIAL_DE_PIN;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  if (enable) {
+    MODIFY_REG(huart1.Instance->CR1, USART_CR1_DEAT | USART_CR1_DEDT,
+               (SERIAL_DE_GUARD_TIME << USART_CR1_DEAT_Pos) | (SERIAL_DE_GUARD_TIME << USART_CR1_DEDT_Pos));
+    CLEAR_BIT(huart1.Instance->CR3, USART_CR3_DEP);
+    SET_BIT(huart1.Instance->CR3, USART_CR3_DEM);
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Alternate = GPIO_AF7_USART1;
+  } else {
+    /* Back to the board LED, off */
+    CLEAR_BIT(huart1.Instance->CR3, USART_CR3_DEM);
+    HAL_GPIO_WritePin(SERIAL_DE_PORT, SERIAL_DE_PIN, GPIO_PIN_RESET);
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+  }
+  HAL_GPIO_Init(SERIAL_DE_PORT, &GPIO_InitStruct);
+
+  __HAL_UART_ENABLE(&huart1);
+
+  status = RestartReceive();
+  StartPendingTransmit();
+
+  return status;
+}
+
+/**
+  * @brief  Turn RTS/CTS hardware flow control on or off
+  * @note   Waits for the transfer in flight to finish, like
+  *         VAL_Serial_SetBaudRate, and keeps the baud rate. RTS is on PB3,
+  *         CTS on PB4, both active low. When turning it off, a transfer
+  *         held by CTS is dropped and sent again from the start. Nothing
+  *         is touched if the setting does not change.
+  *         Must not be called from interrupt context.
+  * @param  enable: 1 for RTS/CTS, 0 for none
+  * @retval VAL_Status: VAL_OK if successful, VAL_TIMEOUT if transmission did
+  *         not stop, VAL_BUSY in DMX512 or Modbus mode or on an RS-485 bus,
+  *         VAL_ERROR otherwise
+  */
+VAL_Status VAL_Serial_SetFlowControl(uint8_t enable) {
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+  VAL_Status status;
+  uint32_t primask;
+
+  VAL_ASSERT_TASK_CONTEXT();
+
+  if ((enable ? 1U : 0U) == VAL_Serial_GetFlowControl()) {
+    return VAL_OK;
+  }
+  if (IsLineTaken() || READ_BIT(huart1.Instance->CR3, USART_CR3_DEM) != 0U) {
+    return VAL_BUSY;
+  }
+
+  status = HoldTransmit();
+  if (status != VAL_OK && enable) {
+    return status;
+  }
+  if (status != VAL_OK) {
+    /* Held by CTS; the chain keeps the entry, which restarts from its first byte */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    tx_ready = 0;
+    __set_PRIMASK(primask);
+    HAL_UART_AbortTransmit(&huart1);
+    tx_dma_length = 0;
+  }
+
+  /* RTSE and CTSE can only change with the UART disabled, which the init does */
+  HAL_UART_AbortReceive(&huart1);
+  huart1.Init.HwFlowCtl = enable ? UART_HWCONTROL_RTS_CTS : UART_HWCONTROL_NONE;
+  if (HAL_UART_Init(&huart1) != HAL_OK) {
+    StartPendingTransmit();
+    return VAL_ERROR;
+  }
+
+  GPIO_InitStruct.Pin = SERIAL_RTS_PIN;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  if (enable) {
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Alternate = GPIO_AF7_USART1;
+    HAL_GPIO_Init(SERIAL_RTS_PORT, &GPIO_InitStruct);
+
+    /* Pulled up, so an unconnected CTS holds transmission rather than losing bytes */
+    GPIO_InitStruct.Pin = SERIAL_CTS_PIN;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    HAL_GPIO_Init(SERIAL_CTS_PORT, &GPIO_InitStruct);
+  } else {
+    /* Back to the board LED, off, and CTS to its reset state */
+    HAL_GPIO_WritePin(SERIAL_RTS_PORT, SERIAL_RTS_PIN, GPIO_PIN_RESET);
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    HAL_GPIO_Init(SERIAL_RTS_PORT, &GPIO_InitStruct);
+    HAL_GPIO_DeInit(SERIAL_CTS_PORT, SERIAL_CTS_PIN);
+  }
+
+  status = RestartReceive();
+  StartPendingTransmit();
+
+  return status;
+}
+
+/**
+  * @brief  Check whether RTS/CTS flow control is on
+  * @retval uint8_t: 1 if on, 0 if off
+  */
+uint8_t VAL_Serial_GetFlowControl(void) {
+  return (huart1.Init.HwFlowCtl == UART_HWCONTROL_RTS_CTS) ? 1 : 0;
+}
+
+/**
+  * @brief  Switch reception to DMX512 packets from a lighting desk
+  * @note   Waits for the transfer in flight to finish, like
+  *         VAL_Serial_SetBaudRate; messages queued from now on are held until
+  *         VAL_Serial_StopDmx. Must not be called from interrupt context.
+  * @param  callback: Receives every complete packet, start code first, from
+  *         interrupt context
+  * @retval VAL_Status: VAL_OK if listening, VAL_PARAM if 250 kbaud cannot be
+  *         generated from the present clock, VAL_BUSY if already in DMX512
+  *         or Modbus mode or with flow control on, VAL_TIMEOUT if
+  *         transmission did not stop, VAL_ERROR otherwise
+  */
+VAL_Status VAL_Serial_StartDmx(SerialDmxCallback callback) {
+  static const SerialLine_t dmx_line = {
+    SERIAL_DMX_BAUD_RATE, UART_WORDLENGTH_8B, UART_STOPBITS_2, UART_PARITY_NONE
+  };
+  VAL_Status status;
+  uint32_t primask;
+
+  if (callback == NULL) {
+    return VAL_PARAM;
+  }
+  if (IsLineTaken() || VAL_Serial_GetFlowControl()) {
+    return VAL_BUSY;
+  }
+
+  status = VAL_Serial_CheckBaudRate(SERIAL_DMX_BAUD_RATE);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  status = HoldTransmit();
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* From here on errors restart DMX reception instead of the host link */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  dmx_callback = callback;
+  dmx_overrun = 0;
+  dmx_dropped = 0;
+  __set_PRIMASK(primask);
+
+  HAL_UART_AbortReceive(&huart1);
+  host_line.baud_rate = huart1.Init.BaudRate;
+  host_line.word_length = huart1.Init.WordLength;
+  host_line.stop_bits = huart1.Init.StopBits;
+  host_line.parity = huart1.Init.Parity;
+  if (SetLine(&dmx_line) != HAL_OK || StartReceiveDmx() != HAL_OK) {
+    VAL_Serial_StopDmx();
+    return VAL_ERROR;
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Leave DMX512 mode and restart the host link
+  * @note   Restores the baud rate and framing in use before, then sends
+  *         the messages held meanwhile. Must not be called from interrupt
+  *         context.
+  * @retval VAL_Status: VAL_OK if the host link runs again, VAL_ERROR otherwise
+  */
+VAL_Status VAL_Serial_StopDmx(void) {
+  VAL_Status status;
+  uint32_t primask;
+
+  if (dmx_callback == NULL) {
+    return VAL_OK;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  dmx_callback = NULL;
+  __set_PRIMASK(primask);
+
+  HAL_UART_AbortReceive(&huart1);
+  if (SetLine(&host_line) != HAL_OK) {
+    return VAL_ERROR;
+  }
+
+  status = RestartReceive();
+  StartPendingTransmit();
+
+  return status;
+}
+
+/**
+  * @brief  Get the number of DMX512 packets lost to line errors
+  * @note   Noise, overrun or a packet longer than 512 slots; counted since
+  *         VAL_Serial_StartDmx
+  * @retval uint32_t: Packets dropped
+  */
+uint32_t VAL_Serial_GetDmxDropped(void) {
+  return dmx_dropped;
+}
+
+/**
+  * @brief  Switch the link to Modbus RTU frames from a bus master
+  * @note   Waits for the transfer in flight to finish, like
+  *         VAL_Serial_SetBaudRate; messages queued from now on are held until
+  *         VAL_Serial_StopModbus. The line runs 8E1 at baud_rate, with the
+  *         RS-485 driver enable as set for the host link.
+  *         Must not be called from interrupt context.
+  * @param  baud_rate: Bus baud rate
+  * @param  callback: Receives every frame ended by the inter-frame gap,
+  *         address to CRC, from interrupt context; VAL_Serial_SendModbus
+  *         may answer from within it
+  * @retval VAL_Status: VAL_OK if listening, VAL_PARAM if the rate cannot be
+  *         generated from the present clock, VAL_BUSY if already in DMX512
+  *         or Modbus mode or with flow control on, VAL_TIMEOUT if
+  *         transmission did not stop, VAL_ERROR otherwise
+  */
+VAL_Status VAL_Serial_StartModbus(uint32_t baud_rate, SerialFrameCallback callback) {
+  SerialLine_t line = { baud_rate, UART_WORDLENGTH_9B, UART_STOPBITS_1, UART_PARITY_EVEN };
+  uint32_t gap_bits = SERIAL_MODBUS_GAP_BITS;
+  VAL_Status status;
+  uint32_t primask;
+
+  VAL_ASSERT_TASK_CONTEXT();
+
+  if (callback == NULL) {
+    return VAL_PARAM;
+  }
+  if (IsLineTaken() || VAL_Serial_GetFlowControl()) {
+    return VAL_BUSY;
+  }
+
+  status = VAL_Serial_CheckBaudRate(baud_rate);
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  status = HoldTransmit();
+  if (status != VAL_OK) {
+    return status;
+  }
+
+  /* From here on errors and timeouts end Modbus frames instead of restarting the host link */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  modbus_callback = callback;
+  modbus_tx_length = 0;
+  modbus_overrun = 0;
+  modbus_dropped = 0;
+  __set_PRIMASK(primask);
+
+  HAL_UART_AbortReceive(&huart1);
+  host_line.baud_rate = huart1.Init.BaudRate;
+  host_line.word_length = huart1.Init.WordLength;
+  host_line.stop_bits = huart1.Init.StopBits;
+  host_line.parity = huart1.Init.Parity;
+  if (baud_rate > SERIAL_MODBUS_FIXED_GAP_BAUD) {
+    gap_bits = (uint32_t)(((uint64_t)SERIAL_MODBUS_FIXED_GAP_US * baud_rate + 999999U) / 1000000U);
+  }
+  if (SetLine(&line) != HAL_OK) {
+    VAL_Serial_StopModbus();
+    return VAL_ERROR;
+  }
+  HAL_UART_ReceiverTimeout_Config(&huart1, gap_bits);
+  if (HAL_UART_EnableReceiverTimeout(&huart1) != HAL_OK || StartReceiveModbus() != HAL_OK) {
+    VAL_Serial_StopModbus();
+    return VAL_ERROR;
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Leave Modbus mode and restart the host link
+  * @note   Lets a reply on the bus finish, then restores the line settings
+  *         in use before and sends the messages held meanwhile. Must not be
+  *         called from interrupt context.
+  * @retval VAL_Status: VAL_OK if the host link runs again, VAL_ERROR otherwise
+  */
+VAL_Status VAL_Serial_StopModbus(void) {
+  VAL_Status status;
+  uint32_t start_tick;
+  uint32_t primask;
+
+  if (modbus_callback == NULL) {
+    return VAL_OK;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  modbus_callback = NULL;
+  __set_PRIMASK(primask);
+
+  start_tick = HAL_GetTick();
+  while (modbus_tx_length != 0 && (HAL_GetTick() - start_tick) < SERIAL_TX_IDLE_TIMEOUT_MS) {
+  }
+  if (modbus_tx_length != 0) {
+    HAL_UART_AbortTransmit(&huart1);
+    modbus_tx_length = 0;
+  }
+
+  HAL_UART_AbortReceive(&huart1);
+  CLEAR_BIT(huart1.Instance->CR1, USART_CR1_RTOIE);
+  CLEAR_BIT(huart1.Instance->CR2, USART_CR2_RTOEN);
+  SET_BIT(huart1.Instance->CR1, USART_CR1_RE);
+  if (SetLine(&host_line) != HAL_OK) {
     return VAL_ERROR;
   }
 
-  /* Send formatted string */
-  return VAL_Serial_Send(txBuffer, length, 1000);
+  status = RestartReceive();
+  StartPendingTransmit();
+
+  return status;
+}
+
+/**
+  * @brief  Send a Modbus RTU reply
+  * @note   Safe to call from interrupt context, the frame callback included.
+  *         The frame is copied and goes out at once, ahead of the held host
+  *         messages; the receiver is off until its last stop bit.
+  * @param  frame: Reply, address to CRC
+  * @param  length: Bytes in the reply
+  * @retval VAL_Status: VAL_OK if sending, VAL_PARAM for an empty or oversized
+  *         frame, VAL_BUSY if the previous reply is still on the bus,
+  *         VAL_ERROR outside Modbus mode
+  */
+VAL_Status VAL_Serial_SendModbus(const uint8_t* frame, uint16_t length) {
+  uint32_t primask;
+
+  if (frame == NULL || length == 0 || length > SERIAL_MODBUS_FRAME_SIZE) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if (modbus_callback == NULL) {
+    __set_PRIMASK(primask);
+    return VAL_ERROR;
+  }
+  if (modbus_tx_length != 0) {
+    __set_PRIMASK(primask);
+    return VAL_BUSY;
+  }
+  modbus_tx_length = length;
+  __set_PRIMASK(primask);
+
+  memcpy(modbus_tx_buffer, frame, length);
+  CLEAR_BIT(huart1.Instance->CR1, USART_CR1_RE);
+  if (HAL_UART_Transmit_DMA(&huart1, modbus_tx_buffer, length) != HAL_OK) {
+    SET_BIT(huart1.Instance->CR1, USART_CR1_RE);
+    modbus_tx_length = 0;
+    return VAL_ERROR;
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the number of Modbus frames lost to line errors
+  * @note   Parity, noise, framing, overrun or a frame longer than 256
+  *         bytes; counted since VAL_Serial_StartModbus
+  * @retval uint32_t: Frames dropped
+  */
+uint32_t VAL_Serial_GetModbusDropped(void) {
+  return modbus_dropped;
+}
+
+/**
+  * @brief  Get the current UART baud rate
+  * @retval uint32_t: Baud rate
+  */
+uint32_t VAL_Serial_GetBaudRate(void) {
+  return huart1.Init.BaudRate;
 }
 
 /**
   * @brief  Check if serial module is busy transmitting
-  * @retval uint8_t: 1 if busy, 0 if ready
+  * @retval uint8_t: 1 if data is still queued or in flight, 0 if idle
   */
 uint8_t VAL_Serial_IsBusy(void) {
-  return tx_busy;
+  return (tx_chain_count != 0) ? 1 : 0;
+}
+
+/**
+  * @brief  Get the number of bytes queued for transmission since start-up
+  * @note   Wraps around; a message is sent once VAL_Serial_GetTxSent has
+  *         caught up with the count read right after queueing it
+  * @retval uint32_t: Bytes
+  */
+uint32_t VAL_Serial_GetTxQueued(void) {
+  return tx_queued_bytes;
+}
+
+/**
+  * @brief  Get the number of bytes sent since start-up
+  * @note   Wraps around, counted as each DMA transfer completes
+  * @retval uint32_t: Bytes
+  */
+uint32_t VAL_Serial_GetTxSent(void) {
+  return tx_sent_bytes;
+}
+
+/**
+  * @brief  Get the time since a byte was last received
+  * @retval uint32_t: Milliseconds since the last reception
+  */
+uint32_t VAL_Serial_GetIdleTime(void) {
+  return HAL_GetTick() - rx_last_tick;
+}
+
+/**
+  * @brief  Get the longest message VAL_Serial_SendSegmentsAsync can queue
+  * @note   Counts the bytes copied; segments sent in place from flash come on top
+  * @retval uint16_t: Bytes, the size of the TX ring
+  */
+uint16_t VAL_Serial_GetMaxMessage(void) {
+  return SERIAL_TX_RING_SIZE;
+}
+
+#if VAL_SERIAL_WAKE_ENABLED
+/**
+  * @brief  Hand the RX line to LPUART1 before a stop
+  * @note   Called with interrupts disabled, right before STOP2. Only in DMA
+  *         reception mode; USART1 must be idle.
+  * @retval VAL_Status: VAL_OK if LPUART1 listens, VAL_BUSY if the link is
+  *         in use or taken, VAL_ERROR if the line cannot be followed
+  */
+VAL_Status VAL_Serial_ArmWake(void) {
+  uint32_t brr;
+  uint32_t polls = SERIAL_WAKE_READY_POLLS;
+
+  if (rx_block_callback == NULL || IsLineTaken() || wake_state != SERIAL_WAKE_OFF) {
+    return VAL_BUSY;
+  }
+  if ((USART1->ISR & USART_ISR_BUSY) != 0U || (USART1->CR3 & USART_CR3_CTSE) != 0U) {
+    return VAL_BUSY;
+  }
+
+  brr = (uint32_t)(((uint64_t)SERIAL_WAKE_CLOCK_HZ * 256U + huart1.Init.BaudRate / 2U) / huart1.Init.BaudRate);
+  if (brr < SERIAL_WAKE_BRR_MIN || brr > SERIAL_WAKE_BRR_MAX) {
+    return VAL_ERROR;
+  }
+
+  /* The receiver only starts on a running kernel clock; in STOP2 the
+   * HSI16 is off and started again for each start bit */
+  wake_hsi_was_on = READ_BIT(RCC->CR, RCC_CR_HSION) != 0U;
+  SET_BIT(RCC->CR, RCC_CR_HSION);
+
+  /* Same framing as the host link; wake up on a complete byte */
+  LPUART1->CR1 = 0;
+  LPUART1->BRR = brr;
+  LPUART1->CR2 = USART1->CR2 & USART_CR2_STOP;
+  LPUART1->CR3 = USART_CR3_WUS_0 | USART_CR3_WUS_1 | USART_CR3_WUFIE;
+  LPUART1->CR1 = (USART1->CR1 & (USART_CR1_M | USART_CR1_PCE | USART_CR1_PS)) | USART_CR1_UESM | USART_CR1_RE |
+                 USART_CR1_UE;
+  while ((LPUART1->ISR & USART_ISR_REACK) == 0U) {
+    if (--polls == 0U) {
+      StopWake();
+      return VAL_ERROR;
+    }
+  }
+  LPUART1->ICR = USART_ICR_WUCF | USART_ICR_IDLECF | USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NECF;
+  (void)LPUART1->RDR;
+
+  CLEAR_BIT(USART1->CR1, USART_CR1_RE);
+  EXTI->IMR1 |= SERIAL_WAKE_EXTI_LINE;
+  wake_state = SERIAL_WAKE_ARMED;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Take over the frame that woke the MCU, or give the line back
+  * @note   Called with interrupts disabled, first thing after a stop armed
+  *         with VAL_Serial_ArmWake, before the byte after the first arrives
+  * @retval uint8_t: 1 if LPUART1 woke the MCU and receives the frame, 0 if
+  *         USART1 has the line again
+  */
+uint8_t VAL_Serial_ResumeWake(void) {
+  if (wake_state != SERIAL_WAKE_ARMED) {
+    return 0;
+  }
+
+  EXTI->IMR1 &= ~SERIAL_WAKE_EXTI_LINE;
+
+  /* Entering STOP2 cleared HSION; the STOP2 logic only ran the HSI16 for
+   * the one byte */
+  SET_BIT(RCC->CR, RCC_CR_HSION);
+
+  if ((LPUART1->ISR & (USART_ISR_RXNE | USART_ISR_BUSY)) == 0U) {
+    StopWake();
+    return 0;
+  }
+
+  /* The pending byte is the first the DMA moves */
+  wake_read_pos = 0;
+  SERIAL_WAKE_DMA->CCR = 0;
+  SERIAL_WAKE_DMA->CNDTR = SERIAL_WAKE_BUFFER_SIZE;
+  SERIAL_WAKE_DMA->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_TCIE | DMA_CCR_PL_1 | DMA_CCR_EN;
+  LPUART1->ICR = USART_ICR_IDLECF;
+  SET_BIT(LPUART1->CR3, USART_CR3_DMAR);
+  SET_BIT(LPUART1->CR1, USART_CR1_IDLEIE);
+  wake_state = SERIAL_WAKE_LISTENING;
+
+  return 1;
 }
 
+/**
+  * @brief  Handle the LPUART1 and DMA2 channel 7 interrupts of the listener
+  * @note   Hands every newly received block to the block callback, as the
+  *         USART1 idle-line event does, and the line back to USART1 at the
+  *         first idle line
+  * @retval None
+  */
+VAL_RAMFUNC void VAL_Serial_WakeIRQHandler(void) {
+  uint32_t isr = LPUART1->ISR;
+  uint16_t write_pos;
+
+  LPUART1->ICR = USART_ICR_WUCF | USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NECF;
+  DMA2->IFCR = DMA_IFCR_CGIF7;
+
+  if (wake_state != SERIAL_WAKE_LISTENING) {
+    return;
+  }
+
+  write_pos = (uint16_t)(SERIAL_WAKE_BUFFER_SIZE - SERIAL_WAKE_DMA->CNDTR);
+  if (write_pos != wake_read_pos) {
+    rx_last_tick = HAL_GetTick();
+    if (write_pos > wake_read_pos) {
+      rx_block_callback(&wake_buffer[wake_read_pos], write_pos - wake_read_pos);
+    } else {
+      /* DMA wrapped around the end of the circular buffer */
+      rx_block_callback(&wake_buffer[wake_read_pos], SERIAL_WAKE_BUFFER_SIZE - wake_read_pos);
+      if (write_pos > 0U) {
+        rx_block_callback(wake_buffer, write_pos);
+      }
+    }
+    wake_read_pos = write_pos;
+  }
+
+  if ((isr & USART_ISR_IDLE) != 0U) {
+    StopWake();
+  }
+}
+#endif
+
 /* Private functions ---------------------------------------------------------*/
 
 /**
   * @brief  Start continuous reception
+  * @retval HAL_StatusTypeDef: HAL_OK if reception started
+  */
+static HAL_StatusTypeDef StartReceive(void) {
+  return HAL_UART_Receive_IT(&huart1, rx_buffer, 1);
+}
+
+/**
+  * @brief  Start circular DMA reception with idle-line detection
+  * @retval HAL_StatusTypeDef: HAL status of the reception request
+  */
+static HAL_StatusTypeDef StartReceiveDMA(void) {
+  rx_dma_read_pos = 0;
+
+  return HAL_UARTEx_ReceiveToIdle_DMA(&huart1, rx_dma_buffer, SERIAL_RX_DMA_BUFFER_SIZE);
+}
+
+/**
+  * @brief  Start DMX512 reception at the top of the packet buffer
+  * @retval HAL_StatusTypeDef: HAL status of the reception request
+  */
+static HAL_StatusTypeDef StartReceiveDmx(void) {
+  dmx_overrun = 0;
+
+  return HAL_UART_Receive_DMA(&huart1, dmx_buffer, SERIAL_DMX_BUFFER_SIZE);
+}
+
+/**
+  * @brief  Hand over the packet a break has ended and listen for the next one
+  * @note   Called from the UART error interrupt, reception has been aborted
+  * @retval None
+  */
+static void ReceiveDmxBreak(void) {
+  uint16_t received = SERIAL_DMX_BUFFER_SIZE - (uint16_t)__HAL_DMA_GET_COUNTER(huart1.hdmarx);
+  uint32_t errors = huart1.ErrorCode;
+
+  if ((errors & ~HAL_UART_ERROR_FE) != 0U || dmx_overrun) {
+    /* Noise or overrun inside the packet, its slots cannot be trusted */
+    dmx_dropped++;
+  } else if (received > 1U) {
+    /* The last byte is the break itself; a lone one is the tail of a long break */
+    rx_last_tick = HAL_GetTick();
+    dmx_callback(dmx_buffer, received - 1U);
+  }
+
+  StartReceiveDmx();
+}
+
+/**
+  * @brief  Start Modbus reception at the top of the frame buffer
+  * @retval HAL_StatusTypeDef: HAL status of the reception request
+  */
+static HAL_StatusTypeDef StartReceiveModbus(void) {
+  modbus_overrun = 0;
+
+  return HAL_UART_Receive_DMA(&huart1, modbus_buffer, SERIAL_MODBUS_BUFFER_SIZE);
+}
+
+/**
+  * @brief  Hand over the frame the inter-frame gap has ended and listen for the next one
+  * @note   Called from the UART error interrupt, reception has been aborted
+  * @retval None
+  */
+static void ReceiveModbusFrame(void) {
+  uint16_t received = SERIAL_MODBUS_BUFFER_SIZE - (uint16_t)__HAL_DMA_GET_COUNTER(huart1.hdmarx);
+  uint32_t errors = huart1.ErrorCode;
+
+  if ((errors & ~HAL_UART_ERROR_RTO) != 0U || modbus_overrun) {
+    /* A bad character; the rest of the frame fails its CRC when the gap ends it */
+    modbus_dropped++;
+  } else if (received > 0U) {
+    rx_last_tick = HAL_GetTick();
+    modbus_callback(modbus_buffer, received);
+  }
+
+  StartReceiveModbus();
+}
+
+#if VAL_SERIAL_WAKE_ENABLED
+/**
+  * @brief  Set up LPUART1 and its RX DMA for the stop mode listener
+  * @note   The host RX line reaches PA3 too (see val_board.h); LPUART1 stays
+  *         disabled until VAL_Serial_ArmWake
+  * @retval None
+  */
+static void InitWake(void) {
+  GPIO_InitTypeDef gpio = {0};
+
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  __HAL_RCC_DMA2_CLK_ENABLE();
+  __HAL_RCC_LPUART1_CONFIG(RCC_LPUART1CLKSOURCE_HSI);
+  __HAL_RCC_LPUART1_CLK_ENABLE();
+
+  gpio.Pin = SERIAL_WAKE_PIN;
+  gpio.Mode = GPIO_MODE_AF_PP;
+  gpio.Pull = GPIO_PULLUP;
+  gpio.Speed = GPIO_SPEED_FREQ_LOW;
+  gpio.Alternate = GPIO_AF8_LPUART1;
+  HAL_GPIO_Init(SERIAL_WAKE_PORT, &gpio);
+
+  LPUART1->CR1 = 0;
+  SERIAL_WAKE_DMA->CCR = 0;
+  SERIAL_WAKE_DMA->CPAR = (uint32_t)&LPUART1->RDR;
+  SERIAL_WAKE_DMA->CMAR = (uint32_t)wake_buffer;
+  MODIFY_REG(DMA2_CSELR->CSELR, DMA_CSELR_C7S, SERIAL_WAKE_DMA_REQUEST << DMA_CSELR_C7S_Pos);
+
+  /* The wake-up line stays masked unless armed */
+  EXTI->IMR1 &= ~SERIAL_WAKE_EXTI_LINE;
+
+  HAL_NVIC_SetPriority(LPUART1_IRQn, VAL_IRQ_PRIORITY_COMMS, 0);
+  HAL_NVIC_EnableIRQ(LPUART1_IRQn);
+  HAL_NVIC_SetPriority(DMA2_Channel7_IRQn, VAL_IRQ_PRIORITY_COMMS, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Channel7_IRQn);
+}
+
+/**
+  * @brief  Give the RX line back to USART1
+  * @retval None
+  */
+static void StopWake(void) {
+  LPUART1->CR1 = 0;
+  LPUART1->CR3 = 0;
+  SERIAL_WAKE_DMA->CCR = 0;
+  LPUART1->ICR = USART_ICR_WUCF | USART_ICR_IDLECF | USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NECF;
+  DMA2->IFCR = DMA_IFCR_CGIF7;
+  EXTI->IMR1 &= ~SERIAL_WAKE_EXTI_LINE;
+
+  if (!wake_hsi_was_on) {
+    CLEAR_BIT(RCC->CR, RCC_CR_HSION);
+  }
+
+  SET_BIT(USART1->CR1, USART_CR1_RE);
+  wake_state = SERIAL_WAKE_OFF;
+}
+#endif
+
+/**
+  * @brief  Check whether DMX512 or Modbus mode has the link
+  * @retval uint8_t: 1 if the host link is suspended, 0 otherwise
+  */
+static uint8_t IsLineTaken(void) {
+  return (dmx_callback != NULL || modbus_callback != NULL) ? 1 : 0;
+}
+
+/**
+  * @brief  Reinitialize the UART with the given line settings
+  * @note   The MSP and DMA links are kept as the handle is not reset
+  * @param  line: Baud rate and framing
+  * @retval HAL_StatusTypeDef: HAL status of the initialization
+  */
+static HAL_StatusTypeDef SetLine(const SerialLine_t* line) {
+  huart1.Init.BaudRate = line->baud_rate;
+  huart1.Init.WordLength = line->word_length;
+  huart1.Init.StopBits = line->stop_bits;
+  huart1.Init.Parity = line->parity;
+  huart1.Init.OverSampling = GetOversampling(line->baud_rate, HAL_RCC_GetPCLK2Freq());
+
+  return HAL_UART_Init(&huart1);
+}
+
+/**
+  * @brief  Check whether a baud rate can be generated from a clock
+  * @param  baud_rate: Requested baud rate
+  * @param  pclk: APB2 clock in Hz
+  * @retval VAL_Status: VAL_OK if supported, VAL_PARAM otherwise
+  */
+static VAL_Status CheckBaudRate(uint32_t baud_rate, uint32_t pclk) {
+  uint32_t oversampling;
+  uint32_t divider;
+  uint32_t actual;
+  uint32_t error;
+
+  if (baud_rate < SERIAL_MIN_BAUD_RATE || baud_rate > pclk / 8) {
+    return VAL_PARAM;
+  }
+
+  /* Same divider as the HAL computes, rounded to nearest */
+  oversampling = GetOversampling(baud_rate, pclk);
+  if (oversampling == UART_OVERSAMPLING_16) {
+    divider = (pclk + (baud_rate / 2)) / baud_rate;
+    actual = pclk / divider;
+  } else {
+    divider = ((2 * pclk) + (baud_rate / 2)) / baud_rate;
+    actual = (2 * pclk) / divider;
+  }
+
+  if (divider < 16 || divider > 0xFFFF) {
+    return VAL_PARAM;
+  }
+
+  error = (actual > baud_rate) ? (actual - baud_rate) : (baud_rate - actual);
+  if ((uint64_t)error * 1000 > (uint64_t)baud_rate * SERIAL_MAX_BAUD_ERROR_PERMILLE) {
+    return VAL_PARAM;
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Select the UART oversampling for a baud rate
+  * @note   Oversampling by 16 is more noise tolerant and is kept whenever the
+  *         USART clock allows it
+  * @param  baud_rate: Baud rate
+  * @param  pclk: APB2 clock in Hz
+  * @retval uint32_t: UART_OVERSAMPLING_16 or UART_OVERSAMPLING_8
+  */
+static uint32_t GetOversampling(uint32_t baud_rate, uint32_t pclk) {
+  return (baud_rate <= pclk / 16) ? UART_OVERSAMPLING_16 : UART_OVERSAMPLING_8;
+}
+
+/**
+  * @brief  Start a DMA transfer for the next entry of the TX chain
+  * @note   Must be called with interrupts disabled or from the UART interrupts
+  * @retval None
+  */
+static void StartTransmitDMA(void) {
+  const SerialTxEntry_t* entry = &tx_chain[tx_chain_tail];
+
+  if (!tx_ready || tx_chain_count == 0) {
+    return;
+  }
+
+  tx_dma_length = entry->length;
+  if (HAL_UART_Transmit_DMA(&huart1, (uint8_t*)entry->data, entry->length) != HAL_OK) {
+    tx_dma_length = 0;
+  }
+}
+
+/**
+  * @brief  Check whether a segment is sent from where it is
+  * @param  segment: Segment to check
+  * @retval uint8_t: 1 for a segment in flash long enough to be worth its own
+  *         transfer, 0 if it is copied
+  */
+static uint8_t IsInPlace(const VAL_Serial_Segment_t* segment) {
+  uintptr_t address = (uintptr_t)segment->data;
+
+  return (segment->length >= SERIAL_TX_INPLACE_MIN && address >= FLASH_BASE &&
+          address + segment->length <= FLASH_END + 1U) ? 1 : 0;
+}
+
+/**
+  * @brief  Append an entry to the TX chain
+  * @note   Must be called with interrupts disabled; the caller checks for room
+  * @param  data: Bytes to send
+  * @param  length: Number of bytes
+  * @param  in_ring: 1 if the bytes are held in tx_ring
+  * @retval None
+  */
+static void QueueEntry(const uint8_t* data, uint16_t length, uint8_t in_ring) {
+  SerialTxEntry_t* entry = &tx_chain[tx_chain_head];
+
+  entry->data = data;
+  entry->length = length;
+  entry->in_ring = in_ring;
+  tx_chain_head = (tx_chain_head + 1U) % SERIAL_TX_CHAIN_SIZE;
+  tx_chain_count++;
+}
+
+/**
+  * @brief  Copy bytes into the TX ring and queue them
+  * @note   Must be called with interrupts disabled; the caller checks for room.
+  *         Extends the last entry when it continues it and is not in flight.
+  * @param  data: Bytes to send
+  * @param  length: Number of bytes
+  * @retval None
+  */
+static void QueueCopy(const uint8_t* data, uint16_t length) {
+  while (length > 0) {
+    uint16_t part = SERIAL_TX_RING_SIZE - tx_head;
+    uint8_t last = (tx_chain_head + SERIAL_TX_CHAIN_SIZE - 1U) % SERIAL_TX_CHAIN_SIZE;
+    SerialTxEntry_t* entry = &tx_chain[last];
+
+    /* Up to the end of the ring; the rest goes to its start */
+    if (part > length) {
+      part = length;
+    }
+    memcpy(&tx_ring[tx_head], data, part);
+
+    if (tx_chain_count > 0 && entry->in_ring && entry->data + entry->length == &tx_ring[tx_head] &&
+        !(tx_chain_count == 1 && tx_dma_length != 0)) {
+      entry->length += part;
+    } else {
+      QueueEntry(&tx_ring[tx_head], part, 1);
+    }
+
+    tx_head = (tx_head + part) % SERIAL_TX_RING_SIZE;
+    tx_count += part;
+    data += part;
+    length -= part;
+  }
+}
+
+/**
+  * @brief  Enable transmission and send anything queued before initialization
   * @retval None
   */
-static void StartReceive(void) {
-  /* Detailed error checking for receive initialization */
-  HAL_StatusTypeDef status = HAL_UART_Receive_IT(&huart1, rx_buffer, 1);
+static void StartPendingTransmit(void) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
 
-  switch(status) {
-    case HAL_OK:
-      //VAL_Serial_Printf("StartReceive: Interrupt receive started successfully\r\n");
-      break;
-    case HAL_ERROR:
-      VAL_Serial_Printf("StartReceive: HAL_ERROR - Receive initialization failed\r\n");
-      break;
-    case HAL_BUSY:
-      VAL_Serial_Printf("StartReceive: HAL_BUSY - UART is busy\r\n");
-      break;
-    case HAL_TIMEOUT:
-      VAL_Serial_Printf("StartReceive: HAL_TIMEOUT - Receive timeout\r\n");
-      break;
-    default:
-      VAL_Serial_Printf("StartReceive: Unknown status %d\r\n", status);
-      break;
+  tx_ready = 1;
+  if (tx_dma_length == 0) {
+    StartTransmitDMA();
+  }
+
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Hold back new transfers and wait for the one in flight to complete
+  * @note   Transmission resumes with StartPendingTransmit
+  * @retval VAL_Status: VAL_OK once idle, VAL_TIMEOUT if the transfer did not
+  *         complete; transmission has resumed then
+  */
+static VAL_Status HoldTransmit(void) {
+  uint32_t start_tick;
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  tx_ready = 0;
+  __set_PRIMASK(primask);
+
+  start_tick = HAL_GetTick();
+  while (tx_dma_length != 0) {
+    if ((HAL_GetTick() - start_tick) >= SERIAL_TX_IDLE_TIMEOUT_MS) {
+      StartPendingTransmit();
+      return VAL_TIMEOUT;
+    }
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Restart reception in the mode it was running in
+  * @retval VAL_Status: VAL_OK if restarted or never started, VAL_ERROR otherwise
+  */
+static VAL_Status RestartReceive(void) {
+  if (rx_block_callback != NULL) {
+    return (StartReceiveDMA() == HAL_OK) ? VAL_OK : VAL_ERROR;
+  }
+  if (rx_callback != NULL) {
+    return (StartReceive() == HAL_OK) ? VAL_OK : VAL_ERROR;
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  UART TX complete callback
+  * @param  huart: UART handle
+  * @retval None
+  */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+  if (huart->Instance == USART1 && modbus_tx_length != 0) {
+    /* Modbus reply out, the bus is free: listen again */
+    modbus_tx_length = 0;
+    SET_BIT(huart1.Instance->CR1, USART_CR1_RE);
+  } else if (huart->Instance == USART1) {
+    /* Release the transmitted entry and continue with the next one */
+    if (tx_chain[tx_chain_tail].in_ring) {
+      tx_count -= tx_dma_length;
+    }
+    tx_sent_bytes += tx_dma_length;
+    tx_chain_tail = (tx_chain_tail + 1U) % SERIAL_TX_CHAIN_SIZE;
+    tx_chain_count--;
+    tx_dma_length = 0;
+
+    StartTransmitDMA();
+
+    if (tx_complete_callback != NULL) {
+      tx_complete_callback();
+    }
+  }
+}
+
+/**
+  * @brief  UART reception event callback (idle line, half or full transfer)
+  * @param  huart: UART handle
+  * @param  Size: Current write position of the DMA inside the RX buffer
+  * @retval None
+  */
+VAL_RAMFUNC void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size) {
+  if (huart->Instance != USART1 || rx_block_callback == NULL || IsLineTaken()) {
+    return;
+  }
+
+  /* Hand over everything received since the previous event */
+  if (Size != rx_dma_read_pos) {
+    rx_last_tick = HAL_GetTick();
+    if (Size > rx_dma_read_pos) {
+      rx_block_callback(&rx_dma_buffer[rx_dma_read_pos], Size - rx_dma_read_pos);
+    } else {
+      /* DMA wrapped around the end of the circular buffer */
+      rx_block_callback(&rx_dma_buffer[rx_dma_read_pos], SERIAL_RX_DMA_BUFFER_SIZE - rx_dma_read_pos);
+      if (Size > 0) {
+        rx_block_callback(rx_dma_buffer, Size);
+      }
+    }
+    rx_dma_read_pos = Size;
+  }
+
+  if (rx_dma_read_pos >= SERIAL_RX_DMA_BUFFER_SIZE) {
+    rx_dma_read_pos = 0;
   }
 }
 
@@ -148,7 +1587,15 @@ static void StartReceive(void) {
   * @retval None
   */
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
-  if (huart->Instance == USART1) {
+  if (huart->Instance == USART1 && dmx_callback != NULL) {
+    /* The circular DMA wrapped: more than 512 slots, not a DMX512 packet */
+    dmx_overrun = 1;
+  } else if (huart->Instance == USART1 && modbus_callback != NULL) {
+    /* Likewise more than 256 bytes, not a Modbus frame */
+    modbus_overrun = 1;
+  } else if (huart->Instance == USART1) {
+    rx_last_tick = HAL_GetTick();
+
     /* Call user callback with received byte */
     if (rx_callback != NULL) {
       rx_callback(rx_buffer[0]);
@@ -166,7 +1613,22 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
   */
 void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
   if (huart->Instance == USART1) {
-    /* Restart reception on error */
-    HAL_UART_Receive_IT(&huart1, rx_buffer, 1);
+    /* Retry an aborted transmission */
+    if (tx_dma_length != 0 && huart->gState == HAL_UART_STATE_READY) {
+      tx_dma_length = 0;
+      StartTransmitDMA();
+    }
+
+    /* Restart reception on error; in DMX512 mode a break ends each packet,
+     * in Modbus mode the receiver timeout each frame */
+    if (dmx_callback != NULL) {
+      ReceiveDmxBreak();
+    } else if (modbus_callback != NULL) {
+      ReceiveModbusFrame();
+    } else if (rx_block_callback != NULL) {
+      StartReceiveDMA();
+    } else {
+      HAL_UART_Receive_IT(&huart1, rx_buffer, 1);
+    }
   }
 }
@@ -0,0 +1,309 @@
+/**
+  ******************************************************************************
+  * @file    val_spi_slave.c
+  * @brief   Vendor Abstraction Layer for the SPI slave host link
+  ******************************************************************************
+  * @attention
+  *
+  * A board embedded next to a host MCU can take its commands over SPI1 as
+  * a slave, described by the board profile (val_board.h). Without such a
+  * profile none of this module is built.
+  *
+  * The host frames each transaction with NSS. SPI1 runs in mode 0 with
+  * 8-bit frames and hardware NSS, and moves every byte by DMA both ways:
+  * DMA2 channel 3 writes what the host sends into the receive buffer,
+  * DMA2 channel 4 feeds the reply prepared for this transaction, so no
+  * interrupt is taken per byte. The rising edge of NSS, on its EXTI line,
+  * ends the transaction: the received length is read from the DMA
+  * counter, SPI1 is reset to drop what its transmit FIFO preloaded, and
+  * the callback gets the bytes and writes the reply the next transaction
+  * clocks out. Both channels are then armed again.
+  *
+  * That turnaround takes a few microseconds and is the only CPU time per
+  * transaction; the host leaves at least that long between raising NSS and
+  * lowering it again (VAL_SpiSlave_GetMaxTurnaroundUs reports the longest
+  * seen). A transaction longer than VAL_SPI_SLAVE_FRAME_MAX overruns the
+  * receive buffer and is handed on as lost, with the bytes that fit.
+  *
+  * SPI1 clocks from the host, so the core clock only bounds its rate: a
+  * slave follows at most half of PCLK2. The IRQ output asks the host for
+  * a transaction, low while asserted.
+  *
+  * SPI1 serves the external ADC instead on profiles that have one.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_spi_slave.h"
+
+#if VAL_SPI_SLAVE_ENABLED
+
+#include "val_sys_clock.h"
+#include "val_irq_priority.h"
+#include "val_ext_adc.h"
+#include "stm32l4xx_hal.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SLAVE_SPI               SPI1
+#define SLAVE_RX_DMA            DMA2_Channel3  /* SPI1_RX, request 4 */
+#define SLAVE_TX_DMA            DMA2_Channel4  /* SPI1_TX, request 4 */
+#define SLAVE_DMA_REQUEST       4U
+#define SLAVE_DRAIN_TIMEOUT     100U           /* Polls of the receive FIFO, one byte takes far fewer */
+
+#define SLAVE_NSS_LINE          VAL_BOARD_PIN_MASK(VAL_BOARD_SPI_SLAVE_NSS)
+#define SLAVE_NSS_EXTI          (VAL_BOARD_SPI_SLAVE_NSS & 15)
+#define SLAVE_NSS_IRQn          ((SLAVE_NSS_EXTI == 4) ? EXTI4_IRQn : EXTI0_IRQn)
+#define SLAVE_PINS_ON_A         (VAL_BOARD_PA_MASK(VAL_BOARD_SPI_SLAVE_SCK) | VAL_BOARD_PA_MASK(VAL_BOARD_SPI_SLAVE_MISO) | \
+                                 VAL_BOARD_PA_MASK(VAL_BOARD_SPI_SLAVE_MOSI) | VAL_BOARD_PA_MASK(VAL_BOARD_SPI_SLAVE_NSS) | \
+                                 VAL_BOARD_PA_MASK(VAL_BOARD_SPI_SLAVE_IRQ))
+
+/* SPI1 (AF5) reaches these pins only */
+_Static_assert(VAL_BOARD_SPI_SLAVE_SCK == VAL_BOARD_PA(1) || VAL_BOARD_SPI_SLAVE_SCK == VAL_BOARD_PA(5) ||
+               VAL_BOARD_SPI_SLAVE_SCK == VAL_BOARD_PB(3), "SPI1 SCK is PA1, PA5 or PB3");
+_Static_assert(VAL_BOARD_SPI_SLAVE_MISO == VAL_BOARD_PA(6) || VAL_BOARD_SPI_SLAVE_MISO == VAL_BOARD_PA(11) ||
+               VAL_BOARD_SPI_SLAVE_MISO == VAL_BOARD_PB(4), "SPI1 MISO is PA6, PA11 or PB4");
+_Static_assert(VAL_BOARD_SPI_SLAVE_MOSI == VAL_BOARD_PA(7) || VAL_BOARD_SPI_SLAVE_MOSI == VAL_BOARD_PA(12) ||
+               VAL_BOARD_SPI_SLAVE_MOSI == VAL_BOARD_PB(5), "SPI1 MOSI is PA7, PA12 or PB5");
+_Static_assert(VAL_BOARD_SPI_SLAVE_NSS == VAL_BOARD_PA(4) || VAL_BOARD_SPI_SLAVE_NSS == VAL_BOARD_PB(0),
+               "SPI slave NSS is PA4 or PB0, on an EXTI line of its own");
+_Static_assert((SLAVE_PINS_ON_A & (VAL_BOARD_ANALOG_PINS | VAL_BOARD_PWM_PINS)) == 0, "SPI slave pins taken by a light");
+_Static_assert(VAL_EXT_ADC_CHANNEL_COUNT == 0, "SPI1 serves either the external ADC or the SPI slave link");
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t rx_buffer[VAL_SPI_SLAVE_FRAME_MAX];
+static uint8_t reply_buffer[VAL_SPI_SLAVE_FRAME_MAX];
+static uint16_t reply_length = 0;
+static VAL_SpiSlave_Callback_t slave_callback = NULL;
+
+static volatile uint32_t last_tick = 0;
+static volatile uint32_t transactions = 0;
+static volatile uint32_t errors = 0;
+static volatile uint32_t max_turnaround_us = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void SpiSlave_Arm(void);
+static void SpiSlave_Disarm(void);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Set up the pins, clocks and the NSS line, and wait for the host
+  * @note   Until the first transaction ends, the host reads zeros
+  * @param  callback: Called from the NSS interrupt at the end of each transaction
+  * @retval VAL_Status: VAL_OK if started, VAL_PARAM if callback is NULL
+  */
+VAL_Status VAL_SpiSlave_Init(VAL_SpiSlave_Callback_t callback) {
+  GPIO_InitTypeDef gpio = {0};
+  static const uint8_t pins[] = {
+    VAL_BOARD_SPI_SLAVE_SCK, VAL_BOARD_SPI_SLAVE_MISO, VAL_BOARD_SPI_SLAVE_MOSI, VAL_BOARD_SPI_SLAVE_NSS
+  };
+
+  if (callback == NULL) {
+    return VAL_PARAM;
+  }
+
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  __HAL_RCC_GPIOB_CLK_ENABLE();
+  __HAL_RCC_DMA2_CLK_ENABLE();
+  __HAL_RCC_SPI1_CLK_ENABLE();
+  __HAL_RCC_SYSCFG_CLK_ENABLE();
+
+  slave_callback = callback;
+  reply_length = 0;
+  memset(reply_buffer, 0, sizeof(reply_buffer));
+
+  gpio.Mode = GPIO_MODE_AF_PP;
+  gpio.Pull = GPIO_NOPULL;
+  gpio.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+  gpio.Alternate = GPIO_AF5_SPI1;
+  for (uint8_t i = 0; i < sizeof(pins); i++) {
+    gpio.Pin = VAL_BOARD_PIN_MASK(pins[i]);
+    HAL_GPIO_Init(VAL_BOARD_PIN_PORT(pins[i]), &gpio);
+  }
+
+  /* Released until there is something for the host */
+  HAL_GPIO_WritePin(VAL_BOARD_PIN_PORT(VAL_BOARD_SPI_SLAVE_IRQ), VAL_BOARD_PIN_MASK(VAL_BOARD_SPI_SLAVE_IRQ),
+                    GPIO_PIN_SET);
+  gpio.Mode = GPIO_MODE_OUTPUT_PP;
+  gpio.Speed = GPIO_SPEED_FREQ_LOW;
+  gpio.Alternate = 0;
+  gpio.Pin = VAL_BOARD_PIN_MASK(VAL_BOARD_SPI_SLAVE_IRQ);
+  HAL_GPIO_Init(VAL_BOARD_PIN_PORT(VAL_BOARD_SPI_SLAVE_IRQ), &gpio);
+
+  /* The NSS pin stays in its alternate function; EXTI still sees its level */
+  MODIFY_REG(SYSCFG->EXTICR[SLAVE_NSS_EXTI >> 2], 0x7U << ((SLAVE_NSS_EXTI & 3U) * 4U),
+             ((VAL_BOARD_SPI_SLAVE_NSS < 16) ? 0U : 1U) << ((SLAVE_NSS_EXTI & 3U) * 4U));
+  EXTI->FTSR1 &= ~SLAVE_NSS_LINE;
+  EXTI->RTSR1 |= SLAVE_NSS_LINE;
+  EXTI->PR1 = SLAVE_NSS_LINE;
+  EXTI->IMR1 |= SLAVE_NSS_LINE;
+
+  MODIFY_REG(DMA2_CSELR->CSELR, DMA_CSELR_C3S | DMA_CSELR_C4S,
+             (SLAVE_DMA_REQUEST << DMA_CSELR_C3S_Pos) | (SLAVE_DMA_REQUEST << DMA_CSELR_C4S_Pos));
+  SpiSlave_Arm();
+
+  HAL_NVIC_SetPriority(SLAVE_NSS_IRQn, VAL_IRQ_PRIORITY_COMMS, 0);
+  HAL_NVIC_EnableIRQ(SLAVE_NSS_IRQn);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Assert or release the IRQ output to the host
+  * @note   Safe to call from tasks and interrupts
+  * @param  asserted: true to drive it low
+  * @retval None
+  */
+void VAL_SpiSlave_SetIrq(bool asserted) {
+  GPIO_TypeDef* port = VAL_BOARD_PIN_PORT(VAL_BOARD_SPI_SLAVE_IRQ);
+
+  if (asserted) {
+    port->BRR = VAL_BOARD_PIN_MASK(VAL_BOARD_SPI_SLAVE_IRQ);
+  } else {
+    port->BSRR = VAL_BOARD_PIN_MASK(VAL_BOARD_SPI_SLAVE_IRQ);
+  }
+}
+
+/**
+  * @brief  Get the time since the last transaction ended
+  * @retval uint32_t: Milliseconds
+  */
+uint32_t VAL_SpiSlave_GetIdleTime(void) {
+  return HAL_GetTick() - last_tick;
+}
+
+/**
+  * @brief  Get the number of transactions since start-up
+  * @retval uint32_t: Transactions, lost ones included
+  */
+uint32_t VAL_SpiSlave_GetTransactionCount(void) {
+  return transactions;
+}
+
+/**
+  * @brief  Get the number of transactions lost to an overrun
+  * @retval uint32_t: Error count
+  */
+uint32_t VAL_SpiSlave_GetErrorCount(void) {
+  return errors;
+}
+
+/**
+  * @brief  Get the longest time from NSS rising to the next reply being ready
+  * @retval uint32_t: Microseconds
+  */
+uint32_t VAL_SpiSlave_GetMaxTurnaroundUs(void) {
+  return max_turnaround_us;
+}
+
+/**
+  * @brief  NSS rising edge interrupt: end the transaction and arm the next
+  * @retval None
+  */
+void VAL_SpiSlave_IRQHandler(void) {
+  uint32_t start = VAL_SysClock_GetMicros();
+  uint16_t length;
+  uint16_t next_length;
+  bool lost;
+
+  EXTI->PR1 = SLAVE_NSS_LINE;
+
+  /* The last byte may still be on its way to memory */
+  for (uint32_t polls = 0; polls < SLAVE_DRAIN_TIMEOUT && (SLAVE_SPI->SR & SPI_SR_FRLVL) != 0U; polls++) {
+  }
+
+  length = (uint16_t)(VAL_SPI_SLAVE_FRAME_MAX - SLAVE_RX_DMA->CNDTR);
+  lost = (SLAVE_SPI->SR & SPI_SR_OVR) != 0U;
+  SpiSlave_Disarm();
+
+  transactions++;
+  last_tick = HAL_GetTick();
+  if (lost) {
+    errors++;
+  }
+
+  next_length = slave_callback(rx_buffer, length, lost, reply_buffer, VAL_SPI_SLAVE_FRAME_MAX);
+  if (next_length > VAL_SPI_SLAVE_FRAME_MAX) {
+    next_length = VAL_SPI_SLAVE_FRAME_MAX;
+  }
+
+  /* Zeros past the reply, the rest of the buffer already is */
+  if (next_length < reply_length) {
+    memset(&reply_buffer[next_length], 0, reply_length - next_length);
+  }
+  reply_length = next_length;
+
+  SpiSlave_Arm();
+
+  uint32_t elapsed = VAL_SysClock_GetMicros() - start;
+  if (elapsed > max_turnaround_us) {
+    max_turnaround_us = elapsed;
+  }
+}
+
+/**
+  * @brief  Stop the link and release the pins and clocks
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_SpiSlave_DeInit(void) {
+  static const uint8_t pins[] = {
+    VAL_BOARD_SPI_SLAVE_SCK, VAL_BOARD_SPI_SLAVE_MISO, VAL_BOARD_SPI_SLAVE_MOSI, VAL_BOARD_SPI_SLAVE_NSS,
+    VAL_BOARD_SPI_SLAVE_IRQ
+  };
+
+  HAL_NVIC_DisableIRQ(SLAVE_NSS_IRQn);
+  EXTI->IMR1 &= ~SLAVE_NSS_LINE;
+  EXTI->RTSR1 &= ~SLAVE_NSS_LINE;
+  SpiSlave_Disarm();
+  for (uint8_t i = 0; i < sizeof(pins); i++) {
+    HAL_GPIO_DeInit(VAL_BOARD_PIN_PORT(pins[i]), VAL_BOARD_PIN_MASK(pins[i]));
+  }
+  __HAL_RCC_SPI1_CLK_DISABLE();
+  slave_callback = NULL;
+
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Arm both DMA channels and enable SPI1 for the next transaction
+  * @note   In the order the reference manual gives: receive DMA, channels,
+  *         transmit DMA, then SPE
+  * @retval None
+  */
+static void SpiSlave_Arm(void) {
+  SLAVE_SPI->CR1 = 0;
+  SLAVE_SPI->CR2 = (7U << SPI_CR2_DS_Pos) | SPI_CR2_FRXTH | SPI_CR2_RXDMAEN;
+
+  DMA2->IFCR = DMA_IFCR_CGIF3 | DMA_IFCR_CGIF4;
+  SLAVE_RX_DMA->CPAR = (uint32_t)&SLAVE_SPI->DR;
+  SLAVE_RX_DMA->CMAR = (uint32_t)rx_buffer;
+  SLAVE_RX_DMA->CNDTR = VAL_SPI_SLAVE_FRAME_MAX;
+  SLAVE_RX_DMA->CCR = DMA_CCR_PL_1 | DMA_CCR_MINC | DMA_CCR_EN;
+
+  SLAVE_TX_DMA->CPAR = (uint32_t)&SLAVE_SPI->DR;
+  SLAVE_TX_DMA->CMAR = (uint32_t)reply_buffer;
+  SLAVE_TX_DMA->CNDTR = VAL_SPI_SLAVE_FRAME_MAX;
+  SLAVE_TX_DMA->CCR = DMA_CCR_PL_1 | DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_EN;
+
+  SLAVE_SPI->CR2 |= SPI_CR2_TXDMAEN;
+  SLAVE_SPI->CR1 = SPI_CR1_SPE;
+}
+
+/**
+  * @brief  Stop both DMA channels and reset SPI1
+  * @note   The reset is the only way to empty the transmit FIFO
+  * @retval None
+  */
+static void SpiSlave_Disarm(void) {
+  SLAVE_RX_DMA->CCR = 0;
+  SLAVE_TX_DMA->CCR = 0;
+  SLAVE_SPI->CR1 = 0;
+  __HAL_RCC_SPI1_FORCE_RESET();
+  __HAL_RCC_SPI1_RELEASE_RESET();
+}
+
+#endif /* VAL_SPI_SLAVE_ENABLED */
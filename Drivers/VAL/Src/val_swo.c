@@ -0,0 +1,147 @@
+/**
+  ******************************************************************************
+  * @file    val_swo.c
+  * @brief   Vendor Abstraction Layer for the ITM stimulus ports over SWO
+  ******************************************************************************
+  * @attention
+  *
+  * Diagnostics leave the MCU on the SWO pin (PB3, TRACESWO) through the
+  * Cortex-M4 ITM, so USART1 carries the protocol only. The debugger sets
+  * up the SWO bit rate, the TPIU and which stimulus ports are enabled,
+  * e.g. in the SWV settings of STM32CubeIDE; the firmware only hands PB3
+  * to the trace output when a debugger is attached at start-up.
+  *
+  * Without a debugger the ITM is disabled and VAL_SWO_IsPortEnabled is a
+  * few register reads, so callers check it first and skip the encoding.
+  * A write waits for the one-word stimulus FIFO, at most SWO_WORD_TIMEOUT_US
+  * per word, and so must not be used from interrupts.
+  *
+  * PB3 is also the LD3 line and the RS-485 driver enable; the board LED
+  * does not light while SWO runs, and an RS-485 bus takes the pin back.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_swo.h"
+#include "val_sys_clock.h"
+#include "stm32l4xx_hal.h"
+#include "main.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SWO_PORT             LD3_GPIO_Port
+#define SWO_PIN              LD3_Pin         /* PB3, TRACESWO on AF0 */
+#define SWO_WORD_TIMEOUT_US  1000U           /* A word takes 16 us at 2 Mbit/s */
+
+/* Private function prototypes -----------------------------------------------*/
+static VAL_Status SWO_WaitReady(uint8_t port);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Route the trace output to the SWO pin if a debugger is attached
+  * @note   Call after VAL_Pins_Init, which makes PB3 the LD3 output
+  * @retval None
+  */
+void VAL_SWO_Init(void) {
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  if (!VAL_SWO_IsDebuggerAttached()) {
+    return;
+  }
+
+  /* Asynchronous trace, the debugger programs the TPIU for it */
+  DBGMCU->CR = (DBGMCU->CR & ~DBGMCU_CR_TRACE_MODE) | DBGMCU_CR_TRACE_IOEN;
+
+  GPIO_InitStruct.Pin = SWO_PIN;
+  GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+  GPIO_InitStruct.Alternate = GPIO_AF0_SWJ;
+  HAL_GPIO_Init(SWO_PORT, &GPIO_InitStruct);
+}
+
+/**
+  * @brief  Check whether a debugger is attached
+  * @retval bool: true while the debug port is enabled
+  */
+bool VAL_SWO_IsDebuggerAttached(void) {
+  return (CoreDebug->DHCSR & CoreDebug_DHCSR_C_DEBUGEN_Msk) != 0U;
+}
+
+/**
+  * @brief  Check whether a stimulus port is enabled by the debugger
+  * @note   Cheap enough to call before every message
+  * @param  port: Stimulus port (0-31)
+  * @retval bool: true if data written to the port is sent
+  */
+bool VAL_SWO_IsPortEnabled(uint8_t port) {
+  if (port >= VAL_SWO_PORT_COUNT || !VAL_SWO_IsDebuggerAttached()) {
+    return false;
+  }
+
+  return (ITM->TCR & ITM_TCR_ITMENA_Msk) != 0U && (ITM->TER & (1UL << port)) != 0U;
+}
+
+/**
+  * @brief  Send a block of bytes on a stimulus port
+  * @note   Task context only. Little-endian words, then the remaining
+  *         bytes one by one; the host sees the bytes in order.
+  * @param  port: Stimulus port (0-31)
+  * @param  data: Bytes to send
+  * @param  length: Number of bytes
+  * @retval VAL_Status: VAL_OK if sent, VAL_PARAM for invalid arguments,
+  *         VAL_ERROR if the port is not enabled, VAL_TIMEOUT if the port
+  *         stopped taking data part way
+  */
+VAL_Status VAL_SWO_Write(uint8_t port, const void* data, uint16_t length) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  uint16_t pos = 0;
+  uint32_t word;
+
+  if (port >= VAL_SWO_PORT_COUNT || (data == NULL && length != 0)) {
+    return VAL_PARAM;
+  }
+
+  if (!VAL_SWO_IsPortEnabled(port)) {
+    return VAL_ERROR;
+  }
+
+  while (pos + 4U <= length) {
+    if (SWO_WaitReady(port) != VAL_OK) {
+      return VAL_TIMEOUT;
+    }
+    word = (uint32_t)bytes[pos] | ((uint32_t)bytes[pos + 1] << 8) |
+           ((uint32_t)bytes[pos + 2] << 16) | ((uint32_t)bytes[pos + 3] << 24);
+    ITM->PORT[port].u32 = word;
+    pos += 4U;
+  }
+
+  while (pos < length) {
+    if (SWO_WaitReady(port) != VAL_OK) {
+      return VAL_TIMEOUT;
+    }
+    ITM->PORT[port].u8 = bytes[pos++];
+  }
+
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Wait until a stimulus port takes the next write
+  * @param  port: Stimulus port (0-31)
+  * @retval VAL_Status: VAL_OK if ready, VAL_TIMEOUT otherwise
+  */
+static VAL_Status SWO_WaitReady(uint8_t port) {
+  uint32_t start = VAL_SysClock_GetMicros();
+
+  while (ITM->PORT[port].u32 == 0U) {
+    if ((VAL_SysClock_GetMicros() - start) >= SWO_WORD_TIMEOUT_US) {
+      return VAL_TIMEOUT;
+    }
+  }
+
+  return VAL_OK;
+}
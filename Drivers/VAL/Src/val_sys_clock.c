@@ -8,12 +8,76 @@
   * This module provides a hardware-independent interface for system clock
   * configuration used by the Wiseled_LBR system.
   *
+  * High resolution time comes from the DWT cycle counter, which runs at the
+  * core clock independently of the SysTick and TIM7 tick sources. The
+  * elapsed cycles are folded into a 64-bit microsecond count on every read
+  * and at least once per HAL tick from the TIM7 interrupt, well within the
+  * 2^32 cycle wrap, so the count never goes backwards and does not drift
+  * against the cycle counter. Time spent in stop mode, when the cycle
+  * counter halts, is added from the wake-up timer. The 32-bit read is the
+  * low word of the same count and wraps after about 71 minutes.
+  *
+  * The core clock can be switched between three levels at runtime with
+  * VAL_SysClock_SetLevel. The PLL runs at 64 MHz for the high level and is
+  * divided by 2 in the AHB prescaler for the nominal 32 MHz, so moving
+  * between the two never waits for the PLL to lock. The low level runs
+  * from the 4 MHz MSI with the PLL off. The MSI stays at range 6
+  * throughout, as it also feeds PLLSAI1 and so the ADC clock, which does
+  * not change. The regulator stays in range 1, which PLLSAI1 needs.
+  *
+  * The peripherals clocked from the buses follow each change: the SysTick
+  * reload and the TIM7 (HAL tick), TIM1 (PWM), TIM6 (ADC trigger) and TIM2
+  * (cue timer) prescalers, the USART1 divider, and on boards with them
+  * the external ADC frames and the I2C sensor bus timing. The timers keep
+  * their count rates, except TIM1 at the low level (see val_pwm.c). Preloaded
+  * prescalers take effect on the next update, so the tick, PWM period and
+  * scan in progress end early or late once. A change is refused while the
+  * UART is sending or receiving, or while the PWM is strobing or holds a
+  * latch, as these could not follow without a glitch.
+  *
+  * Microseconds and cycle intervals are converted at the clock in use, so
+  * an interval measured across a change is scaled by the later clock.
+  *
   ******************************************************************************
   */
 
 /* Includes ------------------------------------------------------------------*/
 #include "val_sys_clock.h"
 #include "rcc.h"
+#include "val_analog.h"
+#include "val_ext_adc.h"
+#include "val_i2c_temp.h"
+#include "val_pwm.h"
+#include "val_serial_comms.h"
+#include "val_timers.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TICK_TIMER_HZ 1000000U  /* TIM7 count rate, as set by HAL_InitTick */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint32_t hclk_hz;
+  uint32_t ahb_divider;   /* RCC_SYSCLK_DIVx */
+  uint32_t flash_latency; /* Wait states in voltage range 1 */
+} SysClock_LevelConfig_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const SysClock_LevelConfig_t level_configs[VAL_SYSCLOCK_LEVEL_COUNT] = {
+  {4000000U,  RCC_SYSCLK_DIV1, FLASH_LATENCY_0},  /* MSI */
+  {32000000U, RCC_SYSCLK_DIV2, FLASH_LATENCY_1},  /* PLL / 2, as set by SystemClock_Config */
+  {64000000U, RCC_SYSCLK_DIV1, FLASH_LATENCY_3},  /* PLL */
+};
+
+static volatile VAL_SysClock_Level_t clock_level = VAL_SYSCLOCK_LEVEL_NOMINAL;
+static uint32_t micros_last_cycles = 0;
+static uint32_t micros_remainder = 0;  /* Cycles not yet counted as a full microsecond */
+static uint64_t micros_total = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void EnableCycleCounter(void);
+static VAL_Status CheckPeripherals(uint32_t hclk_hz);
+static void SetFlashLatency(uint32_t latency);
+static void UpdateTickSources(uint32_t old_hclk_hz);
 
 /* Public functions ----------------------------------------------------------*/
 
@@ -24,6 +88,9 @@
 VAL_Status VAL_SysClock_Init(void) {
   /* Configure the system clock */
   SystemClock_Config();
+
+  /* Start the cycle counter used for microsecond timing and profiling */
+  EnableCycleCounter();
   
   return VAL_OK;
 }
@@ -56,19 +123,228 @@ uint32_t VAL_SysClock_GetFrequency(void) {
 
 /**
   * @brief  Get current time in microseconds
-  * @retval uint32_t: Current time in microseconds
+  * @note   Safe to call from interrupts; wraps after about 71 minutes
+  * @retval uint32_t: Microseconds since start-up, low word
   */
 uint32_t VAL_SysClock_GetMicros(void) {
-  /* Get the current tick count */
-  uint32_t tick = HAL_GetTick();
-  
-  /* Get the SysTick counter value */
-  uint32_t count = SysTick->VAL;
-  
-  /* Calculate microseconds from tick and counter */
-  uint32_t subtick = ((SysTick->LOAD - count) * 1000) / SysTick->LOAD;
-  
-  return (tick * 1000) + subtick;
+  return (uint32_t)VAL_SysClock_GetMicros64();
+}
+
+/**
+  * @brief  Get current time in microseconds, without wrapping
+  * @note   Safe to call from interrupts
+  * @retval uint64_t: Microseconds since start-up
+  */
+uint64_t VAL_SysClock_GetMicros64(void) {
+  uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+  uint32_t primask = __get_PRIMASK();
+  uint64_t result;
+
+  __disable_irq();
+
+  /* Accumulate elapsed cycles; the TIM7 tick keeps reads less than one
+   * counter wrap (2^32 cycles, 67 s at 64 MHz) apart */
+  uint32_t now = DWT->CYCCNT;
+  uint32_t elapsed = (now - micros_last_cycles) + micros_remainder;
+  micros_last_cycles = now;
+  micros_total += elapsed / cycles_per_us;
+  micros_remainder = elapsed % cycles_per_us;
+  result = micros_total;
+
+  __set_PRIMASK(primask);
+
+  return result;
+}
+
+/**
+  * @brief  Get the raw core cycle counter
+  * @note   Wraps every 2^32 cycles; use unsigned subtraction for intervals
+  * @retval uint32_t: Current DWT cycle count
+  */
+uint32_t VAL_SysClock_GetCycles(void) {
+  return DWT->CYCCNT;
+}
+
+/**
+  * @brief  Convert a cycle interval to microseconds
+  * @param  cycles: Number of core clock cycles
+  * @retval uint32_t: Duration in microseconds
+  */
+uint32_t VAL_SysClock_CyclesToMicros(uint32_t cycles) {
+  return cycles / (SystemCoreClock / 1000000U);
+}
+
+/**
+  * @brief  Account for time the core clock was stopped
+  * @note   The cycle counter and the HAL tick do not run in stop mode
+  * @param  ms: Time spent stopped, in milliseconds
+  * @retval None
+  */
+void VAL_SysClock_AdvanceTime(uint32_t ms) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  micros_total += (uint64_t)ms * 1000U;
+  uwTick += ms;
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Switch the core clock to another level
+  * @note   Only once the drivers are initialized, from task context. The
+  *         PLL is started with interrupts enabled; the switch itself runs
+  *         with interrupts disabled for a few microseconds.
+  * @param  level: Clock level to run at
+  * @retval VAL_Status: VAL_OK if running at the level, VAL_PARAM if the
+  *         level is invalid or the baud rate cannot be generated at it,
+  *         VAL_BUSY if a peripheral cannot follow now; try again later
+  */
+VAL_Status VAL_SysClock_SetLevel(VAL_SysClock_Level_t level) {
+  const SysClock_LevelConfig_t* config;
+  uint32_t old_hclk_hz;
+  uint32_t primask;
+  VAL_Status status;
+
+  if (level >= VAL_SYSCLOCK_LEVEL_COUNT) {
+    return VAL_PARAM;
+  }
+
+  if (level == clock_level) {
+    return VAL_OK;
+  }
+
+  config = &level_configs[level];
+
+  /* The PLL takes up to 40 us to lock, not worth holding interrupts off for */
+  if (level != VAL_SYSCLOCK_LEVEL_LOW && __HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY) == 0U) {
+    __HAL_RCC_PLL_ENABLE();
+    while (__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY) == 0U) {
+    }
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  status = CheckPeripherals(config->hclk_hz);
+  if (status != VAL_OK) {
+    __set_PRIMASK(primask);
+    if (clock_level == VAL_SYSCLOCK_LEVEL_LOW) {
+      __HAL_RCC_PLL_DISABLE();
+    }
+    return status;
+  }
+
+  /* Count the cycles so far at the clock they ran at */
+  (void)VAL_SysClock_GetMicros();
+  old_hclk_hz = SystemCoreClock;
+
+  /* More wait states before speeding up, fewer only after slowing down */
+  if (config->hclk_hz > old_hclk_hz) {
+    SetFlashLatency(config->flash_latency);
+  }
+
+  /* Never above the target on the way: the source and the divider change
+   * in the order that passes through a lower clock */
+  if (level == VAL_SYSCLOCK_LEVEL_LOW) {
+    __HAL_RCC_SYSCLK_CONFIG(RCC_SYSCLKSOURCE_MSI);
+    while (__HAL_RCC_GET_SYSCLK_SOURCE() != RCC_SYSCLKSOURCE_STATUS_MSI) {
+    }
+    MODIFY_REG(RCC->CFGR, RCC_CFGR_HPRE, config->ahb_divider);
+  } else {
+    MODIFY_REG(RCC->CFGR, RCC_CFGR_HPRE, config->ahb_divider);
+    __HAL_RCC_SYSCLK_CONFIG(RCC_SYSCLKSOURCE_PLLCLK);
+    while (__HAL_RCC_GET_SYSCLK_SOURCE() != RCC_SYSCLKSOURCE_STATUS_PLLCLK) {
+    }
+  }
+  SystemCoreClockUpdate();
+
+  if (config->hclk_hz < old_hclk_hz) {
+    SetFlashLatency(config->flash_latency);
+  }
+
+  UpdateTickSources(old_hclk_hz);
+  VAL_PWM_UpdateClock();
+  VAL_Analog_UpdateClock();
+#if VAL_EXT_ADC_CHANNEL_COUNT > 0
+  VAL_ExtAdc_UpdateClock();
+#endif
+#if VAL_I2C_TEMP_ENABLED
+  VAL_I2CTemp_UpdateClock();
+#endif
+  VAL_Timers_UpdateClock();
+  VAL_Serial_UpdateClock();
+  clock_level = level;
+
+  __set_PRIMASK(primask);
+
+  if (level == VAL_SYSCLOCK_LEVEL_LOW) {
+    __HAL_RCC_PLL_DISABLE();
+  }
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the core clock level
+  * @retval VAL_SysClock_Level_t: Level in use
+  */
+VAL_SysClock_Level_t VAL_SysClock_GetLevel(void) {
+  return clock_level;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Check whether the peripherals can follow a clock change now
+  * @note   Called with interrupts disabled
+  * @param  hclk_hz: Core clock to change to; the APB clocks are undivided
+  * @retval VAL_Status: VAL_OK if they can, VAL_PARAM or VAL_BUSY otherwise
+  */
+static VAL_Status CheckPeripherals(uint32_t hclk_hz) {
+  /* The strobe pulse is timed in TIM1 counts, a held latch blocks the
+   * update that loads the prescaler */
+  if (VAL_PWM_IsStrobeActive() || VAL_PWM_IsLatchArmed()) {
+    return VAL_BUSY;
+  }
+
+  return VAL_Serial_CheckClock(hclk_hz);
+}
+
+/**
+  * @brief  Set the flash wait states and wait until they apply
+  * @param  latency: FLASH_LATENCY_x
+  * @retval None
+  */
+static void SetFlashLatency(uint32_t latency) {
+  __HAL_FLASH_SET_LATENCY(latency);
+  while (__HAL_FLASH_GET_LATENCY() != latency) {
+  }
+}
+
+/**
+  * @brief  Keep the tick sources at their rates after a clock change
+  * @note   The SysTick counts core cycles; TIM7 runs from the APB1 timer
+  *         clock, undivided as PCLK1 equals HCLK
+  * @param  old_hclk_hz: Core clock before the change
+  * @retval None
+  */
+static void UpdateTickSources(uint32_t old_hclk_hz) {
+  SysTick->LOAD = ((SysTick->LOAD + 1U) / (old_hclk_hz / 1000U)) * (SystemCoreClock / 1000U) - 1U;
+  TIM7->PSC = HAL_RCC_GetPCLK1Freq() / TICK_TIMER_HZ - 1U;
+}
+
+/**
+  * @brief  Enable the DWT cycle counter
+  * @retval None
+  */
+static void EnableCycleCounter(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  micros_last_cycles = 0;
+  micros_remainder = 0;
+  micros_total = 0;
 }
 
 /**
@@ -8,12 +8,62 @@
   * This module provides a hardware-independent interface for timers
   * used by the Wiseled_LBR system.
   *
+  * The cue timer is TIM2, a 32-bit counter at 1 MHz started from 0. One
+  * compare channel raises a one-shot alarm at an absolute count, so a
+  * sequence of alarms scheduled from the start time does not accumulate
+  * interrupt latency. The counter wraps after about 71 minutes. When the
+  * system clock changes, VAL_Timers_UpdateClock sets the prescaler for the
+  * new clock and keeps the count, so the absolute alarm times still hold.
+  *
   ******************************************************************************
   */
 
 /* Includes ------------------------------------------------------------------*/
 #include "val_timers.h"
 #include "tim.h"
+#include "val_sys_clock.h"
+#include "val_irq_priority.h"
+#ifdef BENCHMARK
+#include "val_pwm.h"
+#include "val_board.h"
+#endif
+
+/* Private define ------------------------------------------------------------*/
+#define CUE_TIMER             TIM2
+#define CUE_TIMER_IRQn        TIM2_IRQn
+#define CUE_TIMER_HZ          1000000U
+/* Same level as the ADC block and fade interrupts, so the alarm callback
+ * and the LED driver code they run never preempt each other */
+#define CUE_TIMER_PRIORITY    VAL_IRQ_PRIORITY_SAMPLING
+
+#ifdef BENCHMARK
+/* Latency probe, on the timer clock; TIM1 break, which shares the vector,
+ * is not used */
+#define LATENCY_TIMER         TIM15
+#define LATENCY_TIMER_IRQn    TIM1_BRK_TIM15_IRQn
+#define LATENCY_INTERVAL_MIN  8000U    /* Counts to the next probe, 250 us at 32 MHz */
+#define LATENCY_INTERVAL_MASK 0x3FFFU  /* Plus up to this many, so the probe does not lock to a period */
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+static volatile VAL_Timers_Callback cue_callback = NULL;
+
+#ifdef BENCHMARK
+static const uint8_t latency_priorities[VAL_IRQ_LEVEL_COUNT] = {
+  VAL_IRQ_PRIORITY_SAFETY, VAL_IRQ_PRIORITY_SAMPLING, VAL_IRQ_PRIORITY_COMMS
+};
+static volatile uint32_t latency_count[VAL_IRQ_LEVEL_COUNT];
+static volatile uint32_t latency_min_cycles[VAL_IRQ_LEVEL_COUNT];
+static volatile uint32_t latency_max_cycles[VAL_IRQ_LEVEL_COUNT];
+static uint8_t latency_level = 0;     /* Level of the next probe interrupt */
+static uint32_t latency_seed = 1U;    /* Spreads the probe intervals */
+#endif
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t GetTimerClock(void);
+#ifdef BENCHMARK
+static uint32_t GetLatencyClock(void);
+#endif
 
 /* Public functions ----------------------------------------------------------*/
 
@@ -38,6 +88,270 @@ VAL_Status VAL_Timers_DeInit(void) {
   return VAL_OK;
 }
 
+/**
+  * @brief  Start the cue timer counting from 0
+  * @note   Restarts the count if already running; no alarm is set
+  * @param  callback: Called from the timer interrupt when the alarm fires
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if callback is NULL,
+  *         VAL_ERROR if the timer clock is not a whole number of MHz
+  */
+VAL_Status VAL_Timers_StartCueTimer(VAL_Timers_Callback callback) {
+  uint32_t clock_hz = GetTimerClock();
+
+  if (callback == NULL) {
+    return VAL_PARAM;
+  }
+
+  if (clock_hz < CUE_TIMER_HZ || (clock_hz % CUE_TIMER_HZ) != 0U) {
+    return VAL_ERROR;
+  }
+
+  VAL_Timers_StopCueTimer();
+  cue_callback = callback;
+
+  __HAL_RCC_TIM2_CLK_ENABLE();
+  CUE_TIMER->PSC = clock_hz / CUE_TIMER_HZ - 1U;
+  CUE_TIMER->ARR = 0xFFFFFFFFU;
+  CUE_TIMER->CCMR1 = 0;                 /* Channel 1 compares only, no pin */
+  CUE_TIMER->EGR = TIM_EGR_UG;          /* Load the prescaler, count from 0 */
+  CUE_TIMER->SR = 0;
+
+  HAL_NVIC_SetPriority(CUE_TIMER_IRQn, CUE_TIMER_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(CUE_TIMER_IRQn);
+  CUE_TIMER->CR1 = TIM_CR1_CEN;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Stop the cue timer and drop a pending alarm
+  * @retval None
+  */
+void VAL_Timers_StopCueTimer(void) {
+  if (!__HAL_RCC_TIM2_IS_CLK_ENABLED()) {
+    return;
+  }
+
+  CUE_TIMER->DIER = 0;
+  CUE_TIMER->CR1 = 0;
+  CUE_TIMER->SR = 0;
+  HAL_NVIC_ClearPendingIRQ(CUE_TIMER_IRQn);
+}
+
+/**
+  * @brief  Set the cue timer prescaler for the present system clock
+  * @note   Called by VAL_SysClock_SetLevel with interrupts disabled. The
+  *         prescaler only loads on an update event, which also clears the
+  *         count, so the count is written back; less than a microsecond is
+  *         lost per change.
+  * @retval None
+  */
+void VAL_Timers_UpdateClock(void) {
+  uint32_t count;
+
+  if (!__HAL_RCC_TIM2_IS_CLK_ENABLED() || (CUE_TIMER->CR1 & TIM_CR1_CEN) == 0U) {
+    return;
+  }
+
+  count = CUE_TIMER->CNT;
+  CUE_TIMER->PSC = GetTimerClock() / CUE_TIMER_HZ - 1U;
+  CUE_TIMER->EGR = TIM_EGR_UG;
+  CUE_TIMER->CNT = count;
+  CUE_TIMER->SR = ~(uint32_t)TIM_SR_UIF;
+}
+
+/**
+  * @brief  Get the cue timer count
+  * @retval uint32_t: Microseconds since VAL_Timers_StartCueTimer
+  */
+uint32_t VAL_Timers_GetCueTime(void) {
+  return CUE_TIMER->CNT;
+}
+
+/**
+  * @brief  Set the cue timer alarm, replacing the previous one
+  * @note   An alarm time already reached fires at once. Called from task and
+  *         interrupt context, including the alarm callback.
+  * @param  time_us: Cue timer count to fire at
+  * @retval None
+  */
+void VAL_Timers_SetCueAlarm(uint32_t time_us) {
+  /* Clear the flag before the compare value changes, so a match on the new
+   * value is never cleared */
+  CUE_TIMER->SR = ~(uint32_t)TIM_SR_CC1IF;
+  CUE_TIMER->CCR1 = time_us;
+  CUE_TIMER->DIER |= TIM_DIER_CC1IE;
+
+  /* A compare value the counter has passed only matches after a wrap */
+  if ((int32_t)(time_us - CUE_TIMER->CNT) <= 0) {
+    CUE_TIMER->EGR = TIM_EGR_CC1G;
+  }
+}
+
+/**
+  * @brief  Cue timer interrupt, fires the alarm once
+  * @retval None
+  */
+void VAL_Timers_CueIRQHandler(void) {
+  if ((CUE_TIMER->SR & TIM_SR_CC1IF) == 0U || (CUE_TIMER->DIER & TIM_DIER_CC1IE) == 0U) {
+    return;
+  }
+
+  CUE_TIMER->SR = ~(uint32_t)TIM_SR_CC1IF;
+  CUE_TIMER->DIER &= ~TIM_DIER_CC1IE;
+
+  if (cue_callback != NULL) {
+    cue_callback();
+  }
+}
+
+#ifdef BENCHMARK
+/**
+  * @brief  Start measuring the interrupt latency of each priority level
+  * @note   Benchmark builds only. TIM15 counts at the timer clock and
+  *         raises a compare interrupt every 250-760 us at 32 MHz, at the
+  *         safety, sampling and comms level in turn. The count the handler
+  *         reads on entry, less the compare value, is the time the
+  *         interrupt waited: for higher or equal levels and for critical
+  *         sections. Clears the figures.
+  * @retval VAL_Status: VAL_OK if successful, VAL_BUSY while a free-running
+  *         strobe uses TIM15 as its rate timer or if a light does
+  */
+VAL_Status VAL_Timers_StartLatencyProbe(void) {
+#if VAL_BOARD_USES_TIM15
+  return VAL_BUSY;
+#endif
+  if (VAL_PWM_IsStrobeFreeRunning()) {
+    return VAL_BUSY;
+  }
+
+  VAL_Timers_StopLatencyProbe();
+  VAL_Timers_ResetLatency();
+
+  __HAL_RCC_TIM15_CLK_ENABLE();
+  LATENCY_TIMER->PSC = 0;
+  LATENCY_TIMER->ARR = 0xFFFFU;
+  LATENCY_TIMER->CCMR1 = 0;             /* Channel 1 compares only, no pin */
+  LATENCY_TIMER->EGR = TIM_EGR_UG;
+  LATENCY_TIMER->CCR1 = LATENCY_INTERVAL_MIN;
+  LATENCY_TIMER->SR = 0;
+  LATENCY_TIMER->DIER = TIM_DIER_CC1IE;
+
+  latency_level = 0;
+  HAL_NVIC_SetPriority(LATENCY_TIMER_IRQn, latency_priorities[latency_level], 0);
+  HAL_NVIC_EnableIRQ(LATENCY_TIMER_IRQn);
+  LATENCY_TIMER->CR1 = TIM_CR1_CEN;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Stop the latency probe; the figures are kept
+  * @retval None
+  */
+void VAL_Timers_StopLatencyProbe(void) {
+  if (!VAL_Timers_IsLatencyProbeRunning()) {
+    return;
+  }
+
+  HAL_NVIC_DisableIRQ(LATENCY_TIMER_IRQn);
+  LATENCY_TIMER->DIER = 0;
+  LATENCY_TIMER->CR1 = 0;
+  LATENCY_TIMER->SR = 0;
+  HAL_NVIC_ClearPendingIRQ(LATENCY_TIMER_IRQn);
+}
+
+/**
+  * @brief  Check whether the latency probe runs
+  * @note   A free-running strobe runs TIM15 without its interrupt
+  * @retval bool: true if started
+  */
+bool VAL_Timers_IsLatencyProbeRunning(void) {
+  return __HAL_RCC_TIM15_IS_CLK_ENABLED() && (LATENCY_TIMER->CR1 & TIM_CR1_CEN) != 0U &&
+         (LATENCY_TIMER->DIER & TIM_DIER_CC1IE) != 0U;
+}
+
+/**
+  * @brief  Get the latency measured at one level
+  * @param  level: Interrupt level
+  * @param  latency: Pointer to store the figures
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+  */
+VAL_Status VAL_Timers_GetLatency(VAL_IrqLevel_t level, VAL_Timers_Latency_t* latency) {
+  uint32_t clock_hz = GetLatencyClock();
+  uint32_t count, min_cycles, max_cycles;
+  uint32_t primask;
+
+  if (latency == NULL || level >= VAL_IRQ_LEVEL_COUNT) {
+    return VAL_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  count = latency_count[level];
+  min_cycles = latency_min_cycles[level];
+  max_cycles = latency_max_cycles[level];
+  __set_PRIMASK(primask);
+
+  latency->count = count;
+  latency->min_ns = (count != 0U) ? (uint32_t)((uint64_t)min_cycles * 1000000000U / clock_hz) : 0U;
+  latency->max_ns = (uint32_t)((uint64_t)max_cycles * 1000000000U / clock_hz);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Clear the latency figures of all levels
+  * @retval None
+  */
+void VAL_Timers_ResetLatency(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  for (uint8_t i = 0; i < VAL_IRQ_LEVEL_COUNT; i++) {
+    latency_count[i] = 0;
+    latency_min_cycles[i] = UINT32_MAX;
+    latency_max_cycles[i] = 0;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Latency probe interrupt: record the wait, move on to the next level
+  * @note   The priority is changed for the next interrupt, after this one
+  *         has read the count
+  * @retval None
+  */
+void VAL_Timers_LatencyIRQHandler(void) {
+  uint16_t now = (uint16_t)LATENCY_TIMER->CNT;
+  uint16_t due = (uint16_t)LATENCY_TIMER->CCR1;
+  uint32_t cycles = (uint16_t)(now - due);
+  uint8_t level = latency_level;
+
+  if ((LATENCY_TIMER->SR & TIM_SR_CC1IF) == 0U) {
+    return;
+  }
+  LATENCY_TIMER->SR = ~(uint32_t)TIM_SR_CC1IF;
+
+  latency_count[level]++;
+  if (cycles < latency_min_cycles[level]) {
+    latency_min_cycles[level] = cycles;
+  }
+  if (cycles > latency_max_cycles[level]) {
+    latency_max_cycles[level] = cycles;
+  }
+
+  /* xorshift32 */
+  latency_seed ^= latency_seed << 13;
+  latency_seed ^= latency_seed >> 17;
+  latency_seed ^= latency_seed << 5;
+  LATENCY_TIMER->CCR1 = (uint16_t)(due + LATENCY_INTERVAL_MIN + (latency_seed & LATENCY_INTERVAL_MASK));
+
+  latency_level = (uint8_t)((level + 1U) % VAL_IRQ_LEVEL_COUNT);
+  HAL_NVIC_SetPriority(LATENCY_TIMER_IRQn, latency_priorities[latency_level], 0);
+}
+#endif
+
 /* Timer Callbacks ----------------------------------------------------------*/
 
 /**
@@ -56,8 +370,45 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
   if (htim->Instance == TIM7)
   {
     HAL_IncTick();
+
+    /* Fold the cycle counter into the microsecond count long before it wraps */
+    (void)VAL_SysClock_GetMicros64();
   }
   /* USER CODE BEGIN Callback 1 */
 
   /* USER CODE END Callback 1 */
 }
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Get the clock of the APB1 timers
+  * @retval uint32_t: Timer clock in Hz
+  */
+static uint32_t GetTimerClock(void) {
+  uint32_t clock_hz = HAL_RCC_GetPCLK1Freq();
+
+  /* APB1 timers run at twice PCLK1 when it is divided */
+  if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) {
+    clock_hz *= 2U;
+  }
+
+  return clock_hz;
+}
+
+#ifdef BENCHMARK
+/**
+  * @brief  Get the clock of the APB2 timers, the latency probe's count rate
+  * @retval uint32_t: Timer clock in Hz
+  */
+static uint32_t GetLatencyClock(void) {
+  uint32_t clock_hz = HAL_RCC_GetPCLK2Freq();
+
+  /* APB2 timers run at twice PCLK2 when it is divided */
+  if ((RCC->CFGR & RCC_CFGR_PPRE2) != RCC_CFGR_PPRE2_DIV1) {
+    clock_hz *= 2U;
+  }
+
+  return clock_hz;
+}
+#endif
@@ -0,0 +1,578 @@
+/**
+  ******************************************************************************
+  * @file    val_update.c
+  * @brief   Vendor Abstraction Layer for firmware updates over USART1
+  ******************************************************************************
+  * @attention
+  *
+  * The firmware updater is a resident boot loader: the updater code
+  * (VAL_UPDATEFUNC, here and in app_update.c) and its vector table are
+  * linked into the first VAL_UPDATE_BOOT_SIZE bytes of flash, which an
+  * update never erases, and the firmware proper starts after them. The MCU
+  * always starts in the boot loader. Unless an update was requested, it
+  * checks the firmware's vector table and jumps to it at once, leaving the
+  * clocks and peripherals as the reset left them; with no valid firmware
+  * (an update cut short) it stays and waits for the image.
+  *
+  * The firmware asks for an update through the RTC backup registers, which
+  * a system reset keeps: VAL_Update_Request records the image size and
+  * CRC, the baud rate, the device address and the RS-485 driver enable,
+  * then resets. The boot loader marks the request taken before it acts on
+  * it, so the next reset starts the firmware again if nothing was erased.
+  * Without a fresh request it runs at the default baud rate.
+  *
+  * Nothing in the firmware is shared with the boot loader: it sets up the
+  * hardware through the registers, with interrupts disabled. The core and
+  * USART1 run from HSI16, the baud rate with 8 times oversampling, so
+  * 16 MHz / n for n from 8 up; VAL_Update_Prepare refuses a baud rate off
+  * by more than 2%. USART1 reception goes by DMA, circular into a
+  * VAL_UPDATE_RX_RING_SIZE ring at the start of the capture buffer with no
+  * interrupts, and the rest of the buffer is the updater's RAM. The ring is
+  * read by polling and holds a chunk arriving while a page is erased, as
+  * the CPU stalls on its own flash meanwhile. Transmission writes the data
+  * register directly.
+  *
+  * Flash is programmed one double word at a time through the registers,
+  * with the caches off so what is read back is what was programmed. The
+  * image check uses the CRC unit in the zlib CRC-32 setting (reflected
+  * input and output, final inversion in software) of VAL_CRC_32, but
+  * programs it here, as val_crc.c is part of the firmware. Time comes from
+  * the DWT cycle counter.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_update.h"
+#include "val_sections.h"
+#include "val_pwm.h"
+#include "val_rtc.h"
+#include "val_data_store.h"
+#include "val_crc.h"
+#include "usart.h"
+
+/* Private define ------------------------------------------------------------*/
+#define UPDATE_FLASH_ERRORS     (FLASH_SR_OPERR | FLASH_SR_PROGERR | FLASH_SR_WRPERR | FLASH_SR_PGAERR | \
+                                 FLASH_SR_SIZERR | FLASH_SR_PGSERR | FLASH_SR_MISERR | FLASH_SR_FASTERR | \
+                                 FLASH_SR_RDERR | FLASH_SR_OPTVERR)
+#define UPDATE_UART_ERRORS      (USART_ICR_PECF | USART_ICR_FECF | USART_ICR_NECF | USART_ICR_ORECF | USART_ICR_IDLECF)
+#define UPDATE_WATCHDOG_RELOAD  0xAAAAU   /* IWDG_KR refresh key */
+#define UPDATE_AIRCR_VECTKEY    0x5FAUL
+
+#define UPDATE_APP_BASE         (FLASH_BASE + VAL_UPDATE_BOOT_SIZE)
+#define UPDATE_APP_END          (FLASH_BASE + VAL_UPDATE_IMAGE_MAX)
+
+/* Backup registers of the request, the last five; app_counters.c and
+   app_restore.c take theirs from 0 upward */
+#define UPDATE_BACKUP_FIRST     27U
+#define UPDATE_BACKUP_MAGIC     0U
+#define UPDATE_BACKUP_SIZE      1U
+#define UPDATE_BACKUP_CRC       2U
+#define UPDATE_BACKUP_BAUD      3U
+#define UPDATE_BACKUP_LINK      4U        /* Device address, RS-485 flag in bit 8 */
+#define UPDATE_BACKUP_RS485     (1UL << 8)
+#define UPDATE_MAGIC_REQUEST    0x55504451UL
+#define UPDATE_MAGIC_TAKEN      0x55504454UL
+
+/* USART1 on HSI16 with 8 times oversampling, PB6 TX, PB7 RX, PB3 DE */
+#define UPDATE_CLOCK_HZ         16000000UL
+#define UPDATE_DEFAULT_BAUD     115200UL
+#define UPDATE_BAUD_TOLERANCE   50U       /* 1/50, 2% */
+#define UPDATE_PIN_DE           3U
+#define UPDATE_PIN_TX           6U
+#define UPDATE_PIN_RX           7U
+#define UPDATE_GPIO_AF_USART1   7U
+#define UPDATE_DE_GUARD_TIME    16U       /* As val_serial_comms.c */
+#define UPDATE_DMA_REQUEST      2U        /* DMA1 channel 5, USART1_RX */
+
+_Static_assert((VAL_UPDATE_RX_RING_SIZE & (VAL_UPDATE_RX_RING_SIZE - 1U)) == 0U, "Ring size must be a power of two");
+_Static_assert(UPDATE_BACKUP_FIRST + UPDATE_BACKUP_LINK < VAL_RTC_BACKUP_COUNT, "Request past the backup registers");
+_Static_assert((VAL_UPDATE_BOOT_SIZE % FLASH_PAGE_SIZE) == 0U, "Boot loader must end on a page boundary");
+
+/* Linker script symbols */
+extern uint8_t _scapture[];
+extern uint8_t _ecapture[];
+
+/* Private variables ---------------------------------------------------------*/
+/* Not initialized: the boot loader runs before the startup code, so
+   VAL_Update_Enter sets every one of them */
+static USART_TypeDef* uart;
+static DMA_Channel_TypeDef* rx_channel;
+static uint8_t* rx_ring;
+static uint16_t rx_read_pos;
+
+static uint32_t tick_cycles_per_ms;
+static uint32_t tick_last_cycles;
+static uint32_t tick_cycles;          /* Cycles not yet counted as a millisecond */
+static uint32_t tick_ms;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t Update_ReadWord(const uint8_t* data);
+
+/* Private functions (inline) ------------------------------------------------*/
+
+/**
+  * @brief  Get the USART1 divider of a baud rate from HSI16
+  * @param  baud: Baud rate
+  * @retval uint32_t: USARTDIV with 8 times oversampling, 0 if the rate
+  *         cannot be made within UPDATE_BAUD_TOLERANCE
+  */
+__STATIC_FORCEINLINE uint32_t Update_GetDivider(uint32_t baud) {
+  uint32_t n;
+  uint32_t actual;
+  uint32_t error;
+
+  if (baud == 0U) {
+    return 0;
+  }
+
+  /* The lowest divider bit is dropped, so the clock is divided by n = USARTDIV / 2 */
+  n = (uint32_t)((UPDATE_CLOCK_HZ + baud / 2U) / baud);
+  if (n < 8U || n > 0x7FFFU) {
+    return 0;
+  }
+
+  actual = (uint32_t)(UPDATE_CLOCK_HZ / n);
+  error = (actual > baud) ? actual - baud : baud - actual;
+  if (error * UPDATE_BAUD_TOLERANCE > baud) {
+    return 0;
+  }
+
+  return n * 2U;
+}
+
+/**
+  * @brief  Check a vector table's initial stack pointer and reset vector
+  * @param  stack: Initial stack pointer
+  * @param  reset: Reset vector
+  * @param  end: End of the image the reset handler is in
+  * @retval bool: true if the stack is in SRAM1 and the reset vector a Thumb
+  *         address in the firmware
+  */
+__STATIC_FORCEINLINE bool Update_IsVectorValid(uint32_t stack, uint32_t reset, uint32_t end) {
+  return stack > SRAM1_BASE && stack <= SRAM1_BASE + SRAM1_SIZE_MAX && (reset & 1U) != 0U &&
+         reset >= UPDATE_APP_BASE + 8U && reset < end;
+}
+
+/**
+  * @brief  Request a system reset and wait for it
+  * @retval None
+  */
+__STATIC_FORCEINLINE void Update_SystemReset(void) {
+  __DSB();
+  SCB->AIRCR = (UPDATE_AIRCR_VECTKEY << SCB_AIRCR_VECTKEY_Pos) | (SCB->AIRCR & SCB_AIRCR_PRIGROUP_Msk) |
+               SCB_AIRCR_SYSRESETREQ_Msk;
+  __DSB();
+
+  for (;;) {
+  }
+}
+
+/**
+  * @brief  Give a port B pin to USART1
+  * @param  pin: Pin number, 0 to 7
+  * @retval None
+  */
+__STATIC_FORCEINLINE void Update_SetAlternate(uint32_t pin) {
+  GPIOB->AFR[0] = (GPIOB->AFR[0] & ~(0xFUL << (pin * 4U))) | (UPDATE_GPIO_AF_USART1 << (pin * 4U));
+  GPIOB->OSPEEDR |= 0x3UL << (pin * 2U);
+  GPIOB->MODER = (GPIOB->MODER & ~(0x3UL << (pin * 2U))) | (0x2UL << (pin * 2U));
+}
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Check that an update can start and take the flash controller for it
+  * @note   Nothing else changes; once this succeeds, VAL_Update_Request must
+  *         follow, as the data store cannot write any more.
+  * @param  work_size: RAM the updater needs besides the reception ring
+  * @retval VAL_Status: VAL_OK if ready, VAL_BUSY while the data store writes,
+  *         VAL_PARAM if the boot loader cannot make the baud rate in use,
+  *         VAL_ERROR if the capture buffer cannot hold the updater's RAM
+  */
+VAL_Status VAL_Update_Prepare(size_t work_size) {
+  if (VAL_UPDATE_RX_RING_SIZE + work_size > (size_t)(_ecapture - _scapture)) {
+    return VAL_ERROR;
+  }
+  if (Update_GetDivider(huart1.Init.BaudRate) == 0U) {
+    return VAL_PARAM;
+  }
+
+  return VAL_DataStore_HoldFlash();
+}
+
+/**
+  * @brief  Record an update request and reset into the boot loader
+  * @note   Call after VAL_Update_Prepare, once the last message has been
+  *         sent. Turns the outputs off first.
+  * @param  size: Image size in bytes
+  * @param  crc: CRC-32 of the image
+  * @param  address: Device address of COMMS_BIN_TYPE_ADDR_CMD frames
+  * @retval None
+  */
+void VAL_Update_Request(uint32_t size, uint32_t crc, uint8_t address) {
+  uint32_t link = address;
+
+  __disable_irq();
+  VAL_PWM_Shutdown();
+
+  if (READ_BIT(huart1.Instance->CR3, USART_CR3_DEM) != 0U) {
+    link |= UPDATE_BACKUP_RS485;
+  }
+  VAL_RTC_WriteBackup(UPDATE_BACKUP_FIRST + UPDATE_BACKUP_SIZE, size);
+  VAL_RTC_WriteBackup(UPDATE_BACKUP_FIRST + UPDATE_BACKUP_CRC, crc);
+  VAL_RTC_WriteBackup(UPDATE_BACKUP_FIRST + UPDATE_BACKUP_BAUD, huart1.Init.BaudRate);
+  VAL_RTC_WriteBackup(UPDATE_BACKUP_FIRST + UPDATE_BACKUP_LINK, link);
+  /* Last, the request counts once this is in */
+  VAL_RTC_WriteBackup(UPDATE_BACKUP_FIRST + UPDATE_BACKUP_MAGIC, UPDATE_MAGIC_REQUEST);
+
+  while ((huart1.Instance->ISR & USART_ISR_TC) == 0U) {
+  }
+
+  Update_SystemReset();
+}
+
+/**
+  * @brief  Take the update request the firmware left before its reset
+  * @note   Boot loader, first thing after the reset. The link settings are
+  *         the recorded ones while a request is being served, the defaults
+  *         otherwise; the baud rate is only kept for a fresh request.
+  * @param  request: Pointer to store the request
+  * @retval bool: true if an update was requested, false otherwise
+  */
+VAL_UPDATEFUNC bool VAL_Update_TakeRequest(VAL_Update_Request_t* request) {
+  volatile uint32_t* backup = &RTC->BKP0R + UPDATE_BACKUP_FIRST;
+  uint32_t enabled = RCC->APB1ENR1;
+  uint32_t magic;
+  bool requested;
+
+  RCC->APB1ENR1 = enabled | RCC_APB1ENR1_PWREN | RCC_APB1ENR1_RTCAPBEN;
+  (void)RCC->APB1ENR1;
+
+  magic = backup[UPDATE_BACKUP_MAGIC];
+  requested = (magic == UPDATE_MAGIC_REQUEST);
+
+  request->size = 0;
+  request->crc = 0;
+  request->baud = UPDATE_DEFAULT_BAUD;
+  request->address = 0;
+  request->rs485 = false;
+  if (magic == UPDATE_MAGIC_REQUEST || magic == UPDATE_MAGIC_TAKEN) {
+    request->address = (uint8_t)backup[UPDATE_BACKUP_LINK];
+    request->rs485 = (backup[UPDATE_BACKUP_LINK] & UPDATE_BACKUP_RS485) != 0U;
+  }
+
+  if (!requested) {
+    RCC->APB1ENR1 = enabled;
+    return false;
+  }
+
+  request->size = backup[UPDATE_BACKUP_SIZE];
+  request->crc = backup[UPDATE_BACKUP_CRC];
+  request->baud = backup[UPDATE_BACKUP_BAUD];
+
+  /* Served once: a reset from here on starts the firmware if it is whole */
+  PWR->CR1 |= PWR_CR1_DBP;
+  backup[UPDATE_BACKUP_MAGIC] = UPDATE_MAGIC_TAKEN;
+
+  return true;
+}
+
+/**
+  * @brief  Start the firmware after the boot loader, if it is whole
+  * @note   Boot loader only. Returns if the firmware's vector table is
+  *         erased or does not point into SRAM1 and the firmware.
+  * @retval None
+  */
+VAL_UPDATEFUNC void VAL_Update_StartApplication(void) {
+  const volatile uint32_t* vectors = (const volatile uint32_t*)UPDATE_APP_BASE;
+  uint32_t stack = vectors[0];
+  uint32_t reset = vectors[1];
+
+  if (!Update_IsVectorValid(stack, reset, UPDATE_APP_END)) {
+    return;
+  }
+
+  SCB->VTOR = UPDATE_APP_BASE;
+  __DSB();
+  __ISB();
+
+  /* Both in registers: the boot loader's stack is gone after the first */
+  __ASM volatile("msr msp, %0\n\tbx %1" : : "r"(stack), "r"(reset) : "memory");
+
+  for (;;) {
+  }
+}
+
+/**
+  * @brief  Set up the hardware for the updater
+  * @note   Boot loader only, once the request is taken; interrupts stay
+  *         disabled from here on and the only way out is VAL_Update_Reset.
+  *         Falls back on the default baud rate if the recorded one cannot
+  *         be made.
+  * @param  request: Link settings, from VAL_Update_TakeRequest
+  * @retval uint8_t*: RAM for the updater after the reception ring, the
+  *         work_size given to VAL_Update_Prepare, word aligned
+  */
+VAL_UPDATEFUNC uint8_t* VAL_Update_Enter(const VAL_Update_Request_t* request) {
+  uint32_t divider = Update_GetDivider(request->baud);
+  uint32_t cr1 = USART_CR1_OVER8 | USART_CR1_TE | USART_CR1_RE;
+  uint32_t cr3 = USART_CR3_DMAR;
+
+  __disable_irq();
+
+  if (divider == 0U) {
+    divider = Update_GetDivider(UPDATE_DEFAULT_BAUD);
+  }
+
+  /* HSI16 for the core and for USART1; no wait state needed */
+  RCC->CR |= RCC_CR_HSION;
+  while ((RCC->CR & RCC_CR_HSIRDY) == 0U) {
+  }
+  RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_HSI;
+  while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_HSI) {
+  }
+  RCC->CCIPR = (RCC->CCIPR & ~RCC_CCIPR_USART1SEL) | RCC_CCIPR_USART1SEL_1;
+
+  RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN | RCC_AHB1ENR_CRCEN;
+  RCC->AHB2ENR |= RCC_AHB2ENR_GPIOBEN;
+  RCC->APB2ENR |= RCC_APB2ENR_USART1EN;
+  (void)RCC->APB2ENR;
+
+  Update_SetAlternate(UPDATE_PIN_TX);
+  Update_SetAlternate(UPDATE_PIN_RX);
+  if (request->rs485) {
+    Update_SetAlternate(UPDATE_PIN_DE);
+    cr1 |= (UPDATE_DE_GUARD_TIME << USART_CR1_DEAT_Pos) | (UPDATE_DE_GUARD_TIME << USART_CR1_DEDT_Pos);
+    cr3 |= USART_CR3_DEM;
+  }
+
+  /* Reception circular into the ring at the start of the capture buffer */
+  rx_ring = _scapture;
+  rx_read_pos = 0;
+  rx_channel = DMA1_Channel5;
+  rx_channel->CCR = 0;
+  DMA1_CSELR->CSELR = (DMA1_CSELR->CSELR & ~DMA_CSELR_C5S) | (UPDATE_DMA_REQUEST << DMA_CSELR_C5S_Pos);
+  rx_channel->CPAR = (uint32_t)&USART1->RDR;
+  rx_channel->CMAR = (uint32_t)rx_ring;
+  rx_channel->CNDTR = VAL_UPDATE_RX_RING_SIZE;
+  rx_channel->CCR = DMA_CCR_PL_1 | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_EN;
+
+  uart = USART1;
+  uart->CR1 = 0;
+  uart->BRR = (divider & 0xFFF0U) | ((divider & 0x000FU) >> 1U);
+  uart->CR3 = cr3;
+  uart->CR1 = cr1;
+  uart->CR1 = cr1 | USART_CR1_UE;
+  uart->ICR = UPDATE_UART_ERRORS;
+
+  /* Read back what was programmed, not what the caches hold */
+  FLASH->ACR &= ~(FLASH_ACR_ICEN | FLASH_ACR_DCEN);
+  FLASH->ACR |= FLASH_ACR_ICRST | FLASH_ACR_DCRST;
+  FLASH->ACR &= ~(FLASH_ACR_ICRST | FLASH_ACR_DCRST);
+
+  while ((FLASH->SR & FLASH_SR_BSY) != 0U) {
+  }
+  if ((FLASH->CR & FLASH_CR_LOCK) != 0U) {
+    FLASH->KEYR = FLASH_KEY1;
+    FLASH->KEYR = FLASH_KEY2;
+  }
+  FLASH->SR = UPDATE_FLASH_ERRORS | FLASH_SR_EOP;
+  FLASH->CR &= ~(FLASH_CR_PG | FLASH_CR_PER | FLASH_CR_PNB | FLASH_CR_EOPIE | FLASH_CR_ERRIE);
+
+  /* zlib CRC-32: reflected bytes in, reflected result out */
+  CRC->POL = VAL_CRC32_POLY;
+  CRC->INIT = VAL_CRC32_INIT;
+  CRC->CR = CRC_CR_REV_IN_0 | CRC_CR_REV_OUT | CRC_CR_RESET;
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  tick_cycles_per_ms = UPDATE_CLOCK_HZ / 1000U;
+  tick_last_cycles = 0;
+  tick_cycles = 0;
+  tick_ms = 0;
+
+  return rx_ring + VAL_UPDATE_RX_RING_SIZE;
+}
+
+/**
+  * @brief  Take the next received byte from the ring
+  * @note   Line errors are cleared and otherwise ignored: a damaged frame
+  *         fails its CRC. Bytes lost to a full ring do the same.
+  * @param  byte: Pointer to store the byte
+  * @retval bool: true if a byte was read, false if none is waiting
+  */
+VAL_UPDATEFUNC bool VAL_Update_ReadByte(uint8_t* byte) {
+  uint16_t write_pos = (uint16_t)((VAL_UPDATE_RX_RING_SIZE - rx_channel->CNDTR) & (VAL_UPDATE_RX_RING_SIZE - 1U));
+
+  if ((uart->ISR & (USART_ISR_PE | USART_ISR_FE | USART_ISR_NE | USART_ISR_ORE)) != 0U) {
+    uart->ICR = UPDATE_UART_ERRORS;
+  }
+
+  if (rx_read_pos == write_pos) {
+    return false;
+  }
+
+  *byte = rx_ring[rx_read_pos];
+  rx_read_pos = (uint16_t)((rx_read_pos + 1U) & (VAL_UPDATE_RX_RING_SIZE - 1U));
+
+  return true;
+}
+
+/**
+  * @brief  Send bytes, waiting for room in the transmit register
+  * @note   Returns with the last byte still being sent
+  * @param  data: Bytes to send
+  * @param  length: Number of bytes
+  * @retval None
+  */
+VAL_UPDATEFUNC void VAL_Update_Send(const uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    while ((uart->ISR & USART_ISR_TXE) == 0U) {
+    }
+    uart->TDR = data[i];
+  }
+}
+
+/**
+  * @brief  Erase one flash page
+  * @note   About 25 ms; reception carries on into the ring meanwhile
+  * @param  address: Any address in the page
+  * @retval VAL_Status: VAL_OK if erased, VAL_ERROR otherwise
+  */
+VAL_UPDATEFUNC VAL_Status VAL_Update_ErasePage(uint32_t address) {
+  uint32_t page = (address - FLASH_BASE) / FLASH_PAGE_SIZE;
+
+  FLASH->SR = UPDATE_FLASH_ERRORS;
+  FLASH->CR = (FLASH->CR & ~(FLASH_CR_PNB | FLASH_CR_PG)) | FLASH_CR_PER | (page << FLASH_CR_PNB_Pos);
+  FLASH->CR |= FLASH_CR_STRT;
+  while ((FLASH->SR & FLASH_SR_BSY) != 0U) {
+  }
+  FLASH->CR &= ~(FLASH_CR_PER | FLASH_CR_PNB);
+
+  return ((FLASH->SR & UPDATE_FLASH_ERRORS) != 0U) ? VAL_ERROR : VAL_OK;
+}
+
+/**
+  * @brief  Program erased flash, one double word at a time, and read it back
+  * @param  address: Flash address, double word aligned
+  * @param  data: Bytes to program, any alignment
+  * @param  length: Number of bytes, a multiple of 8
+  * @retval VAL_Status: VAL_OK if programmed, VAL_PARAM if not aligned,
+  *         VAL_ERROR if programming failed or read back differently
+  */
+VAL_UPDATEFUNC VAL_Status VAL_Update_Program(uint32_t address, const uint8_t* data, size_t length) {
+  VAL_Status status = VAL_OK;
+
+  if ((address % 8U) != 0U || (length % 8U) != 0U) {
+    return VAL_PARAM;
+  }
+
+  FLASH->SR = UPDATE_FLASH_ERRORS;
+  FLASH->CR |= FLASH_CR_PG;
+
+  for (size_t i = 0; i < length; i += 8U) {
+    volatile uint32_t* dest = (volatile uint32_t*)(address + i);
+    uint32_t low = Update_ReadWord(&data[i]);
+    uint32_t high = Update_ReadWord(&data[i + 4U]);
+
+    /* The second word starts the cycle */
+    dest[0] = low;
+    dest[1] = high;
+    while ((FLASH->SR & FLASH_SR_BSY) != 0U) {
+    }
+
+    if ((FLASH->SR & UPDATE_FLASH_ERRORS) != 0U || dest[0] != low || dest[1] != high) {
+      status = VAL_ERROR;
+      break;
+    }
+  }
+
+  FLASH->CR &= ~FLASH_CR_PG;
+
+  return status;
+}
+
+/**
+  * @brief  Start a new CRC-32
+  * @retval None
+  */
+VAL_UPDATEFUNC void VAL_Update_CrcReset(void) {
+  CRC->CR |= CRC_CR_RESET;
+}
+
+/**
+  * @brief  Add bytes to the CRC-32
+  * @param  data: Bytes, in RAM or flash
+  * @param  length: Number of bytes
+  * @retval None
+  */
+VAL_UPDATEFUNC void VAL_Update_CrcAdd(const uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    *(volatile uint8_t*)&CRC->DR = data[i];
+  }
+}
+
+/**
+  * @brief  Get the CRC-32 of the bytes added since VAL_Update_CrcReset
+  * @retval uint32_t: CRC, the value zlib's crc32 gives
+  */
+VAL_UPDATEFUNC uint32_t VAL_Update_CrcGet(void) {
+  return CRC->DR ^ 0xFFFFFFFFU;
+}
+
+/**
+  * @brief  Get the milliseconds since VAL_Update_Enter
+  * @note   Call at least every 50 s, before the cycle counter wraps twice
+  * @retval uint32_t: Milliseconds
+  */
+VAL_UPDATEFUNC uint32_t VAL_Update_GetTick(void) {
+  uint32_t now = DWT->CYCCNT;
+
+  tick_cycles += now - tick_last_cycles;
+  tick_last_cycles = now;
+  tick_ms += tick_cycles / tick_cycles_per_ms;
+  tick_cycles %= tick_cycles_per_ms;
+
+  return tick_ms;
+}
+
+/**
+  * @brief  Refresh the independent watchdog, if it was started
+  * @retval None
+  */
+VAL_UPDATEFUNC void VAL_Update_Feed(void) {
+  IWDG->KR = UPDATE_WATCHDOG_RELOAD;
+}
+
+/**
+  * @brief  Reset the MCU once the last byte has been sent
+  * @retval None
+  */
+VAL_UPDATEFUNC void VAL_Update_Reset(void) {
+  while ((uart->ISR & USART_ISR_TC) == 0U) {
+  }
+
+  Update_SystemReset();
+}
+
+/**
+  * @brief  Reset the MCU at once
+  * @note   The boot loader's fault handler
+  * @retval None
+  */
+VAL_UPDATEFUNC void VAL_Update_Fault(void) {
+  Update_SystemReset();
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Read a little-endian word from any alignment
+  * @param  data: First byte
+  * @retval uint32_t: Word
+  */
+VAL_UPDATEFUNC static uint32_t Update_ReadWord(const uint8_t* data) {
+  return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
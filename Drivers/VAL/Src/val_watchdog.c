@@ -0,0 +1,115 @@
+/**
+  ******************************************************************************
+  * @file    val_watchdog.c
+  * @brief   Vendor Abstraction Layer for the independent watchdog
+  ******************************************************************************
+  * @attention
+  *
+  * The IWDG runs from the LSI and resets the MCU unless it is refreshed
+  * within its timeout. Once started it cannot be stopped, and it keeps
+  * counting in stop mode, so the timeout must cover the longest stop
+  * (VAL_LOW_POWER_MAX_STOP_MS) plus the time to the next refresh. It is
+  * frozen while the core is halted by a debugger.
+  *
+  * The LSI is only accurate to a few percent, so the timeout is nominal.
+  *
+  * The reset flags in RCC_CSR stay set until cleared; VAL_Watchdog_Init
+  * latches the watchdog flag and clears all of them, so the next reset is
+  * reported by its own cause.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_watchdog.h"
+
+/* Private define ------------------------------------------------------------*/
+#define WATCHDOG_LSI_HZ       32000U
+#define WATCHDOG_MAX_RELOAD   0x0FFFU
+#define WATCHDOG_MAX_PR       6U       /* Divider 256 */
+
+/* IWDG_KR keys */
+#define WATCHDOG_KEY_RELOAD   0xAAAAU
+#define WATCHDOG_KEY_ACCESS   0x5555U
+#define WATCHDOG_KEY_START    0xCCCCU
+
+/* Private variables ---------------------------------------------------------*/
+static bool reset_by_watchdog = false;
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Read and clear the reset cause flags
+  * @note   Call once at start-up, before anything else reads RCC_CSR
+  * @retval None
+  */
+void VAL_Watchdog_Init(void) {
+  reset_by_watchdog = (RCC->CSR & RCC_CSR_IWDGRSTF) != 0U;
+  RCC->CSR |= RCC_CSR_RMVF;
+}
+
+/**
+  * @brief  Start the watchdog
+  * @note   The watchdog cannot be stopped again; refresh it well within
+  *         the timeout from then on
+  * @param  timeout_ms: Time without a refresh until the reset, 1 to
+  *         VAL_WATCHDOG_MAX_TIMEOUT_MS
+  * @retval VAL_Status: VAL_OK if started, VAL_PARAM if invalid, VAL_TIMEOUT if
+  *         the settings were not taken over
+  */
+VAL_Status VAL_Watchdog_Start(uint32_t timeout_ms) {
+  uint32_t prescaler = 0;
+  uint32_t reload;
+  uint32_t start;
+
+  if (timeout_ms == 0 || timeout_ms > VAL_WATCHDOG_MAX_TIMEOUT_MS) {
+    return VAL_PARAM;
+  }
+
+  /* Finest divider (4 << PR) whose count fits the reload register */
+  reload = (timeout_ms * (WATCHDOG_LSI_HZ / 1000U)) / 4U;
+  while (reload > WATCHDOG_MAX_RELOAD + 1U && prescaler < WATCHDOG_MAX_PR) {
+    prescaler++;
+    reload = (reload + 1U) / 2U;
+  }
+  if (reload > WATCHDOG_MAX_RELOAD + 1U) {
+    reload = WATCHDOG_MAX_RELOAD + 1U;
+  }
+
+  /* Halted at a breakpoint means no refresh */
+  DBGMCU->APB1FZR1 |= DBGMCU_APB1FZR1_DBG_IWDG_STOP;
+
+  /* Starting turns on the LSI; the registers are written in its domain */
+  IWDG->KR = WATCHDOG_KEY_START;
+  IWDG->KR = WATCHDOG_KEY_ACCESS;
+  IWDG->PR = prescaler;
+  IWDG->RLR = reload - 1U;
+
+  start = HAL_GetTick();
+  while ((IWDG->SR & (IWDG_SR_PVU | IWDG_SR_RVU)) != 0U) {
+    if ((HAL_GetTick() - start) > 10U) {
+      return VAL_TIMEOUT;
+    }
+  }
+
+  IWDG->KR = WATCHDOG_KEY_RELOAD;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Restart the watchdog timeout
+  * @note   Safe to call from interrupts; no effect before VAL_Watchdog_Start
+  * @retval None
+  */
+void VAL_Watchdog_Refresh(void) {
+  IWDG->KR = WATCHDOG_KEY_RELOAD;
+}
+
+/**
+  * @brief  Check whether the last reset was caused by the watchdog
+  * @retval bool: true if the watchdog expired, as latched by VAL_Watchdog_Init
+  */
+bool VAL_Watchdog_CausedReset(void) {
+  return reset_by_watchdog;
+}
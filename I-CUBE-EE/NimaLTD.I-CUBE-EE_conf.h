@@ -41,7 +41,7 @@
 #define EE_MANUAL_CONFIG      true
 
 /*---------- EE_SELECTED_PAGE_SECTOR_NUMBER  -----------*/
-#define EE_SELECTED_PAGE_SECTOR_NUMBER      2
+#define EE_SELECTED_PAGE_SECTOR_NUMBER      126
 
 /*---------- EE_SELECTED_PAGE_SECTOR_SIZE  -----------*/
 #define EE_SELECTED_PAGE_SECTOR_SIZE      EE_PAGE_SECTOR_SIZE_2K
@@ -35,7 +35,7 @@
 #define LWJSON_OPT_HDR_H
 
 /* Uncomment to ignore user options (or set macro in compiler flags) */
-#define LWJSON_IGNORE_USER_OPTS
+/* #define LWJSON_IGNORE_USER_OPTS */
 
 /* Include application options */
 #ifndef LWJSON_IGNORE_USER_OPTS
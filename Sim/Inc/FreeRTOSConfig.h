@@ -0,0 +1,34 @@
+/**
+  ******************************************************************************
+  * @file    FreeRTOSConfig.h
+  * @brief   FreeRTOS configuration of the host simulation
+  ******************************************************************************
+  * @attention
+  *
+  * Takes the firmware configuration and changes what the host port needs.
+  * The tick is the port's own timer signal, so there is no tickless idle;
+  * the idle hook also sleeps the host thread instead (sim_core.c). Task
+  * selection is the generic one and the C library is the host's.
+  *
+  ******************************************************************************
+  */
+
+#include_next "FreeRTOSConfig.h"
+
+#ifndef SIM_FREERTOS_CONFIG_H
+#define SIM_FREERTOS_CONFIG_H
+
+#undef configUSE_TICKLESS_IDLE
+#define configUSE_TICKLESS_IDLE                  0
+
+#undef configUSE_PORT_OPTIMISED_TASK_SELECTION
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION  0
+
+/* The idle task's stack is also a host thread's (Port/port.c) */
+#undef configMINIMAL_STACK_SIZE
+#define configMINIMAL_STACK_SIZE                 ((uint16_t)16384)
+
+#undef configUSE_NEWLIB_REENTRANT
+#define configUSE_NEWLIB_REENTRANT               0
+
+#endif /* SIM_FREERTOS_CONFIG_H */
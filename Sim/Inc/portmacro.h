@@ -0,0 +1,47 @@
+/**
+  ******************************************************************************
+  * @file    portmacro.h
+  * @brief   Port macros of Port/portmacro.h, adjusted for the simulated interrupts
+  ******************************************************************************
+  * @attention
+  *
+  * The simulated interrupts run inside the port's tick signal handler,
+  * which switches tasks itself when an interrupt woke one; a yield from
+  * there would switch threads under the handler. The ISR yield macros
+  * therefore only yield from task context, and the FromISR calls leave
+  * the switch to the tick as the kernel marks it pending.
+  *
+  * The run time statistics hooks are the firmware's (app_profiler.c).
+  *
+  ******************************************************************************
+  */
+
+#include_next "portmacro.h"
+
+#ifndef SIM_PORTMACRO_H
+#define SIM_PORTMACRO_H
+
+#include <stdbool.h>
+
+/* sim_core.c; the kernel is built without the device headers */
+bool Sim_InInterrupt(void);
+
+#undef portEND_SWITCHING_ISR
+#define portEND_SWITCHING_ISR(xSwitchRequired) \
+  do { if ((xSwitchRequired) && !Sim_InInterrupt()) { portYIELD(); } } while (0)
+
+#undef portYIELD_FROM_ISR
+#define portYIELD_FROM_ISR(x) portEND_SWITCHING_ISR(x)
+
+#undef portCONFIGURE_TIMER_FOR_RUN_TIME_STATS
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS configureTimerForRunTimeStats
+
+#undef portGET_RUN_TIME_COUNTER_VALUE
+#define portGET_RUN_TIME_COUNTER_VALUE getRunTimeCounterValue
+
+/* Part of the Cortex-M ports, used by the application */
+static inline BaseType_t xPortIsInsideInterrupt(void) {
+  return Sim_InInterrupt() ? pdTRUE : pdFALSE;
+}
+
+#endif /* SIM_PORTMACRO_H */
@@ -0,0 +1,164 @@
+/**
+  ******************************************************************************
+  * @file    sim.h
+  * @brief   Interfaces between the host simulation modules
+  ******************************************************************************
+  * @attention
+  *
+  * The simulation runs the unmodified firmware as a Linux process on the
+  * FreeRTOS host port in Sim/Port. The STM32 peripheral address ranges
+  * are mapped as plain memory at their real addresses, so the HAL, CubeMX
+  * and VAL code read and write registers as on the target, and a set of
+  * models gives the registers their behaviour: each model picks up what
+  * the firmware wrote (sync), moves its peripheral forward in time
+  * (advance) and raises the interrupt lines it drives (lines).
+  *
+  * Time is host time. Sim_Step, called from the FreeRTOS tick hook, and
+  * before the scheduler runs from HAL_GetTick and WFI, advances the
+  * models to the present in slices of at most SIM_SLICE_NS and dispatches
+  * the pending interrupts after each slice, in NVIC priority order, from
+  * the tick signal handler of the running task. Interrupts therefore see
+  * at most a slice of latency and never preempt one another.
+  *
+  * All of this runs in the tick signal handler; the models only use
+  * async-signal-safe calls and the control thread hands its commands over
+  * under Sim_Lock.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SIM_H
+#define __SIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "stm32l4xx.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define SIM_SLICE_NS          500000U     /* Longest step between interrupt dispatches */
+#define SIM_STEP_MAX_NS       50000000U   /* Longer host stalls are not caught up */
+#define SIM_W1C_CANARY        0x80000000U /* Unused bit kept set in write-1-to-clear registers */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  void (*init)(void);             /* Reset state, before main */
+  void (*sync)(void);             /* Apply what the firmware wrote since the last call */
+  void (*advance)(uint32_t ns);   /* Move forward in time */
+  void (*lines)(void);            /* Raise the interrupt lines now active */
+} Sim_Model_t;
+
+/* Kept across resets in the state directory */
+typedef struct {
+  uint32_t magic;
+  uint32_t reset_flags;           /* RCC_CSR reset flags for the next start */
+  uint32_t backup[32];            /* RTC backup registers */
+  uint32_t rtc_set;
+  int64_t rtc_offset_ms;          /* Calendar time minus host realtime */
+  int32_t rtc_calibration_ppb;
+} Sim_State_t;
+
+/* Exported variables --------------------------------------------------------*/
+extern Sim_State_t* Sim_State;
+
+extern const Sim_Model_t Sim_SystemModel;
+extern const Sim_Model_t Sim_DmaModel;
+extern const Sim_Model_t Sim_TimerModel;
+extern const Sim_Model_t Sim_AdcModel;
+extern const Sim_Model_t Sim_UartModel;
+extern const Sim_Model_t Sim_LedModel;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/* sim_core.c */
+void Sim_Step(void);
+uint64_t Sim_GetNanos(void);
+bool Sim_InInterrupt(void);
+void Sim_RaiseIrq(IRQn_Type irq);
+void Sim_Reset(uint32_t reset_flag) __attribute__((noreturn));
+void Sim_Exit(int code) __attribute__((noreturn));
+void Sim_Log(const char* format, ...) __attribute__((format(printf, 1, 2)));
+const char* Sim_GetEnv(const char* name, const char* fallback);
+double Sim_GetEnvNumber(const char* name, double fallback);
+void Sim_Lock(void);
+bool Sim_TryLock(void);
+void Sim_Unlock(void);
+
+/* sim_system.c */
+void Sim_System_MapFlash(const char* state_dir);
+void Sim_System_Sync(void);
+void Sim_System_RisingEdge(uint32_t exti_line);
+void Sim_System_ClearBackupDomain(void);
+
+/* sim_dma.c */
+bool Sim_Dma_Read(DMA_Channel_TypeDef* channel, uint32_t* value);
+bool Sim_Dma_Write(DMA_Channel_TypeDef* channel, uint32_t value);
+uint32_t Sim_Dma_Remaining(DMA_Channel_TypeDef* channel);
+
+/* sim_timer.c */
+uint32_t Sim_Timer_GetClock(TIM_TypeDef* timer);
+float Sim_Timer_GetOnFraction(uint8_t light_index);
+void Sim_Timer_ExternalTrigger(bool rising);
+void Sim_Timer_Break(uint8_t comparator);
+
+/* val_timers.c (simulation) */
+bool Sim_Timer_CueAlarmPending(void);
+
+/* sim_adc.c */
+void Sim_Adc_Trigger(uint32_t source, bool rising);
+uint32_t Sim_Adc_GetVdda(void);
+void Sim_Adc_SetVdda(uint32_t mv);
+
+/* sim_uart.c */
+int Sim_Uart_Open(void);
+void Sim_Uart_Dispatched(void);
+
+/* sim_led.c */
+int32_t Sim_Led_GetCurrentMa(uint8_t light_index);
+int32_t Sim_Led_GetOnCurrentMa(uint8_t light_index);
+int32_t Sim_Led_GetTemperatureCdeg(uint8_t light_index);
+int32_t Sim_Led_GetDieTemperatureCdeg(void);
+void Sim_Led_SetAmbient(int32_t cdeg);
+void Sim_Led_SetFault(uint8_t light_index, float current_scale);
+
+/* sim_control.c */
+void Sim_Control_Start(void);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+ * @brief Apply the firmware's writes to a write-0-to-clear status register
+ * @param reg Register in simulated memory
+ * @param shadow Flags as the model holds them
+ * @return None
+ */
+static inline void Sim_SyncW0C(volatile uint32_t* reg, uint32_t* shadow) {
+  *shadow &= *reg;
+  *reg = *shadow;
+}
+
+/**
+ * @brief Apply the firmware's writes to a write-1-to-clear status register
+ * @note  The canary bit is set in memory after every update; a write by the
+ *        firmware clears it and names the flags to clear.
+ * @param reg Register in simulated memory
+ * @param shadow Flags as the model holds them
+ * @return None
+ */
+static inline void Sim_SyncW1C(volatile uint32_t* reg, uint32_t* shadow) {
+  uint32_t value = *reg;
+
+  if ((value & SIM_W1C_CANARY) == 0U) {
+    *shadow &= ~value;
+  }
+  *reg = *shadow | SIM_W1C_CANARY;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_H */
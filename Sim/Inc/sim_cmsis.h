@@ -0,0 +1,156 @@
+/**
+  ******************************************************************************
+  * @file    sim_cmsis.h
+  * @brief   Host replacement for the CMSIS compiler header in simulation
+  ******************************************************************************
+  * @attention
+  *
+  * Force-included ahead of every firmware source in the simulation build.
+  * It takes the include guard of cmsis_gcc.h, so core_cm4.h finds the
+  * compiler macros and core intrinsics already defined and the Cortex-M
+  * assembly never reaches the host compiler.
+  *
+  * The core state behind the intrinsics is the simulated one: PRIMASK is
+  * whether the tick signal is blocked in the calling thread, so a critical
+  * section keeps out the tick and with it every simulated interrupt, and
+  * IPSR is the exception the simulation is running, 0 in tasks. WFI sleeps
+  * briefly instead of spinning. The DSP intrinsics are not provided; the
+  * simulation builds without ANALOG_USE_SIMD.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SIM_CMSIS_H
+#define __SIM_CMSIS_H
+
+/* Taken so that core_cm4.h does not pull in the Cortex-M version */
+#define __CMSIS_GCC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Compiler specific defines -------------------------------------------------*/
+#define __ASM                     __asm
+#define __INLINE                  inline
+#define __STATIC_INLINE           static inline
+#define __STATIC_FORCEINLINE      __attribute__((always_inline)) static inline
+#define __NO_RETURN               __attribute__((__noreturn__))
+#define __USED                    __attribute__((used))
+#define __WEAK                    __attribute__((weak))
+#define __PACKED                  __attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT           struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION            union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x)              __attribute__((aligned(x)))
+#define __RESTRICT                __restrict
+#define __COMPILER_BARRIER()      __ASM volatile("" ::: "memory")
+
+/* Simulated core state, sim_core.c ------------------------------------------*/
+uint32_t Sim_GetPrimask(void);
+void Sim_SetPrimask(uint32_t primask);
+uint32_t Sim_GetIpsr(void);
+void Sim_WaitForInterrupt(void);
+void Sim_Breakpoint(void);
+
+/* Core register access ------------------------------------------------------*/
+__STATIC_FORCEINLINE void __enable_irq(void)           { Sim_SetPrimask(0U); }
+__STATIC_FORCEINLINE void __disable_irq(void)          { Sim_SetPrimask(1U); }
+__STATIC_FORCEINLINE uint32_t __get_PRIMASK(void)      { return Sim_GetPrimask(); }
+__STATIC_FORCEINLINE void __set_PRIMASK(uint32_t pm)   { Sim_SetPrimask(pm); }
+__STATIC_FORCEINLINE uint32_t __get_IPSR(void)         { return Sim_GetIpsr(); }
+__STATIC_FORCEINLINE uint32_t __get_xPSR(void)         { return Sim_GetIpsr(); }
+__STATIC_FORCEINLINE uint32_t __get_APSR(void)         { return 0U; }
+__STATIC_FORCEINLINE uint32_t __get_CONTROL(void)      { return 0U; }
+__STATIC_FORCEINLINE void __set_CONTROL(uint32_t c)    { (void)c; }
+__STATIC_FORCEINLINE uint32_t __get_PSP(void)          { return (uint32_t)(uintptr_t)__builtin_frame_address(0); }
+__STATIC_FORCEINLINE void __set_PSP(uint32_t sp)       { (void)sp; }
+__STATIC_FORCEINLINE uint32_t __get_MSP(void)          { return (uint32_t)(uintptr_t)__builtin_frame_address(0); }
+__STATIC_FORCEINLINE void __set_MSP(uint32_t sp)       { (void)sp; }
+__STATIC_FORCEINLINE uint32_t __get_BASEPRI(void)      { return 0U; }
+__STATIC_FORCEINLINE void __set_BASEPRI(uint32_t bp)   { (void)bp; }
+__STATIC_FORCEINLINE void __set_BASEPRI_MAX(uint32_t bp) { (void)bp; }
+__STATIC_FORCEINLINE uint32_t __get_FAULTMASK(void)    { return 0U; }
+__STATIC_FORCEINLINE void __set_FAULTMASK(uint32_t fm) { (void)fm; }
+__STATIC_FORCEINLINE void __enable_fault_irq(void)     { }
+__STATIC_FORCEINLINE void __disable_fault_irq(void)    { }
+__STATIC_FORCEINLINE uint32_t __get_FPSCR(void)        { return 0U; }
+__STATIC_FORCEINLINE void __set_FPSCR(uint32_t fpscr)  { (void)fpscr; }
+
+/* Instructions --------------------------------------------------------------*/
+#define __NOP()                   __ASM volatile ("nop")
+#define __WFI()                   Sim_WaitForInterrupt()
+#define __WFE()                   Sim_WaitForInterrupt()
+#define __SEV()                   ((void)0)
+#define __BKPT(value)             Sim_Breakpoint()
+
+__STATIC_FORCEINLINE void __ISB(void) { __sync_synchronize(); }
+__STATIC_FORCEINLINE void __DSB(void) { __sync_synchronize(); }
+__STATIC_FORCEINLINE void __DMB(void) { __sync_synchronize(); }
+
+__STATIC_FORCEINLINE uint32_t __REV(uint32_t value)  { return __builtin_bswap32(value); }
+__STATIC_FORCEINLINE uint32_t __REV16(uint32_t value)
+{
+  return ((value & 0xFF00FF00U) >> 8) | ((value & 0x00FF00FFU) << 8);
+}
+__STATIC_FORCEINLINE int16_t __REVSH(int16_t value)  { return (int16_t)__builtin_bswap16((uint16_t)value); }
+__STATIC_FORCEINLINE uint32_t __ROR(uint32_t op1, uint32_t op2)
+{
+  op2 %= 32U;
+  return (op2 == 0U) ? op1 : (op1 >> op2) | (op1 << (32U - op2));
+}
+__STATIC_FORCEINLINE uint32_t __RBIT(uint32_t value)
+{
+  uint32_t result = 0U;
+  for (uint32_t i = 0U; i < 32U; i++) {
+    result = (result << 1) | ((value >> i) & 1U);
+  }
+  return result;
+}
+__STATIC_FORCEINLINE uint8_t __CLZ(uint32_t value)   { return (value == 0U) ? 32U : (uint8_t)__builtin_clz(value); }
+
+/* Exclusive access: the simulated interrupts never write what the firmware
+ * updates this way, so the store always succeeds */
+__STATIC_FORCEINLINE uint8_t __LDREXB(volatile uint8_t* addr)   { return *addr; }
+__STATIC_FORCEINLINE uint16_t __LDREXH(volatile uint16_t* addr) { return *addr; }
+__STATIC_FORCEINLINE uint32_t __LDREXW(volatile uint32_t* addr) { return *addr; }
+__STATIC_FORCEINLINE uint32_t __STREXB(uint8_t value, volatile uint8_t* addr)   { *addr = value; return 0U; }
+__STATIC_FORCEINLINE uint32_t __STREXH(uint16_t value, volatile uint16_t* addr) { *addr = value; return 0U; }
+__STATIC_FORCEINLINE uint32_t __STREXW(uint32_t value, volatile uint32_t* addr) { *addr = value; return 0U; }
+__STATIC_FORCEINLINE void __CLREX(void) { }
+
+__STATIC_FORCEINLINE int32_t __SSAT(int32_t val, uint32_t sat)
+{
+  if (sat >= 1U && sat <= 32U) {
+    const int32_t max = (int32_t)((1U << (sat - 1U)) - 1U);
+    const int32_t min = -1 - max;
+    if (val > max) {
+      return max;
+    }
+    if (val < min) {
+      return min;
+    }
+  }
+  return val;
+}
+__STATIC_FORCEINLINE uint32_t __USAT(int32_t val, uint32_t sat)
+{
+  if (sat <= 31U) {
+    const uint32_t max = ((1U << sat) - 1U);
+    if (val > (int32_t)max) {
+      return max;
+    }
+    if (val < 0) {
+      return 0U;
+    }
+  }
+  return (uint32_t)val;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_CMSIS_H */
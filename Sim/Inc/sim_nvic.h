@@ -0,0 +1,54 @@
+/**
+  ******************************************************************************
+  * @file    sim_nvic.h
+  * @brief   NVIC functions of the host simulation
+  ******************************************************************************
+  * @attention
+  *
+  * Included by core_cm4.h in place of its NVIC functions, through
+  * CMSIS_NVIC_VIRTUAL. The simulation keeps the enables, priorities and
+  * pending flags itself and dispatches from them (sim_core.c); the NVIC
+  * registers in the mapped core range are not used.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SIM_NVIC_H
+#define __SIM_NVIC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void Sim_NVIC_SetPriorityGrouping(uint32_t group);
+uint32_t Sim_NVIC_GetPriorityGrouping(void);
+void Sim_NVIC_EnableIRQ(IRQn_Type irq);
+uint32_t Sim_NVIC_GetEnableIRQ(IRQn_Type irq);
+void Sim_NVIC_DisableIRQ(IRQn_Type irq);
+uint32_t Sim_NVIC_GetPendingIRQ(IRQn_Type irq);
+void Sim_NVIC_SetPendingIRQ(IRQn_Type irq);
+void Sim_NVIC_ClearPendingIRQ(IRQn_Type irq);
+uint32_t Sim_NVIC_GetActive(IRQn_Type irq);
+void Sim_NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+uint32_t Sim_NVIC_GetPriority(IRQn_Type irq);
+void Sim_NVIC_SystemReset(void) __attribute__((noreturn));
+
+#define NVIC_SetPriorityGrouping    Sim_NVIC_SetPriorityGrouping
+#define NVIC_GetPriorityGrouping    Sim_NVIC_GetPriorityGrouping
+#define NVIC_EnableIRQ              Sim_NVIC_EnableIRQ
+#define NVIC_GetEnableIRQ           Sim_NVIC_GetEnableIRQ
+#define NVIC_DisableIRQ             Sim_NVIC_DisableIRQ
+#define NVIC_GetPendingIRQ          Sim_NVIC_GetPendingIRQ
+#define NVIC_SetPendingIRQ          Sim_NVIC_SetPendingIRQ
+#define NVIC_ClearPendingIRQ        Sim_NVIC_ClearPendingIRQ
+#define NVIC_GetActive              Sim_NVIC_GetActive
+#define NVIC_SetPriority            Sim_NVIC_SetPriority
+#define NVIC_GetPriority            Sim_NVIC_GetPriority
+#define NVIC_SystemReset            Sim_NVIC_SystemReset
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_NVIC_H */
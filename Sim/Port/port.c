@@ -0,0 +1,326 @@
+/**
+  ******************************************************************************
+  * @file    port.c
+  * @brief   FreeRTOS port of the host simulation: threads, tick and switches
+  ******************************************************************************
+  * @attention
+  *
+  * Every task runs on a host thread of its own, on the stack the kernel
+  * gave it. The port keeps the thread's state at the top of that stack and
+  * returns it as the task's top of stack, so the TCB leads to the thread.
+  * Only the thread of the task the kernel selected runs; the others wait
+  * on their own condition variable. A switch wakes the next thread, then
+  * waits on its own, so exactly one runs at any time.
+  *
+  * The tick is the SIGALRM interval timer. Every thread but the running
+  * one keeps SIGALRM blocked, so the handler always runs on the running
+  * task, where a tick interrupts it on the target; when the kernel asks
+  * for another task the handler switches threads itself and the
+  * interrupted thread resumes inside it later. Disabling interrupts blocks
+  * SIGALRM in the calling thread. The critical section nesting belongs to
+  * the thread; it is kept over a switch.
+  *
+  * Only SIGALRM is blocked: faults raise their signals in whichever thread
+  * caused them, and SIGINT still ends the program.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "FreeRTOS.h"
+#include "task.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  pthread_t thread;
+  TaskFunction_t code;
+  void* parameters;
+  UBaseType_t nesting;            /* Critical nesting while switched out */
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  bool resumed;                   /* Set by the thread switching to this one */
+  bool dying;                     /* The task was deleted, end the thread */
+} Port_Thread_t;
+
+/* Private variables ---------------------------------------------------------*/
+static volatile UBaseType_t critical_nesting = 0;
+static sigset_t tick_signal;
+
+/* Private function prototypes -----------------------------------------------*/
+static void* Port_ThreadStart(void* argument);
+static Port_Thread_t* Port_GetThread(TaskHandle_t task);
+static void Port_Switch(Port_Thread_t* from, Port_Thread_t* to);
+static void Port_Suspend(Port_Thread_t* self);
+static void Port_Resume(Port_Thread_t* thread);
+static void Port_Tick(int sig);
+static void Port_Fail(const char* what);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Set up a task's thread on its stack
+  * @note   The thread starts with the tick blocked and waits to be switched
+  *         to for the first time
+  * @param  pxTopOfStack: Highest word of the stack
+  * @param  pxEndOfStack: Lowest word of the stack
+  * @param  pxCode: Task function
+  * @param  pvParameters: Its argument
+  * @retval StackType_t*: The thread state, kept as the task's top of stack
+  */
+StackType_t* pxPortInitialiseStack(StackType_t* pxTopOfStack, StackType_t* pxEndOfStack,
+                                   TaskFunction_t pxCode, void* pvParameters) {
+  Port_Thread_t* thread;
+  pthread_attr_t attributes;
+  sigset_t previous;
+  size_t size;
+
+  sigemptyset(&tick_signal);
+  sigaddset(&tick_signal, SIGALRM);
+
+  thread = (Port_Thread_t*)(((uintptr_t)pxTopOfStack + sizeof(StackType_t) - sizeof(Port_Thread_t)) &
+                            ~(uintptr_t)(portBYTE_ALIGNMENT - 1));
+  size = ((uintptr_t)thread - (uintptr_t)pxEndOfStack) & ~(uintptr_t)(sizeof(void*) * 2U - 1U);
+  if ((uintptr_t)thread <= (uintptr_t)pxEndOfStack || size < PTHREAD_STACK_MIN) {
+    Port_Fail("task stack too small for a host thread");
+  }
+
+  memset(thread, 0, sizeof(*thread));
+  thread->code = pxCode;
+  thread->parameters = pvParameters;
+  pthread_mutex_init(&thread->lock, NULL);
+  pthread_cond_init(&thread->wake, NULL);
+
+  pthread_attr_init(&attributes);
+  pthread_attr_setstack(&attributes, pxEndOfStack, size);
+
+  /* The new thread inherits the mask */
+  pthread_sigmask(SIG_BLOCK, &tick_signal, &previous);
+  if (pthread_create(&thread->thread, &attributes, Port_ThreadStart, thread) != 0) {
+    Port_Fail("cannot create a task thread");
+  }
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+  pthread_attr_destroy(&attributes);
+
+  return (StackType_t*)thread;
+}
+
+/**
+  * @brief  Start the tick and the first task
+  * @note   The calling thread only waits from here on
+  * @retval BaseType_t: Does not return
+  */
+BaseType_t xPortStartScheduler(void) {
+  struct sigaction tick = {0};
+  struct itimerval interval = {{0, portTICK_USEC}, {0, portTICK_USEC}};
+
+  pthread_sigmask(SIG_BLOCK, &tick_signal, NULL);
+
+  tick.sa_handler = Port_Tick;
+  sigemptyset(&tick.sa_mask);
+  tick.sa_flags = SA_RESTART;
+  sigaction(SIGALRM, &tick, NULL);
+  setitimer(ITIMER_REAL, &interval, NULL);
+
+  Port_Resume(Port_GetThread(xTaskGetCurrentTaskHandle()));
+
+  for (;;) {
+    pause();
+  }
+}
+
+/**
+  * @brief  Stop the scheduler
+  * @note   Not used by the firmware; the simulation ends the process instead
+  * @retval None
+  */
+void vPortEndScheduler(void) {
+  exit(0);
+}
+
+/**
+  * @brief  Switch to the task the kernel selects next
+  * @retval None
+  */
+void vPortYield(void) {
+  Port_Thread_t* from;
+
+  vPortEnterCritical();
+  from = Port_GetThread(xTaskGetCurrentTaskHandle());
+  vTaskSwitchContext();
+  Port_Switch(from, Port_GetThread(xTaskGetCurrentTaskHandle()));
+  vPortExitCritical();
+}
+
+/**
+  * @brief  Block the tick in the calling thread
+  * @retval None
+  */
+void vPortDisableInterrupts(void) {
+  pthread_sigmask(SIG_BLOCK, &tick_signal, NULL);
+}
+
+/**
+  * @brief  Unblock the tick in the calling thread
+  * @retval None
+  */
+void vPortEnableInterrupts(void) {
+  pthread_sigmask(SIG_UNBLOCK, &tick_signal, NULL);
+}
+
+/**
+  * @brief  Enter a critical section
+  * @retval None
+  */
+void vPortEnterCritical(void) {
+  if (critical_nesting == 0U) {
+    vPortDisableInterrupts();
+  }
+  critical_nesting++;
+}
+
+/**
+  * @brief  Leave a critical section, unblocking the tick at the outermost
+  * @retval None
+  */
+void vPortExitCritical(void) {
+  critical_nesting--;
+  if (critical_nesting == 0U) {
+    vPortEnableInterrupts();
+  }
+}
+
+/**
+  * @brief  End the thread of a deleted task
+  * @note   Called by the kernel before it frees the TCB, from another task
+  *         or from the idle task once the deleted task has switched out
+  * @param  pxTaskToDelete: TCB of the task
+  * @retval None
+  */
+void vPortCancelThread(void* pxTaskToDelete) {
+  Port_Thread_t* thread = Port_GetThread((TaskHandle_t)pxTaskToDelete);
+
+  if (pthread_equal(thread->thread, pthread_self())) {
+    return;
+  }
+
+  pthread_mutex_lock(&thread->lock);
+  thread->dying = true;
+  pthread_cond_signal(&thread->wake);
+  pthread_mutex_unlock(&thread->lock);
+  pthread_join(thread->thread, NULL);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Entry of a task thread
+  * @param  argument: Thread state
+  * @retval void*: Not reached while the task exists
+  */
+static void* Port_ThreadStart(void* argument) {
+  Port_Thread_t* self = argument;
+
+  Port_Suspend(self);
+
+  /* First switched to: from outside any critical section */
+  critical_nesting = 0;
+  vPortEnableInterrupts();
+  self->code(self->parameters);
+
+  Port_Fail("task function returned");
+  return NULL;
+}
+
+/**
+  * @brief  Get the thread of a task
+  * @param  task: Task handle, the TCB
+  * @retval Port_Thread_t*: Its thread state, the TCB's top of stack
+  */
+static Port_Thread_t* Port_GetThread(TaskHandle_t task) {
+  return *(Port_Thread_t**)task;
+}
+
+/**
+  * @brief  Run another thread and wait until switched back to
+  * @note   The caller has the tick blocked
+  * @param  from: Thread calling
+  * @param  to: Thread to run
+  * @retval None
+  */
+static void Port_Switch(Port_Thread_t* from, Port_Thread_t* to) {
+  if (from == to) {
+    return;
+  }
+
+  from->nesting = critical_nesting;
+  Port_Resume(to);
+  Port_Suspend(from);
+  critical_nesting = from->nesting;
+}
+
+/**
+  * @brief  Wait until another thread switches to this one
+  * @param  self: Thread calling
+  * @retval None
+  */
+static void Port_Suspend(Port_Thread_t* self) {
+  pthread_mutex_lock(&self->lock);
+  while (!self->resumed && !self->dying) {
+    pthread_cond_wait(&self->wake, &self->lock);
+  }
+  self->resumed = false;
+  if (self->dying) {
+    pthread_mutex_unlock(&self->lock);
+    pthread_exit(NULL);
+  }
+  pthread_mutex_unlock(&self->lock);
+}
+
+/**
+  * @brief  Let a waiting thread run
+  * @param  thread: Thread to wake
+  * @retval None
+  */
+static void Port_Resume(Port_Thread_t* thread) {
+  pthread_mutex_lock(&thread->lock);
+  thread->resumed = true;
+  pthread_cond_signal(&thread->wake);
+  pthread_mutex_unlock(&thread->lock);
+}
+
+/**
+  * @brief  Tick signal handler, on the running task's thread
+  * @note   SIGALRM stays blocked until it returns, as in a critical section
+  * @param  sig: SIGALRM
+  * @retval None
+  */
+static void Port_Tick(int sig) {
+  Port_Thread_t* from = Port_GetThread(xTaskGetCurrentTaskHandle());
+
+  (void)sig;
+
+  critical_nesting++;
+  if (xTaskIncrementTick() != pdFALSE) {
+    vTaskSwitchContext();
+    Port_Switch(from, Port_GetThread(xTaskGetCurrentTaskHandle()));
+  }
+  critical_nesting--;
+}
+
+/**
+  * @brief  Report a port failure and end the program
+  * @param  what: Failure
+  * @retval None
+  */
+static void Port_Fail(const char* what) {
+  fprintf(stderr, "port: %s\n", what);
+  _exit(1);
+}
@@ -0,0 +1,94 @@
+/**
+  ******************************************************************************
+  * @file    portmacro.h
+  * @brief   FreeRTOS port of the host simulation: types and macros
+  ******************************************************************************
+  * @attention
+  *
+  * A port for a Linux host, after the design of the FreeRTOS GCC/Posix
+  * port: every task is a host thread and only the one the kernel selected
+  * runs, the tick is the SIGALRM interval timer, and interrupts disabled
+  * means SIGALRM blocked in the calling thread. Sim/Inc/portmacro.h
+  * includes this one and adjusts it for the simulated interrupts.
+  *
+  * A stack word is 32 bits, as on the target, so the stack depths the
+  * firmware gives stay byte sizes it can reason about; pointers are the
+  * host's.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SIM_PORT_PORTMACRO_H
+#define __SIM_PORT_PORTMACRO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Type definitions ----------------------------------------------------------*/
+#define portCHAR              char
+#define portFLOAT             float
+#define portDOUBLE            double
+#define portLONG              long
+#define portSHORT             short
+#define portSTACK_TYPE        uint32_t
+#define portBASE_TYPE         long
+#define portPOINTER_SIZE_TYPE uintptr_t
+
+typedef portSTACK_TYPE StackType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#if (configUSE_16_BIT_TICKS == 1)
+#error The simulation port has 32-bit ticks only
+#endif
+typedef uint32_t TickType_t;
+#define portMAX_DELAY         ((TickType_t)0xFFFFFFFFUL)
+#define portTICK_TYPE_IS_ATOMIC 1
+
+/* Architecture specifics ----------------------------------------------------*/
+#define portSTACK_GROWTH      (-1)
+#define portHAS_STACK_OVERFLOW_CHECKING 1
+#define portTICK_PERIOD_MS    ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portTICK_USEC         (1000000UL / configTICK_RATE_HZ)
+#define portBYTE_ALIGNMENT    8
+#define portNOP()             __asm volatile ("nop")
+
+/* Scheduler utilities -------------------------------------------------------*/
+void vPortYield(void);
+
+#define portYIELD()                           vPortYield()
+#define portEND_SWITCHING_ISR(xSwitchRequired) do { if (xSwitchRequired) { vPortYield(); } } while (0)
+#define portYIELD_FROM_ISR(x)                 portEND_SWITCHING_ISR(x)
+
+/* Critical sections ---------------------------------------------------------*/
+void vPortDisableInterrupts(void);
+void vPortEnableInterrupts(void);
+void vPortEnterCritical(void);
+void vPortExitCritical(void);
+
+/* Interrupts already run with the tick blocked */
+#define portSET_INTERRUPT_MASK_FROM_ISR()         0
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(x)      ((void)(x))
+#define portDISABLE_INTERRUPTS()                  vPortDisableInterrupts()
+#define portENABLE_INTERRUPTS()                   vPortEnableInterrupts()
+#define portENTER_CRITICAL()                      vPortEnterCritical()
+#define portEXIT_CRITICAL()                       vPortExitCritical()
+
+/* Task function macros ------------------------------------------------------*/
+#define portTASK_FUNCTION_PROTO(vFunction, pvParameters) void vFunction(void* pvParameters)
+#define portTASK_FUNCTION(vFunction, pvParameters)       void vFunction(void* pvParameters)
+
+/* The thread of a deleted task ends once the kernel frees its TCB */
+void vPortCancelThread(void* pxTaskToDelete);
+#define portCLEAN_UP_TCB(pxTCB)  vPortCancelThread(pxTCB)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_PORT_PORTMACRO_H */
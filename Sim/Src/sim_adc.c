@@ -0,0 +1,653 @@
+/**
+  ******************************************************************************
+  * @file    sim_adc.c
+  * @brief   Host simulation of ADC1, in place of the ADC HAL
+  ******************************************************************************
+  * @attention
+  *
+  * The ADC HAL (stm32l4xx_hal_adc.c and _ex.c) is replaced by the subset
+  * of it the firmware calls, keeping its handle states and callbacks. The
+  * regular sequence, the sampling times and the watchdogs are held here
+  * rather than decoded from SQR, SMPR and TR; the status and interrupt
+  * enable registers are the mapped ones, so the __HAL_ADC flag and
+  * interrupt macros work as on the target.
+  *
+  * A scan starts on the selected edge of the external trigger, or at once
+  * for a software start, and takes the sampling and conversion time of
+  * its ranks at the 4 MHz ADC clock times the oversampling ratio. Each
+  * step's triggers arrive together; those left over when the ADC has been
+  * busy for the whole step are lost, as triggers during a conversion are
+  * on the target. Each result goes to DMA1 channel 1.
+  *
+  * The inputs come from the LED model: the current sense amplifier gives
+  * 1 mV per 10 mA, the temperature dividers 1 mV per 10 centi-degrees,
+  * both as the firmware's default scaling. Scans started by the strobe or
+  * the PWM-synchronous triggers sample inside the pulse and see the
+  * on-state current, the others the mean. VREFINT and the die sensor
+  * follow the factory values in system memory. Every conversion gets
+  * uniform noise of +/-SIM_ADC_NOISE counts (default 2). The analog
+  * supply is SIM_VDDA_MV (default 3300), changed by the control thread's
+  * vdda command.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "stm32l4xx_hal.h"
+#include "val_channels.h"
+#include <math.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_ADC_CLOCK_HZ      4000000U
+#define SIM_ADC_RANKS         16U
+#define SIM_ADC_FULL_SCALE    4095U
+#define SIM_ADC_QUEUE_MAX     64U
+#define SIM_ADC_CHANNEL_VREFINT 0U
+#define SIM_ADC_CHANNEL_TEMPSENSOR 17U
+#define SIM_TS_CAL_VDDA_MV    3000
+#define SIM_TS_CAL1_CDEG      3000
+#define SIM_TS_CAL2_CDEG      13000
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  bool enabled;
+  uint32_t channel;         /* Decimal channel number */
+  uint32_t high;            /* Thresholds at the watchdog's resolution */
+  uint32_t low;
+} Sim_AdcWatchdog_t;
+
+/* Private variables ---------------------------------------------------------*/
+static ADC_HandleTypeDef* handle = NULL;
+static uint8_t rank_channel[SIM_ADC_RANKS];
+static uint8_t rank_sampling[SIM_ADC_RANKS];
+static Sim_AdcWatchdog_t watchdogs[3];
+
+static bool armed = false;              /* Started, waiting for triggers */
+static bool dma_mode = false;
+static bool busy = false;
+static bool in_pulse = false;           /* Scan started inside a light pulse */
+static uint32_t busy_left_ns = 0;
+static uint32_t queued = 0;             /* Triggers of this step not yet served */
+static uint32_t isr_flags = 0;
+static uint32_t vdda_mv = 3300;
+static uint32_t noise_counts = 2;
+static uint32_t noise_state = 0x2545F491U;
+
+/* Sampling cycles x 2 of the SMP settings, with the 12.5 conversion cycles */
+static const uint16_t scan_half_cycles[8] = {30, 38, 50, 74, 120, 210, 520, 1306};
+
+/* Private function prototypes -----------------------------------------------*/
+static void Sim_Adc_Init(void);
+static void Sim_Adc_Sync(void);
+static void Sim_Adc_Advance(uint32_t ns);
+static void Sim_Adc_Lines(void);
+static void Sim_Adc_Begin(void);
+static void Sim_Adc_Complete(void);
+static uint32_t Sim_Adc_ScanNs(void);
+static uint32_t Sim_Adc_Ratio(void);
+static float Sim_Adc_InputCounts(uint32_t rank);
+static uint32_t Sim_Adc_Noise(void);
+static void Sim_Adc_DmaConvCplt(DMA_HandleTypeDef* hdma);
+static void Sim_Adc_DmaHalfConvCplt(DMA_HandleTypeDef* hdma);
+static void Sim_Adc_DmaError(DMA_HandleTypeDef* hdma);
+
+/* Exported variables --------------------------------------------------------*/
+const Sim_Model_t Sim_AdcModel = {
+  Sim_Adc_Init, Sim_Adc_Sync, Sim_Adc_Advance, Sim_Adc_Lines
+};
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Trigger output of a timer changed
+  * @param  source: ADC_EXTERNALTRIG_x of the output
+  * @param  rising: true for a rising edge
+  * @retval None
+  */
+void Sim_Adc_Trigger(uint32_t source, bool rising) {
+  uint32_t edge;
+
+  if (handle == NULL || !armed || handle->Init.ExternalTrigConv != source) {
+    return;
+  }
+
+  edge = handle->Init.ExternalTrigConvEdge;
+  if (edge == ADC_EXTERNALTRIGCONVEDGE_RISINGFALLING ||
+      edge == (rising ? ADC_EXTERNALTRIGCONVEDGE_RISING : ADC_EXTERNALTRIGCONVEDGE_FALLING)) {
+    in_pulse = (source == ADC_EXTERNALTRIG_T15_TRGO || source == ADC_EXTERNALTRIG_T1_TRGO2);
+    if (!busy) {
+      Sim_Adc_Begin();
+    } else if (queued < SIM_ADC_QUEUE_MAX) {
+      queued++;
+    }
+  }
+}
+
+/**
+  * @brief  Get the analog supply
+  * @retval uint32_t: Millivolts
+  */
+uint32_t Sim_Adc_GetVdda(void) {
+  return vdda_mv;
+}
+
+/**
+  * @brief  Set the analog supply
+  * @param  mv: Millivolts, 1710 to 3600
+  * @retval None
+  */
+void Sim_Adc_SetVdda(uint32_t mv) {
+  vdda_mv = (mv < 1710U) ? 1710U : (mv > 3600U) ? 3600U : mv;
+}
+
+/* ADC HAL -------------------------------------------------------------------*/
+
+/**
+  * @brief  Initialize the ADC, running the MSP initialization the first time
+  * @param  hadc: ADC handle
+  * @retval HAL_StatusTypeDef: HAL_ERROR while a conversion runs
+  */
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef* hadc) {
+  if (hadc == NULL) {
+    return HAL_ERROR;
+  }
+
+  if (hadc->State == HAL_ADC_STATE_RESET) {
+    hadc->ErrorCode = HAL_ADC_ERROR_NONE;
+    hadc->Lock = HAL_UNLOCKED;
+    HAL_ADC_MspInit(hadc);
+  }
+  if (busy) {
+    return HAL_ERROR;
+  }
+
+  handle = hadc;
+  SET_BIT(hadc->Instance->CR, ADC_CR_ADVREGEN);
+  hadc->State = HAL_ADC_STATE_READY;
+  return HAL_OK;
+}
+
+/**
+  * @brief  Reset the ADC and run the MSP de-initialization
+  * @param  hadc: ADC handle
+  * @retval HAL_StatusTypeDef: HAL_OK
+  */
+HAL_StatusTypeDef HAL_ADC_DeInit(ADC_HandleTypeDef* hadc) {
+  (void)HAL_ADC_Stop_DMA(hadc);
+  memset(watchdogs, 0, sizeof(watchdogs));
+  hadc->Instance->IER = 0;
+  hadc->Instance->CR = 0;
+  HAL_ADC_MspDeInit(hadc);
+  hadc->ErrorCode = HAL_ADC_ERROR_NONE;
+  hadc->State = HAL_ADC_STATE_RESET;
+  return HAL_OK;
+}
+
+/**
+  * @brief  Put a channel into the regular sequence
+  * @param  hadc: ADC handle
+  * @param  sConfig: Channel, rank and sampling time
+  * @retval HAL_StatusTypeDef: HAL_ERROR for a bad rank or while converting
+  */
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef* hadc, const ADC_ChannelConfTypeDef* sConfig) {
+  uint32_t sqr = (sConfig->Rank & ADC_REG_SQRX_REGOFFSET_MASK) >> 8;
+  uint32_t index = sqr * 5U + (sConfig->Rank & ADC_REG_RANK_ID_SQRX_MASK) / 6U - 1U;
+
+  if (index >= SIM_ADC_RANKS || busy) {
+    return HAL_ERROR;
+  }
+  (void)hadc;
+
+  rank_channel[index] = (uint8_t)__LL_ADC_CHANNEL_TO_DECIMAL_NB(sConfig->Channel);
+  rank_sampling[index] = (uint8_t)(sConfig->SamplingTime & 7U);
+  return HAL_OK;
+}
+
+/**
+  * @brief  Configure an analog watchdog on a single channel
+  * @note   Watchdogs 2 and 3 compare the 8 MSBs, as on the target
+  * @param  hadc: ADC handle
+  * @param  AnalogWDGConfig: Watchdog settings
+  * @retval HAL_StatusTypeDef: HAL_ERROR while converting
+  */
+HAL_StatusTypeDef HAL_ADC_AnalogWDGConfig(ADC_HandleTypeDef* hadc, const ADC_AnalogWDGConfTypeDef* AnalogWDGConfig) {
+  uint32_t index;
+  uint32_t shift;
+
+  if (busy) {
+    return HAL_ERROR;
+  }
+
+  index = (AnalogWDGConfig->WatchdogNumber == ADC_ANALOGWATCHDOG_1) ? 0U :
+          (AnalogWDGConfig->WatchdogNumber == ADC_ANALOGWATCHDOG_2) ? 1U : 2U;
+  shift = (index == 0U) ? 0U : 4U;
+
+  watchdogs[index].enabled = (AnalogWDGConfig->WatchdogMode != ADC_ANALOGWATCHDOG_NONE);
+  watchdogs[index].channel = __LL_ADC_CHANNEL_TO_DECIMAL_NB(AnalogWDGConfig->Channel);
+  watchdogs[index].high = AnalogWDGConfig->HighThreshold >> shift;
+  watchdogs[index].low = AnalogWDGConfig->LowThreshold >> shift;
+
+  if (AnalogWDGConfig->ITMode == ENABLE) {
+    __HAL_ADC_ENABLE_IT(hadc, ADC_IT_AWD1 << index);
+  } else {
+    __HAL_ADC_DISABLE_IT(hadc, ADC_IT_AWD1 << index);
+  }
+  return HAL_OK;
+}
+
+/**
+  * @brief  Calibrate the ADC
+  * @param  hadc: ADC handle
+  * @param  SingleDiff: ADC_SINGLE_ENDED or ADC_DIFFERENTIAL_ENDED
+  * @retval HAL_StatusTypeDef: HAL_OK
+  */
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef* hadc, uint32_t SingleDiff) {
+  (void)SingleDiff;
+  hadc->Instance->CALFACT = 0;
+  return HAL_OK;
+}
+
+/**
+  * @brief  Start regular conversions without DMA
+  * @param  hadc: ADC handle
+  * @retval HAL_StatusTypeDef: HAL_BUSY if already started
+  */
+HAL_StatusTypeDef HAL_ADC_Start(ADC_HandleTypeDef* hadc) {
+  if (armed) {
+    return HAL_BUSY;
+  }
+
+  handle = hadc;
+  armed = true;
+  dma_mode = false;
+  hadc->State = HAL_ADC_STATE_REG_BUSY;
+  SET_BIT(hadc->Instance->CR, ADC_CR_ADEN | ADC_CR_ADSTART);
+  if (hadc->Init.ExternalTrigConv == ADC_SOFTWARE_START) {
+    Sim_Adc_Begin();
+  }
+  return HAL_OK;
+}
+
+/**
+  * @brief  Start regular conversions with DMA to a buffer
+  * @param  hadc: ADC handle
+  * @param  pData: Destination buffer
+  * @param  Length: Number of conversions in the buffer
+  * @retval HAL_StatusTypeDef: HAL_BUSY if already started, HAL_ERROR if the
+  *         DMA could not start
+  */
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef* hadc, uint32_t* pData, uint32_t Length) {
+  if (armed) {
+    return HAL_BUSY;
+  }
+
+  hadc->ErrorCode = HAL_ADC_ERROR_NONE;
+  hadc->DMA_Handle->XferCpltCallback = Sim_Adc_DmaConvCplt;
+  hadc->DMA_Handle->XferHalfCpltCallback = Sim_Adc_DmaHalfConvCplt;
+  hadc->DMA_Handle->XferErrorCallback = Sim_Adc_DmaError;
+  __HAL_ADC_CLEAR_FLAG(hadc, (ADC_FLAG_EOC | ADC_FLAG_EOS | ADC_FLAG_OVR));
+  __HAL_ADC_ENABLE_IT(hadc, ADC_IT_OVR);
+
+  if (HAL_DMA_Start_IT(hadc->DMA_Handle, (uint32_t)(uintptr_t)&hadc->Instance->DR,
+                       (uint32_t)(uintptr_t)pData, Length) != HAL_OK) {
+    hadc->ErrorCode |= HAL_ADC_ERROR_DMA;
+    return HAL_ERROR;
+  }
+
+  SET_BIT(hadc->Instance->CFGR, ADC_CFGR_DMAEN | ADC_CFGR_DMACFG);
+  if (HAL_ADC_Start(hadc) != HAL_OK) {
+    return HAL_ERROR;
+  }
+  dma_mode = true;
+  return HAL_OK;
+}
+
+/**
+  * @brief  Stop regular conversions
+  * @param  hadc: ADC handle
+  * @retval HAL_StatusTypeDef: HAL_OK
+  */
+HAL_StatusTypeDef HAL_ADC_Stop(ADC_HandleTypeDef* hadc) {
+  armed = false;
+  busy = false;
+  queued = 0;
+  /* Stopped before MX_ADC1_Init: the target reads and writes around
+   * address 0 then, which the host does not map */
+  if (hadc->Instance == NULL) {
+    return HAL_OK;
+  }
+  CLEAR_BIT(hadc->Instance->CR, ADC_CR_ADSTART | ADC_CR_ADEN);
+  if (hadc->State != HAL_ADC_STATE_RESET) {
+    hadc->State = HAL_ADC_STATE_READY;
+  }
+  return HAL_OK;
+}
+
+/**
+  * @brief  Stop regular conversions and their DMA transfer
+  * @param  hadc: ADC handle
+  * @retval HAL_StatusTypeDef: HAL_OK
+  */
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef* hadc) {
+  (void)HAL_ADC_Stop(hadc);
+  if (hadc->Instance == NULL) {
+    return HAL_OK;
+  }
+  if (dma_mode && hadc->DMA_Handle != NULL) {
+    (void)HAL_DMA_Abort(hadc->DMA_Handle);
+  }
+  dma_mode = false;
+  CLEAR_BIT(hadc->Instance->CFGR, ADC_CFGR_DMAEN | ADC_CFGR_DMACFG);
+  __HAL_ADC_DISABLE_IT(hadc, ADC_IT_OVR);
+  return HAL_OK;
+}
+
+/**
+  * @brief  Get the last conversion result
+  * @param  hadc: ADC handle
+  * @retval uint32_t: Data register
+  */
+uint32_t HAL_ADC_GetValue(const ADC_HandleTypeDef* hadc) {
+  return hadc->Instance->DR;
+}
+
+/**
+  * @brief  Get the handle state
+  * @param  hadc: ADC handle
+  * @retval uint32_t: HAL_ADC_STATE_x bits
+  */
+uint32_t HAL_ADC_GetState(const ADC_HandleTypeDef* hadc) {
+  return hadc->State;
+}
+
+/**
+  * @brief  Get the errors since the last start
+  * @param  hadc: ADC handle
+  * @retval uint32_t: HAL_ADC_ERROR_x bits
+  */
+uint32_t HAL_ADC_GetError(const ADC_HandleTypeDef* hadc) {
+  return hadc->ErrorCode;
+}
+
+/**
+  * @brief  ADC interrupt: watchdogs and overrun
+  * @param  hadc: ADC handle
+  * @retval None
+  */
+void HAL_ADC_IRQHandler(ADC_HandleTypeDef* hadc) {
+  uint32_t active = hadc->Instance->ISR & hadc->Instance->IER & ~SIM_W1C_CANARY;
+
+  if ((active & ADC_FLAG_AWD1) != 0U) {
+    SET_BIT(hadc->State, HAL_ADC_STATE_AWD1);
+    HAL_ADC_LevelOutOfWindowCallback(hadc);
+    __HAL_ADC_CLEAR_FLAG(hadc, ADC_FLAG_AWD1);
+  }
+  if ((active & ADC_FLAG_AWD2) != 0U) {
+    SET_BIT(hadc->State, HAL_ADC_STATE_AWD2);
+    HAL_ADCEx_LevelOutOfWindow2Callback(hadc);
+    __HAL_ADC_CLEAR_FLAG(hadc, ADC_FLAG_AWD2);
+  }
+  if ((active & ADC_FLAG_AWD3) != 0U) {
+    SET_BIT(hadc->State, HAL_ADC_STATE_AWD3);
+    HAL_ADCEx_LevelOutOfWindow3Callback(hadc);
+    __HAL_ADC_CLEAR_FLAG(hadc, ADC_FLAG_AWD3);
+  }
+  if ((active & (ADC_FLAG_EOC | ADC_FLAG_EOS)) != 0U) {
+    if (!dma_mode) {
+      HAL_ADC_ConvCpltCallback(hadc);
+    }
+    __HAL_ADC_CLEAR_FLAG(hadc, (ADC_FLAG_EOC | ADC_FLAG_EOS));
+  }
+  if ((active & ADC_FLAG_OVR) != 0U) {
+    SET_BIT(hadc->State, HAL_ADC_STATE_REG_OVR);
+    SET_BIT(hadc->ErrorCode, HAL_ADC_ERROR_OVR);
+    HAL_ADC_ErrorCallback(hadc);
+    __HAL_ADC_CLEAR_FLAG(hadc, ADC_FLAG_OVR);
+  }
+}
+
+__weak void HAL_ADC_MspInit(ADC_HandleTypeDef* hadc) {
+  (void)hadc;
+}
+
+__weak void HAL_ADC_MspDeInit(ADC_HandleTypeDef* hadc) {
+  (void)hadc;
+}
+
+__weak void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) {
+  (void)hadc;
+}
+
+__weak void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc) {
+  (void)hadc;
+}
+
+__weak void HAL_ADC_LevelOutOfWindowCallback(ADC_HandleTypeDef* hadc) {
+  (void)hadc;
+}
+
+__weak void HAL_ADCEx_LevelOutOfWindow2Callback(ADC_HandleTypeDef* hadc) {
+  (void)hadc;
+}
+
+__weak void HAL_ADCEx_LevelOutOfWindow3Callback(ADC_HandleTypeDef* hadc) {
+  (void)hadc;
+}
+
+__weak void HAL_ADC_ErrorCallback(ADC_HandleTypeDef* hadc) {
+  (void)hadc;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Reset state and read the settings
+  * @retval None
+  */
+static void Sim_Adc_Init(void) {
+  handle = NULL;
+  armed = false;
+  busy = false;
+  queued = 0;
+  isr_flags = 0;
+  memset(watchdogs, 0, sizeof(watchdogs));
+  ADC1->ISR = SIM_W1C_CANARY;
+  Sim_Adc_SetVdda((uint32_t)Sim_GetEnvNumber("SIM_VDDA_MV", 3300.0));
+  noise_counts = (uint32_t)Sim_GetEnvNumber("SIM_ADC_NOISE", 2.0);
+}
+
+/**
+  * @brief  Apply flag clears
+  * @retval None
+  */
+static void Sim_Adc_Sync(void) {
+  Sim_SyncW1C(&ADC1->ISR, &isr_flags);
+}
+
+/**
+  * @brief  Run conversions for a step
+  * @param  ns: Time step
+  * @retval None
+  */
+static void Sim_Adc_Advance(uint32_t ns) {
+  while (busy) {
+    if (busy_left_ns > ns) {
+      busy_left_ns -= ns;
+      break;
+    }
+    ns -= busy_left_ns;
+    Sim_Adc_Complete();
+    if (queued > 0U) {
+      queued--;
+      Sim_Adc_Begin();
+    }
+  }
+  /* Triggers during a conversion that outlasted the step */
+  queued = 0;
+}
+
+/**
+  * @brief  Raise the ADC interrupt line
+  * @retval None
+  */
+static void Sim_Adc_Lines(void) {
+  if ((isr_flags & ADC1->IER) != 0U) {
+    Sim_RaiseIrq(ADC1_IRQn);
+  }
+}
+
+/**
+  * @brief  Start a scan
+  * @retval None
+  */
+static void Sim_Adc_Begin(void) {
+  busy = true;
+  busy_left_ns = Sim_Adc_ScanNs();
+}
+
+/**
+  * @brief  End of a scan: convert every rank, compare, store by DMA
+  * @retval None
+  */
+static void Sim_Adc_Complete(void) {
+  uint32_t ratio = Sim_Adc_Ratio();
+  uint32_t shift = (handle->Init.OversamplingMode == ENABLE) ?
+                   (handle->Init.Oversampling.RightBitShift >> ADC_CFGR2_OVSS_Pos) : 0U;
+  uint32_t ranks = handle->Init.NbrOfConversion;
+
+  busy = false;
+  if (ranks > SIM_ADC_RANKS) {
+    ranks = SIM_ADC_RANKS;
+  }
+
+  for (uint32_t rank = 0; rank < ranks; rank++) {
+    float counts = Sim_Adc_InputCounts(rank);
+    float spread = (float)noise_counts * sqrtf((float)ratio);
+    float sum = counts * (float)ratio + spread * (2.0f * (float)Sim_Adc_Noise() / 4294967295.0f - 1.0f);
+    uint32_t full = SIM_ADC_FULL_SCALE * ratio;
+    uint32_t value = (sum <= 0.0f) ? 0U : (sum >= (float)full) ? full : (uint32_t)(sum + 0.5f);
+    uint32_t value12;
+
+    value >>= shift;
+    value12 = (handle->Init.OversamplingMode == ENABLE) ? (value >> 4) : value;
+
+    for (uint32_t w = 0; w < 3U; w++) {
+      uint32_t compared = (w == 0U) ? value12 : (value12 >> 4);
+
+      if (watchdogs[w].enabled && watchdogs[w].channel == rank_channel[rank] &&
+          (compared > watchdogs[w].high || compared < watchdogs[w].low)) {
+        isr_flags |= ADC_FLAG_AWD1 << w;
+      }
+    }
+
+    ADC1->DR = value;
+    if (dma_mode && !Sim_Dma_Write(DMA1_Channel1, value)) {
+      isr_flags |= ADC_FLAG_OVR;
+    }
+  }
+
+  isr_flags |= ADC_FLAG_EOC | ADC_FLAG_EOS | ADC_FLAG_EOSMP;
+  ADC1->ISR = isr_flags | SIM_W1C_CANARY;
+}
+
+/**
+  * @brief  Duration of a scan
+  * @retval uint32_t: Nanoseconds
+  */
+static uint32_t Sim_Adc_ScanNs(void) {
+  uint64_t half_cycles = 0;
+  uint32_t ranks = (handle->Init.NbrOfConversion > SIM_ADC_RANKS) ? SIM_ADC_RANKS : handle->Init.NbrOfConversion;
+
+  for (uint32_t rank = 0; rank < ranks; rank++) {
+    half_cycles += scan_half_cycles[rank_sampling[rank]];
+  }
+  return (uint32_t)(half_cycles * Sim_Adc_Ratio() * 1000000000ULL / (2ULL * SIM_ADC_CLOCK_HZ));
+}
+
+/**
+  * @brief  Oversampling ratio in use
+  * @retval uint32_t: 1 to 256
+  */
+static uint32_t Sim_Adc_Ratio(void) {
+  if (handle->Init.OversamplingMode != ENABLE) {
+    return 1U;
+  }
+  return 2UL << (handle->Init.Oversampling.Ratio >> ADC_CFGR2_OVSR_Pos);
+}
+
+/**
+  * @brief  Noise-free 12-bit value of a rank's input
+  * @param  rank: Rank, from 0
+  * @retval float: Counts
+  */
+static float Sim_Adc_InputCounts(uint32_t rank) {
+  uint32_t channel = rank_channel[rank];
+  float counts_per_mv = (float)SIM_ADC_FULL_SCALE / (float)vdda_mv;
+
+  if (channel == SIM_ADC_CHANNEL_VREFINT) {
+    return (float)*VREFINT_CAL_ADDR * (float)SIM_TS_CAL_VDDA_MV / (float)vdda_mv;
+  }
+  if (channel == SIM_ADC_CHANNEL_TEMPSENSOR) {
+    float cal1 = (float)*TEMPSENSOR_CAL1_ADDR;
+    float cal2 = (float)*TEMPSENSOR_CAL2_ADDR;
+    float cdeg = (float)Sim_Led_GetDieTemperatureCdeg();
+    float at_cal = cal1 + (cal2 - cal1) * (cdeg - SIM_TS_CAL1_CDEG) / (SIM_TS_CAL2_CDEG - SIM_TS_CAL1_CDEG);
+
+    return at_cal * (float)SIM_TS_CAL_VDDA_MV / (float)vdda_mv;
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    if (rank == VAL_Channels[i].current_rank) {
+      int32_t ma = in_pulse ? Sim_Led_GetOnCurrentMa(i) : Sim_Led_GetCurrentMa(i);
+
+      return (float)ma / 10.0f * counts_per_mv;
+    }
+    if (rank == VAL_Channels[i].temperature_rank) {
+      return (float)Sim_Led_GetTemperatureCdeg(i) / 10.0f * counts_per_mv;
+    }
+  }
+  return 0.0f;
+}
+
+/**
+  * @brief  Next pseudo-random number, xorshift32
+  * @retval uint32_t: Uniform over 1 to 2^32 - 1
+  */
+static uint32_t Sim_Adc_Noise(void) {
+  noise_state ^= noise_state << 13;
+  noise_state ^= noise_state >> 17;
+  noise_state ^= noise_state << 5;
+  return noise_state;
+}
+
+/**
+  * @brief  DMA transfer complete
+  * @param  hdma: DMA handle
+  * @retval None
+  */
+static void Sim_Adc_DmaConvCplt(DMA_HandleTypeDef* hdma) {
+  HAL_ADC_ConvCpltCallback((ADC_HandleTypeDef*)hdma->Parent);
+}
+
+/**
+  * @brief  DMA half transfer complete
+  * @param  hdma: DMA handle
+  * @retval None
+  */
+static void Sim_Adc_DmaHalfConvCplt(DMA_HandleTypeDef* hdma) {
+  HAL_ADC_ConvHalfCpltCallback((ADC_HandleTypeDef*)hdma->Parent);
+}
+
+/**
+  * @brief  DMA transfer error
+  * @param  hdma: DMA handle
+  * @retval None
+  */
+static void Sim_Adc_DmaError(DMA_HandleTypeDef* hdma) {
+  ADC_HandleTypeDef* hadc = (ADC_HandleTypeDef*)hdma->Parent;
+
+  SET_BIT(hadc->ErrorCode, HAL_ADC_ERROR_DMA);
+  HAL_ADC_ErrorCallback(hadc);
+}
@@ -0,0 +1,144 @@
+/**
+  ******************************************************************************
+  * @file    sim_control.c
+  * @brief   Control commands of the host simulation, read from stdin
+  ******************************************************************************
+  * @attention
+  *
+  * A thread outside the scheduler reads one command per line from stdin
+  * and applies it with the models held still (Sim_Lock), so test scripts
+  * can change the environment while the firmware runs:
+  *
+  *   ambient <degC>          ambient temperature of the loads and the MCU
+  *   short <light>           on-state current of a light x1.4
+  *   open <light>            no current through a light
+  *   clear <light>           remove an injected fault
+  *   vdda <mV>               supply, VDDA and VDD (the PVD follows it)
+  *   sync                    pulse on the sync input (PA12, EXTI12, TIM1 ETR)
+  *   reset                   press the reset button
+  *   powercycle              remove power, losing the backup domain
+  *   quit                    end the simulation
+  *
+  * The thread blocks every signal, so the tick and the faults stay with
+  * the kernel's threads. At the end of stdin it ends quietly and the
+  * simulation runs on.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "stm32l4xx_hal.h"
+#include "val_channels.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_SHORT_SCALE       1.4f
+#define SIM_SYNC_EXTI_LINE    12U
+
+/* Private function prototypes -----------------------------------------------*/
+static void* Sim_Control_Thread(void* argument);
+static void Sim_Control_Execute(char* line);
+static bool Sim_Control_Light(const char* argument, uint8_t* light_index);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Start the control thread
+  * @retval None
+  */
+void Sim_Control_Start(void) {
+  pthread_t thread;
+  sigset_t all;
+  sigset_t previous;
+
+  /* The new thread inherits the mask */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &previous);
+  if (pthread_create(&thread, NULL, Sim_Control_Thread, NULL) == 0) {
+    pthread_detach(thread);
+  } else {
+    Sim_Log("no control thread, stdin is ignored");
+  }
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Read and run commands until the end of stdin
+  * @param  argument: Unused
+  * @retval void*: NULL
+  */
+static void* Sim_Control_Thread(void* argument) {
+  char line[128];
+
+  (void)argument;
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+    Sim_Lock();
+    Sim_Control_Execute(line);
+    Sim_Unlock();
+  }
+  return NULL;
+}
+
+/**
+  * @brief  Run one command
+  * @param  line: Command line, modified
+  * @retval None
+  */
+static void Sim_Control_Execute(char* line) {
+  char* command = strtok(line, " \t");
+  char* argument = strtok(NULL, " \t");
+  uint8_t light_index;
+
+  if (command == NULL) {
+    return;
+  }
+
+  if (strcmp(command, "ambient") == 0 && argument != NULL) {
+    Sim_Led_SetAmbient((int32_t)(strtod(argument, NULL) * 100.0));
+  } else if (strcmp(command, "short") == 0 && Sim_Control_Light(argument, &light_index)) {
+    Sim_Led_SetFault(light_index, SIM_SHORT_SCALE);
+  } else if (strcmp(command, "open") == 0 && Sim_Control_Light(argument, &light_index)) {
+    Sim_Led_SetFault(light_index, 0.0f);
+  } else if (strcmp(command, "clear") == 0 && Sim_Control_Light(argument, &light_index)) {
+    Sim_Led_SetFault(light_index, 1.0f);
+  } else if (strcmp(command, "vdda") == 0 && argument != NULL) {
+    Sim_Adc_SetVdda((uint32_t)strtoul(argument, NULL, 10));
+  } else if (strcmp(command, "sync") == 0) {
+    Sim_System_RisingEdge(SIM_SYNC_EXTI_LINE);
+    Sim_Timer_ExternalTrigger(true);
+    Sim_Timer_ExternalTrigger(false);
+  } else if (strcmp(command, "reset") == 0) {
+    Sim_Reset(RCC_CSR_PINRSTF);
+  } else if (strcmp(command, "powercycle") == 0) {
+    Sim_System_ClearBackupDomain();
+    Sim_Reset(RCC_CSR_BORRSTF | RCC_CSR_PINRSTF);
+  } else if (strcmp(command, "quit") == 0) {
+    Sim_Exit(0);
+  } else {
+    Sim_Log("commands: ambient <degC>, short|open|clear <light>, vdda <mV>, sync, reset, powercycle, quit");
+  }
+}
+
+/**
+  * @brief  Parse a light ID argument
+  * @param  argument: Text, may be NULL
+  * @param  light_index: Light ID - 1
+  * @retval bool: true if valid
+  */
+static bool Sim_Control_Light(const char* argument, uint8_t* light_index) {
+  long id = (argument != NULL) ? strtol(argument, NULL, 10) : 0;
+
+  if (id < 1 || id > VAL_LIGHT_COUNT) {
+    return false;
+  }
+  *light_index = (uint8_t)(id - 1);
+  return true;
+}
@@ -0,0 +1,747 @@
+/**
+  ******************************************************************************
+  * @file    sim_core.c
+  * @brief   Host simulation core: address map, NVIC, time and dispatch
+  ******************************************************************************
+  * @attention
+  *
+  * Before main, the STM32 address ranges the firmware touches are mapped
+  * at their real addresses: the peripherals and the Cortex-M core
+  * registers as zeroed memory, the system memory page with the factory
+  * calibration values, and the flash and the reset-proof state from files
+  * in the state directory (SIM_STATE_DIR, default .sim). SystemInit then
+  * runs as from the reset handler.
+  *
+  * The NVIC is kept here rather than in the mapped registers: enables,
+  * priorities and software pending flags. Sim_Step advances every model
+  * to the present and then dispatches: the enabled interrupt with an
+  * active line or a pending flag and the lowest priority value, ties to
+  * the lowest number, runs to completion with IPSR set, and the lines are
+  * evaluated again, until none is left.
+  *
+  * After the scheduler starts, Sim_Step runs from the tick hook, inside
+  * the host port's tick signal handler, so a task is interrupted exactly
+  * where a tick would interrupt it and the kernel switches to a task an
+  * interrupt woke as the tick returns. PRIMASK is whether the calling
+  * thread blocks that signal. Before the scheduler there is no tick
+  * signal: HAL_GetTick and WFI step the models instead, and PRIMASK is a
+  * plain flag.
+  *
+  * Faults (SIGSEGV, SIGBUS, SIGFPE, SIGILL) enter HardFault_Handler as on
+  * the target. A reset executes the binary again, keeping the flash, the
+  * backup domain and the serial port, but not RAM, so the crash record
+  * the firmware keeps in .noinit does not survive it.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "stm32l4xx_hal.h"
+#include "stm32l4xx_it.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_STATE_MAGIC       0x53494D31U   /* "SIM1" */
+#define SIM_IRQ_COUNT         (FPU_IRQn + 1)
+#define SIM_DISPATCH_MAX      64U           /* Handlers per dispatch, against a line stuck high */
+#define SIM_IDLE_SLEEP_NS     200000L       /* Idle and WFI sleep, well below a tick */
+#define SIM_TASK_STACK_WORDS  16384U        /* Host task stack, for the C library's needs */
+
+#define SIM_PERIPH_START      PERIPH_BASE
+#define SIM_PERIPH_END        (AHB2PERIPH_BASE + 0x08061000UL)
+#define SIM_CORE_START        0xE0000000UL
+#define SIM_CORE_END          0xE0100000UL
+#define SIM_SYSMEM_START      0x1FFF0000UL
+#define SIM_SYSMEM_END        0x1FFF8000UL
+
+/* Factory values of a typical part, at 3.0 V */
+#define SIM_VREFINT_CAL       1655U
+#define SIM_TS_CAL1           1035U         /* 30 degC */
+#define SIM_TS_CAL2           1375U         /* 130 degC */
+#define SIM_FLASH_SIZE_KB     256U
+
+/* Private variables ---------------------------------------------------------*/
+Sim_State_t* Sim_State;
+
+static const Sim_Model_t* const models[] = {
+  &Sim_SystemModel, &Sim_TimerModel, &Sim_DmaModel, &Sim_AdcModel, &Sim_UartModel, &Sim_LedModel,
+};
+
+/* Handlers of the interrupts the firmware enables (stm32l4xx_it.c) */
+static void (* const handlers[SIM_IRQ_COUNT])(void) = {
+  [DMA1_Channel1_IRQn]    = DMA1_Channel1_IRQHandler,
+  [DMA1_Channel4_IRQn]    = DMA1_Channel4_IRQHandler,
+  [DMA1_Channel5_IRQn]    = DMA1_Channel5_IRQHandler,
+  [DMA1_Channel6_IRQn]    = DMA1_Channel6_IRQHandler,
+  [ADC1_IRQn]             = ADC1_IRQHandler,
+  [USART1_IRQn]           = USART1_IRQHandler,
+  [TIM7_IRQn]             = TIM7_IRQHandler,
+  [LPTIM1_IRQn]           = LPTIM1_IRQHandler,
+  [TIM2_IRQn]             = TIM2_IRQHandler,
+  [TIM1_UP_TIM16_IRQn]    = TIM1_UP_TIM16_IRQHandler,
+  [TIM1_TRG_COM_IRQn]     = TIM1_TRG_COM_IRQHandler,
+#ifdef BENCHMARK
+  [TIM1_BRK_TIM15_IRQn]   = TIM1_BRK_TIM15_IRQHandler,
+#endif
+  [EXTI9_5_IRQn]          = EXTI9_5_IRQHandler,
+  [EXTI15_10_IRQn]        = EXTI15_10_IRQHandler,
+  [COMP_IRQn]             = COMP_IRQHandler,
+  [PVD_PVM_IRQn]          = PVD_PVM_IRQHandler,
+  [DMA2_Channel2_IRQn]    = DMA2_Channel2_IRQHandler,
+};
+
+static bool irq_enabled[SIM_IRQ_COUNT];
+static bool irq_pending[SIM_IRQ_COUNT];
+static bool irq_line[SIM_IRQ_COUNT];
+static uint8_t irq_priority[SIM_IRQ_COUNT];
+static uint32_t priority_grouping = 0;
+
+static volatile uint32_t ipsr = 0;
+static volatile uint32_t primask_before_start = 0;
+static volatile bool stepping = false;
+
+static uint64_t start_ns = 0;
+static uint64_t stepped_ns = 0;       /* Host time the models have reached */
+
+static pthread_mutex_t control_lock = PTHREAD_MUTEX_INITIALIZER;
+static int saved_argc;
+static char** saved_argv;
+static char state_path[512];
+
+/* Private function prototypes -----------------------------------------------*/
+static void Sim_Start(int argc, char** argv, char** envp) __attribute__((constructor));
+static void Sim_MapRegion(uintptr_t start, uintptr_t end);
+static void Sim_MapState(const char* state_dir);
+static void Sim_PresetRegisters(void);
+static void Sim_Dispatch(void);
+static bool Sim_SchedulerStarted(void);
+static void Sim_FaultHandler(int sig);
+static void Sim_SleepNs(long ns);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Advance the models to the present and run the pending interrupts
+  * @note   Tick signal handler, or HAL_GetTick and WFI before the scheduler
+  * @retval None
+  */
+void Sim_Step(void) {
+  uint64_t now;
+  uint64_t elapsed;
+
+  if (stepping || !Sim_TryLock()) {
+    return;
+  }
+  stepping = true;
+
+  now = Sim_GetNanos();
+  elapsed = now - stepped_ns;
+  stepped_ns = now;
+  if (elapsed > SIM_STEP_MAX_NS) {
+    elapsed = SIM_STEP_MAX_NS;
+  }
+
+  do {
+    uint32_t slice = (elapsed > SIM_SLICE_NS) ? SIM_SLICE_NS : (uint32_t)elapsed;
+
+    for (uint32_t i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+      models[i]->sync();
+    }
+    for (uint32_t i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+      models[i]->advance(slice);
+    }
+    Sim_Dispatch();
+    elapsed -= slice;
+  } while (elapsed > 0U);
+
+  stepping = false;
+  Sim_Unlock();
+}
+
+/**
+  * @brief  Get the host time since start-up
+  * @retval uint64_t: Nanoseconds, from the monotonic clock
+  */
+uint64_t Sim_GetNanos(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec - start_ns;
+}
+
+/**
+  * @brief  Check whether a simulated interrupt or fault is running
+  * @retval bool: true if IPSR is non-zero
+  */
+bool Sim_InInterrupt(void) {
+  return ipsr != 0U;
+}
+
+/**
+  * @brief  Mark an interrupt line active for this dispatch round
+  * @note   Called by the models from their lines function
+  * @param  irq: Interrupt number
+  * @retval None
+  */
+void Sim_RaiseIrq(IRQn_Type irq) {
+  if (irq >= 0 && irq < SIM_IRQ_COUNT) {
+    irq_line[irq] = true;
+  }
+}
+
+/**
+  * @brief  Reset the simulated device
+  * @note   Executes the binary again. The flash and state files are mapped
+  *         shared, so they are on disk already; the serial port is kept
+  *         open for the next run.
+  * @param  reset_flag: RCC_CSR flags the next start reports
+  * @retval None
+  */
+void Sim_Reset(uint32_t reset_flag) {
+  static const struct itimerval stop = {{0, 0}, {0, 0}};
+  char fd_text[16];
+  sigset_t none;
+
+  Sim_State->reset_flags = reset_flag;
+  msync(Sim_State, sizeof(*Sim_State), MS_SYNC);
+  msync((void*)FLASH_BASE, SIM_FLASH_SIZE_KB * 1024U, MS_SYNC);
+
+  /* The interval timer and the signal mask would outlive the exec */
+  setitimer(ITIMER_REAL, &stop, NULL);
+  sigemptyset(&none);
+  pthread_sigmask(SIG_SETMASK, &none, NULL);
+
+  snprintf(fd_text, sizeof(fd_text), "%d", Sim_Uart_Open());
+  setenv("SIM_UART_FD", fd_text, 1);
+  Sim_Log("reset (RCC_CSR 0x%08lx)", (unsigned long)reset_flag);
+  execv("/proc/self/exe", saved_argv);
+
+  Sim_Log("restart failed: %s", strerror(errno));
+  _exit(1);
+}
+
+/**
+  * @brief  End the simulation
+  * @param  code: Process exit status
+  * @retval None
+  */
+void Sim_Exit(int code) {
+  msync(Sim_State, sizeof(*Sim_State), MS_SYNC);
+  msync((void*)FLASH_BASE, SIM_FLASH_SIZE_KB * 1024U, MS_SYNC);
+  _exit(code);
+}
+
+/**
+  * @brief  Write a line to stderr
+  * @note   Async-signal-safe for the formats used here
+  * @param  format: printf format
+  * @retval None
+  */
+void Sim_Log(const char* format, ...) {
+  char line[256];
+  va_list args;
+  int length = snprintf(line, sizeof(line), "sim: ");
+
+  va_start(args, format);
+  length += vsnprintf(&line[length], sizeof(line) - (size_t)length - 1U, format, args);
+  va_end(args);
+  if (length > (int)sizeof(line) - 2) {
+    length = (int)sizeof(line) - 2;
+  }
+  line[length++] = '\n';
+  (void)!write(STDERR_FILENO, line, (size_t)length);
+}
+
+/**
+  * @brief  Read a setting from the environment
+  * @param  name: Variable name
+  * @param  fallback: Value if unset or empty
+  * @retval const char*: Setting
+  */
+const char* Sim_GetEnv(const char* name, const char* fallback) {
+  const char* value = getenv(name);
+
+  return (value != NULL && value[0] != '\0') ? value : fallback;
+}
+
+/**
+  * @brief  Read a numeric setting from the environment
+  * @param  name: Variable name
+  * @param  fallback: Value if unset or not a number
+  * @retval double: Setting
+  */
+double Sim_GetEnvNumber(const char* name, double fallback) {
+  const char* value = getenv(name);
+  char* end;
+  double number;
+
+  if (value == NULL || value[0] == '\0') {
+    return fallback;
+  }
+  number = strtod(value, &end);
+  return (*end == '\0' && isfinite(number)) ? number : fallback;
+}
+
+/**
+  * @brief  Keep the models still while the control thread changes them
+  * @retval None
+  */
+void Sim_Lock(void) {
+  pthread_mutex_lock(&control_lock);
+}
+
+/**
+  * @brief  Take the model lock if it is free
+  * @note   The tick never waits for the control thread; the models catch
+  *         up on the next tick
+  * @retval bool: true if taken
+  */
+bool Sim_TryLock(void) {
+  return pthread_mutex_trylock(&control_lock) == 0;
+}
+
+/**
+  * @brief  Release the model lock
+  * @retval None
+  */
+void Sim_Unlock(void) {
+  pthread_mutex_unlock(&control_lock);
+}
+
+/* Core state behind sim_cmsis.h ---------------------------------------------*/
+
+/**
+  * @brief  Read PRIMASK
+  * @retval uint32_t: 1 if interrupts are masked in the calling context
+  */
+uint32_t Sim_GetPrimask(void) {
+  sigset_t set;
+
+  if (ipsr != 0U) {
+    return 1U;
+  }
+  if (!Sim_SchedulerStarted()) {
+    return primask_before_start;
+  }
+  pthread_sigmask(SIG_BLOCK, NULL, &set);
+  return sigismember(&set, SIGALRM) ? 1U : 0U;
+}
+
+/**
+  * @brief  Write PRIMASK
+  * @note   Ignored in interrupts, which run with the tick signal blocked
+  *         until they return
+  * @param  primask: 1 to mask interrupts, 0 to unmask
+  * @retval None
+  */
+void Sim_SetPrimask(uint32_t primask) {
+  sigset_t set;
+
+  if (ipsr != 0U) {
+    return;
+  }
+  if (!Sim_SchedulerStarted()) {
+    primask_before_start = primask & 1U;
+    return;
+  }
+  sigemptyset(&set);
+  sigaddset(&set, SIGALRM);
+  pthread_sigmask(((primask & 1U) != 0U) ? SIG_BLOCK : SIG_UNBLOCK, &set, NULL);
+}
+
+/**
+  * @brief  Read IPSR
+  * @retval uint32_t: Exception number running, 0 in tasks
+  */
+uint32_t Sim_GetIpsr(void) {
+  return ipsr;
+}
+
+/**
+  * @brief  Wait for an interrupt
+  * @note   Before the scheduler this is where time passes; afterwards the
+  *         tick signal ends the sleep
+  * @retval None
+  */
+void Sim_WaitForInterrupt(void) {
+  if (!Sim_SchedulerStarted() && ipsr == 0U) {
+    Sim_Step();
+  }
+  Sim_SleepNs(SIM_IDLE_SLEEP_NS);
+}
+
+/**
+  * @brief  Breakpoint instruction
+  * @note   No debugger is attached; noted and skipped
+  * @retval None
+  */
+void Sim_Breakpoint(void) {
+  Sim_Log("breakpoint");
+}
+
+/* NVIC (sim_nvic.h) ---------------------------------------------------------*/
+
+void Sim_NVIC_SetPriorityGrouping(uint32_t group) {
+  priority_grouping = group & 7U;
+}
+
+uint32_t Sim_NVIC_GetPriorityGrouping(void) {
+  return priority_grouping;
+}
+
+void Sim_NVIC_EnableIRQ(IRQn_Type irq) {
+  if (irq >= 0 && irq < SIM_IRQ_COUNT) {
+    irq_enabled[irq] = true;
+  }
+}
+
+uint32_t Sim_NVIC_GetEnableIRQ(IRQn_Type irq) {
+  return (irq >= 0 && irq < SIM_IRQ_COUNT && irq_enabled[irq]) ? 1U : 0U;
+}
+
+void Sim_NVIC_DisableIRQ(IRQn_Type irq) {
+  if (irq >= 0 && irq < SIM_IRQ_COUNT) {
+    irq_enabled[irq] = false;
+  }
+}
+
+uint32_t Sim_NVIC_GetPendingIRQ(IRQn_Type irq) {
+  return (irq >= 0 && irq < SIM_IRQ_COUNT && (irq_pending[irq] || irq_line[irq])) ? 1U : 0U;
+}
+
+void Sim_NVIC_SetPendingIRQ(IRQn_Type irq) {
+  if (irq >= 0 && irq < SIM_IRQ_COUNT) {
+    irq_pending[irq] = true;
+  }
+}
+
+void Sim_NVIC_ClearPendingIRQ(IRQn_Type irq) {
+  if (irq >= 0 && irq < SIM_IRQ_COUNT) {
+    irq_pending[irq] = false;
+  }
+}
+
+uint32_t Sim_NVIC_GetActive(IRQn_Type irq) {
+  return (irq >= 0 && ipsr == (uint32_t)irq + 16U) ? 1U : 0U;
+}
+
+void Sim_NVIC_SetPriority(IRQn_Type irq, uint32_t priority) {
+  if (irq >= 0 && irq < SIM_IRQ_COUNT) {
+    irq_priority[irq] = (uint8_t)(priority & 0xFFU);
+  }
+}
+
+uint32_t Sim_NVIC_GetPriority(IRQn_Type irq) {
+  return (irq >= 0 && irq < SIM_IRQ_COUNT) ? irq_priority[irq] : 0U;
+}
+
+void Sim_NVIC_SystemReset(void) {
+  Sim_Reset(RCC_CSR_SFTRSTF | RCC_CSR_PINRSTF);
+}
+
+/* Hooks ---------------------------------------------------------------------*/
+
+/**
+  * @brief  HAL tick, with the models stepped while no scheduler runs
+  * @note   Replaces the weak HAL_GetTick of stm32l4xx_hal.c
+  * @retval uint32_t: Milliseconds counted by the TIM7 interrupt
+  */
+uint32_t HAL_GetTick(void) {
+  if (!Sim_SchedulerStarted() && ipsr == 0U) {
+    Sim_Step();
+  }
+  return uwTick;
+}
+
+/**
+  * @brief  Kernel tick hook: the models run first, then the firmware's hook
+  * @note   Linked in place of vApplicationTickHook (--wrap)
+  * @retval None
+  */
+void __real_vApplicationTickHook(void);
+void __wrap_vApplicationTickHook(void) {
+  Sim_Step();
+  __real_vApplicationTickHook();
+}
+
+/**
+  * @brief  Give statically created tasks a stack the host can run on
+  * @note   Linked in place of xTaskCreateStatic (--wrap). The firmware's
+  *         stack buffer is sized for the target and stays unused, so the
+  *         stack high-water marks are those of the host stacks. They are
+  *         mapped in the low 4 GB, where the firmware's 32-bit casts of
+  *         pointers still hold.
+  * @retval TaskHandle_t: Task created
+  */
+TaskHandle_t __real_xTaskCreateStatic(TaskFunction_t code, const char* const name, const uint32_t depth,
+                                      void* const parameters, UBaseType_t priority,
+                                      StackType_t* const stack, StaticTask_t* const tcb);
+TaskHandle_t __wrap_xTaskCreateStatic(TaskFunction_t code, const char* const name, const uint32_t depth,
+                                      void* const parameters, UBaseType_t priority,
+                                      StackType_t* const stack, StaticTask_t* const tcb) {
+  uint32_t words = (depth > SIM_TASK_STACK_WORDS) ? depth : SIM_TASK_STACK_WORDS;
+  void* host_stack;
+
+  (void)stack;
+
+  /* A task switch inside the C library would hold its lock from the others */
+  vTaskSuspendAll();
+  host_stack = mmap(NULL, words * sizeof(StackType_t), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+  (void)xTaskResumeAll();
+  if (host_stack == MAP_FAILED) {
+    return NULL;
+  }
+
+  return __real_xTaskCreateStatic(code, name, words, parameters, priority, host_stack, tcb);
+}
+
+/**
+  * @brief  Idle hook: the firmware's hook, then sleep the host thread until
+  *         the next tick
+  * @note   Linked in place of vApplicationIdleHook (--wrap)
+  * @retval None
+  */
+void __real_vApplicationIdleHook(void);
+void __wrap_vApplicationIdleHook(void) {
+  __real_vApplicationIdleHook();
+  __WFI();
+}
+
+/**
+  * @brief  SysTick handler named by the CMSIS-RTOS layer
+  * @note   The host port takes the tick from its timer signal instead
+  * @retval None
+  */
+void SysTick_Handler(void) {
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Set up the simulated device before main
+  * @param  argc: Argument count
+  * @param  argv: Arguments, kept for a reset
+  * @param  envp: Environment
+  * @retval None
+  */
+static void Sim_Start(int argc, char** argv, char** envp) {
+  const char* state_dir = Sim_GetEnv("SIM_STATE_DIR", ".sim");
+  struct sigaction fault = {0};
+  struct timespec ts;
+  sigset_t none;
+
+  (void)envp;
+  saved_argc = argc;
+  saved_argv = argv;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  start_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+
+  sigemptyset(&none);
+  sigprocmask(SIG_SETMASK, &none, NULL);
+
+  if (mkdir(state_dir, 0777) != 0 && errno != EEXIST) {
+    Sim_Log("cannot create %s: %s", state_dir, strerror(errno));
+    _exit(1);
+  }
+
+  Sim_MapRegion(SIM_PERIPH_START, SIM_PERIPH_END);
+  Sim_MapRegion(SIM_CORE_START, SIM_CORE_END);
+  Sim_MapRegion(SIM_SYSMEM_START, SIM_SYSMEM_END);
+  Sim_System_MapFlash(state_dir);
+  Sim_MapState(state_dir);
+
+  Sim_PresetRegisters();
+  SystemInit();
+
+  for (uint32_t i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+    models[i]->init();
+  }
+
+  fault.sa_handler = Sim_FaultHandler;
+  sigemptyset(&fault.sa_mask);
+  sigaddset(&fault.sa_mask, SIGALRM);
+  fault.sa_flags = SA_NODEFER;
+  sigaction(SIGSEGV, &fault, NULL);
+  sigaction(SIGBUS, &fault, NULL);
+  sigaction(SIGFPE, &fault, NULL);
+  sigaction(SIGILL, &fault, NULL);
+
+  Sim_Control_Start();
+}
+
+/**
+  * @brief  Map zeroed memory at a fixed address range
+  * @param  start: First address
+  * @param  end: Address after the range
+  * @retval None
+  */
+static void Sim_MapRegion(uintptr_t start, uintptr_t end) {
+  void* mapped = mmap((void*)start, end - start, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+
+  if (mapped != (void*)start) {
+    Sim_Log("cannot map 0x%08lx-0x%08lx: %s", (unsigned long)start, (unsigned long)end,
+            (mapped == MAP_FAILED) ? strerror(errno) : "address taken");
+    _exit(1);
+  }
+}
+
+/**
+  * @brief  Map the reset-proof state, creating it on the first run
+  * @param  state_dir: State directory
+  * @retval None
+  */
+static void Sim_MapState(const char* state_dir) {
+  struct stat info;
+  int fd;
+
+  snprintf(state_path, sizeof(state_path), "%s/state.bin", state_dir);
+  fd = open(state_path, O_RDWR | O_CREAT, 0666);
+  if (fd < 0 || fstat(fd, &info) != 0 ||
+      ((size_t)info.st_size < sizeof(Sim_State_t) && ftruncate(fd, sizeof(Sim_State_t)) != 0)) {
+    Sim_Log("cannot open %s: %s", state_path, strerror(errno));
+    _exit(1);
+  }
+
+  Sim_State = mmap(NULL, sizeof(Sim_State_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (Sim_State == MAP_FAILED) {
+    Sim_Log("cannot map %s: %s", state_path, strerror(errno));
+    _exit(1);
+  }
+
+  /* A new file is a first power-up */
+  if (Sim_State->magic != SIM_STATE_MAGIC) {
+    memset(Sim_State, 0, sizeof(*Sim_State));
+    Sim_State->magic = SIM_STATE_MAGIC;
+    Sim_State->reset_flags = RCC_CSR_BORRSTF | RCC_CSR_PINRSTF;
+  }
+}
+
+/**
+  * @brief  Put the values a reset leaves into the mapped registers
+  * @retval None
+  */
+static void Sim_PresetRegisters(void) {
+  /* Factory data in system memory */
+  *VREFINT_CAL_ADDR = SIM_VREFINT_CAL;
+  *TEMPSENSOR_CAL1_ADDR = SIM_TS_CAL1;
+  *TEMPSENSOR_CAL2_ADDR = SIM_TS_CAL2;
+  *(volatile uint16_t*)FLASHSIZE_BASE = SIM_FLASH_SIZE_KB;
+  ((volatile uint32_t*)UID_BASE)[0] = 0x00320041U;
+  ((volatile uint32_t*)UID_BASE)[1] = 0x5346500DU;
+  ((volatile uint32_t*)UID_BASE)[2] = 0x20373733U;
+
+  /* FPU on with lazy stacking, as the startup code leaves it on the target */
+  SCB->CPACR = (3UL << 20) | (3UL << 22);
+  FPU->FPCCR = FPU_FPCCR_ASPEN_Msk | FPU_FPCCR_LSPEN_Msk;
+
+  /* Clock tree out of reset: MSI at 4 MHz, the LSE running in the backup domain */
+  RCC->CR = RCC_CR_MSION | RCC_CR_MSIRDY | RCC_CR_MSIRANGE_6;
+  RCC->CSR = RCC_CSR_MSISRANGE_4 | Sim_State->reset_flags;
+  RCC->BDCR = RCC_BDCR_LSEON | RCC_BDCR_LSERDY;
+  Sim_State->reset_flags = 0;
+
+  IWDG->RLR = IWDG_RLR_RL;
+}
+
+/**
+  * @brief  Run the pending interrupts in priority order
+  * @retval None
+  */
+static void Sim_Dispatch(void) {
+  /* Interrupts wait while masked before the scheduler runs */
+  if (!Sim_SchedulerStarted() && primask_before_start != 0U) {
+    return;
+  }
+
+  for (uint32_t round = 0; round < SIM_DISPATCH_MAX; round++) {
+    int32_t selected = -1;
+
+    memset(irq_line, 0, sizeof(irq_line));
+    for (uint32_t i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+      models[i]->sync();
+    }
+    for (uint32_t i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+      models[i]->lines();
+    }
+
+    for (int32_t irq = 0; irq < SIM_IRQ_COUNT; irq++) {
+      if (irq_enabled[irq] && (irq_line[irq] || irq_pending[irq]) && handlers[irq] != NULL &&
+          (selected < 0 || irq_priority[irq] < irq_priority[selected])) {
+        selected = irq;
+      }
+    }
+    if (selected < 0) {
+      return;
+    }
+
+    irq_pending[selected] = false;
+    ipsr = (uint32_t)selected + 16U;
+    handlers[selected]();
+    ipsr = 0U;
+
+    if (selected == USART1_IRQn) {
+      Sim_Uart_Dispatched();
+    }
+  }
+}
+
+/**
+  * @brief  Check whether the kernel scheduler runs
+  * @retval bool: true once osKernelStart started it
+  */
+static bool Sim_SchedulerStarted(void) {
+  return xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED;
+}
+
+/**
+  * @brief  Enter the fault handler on a host fault signal
+  * @param  sig: Signal
+  * @retval None
+  */
+static void Sim_FaultHandler(int sig) {
+  static volatile sig_atomic_t in_fault = 0;
+
+  if (in_fault) {
+    Sim_Log("fault in the fault handler (signal %d)", sig);
+    Sim_Exit(1);
+  }
+  in_fault = 1;
+
+  Sim_Log("hard fault (signal %d)", sig);
+  ipsr = 3U;
+  HardFault_Handler();
+
+  Sim_Log("fault handler returned");
+  Sim_Exit(1);
+}
+
+/**
+  * @brief  Sleep the calling thread
+  * @param  ns: Nanoseconds, less than a second
+  * @retval None
+  */
+static void Sim_SleepNs(long ns) {
+  struct timespec ts = {0, ns};
+
+  nanosleep(&ts, NULL);
+}
@@ -0,0 +1,310 @@
+/**
+  ******************************************************************************
+  * @file    sim_dma.c
+  * @brief   Host simulation of the DMA controllers
+  ******************************************************************************
+  * @attention
+  *
+  * Peripheral-to-memory and memory-to-peripheral channels move one item
+  * per request of their peripheral model (Sim_Dma_Read, Sim_Dma_Write):
+  * the memory address steps with MINC, CNDTR counts down, half transfer
+  * and transfer complete flags are raised, and a circular channel reloads
+  * the count it was enabled with. Memory-to-memory channels complete the
+  * whole block at the next step. Transfer errors are not simulated.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "stm32l4xx_hal.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_DMA_FLAG_GIF      0x1U
+#define SIM_DMA_FLAG_TCIF     0x2U
+#define SIM_DMA_FLAG_HTIF     0x4U
+#define SIM_DMA_FLAG_ALL      0xFU
+#define SIM_DMA_IT_MASK       (DMA_CCR_TCIE | DMA_CCR_HTIE | DMA_CCR_TEIE)
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  DMA_Channel_TypeDef* channel;
+  uint8_t controller;       /* 0 for DMA1, 1 for DMA2 */
+  uint8_t index;            /* Channel number - 1 */
+  IRQn_Type irq;
+  bool enabled;             /* EN as last seen */
+  uint32_t reload;          /* CNDTR when enabled */
+  uint32_t done;            /* Items moved since the last reload */
+  uint32_t count;           /* CNDTR as the model left it */
+  uint32_t address;         /* CMAR when enabled */
+} Sim_DmaChannel_t;
+
+/* Private variables ---------------------------------------------------------*/
+static DMA_TypeDef* const controllers[2] = {DMA1, DMA2};
+static uint32_t isr_flags[2];
+
+static Sim_DmaChannel_t channels[] = {
+  {DMA1_Channel1, 0, 0, DMA1_Channel1_IRQn},
+  {DMA1_Channel2, 0, 1, DMA1_Channel2_IRQn},
+  {DMA1_Channel3, 0, 2, DMA1_Channel3_IRQn},
+  {DMA1_Channel4, 0, 3, DMA1_Channel4_IRQn},
+  {DMA1_Channel5, 0, 4, DMA1_Channel5_IRQn},
+  {DMA1_Channel6, 0, 5, DMA1_Channel6_IRQn},
+  {DMA1_Channel7, 0, 6, DMA1_Channel7_IRQn},
+  {DMA2_Channel1, 1, 0, DMA2_Channel1_IRQn},
+  {DMA2_Channel2, 1, 1, DMA2_Channel2_IRQn},
+  {DMA2_Channel3, 1, 2, DMA2_Channel3_IRQn},
+  {DMA2_Channel4, 1, 3, DMA2_Channel4_IRQn},
+  {DMA2_Channel5, 1, 4, DMA2_Channel5_IRQn},
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void Sim_Dma_Init(void);
+static void Sim_Dma_Sync(void);
+static void Sim_Dma_Advance(uint32_t ns);
+static void Sim_Dma_Lines(void);
+static Sim_DmaChannel_t* Sim_Dma_Find(DMA_Channel_TypeDef* channel);
+static void Sim_Dma_Refresh(Sim_DmaChannel_t* ch);
+static uint32_t Sim_Dma_ItemSize(uint32_t ccr, uint32_t size_pos);
+static void Sim_Dma_Step(Sim_DmaChannel_t* ch);
+static void Sim_Dma_Flag(Sim_DmaChannel_t* ch, uint32_t flags);
+static void Sim_Dma_Copy(Sim_DmaChannel_t* ch);
+
+/* Exported variables --------------------------------------------------------*/
+const Sim_Model_t Sim_DmaModel = {
+  Sim_Dma_Init, Sim_Dma_Sync, Sim_Dma_Advance, Sim_Dma_Lines
+};
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Take the next item of a memory-to-peripheral channel
+  * @param  channel: Channel serving the peripheral
+  * @param  value: Item read from memory
+  * @retval bool: false if the channel is off or done
+  */
+bool Sim_Dma_Read(DMA_Channel_TypeDef* channel, uint32_t* value) {
+  Sim_DmaChannel_t* ch = Sim_Dma_Find(channel);
+  uint32_t size;
+  uintptr_t address;
+
+  if (ch == NULL) {
+    return false;
+  }
+  Sim_Dma_Refresh(ch);
+  if (!ch->enabled || channel->CNDTR == 0U) {
+    return false;
+  }
+
+  size = Sim_Dma_ItemSize(channel->CCR, DMA_CCR_MSIZE_Pos);
+  address = channel->CMAR + (((channel->CCR & DMA_CCR_MINC) != 0U) ? ch->done * size : 0U);
+  *value = (size == 1U) ? *(volatile uint8_t*)address :
+           (size == 2U) ? *(volatile uint16_t*)address : *(volatile uint32_t*)address;
+  Sim_Dma_Step(ch);
+  return true;
+}
+
+/**
+  * @brief  Store the next item of a peripheral-to-memory channel
+  * @param  channel: Channel serving the peripheral
+  * @param  value: Item to store
+  * @retval bool: false if the channel is off or done; the item is lost
+  */
+bool Sim_Dma_Write(DMA_Channel_TypeDef* channel, uint32_t value) {
+  Sim_DmaChannel_t* ch = Sim_Dma_Find(channel);
+  uint32_t size;
+  uintptr_t address;
+
+  if (ch == NULL) {
+    return false;
+  }
+  Sim_Dma_Refresh(ch);
+  if (!ch->enabled || channel->CNDTR == 0U) {
+    return false;
+  }
+
+  size = Sim_Dma_ItemSize(channel->CCR, DMA_CCR_MSIZE_Pos);
+  address = channel->CMAR + (((channel->CCR & DMA_CCR_MINC) != 0U) ? ch->done * size : 0U);
+  if (size == 1U) {
+    *(volatile uint8_t*)address = (uint8_t)value;
+  } else if (size == 2U) {
+    *(volatile uint16_t*)address = (uint16_t)value;
+  } else {
+    *(volatile uint32_t*)address = value;
+  }
+  Sim_Dma_Step(ch);
+  return true;
+}
+
+/**
+  * @brief  Items left on a channel
+  * @param  channel: Channel
+  * @retval uint32_t: CNDTR if enabled, else 0
+  */
+uint32_t Sim_Dma_Remaining(DMA_Channel_TypeDef* channel) {
+  return ((channel->CCR & DMA_CCR_EN) != 0U) ? channel->CNDTR : 0U;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Reset state
+  * @retval None
+  */
+static void Sim_Dma_Init(void) {
+  memset(isr_flags, 0, sizeof(isr_flags));
+  for (uint32_t i = 0; i < sizeof(channels) / sizeof(channels[0]); i++) {
+    channels[i].enabled = false;
+  }
+}
+
+/**
+  * @brief  Apply flag clears and channel enables
+  * @retval None
+  */
+static void Sim_Dma_Sync(void) {
+  for (uint32_t c = 0; c < 2U; c++) {
+    isr_flags[c] &= ~controllers[c]->IFCR;
+    controllers[c]->IFCR = 0;
+  }
+
+  for (uint32_t i = 0; i < sizeof(channels) / sizeof(channels[0]); i++) {
+    Sim_Dma_Refresh(&channels[i]);
+    if (channels[i].enabled && (channels[i].channel->CCR & DMA_CCR_MEM2MEM) != 0U &&
+        channels[i].channel->CNDTR != 0U) {
+      Sim_Dma_Copy(&channels[i]);
+    }
+  }
+
+  for (uint32_t c = 0; c < 2U; c++) {
+    controllers[c]->ISR = isr_flags[c];
+  }
+}
+
+/**
+  * @brief  Nothing moves on its own; the peripherals request
+  * @param  ns: Time step
+  * @retval None
+  */
+static void Sim_Dma_Advance(uint32_t ns) {
+  (void)ns;
+}
+
+/**
+  * @brief  Raise the channel interrupt lines
+  * @retval None
+  */
+static void Sim_Dma_Lines(void) {
+  for (uint32_t i = 0; i < sizeof(channels) / sizeof(channels[0]); i++) {
+    const Sim_DmaChannel_t* ch = &channels[i];
+    uint32_t flags = (isr_flags[ch->controller] >> (ch->index * 4U)) & SIM_DMA_FLAG_ALL;
+
+    if ((flags & ch->channel->CCR & SIM_DMA_IT_MASK) != 0U) {
+      Sim_RaiseIrq(ch->irq);
+    }
+  }
+}
+
+/**
+  * @brief  Find the model state of a channel
+  * @param  channel: Channel registers
+  * @retval Sim_DmaChannel_t*: State, NULL if not modelled
+  */
+static Sim_DmaChannel_t* Sim_Dma_Find(DMA_Channel_TypeDef* channel) {
+  for (uint32_t i = 0; i < sizeof(channels) / sizeof(channels[0]); i++) {
+    if (channels[i].channel == channel) {
+      return &channels[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+  * @brief  Pick up an enable: the count written before it is the reload
+  * @note   A handler may disable, reprogram and enable a channel between
+  *         two steps, so a count or address other than the model left
+  *         also starts a transfer; both are only writable while disabled
+  * @param  ch: Channel
+  * @retval None
+  */
+static void Sim_Dma_Refresh(Sim_DmaChannel_t* ch) {
+  DMA_Channel_TypeDef* channel = ch->channel;
+  bool enabled = (channel->CCR & DMA_CCR_EN) != 0U;
+
+  if (enabled && (!ch->enabled || channel->CNDTR != ch->count || channel->CMAR != ch->address)) {
+    ch->reload = channel->CNDTR;
+    ch->done = 0;
+    ch->address = channel->CMAR;
+  }
+  ch->enabled = enabled;
+  ch->count = channel->CNDTR;
+}
+
+/**
+  * @brief  Item size of a CCR size field
+  * @param  ccr: Channel configuration
+  * @param  size_pos: DMA_CCR_MSIZE_Pos or DMA_CCR_PSIZE_Pos
+  * @retval uint32_t: 1, 2 or 4 bytes
+  */
+static uint32_t Sim_Dma_ItemSize(uint32_t ccr, uint32_t size_pos) {
+  return 1UL << ((ccr >> size_pos) & 3U);
+}
+
+/**
+  * @brief  Count one item moved
+  * @param  ch: Channel
+  * @retval None
+  */
+static void Sim_Dma_Step(Sim_DmaChannel_t* ch) {
+  uint32_t left = ch->channel->CNDTR - 1U;
+
+  ch->done++;
+  ch->channel->CNDTR = left;
+  if (left == ch->reload / 2U) {
+    Sim_Dma_Flag(ch, SIM_DMA_FLAG_HTIF);
+  }
+  if (left == 0U) {
+    Sim_Dma_Flag(ch, SIM_DMA_FLAG_TCIF);
+    if ((ch->channel->CCR & (DMA_CCR_CIRC | DMA_CCR_MEM2MEM)) == DMA_CCR_CIRC) {
+      ch->channel->CNDTR = ch->reload;
+      ch->done = 0;
+    }
+  }
+  ch->count = ch->channel->CNDTR;
+}
+
+/**
+  * @brief  Raise channel flags, with the global flag
+  * @param  ch: Channel
+  * @param  flags: SIM_DMA_FLAG_x
+  * @retval None
+  */
+static void Sim_Dma_Flag(Sim_DmaChannel_t* ch, uint32_t flags) {
+  isr_flags[ch->controller] |= (flags | SIM_DMA_FLAG_GIF) << (ch->index * 4U);
+  controllers[ch->controller]->ISR = isr_flags[ch->controller];
+}
+
+/**
+  * @brief  Complete a memory-to-memory block
+  * @note   DIR clear reads from the peripheral address into memory
+  * @param  ch: Channel
+  * @retval None
+  */
+static void Sim_Dma_Copy(Sim_DmaChannel_t* ch) {
+  DMA_Channel_TypeDef* channel = ch->channel;
+  bool from_memory = (channel->CCR & DMA_CCR_DIR) != 0U;
+  uintptr_t source = from_memory ? channel->CMAR : channel->CPAR;
+  uintptr_t dest = from_memory ? channel->CPAR : channel->CMAR;
+  uint32_t size = Sim_Dma_ItemSize(channel->CCR, DMA_CCR_MSIZE_Pos);
+  bool source_inc = (channel->CCR & (from_memory ? DMA_CCR_MINC : DMA_CCR_PINC)) != 0U;
+  bool dest_inc = (channel->CCR & (from_memory ? DMA_CCR_PINC : DMA_CCR_MINC)) != 0U;
+
+  while (channel->CNDTR != 0U) {
+    uintptr_t from = source + (source_inc ? ch->done * size : 0U);
+    uintptr_t to = dest + (dest_inc ? ch->done * size : 0U);
+
+    memcpy((void*)to, (const void*)from, size);
+    Sim_Dma_Step(ch);
+  }
+}
@@ -0,0 +1,117 @@
+/**
+  ******************************************************************************
+  * @file    sim_hal.c
+  * @brief   HAL functions replaced in the host simulation
+  ******************************************************************************
+  * @attention
+  *
+  * The flash HAL works on the flash file mapped by sim_system.c: a double
+  * word can only be programmed over erased bytes, as on the target, and
+  * erasing fills 2 KB pages with 0xFF. Programming and erasing complete
+  * at once.
+  *
+  * The peripheral clock selection has nothing to configure: the models
+  * take the USART, ADC and timer clocks from the bus clocks.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "stm32l4xx_hal.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_FLASH_END         (FLASH_BASE + 256U * 1024U)
+
+/* Private variables ---------------------------------------------------------*/
+static bool flash_unlocked = false;
+
+/* Flash HAL -----------------------------------------------------------------*/
+
+/**
+  * @brief  Unlock the flash for programming and erasing
+  * @retval HAL_StatusTypeDef: HAL_OK
+  */
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) {
+  flash_unlocked = true;
+  CLEAR_BIT(FLASH->CR, FLASH_CR_LOCK);
+  return HAL_OK;
+}
+
+/**
+  * @brief  Lock the flash
+  * @retval HAL_StatusTypeDef: HAL_OK
+  */
+HAL_StatusTypeDef HAL_FLASH_Lock(void) {
+  flash_unlocked = false;
+  SET_BIT(FLASH->CR, FLASH_CR_LOCK);
+  return HAL_OK;
+}
+
+/**
+  * @brief  Program a double word
+  * @param  TypeProgram: FLASH_TYPEPROGRAM_DOUBLEWORD only
+  * @param  Address: Flash address, 8-byte aligned
+  * @param  Data: Value
+  * @retval HAL_StatusTypeDef: HAL_ERROR if locked, misaligned, out of range
+  *         or not erased
+  */
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data) {
+  volatile uint64_t* target = (volatile uint64_t*)(uintptr_t)Address;
+
+  if (!flash_unlocked || TypeProgram != FLASH_TYPEPROGRAM_DOUBLEWORD || (Address & 7U) != 0U ||
+      Address < FLASH_BASE || Address + 8U > SIM_FLASH_END) {
+    SET_BIT(FLASH->SR, FLASH_SR_PGAERR);
+    return HAL_ERROR;
+  }
+  if (*target != UINT64_MAX) {
+    SET_BIT(FLASH->SR, FLASH_SR_PROGERR);
+    return HAL_ERROR;
+  }
+
+  *target = Data;
+  SET_BIT(FLASH->SR, FLASH_SR_EOP);
+  return HAL_OK;
+}
+
+/**
+  * @brief  Erase pages
+  * @param  pEraseInit: Pages to erase; mass erase is refused
+  * @param  PageError: 0xFFFFFFFF if all pages were erased
+  * @retval HAL_StatusTypeDef: HAL_ERROR if locked or out of range
+  */
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* pEraseInit, uint32_t* PageError) {
+  uint32_t address = FLASH_BASE + pEraseInit->Page * FLASH_PAGE_SIZE;
+
+  *PageError = pEraseInit->Page;
+  if (!flash_unlocked || pEraseInit->TypeErase != FLASH_TYPEERASE_PAGES ||
+      address + pEraseInit->NbPages * FLASH_PAGE_SIZE > SIM_FLASH_END) {
+    SET_BIT(FLASH->SR, FLASH_SR_PGSERR);
+    return HAL_ERROR;
+  }
+
+  memset((void*)(uintptr_t)address, 0xFF, pEraseInit->NbPages * FLASH_PAGE_SIZE);
+  *PageError = 0xFFFFFFFFU;
+  return HAL_OK;
+}
+
+/* RCC extended HAL ----------------------------------------------------------*/
+
+/**
+  * @brief  Select peripheral kernel clocks
+  * @param  PeriphClkInit: Selection, not needed by the models
+  * @retval HAL_StatusTypeDef: HAL_OK
+  */
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef* PeriphClkInit) {
+  (void)PeriphClkInit;
+  return HAL_OK;
+}
+
+/**
+  * @brief  Lock the MSI to the LSE
+  * @retval None
+  */
+void HAL_RCCEx_EnableMSIPLLMode(void) {
+  SET_BIT(RCC->CR, RCC_CR_MSIPLLEN);
+}
@@ -0,0 +1,237 @@
+/**
+  ******************************************************************************
+  * @file    sim_led.c
+  * @brief   Host simulation of the LED loads, their sensors and COMP1/COMP2
+  ******************************************************************************
+  * @attention
+  *
+  * Each light is a constant-current driver switched by its PWM output:
+  * SIM_LED_CURRENT_MA (default 20000) while the output is active, scaled
+  * by a fault the control thread injects (short raises it, open removes
+  * it). The mean current over a step is that times the fraction of the
+  * step the output was active.
+  *
+  * The heatsink is a single thermal resistance and time constant per
+  * light (SIM_LED_RTH in K/W, default 0.8, and SIM_LED_TAU_S, default 30)
+  * above the ambient (SIM_AMBIENT_C, default 25), heated by the forward
+  * voltage times the mean current; the forward voltage is 3.0 V for white
+  * and green and 2.2 V for red unless SIM_LED_VF sets one for all. The
+  * die sensor of the MCU sits a few degrees above the ambient.
+  *
+  * COMP1 and COMP2 compare the on-state current sense voltage of the
+  * light wired to them against the DAC1 channel of the same number while
+  * enabled. The output shows in the CSR VALUE bit, pends its EXTI line
+  * (21, 22) on a rising edge and, while high, drives the TIM1 break.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "stm32l4xx_hal.h"
+#include "val_channels.h"
+#include <math.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_LED_DIE_RISE_CDEG 500         /* MCU die above ambient */
+#define SIM_DAC_FULL_SCALE    4095U
+#define SIM_COMP_COUNT        2U
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  float temperature_c;
+  float mean_ma;
+  float on_ma;
+  float fault_scale;        /* 1 healthy, above 1 shorted, 0 open */
+} Sim_Led_t;
+
+/* Private variables ---------------------------------------------------------*/
+static Sim_Led_t leds[VAL_LIGHT_COUNT];
+static float ambient_c = 25.0f;
+static float on_current_ma = 20000.0f;
+static float rth_k_per_w = 0.8f;
+static float tau_s = 30.0f;
+static float vf_override = 0.0f;
+static bool comp_output[SIM_COMP_COUNT];
+
+static COMP_TypeDef* const comparators[SIM_COMP_COUNT] = {COMP1, COMP2};
+
+/* Private function prototypes -----------------------------------------------*/
+static void Sim_Led_Init(void);
+static void Sim_Led_Sync(void);
+static void Sim_Led_Advance(uint32_t ns);
+static void Sim_Led_Lines(void);
+static float Sim_Led_ForwardVoltage(uint8_t light_index);
+static void Sim_Led_Compare(void);
+
+/* Exported variables --------------------------------------------------------*/
+const Sim_Model_t Sim_LedModel = {
+  Sim_Led_Init, Sim_Led_Sync, Sim_Led_Advance, Sim_Led_Lines
+};
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Mean current of a light over the last step
+  * @param  light_index: Light ID - 1
+  * @retval int32_t: Milliamps
+  */
+int32_t Sim_Led_GetCurrentMa(uint8_t light_index) {
+  return (int32_t)lroundf(leds[light_index].mean_ma);
+}
+
+/**
+  * @brief  Current of a light while its output is active
+  * @param  light_index: Light ID - 1
+  * @retval int32_t: Milliamps, 0 if the output was never active in the step
+  */
+int32_t Sim_Led_GetOnCurrentMa(uint8_t light_index) {
+  return (int32_t)lroundf(leds[light_index].on_ma);
+}
+
+/**
+  * @brief  Heatsink temperature of a light
+  * @param  light_index: Light ID - 1
+  * @retval int32_t: Centi-degrees Celsius
+  */
+int32_t Sim_Led_GetTemperatureCdeg(uint8_t light_index) {
+  return (int32_t)lroundf(leds[light_index].temperature_c * 100.0f);
+}
+
+/**
+  * @brief  Temperature of the MCU die
+  * @retval int32_t: Centi-degrees Celsius
+  */
+int32_t Sim_Led_GetDieTemperatureCdeg(void) {
+  return (int32_t)lroundf(ambient_c * 100.0f) + SIM_LED_DIE_RISE_CDEG;
+}
+
+/**
+  * @brief  Set the ambient temperature
+  * @param  cdeg: Centi-degrees Celsius
+  * @retval None
+  */
+void Sim_Led_SetAmbient(int32_t cdeg) {
+  ambient_c = (float)cdeg / 100.0f;
+}
+
+/**
+  * @brief  Inject or clear a load fault
+  * @param  light_index: Light ID - 1
+  * @param  current_scale: On-state current relative to healthy; 0 for open
+  * @retval None
+  */
+void Sim_Led_SetFault(uint8_t light_index, float current_scale) {
+  if (light_index < VAL_LIGHT_COUNT) {
+    leds[light_index].fault_scale = current_scale;
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Reset state and read the settings
+  * @retval None
+  */
+static void Sim_Led_Init(void) {
+  ambient_c = (float)Sim_GetEnvNumber("SIM_AMBIENT_C", 25.0);
+  on_current_ma = (float)Sim_GetEnvNumber("SIM_LED_CURRENT_MA", 20000.0);
+  rth_k_per_w = (float)Sim_GetEnvNumber("SIM_LED_RTH", 0.8);
+  tau_s = (float)Sim_GetEnvNumber("SIM_LED_TAU_S", 30.0);
+  vf_override = (float)Sim_GetEnvNumber("SIM_LED_VF", 0.0);
+  if (tau_s < 0.001f) {
+    tau_s = 0.001f;
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    leds[i].temperature_c = ambient_c;
+    leds[i].mean_ma = 0.0f;
+    leds[i].on_ma = 0.0f;
+    leds[i].fault_scale = 1.0f;
+  }
+  memset(comp_output, 0, sizeof(comp_output));
+}
+
+/**
+  * @brief  Nothing to pick up; the comparators are read as they stand
+  * @retval None
+  */
+static void Sim_Led_Sync(void) {
+}
+
+/**
+  * @brief  Update currents, temperatures and comparators for a step
+  * @param  ns: Time step
+  * @retval None
+  */
+static void Sim_Led_Advance(uint32_t ns) {
+  float settle = 1.0f - expf(-(float)ns * 1e-9f / tau_s);
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    Sim_Led_t* led = &leds[i];
+    float fraction = Sim_Timer_GetOnFraction(i);
+    float power_w;
+
+    led->on_ma = (fraction > 0.0f) ? on_current_ma * led->fault_scale : 0.0f;
+    led->mean_ma = led->on_ma * fraction;
+    power_w = Sim_Led_ForwardVoltage(i) * led->mean_ma * 0.001f;
+    led->temperature_c += (ambient_c + rth_k_per_w * power_w - led->temperature_c) * settle;
+  }
+
+  Sim_Led_Compare();
+}
+
+/**
+  * @brief  The comparator interrupt goes through EXTI (sim_system.c)
+  * @retval None
+  */
+static void Sim_Led_Lines(void) {
+}
+
+/**
+  * @brief  Forward voltage of a light
+  * @param  light_index: Light ID - 1
+  * @retval float: Volts
+  */
+static float Sim_Led_ForwardVoltage(uint8_t light_index) {
+  if (vf_override > 0.0f) {
+    return vf_override;
+  }
+  return (strcmp(VAL_Channels[light_index].colour, "red") == 0) ? 2.2f : 3.0f;
+}
+
+/**
+  * @brief  Evaluate COMP1 and COMP2 against their DAC levels
+  * @retval None
+  */
+static void Sim_Led_Compare(void) {
+  for (uint32_t k = 0; k < SIM_COMP_COUNT; k++) {
+    COMP_TypeDef* comp = comparators[k];
+    uint32_t dac = ((k == 0U) ? DAC1->DHR12R1 : DAC1->DHR12R2) & SIM_DAC_FULL_SCALE;
+    float threshold_mv = (float)dac * (float)Sim_Adc_GetVdda() / (float)SIM_DAC_FULL_SCALE;
+    float sense_mv = 0.0f;
+    bool output = false;
+
+    for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+      if (VAL_Channels[i].comparator == k + 1U) {
+        sense_mv = leds[i].on_ma / 10.0f;
+      }
+    }
+
+    if ((comp->CSR & COMP_CSR_EN) != 0U) {
+      output = (sense_mv > threshold_mv) != ((comp->CSR & COMP_CSR_POLARITY) != 0U);
+    }
+
+    if (output) {
+      comp->CSR |= COMP_CSR_VALUE;
+      if (!comp_output[k]) {
+        Sim_System_RisingEdge(21U + k);
+      }
+      Sim_Timer_Break((uint8_t)(k + 1U));
+    } else {
+      comp->CSR &= ~COMP_CSR_VALUE;
+    }
+    comp_output[k] = output;
+  }
+}
@@ -0,0 +1,274 @@
+/**
+  ******************************************************************************
+  * @file    sim_system.c
+  * @brief   Host simulation of the flash, RCC, IWDG, GPIO, EXTI and PVD
+  ******************************************************************************
+  * @attention
+  *
+  * The flash is a file in the state directory (flash.bin, erased bytes
+  * 0xFF) mapped shared at FLASH_BASE, so the data store survives resets
+  * and runs; programming and erasing go through the flash HAL of
+  * sim_hal.c.
+  *
+  * The RCC ready and status bits follow their enables at once, the reset
+  * flags clear on RMVF. The independent watchdog counts down from its
+  * reload at 32 kHz divided by its prescaler once started or refreshed,
+  * and resets the device when it runs out. GPIO writes through BSRR and
+  * BRR land in ODR, and the input register follows the outputs. EXTI
+  * lines pend on a rising edge with their rising trigger selected; PR1 is
+  * write-1-to-clear.
+  *
+  * The PVD output follows the simulated supply (the vdda command) against
+  * the level selected in PWR_CR2, with 100 mV of hysteresis, and pends
+  * EXTI line 16 on the edges whose trigger is selected.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "stm32l4xx_hal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_FLASH_SIZE        (256U * 1024U)
+#define SIM_LSI_HZ            32000U
+#define SIM_IWDG_KEY_RELOAD   0xAAAAU
+#define SIM_IWDG_KEY_START    0xCCCCU
+
+#define SIM_EXTI_9_5          0x000003E0U
+#define SIM_EXTI_15_10        0x0000FC00U
+#define SIM_EXTI_COMP         ((1UL << 21) | (1UL << 22))
+#define SIM_EXTI_PVD          (1UL << 16)
+#define SIM_PVD_LEVELS        7U          /* Level 7 is the PVD_IN pin, not modelled */
+#define SIM_PVD_HYSTERESIS_MV 100U
+
+/* Private variables ---------------------------------------------------------*/
+static GPIO_TypeDef* const ports[] = {GPIOA, GPIOB, GPIOC, GPIOH};
+
+static const uint16_t pvd_levels_mv[SIM_PVD_LEVELS] = {2000, 2150, 2310, 2450, 2590, 2750, 2840};
+
+static uint32_t exti_pending = 0;
+static bool pvd_low = false;
+static bool watchdog_running = false;
+static uint64_t watchdog_left_ns = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Sim_System_Init(void);
+static void Sim_System_Advance(uint32_t ns);
+static void Sim_System_Lines(void);
+static void Sim_System_Pvd(void);
+static uint64_t Sim_System_WatchdogTimeout(void);
+
+/* Exported variables --------------------------------------------------------*/
+const Sim_Model_t Sim_SystemModel = {
+  Sim_System_Init, Sim_System_Sync, Sim_System_Advance, Sim_System_Lines
+};
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Map the flash file at FLASH_BASE, creating it erased
+  * @param  state_dir: State directory
+  * @retval None
+  */
+void Sim_System_MapFlash(const char* state_dir) {
+  char path[512];
+  struct stat info;
+  void* mapped;
+  int fd;
+
+  snprintf(path, sizeof(path), "%s/flash.bin", state_dir);
+  fd = open(path, O_RDWR | O_CREAT, 0666);
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    Sim_Log("cannot open %s: %s", path, strerror(errno));
+    _exit(1);
+  }
+
+  if ((size_t)info.st_size < SIM_FLASH_SIZE) {
+    static const uint8_t erased[4096] = {[0 ... 4095] = 0xFF};
+
+    lseek(fd, info.st_size, SEEK_SET);
+    for (size_t size = (size_t)info.st_size; size < SIM_FLASH_SIZE; ) {
+      size_t chunk = SIM_FLASH_SIZE - size;
+      ssize_t written = write(fd, erased, (chunk > sizeof(erased)) ? sizeof(erased) : chunk);
+
+      if (written <= 0) {
+        Sim_Log("cannot write %s: %s", path, strerror(errno));
+        _exit(1);
+      }
+      size += (size_t)written;
+    }
+  }
+
+  mapped = mmap((void*)FLASH_BASE, SIM_FLASH_SIZE, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+  close(fd);
+  if (mapped != (void*)FLASH_BASE) {
+    Sim_Log("cannot map %s at 0x%08lx", path, (unsigned long)FLASH_BASE);
+    _exit(1);
+  }
+}
+
+/**
+  * @brief  Apply register writes to the RCC, IWDG, GPIO and EXTI
+  * @retval None
+  */
+void Sim_System_Sync(void) {
+  uint32_t key = IWDG->KR;
+
+  /* Ready flags follow their enables */
+  MODIFY_REG(RCC->CR, RCC_CR_MSIRDY | RCC_CR_HSIRDY | RCC_CR_PLLRDY | RCC_CR_PLLSAI1RDY,
+             ((RCC->CR & RCC_CR_MSION) ? RCC_CR_MSIRDY : 0U) |
+             ((RCC->CR & RCC_CR_HSION) ? RCC_CR_HSIRDY : 0U) |
+             ((RCC->CR & RCC_CR_PLLON) ? RCC_CR_PLLRDY : 0U) |
+             ((RCC->CR & RCC_CR_PLLSAI1ON) ? RCC_CR_PLLSAI1RDY : 0U));
+  MODIFY_REG(RCC->CFGR, RCC_CFGR_SWS, (RCC->CFGR & RCC_CFGR_SW) << RCC_CFGR_SWS_Pos);
+  MODIFY_REG(RCC->CSR, RCC_CSR_LSIRDY, (RCC->CSR & RCC_CSR_LSION) ? RCC_CSR_LSIRDY : 0U);
+  if ((RCC->CSR & RCC_CSR_RMVF) != 0U) {
+    RCC->CSR &= ~(RCC_CSR_RMVF | RCC_CSR_FWRSTF | RCC_CSR_OBLRSTF | RCC_CSR_PINRSTF | RCC_CSR_BORRSTF |
+                  RCC_CSR_SFTRSTF | RCC_CSR_IWDGRSTF | RCC_CSR_WWDGRSTF | RCC_CSR_LPWRRSTF);
+  }
+
+  /* The watchdog cannot be stopped once started */
+  if (key == SIM_IWDG_KEY_START || key == SIM_IWDG_KEY_RELOAD) {
+    watchdog_running = true;
+    watchdog_left_ns = Sim_System_WatchdogTimeout();
+  }
+  IWDG->KR = 0;
+  IWDG->SR = 0;
+
+  for (uint32_t i = 0; i < sizeof(ports) / sizeof(ports[0]); i++) {
+    GPIO_TypeDef* port = ports[i];
+    uint32_t set = port->BSRR;
+    uint32_t reset = port->BRR;
+
+    port->ODR = ((port->ODR | (set & 0xFFFFU)) & ~(set >> 16) & ~reset) & 0xFFFFU;
+    port->BSRR = 0;
+    port->BRR = 0;
+    port->IDR = port->ODR;
+  }
+
+  Sim_SyncW1C(&EXTI->PR1, &exti_pending);
+  Sim_System_Pvd();
+}
+
+/**
+  * @brief  Signal a rising edge on an EXTI line
+  * @param  exti_line: Line number, 0-31
+  * @retval None
+  */
+void Sim_System_RisingEdge(uint32_t exti_line) {
+  uint32_t mask = 1UL << exti_line;
+
+  if ((EXTI->RTSR1 & mask) != 0U) {
+    exti_pending |= mask;
+    EXTI->PR1 = exti_pending | SIM_W1C_CANARY;
+  }
+}
+
+/**
+  * @brief  Lose the backup domain, as with the supply and battery removed
+  * @retval None
+  */
+void Sim_System_ClearBackupDomain(void) {
+  memset(Sim_State->backup, 0, sizeof(Sim_State->backup));
+  Sim_State->rtc_set = 0;
+  Sim_State->rtc_offset_ms = 0;
+  Sim_State->rtc_calibration_ppb = 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Reset state
+  * @retval None
+  */
+static void Sim_System_Init(void) {
+  exti_pending = 0;
+  EXTI->PR1 = SIM_W1C_CANARY;
+  pvd_low = false;
+  watchdog_running = false;
+}
+
+/**
+  * @brief  Count the watchdog down
+  * @param  ns: Time step
+  * @retval None
+  */
+static void Sim_System_Advance(uint32_t ns) {
+  if (!watchdog_running) {
+    return;
+  }
+
+  if (watchdog_left_ns <= ns) {
+    Sim_Log("independent watchdog expired");
+    Sim_Reset(RCC_CSR_IWDGRSTF | RCC_CSR_PINRSTF);
+  }
+  watchdog_left_ns -= ns;
+}
+
+/**
+  * @brief  Raise the EXTI interrupt lines
+  * @retval None
+  */
+static void Sim_System_Lines(void) {
+  uint32_t active = exti_pending & EXTI->IMR1;
+
+  if ((active & SIM_EXTI_9_5) != 0U) {
+    Sim_RaiseIrq(EXTI9_5_IRQn);
+  }
+  if ((active & SIM_EXTI_15_10) != 0U) {
+    Sim_RaiseIrq(EXTI15_10_IRQn);
+  }
+  if ((active & SIM_EXTI_COMP) != 0U) {
+    Sim_RaiseIrq(COMP_IRQn);
+  }
+  if ((active & SIM_EXTI_PVD) != 0U) {
+    Sim_RaiseIrq(PVD_PVM_IRQn);
+  }
+}
+
+/**
+  * @brief  Compare the supply with the PVD level, pending line 16 on an edge
+  * @retval None
+  */
+static void Sim_System_Pvd(void) {
+  uint32_t level = (PWR->CR2 & PWR_CR2_PLS) >> PWR_CR2_PLS_Pos;
+  bool low = false;
+
+  if ((PWR->CR2 & PWR_CR2_PVDE) != 0U && level < SIM_PVD_LEVELS) {
+    uint32_t threshold_mv = pvd_levels_mv[level] + (pvd_low ? SIM_PVD_HYSTERESIS_MV : 0U);
+
+    low = Sim_Adc_GetVdda() < threshold_mv;
+  }
+
+  if (low != pvd_low) {
+    uint32_t edges = low ? EXTI->RTSR1 : EXTI->FTSR1;
+
+    if ((edges & SIM_EXTI_PVD) != 0U) {
+      exti_pending |= SIM_EXTI_PVD;
+      EXTI->PR1 = exti_pending | SIM_W1C_CANARY;
+    }
+    pvd_low = low;
+  }
+
+  MODIFY_REG(PWR->SR2, PWR_SR2_PVDO, low ? PWR_SR2_PVDO : 0U);
+}
+
+/**
+  * @brief  Time from a refresh to the watchdog reset
+  * @retval uint64_t: Nanoseconds
+  */
+static uint64_t Sim_System_WatchdogTimeout(void) {
+  uint32_t divider = 4UL << (IWDG->PR & IWDG_PR_PR);
+  uint32_t reload = (IWDG->RLR & IWDG_RLR_RL) + 1U;
+
+  return (uint64_t)reload * divider * 1000000000ULL / SIM_LSI_HZ;
+}
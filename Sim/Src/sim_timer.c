@@ -0,0 +1,519 @@
+/**
+  ******************************************************************************
+  * @file    sim_timer.c
+  * @brief   Host simulation of TIM1, TIM6, TIM7 and TIM15, with a PWM recorder
+  ******************************************************************************
+  * @attention
+  *
+  * The counters run at the timer clock of their bus divided by the
+  * prescaler in use. The prescaler, the auto-reload with ARPE and the
+  * TIM1 compares with OCxPE are preloaded: the written values take effect
+  * at the next update event, which UDIS holds off. TIM1 updates every
+  * RCR+1 periods and, with UDE, then runs its DMA burst from DMA1 channel
+  * 6 into the registers from DBA on, as the ramps and dither tables need.
+  *
+  * Events are resolved to the period, not to the count: a period's
+  * trigger outputs (TIM6 TRGO to the ADC, TIM1 TRGO2 from OC4REF, the
+  * TIM15 OC1REF edges to the ADC and to TIM1 ITR0) all happen as the
+  * period ends, and the ADC receives every trigger of a step at once. In trigger mode (strobe) TIM1 starts on ITR0 or on the
+  * external trigger of the control thread's sync command and stops at
+  * the update after its repetitions in one-pulse mode.
+  *
+  * For each output the model integrates the fraction of time it is
+  * active over a step, from the output mode, the compare and period in
+  * use, the polarity and the enables including MOE; the LED model turns
+  * that into current. A comparator trip with its break source enabled
+  * clears MOE and sets BIF.
+  *
+  * The recorder writes a line to the CSV file named by SIM_PWM_LOG each
+  * time a light's compare, period or effective duty changes:
+  * time_us,light,compare,period,permille.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "stm32l4xx_hal.h"
+#include "val_channels.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_NS_PER_S          1000000000ULL
+#define SIM_TIM1_SEGMENTS     1000U   /* Periods resolved per step, the rest averaged */
+#define SIM_TRIGGERS_MAX      64U     /* ADC triggers passed on per step */
+#define SIM_OCMODE_FORCED_LOW  4U
+#define SIM_OCMODE_FORCED_HIGH 5U
+#define SIM_OCMODE_PWM1       6U
+#define SIM_OCMODE_PWM2       7U
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  TIM_TypeDef* tim;
+  uint32_t sr;              /* Status flags as held by the model */
+  uint32_t psc;             /* Prescaler in use */
+  uint32_t arr;             /* Auto-reload in use when preloaded */
+  uint32_t ccr[4];          /* Compares in use when preloaded */
+  uint32_t rep;             /* Periods left to the next update */
+  uint64_t phase;           /* Position in the period, timer clock ticks x 1e9 */
+} Sim_Tim_t;
+
+typedef struct {
+  uint32_t compare;
+  uint32_t period;
+  uint32_t permille;
+} Sim_PwmRecord_t;
+
+/* Private variables ---------------------------------------------------------*/
+static Sim_Tim_t tim1 = {TIM1};
+static Sim_Tim_t tim6 = {TIM6};
+static Sim_Tim_t tim7 = {TIM7};
+static Sim_Tim_t tim15 = {TIM15};
+
+static float on_fraction[4];        /* Per TIM1 channel, over the last step */
+static Sim_PwmRecord_t recorded[VAL_LIGHT_COUNT];
+static int record_fd = -1;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Sim_Timer_Init(void);
+static void Sim_Timer_Sync(void);
+static void Sim_Timer_Advance(uint32_t ns);
+static void Sim_Timer_Lines(void);
+static void Sim_Tim_Sync(Sim_Tim_t* t);
+static bool Sim_Tim_Update(Sim_Tim_t* t, bool generated);
+static uint64_t Sim_Tim_Period(const Sim_Tim_t* t);
+static uint32_t Sim_Tim_Count(Sim_Tim_t* t, uint32_t ns);
+static void Sim_Tim1_Advance(uint32_t ns);
+static void Sim_Tim1_PeriodEnd(void);
+static void Sim_Tim1_Trigger(void);
+static uint32_t Sim_Tim1_Compare(uint32_t channel);
+static float Sim_Tim1_Duty(uint32_t channel);
+static void Sim_Tim1_Record(void);
+
+/* Exported variables --------------------------------------------------------*/
+const Sim_Model_t Sim_TimerModel = {
+  Sim_Timer_Init, Sim_Timer_Sync, Sim_Timer_Advance, Sim_Timer_Lines
+};
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Get the counter clock of a timer before its prescaler
+  * @note   Twice the bus clock when the bus is divided
+  * @param  timer: Timer
+  * @retval uint32_t: Clock in Hz
+  */
+uint32_t Sim_Timer_GetClock(TIM_TypeDef* timer) {
+  bool apb2 = (timer == TIM1 || timer == TIM15 || timer == TIM16);
+  uint32_t clock = apb2 ? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+  bool divided = apb2 ? (RCC->CFGR & RCC_CFGR_PPRE2_2) != 0U : (RCC->CFGR & RCC_CFGR_PPRE1_2) != 0U;
+
+  return divided ? clock * 2U : clock;
+}
+
+/**
+  * @brief  Fraction of the last step a light's output was active
+  * @param  light_index: Light ID - 1
+  * @retval float: 0 to 1
+  */
+float Sim_Timer_GetOnFraction(uint8_t light_index) {
+  return on_fraction[(VAL_Channels[light_index].pwm_channel / 4U) & 3U];
+}
+
+/**
+  * @brief  Edge on the TIM1 external trigger input (PA12)
+  * @param  rising: true for a rising edge
+  * @retval None
+  */
+void Sim_Timer_ExternalTrigger(bool rising) {
+  bool active_rising = (TIM1->SMCR & TIM_SMCR_ETP) == 0U;
+
+  if ((TIM1->SMCR & TIM_SMCR_TS) == TIM_TS_ETRF && rising == active_rising) {
+    Sim_Tim1_Trigger();
+  }
+}
+
+/**
+  * @brief  Comparator output high on a TIM1 break source
+  * @param  comparator: 1 or 2
+  * @retval None
+  */
+void Sim_Timer_Break(uint8_t comparator) {
+  uint32_t source = (comparator == 1U) ? TIM1_OR2_BKCMP1E : TIM1_OR2_BKCMP2E;
+
+  if ((TIM1->BDTR & TIM_BDTR_BKE) != 0U && (TIM1->OR2 & source) != 0U) {
+    TIM1->BDTR &= ~TIM_BDTR_MOE;
+    tim1.sr |= TIM_SR_BIF;
+    TIM1->SR = tim1.sr;
+    Sim_Tim1_Record();
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Reset state and open the recorder
+  * @retval None
+  */
+static void Sim_Timer_Init(void) {
+  const char* path = Sim_GetEnv("SIM_PWM_LOG", NULL);
+
+  memset(on_fraction, 0, sizeof(on_fraction));
+  memset(recorded, 0xFF, sizeof(recorded));
+
+  if (path != NULL) {
+    record_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+    if (record_fd < 0) {
+      Sim_Log("cannot open %s", path);
+    } else if (lseek(record_fd, 0, SEEK_END) == 0) {
+      static const char header[] = "time_us,light,compare,period,permille\n";
+
+      (void)!write(record_fd, header, sizeof(header) - 1U);
+    }
+  }
+}
+
+/**
+  * @brief  Apply register writes to all timers
+  * @retval None
+  */
+static void Sim_Timer_Sync(void) {
+  Sim_Tim_Sync(&tim1);
+  Sim_Tim_Sync(&tim6);
+  Sim_Tim_Sync(&tim7);
+  Sim_Tim_Sync(&tim15);
+}
+
+/**
+  * @brief  Advance all timers
+  * @param  ns: Time step
+  * @retval None
+  */
+static void Sim_Timer_Advance(uint32_t ns) {
+  uint32_t periods;
+
+  /* TIM15 first, its period end may start a TIM1 strobe pulse */
+  periods = ((TIM15->CR1 & TIM_CR1_CEN) != 0U) ? Sim_Tim_Count(&tim15, ns) : 0U;
+  if (periods != 0U) {
+    (void)Sim_Tim_Update(&tim15, false);
+    if ((TIM15->CR2 & TIM_CR2_MMS) == TIM_TRGO_OC1REF) {
+      if ((TIM1->SMCR & TIM_SMCR_TS) == TIM_TS_ITR0) {
+        Sim_Tim1_Trigger();
+      }
+      for (uint32_t i = 0; i < periods && i < SIM_TRIGGERS_MAX; i++) {
+        Sim_Adc_Trigger(ADC_EXTERNALTRIG_T15_TRGO, true);
+        Sim_Adc_Trigger(ADC_EXTERNALTRIG_T15_TRGO, false);
+      }
+    }
+  }
+
+  Sim_Tim1_Advance(ns);
+
+  periods = ((TIM6->CR1 & TIM_CR1_CEN) != 0U) ? Sim_Tim_Count(&tim6, ns) : 0U;
+  if (periods != 0U) {
+    (void)Sim_Tim_Update(&tim6, false);
+    if ((TIM6->CR2 & TIM_CR2_MMS) == TIM_TRGO_UPDATE) {
+      for (uint32_t i = 0; i < periods && i < SIM_TRIGGERS_MAX; i++) {
+        Sim_Adc_Trigger(ADC_EXTERNALTRIG_T6_TRGO, true);
+      }
+    }
+  }
+
+  if ((TIM7->CR1 & TIM_CR1_CEN) != 0U && Sim_Tim_Count(&tim7, ns) != 0U) {
+    (void)Sim_Tim_Update(&tim7, false);
+  }
+
+  TIM1->SR = tim1.sr;
+  TIM6->SR = tim6.sr;
+  TIM7->SR = tim7.sr;
+  TIM15->SR = tim15.sr;
+}
+
+/**
+  * @brief  Raise the timer interrupt lines
+  * @retval None
+  */
+static void Sim_Timer_Lines(void) {
+  uint32_t tim1_active = tim1.sr & TIM1->DIER;
+
+  if ((tim1_active & TIM_SR_UIF) != 0U) {
+    Sim_RaiseIrq(TIM1_UP_TIM16_IRQn);
+  }
+  if ((tim1_active & (TIM_SR_TIF | TIM_SR_COMIF)) != 0U) {
+    Sim_RaiseIrq(TIM1_TRG_COM_IRQn);
+  }
+  if ((tim1_active & TIM_SR_BIF) != 0U || (tim15.sr & TIM15->DIER & (TIM_SR_UIF | TIM_SR_CC1IF)) != 0U) {
+    Sim_RaiseIrq(TIM1_BRK_TIM15_IRQn);
+  }
+  if ((tim6.sr & TIM6->DIER & TIM_SR_UIF) != 0U) {
+    Sim_RaiseIrq(TIM6_DAC_IRQn);
+  }
+  if ((tim7.sr & TIM7->DIER & TIM_SR_UIF) != 0U) {
+    Sim_RaiseIrq(TIM7_IRQn);
+  }
+  if (Sim_Timer_CueAlarmPending()) {
+    Sim_RaiseIrq(TIM2_IRQn);
+  }
+}
+
+/**
+  * @brief  Apply status clears and event generation of one timer
+  * @param  t: Timer state
+  * @retval None
+  */
+static void Sim_Tim_Sync(Sim_Tim_t* t) {
+  uint32_t egr = t->tim->EGR;
+
+  Sim_SyncW0C(&t->tim->SR, &t->sr);
+
+  if (egr != 0U) {
+    t->tim->EGR = 0;
+    if ((egr & TIM_EGR_UG) != 0U) {
+      t->phase = 0;
+      (void)Sim_Tim_Update(t, true);
+    }
+    if ((egr & TIM_EGR_TG) != 0U) {
+      t->sr |= TIM_SR_TIF;
+    }
+    if (t == &tim1 && (egr & TIM_EGR_BG) != 0U && (TIM1->BDTR & TIM_BDTR_BKE) != 0U) {
+      TIM1->BDTR &= ~TIM_BDTR_MOE;
+      t->sr |= TIM_SR_BIF;
+    }
+    t->tim->SR = t->sr;
+  }
+}
+
+/**
+  * @brief  Update event: load the preloaded registers
+  * @param  t: Timer state
+  * @param  generated: true if from UG, which URS keeps from setting UIF
+  * @retval bool: false if UDIS held the update off
+  */
+static bool Sim_Tim_Update(Sim_Tim_t* t, bool generated) {
+  TIM_TypeDef* tim = t->tim;
+
+  if ((tim->CR1 & TIM_CR1_UDIS) != 0U) {
+    return false;
+  }
+
+  t->psc = tim->PSC & 0xFFFFU;
+  t->arr = tim->ARR;
+  if (t == &tim1) {
+    t->ccr[0] = tim->CCR1;
+    t->ccr[1] = tim->CCR2;
+    t->ccr[2] = tim->CCR3;
+    t->ccr[3] = tim->CCR4;
+    t->rep = tim->RCR & 0xFFFFU;
+  }
+  if (!generated || (tim->CR1 & TIM_CR1_URS) == 0U) {
+    t->sr |= TIM_SR_UIF;
+  }
+  return true;
+}
+
+/**
+  * @brief  Length of the period in use
+  * @param  t: Timer state
+  * @retval uint64_t: Timer clock ticks x 1e9
+  */
+static uint64_t Sim_Tim_Period(const Sim_Tim_t* t) {
+  uint32_t arr = ((t->tim->CR1 & TIM_CR1_ARPE) != 0U) ? t->arr : t->tim->ARR;
+
+  return ((uint64_t)t->psc + 1U) * ((uint64_t)(arr & 0xFFFFU) + 1U) * SIM_NS_PER_S;
+}
+
+/**
+  * @brief  Run a counter for a step
+  * @param  t: Timer state
+  * @param  ns: Time step
+  * @retval uint32_t: Periods completed
+  */
+static uint32_t Sim_Tim_Count(Sim_Tim_t* t, uint32_t ns) {
+  uint64_t period = Sim_Tim_Period(t);
+  uint32_t periods = 0;
+
+  t->phase += (uint64_t)ns * Sim_Timer_GetClock(t->tim);
+  if (t->phase >= period) {
+    periods = (uint32_t)(t->phase / period);
+    t->phase %= period;
+  }
+  t->tim->CNT = (uint32_t)(t->phase / (((uint64_t)t->psc + 1U) * SIM_NS_PER_S));
+  return periods;
+}
+
+/**
+  * @brief  Run TIM1 for a step, integrating the output duty
+  * @param  ns: Time step
+  * @retval None
+  */
+static void Sim_Tim1_Advance(uint32_t ns) {
+  uint64_t clock = Sim_Timer_GetClock(TIM1);
+  uint64_t left = ns;
+  float on_ns[4] = {0};
+
+  for (uint32_t segment = 0; left > 0U; segment++) {
+    uint64_t period = Sim_Tim_Period(&tim1);
+    uint64_t to_end;
+    uint64_t step;
+
+    if ((TIM1->CR1 & TIM_CR1_CEN) == 0U) {
+      step = left;
+    } else if (segment >= SIM_TIM1_SEGMENTS) {
+      step = left;
+      tim1.phase = (tim1.phase + step * clock) % period;
+    } else {
+      to_end = (period - tim1.phase + clock - 1U) / clock;
+      step = (to_end < left) ? to_end : left;
+      tim1.phase += step * clock;
+    }
+
+    for (uint32_t ch = 0; ch < 4U; ch++) {
+      on_ns[ch] += Sim_Tim1_Duty(ch) * (float)step;
+    }
+    left -= step;
+
+    if ((TIM1->CR1 & TIM_CR1_CEN) != 0U && tim1.phase >= period) {
+      tim1.phase -= period;
+      Sim_Tim1_PeriodEnd();
+    }
+  }
+
+  for (uint32_t ch = 0; ch < 4U; ch++) {
+    on_fraction[ch] = (ns != 0U) ? on_ns[ch] / (float)ns : Sim_Tim1_Duty(ch);
+  }
+  TIM1->CNT = (uint32_t)(tim1.phase / (((uint64_t)tim1.psc + 1U) * SIM_NS_PER_S));
+  Sim_Tim1_Record();
+}
+
+/**
+  * @brief  End of a TIM1 period: trigger output, repetition and update
+  * @retval None
+  */
+static void Sim_Tim1_PeriodEnd(void) {
+  if ((TIM1->CR2 & TIM_CR2_MMS2) == TIM_TRGO2_OC4REF && Sim_Tim1_Compare(3) <= (TIM1->ARR & 0xFFFFU)) {
+    Sim_Adc_Trigger(ADC_EXTERNALTRIG_T1_TRGO2, true);
+  }
+
+  if (tim1.rep > 0U) {
+    tim1.rep--;
+    return;
+  }
+
+  if (Sim_Tim_Update(&tim1, false)) {
+    /* The burst writes the preload registers, used from the next update */
+    if ((TIM1->DIER & TIM_DIER_UDE) != 0U) {
+      uint32_t base = (TIM1->DCR & TIM_DCR_DBA) >> TIM_DCR_DBA_Pos;
+      uint32_t length = ((TIM1->DCR & TIM_DCR_DBL) >> TIM_DCR_DBL_Pos) + 1U;
+      uint32_t value;
+
+      for (uint32_t i = 0; i < length && Sim_Dma_Read(DMA1_Channel6, &value); i++) {
+        (&TIM1->CR1)[base + i] = value;
+      }
+    }
+    Sim_Tim1_Record();
+  }
+
+  if ((TIM1->CR1 & TIM_CR1_OPM) != 0U) {
+    TIM1->CR1 &= ~TIM_CR1_CEN;
+  }
+}
+
+/**
+  * @brief  Trigger input of TIM1: starts the counter in trigger mode
+  * @retval None
+  */
+static void Sim_Tim1_Trigger(void) {
+  tim1.sr |= TIM_SR_TIF;
+  if ((TIM1->SMCR & TIM_SMCR_SMS) == TIM_SLAVEMODE_TRIGGER) {
+    TIM1->CR1 |= TIM_CR1_CEN;
+  }
+  TIM1->SR = tim1.sr;
+}
+
+/**
+  * @brief  Compare of a TIM1 channel in use
+  * @param  channel: 0-3
+  * @retval uint32_t: Compare value
+  */
+static uint32_t Sim_Tim1_Compare(uint32_t channel) {
+  uint32_t ccmr = (channel < 2U) ? TIM1->CCMR1 : TIM1->CCMR2;
+  uint32_t preload = TIM_CCMR1_OC1PE << ((channel & 1U) * 8U);
+
+  return ((ccmr & preload) != 0U) ? tim1.ccr[channel] : (&TIM1->CCR1)[channel];
+}
+
+/**
+  * @brief  Fraction of the period a TIM1 output is active
+  * @param  channel: 0-3
+  * @retval float: 0 to 1
+  */
+static float Sim_Tim1_Duty(uint32_t channel) {
+  uint32_t ccmr = (channel < 2U) ? TIM1->CCMR1 : TIM1->CCMR2;
+  uint32_t shift = (channel & 1U) * 8U;
+  uint32_t mode = ((ccmr >> (TIM_CCMR1_OC1M_Pos + shift)) & 7U) | (((ccmr >> (16U + shift)) & 1U) << 3);
+  uint32_t period = (((TIM1->CR1 & TIM_CR1_ARPE) != 0U) ? tim1.arr : TIM1->ARR) & 0xFFFFU;
+  uint32_t compare = Sim_Tim1_Compare(channel);
+  bool counting = (TIM1->CR1 & TIM_CR1_CEN) != 0U;
+  float active;
+
+  if ((TIM1->CCER & (TIM_CCER_CC1E << (channel * 4U))) == 0U || (TIM1->BDTR & TIM_BDTR_MOE) == 0U) {
+    return 0.0f;
+  }
+
+  period += 1U;
+  if (compare > period) {
+    compare = period;
+  }
+
+  switch (mode) {
+    case SIM_OCMODE_PWM1:
+      active = counting ? (float)compare / (float)period : 0.0f;
+      break;
+    case SIM_OCMODE_PWM2:
+      active = counting ? 1.0f - (float)compare / (float)period : 0.0f;
+      break;
+    case SIM_OCMODE_FORCED_HIGH:
+      active = 1.0f;
+      break;
+    case SIM_OCMODE_FORCED_LOW:
+    default:
+      active = 0.0f;
+      break;
+  }
+
+  return ((TIM1->CCER & (TIM_CCER_CC1P << (channel * 4U))) != 0U) ? 1.0f - active : active;
+}
+
+/**
+  * @brief  Write a recorder line for every light whose output changed
+  * @retval None
+  */
+static void Sim_Tim1_Record(void) {
+  if (record_fd < 0) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < VAL_LIGHT_COUNT; i++) {
+    uint32_t channel = (VAL_Channels[i].pwm_channel / 4U) & 3U;
+    Sim_PwmRecord_t now = {
+      Sim_Tim1_Compare(channel),
+      ((((TIM1->CR1 & TIM_CR1_ARPE) != 0U) ? tim1.arr : TIM1->ARR) & 0xFFFFU) + 1U,
+      (uint32_t)(Sim_Tim1_Duty(channel) * 1000.0f + 0.5f),
+    };
+    char line[96];
+    int length;
+
+    if (memcmp(&now, &recorded[i], sizeof(now)) == 0) {
+      continue;
+    }
+    recorded[i] = now;
+
+    length = snprintf(line, sizeof(line), "%llu,%u,%lu,%lu,%lu\n",
+                      (unsigned long long)(Sim_GetNanos() / 1000U), (unsigned)(i + 1U),
+                      (unsigned long)now.compare, (unsigned long)now.period, (unsigned long)now.permille);
+    (void)!write(record_fd, line, (size_t)length);
+  }
+}
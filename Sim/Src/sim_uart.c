@@ -0,0 +1,331 @@
+/**
+  ******************************************************************************
+  * @file    sim_uart.c
+  * @brief   Host simulation of USART1 on a pseudo-terminal
+  ******************************************************************************
+  * @attention
+  *
+  * USART1 is connected to the master side of a pseudo-terminal. The slave
+  * side is linked from SIM_UART_LINK (default <state dir>/uart) and takes
+  * any terminal program or host tool as on the real serial port; the
+  * terminal's own line settings do not matter. The master is kept open
+  * across resets (SIM_UART_FD), so a connected host sees the device
+  * restart rather than the port vanish.
+  *
+  * Bytes move at the baud rate set in BRR, ten bit times per byte. The
+  * transmitter takes bytes from DMA1 channel 4 while DMAT is set, or a
+  * byte written to TDR, and sets TC once it runs out. The receiver
+  * delivers to DMA1 channel 5 while DMAR is set, with IDLE at the end of
+  * each burst (and RTOF with the receiver timeout on, which ends Modbus
+  * frames whatever RTOR holds), or otherwise one byte at a time through RDR and RXNE; the
+  * next byte follows once the interrupt handler has read it. Received
+  * bytes wait in the pseudo-terminal rather than overrun, and what the
+  * host cannot take is dropped. Break, framing errors, DMX timing and the
+  * RTS/CTS and driver enable lines are not simulated.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "stm32l4xx_hal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* termios.h names output delay flags after the USART registers */
+#undef CR1
+#undef CR2
+#undef CR3
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_UART_FIFO_SIZE    256U
+#define SIM_UART_TDR_EMPTY    0xFFFFU       /* Written to TDR after each byte taken, above 9 bits */
+#define SIM_UART_BITS_PER_BYTE 10U
+#define SIM_UART_ISR_ALWAYS   (USART_ISR_TEACK | USART_ISR_REACK | USART_ISR_TXE)
+#define SIM_UART_ISR_CLEARABLE (USART_ISR_PE | USART_ISR_FE | USART_ISR_NE | USART_ISR_ORE | \
+                               USART_ISR_IDLE | USART_ISR_TC | USART_ISR_LBDF | USART_ISR_CTSIF | \
+                               USART_ISR_RTOF | USART_ISR_EOBF | USART_ISR_CMF | USART_ISR_WUF)
+
+/* Private variables ---------------------------------------------------------*/
+static int master_fd = -1;
+static uint32_t isr_flags = USART_ISR_TC;
+static uint8_t rx_fifo[SIM_UART_FIFO_SIZE];
+static uint32_t rx_head = 0;
+static uint32_t rx_count = 0;
+static uint64_t rx_credit_ns = 0;
+static uint64_t tx_credit_ns = 0;
+static bool tx_active = false;          /* Bytes sent since TC was last set */
+static bool rx_burst = false;           /* Bytes received since IDLE was last set */
+
+/* Private function prototypes -----------------------------------------------*/
+static void Sim_Uart_Init(void);
+static void Sim_Uart_Sync(void);
+static void Sim_Uart_Advance(uint32_t ns);
+static void Sim_Uart_Lines(void);
+static uint32_t Sim_Uart_ByteNs(void);
+static void Sim_Uart_Fill(void);
+static bool Sim_Uart_Deliver(void);
+static void Sim_Uart_Send(const uint8_t* data, size_t length);
+
+/* Exported variables --------------------------------------------------------*/
+const Sim_Model_t Sim_UartModel = {
+  Sim_Uart_Init, Sim_Uart_Sync, Sim_Uart_Advance, Sim_Uart_Lines
+};
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Get the pseudo-terminal master, opening it on first use
+  * @retval int: File descriptor, -1 if none could be opened
+  */
+int Sim_Uart_Open(void) {
+  const char* inherited = getenv("SIM_UART_FD");
+  char default_link[512];
+  const char* link;
+  struct termios raw;
+  int slave_fd;
+
+  if (master_fd >= 0) {
+    return master_fd;
+  }
+
+  if (inherited != NULL && fcntl(atoi(inherited), F_GETFD) >= 0) {
+    master_fd = atoi(inherited);
+    return master_fd;
+  }
+
+  master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (master_fd < 0 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0) {
+    Sim_Log("cannot open a pseudo-terminal: %s", strerror(errno));
+    return -1;
+  }
+
+  /* Held open so the master never reads end-of-file between host sessions */
+  slave_fd = open(ptsname(master_fd), O_RDWR | O_NOCTTY);
+  if (slave_fd >= 0 && tcgetattr(slave_fd, &raw) == 0) {
+    cfmakeraw(&raw);
+    tcsetattr(slave_fd, TCSANOW, &raw);
+  }
+
+  snprintf(default_link, sizeof(default_link), "%s/uart", Sim_GetEnv("SIM_STATE_DIR", ".sim"));
+  link = Sim_GetEnv("SIM_UART_LINK", default_link);
+  unlink(link);
+  if (symlink(ptsname(master_fd), link) != 0) {
+    Sim_Log("cannot link %s: %s", link, strerror(errno));
+  }
+  Sim_Log("serial port on %s (%s)", ptsname(master_fd), link);
+  return master_fd;
+}
+
+/**
+  * @brief  USART1 interrupt handler returned: RDR counts as read
+  * @retval None
+  */
+void Sim_Uart_Dispatched(void) {
+  if ((isr_flags & USART_ISR_RXNE) != 0U && (USART1->CR1 & USART_CR1_RXNEIE) != 0U) {
+    isr_flags &= ~USART_ISR_RXNE;
+    (void)Sim_Uart_Deliver();
+    USART1->ISR = isr_flags | SIM_UART_ISR_ALWAYS;
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Reset state and open the pseudo-terminal
+  * @retval None
+  */
+static void Sim_Uart_Init(void) {
+  isr_flags = USART_ISR_TC;
+  rx_head = 0;
+  rx_count = 0;
+  tx_active = false;
+  rx_burst = false;
+  USART1->TDR = SIM_UART_TDR_EMPTY;
+  USART1->ISR = isr_flags | SIM_UART_ISR_ALWAYS;
+  (void)Sim_Uart_Open();
+}
+
+/**
+  * @brief  Apply flag clears, requests and a byte written to TDR
+  * @retval None
+  */
+static void Sim_Uart_Sync(void) {
+  uint32_t tdr = USART1->TDR;
+
+  isr_flags &= ~(USART1->ICR & SIM_UART_ISR_CLEARABLE);
+  USART1->ICR = 0;
+  if ((USART1->RQR & USART_RQR_RXFRQ) != 0U) {
+    isr_flags &= ~USART_ISR_RXNE;
+  }
+  USART1->RQR = 0;
+
+  if (tdr != SIM_UART_TDR_EMPTY) {
+    uint8_t byte = (uint8_t)tdr;
+
+    USART1->TDR = SIM_UART_TDR_EMPTY;
+    if ((USART1->CR1 & (USART_CR1_UE | USART_CR1_TE)) == (USART_CR1_UE | USART_CR1_TE)) {
+      Sim_Uart_Send(&byte, 1U);
+      isr_flags &= ~USART_ISR_TC;
+      tx_active = true;
+    }
+  }
+
+  USART1->ISR = isr_flags | SIM_UART_ISR_ALWAYS;
+}
+
+/**
+  * @brief  Move bytes for a step
+  * @param  ns: Time step
+  * @retval None
+  */
+static void Sim_Uart_Advance(uint32_t ns) {
+  uint32_t byte_ns = Sim_Uart_ByteNs();
+  uint8_t out[SIM_UART_FIFO_SIZE];
+  size_t length = 0;
+  uint32_t value;
+
+  if ((USART1->CR1 & USART_CR1_UE) == 0U || byte_ns == 0U) {
+    return;
+  }
+
+  /* Transmitter */
+  tx_credit_ns += ns;
+  while (tx_credit_ns >= byte_ns && length < sizeof(out) && (USART1->CR1 & USART_CR1_TE) != 0U &&
+         (USART1->CR3 & USART_CR3_DMAT) != 0U && Sim_Dma_Read(DMA1_Channel4, &value)) {
+    out[length++] = (uint8_t)value;
+    tx_credit_ns -= byte_ns;
+  }
+  if (length > 0U) {
+    Sim_Uart_Send(out, length);
+    isr_flags &= ~USART_ISR_TC;
+    tx_active = true;
+  } else {
+    if (tx_active) {
+      isr_flags |= USART_ISR_TC;
+      tx_active = false;
+    }
+    tx_credit_ns = 0;
+  }
+
+  /* Receiver */
+  if ((USART1->CR1 & USART_CR1_RE) != 0U) {
+    Sim_Uart_Fill();
+    rx_credit_ns += ns;
+    while (rx_count > 0U && rx_credit_ns >= byte_ns && Sim_Uart_Deliver()) {
+      rx_credit_ns -= byte_ns;
+    }
+    if (rx_count == 0U) {
+      rx_credit_ns = 0;
+      if (rx_burst) {
+        isr_flags |= USART_ISR_IDLE;
+        if ((USART1->CR2 & USART_CR2_RTOEN) != 0U) {
+          isr_flags |= USART_ISR_RTOF;
+        }
+        rx_burst = false;
+      }
+    }
+  }
+
+  USART1->ISR = isr_flags | SIM_UART_ISR_ALWAYS;
+}
+
+/**
+  * @brief  Raise the USART1 interrupt line
+  * @retval None
+  */
+static void Sim_Uart_Lines(void) {
+  uint32_t cr1 = USART1->CR1;
+  bool active = ((isr_flags & USART_ISR_RXNE) != 0U && (cr1 & USART_CR1_RXNEIE) != 0U) ||
+                ((isr_flags & USART_ISR_ORE) != 0U && ((cr1 & USART_CR1_RXNEIE) != 0U ||
+                                                      (USART1->CR3 & USART_CR3_EIE) != 0U)) ||
+                ((isr_flags & USART_ISR_TC) != 0U && (cr1 & USART_CR1_TCIE) != 0U) ||
+                ((cr1 & USART_CR1_TXEIE) != 0U) ||
+                ((isr_flags & USART_ISR_IDLE) != 0U && (cr1 & USART_CR1_IDLEIE) != 0U) ||
+                ((isr_flags & USART_ISR_RTOF) != 0U && (cr1 & USART_CR1_RTOIE) != 0U);
+
+  if (active && (cr1 & USART_CR1_UE) != 0U) {
+    Sim_RaiseIrq(USART1_IRQn);
+  }
+}
+
+/**
+  * @brief  Time on the line for one byte at the configured baud rate
+  * @retval uint32_t: Nanoseconds, 0 if BRR is not set
+  */
+static uint32_t Sim_Uart_ByteNs(void) {
+  uint32_t brr = USART1->BRR & 0xFFFFU;
+  uint64_t divider;
+
+  if ((USART1->CR1 & USART_CR1_OVER8) != 0U) {
+    divider = (brr & 0xFFF0U) | ((brr & 0x7U) << 1);
+    divider = (divider + 1U) / 2U;
+  } else {
+    divider = brr;
+  }
+  if (divider == 0U) {
+    return 0U;
+  }
+
+  return (uint32_t)(SIM_UART_BITS_PER_BYTE * 1000000000ULL * divider / HAL_RCC_GetPCLK2Freq());
+}
+
+/**
+  * @brief  Top up the receive FIFO from the pseudo-terminal
+  * @retval None
+  */
+static void Sim_Uart_Fill(void) {
+  while (master_fd >= 0 && rx_count < SIM_UART_FIFO_SIZE) {
+    uint32_t tail = (rx_head + rx_count) % SIM_UART_FIFO_SIZE;
+    uint32_t space = (tail >= rx_head) ? SIM_UART_FIFO_SIZE - tail : rx_head - tail;
+    ssize_t got = read(master_fd, &rx_fifo[tail], space);
+
+    if (got <= 0) {
+      break;
+    }
+    rx_count += (uint32_t)got;
+  }
+}
+
+/**
+  * @brief  Hand the next received byte to DMA or to RDR
+  * @retval bool: false if RDR still holds an unread byte
+  */
+static bool Sim_Uart_Deliver(void) {
+  uint8_t byte;
+
+  if (rx_count == 0U) {
+    return false;
+  }
+  byte = rx_fifo[rx_head];
+
+  if ((USART1->CR3 & USART_CR3_DMAR) == 0U || !Sim_Dma_Write(DMA1_Channel5, byte)) {
+    if ((isr_flags & USART_ISR_RXNE) != 0U) {
+      return false;
+    }
+    USART1->RDR = byte;
+    isr_flags |= USART_ISR_RXNE;
+  }
+
+  rx_head = (rx_head + 1U) % SIM_UART_FIFO_SIZE;
+  rx_count--;
+  rx_burst = true;
+  return true;
+}
+
+/**
+  * @brief  Write bytes to the host, dropping what it cannot take
+  * @param  data: Bytes
+  * @param  length: Number of bytes
+  * @retval None
+  */
+static void Sim_Uart_Send(const uint8_t* data, size_t length) {
+  if (master_fd >= 0) {
+    (void)!write(master_fd, data, length);
+  }
+}
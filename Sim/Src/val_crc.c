@@ -0,0 +1,168 @@
+/**
+  ******************************************************************************
+  * @file    val_crc.c
+  * @brief   Vendor Abstraction Layer for CRC computation, host simulation
+  ******************************************************************************
+  * @attention
+  *
+  * Takes the place of Drivers/VAL/Src/val_crc.c in the simulation, where
+  * there is no CRC unit: every CRC is computed in software, with the same
+  * results. A DMA run completes in VAL_Crc_StartDma and is collected by
+  * the first VAL_Crc_PollDma.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_crc.h"
+#include <stdbool.h>
+
+/* Private define ------------------------------------------------------------*/
+#define CRC32_POLY_REFLECTED    0xEDB88320U   /* VAL_CRC32_POLY with its bits reversed */
+#define CRC16_MODBUS_POLY_REFLECTED 0xA001U   /* VAL_CRC16_MODBUS_POLY with its bits reversed */
+
+/* Private variables ---------------------------------------------------------*/
+static bool dma_running = false;
+static uint32_t dma_result;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t Crc_Software(VAL_Crc_Type_t type, uint32_t crc, const uint8_t* bytes, size_t length);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Initialize the CRC unit
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_Crc_Init(void) {
+  dma_running = false;
+  return VAL_OK;
+}
+
+/**
+  * @brief  Compute the CRC of a buffer
+  * @param  type: CRC to compute
+  * @param  data: Bytes
+  * @param  length: Number of bytes
+  * @retval uint32_t: CRC, 16-bit ones in the low half
+  */
+uint32_t VAL_Crc_Compute(VAL_Crc_Type_t type, const void* data, size_t length) {
+  return VAL_Crc_ComputeSoftware(type, data, length);
+}
+
+/**
+  * @brief  Carry a CRC on over the bytes that follow
+  * @param  type: CRC to compute
+  * @param  crc: CRC of the bytes before, from VAL_Crc_Compute or VAL_Crc_Extend
+  * @param  data: Bytes that follow
+  * @param  length: Number of bytes
+  * @retval uint32_t: CRC of all the bytes so far, 16-bit ones in the low half
+  */
+uint32_t VAL_Crc_Extend(VAL_Crc_Type_t type, uint32_t crc, const void* data, size_t length) {
+  return Crc_Software(type, crc, (const uint8_t*)data, length);
+}
+
+/**
+  * @brief  Compute the CRC of a buffer in software
+  * @param  type: CRC to compute
+  * @param  data: Bytes
+  * @param  length: Number of bytes
+  * @retval uint32_t: CRC, 16-bit ones in the low half
+  */
+uint32_t VAL_Crc_ComputeSoftware(VAL_Crc_Type_t type, const void* data, size_t length) {
+  /* The CRC-32 is inverted on the way out */
+  uint32_t initial = (type == VAL_CRC_32) ? (VAL_CRC32_INIT ^ 0xFFFFFFFFU) : VAL_CRC16_INIT;
+
+  return Crc_Software(type, initial, (const uint8_t*)data, length);
+}
+
+/**
+  * @brief  Compute the CRC of a block, to be collected with VAL_Crc_PollDma
+  * @param  type: CRC to compute
+  * @param  data: Bytes
+  * @param  length: Number of bytes, at least 1
+  * @retval VAL_Status: VAL_OK if started, VAL_BUSY if a run is not collected
+  *         yet, VAL_PARAM if invalid
+  */
+VAL_Status VAL_Crc_StartDma(VAL_Crc_Type_t type, const void* data, size_t length) {
+  if (type >= VAL_CRC_TYPE_COUNT || data == NULL || length == 0) {
+    return VAL_PARAM;
+  }
+
+  if (dma_running) {
+    return VAL_BUSY;
+  }
+
+  dma_result = VAL_Crc_ComputeSoftware(type, data, length);
+  dma_running = true;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Collect the run started by VAL_Crc_StartDma
+  * @param  crc: Pointer to store the CRC, 16-bit ones in the low half
+  * @retval VAL_Status: VAL_OK once done, VAL_ERROR if no run was started
+  */
+VAL_Status VAL_Crc_PollDma(uint32_t* crc) {
+  if (!dma_running) {
+    return VAL_ERROR;
+  }
+
+  if (crc != NULL) {
+    *crc = dma_result;
+  }
+  dma_running = false;
+
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Carry a CRC on over a buffer
+  * @param  type: CRC to compute
+  * @param  crc: CRC of the bytes before
+  * @param  bytes: Bytes that follow
+  * @param  length: Number of bytes
+  * @retval uint32_t: CRC, 16-bit ones in the low half
+  */
+static uint32_t Crc_Software(VAL_Crc_Type_t type, uint32_t crc, const uint8_t* bytes, size_t length) {
+  if (type == VAL_CRC_16_CCITT) {
+    uint16_t state = (uint16_t)crc;
+
+    for (size_t i = 0; i < length; i++) {
+      state ^= (uint16_t)bytes[i] << 8;
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        state = (state & 0x8000U) ? (uint16_t)((state << 1) ^ VAL_CRC16_POLY) : (uint16_t)(state << 1);
+      }
+    }
+    return state;
+  }
+
+  if (type == VAL_CRC_32) {
+    uint32_t state = crc ^ 0xFFFFFFFFU;
+
+    for (size_t i = 0; i < length; i++) {
+      state ^= bytes[i];
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        state = (state & 1U) ? ((state >> 1) ^ CRC32_POLY_REFLECTED) : (state >> 1);
+      }
+    }
+    return state ^ 0xFFFFFFFFU;
+  }
+
+  if (type == VAL_CRC_16_MODBUS) {
+    uint16_t state = (uint16_t)crc;
+
+    for (size_t i = 0; i < length; i++) {
+      state ^= bytes[i];
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        state = (state & 1U) ? (uint16_t)((state >> 1) ^ CRC16_MODBUS_POLY_REFLECTED) : (uint16_t)(state >> 1);
+      }
+    }
+    return state;
+  }
+
+  return 0;
+}
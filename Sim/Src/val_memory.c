@@ -0,0 +1,64 @@
+/**
+  ******************************************************************************
+  * @file    val_memory.c
+  * @brief   Vendor Abstraction Layer for the memory map, host simulation
+  ******************************************************************************
+  * @attention
+  *
+  * Takes the place of Drivers/VAL/Src/val_memory.c in the simulation,
+  * which has no linker script of its own. The image is the program's own
+  * code, from the start of the executable to etext, and the spare RAM a
+  * buffer nothing else uses, so the background checks run as on the
+  * target.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_memory.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_SPARE_RAM_WORDS  1024U
+
+/* Host linker symbols */
+extern const uint8_t __executable_start[];
+extern const uint8_t etext[];
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t spare_ram[SIM_SPARE_RAM_WORDS];
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Get the bytes of the running program's code
+  * @param  start: Pointer to store the first byte
+  * @param  length: Pointer to store the number of bytes
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if a pointer is NULL
+  */
+VAL_Status VAL_Memory_GetImage(const uint8_t** start, size_t* length) {
+  if (start == NULL || length == NULL) {
+    return VAL_PARAM;
+  }
+
+  *start = __executable_start;
+  *length = (size_t)(etext - __executable_start);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the RAM no one uses
+  * @param  start: Pointer to store the first word
+  * @param  end: Pointer to store the word after the last
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if a pointer is NULL
+  */
+VAL_Status VAL_Memory_GetSpareRam(uint32_t** start, uint32_t** end) {
+  if (start == NULL || end == NULL) {
+    return VAL_PARAM;
+  }
+
+  *start = spare_ram;
+  *end = spare_ram + SIM_SPARE_RAM_WORDS;
+
+  return VAL_OK;
+}
@@ -0,0 +1,161 @@
+/**
+  ******************************************************************************
+  * @file    val_rtc.c
+  * @brief   Vendor Abstraction Layer for the real-time clock, host simulation
+  ******************************************************************************
+  * @attention
+  *
+  * Takes the place of Drivers/VAL/Src/val_rtc.c in the simulation. The
+  * calendar is the host's realtime clock plus an offset kept, with the
+  * backup registers, in the state file (sim.h), so it survives a reset
+  * and is lost on a power cycle as on the target.
+  *
+  * The calibration is rounded to whole pulses per 32 s cycle and read
+  * back as on the target, but does not change the rate: the host clock
+  * is taken as exact. Adjustments apply at once.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_rtc.h"
+#include "sim.h"
+#include <time.h>
+
+/* Private define ------------------------------------------------------------*/
+#define RTC_CAL_CYCLE_PULSES  1048576LL  /* LSE pulses per 32 s calibration cycle */
+
+/* Private function prototypes -----------------------------------------------*/
+static int64_t RTC_HostTime(void);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Initialize the RTC
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_RTC_Init(void) {
+  return VAL_OK;
+}
+
+/**
+  * @brief  Check whether the calendar holds a time
+  * @retval bool: true once set, also after a reset
+  */
+bool VAL_RTC_IsSet(void) {
+  return Sim_State->rtc_set != 0U;
+}
+
+/**
+  * @brief  Get the current time
+  * @retval uint64_t: Milliseconds since 1970-01-01 UTC, 0 if never set
+  */
+uint64_t VAL_RTC_GetTime(void) {
+  if (!VAL_RTC_IsSet()) {
+    return 0;
+  }
+
+  return (uint64_t)(RTC_HostTime() + Sim_State->rtc_offset_ms);
+}
+
+/**
+  * @brief  Set the time
+  * @param  time_ms: Milliseconds since 1970-01-01 UTC, within VAL_RTC_TIME_MIN_MS
+  *         and VAL_RTC_TIME_MAX_MS
+  * @retval VAL_Status: VAL_OK if set, VAL_PARAM if out of range
+  */
+VAL_Status VAL_RTC_SetTime(uint64_t time_ms) {
+  if (time_ms < VAL_RTC_TIME_MIN_MS || time_ms > VAL_RTC_TIME_MAX_MS) {
+    return VAL_PARAM;
+  }
+
+  Sim_State->rtc_offset_ms = (int64_t)time_ms - RTC_HostTime();
+  Sim_State->rtc_set = 1U;
+  return VAL_OK;
+}
+
+/**
+  * @brief  Move the time forwards or backwards by less than a second
+  * @param  delta_ms: Correction in milliseconds, -999 to 999, positive to advance
+  * @retval VAL_Status: VAL_OK if applied, VAL_PARAM if out of range,
+  *         VAL_ERROR if never set
+  */
+VAL_Status VAL_RTC_Adjust(int32_t delta_ms) {
+  if (delta_ms <= -1000 || delta_ms >= 1000) {
+    return VAL_PARAM;
+  }
+  if (!VAL_RTC_IsSet()) {
+    return VAL_ERROR;
+  }
+
+  Sim_State->rtc_offset_ms += delta_ms;
+  return VAL_OK;
+}
+
+/**
+  * @brief  Trim the RTC rate
+  * @param  ppb: Rate change in parts per billion, positive to run faster,
+  *         within VAL_RTC_CALIBRATION_MAX_PPB either way
+  * @retval VAL_Status: VAL_OK if set, VAL_PARAM if out of range
+  */
+VAL_Status VAL_RTC_SetCalibration(int32_t ppb) {
+  if (ppb < -VAL_RTC_CALIBRATION_MAX_PPB || ppb > VAL_RTC_CALIBRATION_MAX_PPB) {
+    return VAL_PARAM;
+  }
+
+  /* Rounded to the nearest pulse per 32 s cycle, as the target reads it back */
+  int64_t scaled = (int64_t)ppb * RTC_CAL_CYCLE_PULSES;
+  int64_t pulses = (scaled + ((scaled < 0) ? -500000000LL : 500000000LL)) / 1000000000LL;
+
+  Sim_State->rtc_calibration_ppb = (int32_t)(pulses * 1000000000LL / RTC_CAL_CYCLE_PULSES);
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the calibration in effect
+  * @retval int32_t: Rate change in parts per billion, positive if faster
+  */
+int32_t VAL_RTC_GetCalibration(void) {
+  return Sim_State->rtc_calibration_ppb;
+}
+
+/**
+  * @brief  Read a backup register
+  * @param  index: Register number (0 to VAL_RTC_BACKUP_COUNT - 1)
+  * @retval uint32_t: Register value, 0 if the index is out of range
+  */
+uint32_t VAL_RTC_ReadBackup(uint8_t index) {
+  if (index >= VAL_RTC_BACKUP_COUNT) {
+    return 0;
+  }
+
+  return Sim_State->backup[index];
+}
+
+/**
+  * @brief  Write a backup register
+  * @param  index: Register number (0 to VAL_RTC_BACKUP_COUNT - 1)
+  * @param  value: Value to keep
+  * @retval VAL_Status: VAL_OK if written, VAL_PARAM if the index is out of range
+  */
+VAL_Status VAL_RTC_WriteBackup(uint8_t index, uint32_t value) {
+  if (index >= VAL_RTC_BACKUP_COUNT) {
+    return VAL_PARAM;
+  }
+
+  Sim_State->backup[index] = value;
+  return VAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Host realtime clock
+  * @retval int64_t: Milliseconds since 1970-01-01 UTC
+  */
+static int64_t RTC_HostTime(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
@@ -0,0 +1,244 @@
+/**
+  ******************************************************************************
+  * @file    val_sys_clock.c
+  * @brief   Vendor Abstraction Layer for system clock, host simulation
+  ******************************************************************************
+  * @attention
+  *
+  * Takes the place of Drivers/VAL/Src/val_sys_clock.c in the simulation.
+  * The microsecond count is the host's monotonic clock, as the models
+  * use, rather than the DWT cycle counter, which does not count on the
+  * host; the cycle count is derived from it at the core clock in use.
+  *
+  * The clock levels and their checks are those of the target. The
+  * switch writes the same RCC registers and has the system model apply
+  * them at once, since the tick that would otherwise do so is held off
+  * while interrupts are disabled; the peripherals follow as on the
+  * target.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_sys_clock.h"
+#include "rcc.h"
+#include "sim.h"
+#include "val_analog.h"
+#include "val_pwm.h"
+#include "val_serial_comms.h"
+#include "val_timers.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TICK_TIMER_HZ 1000000U  /* TIM7 count rate, as set by HAL_InitTick */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint32_t hclk_hz;
+  uint32_t ahb_divider;   /* RCC_SYSCLK_DIVx */
+  uint32_t flash_latency; /* Wait states in voltage range 1 */
+} SysClock_LevelConfig_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const SysClock_LevelConfig_t level_configs[VAL_SYSCLOCK_LEVEL_COUNT] = {
+  {4000000U,  RCC_SYSCLK_DIV1, FLASH_LATENCY_0},  /* MSI */
+  {32000000U, RCC_SYSCLK_DIV2, FLASH_LATENCY_1},  /* PLL / 2, as set by SystemClock_Config */
+  {64000000U, RCC_SYSCLK_DIV1, FLASH_LATENCY_3},  /* PLL */
+};
+
+static volatile VAL_SysClock_Level_t clock_level = VAL_SYSCLOCK_LEVEL_NOMINAL;
+static uint64_t micros_offset = 0;  /* Time reported stopped, not seen by the host clock */
+
+/* Private function prototypes -----------------------------------------------*/
+static VAL_Status CheckPeripherals(uint32_t hclk_hz);
+static void UpdateTickSources(uint32_t old_hclk_hz);
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Initialize the system clock
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_SysClock_Init(void) {
+  /* Configure the system clock; the RCC model sets the ready flags */
+  SystemClock_Config();
+
+  micros_offset = 0;
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the system tick count
+  * @retval uint32_t: Current tick count in milliseconds
+  */
+uint32_t VAL_SysClock_GetTick(void) {
+  return HAL_GetTick();
+}
+
+/**
+  * @brief  Delay execution for a specified number of milliseconds
+  * @param  delay: Delay in milliseconds
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_SysClock_Delay(uint32_t delay) {
+  HAL_Delay(delay);
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the current system clock frequency
+  * @retval uint32_t: Clock frequency in Hz
+  */
+uint32_t VAL_SysClock_GetFrequency(void) {
+  return SystemCoreClock;
+}
+
+/**
+  * @brief  Get current time in microseconds
+  * @retval uint32_t: Microseconds since start-up, low word
+  */
+uint32_t VAL_SysClock_GetMicros(void) {
+  return (uint32_t)VAL_SysClock_GetMicros64();
+}
+
+/**
+  * @brief  Get current time in microseconds, without wrapping
+  * @retval uint64_t: Microseconds since start-up
+  */
+uint64_t VAL_SysClock_GetMicros64(void) {
+  return Sim_GetNanos() / 1000U + micros_offset;
+}
+
+/**
+  * @brief  Get the core cycle count
+  * @note   Host time at the core clock in use
+  * @retval uint32_t: Cycles, wrapping every 2^32
+  */
+uint32_t VAL_SysClock_GetCycles(void) {
+  return (uint32_t)(VAL_SysClock_GetMicros64() * (SystemCoreClock / 1000000U));
+}
+
+/**
+  * @brief  Convert a cycle interval to microseconds
+  * @param  cycles: Number of core clock cycles
+  * @retval uint32_t: Duration in microseconds
+  */
+uint32_t VAL_SysClock_CyclesToMicros(uint32_t cycles) {
+  return cycles / (SystemCoreClock / 1000000U);
+}
+
+/**
+  * @brief  Account for time the core clock was stopped
+  * @param  ms: Time spent stopped, in milliseconds
+  * @retval None
+  */
+void VAL_SysClock_AdvanceTime(uint32_t ms) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  micros_offset += (uint64_t)ms * 1000U;
+  uwTick += ms;
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Switch the core clock to another level
+  * @param  level: Clock level to run at
+  * @retval VAL_Status: VAL_OK if running at the level, VAL_PARAM if the
+  *         level is invalid or the baud rate cannot be generated at it,
+  *         VAL_BUSY if a peripheral cannot follow now; try again later
+  */
+VAL_Status VAL_SysClock_SetLevel(VAL_SysClock_Level_t level) {
+  const SysClock_LevelConfig_t* config;
+  uint32_t old_hclk_hz;
+  uint32_t primask;
+  VAL_Status status;
+
+  if (level >= VAL_SYSCLOCK_LEVEL_COUNT) {
+    return VAL_PARAM;
+  }
+
+  if (level == clock_level) {
+    return VAL_OK;
+  }
+
+  config = &level_configs[level];
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  if (level != VAL_SYSCLOCK_LEVEL_LOW) {
+    __HAL_RCC_PLL_ENABLE();
+  }
+
+  status = CheckPeripherals(config->hclk_hz);
+  if (status != VAL_OK) {
+    if (clock_level == VAL_SYSCLOCK_LEVEL_LOW) {
+      __HAL_RCC_PLL_DISABLE();
+    }
+    Sim_System_Sync();
+    __set_PRIMASK(primask);
+    return status;
+  }
+
+  old_hclk_hz = SystemCoreClock;
+
+  __HAL_FLASH_SET_LATENCY(config->flash_latency);
+  MODIFY_REG(RCC->CFGR, RCC_CFGR_HPRE, config->ahb_divider);
+  __HAL_RCC_SYSCLK_CONFIG((level == VAL_SYSCLOCK_LEVEL_LOW) ? RCC_SYSCLKSOURCE_MSI : RCC_SYSCLKSOURCE_PLLCLK);
+  if (level == VAL_SYSCLOCK_LEVEL_LOW) {
+    __HAL_RCC_PLL_DISABLE();
+  }
+  Sim_System_Sync();
+  SystemCoreClockUpdate();
+
+  UpdateTickSources(old_hclk_hz);
+  VAL_PWM_UpdateClock();
+  VAL_Analog_UpdateClock();
+  VAL_Timers_UpdateClock();
+  VAL_Serial_UpdateClock();
+  clock_level = level;
+
+  __set_PRIMASK(primask);
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Get the core clock level
+  * @retval VAL_SysClock_Level_t: Level in use
+  */
+VAL_SysClock_Level_t VAL_SysClock_GetLevel(void) {
+  return clock_level;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Check whether the peripherals can follow a clock change now
+  * @param  hclk_hz: Core clock to change to; the APB clocks are undivided
+  * @retval VAL_Status: VAL_OK if they can, VAL_PARAM or VAL_BUSY otherwise
+  */
+static VAL_Status CheckPeripherals(uint32_t hclk_hz) {
+  if (VAL_PWM_IsStrobeActive() || VAL_PWM_IsLatchArmed()) {
+    return VAL_BUSY;
+  }
+
+  return VAL_Serial_CheckClock(hclk_hz);
+}
+
+/**
+  * @brief  Keep the tick sources at their rates after a clock change
+  * @param  old_hclk_hz: Core clock before the change
+  * @retval None
+  */
+static void UpdateTickSources(uint32_t old_hclk_hz) {
+  SysTick->LOAD = ((SysTick->LOAD + 1U) / (old_hclk_hz / 1000U)) * (SystemCoreClock / 1000U) - 1U;
+  TIM7->PSC = HAL_RCC_GetPCLK1Freq() / TICK_TIMER_HZ - 1U;
+}
+
+/**
+  * @brief  System Clock Configuration
+  * @note   This function is imported from main.c
+  * @retval None
+  */
+extern void SystemClock_Config(void);
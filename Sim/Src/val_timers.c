@@ -0,0 +1,209 @@
+/**
+  ******************************************************************************
+  * @file    val_timers.c
+  * @brief   Vendor Abstraction Layer for timer functionality, host simulation
+  ******************************************************************************
+  * @attention
+  *
+  * Takes the place of Drivers/VAL/Src/val_timers.c in the simulation. The
+  * cue timer counts host microseconds from its start, so its alarms keep
+  * to wall-clock time whatever the host scheduling. An alarm that is due
+  * raises the TIM2 line at the end of the next slice (sim_timer.c) and
+  * the handler runs from the TIM2 interrupt as on the target.
+  *
+  * Interrupt latency on the host says nothing about the target: the
+  * latency probe starts and stops but measures nothing.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_timers.h"
+#include "sim.h"
+#include "val_sys_clock.h"
+
+/* Private variables ---------------------------------------------------------*/
+static volatile VAL_Timers_Callback cue_callback = NULL;
+static volatile bool cue_running = false;
+static volatile bool cue_armed = false;
+static uint64_t cue_start_us = 0;
+static volatile uint32_t cue_alarm_us = 0;
+
+#ifdef BENCHMARK
+static bool latency_running = false;
+#endif
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Initialize timers
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_Timers_Init(void) {
+  return VAL_OK;
+}
+
+/**
+  * @brief  De-initialize timers
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_Timers_DeInit(void) {
+  VAL_Timers_StopCueTimer();
+  return VAL_OK;
+}
+
+/**
+  * @brief  Start the cue timer counting from 0
+  * @param  callback: Called from the timer interrupt when the alarm fires
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if callback is NULL
+  */
+VAL_Status VAL_Timers_StartCueTimer(VAL_Timers_Callback callback) {
+  if (callback == NULL) {
+    return VAL_PARAM;
+  }
+
+  VAL_Timers_StopCueTimer();
+  cue_callback = callback;
+  cue_start_us = VAL_SysClock_GetMicros64();
+  cue_running = true;
+
+  return VAL_OK;
+}
+
+/**
+  * @brief  Stop the cue timer and drop a pending alarm
+  * @retval None
+  */
+void VAL_Timers_StopCueTimer(void) {
+  cue_running = false;
+  cue_armed = false;
+}
+
+/**
+  * @brief  Nothing to follow: the count is host time
+  * @retval None
+  */
+void VAL_Timers_UpdateClock(void) {
+}
+
+/**
+  * @brief  Get the cue timer count
+  * @retval uint32_t: Microseconds since VAL_Timers_StartCueTimer
+  */
+uint32_t VAL_Timers_GetCueTime(void) {
+  if (!cue_running) {
+    return 0;
+  }
+
+  return (uint32_t)(VAL_SysClock_GetMicros64() - cue_start_us);
+}
+
+/**
+  * @brief  Set the cue timer alarm, replacing the previous one
+  * @note   An alarm time already reached fires at the end of the slice
+  * @param  time_us: Cue timer count to fire at
+  * @retval None
+  */
+void VAL_Timers_SetCueAlarm(uint32_t time_us) {
+  cue_alarm_us = time_us;
+  cue_armed = cue_running;
+}
+
+/**
+  * @brief  Cue timer interrupt, fires the alarm once
+  * @retval None
+  */
+void VAL_Timers_CueIRQHandler(void) {
+  if (!Sim_Timer_CueAlarmPending()) {
+    return;
+  }
+
+  cue_armed = false;
+  if (cue_callback != NULL) {
+    cue_callback();
+  }
+}
+
+/**
+  * @brief  Check whether the cue alarm is due
+  * @retval bool: true if armed and reached
+  */
+bool Sim_Timer_CueAlarmPending(void) {
+  return cue_armed && (int32_t)(cue_alarm_us - VAL_Timers_GetCueTime()) <= 0;
+}
+
+#ifdef BENCHMARK
+/**
+  * @brief  Start the latency probe
+  * @note   Measures nothing in the simulation; the figures stay empty
+  * @retval VAL_Status: VAL_OK
+  */
+VAL_Status VAL_Timers_StartLatencyProbe(void) {
+  latency_running = true;
+  return VAL_OK;
+}
+
+/**
+  * @brief  Stop the latency probe
+  * @retval None
+  */
+void VAL_Timers_StopLatencyProbe(void) {
+  latency_running = false;
+}
+
+/**
+  * @brief  Check whether the latency probe runs
+  * @retval bool: true if started
+  */
+bool VAL_Timers_IsLatencyProbeRunning(void) {
+  return latency_running;
+}
+
+/**
+  * @brief  Get the latency measured at one level
+  * @param  level: Interrupt level
+  * @param  latency: Pointer to store the figures, all 0
+  * @retval VAL_Status: VAL_OK if successful, VAL_PARAM if invalid
+  */
+VAL_Status VAL_Timers_GetLatency(VAL_IrqLevel_t level, VAL_Timers_Latency_t* latency) {
+  if (latency == NULL || level >= VAL_IRQ_LEVEL_COUNT) {
+    return VAL_PARAM;
+  }
+
+  latency->count = 0;
+  latency->min_ns = 0;
+  latency->max_ns = 0;
+  return VAL_OK;
+}
+
+/**
+  * @brief  Clear the latency figures of all levels
+  * @retval None
+  */
+void VAL_Timers_ResetLatency(void) {
+}
+
+/**
+  * @brief  Latency probe interrupt, never raised in the simulation
+  * @retval None
+  */
+void VAL_Timers_LatencyIRQHandler(void) {
+}
+#endif
+
+/* Timer Callbacks ----------------------------------------------------------*/
+
+/**
+  * @brief  Period elapsed callback in non blocking mode
+  * @note   Called when the TIM7 model raises its update, inside
+  *         HAL_TIM_IRQHandler(); increments the HAL tick
+  * @param  htim : TIM handle
+  * @retval None
+  */
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
+{
+  if (htim->Instance == TIM7)
+  {
+    HAL_IncTick();
+  }
+}
@@ -0,0 +1,179 @@
+/**
+  ******************************************************************************
+  * @file    val_update.c
+  * @brief   Vendor Abstraction Layer for firmware updates, host simulation
+  ******************************************************************************
+  * @attention
+  *
+  * Takes the place of Drivers/VAL/Src/val_update.c in the simulation. A
+  * firmware update would replace the running image, which the host
+  * cannot do, so VAL_Update_Prepare refuses it and the boot loader is
+  * never asked for. The rest keeps the API for app_update.c.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "val_update.h"
+#include "sim.h"
+#include "stm32l4xx_hal.h"
+
+/* Public functions ----------------------------------------------------------*/
+
+/**
+  * @brief  Check that an update can start
+  * @param  work_size: RAM the updater needs besides the reception ring
+  * @retval VAL_Status: VAL_ERROR, updates are not simulated
+  */
+VAL_Status VAL_Update_Prepare(size_t work_size) {
+  (void)work_size;
+  return VAL_ERROR;
+}
+
+/**
+  * @brief  Record an update request and reset into the boot loader
+  * @note   Not reached, as VAL_Update_Prepare fails
+  * @param  size: Image size in bytes
+  * @param  crc: CRC-32 of the image
+  * @param  address: Device address
+  * @retval None
+  */
+void VAL_Update_Request(uint32_t size, uint32_t crc, uint8_t address) {
+  (void)size;
+  (void)crc;
+  (void)address;
+  Sim_Reset(RCC_CSR_SFTRSTF);
+}
+
+/**
+  * @brief  Take the update request the firmware left
+  * @param  request: Pointer to store the request
+  * @retval bool: false, there is no boot loader
+  */
+bool VAL_Update_TakeRequest(VAL_Update_Request_t* request) {
+  request->size = 0;
+  request->crc = 0;
+  request->baud = 0;
+  request->address = 0;
+  request->rs485 = false;
+  return false;
+}
+
+/**
+  * @brief  Start the firmware after the boot loader
+  * @retval None
+  */
+void VAL_Update_StartApplication(void) {
+}
+
+/**
+  * @brief  Set up the hardware for the updater
+  * @param  request: Link settings
+  * @retval uint8_t*: NULL
+  */
+uint8_t* VAL_Update_Enter(const VAL_Update_Request_t* request) {
+  (void)request;
+  return NULL;
+}
+
+/**
+  * @brief  Take the next received byte
+  * @param  byte: Pointer to store the byte
+  * @retval bool: false, nothing is received
+  */
+bool VAL_Update_ReadByte(uint8_t* byte) {
+  (void)byte;
+  return false;
+}
+
+/**
+  * @brief  Send bytes
+  * @param  data: Bytes to send
+  * @param  length: Number of bytes
+  * @retval None
+  */
+void VAL_Update_Send(const uint8_t* data, size_t length) {
+  (void)data;
+  (void)length;
+}
+
+/**
+  * @brief  Erase a flash page
+  * @param  address: Page address
+  * @retval VAL_Status: VAL_ERROR
+  */
+VAL_Status VAL_Update_ErasePage(uint32_t address) {
+  (void)address;
+  return VAL_ERROR;
+}
+
+/**
+  * @brief  Program flash
+  * @param  address: Flash address
+  * @param  data: Bytes to program
+  * @param  length: Number of bytes
+  * @retval VAL_Status: VAL_ERROR
+  */
+VAL_Status VAL_Update_Program(uint32_t address, const uint8_t* data, size_t length) {
+  (void)address;
+  (void)data;
+  (void)length;
+  return VAL_ERROR;
+}
+
+/**
+  * @brief  Start a new image check
+  * @retval None
+  */
+void VAL_Update_CrcReset(void) {
+}
+
+/**
+  * @brief  Add bytes to the image check
+  * @param  data: Bytes
+  * @param  length: Number of bytes
+  * @retval None
+  */
+void VAL_Update_CrcAdd(const uint8_t* data, size_t length) {
+  (void)data;
+  (void)length;
+}
+
+/**
+  * @brief  Get the image check
+  * @retval uint32_t: 0
+  */
+uint32_t VAL_Update_CrcGet(void) {
+  return 0;
+}
+
+/**
+  * @brief  Get the milliseconds since VAL_Update_Enter
+  * @retval uint32_t: Milliseconds
+  */
+uint32_t VAL_Update_GetTick(void) {
+  return HAL_GetTick();
+}
+
+/**
+  * @brief  Refresh the independent watchdog
+  * @retval None
+  */
+void VAL_Update_Feed(void) {
+}
+
+/**
+  * @brief  Reset the MCU
+  * @retval None
+  */
+void VAL_Update_Reset(void) {
+  Sim_Reset(RCC_CSR_SFTRSTF);
+}
+
+/**
+  * @brief  Reset the MCU at once
+  * @retval None
+  */
+void VAL_Update_Fault(void) {
+  Sim_Reset(RCC_CSR_SFTRSTF);
+}
@@ -0,0 +1,964 @@
+#!/usr/bin/env python3
+"""Hardware-in-the-loop benchmark for the Illuminator firmware.
+
+Runs scripted workloads against a board flashed with the Benchmark build
+configuration and reports the device's DWT profiler statistics as JSON.
+Results can be saved as a baseline and later runs compared against it.
+Two saved results, e.g. of a Debug and a Release build, can be shown side
+by side.
+
+    benchmark.py --port /dev/ttyACM0 --save-baseline baseline.json
+    benchmark.py --port /dev/ttyACM0 --baseline baseline.json
+    benchmark.py --port /dev/ttyACM0 --no-alarm --save-baseline debug.json
+    benchmark.py --diff debug.json baseline.json
+    benchmark.py --port /dev/ttyACM0 --record corpus.jsonl
+    benchmark.py --port /dev/ttyACM0 --corpus corpus.jsonl --fuzz 5000
+    benchmark.py --port /dev/ttyACM0 --synthetic-seconds 60
+    benchmark.py --port /dev/ttyACM0 --no-alarm --standby-seconds 10
+    benchmark.py --port /dev/ttyACM0 --no-alarm --blackouts 200
+
+Requires pyserial. See docs/benchmark.md for the metrics.
+"""
+
+import argparse
+import json
+import os
+import random
+import sys
+import time
+
+import illuminator
+
+# Must match ANALOG_SCANS_PER_BLOCK in val_analog.h, the default block size
+SCANS_PER_BLOCK = 4
+
+# Must match POWER_SERIAL_AWAKE_MS in app_power.h, the quiet time before stop mode
+SERIAL_AWAKE_S = 2.0
+
+# Metrics compared against the baseline: name -> True if higher is better
+METRICS = {
+    "round_trips_per_s": True,
+    "command_max_us": False,
+    "pwm_update_max_us": False,
+    "pwm_update_jitter_us": False,
+    "adc_scan_rate_hz": True,
+    "adc_block_jitter_us": False,
+    "sensor_update_avg_us": False,
+    "adc_isr_percent": False,
+    "alarm_reaction_max_us": False,
+    "synthetic_filter_max_us": False,
+    "synthetic_cut_max_us": False,
+    "synthetic_event_max_us": False,
+    "selftest_parse_p50_us": False,
+    "selftest_dispatch_p50_us": False,
+    "selftest_format_p50_us": False,
+    "selftest_total_p50_us": False,
+    "selftest_total_max_us": False,
+    "corpus_lines_per_s": True,
+    "corpus_parse_max_us": False,
+    "corpus_command_max_us": False,
+    "link_rtt_us": False,
+    "link_sink_bytes_per_s": True,
+    "link_source_bytes_per_s": True,
+    "crc16_software_us_per_kb": False,
+    "crc16_cpu_us_per_kb": False,
+    "crc16_dma_us_per_kb": False,
+    "crc32_software_us_per_kb": False,
+    "crc32_cpu_us_per_kb": False,
+    "crc32_dma_us_per_kb": False,
+    "crc16_modbus_software_us_per_kb": False,
+    "crc16_modbus_cpu_us_per_kb": False,
+    "crc16_modbus_dma_us_per_kb": False,
+    "copy_word_crossover_bytes": False,
+    "copy_byte_crossover_bytes": False,
+    "kernel_trace_cycles_per_record": False,
+    "kernel_trace_load_permille": False,
+    "kernel_trace_slowdown_percent": False,
+    "irq_latency_safety_max_ns": False,
+    "irq_latency_sampling_max_ns": False,
+    "irq_latency_comms_max_ns": False,
+    "wakeup_rx_max_ns": False,
+    "wakeup_adc_max_ns": False,
+    "wakeup_tx_max_ns": False,
+    "loop_sampling_max_late_us": False,
+    "loop_sampling_max_early_us": False,
+    "loop_sampling_missed": False,
+    "loop_control_max_late_us": False,
+    "loop_control_max_early_us": False,
+    "loop_control_missed": False,
+    "flash_erase_max_us": False,
+    "flash_program_max_us": False,
+    "flash_write_avg_us": False,
+    "flash_irq_latency_safety_max_ns": False,
+    "flash_irq_latency_sampling_max_ns": False,
+    "flash_irq_latency_comms_max_ns": False,
+    "standby_wake_rtt_us": False,
+    "standby_entry_max_us": False,
+    "standby_exit_max_us": False,
+    "blackout_max_us": False,
+    "blackout_bound_us": False,
+}
+
+# Phases reported by system/selftest
+SELFTEST_PHASES = ("parse", "dispatch", "format", "total")
+
+# Interrupt levels reported by system/irq_latency, most urgent first
+IRQ_LEVELS = ("safety", "sampling", "comms")
+
+# Interrupt to task handoffs reported by system/irq_latency
+WAKEUPS = ("rx", "adc", "tx")
+
+# CRCs timed by bench/crc
+CRC_TYPES = ("crc16", "crc32", "crc16_modbus")
+
+# Ways bench/crc computes each of them
+CRC_PATHS = ("software", "cpu", "dma")
+
+# Layouts bench/copy times, destination word aligned and a byte off
+COPY_LAYOUTS = ("word", "byte")
+
+# Loops reported by system/loop_timing
+JITTER_LOOPS = ("sampling", "control")
+
+# Scene overwritten by the flash workload
+FLASH_SCENE = 8
+
+# Queries sent ahead of each blackout frame, in the RX stream as it arrives
+BLACKOUT_LOAD = 8
+
+# Stages timed by bench/synthetic from the edge of the waveform
+SYNTHETIC_STAGES = ("filter", "violation", "cut", "event")
+
+# Output of a light under a synthetic waveform; a current with the output
+# off reads as a sensor fault
+SYNTHETIC_PERMILLE = 500
+
+# Real scans before the edge of a step
+SYNTHETIC_OFFSET_US = 20000
+
+# Spikes of the false trip run: one scan over the limit every 10 ms
+SYNTHETIC_SPIKE_PERIOD_US = 10000
+
+# Never replayed or mutated: they change the link, the clock, the stored
+# settings or the flash, or trip the outputs
+UNSAFE_COMMANDS = {
+    ("system", "set_baud"), ("system", "link"), ("system", "time_sync"),
+    ("system", "update"), ("system", "inject_fault"), ("bench", "synthetic"), ("config", "set"),
+    ("config", "set_calibration"), ("config", "set_address"),
+    ("config", "set_failsafe"), ("config", "set_slew"),
+    ("config", "set_primary"), ("config", "set_ageing"), ("config", "set_trim"),
+    ("config", "set_groups"), ("config", "set_stop_mode"), ("scene", "save"), ("dmx", "start"),
+    ("modbus", "start"), ("macro", "save"), ("macro", "run"),
+}
+
+# Fuzz seeds when no corpus is given
+FUZZ_SEEDS = (
+    '{"type":"cmd","id":1,"topic":"system","action":"ping","data":{}}',
+    '{"type":"cmd","id":"a","topic":"light","action":"set_permille","data":{"id":1,"permille":0}}',
+    '{"type":"cmd","id":2,"topic":"light","action":"set_all_permille","data":{"permilles":[0,0,0]}}',
+    '{"type":"cmd","id":3,"topic":"light","action":"fade","data":{"id":1,"permille":0,"duration":10,"curve":"linear"}}',
+    '{"type":"cmd","id":4,"topic":"telemetry","action":"subscribe","data":{"rate":0,"fields":["intensity","alarms"]}}',
+    '[{"type":"cmd","id":5,"topic":"status","action":"get_all_sensors","data":{}},'
+    '{"type":"cmd","id":6,"topic":"alarm","action":"status","data":{}}]',
+)
+
+# Times a command answered busy is sent again; the device's admission
+# limit answers busy with the time to wait in retry_ms
+BUSY_RETRIES = 20
+
+# Tokens spliced into fuzzed lines
+FUZZ_TOKENS = ("{", "}", "[", "]", ",", ":", "\"", "\\", "\\u0000", "null", "true",
+               "-", "1e99", "-2147483649", "4294967296", "0.5", '"id":', '"data":')
+
+
+class Device:
+    """JSON command link to the board."""
+
+    def __init__(self, port, baud, timeout):
+        # Only needed to talk to a board, --diff works without it
+        import serial
+
+        self.link = serial.Serial(port, baud, timeout=timeout)
+        self.timeout = timeout
+        self.next_id = 0
+        self.events = []
+        self.sent = []
+
+        # Wake the board in case a normal build is in stop mode
+        self.link.write(b"\n")
+        time.sleep(0.01)
+        self.link.reset_input_buffer()
+
+    def send(self, topic, action, data=None):
+        """Send a command and return its message ID."""
+        self.next_id += 1
+        msg_id = "b%d" % self.next_id
+        cmd = {"type": "cmd", "id": msg_id, "topic": topic, "action": action,
+               "data": data or {}}
+        line = json.dumps(cmd, separators=(",", ":"))
+        self.sent.append(line)
+        self.link.write((line + "\n").encode())
+        return msg_id
+
+    def command(self, topic, action, data=None):
+        """Send a command and return the data of its response, retrying while busy."""
+        for _ in range(BUSY_RETRIES):
+            response = self.wait(self.send(topic, action, data))
+            if response is None:
+                raise TimeoutError("%s/%s: no response" % (topic, action))
+            if response.get("status") != "busy":
+                break
+            time.sleep(response.get("retry_ms", 0) / 1000.0)
+        return response
+
+    def wait(self, msg_id):
+        """Return the data of the response to msg_id, None on a timeout."""
+        deadline = time.monotonic() + self.timeout
+        while time.monotonic() < deadline:
+            line = self.link.readline()
+            if not line:
+                continue
+            try:
+                msg = json.loads(line)
+            except ValueError:
+                continue
+            if not isinstance(msg, dict):
+                continue
+            if msg.get("type") == "event":
+                self.events.append(msg)
+            elif msg.get("id") == msg_id:
+                return msg.get("data", {})
+        return None
+
+    def resync(self):
+        """End whatever a fuzzed line left half received, JSON or binary."""
+        self.link.write(b"\n\x00")
+        time.sleep(0.01)
+        self.link.reset_input_buffer()
+
+    def perf(self, reset=False):
+        """Get the profiler probes by name, optionally clearing them."""
+        data = self.command("system", "perf", {"reset": True} if reset else None)
+        return {probe["name"]: probe for probe in data.get("probes", [])}
+
+
+def check_ok(data, what):
+    if data.get("status") != "ok":
+        raise RuntimeError("%s failed: %s" % (what, data.get("message", data)))
+
+
+def bench_round_trip(dev, count):
+    dev.perf(reset=True)
+    start = time.monotonic()
+    for _ in range(count):
+        dev.command("system", "ping")
+    elapsed = time.monotonic() - start
+    probes = dev.perf()
+    return {
+        "round_trips_per_s": round(count / elapsed, 1),
+        "command": probes.get("command"),
+        "command_max_us": probes.get("command", {}).get("max_us"),
+    }
+
+
+def bench_kernel_trace(dev, count):
+    """Cost of the scheduler trace: round trips with it off, then on."""
+    data = dev.command("system", "kernel_trace", {"enable": False})
+    check_ok(data, "system/kernel_trace")
+    start = time.monotonic()
+    for _ in range(count):
+        dev.command("system", "ping")
+    off_s = time.monotonic() - start
+
+    data = dev.command("system", "kernel_trace", {"enable": True})
+    check_ok(data, "system/kernel_trace")
+    start = time.monotonic()
+    for _ in range(count):
+        dev.command("system", "ping")
+    on_s = time.monotonic() - start
+    data = dev.command("system", "kernel_trace", {"enable": False})
+    check_ok(data, "system/kernel_trace")
+
+    status = {key: data.get(key) for key in ("records", "cost_cycles", "elapsed_us",
+                                             "cycles_per_record", "load_permille")}
+    return {
+        "kernel_trace": status,
+        "kernel_trace_cycles_per_record": data.get("cycles_per_record"),
+        "kernel_trace_load_permille": data.get("load_permille"),
+        "kernel_trace_slowdown_percent": round((on_s - off_s) / off_s * 100.0, 1),
+    }
+
+
+def bench_pwm(dev, count):
+    dev.perf(reset=True)
+    for i in range(count):
+        permille = 100 + (i % 2) * 800
+        check_ok(dev.command("light", "set_permille", {"id": 1, "permille": permille}),
+                 "light/set_permille")
+    check_ok(dev.command("light", "set_permille", {"id": 1, "permille": 0}),
+             "light/set_permille")
+    probe = dev.perf().get("pwm_update", {})
+    return {
+        "pwm_update": probe,
+        "pwm_update_max_us": probe.get("max_us"),
+        "pwm_update_jitter_us": probe.get("max_us", 0) - probe.get("min_us", 0),
+    }
+
+
+def bench_adc(dev, seconds):
+    dev.perf(reset=True)
+    time.sleep(seconds)
+    probes = dev.perf()
+    probe = probes.get("adc_block", {})
+    avg_us = probe.get("avg_us", 0)
+    # Share of the CPU in the block interrupt, filters included
+    interrupts = dev.command("system", "cpu").get("interrupts", [])
+    adc_isr = [isr.get("percent") for isr in interrupts if isr.get("name") == "adc_dma"]
+    return {
+        "adc_block": probe,
+        "adc_scan_rate_hz": round(SCANS_PER_BLOCK * 1e6 / avg_us, 1) if avg_us else 0,
+        "adc_block_jitter_us": probe.get("max_us", 0) - probe.get("min_us", 0),
+        "sensor_update": probes.get("sensor_update"),
+        "sensor_update_avg_us": probes.get("sensor_update", {}).get("avg_us"),
+        "adc_isr_percent": adc_isr[0] if adc_isr else None,
+    }
+
+
+def bench_block_scans(dev, sizes, seconds):
+    """CPU load and wakeups at each ADC block size; measure the supply current meanwhile."""
+    results = {}
+    for scans in sizes:
+        check_ok(dev.command("status", "block_scans", {"scans": scans}), "status/block_scans")
+        print("block of %d scans for %g s" % (scans, seconds), file=sys.stderr)
+        dev.perf(reset=True)
+        time.sleep(seconds)
+        avg_us = dev.perf().get("adc_block", {}).get("avg_us", 0)
+        cpu = dev.command("system", "cpu")
+        adc_isr = [isr.get("percent") for isr in cpu.get("interrupts", [])
+                   if isr.get("name") == "adc_dma"]
+        idle = [task.get("percent") for task in cpu.get("tasks", []) if task.get("name") == "IDLE"]
+        results["block_%d_wakeups_per_s" % scans] = round(1e6 / avg_us, 1) if avg_us else None
+        results["block_%d_adc_isr_percent" % scans] = adc_isr[0] if adc_isr else None
+        results["block_%d_cpu_percent" % scans] = round(100 - idle[0], 1) if idle else None
+    check_ok(dev.command("status", "block_scans", {"scans": SCANS_PER_BLOCK}), "status/block_scans")
+    return results
+
+
+def bench_standby(dev, seconds, lights):
+    """Stop mode with all lights off, then the first command; measure the supply current meanwhile."""
+    # Off by default, as the first byte after a stop is lost
+    enabled = dev.command("config", "get").get("stop_mode", False)
+    if not enabled:
+        check_ok(dev.command("config", "set_stop_mode", {"enable": True}), "config/set_stop_mode")
+    check_ok(dev.command("light", "set_all_permille", {"permilles": [0] * lights}),
+             "light/set_all_permille")
+    check_ok(dev.command("telemetry", "unsubscribe"), "telemetry/unsubscribe")
+    before = dev.command("system", "cpu").get("stop", {})
+    start = time.monotonic()
+    print("standby for %g s: read the supply current now" % seconds, file=sys.stderr)
+    time.sleep(SERIAL_AWAKE_S + seconds)
+
+    # No newline ahead of it: without the LPUART listener the first bytes
+    # only wake the board and the command is lost
+    sent = time.monotonic()
+    data = dev.wait(dev.send("system", "ping"))
+    rtt = time.monotonic() - sent
+    lost = data is None
+    if lost:
+        dev.command("system", "ping")
+    elapsed_ms = (time.monotonic() - start) * 1000
+    stop = dev.command("system", "cpu").get("stop", {})
+    if not enabled:
+        check_ok(dev.command("config", "set_stop_mode", {"enable": False}), "config/set_stop_mode")
+
+    return {
+        "standby_frame_lost": lost,
+        "standby_wake_rtt_us": None if lost else round(rtt * 1e6),
+        "standby_stopped_percent": round((stop.get("ms", 0) - before.get("ms", 0)) * 100 / elapsed_ms, 1),
+        "standby_serial_wakes": stop.get("serial_wakes", 0) - before.get("serial_wakes", 0),
+        "standby_entry_max_us": stop.get("entry_max_us"),
+        "standby_exit_max_us": stop.get("exit_max_us"),
+    }
+
+
+def bench_alarm(dev, lights, repeats):
+    reactions = []
+    for _ in range(repeats):
+        for light_id in range(1, lights + 1):
+            dev.perf(reset=True)
+            check_ok(dev.command("system", "inject_fault", {"id": light_id}),
+                     "system/inject_fault")
+            # Trip, then release once the injected fault is withdrawn
+            time.sleep(0.3)
+            probe = dev.perf().get("alarm_reaction", {})
+            if probe.get("count"):
+                reactions.append(probe["max_us"])
+            clear_alarm(dev, light_id)
+    dev.events.clear()
+    return {
+        "alarm_trips": len(reactions),
+        "alarm_reaction_min_us": min(reactions) if reactions else None,
+        "alarm_reaction_max_us": max(reactions) if reactions else None,
+    }
+
+
+def clear_alarm(dev, light_id):
+    """Clear a tripped light, waiting for its release."""
+    for _ in range(10):
+        if dev.command("alarm", "clear", {"id": light_id}).get("status") == "ok":
+            return
+        time.sleep(0.1)
+    raise RuntimeError("alarm on light %d not cleared" % light_id)
+
+
+def run_synthetic(dev, light_id, seconds, wave):
+    """Run one synthetic waveform on a light that is on, and return its report."""
+    check_ok(dev.command("light", "set_permille", {"id": light_id, "permille": SYNTHETIC_PERMILLE}),
+             "light/set_permille")
+    check_ok(dev.command("bench", "synthetic", dict(wave, id=light_id)), "bench/synthetic")
+    time.sleep(seconds)
+    data = dev.command("bench", "synthetic", {"shape": "off"})
+    check_ok(data, "bench/synthetic")
+    if data.get("trips"):
+        clear_alarm(dev, light_id)
+    check_ok(dev.command("light", "set_permille", {"id": light_id, "permille": 0}),
+             "light/set_permille")
+    return data
+
+
+def bench_synthetic(dev, lights, repeats, seconds):
+    """Alarm reaction stage by stage, and false trips, on synthetic currents."""
+    # Builds without BENCHMARK do not know the command
+    if dev.command("bench", "synthetic").get("message") == "Unknown command":
+        return {}
+    limits = dev.command("config", "get").get("lights", [])
+
+    # A step to half again the limit trips every time
+    stages = {name: [] for name in SYNTHETIC_STAGES}
+    for _ in range(repeats):
+        for light_id in range(1, lights + 1):
+            current_max = limits[light_id - 1]["current_max"]
+            data = run_synthetic(dev, light_id, 0.3, {
+                "shape": "step", "current": current_max * 3 // 2, "offset": SYNTHETIC_OFFSET_US})
+            for name in SYNTHETIC_STAGES:
+                if data.get(name + "_us"):
+                    stages[name].append(data[name + "_us"])
+
+    # Noise peaking just under the limit, and single-scan spikes over it,
+    # should never trip
+    current_max = limits[0]["current_max"]
+    noise = run_synthetic(dev, 1, seconds, {
+        "shape": "noise", "current": current_max * 8 // 10, "noise": current_max * 15 // 100})
+    spikes = run_synthetic(dev, 1, seconds, {
+        "shape": "spike", "current": current_max * 2, "period": SYNTHETIC_SPIKE_PERIOD_US})
+    dev.events.clear()
+
+    results = {
+        "synthetic": {"stages_us": stages, "noise": noise, "spikes": spikes},
+        "synthetic_trips": len(stages["cut"]),
+        "synthetic_false_trips": noise.get("trips", 0) + spikes.get("trips", 0),
+    }
+    for name in SYNTHETIC_STAGES:
+        results["synthetic_%s_max_us" % name] = max(stages[name]) if stages[name] else None
+    return results
+
+
+def bench_crc(dev, size):
+    """Time the CRCs in software and on the CRC unit, per kilobyte."""
+    data = dev.command("bench", "crc", {"size": size})
+    check_ok(data, "bench/crc")
+    results = {"crc": data}
+    for crc in CRC_TYPES:
+        if not data.get(crc, {}).get("match"):
+            raise RuntimeError("bench/crc: %s differs between software and the CRC unit" % crc)
+        for path in CRC_PATHS:
+            results["%s_%s_us_per_kb" % (crc, path)] = data[crc].get("%s_us_per_kb" % path)
+    return results
+
+
+def bench_copy(dev, sizes):
+    """Time memcpy against the DMA copy per size and find where the DMA costs the CPU less."""
+    runs = []
+    for size in sorted(sizes):
+        data = dev.command("bench", "copy", {"size": size})
+        check_ok(data, "bench/copy")
+        for layout in COPY_LAYOUTS:
+            if not data.get(layout, {}).get("match"):
+                raise RuntimeError("bench/copy: %s copy of %d bytes differs" % (layout, size))
+        runs.append(data)
+    results = {"copy": runs}
+    for layout in COPY_LAYOUTS:
+        # Smallest size from which every larger one is cheaper by DMA: the
+        # channel setup and the completion interrupt against the memcpy
+        crossover = None
+        for data in reversed(runs):
+            run = data[layout]
+            if run["setup_cycles"] + run["irq_cycles"] >= run["cpu_cycles"]:
+                break
+            crossover = data["size"]
+        results["copy_%s_crossover_bytes" % layout] = crossover
+    return results
+
+
+def bench_selftest(dev):
+    # The device times its own command path on a built-in set of commands
+    data = dev.command("system", "selftest")
+    check_ok(data, "system/selftest")
+    results = {"selftest": {phase: data.get(phase) for phase in SELFTEST_PHASES}}
+    for phase in SELFTEST_PHASES:
+        results["selftest_%s_p50_us" % phase] = data.get(phase, {}).get("p50_us")
+    results["selftest_total_max_us"] = data.get("total", {}).get("max_us")
+    return results
+
+
+def bench_irq_latency(dev, seconds):
+    # Starts the probe on the first call; the figures are cleared after each
+    dev.command("system", "irq_latency", {"reset": True})
+    # Load every level: fades on the sampling level, commands on the comms one
+    deadline = time.monotonic() + seconds
+    i = 0
+    while time.monotonic() < deadline:
+        if i % 4 == 0:
+            check_ok(dev.command("light", "fade", {"id": 1, "permille": 900 * (i // 4 % 2),
+                                                   "duration": 50}),
+                     "light/fade")
+        else:
+            dev.command("status", "get_all_sensors")
+        i += 1
+    check_ok(dev.command("light", "set_permille", {"id": 1, "permille": 0}),
+             "light/set_permille")
+    data = dev.command("system", "irq_latency", {"reset": True})
+    check_ok(data, "system/irq_latency")
+    levels = {level["name"]: level for level in data.get("levels", [])}
+    wakeups = {wakeup["name"]: wakeup for wakeup in data.get("wakeups", [])}
+    results = {"irq_latency": levels, "wakeups": wakeups}
+    for name in IRQ_LEVELS:
+        results["irq_latency_%s_max_ns" % name] = levels.get(name, {}).get("max_ns")
+    # A handoff that never happened under the load has no figure
+    for name in WAKEUPS:
+        wakeup = wakeups.get(name, {})
+        results["wakeup_%s_max_ns" % name] = wakeup.get("max_ns") if wakeup.get("count") else None
+    return results
+
+
+def bench_blackout(dev, count, lights):
+    """Binary alarm/blackout behind a backlog of queries, lights on each time."""
+    protocol = illuminator.Protocol()
+    code = protocol.code("alarm", "blackout")
+    load = "".join(json.dumps({"type": "cmd", "id": "q%d" % i, "topic": "status",
+                               "action": "get_all_sensors", "data": {}},
+                              separators=(",", ":")) + "\n" for i in range(BLACKOUT_LOAD))
+    read_latency(dev)
+    for i in range(count):
+        frame = illuminator.encode_frame(bytes((protocol.BIN_TYPE_CMD, (i + 1) & 0xFF, code)))
+        check_ok(dev.command("light", "set_all_permille", {"permilles": [500] * lights}),
+                 "light/set_all_permille")
+        dev.link.write(load.encode() + frame)
+        # The responses to the load and the binary one are not read
+        time.sleep(0.1)
+        dev.link.reset_input_buffer()
+    permilles = dev.command("light", "get_all_permille").get("permilles", [])
+    dev.events.clear()
+    if any(permilles):
+        raise RuntimeError("alarm/blackout: lights still on: %s" % permilles)
+    entry = read_latency(dev).get(("alarm", "blackout"), {})
+    return {
+        "blackout": entry,
+        "blackout_max_us": entry.get("max_us") if entry.get("count") else None,
+    }
+
+
+def read_latency(dev):
+    """Read and clear system/latency; the command figures by (topic, action)."""
+    commands = {}
+    start = 0
+    while True:
+        data = dev.command("system", "latency", {"from": start})
+        check_ok(data, "system/latency")
+        for command in data.get("commands", []):
+            commands[(command.get("topic"), command.get("action"))] = command
+        start = data.get("next", 0)
+        if not data.get("commands") or start >= data.get("total", 0):
+            return commands
+
+
+def bench_jitter(dev, seconds):
+    """Loop start errors under link, flash and logging load at once."""
+    check_ok(dev.command("system", "loop_timing", {"reset": True}), "system/loop_timing")
+    level = dev.command("system", "log_level").get("level")
+    dev.command("system", "log_level", {"level": "debug"})
+    dev.command("telemetry", "subscribe", {"rate": 50, "fields": ["intensity", "current", "adc"]})
+    deadline = time.monotonic() + seconds
+    i = 0
+    while time.monotonic() < deadline:
+        if i % 20 == 0:
+            check_ok(dev.command("scene", "save", {"id": FLASH_SCENE}), "scene/save")
+        elif i % 2 == 0:
+            dev.command("system", "ping")
+        else:
+            dev.command("status", "get_all_sensors")
+        i += 1
+    check_ok(dev.command("telemetry", "unsubscribe"), "telemetry/unsubscribe")
+    dev.events.clear()
+    if level is not None:
+        dev.command("system", "log_level", {"level": level})
+    data = dev.command("system", "loop_timing", {"reset": True})
+    check_ok(data, "system/loop_timing")
+    loops = {loop["name"]: loop for loop in data.get("loops", [])}
+    results = {"loop_timing": loops}
+    for name in JITTER_LOOPS:
+        for key in ("max_late_us", "max_early_us", "missed"):
+            results["loop_%s_%s" % (name, key)] = loops.get(name, {}).get(key)
+    return results
+
+
+def bench_flash(dev, saves):
+    # Enough records to fill the active store page, so one compaction erases
+    dev.command("system", "irq_latency", {"reset": True})
+    before = dev.command("system", "resources").get("flash", {})
+    for _ in range(saves):
+        check_ok(dev.command("scene", "save", {"id": FLASH_SCENE}), "scene/save")
+    data = dev.command("system", "irq_latency", {"reset": True})
+    wear = dev.command("system", "resources").get("flash", {})
+    check_ok(data, "system/irq_latency")
+    levels = {level["name"]: level for level in data.get("levels", [])}
+    flash = data.get("flash", {})
+    results = {"flash": flash}
+    results["flash_erase_max_us"] = flash.get("erase_max_us") if flash.get("erases") else None
+    results["flash_program_max_us"] = flash.get("program_max_us") if flash.get("programs") else None
+    writes = wear.get("writes", 0) - before.get("writes", 0)
+    results["flash_write_avg_us"] = wear.get("write_avg_us") if writes else None
+    results["flash_page_erases"] = [now - then for now, then in
+                                    zip(wear.get("page_erases", []), before.get("page_erases", []))]
+    for name in IRQ_LEVELS:
+        results["flash_irq_latency_%s_max_ns" % name] = levels.get(name, {}).get("max_ns")
+    return results
+
+
+def read_exact(dev, size):
+    """Read size raw bytes, allowing for their time on the wire."""
+    deadline = time.monotonic() + dev.timeout + size * 10.0 / dev.link.baudrate
+    data = bytearray()
+    while len(data) < size and time.monotonic() < deadline:
+        data += dev.link.read(size - len(data))
+    return bytes(data)
+
+
+def bench_link(dev, size, repeats):
+    """Time the link itself with the device's bench/* commands."""
+    # Lines of digits, as bench/source sends them
+    line = bytes(b"0123456789"[i % 10] for i in range(63)) + b"\n"
+    payload = (line * (size // len(line) + 1))[:size]
+
+    # Builds without BENCHMARK or COMMS_LINK_BENCH do not know the commands
+    if dev.command("bench", "echo", {"size": 0}).get("message") == "Unknown command":
+        return {}
+
+    # Round trip of one line through the device and back
+    rtts = []
+    turnaround = 0
+    for _ in range(repeats):
+        msg_id = dev.send("bench", "echo", {"size": len(line)})
+        time.sleep(0.01)
+        start = time.monotonic()
+        dev.link.write(line)
+        echoed = read_exact(dev, len(line))
+        rtts.append((time.monotonic() - start) * 1e6)
+        data = dev.wait(msg_id)
+        if echoed != line or data is None or not data.get("complete"):
+            raise RuntimeError("bench/echo: line not echoed")
+        turnaround = max(turnaround, data.get("turnaround_max_us", 0))
+    rtts.sort()
+
+    msg_id = dev.send("bench", "sink", {"size": size})
+    dev.link.write(payload)
+    sink = dev.wait(msg_id)
+    if sink is None:
+        raise TimeoutError("bench/sink: no response")
+
+    msg_id = dev.send("bench", "source", {"size": size})
+    start = time.monotonic()
+    received = read_exact(dev, size)
+    elapsed = time.monotonic() - start
+    source = dev.wait(msg_id)
+    if source is None or len(received) != size:
+        raise TimeoutError("bench/source: %d of %d bytes" % (len(received), size))
+    dev.events.clear()
+
+    return {
+        "link": {"echo": {"host_rtt_us": rtts, "turnaround_max_us": turnaround},
+                 "sink": sink, "source": source,
+                 "source_host_bytes_per_s": round(size / elapsed, 1) if elapsed else None},
+        "link_rtt_us": round(rtts[len(rtts) // 2], 1),
+        "link_sink_bytes_per_s": sink.get("bytes_per_s"),
+        "link_source_bytes_per_s": source.get("bytes_per_s"),
+    }
+
+
+def load_corpus(path):
+    """Read recorded command lines, leaving out the unsafe ones."""
+    lines = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            try:
+                msg = json.loads(line)
+            except ValueError:
+                continue
+            for cmd in msg if isinstance(msg, list) else [msg]:
+                if not isinstance(cmd, dict) or (cmd.get("topic"), cmd.get("action")) in UNSAFE_COMMANDS:
+                    break
+            else:
+                lines.append(line)
+    return lines
+
+
+def bench_corpus(dev, lines):
+    # Recorded host traffic, one line at a time as the host sent it
+    dev.perf(reset=True)
+    answered = 0
+    busy = 0
+    start = time.monotonic()
+    for line in lines:
+        msg = json.loads(line)
+        first = msg[0] if isinstance(msg, list) else msg
+        for _ in range(BUSY_RETRIES):
+            dev.link.write((line + "\n").encode())
+            data = dev.wait(first["id"]) if "id" in first else None
+            if data is None or data.get("status") != "busy":
+                break
+            # Past the admission limit: wait as told and send it again
+            busy += 1
+            time.sleep(data.get("retry_ms", 0) / 1000.0)
+        if data is not None:
+            answered += 1
+    elapsed = time.monotonic() - start
+    probes = dev.perf()
+    dev.events.clear()
+    return {
+        "corpus_lines": len(lines),
+        "corpus_answered": answered,
+        "corpus_busy": busy,
+        "corpus_lines_per_s": round(len(lines) / elapsed, 1) if elapsed else None,
+        "corpus_parse_max_us": probes.get("json_parse", {}).get("max_us"),
+        "corpus_command_max_us": probes.get("command", {}).get("max_us"),
+    }
+
+
+def mutate(rng, line):
+    """Damage one command line the way a noisy link or a buggy host would."""
+    data = bytearray(line.encode())
+    for _ in range(rng.randint(1, 4)):
+        choice = rng.randrange(7)
+        pos = rng.randrange(len(data) + 1)
+        if choice == 0 and data:
+            # Flip a byte; NUL and line ends would only end the line early
+            data[min(pos, len(data) - 1)] = rng.choice([b for b in range(1, 256) if b not in (10, 13)])
+        elif choice == 1 and data:
+            del data[min(pos, len(data) - 1):min(pos + rng.randint(1, 8), len(data))]
+        elif choice == 2:
+            data[pos:pos] = rng.choice(FUZZ_TOKENS).encode()
+        elif choice == 3:
+            data = data[:pos]
+        elif choice == 4:
+            # Nesting past the parser stack
+            depth = rng.randint(4, 40)
+            data[pos:pos] = b"[" * depth + b"]" * rng.randint(0, depth)
+        elif choice == 5:
+            # Keys and strings past the parser buffers
+            data[pos:pos] = b'"' + b"k" * rng.randint(16, 300) + b'"'
+        else:
+            # Repeat a slice, e.g. a key or a whole object
+            data[pos:pos] = data[pos:pos + rng.randint(1, 40)]
+    return bytes(data)
+
+
+def bench_fuzz(dev, seeds, count, seed, lights):
+    """Send damaged commands; the device must keep answering and not reset."""
+    rng = random.Random(seed)
+    link = dev.command("system", "link")
+    accepted = link.get("accepted", 0)
+    overflows = link.get("dropped", {}).get("overflow", 0)
+    hangs = []
+    lost = 0
+    for i in range(count):
+        line = mutate(rng, rng.choice(seeds))
+        dev.link.write(line + b"\n")
+        if i % 20 != 19 and i != count - 1:
+            continue
+
+        dev.resync()
+        dev.next_id += 1
+        msg_id = "b%d" % dev.next_id
+        dev.link.write(('{"type":"cmd","id":"%s","topic":"system","action":"link","data":{}}\n'
+                        % msg_id).encode())
+        data = dev.wait(msg_id)
+        if data is None:
+            time.sleep(1.0)
+            dev.resync()
+            # A receive queue overflow can drop the check itself
+            data = dev.command("system", "link")
+            if data.get("dropped", {}).get("overflow", 0) > overflows:
+                lost += 1
+            else:
+                hangs.append({"line": i, "sent": line.decode("latin-1")})
+        if data.get("accepted", 0) < accepted:
+            raise RuntimeError("device reset during fuzzing, after line %d: %r" % (i, line))
+        accepted = data.get("accepted", 0)
+        overflows = data.get("dropped", {}).get("overflow", 0)
+    check_ok(dev.command("light", "set_all_permille", {"permilles": [0] * lights}),
+             "light/set_all_permille")
+    check_ok(dev.command("telemetry", "unsubscribe"), "telemetry/unsubscribe")
+    dev.events.clear()
+    return {"fuzz_lines": count, "fuzz_seed": seed, "fuzz_hangs": hangs, "fuzz_checks_lost": lost}
+
+
+def compare(results, baseline, tolerance):
+    """Return a list of metrics that regressed by more than tolerance."""
+    regressions = []
+    for name, higher_is_better in METRICS.items():
+        now, then = results.get(name), baseline.get(name)
+        if now is None or not then:
+            continue
+        change = (now - then) / then
+        if (-change if higher_is_better else change) > tolerance:
+            regressions.append({"metric": name, "baseline": then, "result": now,
+                                "change_pct": round(change * 100, 1)})
+    return regressions
+
+
+def diff(first, second):
+    """Print the metrics of two result files side by side, with their ratio."""
+    (first_name, first_results), (second_name, second_results) = first, second
+    width = max(len(name) for name in METRICS)
+    print("%-*s %12s %12s %8s" % (width, "metric", first_name, second_name, "ratio"))
+    for name in METRICS:
+        a, b = first_results.get(name), second_results.get(name)
+        if a is None and b is None:
+            continue
+        ratio = "%.2f" % (b / a) if a and b is not None else "-"
+        print("%-*s %12s %12s %8s" % (width, name, "-" if a is None else a,
+                                      "-" if b is None else b, ratio))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", help="serial port of the board")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--timeout", type=float, default=1.0, help="response timeout in s")
+    parser.add_argument("--count", type=int, default=200, help="commands per workload")
+    parser.add_argument("--adc-seconds", type=float, default=2.0)
+    parser.add_argument("--lights", type=int, default=3, help="lights to trip")
+    parser.add_argument("--repeats", type=int, default=3, help="trips per light")
+    parser.add_argument("--irq-seconds", type=float, default=3.0)
+    parser.add_argument("--synthetic-seconds", type=float, default=5.0,
+                        help="length of each false trip run on synthetic waveforms")
+    parser.add_argument("--block-scans", default="1,2,4,8,16",
+                        help="ADC block sizes to run the idle load at, empty to skip")
+    parser.add_argument("--block-seconds", type=float, default=5.0,
+                        help="time at each block size")
+    parser.add_argument("--jitter-seconds", type=float, default=5.0,
+                        help="length of the loop jitter workload, 0 to skip it")
+    parser.add_argument("--flash-saves", type=int, default=100,
+                        help="scene saves of the flash workload, 0 to skip it")
+    parser.add_argument("--no-alarm", action="store_true",
+                        help="skip the alarm and interrupt latency workloads, for builds without BENCHMARK")
+    parser.add_argument("--standby-seconds", type=float, default=0,
+                        help="time in stop mode of the standby workload, for builds without BENCHMARK, "
+                             "0 to skip it")
+    parser.add_argument("--blackouts", type=int, default=20,
+                        help="alarm/blackout frames of the blackout workload, 0 to skip it")
+    parser.add_argument("--link-bytes", type=int, default=4096,
+                        help="bytes of the link sink and source runs, 0 to skip the link workload")
+    parser.add_argument("--crc-bytes", type=int, default=4096,
+                        help="flash block of the CRC workload, 0 to skip it")
+    parser.add_argument("--copy-sizes", default="16,32,64,128,256,512,1024,2048",
+                        help="copy lengths of the DMA copy workload, empty to skip it")
+    parser.add_argument("--corpus", help="replay these recorded command lines, and fuzz from them")
+    parser.add_argument("--record", help="write the command lines sent to this file")
+    parser.add_argument("--fuzz", type=int, default=0, help="damaged command lines to send")
+    parser.add_argument("--seed", type=int, default=1, help="seed of the damaged lines")
+    parser.add_argument("--diff", nargs=2, metavar="RESULTS",
+                        help="show two result files side by side instead of running")
+    parser.add_argument("--baseline", help="compare against this result file")
+    parser.add_argument("--save-baseline", help="write the results to this file")
+    parser.add_argument("--tolerance", type=float, default=0.10,
+                        help="allowed regression as a fraction (default 0.10)")
+    args = parser.parse_args()
+
+    if args.diff:
+        files = []
+        for path in args.diff:
+            with open(path) as f:
+                files.append((os.path.splitext(os.path.basename(path))[0],
+                              json.load(f).get("results", {})))
+        diff(files[0], files[1])
+        return 0
+    if not args.port:
+        parser.error("--port is required unless --diff is given")
+
+    dev = Device(args.port, args.baud, args.timeout)
+    results = {}
+    results.update(bench_round_trip(dev, args.count))
+    results.update(bench_kernel_trace(dev, args.count))
+    results.update(bench_pwm(dev, args.count))
+    results.update(bench_adc(dev, args.adc_seconds))
+    if args.block_scans:
+        sizes = [int(size) for size in args.block_scans.split(",")]
+        results.update(bench_block_scans(dev, sizes, args.block_seconds))
+    results.update(bench_selftest(dev))
+    if args.jitter_seconds:
+        results.update(bench_jitter(dev, args.jitter_seconds))
+    if args.crc_bytes:
+        results.update(bench_crc(dev, args.crc_bytes))
+    if args.copy_sizes:
+        results.update(bench_copy(dev, [int(size) for size in args.copy_sizes.split(",")]))
+    if args.link_bytes:
+        results.update(bench_link(dev, args.link_bytes, args.repeats * 5))
+    corpus = load_corpus(args.corpus) if args.corpus else []
+    if corpus:
+        results.update(bench_corpus(dev, corpus))
+    if args.fuzz:
+        results.update(bench_fuzz(dev, corpus or list(FUZZ_SEEDS), args.fuzz, args.seed,
+                                  args.lights))
+    if args.standby_seconds:
+        results.update(bench_standby(dev, args.standby_seconds, args.lights))
+    if not args.no_alarm:
+        results.update(bench_alarm(dev, args.lights, args.repeats))
+        results.update(bench_synthetic(dev, args.lights, args.repeats, args.synthetic_seconds))
+        results.update(bench_irq_latency(dev, args.irq_seconds))
+        if args.flash_saves:
+            results.update(bench_flash(dev, args.flash_saves))
+    if args.blackouts:
+        results.update(bench_blackout(dev, args.blackouts, args.lights))
+        # Idle line detection ends the frame a character after its last byte
+        comms_ns = results.get("irq_latency_comms_max_ns")
+        if results["blackout_max_us"] is not None and comms_ns is not None:
+            results["blackout_bound_us"] = round(results["blackout_max_us"] + comms_ns / 1000.0
+                                                 + 10e6 / dev.link.baudrate, 1)
+
+    if args.record:
+        with open(args.record, "w") as f:
+            f.write("\n".join(dev.sent) + "\n")
+
+    report = {"results": results}
+    status = 1 if results.get("fuzz_hangs") or results.get("synthetic_false_trips") else 0
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f).get("results", {})
+        report["regressions"] = compare(results, baseline, args.tolerance)
+        status = 1 if report["regressions"] else status
+
+    if args.save_baseline:
+        with open(args.save_baseline, "w") as f:
+            json.dump({"results": results}, f, indent=2, sort_keys=True)
+
+    json.dump(report, sys.stdout, indent=2, sort_keys=True)
+    print()
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
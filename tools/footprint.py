@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""Flash and RAM footprint per module of the Illuminator firmware.
+
+Reads the linker map file written by the build and reports the bytes each
+object file takes in flash and RAM, largest first. Library members are
+counted under their library. Results can be saved as a baseline and later
+builds compared against it, e.g. from one release to the next.
+
+    footprint.py Release/Wiseled_LBR_Illuminator.map --save-baseline v1.2.json
+    footprint.py Release/Wiseled_LBR_Illuminator.map --baseline v1.2.json
+
+See the "Building the Project" section of the README.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+# Address ranges of the memories in STM32L432KCUX_FLASH.ld
+FLASH = (0x08000000, 0x08040000)
+RAM = [(0x20000000, 0x2000C000), (0x10000000, 0x10004000)]
+
+# Archive member that newlib-nano links for -u _printf_float
+PRINTF_FLOAT_MEMBER = "nano-vfprintf_float"
+
+SECTION_RE = re.compile(r"^\s*(?:((?!0x)\S+)\s+)?0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)(?:\s+(.*))?$")
+LOAD_RE = re.compile(r"load address 0x([0-9a-fA-F]+)")
+MEMBER_RE = re.compile(r"^(.*?)([^/\\]+\.a)\((.+)\)$")
+
+
+def in_ram(address):
+    return any(start <= address < end for start, end in RAM)
+
+
+def module_name(path, members):
+    """Name an input file by its object, or its library for archive members."""
+    match = MEMBER_RE.match(path)
+    if match:
+        if members:
+            return "%s(%s)" % (match.group(2), match.group(3))
+        return match.group(2)
+    return os.path.splitext(re.split(r"[/\\]", path)[-1])[0]
+
+
+def parse_map(path, members):
+    """Return {module: {"flash": bytes, "ram": bytes}} and the linked library members."""
+    modules = {}
+    linked = set()
+    loaded = False
+    started = False
+    pending = None
+
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\r\n")
+            if not started:
+                started = line.startswith("Linker script and memory map")
+                continue
+            if line.startswith("OUTPUT("):
+                break
+
+            # Long section names are on a line of their own
+            stripped = line.strip()
+            if stripped and " " not in stripped and not line.startswith("  ") and stripped.startswith("."):
+                pending = (line, not line.startswith(" "))
+                continue
+
+            match = SECTION_RE.match(line)
+            if match is None:
+                pending = None
+                continue
+
+            name, address, size, rest = match.groups()
+            output = not line.startswith(" ")
+            if name is None and pending is not None:
+                name, output = pending[0].strip(), pending[1]
+            pending = None
+            address, size = int(address, 16), int(size, 16)
+
+            if output:
+                # Output section: .data and .ramfunc are also stored in flash
+                loaded = bool(rest and LOAD_RE.search(rest))
+                continue
+            if name is None or name == "*fill*" or not rest or size == 0 or address == 0:
+                continue
+
+            match = MEMBER_RE.match(rest.strip())
+            if match:
+                linked.add(match.group(3))
+            entry = modules.setdefault(module_name(rest.strip(), members), {"flash": 0, "ram": 0})
+            if FLASH[0] <= address < FLASH[1]:
+                entry["flash"] += size
+            elif in_ram(address):
+                entry["ram"] += size
+                if loaded:
+                    entry["flash"] += size
+
+    return modules, linked
+
+
+def compare(modules, baseline):
+    """Return the modules whose footprint changed, with the differences."""
+    changes = []
+    for name in sorted(set(modules) | set(baseline)):
+        now = modules.get(name, {"flash": 0, "ram": 0})
+        then = baseline.get(name, {"flash": 0, "ram": 0})
+        flash, ram = now["flash"] - then["flash"], now["ram"] - then["ram"]
+        if flash or ram:
+            changes.append((name, flash, ram))
+    changes.sort(key=lambda change: -abs(change[1]) - abs(change[2]))
+    return changes
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("map", help="linker map file, e.g. Release/Wiseled_LBR_Illuminator.map")
+    parser.add_argument("--members", action="store_true",
+                        help="list library members separately")
+    parser.add_argument("--top", type=int, default=0, help="only list the largest N modules")
+    parser.add_argument("--baseline", help="compare against this footprint file")
+    parser.add_argument("--save-baseline", help="write the footprint to this file")
+    args = parser.parse_args()
+
+    modules, linked = parse_map(args.map, args.members)
+    if not modules:
+        print("no sections found in %s" % args.map, file=sys.stderr)
+        return 1
+
+    rows = sorted(modules.items(), key=lambda item: (-item[1]["flash"], -item[1]["ram"], item[0]))
+    if args.top:
+        rows = rows[:args.top]
+    width = max(len(name) for name in modules)
+    print("%-*s %8s %8s" % (width, "module", "flash", "ram"))
+    for name, entry in rows:
+        print("%-*s %8d %8d" % (width, name, entry["flash"], entry["ram"]))
+    print("%-*s %8d %8d" % (width, "total", sum(e["flash"] for e in modules.values()),
+                            sum(e["ram"] for e in modules.values())))
+
+    float_printf = any(PRINTF_FLOAT_MEMBER in member for member in linked)
+    print("\nfloat printf: %s" % ("linked" if float_printf else "not linked"))
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f).get("modules", {})
+        changes = compare(modules, baseline)
+        print("\nchanges against %s:" % args.baseline)
+        for name, flash, ram in changes:
+            print("%-*s %+8d %+8d" % (width, name, flash, ram))
+        if not changes:
+            print("none")
+
+    if args.save_baseline:
+        with open(args.save_baseline, "w") as f:
+            json.dump({"modules": modules, "float_printf": float_printf}, f, indent=2, sort_keys=True)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,575 @@
+#!/usr/bin/env python3
+"""Host client for the Illuminator firmware.
+
+The one copy of the protocol the host tools share: the binary framing, the
+command codes, and a link that keeps several commands in flight. The codes
+are read from the firmware sources, the command table in
+app_comms_handler.c and the constants in app_comms_binary.h, so they
+follow every change to the firmware without being copied.
+
+One thread reads the port. It hands each response to the request waiting
+for it, JSON by message ID and binary by seq, and each event to the
+callbacks subscribed to it. Requests return a concurrent.futures.Future,
+and up to `window` of them may be outstanding.
+
+    link = illuminator.Link("/dev/ttyACM0")
+    link.negotiate_baud()
+    dev = link.device()                  # link.device(3) on a bus
+    pending = [dev.request("light", "get", {"id": i}) for i in (1, 2, 3)]
+    print([p.result() for p in pending])
+    dev.telemetry(print, rate=10, fields=["intensity"])
+
+    illuminator.py --codes               # the command codes as JSON
+
+Requires pyserial. The protocol is described in app_comms_binary.h and the
+README.
+"""
+
+import argparse
+import collections
+import concurrent.futures
+import json
+import os
+import re
+import struct
+import sys
+import threading
+import time
+
+# Firmware tree the protocol is read from
+ROOT = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), os.pardir))
+BINARY_HEADER = os.path.join("Core", "Inc", "app_comms_binary.h")
+COMMAND_SOURCE = os.path.join("Core", "Src", "app_comms_handler.c")
+
+# VAL_Status in val_status.h
+STATUS_NAMES = ("ok", "error", "timeout", "busy", "param")
+VAL_OK = 0
+VAL_ERROR = 1
+
+# Default baud rate after reset
+DEFAULT_BAUD = 115200
+
+# Rates tried by Link.negotiate_baud, fastest first
+NEGOTIATE_RATES = (2000000, 1000000, 921600, 460800, 230400)
+
+# Commands in flight by default. Slow commands beyond COMMS_PIPELINE_DEPTH
+# are answered busy, and the RX stream holds RX_STREAM_SIZE bytes.
+DEFAULT_WINDOW = 4
+
+# A device that may stop after POWER_SERIAL_AWAKE_MS (app_power.c) without
+# received bytes only wakes on the first byte after it; a write after that
+# long idle, less a margin, first sends a line end and waits WAKE_S
+SERIAL_AWAKE_S = 2.0
+WAKE_MARGIN_S = 0.25
+WAKE_S = 0.01
+
+# Seconds a read waits, the resolution of the request timeouts
+READ_INTERVAL = 0.02
+
+# Longest JSON line kept; a longer one is noise
+MAX_LINE = 4096
+
+DEFINE_RE = re.compile(r"^#define\s+(COMMS_\w+)\s+(.+?)\s*(?:/\*\s*(.*?)\s*\*/)?\s*$")
+CODE_RE = re.compile(r"COMMS_BIN_CODE\(\s*(\w+)\s*,\s*(\w+)\s*\)")
+TABLE_RE = re.compile(r'^\s*\{\s*"(\w+)",\s*"(\w+)",\s*(COMMS_BIN_\w+)\s*,')
+NAME_RE = re.compile(r"^(\w+)/(\w+)$")
+
+# Binary response: status is the first byte of the body
+Response = collections.namedtuple("Response", "status body code")
+
+# JSON events have data, binary ones body; stream is the telemetry stream
+Event = collections.namedtuple("Event", "topic action data body stream")
+
+
+def parse_int(text):
+    return int(text.rstrip("uUlL"), 0)
+
+
+class Protocol:
+    """Command codes and frame constants read from the firmware sources."""
+
+    def __init__(self, root=ROOT):
+        self.constants = {}
+        self.codes = {}
+        self.names = {}
+        derived = {}
+
+        with open(os.path.join(root, BINARY_HEADER)) as f:
+            for line in f:
+                match = DEFINE_RE.match(line)
+                if not match:
+                    continue
+                name, value, comment = match.groups()
+                code = CODE_RE.fullmatch(value)
+                try:
+                    if code:
+                        number = (self.constants[code.group(1)] << 4) | parse_int(code.group(2))
+                    else:
+                        number = parse_int(value)
+                except (KeyError, ValueError):
+                    continue
+                self.constants[name] = number
+                if code:
+                    # A code under another topic names its command in the comment
+                    named = NAME_RE.match(comment or "")
+                    if named:
+                        derived[number] = named.groups()
+                    else:
+                        topic, _, action = name[len("COMMS_BIN_"):].lower().partition("_")
+                        derived[number] = (topic, action)
+
+        with open(os.path.join(root, COMMAND_SOURCE)) as f:
+            in_table = False
+            for line in f:
+                if not in_table:
+                    in_table = line.startswith("static const COMMS_Command_t command_table[]")
+                    continue
+                if line.startswith("};"):
+                    break
+                match = TABLE_RE.match(line)
+                if match and match.group(3) in self.constants:
+                    self.codes[(match.group(1), match.group(2))] = self.constants[match.group(3)]
+
+        if not self.codes:
+            raise ValueError("no command table in %s" % os.path.join(root, COMMAND_SOURCE))
+
+        # Events and the updater are not in the table, their codes are named
+        # as commands are
+        self.names = dict(derived)
+        self.names.update({code: key for key, code in self.codes.items()})
+        self.lookup = {key: code for code, key in self.names.items()}
+
+    def __getattr__(self, name):
+        """Constants without their COMMS_ prefix, e.g. BIN_TYPE_CMD."""
+        if name == "constants":
+            raise AttributeError(name)
+        try:
+            return self.constants["COMMS_" + name]
+        except KeyError:
+            raise AttributeError(name) from None
+
+    def code(self, topic, action):
+        try:
+            return self.lookup[(topic, action)]
+        except KeyError:
+            raise ValueError("%s/%s has no binary code" % (topic, action)) from None
+
+
+def status_name(status):
+    return STATUS_NAMES[status] if status < len(STATUS_NAMES) else str(status)
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE, as COMMS_Binary_Crc16 computes it."""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray()
+    block = bytearray()
+    for byte in data:
+        if byte == 0:
+            out.append(len(block) + 1)
+            out += block
+            block.clear()
+        else:
+            block.append(byte)
+            if len(block) == 254:
+                out.append(255)
+                out += block
+                block.clear()
+    out.append(len(block) + 1)
+    out += block
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data) + 1:
+            raise ValueError("bad COBS frame")
+        out += data[i + 1:i + code]
+        i += code
+        if code < 255 and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(payload):
+    """Add the CRC and COBS, between two delimiters."""
+    payload += struct.pack("<H", crc16(payload))
+    return b"\x00" + cobs_encode(payload) + b"\x00"
+
+
+class Link:
+    """One serial port and the requests in flight on it.
+
+    Event callbacks run on the reading thread: they must return quickly and
+    must not wait for a response on the same link.
+    """
+
+    def __init__(self, port, baud=DEFAULT_BAUD, timeout=1.0, window=DEFAULT_WINDOW,
+                 protocol=None):
+        if not 0 < window < 128:
+            # The device drops a binary seq not ahead of the last one by int8
+            raise ValueError("window must be 1 to 127")
+        self.protocol = protocol or Protocol()
+        self.port = port
+        self.timeout = timeout
+        self.window = threading.BoundedSemaphore(window)
+        self.lock = threading.Lock()   # pending, subscribers, counters and writes
+        self.pending = {}              # key -> (future, deadline, code)
+        self.subscribers = {}          # token -> (topic, action, callback)
+        self.next_id = 0
+        self.next_seq = 0
+        self.next_token = 0
+        self.error = None
+        self.serial = None
+        self.reader = None
+        self.running = False
+        self.last_write = 0.0           # time.monotonic() of the last write
+        self.open(baud)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def open(self, baud=DEFAULT_BAUD):
+        """Open the port and start reading; a board reset comes back at DEFAULT_BAUD."""
+        import serial
+
+        self.serial = serial.Serial(self.port, baud, timeout=READ_INTERVAL)
+        self.error = None
+
+        # Wake the board in case it is in stop mode
+        self._wake()
+        self.serial.reset_input_buffer()
+
+        self.running = True
+        self.reader = threading.Thread(target=self._read, name="illuminator-rx", daemon=True)
+        self.reader.start()
+
+    def close(self):
+        self.running = False
+        if self.reader is not None:
+            self.reader.join()
+            self.reader = None
+        self._fail_all(ConnectionError("link closed"))
+        if self.serial is not None:
+            self.serial.close()
+            self.serial = None
+
+    def reopen(self, baud=DEFAULT_BAUD):
+        """Start again after the port was lost, failing what was in flight."""
+        self.close()
+        self.open(baud)
+
+    def device(self, address=None):
+        """Commands for one device address, or for whichever device listens."""
+        return Device(self, address)
+
+    def subscribe(self, callback, topic=None, action=None):
+        """Call callback(Event) for every event of topic/action, None for any."""
+        with self.lock:
+            self.next_token += 1
+            self.subscribers[self.next_token] = (topic, action, callback)
+            return self.next_token
+
+    def unsubscribe(self, token):
+        with self.lock:
+            self.subscribers.pop(token, None)
+
+    def drain(self):
+        """Wait until every request in flight is answered or timed out."""
+        while True:
+            with self.lock:
+                if not self.pending:
+                    return
+            time.sleep(READ_INTERVAL)
+
+    def set_rate(self, baud, flow=False):
+        """Follow a rate change the devices were told of."""
+        self.serial.flush()
+        # The device switches once its response is out
+        time.sleep(0.05)
+        with self.lock:
+            self.serial.baudrate = baud
+            self.serial.rtscts = flow
+            self.serial.reset_input_buffer()
+
+    def negotiate_baud(self, rates=NEGOTIATE_RATES, flow=False, device=None):
+        """Switch to the fastest of rates the device and the port follow.
+
+        Each rate is confirmed with a ping; one that is not falls back on
+        both sides once the device's confirmation timeout passes. All
+        devices on a bus change together: send system/set_baud to the
+        broadcast address and call set_rate instead.
+        Returns the rate in use.
+        """
+        dev = device or self.device()
+        self.drain()
+        for baud in rates:
+            previous = (self.serial.baudrate, self.serial.rtscts)
+            if (baud, flow) == previous:
+                return baud
+            data = dev.command("system", "set_baud", {"baud": baud, "flow": flow})
+            if data.get("status") != "ok":
+                # Not a rate the UART clock makes, or flow control on a bus
+                continue
+            try:
+                self.set_rate(baud, flow)
+            except (ValueError, OSError):
+                # Not a rate the port makes; the device will fall back
+                pass
+            else:
+                if self._confirm(dev):
+                    return baud
+
+            self.set_rate(*previous)
+            time.sleep(data.get("timeout_ms", 2000) / 1000.0 + 0.1)
+            if not self._confirm(dev):
+                raise ConnectionError("device did not return to %d baud" % previous[0])
+        return self.serial.baudrate
+
+    def _confirm(self, dev, attempts=3):
+        for _ in range(attempts):
+            try:
+                dev.command("system", "ping", timeout=0.2)
+                return True
+            except TimeoutError:
+                pass
+        return False
+
+    def _submit(self, key, message, code, timeout, answered):
+        """Send a message and return the Future of its response."""
+        if self.error is not None:
+            raise ConnectionError("link lost: %s" % self.error)
+        if not self.window.acquire(timeout=self.timeout + timeout):
+            raise TimeoutError("no room in the window")
+
+        future = concurrent.futures.Future()
+        future.add_done_callback(lambda _: self.window.release())
+        with self.lock:
+            if time.monotonic() - self.last_write > SERIAL_AWAKE_S - WAKE_MARGIN_S:
+                self._wake()
+            pending = key(self)
+            if answered:
+                self.pending[pending] = (future, time.monotonic() + timeout, code)
+            self.serial.write(message(self))
+            self.last_write = time.monotonic()
+        if not answered:
+            future.set_result(None)
+        return future
+
+    def _wake(self):
+        """Send a line end, which ends no frame, and give the device time to wake."""
+        self.serial.write(b"\n")
+        time.sleep(WAKE_S)
+        self.last_write = time.monotonic()
+
+    def _read(self):
+        line = bytearray()    # JSON text since the last line end
+        frame = bytearray()   # Binary frame since the last delimiter
+        in_frame = False
+
+        while self.running:
+            try:
+                chunk = self.serial.read(self.serial.in_waiting or 1)
+            except Exception as exc:  # serial.SerialException, OSError
+                self.error = exc
+                self._fail_all(ConnectionError("link lost: %s" % exc))
+                return
+
+            for byte in chunk:
+                if byte == 0:
+                    if in_frame and frame:
+                        self._on_frame(bytes(frame))
+                    frame.clear()
+                    in_frame = True
+                    continue
+                if in_frame:
+                    # A JSON line right after the closing delimiter
+                    if frame or byte != ord("{"):
+                        frame.append(byte)
+                        continue
+                    in_frame = False
+                if byte in b"\r\n":
+                    if line:
+                        self._on_line(bytes(line))
+                    line.clear()
+                elif len(line) < MAX_LINE:
+                    line.append(byte)
+
+            self._expire()
+
+    def _on_line(self, line):
+        try:
+            msg = json.loads(line)
+        except ValueError:
+            return
+        if not isinstance(msg, dict):
+            return
+        if msg.get("type") == "event":
+            data = msg.get("data", {})
+            stream = data.get("stream") if isinstance(data, dict) else None
+            self._on_event(Event(msg.get("topic"), msg.get("action"), data, None, stream))
+        elif msg.get("type") == "resp":
+            self._resolve(("json", msg.get("id")), None, msg.get("data", {}))
+
+    def _on_frame(self, encoded):
+        try:
+            payload = cobs_decode(encoded)
+        except ValueError:
+            return
+        if len(payload) < 5 or crc16(payload[:-2]) != struct.unpack("<H", payload[-2:])[0]:
+            return
+
+        kind, seq, code, body = payload[0], payload[1], payload[2], payload[3:-2]
+        if kind == self.protocol.BIN_TYPE_RESP and body:
+            self._resolve(("bin", seq), code, Response(body[0], body[1:], code))
+        elif kind == self.protocol.BIN_TYPE_EVENT:
+            topic, action = self.protocol.names.get(code, (None, None))
+            self._on_event(Event(topic, action, None, body, seq))
+
+    def _on_event(self, event):
+        with self.lock:
+            callbacks = [callback for topic, action, callback in self.subscribers.values()
+                         if topic in (None, event.topic) and action in (None, event.action)]
+        for callback in callbacks:
+            callback(event)
+
+    def _resolve(self, key, code, result):
+        with self.lock:
+            entry = self.pending.get(key)
+            if entry is None or (code is not None and entry[2] != code):
+                return
+            del self.pending[key]
+        entry[0].set_result(result)
+
+    def _expire(self):
+        now = time.monotonic()
+        with self.lock:
+            expired = [key for key, entry in self.pending.items() if entry[1] < now]
+            futures = [self.pending.pop(key)[0] for key in expired]
+        for future in futures:
+            future.set_exception(TimeoutError("no response"))
+
+    def _fail_all(self, error):
+        with self.lock:
+            futures = [entry[0] for entry in self.pending.values()]
+            self.pending.clear()
+        for future in futures:
+            future.set_exception(error)
+
+
+class Device:
+    """Commands for one device of a link.
+
+    With an address, commands carry it, JSON in a leading {"addr":N, and
+    binary as COMMS_BIN_TYPE_ADDR_CMD. Broadcast and group addresses run
+    on every device concerned and are not answered: their requests are
+    done as soon as they are sent, with None.
+    """
+
+    def __init__(self, link, address=None):
+        self.link = link
+        self.address = address
+        self.silent = address is not None and address >= link.protocol.ADDRESS_GROUP_FIRST
+
+    def request(self, topic, action, data=None, timeout=None):
+        """Send a JSON command; the Future gives the data of its response."""
+        link = self.link
+        cmd = {"type": "cmd", "id": 0, "topic": topic, "action": action, "data": data or {}}
+        if self.address is not None:
+            # The address filter only looks at a leading {"addr":N,
+            cmd = dict([("addr", self.address)] + list(cmd.items()))
+
+        def key(link):
+            link.next_id = link.next_id % 0x7FFFFFFF + 1
+            return ("json", link.next_id)
+
+        def message(link):
+            # Integer IDs are kept by the device as a number, not a string
+            cmd["id"] = link.next_id
+            return (json.dumps(cmd, separators=(",", ":")) + "\n").encode()
+
+        return link._submit(key, message, None, timeout or link.timeout, not self.silent)
+
+    def command(self, topic, action, data=None, timeout=None):
+        """Send a JSON command and return the data of its response."""
+        return self.request(topic, action, data, timeout).result()
+
+    def request_binary(self, topic, action, body=b"", timeout=None):
+        """Send a binary command; the Future gives its Response."""
+        link = self.link
+        proto = link.protocol
+        code = proto.code(topic, action)
+
+        def key(link):
+            link.next_seq = (link.next_seq + 1) & 0xFF
+            return ("bin", link.next_seq)
+
+        def message(link):
+            if self.address is None:
+                header = bytes((proto.BIN_TYPE_CMD, link.next_seq, code))
+            else:
+                header = bytes((proto.BIN_TYPE_ADDR_CMD, self.address, link.next_seq, code))
+            return encode_frame(header + bytes(body))
+
+        return link._submit(key, message, code, timeout or link.timeout, not self.silent)
+
+    def command_binary(self, topic, action, body=b"", timeout=None):
+        """Send a binary command and return its Response."""
+        return self.request_binary(topic, action, body, timeout).result()
+
+    def telemetry(self, callback, stream=1, **options):
+        """Subscribe a telemetry stream and call callback(Event) with each sample.
+
+        options are the fields of telemetry/subscribe, e.g. rate and fields.
+        Samples carry no address: on a bus subscribe one device at a time.
+        Returns the token for Link.unsubscribe.
+        """
+        def on_sample(event):
+            if event.stream == stream:
+                callback(event)
+
+        token = self.link.subscribe(on_sample, "telemetry", "sample")
+        data = self.command("telemetry", "subscribe", dict(options, stream=stream))
+        if data is not None and data.get("status") != "ok":
+            self.link.unsubscribe(token)
+            raise RuntimeError("telemetry/subscribe failed: %s" % data.get("message", data))
+        return token
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--codes", action="store_true",
+                        help="print the binary code of every command as JSON")
+    parser.add_argument("--root", default=ROOT, help="firmware tree to read the protocol from")
+    args = parser.parse_args()
+
+    if not args.codes:
+        parser.print_help()
+        return 0
+
+    proto = Protocol(args.root)
+    codes = {"%s/%s" % key: code for key, code in sorted(proto.codes.items())}
+    events = {"%s/%s" % name: code for code, name in sorted(proto.names.items())
+              if name not in proto.codes}
+    json.dump({"commands": codes, "other": events}, sys.stdout, indent=2)
+    print()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""Scheduler trace capture for the Illuminator firmware.
+
+Switches the device's scheduler trace on for a while, reads the ring back
+with system/kernel_trace and writes it in the Chrome trace event format,
+which chrome://tracing and https://ui.perfetto.dev open: one row per task
+with the stretches it ran, one row per interrupt, and marks where a task
+blocked or a mutex holder changed priority. Also reports what recording
+cost the device.
+
+    kernel_trace.py --port /dev/ttyACM0 --seconds 0.01 trace.json
+    kernel_trace.py --port /dev/ttyACM0 --raw entries.json trace.json
+
+The ring keeps the last 256 events, a few milliseconds with the tick
+running. Requires pyserial. The entries are described in app_trace.h.
+"""
+
+import argparse
+import json
+import sys
+import time
+
+# Must match TRACE_KERNEL_ENTRY_COUNT in app_trace.h
+RING_ENTRIES = 256
+
+# Row of the interrupts: exception number + ISR_TID_BASE
+ISR_TID_BASE = 1000
+
+
+class Device:
+    """JSON command link to the board."""
+
+    def __init__(self, port, baud, timeout):
+        import serial
+
+        self.link = serial.Serial(port, baud, timeout=timeout)
+        self.timeout = timeout
+        self.next_id = 0
+
+        # Wake the board in case it is in stop mode
+        self.link.write(b"\n")
+        time.sleep(0.01)
+        self.link.reset_input_buffer()
+
+    def command(self, topic, action, data=None):
+        """Send a command and return the data of its response."""
+        self.next_id += 1
+        msg_id = "k%d" % self.next_id
+        cmd = {"type": "cmd", "id": msg_id, "topic": topic, "action": action,
+               "data": data or {}}
+        self.link.write((json.dumps(cmd, separators=(",", ":")) + "\n").encode())
+
+        deadline = time.monotonic() + self.timeout
+        while time.monotonic() < deadline:
+            line = self.link.readline()
+            if not line:
+                continue
+            try:
+                msg = json.loads(line)
+            except ValueError:
+                continue
+            if isinstance(msg, dict) and msg.get("id") == msg_id:
+                data = msg.get("data", {})
+                if data.get("status") != "ok":
+                    raise RuntimeError("%s/%s failed: %s" % (topic, action, data.get("message", data)))
+                return data
+        raise TimeoutError("%s/%s: no response" % (topic, action))
+
+
+def capture(dev, seconds):
+    """Record for a while, then read back the status and every entry kept."""
+    dev.command("system", "kernel_trace", {"enable": True, "reset": True})
+    time.sleep(seconds)
+    dev.command("system", "kernel_trace", {"enable": False})
+    status = dev.command("system", "kernel_trace")
+
+    entries = []
+    start = max(status["next"] - RING_ENTRIES, 0)
+    while start < status["next"]:
+        data = dev.command("system", "kernel_trace", {"from": start})
+        if not data["entries"]:
+            break
+        entries.extend(data["entries"])
+        start = data["from"] + len(data["entries"])
+    return status, entries
+
+
+def convert(status, entries):
+    """Chrome trace events of the entries, times in microseconds."""
+    names = {task["number"]: task["name"] for task in status.get("tasks", [])}
+    us_per_cycle = 1e6 / status["clock_hz"]
+    events = [{"ph": "M", "name": "process_name", "pid": 1, "args": {"name": "Illuminator"}}]
+    for number, name in sorted(names.items()):
+        events.append({"ph": "M", "name": "thread_name", "pid": 1, "tid": number,
+                       "args": {"name": name}})
+
+    # The cycle counter wraps; entries are in order, so count the wraps
+    elapsed = 0
+    previous = None
+    running = {}
+    isrs = {}
+    for entry in entries:
+        if previous is not None:
+            elapsed += (entry["cycles"] - previous) & 0xFFFFFFFF
+        previous = entry["cycles"]
+        ts = elapsed * us_per_cycle
+        event, task, obj = entry["event"], entry["task"], entry["object"]
+
+        if event == "switch_in":
+            running[task] = ts
+        elif event == "switch_out" and task in running:
+            start = running.pop(task)
+            events.append({"ph": "X", "name": names.get(task, "task %d" % task), "pid": 1,
+                           "tid": task, "ts": start, "dur": ts - start, "args": {"priority": obj}})
+        elif event == "isr_enter":
+            isrs[obj] = ts
+        elif event == "isr_exit" and obj in isrs:
+            start = isrs.pop(obj)
+            events.append({"ph": "X", "name": "IRQ %d" % (obj - 16), "pid": 1,
+                           "tid": ISR_TID_BASE + obj, "ts": start, "dur": ts - start})
+        else:
+            events.append({"ph": "i", "s": "t", "name": event, "pid": 1, "tid": task,
+                           "ts": ts, "args": {"object": obj}})
+
+    for obj in sorted({e["tid"] - ISR_TID_BASE for e in events if e.get("tid", 0) >= ISR_TID_BASE}):
+        events.append({"ph": "M", "name": "thread_name", "pid": 1, "tid": ISR_TID_BASE + obj,
+                       "args": {"name": "IRQ %d" % (obj - 16)}})
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", required=True, help="serial port of the board")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--timeout", type=float, default=1.0, help="response timeout in s")
+    parser.add_argument("--seconds", type=float, default=0.01, help="time to record")
+    parser.add_argument("--raw", help="also write the status and entries as read to this file")
+    parser.add_argument("output", help="Chrome trace event file to write")
+    args = parser.parse_args()
+
+    dev = Device(args.port, args.baud, args.timeout)
+    status, entries = capture(dev, args.seconds)
+
+    if args.raw:
+        with open(args.raw, "w") as f:
+            json.dump({"status": status, "entries": entries}, f, indent=2)
+    with open(args.output, "w") as f:
+        json.dump(convert(status, entries), f)
+
+    json.dump({key: status.get(key) for key in ("records", "cost_cycles", "elapsed_us",
+                                                "cycles_per_record", "load_permille")},
+              sys.stdout, indent=2, sort_keys=True)
+    print()
+    print("%d entries written to %s" % (len(entries), args.output), file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,353 @@
+#!/usr/bin/env python3
+"""Driver of the host simulation of the Illuminator firmware.
+
+Starts Sim/build/wiseled_sim on a state directory of its own, talks to it
+over its pseudo-terminal as a host would talk to the board, and ends it.
+
+    simulation.py smoke
+    simulation.py --sim Sim/build/wiseled_sim --keep /tmp/sim smoke
+    simulation.py --passes 1000 bench
+    simulation.py --count 20000 --seed 7 fuzz
+
+smoke boots the firmware from blank flash, checks that system/ping is
+answered and that a light/set reaches the PWM recorder, and prints the
+figures as JSON. bench replays the system/selftest command set, read from
+the firmware source, over the serial link --passes times and reports the
+corpus and self-test figures of benchmark.py; fuzz sends it damaged, as
+benchmark.py --fuzz does. Each fails on a timeout, a wrong answer, or a
+fault or reset of the simulated MCU. `make -C Sim smoke`, `bench` and
+`fuzz` build and run them.
+
+Needs no pyserial: the pseudo-terminal is opened directly. See
+docs/simulation.md.
+"""
+
+import argparse
+import csv
+import json
+import os
+import re
+import select
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import tty
+
+import benchmark
+
+# Firmware tree the simulation is built in
+ROOT = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), os.pardir))
+DEFAULT_SIM = os.path.join(ROOT, "Sim", "build", "wiseled_sim")
+
+# Holds selftest_corpus, the command set of system/selftest
+SELFTEST_SOURCE = os.path.join(ROOT, "Core", "Src", "app_comms_handler.c")
+
+# Seconds to wait for the serial link and for the firmware to answer
+START_TIMEOUT = 10.0
+BOOT_TIMEOUT = 20.0
+
+# Longest JSON line kept; a longer one is noise
+MAX_LINE = 4096
+
+# Lines of the simulation log that mean the MCU did not run through
+FAILURE_MARKS = ("hard fault", "reset (", "fault in the fault handler")
+
+# smoke: the light set and the duty cycle it must reach, in permille
+SMOKE_LIGHT = 1
+SMOKE_INTENSITY = 40
+
+# bench and fuzz: the link runs at this rate unless --baud says otherwise,
+# so the simulated UART does not bound the figures as much
+FAST_BAUD = 2000000
+
+# Lights of the simulated board
+LIGHTS = 3
+
+
+class Simulation:
+    """The simulation program and its serial link.
+
+    Has what the workloads of benchmark.py use of its Device, so they run
+    on the simulation as they do on a board.
+    """
+
+    def __init__(self, program=DEFAULT_SIM, state_dir=None, env=None, timeout=2.0):
+        self.own_dir = state_dir is None
+        self.state_dir = state_dir or tempfile.mkdtemp(prefix="wiseled_sim.")
+        self.pwm_log = os.path.join(self.state_dir, "pwm.csv")
+        self.log_path = os.path.join(self.state_dir, "sim.log")
+        self.timeout = timeout
+        self.next_id = 0
+        self.events = []
+        self.buffer = b""
+
+        os.makedirs(self.state_dir, exist_ok=True)
+        link = os.path.join(self.state_dir, "uart")
+        environment = dict(os.environ, SIM_STATE_DIR=self.state_dir, SIM_PWM_LOG=self.pwm_log)
+        environment.update(env or {})
+
+        self.log = open(self.log_path, "w")
+        self.process = subprocess.Popen([program], env=environment, stdin=subprocess.PIPE,
+                                        stdout=self.log, stderr=subprocess.STDOUT)
+        deadline = time.monotonic() + START_TIMEOUT
+        while not os.path.exists(link):
+            if self.process.poll() is not None or time.monotonic() > deadline:
+                self.close()
+                raise RuntimeError("simulation did not open its serial link:\n" + self.log_tail())
+            time.sleep(0.05)
+
+        self.link = os.fdopen(os.open(link, os.O_RDWR | os.O_NOCTTY), "r+b", buffering=0)
+        self.fd = self.link.fileno()
+        tty.setraw(self.fd)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def close(self):
+        """End the program; the state directory goes too unless given."""
+        if getattr(self, "link", None) is not None:
+            self.link.close()
+            self.link = None
+        if self.process.poll() is None:
+            try:
+                self.control("quit")
+                self.process.wait(5)
+            except (OSError, subprocess.TimeoutExpired):
+                self.process.kill()
+                self.process.wait()
+        self.log.close()
+        if self.own_dir:
+            shutil.rmtree(self.state_dir, ignore_errors=True)
+
+    def control(self, line):
+        """Send a control command (ambient, short, reset, ...) on stdin."""
+        self.process.stdin.write((line + "\n").encode())
+        self.process.stdin.flush()
+
+    def write(self, data):
+        self.link.write(data)
+
+    def send(self, topic, action, data=None):
+        """Send a command and return its message ID."""
+        self.next_id += 1
+        msg_id = "s%d" % self.next_id
+        cmd = {"type": "cmd", "id": msg_id, "topic": topic, "action": action, "data": data or {}}
+        self.write((json.dumps(cmd, separators=(",", ":")) + "\n").encode())
+        return msg_id
+
+    def command(self, topic, action, data=None, timeout=None):
+        """Send a command and return the data of its response, retrying while busy."""
+        for _ in range(benchmark.BUSY_RETRIES):
+            response = self.wait(self.send(topic, action, data), timeout)
+            if response is None:
+                raise TimeoutError("%s/%s: no response" % (topic, action))
+            if response.get("status") != "busy":
+                break
+            time.sleep(response.get("retry_ms", 0) / 1000.0)
+        return response
+
+    def wait(self, msg_id, timeout=None):
+        """Return the data of the response to msg_id, None on a timeout."""
+        deadline = time.monotonic() + (self.timeout if timeout is None else timeout)
+        while time.monotonic() < deadline:
+            line = self.readline(deadline - time.monotonic())
+            if line is None:
+                continue
+            try:
+                msg = json.loads(line)
+            except ValueError:
+                continue
+            if not isinstance(msg, dict):
+                continue
+            if msg.get("type") == "event":
+                self.events.append(msg)
+            elif msg.get("id") == msg_id:
+                return msg.get("data", {})
+        return None
+
+    def readline(self, timeout):
+        """Return the next line the firmware sent, None on a timeout."""
+        while b"\n" not in self.buffer:
+            ready, _, _ = select.select([self.fd], [], [], max(timeout, 0.0))
+            if not ready:
+                return None
+            self.buffer += os.read(self.fd, 4096)
+            if len(self.buffer) > MAX_LINE and b"\n" not in self.buffer:
+                self.buffer = b""
+        line, _, self.buffer = self.buffer.partition(b"\n")
+        return line
+
+    def drain(self):
+        """Drop what the firmware sent and was not read."""
+        while select.select([self.fd], [], [], 0.05)[0]:
+            os.read(self.fd, 4096)
+        self.buffer = b""
+
+    def resync(self):
+        """End whatever a fuzzed line left half received, JSON or binary."""
+        self.write(b"\n\x00")
+        time.sleep(0.01)
+        self.drain()
+
+    def perf(self, reset=False):
+        """Get the profiler probes by name, optionally clearing them."""
+        data = self.command("system", "perf", {"reset": True} if reset else None)
+        return {probe["name"]: probe for probe in data.get("probes", [])}
+
+    def failures(self):
+        """Lines of the simulation log reporting a fault or a reset."""
+        self.log.flush()
+        with open(self.log_path, errors="replace") as f:
+            return [line.strip() for line in f if any(mark in line for mark in FAILURE_MARKS)]
+
+    def log_tail(self, lines=20):
+        self.log.flush()
+        with open(self.log_path, errors="replace") as f:
+            return "".join(f.readlines()[-lines:])
+
+    def pwm(self, light):
+        """PWM recorder lines of a light, oldest first."""
+        if not os.path.exists(self.pwm_log):
+            return []
+        with open(self.pwm_log) as f:
+            return [row for row in csv.DictReader(f) if row.get("light") == str(light)]
+
+
+def boot(sim):
+    """Wait until the firmware answers system/ping; return the seconds taken."""
+    start = time.monotonic()
+    while time.monotonic() - start < BOOT_TIMEOUT:
+        if sim.process.poll() is not None:
+            raise RuntimeError("simulation ended during start-up")
+        if sim.wait(sim.send("system", "ping"), 0.5) is not None:
+            return time.monotonic() - start
+    raise TimeoutError("no answer to system/ping %.0f s after start" % BOOT_TIMEOUT)
+
+
+def check_ok(data, what):
+    if data.get("status") != "ok":
+        raise RuntimeError("%s failed: %s" % (what, data.get("message", data)))
+
+
+def set_baud(sim, baud):
+    """Switch the serial link to baud and check the firmware answers at it."""
+    sim.send("system", "set_baud", {"baud": baud})
+    time.sleep(0.05)
+    sim.drain()
+    check_ok(sim.command("system", "ping"), "system/ping at %d baud" % baud)
+
+
+def load_selftest_corpus(path=SELFTEST_SOURCE):
+    """Read the command lines of selftest_corpus from the firmware source."""
+    with open(path) as f:
+        match = re.search(r"selftest_corpus\[[^]]*\]\s*=\s*\{(.*?)\};", f.read(), re.S)
+    if not match:
+        raise RuntimeError("no selftest_corpus in %s" % path)
+    # The C escapes used there are JSON's as well
+    lines = [json.loads('"%s"' % literal).rstrip("\n")
+             for literal in re.findall(r'"((?:[^"\\]|\\.)*)"', match.group(1))]
+    if not lines:
+        raise RuntimeError("selftest_corpus in %s is empty" % path)
+    return lines
+
+
+def run_smoke(sim, args):
+    result = {"boot_s": round(boot(sim), 2)}
+    sim.drain()
+
+    start = time.monotonic()
+    check_ok(sim.command("system", "ping"), "system/ping")
+    result["ping_ms"] = round((time.monotonic() - start) * 1000.0, 1)
+
+    permille = SMOKE_INTENSITY * 10
+    check_ok(sim.command("light", "set", {"id": SMOKE_LIGHT, "intensity": SMOKE_INTENSITY}),
+             "light/set")
+    deadline = time.monotonic() + 5.0
+    rows = []
+    while time.monotonic() < deadline:
+        rows = sim.pwm(SMOKE_LIGHT)
+        if rows and int(rows[-1]["permille"]) == permille:
+            break
+        time.sleep(0.1)
+    else:
+        raise RuntimeError("light %d not at %d permille in the PWM log, last %s"
+                           % (SMOKE_LIGHT, permille, rows[-1] if rows else "none"))
+    result["pwm_light"] = SMOKE_LIGHT
+    result["pwm_permille"] = permille
+    result["pwm_compare"] = int(rows[-1]["compare"])
+    result["pwm_period"] = int(rows[-1]["period"])
+    return result
+
+
+def run_bench(sim, args):
+    lines = load_selftest_corpus()
+    boot(sim)
+    sim.drain()
+    set_baud(sim, args.baud)
+
+    result = {"baud": args.baud}
+    result.update(benchmark.bench_selftest(sim))
+    result.update(benchmark.bench_corpus(sim, lines * args.passes))
+    if result["corpus_answered"] != result["corpus_lines"]:
+        raise RuntimeError("%d of %d corpus lines unanswered"
+                           % (result["corpus_lines"] - result["corpus_answered"],
+                              result["corpus_lines"]))
+    return result
+
+
+def run_fuzz(sim, args):
+    lines = load_selftest_corpus()
+    boot(sim)
+    sim.drain()
+    set_baud(sim, args.baud)
+
+    start = time.monotonic()
+    result = {"baud": args.baud}
+    result.update(benchmark.bench_fuzz(sim, lines, args.count, args.seed, LIGHTS))
+    result["fuzz_lines_per_s"] = round(args.count / (time.monotonic() - start), 1)
+    if result["fuzz_hangs"]:
+        raise RuntimeError("no answer to system/link after %d of the checks, first after line %d"
+                           % (len(result["fuzz_hangs"]), result["fuzz_hangs"][0]["line"]))
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--sim", default=DEFAULT_SIM, help="simulation program")
+    parser.add_argument("--keep", help="state directory to use and keep, with the logs")
+    parser.add_argument("--timeout", type=float, default=2.0,
+                        help="seconds to wait for each response")
+    parser.add_argument("--baud", type=int, default=FAST_BAUD,
+                        help="baud rate bench and fuzz switch the link to")
+    parser.add_argument("--passes", type=int, default=100,
+                        help="bench: passes over the self-test commands")
+    parser.add_argument("--count", type=int, default=2000, help="fuzz: damaged lines to send")
+    parser.add_argument("--seed", type=int, default=1, help="fuzz: seed of the damaged lines")
+    parser.add_argument("test", choices=("smoke", "bench", "fuzz"), help="what to run")
+    args = parser.parse_args()
+
+    runs = {"smoke": run_smoke, "bench": run_bench, "fuzz": run_fuzz}
+    with Simulation(args.sim, args.keep, timeout=args.timeout) as sim:
+        try:
+            result = runs[args.test](sim, args)
+        except (RuntimeError, TimeoutError) as e:
+            print("%s: %s\n%s" % (args.test, e, sim.log_tail()), file=sys.stderr)
+            return 1
+        failures = sim.failures()
+        if failures:
+            print("%s: the simulated MCU failed:\n%s" % (args.test, "\n".join(failures)),
+                  file=sys.stderr)
+            return 1
+
+    json.dump(result, sys.stdout, indent=2)
+    print()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Command throughput of the Illuminator firmware with pipelining.
+
+Sends the same command many times through the host client, with 1, 2, 4
+and 8 commands in flight, in JSON and in binary, and reports the commands
+per second and the host round trip of each run as JSON. A depth of 1 is
+the lock-step exchange the other tools use; the gain at larger depths is
+what the link and the device parse loop give when the host does not wait.
+
+    throughput.py --port /dev/ttyACM0
+    throughput.py --port /dev/ttyACM0 --negotiate --count 5000
+    throughput.py --port /dev/ttyUSB0 --address 3 --command light/get --data '{"id":1}'
+
+The binary runs send --body as the command body, hex. Requires pyserial.
+See docs/benchmark.md.
+"""
+
+import argparse
+import json
+import statistics
+import sys
+import time
+
+import illuminator
+
+DEPTHS = (1, 2, 4, 8)
+
+
+def run(dev, depth, count, send):
+    """Send count commands, depth at a time; return the figures of the run."""
+    in_flight = []
+    round_trips = []
+    failed = 0
+
+    def done(future, sent):
+        round_trips.append(time.monotonic() - sent)
+
+    start = time.monotonic()
+    for _ in range(count):
+        if len(in_flight) >= depth:
+            failed += collect(in_flight.pop(0))
+        sent = time.monotonic()
+        future = send()
+        future.add_done_callback(lambda f, sent=sent: done(f, sent))
+        in_flight.append(future)
+    for future in in_flight:
+        failed += collect(future)
+    elapsed = time.monotonic() - start
+
+    round_trips.sort()
+    return {
+        "depth": depth,
+        "commands_per_s": round(count / elapsed, 1),
+        "round_trip_p50_us": round(statistics.median(round_trips) * 1e6) if round_trips else None,
+        "round_trip_max_us": round(round_trips[-1] * 1e6) if round_trips else None,
+        "failed": failed,
+    }
+
+
+def collect(future):
+    """Wait for a response; 1 if it timed out or was refused, else 0."""
+    try:
+        result = future.result()
+    except TimeoutError:
+        return 1
+    if isinstance(result, illuminator.Response):
+        return 0 if result.status == illuminator.VAL_OK else 1
+    return 0 if result is None or result.get("status", "ok") == "ok" else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", required=True, help="serial port of the board")
+    parser.add_argument("--baud", type=int, default=illuminator.DEFAULT_BAUD,
+                        help="baud rate the board is at")
+    parser.add_argument("--negotiate", action="store_true",
+                        help="switch to the fastest rate both sides follow first")
+    parser.add_argument("--address", type=int, help="device address on a shared link")
+    parser.add_argument("--command", default="system/ping", help="topic/action to send")
+    parser.add_argument("--data", default="{}", help="JSON data of the command")
+    parser.add_argument("--body", default="", help="binary body of the command, hex")
+    parser.add_argument("--count", type=int, default=1000, help="commands per run")
+    parser.add_argument("--depths", type=int, nargs="+", default=DEPTHS,
+                        help="commands in flight, one run each")
+    parser.add_argument("--timeout", type=float, default=1.0,
+                        help="seconds to wait for each response")
+    args = parser.parse_args()
+
+    topic, _, action = args.command.partition("/")
+    data = json.loads(args.data)
+    body = bytes.fromhex(args.body)
+
+    with illuminator.Link(args.port, args.baud, args.timeout, max(args.depths)) as link:
+        if args.negotiate:
+            link.negotiate_baud()
+        dev = link.device(args.address)
+
+        formats = {"json": lambda: dev.request(topic, action, data)}
+        if (topic, action) in link.protocol.codes:
+            formats["binary"] = lambda: dev.request_binary(topic, action, body)
+
+        result = {"command": args.command, "baud": link.serial.baudrate, "count": args.count}
+        for name, send in formats.items():
+            result[name] = [run(dev, depth, args.count, send) for depth in args.depths]
+            link.drain()
+
+    json.dump(result, sys.stdout, indent=2)
+    print()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""Firmware update over the host link for the Illuminator firmware.
+
+Sends system/update with the size and CRC-32 of a raw binary image, then
+streams the image to the device's resident boot loader in binary
+update/write frames and finishes with update/finish, after which the device
+resets into the new firmware. The image is the .bin file of a build, linked
+at the start of the flash. A device whose firmware does not answer is taken
+to be waiting in the boot loader after an interrupted update; it gets the
+image at the default baud rate.
+
+    update.py --port /dev/ttyACM0 Release/Wiseled_LBR_Illuminator.bin
+    update.py --port /dev/ttyACM0 --baud 1000000 Release/Wiseled_LBR_Illuminator.bin
+    update.py --port /dev/ttyUSB0 --address 3 Release/Wiseled_LBR_Illuminator.bin
+
+Requires pyserial. The protocol is described in app_comms_binary.h.
+"""
+
+import argparse
+import struct
+import sys
+import time
+import zlib
+
+import illuminator
+from illuminator import DEFAULT_BAUD, VAL_ERROR, VAL_OK, status_name
+
+
+def request(dev, action, body, timeout):
+    """Send an updater command frame; return (status, next) or None."""
+    try:
+        resp = dev.command_binary("update", action, body, timeout)
+    except TimeoutError:
+        return None
+    if len(resp.body) < 4:
+        return None
+    return resp.status, struct.unpack("<I", resp.body[:4])[0]
+
+
+def firmware_answers(dev, timeout):
+    """Return whether the firmware answers a ping; the boot loader does not."""
+    try:
+        dev.command("system", "ping", timeout=timeout)
+    except TimeoutError:
+        return False
+    return True
+
+
+def send_image(dev, image, chunk, retries, timeout):
+    """Stream the image from the offset the updater expects until it is all in."""
+    offset = 0
+    while offset < len(image):
+        body = struct.pack("<I", offset) + image[offset:offset + chunk]
+        for _ in range(retries):
+            # Erasing a page before programming takes up to 25 ms
+            result = request(dev, "write", body, timeout)
+            if result is not None:
+                break
+        else:
+            raise TimeoutError("update/write at %d: no response" % offset)
+
+        status, expected = result
+        if status == VAL_OK:
+            offset = max(offset + len(body) - 4, expected)
+        elif status == VAL_ERROR and expected == 0:
+            print("flash error at %d, starting again" % offset, file=sys.stderr)
+            offset = 0
+        elif expected != offset:
+            # Out of step with the updater, go on from where it is
+            offset = expected
+        else:
+            raise RuntimeError("update/write at %d: %s" % (offset, status_name(status)))
+
+        sys.stderr.write("\r%d/%d bytes" % (min(offset, len(image)), len(image)))
+    sys.stderr.write("\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("image", help="raw binary image (.bin)")
+    parser.add_argument("--port", required=True, help="serial port of the board")
+    parser.add_argument("--baud", type=int, default=DEFAULT_BAUD,
+                        help="baud rate to switch to first with system/set_baud")
+    parser.add_argument("--address", type=int,
+                        help="device address on a shared link")
+    parser.add_argument("--timeout", type=float, default=1.0,
+                        help="seconds to wait for each response")
+    parser.add_argument("--retries", type=int, default=5,
+                        help="attempts per frame before giving up")
+    parser.add_argument("--attempts", type=int, default=3,
+                        help="times the whole image is sent after a failed check")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    link = illuminator.Link(args.port, DEFAULT_BAUD, args.timeout, window=1)
+    dev = link.device(args.address)
+    if not firmware_answers(dev, args.timeout):
+        print("no answer from the firmware, trying the boot loader at %d baud" % DEFAULT_BAUD,
+              file=sys.stderr)
+    elif args.baud != DEFAULT_BAUD and link.negotiate_baud((args.baud,), device=dev) != args.baud:
+        raise RuntimeError("system/set_baud: %d baud not confirmed" % args.baud)
+
+    # The firmware answers and resets into the boot loader, or the boot
+    # loader answers itself; both give the chunk size
+    crc = zlib.crc32(image) & 0xFFFFFFFF
+    try:
+        resp = dev.command_binary("system", "update", struct.pack("<II", len(image), crc), args.timeout)
+    except TimeoutError:
+        raise TimeoutError("system/update: no response") from None
+    if resp.status != VAL_OK or len(resp.body) < 6:
+        raise RuntimeError("system/update failed: %s" % status_name(resp.status))
+    chunk = struct.unpack("<IH", resp.body[:6])[1]
+
+    start = time.monotonic()
+    for _ in range(args.attempts):
+        send_image(dev, image, chunk, args.retries, args.timeout)
+        for _ in range(args.retries):
+            # The CRC check reads the whole image back
+            result = request(dev, "finish", b"", args.timeout)
+            if result is not None:
+                break
+        else:
+            raise TimeoutError("update/finish: no response")
+
+        status, expected = result
+        if status == VAL_OK:
+            print("updated %d bytes in %.1f s, device restarting at %d baud"
+                  % (len(image), time.monotonic() - start, DEFAULT_BAUD))
+            return 0
+        if status != VAL_ERROR or expected != 0:
+            raise RuntimeError("update/finish: %s" % status_name(status))
+        print("CRC mismatch, sending the image again", file=sys.stderr)
+
+    raise RuntimeError("update/finish: CRC mismatch after %d attempts" % args.attempts)
+
+
+if __name__ == "__main__":
+    sys.exit(main())